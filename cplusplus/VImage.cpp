@@ -6,6 +6,11 @@
  * 	- missing implementation of VImage::write()
  * 11/6/16
  * 	- added arithmetic assignment overloads, += etc.
+ * 14/10/26
+ * 	- keep the first few options inside VOption
+ * 	- add pointer and length array setters, take vectors by reference
+ * 15/10/26
+ * 	- add VOperationType, set args by cached pspec
  */
 
 /*
@@ -39,6 +44,8 @@
 #include <config.h>
 #endif /*HAVE_CONFIG_H*/
 
+#include <algorithm>
+
 #include <vips/vips8>
 
 #include <vips/debug.h>
@@ -109,6 +116,50 @@ invert(std::vector<double> vector)
 	return new_vector;
 }
 
+static bool
+pspec_less(const GParamSpec *a, const GParamSpec *b)
+{
+	return strcmp(a->name, b->name) < 0;
+}
+
+VOperationType::VOperationType(const char *nickname)
+	: nickname(nickname), type(vips_type_find("VipsOperation", nickname))
+{
+	if (type &&
+		G_TYPE_IS_ABSTRACT(type))
+		type = 0;
+
+	if (type) {
+		// we keep this class ref forever, like the GType itself
+		GObjectClass *object_class =
+			G_OBJECT_CLASS(g_type_class_ref(type));
+
+		guint n_pspecs;
+		GParamSpec **all =
+			g_object_class_list_properties(object_class, &n_pspecs);
+
+		pspecs.assign(all, all + n_pspecs);
+		g_free(all);
+
+		std::sort(pspecs.begin(), pspecs.end(), pspec_less);
+	}
+}
+
+GParamSpec *
+VOperationType::find_pspec(const char *name) const
+{
+	auto i = std::lower_bound(pspecs.begin(), pspecs.end(), name,
+		[](const GParamSpec *pspec, const char *name) {
+			return strcmp(pspec->name, name) < 0;
+		});
+
+	if (i == pspecs.end() ||
+		strcmp((*i)->name, name) != 0)
+		return nullptr;
+
+	return *i;
+}
+
 VOption::~VOption()
 {
 	std::list<Pair *>::iterator i;
@@ -117,17 +168,33 @@ VOption::~VOption()
 		delete *i;
 }
 
+// a new pair, inline if there's room
+VOption::Pair *
+VOption::new_pair(const char *name)
+{
+	Pair *pair;
+
+	if (n_inline < N_INLINE) {
+		pair = &inline_options[n_inline++];
+		pair->name = name;
+	}
+	else {
+		pair = new Pair(name);
+		options.push_back(pair);
+	}
+
+	return pair;
+}
+
 // input bool
 VOption *
 VOption::set(const char *name, bool value)
 {
-	Pair *pair = new Pair(name);
+	Pair *pair = new_pair(name);
 
 	pair->input = true;
 	g_value_init(&pair->value, G_TYPE_BOOLEAN);
 	g_value_set_boolean(&pair->value, value);
-	options.push_back(pair);
-
 	return this;
 }
 
@@ -135,13 +202,11 @@ VOption::set(const char *name, bool value)
 VOption *
 VOption::set(const char *name, int value)
 {
-	Pair *pair = new Pair(name);
+	Pair *pair = new_pair(name);
 
 	pair->input = true;
 	g_value_init(&pair->value, G_TYPE_INT);
 	g_value_set_int(&pair->value, value);
-	options.push_back(pair);
-
 	return this;
 }
 
@@ -149,13 +214,11 @@ VOption::set(const char *name, int value)
 VOption *
 VOption::set(const char *name, guint64 value)
 {
-	Pair *pair = new Pair(name);
+	Pair *pair = new_pair(name);
 
 	pair->input = true;
 	g_value_init(&pair->value, G_TYPE_UINT64);
 	g_value_set_uint64(&pair->value, value);
-	options.push_back(pair);
-
 	return this;
 }
 
@@ -163,26 +226,22 @@ VOption::set(const char *name, guint64 value)
 VOption *
 VOption::set(const char *name, double value)
 {
-	Pair *pair = new Pair(name);
+	Pair *pair = new_pair(name);
 
 	pair->input = true;
 	g_value_init(&pair->value, G_TYPE_DOUBLE);
 	g_value_set_double(&pair->value, value);
-	options.push_back(pair);
-
 	return this;
 }
 
 VOption *
 VOption::set(const char *name, const char *value)
 {
-	Pair *pair = new Pair(name);
+	Pair *pair = new_pair(name);
 
 	pair->input = true;
 	g_value_init(&pair->value, G_TYPE_STRING);
 	g_value_set_string(&pair->value, value);
-	options.push_back(pair);
-
 	return this;
 }
 
@@ -190,69 +249,61 @@ VOption::set(const char *name, const char *value)
 VOption *
 VOption::set(const char *name, const VObject value)
 {
-	Pair *pair = new Pair(name);
+	Pair *pair = new_pair(name);
 	VipsObject *object = value.get_object();
 	GType type = G_OBJECT_TYPE(object);
 
 	pair->input = true;
 	g_value_init(&pair->value, type);
 	g_value_set_object(&pair->value, object);
-	options.push_back(pair);
-
 	return this;
 }
 
 // input int array
 VOption *
-VOption::set(const char *name, std::vector<int> value)
+VOption::set(const char *name, const std::vector<int> &value)
 {
-	Pair *pair = new Pair(name);
+	return set(name, value.data(), static_cast<int>(value.size()));
+}
 
-	int *array;
+VOption *
+VOption::set(const char *name, const int *value, int n)
+{
+	Pair *pair = new_pair(name);
 
 	pair->input = true;
 
 	g_value_init(&pair->value, VIPS_TYPE_ARRAY_INT);
-	vips_value_set_array_int(&pair->value, nullptr,
-		static_cast<int>(value.size()));
-	array = vips_value_get_array_int(&pair->value, nullptr);
-
-	for (std::vector<double>::size_type i = 0; i < value.size(); i++)
-		array[i] = value[i];
-
-	options.push_back(pair);
+	vips_value_set_array_int(&pair->value, value, n);
 
 	return this;
 }
 
 // input double array
 VOption *
-VOption::set(const char *name, std::vector<double> value)
+VOption::set(const char *name, const std::vector<double> &value)
 {
-	Pair *pair = new Pair(name);
+	return set(name, value.data(), static_cast<int>(value.size()));
+}
 
-	double *array;
+VOption *
+VOption::set(const char *name, const double *value, int n)
+{
+	Pair *pair = new_pair(name);
 
 	pair->input = true;
 
 	g_value_init(&pair->value, VIPS_TYPE_ARRAY_DOUBLE);
-	vips_value_set_array_double(&pair->value, nullptr,
-		static_cast<int>(value.size()));
-	array = vips_value_get_array_double(&pair->value, nullptr);
-
-	for (std::vector<double>::size_type i = 0; i < value.size(); i++)
-		array[i] = value[i];
-
-	options.push_back(pair);
+	vips_value_set_array_double(&pair->value, value, n);
 
 	return this;
 }
 
 // input image array
 VOption *
-VOption::set(const char *name, std::vector<VImage> value)
+VOption::set(const char *name, const std::vector<VImage> &value)
 {
-	Pair *pair = new Pair(name);
+	Pair *pair = new_pair(name);
 
 	VipsImage **array;
 
@@ -270,8 +321,6 @@ VOption::set(const char *name, std::vector<VImage> value)
 		g_object_ref(vips_image);
 	}
 
-	options.push_back(pair);
-
 	return this;
 }
 
@@ -279,13 +328,11 @@ VOption::set(const char *name, std::vector<VImage> value)
 VOption *
 VOption::set(const char *name, VipsBlob *value)
 {
-	Pair *pair = new Pair(name);
+	Pair *pair = new_pair(name);
 
 	pair->input = true;
 	g_value_init(&pair->value, VIPS_TYPE_BLOB);
 	g_value_set_boxed(&pair->value, value);
-	options.push_back(pair);
-
 	return this;
 }
 
@@ -293,14 +340,12 @@ VOption::set(const char *name, VipsBlob *value)
 VOption *
 VOption::set(const char *name, bool *value)
 {
-	Pair *pair = new Pair(name);
+	Pair *pair = new_pair(name);
 
 	pair->input = false;
 	pair->vbool = value;
 	g_value_init(&pair->value, G_TYPE_BOOLEAN);
 
-	options.push_back(pair);
-
 	return this;
 }
 
@@ -308,14 +353,12 @@ VOption::set(const char *name, bool *value)
 VOption *
 VOption::set(const char *name, int *value)
 {
-	Pair *pair = new Pair(name);
+	Pair *pair = new_pair(name);
 
 	pair->input = false;
 	pair->vint = value;
 	g_value_init(&pair->value, G_TYPE_INT);
 
-	options.push_back(pair);
-
 	return this;
 }
 
@@ -323,14 +366,12 @@ VOption::set(const char *name, int *value)
 VOption *
 VOption::set(const char *name, double *value)
 {
-	Pair *pair = new Pair(name);
+	Pair *pair = new_pair(name);
 
 	pair->input = false;
 	pair->vdouble = value;
 	g_value_init(&pair->value, G_TYPE_DOUBLE);
 
-	options.push_back(pair);
-
 	return this;
 }
 
@@ -338,14 +379,12 @@ VOption::set(const char *name, double *value)
 VOption *
 VOption::set(const char *name, VImage *value)
 {
-	Pair *pair = new Pair(name);
+	Pair *pair = new_pair(name);
 
 	pair->input = false;
 	pair->vimage = value;
 	g_value_init(&pair->value, VIPS_TYPE_IMAGE);
 
-	options.push_back(pair);
-
 	return this;
 }
 
@@ -353,14 +392,12 @@ VOption::set(const char *name, VImage *value)
 VOption *
 VOption::set(const char *name, std::vector<double> *value)
 {
-	Pair *pair = new Pair(name);
+	Pair *pair = new_pair(name);
 
 	pair->input = false;
 	pair->vvector = value;
 	g_value_init(&pair->value, VIPS_TYPE_ARRAY_DOUBLE);
 
-	options.push_back(pair);
-
 	return this;
 }
 
@@ -368,29 +405,29 @@ VOption::set(const char *name, std::vector<double> *value)
 VOption *
 VOption::set(const char *name, VipsBlob **value)
 {
-	Pair *pair = new Pair(name);
+	Pair *pair = new_pair(name);
 
 	pair->input = false;
 	pair->vblob = value;
 	g_value_init(&pair->value, VIPS_TYPE_BLOB);
 
-	options.push_back(pair);
-
 	return this;
 }
 
-// just g_object_set_property(), except we allow set enum from string
+// just g_object_set_property(), except we allow set enum from string, and
+// skip the name lookup if we have a pspec already
 static void
-set_property(VipsObject *object, const char *name, const GValue *value)
+set_property(VipsObject *object,
+	const char *name, GParamSpec *pspec, GValue *value)
 {
 	VipsObjectClass *object_class = VIPS_OBJECT_GET_CLASS(object);
 	GType type = G_VALUE_TYPE(value);
 
-	GParamSpec *pspec;
 	VipsArgumentClass *argument_class;
 	VipsArgumentInstance *argument_instance;
 
-	if (vips_object_get_argument(object, name,
+	if (!pspec &&
+		vips_object_get_argument(object, name,
 			&pspec, &argument_class, &argument_instance)) {
 		g_warning("%s", vips_error_buffer());
 		vips_error_clear();
@@ -416,93 +453,122 @@ set_property(VipsObject *object, const char *name, const GValue *value)
 		g_object_set_property(G_OBJECT(object), name, &value2);
 		g_value_unset(&value2);
 	}
+	else if (g_value_type_compatible(type,
+				 G_PARAM_SPEC_VALUE_TYPE(pspec))) {
+		// the checks g_object_set_property() would make, then straight
+		// to the class that owns the property
+		GObjectClass *owner_class =
+			G_OBJECT_CLASS(g_type_class_peek(pspec->owner_type));
+
+		if (g_param_value_validate(pspec, value)) {
+			g_warning("value for property '%s' of type '%s' is invalid "
+					  "or out of range",
+				name, G_OBJECT_TYPE_NAME(object));
+			return;
+		}
+
+		owner_class->set_property(G_OBJECT(object),
+			pspec->param_id, value, pspec);
+	}
 	else
+		// needs a transform, eg. int to double
 		g_object_set_property(G_OBJECT(object), name, value);
 }
 
 // walk the options and set props on the operation
 void
-VOption::set_operation(VipsOperation *operation)
+VOption::set_operation(VipsOperation *operation, const VOperationType *type)
 {
-	std::list<Pair *>::iterator i;
-
-	for (i = options.begin(); i != options.end(); ++i)
-		if ((*i)->input) {
+	auto set_pair = [operation, type](Pair *pair) {
+		if (pair->input) {
 #ifdef VIPS_DEBUG_VERBOSE
 			printf("set_operation: ");
 			vips_object_print_name(VIPS_OBJECT(operation));
-			char *str_value = g_strdup_value_contents(&(*i)->value);
-			printf(".%s = %s\n", (*i)->name, str_value);
+			char *str_value = g_strdup_value_contents(&pair->value);
+			printf(".%s = %s\n", pair->name, str_value);
 			g_free(str_value);
 #endif /*VIPS_DEBUG_VERBOSE*/
 
 			set_property(VIPS_OBJECT(operation),
-				(*i)->name, &(*i)->value);
+				pair->name,
+				type ? type->find_pspec(pair->name) : nullptr,
+				&pair->value);
 		}
+	};
+
+	for (int i = 0; i < n_inline; i++)
+		set_pair(&inline_options[i]);
+	for (Pair *pair : options)
+		set_pair(pair);
+}
+
+void
+VOption::set_operation(VipsOperation *operation)
+{
+	set_operation(operation, nullptr);
+}
+
+void
+VOption::set_operation(VipsOperation *operation, const VOperationType &type)
+{
+	set_operation(operation, &type);
 }
 
 // walk the options and fetch any requested outputs
 void
 VOption::get_operation(VipsOperation *operation)
 {
-	std::list<Pair *>::iterator i;
+	auto get_pair = [operation](Pair *pair) {
+		if (!pair->input) {
+			const char *name = pair->name;
 
-	for (i = options.begin(); i != options.end(); ++i)
-		if (!(*i)->input) {
-			const char *name = (*i)->name;
-
-			g_object_get_property(G_OBJECT(operation), name, &(*i)->value);
+			g_object_get_property(G_OBJECT(operation), name, &pair->value);
 
 #ifdef VIPS_DEBUG_VERBOSE
 			printf("get_operation: ");
 			vips_object_print_name(VIPS_OBJECT(operation));
-			char *str_value = g_strdup_value_contents(&(*i)->value);
+			char *str_value = g_strdup_value_contents(&pair->value);
 			printf(".%s = %s\n", name, str_value);
 			g_free(str_value);
 #endif /*VIPS_DEBUG_VERBOSE*/
 
-			GValue *value = &(*i)->value;
+			GValue *value = &pair->value;
 			GType type = G_VALUE_TYPE(value);
 
 			if (type == VIPS_TYPE_IMAGE) {
 				// rebox object
 				VipsImage *image = VIPS_IMAGE(g_value_get_object(value));
-				*((*i)->vimage) = VImage(image, NOSTEAL);
+				*(pair->vimage) = VImage(image, NOSTEAL);
 			}
 			else if (type == G_TYPE_INT)
-				*((*i)->vint) = g_value_get_int(value);
+				*(pair->vint) = g_value_get_int(value);
 			else if (type == G_TYPE_BOOLEAN)
-				*((*i)->vbool) = g_value_get_boolean(value);
+				*(pair->vbool) = g_value_get_boolean(value);
 			else if (type == G_TYPE_DOUBLE)
-				*((*i)->vdouble) = g_value_get_double(value);
+				*(pair->vdouble) = g_value_get_double(value);
 			else if (type == VIPS_TYPE_ARRAY_DOUBLE) {
 				int length;
 				double *array = vips_value_get_array_double(value, &length);
 
-				((*i)->vvector)->resize(length);
-				for (int j = 0; j < length; j++)
-					(*((*i)->vvector))[j] = array[j];
+				pair->vvector->assign(array, array + length);
 			}
 			else if (type == VIPS_TYPE_BLOB)
 				// our caller gets a reference
-				*((*i)->vblob) = (VipsBlob *) g_value_dup_boxed(value);
+				*(pair->vblob) = (VipsBlob *) g_value_dup_boxed(value);
 		}
+	};
+
+	for (int i = 0; i < n_inline; i++)
+		get_pair(&inline_options[i]);
+	for (Pair *pair : options)
+		get_pair(pair);
 }
 
-void
-VImage::call_option_string(const char *operation_name,
+// run a new operation, consuming the ref and the options
+static void
+call_operation(VipsOperation *operation, const VOperationType *type,
 	const char *option_string, VOption *options)
 {
-	VipsOperation *operation;
-
-	VIPS_DEBUG_MSG("call_option_string: starting for %s ...\n",
-		operation_name);
-
-	if (!(operation = vips_operation_new(operation_name))) {
-		delete options;
-		throw(VError());
-	}
-
 	/* Set str options before vargs options, so the user can't
 	 * override things we set deliberately.
 	 */
@@ -514,8 +580,12 @@ VImage::call_option_string(const char *operation_name,
 		throw(VError());
 	}
 
-	if (options)
-		options->set_operation(operation);
+	if (options) {
+		if (type)
+			options->set_operation(operation, *type);
+		else
+			options->set_operation(operation);
+	}
 
 	/* Build from cache.
 	 */
@@ -546,12 +616,47 @@ VImage::call_option_string(const char *operation_name,
 	delete options;
 }
 
+void
+VImage::call_option_string(const char *operation_name,
+	const char *option_string, VOption *options)
+{
+	VipsOperation *operation;
+
+	VIPS_DEBUG_MSG("call_option_string: starting for %s ...\n",
+		operation_name);
+
+	if (!(operation = vips_operation_new(operation_name))) {
+		delete options;
+		throw(VError());
+	}
+
+	call_operation(operation, nullptr, option_string, options);
+}
+
 void
 VImage::call(const char *operation_name, VOption *options)
 {
 	call_option_string(operation_name, nullptr, options);
 }
 
+void
+VImage::call(const VOperationType &type, VOption *options)
+{
+	VipsOperation *operation;
+
+	VIPS_DEBUG_MSG("call: starting for %s ...\n", type.get_nickname());
+
+	// not found ... take the slow path for the error message
+	if (!type.get_type()) {
+		call(type.get_nickname(), options);
+		return;
+	}
+
+	operation = VIPS_OPERATION(g_object_new(type.get_type(), nullptr));
+
+	call_operation(operation, &type, nullptr, options);
+}
+
 VImage
 VImage::new_from_file(const char *name, VOption *options)
 {
@@ -0,0 +1,52 @@
+/*
+ * compile with:
+ *
+ *      g++ -g -Wall tilesum.cpp `pkg-config vips-cpp --cflags --libs`
+ *
+ * Sum each band of a uchar image with VImage::reduce_tiles().
+ */
+
+#include <vector>
+
+#include <vips/vips8>
+
+using namespace vips;
+
+int
+main(int argc, char **argv)
+{
+	if (vips_init(argv[0]))
+		vips_error_exit(NULL);
+
+	VImage in = VImage::new_from_file(argv[1],
+		VImage::option()->set("access", VIPS_ACCESS_SEQUENTIAL))
+					.cast(VIPS_FORMAT_UCHAR);
+	int bands = in.bands();
+
+	std::vector<double> sum = in.reduce_tiles(
+		std::vector<double>(bands, 0.0),
+		[bands](std::vector<double> &acc, const VRegion &region) {
+			VipsRect r = region.valid();
+
+			for (int y = 0; y < r.height; y++) {
+				VipsPel *p = region.addr(r.left, r.top + y);
+
+				for (int x = 0; x < r.width; x++)
+					for (int b = 0; b < bands; b++)
+						acc[b] += *p++;
+			}
+		},
+		[bands](std::vector<double> &total,
+			const std::vector<double> &acc) {
+			for (int b = 0; b < bands; b++)
+				total[b] += acc[b];
+		});
+
+	for (int b = 0; b < bands; b++)
+		printf("band %d: sum = %g, avg = %g\n",
+			b, sum[b], sum[b] / ((double) in.width() * in.height()));
+
+	vips_shutdown();
+
+	return 0;
+}
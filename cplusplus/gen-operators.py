@@ -17,9 +17,10 @@
 # VImage
 # VImage::invert(VOption *options) const
 # {
-#   VImage out;
+# 	static const VOperationType operation_type("invert");
+# 	VImage out;
 #
-# 	call("invert", (options ? options : VImage::option())
+# 	call(operation_type, (options ? options : VImage::option())
 # 				->set("in", *this)
 # 				->set("out", &out));
 #
@@ -199,14 +200,18 @@ def generate_operation(operation_name, declaration_only=False, indent=''):
 
     result += '\n{\n'
 
+    # look the operation up once, on first call
+    result += f'\tstatic const VOperationType operation_type("{operation_name}");\n'
+
     if has_output:
         # the first output arg will be used as the result
         name = required_output[0]
         cpp_type = get_cpp_type(intro.details[name]['type'])
         spacing = '' if cpp_type.endswith(cplusplus_suffixes) else ' '
-        result += f'\t{cpp_type}{spacing}{cppize(name)};\n\n'
+        result += f'\t{cpp_type}{spacing}{cppize(name)};\n'
 
-    result += f'\tcall("{operation_name}", (options ? options : VImage::option())'
+    result += '\n'
+    result += f'\tcall(operation_type, (options ? options : VImage::option())'
     if intro.member_x is not None:
         result += f'\n\t\t\t->set("{intro.member_x}", *this)'
 
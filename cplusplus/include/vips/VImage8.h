@@ -32,6 +32,7 @@
 
 #include <list>
 #include <complex>
+#include <utility>
 #include <vector>
 
 #include <cstring>
@@ -119,6 +120,12 @@ public:
 			g_object_ref(vobject);
 	}
 
+	// move ... take over the ref, no need to touch the refcount
+	VObject(VObject &&a) noexcept : vobject(a.vobject)
+	{
+		a.vobject = nullptr;
+	}
+
 	// assignment ... we must delete the old ref
 	VObject &
 	operator=(const VObject &a)
@@ -145,6 +152,15 @@ public:
 		return *this;
 	}
 
+	// move assignment ... swap, so the old ref goes when a is destroyed
+	VObject &
+	operator=(VObject &&a) noexcept
+	{
+		std::swap(vobject, a.vobject);
+
+		return *this;
+	}
+
 	// this mustn't be virtual: we want this class to only be a pointer,
 	// no vtable allowed
 	~VObject()
@@ -191,6 +207,65 @@ class VIPS_CPLUSPLUS_API VRegion;
 class VIPS_CPLUSPLUS_API VSource;
 class VIPS_CPLUSPLUS_API VTarget;
 class VIPS_CPLUSPLUS_API VOption;
+class VIPS_CPLUSPLUS_API VOperationType;
+
+/**
+ * A libvips operation class, looked up once.
+ *
+ * This holds the GType for an operation nickname and the GParamSpec for
+ * each of its arguments. The generated operator wrappers keep one of
+ * these in a function-local static, so calls after the first skip the
+ * nickname search and set arguments by pspec rather than by name.
+ *
+ *     static const VOperationType type("embed");
+ *
+ *     VImage::call(type, VImage::option()->set("in", in) ...);
+ */
+class VOperationType {
+private:
+	const char *nickname;
+	GType type;
+
+	// the pspecs of all arguments, sorted by name
+	std::vector<GParamSpec *> pspecs;
+
+public:
+	/**
+	 * Look up the operation with this nickname. If there is no such
+	 * operation, calls through this type fall back to a lookup by name,
+	 * so the usual error is raised then.
+	 */
+	explicit VOperationType(const char *nickname);
+
+	VOperationType(const VOperationType &) = delete;
+	VOperationType &
+	operator=(const VOperationType &) = delete;
+
+	/**
+	 * The nickname this type was made from.
+	 */
+	const char *
+	get_nickname() const
+	{
+		return nickname;
+	}
+
+	/**
+	 * The GType of the operation, or 0 if it was not found.
+	 */
+	GType
+	get_type() const
+	{
+		return type;
+	}
+
+	/**
+	 * The GParamSpec of the named argument, or nullptr if there's no
+	 * such argument.
+	 */
+	GParamSpec *
+	find_pspec(const char *name) const;
+};
 
 /**
  * A list of name-value pairs. Pass these to libvips operations to set
@@ -235,6 +310,11 @@ private:
 			VipsBlob **vblob;
 		};
 
+		Pair() : name(nullptr), value(G_VALUE_INIT),
+				 input(false), vimage(nullptr)
+		{
+		}
+
 		explicit Pair(const char *name) : name(name), value(G_VALUE_INIT),
 										  input(false), vimage(nullptr)
 		{
@@ -242,15 +322,33 @@ private:
 
 		~Pair()
 		{
-			g_value_unset(&value);
+			// unused inline pairs were never initialised
+			if (G_IS_VALUE(&value))
+				g_value_unset(&value);
 		}
 	};
 
+	// most calls only set a few options, so the first few pairs live
+	// inside the VOption and only the rest need to be allocated
+	enum { N_INLINE = 8 };
+	Pair inline_options[N_INLINE];
+	int n_inline = 0;
 	std::list<Pair *> options;
 
+	Pair *
+	new_pair(const char *name);
+
+	void
+	set_operation(VipsOperation *operation, const VOperationType *type);
+
 public:
 	VOption() = default;
 
+	// pairs hold GValues and output pointers, so copying is never safe
+	VOption(const VOption &) = delete;
+	VOption &
+	operator=(const VOption &) = delete;
+
 	virtual ~VOption();
 
 	/**
@@ -301,7 +399,16 @@ public:
 	 * A copy is taken of the object.
 	 */
 	VOption *
-	set(const char *name, std::vector<int> value);
+	set(const char *name, const std::vector<int> &value);
+
+	/**
+	 * Set an array of integers as an input option, without making a
+	 * std::vector first.
+	 *
+	 * A copy is taken of the array.
+	 */
+	VOption *
+	set(const char *name, const int *value, int n);
 
 	/**
 	 * Set an array of doubles as an input option.
@@ -309,7 +416,16 @@ public:
 	 * A copy is taken of the object.
 	 */
 	VOption *
-	set(const char *name, std::vector<double> value);
+	set(const char *name, const std::vector<double> &value);
+
+	/**
+	 * Set an array of doubles as an input option, without making a
+	 * std::vector first.
+	 *
+	 * A copy is taken of the array.
+	 */
+	VOption *
+	set(const char *name, const double *value, int n);
 
 	/**
 	 * Set an array of images as an input option.
@@ -317,7 +433,7 @@ public:
 	 * A copy is taken of the object.
 	 */
 	VOption *
-	set(const char *name, std::vector<VImage> value);
+	set(const char *name, const std::vector<VImage> &value);
 
 	/**
 	 * Set a binary object an input option. Use vips_blob_new() to make
@@ -372,6 +488,13 @@ public:
 	void
 	set_operation(VipsOperation *operation);
 
+	/**
+	 * As set_operation(), but find arguments with the pspecs cached in the
+	 * operation type.
+	 */
+	void
+	set_operation(VipsOperation *operation, const VOperationType &type);
+
 	/**
 	 * Walk the set of options, fetching any output values. This is used
 	 * internally by VImage::call().
@@ -876,6 +999,13 @@ public:
 	static void
 	call(const char *operation_name, VOption *options = nullptr);
 
+	/**
+	 * Call a libvips operation you have already looked up. This is
+	 * what the generated operator wrappers use.
+	 */
+	static void
+	call(const VOperationType &type, VOption *options = nullptr);
+
 	/**
 	 * Make a new image which, when written to, will create a large memory
 	 * object. See VImage::write().
@@ -1138,6 +1268,52 @@ public:
 	VRegion
 	region(int left, int top, int width, int height) const;
 
+	/**
+	 * Compute the image and call @fn on every tile, in parallel on the
+	 * vips worker threads. @fn is called as:
+	 *
+	 *     fn(const VRegion &region)
+	 *
+	 * with a region that has just been prepared on a tile. Use
+	 * region.valid() to find the tile position and region.addr() and
+	 * region.stride() to read pixels in place. @fn must be safe to call
+	 * from several threads at once.
+	 *
+	 * Tiles are @tile_width by @tile_height pixels (less at the image
+	 * edges), or a size picked by libvips if these are zero.
+	 *
+	 * Exceptions thrown by @fn stop the scan and are rethrown here.
+	 */
+	template <typename Fn>
+	void
+	for_each_tile(Fn fn, int tile_width = 0, int tile_height = 0) const;
+
+	/**
+	 * Compute the image and reduce it to a value of type T, in parallel
+	 * on the vips worker threads.
+	 *
+	 * Each worker starts with a copy of @init, and calls:
+	 *
+	 *     fn(T &acc, const VRegion &region)
+	 *
+	 * for each tile it computes, folding the tile into its private
+	 * accumulator without any locking. When a worker finishes, its
+	 * accumulator is merged into the result with:
+	 *
+	 *     merge(T &total, const T &acc)
+	 *
+	 * Merges happen one at a time. The result also starts as a copy of
+	 * @init, so @init should be an identity for @merge, eg. zero for a
+	 * sum.
+	 *
+	 * Tiles are sized as for for_each_tile(). Exceptions thrown by @fn
+	 * or @merge stop the scan and are rethrown here.
+	 */
+	template <typename T, typename Fn, typename Merge>
+	T
+	reduce_tiles(const T &init, Fn fn, Merge merge,
+		int tile_width = 0, int tile_height = 0) const;
+
 	/**
 	 * Apply a linear transform to an image. For every pixel,
 	 *
@@ -3385,6 +3561,7 @@ public:
 	 *   - **interpalette_maxerror** -- Maximum inter-palette error for palette reusage, double.
 	 *   - **interlace** -- Generate an interlaced (progressive) GIF, bool.
 	 *   - **keep_duplicate_frames** -- Keep duplicate frames in the output instead of combining them, bool.
+	 *   - **global_palette** -- Map all frames to one palette made from a sample of frames, bool.
 	 *   - **keep** -- Which metadata to retain, VipsForeignKeep.
 	 *   - **background** -- Background value, std::vector<double>.
 	 *   - **page_height** -- Set page height for multipage save, int.
@@ -3407,6 +3584,7 @@ public:
 	 *   - **interpalette_maxerror** -- Maximum inter-palette error for palette reusage, double.
 	 *   - **interlace** -- Generate an interlaced (progressive) GIF, bool.
 	 *   - **keep_duplicate_frames** -- Keep duplicate frames in the output instead of combining them, bool.
+	 *   - **global_palette** -- Map all frames to one palette made from a sample of frames, bool.
 	 *   - **keep** -- Which metadata to retain, VipsForeignKeep.
 	 *   - **background** -- Background value, std::vector<double>.
 	 *   - **page_height** -- Set page height for multipage save, int.
@@ -3429,6 +3607,7 @@ public:
 	 *   - **interpalette_maxerror** -- Maximum inter-palette error for palette reusage, double.
 	 *   - **interlace** -- Generate an interlaced (progressive) GIF, bool.
 	 *   - **keep_duplicate_frames** -- Keep duplicate frames in the output instead of combining them, bool.
+	 *   - **global_palette** -- Map all frames to one palette made from a sample of frames, bool.
 	 *   - **keep** -- Which metadata to retain, VipsForeignKeep.
 	 *   - **background** -- Background value, std::vector<double>.
 	 *   - **page_height** -- Set page height for multipage save, int.
@@ -3497,6 +3676,7 @@ public:
 	 *   - **n** -- Number of pages to load, -1 for all, int.
 	 *   - **thumbnail** -- Fetch thumbnail image, bool.
 	 *   - **unlimited** -- Remove all denial of service limits, bool.
+	 *   - **parallel** -- Decode pages in parallel, bool.
 	 *   - **memory** -- Force open via memory, bool.
 	 *   - **access** -- Required access pattern for this file, VipsAccess.
 	 *   - **fail_on** -- Error level to fail on, VipsFailOn.
@@ -3516,6 +3696,7 @@ public:
 	 *   - **n** -- Number of pages to load, -1 for all, int.
 	 *   - **thumbnail** -- Fetch thumbnail image, bool.
 	 *   - **unlimited** -- Remove all denial of service limits, bool.
+	 *   - **parallel** -- Decode pages in parallel, bool.
 	 *   - **memory** -- Force open via memory, bool.
 	 *   - **access** -- Required access pattern for this file, VipsAccess.
 	 *   - **fail_on** -- Error level to fail on, VipsFailOn.
@@ -3535,6 +3716,7 @@ public:
 	 *   - **n** -- Number of pages to load, -1 for all, int.
 	 *   - **thumbnail** -- Fetch thumbnail image, bool.
 	 *   - **unlimited** -- Remove all denial of service limits, bool.
+	 *   - **parallel** -- Decode pages in parallel, bool.
 	 *   - **memory** -- Force open via memory, bool.
 	 *   - **access** -- Required access pattern for this file, VipsAccess.
 	 *   - **fail_on** -- Error level to fail on, VipsFailOn.
@@ -3984,6 +4166,7 @@ public:
 	 *   - **shrink** -- Shrink factor on load, int.
 	 *   - **autorotate** -- Rotate image using exif orientation, bool.
 	 *   - **unlimited** -- Remove all denial of service limits, bool.
+	 *   - **scale** -- Decode at this scale, rounded up to a multiple of 1/8, double.
 	 *   - **memory** -- Force open via memory, bool.
 	 *   - **access** -- Required access pattern for this file, VipsAccess.
 	 *   - **fail_on** -- Error level to fail on, VipsFailOn.
@@ -4002,6 +4185,7 @@ public:
 	 *   - **shrink** -- Shrink factor on load, int.
 	 *   - **autorotate** -- Rotate image using exif orientation, bool.
 	 *   - **unlimited** -- Remove all denial of service limits, bool.
+	 *   - **scale** -- Decode at this scale, rounded up to a multiple of 1/8, double.
 	 *   - **memory** -- Force open via memory, bool.
 	 *   - **access** -- Required access pattern for this file, VipsAccess.
 	 *   - **fail_on** -- Error level to fail on, VipsFailOn.
@@ -4020,6 +4204,7 @@ public:
 	 *   - **shrink** -- Shrink factor on load, int.
 	 *   - **autorotate** -- Rotate image using exif orientation, bool.
 	 *   - **unlimited** -- Remove all denial of service limits, bool.
+	 *   - **scale** -- Decode at this scale, rounded up to a multiple of 1/8, double.
 	 *   - **memory** -- Force open via memory, bool.
 	 *   - **access** -- Required access pattern for this file, VipsAccess.
 	 *   - **fail_on** -- Error level to fail on, VipsFailOn.
@@ -4982,6 +5167,7 @@ public:
 	 *   - **background** -- Background colour, std::vector<double>.
 	 *   - **password** -- Password to decrypt with, const char *.
 	 *   - **page_box** -- The region of the page to render, VipsForeignPdfPageBox.
+	 *   - **parallel** -- Render pages in parallel, bool.
 	 *   - **memory** -- Force open via memory, bool.
 	 *   - **access** -- Required access pattern for this file, VipsAccess.
 	 *   - **fail_on** -- Error level to fail on, VipsFailOn.
@@ -5004,6 +5190,7 @@ public:
 	 *   - **background** -- Background colour, std::vector<double>.
 	 *   - **password** -- Password to decrypt with, const char *.
 	 *   - **page_box** -- The region of the page to render, VipsForeignPdfPageBox.
+	 *   - **parallel** -- Render pages in parallel, bool.
 	 *   - **memory** -- Force open via memory, bool.
 	 *   - **access** -- Required access pattern for this file, VipsAccess.
 	 *   - **fail_on** -- Error level to fail on, VipsFailOn.
@@ -5026,6 +5213,7 @@ public:
 	 *   - **background** -- Background colour, std::vector<double>.
 	 *   - **password** -- Password to decrypt with, const char *.
 	 *   - **page_box** -- The region of the page to render, VipsForeignPdfPageBox.
+	 *   - **parallel** -- Render pages in parallel, bool.
 	 *   - **memory** -- Force open via memory, bool.
 	 *   - **access** -- Required access pattern for this file, VipsAccess.
 	 *   - **fail_on** -- Error level to fail on, VipsFailOn.
@@ -6103,6 +6291,7 @@ public:
 	 *   - **autorotate** -- Rotate image using orientation tag, bool.
 	 *   - **subifd** -- Subifd index, int.
 	 *   - **unlimited** -- Remove all denial of service limits, bool.
+	 *   - **parallel** -- Decode pages in parallel, bool.
 	 *   - **memory** -- Force open via memory, bool.
 	 *   - **access** -- Required access pattern for this file, VipsAccess.
 	 *   - **fail_on** -- Error level to fail on, VipsFailOn.
@@ -6123,6 +6312,7 @@ public:
 	 *   - **autorotate** -- Rotate image using orientation tag, bool.
 	 *   - **subifd** -- Subifd index, int.
 	 *   - **unlimited** -- Remove all denial of service limits, bool.
+	 *   - **parallel** -- Decode pages in parallel, bool.
 	 *   - **memory** -- Force open via memory, bool.
 	 *   - **access** -- Required access pattern for this file, VipsAccess.
 	 *   - **fail_on** -- Error level to fail on, VipsFailOn.
@@ -6143,6 +6333,7 @@ public:
 	 *   - **autorotate** -- Rotate image using orientation tag, bool.
 	 *   - **subifd** -- Subifd index, int.
 	 *   - **unlimited** -- Remove all denial of service limits, bool.
+	 *   - **parallel** -- Decode pages in parallel, bool.
 	 *   - **memory** -- Force open via memory, bool.
 	 *   - **access** -- Required access pattern for this file, VipsAccess.
 	 *   - **fail_on** -- Error level to fail on, VipsFailOn.
@@ -30,6 +30,9 @@
 #ifndef VIPS_VREGION_H
 #define VIPS_VREGION_H
 
+#include <exception>
+#include <mutex>
+
 #include <vips/vips.h>
 
 VIPS_NAMESPACE_START
@@ -149,6 +152,127 @@ public:
 	}
 };
 
+/* State for VImage::reduce_tiles(). The sink gives each worker a T as its
+ * sequence value, and calls stop (and so merge) one thread at a time.
+ */
+template <typename T, typename Fn, typename Merge>
+struct VTileReduce {
+	const T *init;
+	T *total;
+	Fn *fn;
+	Merge *merge;
+
+	std::mutex lock;
+	std::exception_ptr error;
+
+	/* Save the first exception, since we can't throw through the C
+	 * threadpool.
+	 */
+	void
+	fail()
+	{
+		std::lock_guard<std::mutex> guard(lock);
+
+		if (!error)
+			error = std::current_exception();
+	}
+
+	static void *
+	start(VipsImage *image, void *a, void *b)
+	{
+		VTileReduce *reduce = static_cast<VTileReduce *>(a);
+
+		try {
+			return new T(*reduce->init);
+		}
+		catch (...) {
+			reduce->fail();
+			return nullptr;
+		}
+	}
+
+	static int
+	generate(VipsRegion *region, void *seq, void *a, void *b,
+		gboolean *stop)
+	{
+		VTileReduce *reduce = static_cast<VTileReduce *>(a);
+
+		try {
+			(*reduce->fn)(*static_cast<T *>(seq),
+				VRegion(region, NOSTEAL));
+		}
+		catch (...) {
+			reduce->fail();
+			return -1;
+		}
+
+		return 0;
+	}
+
+	static int
+	stop(void *seq, void *a, void *b)
+	{
+		VTileReduce *reduce = static_cast<VTileReduce *>(a);
+		T *acc = static_cast<T *>(seq);
+		int result;
+
+		result = 0;
+		try {
+			(*reduce->merge)(*reduce->total, *acc);
+		}
+		catch (...) {
+			reduce->fail();
+			result = -1;
+		}
+
+		delete acc;
+
+		return result;
+	}
+};
+
+template <typename T, typename Fn, typename Merge>
+T
+VImage::reduce_tiles(const T &init, Fn fn, Merge merge,
+	int tile_width, int tile_height) const
+{
+	T total(init);
+	VTileReduce<T, Fn, Merge> reduce;
+
+	reduce.init = &init;
+	reduce.total = &total;
+	reduce.fn = &fn;
+	reduce.merge = &merge;
+
+	int result = vips_sink_tile(get_image(),
+		tile_width > 0 ? tile_width : -1,
+		tile_height > 0 ? tile_height : -1,
+		VTileReduce<T, Fn, Merge>::start,
+		VTileReduce<T, Fn, Merge>::generate,
+		VTileReduce<T, Fn, Merge>::stop,
+		&reduce, nullptr);
+
+	if (reduce.error)
+		std::rethrow_exception(reduce.error);
+	if (result)
+		throw VError();
+
+	return total;
+}
+
+template <typename Fn>
+void
+VImage::for_each_tile(Fn fn, int tile_width, int tile_height) const
+{
+	struct Empty {};
+
+	(void) reduce_tiles(
+		Empty(),
+		[&fn](Empty &, const VRegion &region) { fn(region); },
+		[](Empty &, const Empty &) {},
+		tile_width, tile_height);
+}
+
 VIPS_NAMESPACE_END
 
 #endif /*VIPS_VREGION_H*/
@@ -5,9 +5,10 @@
 VImage
 VImage::CICP2scRGB(VOption *options) const
 {
+	static const VOperationType operation_type("CICP2scRGB");
 	VImage out;
 
-	call("CICP2scRGB", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out));
 
@@ -17,9 +18,10 @@ VImage::CICP2scRGB(VOption *options) const
 VImage
 VImage::CMC2LCh(VOption *options) const
 {
+	static const VOperationType operation_type("CMC2LCh");
 	VImage out;
 
-	call("CMC2LCh", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out));
 
@@ -29,9 +31,10 @@ VImage::CMC2LCh(VOption *options) const
 VImage
 VImage::CMYK2XYZ(VOption *options) const
 {
+	static const VOperationType operation_type("CMYK2XYZ");
 	VImage out;
 
-	call("CMYK2XYZ", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out));
 
@@ -41,9 +44,10 @@ VImage::CMYK2XYZ(VOption *options) const
 VImage
 VImage::HSV2sRGB(VOption *options) const
 {
+	static const VOperationType operation_type("HSV2sRGB");
 	VImage out;
 
-	call("HSV2sRGB", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out));
 
@@ -53,9 +57,10 @@ VImage::HSV2sRGB(VOption *options) const
 VImage
 VImage::LCh2CMC(VOption *options) const
 {
+	static const VOperationType operation_type("LCh2CMC");
 	VImage out;
 
-	call("LCh2CMC", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out));
 
@@ -65,9 +70,10 @@ VImage::LCh2CMC(VOption *options) const
 VImage
 VImage::LCh2Lab(VOption *options) const
 {
+	static const VOperationType operation_type("LCh2Lab");
 	VImage out;
 
-	call("LCh2Lab", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out));
 
@@ -77,9 +83,10 @@ VImage::LCh2Lab(VOption *options) const
 VImage
 VImage::Lab2LCh(VOption *options) const
 {
+	static const VOperationType operation_type("Lab2LCh");
 	VImage out;
 
-	call("Lab2LCh", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out));
 
@@ -89,9 +96,10 @@ VImage::Lab2LCh(VOption *options) const
 VImage
 VImage::Lab2LabQ(VOption *options) const
 {
+	static const VOperationType operation_type("Lab2LabQ");
 	VImage out;
 
-	call("Lab2LabQ", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out));
 
@@ -101,9 +109,10 @@ VImage::Lab2LabQ(VOption *options) const
 VImage
 VImage::Lab2LabS(VOption *options) const
 {
+	static const VOperationType operation_type("Lab2LabS");
 	VImage out;
 
-	call("Lab2LabS", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out));
 
@@ -113,9 +122,10 @@ VImage::Lab2LabS(VOption *options) const
 VImage
 VImage::Lab2XYZ(VOption *options) const
 {
+	static const VOperationType operation_type("Lab2XYZ");
 	VImage out;
 
-	call("Lab2XYZ", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out));
 
@@ -125,9 +135,10 @@ VImage::Lab2XYZ(VOption *options) const
 VImage
 VImage::LabQ2Lab(VOption *options) const
 {
+	static const VOperationType operation_type("LabQ2Lab");
 	VImage out;
 
-	call("LabQ2Lab", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out));
 
@@ -137,9 +148,10 @@ VImage::LabQ2Lab(VOption *options) const
 VImage
 VImage::LabQ2LabS(VOption *options) const
 {
+	static const VOperationType operation_type("LabQ2LabS");
 	VImage out;
 
-	call("LabQ2LabS", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out));
 
@@ -149,9 +161,10 @@ VImage::LabQ2LabS(VOption *options) const
 VImage
 VImage::LabQ2sRGB(VOption *options) const
 {
+	static const VOperationType operation_type("LabQ2sRGB");
 	VImage out;
 
-	call("LabQ2sRGB", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out));
 
@@ -161,9 +174,10 @@ VImage::LabQ2sRGB(VOption *options) const
 VImage
 VImage::LabS2Lab(VOption *options) const
 {
+	static const VOperationType operation_type("LabS2Lab");
 	VImage out;
 
-	call("LabS2Lab", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out));
 
@@ -173,9 +187,10 @@ VImage::LabS2Lab(VOption *options) const
 VImage
 VImage::LabS2LabQ(VOption *options) const
 {
+	static const VOperationType operation_type("LabS2LabQ");
 	VImage out;
 
-	call("LabS2LabQ", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out));
 
@@ -185,9 +200,10 @@ VImage::LabS2LabQ(VOption *options) const
 VImage
 VImage::Oklab2Oklch(VOption *options) const
 {
+	static const VOperationType operation_type("Oklab2Oklch");
 	VImage out;
 
-	call("Oklab2Oklch", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out));
 
@@ -197,9 +213,10 @@ VImage::Oklab2Oklch(VOption *options) const
 VImage
 VImage::Oklab2XYZ(VOption *options) const
 {
+	static const VOperationType operation_type("Oklab2XYZ");
 	VImage out;
 
-	call("Oklab2XYZ", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out));
 
@@ -209,9 +226,10 @@ VImage::Oklab2XYZ(VOption *options) const
 VImage
 VImage::Oklch2Oklab(VOption *options) const
 {
+	static const VOperationType operation_type("Oklch2Oklab");
 	VImage out;
 
-	call("Oklch2Oklab", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out));
 
@@ -221,9 +239,10 @@ VImage::Oklch2Oklab(VOption *options) const
 VImage
 VImage::XYZ2CMYK(VOption *options) const
 {
+	static const VOperationType operation_type("XYZ2CMYK");
 	VImage out;
 
-	call("XYZ2CMYK", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out));
 
@@ -233,9 +252,10 @@ VImage::XYZ2CMYK(VOption *options) const
 VImage
 VImage::XYZ2Lab(VOption *options) const
 {
+	static const VOperationType operation_type("XYZ2Lab");
 	VImage out;
 
-	call("XYZ2Lab", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out));
 
@@ -245,9 +265,10 @@ VImage::XYZ2Lab(VOption *options) const
 VImage
 VImage::XYZ2Oklab(VOption *options) const
 {
+	static const VOperationType operation_type("XYZ2Oklab");
 	VImage out;
 
-	call("XYZ2Oklab", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out));
 
@@ -257,9 +278,10 @@ VImage::XYZ2Oklab(VOption *options) const
 VImage
 VImage::XYZ2Yxy(VOption *options) const
 {
+	static const VOperationType operation_type("XYZ2Yxy");
 	VImage out;
 
-	call("XYZ2Yxy", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out));
 
@@ -269,9 +291,10 @@ VImage::XYZ2Yxy(VOption *options) const
 VImage
 VImage::XYZ2scRGB(VOption *options) const
 {
+	static const VOperationType operation_type("XYZ2scRGB");
 	VImage out;
 
-	call("XYZ2scRGB", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out));
 
@@ -281,9 +304,10 @@ VImage::XYZ2scRGB(VOption *options) const
 VImage
 VImage::Yxy2XYZ(VOption *options) const
 {
+	static const VOperationType operation_type("Yxy2XYZ");
 	VImage out;
 
-	call("Yxy2XYZ", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out));
 
@@ -293,9 +317,10 @@ VImage::Yxy2XYZ(VOption *options) const
 VImage
 VImage::abs(VOption *options) const
 {
+	static const VOperationType operation_type("abs");
 	VImage out;
 
-	call("abs", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out));
 
@@ -305,9 +330,10 @@ VImage::abs(VOption *options) const
 VImage
 VImage::add(VImage right, VOption *options) const
 {
+	static const VOperationType operation_type("add");
 	VImage out;
 
-	call("add", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("left", *this)
 			->set("out", &out)
 			->set("right", right));
@@ -318,9 +344,10 @@ VImage::add(VImage right, VOption *options) const
 VImage
 VImage::addalpha(VOption *options) const
 {
+	static const VOperationType operation_type("addalpha");
 	VImage out;
 
-	call("addalpha", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out));
 
@@ -330,9 +357,10 @@ VImage::addalpha(VOption *options) const
 VImage
 VImage::affine(std::vector<double> matrix, VOption *options) const
 {
+	static const VOperationType operation_type("affine");
 	VImage out;
 
-	call("affine", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out)
 			->set("matrix", matrix));
@@ -343,9 +371,10 @@ VImage::affine(std::vector<double> matrix, VOption *options) const
 VImage
 VImage::analyzeload(const char *filename, VOption *options)
 {
+	static const VOperationType operation_type("analyzeload");
 	VImage out;
 
-	call("analyzeload", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("out", &out)
 			->set("filename", filename));
 
@@ -355,9 +384,10 @@ VImage::analyzeload(const char *filename, VOption *options)
 VImage
 VImage::arrayjoin(std::vector<VImage> in, VOption *options)
 {
+	static const VOperationType operation_type("arrayjoin");
 	VImage out;
 
-	call("arrayjoin", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("out", &out)
 			->set("in", in));
 
@@ -367,9 +397,10 @@ VImage::arrayjoin(std::vector<VImage> in, VOption *options)
 VImage
 VImage::autorot(VOption *options) const
 {
+	static const VOperationType operation_type("autorot");
 	VImage out;
 
-	call("autorot", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out));
 
@@ -379,9 +410,10 @@ VImage::autorot(VOption *options) const
 double
 VImage::avg(VOption *options) const
 {
+	static const VOperationType operation_type("avg");
 	double out;
 
-	call("avg", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out));
 
@@ -391,9 +423,10 @@ VImage::avg(VOption *options) const
 VImage
 VImage::bandbool(VipsOperationBoolean boolean, VOption *options) const
 {
+	static const VOperationType operation_type("bandbool");
 	VImage out;
 
-	call("bandbool", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out)
 			->set("boolean", boolean));
@@ -404,9 +437,10 @@ VImage::bandbool(VipsOperationBoolean boolean, VOption *options) const
 VImage
 VImage::bandfold(VOption *options) const
 {
+	static const VOperationType operation_type("bandfold");
 	VImage out;
 
-	call("bandfold", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out));
 
@@ -416,9 +450,10 @@ VImage::bandfold(VOption *options) const
 VImage
 VImage::bandjoin(std::vector<VImage> in, VOption *options)
 {
+	static const VOperationType operation_type("bandjoin");
 	VImage out;
 
-	call("bandjoin", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("out", &out)
 			->set("in", in));
 
@@ -428,9 +463,10 @@ VImage::bandjoin(std::vector<VImage> in, VOption *options)
 VImage
 VImage::bandjoin_const(std::vector<double> c, VOption *options) const
 {
+	static const VOperationType operation_type("bandjoin_const");
 	VImage out;
 
-	call("bandjoin_const", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out)
 			->set("c", c));
@@ -441,9 +477,10 @@ VImage::bandjoin_const(std::vector<double> c, VOption *options) const
 VImage
 VImage::bandmean(VOption *options) const
 {
+	static const VOperationType operation_type("bandmean");
 	VImage out;
 
-	call("bandmean", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out));
 
@@ -453,9 +490,10 @@ VImage::bandmean(VOption *options) const
 VImage
 VImage::bandrank(std::vector<VImage> in, VOption *options)
 {
+	static const VOperationType operation_type("bandrank");
 	VImage out;
 
-	call("bandrank", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("out", &out)
 			->set("in", in));
 
@@ -465,9 +503,10 @@ VImage::bandrank(std::vector<VImage> in, VOption *options)
 VImage
 VImage::bandunfold(VOption *options) const
 {
+	static const VOperationType operation_type("bandunfold");
 	VImage out;
 
-	call("bandunfold", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out));
 
@@ -477,9 +516,10 @@ VImage::bandunfold(VOption *options) const
 VImage
 VImage::black(int width, int height, VOption *options)
 {
+	static const VOperationType operation_type("black");
 	VImage out;
 
-	call("black", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("out", &out)
 			->set("width", width)
 			->set("height", height));
@@ -490,9 +530,10 @@ VImage::black(int width, int height, VOption *options)
 VImage
 VImage::boolean(VImage right, VipsOperationBoolean boolean, VOption *options) const
 {
+	static const VOperationType operation_type("boolean");
 	VImage out;
 
-	call("boolean", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("left", *this)
 			->set("out", &out)
 			->set("right", right)
@@ -504,9 +545,10 @@ VImage::boolean(VImage right, VipsOperationBoolean boolean, VOption *options) co
 VImage
 VImage::boolean_const(VipsOperationBoolean boolean, std::vector<double> c, VOption *options) const
 {
+	static const VOperationType operation_type("boolean_const");
 	VImage out;
 
-	call("boolean_const", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out)
 			->set("boolean", boolean)
@@ -518,9 +560,10 @@ VImage::boolean_const(VipsOperationBoolean boolean, std::vector<double> c, VOpti
 VImage
 VImage::buildlut(VOption *options) const
 {
+	static const VOperationType operation_type("buildlut");
 	VImage out;
 
-	call("buildlut", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out));
 
@@ -530,9 +573,10 @@ VImage::buildlut(VOption *options) const
 VImage
 VImage::byteswap(VOption *options) const
 {
+	static const VOperationType operation_type("byteswap");
 	VImage out;
 
-	call("byteswap", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out));
 
@@ -542,9 +586,10 @@ VImage::byteswap(VOption *options) const
 VImage
 VImage::cache(VOption *options) const
 {
+	static const VOperationType operation_type("cache");
 	VImage out;
 
-	call("cache", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out));
 
@@ -554,9 +599,10 @@ VImage::cache(VOption *options) const
 VImage
 VImage::canny(VOption *options) const
 {
+	static const VOperationType operation_type("canny");
 	VImage out;
 
-	call("canny", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out));
 
@@ -566,9 +612,10 @@ VImage::canny(VOption *options) const
 VImage
 VImage::case_image(std::vector<VImage> cases, VOption *options) const
 {
+	static const VOperationType operation_type("case");
 	VImage out;
 
-	call("case", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("index", *this)
 			->set("out", &out)
 			->set("cases", cases));
@@ -579,9 +626,10 @@ VImage::case_image(std::vector<VImage> cases, VOption *options) const
 VImage
 VImage::cast(VipsBandFormat format, VOption *options) const
 {
+	static const VOperationType operation_type("cast");
 	VImage out;
 
-	call("cast", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out)
 			->set("format", format));
@@ -592,9 +640,10 @@ VImage::cast(VipsBandFormat format, VOption *options) const
 VImage
 VImage::clamp(VOption *options) const
 {
+	static const VOperationType operation_type("clamp");
 	VImage out;
 
-	call("clamp", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out));
 
@@ -604,9 +653,10 @@ VImage::clamp(VOption *options) const
 VImage
 VImage::colourspace(VipsInterpretation space, VOption *options) const
 {
+	static const VOperationType operation_type("colourspace");
 	VImage out;
 
-	call("colourspace", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out)
 			->set("space", space));
@@ -617,9 +667,10 @@ VImage::colourspace(VipsInterpretation space, VOption *options) const
 VImage
 VImage::compass(VImage mask, VOption *options) const
 {
+	static const VOperationType operation_type("compass");
 	VImage out;
 
-	call("compass", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out)
 			->set("mask", mask));
@@ -630,9 +681,10 @@ VImage::compass(VImage mask, VOption *options) const
 VImage
 VImage::complex(VipsOperationComplex cmplx, VOption *options) const
 {
+	static const VOperationType operation_type("complex");
 	VImage out;
 
-	call("complex", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out)
 			->set("cmplx", cmplx));
@@ -643,9 +695,10 @@ VImage::complex(VipsOperationComplex cmplx, VOption *options) const
 VImage
 VImage::complex2(VImage right, VipsOperationComplex2 cmplx, VOption *options) const
 {
+	static const VOperationType operation_type("complex2");
 	VImage out;
 
-	call("complex2", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("left", *this)
 			->set("out", &out)
 			->set("right", right)
@@ -657,9 +710,10 @@ VImage::complex2(VImage right, VipsOperationComplex2 cmplx, VOption *options) co
 VImage
 VImage::complexform(VImage right, VOption *options) const
 {
+	static const VOperationType operation_type("complexform");
 	VImage out;
 
-	call("complexform", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("left", *this)
 			->set("out", &out)
 			->set("right", right));
@@ -670,9 +724,10 @@ VImage::complexform(VImage right, VOption *options) const
 VImage
 VImage::complexget(VipsOperationComplexget get, VOption *options) const
 {
+	static const VOperationType operation_type("complexget");
 	VImage out;
 
-	call("complexget", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out)
 			->set("get", get));
@@ -683,9 +738,10 @@ VImage::complexget(VipsOperationComplexget get, VOption *options) const
 VImage
 VImage::composite(std::vector<VImage> in, std::vector<int> mode, VOption *options)
 {
+	static const VOperationType operation_type("composite");
 	VImage out;
 
-	call("composite", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("out", &out)
 			->set("in", in)
 			->set("mode", mode));
@@ -696,9 +752,10 @@ VImage::composite(std::vector<VImage> in, std::vector<int> mode, VOption *option
 VImage
 VImage::composite2(VImage overlay, VipsBlendMode mode, VOption *options) const
 {
+	static const VOperationType operation_type("composite2");
 	VImage out;
 
-	call("composite2", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("base", *this)
 			->set("out", &out)
 			->set("overlay", overlay)
@@ -710,9 +767,10 @@ VImage::composite2(VImage overlay, VipsBlendMode mode, VOption *options) const
 VImage
 VImage::conv(VImage mask, VOption *options) const
 {
+	static const VOperationType operation_type("conv");
 	VImage out;
 
-	call("conv", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out)
 			->set("mask", mask));
@@ -723,9 +781,10 @@ VImage::conv(VImage mask, VOption *options) const
 VImage
 VImage::conva(VImage mask, VOption *options) const
 {
+	static const VOperationType operation_type("conva");
 	VImage out;
 
-	call("conva", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out)
 			->set("mask", mask));
@@ -736,9 +795,10 @@ VImage::conva(VImage mask, VOption *options) const
 VImage
 VImage::convasep(VImage mask, VOption *options) const
 {
+	static const VOperationType operation_type("convasep");
 	VImage out;
 
-	call("convasep", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out)
 			->set("mask", mask));
@@ -749,9 +809,10 @@ VImage::convasep(VImage mask, VOption *options) const
 VImage
 VImage::convf(VImage mask, VOption *options) const
 {
+	static const VOperationType operation_type("convf");
 	VImage out;
 
-	call("convf", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out)
 			->set("mask", mask));
@@ -762,9 +823,10 @@ VImage::convf(VImage mask, VOption *options) const
 VImage
 VImage::convi(VImage mask, VOption *options) const
 {
+	static const VOperationType operation_type("convi");
 	VImage out;
 
-	call("convi", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out)
 			->set("mask", mask));
@@ -775,9 +837,10 @@ VImage::convi(VImage mask, VOption *options) const
 VImage
 VImage::convsep(VImage mask, VOption *options) const
 {
+	static const VOperationType operation_type("convsep");
 	VImage out;
 
-	call("convsep", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out)
 			->set("mask", mask));
@@ -788,9 +851,10 @@ VImage::convsep(VImage mask, VOption *options) const
 VImage
 VImage::copy(VOption *options) const
 {
+	static const VOperationType operation_type("copy");
 	VImage out;
 
-	call("copy", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out));
 
@@ -800,9 +864,10 @@ VImage::copy(VOption *options) const
 double
 VImage::countlines(VipsDirection direction, VOption *options) const
 {
+	static const VOperationType operation_type("countlines");
 	double nolines;
 
-	call("countlines", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("nolines", &nolines)
 			->set("direction", direction));
@@ -813,9 +878,10 @@ VImage::countlines(VipsDirection direction, VOption *options) const
 VImage
 VImage::crop(int left, int top, int width, int height, VOption *options) const
 {
+	static const VOperationType operation_type("crop");
 	VImage out;
 
-	call("crop", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("input", *this)
 			->set("out", &out)
 			->set("left", left)
@@ -829,9 +895,10 @@ VImage::crop(int left, int top, int width, int height, VOption *options) const
 VImage
 VImage::csvload(const char *filename, VOption *options)
 {
+	static const VOperationType operation_type("csvload");
 	VImage out;
 
-	call("csvload", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("out", &out)
 			->set("filename", filename));
 
@@ -841,9 +908,10 @@ VImage::csvload(const char *filename, VOption *options)
 VImage
 VImage::csvload_source(VSource source, VOption *options)
 {
+	static const VOperationType operation_type("csvload_source");
 	VImage out;
 
-	call("csvload_source", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("out", &out)
 			->set("source", source));
 
@@ -853,7 +921,9 @@ VImage::csvload_source(VSource source, VOption *options)
 void
 VImage::csvsave(const char *filename, VOption *options) const
 {
-	call("csvsave", (options ? options : VImage::option())
+	static const VOperationType operation_type("csvsave");
+
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("filename", filename));
 }
@@ -861,7 +931,9 @@ VImage::csvsave(const char *filename, VOption *options) const
 void
 VImage::csvsave_target(VTarget target, VOption *options) const
 {
-	call("csvsave_target", (options ? options : VImage::option())
+	static const VOperationType operation_type("csvsave_target");
+
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("target", target));
 }
@@ -869,9 +941,10 @@ VImage::csvsave_target(VTarget target, VOption *options) const
 VImage
 VImage::dE00(VImage right, VOption *options) const
 {
+	static const VOperationType operation_type("dE00");
 	VImage out;
 
-	call("dE00", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("left", *this)
 			->set("out", &out)
 			->set("right", right));
@@ -882,9 +955,10 @@ VImage::dE00(VImage right, VOption *options) const
 VImage
 VImage::dE76(VImage right, VOption *options) const
 {
+	static const VOperationType operation_type("dE76");
 	VImage out;
 
-	call("dE76", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("left", *this)
 			->set("out", &out)
 			->set("right", right));
@@ -895,9 +969,10 @@ VImage::dE76(VImage right, VOption *options) const
 VImage
 VImage::dECMC(VImage right, VOption *options) const
 {
+	static const VOperationType operation_type("dECMC");
 	VImage out;
 
-	call("dECMC", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("left", *this)
 			->set("out", &out)
 			->set("right", right));
@@ -908,9 +983,10 @@ VImage::dECMC(VImage right, VOption *options) const
 VImage
 VImage::dcrawload(const char *filename, VOption *options)
 {
+	static const VOperationType operation_type("dcrawload");
 	VImage out;
 
-	call("dcrawload", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("out", &out)
 			->set("filename", filename));
 
@@ -920,9 +996,10 @@ VImage::dcrawload(const char *filename, VOption *options)
 VImage
 VImage::dcrawload_buffer(VipsBlob *buffer, VOption *options)
 {
+	static const VOperationType operation_type("dcrawload_buffer");
 	VImage out;
 
-	call("dcrawload_buffer", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("out", &out)
 			->set("buffer", buffer));
 
@@ -932,9 +1009,10 @@ VImage::dcrawload_buffer(VipsBlob *buffer, VOption *options)
 VImage
 VImage::dcrawload_source(VSource source, VOption *options)
 {
+	static const VOperationType operation_type("dcrawload_source");
 	VImage out;
 
-	call("dcrawload_source", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("out", &out)
 			->set("source", source));
 
@@ -944,9 +1022,10 @@ VImage::dcrawload_source(VSource source, VOption *options)
 double
 VImage::deviate(VOption *options) const
 {
+	static const VOperationType operation_type("deviate");
 	double out;
 
-	call("deviate", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out));
 
@@ -956,9 +1035,10 @@ VImage::deviate(VOption *options) const
 VImage
 VImage::divide(VImage right, VOption *options) const
 {
+	static const VOperationType operation_type("divide");
 	VImage out;
 
-	call("divide", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("left", *this)
 			->set("out", &out)
 			->set("right", right));
@@ -969,7 +1049,9 @@ VImage::divide(VImage right, VOption *options) const
 void
 VImage::draw_circle(std::vector<double> ink, int cx, int cy, int radius, VOption *options) const
 {
-	call("draw_circle", (options ? options : VImage::option())
+	static const VOperationType operation_type("draw_circle");
+
+	call(operation_type, (options ? options : VImage::option())
 			->set("image", *this)
 			->set("ink", ink)
 			->set("cx", cx)
@@ -980,7 +1062,9 @@ VImage::draw_circle(std::vector<double> ink, int cx, int cy, int radius, VOption
 void
 VImage::draw_flood(std::vector<double> ink, int x, int y, VOption *options) const
 {
-	call("draw_flood", (options ? options : VImage::option())
+	static const VOperationType operation_type("draw_flood");
+
+	call(operation_type, (options ? options : VImage::option())
 			->set("image", *this)
 			->set("ink", ink)
 			->set("x", x)
@@ -990,7 +1074,9 @@ VImage::draw_flood(std::vector<double> ink, int x, int y, VOption *options) cons
 void
 VImage::draw_image(VImage sub, int x, int y, VOption *options) const
 {
-	call("draw_image", (options ? options : VImage::option())
+	static const VOperationType operation_type("draw_image");
+
+	call(operation_type, (options ? options : VImage::option())
 			->set("image", *this)
 			->set("sub", sub)
 			->set("x", x)
@@ -1000,7 +1086,9 @@ VImage::draw_image(VImage sub, int x, int y, VOption *options) const
 void
 VImage::draw_line(std::vector<double> ink, int x1, int y1, int x2, int y2, VOption *options) const
 {
-	call("draw_line", (options ? options : VImage::option())
+	static const VOperationType operation_type("draw_line");
+
+	call(operation_type, (options ? options : VImage::option())
 			->set("image", *this)
 			->set("ink", ink)
 			->set("x1", x1)
@@ -1012,7 +1100,9 @@ VImage::draw_line(std::vector<double> ink, int x1, int y1, int x2, int y2, VOpti
 void
 VImage::draw_mask(std::vector<double> ink, VImage mask, int x, int y, VOption *options) const
 {
-	call("draw_mask", (options ? options : VImage::option())
+	static const VOperationType operation_type("draw_mask");
+
+	call(operation_type, (options ? options : VImage::option())
 			->set("image", *this)
 			->set("ink", ink)
 			->set("mask", mask)
@@ -1023,7 +1113,9 @@ VImage::draw_mask(std::vector<double> ink, VImage mask, int x, int y, VOption *o
 void
 VImage::draw_rect(std::vector<double> ink, int left, int top, int width, int height, VOption *options) const
 {
-	call("draw_rect", (options ? options : VImage::option())
+	static const VOperationType operation_type("draw_rect");
+
+	call(operation_type, (options ? options : VImage::option())
 			->set("image", *this)
 			->set("ink", ink)
 			->set("left", left)
@@ -1035,7 +1127,9 @@ VImage::draw_rect(std::vector<double> ink, int left, int top, int width, int hei
 void
 VImage::draw_smudge(int left, int top, int width, int height, VOption *options) const
 {
-	call("draw_smudge", (options ? options : VImage::option())
+	static const VOperationType operation_type("draw_smudge");
+
+	call(operation_type, (options ? options : VImage::option())
 			->set("image", *this)
 			->set("left", left)
 			->set("top", top)
@@ -1046,7 +1140,9 @@ VImage::draw_smudge(int left, int top, int width, int height, VOption *options)
 void
 VImage::dzsave(const char *filename, VOption *options) const
 {
-	call("dzsave", (options ? options : VImage::option())
+	static const VOperationType operation_type("dzsave");
+
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("filename", filename));
 }
@@ -1054,9 +1150,10 @@ VImage::dzsave(const char *filename, VOption *options) const
 VipsBlob *
 VImage::dzsave_buffer(VOption *options) const
 {
+	static const VOperationType operation_type("dzsave_buffer");
 	VipsBlob *buffer;
 
-	call("dzsave_buffer", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("buffer", &buffer));
 
@@ -1066,7 +1163,9 @@ VImage::dzsave_buffer(VOption *options) const
 void
 VImage::dzsave_target(VTarget target, VOption *options) const
 {
-	call("dzsave_target", (options ? options : VImage::option())
+	static const VOperationType operation_type("dzsave_target");
+
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("target", target));
 }
@@ -1074,9 +1173,10 @@ VImage::dzsave_target(VTarget target, VOption *options) const
 VImage
 VImage::embed(int x, int y, int width, int height, VOption *options) const
 {
+	static const VOperationType operation_type("embed");
 	VImage out;
 
-	call("embed", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out)
 			->set("x", x)
@@ -1090,9 +1190,10 @@ VImage::embed(int x, int y, int width, int height, VOption *options) const
 VImage
 VImage::extract_area(int left, int top, int width, int height, VOption *options) const
 {
+	static const VOperationType operation_type("extract_area");
 	VImage out;
 
-	call("extract_area", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("input", *this)
 			->set("out", &out)
 			->set("left", left)
@@ -1106,9 +1207,10 @@ VImage::extract_area(int left, int top, int width, int height, VOption *options)
 VImage
 VImage::extract_band(int band, VOption *options) const
 {
+	static const VOperationType operation_type("extract_band");
 	VImage out;
 
-	call("extract_band", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out)
 			->set("band", band));
@@ -1119,9 +1221,10 @@ VImage::extract_band(int band, VOption *options) const
 VImage
 VImage::eye(int width, int height, VOption *options)
 {
+	static const VOperationType operation_type("eye");
 	VImage out;
 
-	call("eye", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("out", &out)
 			->set("width", width)
 			->set("height", height));
@@ -1132,9 +1235,10 @@ VImage::eye(int width, int height, VOption *options)
 VImage
 VImage::falsecolour(VOption *options) const
 {
+	static const VOperationType operation_type("falsecolour");
 	VImage out;
 
-	call("falsecolour", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out));
 
@@ -1144,9 +1248,10 @@ VImage::falsecolour(VOption *options) const
 VImage
 VImage::fastcor(VImage ref, VOption *options) const
 {
+	static const VOperationType operation_type("fastcor");
 	VImage out;
 
-	call("fastcor", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out)
 			->set("ref", ref));
@@ -1157,9 +1262,10 @@ VImage::fastcor(VImage ref, VOption *options) const
 VImage
 VImage::fill_nearest(VOption *options) const
 {
+	static const VOperationType operation_type("fill_nearest");
 	VImage out;
 
-	call("fill_nearest", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out));
 
@@ -1169,9 +1275,10 @@ VImage::fill_nearest(VOption *options) const
 int
 VImage::find_trim(int *top, int *width, int *height, VOption *options) const
 {
+	static const VOperationType operation_type("find_trim");
 	int left;
 
-	call("find_trim", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("left", &left)
 			->set("top", top)
@@ -1184,9 +1291,10 @@ VImage::find_trim(int *top, int *width, int *height, VOption *options) const
 VImage
 VImage::fitsload(const char *filename, VOption *options)
 {
+	static const VOperationType operation_type("fitsload");
 	VImage out;
 
-	call("fitsload", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("out", &out)
 			->set("filename", filename));
 
@@ -1196,9 +1304,10 @@ VImage::fitsload(const char *filename, VOption *options)
 VImage
 VImage::fitsload_source(VSource source, VOption *options)
 {
+	static const VOperationType operation_type("fitsload_source");
 	VImage out;
 
-	call("fitsload_source", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("out", &out)
 			->set("source", source));
 
@@ -1208,7 +1317,9 @@ VImage::fitsload_source(VSource source, VOption *options)
 void
 VImage::fitssave(const char *filename, VOption *options) const
 {
-	call("fitssave", (options ? options : VImage::option())
+	static const VOperationType operation_type("fitssave");
+
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("filename", filename));
 }
@@ -1216,9 +1327,10 @@ VImage::fitssave(const char *filename, VOption *options) const
 VImage
 VImage::flatten(VOption *options) const
 {
+	static const VOperationType operation_type("flatten");
 	VImage out;
 
-	call("flatten", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out));
 
@@ -1228,9 +1340,10 @@ VImage::flatten(VOption *options) const
 VImage
 VImage::flip(VipsDirection direction, VOption *options) const
 {
+	static const VOperationType operation_type("flip");
 	VImage out;
 
-	call("flip", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out)
 			->set("direction", direction));
@@ -1241,9 +1354,10 @@ VImage::flip(VipsDirection direction, VOption *options) const
 VImage
 VImage::float2rad(VOption *options) const
 {
+	static const VOperationType operation_type("float2rad");
 	VImage out;
 
-	call("float2rad", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out));
 
@@ -1253,9 +1367,10 @@ VImage::float2rad(VOption *options) const
 VImage
 VImage::fractsurf(int width, int height, double fractal_dimension, VOption *options)
 {
+	static const VOperationType operation_type("fractsurf");
 	VImage out;
 
-	call("fractsurf", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("out", &out)
 			->set("width", width)
 			->set("height", height)
@@ -1267,9 +1382,10 @@ VImage::fractsurf(int width, int height, double fractal_dimension, VOption *opti
 VImage
 VImage::freqmult(VImage mask, VOption *options) const
 {
+	static const VOperationType operation_type("freqmult");
 	VImage out;
 
-	call("freqmult", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out)
 			->set("mask", mask));
@@ -1280,9 +1396,10 @@ VImage::freqmult(VImage mask, VOption *options) const
 VImage
 VImage::fwfft(VOption *options) const
 {
+	static const VOperationType operation_type("fwfft");
 	VImage out;
 
-	call("fwfft", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out));
 
@@ -1292,9 +1409,10 @@ VImage::fwfft(VOption *options) const
 VImage
 VImage::gamma(VOption *options) const
 {
+	static const VOperationType operation_type("gamma");
 	VImage out;
 
-	call("gamma", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out));
 
@@ -1304,9 +1422,10 @@ VImage::gamma(VOption *options) const
 VImage
 VImage::gaussblur(double sigma, VOption *options) const
 {
+	static const VOperationType operation_type("gaussblur");
 	VImage out;
 
-	call("gaussblur", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out)
 			->set("sigma", sigma));
@@ -1317,9 +1436,10 @@ VImage::gaussblur(double sigma, VOption *options) const
 VImage
 VImage::gaussmat(double sigma, double min_ampl, VOption *options)
 {
+	static const VOperationType operation_type("gaussmat");
 	VImage out;
 
-	call("gaussmat", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("out", &out)
 			->set("sigma", sigma)
 			->set("min_ampl", min_ampl));
@@ -1330,9 +1450,10 @@ VImage::gaussmat(double sigma, double min_ampl, VOption *options)
 VImage
 VImage::gaussnoise(int width, int height, VOption *options)
 {
+	static const VOperationType operation_type("gaussnoise");
 	VImage out;
 
-	call("gaussnoise", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("out", &out)
 			->set("width", width)
 			->set("height", height));
@@ -1343,9 +1464,10 @@ VImage::gaussnoise(int width, int height, VOption *options)
 std::vector<double>
 VImage::getpoint(int x, int y, VOption *options) const
 {
+	static const VOperationType operation_type("getpoint");
 	std::vector<double> out_array;
 
-	call("getpoint", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out_array", &out_array)
 			->set("x", x)
@@ -1357,9 +1479,10 @@ VImage::getpoint(int x, int y, VOption *options) const
 VImage
 VImage::gifload(const char *filename, VOption *options)
 {
+	static const VOperationType operation_type("gifload");
 	VImage out;
 
-	call("gifload", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("out", &out)
 			->set("filename", filename));
 
@@ -1369,9 +1492,10 @@ VImage::gifload(const char *filename, VOption *options)
 VImage
 VImage::gifload_buffer(VipsBlob *buffer, VOption *options)
 {
+	static const VOperationType operation_type("gifload_buffer");
 	VImage out;
 
-	call("gifload_buffer", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("out", &out)
 			->set("buffer", buffer));
 
@@ -1381,9 +1505,10 @@ VImage::gifload_buffer(VipsBlob *buffer, VOption *options)
 VImage
 VImage::gifload_source(VSource source, VOption *options)
 {
+	static const VOperationType operation_type("gifload_source");
 	VImage out;
 
-	call("gifload_source", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("out", &out)
 			->set("source", source));
 
@@ -1393,7 +1518,9 @@ VImage::gifload_source(VSource source, VOption *options)
 void
 VImage::gifsave(const char *filename, VOption *options) const
 {
-	call("gifsave", (options ? options : VImage::option())
+	static const VOperationType operation_type("gifsave");
+
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("filename", filename));
 }
@@ -1401,9 +1528,10 @@ VImage::gifsave(const char *filename, VOption *options) const
 VipsBlob *
 VImage::gifsave_buffer(VOption *options) const
 {
+	static const VOperationType operation_type("gifsave_buffer");
 	VipsBlob *buffer;
 
-	call("gifsave_buffer", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("buffer", &buffer));
 
@@ -1413,7 +1541,9 @@ VImage::gifsave_buffer(VOption *options) const
 void
 VImage::gifsave_target(VTarget target, VOption *options) const
 {
-	call("gifsave_target", (options ? options : VImage::option())
+	static const VOperationType operation_type("gifsave_target");
+
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("target", target));
 }
@@ -1421,9 +1551,10 @@ VImage::gifsave_target(VTarget target, VOption *options) const
 VImage
 VImage::globalbalance(VOption *options) const
 {
+	static const VOperationType operation_type("globalbalance");
 	VImage out;
 
-	call("globalbalance", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out));
 
@@ -1433,9 +1564,10 @@ VImage::globalbalance(VOption *options) const
 VImage
 VImage::gravity(VipsCompassDirection direction, int width, int height, VOption *options) const
 {
+	static const VOperationType operation_type("gravity");
 	VImage out;
 
-	call("gravity", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out)
 			->set("direction", direction)
@@ -1448,9 +1580,10 @@ VImage::gravity(VipsCompassDirection direction, int width, int height, VOption *
 VImage
 VImage::grey(int width, int height, VOption *options)
 {
+	static const VOperationType operation_type("grey");
 	VImage out;
 
-	call("grey", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("out", &out)
 			->set("width", width)
 			->set("height", height));
@@ -1461,9 +1594,10 @@ VImage::grey(int width, int height, VOption *options)
 VImage
 VImage::grid(int tile_height, int across, int down, VOption *options) const
 {
+	static const VOperationType operation_type("grid");
 	VImage out;
 
-	call("grid", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out)
 			->set("tile_height", tile_height)
@@ -1476,9 +1610,10 @@ VImage::grid(int tile_height, int across, int down, VOption *options) const
 VImage
 VImage::heifload(const char *filename, VOption *options)
 {
+	static const VOperationType operation_type("heifload");
 	VImage out;
 
-	call("heifload", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("out", &out)
 			->set("filename", filename));
 
@@ -1488,9 +1623,10 @@ VImage::heifload(const char *filename, VOption *options)
 VImage
 VImage::heifload_buffer(VipsBlob *buffer, VOption *options)
 {
+	static const VOperationType operation_type("heifload_buffer");
 	VImage out;
 
-	call("heifload_buffer", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("out", &out)
 			->set("buffer", buffer));
 
@@ -1500,9 +1636,10 @@ VImage::heifload_buffer(VipsBlob *buffer, VOption *options)
 VImage
 VImage::heifload_source(VSource source, VOption *options)
 {
+	static const VOperationType operation_type("heifload_source");
 	VImage out;
 
-	call("heifload_source", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("out", &out)
 			->set("source", source));
 
@@ -1512,7 +1649,9 @@ VImage::heifload_source(VSource source, VOption *options)
 void
 VImage::heifsave(const char *filename, VOption *options) const
 {
-	call("heifsave", (options ? options : VImage::option())
+	static const VOperationType operation_type("heifsave");
+
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("filename", filename));
 }
@@ -1520,9 +1659,10 @@ VImage::heifsave(const char *filename, VOption *options) const
 VipsBlob *
 VImage::heifsave_buffer(VOption *options) const
 {
+	static const VOperationType operation_type("heifsave_buffer");
 	VipsBlob *buffer;
 
-	call("heifsave_buffer", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("buffer", &buffer));
 
@@ -1532,7 +1672,9 @@ VImage::heifsave_buffer(VOption *options) const
 void
 VImage::heifsave_target(VTarget target, VOption *options) const
 {
-	call("heifsave_target", (options ? options : VImage::option())
+	static const VOperationType operation_type("heifsave_target");
+
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("target", target));
 }
@@ -1540,9 +1682,10 @@ VImage::heifsave_target(VTarget target, VOption *options) const
 VImage
 VImage::hist_cum(VOption *options) const
 {
+	static const VOperationType operation_type("hist_cum");
 	VImage out;
 
-	call("hist_cum", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out));
 
@@ -1552,9 +1695,10 @@ VImage::hist_cum(VOption *options) const
 double
 VImage::hist_entropy(VOption *options) const
 {
+	static const VOperationType operation_type("hist_entropy");
 	double out;
 
-	call("hist_entropy", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out));
 
@@ -1564,9 +1708,10 @@ VImage::hist_entropy(VOption *options) const
 VImage
 VImage::hist_equal(VOption *options) const
 {
+	static const VOperationType operation_type("hist_equal");
 	VImage out;
 
-	call("hist_equal", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out));
 
@@ -1576,9 +1721,10 @@ VImage::hist_equal(VOption *options) const
 VImage
 VImage::hist_find(VOption *options) const
 {
+	static const VOperationType operation_type("hist_find");
 	VImage out;
 
-	call("hist_find", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out));
 
@@ -1588,9 +1734,10 @@ VImage::hist_find(VOption *options) const
 VImage
 VImage::hist_find_indexed(VImage index, VOption *options) const
 {
+	static const VOperationType operation_type("hist_find_indexed");
 	VImage out;
 
-	call("hist_find_indexed", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out)
 			->set("index", index));
@@ -1601,9 +1748,10 @@ VImage::hist_find_indexed(VImage index, VOption *options) const
 VImage
 VImage::hist_find_ndim(VOption *options) const
 {
+	static const VOperationType operation_type("hist_find_ndim");
 	VImage out;
 
-	call("hist_find_ndim", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out));
 
@@ -1613,9 +1761,10 @@ VImage::hist_find_ndim(VOption *options) const
 bool
 VImage::hist_ismonotonic(VOption *options) const
 {
+	static const VOperationType operation_type("hist_ismonotonic");
 	bool monotonic;
 
-	call("hist_ismonotonic", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("monotonic", &monotonic));
 
@@ -1625,9 +1774,10 @@ VImage::hist_ismonotonic(VOption *options) const
 VImage
 VImage::hist_local(int width, int height, VOption *options) const
 {
+	static const VOperationType operation_type("hist_local");
 	VImage out;
 
-	call("hist_local", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out)
 			->set("width", width)
@@ -1639,9 +1789,10 @@ VImage::hist_local(int width, int height, VOption *options) const
 VImage
 VImage::hist_match(VImage ref, VOption *options) const
 {
+	static const VOperationType operation_type("hist_match");
 	VImage out;
 
-	call("hist_match", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out)
 			->set("ref", ref));
@@ -1652,9 +1803,10 @@ VImage::hist_match(VImage ref, VOption *options) const
 VImage
 VImage::hist_norm(VOption *options) const
 {
+	static const VOperationType operation_type("hist_norm");
 	VImage out;
 
-	call("hist_norm", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out));
 
@@ -1664,9 +1816,10 @@ VImage::hist_norm(VOption *options) const
 VImage
 VImage::hist_plot(VOption *options) const
 {
+	static const VOperationType operation_type("hist_plot");
 	VImage out;
 
-	call("hist_plot", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out));
 
@@ -1676,9 +1829,10 @@ VImage::hist_plot(VOption *options) const
 VImage
 VImage::hough_circle(VOption *options) const
 {
+	static const VOperationType operation_type("hough_circle");
 	VImage out;
 
-	call("hough_circle", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out));
 
@@ -1688,9 +1842,10 @@ VImage::hough_circle(VOption *options) const
 VImage
 VImage::hough_line(VOption *options) const
 {
+	static const VOperationType operation_type("hough_line");
 	VImage out;
 
-	call("hough_line", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out));
 
@@ -1700,9 +1855,10 @@ VImage::hough_line(VOption *options) const
 VImage
 VImage::icc_export(VOption *options) const
 {
+	static const VOperationType operation_type("icc_export");
 	VImage out;
 
-	call("icc_export", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out));
 
@@ -1712,9 +1868,10 @@ VImage::icc_export(VOption *options) const
 VImage
 VImage::icc_import(VOption *options) const
 {
+	static const VOperationType operation_type("icc_import");
 	VImage out;
 
-	call("icc_import", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out));
 
@@ -1724,9 +1881,10 @@ VImage::icc_import(VOption *options) const
 VImage
 VImage::icc_transform(const char *output_profile, VOption *options) const
 {
+	static const VOperationType operation_type("icc_transform");
 	VImage out;
 
-	call("icc_transform", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out)
 			->set("output_profile", output_profile));
@@ -1737,9 +1895,10 @@ VImage::icc_transform(const char *output_profile, VOption *options) const
 VImage
 VImage::identity(VOption *options)
 {
+	static const VOperationType operation_type("identity");
 	VImage out;
 
-	call("identity", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("out", &out));
 
 	return out;
@@ -1748,9 +1907,10 @@ VImage::identity(VOption *options)
 VImage
 VImage::ifthenelse(VImage in1, VImage in2, VOption *options) const
 {
+	static const VOperationType operation_type("ifthenelse");
 	VImage out;
 
-	call("ifthenelse", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("cond", *this)
 			->set("out", &out)
 			->set("in1", in1)
@@ -1762,9 +1922,10 @@ VImage::ifthenelse(VImage in1, VImage in2, VOption *options) const
 VImage
 VImage::insert(VImage sub, int x, int y, VOption *options) const
 {
+	static const VOperationType operation_type("insert");
 	VImage out;
 
-	call("insert", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("main", *this)
 			->set("out", &out)
 			->set("sub", sub)
@@ -1777,9 +1938,10 @@ VImage::insert(VImage sub, int x, int y, VOption *options) const
 VImage
 VImage::invert(VOption *options) const
 {
+	static const VOperationType operation_type("invert");
 	VImage out;
 
-	call("invert", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out));
 
@@ -1789,9 +1951,10 @@ VImage::invert(VOption *options) const
 VImage
 VImage::invertlut(VOption *options) const
 {
+	static const VOperationType operation_type("invertlut");
 	VImage out;
 
-	call("invertlut", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out));
 
@@ -1801,9 +1964,10 @@ VImage::invertlut(VOption *options) const
 VImage
 VImage::invfft(VOption *options) const
 {
+	static const VOperationType operation_type("invfft");
 	VImage out;
 
-	call("invfft", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out));
 
@@ -1813,9 +1977,10 @@ VImage::invfft(VOption *options) const
 VImage
 VImage::join(VImage in2, VipsDirection direction, VOption *options) const
 {
+	static const VOperationType operation_type("join");
 	VImage out;
 
-	call("join", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in1", *this)
 			->set("out", &out)
 			->set("in2", in2)
@@ -1827,9 +1992,10 @@ VImage::join(VImage in2, VipsDirection direction, VOption *options) const
 VImage
 VImage::jp2kload(const char *filename, VOption *options)
 {
+	static const VOperationType operation_type("jp2kload");
 	VImage out;
 
-	call("jp2kload", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("out", &out)
 			->set("filename", filename));
 
@@ -1839,9 +2005,10 @@ VImage::jp2kload(const char *filename, VOption *options)
 VImage
 VImage::jp2kload_buffer(VipsBlob *buffer, VOption *options)
 {
+	static const VOperationType operation_type("jp2kload_buffer");
 	VImage out;
 
-	call("jp2kload_buffer", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("out", &out)
 			->set("buffer", buffer));
 
@@ -1851,9 +2018,10 @@ VImage::jp2kload_buffer(VipsBlob *buffer, VOption *options)
 VImage
 VImage::jp2kload_source(VSource source, VOption *options)
 {
+	static const VOperationType operation_type("jp2kload_source");
 	VImage out;
 
-	call("jp2kload_source", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("out", &out)
 			->set("source", source));
 
@@ -1863,7 +2031,9 @@ VImage::jp2kload_source(VSource source, VOption *options)
 void
 VImage::jp2ksave(const char *filename, VOption *options) const
 {
-	call("jp2ksave", (options ? options : VImage::option())
+	static const VOperationType operation_type("jp2ksave");
+
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("filename", filename));
 }
@@ -1871,9 +2041,10 @@ VImage::jp2ksave(const char *filename, VOption *options) const
 VipsBlob *
 VImage::jp2ksave_buffer(VOption *options) const
 {
+	static const VOperationType operation_type("jp2ksave_buffer");
 	VipsBlob *buffer;
 
-	call("jp2ksave_buffer", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("buffer", &buffer));
 
@@ -1883,7 +2054,9 @@ VImage::jp2ksave_buffer(VOption *options) const
 void
 VImage::jp2ksave_target(VTarget target, VOption *options) const
 {
-	call("jp2ksave_target", (options ? options : VImage::option())
+	static const VOperationType operation_type("jp2ksave_target");
+
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("target", target));
 }
@@ -1891,9 +2064,10 @@ VImage::jp2ksave_target(VTarget target, VOption *options) const
 VImage
 VImage::jpegload(const char *filename, VOption *options)
 {
+	static const VOperationType operation_type("jpegload");
 	VImage out;
 
-	call("jpegload", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("out", &out)
 			->set("filename", filename));
 
@@ -1903,9 +2077,10 @@ VImage::jpegload(const char *filename, VOption *options)
 VImage
 VImage::jpegload_buffer(VipsBlob *buffer, VOption *options)
 {
+	static const VOperationType operation_type("jpegload_buffer");
 	VImage out;
 
-	call("jpegload_buffer", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("out", &out)
 			->set("buffer", buffer));
 
@@ -1915,9 +2090,10 @@ VImage::jpegload_buffer(VipsBlob *buffer, VOption *options)
 VImage
 VImage::jpegload_source(VSource source, VOption *options)
 {
+	static const VOperationType operation_type("jpegload_source");
 	VImage out;
 
-	call("jpegload_source", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("out", &out)
 			->set("source", source));
 
@@ -1927,7 +2103,9 @@ VImage::jpegload_source(VSource source, VOption *options)
 void
 VImage::jpegsave(const char *filename, VOption *options) const
 {
-	call("jpegsave", (options ? options : VImage::option())
+	static const VOperationType operation_type("jpegsave");
+
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("filename", filename));
 }
@@ -1935,9 +2113,10 @@ VImage::jpegsave(const char *filename, VOption *options) const
 VipsBlob *
 VImage::jpegsave_buffer(VOption *options) const
 {
+	static const VOperationType operation_type("jpegsave_buffer");
 	VipsBlob *buffer;
 
-	call("jpegsave_buffer", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("buffer", &buffer));
 
@@ -1947,14 +2126,18 @@ VImage::jpegsave_buffer(VOption *options) const
 void
 VImage::jpegsave_mime(VOption *options) const
 {
-	call("jpegsave_mime", (options ? options : VImage::option())
+	static const VOperationType operation_type("jpegsave_mime");
+
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this));
 }
 
 void
 VImage::jpegsave_target(VTarget target, VOption *options) const
 {
-	call("jpegsave_target", (options ? options : VImage::option())
+	static const VOperationType operation_type("jpegsave_target");
+
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("target", target));
 }
@@ -1962,9 +2145,10 @@ VImage::jpegsave_target(VTarget target, VOption *options) const
 VImage
 VImage::jxlload(const char *filename, VOption *options)
 {
+	static const VOperationType operation_type("jxlload");
 	VImage out;
 
-	call("jxlload", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("out", &out)
 			->set("filename", filename));
 
@@ -1974,9 +2158,10 @@ VImage::jxlload(const char *filename, VOption *options)
 VImage
 VImage::jxlload_buffer(VipsBlob *buffer, VOption *options)
 {
+	static const VOperationType operation_type("jxlload_buffer");
 	VImage out;
 
-	call("jxlload_buffer", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("out", &out)
 			->set("buffer", buffer));
 
@@ -1986,9 +2171,10 @@ VImage::jxlload_buffer(VipsBlob *buffer, VOption *options)
 VImage
 VImage::jxlload_source(VSource source, VOption *options)
 {
+	static const VOperationType operation_type("jxlload_source");
 	VImage out;
 
-	call("jxlload_source", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("out", &out)
 			->set("source", source));
 
@@ -1998,7 +2184,9 @@ VImage::jxlload_source(VSource source, VOption *options)
 void
 VImage::jxlsave(const char *filename, VOption *options) const
 {
-	call("jxlsave", (options ? options : VImage::option())
+	static const VOperationType operation_type("jxlsave");
+
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("filename", filename));
 }
@@ -2006,9 +2194,10 @@ VImage::jxlsave(const char *filename, VOption *options) const
 VipsBlob *
 VImage::jxlsave_buffer(VOption *options) const
 {
+	static const VOperationType operation_type("jxlsave_buffer");
 	VipsBlob *buffer;
 
-	call("jxlsave_buffer", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("buffer", &buffer));
 
@@ -2018,7 +2207,9 @@ VImage::jxlsave_buffer(VOption *options) const
 void
 VImage::jxlsave_target(VTarget target, VOption *options) const
 {
-	call("jxlsave_target", (options ? options : VImage::option())
+	static const VOperationType operation_type("jxlsave_target");
+
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("target", target));
 }
@@ -2026,9 +2217,10 @@ VImage::jxlsave_target(VTarget target, VOption *options) const
 VImage
 VImage::labelregions(VOption *options) const
 {
+	static const VOperationType operation_type("labelregions");
 	VImage mask;
 
-	call("labelregions", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("mask", &mask));
 
@@ -2038,9 +2230,10 @@ VImage::labelregions(VOption *options) const
 VImage
 VImage::linear(std::vector<double> a, std::vector<double> b, VOption *options) const
 {
+	static const VOperationType operation_type("linear");
 	VImage out;
 
-	call("linear", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out)
 			->set("a", a)
@@ -2052,9 +2245,10 @@ VImage::linear(std::vector<double> a, std::vector<double> b, VOption *options) c
 VImage
 VImage::linecache(VOption *options) const
 {
+	static const VOperationType operation_type("linecache");
 	VImage out;
 
-	call("linecache", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out));
 
@@ -2064,9 +2258,10 @@ VImage::linecache(VOption *options) const
 VImage
 VImage::logmat(double sigma, double min_ampl, VOption *options)
 {
+	static const VOperationType operation_type("logmat");
 	VImage out;
 
-	call("logmat", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("out", &out)
 			->set("sigma", sigma)
 			->set("min_ampl", min_ampl));
@@ -2077,9 +2272,10 @@ VImage::logmat(double sigma, double min_ampl, VOption *options)
 VImage
 VImage::magickload(const char *filename, VOption *options)
 {
+	static const VOperationType operation_type("magickload");
 	VImage out;
 
-	call("magickload", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("out", &out)
 			->set("filename", filename));
 
@@ -2089,9 +2285,10 @@ VImage::magickload(const char *filename, VOption *options)
 VImage
 VImage::magickload_buffer(VipsBlob *buffer, VOption *options)
 {
+	static const VOperationType operation_type("magickload_buffer");
 	VImage out;
 
-	call("magickload_buffer", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("out", &out)
 			->set("buffer", buffer));
 
@@ -2101,9 +2298,10 @@ VImage::magickload_buffer(VipsBlob *buffer, VOption *options)
 VImage
 VImage::magickload_source(VSource source, VOption *options)
 {
+	static const VOperationType operation_type("magickload_source");
 	VImage out;
 
-	call("magickload_source", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("out", &out)
 			->set("source", source));
 
@@ -2113,7 +2311,9 @@ VImage::magickload_source(VSource source, VOption *options)
 void
 VImage::magicksave(const char *filename, VOption *options) const
 {
-	call("magicksave", (options ? options : VImage::option())
+	static const VOperationType operation_type("magicksave");
+
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("filename", filename));
 }
@@ -2121,9 +2321,10 @@ VImage::magicksave(const char *filename, VOption *options) const
 VipsBlob *
 VImage::magicksave_buffer(VOption *options) const
 {
+	static const VOperationType operation_type("magicksave_buffer");
 	VipsBlob *buffer;
 
-	call("magicksave_buffer", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("buffer", &buffer));
 
@@ -2133,9 +2334,10 @@ VImage::magicksave_buffer(VOption *options) const
 VImage
 VImage::mapim(VImage index, VOption *options) const
 {
+	static const VOperationType operation_type("mapim");
 	VImage out;
 
-	call("mapim", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out)
 			->set("index", index));
@@ -2146,9 +2348,10 @@ VImage::mapim(VImage index, VOption *options) const
 VImage
 VImage::maplut(VImage lut, VOption *options) const
 {
+	static const VOperationType operation_type("maplut");
 	VImage out;
 
-	call("maplut", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out)
 			->set("lut", lut));
@@ -2159,9 +2362,10 @@ VImage::maplut(VImage lut, VOption *options) const
 VImage
 VImage::mask_butterworth(int width, int height, double order, double frequency_cutoff, double amplitude_cutoff, VOption *options)
 {
+	static const VOperationType operation_type("mask_butterworth");
 	VImage out;
 
-	call("mask_butterworth", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("out", &out)
 			->set("width", width)
 			->set("height", height)
@@ -2175,9 +2379,10 @@ VImage::mask_butterworth(int width, int height, double order, double frequency_c
 VImage
 VImage::mask_butterworth_band(int width, int height, double order, double frequency_cutoff_x, double frequency_cutoff_y, double radius, double amplitude_cutoff, VOption *options)
 {
+	static const VOperationType operation_type("mask_butterworth_band");
 	VImage out;
 
-	call("mask_butterworth_band", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("out", &out)
 			->set("width", width)
 			->set("height", height)
@@ -2193,9 +2398,10 @@ VImage::mask_butterworth_band(int width, int height, double order, double freque
 VImage
 VImage::mask_butterworth_ring(int width, int height, double order, double frequency_cutoff, double amplitude_cutoff, double ringwidth, VOption *options)
 {
+	static const VOperationType operation_type("mask_butterworth_ring");
 	VImage out;
 
-	call("mask_butterworth_ring", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("out", &out)
 			->set("width", width)
 			->set("height", height)
@@ -2210,9 +2416,10 @@ VImage::mask_butterworth_ring(int width, int height, double order, double freque
 VImage
 VImage::mask_fractal(int width, int height, double fractal_dimension, VOption *options)
 {
+	static const VOperationType operation_type("mask_fractal");
 	VImage out;
 
-	call("mask_fractal", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("out", &out)
 			->set("width", width)
 			->set("height", height)
@@ -2224,9 +2431,10 @@ VImage::mask_fractal(int width, int height, double fractal_dimension, VOption *o
 VImage
 VImage::mask_gaussian(int width, int height, double frequency_cutoff, double amplitude_cutoff, VOption *options)
 {
+	static const VOperationType operation_type("mask_gaussian");
 	VImage out;
 
-	call("mask_gaussian", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("out", &out)
 			->set("width", width)
 			->set("height", height)
@@ -2239,9 +2447,10 @@ VImage::mask_gaussian(int width, int height, double frequency_cutoff, double amp
 VImage
 VImage::mask_gaussian_band(int width, int height, double frequency_cutoff_x, double frequency_cutoff_y, double radius, double amplitude_cutoff, VOption *options)
 {
+	static const VOperationType operation_type("mask_gaussian_band");
 	VImage out;
 
-	call("mask_gaussian_band", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("out", &out)
 			->set("width", width)
 			->set("height", height)
@@ -2256,9 +2465,10 @@ VImage::mask_gaussian_band(int width, int height, double frequency_cutoff_x, dou
 VImage
 VImage::mask_gaussian_ring(int width, int height, double frequency_cutoff, double amplitude_cutoff, double ringwidth, VOption *options)
 {
+	static const VOperationType operation_type("mask_gaussian_ring");
 	VImage out;
 
-	call("mask_gaussian_ring", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("out", &out)
 			->set("width", width)
 			->set("height", height)
@@ -2272,9 +2482,10 @@ VImage::mask_gaussian_ring(int width, int height, double frequency_cutoff, doubl
 VImage
 VImage::mask_ideal(int width, int height, double frequency_cutoff, VOption *options)
 {
+	static const VOperationType operation_type("mask_ideal");
 	VImage out;
 
-	call("mask_ideal", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("out", &out)
 			->set("width", width)
 			->set("height", height)
@@ -2286,9 +2497,10 @@ VImage::mask_ideal(int width, int height, double frequency_cutoff, VOption *opti
 VImage
 VImage::mask_ideal_band(int width, int height, double frequency_cutoff_x, double frequency_cutoff_y, double radius, VOption *options)
 {
+	static const VOperationType operation_type("mask_ideal_band");
 	VImage out;
 
-	call("mask_ideal_band", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("out", &out)
 			->set("width", width)
 			->set("height", height)
@@ -2302,9 +2514,10 @@ VImage::mask_ideal_band(int width, int height, double frequency_cutoff_x, double
 VImage
 VImage::mask_ideal_ring(int width, int height, double frequency_cutoff, double ringwidth, VOption *options)
 {
+	static const VOperationType operation_type("mask_ideal_ring");
 	VImage out;
 
-	call("mask_ideal_ring", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("out", &out)
 			->set("width", width)
 			->set("height", height)
@@ -2317,9 +2530,10 @@ VImage::mask_ideal_ring(int width, int height, double frequency_cutoff, double r
 VImage
 VImage::match(VImage sec, int xr1, int yr1, int xs1, int ys1, int xr2, int yr2, int xs2, int ys2, VOption *options) const
 {
+	static const VOperationType operation_type("match");
 	VImage out;
 
-	call("match", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("ref", *this)
 			->set("out", &out)
 			->set("sec", sec)
@@ -2338,9 +2552,10 @@ VImage::match(VImage sec, int xr1, int yr1, int xs1, int ys1, int xr2, int yr2,
 VImage
 VImage::math(VipsOperationMath math, VOption *options) const
 {
+	static const VOperationType operation_type("math");
 	VImage out;
 
-	call("math", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out)
 			->set("math", math));
@@ -2351,9 +2566,10 @@ VImage::math(VipsOperationMath math, VOption *options) const
 VImage
 VImage::math2(VImage right, VipsOperationMath2 math2, VOption *options) const
 {
+	static const VOperationType operation_type("math2");
 	VImage out;
 
-	call("math2", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("left", *this)
 			->set("out", &out)
 			->set("right", right)
@@ -2365,9 +2581,10 @@ VImage::math2(VImage right, VipsOperationMath2 math2, VOption *options) const
 VImage
 VImage::math2_const(VipsOperationMath2 math2, std::vector<double> c, VOption *options) const
 {
+	static const VOperationType operation_type("math2_const");
 	VImage out;
 
-	call("math2_const", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out)
 			->set("math2", math2)
@@ -2379,9 +2596,10 @@ VImage::math2_const(VipsOperationMath2 math2, std::vector<double> c, VOption *op
 VImage
 VImage::matload(const char *filename, VOption *options)
 {
+	static const VOperationType operation_type("matload");
 	VImage out;
 
-	call("matload", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("out", &out)
 			->set("filename", filename));
 
@@ -2391,9 +2609,10 @@ VImage::matload(const char *filename, VOption *options)
 VImage
 VImage::matrixinvert(VOption *options) const
 {
+	static const VOperationType operation_type("matrixinvert");
 	VImage out;
 
-	call("matrixinvert", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out));
 
@@ -2403,9 +2622,10 @@ VImage::matrixinvert(VOption *options) const
 VImage
 VImage::matrixload(const char *filename, VOption *options)
 {
+	static const VOperationType operation_type("matrixload");
 	VImage out;
 
-	call("matrixload", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("out", &out)
 			->set("filename", filename));
 
@@ -2415,9 +2635,10 @@ VImage::matrixload(const char *filename, VOption *options)
 VImage
 VImage::matrixload_source(VSource source, VOption *options)
 {
+	static const VOperationType operation_type("matrixload_source");
 	VImage out;
 
-	call("matrixload_source", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("out", &out)
 			->set("source", source));
 
@@ -2427,9 +2648,10 @@ VImage::matrixload_source(VSource source, VOption *options)
 VImage
 VImage::matrixmultiply(VImage right, VOption *options) const
 {
+	static const VOperationType operation_type("matrixmultiply");
 	VImage out;
 
-	call("matrixmultiply", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("left", *this)
 			->set("out", &out)
 			->set("right", right));
@@ -2440,14 +2662,18 @@ VImage::matrixmultiply(VImage right, VOption *options) const
 void
 VImage::matrixprint(VOption *options) const
 {
-	call("matrixprint", (options ? options : VImage::option())
+	static const VOperationType operation_type("matrixprint");
+
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this));
 }
 
 void
 VImage::matrixsave(const char *filename, VOption *options) const
 {
-	call("matrixsave", (options ? options : VImage::option())
+	static const VOperationType operation_type("matrixsave");
+
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("filename", filename));
 }
@@ -2455,7 +2681,9 @@ VImage::matrixsave(const char *filename, VOption *options) const
 void
 VImage::matrixsave_target(VTarget target, VOption *options) const
 {
-	call("matrixsave_target", (options ? options : VImage::option())
+	static const VOperationType operation_type("matrixsave_target");
+
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("target", target));
 }
@@ -2463,9 +2691,10 @@ VImage::matrixsave_target(VTarget target, VOption *options) const
 double
 VImage::max(VOption *options) const
 {
+	static const VOperationType operation_type("max");
 	double out;
 
-	call("max", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out));
 
@@ -2475,9 +2704,10 @@ VImage::max(VOption *options) const
 VImage
 VImage::maxpair(VImage right, VOption *options) const
 {
+	static const VOperationType operation_type("maxpair");
 	VImage out;
 
-	call("maxpair", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("left", *this)
 			->set("out", &out)
 			->set("right", right));
@@ -2488,9 +2718,10 @@ VImage::maxpair(VImage right, VOption *options) const
 VImage
 VImage::measure(int h, int v, VOption *options) const
 {
+	static const VOperationType operation_type("measure");
 	VImage out;
 
-	call("measure", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out)
 			->set("h", h)
@@ -2502,9 +2733,10 @@ VImage::measure(int h, int v, VOption *options) const
 VImage
 VImage::merge(VImage sec, VipsDirection direction, int dx, int dy, VOption *options) const
 {
+	static const VOperationType operation_type("merge");
 	VImage out;
 
-	call("merge", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("ref", *this)
 			->set("out", &out)
 			->set("sec", sec)
@@ -2518,9 +2750,10 @@ VImage::merge(VImage sec, VipsDirection direction, int dx, int dy, VOption *opti
 double
 VImage::min(VOption *options) const
 {
+	static const VOperationType operation_type("min");
 	double out;
 
-	call("min", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out));
 
@@ -2530,9 +2763,10 @@ VImage::min(VOption *options) const
 VImage
 VImage::minpair(VImage right, VOption *options) const
 {
+	static const VOperationType operation_type("minpair");
 	VImage out;
 
-	call("minpair", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("left", *this)
 			->set("out", &out)
 			->set("right", right));
@@ -2543,9 +2777,10 @@ VImage::minpair(VImage right, VOption *options) const
 VImage
 VImage::morph(VImage mask, VipsOperationMorphology morph, VOption *options) const
 {
+	static const VOperationType operation_type("morph");
 	VImage out;
 
-	call("morph", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out)
 			->set("mask", mask)
@@ -2557,9 +2792,10 @@ VImage::morph(VImage mask, VipsOperationMorphology morph, VOption *options) cons
 VImage
 VImage::mosaic(VImage sec, VipsDirection direction, int xref, int yref, int xsec, int ysec, VOption *options) const
 {
+	static const VOperationType operation_type("mosaic");
 	VImage out;
 
-	call("mosaic", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("ref", *this)
 			->set("out", &out)
 			->set("sec", sec)
@@ -2575,9 +2811,10 @@ VImage::mosaic(VImage sec, VipsDirection direction, int xref, int yref, int xsec
 VImage
 VImage::mosaic1(VImage sec, VipsDirection direction, int xr1, int yr1, int xs1, int ys1, int xr2, int yr2, int xs2, int ys2, VOption *options) const
 {
+	static const VOperationType operation_type("mosaic1");
 	VImage out;
 
-	call("mosaic1", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("ref", *this)
 			->set("out", &out)
 			->set("sec", sec)
@@ -2597,9 +2834,10 @@ VImage::mosaic1(VImage sec, VipsDirection direction, int xr1, int yr1, int xs1,
 VImage
 VImage::msb(VOption *options) const
 {
+	static const VOperationType operation_type("msb");
 	VImage out;
 
-	call("msb", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out));
 
@@ -2609,9 +2847,10 @@ VImage::msb(VOption *options) const
 VImage
 VImage::multiply(VImage right, VOption *options) const
 {
+	static const VOperationType operation_type("multiply");
 	VImage out;
 
-	call("multiply", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("left", *this)
 			->set("out", &out)
 			->set("right", right));
@@ -2622,9 +2861,10 @@ VImage::multiply(VImage right, VOption *options) const
 VImage
 VImage::niftiload(const char *filename, VOption *options)
 {
+	static const VOperationType operation_type("niftiload");
 	VImage out;
 
-	call("niftiload", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("out", &out)
 			->set("filename", filename));
 
@@ -2634,9 +2874,10 @@ VImage::niftiload(const char *filename, VOption *options)
 VImage
 VImage::niftiload_source(VSource source, VOption *options)
 {
+	static const VOperationType operation_type("niftiload_source");
 	VImage out;
 
-	call("niftiload_source", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("out", &out)
 			->set("source", source));
 
@@ -2646,7 +2887,9 @@ VImage::niftiload_source(VSource source, VOption *options)
 void
 VImage::niftisave(const char *filename, VOption *options) const
 {
-	call("niftisave", (options ? options : VImage::option())
+	static const VOperationType operation_type("niftisave");
+
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("filename", filename));
 }
@@ -2654,9 +2897,10 @@ VImage::niftisave(const char *filename, VOption *options) const
 VImage
 VImage::openexrload(const char *filename, VOption *options)
 {
+	static const VOperationType operation_type("openexrload");
 	VImage out;
 
-	call("openexrload", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("out", &out)
 			->set("filename", filename));
 
@@ -2666,9 +2910,10 @@ VImage::openexrload(const char *filename, VOption *options)
 VImage
 VImage::openslideload(const char *filename, VOption *options)
 {
+	static const VOperationType operation_type("openslideload");
 	VImage out;
 
-	call("openslideload", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("out", &out)
 			->set("filename", filename));
 
@@ -2678,9 +2923,10 @@ VImage::openslideload(const char *filename, VOption *options)
 VImage
 VImage::openslideload_source(VSource source, VOption *options)
 {
+	static const VOperationType operation_type("openslideload_source");
 	VImage out;
 
-	call("openslideload_source", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("out", &out)
 			->set("source", source));
 
@@ -2690,9 +2936,10 @@ VImage::openslideload_source(VSource source, VOption *options)
 VImage
 VImage::pdfload(const char *filename, VOption *options)
 {
+	static const VOperationType operation_type("pdfload");
 	VImage out;
 
-	call("pdfload", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("out", &out)
 			->set("filename", filename));
 
@@ -2702,9 +2949,10 @@ VImage::pdfload(const char *filename, VOption *options)
 VImage
 VImage::pdfload_buffer(VipsBlob *buffer, VOption *options)
 {
+	static const VOperationType operation_type("pdfload_buffer");
 	VImage out;
 
-	call("pdfload_buffer", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("out", &out)
 			->set("buffer", buffer));
 
@@ -2714,9 +2962,10 @@ VImage::pdfload_buffer(VipsBlob *buffer, VOption *options)
 VImage
 VImage::pdfload_source(VSource source, VOption *options)
 {
+	static const VOperationType operation_type("pdfload_source");
 	VImage out;
 
-	call("pdfload_source", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("out", &out)
 			->set("source", source));
 
@@ -2726,9 +2975,10 @@ VImage::pdfload_source(VSource source, VOption *options)
 int
 VImage::percent(double percent, VOption *options) const
 {
+	static const VOperationType operation_type("percent");
 	int threshold;
 
-	call("percent", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("threshold", &threshold)
 			->set("percent", percent));
@@ -2739,9 +2989,10 @@ VImage::percent(double percent, VOption *options) const
 VImage
 VImage::perlin(int width, int height, VOption *options)
 {
+	static const VOperationType operation_type("perlin");
 	VImage out;
 
-	call("perlin", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("out", &out)
 			->set("width", width)
 			->set("height", height));
@@ -2752,9 +3003,10 @@ VImage::perlin(int width, int height, VOption *options)
 VImage
 VImage::phasecor(VImage in2, VOption *options) const
 {
+	static const VOperationType operation_type("phasecor");
 	VImage out;
 
-	call("phasecor", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out)
 			->set("in2", in2));
@@ -2765,9 +3017,10 @@ VImage::phasecor(VImage in2, VOption *options) const
 VImage
 VImage::pngload(const char *filename, VOption *options)
 {
+	static const VOperationType operation_type("pngload");
 	VImage out;
 
-	call("pngload", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("out", &out)
 			->set("filename", filename));
 
@@ -2777,9 +3030,10 @@ VImage::pngload(const char *filename, VOption *options)
 VImage
 VImage::pngload_buffer(VipsBlob *buffer, VOption *options)
 {
+	static const VOperationType operation_type("pngload_buffer");
 	VImage out;
 
-	call("pngload_buffer", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("out", &out)
 			->set("buffer", buffer));
 
@@ -2789,9 +3043,10 @@ VImage::pngload_buffer(VipsBlob *buffer, VOption *options)
 VImage
 VImage::pngload_source(VSource source, VOption *options)
 {
+	static const VOperationType operation_type("pngload_source");
 	VImage out;
 
-	call("pngload_source", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("out", &out)
 			->set("source", source));
 
@@ -2801,7 +3056,9 @@ VImage::pngload_source(VSource source, VOption *options)
 void
 VImage::pngsave(const char *filename, VOption *options) const
 {
-	call("pngsave", (options ? options : VImage::option())
+	static const VOperationType operation_type("pngsave");
+
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("filename", filename));
 }
@@ -2809,9 +3066,10 @@ VImage::pngsave(const char *filename, VOption *options) const
 VipsBlob *
 VImage::pngsave_buffer(VOption *options) const
 {
+	static const VOperationType operation_type("pngsave_buffer");
 	VipsBlob *buffer;
 
-	call("pngsave_buffer", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("buffer", &buffer));
 
@@ -2821,7 +3079,9 @@ VImage::pngsave_buffer(VOption *options) const
 void
 VImage::pngsave_target(VTarget target, VOption *options) const
 {
-	call("pngsave_target", (options ? options : VImage::option())
+	static const VOperationType operation_type("pngsave_target");
+
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("target", target));
 }
@@ -2829,9 +3089,10 @@ VImage::pngsave_target(VTarget target, VOption *options) const
 VImage
 VImage::ppmload(const char *filename, VOption *options)
 {
+	static const VOperationType operation_type("ppmload");
 	VImage out;
 
-	call("ppmload", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("out", &out)
 			->set("filename", filename));
 
@@ -2841,9 +3102,10 @@ VImage::ppmload(const char *filename, VOption *options)
 VImage
 VImage::ppmload_buffer(VipsBlob *buffer, VOption *options)
 {
+	static const VOperationType operation_type("ppmload_buffer");
 	VImage out;
 
-	call("ppmload_buffer", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("out", &out)
 			->set("buffer", buffer));
 
@@ -2853,9 +3115,10 @@ VImage::ppmload_buffer(VipsBlob *buffer, VOption *options)
 VImage
 VImage::ppmload_source(VSource source, VOption *options)
 {
+	static const VOperationType operation_type("ppmload_source");
 	VImage out;
 
-	call("ppmload_source", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("out", &out)
 			->set("source", source));
 
@@ -2865,7 +3128,9 @@ VImage::ppmload_source(VSource source, VOption *options)
 void
 VImage::ppmsave(const char *filename, VOption *options) const
 {
-	call("ppmsave", (options ? options : VImage::option())
+	static const VOperationType operation_type("ppmsave");
+
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("filename", filename));
 }
@@ -2873,7 +3138,9 @@ VImage::ppmsave(const char *filename, VOption *options) const
 void
 VImage::ppmsave_target(VTarget target, VOption *options) const
 {
-	call("ppmsave_target", (options ? options : VImage::option())
+	static const VOperationType operation_type("ppmsave_target");
+
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("target", target));
 }
@@ -2881,9 +3148,10 @@ VImage::ppmsave_target(VTarget target, VOption *options) const
 VImage
 VImage::premultiply(VOption *options) const
 {
+	static const VOperationType operation_type("premultiply");
 	VImage out;
 
-	call("premultiply", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out));
 
@@ -2893,9 +3161,10 @@ VImage::premultiply(VOption *options) const
 VImage
 VImage::prewitt(VOption *options) const
 {
+	static const VOperationType operation_type("prewitt");
 	VImage out;
 
-	call("prewitt", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out));
 
@@ -2905,9 +3174,10 @@ VImage::prewitt(VOption *options) const
 VImage
 VImage::profile(VImage *rows, VOption *options) const
 {
+	static const VOperationType operation_type("profile");
 	VImage columns;
 
-	call("profile", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("columns", &columns)
 			->set("rows", rows));
@@ -2918,9 +3188,10 @@ VImage::profile(VImage *rows, VOption *options) const
 VipsBlob *
 VImage::profile_load(const char *name, VOption *options)
 {
+	static const VOperationType operation_type("profile_load");
 	VipsBlob *profile;
 
-	call("profile_load", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("profile", &profile)
 			->set("name", name));
 
@@ -2930,9 +3201,10 @@ VImage::profile_load(const char *name, VOption *options)
 VImage
 VImage::project(VImage *rows, VOption *options) const
 {
+	static const VOperationType operation_type("project");
 	VImage columns;
 
-	call("project", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("columns", &columns)
 			->set("rows", rows));
@@ -2943,9 +3215,10 @@ VImage::project(VImage *rows, VOption *options) const
 VImage
 VImage::quadratic(VImage coeff, VOption *options) const
 {
+	static const VOperationType operation_type("quadratic");
 	VImage out;
 
-	call("quadratic", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out)
 			->set("coeff", coeff));
@@ -2956,9 +3229,10 @@ VImage::quadratic(VImage coeff, VOption *options) const
 VImage
 VImage::rad2float(VOption *options) const
 {
+	static const VOperationType operation_type("rad2float");
 	VImage out;
 
-	call("rad2float", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out));
 
@@ -2968,9 +3242,10 @@ VImage::rad2float(VOption *options) const
 VImage
 VImage::radload(const char *filename, VOption *options)
 {
+	static const VOperationType operation_type("radload");
 	VImage out;
 
-	call("radload", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("out", &out)
 			->set("filename", filename));
 
@@ -2980,9 +3255,10 @@ VImage::radload(const char *filename, VOption *options)
 VImage
 VImage::radload_buffer(VipsBlob *buffer, VOption *options)
 {
+	static const VOperationType operation_type("radload_buffer");
 	VImage out;
 
-	call("radload_buffer", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("out", &out)
 			->set("buffer", buffer));
 
@@ -2992,9 +3268,10 @@ VImage::radload_buffer(VipsBlob *buffer, VOption *options)
 VImage
 VImage::radload_source(VSource source, VOption *options)
 {
+	static const VOperationType operation_type("radload_source");
 	VImage out;
 
-	call("radload_source", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("out", &out)
 			->set("source", source));
 
@@ -3004,7 +3281,9 @@ VImage::radload_source(VSource source, VOption *options)
 void
 VImage::radsave(const char *filename, VOption *options) const
 {
-	call("radsave", (options ? options : VImage::option())
+	static const VOperationType operation_type("radsave");
+
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("filename", filename));
 }
@@ -3012,9 +3291,10 @@ VImage::radsave(const char *filename, VOption *options) const
 VipsBlob *
 VImage::radsave_buffer(VOption *options) const
 {
+	static const VOperationType operation_type("radsave_buffer");
 	VipsBlob *buffer;
 
-	call("radsave_buffer", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("buffer", &buffer));
 
@@ -3024,7 +3304,9 @@ VImage::radsave_buffer(VOption *options) const
 void
 VImage::radsave_target(VTarget target, VOption *options) const
 {
-	call("radsave_target", (options ? options : VImage::option())
+	static const VOperationType operation_type("radsave_target");
+
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("target", target));
 }
@@ -3032,9 +3314,10 @@ VImage::radsave_target(VTarget target, VOption *options) const
 VImage
 VImage::rank(int width, int height, int index, VOption *options) const
 {
+	static const VOperationType operation_type("rank");
 	VImage out;
 
-	call("rank", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out)
 			->set("width", width)
@@ -3047,9 +3330,10 @@ VImage::rank(int width, int height, int index, VOption *options) const
 VImage
 VImage::rawload(const char *filename, int width, int height, int bands, VOption *options)
 {
+	static const VOperationType operation_type("rawload");
 	VImage out;
 
-	call("rawload", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("out", &out)
 			->set("filename", filename)
 			->set("width", width)
@@ -3062,7 +3346,9 @@ VImage::rawload(const char *filename, int width, int height, int bands, VOption
 void
 VImage::rawsave(const char *filename, VOption *options) const
 {
-	call("rawsave", (options ? options : VImage::option())
+	static const VOperationType operation_type("rawsave");
+
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("filename", filename));
 }
@@ -3070,9 +3356,10 @@ VImage::rawsave(const char *filename, VOption *options) const
 VipsBlob *
 VImage::rawsave_buffer(VOption *options) const
 {
+	static const VOperationType operation_type("rawsave_buffer");
 	VipsBlob *buffer;
 
-	call("rawsave_buffer", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("buffer", &buffer));
 
@@ -3082,7 +3369,9 @@ VImage::rawsave_buffer(VOption *options) const
 void
 VImage::rawsave_target(VTarget target, VOption *options) const
 {
-	call("rawsave_target", (options ? options : VImage::option())
+	static const VOperationType operation_type("rawsave_target");
+
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("target", target));
 }
@@ -3090,9 +3379,10 @@ VImage::rawsave_target(VTarget target, VOption *options) const
 VImage
 VImage::recomb(VImage m, VOption *options) const
 {
+	static const VOperationType operation_type("recomb");
 	VImage out;
 
-	call("recomb", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out)
 			->set("m", m));
@@ -3103,9 +3393,10 @@ VImage::recomb(VImage m, VOption *options) const
 VImage
 VImage::reduce(double hshrink, double vshrink, VOption *options) const
 {
+	static const VOperationType operation_type("reduce");
 	VImage out;
 
-	call("reduce", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out)
 			->set("hshrink", hshrink)
@@ -3117,9 +3408,10 @@ VImage::reduce(double hshrink, double vshrink, VOption *options) const
 VImage
 VImage::reduceh(double hshrink, VOption *options) const
 {
+	static const VOperationType operation_type("reduceh");
 	VImage out;
 
-	call("reduceh", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out)
 			->set("hshrink", hshrink));
@@ -3130,9 +3422,10 @@ VImage::reduceh(double hshrink, VOption *options) const
 VImage
 VImage::reducev(double vshrink, VOption *options) const
 {
+	static const VOperationType operation_type("reducev");
 	VImage out;
 
-	call("reducev", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out)
 			->set("vshrink", vshrink));
@@ -3143,9 +3436,10 @@ VImage::reducev(double vshrink, VOption *options) const
 VImage
 VImage::relational(VImage right, VipsOperationRelational relational, VOption *options) const
 {
+	static const VOperationType operation_type("relational");
 	VImage out;
 
-	call("relational", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("left", *this)
 			->set("out", &out)
 			->set("right", right)
@@ -3157,9 +3451,10 @@ VImage::relational(VImage right, VipsOperationRelational relational, VOption *op
 VImage
 VImage::relational_const(VipsOperationRelational relational, std::vector<double> c, VOption *options) const
 {
+	static const VOperationType operation_type("relational_const");
 	VImage out;
 
-	call("relational_const", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out)
 			->set("relational", relational)
@@ -3171,9 +3466,10 @@ VImage::relational_const(VipsOperationRelational relational, std::vector<double>
 VImage
 VImage::remainder(VImage right, VOption *options) const
 {
+	static const VOperationType operation_type("remainder");
 	VImage out;
 
-	call("remainder", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("left", *this)
 			->set("out", &out)
 			->set("right", right));
@@ -3184,9 +3480,10 @@ VImage::remainder(VImage right, VOption *options) const
 VImage
 VImage::remainder_const(std::vector<double> c, VOption *options) const
 {
+	static const VOperationType operation_type("remainder_const");
 	VImage out;
 
-	call("remainder_const", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out)
 			->set("c", c));
@@ -3197,9 +3494,10 @@ VImage::remainder_const(std::vector<double> c, VOption *options) const
 VImage
 VImage::remosaic(const char *old_str, const char *new_str, VOption *options) const
 {
+	static const VOperationType operation_type("remosaic");
 	VImage out;
 
-	call("remosaic", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out)
 			->set("old_str", old_str)
@@ -3211,9 +3509,10 @@ VImage::remosaic(const char *old_str, const char *new_str, VOption *options) con
 VImage
 VImage::replicate(int across, int down, VOption *options) const
 {
+	static const VOperationType operation_type("replicate");
 	VImage out;
 
-	call("replicate", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out)
 			->set("across", across)
@@ -3225,9 +3524,10 @@ VImage::replicate(int across, int down, VOption *options) const
 VImage
 VImage::resize(double scale, VOption *options) const
 {
+	static const VOperationType operation_type("resize");
 	VImage out;
 
-	call("resize", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out)
 			->set("scale", scale));
@@ -3238,9 +3538,10 @@ VImage::resize(double scale, VOption *options) const
 VImage
 VImage::rot(VipsAngle angle, VOption *options) const
 {
+	static const VOperationType operation_type("rot");
 	VImage out;
 
-	call("rot", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out)
 			->set("angle", angle));
@@ -3251,9 +3552,10 @@ VImage::rot(VipsAngle angle, VOption *options) const
 VImage
 VImage::rot45(VOption *options) const
 {
+	static const VOperationType operation_type("rot45");
 	VImage out;
 
-	call("rot45", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out));
 
@@ -3263,9 +3565,10 @@ VImage::rot45(VOption *options) const
 VImage
 VImage::rotate(double angle, VOption *options) const
 {
+	static const VOperationType operation_type("rotate");
 	VImage out;
 
-	call("rotate", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out)
 			->set("angle", angle));
@@ -3276,9 +3579,10 @@ VImage::rotate(double angle, VOption *options) const
 VImage
 VImage::round(VipsOperationRound round, VOption *options) const
 {
+	static const VOperationType operation_type("round");
 	VImage out;
 
-	call("round", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out)
 			->set("round", round));
@@ -3289,9 +3593,10 @@ VImage::round(VipsOperationRound round, VOption *options) const
 VImage
 VImage::sRGB2HSV(VOption *options) const
 {
+	static const VOperationType operation_type("sRGB2HSV");
 	VImage out;
 
-	call("sRGB2HSV", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out));
 
@@ -3301,9 +3606,10 @@ VImage::sRGB2HSV(VOption *options) const
 VImage
 VImage::sRGB2scRGB(VOption *options) const
 {
+	static const VOperationType operation_type("sRGB2scRGB");
 	VImage out;
 
-	call("sRGB2scRGB", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out));
 
@@ -3313,9 +3619,10 @@ VImage::sRGB2scRGB(VOption *options) const
 VImage
 VImage::scRGB2BW(VOption *options) const
 {
+	static const VOperationType operation_type("scRGB2BW");
 	VImage out;
 
-	call("scRGB2BW", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out));
 
@@ -3325,9 +3632,10 @@ VImage::scRGB2BW(VOption *options) const
 VImage
 VImage::scRGB2XYZ(VOption *options) const
 {
+	static const VOperationType operation_type("scRGB2XYZ");
 	VImage out;
 
-	call("scRGB2XYZ", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out));
 
@@ -3337,9 +3645,10 @@ VImage::scRGB2XYZ(VOption *options) const
 VImage
 VImage::scRGB2sRGB(VOption *options) const
 {
+	static const VOperationType operation_type("scRGB2sRGB");
 	VImage out;
 
-	call("scRGB2sRGB", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out));
 
@@ -3349,9 +3658,10 @@ VImage::scRGB2sRGB(VOption *options) const
 VImage
 VImage::scale(VOption *options) const
 {
+	static const VOperationType operation_type("scale");
 	VImage out;
 
-	call("scale", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out));
 
@@ -3361,9 +3671,10 @@ VImage::scale(VOption *options) const
 VImage
 VImage::scharr(VOption *options) const
 {
+	static const VOperationType operation_type("scharr");
 	VImage out;
 
-	call("scharr", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out));
 
@@ -3373,9 +3684,10 @@ VImage::scharr(VOption *options) const
 VImage
 VImage::sdf(int width, int height, VipsSdfShape shape, VOption *options)
 {
+	static const VOperationType operation_type("sdf");
 	VImage out;
 
-	call("sdf", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("out", &out)
 			->set("width", width)
 			->set("height", height)
@@ -3387,9 +3699,10 @@ VImage::sdf(int width, int height, VipsSdfShape shape, VOption *options)
 VImage
 VImage::sequential(VOption *options) const
 {
+	static const VOperationType operation_type("sequential");
 	VImage out;
 
-	call("sequential", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out));
 
@@ -3399,9 +3712,10 @@ VImage::sequential(VOption *options) const
 VImage
 VImage::sharpen(VOption *options) const
 {
+	static const VOperationType operation_type("sharpen");
 	VImage out;
 
-	call("sharpen", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out));
 
@@ -3411,9 +3725,10 @@ VImage::sharpen(VOption *options) const
 VImage
 VImage::shrink(double hshrink, double vshrink, VOption *options) const
 {
+	static const VOperationType operation_type("shrink");
 	VImage out;
 
-	call("shrink", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out)
 			->set("hshrink", hshrink)
@@ -3425,9 +3740,10 @@ VImage::shrink(double hshrink, double vshrink, VOption *options) const
 VImage
 VImage::shrinkh(int hshrink, VOption *options) const
 {
+	static const VOperationType operation_type("shrinkh");
 	VImage out;
 
-	call("shrinkh", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out)
 			->set("hshrink", hshrink));
@@ -3438,9 +3754,10 @@ VImage::shrinkh(int hshrink, VOption *options) const
 VImage
 VImage::shrinkv(int vshrink, VOption *options) const
 {
+	static const VOperationType operation_type("shrinkv");
 	VImage out;
 
-	call("shrinkv", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out)
 			->set("vshrink", vshrink));
@@ -3451,9 +3768,10 @@ VImage::shrinkv(int vshrink, VOption *options) const
 VImage
 VImage::sign(VOption *options) const
 {
+	static const VOperationType operation_type("sign");
 	VImage out;
 
-	call("sign", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out));
 
@@ -3463,9 +3781,10 @@ VImage::sign(VOption *options) const
 VImage
 VImage::similarity(VOption *options) const
 {
+	static const VOperationType operation_type("similarity");
 	VImage out;
 
-	call("similarity", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out));
 
@@ -3475,9 +3794,10 @@ VImage::similarity(VOption *options) const
 VImage
 VImage::sines(int width, int height, VOption *options)
 {
+	static const VOperationType operation_type("sines");
 	VImage out;
 
-	call("sines", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("out", &out)
 			->set("width", width)
 			->set("height", height));
@@ -3488,9 +3808,10 @@ VImage::sines(int width, int height, VOption *options)
 VImage
 VImage::smartcrop(int width, int height, VOption *options) const
 {
+	static const VOperationType operation_type("smartcrop");
 	VImage out;
 
-	call("smartcrop", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("input", *this)
 			->set("out", &out)
 			->set("width", width)
@@ -3502,9 +3823,10 @@ VImage::smartcrop(int width, int height, VOption *options) const
 VImage
 VImage::sobel(VOption *options) const
 {
+	static const VOperationType operation_type("sobel");
 	VImage out;
 
-	call("sobel", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out));
 
@@ -3514,9 +3836,10 @@ VImage::sobel(VOption *options) const
 VImage
 VImage::spcor(VImage ref, VOption *options) const
 {
+	static const VOperationType operation_type("spcor");
 	VImage out;
 
-	call("spcor", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out)
 			->set("ref", ref));
@@ -3527,9 +3850,10 @@ VImage::spcor(VImage ref, VOption *options) const
 VImage
 VImage::spectrum(VOption *options) const
 {
+	static const VOperationType operation_type("spectrum");
 	VImage out;
 
-	call("spectrum", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out));
 
@@ -3539,9 +3863,10 @@ VImage::spectrum(VOption *options) const
 VImage
 VImage::stats(VOption *options) const
 {
+	static const VOperationType operation_type("stats");
 	VImage out;
 
-	call("stats", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out));
 
@@ -3551,9 +3876,10 @@ VImage::stats(VOption *options) const
 VImage
 VImage::stdif(int width, int height, VOption *options) const
 {
+	static const VOperationType operation_type("stdif");
 	VImage out;
 
-	call("stdif", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out)
 			->set("width", width)
@@ -3565,9 +3891,10 @@ VImage::stdif(int width, int height, VOption *options) const
 VImage
 VImage::subsample(int xfac, int yfac, VOption *options) const
 {
+	static const VOperationType operation_type("subsample");
 	VImage out;
 
-	call("subsample", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("input", *this)
 			->set("out", &out)
 			->set("xfac", xfac)
@@ -3579,9 +3906,10 @@ VImage::subsample(int xfac, int yfac, VOption *options) const
 VImage
 VImage::subtract(VImage right, VOption *options) const
 {
+	static const VOperationType operation_type("subtract");
 	VImage out;
 
-	call("subtract", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("left", *this)
 			->set("out", &out)
 			->set("right", right));
@@ -3592,9 +3920,10 @@ VImage::subtract(VImage right, VOption *options) const
 VImage
 VImage::sum(std::vector<VImage> in, VOption *options)
 {
+	static const VOperationType operation_type("sum");
 	VImage out;
 
-	call("sum", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("out", &out)
 			->set("in", in));
 
@@ -3604,9 +3933,10 @@ VImage::sum(std::vector<VImage> in, VOption *options)
 VImage
 VImage::svgload(const char *filename, VOption *options)
 {
+	static const VOperationType operation_type("svgload");
 	VImage out;
 
-	call("svgload", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("out", &out)
 			->set("filename", filename));
 
@@ -3616,9 +3946,10 @@ VImage::svgload(const char *filename, VOption *options)
 VImage
 VImage::svgload_buffer(VipsBlob *buffer, VOption *options)
 {
+	static const VOperationType operation_type("svgload_buffer");
 	VImage out;
 
-	call("svgload_buffer", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("out", &out)
 			->set("buffer", buffer));
 
@@ -3628,9 +3959,10 @@ VImage::svgload_buffer(VipsBlob *buffer, VOption *options)
 VImage
 VImage::svgload_source(VSource source, VOption *options)
 {
+	static const VOperationType operation_type("svgload_source");
 	VImage out;
 
-	call("svgload_source", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("out", &out)
 			->set("source", source));
 
@@ -3640,9 +3972,10 @@ VImage::svgload_source(VSource source, VOption *options)
 VImage
 VImage::switch_image(std::vector<VImage> tests, VOption *options)
 {
+	static const VOperationType operation_type("switch");
 	VImage out;
 
-	call("switch", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("out", &out)
 			->set("tests", tests));
 
@@ -3652,16 +3985,19 @@ VImage::switch_image(std::vector<VImage> tests, VOption *options)
 void
 VImage::system(const char *cmd_format, VOption *options)
 {
-	call("system", (options ? options : VImage::option())
+	static const VOperationType operation_type("system");
+
+	call(operation_type, (options ? options : VImage::option())
 			->set("cmd_format", cmd_format));
 }
 
 VImage
 VImage::text(const char *text, VOption *options)
 {
+	static const VOperationType operation_type("text");
 	VImage out;
 
-	call("text", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("out", &out)
 			->set("text", text));
 
@@ -3671,9 +4007,10 @@ VImage::text(const char *text, VOption *options)
 VImage
 VImage::thumbnail(const char *filename, int width, VOption *options)
 {
+	static const VOperationType operation_type("thumbnail");
 	VImage out;
 
-	call("thumbnail", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("out", &out)
 			->set("filename", filename)
 			->set("width", width));
@@ -3684,9 +4021,10 @@ VImage::thumbnail(const char *filename, int width, VOption *options)
 VImage
 VImage::thumbnail_buffer(VipsBlob *buffer, int width, VOption *options)
 {
+	static const VOperationType operation_type("thumbnail_buffer");
 	VImage out;
 
-	call("thumbnail_buffer", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("out", &out)
 			->set("buffer", buffer)
 			->set("width", width));
@@ -3697,9 +4035,10 @@ VImage::thumbnail_buffer(VipsBlob *buffer, int width, VOption *options)
 VImage
 VImage::thumbnail_image(int width, VOption *options) const
 {
+	static const VOperationType operation_type("thumbnail_image");
 	VImage out;
 
-	call("thumbnail_image", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out)
 			->set("width", width));
@@ -3710,9 +4049,10 @@ VImage::thumbnail_image(int width, VOption *options) const
 VImage
 VImage::thumbnail_source(VSource source, int width, VOption *options)
 {
+	static const VOperationType operation_type("thumbnail_source");
 	VImage out;
 
-	call("thumbnail_source", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("out", &out)
 			->set("source", source)
 			->set("width", width));
@@ -3723,9 +4063,10 @@ VImage::thumbnail_source(VSource source, int width, VOption *options)
 VImage
 VImage::tiffload(const char *filename, VOption *options)
 {
+	static const VOperationType operation_type("tiffload");
 	VImage out;
 
-	call("tiffload", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("out", &out)
 			->set("filename", filename));
 
@@ -3735,9 +4076,10 @@ VImage::tiffload(const char *filename, VOption *options)
 VImage
 VImage::tiffload_buffer(VipsBlob *buffer, VOption *options)
 {
+	static const VOperationType operation_type("tiffload_buffer");
 	VImage out;
 
-	call("tiffload_buffer", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("out", &out)
 			->set("buffer", buffer));
 
@@ -3747,9 +4089,10 @@ VImage::tiffload_buffer(VipsBlob *buffer, VOption *options)
 VImage
 VImage::tiffload_source(VSource source, VOption *options)
 {
+	static const VOperationType operation_type("tiffload_source");
 	VImage out;
 
-	call("tiffload_source", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("out", &out)
 			->set("source", source));
 
@@ -3759,7 +4102,9 @@ VImage::tiffload_source(VSource source, VOption *options)
 void
 VImage::tiffsave(const char *filename, VOption *options) const
 {
-	call("tiffsave", (options ? options : VImage::option())
+	static const VOperationType operation_type("tiffsave");
+
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("filename", filename));
 }
@@ -3767,9 +4112,10 @@ VImage::tiffsave(const char *filename, VOption *options) const
 VipsBlob *
 VImage::tiffsave_buffer(VOption *options) const
 {
+	static const VOperationType operation_type("tiffsave_buffer");
 	VipsBlob *buffer;
 
-	call("tiffsave_buffer", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("buffer", &buffer));
 
@@ -3779,7 +4125,9 @@ VImage::tiffsave_buffer(VOption *options) const
 void
 VImage::tiffsave_target(VTarget target, VOption *options) const
 {
-	call("tiffsave_target", (options ? options : VImage::option())
+	static const VOperationType operation_type("tiffsave_target");
+
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("target", target));
 }
@@ -3787,9 +4135,10 @@ VImage::tiffsave_target(VTarget target, VOption *options) const
 VImage
 VImage::tilecache(VOption *options) const
 {
+	static const VOperationType operation_type("tilecache");
 	VImage out;
 
-	call("tilecache", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out));
 
@@ -3799,9 +4148,10 @@ VImage::tilecache(VOption *options) const
 VImage
 VImage::tonelut(VOption *options)
 {
+	static const VOperationType operation_type("tonelut");
 	VImage out;
 
-	call("tonelut", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("out", &out));
 
 	return out;
@@ -3810,9 +4160,10 @@ VImage::tonelut(VOption *options)
 VImage
 VImage::transpose3d(VOption *options) const
 {
+	static const VOperationType operation_type("transpose3d");
 	VImage out;
 
-	call("transpose3d", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out));
 
@@ -3822,9 +4173,10 @@ VImage::transpose3d(VOption *options) const
 VImage
 VImage::uhdr2scRGB(VOption *options) const
 {
+	static const VOperationType operation_type("uhdr2scRGB");
 	VImage out;
 
-	call("uhdr2scRGB", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out));
 
@@ -3834,9 +4186,10 @@ VImage::uhdr2scRGB(VOption *options) const
 VImage
 VImage::uhdrload(const char *filename, VOption *options)
 {
+	static const VOperationType operation_type("uhdrload");
 	VImage out;
 
-	call("uhdrload", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("out", &out)
 			->set("filename", filename));
 
@@ -3846,9 +4199,10 @@ VImage::uhdrload(const char *filename, VOption *options)
 VImage
 VImage::uhdrload_buffer(VipsBlob *buffer, VOption *options)
 {
+	static const VOperationType operation_type("uhdrload_buffer");
 	VImage out;
 
-	call("uhdrload_buffer", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("out", &out)
 			->set("buffer", buffer));
 
@@ -3858,9 +4212,10 @@ VImage::uhdrload_buffer(VipsBlob *buffer, VOption *options)
 VImage
 VImage::uhdrload_source(VSource source, VOption *options)
 {
+	static const VOperationType operation_type("uhdrload_source");
 	VImage out;
 
-	call("uhdrload_source", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("out", &out)
 			->set("source", source));
 
@@ -3870,7 +4225,9 @@ VImage::uhdrload_source(VSource source, VOption *options)
 void
 VImage::uhdrsave(const char *filename, VOption *options) const
 {
-	call("uhdrsave", (options ? options : VImage::option())
+	static const VOperationType operation_type("uhdrsave");
+
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("filename", filename));
 }
@@ -3878,9 +4235,10 @@ VImage::uhdrsave(const char *filename, VOption *options) const
 VipsBlob *
 VImage::uhdrsave_buffer(VOption *options) const
 {
+	static const VOperationType operation_type("uhdrsave_buffer");
 	VipsBlob *buffer;
 
-	call("uhdrsave_buffer", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("buffer", &buffer));
 
@@ -3890,7 +4248,9 @@ VImage::uhdrsave_buffer(VOption *options) const
 void
 VImage::uhdrsave_target(VTarget target, VOption *options) const
 {
-	call("uhdrsave_target", (options ? options : VImage::option())
+	static const VOperationType operation_type("uhdrsave_target");
+
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("target", target));
 }
@@ -3898,9 +4258,10 @@ VImage::uhdrsave_target(VTarget target, VOption *options) const
 VImage
 VImage::unpremultiply(VOption *options) const
 {
+	static const VOperationType operation_type("unpremultiply");
 	VImage out;
 
-	call("unpremultiply", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out));
 
@@ -3910,9 +4271,10 @@ VImage::unpremultiply(VOption *options) const
 VImage
 VImage::vipsload(const char *filename, VOption *options)
 {
+	static const VOperationType operation_type("vipsload");
 	VImage out;
 
-	call("vipsload", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("out", &out)
 			->set("filename", filename));
 
@@ -3922,9 +4284,10 @@ VImage::vipsload(const char *filename, VOption *options)
 VImage
 VImage::vipsload_source(VSource source, VOption *options)
 {
+	static const VOperationType operation_type("vipsload_source");
 	VImage out;
 
-	call("vipsload_source", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("out", &out)
 			->set("source", source));
 
@@ -3934,7 +4297,9 @@ VImage::vipsload_source(VSource source, VOption *options)
 void
 VImage::vipssave(const char *filename, VOption *options) const
 {
-	call("vipssave", (options ? options : VImage::option())
+	static const VOperationType operation_type("vipssave");
+
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("filename", filename));
 }
@@ -3942,7 +4307,9 @@ VImage::vipssave(const char *filename, VOption *options) const
 void
 VImage::vipssave_target(VTarget target, VOption *options) const
 {
-	call("vipssave_target", (options ? options : VImage::option())
+	static const VOperationType operation_type("vipssave_target");
+
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("target", target));
 }
@@ -3950,9 +4317,10 @@ VImage::vipssave_target(VTarget target, VOption *options) const
 VImage
 VImage::webpload(const char *filename, VOption *options)
 {
+	static const VOperationType operation_type("webpload");
 	VImage out;
 
-	call("webpload", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("out", &out)
 			->set("filename", filename));
 
@@ -3962,9 +4330,10 @@ VImage::webpload(const char *filename, VOption *options)
 VImage
 VImage::webpload_buffer(VipsBlob *buffer, VOption *options)
 {
+	static const VOperationType operation_type("webpload_buffer");
 	VImage out;
 
-	call("webpload_buffer", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("out", &out)
 			->set("buffer", buffer));
 
@@ -3974,9 +4343,10 @@ VImage::webpload_buffer(VipsBlob *buffer, VOption *options)
 VImage
 VImage::webpload_source(VSource source, VOption *options)
 {
+	static const VOperationType operation_type("webpload_source");
 	VImage out;
 
-	call("webpload_source", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("out", &out)
 			->set("source", source));
 
@@ -3986,7 +4356,9 @@ VImage::webpload_source(VSource source, VOption *options)
 void
 VImage::webpsave(const char *filename, VOption *options) const
 {
-	call("webpsave", (options ? options : VImage::option())
+	static const VOperationType operation_type("webpsave");
+
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("filename", filename));
 }
@@ -3994,9 +4366,10 @@ VImage::webpsave(const char *filename, VOption *options) const
 VipsBlob *
 VImage::webpsave_buffer(VOption *options) const
 {
+	static const VOperationType operation_type("webpsave_buffer");
 	VipsBlob *buffer;
 
-	call("webpsave_buffer", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("buffer", &buffer));
 
@@ -4006,14 +4379,18 @@ VImage::webpsave_buffer(VOption *options) const
 void
 VImage::webpsave_mime(VOption *options) const
 {
-	call("webpsave_mime", (options ? options : VImage::option())
+	static const VOperationType operation_type("webpsave_mime");
+
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this));
 }
 
 void
 VImage::webpsave_target(VTarget target, VOption *options) const
 {
-	call("webpsave_target", (options ? options : VImage::option())
+	static const VOperationType operation_type("webpsave_target");
+
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("target", target));
 }
@@ -4021,9 +4398,10 @@ VImage::webpsave_target(VTarget target, VOption *options) const
 VImage
 VImage::worley(int width, int height, VOption *options)
 {
+	static const VOperationType operation_type("worley");
 	VImage out;
 
-	call("worley", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("out", &out)
 			->set("width", width)
 			->set("height", height));
@@ -4034,9 +4412,10 @@ VImage::worley(int width, int height, VOption *options)
 VImage
 VImage::wrap(VOption *options) const
 {
+	static const VOperationType operation_type("wrap");
 	VImage out;
 
-	call("wrap", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("in", *this)
 			->set("out", &out));
 
@@ -4046,9 +4425,10 @@ VImage::wrap(VOption *options) const
 VImage
 VImage::xyz(int width, int height, VOption *options)
 {
+	static const VOperationType operation_type("xyz");
 	VImage out;
 
-	call("xyz", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("out", &out)
 			->set("width", width)
 			->set("height", height));
@@ -4059,9 +4439,10 @@ VImage::xyz(int width, int height, VOption *options)
 VImage
 VImage::zone(int width, int height, VOption *options)
 {
+	static const VOperationType operation_type("zone");
 	VImage out;
 
-	call("zone", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("out", &out)
 			->set("width", width)
 			->set("height", height));
@@ -4072,9 +4453,10 @@ VImage::zone(int width, int height, VOption *options)
 VImage
 VImage::zoom(int xfac, int yfac, VOption *options) const
 {
+	static const VOperationType operation_type("zoom");
 	VImage out;
 
-	call("zoom", (options ? options : VImage::option())
+	call(operation_type, (options ? options : VImage::option())
 			->set("input", *this)
 			->set("out", &out)
 			->set("xfac", xfac)
@@ -142,6 +142,24 @@ vips_abs_buffer(VipsArithmetic *arithmetic,
 	const int bands = vips_image_get_bands(im);
 	int sz = width * bands;
 
+#ifdef HAVE_HWY
+	if (arithmetic->vector)
+		switch (vips_image_get_format(im)) {
+		case VIPS_FORMAT_CHAR:
+			vips_abs_char_hwy(out, in[0], sz);
+			return;
+		case VIPS_FORMAT_SHORT:
+			vips_abs_short_hwy(out, in[0], sz);
+			return;
+		case VIPS_FORMAT_FLOAT:
+			vips_abs_float_hwy(out, in[0], sz);
+			return;
+
+		default:
+			break;
+		}
+#endif /*HAVE_HWY*/
+
 	switch (vips_image_get_format(im)) {
 	case VIPS_FORMAT_CHAR:
 		ABS_INT(signed char);
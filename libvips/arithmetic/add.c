@@ -122,6 +122,24 @@ add_buffer(VipsArithmetic *arithmetic, VipsPel *out, VipsPel **in, int width)
 
 	int x;
 
+#ifdef HAVE_HWY
+	if (arithmetic->vector)
+		switch (vips_image_get_format(im)) {
+		case VIPS_FORMAT_UCHAR:
+			vips_add_uchar_hwy(out, in[0], in[1], sz);
+			return;
+		case VIPS_FORMAT_USHORT:
+			vips_add_ushort_hwy(out, in[0], in[1], sz);
+			return;
+		case VIPS_FORMAT_FLOAT:
+			vips_add_float_hwy(out, in[0], in[1], sz);
+			return;
+
+		default:
+			break;
+		}
+#endif /*HAVE_HWY*/
+
 	/* Add all input types. Keep types here in sync with
 	 * vips_add_format_table[] below.
 	 */
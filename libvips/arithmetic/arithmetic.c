@@ -51,6 +51,7 @@
 #include <math.h>
 
 #include <vips/vips.h>
+#include <vips/vector.h>
 #include <vips/internal.h>
 
 #include "parithmetic.h"
@@ -310,81 +311,227 @@ vips__bandalike(const char *domain,
 	return 0;
 }
 
-/* Our sequence value.
+/* Don't fuse chains longer than this, it'd recurse too deeply.
  */
-typedef struct {
+#define MAX_FUSE_DEPTH (8)
+
+/* Set from VIPS_NOFUSE to turn fusion off.
+ */
+static gboolean vips__arithmetic_nofuse = FALSE;
+
+/* One operation in a fused chain. The root node writes to the output
+ * region, interior nodes compute a scanline into @line for their parent. An
+ * input is either a region, or another node run inline.
+ */
+typedef struct _VipsArithmeticNode {
 	VipsArithmetic *arithmetic;
+	int n;
 
-	/* Set of input regions.
+	/* For each input, a region, or NULL for fused inputs.
 	 */
 	VipsRegion **ir;
 
-	/* For each input, an input pointer.
+	/* For each input, the node we run inline, or NULL for region inputs.
+	 */
+	struct _VipsArithmeticNode **child;
+
+	/* Row pointers for region inputs, and the pointers we pass to
+	 * process_line, NULL-terminated.
 	 */
+	VipsPel **row;
 	VipsPel **p;
 
-} VipsArithmeticSequence;
+	/* The scanline our parent reads from. NULL for the root.
+	 */
+	VipsPel *line;
+	size_t line_size;
 
-static int
-vips_arithmetic_stop(void *vseq, void *a, void *b)
-{
-	VipsArithmeticSequence *seq = (VipsArithmeticSequence *) vseq;
+	/* TRUE if any input is fused.
+	 */
+	gboolean fused;
+} VipsArithmeticNode;
 
-	if (seq->ir) {
-		int i;
+/* Our sequence value.
+ */
+typedef struct {
+	VipsArithmetic *arithmetic;
 
-		for (i = 0; seq->ir[i]; i++)
-			VIPS_UNREF(seq->ir[i]);
-		VIPS_FREE(seq->ir);
-	}
+	VipsArithmeticNode *root;
 
-	VIPS_FREE(seq->p);
+} VipsArithmeticSequence;
 
-	VIPS_FREE(seq);
+static void
+vips_arithmetic_node_free(VipsArithmeticNode *node)
+{
+	int i;
 
-	return 0;
+	for (i = 0; i < node->n; i++) {
+		if (node->ir)
+			VIPS_UNREF(node->ir[i]);
+		if (node->child)
+			VIPS_FREEF(vips_arithmetic_node_free, node->child[i]);
+	}
+
+	VIPS_FREE(node->ir);
+	VIPS_FREE(node->child);
+	VIPS_FREE(node->row);
+	VIPS_FREE(node->p);
+	VIPS_FREE(node->line);
+	VIPS_FREE(node);
 }
 
-static void *
-vips_arithmetic_start(VipsImage *out, void *a, void *b)
+static VipsArithmeticNode *
+vips_arithmetic_node_new(VipsArithmetic *arithmetic)
 {
-	VipsImage **in = (VipsImage **) a;
-	VipsArithmetic *arithmetic = (VipsArithmetic *) b;
+	VipsImage **in = arithmetic->ready;
 
-	VipsArithmeticSequence *seq;
+	VipsArithmeticNode *node;
 	int i, n;
 
-	if (!(seq = VIPS_NEW(NULL, VipsArithmeticSequence)))
+	if (!(node = VIPS_NEW(NULL, VipsArithmeticNode)))
 		return NULL;
 
-	seq->arithmetic = arithmetic;
-	seq->ir = NULL;
-	seq->p = NULL;
-
-	/* How many images?
-	 */
 	for (n = 0; in[n]; n++)
 		;
 
-	/* Allocate space for region array.
-	 */
-	if (!(seq->ir = VIPS_ARRAY(NULL, n + 1, VipsRegion *))) {
-		vips_arithmetic_stop(seq, NULL, NULL);
+	node->arithmetic = arithmetic;
+	node->n = n;
+	node->ir = VIPS_ARRAY(NULL, n + 1, VipsRegion *);
+	node->child = VIPS_ARRAY(NULL, n + 1, VipsArithmeticNode *);
+	node->row = VIPS_ARRAY(NULL, n + 1, VipsPel *);
+	node->p = VIPS_ARRAY(NULL, n + 1, VipsPel *);
+	node->line = NULL;
+	node->line_size = 0;
+	node->fused = FALSE;
+	if (!node->ir ||
+		!node->child ||
+		!node->row ||
+		!node->p) {
+		vips_arithmetic_node_free(node);
 		return NULL;
 	}
 
-	/* Create a set of regions.
-	 */
+	for (i = 0; i <= n; i++) {
+		node->ir[i] = NULL;
+		node->child[i] = NULL;
+	}
+
 	for (i = 0; i < n; i++)
-		if (!(seq->ir[i] = vips_region_new(in[i]))) {
-			vips_arithmetic_stop(seq, NULL, NULL);
+		if (arithmetic->fused &&
+			arithmetic->fused[i]) {
+			if (!(node->child[i] =
+						vips_arithmetic_node_new(arithmetic->fused[i]))) {
+				vips_arithmetic_node_free(node);
+				return NULL;
+			}
+			node->fused = TRUE;
+		}
+		else if (!(node->ir[i] = vips_region_new(in[i]))) {
+			vips_arithmetic_node_free(node);
 			return NULL;
 		}
-	seq->ir[n] = NULL;
 
-	/* Input pointers.
+	return node;
+}
+
+/* Prepare all the regions a node reads from, and make sure our scanline is
+ * large enough for @r.
+ */
+static int
+vips_arithmetic_node_prepare(VipsArithmeticNode *node, VipsRect *r)
+{
+	int i;
+
+	/* Without fusion we can use the reorder system to pick the order to
+	 * compute our inputs in.
 	 */
-	if (!(seq->p = VIPS_ARRAY(NULL, n + 1, VipsPel *))) {
+	if (!node->fused) {
+		if (vips_reorder_prepare_many(node->arithmetic->out, node->ir, r))
+			return -1;
+	}
+	else
+		for (i = 0; i < node->n; i++)
+			if (node->child[i]) {
+				if (vips_arithmetic_node_prepare(node->child[i], r))
+					return -1;
+			}
+			else if (vips_region_prepare(node->ir[i], r))
+				return -1;
+
+	for (i = 0; i < node->n; i++)
+		if (node->child[i]) {
+			VipsArithmeticNode *child = node->child[i];
+			size_t size = (size_t) r->width *
+				VIPS_IMAGE_SIZEOF_PEL(child->arithmetic->out);
+
+			if (size > child->line_size) {
+				VIPS_FREE(child->line);
+				if (!(child->line = VIPS_ARRAY(NULL, size, VipsPel)))
+					return -1;
+				child->line_size = size;
+			}
+		}
+		else
+			node->row[i] = VIPS_REGION_ADDR(node->ir[i], r->left, r->top);
+
+	for (i = 0; i < node->n; i++)
+		if (node->child[i])
+			node->p[i] = node->child[i]->line;
+	node->p[node->n] = NULL;
+
+	return 0;
+}
+
+/* Compute one scanline of a node into @q. Inline nodes compute their
+ * scanline first.
+ */
+static void
+vips_arithmetic_node_line(VipsArithmeticNode *node, VipsPel *q, int width)
+{
+	VipsArithmeticClass *class = VIPS_ARITHMETIC_GET_CLASS(node->arithmetic);
+
+	int i;
+
+	for (i = 0; i < node->n; i++)
+		if (node->child[i])
+			vips_arithmetic_node_line(node->child[i],
+				node->child[i]->line, width);
+		else
+			node->p[i] = node->row[i];
+
+	class->process_line(node->arithmetic, q, node->p, width);
+
+	for (i = 0; i < node->n; i++)
+		if (!node->child[i])
+			node->row[i] += VIPS_REGION_LSKIP(node->ir[i]);
+}
+
+static int
+vips_arithmetic_stop(void *vseq, void *a, void *b)
+{
+	VipsArithmeticSequence *seq = (VipsArithmeticSequence *) vseq;
+
+	VIPS_FREEF(vips_arithmetic_node_free, seq->root);
+
+	VIPS_FREE(seq);
+
+	return 0;
+}
+
+static void *
+vips_arithmetic_start(VipsImage *out, void *a, void *b)
+{
+	VipsArithmetic *arithmetic = (VipsArithmetic *) b;
+
+	VipsArithmeticSequence *seq;
+
+	if (!(seq = VIPS_NEW(NULL, VipsArithmeticSequence)))
+		return NULL;
+
+	seq->arithmetic = arithmetic;
+	seq->root = NULL;
+
+	if (!(seq->root = vips_arithmetic_node_new(arithmetic))) {
 		vips_arithmetic_stop(seq, NULL, NULL);
 		return NULL;
 	}
@@ -397,31 +544,24 @@ vips_arithmetic_gen(VipsRegion *out_region,
 	void *vseq, void *a, void *b, gboolean *stop)
 {
 	VipsArithmeticSequence *seq = (VipsArithmeticSequence *) vseq;
-	VipsRegion **ir = seq->ir;
 	VipsArithmetic *arithmetic = VIPS_ARITHMETIC(b);
 	VipsArithmeticClass *class = VIPS_ARITHMETIC_GET_CLASS(arithmetic);
 	VipsRect *r = &out_region->valid;
 
 	VipsPel *q;
-	int i, y;
+	int y;
 
 	/* Prepare all input regions and make buffer pointers.
 	 */
-	if (vips_reorder_prepare_many(out_region->im, ir, r))
+	if (vips_arithmetic_node_prepare(seq->root, r))
 		return -1;
-	for (i = 0; ir[i]; i++)
-		seq->p[i] = (VipsPel *)
-			VIPS_REGION_ADDR(ir[i], r->left, r->top);
-	seq->p[i] = NULL;
 	q = (VipsPel *) VIPS_REGION_ADDR(out_region, r->left, r->top);
 
 	VIPS_GATE_START("vips_arithmetic_gen: work");
 
 	for (y = 0; y < r->height; y++) {
-		class->process_line(arithmetic, q, seq->p, r->width);
+		vips_arithmetic_node_line(seq->root, q, r->width);
 
-		for (i = 0; ir[i]; i++)
-			seq->p[i] += VIPS_REGION_LSKIP(ir[i]);
 		q += VIPS_REGION_LSKIP(out_region);
 	}
 
@@ -432,6 +572,47 @@ vips_arithmetic_gen(VipsRegion *out_region,
 	return 0;
 }
 
+/* Can we run the operation that made @in inline, rather than preparing a
+ * region on it? Only if @in was made by another arithmetic operation and
+ * needed no decode, cast, bandup or embed to become @ready. Constant
+ * images are painted, not computed, so there's nothing to gain there.
+ */
+static VipsArithmetic *
+vips_arithmetic_fusable(VipsImage *in, VipsImage *decode, VipsImage *ready)
+{
+	VipsArithmetic *upstream;
+
+	if (vips__arithmetic_nofuse ||
+		in->constant ||
+		in->Coding != VIPS_CODING_NONE ||
+		decode != ready ||
+		in->generate_fn != vips_arithmetic_gen ||
+		!VIPS_IS_ARITHMETIC(in->client2))
+		return NULL;
+
+	upstream = VIPS_ARITHMETIC(in->client2);
+	if (upstream->out != in ||
+		upstream->fuse_depth >= MAX_FUSE_DEPTH)
+		return NULL;
+
+	return upstream;
+}
+
+/* If @image was made by an arithmetic operation, that operation. Used to
+ * replay point operations on a shrunk input, see
+ * vips__image_shrink_on_load().
+ */
+VipsOperation *
+vips__arithmetic_producer(VipsImage *image)
+{
+	if (image->generate_fn != vips_arithmetic_gen ||
+		!VIPS_IS_ARITHMETIC(image->client2) ||
+		VIPS_ARITHMETIC(image->client2)->out != image)
+		return NULL;
+
+	return VIPS_OPERATION(image->client2);
+}
+
 static int
 vips_arithmetic_build(VipsObject *object)
 {
@@ -483,6 +664,23 @@ vips_arithmetic_build(VipsObject *object)
 	 */
 	arithmetic->ready = size;
 
+	arithmetic->vector = vips_vector_isenabled();
+
+	/* Find any inputs we can compute inline. This saves a region and a
+	 * buffer for each fused operation, and keeps scanlines in cache.
+	 */
+	arithmetic->fused = VIPS_ARRAY(object, arithmetic->n, VipsArithmetic *);
+	if (!arithmetic->fused)
+		return -1;
+	for (i = 0; i < arithmetic->n; i++) {
+		arithmetic->fused[i] = vips_arithmetic_fusable(arithmetic->in[i],
+			decode[i], arithmetic->ready[i]);
+
+		if (arithmetic->fused[i])
+			arithmetic->fuse_depth = VIPS_MAX(arithmetic->fuse_depth,
+				arithmetic->fused[i]->fuse_depth + 1);
+	}
+
 	if (vips_image_pipeline_array(arithmetic->out,
 			VIPS_DEMAND_STYLE_THINSTRIP, arithmetic->ready))
 		return -1;
@@ -501,6 +699,8 @@ vips_arithmetic_build(VipsObject *object)
 			arithmetic->ready, arithmetic))
 		return -1;
 
+	vips__image_fold_constant(arithmetic->out, arithmetic->ready);
+
 	return 0;
 }
 
@@ -518,6 +718,9 @@ vips_arithmetic_class_init(VipsArithmeticClass *class)
 	vobject_class->description = _("arithmetic operations");
 	vobject_class->build = vips_arithmetic_build;
 
+	if (g_getenv("VIPS_NOFUSE"))
+		vips__arithmetic_nofuse = TRUE;
+
 	operation_class->flags = VIPS_OPERATION_SEQUENTIAL;
 
 	VIPS_ARG_IMAGE(class, "out", 100,
@@ -532,6 +735,9 @@ vips_arithmetic_init(VipsArithmetic *arithmetic)
 {
 	arithmetic->base_bands = 1;
 	arithmetic->format = VIPS_FORMAT_NOTSET;
+	arithmetic->vector = FALSE;
+	arithmetic->fused = NULL;
+	arithmetic->fuse_depth = 0;
 }
 
 void
@@ -576,6 +782,8 @@ vips_arithmetic_operation_init(void)
 	extern GType vips_profile_get_type(void);
 	extern GType vips_measure_get_type(void);
 	extern GType vips_getpoint_get_type(void);
+	extern GType vips_getpoints_get_type(void);
+	extern GType vips_percentiles_get_type(void);
 	extern GType vips_round_get_type(void);
 	extern GType vips_relational_get_type(void);
 	extern GType vips_relational_const_get_type(void);
@@ -618,6 +826,8 @@ vips_arithmetic_operation_init(void)
 	vips_profile_get_type();
 	vips_measure_get_type();
 	vips_getpoint_get_type();
+	vips_getpoints_get_type();
+	vips_percentiles_get_type();
 	vips_round_get_type();
 	vips_relational_get_type();
 	vips_relational_const_get_type();
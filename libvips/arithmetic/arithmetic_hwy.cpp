@@ -0,0 +1,576 @@
+/* Highway kernels for the point arithmetic operators.
+ *
+ * 14/10/26
+ * 	- initial implementation
+ */
+
+/*
+
+	This file is part of VIPS.
+
+	VIPS is free software; you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+	02110-1301  USA
+
+ */
+
+/*
+
+	These files are distributed with VIPS - http://www.vips.ecs.soton.ac.uk
+
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /*HAVE_CONFIG_H*/
+#include <glib/gi18n-lib.h>
+
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <cmath>
+
+#include <vips/vips.h>
+#include <vips/vector.h>
+#include <vips/debug.h>
+#include <vips/internal.h>
+
+#include "parithmetic.h"
+
+#ifdef HAVE_HWY
+
+#undef HWY_TARGET_INCLUDE
+#define HWY_TARGET_INCLUDE "libvips/arithmetic/arithmetic_hwy.cpp"
+#include <hwy/foreach_target.h>
+#include <hwy/highway.h>
+
+namespace HWY_NAMESPACE {
+
+using namespace hwy::HWY_NAMESPACE;
+
+using DF32 = ScalableTag<float>;
+using DI32 = ScalableTag<int32_t>;
+using DU32 = ScalableTag<uint32_t>;
+using DI16 = ScalableTag<int16_t>;
+using DU16 = ScalableTag<uint16_t>;
+using DI8 = ScalableTag<int8_t>;
+using DU8 = ScalableTag<uint8_t>;
+constexpr DF32 df32;
+constexpr DI32 di32;
+constexpr DU32 du32;
+constexpr DI16 di16;
+constexpr DU16 du16;
+constexpr DI8 di8;
+constexpr DU8 du8;
+
+/* Narrow vectors with one lane for each lane of a wider type, for loading
+ * before a promote, or storing after a demote.
+ */
+constexpr Rebind<uint8_t, DU16> du8x16;
+constexpr Rebind<uint8_t, DI32> du8x32;
+constexpr Rebind<uint16_t, DU32> du16x32;
+
+// Compat for Highway versions < 1.3.0
+#ifndef HWY_LANES_CONSTEXPR
+#define HWY_LANES_CONSTEXPR
+#endif
+
+/* The vector loops only run on SIMD targets, the scalar tail handles any
+ * remaining elements (or all of them for HWY_SCALAR).
+ */
+#if HWY_TARGET != HWY_SCALAR
+#define VECTOR_LOOP 1
+#else
+#define VECTOR_LOOP 0
+#endif
+
+/* Binary op, both inputs promoted to the output type first.
+ */
+#define BINARY_PROMOTE(NAME, IN, OUT, DIN, DOUT, VOP, OP) \
+	HWY_ATTR void \
+	NAME(VipsPel *pout, VipsPel *pin0, VipsPel *pin1, int32_t sz) \
+	{ \
+		const IN *HWY_RESTRICT left = (IN *) pin0; \
+		const IN *HWY_RESTRICT right = (IN *) pin1; \
+		OUT *HWY_RESTRICT q = (OUT *) pout; \
+		int32_t x = 0; \
+\
+		if (VECTOR_LOOP) { \
+			HWY_LANES_CONSTEXPR int32_t N = Lanes(DOUT); \
+\
+			for (; x + N <= sz; x += N) { \
+				auto a = PromoteTo(DOUT, LoadU(DIN, left + x)); \
+				auto b = PromoteTo(DOUT, LoadU(DIN, right + x)); \
+\
+				StoreU(VOP(a, b), DOUT, q + x); \
+			} \
+		} \
+\
+		for (; x < sz; ++x) \
+			q[x] = (OUT) left[x] OP(OUT) right[x]; \
+	}
+
+/* Binary op, inputs and output all float.
+ */
+#define BINARY_FLOAT(NAME, VOP, OP) \
+	HWY_ATTR void \
+	NAME(VipsPel *pout, VipsPel *pin0, VipsPel *pin1, int32_t sz) \
+	{ \
+		const float *HWY_RESTRICT left = (float *) pin0; \
+		const float *HWY_RESTRICT right = (float *) pin1; \
+		float *HWY_RESTRICT q = (float *) pout; \
+		int32_t x = 0; \
+\
+		if (VECTOR_LOOP) { \
+			HWY_LANES_CONSTEXPR int32_t N = Lanes(df32); \
+\
+			for (; x + N <= sz; x += N) { \
+				auto a = LoadU(df32, left + x); \
+				auto b = LoadU(df32, right + x); \
+\
+				StoreU(VOP(a, b), df32, q + x); \
+			} \
+		} \
+\
+		for (; x < sz; ++x) \
+			q[x] = left[x] OP right[x]; \
+	}
+
+BINARY_PROMOTE(vips_add_uchar_hwy,
+	uint8_t, uint16_t, du8x16, du16, Add, +)
+BINARY_PROMOTE(vips_add_ushort_hwy,
+	uint16_t, uint32_t, du16x32, du32, Add, +)
+BINARY_FLOAT(vips_add_float_hwy, Add, +)
+
+BINARY_PROMOTE(vips_subtract_uchar_hwy,
+	uint8_t, int16_t, du8x16, di16, Sub, -)
+BINARY_PROMOTE(vips_subtract_ushort_hwy,
+	uint16_t, int32_t, du16x32, di32, Sub, -)
+BINARY_FLOAT(vips_subtract_float_hwy, Sub, -)
+
+BINARY_PROMOTE(vips_multiply_uchar_hwy,
+	uint8_t, uint16_t, du8x16, du16, Mul, *)
+BINARY_PROMOTE(vips_multiply_ushort_hwy,
+	uint16_t, uint32_t, du16x32, du32, Mul, *)
+BINARY_FLOAT(vips_multiply_float_hwy, Mul, *)
+
+/* Divide to float output, with divide by zero giving zero.
+ */
+#define DIVIDE(NAME, IN, LOAD) \
+	HWY_ATTR void \
+	NAME(VipsPel *pout, VipsPel *pin0, VipsPel *pin1, int32_t sz) \
+	{ \
+		const IN *HWY_RESTRICT left = (IN *) pin0; \
+		const IN *HWY_RESTRICT right = (IN *) pin1; \
+		float *HWY_RESTRICT q = (float *) pout; \
+		int32_t x = 0; \
+\
+		if (VECTOR_LOOP) { \
+			HWY_LANES_CONSTEXPR int32_t N = Lanes(df32); \
+			const auto zero = Zero(df32); \
+\
+			for (; x + N <= sz; x += N) { \
+				auto a = LOAD(left + x); \
+				auto b = LOAD(right + x); \
+\
+				StoreU(IfThenZeroElse(Eq(b, zero), Div(a, b)), \
+					df32, q + x); \
+			} \
+		} \
+\
+		for (; x < sz; ++x) \
+			q[x] = right[x] == 0 \
+				? 0 \
+				: (float) left[x] / (float) right[x]; \
+	}
+
+#define LOAD_UCHAR_F32(P) \
+	ConvertTo(df32, PromoteTo(di32, LoadU(du8x32, P)))
+#define LOAD_USHORT_F32(P) \
+	ConvertTo(df32, PromoteTo(di32, LoadU(du16x32, P)))
+#define LOAD_FLOAT_F32(P) LoadU(df32, P)
+
+DIVIDE(vips_divide_uchar_hwy, uint8_t, LOAD_UCHAR_F32)
+DIVIDE(vips_divide_ushort_hwy, uint16_t, LOAD_USHORT_F32)
+DIVIDE(vips_divide_float_hwy, float, LOAD_FLOAT_F32)
+
+/* Relational ops, true is 255, false is 0. The caller has already turned
+ * MORE and MOREEQ into LESS and LESSEQ by swapping the arguments.
+ */
+#define RELATIONAL_SWITCH(LOOP) \
+	switch (op) { \
+	case VIPS_OPERATION_RELATIONAL_EQUAL: \
+		LOOP(Eq, ==); \
+		break; \
+\
+	case VIPS_OPERATION_RELATIONAL_NOTEQ: \
+		LOOP(Ne, !=); \
+		break; \
+\
+	case VIPS_OPERATION_RELATIONAL_LESS: \
+		LOOP(Lt, <); \
+		break; \
+\
+	case VIPS_OPERATION_RELATIONAL_LESSEQ: \
+		LOOP(Le, <=); \
+		break; \
+\
+	default: \
+		break; \
+	}
+
+HWY_ATTR void
+vips_relational_uchar_hwy(VipsPel *pout, VipsPel *pin0, VipsPel *pin1,
+	int32_t sz, VipsOperationRelational op)
+{
+	const uint8_t *HWY_RESTRICT left = (uint8_t *) pin0;
+	const uint8_t *HWY_RESTRICT right = (uint8_t *) pin1;
+	uint8_t *HWY_RESTRICT q = (uint8_t *) pout;
+	HWY_LANES_CONSTEXPR int32_t N = Lanes(du8);
+
+#define RLOOP(VOP, OP) \
+	{ \
+		int32_t x = 0; \
+\
+		if (VECTOR_LOOP) \
+			for (; x + N <= sz; x += N) { \
+				auto a = LoadU(du8, left + x); \
+				auto b = LoadU(du8, right + x); \
+\
+				StoreU(VecFromMask(du8, VOP(a, b)), du8, q + x); \
+			} \
+\
+		for (; x < sz; ++x) \
+			q[x] = (left[x] OP right[x]) ? 255 : 0; \
+	}
+
+	RELATIONAL_SWITCH(RLOOP);
+
+#undef RLOOP
+}
+
+HWY_ATTR void
+vips_relational_ushort_hwy(VipsPel *pout, VipsPel *pin0, VipsPel *pin1,
+	int32_t sz, VipsOperationRelational op)
+{
+	const uint16_t *HWY_RESTRICT left = (uint16_t *) pin0;
+	const uint16_t *HWY_RESTRICT right = (uint16_t *) pin1;
+	uint8_t *HWY_RESTRICT q = (uint8_t *) pout;
+	HWY_LANES_CONSTEXPR int32_t N = Lanes(du16);
+	const auto v255 = Set(du16, 255);
+
+	/* Select 255 in 16 bits, then demote with saturation to 8 bits.
+	 */
+#define RLOOP(VOP, OP) \
+	{ \
+		int32_t x = 0; \
+\
+		if (VECTOR_LOOP) \
+			for (; x + N <= sz; x += N) { \
+				auto a = LoadU(du16, left + x); \
+				auto b = LoadU(du16, right + x); \
+				auto t = IfThenElseZero(VOP(a, b), v255); \
+\
+				StoreU(DemoteTo(du8x16, BitCast(di16, t)), \
+					du8x16, q + x); \
+			} \
+\
+		for (; x < sz; ++x) \
+			q[x] = (left[x] OP right[x]) ? 255 : 0; \
+	}
+
+	RELATIONAL_SWITCH(RLOOP);
+
+#undef RLOOP
+}
+
+HWY_ATTR void
+vips_relational_float_hwy(VipsPel *pout, VipsPel *pin0, VipsPel *pin1,
+	int32_t sz, VipsOperationRelational op)
+{
+	const float *HWY_RESTRICT left = (float *) pin0;
+	const float *HWY_RESTRICT right = (float *) pin1;
+	uint8_t *HWY_RESTRICT q = (uint8_t *) pout;
+	HWY_LANES_CONSTEXPR int32_t N = Lanes(df32);
+	const auto v255 = Set(di32, 255);
+
+#define RLOOP(VOP, OP) \
+	{ \
+		int32_t x = 0; \
+\
+		if (VECTOR_LOOP) \
+			for (; x + N <= sz; x += N) { \
+				auto a = LoadU(df32, left + x); \
+				auto b = LoadU(df32, right + x); \
+				auto t = IfThenElseZero(RebindMask(di32, VOP(a, b)), \
+					v255); \
+\
+				StoreU(DemoteTo(du8x32, t), du8x32, q + x); \
+			} \
+\
+		for (; x < sz; ++x) \
+			q[x] = (left[x] OP right[x]) ? 255 : 0; \
+	}
+
+	RELATIONAL_SWITCH(RLOOP);
+
+#undef RLOOP
+}
+
+/* Bitwise boolean ops, same type in and out.
+ */
+#define BOOLEAN(NAME, T, D) \
+	HWY_ATTR void \
+	NAME(VipsPel *pout, VipsPel *pin0, VipsPel *pin1, \
+		int32_t sz, VipsOperationBoolean op) \
+	{ \
+		const T *HWY_RESTRICT left = (T *) pin0; \
+		const T *HWY_RESTRICT right = (T *) pin1; \
+		T *HWY_RESTRICT q = (T *) pout; \
+		HWY_LANES_CONSTEXPR int32_t N = Lanes(D); \
+\
+		switch (op) { \
+		case VIPS_OPERATION_BOOLEAN_AND: \
+			BLOOP(T, D, And, &); \
+			break; \
+\
+		case VIPS_OPERATION_BOOLEAN_OR: \
+			BLOOP(T, D, Or, |); \
+			break; \
+\
+		case VIPS_OPERATION_BOOLEAN_EOR: \
+			BLOOP(T, D, Xor, ^); \
+			break; \
+\
+		default: \
+			break; \
+		} \
+	}
+
+#define BLOOP(T, D, VOP, OP) \
+	{ \
+		int32_t x = 0; \
+\
+		if (VECTOR_LOOP) \
+			for (; x + N <= sz; x += N) \
+				StoreU(VOP(LoadU(D, left + x), LoadU(D, right + x)), \
+					D, q + x); \
+\
+		for (; x < sz; ++x) \
+			q[x] = left[x] OP right[x]; \
+	}
+
+BOOLEAN(vips_boolean_uchar_hwy, uint8_t, du8)
+BOOLEAN(vips_boolean_ushort_hwy, uint16_t, du16)
+
+#undef BLOOP
+
+/* a * in + b, float output.
+ */
+#define LINEAR(NAME, IN, LOAD) \
+	HWY_ATTR void \
+	NAME(VipsPel *pout, VipsPel *pin, int32_t sz, float a, float b) \
+	{ \
+		const IN *HWY_RESTRICT p = (IN *) pin; \
+		float *HWY_RESTRICT q = (float *) pout; \
+		int32_t x = 0; \
+\
+		if (VECTOR_LOOP) { \
+			HWY_LANES_CONSTEXPR int32_t N = Lanes(df32); \
+			const auto va = Set(df32, a); \
+			const auto vb = Set(df32, b); \
+\
+			for (; x + N <= sz; x += N) \
+				StoreU(Add(Mul(va, LOAD(p + x)), vb), df32, q + x); \
+		} \
+\
+		for (; x < sz; ++x) \
+			q[x] = a * (float) p[x] + b; \
+	}
+
+LINEAR(vips_linear_uchar_hwy, uint8_t, LOAD_UCHAR_F32)
+LINEAR(vips_linear_ushort_hwy, uint16_t, LOAD_USHORT_F32)
+LINEAR(vips_linear_float_hwy, float, LOAD_FLOAT_F32)
+
+/* a * in + b, clipped to uchar output. NaN becomes 255, like fmin()/fmax()
+ * in the C path.
+ */
+#define LINEAR_UCHAR(NAME, IN, LOAD) \
+	HWY_ATTR void \
+	NAME(VipsPel *pout, VipsPel *pin, int32_t sz, float a, float b) \
+	{ \
+		const IN *HWY_RESTRICT p = (IN *) pin; \
+		uint8_t *HWY_RESTRICT q = (uint8_t *) pout; \
+		int32_t x = 0; \
+\
+		if (VECTOR_LOOP) { \
+			HWY_LANES_CONSTEXPR int32_t N = Lanes(df32); \
+			const auto va = Set(df32, a); \
+			const auto vb = Set(df32, b); \
+			const auto zero = Zero(df32); \
+			const auto v255 = Set(df32, 255.0f); \
+\
+			for (; x + N <= sz; x += N) { \
+				auto t = Add(Mul(va, LOAD(p + x)), vb); \
+\
+				t = IfThenElse(IsNaN(t), v255, t); \
+				t = Max(zero, Min(v255, t)); \
+\
+				StoreU(DemoteTo(du8x32, ConvertTo(di32, t)), \
+					du8x32, q + x); \
+			} \
+		} \
+\
+		for (; x < sz; ++x) { \
+			float t = a * p[x] + b; \
+\
+			q[x] = VIPS_FCLIP(0, t, 255); \
+		} \
+	}
+
+LINEAR_UCHAR(vips_linear_uchar_uchar_hwy, uint8_t, LOAD_UCHAR_F32)
+LINEAR_UCHAR(vips_linear_ushort_uchar_hwy, uint16_t, LOAD_USHORT_F32)
+LINEAR_UCHAR(vips_linear_float_uchar_hwy, float, LOAD_FLOAT_F32)
+
+/* abs, same type in and out.
+ */
+#define ABS_INT(V) ((V) < 0 ? 0 - (V) : (V))
+#define ABS_FLOAT(V) std::fabs(V)
+
+#define ABS(NAME, T, D, SOP) \
+	HWY_ATTR void \
+	NAME(VipsPel *pout, VipsPel *pin, int32_t sz) \
+	{ \
+		const T *HWY_RESTRICT p = (T *) pin; \
+		T *HWY_RESTRICT q = (T *) pout; \
+		int32_t x = 0; \
+\
+		if (VECTOR_LOOP) { \
+			HWY_LANES_CONSTEXPR int32_t N = Lanes(D); \
+\
+			for (; x + N <= sz; x += N) \
+				StoreU(Abs(LoadU(D, p + x)), D, q + x); \
+		} \
+\
+		for (; x < sz; ++x) \
+			q[x] = SOP(p[x]); \
+	}
+
+ABS(vips_abs_char_hwy, int8_t, di8, ABS_INT)
+ABS(vips_abs_short_hwy, int16_t, di16, ABS_INT)
+ABS(vips_abs_float_hwy, float, df32, ABS_FLOAT)
+
+/* This file is included once per target, and VECTOR_LOOP differs between
+ * them.
+ */
+#undef VECTOR_LOOP
+
+} /*namespace HWY_NAMESPACE*/
+
+#if HWY_ONCE
+HWY_EXPORT(vips_add_uchar_hwy);
+HWY_EXPORT(vips_add_ushort_hwy);
+HWY_EXPORT(vips_add_float_hwy);
+HWY_EXPORT(vips_subtract_uchar_hwy);
+HWY_EXPORT(vips_subtract_ushort_hwy);
+HWY_EXPORT(vips_subtract_float_hwy);
+HWY_EXPORT(vips_multiply_uchar_hwy);
+HWY_EXPORT(vips_multiply_ushort_hwy);
+HWY_EXPORT(vips_multiply_float_hwy);
+HWY_EXPORT(vips_divide_uchar_hwy);
+HWY_EXPORT(vips_divide_ushort_hwy);
+HWY_EXPORT(vips_divide_float_hwy);
+HWY_EXPORT(vips_relational_uchar_hwy);
+HWY_EXPORT(vips_relational_ushort_hwy);
+HWY_EXPORT(vips_relational_float_hwy);
+HWY_EXPORT(vips_boolean_uchar_hwy);
+HWY_EXPORT(vips_boolean_ushort_hwy);
+HWY_EXPORT(vips_linear_uchar_hwy);
+HWY_EXPORT(vips_linear_ushort_hwy);
+HWY_EXPORT(vips_linear_float_hwy);
+HWY_EXPORT(vips_linear_uchar_uchar_hwy);
+HWY_EXPORT(vips_linear_ushort_uchar_hwy);
+HWY_EXPORT(vips_linear_float_uchar_hwy);
+HWY_EXPORT(vips_abs_char_hwy);
+HWY_EXPORT(vips_abs_short_hwy);
+HWY_EXPORT(vips_abs_float_hwy);
+
+/* clang-format off */
+#define DISPATCH_BINARY(NAME) \
+	void \
+	NAME(VipsPel *out, VipsPel *in0, VipsPel *in1, int sz) \
+	{ \
+		HWY_DYNAMIC_DISPATCH(NAME)(out, in0, in1, sz); \
+	}
+
+#define DISPATCH_RELATIONAL(NAME) \
+	void \
+	NAME(VipsPel *out, VipsPel *in0, VipsPel *in1, int sz, \
+		VipsOperationRelational op) \
+	{ \
+		HWY_DYNAMIC_DISPATCH(NAME)(out, in0, in1, sz, op); \
+	}
+
+#define DISPATCH_BOOLEAN(NAME) \
+	void \
+	NAME(VipsPel *out, VipsPel *in0, VipsPel *in1, int sz, \
+		VipsOperationBoolean op) \
+	{ \
+		HWY_DYNAMIC_DISPATCH(NAME)(out, in0, in1, sz, op); \
+	}
+
+#define DISPATCH_LINEAR(NAME) \
+	void \
+	NAME(VipsPel *out, VipsPel *in, int sz, float a, float b) \
+	{ \
+		HWY_DYNAMIC_DISPATCH(NAME)(out, in, sz, a, b); \
+	}
+
+#define DISPATCH_UNARY(NAME) \
+	void \
+	NAME(VipsPel *out, VipsPel *in, int sz) \
+	{ \
+		HWY_DYNAMIC_DISPATCH(NAME)(out, in, sz); \
+	}
+/* clang-format on */
+
+DISPATCH_BINARY(vips_add_uchar_hwy)
+DISPATCH_BINARY(vips_add_ushort_hwy)
+DISPATCH_BINARY(vips_add_float_hwy)
+DISPATCH_BINARY(vips_subtract_uchar_hwy)
+DISPATCH_BINARY(vips_subtract_ushort_hwy)
+DISPATCH_BINARY(vips_subtract_float_hwy)
+DISPATCH_BINARY(vips_multiply_uchar_hwy)
+DISPATCH_BINARY(vips_multiply_ushort_hwy)
+DISPATCH_BINARY(vips_multiply_float_hwy)
+DISPATCH_BINARY(vips_divide_uchar_hwy)
+DISPATCH_BINARY(vips_divide_ushort_hwy)
+DISPATCH_BINARY(vips_divide_float_hwy)
+DISPATCH_RELATIONAL(vips_relational_uchar_hwy)
+DISPATCH_RELATIONAL(vips_relational_ushort_hwy)
+DISPATCH_RELATIONAL(vips_relational_float_hwy)
+DISPATCH_BOOLEAN(vips_boolean_uchar_hwy)
+DISPATCH_BOOLEAN(vips_boolean_ushort_hwy)
+DISPATCH_LINEAR(vips_linear_uchar_hwy)
+DISPATCH_LINEAR(vips_linear_ushort_hwy)
+DISPATCH_LINEAR(vips_linear_float_hwy)
+DISPATCH_LINEAR(vips_linear_uchar_uchar_hwy)
+DISPATCH_LINEAR(vips_linear_ushort_uchar_hwy)
+DISPATCH_LINEAR(vips_linear_float_uchar_hwy)
+DISPATCH_UNARY(vips_abs_char_hwy)
+DISPATCH_UNARY(vips_abs_short_hwy)
+DISPATCH_UNARY(vips_abs_float_hwy)
+#endif /*HWY_ONCE*/
+
+#endif /*HAVE_HWY*/
@@ -179,6 +179,26 @@ vips_boolean_buffer(VipsArithmetic *arithmetic,
 
 	int x;
 
+#ifdef HAVE_HWY
+	if (arithmetic->vector &&
+		(boolean->operation == VIPS_OPERATION_BOOLEAN_AND ||
+			boolean->operation == VIPS_OPERATION_BOOLEAN_OR ||
+			boolean->operation == VIPS_OPERATION_BOOLEAN_EOR))
+		switch (vips_image_get_format(im)) {
+		case VIPS_FORMAT_UCHAR:
+			vips_boolean_uchar_hwy(out, in[0], in[1], sz,
+				boolean->operation);
+			return;
+		case VIPS_FORMAT_USHORT:
+			vips_boolean_ushort_hwy(out, in[0], in[1], sz,
+				boolean->operation);
+			return;
+
+		default:
+			break;
+		}
+#endif /*HAVE_HWY*/
+
 	switch (boolean->operation) {
 	case VIPS_OPERATION_BOOLEAN_AND:
 		SWITCH(LOOP, FLOOP, &);
@@ -7,6 +7,9 @@
  * 	- only flatten if there is an alpha
  * 8/2/23
  *	- add @line_art
+ * 15/10/26
+ *	- scan in from each edge a strip at a time and stop at the first
+ *	  object pixel, rather than projecting the whole image
  */
 
 /*
@@ -47,6 +50,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 
 #include <vips/vips.h>
@@ -69,11 +73,154 @@ typedef VipsOperationClass VipsFindTrimClass;
 
 G_DEFINE_TYPE(VipsFindTrim, vips_find_trim, VIPS_TYPE_OPERATION);
 
+/* Scan in from each edge this many pixels at a time to start with, doubling
+ * each step up to the max.
+ */
+#define VIPS_FIND_TRIM_STRIP (16)
+#define VIPS_FIND_TRIM_STRIP_MAX (256)
+
+/* Render an area of the mask to a memory image. This runs the mask
+ * pipeline on the worker threads.
+ */
+static VipsImage *
+vips_find_trim_strip(VipsImage *mask, int left, int top, int width, int height)
+{
+	VipsImage *area;
+	VipsImage *strip;
+
+	if (vips_crop(mask, &area, left, top, width, height, NULL))
+		return NULL;
+	strip = vips_image_new_memory();
+	if (vips_image_write(area, strip)) {
+		VIPS_UNREF(area);
+		VIPS_UNREF(strip);
+		return NULL;
+	}
+	VIPS_UNREF(area);
+
+	return strip;
+}
+
+/* TRUE if there are any set pixels in a line. An OR reduction rather than an
+ * early exit, so the compiler can vectorise it.
+ */
+static gboolean
+vips_find_trim_any(VipsPel *p, int n)
+{
+	VipsPel any;
+	int i;
+
+	any = 0;
+	for (i = 0; i < n; i++)
+		any |= p[i];
+
+	return any != 0;
+}
+
+/* OR each line of a strip into a single line.
+ */
+static void
+vips_find_trim_or_lines(VipsImage *strip, VipsPel *line)
+{
+	int x, y;
+
+	memset(line, 0, strip->Xsize);
+	for (y = 0; y < strip->Ysize; y++) {
+		VipsPel *p = VIPS_IMAGE_ADDR(strip, 0, y);
+
+		for (x = 0; x < strip->Xsize; x++)
+			line[x] |= p[x];
+	}
+}
+
+/* Search in from the top (or bottom, if @up) for the first row with an object
+ * pixel. Set @row to -1 if there are none.
+ */
+static int
+vips_find_trim_rows(VipsImage *mask, gboolean up, int *row)
+{
+	int size;
+	int y;
+
+	*row = -1;
+	size = VIPS_FIND_TRIM_STRIP;
+	for (y = 0; y < mask->Ysize && *row == -1;) {
+		int height = VIPS_MIN(size, mask->Ysize - y);
+		int top = up ? mask->Ysize - y - height : y;
+
+		VipsImage *strip;
+		int i;
+
+		if (!(strip = vips_find_trim_strip(mask,
+				  0, top, mask->Xsize, height)))
+			return -1;
+
+		for (i = 0; i < height; i++) {
+			int line = up ? height - 1 - i : i;
+
+			if (vips_find_trim_any(VIPS_IMAGE_ADDR(strip, 0, line),
+					mask->Xsize)) {
+				*row = top + line;
+				break;
+			}
+		}
+
+		VIPS_UNREF(strip);
+
+		y += height;
+		size = VIPS_MIN(size * 2, VIPS_FIND_TRIM_STRIP_MAX);
+	}
+
+	return 0;
+}
+
+/* Search in from the left (or right, if @back) for the first column with an
+ * object pixel, looking only at rows @top to @top + @height.
+ */
+static int
+vips_find_trim_columns(VipsImage *mask, int top, int height,
+	gboolean back, int *column)
+{
+	VipsPel line[VIPS_FIND_TRIM_STRIP_MAX];
+	int size;
+	int x;
+
+	*column = -1;
+	size = VIPS_FIND_TRIM_STRIP;
+	for (x = 0; x < mask->Xsize && *column == -1;) {
+		int width = VIPS_MIN(size, mask->Xsize - x);
+		int left = back ? mask->Xsize - x - width : x;
+
+		VipsImage *strip;
+		int i;
+
+		if (!(strip = vips_find_trim_strip(mask,
+				  left, top, width, height)))
+			return -1;
+		vips_find_trim_or_lines(strip, line);
+		VIPS_UNREF(strip);
+
+		for (i = 0; i < width; i++) {
+			int col = back ? width - 1 - i : i;
+
+			if (line[col]) {
+				*column = left + col;
+				break;
+			}
+		}
+
+		x += width;
+		size = VIPS_MIN(size * 2, VIPS_FIND_TRIM_STRIP_MAX);
+	}
+
+	return 0;
+}
+
 static int
 vips_find_trim_build(VipsObject *object)
 {
 	VipsFindTrim *find_trim = (VipsFindTrim *) object;
-	VipsImage **t = (VipsImage **) vips_object_local_array(object, 20);
+	VipsImage **t = (VipsImage **) vips_object_local_array(object, 6);
 
 	VipsImage *in;
 	double *background;
@@ -81,10 +228,10 @@ vips_find_trim_build(VipsObject *object)
 	double *neg_bg;
 	double *ones;
 	int i;
-	double left;
-	double top;
-	double right;
-	double bottom;
+	int left;
+	int top;
+	int right;
+	int bottom;
 
 	if (VIPS_OBJECT_CLASS(vips_find_trim_parent_class)->build(object))
 		return -1;
@@ -135,36 +282,38 @@ vips_find_trim_build(VipsObject *object)
 		return -1;
 	in = t[5];
 
-	/* t[6] == column sums, t[7] == row sums.
+	/* Search in from the top and bottom for the first object row, then
+	 * in from the left and right between those rows. We only read the
+	 * whole mask if the object touches the edges.
 	 */
-	if (vips_project(in, &t[6], &t[7], NULL))
+	if (vips_find_trim_rows(in, FALSE, &top))
 		return -1;
 
-	/* t[8] == search column sums in from left.
-	 */
-	if (vips_profile(t[6], &t[8], &t[9], NULL) ||
-		vips_avg(t[9], &left, NULL))
-		return -1;
-	if (vips_flip(t[6], &t[10], VIPS_DIRECTION_HORIZONTAL, NULL) ||
-		vips_profile(t[10], &t[11], &t[12], NULL) ||
-		vips_avg(t[12], &right, NULL))
-		return -1;
+	if (top == -1) {
+		/* All background.
+		 */
+		g_object_set(find_trim,
+			"left", in->Xsize,
+			"top", in->Ysize,
+			"width", 0,
+			"height", 0,
+			NULL);
+
+		return 0;
+	}
 
-	/* t[8] == search column sums in from left.
-	 */
-	if (vips_profile(t[7], &t[13], &t[14], NULL) ||
-		vips_avg(t[13], &top, NULL))
-		return -1;
-	if (vips_flip(t[7], &t[15], VIPS_DIRECTION_VERTICAL, NULL) ||
-		vips_profile(t[15], &t[16], &t[17], NULL) ||
-		vips_avg(t[16], &bottom, NULL))
+	if (vips_find_trim_rows(in, TRUE, &bottom) ||
+		vips_find_trim_columns(in,
+			top, bottom - top + 1, FALSE, &left) ||
+		vips_find_trim_columns(in,
+			top, bottom - top + 1, TRUE, &right))
 		return -1;
 
 	g_object_set(find_trim,
-		"left", (int) left,
-		"top", (int) top,
-		"width", (int) VIPS_MAX(0, (t[6]->Xsize - right) - left),
-		"height", (int) VIPS_MAX(0, (t[7]->Ysize - bottom) - top),
+		"left", left,
+		"top", top,
+		"width", right - left + 1,
+		"height", bottom - top + 1,
 		NULL);
 
 	return 0;
@@ -260,9 +409,10 @@ vips_find_trim_init(VipsFindTrim *find_trim)
  *
  * Any alpha is flattened out, then the image is median-filtered (unless
  * @line_art is set, see below). The absolute difference from @background is
- * computed and binarized according to @threshold. Row and column sums of
- * the absolute difference are calculated from this binary image and searched
- * for the first row or column in each direction to obtain the bounding box.
+ * computed and binarized according to @threshold. This binary image is
+ * searched in from each edge for the first row or column containing an
+ * object pixel to obtain the bounding box. Only the edges are read, unless
+ * the object touches them.
  *
  * If the image is entirely background, [method@Image.find_trim] returns
  * @width == 0 and @height == 0.
@@ -203,10 +203,11 @@ vips_getpoint_init(VipsGetpoint *getpoint)
  * pixels in complex images are returned as double-length arrays.
  *
  * This operation is slow. If you want to read many points, use
- * [method@Image.write_to_memory].
+ * [method@Image.getpoints] or [method@Image.write_to_memory].
  *
  * ::: seealso
- *     [method@Image.draw_point], [method@Image.write_to_memory].
+ *     [method@Image.draw_point], [method@Image.getpoints],
+ *     [method@Image.write_to_memory].
  *
  * Returns: 0 on success, or -1 on error.
  */
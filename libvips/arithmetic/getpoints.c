@@ -0,0 +1,507 @@
+/* read many points from an image in one pass
+ *
+ * 15/10/26
+ * 	- from getpoint.c
+ */
+
+/*
+
+	This file is part of VIPS.
+
+	VIPS is free software; you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+	02110-1301  USA
+
+ */
+
+/*
+
+	These files are distributed with VIPS - http://www.vips.ecs.soton.ac.uk
+
+ */
+
+/*
+#define VIPS_DEBUG
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /*HAVE_CONFIG_H*/
+#include <glib/gi18n-lib.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <vips/vips.h>
+#include <vips/internal.h>
+#include <vips/debug.h>
+
+/* Points are grouped into tiles of this size. Each tile is a unit of work,
+ * with a single region fetch.
+ */
+#define VIPS_GETPOINTS_TILE (64)
+
+/* A point, and the tile it falls in.
+ */
+typedef struct _VipsGetpointsPoint {
+	guint64 tile;
+	int index;
+} VipsGetpointsPoint;
+
+typedef struct _VipsGetpoints {
+	VipsOperation parent_instance;
+
+	VipsImage *in;
+	VipsArrayDouble *x;
+	VipsArrayDouble *y;
+	VipsInterpolate *interpolate;
+	gboolean unpack_complex;
+
+	VipsArrayDouble *out_array;
+
+	/* The image we sample, after decode, cast and perhaps embed.
+	 */
+	VipsImage *image;
+
+	/* Interpolation stencil, or 1 and 0 for no interpolation.
+	 */
+	int window_size;
+	int window_offset;
+	VipsInterpolateMethod interpolate_fn;
+
+	/* Points sorted by tile, and the start of each run of points in
+	 * a tile. There's an extra entry at the end of group_start.
+	 */
+	VipsGetpointsPoint *points;
+	int *group_start;
+	int n_groups;
+	int next_group;
+
+	/* Values for each point go here.
+	 */
+	double *values;
+	int n_values;
+} VipsGetpoints;
+
+typedef VipsOperationClass VipsGetpointsClass;
+
+G_DEFINE_TYPE(VipsGetpoints, vips_getpoints, VIPS_TYPE_OPERATION);
+
+static void
+vips_getpoints_finalize(GObject *gobject)
+{
+	VipsGetpoints *getpoints = (VipsGetpoints *) gobject;
+
+	VIPS_FREE(getpoints->points);
+	VIPS_FREE(getpoints->group_start);
+	VIPS_FREE(getpoints->values);
+
+	G_OBJECT_CLASS(vips_getpoints_parent_class)->finalize(gobject);
+}
+
+static int
+vips_getpoints_compare(const void *a, const void *b)
+{
+	const VipsGetpointsPoint *p1 = (const VipsGetpointsPoint *) a;
+	const VipsGetpointsPoint *p2 = (const VipsGetpointsPoint *) b;
+
+	if (p1->tile != p2->tile)
+		return p1->tile < p2->tile ? -1 : 1;
+
+	return p1->index - p2->index;
+}
+
+/* The top-left of the stencil for a point, in the sampled image.
+ */
+static void
+vips_getpoints_stencil(VipsGetpoints *getpoints, int i,
+	double *sx, double *sy, int *left, int *top)
+{
+	double *x = (double *) VIPS_AREA(getpoints->x)->data;
+	double *y = (double *) VIPS_AREA(getpoints->y)->data;
+
+	if (getpoints->interpolate_fn) {
+		/* We've embedded by window_offset + 1, see build.
+		 */
+		*sx = x[i] + getpoints->window_offset + 1;
+		*sy = y[i] + getpoints->window_offset + 1;
+		*left = floor(*sx) - getpoints->window_offset;
+		*top = floor(*sy) - getpoints->window_offset;
+	}
+	else {
+		*sx = x[i];
+		*sy = y[i];
+		*left = floor(*sx);
+		*top = floor(*sy);
+	}
+}
+
+static int
+vips_getpoints_allocate(VipsThreadState *state, void *a, gboolean *stop)
+{
+	VipsGetpoints *getpoints = (VipsGetpoints *) a;
+
+	if (getpoints->next_group >= getpoints->n_groups) {
+		*stop = TRUE;
+		return 0;
+	}
+
+	state->x = getpoints->next_group;
+	getpoints->next_group += 1;
+
+	return 0;
+}
+
+/* Fetch the area covered by one tile of points, then read each point.
+ */
+static int
+vips_getpoints_work(VipsThreadState *state, void *a)
+{
+	VipsGetpoints *getpoints = (VipsGetpoints *) a;
+	int start = getpoints->group_start[state->x];
+	int end = getpoints->group_start[state->x + 1];
+	int bands = VIPS_IMAGE_SIZEOF_PEL(getpoints->image) / sizeof(double);
+
+	VipsRect need;
+	VipsRect image;
+	VipsRect stencil;
+	double sx, sy;
+	int i;
+
+	need.width = 0;
+	need.height = 0;
+	for (i = start; i < end; i++) {
+		vips_getpoints_stencil(getpoints, getpoints->points[i].index,
+			&sx, &sy, &stencil.left, &stencil.top);
+		stencil.width = getpoints->window_size;
+		stencil.height = getpoints->window_size;
+
+		if (i == start)
+			need = stencil;
+		else
+			vips_rect_unionrect(&need, &stencil, &need);
+	}
+
+	image.left = 0;
+	image.top = 0;
+	image.width = getpoints->image->Xsize;
+	image.height = getpoints->image->Ysize;
+	vips_rect_intersectrect(&need, &image, &need);
+
+	if (vips_region_prepare(state->reg, &need))
+		return -1;
+
+	for (i = start; i < end; i++) {
+		int index = getpoints->points[i].index;
+		double *q = getpoints->values + (size_t) index * bands;
+
+		vips_getpoints_stencil(getpoints, index,
+			&sx, &sy, &stencil.left, &stencil.top);
+
+		if (getpoints->interpolate_fn)
+			getpoints->interpolate_fn(getpoints->interpolate,
+				q, state->reg, sx, sy);
+		else
+			memcpy(q,
+				VIPS_REGION_ADDR(state->reg,
+					stencil.left, stencil.top),
+				bands * sizeof(double));
+	}
+
+	return 0;
+}
+
+static int
+vips_getpoints_progress(void *a)
+{
+	VipsGetpoints *getpoints = (VipsGetpoints *) a;
+
+	if (vips_image_iskilled(getpoints->in))
+		return -1;
+
+	return 0;
+}
+
+static int
+vips_getpoints_build(VipsObject *object)
+{
+	VipsObjectClass *class = VIPS_OBJECT_GET_CLASS(object);
+	VipsGetpoints *getpoints = (VipsGetpoints *) object;
+	VipsImage **t = (VipsImage **) vips_object_local_array(object, 3);
+
+	VipsImage *in;
+	double *x;
+	double *y;
+	int n_points;
+	int tiles_across;
+	int bands;
+	gboolean iscomplex;
+	VipsArrayDouble *out_array;
+	int i;
+
+	if (VIPS_OBJECT_CLASS(vips_getpoints_parent_class)->build(object))
+		return -1;
+
+	n_points = VIPS_AREA(getpoints->x)->n;
+	if (VIPS_AREA(getpoints->y)->n != n_points) {
+		vips_error(class->nickname,
+			"%s", _("x and y must be the same length"));
+		return -1;
+	}
+	if (n_points < 1) {
+		vips_error(class->nickname, "%s", _("no points"));
+		return -1;
+	}
+
+	x = (double *) VIPS_AREA(getpoints->x)->data;
+	y = (double *) VIPS_AREA(getpoints->y)->data;
+	for (i = 0; i < n_points; i++)
+		if (x[i] < 0 ||
+			x[i] >= getpoints->in->Xsize ||
+			y[i] < 0 ||
+			y[i] >= getpoints->in->Ysize) {
+			vips_error(class->nickname,
+				_("point %d is outside the image"), i);
+			return -1;
+		}
+
+	/* Unpack to double. Complex unpacks to 2 * bands.
+	 */
+	iscomplex = getpoints->unpack_complex &&
+		vips_band_format_iscomplex(getpoints->in->BandFmt);
+	bands = iscomplex ? getpoints->in->Bands * 2 : getpoints->in->Bands;
+
+	if (vips_image_decode(getpoints->in, &t[0]) ||
+		vips_cast(t[0], &t[1],
+			iscomplex ? VIPS_FORMAT_DPCOMPLEX : VIPS_FORMAT_DOUBLE,
+			NULL))
+		return -1;
+	in = t[1];
+
+	getpoints->window_size = 1;
+	getpoints->window_offset = 0;
+	getpoints->interpolate_fn = NULL;
+	if (getpoints->interpolate) {
+		getpoints->window_size =
+			vips_interpolate_get_window_size(getpoints->interpolate);
+		getpoints->window_offset =
+			vips_interpolate_get_window_offset(getpoints->interpolate);
+		getpoints->interpolate_fn =
+			vips_interpolate_get_method(getpoints->interpolate);
+
+		/* Copy edge pixels out so we can interpolate right up to
+		 * the edges, as mapim does.
+		 */
+		if (vips_embed(in, &t[2],
+				getpoints->window_offset + 1,
+				getpoints->window_offset + 1,
+				in->Xsize + getpoints->window_size - 1 + 2,
+				in->Ysize + getpoints->window_size - 1 + 2,
+				"extend", VIPS_EXTEND_COPY,
+				NULL))
+			return -1;
+		in = t[2];
+	}
+	getpoints->image = in;
+
+	/* Sort the points by tile, so each tile is fetched just once.
+	 */
+	if (!(getpoints->points = VIPS_ARRAY(NULL,
+			  n_points, VipsGetpointsPoint)) ||
+		!(getpoints->group_start = VIPS_ARRAY(NULL,
+			  n_points + 1, int)) ||
+		!(getpoints->values = VIPS_ARRAY(NULL,
+			  (size_t) n_points * bands, double)))
+		return -1;
+	getpoints->n_values = n_points * bands;
+
+	tiles_across = VIPS_ROUND_UP(in->Xsize, VIPS_GETPOINTS_TILE) /
+		VIPS_GETPOINTS_TILE;
+	for (i = 0; i < n_points; i++) {
+		int left;
+		int top;
+		double sx, sy;
+
+		vips_getpoints_stencil(getpoints, i, &sx, &sy, &left, &top);
+		getpoints->points[i].tile =
+			(guint64) (top / VIPS_GETPOINTS_TILE) * tiles_across +
+			left / VIPS_GETPOINTS_TILE;
+		getpoints->points[i].index = i;
+	}
+	qsort(getpoints->points, n_points, sizeof(VipsGetpointsPoint),
+		vips_getpoints_compare);
+
+	getpoints->n_groups = 0;
+	for (i = 0; i < n_points; i++)
+		if (i == 0 ||
+			getpoints->points[i].tile != getpoints->points[i - 1].tile)
+			getpoints->group_start[getpoints->n_groups++] = i;
+	getpoints->group_start[getpoints->n_groups] = n_points;
+
+	VIPS_DEBUG_MSG("vips_getpoints_build: %d points in %d tiles\n",
+		n_points, getpoints->n_groups);
+
+	getpoints->next_group = 0;
+	if (vips_threadpool_run(in,
+			vips_thread_state_new,
+			vips_getpoints_allocate,
+			vips_getpoints_work,
+			vips_getpoints_progress,
+			getpoints))
+		return -1;
+
+	out_array = vips_array_double_new(getpoints->values,
+		getpoints->n_values);
+	g_object_set(object,
+		"out_array", out_array,
+		NULL);
+	vips_area_unref(VIPS_AREA(out_array));
+	VIPS_FREE(getpoints->values);
+
+	return 0;
+}
+
+static void
+vips_getpoints_class_init(VipsGetpointsClass *class)
+{
+	GObjectClass *gobject_class = (GObjectClass *) class;
+	VipsObjectClass *object_class = (VipsObjectClass *) class;
+
+	gobject_class->finalize = vips_getpoints_finalize;
+	gobject_class->set_property = vips_object_set_property;
+	gobject_class->get_property = vips_object_get_property;
+
+	object_class->nickname = "getpoints";
+	object_class->description = _("read many points from an image");
+	object_class->build = vips_getpoints_build;
+
+	VIPS_ARG_IMAGE(class, "in", 1,
+		_("Input"),
+		_("Input image"),
+		VIPS_ARGUMENT_REQUIRED_INPUT,
+		G_STRUCT_OFFSET(VipsGetpoints, in));
+
+	VIPS_ARG_BOXED(class, "out_array", 2,
+		_("Output array"),
+		_("Array of output values"),
+		VIPS_ARGUMENT_REQUIRED_OUTPUT,
+		G_STRUCT_OFFSET(VipsGetpoints, out_array),
+		VIPS_TYPE_ARRAY_DOUBLE);
+
+	VIPS_ARG_BOXED(class, "x", 5,
+		_("x"),
+		_("Horizontal positions of points to read"),
+		VIPS_ARGUMENT_REQUIRED_INPUT,
+		G_STRUCT_OFFSET(VipsGetpoints, x),
+		VIPS_TYPE_ARRAY_DOUBLE);
+
+	VIPS_ARG_BOXED(class, "y", 6,
+		_("y"),
+		_("Vertical positions of points to read"),
+		VIPS_ARGUMENT_REQUIRED_INPUT,
+		G_STRUCT_OFFSET(VipsGetpoints, y),
+		VIPS_TYPE_ARRAY_DOUBLE);
+
+	VIPS_ARG_INTERPOLATE(class, "interpolate", 7,
+		_("Interpolate"),
+		_("Interpolate pixels with this"),
+		VIPS_ARGUMENT_OPTIONAL_INPUT,
+		G_STRUCT_OFFSET(VipsGetpoints, interpolate));
+
+	VIPS_ARG_BOOL(class, "unpack_complex", 8,
+		_("unpack_complex"),
+		_("Complex pixels should be unpacked"),
+		VIPS_ARGUMENT_OPTIONAL_INPUT,
+		G_STRUCT_OFFSET(VipsGetpoints, unpack_complex),
+		FALSE);
+}
+
+static void
+vips_getpoints_init(VipsGetpoints *getpoints)
+{
+}
+
+/**
+ * vips_getpoints: (method)
+ * @in: image to read from
+ * @vector: (out)(array length=n): output pixel values here
+ * @n: length of output vector
+ * @x: (array length=n_points): horizontal positions to read
+ * @y: (array length=n_points): vertical positions to read
+ * @n_points: number of points
+ * @...: `NULL`-terminated list of optional named arguments
+ *
+ * Reads many pixels from an image in a single pass.
+ *
+ * The points are sorted into tiles, each tile of the image that contains
+ * a point is computed once, and the tiles are computed in parallel. This is
+ * much quicker than calling [method@Image.getpoint] for each point.
+ *
+ * The pixel values are returned in @vector, one after the other, with an
+ * element for each band of each point. If @unpack_complex is set, pixels in
+ * complex images are returned as double-length. You must free the array
+ * with [func@GLib.free] when you are done with it.
+ *
+ * Positions are rounded down to the nearest pixel, unless you set
+ * @interpolate, for example to bilinear or bicubic. Every point must be
+ * inside the image.
+ *
+ * ::: tip "Optional arguments"
+ *     * @interpolate: [class@Interpolate], interpolate pixels with this
+ *     * @unpack_complex: `gboolean`, complex pixels should be unpacked
+ *
+ * ::: seealso
+ *     [method@Image.getpoint], [method@Image.write_to_memory].
+ *
+ * Returns: 0 on success, or -1 on error.
+ */
+int
+vips_getpoints(VipsImage *in, double **vector, int *n,
+	const double *x, const double *y, int n_points, ...)
+{
+	va_list ap;
+	VipsArrayDouble *array_x;
+	VipsArrayDouble *array_y;
+	VipsArrayDouble *out_array;
+	VipsArea *area;
+	int result;
+
+	array_x = vips_array_double_new(x, n_points);
+	array_y = vips_array_double_new(y, n_points);
+
+	va_start(ap, n_points);
+	result = vips_call_split("getpoints", ap,
+		in, &out_array, array_x, array_y);
+	va_end(ap);
+
+	vips_area_unref(VIPS_AREA(array_x));
+	vips_area_unref(VIPS_AREA(array_y));
+
+	if (result)
+		return -1;
+
+	area = VIPS_AREA(out_array);
+	*vector = VIPS_ARRAY(NULL, area->n, double);
+	if (!*vector) {
+		vips_area_unref(area);
+		return -1;
+	}
+	memcpy(*vector, area->data, area->n * area->sizeof_type);
+	*n = area->n;
+	vips_area_unref(area);
+
+	return 0;
+}
@@ -28,6 +28,9 @@
  * 	- unroll common cases
  * 1/2/21 erdmann
  * 	- use double for very large histograms
+ * 14/10/26
+ * 	- count uchar images into several interleaved sub-histograms
+ * 	- only merge the range of bins each thread has touched
  */
 
 /*
@@ -74,10 +77,18 @@ typedef struct {
 	int n_bands;	/* Number of bands in output */
 	int band;		/* If one band in out, which band of input */
 	int size;		/* Number of bins for each band */
+	int n_shards;	/* Number of interleaved sub-histograms per band */
+	int mn;			/* Minimum value we have seen */
 	int mx;			/* Maximum value we have seen */
 	VipsPel **bins; /* double or uint bins */
 } Histogram;
 
+/* uchar images are counted into this many sub-histograms per band, with
+ * neighbouring pixels going to different sub-histograms. Runs of equal
+ * pixels then don't stall on the previous increment of the same bin.
+ */
+#define N_SHARDS (4)
+
 typedef struct _VipsHistFind {
 	VipsStatistic parent_instance;
 
@@ -107,11 +118,11 @@ G_DEFINE_TYPE(VipsHistFind, vips_hist_find, VIPS_TYPE_STATISTIC);
 /* Build a Histogram.
  */
 static Histogram *
-histogram_new(VipsHistFind *hist_find, int n_bands, int band, int size)
+histogram_new(VipsHistFind *hist_find,
+	int n_bands, int band, int size, int n_shards)
 {
-	/* We won't use all of this for uint accumulators.
-	 */
-	int n_bytes = size * sizeof(double);
+	int n_bytes = size * n_shards *
+		(hist_find->large ? sizeof(double) : sizeof(unsigned int));
 
 	Histogram *hist;
 	int i;
@@ -130,6 +141,8 @@ histogram_new(VipsHistFind *hist_find, int n_bands, int band, int size)
 	hist->n_bands = n_bands;
 	hist->band = band;
 	hist->size = size;
+	hist->n_shards = n_shards;
+	hist->mn = size - 1;
 	hist->mx = 0;
 
 	return hist;
@@ -223,12 +236,19 @@ vips_hist_find_start(VipsStatistic *statistic)
 			hist_find->band,
 			statistic->ready->BandFmt == VIPS_FORMAT_UCHAR
 				? 256
-				: 65536);
+				: 65536,
+			1);
 
+	/* Shards are uint, so large histograms get just one.
+	 */
 	return (void *) histogram_new(hist_find,
 		hist_find->hist->n_bands,
 		hist_find->hist->band,
-		hist_find->hist->size);
+		hist_find->hist->size,
+		statistic->ready->BandFmt == VIPS_FORMAT_UCHAR &&
+				!hist_find->large
+			? N_SHARDS
+			: 1);
 }
 
 /* Join a sub-hist onto the main hist.
@@ -245,10 +265,37 @@ vips_hist_find_stop(VipsStatistic *statistic, void *seq)
 	g_assert(sub_hist->n_bands == hist->n_bands &&
 		sub_hist->size == hist->size);
 
-	/* Add on sub-data.
+	/* Add on sub-data. We are called under the statistic lock, so only
+	 * merge the range of bins this sub-hist has touched.
 	 */
-	hist->mx = VIPS_MAX(hist->mx, sub_hist->mx);
+	if (sub_hist->n_shards > 1) {
+		unsigned int **main_bins = (unsigned int **) hist->bins;
+		unsigned int **sub_bins = (unsigned int **) sub_hist->bins;
+		int size = sub_hist->size;
+
+		int mx;
+
+		/* Fold the shards, and find the max as we go. The single band
+		 * scan doesn't track it.
+		 */
+		mx = 0;
+		for (i = 0; i < hist->n_bands; i++) {
+			unsigned int *p = sub_bins[i];
+
+			for (j = 0; j < size; j++) {
+				unsigned int sum = p[j] + p[j + size] +
+					p[j + 2 * size] + p[j + 3 * size];
+
+				if (sum) {
+					main_bins[i][j] += sum;
+					mx = j;
+				}
+			}
+		}
 
+		sub_hist->mx = VIPS_MAX(sub_hist->mx, mx);
+	}
+	else {
 #define SUM(TYPE) \
 	G_STMT_START \
 	{ \
@@ -256,15 +303,18 @@ vips_hist_find_stop(VipsStatistic *statistic, void *seq)
 		TYPE **sub_bins = (TYPE **) sub_hist->bins; \
 \
 		for (i = 0; i < hist->n_bands; i++) \
-			for (j = 0; j < hist->size; j++) \
+			for (j = sub_hist->mn; j <= sub_hist->mx; j++) \
 				main_bins[i][j] += sub_bins[i][j]; \
 	} \
 	G_STMT_END
 
-	if (hist_find->large)
-		SUM(double);
-	else
-		SUM(unsigned int);
+		if (hist_find->large)
+			SUM(double);
+		else
+			SUM(unsigned int);
+	}
+
+	hist->mx = VIPS_MAX(hist->mx, sub_hist->mx);
 
 	/* Blank out sub-hist to make sure we can't add it again.
 	 */
@@ -281,6 +331,8 @@ vips_hist_find_stop(VipsStatistic *statistic, void *seq)
 		for (z = 0; z < nb; z++) { \
 			int v = p[z]; \
 \
+			if (v < mn) \
+				mn = v; \
 			if (v > mx) \
 				mx = v; \
 \
@@ -332,6 +384,8 @@ vips_hist_find_stop(VipsStatistic *statistic, void *seq)
 		for (i = hist->band; i < max; i += nb) { \
 			int v = p[i]; \
 \
+			if (v < mn) \
+				mn = v; \
 			if (v > mx) \
 				mx = v; \
 \
@@ -340,6 +394,30 @@ vips_hist_find_stop(VipsStatistic *statistic, void *seq)
 	} \
 	G_STMT_END
 
+/* Count one band of a uchar line into N_SHARDS sub-histograms.
+ */
+static void
+vips_hist_find_uchar_sharded(unsigned int *restrict bins,
+	VipsPel *restrict p, int n, int nb)
+{
+	int x;
+
+	for (x = 0; x + N_SHARDS <= n; x += N_SHARDS) {
+		bins[p[0]] += 1;
+		bins[256 + p[nb]] += 1;
+		bins[512 + p[2 * nb]] += 1;
+		bins[768 + p[3 * nb]] += 1;
+
+		p += N_SHARDS * nb;
+	}
+
+	for (; x < n; x++) {
+		bins[p[0]] += 1;
+
+		p += nb;
+	}
+}
+
 static int
 vips_hist_find_scan(VipsStatistic *statistic, void *seq,
 	int x, int y, void *in, int n)
@@ -347,10 +425,28 @@ vips_hist_find_scan(VipsStatistic *statistic, void *seq,
 	VipsHistFind *hist_find = (VipsHistFind *) statistic;
 	Histogram *hist = (Histogram *) seq;
 	int nb = statistic->ready->Bands;
+	int mn = hist->mn;
 	int mx = hist->mx;
 
 	int i;
 
+	if (hist->n_shards > 1) {
+		unsigned int **bins = (unsigned int **) hist->bins;
+
+		if (hist_find->band < 0) {
+			for (i = 0; i < nb; i++)
+				vips_hist_find_uchar_sharded(bins[i],
+					(VipsPel *) in + i, n, nb);
+
+			hist->mx = 255;
+		}
+		else
+			vips_hist_find_uchar_sharded(bins[0],
+				(VipsPel *) in + hist_find->band, n, nb);
+
+		return 0;
+	}
+
 	if (hist_find->band < 0)
 		switch (statistic->ready->BandFmt) {
 		case VIPS_FORMAT_UCHAR:
@@ -358,6 +454,7 @@ vips_hist_find_scan(VipsStatistic *statistic, void *seq,
 				SCAN(unsigned char, double, UCSCANOP);
 			else
 				SCAN(unsigned char, unsigned int, UCSCANOP);
+			mn = 0;
 			mx = 255;
 			break;
 
@@ -391,6 +488,7 @@ vips_hist_find_scan(VipsStatistic *statistic, void *seq,
 			g_assert_not_reached();
 		}
 
+	hist->mn = mn;
 	hist->mx = mx;
 
 	return 0;
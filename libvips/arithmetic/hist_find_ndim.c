@@ -10,6 +10,9 @@
  * 	- redo as a class
  * 28/1/22 travisbell
  * 	- better arg checking
+ * 14/10/26
+ * 	- bin with a lookup table
+ * 	- only merge the rows each thread has touched
  */
 
 /*
@@ -60,6 +63,10 @@ typedef struct {
 	struct _VipsHistFindNDim *ndim;
 
 	unsigned int ***data;
+
+	/* Set for each [i][j] row of data we've added to.
+	 */
+	VipsPel *touched;
 } Histogram;
 
 typedef struct _VipsHistFindNDim {
@@ -73,6 +80,10 @@ typedef struct _VipsHistFindNDim {
 	 */
 	int max_val;
 
+	/* Map pixel values to bin indexes.
+	 */
+	int *lut;
+
 	/* Main image histogram. Subhists accumulate to this.
 	 */
 	Histogram *hist;
@@ -108,8 +119,10 @@ histogram_new(VipsHistFindNDim *ndim)
 
 	hist->ndim = ndim;
 
-	if (!(hist->data = VIPS_ARRAY(ndim, bins, unsigned int **)))
+	if (!(hist->data = VIPS_ARRAY(ndim, bins, unsigned int **)) ||
+		!(hist->touched = VIPS_ARRAY(ndim, bins * bins, VipsPel)))
 		return NULL;
+	memset(hist->touched, 0, bins * bins);
 	memset(hist->data, 0, bins * sizeof(unsigned int **));
 
 	for (i = 0; i < ilimit; i++) {
@@ -159,6 +172,15 @@ vips_hist_find_ndim_build(VipsObject *object)
 				_("bins out of range [1,%d]"), ndim->max_val);
 			return -1;
 		}
+
+		/* Same as dividing each pixel by the bin width.
+		 */
+		double scale = (double) (ndim->max_val + 1) / ndim->bins;
+
+		if (!(ndim->lut = VIPS_ARRAY(ndim, ndim->max_val, int)))
+			return -1;
+		for (int v = 0; v < ndim->max_val; v++)
+			ndim->lut[v] = v / scale;
 	}
 
 	/* main hist made on first thread start.
@@ -214,21 +236,28 @@ vips_hist_find_ndim_stop(VipsStatistic *statistic, void *seq)
 	Histogram *sub_hist = (Histogram *) seq;
 	VipsHistFindNDim *ndim = (VipsHistFindNDim *) statistic;
 	Histogram *hist = ndim->hist;
+	int bins = ndim->bins;
 
 	int i, j, k;
 
-	for (i = 0; i < ndim->bins; i++)
-		for (j = 0; j < ndim->bins; j++)
-			for (k = 0; k < ndim->bins; k++)
-				if (hist->data[i] && hist->data[i][j]) {
-					hist->data[i][j][k] +=
-						sub_hist->data[i][j][k];
-
-					/* Zap sub-hist to make sure we
-					 * can't add it again.
-					 */
-					sub_hist->data[i][j][k] = 0;
-				}
+	/* We are called under the statistic lock, so skip any rows this
+	 * sub-hist has not touched.
+	 */
+	for (i = 0; i < bins; i++)
+		for (j = 0; j < bins; j++)
+			if (sub_hist->touched[i * bins + j]) {
+				unsigned int *p = sub_hist->data[i][j];
+				unsigned int *q = hist->data[i][j];
+
+				for (k = 0; k < bins; k++)
+					q[k] += p[k];
+
+				/* Zap sub-hist to make sure we can't add it
+				 * again.
+				 */
+				memset(p, 0, bins * sizeof(unsigned int));
+				sub_hist->touched[i * bins + j] = 0;
+			}
 
 	return 0;
 }
@@ -239,9 +268,10 @@ vips_hist_find_ndim_stop(VipsStatistic *statistic, void *seq)
 \
 		for (i = 0, j = 0; j < n; j++) { \
 			for (k = 0; k < nb; k++, i++) \
-				index[k] = p[i] / scale; \
+				index[k] = lut[p[i]]; \
 \
 			hist->data[index[2]][index[1]][index[0]] += 1; \
+			hist->touched[index[2] * bins + index[1]] = 1; \
 		} \
 	}
 
@@ -253,7 +283,8 @@ vips_hist_find_ndim_scan(VipsStatistic *statistic, void *seq,
 	VipsHistFindNDim *ndim = (VipsHistFindNDim *) statistic;
 	VipsImage *im = statistic->ready;
 	int nb = im->Bands;
-	double scale = (double) (ndim->max_val + 1) / ndim->bins;
+	const int *lut = ndim->lut;
+	int bins = ndim->bins;
 	int i, j, k;
 	int index[3];
 
@@ -2,6 +2,9 @@
  *
  * 7/3/14
  * 	- from hist_find.c
+ * 15/10/26
+ * 	- vote into a single shared accumulator if per-thread ones would be
+ * 	  too large
  */
 
 /*
@@ -43,6 +46,11 @@
 #include "statistic.h"
 #include "hough.h"
 
+/* Per-thread accumulators can use up to this much memory in total. Past this
+ * we share one accumulator.
+ */
+#define VIPS_HOUGH_MAX_MEMORY (64 * 1024 * 1024)
+
 G_DEFINE_ABSTRACT_TYPE(VipsHough, vips_hough, VIPS_TYPE_STATISTIC);
 
 static VipsImage *
@@ -88,6 +96,15 @@ vips_hough_build(VipsObject *object)
 		"out", out,
 		NULL);
 
+	/* Each thread needs a whole accumulator, so memory use can grow
+	 * quickly for large circle transforms. Share one when it gets too
+	 * large, so memory use stays the same however many threads we run.
+	 */
+	hough->shared = VIPS_IMAGE_SIZEOF_IMAGE(out) * vips_concurrency_get() >
+		VIPS_HOUGH_MAX_MEMORY;
+	if (hough->shared)
+		g_info("%s: sharing accumulator", class->nickname);
+
 	if (VIPS_OBJECT_CLASS(vips_hough_parent_class)->build(object))
 		return -1;
 
@@ -103,6 +120,9 @@ vips_hough_start(VipsStatistic *statistic)
 
 	VipsImage *accumulator;
 
+	if (hough->shared)
+		return (void *) hough->out;
+
 	if (!(accumulator = vips_hough_new_accumulator(hough)))
 		return NULL;
 
@@ -117,6 +137,11 @@ vips_hough_stop(VipsStatistic *statistic, void *seq)
 	VipsImage *accumulator = (VipsImage *) seq;
 	VipsHough *hough = (VipsHough *) statistic;
 
+	/* Votes are already in @out.
+	 */
+	if (hough->shared)
+		return 0;
+
 	if (vips_draw_image(hough->out, accumulator, 0, 0,
 			"mode", VIPS_COMBINE_MODE_ADD,
 			NULL)) {
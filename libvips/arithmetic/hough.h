@@ -67,8 +67,25 @@ struct _VipsHough {
 	/* Sum the thread accumulators to here.
 	 */
 	VipsImage *out;
+
+	/* If a set of per-thread accumulators would be too large, all threads
+	 * vote directly into @out with atomic adds instead.
+	 */
+	gboolean shared;
 };
 
+/* Add one vote to an accumulator element.
+ */
+#define VIPS_HOUGH_VOTE(HOUGH, P) \
+	G_STMT_START \
+	{ \
+		if ((HOUGH)->shared) \
+			g_atomic_int_inc((gint *) (P)); \
+		else \
+			*(P) += 1; \
+	} \
+	G_STMT_END
+
 struct _VipsHoughClass {
 	VipsStatisticClass parent_class;
 
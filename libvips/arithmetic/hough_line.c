@@ -124,7 +124,7 @@ vips_hough_line_vote(VipsHough *hough, VipsImage *accumulator, int x, int y)
 		int ri = (r + 1) * (height / 2.0);
 
 		g_assert(ri >= 0 && ri < height);
-		data[i + ri * width] += 1;
+		VIPS_HOUGH_VOTE(hough, &data[i + ri * width]);
 	}
 }
 
@@ -333,6 +333,48 @@ vips_linear_buffer(VipsArithmetic *arithmetic,
 
 	int i, x, k;
 
+#ifdef HAVE_HWY
+	/* SIMD paths for the common single-constant cases.
+	 */
+	if (arithmetic->vector &&
+		linear->single_element) {
+		int sz = width * nb;
+		float a1 = a[0];
+		float b1 = b[0];
+
+		if (linear->uchar)
+			switch (vips_image_get_format(im)) {
+			case VIPS_FORMAT_UCHAR:
+				vips_linear_uchar_uchar_hwy(out, in[0], sz, a1, b1);
+				return;
+			case VIPS_FORMAT_USHORT:
+				vips_linear_ushort_uchar_hwy(out, in[0], sz, a1, b1);
+				return;
+			case VIPS_FORMAT_FLOAT:
+				vips_linear_float_uchar_hwy(out, in[0], sz, a1, b1);
+				return;
+
+			default:
+				break;
+			}
+		else
+			switch (vips_image_get_format(im)) {
+			case VIPS_FORMAT_UCHAR:
+				vips_linear_uchar_hwy(out, in[0], sz, a1, b1);
+				return;
+			case VIPS_FORMAT_USHORT:
+				vips_linear_ushort_hwy(out, in[0], sz, a1, b1);
+				return;
+			case VIPS_FORMAT_FLOAT:
+				vips_linear_float_hwy(out, in[0], sz, a1, b1);
+				return;
+
+			default:
+				break;
+			}
+	}
+#endif /*HAVE_HWY*/
+
 	if (linear->uchar)
 		switch (vips_image_get_format(im)) {
 		case VIPS_FORMAT_UCHAR:
@@ -25,6 +25,8 @@
  * 	- redone as a class
  * 11/8/15
  * 	- log/log10 zero-avoid
+ * 15/10/26
+ * 	- tabulate 8- and 16-bit inputs
  */
 
 /*
@@ -76,31 +78,20 @@ typedef struct _VipsMath {
 
 	VipsOperationMath math;
 
+	/* 8- and 16-bit images use this table, indexed by value + lut_offset.
+	 */
+	float *lut;
+	int lut_offset;
+
 } VipsMath;
 
 typedef VipsUnaryClass VipsMathClass;
 
 G_DEFINE_TYPE(VipsMath, vips_math, VIPS_TYPE_UNARY);
 
-static int
-vips_math_build(VipsObject *object)
-{
-	VipsObjectClass *class = VIPS_OBJECT_GET_CLASS(object);
-	VipsUnary *unary = (VipsUnary *) object;
-
-	if (unary->in &&
-		vips_check_noncomplex(class->nickname, unary->in))
-		return -1;
-
-	if (VIPS_OBJECT_CLASS(vips_math_parent_class)->build(object))
-		return -1;
-
-	return 0;
-}
-
 #define LOOP(IN, OUT, OP) \
 	{ \
-		IN *restrict p = (IN *) in[0]; \
+		IN *restrict p = (IN *) in; \
 		OUT *restrict q = (OUT *) out; \
 \
 		for (x = 0; x < sz; x++) \
@@ -108,7 +99,7 @@ vips_math_build(VipsObject *object)
 	}
 
 #define SWITCH(OP) \
-	switch (vips_image_get_format(im)) { \
+	switch (format) { \
 	case VIPS_FORMAT_UCHAR: \
 		LOOP(unsigned char, float, OP); \
 		break; \
@@ -157,16 +148,12 @@ vips_math_build(VipsObject *object)
 #define LOGZ10(X) ((X) == 0.0 ? 0.0 : log10(X))
 
 static void
-vips_math_buffer(VipsArithmetic *arithmetic,
-	VipsPel *out, VipsPel **in, int width)
+vips_math_line(VipsOperationMath op, VipsBandFormat format,
+	VipsPel *out, VipsPel *in, int sz)
 {
-	VipsMath *math = (VipsMath *) arithmetic;
-	VipsImage *im = arithmetic->ready[0];
-	const int sz = width * vips_image_get_bands(im);
-
 	int x;
 
-	switch (math->math) {
+	switch (op) {
 	case VIPS_OPERATION_MATH_SIN:
 		SWITCH(DSIN);
 		break;
@@ -221,6 +208,148 @@ vips_math_buffer(VipsArithmetic *arithmetic,
 	}
 }
 
+#define LOOKUP(IN) \
+	{ \
+		IN *restrict p = (IN *) in[0]; \
+		float *restrict q = (float *) out; \
+		const float *restrict lut = math->lut + math->lut_offset; \
+\
+		for (x = 0; x < sz; x++) \
+			q[x] = lut[p[x]]; \
+	}
+
+static void
+vips_math_buffer(VipsArithmetic *arithmetic,
+	VipsPel *out, VipsPel **in, int width)
+{
+	VipsMath *math = (VipsMath *) arithmetic;
+	VipsImage *im = arithmetic->ready[0];
+	VipsBandFormat format = vips_image_get_format(im);
+	const int sz = width * vips_image_get_bands(im);
+
+	int x;
+
+	if (!math->lut)
+		vips_math_line(math->math, format, out, in[0], sz);
+	else
+		switch (format) {
+		case VIPS_FORMAT_UCHAR:
+			LOOKUP(unsigned char);
+			break;
+		case VIPS_FORMAT_CHAR:
+			LOOKUP(signed char);
+			break;
+		case VIPS_FORMAT_USHORT:
+			LOOKUP(unsigned short);
+			break;
+		case VIPS_FORMAT_SHORT:
+			LOOKUP(signed short);
+			break;
+
+		default:
+			g_assert_not_reached();
+		}
+}
+
+#define INDEX(IN) \
+	{ \
+		IN *restrict p = (IN *) index; \
+\
+		for (i = 0; i < size; i++) \
+			p[i] = i - offset; \
+	}
+
+/* 8- and 16-bit images have at most 65536 distinct values, so for all but
+ * tiny images it's quicker to run the function once for each value and
+ * look the results up.
+ */
+static int
+vips_math_build_lut(VipsMath *math, VipsImage *in)
+{
+	int size;
+	int offset;
+	VipsPel *index;
+	int i;
+
+	if (in->Coding != VIPS_CODING_NONE)
+		return 0;
+
+	switch (in->BandFmt) {
+	case VIPS_FORMAT_UCHAR:
+	case VIPS_FORMAT_CHAR:
+		size = 256;
+		break;
+
+	case VIPS_FORMAT_USHORT:
+	case VIPS_FORMAT_SHORT:
+		size = 65536;
+		break;
+
+	default:
+		return 0;
+	}
+	offset = vips_band_format_isuint(in->BandFmt) ? 0 : size / 2;
+
+	if ((guint64) VIPS_IMAGE_N_PELS(in) * in->Bands < size)
+		return 0;
+
+	if (!(index = vips_malloc(NULL, size * sizeof(unsigned short))) ||
+		!(math->lut = VIPS_ARRAY(math, size, float))) {
+		g_free(index);
+		return -1;
+	}
+
+	switch (in->BandFmt) {
+	case VIPS_FORMAT_UCHAR:
+		INDEX(unsigned char);
+		break;
+	case VIPS_FORMAT_CHAR:
+		INDEX(signed char);
+		break;
+	case VIPS_FORMAT_USHORT:
+		INDEX(unsigned short);
+		break;
+	case VIPS_FORMAT_SHORT:
+		INDEX(signed short);
+		break;
+
+	default:
+		g_assert_not_reached();
+	}
+
+	vips_math_line(math->math, in->BandFmt,
+		(VipsPel *) math->lut, index, size);
+	math->lut_offset = offset;
+
+	g_free(index);
+
+	return 0;
+}
+
+static int
+vips_math_build(VipsObject *object)
+{
+	VipsObjectClass *class = VIPS_OBJECT_GET_CLASS(object);
+	VipsMath *math = (VipsMath *) object;
+	VipsUnary *unary = (VipsUnary *) object;
+
+	if (unary->in &&
+		vips_check_noncomplex(class->nickname, unary->in))
+		return -1;
+
+	/* The table must be ready before the parent build, since that can
+	 * fold constant images through vips_math_buffer().
+	 */
+	if (unary->in &&
+		vips_math_build_lut(math, unary->in))
+		return -1;
+
+	if (VIPS_OBJECT_CLASS(vips_math_parent_class)->build(object))
+		return -1;
+
+	return 0;
+}
+
 /* Save a bit of typing.
  */
 #define UC VIPS_FORMAT_UCHAR
@@ -26,6 +26,8 @@
  * 	- wopconst was broken
  * 20/10/21 indus
  * 	- add atan2
+ * 15/10/26
+ * 	- tabulate 8- and 16-bit inputs to math2_const
  */
 
 /*
@@ -114,7 +116,7 @@ vips_math2_build(VipsObject *object)
 	}
 
 #define SWITCH(L, OP) \
-	switch (vips_image_get_format(im)) { \
+	switch (format) { \
 	case VIPS_FORMAT_UCHAR: \
 		L(unsigned char, float, OP); \
 		break; \
@@ -179,6 +181,7 @@ vips_math2_buffer(VipsArithmetic *arithmetic,
 {
 	VipsMath2 *math2 = (VipsMath2 *) arithmetic;
 	VipsImage *im = arithmetic->ready[0];
+	VipsBandFormat format = vips_image_get_format(im);
 	const int sz = width * vips_image_get_bands(im);
 
 	int x;
@@ -385,6 +388,13 @@ typedef struct _VipsMath2Const {
 
 	VipsOperationMath2 math2;
 
+	/* 8- and 16-bit images use this table, one per band, indexed by
+	 * value + lut_offset.
+	 */
+	float *lut;
+	int lut_size;
+	int lut_offset;
+
 } VipsMath2Const;
 
 typedef VipsUnaryConstClass VipsMath2ConstClass;
@@ -392,31 +402,49 @@ typedef VipsUnaryConstClass VipsMath2ConstClass;
 G_DEFINE_TYPE(VipsMath2Const,
 	vips_math2_const, VIPS_TYPE_UNARY_CONST);
 
-static int
-vips_math2_const_build(VipsObject *object)
+#define LOOPC(IN, OUT, OP) \
+	{ \
+		IN *restrict p = (IN *) in[0]; \
+		OUT *restrict q = (OUT *) out; \
+\
+		for (i = 0, x = 0; x < width; x++) \
+			for (b = 0; b < bands; b++, i++) \
+				OP(q[i], p[i], c[b]); \
+	}
+
+static void
+vips_math2_const_line(VipsOperationMath2 op, VipsBandFormat format,
+	VipsPel *out, VipsPel **in, int width, int bands, const double *c)
 {
-	VipsObjectClass *class = VIPS_OBJECT_GET_CLASS(object);
-	VipsUnary *unary = (VipsUnary *) object;
+	int i, x, b;
 
-	if (unary->in &&
-		vips_check_noncomplex(class->nickname, unary->in))
-		return -1;
+	switch (op) {
+	case VIPS_OPERATION_MATH2_POW:
+		SWITCH(LOOPC, POW);
+		break;
 
-	if (VIPS_OBJECT_CLASS(vips_math2_const_parent_class)->build(object))
-		return -1;
+	case VIPS_OPERATION_MATH2_WOP:
+		SWITCH(LOOPC, WOP);
+		break;
 
-	return 0;
+	case VIPS_OPERATION_MATH2_ATAN2:
+		SWITCH(LOOPC, ATAN2);
+		break;
+
+	default:
+		g_assert_not_reached();
+		break;
+	}
 }
 
-#define LOOPC(IN, OUT, OP) \
+#define LOOKUP(IN) \
 	{ \
 		IN *restrict p = (IN *) in[0]; \
-		OUT *restrict q = (OUT *) out; \
-		double *restrict c = uconst->c_double; \
+		float *restrict q = (float *) out; \
 \
 		for (i = 0, x = 0; x < width; x++) \
 			for (b = 0; b < bands; b++, i++) \
-				OP(q[i], p[i], c[b]); \
+				q[i] = lut[b * size + p[i]]; \
 	}
 
 static void
@@ -426,27 +454,151 @@ vips_math2_const_buffer(VipsArithmetic *arithmetic,
 	VipsUnaryConst *uconst = (VipsUnaryConst *) arithmetic;
 	VipsMath2Const *math2 = (VipsMath2Const *) arithmetic;
 	VipsImage *im = arithmetic->ready[0];
+	VipsBandFormat format = vips_image_get_format(im);
 	int bands = im->Bands;
 
-	int i, x, b;
+	if (!math2->lut)
+		vips_math2_const_line(math2->math2, format,
+			out, in, width, bands, uconst->c_double);
+	else {
+		const float *restrict lut = math2->lut + math2->lut_offset;
+		const int size = math2->lut_size;
+
+		int i, x, b;
+
+		switch (format) {
+		case VIPS_FORMAT_UCHAR:
+			LOOKUP(unsigned char);
+			break;
+		case VIPS_FORMAT_CHAR:
+			LOOKUP(signed char);
+			break;
+		case VIPS_FORMAT_USHORT:
+			LOOKUP(unsigned short);
+			break;
+		case VIPS_FORMAT_SHORT:
+			LOOKUP(signed short);
+			break;
+
+		default:
+			g_assert_not_reached();
+		}
+	}
+}
 
-	switch (math2->math2) {
-	case VIPS_OPERATION_MATH2_POW:
-		SWITCH(LOOPC, POW);
+#define INDEX(IN) \
+	{ \
+		IN *restrict p = (IN *) index; \
+\
+		for (i = 0; i < size; i++) \
+			p[i] = i - offset; \
+	}
+
+/* The most memory we will use for tables, per operation.
+ */
+#define VIPS_MATH2_LUT_MAX (1024 * 1024)
+
+/* 8- and 16-bit images have at most 65536 distinct values, so for all but
+ * tiny images it's quicker to run the function once for each value and
+ * band and look the results up.
+ */
+static int
+vips_math2_const_build_lut(VipsMath2Const *math2, VipsImage *in,
+	VipsArea *c)
+{
+	double *cv = (double *) c->data;
+	int nc = c->n;
+	int bands = VIPS_MAX(nc, in->Bands);
+
+	int size;
+	int offset;
+	VipsPel *index;
+	int i, b;
+
+	if (in->Coding != VIPS_CODING_NONE)
+		return 0;
+
+	switch (in->BandFmt) {
+	case VIPS_FORMAT_UCHAR:
+	case VIPS_FORMAT_CHAR:
+		size = 256;
 		break;
 
-	case VIPS_OPERATION_MATH2_WOP:
-		SWITCH(LOOPC, WOP);
+	case VIPS_FORMAT_USHORT:
+	case VIPS_FORMAT_SHORT:
+		size = 65536;
 		break;
 
-	case VIPS_OPERATION_MATH2_ATAN2:
-		SWITCH(LOOPC, ATAN2);
+	default:
+		return 0;
+	}
+	offset = vips_band_format_isuint(in->BandFmt) ? 0 : size / 2;
+
+	if ((guint64) bands * size * sizeof(float) > VIPS_MATH2_LUT_MAX ||
+		(guint64) VIPS_IMAGE_N_PELS(in) < size)
+		return 0;
+
+	if (!(index = vips_malloc(NULL, size * sizeof(unsigned short))) ||
+		!(math2->lut = VIPS_ARRAY(math2, bands * size, float))) {
+		g_free(index);
+		return -1;
+	}
+
+	switch (in->BandFmt) {
+	case VIPS_FORMAT_UCHAR:
+		INDEX(unsigned char);
+		break;
+	case VIPS_FORMAT_CHAR:
+		INDEX(signed char);
+		break;
+	case VIPS_FORMAT_USHORT:
+		INDEX(unsigned short);
+		break;
+	case VIPS_FORMAT_SHORT:
+		INDEX(signed short);
 		break;
 
 	default:
 		g_assert_not_reached();
-		break;
 	}
+
+	for (b = 0; b < bands; b++)
+		vips_math2_const_line(math2->math2, in->BandFmt,
+			(VipsPel *) (math2->lut + b * size), &index, size, 1,
+			&cv[VIPS_MIN(b, nc - 1)]);
+	math2->lut_size = size;
+	math2->lut_offset = offset;
+
+	g_free(index);
+
+	return 0;
+}
+
+static int
+vips_math2_const_build(VipsObject *object)
+{
+	VipsObjectClass *class = VIPS_OBJECT_GET_CLASS(object);
+	VipsMath2Const *math2 = (VipsMath2Const *) object;
+	VipsUnary *unary = (VipsUnary *) object;
+	VipsUnaryConst *uconst = (VipsUnaryConst *) object;
+
+	if (unary->in &&
+		vips_check_noncomplex(class->nickname, unary->in))
+		return -1;
+
+	/* The table must be ready before the parent build, since that can
+	 * fold constant images through vips_math2_const_buffer().
+	 */
+	if (unary->in &&
+		uconst->c &&
+		uconst->c->n > 0 &&
+		vips_math2_const_build_lut(math2, unary->in, uconst->c))
+		return -1;
+
+	if (VIPS_OBJECT_CLASS(vips_math2_const_parent_class)->build(object))
+		return -1;
+
+	return 0;
 }
 
 static void
@@ -136,6 +136,24 @@ vips_multiply_buffer(VipsArithmetic *arithmetic,
 
 	int x;
 
+#ifdef HAVE_HWY
+	if (arithmetic->vector)
+		switch (vips_image_get_format(im)) {
+		case VIPS_FORMAT_UCHAR:
+			vips_multiply_uchar_hwy(out, in[0], in[1], sz);
+			return;
+		case VIPS_FORMAT_USHORT:
+			vips_multiply_ushort_hwy(out, in[0], in[1], sz);
+			return;
+		case VIPS_FORMAT_FLOAT:
+			vips_multiply_float_hwy(out, in[0], in[1], sz);
+			return;
+
+		default:
+			break;
+		}
+#endif /*HAVE_HWY*/
+
 	/* Keep types here in sync with vips_bandfmt_multiply[]
 	 * below.
 	 */
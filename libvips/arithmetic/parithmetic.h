@@ -80,6 +80,17 @@ typedef struct _VipsArithmetic {
 	/* Set this to override class->format_table.
 	 */
 	VipsBandFormat format;
+
+	/* Set at build time if subclasses can use their SIMD paths.
+	 */
+	gboolean vector;
+
+	/* For each input, the upstream arithmetic operation we run inline
+	 * rather than computing into a region, or NULL. fuse_depth is the
+	 * length of the longest fused chain ending here.
+	 */
+	struct _VipsArithmetic **fused;
+	int fuse_depth;
 } VipsArithmetic;
 
 typedef struct _VipsArithmeticClass {
@@ -100,6 +111,53 @@ GType vips_arithmetic_get_type(void);
 void vips_arithmetic_set_format_table(VipsArithmeticClass *klass,
 	const VipsBandFormat *format_table);
 
+/* SIMD paths, see arithmetic_hwy.cpp. @sz is the number of elements in each
+ * buffer (width * bands).
+ */
+void vips_add_uchar_hwy(VipsPel *out, VipsPel *in0, VipsPel *in1, int sz);
+void vips_add_ushort_hwy(VipsPel *out, VipsPel *in0, VipsPel *in1, int sz);
+void vips_add_float_hwy(VipsPel *out, VipsPel *in0, VipsPel *in1, int sz);
+void vips_subtract_uchar_hwy(VipsPel *out,
+	VipsPel *in0, VipsPel *in1, int sz);
+void vips_subtract_ushort_hwy(VipsPel *out,
+	VipsPel *in0, VipsPel *in1, int sz);
+void vips_subtract_float_hwy(VipsPel *out,
+	VipsPel *in0, VipsPel *in1, int sz);
+void vips_multiply_uchar_hwy(VipsPel *out,
+	VipsPel *in0, VipsPel *in1, int sz);
+void vips_multiply_ushort_hwy(VipsPel *out,
+	VipsPel *in0, VipsPel *in1, int sz);
+void vips_multiply_float_hwy(VipsPel *out,
+	VipsPel *in0, VipsPel *in1, int sz);
+void vips_divide_uchar_hwy(VipsPel *out, VipsPel *in0, VipsPel *in1, int sz);
+void vips_divide_ushort_hwy(VipsPel *out, VipsPel *in0, VipsPel *in1, int sz);
+void vips_divide_float_hwy(VipsPel *out, VipsPel *in0, VipsPel *in1, int sz);
+void vips_relational_uchar_hwy(VipsPel *out, VipsPel *in0, VipsPel *in1,
+	int sz, VipsOperationRelational op);
+void vips_relational_ushort_hwy(VipsPel *out, VipsPel *in0, VipsPel *in1,
+	int sz, VipsOperationRelational op);
+void vips_relational_float_hwy(VipsPel *out, VipsPel *in0, VipsPel *in1,
+	int sz, VipsOperationRelational op);
+void vips_boolean_uchar_hwy(VipsPel *out, VipsPel *in0, VipsPel *in1,
+	int sz, VipsOperationBoolean op);
+void vips_boolean_ushort_hwy(VipsPel *out, VipsPel *in0, VipsPel *in1,
+	int sz, VipsOperationBoolean op);
+void vips_linear_uchar_hwy(VipsPel *out, VipsPel *in, int sz,
+	float a, float b);
+void vips_linear_ushort_hwy(VipsPel *out, VipsPel *in, int sz,
+	float a, float b);
+void vips_linear_float_hwy(VipsPel *out, VipsPel *in, int sz,
+	float a, float b);
+void vips_linear_uchar_uchar_hwy(VipsPel *out, VipsPel *in, int sz,
+	float a, float b);
+void vips_linear_ushort_uchar_hwy(VipsPel *out, VipsPel *in, int sz,
+	float a, float b);
+void vips_linear_float_uchar_hwy(VipsPel *out, VipsPel *in, int sz,
+	float a, float b);
+void vips_abs_char_hwy(VipsPel *out, VipsPel *in, int sz);
+void vips_abs_short_hwy(VipsPel *out, VipsPel *in, int sz);
+void vips_abs_float_hwy(VipsPel *out, VipsPel *in, int sz);
+
 #ifdef __cplusplus
 }
 #endif /*__cplusplus*/
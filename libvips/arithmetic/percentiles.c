@@ -0,0 +1,672 @@
+/* find many percentiles of each band in a single pass
+ *
+ * 15/10/26
+ * 	- from percent.c and hist_find.c
+ */
+
+/*
+
+	This file is part of VIPS.
+
+	VIPS is free software; you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+	02110-1301  USA
+
+ */
+
+/*
+
+	These files are distributed with VIPS - http://www.vips.ecs.soton.ac.uk
+
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /*HAVE_CONFIG_H*/
+#include <glib/gi18n-lib.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <vips/vips.h>
+#include <vips/internal.h>
+
+#include "statistic.h"
+
+/* Size of the top compactor in the sketch. Rank error is around 1.7 / k, so
+ * about 0.3%.
+ */
+#define VIPS_SKETCH_K (512)
+
+/* Smallest compactor we make.
+ */
+#define VIPS_SKETCH_MIN (8)
+
+/* Enough levels for 2^48 values.
+ */
+#define VIPS_SKETCH_MAX_LEVELS (48)
+
+/* A KLL quantile sketch for one band. Level h holds items of weight 2^h.
+ * When a level fills up, it's sorted and every other item is promoted to the
+ * next level, so the sketch stays small however many values we add, and two
+ * sketches can be merged by concatenating their levels.
+ */
+typedef struct _VipsSketch {
+	double *items[VIPS_SKETCH_MAX_LEVELS];
+	int n[VIPS_SKETCH_MAX_LEVELS];
+	int size[VIPS_SKETCH_MAX_LEVELS];
+	int n_levels;
+
+	guint64 count;
+	double min;
+	double max;
+
+	/* Pick which half to keep on compaction.
+	 */
+	guint32 seed;
+} VipsSketch;
+
+/* Per-thread state, and the merged result.
+ */
+typedef struct _VipsPercentilesSeq {
+	int bands;
+
+	/* Exact histogram for 8 and 16-bit images, n_bins per band.
+	 */
+	guint64 *hist;
+	int n_bins;
+	int offset;
+
+	/* A sketch per band for everything else.
+	 */
+	VipsSketch *sketch;
+} VipsPercentilesSeq;
+
+typedef struct _VipsPercentiles {
+	VipsStatistic parent_instance;
+
+	VipsArrayDouble *percent;
+	VipsArrayDouble *out_array;
+
+	/* The first thread to finish, everyone else merges into this.
+	 */
+	VipsPercentilesSeq *total;
+} VipsPercentiles;
+
+typedef VipsStatisticClass VipsPercentilesClass;
+
+G_DEFINE_TYPE(VipsPercentiles, vips_percentiles, VIPS_TYPE_STATISTIC);
+
+static int
+vips_sketch_capacity(VipsSketch *sketch, int level)
+{
+	double capacity;
+
+	capacity = VIPS_SKETCH_K *
+		pow(2.0 / 3.0, sketch->n_levels - 1 - level);
+
+	return VIPS_MAX(VIPS_SKETCH_MIN, (int) ceil(capacity));
+}
+
+static void
+vips_sketch_init(VipsSketch *sketch)
+{
+	memset(sketch, 0, sizeof(VipsSketch));
+	sketch->n_levels = 1;
+	sketch->min = INFINITY;
+	sketch->max = -INFINITY;
+	sketch->seed = 0x9e3779b9;
+}
+
+static void
+vips_sketch_free(VipsSketch *sketch)
+{
+	int h;
+
+	for (h = 0; h < VIPS_SKETCH_MAX_LEVELS; h++)
+		VIPS_FREE(sketch->items[h]);
+}
+
+static void
+vips_sketch_append(VipsSketch *sketch, int level, double value)
+{
+	if (sketch->n[level] >= sketch->size[level]) {
+		sketch->size[level] = VIPS_MAX(VIPS_SKETCH_MIN,
+			sketch->size[level] * 2);
+		sketch->items[level] = g_renew(double,
+			sketch->items[level], sketch->size[level]);
+	}
+
+	sketch->items[level][sketch->n[level]++] = value;
+}
+
+static int
+vips_sketch_compare(const void *a, const void *b)
+{
+	double d1 = *((double *) a);
+	double d2 = *((double *) b);
+
+	return d1 < d2 ? -1 : d1 > d2 ? 1 : 0;
+}
+
+/* Compact any level that's over capacity. Promoting items can overfill the
+ * level above, so go up the whole stack.
+ */
+static void
+vips_sketch_compress(VipsSketch *sketch)
+{
+	int h;
+
+	for (h = 0; h < sketch->n_levels; h++) {
+		double *items = sketch->items[h];
+		int n = sketch->n[h];
+
+		int keep;
+		int offset;
+		int i;
+
+		if (n < vips_sketch_capacity(sketch, h))
+			continue;
+
+		if (h == sketch->n_levels - 1) {
+			if (sketch->n_levels >= VIPS_SKETCH_MAX_LEVELS)
+				return;
+			sketch->n_levels += 1;
+		}
+
+		qsort(items, n, sizeof(double), vips_sketch_compare);
+
+		/* An odd item out stays behind at this level, so the total
+		 * weight never changes.
+		 */
+		keep = n & 1;
+
+		sketch->seed ^= sketch->seed << 13;
+		sketch->seed ^= sketch->seed >> 17;
+		sketch->seed ^= sketch->seed << 5;
+		offset = sketch->seed & 1;
+
+		for (i = keep + offset; i < n; i += 2)
+			vips_sketch_append(sketch, h + 1, items[i]);
+
+		sketch->n[h] = keep;
+	}
+}
+
+static inline void
+vips_sketch_add(VipsSketch *sketch, double value)
+{
+	if (value < sketch->min)
+		sketch->min = value;
+	if (value > sketch->max)
+		sketch->max = value;
+	sketch->count += 1;
+
+	vips_sketch_append(sketch, 0, value);
+	if (sketch->n[0] >= vips_sketch_capacity(sketch, 0))
+		vips_sketch_compress(sketch);
+}
+
+static void
+vips_sketch_merge(VipsSketch *sketch, VipsSketch *from)
+{
+	int h, i;
+
+	for (h = 0; h < from->n_levels; h++)
+		for (i = 0; i < from->n[h]; i++)
+			vips_sketch_append(sketch, h, from->items[h][i]);
+	sketch->n_levels = VIPS_MAX(sketch->n_levels, from->n_levels);
+
+	sketch->count += from->count;
+	sketch->min = VIPS_MIN(sketch->min, from->min);
+	sketch->max = VIPS_MAX(sketch->max, from->max);
+
+	vips_sketch_compress(sketch);
+}
+
+typedef struct _VipsSketchItem {
+	double value;
+	guint64 weight;
+} VipsSketchItem;
+
+static int
+vips_sketch_item_compare(const void *a, const void *b)
+{
+	const VipsSketchItem *i1 = (const VipsSketchItem *) a;
+	const VipsSketchItem *i2 = (const VipsSketchItem *) b;
+
+	return i1->value < i2->value ? -1 : i1->value > i2->value ? 1 : 0;
+}
+
+/* Look up each percentile. Write results @stride apart.
+ */
+static void
+vips_sketch_query(VipsSketch *sketch,
+	double *percent, int n_percent, double *out, int stride)
+{
+	VipsSketchItem *items;
+	int n_items;
+	int h, i, j;
+
+	n_items = 0;
+	for (h = 0; h < sketch->n_levels; h++)
+		n_items += sketch->n[h];
+	items = VIPS_ARRAY(NULL, VIPS_MAX(1, n_items), VipsSketchItem);
+
+	j = 0;
+	for (h = 0; h < sketch->n_levels; h++)
+		for (i = 0; i < sketch->n[h]; i++) {
+			items[j].value = sketch->items[h][i];
+			items[j].weight = (guint64) 1 << h;
+			j += 1;
+		}
+	qsort(items, n_items, sizeof(VipsSketchItem),
+		vips_sketch_item_compare);
+
+	for (i = 0; i < n_percent; i++) {
+		double target = percent[i] / 100.0 * sketch->count;
+
+		guint64 cumulative;
+		double value;
+
+		if (sketch->count == 0)
+			value = 0.0;
+		else if (percent[i] <= 0.0)
+			value = sketch->min;
+		else {
+			value = sketch->max;
+			cumulative = 0;
+			for (j = 0; j < n_items; j++) {
+				cumulative += items[j].weight;
+				if (cumulative > target) {
+					value = items[j].value;
+					break;
+				}
+			}
+		}
+
+		out[i * stride] = value;
+	}
+
+	g_free(items);
+}
+
+static void
+vips_percentiles_seq_free(VipsPercentilesSeq *seq)
+{
+	int b;
+
+	if (seq->sketch)
+		for (b = 0; b < seq->bands; b++)
+			vips_sketch_free(&seq->sketch[b]);
+	VIPS_FREE(seq->sketch);
+	VIPS_FREE(seq->hist);
+	g_free(seq);
+}
+
+static void
+vips_percentiles_dispose(GObject *gobject)
+{
+	VipsPercentiles *percentiles = (VipsPercentiles *) gobject;
+
+	if (percentiles->total) {
+		vips_percentiles_seq_free(percentiles->total);
+		percentiles->total = NULL;
+	}
+
+	G_OBJECT_CLASS(vips_percentiles_parent_class)->dispose(gobject);
+}
+
+static int
+vips_percentiles_build(VipsObject *object)
+{
+	VipsObjectClass *class = VIPS_OBJECT_GET_CLASS(object);
+	VipsStatistic *statistic = VIPS_STATISTIC(object);
+	VipsPercentiles *percentiles = (VipsPercentiles *) object;
+
+	double *percent;
+	int n_percent;
+	VipsPercentilesSeq *total;
+	double *out;
+	VipsArrayDouble *out_array;
+	int i, b;
+
+	if (statistic->in &&
+		vips_check_noncomplex(class->nickname, statistic->in))
+		return -1;
+
+	if (percentiles->percent) {
+		percent = (double *) VIPS_AREA(percentiles->percent)->data;
+		n_percent = VIPS_AREA(percentiles->percent)->n;
+		for (i = 0; i < n_percent; i++)
+			if (percent[i] < 0.0 ||
+				percent[i] > 100.0) {
+				vips_error(class->nickname,
+					"%s", _("percent must be in [0, 100]"));
+				return -1;
+			}
+	}
+
+	if (VIPS_OBJECT_CLASS(vips_percentiles_parent_class)->build(object))
+		return -1;
+
+	if (!(total = percentiles->total)) {
+		vips_error(class->nickname, "%s", _("no pixels"));
+		return -1;
+	}
+	percent = (double *) VIPS_AREA(percentiles->percent)->data;
+	n_percent = VIPS_AREA(percentiles->percent)->n;
+	out = VIPS_ARRAY(object, n_percent * total->bands, double);
+
+	for (b = 0; b < total->bands; b++)
+		if (total->hist) {
+			guint64 *hist = total->hist + b * total->n_bins;
+
+			guint64 count;
+			guint64 cumulative;
+			int lo, hi, v;
+
+			count = 0;
+			lo = total->n_bins - 1;
+			hi = 0;
+			for (v = 0; v < total->n_bins; v++)
+				if (hist[v]) {
+					count += hist[v];
+					lo = VIPS_MIN(lo, v);
+					hi = VIPS_MAX(hi, v);
+				}
+
+			/* The first value with more than percent of
+			 * pixels at or below it, as percent does.
+			 */
+			for (i = 0; i < n_percent; i++) {
+				double target = percent[i] / 100.0 * count;
+
+				if (count == 0)
+					v = total->offset;
+				else if (percent[i] <= 0.0)
+					v = lo;
+				else {
+					cumulative = 0;
+					for (v = lo; v < hi; v++) {
+						cumulative += hist[v];
+						if (cumulative > target)
+							break;
+					}
+				}
+
+				out[i * total->bands + b] = v - total->offset;
+			}
+		}
+		else
+			vips_sketch_query(&total->sketch[b],
+				percent, n_percent, out + b, total->bands);
+
+	out_array = vips_array_double_new(out, n_percent * total->bands);
+	g_object_set(object,
+		"out_array", out_array,
+		NULL);
+	vips_area_unref(VIPS_AREA(out_array));
+
+	return 0;
+}
+
+static void *
+vips_percentiles_start(VipsStatistic *statistic)
+{
+	VipsImage *ready = statistic->ready;
+	VipsPercentilesSeq *seq;
+	int b;
+
+	seq = g_new0(VipsPercentilesSeq, 1);
+	seq->bands = ready->Bands;
+
+	switch (ready->BandFmt) {
+	case VIPS_FORMAT_UCHAR:
+	case VIPS_FORMAT_CHAR:
+		seq->n_bins = 256;
+		break;
+
+	case VIPS_FORMAT_USHORT:
+	case VIPS_FORMAT_SHORT:
+		seq->n_bins = 65536;
+		break;
+
+	default:
+		break;
+	}
+
+	if (ready->BandFmt == VIPS_FORMAT_CHAR ||
+		ready->BandFmt == VIPS_FORMAT_SHORT)
+		seq->offset = seq->n_bins / 2;
+
+	if (seq->n_bins)
+		seq->hist = g_new0(guint64, seq->n_bins * seq->bands);
+	else {
+		seq->sketch = g_new(VipsSketch, seq->bands);
+		for (b = 0; b < seq->bands; b++)
+			vips_sketch_init(&seq->sketch[b]);
+	}
+
+	return (void *) seq;
+}
+
+#define HIST(TYPE) \
+	{ \
+		TYPE *p = (TYPE *) in; \
+\
+		for (x = 0; x < n; x++) \
+			for (b = 0; b < bands; b++) { \
+				seq->hist[b * seq->n_bins + \
+					(int) p[0] + seq->offset] += 1; \
+				p += 1; \
+			} \
+	}
+
+#define SKETCH(TYPE) \
+	{ \
+		TYPE *p = (TYPE *) in; \
+\
+		for (x = 0; x < n; x++) \
+			for (b = 0; b < bands; b++) { \
+				double v = p[0]; \
+\
+				if (!isnan(v)) \
+					vips_sketch_add(&seq->sketch[b], v); \
+				p += 1; \
+			} \
+	}
+
+static int
+vips_percentiles_scan(VipsStatistic *statistic,
+	void *vseq, int x, int y, void *in, int n)
+{
+	VipsPercentilesSeq *seq = (VipsPercentilesSeq *) vseq;
+	const int bands = seq->bands;
+
+	int b;
+
+	switch (statistic->ready->BandFmt) {
+	case VIPS_FORMAT_UCHAR:
+		HIST(unsigned char);
+		break;
+	case VIPS_FORMAT_CHAR:
+		HIST(signed char);
+		break;
+	case VIPS_FORMAT_USHORT:
+		HIST(unsigned short);
+		break;
+	case VIPS_FORMAT_SHORT:
+		HIST(signed short);
+		break;
+	case VIPS_FORMAT_UINT:
+		SKETCH(unsigned int);
+		break;
+	case VIPS_FORMAT_INT:
+		SKETCH(signed int);
+		break;
+	case VIPS_FORMAT_FLOAT:
+		SKETCH(float);
+		break;
+	case VIPS_FORMAT_DOUBLE:
+		SKETCH(double);
+		break;
+
+	default:
+		g_assert_not_reached();
+	}
+
+	return 0;
+}
+
+/* Merge a thread's partial result into the total. The first thread to
+ * finish becomes the total.
+ */
+static int
+vips_percentiles_stop(VipsStatistic *statistic, void *vseq)
+{
+	VipsPercentiles *percentiles = (VipsPercentiles *) statistic;
+	VipsPercentilesSeq *seq = (VipsPercentilesSeq *) vseq;
+	VipsPercentilesSeq *total = percentiles->total;
+
+	int i, b;
+
+	if (!total) {
+		percentiles->total = seq;
+		return 0;
+	}
+
+	if (total->hist)
+		for (i = 0; i < total->n_bins * total->bands; i++)
+			total->hist[i] += seq->hist[i];
+	else
+		for (b = 0; b < total->bands; b++)
+			vips_sketch_merge(&total->sketch[b], &seq->sketch[b]);
+
+	vips_percentiles_seq_free(seq);
+
+	return 0;
+}
+
+static void
+vips_percentiles_class_init(VipsPercentilesClass *class)
+{
+	GObjectClass *gobject_class = (GObjectClass *) class;
+	VipsObjectClass *object_class = (VipsObjectClass *) class;
+	VipsStatisticClass *sclass = VIPS_STATISTIC_CLASS(class);
+
+	gobject_class->dispose = vips_percentiles_dispose;
+	gobject_class->set_property = vips_object_set_property;
+	gobject_class->get_property = vips_object_get_property;
+
+	object_class->nickname = "percentiles";
+	object_class->description = _("find many percentiles of each band");
+	object_class->build = vips_percentiles_build;
+
+	sclass->start = vips_percentiles_start;
+	sclass->scan = vips_percentiles_scan;
+	sclass->stop = vips_percentiles_stop;
+
+	VIPS_ARG_BOXED(class, "out_array", 2,
+		_("Output array"),
+		_("Array of output values"),
+		VIPS_ARGUMENT_REQUIRED_OUTPUT,
+		G_STRUCT_OFFSET(VipsPercentiles, out_array),
+		VIPS_TYPE_ARRAY_DOUBLE);
+
+	VIPS_ARG_BOXED(class, "percent", 5,
+		_("Percent"),
+		_("Percentiles to find"),
+		VIPS_ARGUMENT_REQUIRED_INPUT,
+		G_STRUCT_OFFSET(VipsPercentiles, percent),
+		VIPS_TYPE_ARRAY_DOUBLE);
+}
+
+static void
+vips_percentiles_init(VipsPercentiles *percentiles)
+{
+}
+
+/**
+ * vips_percentiles: (method)
+ * @in: input image
+ * @vector: (out)(array length=n): output thresholds here
+ * @n: length of output vector
+ * @percent: (array length=n_percent): percentiles to find
+ * @n_percent: number of percentiles
+ * @...: `NULL`-terminated list of optional named arguments
+ *
+ * Find the value below which there are @percent values of each band of @in,
+ * for many values of @percent, in a single pass over the image. For
+ * example, the 1st and 99th percentiles of each band for auto-levels:
+ *
+ * ```c
+ * double percent[] = { 1, 99 };
+ * double *vector;
+ * int n;
+ *
+ * if (vips_percentiles(in, &vector, &n, percent, 2, NULL))
+ *     return -1;
+ * ```
+ *
+ * The result has @n_percent times bands elements: all the bands for the
+ * first percentile, then all the bands for the second, and so on. You must
+ * free the array with [func@GLib.free] when you are done with it.
+ *
+ * 8 and 16-bit images are counted with a histogram, so the result is
+ * exact. Other formats use a quantile sketch
+ * built in parallel, which is accurate to within about 0.3% of the pixels.
+ * NaN is ignored.
+ *
+ * ::: seealso
+ *     [method@Image.percent], [method@Image.hist_find].
+ *
+ * Returns: 0 on success, -1 on error
+ */
+int
+vips_percentiles(VipsImage *in, double **vector, int *n,
+	const double *percent, int n_percent, ...)
+{
+	va_list ap;
+	VipsArrayDouble *array_percent;
+	VipsArrayDouble *out_array;
+	VipsArea *area;
+	int result;
+
+	array_percent = vips_array_double_new(percent, n_percent);
+
+	va_start(ap, n_percent);
+	result = vips_call_split("percentiles", ap,
+		in, &out_array, array_percent);
+	va_end(ap);
+
+	vips_area_unref(VIPS_AREA(array_percent));
+
+	if (result)
+		return -1;
+
+	area = VIPS_AREA(out_array);
+	*vector = VIPS_ARRAY(NULL, area->n, double);
+	if (!*vector) {
+		vips_area_unref(area);
+		return -1;
+	}
+	memcpy(*vector, area->data, area->n * area->sizeof_type);
+	*n = area->n;
+	vips_area_unref(area);
+
+	return 0;
+}
@@ -184,6 +184,24 @@ vips_relational_buffer(VipsArithmetic *arithmetic,
 		VIPS_SWAP(VipsPel *, in0, in1);
 	}
 
+#ifdef HAVE_HWY
+	if (arithmetic->vector)
+		switch (vips_image_get_format(im)) {
+		case VIPS_FORMAT_UCHAR:
+			vips_relational_uchar_hwy(out, in0, in1, sz, op);
+			return;
+		case VIPS_FORMAT_USHORT:
+			vips_relational_ushort_hwy(out, in0, in1, sz, op);
+			return;
+		case VIPS_FORMAT_FLOAT:
+			vips_relational_float_hwy(out, in0, in1, sz, op);
+			return;
+
+		default:
+			break;
+		}
+#endif /*HAVE_HWY*/
+
 	switch (op) {
 	case VIPS_OPERATION_RELATIONAL_EQUAL:
 		SWITCH(RLOOP, CLOOP, ==, CEQUAL);
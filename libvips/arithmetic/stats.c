@@ -27,6 +27,9 @@
  * 7/11/11
  * 	- redone as a class
  * 	- track maxpos / minpos too
+ * 15/10/26
+ * 	- add @histogram, @percent, @hist and @threshold, so you can find a
+ * 	  histogram and percentiles in the same pass
  */
 
 /*
@@ -78,8 +81,18 @@ typedef struct _VipsStats {
 	VipsStatistic parent_instance;
 
 	VipsImage *out;
+	gboolean histogram;
+	VipsArrayDouble *percent;
+	VipsImage *hist;
+	VipsArrayDouble *threshold;
 
 	gboolean set; /* FALSE means no value yet */
+
+	/* If we are finding a histogram, n_bins per band, all bands
+	 * together. NULL otherwise.
+	 */
+	int n_bins;
+	guint64 *bins;
 } VipsStats;
 
 typedef VipsStatisticClass VipsStatsClass;
@@ -102,6 +115,116 @@ enum {
 	COL_LAST = 10
 };
 
+/* As vips_hist_find(), 8-bit images get 256 bins and everything else is
+ * clipped to 16 bits.
+ */
+static int
+vips_stats_n_bins(VipsImage *in)
+{
+	VipsBandFormat format = vips_image_get_format(in);
+
+	return format == VIPS_FORMAT_UCHAR ||
+			format == VIPS_FORMAT_CHAR
+		? 256
+		: 65536;
+}
+
+/* Make the histogram output, and find any percentiles. Percentiles are
+ * found for each band and averaged, as vips_percent().
+ */
+static int
+vips_stats_build_hist(VipsStats *stats)
+{
+	VipsStatistic *statistic = VIPS_STATISTIC(stats);
+	int bands = vips_image_get_bands(statistic->ready);
+	guint64 pels = VIPS_IMAGE_N_PELS(statistic->ready);
+	double *row0 = VIPS_MATRIX(stats->out, 0, 0);
+
+	VipsImage *hist;
+	int width;
+	int b, i;
+
+	/* Nothing was scanned.
+	 */
+	if (!stats->bins)
+		return 0;
+
+	/* ushort and wider images get a histogram as wide as the largest
+	 * value, as vips_hist_find().
+	 */
+	if (stats->n_bins == 256)
+		width = 256;
+	else
+		width = VIPS_CLIP(1, (int) row0[COL_MAX] + 1, stats->n_bins);
+
+	hist = vips_image_new_memory();
+	vips_image_init_fields(hist,
+		width, 1, bands,
+		pels >= ((guint64) 1 << 32) ? VIPS_FORMAT_DOUBLE : VIPS_FORMAT_UINT,
+		VIPS_CODING_NONE, VIPS_INTERPRETATION_HISTOGRAM, 1.0, 1.0);
+	if (vips_image_write_prepare(hist)) {
+		VIPS_UNREF(hist);
+		return -1;
+	}
+
+	for (b = 0; b < bands; b++) {
+		guint64 *bins = stats->bins + b * stats->n_bins;
+
+		if (hist->BandFmt == VIPS_FORMAT_DOUBLE) {
+			double *q = (double *) VIPS_IMAGE_ADDR(hist, 0, 0);
+
+			for (i = 0; i < width; i++)
+				q[i * bands + b] = bins[i];
+		}
+		else {
+			unsigned int *q = (unsigned int *) VIPS_IMAGE_ADDR(hist, 0, 0);
+
+			for (i = 0; i < width; i++)
+				q[i * bands + b] = bins[i];
+		}
+	}
+
+	g_object_set(stats, "hist", hist, NULL);
+
+	if (stats->percent) {
+		int n;
+		double *percent = vips_array_double_get(stats->percent, &n);
+		double *threshold;
+		VipsArrayDouble *array;
+
+		if (!(threshold = VIPS_ARRAY(stats, n, double)))
+			return -1;
+
+		for (i = 0; i < n; i++) {
+			double target = percent[i] / 100.0 * pels;
+
+			threshold[i] = 0.0;
+			for (b = 0; b < bands; b++) {
+				guint64 *bins = stats->bins + b * stats->n_bins;
+
+				guint64 sum;
+				int j;
+
+				sum = 0;
+				for (j = 0; j < width - 1; j++) {
+					sum += bins[j];
+					if (sum > target)
+						break;
+				}
+
+				threshold[i] += j;
+			}
+			threshold[i] /= bands;
+		}
+
+		array = vips_array_double_new(threshold, n);
+		g_object_set(stats, "threshold", array, NULL);
+		vips_area_unref(VIPS_AREA(array));
+	}
+
+	return 0;
+}
+
 static int
 vips_stats_build(VipsObject *object)
 {
@@ -124,6 +247,11 @@ vips_stats_build(VipsObject *object)
 			NULL);
 	}
 
+	/* Percentiles need the histogram.
+	 */
+	if (stats->percent)
+		stats->histogram = TRUE;
+
 	if (VIPS_OBJECT_CLASS(vips_stats_parent_class)->build(object))
 		return -1;
 
@@ -170,6 +298,10 @@ vips_stats_build(VipsObject *object)
 			(row0[COL_SUM] * row0[COL_SUM] / vals)) /
 		(vals - 1));
 
+	if (stats->histogram &&
+		vips_stats_build_hist(stats))
+		return -1;
+
 	return 0;
 }
 
@@ -219,6 +351,23 @@ vips_stats_stop(VipsStatistic *statistic, void *seq)
 		}
 	}
 
+	if (local->bins) {
+		if (!global->bins) {
+			global->n_bins = local->n_bins;
+			global->bins = local->bins;
+			local->bins = NULL;
+		}
+		else {
+			int n = local->n_bins * bands;
+
+			int i;
+
+			for (i = 0; i < n; i++)
+				global->bins[i] += local->bins[i];
+		}
+	}
+
+	VIPS_FREE(local->bins);
 	VIPS_FREEF(g_object_unref, local->out);
 	VIPS_FREEF(g_free, seq);
 
@@ -232,15 +381,22 @@ vips_stats_start(VipsStatistic *statistic)
 {
 	int bands = vips_image_get_bands(statistic->ready);
 
+	VipsStats *global = (VipsStats *) statistic;
+
 	VipsStats *stats;
 
-	stats = g_new(VipsStats, 1);
+	stats = g_new0(VipsStats, 1);
 	if (!(stats->out = vips_image_new_matrix(COL_LAST, bands + 1))) {
 		g_free(stats);
 		return NULL;
 	}
 	stats->set = FALSE;
 
+	if (global->histogram) {
+		stats->n_bins = vips_stats_n_bins(statistic->ready);
+		stats->bins = g_new0(guint64, stats->n_bins * bands);
+	}
+
 	return (void *) stats;
 }
 
@@ -375,6 +531,77 @@ vips_stats_start(VipsStatistic *statistic)
 		local->set = TRUE; \
 	}
 
+/* Count into the histogram. Values are clipped to the range of the bins.
+ */
+#define HIST(TYPE) \
+	{ \
+		TYPE *p = (TYPE *) in; \
+\
+		for (i = 0; i < n; i++) \
+			for (b = 0; b < bands; b++) { \
+				int v = VIPS_CLIP(0, *p, local->n_bins - 1); \
+\
+				local->bins[b * local->n_bins + v] += 1; \
+				p += 1; \
+			} \
+	}
+
+/* As above, but skip NaN.
+ */
+#define HISTF(TYPE) \
+	{ \
+		TYPE *p = (TYPE *) in; \
+\
+		for (i = 0; i < n; i++) \
+			for (b = 0; b < bands; b++) { \
+				if (!isnan(*p)) { \
+					int v = VIPS_CLIP(0, *p, local->n_bins - 1); \
+\
+					local->bins[b * local->n_bins + v] += 1; \
+				} \
+				p += 1; \
+			} \
+	}
+
+static void
+vips_stats_scan_hist(VipsStatistic *statistic, VipsStats *local,
+	void *in, int n)
+{
+	const int bands = vips_image_get_bands(statistic->ready);
+
+	int b, i;
+
+	switch (vips_image_get_format(statistic->ready)) {
+	case VIPS_FORMAT_UCHAR:
+		HIST(unsigned char);
+		break;
+	case VIPS_FORMAT_CHAR:
+		HIST(signed char);
+		break;
+	case VIPS_FORMAT_USHORT:
+		HIST(unsigned short);
+		break;
+	case VIPS_FORMAT_SHORT:
+		HIST(signed short);
+		break;
+	case VIPS_FORMAT_UINT:
+		HIST(unsigned int);
+		break;
+	case VIPS_FORMAT_INT:
+		HIST(signed int);
+		break;
+	case VIPS_FORMAT_FLOAT:
+		HISTF(float);
+		break;
+	case VIPS_FORMAT_DOUBLE:
+		HISTF(double);
+		break;
+
+	default:
+		g_assert_not_reached();
+	}
+}
+
 /* Loop over region, accumulating a sum in *tmp.
  */
 static int
@@ -416,6 +643,9 @@ vips_stats_scan(VipsStatistic *statistic, void *seq,
 		g_assert_not_reached();
 	}
 
+	if (local->bins)
+		vips_stats_scan_hist(statistic, local, in, n);
+
 	return 0;
 }
 
@@ -442,6 +672,33 @@ vips_stats_class_init(VipsStatsClass *class)
 		_("Output array of statistics"),
 		VIPS_ARGUMENT_REQUIRED_OUTPUT,
 		G_STRUCT_OFFSET(VipsStats, out));
+
+	VIPS_ARG_BOOL(class, "histogram", 101,
+		_("Histogram"),
+		_("Also find a histogram"),
+		VIPS_ARGUMENT_OPTIONAL_INPUT,
+		G_STRUCT_OFFSET(VipsStats, histogram),
+		FALSE);
+
+	VIPS_ARG_BOXED(class, "percent", 102,
+		_("Percent"),
+		_("Also find thresholds for these percents of pixels"),
+		VIPS_ARGUMENT_OPTIONAL_INPUT,
+		G_STRUCT_OFFSET(VipsStats, percent),
+		VIPS_TYPE_ARRAY_DOUBLE);
+
+	VIPS_ARG_IMAGE(class, "hist", 103,
+		_("Hist"),
+		_("Output histogram"),
+		VIPS_ARGUMENT_OPTIONAL_OUTPUT,
+		G_STRUCT_OFFSET(VipsStats, hist));
+
+	VIPS_ARG_BOXED(class, "threshold", 104,
+		_("Threshold"),
+		_("Threshold for each percent"),
+		VIPS_ARGUMENT_OPTIONAL_OUTPUT,
+		G_STRUCT_OFFSET(VipsStats, threshold),
+		VIPS_TYPE_ARRAY_DOUBLE);
 }
 
 static void
@@ -469,8 +726,21 @@ vips_stats_init(VipsStats *stats)
  * If there is more than one maxima or minima, one of them will be chosen at
  * random.
  *
+ * Set @histogram to also find a histogram in the same pass, as
+ * [method@Image.hist_find], and return it in @hist. Set @percent to an array
+ * of percentages to find the threshold below which each percentage of pixels
+ * falls, as [method@Image.percent], and return them in @threshold. Setting
+ * @percent implies @histogram. 8-bit images get a 256 bin histogram, and
+ * other formats are clipped to 16 bits.
+ *
+ * ::: tip "Optional arguments"
+ *     * @histogram: `gboolean`, also find a histogram
+ *     * @percent: [struct@ArrayDouble], also find these percentiles
+ *     * @hist: [class@Image], output, histogram
+ *     * @threshold: [struct@ArrayDouble], output, threshold for each percent
+ *
  * ::: seealso
- *     [method@Image.avg], [method@Image.min].
+ *     [method@Image.avg], [method@Image.min], [method@Image.hist_find].
  *
  * Returns: 0 on success, -1 on error
  */
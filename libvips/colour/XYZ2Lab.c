@@ -19,6 +19,8 @@
  * 	- fix a race in the table build
  * 19/9/12
  * 	- redone as a class
+ * 14/10/26
+ * 	- add a SIMD path
  */
 
 /*
@@ -57,15 +59,12 @@
 #include <math.h>
 
 #include <vips/vips.h>
+#include <vips/vector.h>
 #include <vips/internal.h>
 
 #include "pcolour.h"
 
-/* Lookup table size.
- */
-#define QUANT_ELEMENTS (100000)
-
-static float cbrt_table[QUANT_ELEMENTS];
+static float cbrt_table[VIPS__XYZ2LAB_QUANT];
 
 typedef struct _VipsXYZ2Lab {
 	VipsColourTransform parent_instance;
@@ -93,8 +92,8 @@ table_init(void *client)
 {
 	int i;
 
-	for (i = 0; i < QUANT_ELEMENTS; i++) {
-		float Y = (double) i / QUANT_ELEMENTS;
+	for (i = 0; i < VIPS__XYZ2LAB_QUANT; i++) {
+		float Y = (double) i / VIPS__XYZ2LAB_QUANT;
 
 		if (Y < 0.008856)
 			cbrt_table[i] = 7.787F * Y + (16.0F / 116.0F);
@@ -105,36 +104,30 @@ table_init(void *client)
 	return NULL;
 }
 
+/* The cube root table, built on first use. The fused sRGB2PCS path needs
+ * this too.
+ */
+const float *
+vips__XYZ2Lab_table(void)
+{
+	VIPS_ONCE(&table_init_once, table_init, NULL);
+
+	return cbrt_table;
+}
+
 static void
 vips_col_XYZ2Lab_helper(VipsXYZ2Lab *XYZ2Lab,
 	float X, float Y, float Z, float *L, float *a, float *b)
 {
-	float nX, nY, nZ;
-	int i;
-	float f;
-	float cbx, cby, cbz;
-
-	nX = QUANT_ELEMENTS * X / XYZ2Lab->X0;
-	nY = QUANT_ELEMENTS * Y / XYZ2Lab->Y0;
-	nZ = QUANT_ELEMENTS * Z / XYZ2Lab->Z0;
-
-	/* CLIP is much faster than FCLIP, and we want an int result.
-	 */
-	i = VIPS_CLIP(0, (int) nX, QUANT_ELEMENTS - 2);
-	f = nX - i;
-	cbx = cbrt_table[i] + f * (cbrt_table[i + 1] - cbrt_table[i]);
+	float p[3] = { X, Y, Z };
+	float q[3];
 
-	i = VIPS_CLIP(0, (int) nY, QUANT_ELEMENTS - 2);
-	f = nY - i;
-	cby = cbrt_table[i] + f * (cbrt_table[i + 1] - cbrt_table[i]);
+	vips__XYZ2Lab_pixel(cbrt_table,
+		XYZ2Lab->X0, XYZ2Lab->Y0, XYZ2Lab->Z0, p, q);
 
-	i = VIPS_CLIP(0, (int) nZ, QUANT_ELEMENTS - 2);
-	f = nZ - i;
-	cbz = cbrt_table[i] + f * (cbrt_table[i + 1] - cbrt_table[i]);
-
-	*L = 116.0F * cby - 16.0F;
-	*a = 500.0F * (cbx - cby);
-	*b = 200.0F * (cby - cbz);
+	*L = q[0];
+	*a = q[1];
+	*b = q[2];
 }
 
 /* Process a buffer of data.
@@ -151,20 +144,22 @@ vips_XYZ2Lab_line(VipsColour *colour, VipsPel *out, VipsPel **in, int width)
 
 	VIPS_ONCE(&table_init_once, table_init, NULL);
 
-	for (x = 0; x < width; x++) {
-		float X, Y, Z;
-		float L, a, b;
+	x = 0;
 
-		X = p[0];
-		Y = p[1];
-		Z = p[2];
-		p += 3;
+#ifdef HAVE_HWY
+	if (vips_vector_isenabled()) {
+		x = vips_XYZ2Lab_hwy(q, p, width, cbrt_table,
+			XYZ2Lab->X0, XYZ2Lab->Y0, XYZ2Lab->Z0);
+		p += x * 3;
+		q += x * 3;
+	}
+#endif /*HAVE_HWY*/
 
-		vips_col_XYZ2Lab_helper(XYZ2Lab, X, Y, Z, &L, &a, &b);
+	for (; x < width; x++) {
+		vips__XYZ2Lab_pixel(cbrt_table,
+			XYZ2Lab->X0, XYZ2Lab->Y0, XYZ2Lab->Z0, p, q);
 
-		q[0] = L;
-		q[1] = a;
-		q[2] = b;
+		p += 3;
 		q += 3;
 	}
 }
@@ -2,6 +2,8 @@
  *
  * 2/12/25
  *	- from XYZ2scRGB.c
+ * 14/10/26
+ *	- add a SIMD path
  */
 
 /*
@@ -40,6 +42,7 @@
 #include <math.h>
 
 #include <vips/vips.h>
+#include <vips/vector.h>
 
 #include "pcolour.h"
 
@@ -48,34 +51,27 @@ typedef VipsColourTransformClass VipsXYZ2OklabClass;
 
 G_DEFINE_TYPE(VipsXYZ2Oklab, vips_XYZ2Oklab, VIPS_TYPE_COLOUR_TRANSFORM);
 
-// see https://en.wikipedia.org/wiki/Oklab_color_space#Conversion_from_CIE_XYZ
 static void
 vips_XYZ2Oklab_line(VipsColour *colour, VipsPel *out, VipsPel **in, int width)
 {
 	float *restrict p = (float *) in[0];
 	float *restrict q = (float *) out;
+	int i;
 
-	for (int i = 0; i < width; i++) {
-		// to D65 normalised XYZ ... M1 already has D65_X0 included etc.
-		const float X = p[0] / 100.0;
-		const float Y = p[1] / 100.0;
-		const float Z = p[2] / 100.0;
-		p += 3;
+	i = 0;
 
-		// convert to LMS
-		const float l = X * 0.8189330101 + Y * 0.3618667424 + Z * -0.1288597137;
-		const float m = X * 0.0329845436 + Y * 0.9293118715 + Z *  0.0361456387;
-		const float s = X * 0.0482003018 + Y * 0.2643662691 + Z *  0.6338517070;
+#ifdef HAVE_HWY
+	if (vips_vector_isenabled()) {
+		i = vips_XYZ2Oklab_hwy(q, p, width);
+		p += i * 3;
+		q += i * 3;
+	}
+#endif /*HAVE_HWY*/
 
-		// cube root ... possibly LUT this?
-		const float lp = cbrtf(l);
-		const float mp = cbrtf(m);
-		const float sp = cbrtf(s);
+	for (; i < width; i++) {
+		vips__XYZ2Oklab_pixel(p, q);
 
-		// to Oklab
-		q[0] = lp * 0.2104542553 + mp *  0.7936177850 + sp * -0.0040720468;
-		q[1] = lp * 1.9779984951 + mp * -2.4285922050 + sp *  0.4505937099;
-		q[2] = lp * 0.0259040371 + mp *  0.7827717662 + sp * -0.8086757660;
+		p += 3;
 		q += 3;
 	}
 }
@@ -6,6 +6,8 @@
  * 	- remove any ICC profile
  * 25/11/14
  * 	- oh argh, revert the above
+ * 14/10/26
+ * 	- add a SIMD path
  */
 
 /*
@@ -44,6 +46,7 @@
 #include <math.h>
 
 #include <vips/vips.h>
+#include <vips/vector.h>
 
 #include "pcolour.h"
 
@@ -73,8 +76,19 @@ vips_XYZ2scRGB_line(VipsColour *colour, VipsPel *out, VipsPel **in, int width)
 {
 	float *restrict p = (float *) in[0];
 	float *restrict q = (float *) out;
+	int i;
 
-	for (int i = 0; i < width; i++) {
+	i = 0;
+
+#ifdef HAVE_HWY
+	if (vips_vector_isenabled()) {
+		i = vips_XYZ2scRGB_hwy(q, p, width);
+		p += i * 3;
+		q += i * 3;
+	}
+#endif /*HAVE_HWY*/
+
+	for (; i < width; i++) {
 		const float X = p[0];
 		const float Y = p[1];
 		const float Z = p[2];
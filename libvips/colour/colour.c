@@ -39,6 +39,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 
 #include <vips/vips.h>
@@ -155,6 +156,20 @@ vips_colour_gen(VipsRegion *out_region,
 	return 0;
 }
 
+/* If @image was made by a colour operation, that operation. Operations
+ * which reattach extra bands don't count, since @image is then the join.
+ */
+VipsOperation *
+vips__colour_producer(VipsImage *image)
+{
+	if (image->generate_fn != vips_colour_gen ||
+		!VIPS_IS_COLOUR(image->client2) ||
+		VIPS_COLOUR(image->client2)->out != image)
+		return NULL;
+
+	return VIPS_OPERATION(image->client2);
+}
+
 static int
 vips_colour_build(VipsObject *object)
 {
@@ -246,6 +261,8 @@ vips_colour_build(VipsObject *object)
 		return -1;
 	}
 
+	vips__image_fold_constant(out, in);
+
 	/* Reattach higher bands, if necessary. If we have more than one input
 	 * image, just use the first extra bands.
 	 */
@@ -555,6 +572,21 @@ vips_colour_difference_build(VipsObject *object)
 	left = t[10];
 	right = t[11];
 
+	/* Comparing against a fixed colour is common, so note it and the
+	 * line functions can skip per-pixel work on that side.
+	 */
+	difference->reference_index = -1;
+	if (right->constant) {
+		difference->reference_index = 1;
+		memcpy(difference->reference, right->constant,
+			3 * sizeof(float));
+	}
+	else if (left->constant) {
+		difference->reference_index = 0;
+		memcpy(difference->reference, left->constant,
+			3 * sizeof(float));
+	}
+
 	colour->n = 2;
 	colour->in = VIPS_ARRAY(object, 3, VipsImage *);
 	colour->in[0] = left;
@@ -600,6 +632,8 @@ vips_colour_difference_init(VipsColourDifference *difference)
 	colour->interpretation = VIPS_INTERPRETATION_B_W;
 	colour->format = VIPS_FORMAT_FLOAT;
 	colour->bands = 1;
+
+	difference->reference_index = -1;
 }
 
 /* Called from iofuncs to init all operations in this dir. Use a plugin system
@@ -628,6 +662,7 @@ vips_colour_operation_init(void)
 	extern GType vips_LabQ2sRGB_get_type(void);
 	extern GType vips_XYZ2sRGB_get_type(void);
 	extern GType vips_sRGB2scRGB_get_type(void);
+	extern GType vips_sRGB2PCS_get_type(void);
 	extern GType vips_sRGB2HSV_get_type(void);
 	extern GType vips_HSV2sRGB_get_type(void);
 	extern GType vips_scRGB2XYZ_get_type(void);
@@ -676,6 +711,7 @@ vips_colour_operation_init(void)
 	vips_float2rad_get_type();
 	vips_LabQ2sRGB_get_type();
 	vips_sRGB2scRGB_get_type();
+	vips_sRGB2PCS_get_type();
 	vips_scRGB2XYZ_get_type();
 	vips_scRGB2BW_get_type();
 	vips_sRGB2HSV_get_type();
@@ -0,0 +1,526 @@
+/* Highway kernels for the sRGB / scRGB / XYZ / Lab / Oklab conversions.
+ *
+ * 14/10/26
+ * 	- initial implementation
+ * 15/10/26
+ * 	- add vips_uhdr2scRGB_hwy()
+ */
+
+/*
+
+	This file is part of VIPS.
+
+	VIPS is free software; you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+	02110-1301  USA
+
+ */
+
+/*
+
+	These files are distributed with VIPS - http://www.vips.ecs.soton.ac.uk
+
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /*HAVE_CONFIG_H*/
+#include <glib/gi18n-lib.h>
+
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <cmath>
+
+#include <vips/vips.h>
+#include <vips/vector.h>
+#include <vips/debug.h>
+#include <vips/internal.h>
+
+#include "pcolour.h"
+
+#ifdef HAVE_HWY
+
+#undef HWY_TARGET_INCLUDE
+#define HWY_TARGET_INCLUDE "libvips/colour/colour_hwy.cpp"
+#include <hwy/foreach_target.h>
+#include <hwy/highway.h>
+
+namespace HWY_NAMESPACE {
+
+using namespace hwy::HWY_NAMESPACE;
+
+using DF32 = ScalableTag<float>;
+using DI32 = ScalableTag<int32_t>;
+constexpr DF32 df32;
+constexpr DI32 di32;
+
+/* Narrow vectors with one lane for each int lane, for loading before a
+ * promote.
+ */
+constexpr Rebind<uint8_t, DI32> du8x32;
+constexpr Rebind<uint16_t, DI32> du16x32;
+
+using VF32 = Vec<DF32>;
+using VI32 = Vec<DI32>;
+
+// Compat for Highway versions < 1.3.0
+#ifndef HWY_LANES_CONSTEXPR
+#define HWY_LANES_CONSTEXPR
+#endif
+
+/* The vector loop only runs on SIMD targets, the caller does any remaining
+ * pixels (or all of them for HWY_SCALAR).
+ */
+#if HWY_TARGET != HWY_SCALAR
+#define VECTOR_LOOP 1
+#else
+#define VECTOR_LOOP 0
+#endif
+
+/* Vectors are sizeless on some targets and can't go into arrays or structs,
+ * so channels are always passed separately.
+ */
+
+/* Gamma-expand through the vips_v2Y_* tables.
+ */
+HWY_ATTR HWY_INLINE void
+load_srgb(const uint8_t *HWY_RESTRICT p, VF32 &R, VF32 &G, VF32 &B)
+{
+	Vec<decltype(du8x32)> r, g, b;
+
+	LoadInterleaved3(du8x32, p, r, g, b);
+	R = GatherIndex(df32, vips_v2Y_8, PromoteTo(di32, r));
+	G = GatherIndex(df32, vips_v2Y_8, PromoteTo(di32, g));
+	B = GatherIndex(df32, vips_v2Y_8, PromoteTo(di32, b));
+}
+
+HWY_ATTR HWY_INLINE void
+load_srgb(const uint16_t *HWY_RESTRICT p, VF32 &R, VF32 &G, VF32 &B)
+{
+	Vec<decltype(du16x32)> r, g, b;
+
+	LoadInterleaved3(du16x32, p, r, g, b);
+	R = GatherIndex(df32, vips_v2Y_16, PromoteTo(di32, r));
+	G = GatherIndex(df32, vips_v2Y_16, PromoteTo(di32, g));
+	B = GatherIndex(df32, vips_v2Y_16, PromoteTo(di32, b));
+}
+
+/* q = M * p, M in row-major order.
+ */
+HWY_ATTR HWY_INLINE void
+matrix(const float *HWY_RESTRICT M,
+	VF32 a, VF32 b, VF32 c, VF32 &x, VF32 &y, VF32 &z)
+{
+	x = MulAdd(Set(df32, M[0]), a,
+		MulAdd(Set(df32, M[1]), b, Mul(Set(df32, M[2]), c)));
+	y = MulAdd(Set(df32, M[3]), a,
+		MulAdd(Set(df32, M[4]), b, Mul(Set(df32, M[5]), c)));
+	z = MulAdd(Set(df32, M[6]), a,
+		MulAdd(Set(df32, M[7]), b, Mul(Set(df32, M[8]), c)));
+}
+
+/* The matrices from vips__scRGB2XYZ_pixel(), vips_col_XYZ2scRGB() and
+ * vips__XYZ2Oklab_pixel(), with the scale factors folded in.
+ */
+static const float scRGB2XYZ_M[9] = {
+	0.4124F * 100.0F, 0.3576F * 100.0F, 0.1805F * 100.0F,
+	0.2126F * 100.0F, 0.7152F * 100.0F, 0.0722F * 100.0F,
+	0.0193F * 100.0F, 0.1192F * 100.0F, 0.9505F * 100.0F
+};
+
+static const float XYZ2scRGB_M[9] = {
+	3.240625F / 100.0F, -1.537208F / 100.0F, -0.498629F / 100.0F,
+	-0.968931F / 100.0F, 1.875756F / 100.0F, 0.041518F / 100.0F,
+	0.055710F / 100.0F, -0.204021F / 100.0F, 1.056996F / 100.0F
+};
+
+static const float XYZ2LMS_M[9] = {
+	0.8189330101F / 100.0F, 0.3618667424F / 100.0F, -0.1288597137F / 100.0F,
+	0.0329845436F / 100.0F, 0.9293118715F / 100.0F, 0.0361456387F / 100.0F,
+	0.0482003018F / 100.0F, 0.2643662691F / 100.0F, 0.6338517070F / 100.0F
+};
+
+static const float LMS2Oklab_M[9] = {
+	0.2104542553F, 0.7936177850F, -0.0040720468F,
+	1.9779984951F, -2.4285922050F, 0.4505937099F,
+	0.0259040371F, 0.7827717662F, -0.8086757660F
+};
+
+/* Linear interpolation in the XYZ2Lab cube root table, n is already scaled
+ * by VIPS__XYZ2LAB_QUANT. Out of range values extrapolate from the end
+ * cells, as vips__XYZ2Lab_cbrt() does.
+ */
+HWY_ATTR HWY_INLINE VF32
+table_cbrt(const float *HWY_RESTRICT table, VF32 n)
+{
+	const VI32 i = Min(Max(ConvertTo(di32, n), Zero(di32)),
+		Set(di32, VIPS__XYZ2LAB_QUANT - 2));
+	const VF32 f = Sub(n, ConvertTo(df32, i));
+	const VF32 c0 = GatherIndex(df32, table, i);
+	const VF32 c1 = GatherIndex(df32, table + 1, i);
+
+	return MulAdd(f, Sub(c1, c0), c0);
+}
+
+HWY_ATTR HWY_INLINE void
+to_lab(const float *HWY_RESTRICT table, VF32 sx, VF32 sy, VF32 sz,
+	VF32 X, VF32 Y, VF32 Z, VF32 &L, VF32 &a, VF32 &b)
+{
+	const VF32 cbx = table_cbrt(table, Mul(X, sx));
+	const VF32 cby = table_cbrt(table, Mul(Y, sy));
+	const VF32 cbz = table_cbrt(table, Mul(Z, sz));
+
+	L = MulAdd(Set(df32, 116.0F), cby, Set(df32, -16.0F));
+	a = Mul(Set(df32, 500.0F), Sub(cbx, cby));
+	b = Mul(Set(df32, 200.0F), Sub(cby, cbz));
+}
+
+/* Cube root: an initial guess from the exponent bits, then three Newton
+ * steps. This is within an ulp or so of cbrtf() over the whole float range.
+ */
+HWY_ATTR HWY_INLINE VF32
+vec_cbrt(VF32 v)
+{
+	const VF32 one_third = Set(df32, 1.0F / 3.0F);
+	const VF32 two = Set(df32, 2.0F);
+	const VF32 a = Abs(v);
+
+	const VI32 bits = BitCast(di32, a);
+	VF32 y = BitCast(df32, Add(
+		ConvertTo(di32, Mul(ConvertTo(df32, bits), one_third)),
+		Set(di32, 0x2a514067)));
+
+	for (int i = 0; i < 3; i++)
+		y = Mul(Add(Mul(two, y), Div(a, Mul(y, y))), one_third);
+
+	/* The iteration never quite reaches zero.
+	 */
+	y = IfThenZeroElse(Eq(a, Zero(df32)), y);
+
+	return CopySign(y, v);
+}
+
+HWY_ATTR HWY_INLINE void
+to_oklab(VF32 X, VF32 Y, VF32 Z, VF32 &L, VF32 &a, VF32 &b)
+{
+	VF32 l, m, s;
+
+	matrix(XYZ2LMS_M, X, Y, Z, l, m, s);
+	matrix(LMS2Oklab_M, vec_cbrt(l), vec_cbrt(m), vec_cbrt(s), L, a, b);
+}
+
+template <typename T>
+HWY_ATTR HWY_INLINE int32_t
+sRGB2scRGB(float *HWY_RESTRICT q, const T *HWY_RESTRICT p, int32_t width)
+{
+	int32_t x = 0;
+
+	if (VECTOR_LOOP) {
+		HWY_LANES_CONSTEXPR int32_t N = Lanes(df32);
+
+		for (; x + N <= width; x += N) {
+			VF32 R, G, B;
+
+			load_srgb(p + x * 3, R, G, B);
+			StoreInterleaved3(R, G, B, df32, q + x * 3);
+		}
+	}
+
+	return x;
+}
+
+HWY_ATTR int32_t
+vips_sRGB2scRGB_uchar_hwy(float *q, const VipsPel *p, int32_t width)
+{
+	return sRGB2scRGB(q, (const uint8_t *) p, width);
+}
+
+HWY_ATTR int32_t
+vips_sRGB2scRGB_ushort_hwy(float *q, const unsigned short *p, int32_t width)
+{
+	return sRGB2scRGB(q, (const uint16_t *) p, width);
+}
+
+HWY_ATTR HWY_INLINE int32_t
+matrix_line(const float *HWY_RESTRICT M,
+	float *HWY_RESTRICT q, const float *HWY_RESTRICT p, int32_t width)
+{
+	int32_t x = 0;
+
+	if (VECTOR_LOOP) {
+		HWY_LANES_CONSTEXPR int32_t N = Lanes(df32);
+
+		for (; x + N <= width; x += N) {
+			VF32 a, b, c;
+			VF32 u, v, w;
+
+			LoadInterleaved3(df32, p + x * 3, a, b, c);
+			matrix(M, a, b, c, u, v, w);
+			StoreInterleaved3(u, v, w, df32, q + x * 3);
+		}
+	}
+
+	return x;
+}
+
+HWY_ATTR int32_t
+vips_scRGB2XYZ_hwy(float *q, const float *p, int32_t width)
+{
+	return matrix_line(scRGB2XYZ_M, q, p, width);
+}
+
+HWY_ATTR int32_t
+vips_XYZ2scRGB_hwy(float *q, const float *p, int32_t width)
+{
+	return matrix_line(XYZ2scRGB_M, q, p, width);
+}
+
+HWY_ATTR int32_t
+vips_XYZ2Lab_hwy(float *q, const float *p, int32_t width,
+	const float *table, double X0, double Y0, double Z0)
+{
+	int32_t x = 0;
+
+	if (VECTOR_LOOP) {
+		HWY_LANES_CONSTEXPR int32_t N = Lanes(df32);
+		const VF32 sx = Set(df32,
+			static_cast<float>(VIPS__XYZ2LAB_QUANT / X0));
+		const VF32 sy = Set(df32,
+			static_cast<float>(VIPS__XYZ2LAB_QUANT / Y0));
+		const VF32 sz = Set(df32,
+			static_cast<float>(VIPS__XYZ2LAB_QUANT / Z0));
+
+		for (; x + N <= width; x += N) {
+			VF32 X, Y, Z;
+			VF32 L, a, b;
+
+			LoadInterleaved3(df32, p + x * 3, X, Y, Z);
+			to_lab(table, sx, sy, sz, X, Y, Z, L, a, b);
+			StoreInterleaved3(L, a, b, df32, q + x * 3);
+		}
+	}
+
+	return x;
+}
+
+HWY_ATTR int32_t
+vips_XYZ2Oklab_hwy(float *q, const float *p, int32_t width)
+{
+	int32_t x = 0;
+
+	if (VECTOR_LOOP) {
+		HWY_LANES_CONSTEXPR int32_t N = Lanes(df32);
+
+		for (; x + N <= width; x += N) {
+			VF32 X, Y, Z;
+			VF32 L, a, b;
+
+			LoadInterleaved3(df32, p + x * 3, X, Y, Z);
+			to_oklab(X, Y, Z, L, a, b);
+			StoreInterleaved3(L, a, b, df32, q + x * 3);
+		}
+	}
+
+	return x;
+}
+
+/* sRGB all the way to XYZ, Lab or Oklab with everything kept in registers.
+ * Lab is always D65, as colourspace uses.
+ */
+template <typename T>
+HWY_ATTR HWY_INLINE int32_t
+sRGB2PCS(float *HWY_RESTRICT q, const T *HWY_RESTRICT p, int32_t width,
+	VipsInterpretation space, const float *HWY_RESTRICT table)
+{
+	int32_t x = 0;
+
+	if (VECTOR_LOOP) {
+		HWY_LANES_CONSTEXPR int32_t N = Lanes(df32);
+		const VF32 sx = Set(df32,
+			static_cast<float>(VIPS__XYZ2LAB_QUANT / VIPS_D65_X0));
+		const VF32 sy = Set(df32,
+			static_cast<float>(VIPS__XYZ2LAB_QUANT / VIPS_D65_Y0));
+		const VF32 sz = Set(df32,
+			static_cast<float>(VIPS__XYZ2LAB_QUANT / VIPS_D65_Z0));
+
+		for (; x + N <= width; x += N) {
+			VF32 R, G, B;
+			VF32 X, Y, Z;
+			VF32 u, v, w;
+
+			load_srgb(p + x * 3, R, G, B);
+			matrix(scRGB2XYZ_M, R, G, B, X, Y, Z);
+
+			if (space == VIPS_INTERPRETATION_LAB)
+				to_lab(table, sx, sy, sz, X, Y, Z, u, v, w);
+			else if (space == VIPS_INTERPRETATION_OKLAB)
+				to_oklab(X, Y, Z, u, v, w);
+			else {
+				u = X;
+				v = Y;
+				w = Z;
+			}
+
+			StoreInterleaved3(u, v, w, df32, q + x * 3);
+		}
+	}
+
+	return x;
+}
+
+HWY_ATTR int32_t
+vips_sRGB2PCS_uchar_hwy(float *q, const VipsPel *p, int32_t width,
+	VipsInterpretation space, const float *table)
+{
+	return sRGB2PCS(q, (const uint8_t *) p, width, space, table);
+}
+
+HWY_ATTR int32_t
+vips_sRGB2PCS_ushort_hwy(float *q, const unsigned short *p, int32_t width,
+	VipsInterpretation space, const float *table)
+{
+	return sRGB2PCS(q, (const uint16_t *) p, width, space, table);
+}
+
+/* Apply a gainmap, see uhdr2scRGB.c. Each output channel is the linear
+ * sRGB value times scale[v] plus offset[v], where v is the gainmap value and
+ * the tables hold 256 entries for each of the three channels.
+ */
+HWY_ATTR int32_t
+vips_uhdr2scRGB_hwy(float *q, const VipsPel *p, const VipsPel *g,
+	int32_t gain_bands, const float *scale, const float *offset,
+	int32_t width)
+{
+	int32_t x = 0;
+
+	if (VECTOR_LOOP) {
+		HWY_LANES_CONSTEXPR int32_t N = Lanes(df32);
+
+		for (; x + N <= width; x += N) {
+			VF32 R, G, B;
+			VI32 gr, gg, gb;
+
+			load_srgb(p + x * 3, R, G, B);
+
+			if (gain_bands == 1) {
+				gr = PromoteTo(di32, LoadU(du8x32, g + x));
+				gg = gr;
+				gb = gr;
+			}
+			else {
+				Vec<decltype(du8x32)> u, v, w;
+
+				LoadInterleaved3(du8x32, g + x * 3, u, v, w);
+				gr = PromoteTo(di32, u);
+				gg = PromoteTo(di32, v);
+				gb = PromoteTo(di32, w);
+			}
+
+			R = MulAdd(R, GatherIndex(df32, scale, gr),
+				GatherIndex(df32, offset, gr));
+			G = MulAdd(G, GatherIndex(df32, scale + 256, gg),
+				GatherIndex(df32, offset + 256, gg));
+			B = MulAdd(B, GatherIndex(df32, scale + 512, gb),
+				GatherIndex(df32, offset + 512, gb));
+
+			StoreInterleaved3(R, G, B, df32, q + x * 3);
+		}
+	}
+
+	return x;
+}
+
+/* This file is included once per target, and VECTOR_LOOP differs between
+ * them.
+ */
+#undef VECTOR_LOOP
+
+} /*namespace HWY_NAMESPACE*/
+
+#if HWY_ONCE
+HWY_EXPORT(vips_sRGB2scRGB_uchar_hwy);
+HWY_EXPORT(vips_sRGB2scRGB_ushort_hwy);
+HWY_EXPORT(vips_scRGB2XYZ_hwy);
+HWY_EXPORT(vips_XYZ2scRGB_hwy);
+HWY_EXPORT(vips_XYZ2Lab_hwy);
+HWY_EXPORT(vips_XYZ2Oklab_hwy);
+HWY_EXPORT(vips_sRGB2PCS_uchar_hwy);
+HWY_EXPORT(vips_sRGB2PCS_ushort_hwy);
+HWY_EXPORT(vips_uhdr2scRGB_hwy);
+
+int
+vips_sRGB2scRGB_uchar_hwy(float *out, const VipsPel *in, int width)
+{
+	return HWY_DYNAMIC_DISPATCH(vips_sRGB2scRGB_uchar_hwy)(out, in, width);
+}
+
+int
+vips_sRGB2scRGB_ushort_hwy(float *out, const unsigned short *in, int width)
+{
+	return HWY_DYNAMIC_DISPATCH(vips_sRGB2scRGB_ushort_hwy)(out, in, width);
+}
+
+int
+vips_scRGB2XYZ_hwy(float *out, const float *in, int width)
+{
+	return HWY_DYNAMIC_DISPATCH(vips_scRGB2XYZ_hwy)(out, in, width);
+}
+
+int
+vips_XYZ2scRGB_hwy(float *out, const float *in, int width)
+{
+	return HWY_DYNAMIC_DISPATCH(vips_XYZ2scRGB_hwy)(out, in, width);
+}
+
+int
+vips_XYZ2Lab_hwy(float *out, const float *in, int width,
+	const float *table, double X0, double Y0, double Z0)
+{
+	return HWY_DYNAMIC_DISPATCH(vips_XYZ2Lab_hwy)(out, in, width,
+		table, X0, Y0, Z0);
+}
+
+int
+vips_XYZ2Oklab_hwy(float *out, const float *in, int width)
+{
+	return HWY_DYNAMIC_DISPATCH(vips_XYZ2Oklab_hwy)(out, in, width);
+}
+
+int
+vips_sRGB2PCS_uchar_hwy(float *out, const VipsPel *in, int width,
+	VipsInterpretation space, const float *table)
+{
+	return HWY_DYNAMIC_DISPATCH(vips_sRGB2PCS_uchar_hwy)(out, in, width,
+		space, table);
+}
+
+int
+vips_sRGB2PCS_ushort_hwy(float *out, const unsigned short *in, int width,
+	VipsInterpretation space, const float *table)
+{
+	return HWY_DYNAMIC_DISPATCH(vips_sRGB2PCS_ushort_hwy)(out, in, width,
+		space, table);
+}
+
+int
+vips_uhdr2scRGB_hwy(float *out, const VipsPel *in, const VipsPel *gain,
+	int gain_bands, const float *scale, const float *offset, int width)
+{
+	return HWY_DYNAMIC_DISPATCH(vips_uhdr2scRGB_hwy)(out, in, gain,
+		gain_bands, scale, offset, width);
+}
+#endif /*HWY_ONCE*/
+
+#endif /*HAVE_HWY*/
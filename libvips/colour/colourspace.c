@@ -21,6 +21,8 @@
  * 	  https://github.com/lovell/sharp/issues/193
  * 27/12/18
  * 	- add CMYK conversions
+ * 14/10/26
+ * 	- sRGB to XYZ, Lab and Oklab in a single pass
  */
 
 /*
@@ -108,6 +110,28 @@ vips_sRGB2RGB16(VipsImage *in, VipsImage **out, ...)
 	return 0;
 }
 
+/* sRGB2scRGB, scRGB2XYZ and then XYZ2Lab or XYZ2Oklab in a single pass,
+ * see sRGB2PCS.c.
+ */
+
+static int
+vips_sRGB2XYZ(VipsImage *in, VipsImage **out, ...)
+{
+	return vips__sRGB2PCS(in, out, VIPS_INTERPRETATION_XYZ);
+}
+
+static int
+vips_sRGB2Lab(VipsImage *in, VipsImage **out, ...)
+{
+	return vips__sRGB2PCS(in, out, VIPS_INTERPRETATION_LAB);
+}
+
+static int
+vips_sRGB2Oklab(VipsImage *in, VipsImage **out, ...)
+{
+	return vips__sRGB2PCS(in, out, VIPS_INTERPRETATION_OKLAB);
+}
+
 /* Process the first @n bands with @fn, detach and reattach remaining bands.
  *
  * Also used by CMYK2XYZ and XYZ2CMYK.
@@ -358,90 +382,90 @@ static VipsColourRoute vips_colour_routes[] = {
 	{ scRGB, OKLAB, { vips_scRGB2XYZ, vips_XYZ2Oklab, NULL } },
 	{ scRGB, OKLCH, { vips_scRGB2XYZ, vips_XYZ2Oklab, vips_Oklab2Oklch, NULL } },
 
-	{ sRGB, XYZ, { vips_sRGB2scRGB, vips_scRGB2XYZ, NULL } },
-	{ sRGB, LAB, { vips_sRGB2scRGB, vips_scRGB2XYZ, vips_XYZ2Lab, NULL } },
-	{ sRGB, LABQ, { vips_sRGB2scRGB, vips_scRGB2XYZ, vips_XYZ2Lab, vips_Lab2LabQ, NULL } },
-	{ sRGB, LCH, { vips_sRGB2scRGB, vips_scRGB2XYZ, vips_XYZ2Lab, vips_Lab2LCh, NULL } },
-	{ sRGB, CMC, { vips_sRGB2scRGB, vips_scRGB2XYZ, vips_XYZ2Lab, vips_Lab2LCh, vips_LCh2CMC, NULL } },
-	{ sRGB, LABS, { vips_sRGB2scRGB, vips_scRGB2XYZ, vips_XYZ2Lab, vips_Lab2LabS, NULL } },
-	{ sRGB, CMYK, { vips_sRGB2scRGB, vips_scRGB2XYZ, vips_XYZ2CMYK, NULL } },
+	{ sRGB, XYZ, { vips_sRGB2XYZ, NULL } },
+	{ sRGB, LAB, { vips_sRGB2Lab, NULL } },
+	{ sRGB, LABQ, { vips_sRGB2Lab, vips_Lab2LabQ, NULL } },
+	{ sRGB, LCH, { vips_sRGB2Lab, vips_Lab2LCh, NULL } },
+	{ sRGB, CMC, { vips_sRGB2Lab, vips_Lab2LCh, vips_LCh2CMC, NULL } },
+	{ sRGB, LABS, { vips_sRGB2Lab, vips_Lab2LabS, NULL } },
+	{ sRGB, CMYK, { vips_sRGB2XYZ, vips_XYZ2CMYK, NULL } },
 	{ sRGB, scRGB, { vips_sRGB2scRGB, NULL } },
 	{ sRGB, sRGB, { vips_cast_uchar, NULL } },
 	{ sRGB, HSV, { vips_sRGB2HSV, NULL } },
 	{ sRGB, BW, { vips_sRGB2scRGB, vips_scRGB2BW, NULL } },
 	{ sRGB, RGB16, { vips_sRGB2RGB16, NULL } },
 	{ sRGB, GREY16, { vips_sRGB2scRGB, vips_scRGB2BW16, NULL } },
-	{ sRGB, YXY, { vips_sRGB2scRGB, vips_scRGB2XYZ, vips_XYZ2Yxy, NULL } },
-	{ sRGB, OKLAB, { vips_sRGB2scRGB, vips_scRGB2XYZ, vips_XYZ2Oklab, NULL } },
-	{ sRGB, OKLCH, { vips_sRGB2scRGB, vips_scRGB2XYZ, vips_XYZ2Oklab, vips_Oklab2Oklch, NULL } },
-
-	{ HSV, XYZ, { vips_HSV2sRGB, vips_sRGB2scRGB, vips_scRGB2XYZ, NULL } },
-	{ HSV, LAB, { vips_HSV2sRGB, vips_sRGB2scRGB, vips_scRGB2XYZ, vips_XYZ2Lab, NULL } },
-	{ HSV, LABQ, { vips_HSV2sRGB, vips_sRGB2scRGB, vips_scRGB2XYZ, vips_XYZ2Lab, vips_Lab2LabQ, NULL } },
-	{ HSV, LCH, { vips_HSV2sRGB, vips_sRGB2scRGB, vips_scRGB2XYZ, vips_XYZ2Lab, vips_Lab2LCh, NULL } },
-	{ HSV, CMC, { vips_HSV2sRGB, vips_sRGB2scRGB, vips_scRGB2XYZ, vips_XYZ2Lab, vips_Lab2LCh, vips_LCh2CMC, NULL } },
-	{ HSV, LABS, { vips_HSV2sRGB, vips_sRGB2scRGB, vips_scRGB2XYZ, vips_XYZ2Lab, vips_Lab2LabS, NULL } },
-	{ HSV, CMYK, { vips_HSV2sRGB, vips_sRGB2scRGB, vips_scRGB2XYZ, vips_XYZ2CMYK, NULL } },
+	{ sRGB, YXY, { vips_sRGB2XYZ, vips_XYZ2Yxy, NULL } },
+	{ sRGB, OKLAB, { vips_sRGB2Oklab, NULL } },
+	{ sRGB, OKLCH, { vips_sRGB2Oklab, vips_Oklab2Oklch, NULL } },
+
+	{ HSV, XYZ, { vips_HSV2sRGB, vips_sRGB2XYZ, NULL } },
+	{ HSV, LAB, { vips_HSV2sRGB, vips_sRGB2Lab, NULL } },
+	{ HSV, LABQ, { vips_HSV2sRGB, vips_sRGB2Lab, vips_Lab2LabQ, NULL } },
+	{ HSV, LCH, { vips_HSV2sRGB, vips_sRGB2Lab, vips_Lab2LCh, NULL } },
+	{ HSV, CMC, { vips_HSV2sRGB, vips_sRGB2Lab, vips_Lab2LCh, vips_LCh2CMC, NULL } },
+	{ HSV, LABS, { vips_HSV2sRGB, vips_sRGB2Lab, vips_Lab2LabS, NULL } },
+	{ HSV, CMYK, { vips_HSV2sRGB, vips_sRGB2XYZ, vips_XYZ2CMYK, NULL } },
 	{ HSV, scRGB, { vips_HSV2sRGB, vips_sRGB2scRGB, NULL } },
 	{ HSV, sRGB, { vips_HSV2sRGB, NULL } },
 	{ HSV, HSV, { vips_cast_uchar, NULL } },
 	{ HSV, BW, { vips_HSV2sRGB, vips_sRGB2scRGB, vips_scRGB2BW, NULL } },
 	{ HSV, RGB16, { vips_HSV2sRGB, vips_sRGB2RGB16, NULL } },
 	{ HSV, GREY16, { vips_HSV2sRGB, vips_sRGB2scRGB, vips_scRGB2BW16, NULL } },
-	{ HSV, YXY, { vips_HSV2sRGB, vips_sRGB2scRGB, vips_scRGB2XYZ, vips_XYZ2Yxy, NULL } },
-	{ HSV, OKLAB, { vips_HSV2sRGB, vips_sRGB2scRGB, vips_scRGB2XYZ, vips_XYZ2Oklab, NULL } },
-	{ HSV, OKLCH, { vips_HSV2sRGB, vips_sRGB2scRGB, vips_scRGB2XYZ, vips_XYZ2Oklab, vips_Oklab2Oklch, NULL } },
-
-	{ BW, XYZ, { vips_BW2sRGB, vips_sRGB2scRGB, vips_scRGB2XYZ, NULL } },
-	{ BW, LAB, { vips_BW2sRGB, vips_sRGB2scRGB, vips_scRGB2XYZ, vips_XYZ2Lab, NULL } },
-	{ BW, LABQ, { vips_BW2sRGB, vips_sRGB2scRGB, vips_scRGB2XYZ, vips_XYZ2Lab, vips_Lab2LabQ, NULL } },
-	{ BW, LCH, { vips_BW2sRGB, vips_sRGB2scRGB, vips_scRGB2XYZ, vips_XYZ2Lab, vips_Lab2LCh, NULL } },
-	{ BW, CMC, { vips_BW2sRGB, vips_sRGB2scRGB, vips_scRGB2XYZ, vips_XYZ2Lab, vips_Lab2LCh, vips_LCh2CMC, NULL } },
-	{ BW, LABS, { vips_BW2sRGB, vips_sRGB2scRGB, vips_scRGB2XYZ, vips_XYZ2Lab, vips_Lab2LabS, NULL } },
-	{ BW, CMYK, { vips_BW2sRGB, vips_sRGB2scRGB, vips_scRGB2XYZ, vips_XYZ2CMYK, NULL } },
+	{ HSV, YXY, { vips_HSV2sRGB, vips_sRGB2XYZ, vips_XYZ2Yxy, NULL } },
+	{ HSV, OKLAB, { vips_HSV2sRGB, vips_sRGB2Oklab, NULL } },
+	{ HSV, OKLCH, { vips_HSV2sRGB, vips_sRGB2Oklab, vips_Oklab2Oklch, NULL } },
+
+	{ BW, XYZ, { vips_BW2sRGB, vips_sRGB2XYZ, NULL } },
+	{ BW, LAB, { vips_BW2sRGB, vips_sRGB2Lab, NULL } },
+	{ BW, LABQ, { vips_BW2sRGB, vips_sRGB2Lab, vips_Lab2LabQ, NULL } },
+	{ BW, LCH, { vips_BW2sRGB, vips_sRGB2Lab, vips_Lab2LCh, NULL } },
+	{ BW, CMC, { vips_BW2sRGB, vips_sRGB2Lab, vips_Lab2LCh, vips_LCh2CMC, NULL } },
+	{ BW, LABS, { vips_BW2sRGB, vips_sRGB2Lab, vips_Lab2LabS, NULL } },
+	{ BW, CMYK, { vips_BW2sRGB, vips_sRGB2XYZ, vips_XYZ2CMYK, NULL } },
 	{ BW, scRGB, { vips_BW2sRGB, vips_sRGB2scRGB, NULL } },
 	{ BW, sRGB, { vips_BW2sRGB, NULL } },
 	{ BW, HSV, { vips_BW2sRGB, vips_sRGB2HSV, NULL } },
 	{ BW, BW, { vips_cast_uchar, NULL } },
 	{ BW, RGB16, { vips_BW2sRGB, vips_sRGB2RGB16, NULL } },
 	{ BW, GREY16, { vips_BW2sRGB, vips_sRGB2scRGB, vips_scRGB2BW16, NULL } },
-	{ BW, YXY, { vips_BW2sRGB, vips_sRGB2scRGB, vips_scRGB2XYZ, vips_XYZ2Yxy, NULL } },
-	{ BW, OKLAB, { vips_BW2sRGB, vips_sRGB2scRGB, vips_scRGB2XYZ, vips_XYZ2Oklab, NULL } },
-	{ BW, OKLCH, { vips_BW2sRGB, vips_sRGB2scRGB, vips_scRGB2XYZ, vips_XYZ2Oklab, vips_Oklab2Oklch, NULL } },
-
-	{ RGB16, XYZ, { vips_sRGB2scRGB, vips_scRGB2XYZ, NULL } },
-	{ RGB16, LAB, { vips_sRGB2scRGB, vips_scRGB2XYZ, vips_XYZ2Lab, NULL } },
-	{ RGB16, LABQ, { vips_sRGB2scRGB, vips_scRGB2XYZ, vips_XYZ2Lab, vips_Lab2LabQ, NULL } },
-	{ RGB16, LCH, { vips_sRGB2scRGB, vips_scRGB2XYZ, vips_XYZ2Lab, vips_Lab2LCh, NULL } },
-	{ RGB16, CMC, { vips_sRGB2scRGB, vips_scRGB2XYZ, vips_XYZ2Lab, vips_Lab2LCh, vips_LCh2CMC, NULL } },
-	{ RGB16, LABS, { vips_sRGB2scRGB, vips_scRGB2XYZ, vips_XYZ2Lab, vips_Lab2LabS, NULL } },
-	{ RGB16, CMYK, { vips_sRGB2scRGB, vips_scRGB2XYZ, vips_XYZ2CMYK, NULL } },
+	{ BW, YXY, { vips_BW2sRGB, vips_sRGB2XYZ, vips_XYZ2Yxy, NULL } },
+	{ BW, OKLAB, { vips_BW2sRGB, vips_sRGB2Oklab, NULL } },
+	{ BW, OKLCH, { vips_BW2sRGB, vips_sRGB2Oklab, vips_Oklab2Oklch, NULL } },
+
+	{ RGB16, XYZ, { vips_sRGB2XYZ, NULL } },
+	{ RGB16, LAB, { vips_sRGB2Lab, NULL } },
+	{ RGB16, LABQ, { vips_sRGB2Lab, vips_Lab2LabQ, NULL } },
+	{ RGB16, LCH, { vips_sRGB2Lab, vips_Lab2LCh, NULL } },
+	{ RGB16, CMC, { vips_sRGB2Lab, vips_Lab2LCh, vips_LCh2CMC, NULL } },
+	{ RGB16, LABS, { vips_sRGB2Lab, vips_Lab2LabS, NULL } },
+	{ RGB16, CMYK, { vips_sRGB2XYZ, vips_XYZ2CMYK, NULL } },
 	{ RGB16, scRGB, { vips_sRGB2scRGB, NULL } },
 	{ RGB16, sRGB, { vips_RGB162sRGB, NULL } },
 	{ RGB16, HSV, { vips_RGB162sRGB, vips_sRGB2HSV, NULL } },
 	{ RGB16, BW, { vips_sRGB2scRGB, vips_scRGB2BW, NULL } },
 	{ RGB16, RGB16, { vips_cast_ushort, NULL } },
 	{ RGB16, GREY16, { vips_sRGB2scRGB, vips_scRGB2BW16, NULL } },
-	{ RGB16, YXY, { vips_sRGB2scRGB, vips_scRGB2XYZ, vips_XYZ2Yxy, NULL } },
-	{ RGB16, OKLAB, { vips_sRGB2scRGB, vips_scRGB2XYZ, vips_XYZ2Oklab, NULL } },
-	{ RGB16, OKLCH, { vips_sRGB2scRGB, vips_scRGB2XYZ, vips_XYZ2Oklab, vips_Oklab2Oklch, NULL } },
-
-	{ GREY16, XYZ, { vips_GREY162RGB16, vips_sRGB2scRGB, vips_scRGB2XYZ, NULL } },
-	{ GREY16, LAB, { vips_GREY162RGB16, vips_sRGB2scRGB, vips_scRGB2XYZ, vips_XYZ2Lab, NULL } },
-	{ GREY16, LABQ, { vips_GREY162RGB16, vips_sRGB2scRGB, vips_scRGB2XYZ, vips_XYZ2Lab, vips_Lab2LabQ, NULL } },
-	{ GREY16, LCH, { vips_GREY162RGB16, vips_sRGB2scRGB, vips_scRGB2XYZ, vips_XYZ2Lab, vips_Lab2LCh, NULL } },
-	{ GREY16, CMC, { vips_GREY162RGB16, vips_sRGB2scRGB, vips_scRGB2XYZ, vips_XYZ2Lab, vips_Lab2LCh, vips_LCh2CMC, NULL } },
-	{ GREY16, LABS, { vips_GREY162RGB16, vips_sRGB2scRGB, vips_scRGB2XYZ, vips_XYZ2Lab, vips_Lab2LabS, NULL } },
-	{ GREY16, CMYK, { vips_GREY162RGB16, vips_sRGB2scRGB, vips_scRGB2XYZ, vips_XYZ2CMYK, NULL } },
+	{ RGB16, YXY, { vips_sRGB2XYZ, vips_XYZ2Yxy, NULL } },
+	{ RGB16, OKLAB, { vips_sRGB2Oklab, NULL } },
+	{ RGB16, OKLCH, { vips_sRGB2Oklab, vips_Oklab2Oklch, NULL } },
+
+	{ GREY16, XYZ, { vips_GREY162RGB16, vips_sRGB2XYZ, NULL } },
+	{ GREY16, LAB, { vips_GREY162RGB16, vips_sRGB2Lab, NULL } },
+	{ GREY16, LABQ, { vips_GREY162RGB16, vips_sRGB2Lab, vips_Lab2LabQ, NULL } },
+	{ GREY16, LCH, { vips_GREY162RGB16, vips_sRGB2Lab, vips_Lab2LCh, NULL } },
+	{ GREY16, CMC, { vips_GREY162RGB16, vips_sRGB2Lab, vips_Lab2LCh, vips_LCh2CMC, NULL } },
+	{ GREY16, LABS, { vips_GREY162RGB16, vips_sRGB2Lab, vips_Lab2LabS, NULL } },
+	{ GREY16, CMYK, { vips_GREY162RGB16, vips_sRGB2XYZ, vips_XYZ2CMYK, NULL } },
 	{ GREY16, scRGB, { vips_GREY162RGB16, vips_sRGB2scRGB, NULL } },
 	{ GREY16, sRGB, { vips_GREY162RGB16, vips_RGB162sRGB, NULL } },
 	{ GREY16, HSV, { vips_GREY162RGB16, vips_RGB162sRGB, vips_sRGB2HSV, NULL } },
 	{ GREY16, BW, { vips_GREY162RGB16, vips_sRGB2scRGB, vips_scRGB2BW, NULL } },
 	{ GREY16, RGB16, { vips_GREY162RGB16, NULL } },
 	{ GREY16, GREY16, { vips_cast_ushort, NULL } },
-	{ GREY16, YXY, { vips_GREY162RGB16, vips_sRGB2scRGB, vips_scRGB2XYZ, vips_XYZ2Yxy, NULL } },
-	{ GREY16, OKLAB, { vips_GREY162RGB16, vips_sRGB2scRGB, vips_scRGB2XYZ, vips_XYZ2Oklab, NULL } },
-	{ GREY16, OKLCH, { vips_GREY162RGB16, vips_sRGB2scRGB, vips_scRGB2XYZ, vips_XYZ2Oklab, vips_Oklab2Oklch, NULL } },
+	{ GREY16, YXY, { vips_GREY162RGB16, vips_sRGB2XYZ, vips_XYZ2Yxy, NULL } },
+	{ GREY16, OKLAB, { vips_GREY162RGB16, vips_sRGB2Oklab, NULL } },
+	{ GREY16, OKLCH, { vips_GREY162RGB16, vips_sRGB2Oklab, vips_Oklab2Oklch, NULL } },
 
 	{ YXY, XYZ, { vips_Yxy2XYZ, NULL } },
 	{ YXY, LAB, { vips_Yxy2XYZ, vips_XYZ2Lab, NULL } },
@@ -3,6 +3,8 @@
  * Modified:
  * 31/10/12
  * 	- from dE76.c
+ * 15/10/26
+ * 	- add a highway path
  */
 
 /*
@@ -40,6 +42,7 @@
 #include <math.h>
 
 #include <vips/vips.h>
+#include <vips/vector.h>
 #include <vips/debug.h>
 
 #include "pcolour.h"
@@ -211,13 +214,30 @@ static void
 vips_dE00_line(VipsColour *colour,
 	VipsPel *out, VipsPel **in, int width)
 {
+	VipsColourDifference *difference = (VipsColourDifference *) colour;
 	float *p1 = (float *) in[0];
 	float *p2 = (float *) in[1];
 	float *q = (float *) out;
 
 	int x;
 
-	for (x = 0; x < width; x++) {
+	x = 0;
+
+#ifdef HAVE_HWY
+	if (vips_vector_isenabled()) {
+		x = vips_dE00_hwy(q,
+			difference->reference_index == 0 ? NULL : p1,
+			difference->reference_index == 1 ? NULL : p2,
+			difference->reference_index >= 0
+				? difference->reference
+				: NULL,
+			width);
+		p1 += x * 3;
+		p2 += x * 3;
+	}
+#endif /*HAVE_HWY*/
+
+	for (; x < width; x++) {
 		q[x] = vips_col_dE00(p1[0], p1[1], p1[2],
 			p2[0], p2[1], p2[2]);
 
@@ -8,6 +8,8 @@
  * 	- gtkdoc comment
  * 25/10/12
  * 	- redone as a class
+ * 15/10/26
+ * 	- add a highway path
  */
 
 /*
@@ -45,6 +47,7 @@
 #include <math.h>
 
 #include <vips/vips.h>
+#include <vips/vector.h>
 #include <vips/debug.h>
 
 #include "pcolour.h"
@@ -85,13 +88,27 @@ void
 vips__pythagoras_line(VipsColour *colour,
 	VipsPel *out, VipsPel **in, int width)
 {
+	VipsColourDifference *difference = (VipsColourDifference *) colour;
 	float *restrict p1 = (float *) in[0];
 	float *restrict p2 = (float *) in[1];
 	float *restrict q = (float *) out;
 
 	int x;
 
-	for (x = 0; x < width; x++) {
+	x = 0;
+
+#ifdef HAVE_HWY
+	if (vips_vector_isenabled()) {
+		x = vips_dE76_hwy(q,
+			difference->reference_index == 0 ? NULL : p1,
+			difference->reference_index == 1 ? NULL : p2,
+			difference->reference, width);
+		p1 += x * 3;
+		p2 += x * 3;
+	}
+#endif /*HAVE_HWY*/
+
+	for (; x < width; x++) {
 		float dL = p1[0] - p2[0];
 		float da = p1[1] - p2[1];
 		float db = p1[2] - p2[2];
@@ -5,6 +5,8 @@
  * 	- from dE76.c
  * 5/3/26
  *	- find difference in LCh
+ * 15/10/26
+ * 	- add a highway path, go to ab once for a constant image
  */
 
 /*
@@ -40,6 +42,7 @@
 #include <glib/gi18n-lib.h>
 
 #include <vips/vips.h>
+#include <vips/vector.h>
 #include <vips/debug.h>
 
 #include "pcolour.h"
@@ -59,25 +62,55 @@ static void
 vips_dECMC_lch_difference(VipsColour *colour,
 	VipsPel *out, VipsPel **in, int width)
 {
+	VipsColourDifference *difference = (VipsColourDifference *) colour;
+	int reference_index = difference->reference_index;
 	float *restrict p1 = (float *) in[0];
 	float *restrict p2 = (float *) in[1];
 	float *restrict q = (float *) out;
 
+	float ref_a;
+	float ref_b;
 	int x;
 
-	for (x = 0; x < width; x++) {
-		float C1 = p1[1];
-		float h1 = p1[2];
-		float C2 = p2[1];
-		float h2 = p2[2];
+	x = 0;
 
+#ifdef HAVE_HWY
+	if (vips_vector_isenabled()) {
+		x = vips_dECMC_hwy(q,
+			reference_index == 0 ? NULL : p1,
+			reference_index == 1 ? NULL : p2,
+			difference->reference, width);
+		p1 += x * 3;
+		p2 += x * 3;
+	}
+#endif /*HAVE_HWY*/
+
+	/* The constant side only needs going to ab once.
+	 */
+	ref_a = 0.0F;
+	ref_b = 0.0F;
+	if (reference_index >= 0)
+		vips_col_Ch2ab(difference->reference[1], difference->reference[2],
+			&ref_a, &ref_b);
+
+	for (; x < width; x++) {
 		float a1;
 		float b1;
-		vips_col_Ch2ab(C1, h1, &a1, &b1);
+		if (reference_index == 0) {
+			a1 = ref_a;
+			b1 = ref_b;
+		}
+		else
+			vips_col_Ch2ab(p1[1], p1[2], &a1, &b1);
 
 		float a2;
 		float b2;
-		vips_col_Ch2ab(C2, h2, &a2, &b2);
+		if (reference_index == 1) {
+			a2 = ref_a;
+			b2 = ref_b;
+		}
+		else
+			vips_col_Ch2ab(p2[1], p2[2], &a2, &b2);
 
 		float dL = p1[0] - p2[0];
 		float da = a1 - a2;
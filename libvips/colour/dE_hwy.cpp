@@ -0,0 +1,374 @@
+/* Highway kernels for the colour difference operations.
+ *
+ * 15/10/26
+ * 	- initial implementation
+ */
+
+/*
+
+	This file is part of VIPS.
+
+	VIPS is free software; you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+	02110-1301  USA
+
+ */
+
+/*
+
+	These files are distributed with VIPS - http://www.vips.ecs.soton.ac.uk
+
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /*HAVE_CONFIG_H*/
+#include <glib/gi18n-lib.h>
+
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <cmath>
+
+#include <vips/vips.h>
+#include <vips/vector.h>
+#include <vips/debug.h>
+#include <vips/internal.h>
+
+#include "pcolour.h"
+
+#ifdef HAVE_HWY
+
+#undef HWY_TARGET_INCLUDE
+#define HWY_TARGET_INCLUDE "libvips/colour/dE_hwy.cpp"
+#include <hwy/foreach_target.h>
+#include <hwy/highway.h>
+#include <hwy/contrib/math/math-inl.h>
+
+namespace HWY_NAMESPACE {
+
+using namespace hwy::HWY_NAMESPACE;
+
+using DF32 = ScalableTag<float>;
+constexpr DF32 df32;
+
+using VF32 = Vec<DF32>;
+
+// Compat for Highway versions < 1.3.0
+#ifndef HWY_LANES_CONSTEXPR
+#define HWY_LANES_CONSTEXPR
+#endif
+
+/* The vector loop only runs on SIMD targets, the caller does any remaining
+ * pixels (or all of them for HWY_SCALAR).
+ */
+#if HWY_TARGET != HWY_SCALAR
+#define VECTOR_LOOP 1
+#else
+#define VECTOR_LOOP 0
+#endif
+
+/* Three channels from @p, or from @ref if @p is NULL (a constant image).
+ */
+HWY_ATTR HWY_INLINE void
+load3(const float *HWY_RESTRICT p, const float *ref, int32_t x,
+	VF32 &c0, VF32 &c1, VF32 &c2)
+{
+	if (p)
+		LoadInterleaved3(df32, p + x * 3, c0, c1, c2);
+	else {
+		c0 = Set(df32, ref[0]);
+		c1 = Set(df32, ref[1]);
+		c2 = Set(df32, ref[2]);
+	}
+}
+
+HWY_ATTR int32_t
+vips_dE76_hwy(float *HWY_RESTRICT q,
+	const float *HWY_RESTRICT p1, const float *HWY_RESTRICT p2,
+	const float *ref, int32_t width)
+{
+	int32_t x = 0;
+
+	if (VECTOR_LOOP) {
+		HWY_LANES_CONSTEXPR int32_t N = Lanes(df32);
+
+		for (; x + N <= width; x += N) {
+			VF32 L1, a1, b1;
+			VF32 L2, a2, b2;
+
+			load3(p1, ref, x, L1, a1, b1);
+			load3(p2, ref, x, L2, a2, b2);
+
+			const VF32 dL = Sub(L1, L2);
+			const VF32 da = Sub(a1, a2);
+			const VF32 db = Sub(b1, b2);
+
+			StoreU(Sqrt(MulAdd(dL, dL, MulAdd(da, da, Mul(db, db)))),
+				df32, q + x);
+		}
+	}
+
+	return x;
+}
+
+/* CMC is LCh, so go to ab with the bounded-error vector sin and cos.
+ */
+HWY_ATTR HWY_INLINE void
+Ch2ab(VF32 C, VF32 h, VF32 &a, VF32 &b)
+{
+	const VF32 rad = Mul(h, Set(df32, static_cast<float>(VIPS_PI / 180.0)));
+
+	a = Mul(C, Cos(df32, rad));
+	b = Mul(C, Sin(df32, rad));
+}
+
+/* Three channels of LCh as Lab, from @p, or from @ref if @p is NULL.
+ */
+HWY_ATTR HWY_INLINE void
+load_lch(const float *HWY_RESTRICT p, const float *ref, int32_t x,
+	VF32 &L, VF32 &a, VF32 &b)
+{
+	if (p) {
+		VF32 C, h;
+
+		LoadInterleaved3(df32, p + x * 3, L, C, h);
+		Ch2ab(C, h, a, b);
+	}
+	else {
+		L = Set(df32, ref[0]);
+		a = Set(df32, ref[1]);
+		b = Set(df32, ref[2]);
+	}
+}
+
+HWY_ATTR int32_t
+vips_dECMC_hwy(float *HWY_RESTRICT q,
+	const float *HWY_RESTRICT p1, const float *HWY_RESTRICT p2,
+	const float *ref, int32_t width)
+{
+	int32_t x = 0;
+
+	if (VECTOR_LOOP) {
+		HWY_LANES_CONSTEXPR int32_t N = Lanes(df32);
+
+		/* The constant colour goes to ab once.
+		 */
+		float ref_ab[3] = { 0 };
+		if (!p1 || !p2) {
+			ref_ab[0] = ref[0];
+			vips_col_Ch2ab(ref[1], ref[2], &ref_ab[1], &ref_ab[2]);
+		}
+
+		for (; x + N <= width; x += N) {
+			VF32 L1, a1, b1;
+			VF32 L2, a2, b2;
+
+			load_lch(p1, ref_ab, x, L1, a1, b1);
+			load_lch(p2, ref_ab, x, L2, a2, b2);
+
+			const VF32 dL = Sub(L1, L2);
+			const VF32 da = Sub(a1, a2);
+			const VF32 db = Sub(b1, b2);
+
+			StoreU(Sqrt(MulAdd(dL, dL, MulAdd(da, da, Mul(db, db)))),
+				df32, q + x);
+		}
+	}
+
+	return x;
+}
+
+/* Hue angle in degrees, 0 - 360, as vips_col_ab2h(). Atan() on the
+ * smaller over the larger of |a| and |b| keeps the argument in [0, 1], then
+ * we fix up the octant.
+ */
+HWY_ATTR HWY_INLINE VF32
+ab2h(VF32 a, VF32 b)
+{
+	const VF32 zero = Zero(df32);
+	const VF32 ax = Abs(a);
+	const VF32 ay = Abs(b);
+	const VF32 mx = Max(ax, ay);
+	const VF32 mn = Min(ax, ay);
+
+	VF32 t = Atan(df32, IfThenElseZero(Gt(mx, zero), Div(mn, mx)));
+	t = IfThenElse(Gt(ay, ax),
+		Sub(Set(df32, static_cast<float>(VIPS_PI / 2.0)), t), t);
+	t = IfThenElse(Lt(a, zero),
+		Sub(Set(df32, static_cast<float>(VIPS_PI)), t), t);
+	t = IfThenElse(Lt(b, zero),
+		Sub(Set(df32, static_cast<float>(2.0 * VIPS_PI)), t), t);
+
+	return Mul(t, Set(df32, static_cast<float>(180.0 / VIPS_PI)));
+}
+
+/* The R_C-style term, 2 * sqrt(C^7 / (C^7 + 25^7)).
+ */
+HWY_ATTR HWY_INLINE VF32
+c7_ratio(VF32 C)
+{
+	const VF32 C2 = Mul(C, C);
+	const VF32 C7 = Mul(Mul(Mul(C2, C2), C2), C);
+
+	return Sqrt(Div(C7, Add(C7, Set(df32, 6103515625.0f))));
+}
+
+HWY_ATTR HWY_INLINE VF32
+cos_deg(VF32 x)
+{
+	return Cos(df32, Mul(x, Set(df32, static_cast<float>(VIPS_PI / 180.0))));
+}
+
+HWY_ATTR int32_t
+vips_dE00_hwy(float *HWY_RESTRICT q,
+	const float *HWY_RESTRICT p1, const float *HWY_RESTRICT p2,
+	const float *ref, int32_t width)
+{
+	int32_t x = 0;
+
+	if (VECTOR_LOOP) {
+		HWY_LANES_CONSTEXPR int32_t N = Lanes(df32);
+		const VF32 zero = Zero(df32);
+		const VF32 one = Set(df32, 1.0f);
+		const VF32 half = Set(df32, 0.5f);
+		const VF32 v180 = Set(df32, 180.0f);
+		const VF32 v360 = Set(df32, 360.0f);
+		const VF32 rad = Set(df32, static_cast<float>(VIPS_PI / 180.0));
+
+		/* G couples the two chromas, so all we can do for a constant
+		 * colour is find its chroma once.
+		 */
+		const VF32 ref_C = Set(df32, ref
+				? sqrtf(ref[1] * ref[1] + ref[2] * ref[2])
+				: 0.0f);
+
+		for (; x + N <= width; x += N) {
+			VF32 L1, a1, b1;
+			VF32 L2, a2, b2;
+
+			load3(p1, ref, x, L1, a1, b1);
+			load3(p2, ref, x, L2, a2, b2);
+
+			const VF32 C1 = p1
+				? Sqrt(MulAdd(a1, a1, Mul(b1, b1)))
+				: ref_C;
+			const VF32 C2 = p2
+				? Sqrt(MulAdd(a2, a2, Mul(b2, b2)))
+				: ref_C;
+			const VF32 Cb = Mul(Add(C1, C2), half);
+			const VF32 G1 = Add(one, Mul(half, Sub(one, c7_ratio(Cb))));
+
+			const VF32 a1d = Mul(G1, a1);
+			const VF32 a2d = Mul(G1, a2);
+			const VF32 C1d = Sqrt(MulAdd(a1d, a1d, Mul(b1, b1)));
+			const VF32 C2d = Sqrt(MulAdd(a2d, a2d, Mul(b2, b2)));
+			const VF32 h1d = ab2h(a1d, b1);
+			const VF32 h2d = ab2h(a2d, b2);
+
+			const VF32 Ldb = Mul(Add(L1, L2), half);
+			const VF32 Cdb = Mul(Add(C1d, C2d), half);
+			const VF32 dh = Sub(h1d, h2d);
+			const auto is_near = Lt(Abs(dh), v180);
+			const VF32 hdb = IfThenElse(is_near,
+				Mul(Add(h1d, h2d), half),
+				Mul(Abs(Sub(Add(h1d, h2d), v360)), half));
+
+			const VF32 hdbd = Div(Sub(hdb, Set(df32, 275.0f)),
+				Set(df32, 25.0f));
+			const VF32 dtheta = Mul(Set(df32, 30.0f),
+				Exp(df32, Neg(Mul(hdbd, hdbd))));
+			const VF32 RC = Add(c7_ratio(Cdb), c7_ratio(Cdb));
+			const VF32 RT = Neg(Mul(
+				Sin(df32, Mul(Add(dtheta, dtheta), rad)), RC));
+
+			const VF32 T = Sub(
+				Add(Sub(one,
+						Mul(Set(df32, 0.17f),
+							cos_deg(Sub(hdb, Set(df32, 30.0f))))),
+					Add(Mul(Set(df32, 0.24f),
+							cos_deg(Add(hdb, hdb))),
+						Mul(Set(df32, 0.32f),
+							cos_deg(MulAdd(hdb, Set(df32, 3.0f),
+								Set(df32, 6.0f)))))),
+				Mul(Set(df32, 0.20f),
+					cos_deg(MulAdd(hdb, Set(df32, 4.0f),
+						Set(df32, -63.0f)))));
+
+			const VF32 Ldb50 = Sub(Ldb, Set(df32, 50.0f));
+			const VF32 Ldb502 = Mul(Ldb50, Ldb50);
+			const VF32 SL = Add(one,
+				Div(Mul(Set(df32, 0.015f), Ldb502),
+					Sqrt(Add(Set(df32, 20.0f), Ldb502))));
+			const VF32 SC = MulAdd(Set(df32, 0.045f), Cdb, one);
+			const VF32 SH = MulAdd(Mul(Set(df32, 0.015f), Cdb), T, one);
+
+			const VF32 dhd = IfThenElse(is_near, dh, Sub(v360, dh));
+
+			const VF32 dLd = Sub(L1, L2);
+			const VF32 dCd = Sub(C1d, C2d);
+			const VF32 rC1dC2d = Sqrt(Mul(C1d, C2d));
+			const VF32 dHd = Mul(Add(rC1dC2d, rC1dC2d),
+				Sin(df32, Mul(Mul(dhd, half), rad)));
+
+			const VF32 nL = Div(dLd, SL);
+			const VF32 nC = Div(dCd, SC);
+			const VF32 nH = Div(dHd, SH);
+
+			const VF32 sum = MulAdd(nL, nL,
+				MulAdd(nC, nC,
+					MulAdd(nH, nH, Mul(RT, Mul(nC, nH)))));
+
+			StoreU(Sqrt(Max(sum, zero)), df32, q + x);
+		}
+	}
+
+	return x;
+}
+
+/* This file is included once per target, and VECTOR_LOOP differs between
+ * them.
+ */
+#undef VECTOR_LOOP
+
+} /*namespace HWY_NAMESPACE*/
+
+#if HWY_ONCE
+HWY_EXPORT(vips_dE76_hwy);
+HWY_EXPORT(vips_dECMC_hwy);
+HWY_EXPORT(vips_dE00_hwy);
+
+int
+vips_dE76_hwy(float *out, const float *in1, const float *in2,
+	const float *ref, int width)
+{
+	return HWY_DYNAMIC_DISPATCH(vips_dE76_hwy)(out, in1, in2, ref, width);
+}
+
+int
+vips_dECMC_hwy(float *out, const float *in1, const float *in2,
+	const float *ref, int width)
+{
+	return HWY_DYNAMIC_DISPATCH(vips_dECMC_hwy)(out, in1, in2, ref, width);
+}
+
+int
+vips_dE00_hwy(float *out, const float *in1, const float *in2,
+	const float *ref, int width)
+{
+	return HWY_DYNAMIC_DISPATCH(vips_dE00_hwy)(out, in1, in2, ref, width);
+}
+#endif /*HWY_ONCE*/
+
+#endif /*HAVE_HWY*/
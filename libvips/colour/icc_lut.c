@@ -0,0 +1,499 @@
+/* Cached interpolation LUTs for 8-bit device to device ICC transforms.
+ *
+ * 14/10/26
+ * 	- from icc_transform.c
+ */
+
+/*
+
+	This file is part of VIPS.
+
+	VIPS is free software; you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+	02110-1301  USA
+
+ */
+
+/*
+
+	These files are distributed with VIPS - http://www.vips.ecs.soton.ac.uk
+
+ */
+
+/* An 8-bit RGB or CMYK transform is sampled once on a regular grid with
+ * lcms, then evaluated with tetrahedral interpolation. CMYK is done as two
+ * tetrahedral lookups in CMY at the K nodes either side, then a linear
+ * blend in K, as lcms does. Grey input gets a plain 256 entry table.
+ *
+ * The LUTs are cached on the profile pair, intent and flags, so repeated
+ * transforms with the same profiles skip profile linking completely.
+ */
+
+/*
+#define DEBUG
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /*HAVE_CONFIG_H*/
+#include <glib/gi18n-lib.h>
+
+#ifdef HAVE_LCMS2
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+/* Has to be before VIPS to avoid nameclashes.
+ */
+#include <lcms2.h>
+
+#include <vips/vips.h>
+#include <vips/vector.h>
+
+#include "pcolour.h"
+
+/* Grid nodes per axis. 33 is what lcms uses for its own 8-bit RGB
+ * optimisation, 17 keeps CMYK tables to a reasonable size.
+ */
+#define GRID_3 (33)
+#define GRID_4 (17)
+
+/* Keep at most this many LUTs in the cache.
+ */
+#define MAX_CACHED_LUTS (16)
+
+static GMutex vips_icc_lut_lock;
+static GHashTable *vips_icc_lut_cache = NULL;
+
+static void
+vips_icc_lut_free(VipsIccLut *lut)
+{
+	VIPS_FREE(lut->table);
+	VIPS_FREE(lut);
+}
+
+void
+vips__icc_lut_unref(VipsIccLut *lut)
+{
+	if (g_atomic_int_dec_and_test(&lut->ref_count))
+		vips_icc_lut_free(lut);
+}
+
+static gboolean
+vips_icc_lut_unused(gpointer key, gpointer value, gpointer user_data)
+{
+	VipsIccLut *lut = (VipsIccLut *) value;
+
+	return g_atomic_int_get(&lut->ref_count) == 1;
+}
+
+/* Sample the transform on the grid.
+ */
+static int
+vips_icc_lut_fill(VipsIccLut *lut, cmsHTRANSFORM trans)
+{
+	int n_nodes;
+	guint16 *in;
+	guint16 *out;
+
+	n_nodes = 1;
+	for (int i = 0; i < lut->n_in; i++)
+		n_nodes *= lut->grid;
+
+	if (!(in = VIPS_ARRAY(NULL, (size_t) n_nodes * lut->n_in, guint16)))
+		return -1;
+	if (!(out = VIPS_ARRAY(NULL, (size_t) n_nodes * lut->n_out, guint16))) {
+		g_free(in);
+		return -1;
+	}
+
+	/* Nodes are in table order, so the last input channel varies
+	 * fastest.
+	 */
+	for (int i = 0; i < n_nodes; i++) {
+		int node = i;
+
+		for (int c = lut->n_in - 1; c >= 0; c--) {
+			int v = node % lut->grid;
+
+			in[i * lut->n_in + c] =
+				rint(v * 65535.0 / (lut->grid - 1));
+			node /= lut->grid;
+		}
+	}
+
+	cmsDoTransform(trans, in, out, n_nodes);
+
+	for (int i = 0; i < n_nodes * lut->n_out; i++)
+		lut->table[i] = out[i] / 257.0F;
+
+	g_free(in);
+	g_free(out);
+
+	return 0;
+}
+
+static VipsIccLut *
+vips_icc_lut_build(cmsHPROFILE in_profile, cmsHPROFILE out_profile,
+	cmsUInt32Number in_format, cmsUInt32Number out_format,
+	int intent, cmsUInt32Number flags)
+{
+	VipsIccLut *lut;
+	cmsHTRANSFORM trans;
+	int n_entries;
+
+	if (!(lut = VIPS_NEW(NULL, VipsIccLut)))
+		return NULL;
+	lut->ref_count = 1;
+	lut->n_in = T_CHANNELS(in_format);
+	lut->n_out = T_CHANNELS(out_format);
+	lut->grid = lut->n_in == 1 ? 256 : lut->n_in == 3 ? GRID_3 : GRID_4;
+	lut->table = NULL;
+
+	/* Strides in floats for each input channel, the last channel varies
+	 * fastest.
+	 */
+	lut->stride[lut->n_in - 1] = lut->n_out;
+	for (int c = lut->n_in - 2; c >= 0; c--)
+		lut->stride[c] = lut->stride[c + 1] * lut->grid;
+	n_entries = lut->stride[0] * lut->grid;
+
+	/* For each 8-bit input value, the node below and the distance to it.
+	 * 255 uses the top cell with a fraction of 1, so we never need to
+	 * look past the edge of the table.
+	 */
+	for (int v = 0; v < 256; v++) {
+		if (lut->grid == 256) {
+			lut->index[v] = v;
+			lut->frac[v] = 0.0F;
+		}
+		else {
+			int pos = v * (lut->grid - 1);
+			int node = VIPS_MIN(pos / 255, lut->grid - 2);
+
+			lut->index[v] = node;
+			lut->frac[v] = (pos - node * 255) / 255.0F;
+		}
+	}
+
+	if (!(lut->table = VIPS_ARRAY(NULL, n_entries, float))) {
+		vips_icc_lut_free(lut);
+		return NULL;
+	}
+
+	/* Sample with a 16-bit version of the transform.
+	 */
+	if (!(trans = cmsCreateTransform(
+			  in_profile, (in_format & ~BYTES_SH(7)) | BYTES_SH(2),
+			  out_profile, (out_format & ~BYTES_SH(7)) | BYTES_SH(2),
+			  intent, flags))) {
+		vips_icc_lut_free(lut);
+		return NULL;
+	}
+
+	if (vips_icc_lut_fill(lut, trans)) {
+		cmsDeleteTransform(trans);
+		vips_icc_lut_free(lut);
+		return NULL;
+	}
+
+	cmsDeleteTransform(trans);
+
+	return lut;
+}
+
+static char *
+vips_icc_lut_key(VipsBlob *in_blob, VipsBlob *out_blob,
+	cmsUInt32Number in_format, cmsUInt32Number out_format,
+	int intent, cmsUInt32Number flags)
+{
+	const void *data;
+	size_t size;
+	char *in_hash;
+	char *out_hash;
+	char *key;
+
+	data = vips_blob_get(in_blob, &size);
+	in_hash = g_compute_checksum_for_data(G_CHECKSUM_SHA256, data, size);
+	data = vips_blob_get(out_blob, &size);
+	out_hash = g_compute_checksum_for_data(G_CHECKSUM_SHA256, data, size);
+
+	key = g_strdup_printf("%s %s %x %x %d %x",
+		in_hash, out_hash, in_format, out_format, intent, flags);
+
+	g_free(in_hash);
+	g_free(out_hash);
+
+	return key;
+}
+
+/* Is this transform one we can do with a LUT? We need 8-bit device space at
+ * both ends, RGB, CMYK or grey in, and RGB, CMYK or grey out.
+ */
+gboolean
+vips__icc_lut_can_use(guint32 in_format, guint32 out_format)
+{
+	int n_in = T_CHANNELS(in_format);
+	int n_out = T_CHANNELS(out_format);
+
+	return T_BYTES(in_format) == 1 &&
+		T_BYTES(out_format) == 1 &&
+		!T_FLOAT(in_format) &&
+		!T_FLOAT(out_format) &&
+		(n_in == 1 || n_in == 3 || n_in == 4) &&
+		(n_out == 1 || n_out == 3 || n_out == 4);
+}
+
+/* Get a LUT for a profile pair, building and caching it if necessary. The
+ * caller must vips__icc_lut_unref() the result.
+ */
+VipsIccLut *
+vips__icc_lut_get(void *in_profile, VipsBlob *in_blob,
+	void *out_profile, VipsBlob *out_blob,
+	guint32 in_format, guint32 out_format, int intent, guint32 flags)
+{
+	char *key;
+	VipsIccLut *lut;
+
+	if (!in_blob ||
+		!out_blob)
+		return NULL;
+
+	key = vips_icc_lut_key(in_blob, out_blob,
+		in_format, out_format, intent, flags);
+
+	g_mutex_lock(&vips_icc_lut_lock);
+
+	if (!vips_icc_lut_cache)
+		vips_icc_lut_cache = g_hash_table_new_full(g_str_hash, g_str_equal,
+			g_free, (GDestroyNotify) vips__icc_lut_unref);
+
+	if ((lut = g_hash_table_lookup(vips_icc_lut_cache, key))) {
+#ifdef DEBUG
+		printf("vips__icc_lut_get: cache hit for %s\n", key);
+#endif /*DEBUG*/
+
+		g_free(key);
+	}
+	else if ((lut = vips_icc_lut_build(in_profile, out_profile,
+				  in_format, out_format, intent, flags))) {
+#ifdef DEBUG
+		printf("vips__icc_lut_get: built %d -> %d LUT for %s\n",
+			lut->n_in, lut->n_out, key);
+#endif /*DEBUG*/
+
+		if (g_hash_table_size(vips_icc_lut_cache) >= MAX_CACHED_LUTS)
+			g_hash_table_foreach_remove(vips_icc_lut_cache,
+				vips_icc_lut_unused, NULL);
+
+		g_hash_table_insert(vips_icc_lut_cache, key, lut);
+	}
+	else
+		g_free(key);
+
+	if (lut)
+		g_atomic_int_inc(&lut->ref_count);
+
+	g_mutex_unlock(&vips_icc_lut_lock);
+
+	return lut;
+}
+
+/* Tetrahedral interpolation in one 3D cube. p is the cube origin, sx, sy, sz
+ * the strides of the three axes and fx, fy, fz the position in the cube.
+ */
+static inline float
+vips_icc_lut_tetrahedral(const float *p,
+	int sx, int sy, int sz, float fx, float fy, float fz)
+{
+	float c0 = p[0];
+	float c3 = p[sx + sy + sz];
+	float c1;
+	float c2;
+	float w1;
+	float w2;
+	float w3;
+
+	/* Walk from the origin along the axis with the largest fraction,
+	 * then the next largest.
+	 */
+	if (fx >= fy) {
+		if (fy >= fz) {
+			c1 = p[sx];
+			c2 = p[sx + sy];
+			w1 = fx;
+			w2 = fy;
+			w3 = fz;
+		}
+		else if (fx >= fz) {
+			c1 = p[sx];
+			c2 = p[sx + sz];
+			w1 = fx;
+			w2 = fz;
+			w3 = fy;
+		}
+		else {
+			c1 = p[sz];
+			c2 = p[sx + sz];
+			w1 = fz;
+			w2 = fx;
+			w3 = fy;
+		}
+	}
+	else {
+		if (fz >= fy) {
+			c1 = p[sz];
+			c2 = p[sy + sz];
+			w1 = fz;
+			w2 = fy;
+			w3 = fx;
+		}
+		else if (fz >= fx) {
+			c1 = p[sy];
+			c2 = p[sy + sz];
+			w1 = fy;
+			w2 = fz;
+			w3 = fx;
+		}
+		else {
+			c1 = p[sy];
+			c2 = p[sx + sy];
+			w1 = fy;
+			w2 = fx;
+			w3 = fz;
+		}
+	}
+
+	return c0 + w1 * (c1 - c0) + w2 * (c2 - c1) + w3 * (c3 - c2);
+}
+
+static inline VipsPel
+vips_icc_lut_to_uchar(float v)
+{
+	return (VipsPel) VIPS_CLIP(0, (int) (v + 0.5F), UCHAR_MAX);
+}
+
+static void
+vips_icc_lut_line_1(VipsIccLut *lut, VipsPel *out, VipsPel *in, int width)
+{
+	const int n_out = lut->n_out;
+
+	for (int x = 0; x < width; x++) {
+		const float *p = lut->table + in[x] * n_out;
+
+		for (int o = 0; o < n_out; o++)
+			out[o] = vips_icc_lut_to_uchar(p[o]);
+
+		out += n_out;
+	}
+}
+
+static void
+vips_icc_lut_line_3(VipsIccLut *lut, VipsPel *out, VipsPel *in, int width)
+{
+	const int n_out = lut->n_out;
+	const int sx = lut->stride[0];
+	const int sy = lut->stride[1];
+	const int sz = lut->stride[2];
+
+	for (int x = 0; x < width; x++) {
+		const float *p = lut->table +
+			lut->index[in[0]] * sx +
+			lut->index[in[1]] * sy +
+			lut->index[in[2]] * sz;
+		float fx = lut->frac[in[0]];
+		float fy = lut->frac[in[1]];
+		float fz = lut->frac[in[2]];
+
+		for (int o = 0; o < n_out; o++)
+			out[o] = vips_icc_lut_to_uchar(vips_icc_lut_tetrahedral(
+				p + o, sx, sy, sz, fx, fy, fz));
+
+		in += 3;
+		out += n_out;
+	}
+}
+
+static void
+vips_icc_lut_line_4(VipsIccLut *lut, VipsPel *out, VipsPel *in, int width)
+{
+	const int n_out = lut->n_out;
+	const int sx = lut->stride[0];
+	const int sy = lut->stride[1];
+	const int sz = lut->stride[2];
+	const int sk = lut->stride[3];
+
+	for (int x = 0; x < width; x++) {
+		const float *p = lut->table +
+			lut->index[in[0]] * sx +
+			lut->index[in[1]] * sy +
+			lut->index[in[2]] * sz +
+			lut->index[in[3]] * sk;
+		float fx = lut->frac[in[0]];
+		float fy = lut->frac[in[1]];
+		float fz = lut->frac[in[2]];
+		float fk = lut->frac[in[3]];
+
+		for (int o = 0; o < n_out; o++) {
+			float k0 = vips_icc_lut_tetrahedral(p + o,
+				sx, sy, sz, fx, fy, fz);
+			float k1 = vips_icc_lut_tetrahedral(p + sk + o,
+				sx, sy, sz, fx, fy, fz);
+
+			out[o] = vips_icc_lut_to_uchar(k0 + fk * (k1 - k0));
+		}
+
+		in += 4;
+		out += n_out;
+	}
+}
+
+/* Transform a line of pixels with a LUT.
+ */
+void
+vips__icc_lut_line(VipsIccLut *lut, VipsPel *out, VipsPel *in, int width)
+{
+	int x = 0;
+
+#ifdef HAVE_HWY
+	if (lut->n_in > 1 &&
+		lut->n_out == 3 &&
+		vips_vector_isenabled())
+		x = vips_icc_lut_uchar_hwy(lut, out, in, width);
+#endif /*HAVE_HWY*/
+
+	in += x * lut->n_in;
+	out += x * lut->n_out;
+	width -= x;
+
+	switch (lut->n_in) {
+	case 1:
+		vips_icc_lut_line_1(lut, out, in, width);
+		break;
+
+	case 3:
+		vips_icc_lut_line_3(lut, out, in, width);
+		break;
+
+	case 4:
+		vips_icc_lut_line_4(lut, out, in, width);
+		break;
+
+	default:
+		g_assert_not_reached();
+	}
+}
+
+#endif /*HAVE_LCMS2*/
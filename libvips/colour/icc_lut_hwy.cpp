@@ -0,0 +1,269 @@
+/* Highway kernel for ICC transform LUTs.
+ *
+ * 14/10/26
+ * 	- initial implementation
+ */
+
+/*
+
+	This file is part of VIPS.
+
+	VIPS is free software; you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+	02110-1301  USA
+
+ */
+
+/*
+
+	These files are distributed with VIPS - http://www.vips.ecs.soton.ac.uk
+
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /*HAVE_CONFIG_H*/
+#include <glib/gi18n-lib.h>
+
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <cmath>
+
+#include <vips/vips.h>
+#include <vips/vector.h>
+#include <vips/debug.h>
+#include <vips/internal.h>
+
+#include "pcolour.h"
+
+#ifdef HAVE_HWY
+
+#undef HWY_TARGET_INCLUDE
+#define HWY_TARGET_INCLUDE "libvips/colour/icc_lut_hwy.cpp"
+#include <hwy/foreach_target.h>
+#include <hwy/highway.h>
+
+namespace HWY_NAMESPACE {
+
+using namespace hwy::HWY_NAMESPACE;
+
+using DF32 = ScalableTag<float>;
+using DI32 = ScalableTag<int32_t>;
+constexpr DF32 df32;
+constexpr DI32 di32;
+
+/* Narrow vector with one lane for each int lane, for loading before a
+ * promote, or storing after a demote.
+ */
+constexpr Rebind<uint8_t, DI32> du8x32;
+
+using VF32 = Vec<DF32>;
+using VI32 = Vec<DI32>;
+
+// Compat for Highway versions < 1.3.0
+#ifndef HWY_LANES_CONSTEXPR
+#define HWY_LANES_CONSTEXPR
+#endif
+
+/* The vector loop only runs on SIMD targets, the caller does any remaining
+ * pixels (or all of them for HWY_SCALAR).
+ */
+#if HWY_TARGET != HWY_SCALAR
+#define VECTOR_LOOP 1
+#else
+#define VECTOR_LOOP 0
+#endif
+
+/* The vertices and weights of the tetrahedron containing each point, see
+ * vips_icc_lut_tetrahedral(). We walk from the origin along the axis with the
+ * largest fraction, then along the next largest. Writing the second vertex as
+ * the far corner minus the axis with the smallest fraction means we don't
+ * need to sort.
+ *
+ * Vectors are sizeless on some targets and can't go into structs, so
+ * everything is passed separately.
+ */
+HWY_ATTR HWY_INLINE void
+tetrahedron(VI32 sx, VI32 sy, VI32 sz, VF32 fx, VF32 fy, VF32 fz,
+	VI32 &o1, VI32 &o2, VF32 &w1, VF32 &w2, VF32 &w3)
+{
+	const auto x_max = And(Ge(fx, fy), Ge(fx, fz));
+	const auto y_max = Ge(fy, fz);
+	const auto z_min = And(Le(fz, fy), Le(fz, fx));
+	const auto y_min = Le(fy, fx);
+
+	const VI32 o_max = IfThenElse(RebindMask(di32, x_max), sx,
+		IfThenElse(RebindMask(di32, y_max), sy, sz));
+	const VI32 o_min = IfThenElse(RebindMask(di32, z_min), sz,
+		IfThenElse(RebindMask(di32, y_min), sy, sx));
+
+	w1 = Max(fx, Max(fy, fz));
+	w3 = Min(fx, Min(fy, fz));
+	w2 = Sub(Add(fx, Add(fy, fz)), Add(w1, w3));
+
+	o1 = o_max;
+	o2 = Sub(Add(sx, Add(sy, sz)), o_min);
+}
+
+/* Interpolate one output channel in the cube at o0.
+ */
+HWY_ATTR HWY_INLINE VF32
+interpolate(const float *HWY_RESTRICT table,
+	VI32 o0, VI32 o1, VI32 o2, VI32 o3, VF32 w1, VF32 w2, VF32 w3)
+{
+	const VF32 c0 = GatherIndex(df32, table, o0);
+	const VF32 c1 = GatherIndex(df32, table, Add(o0, o1));
+	const VF32 c2 = GatherIndex(df32, table, Add(o0, o2));
+	const VF32 c3 = GatherIndex(df32, table, Add(o0, o3));
+
+	return Add(Add(Add(c0, Mul(w1, Sub(c1, c0))),
+				   Mul(w2, Sub(c2, c1))),
+		Mul(w3, Sub(c3, c2)));
+}
+
+/* Interpolate one output channel at the K nodes either side of o0, then
+ * blend linearly in K.
+ */
+HWY_ATTR HWY_INLINE VF32
+interpolate_k(const float *HWY_RESTRICT table, VI32 o0, VI32 sk, VF32 fk,
+	VI32 o1, VI32 o2, VI32 o3, VF32 w1, VF32 w2, VF32 w3)
+{
+	const VF32 k0 = interpolate(table, o0, o1, o2, o3, w1, w2, w3);
+	const VF32 k1 = interpolate(table, Add(o0, sk), o1, o2, o3, w1, w2, w3);
+
+	return Add(k0, Mul(fk, Sub(k1, k0)));
+}
+
+HWY_ATTR HWY_INLINE Vec<decltype(du8x32)>
+to_uchar(VF32 v)
+{
+	/* Round, then demote with saturation.
+	 */
+	return DemoteTo(du8x32,
+		ConvertTo(di32, Max(Add(v, Set(df32, 0.5F)), Zero(df32))));
+}
+
+HWY_ATTR int32_t
+vips_icc_lut_uchar_hwy(VipsIccLut *lut,
+	VipsPel *pout, VipsPel *pin, int32_t width)
+{
+	const uint8_t *HWY_RESTRICT in = (uint8_t *) pin;
+	uint8_t *HWY_RESTRICT out = (uint8_t *) pout;
+	const float *HWY_RESTRICT table = lut->table;
+	const int32_t *HWY_RESTRICT index = lut->index;
+	const float *HWY_RESTRICT frac = lut->frac;
+	int32_t x = 0;
+
+	if (VECTOR_LOOP) {
+		HWY_LANES_CONSTEXPR int32_t N = Lanes(df32);
+		const VI32 sx = Set(di32, lut->stride[0]);
+		const VI32 sy = Set(di32, lut->stride[1]);
+		const VI32 sz = Set(di32, lut->stride[2]);
+		const VI32 o3 = Add(sx, Add(sy, sz));
+
+		if (lut->n_in == 3)
+			for (; x + N <= width; x += N) {
+				Vec<decltype(du8x32)> r8, g8, b8;
+				VI32 o1, o2;
+				VF32 w1, w2, w3;
+
+				LoadInterleaved3(du8x32, in + x * 3, r8, g8, b8);
+				const VI32 r = PromoteTo(di32, r8);
+				const VI32 g = PromoteTo(di32, g8);
+				const VI32 b = PromoteTo(di32, b8);
+
+				const VI32 o0 = Add(Add(
+					Mul(GatherIndex(di32, index, r), sx),
+					Mul(GatherIndex(di32, index, g), sy)),
+					Mul(GatherIndex(di32, index, b), sz));
+
+				tetrahedron(sx, sy, sz,
+					GatherIndex(df32, frac, r),
+					GatherIndex(df32, frac, g),
+					GatherIndex(df32, frac, b),
+					o1, o2, w1, w2, w3);
+
+				StoreInterleaved3(
+					to_uchar(interpolate(table,
+						o0, o1, o2, o3, w1, w2, w3)),
+					to_uchar(interpolate(table + 1,
+						o0, o1, o2, o3, w1, w2, w3)),
+					to_uchar(interpolate(table + 2,
+						o0, o1, o2, o3, w1, w2, w3)),
+					du8x32, out + x * 3);
+			}
+		else if (lut->n_in == 4) {
+			/* Two lookups at the K nodes either side, then a linear
+			 * blend in K.
+			 */
+			const VI32 sk = Set(di32, lut->stride[3]);
+
+			for (; x + N <= width; x += N) {
+				Vec<decltype(du8x32)> c8, m8, y8, k8;
+				VI32 o1, o2;
+				VF32 w1, w2, w3;
+
+				LoadInterleaved4(du8x32, in + x * 4, c8, m8, y8, k8);
+				const VI32 c = PromoteTo(di32, c8);
+				const VI32 m = PromoteTo(di32, m8);
+				const VI32 y = PromoteTo(di32, y8);
+				const VI32 k = PromoteTo(di32, k8);
+
+				const VI32 o0 = Add(Add(Add(
+					Mul(GatherIndex(di32, index, c), sx),
+					Mul(GatherIndex(di32, index, m), sy)),
+					Mul(GatherIndex(di32, index, y), sz)),
+					Mul(GatherIndex(di32, index, k), sk));
+				const VF32 fk = GatherIndex(df32, frac, k);
+
+				tetrahedron(sx, sy, sz,
+					GatherIndex(df32, frac, c),
+					GatherIndex(df32, frac, m),
+					GatherIndex(df32, frac, y),
+					o1, o2, w1, w2, w3);
+
+				StoreInterleaved3(
+					to_uchar(interpolate_k(table, o0, sk, fk,
+						o1, o2, o3, w1, w2, w3)),
+					to_uchar(interpolate_k(table + 1, o0, sk, fk,
+						o1, o2, o3, w1, w2, w3)),
+					to_uchar(interpolate_k(table + 2, o0, sk, fk,
+						o1, o2, o3, w1, w2, w3)),
+					du8x32, out + x * 3);
+			}
+		}
+	}
+
+	return x;
+}
+
+/* This file is included once per target, and VECTOR_LOOP differs between
+ * them.
+ */
+#undef VECTOR_LOOP
+
+} /*namespace HWY_NAMESPACE*/
+
+#if HWY_ONCE
+HWY_EXPORT(vips_icc_lut_uchar_hwy);
+
+int
+vips_icc_lut_uchar_hwy(VipsIccLut *lut, VipsPel *out, VipsPel *in, int width)
+{
+	return HWY_DYNAMIC_DISPATCH(vips_icc_lut_uchar_hwy)(lut, out, in, width);
+}
+#endif /*HWY_ONCE*/
+
+#endif /*HAVE_HWY*/
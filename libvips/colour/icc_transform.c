@@ -47,6 +47,9 @@
  * 	- add black_point_compensation
  * 11/7/26 lancylot2004
  * 	- use the lcms float path for float input
+ * 14/10/26
+ * 	- use a cached LUT for 8-bit device to device transforms
+ * 	- share lcms transforms between operations with an LRU cache
  */
 
 /*
@@ -102,6 +105,12 @@
  */
 #define PIXEL_BUFFER_SIZE (10000)
 
+/* Keep at most this many lcms transforms, and this much memory, in the
+ * transform cache.
+ */
+#define MAX_CACHED_TRANSFORMS (32)
+#define MAX_CACHED_MEMORY (32 * 1024 * 1024)
+
 /**
  * VipsIntent:
  * @VIPS_INTENT_PERCEPTUAL: perceptual rendering intent
@@ -171,6 +180,8 @@ typedef struct _VipsIcc {
 	cmsUInt32Number in_icc_format;
 	cmsUInt32Number out_icc_format;
 	cmsHTRANSFORM trans;
+	struct _VipsIccCached *cached;
+	VipsIccLut *lut;
 	gboolean non_standard_input_profile;
 } VipsIcc;
 
@@ -187,12 +198,168 @@ icc_error(cmsContext context, cmsUInt32Number code, const char *text)
 	vips_error("VipsIcc", "%s", text);
 }
 
+/* An lcms transform in the transform cache. Transforms made with
+ * cmsFLAGS_NOCACHE are safe to share between threads, so operations with the
+ * same profiles, formats, intent and flags can all use the same one.
+ */
+typedef struct _VipsIccCached {
+	int ref_count;
+	char *key;
+	cmsHTRANSFORM trans;
+
+	/* lcms can't tell us how large a transform is, so we estimate from
+	 * the size of the profiles.
+	 */
+	size_t size;
+} VipsIccCached;
+
+/* Most recently used at the head. The hash maps keys to links in the queue.
+ */
+static GMutex vips_icc_cache_lock;
+static GHashTable *vips_icc_cache_table = NULL;
+static GQueue vips_icc_cache_lru = G_QUEUE_INIT;
+static size_t vips_icc_cache_memory = 0;
+
+static void
+vips_icc_cached_unref(VipsIccCached *cached)
+{
+	if (g_atomic_int_dec_and_test(&cached->ref_count)) {
+		VIPS_FREEF(cmsDeleteTransform, cached->trans);
+		VIPS_FREE(cached->key);
+		g_free(cached);
+	}
+}
+
+/* Drop least recently used transforms until we are within the limits. Call
+ * with the lock held.
+ */
+static void
+vips_icc_cache_trim(void)
+{
+	while (vips_icc_cache_lru.length > MAX_CACHED_TRANSFORMS ||
+		(vips_icc_cache_lru.length > 1 &&
+			vips_icc_cache_memory > MAX_CACHED_MEMORY)) {
+		VipsIccCached *cached = g_queue_pop_tail(&vips_icc_cache_lru);
+
+		g_hash_table_remove(vips_icc_cache_table, cached->key);
+		vips_icc_cache_memory -= cached->size;
+		vips_icc_cached_unref(cached);
+	}
+}
+
+/* Half of the cache key: a digest of the profile, or the colour space for
+ * the built-in PCS profiles, which have no blob.
+ */
+static char *
+vips_icc_cache_profile_key(VipsBlob *blob, cmsHPROFILE profile)
+{
+	if (blob) {
+		const void *data;
+		size_t size;
+
+		data = vips_blob_get(blob, &size);
+
+		return g_compute_checksum_for_data(G_CHECKSUM_SHA256, data, size);
+	}
+	else
+		return g_strdup_printf("pcs-%x", cmsGetColorSpace(profile));
+}
+
+/* Find or make the lcms transform for this icc.
+ */
+static int
+vips_icc_cache_get(VipsIcc *icc, cmsUInt32Number flags)
+{
+	char *in_key;
+	char *out_key;
+	char *key;
+	GList *link;
+	VipsIccCached *cached;
+	cmsHTRANSFORM trans;
+
+	in_key = vips_icc_cache_profile_key(icc->in_blob, icc->in_profile);
+	out_key = vips_icc_cache_profile_key(icc->out_blob, icc->out_profile);
+	key = g_strdup_printf("%s %s %x %x %d %x",
+		in_key, out_key,
+		icc->in_icc_format, icc->out_icc_format,
+		icc->selected_intent, flags);
+	g_free(in_key);
+	g_free(out_key);
+
+	g_mutex_lock(&vips_icc_cache_lock);
+
+	if (!vips_icc_cache_table)
+		vips_icc_cache_table = g_hash_table_new(g_str_hash, g_str_equal);
+
+	if ((link = g_hash_table_lookup(vips_icc_cache_table, key))) {
+		cached = (VipsIccCached *) link->data;
+		g_queue_unlink(&vips_icc_cache_lru, link);
+		g_queue_push_head_link(&vips_icc_cache_lru, link);
+		g_atomic_int_inc(&cached->ref_count);
+		g_mutex_unlock(&vips_icc_cache_lock);
+
+		g_free(key);
+		icc->cached = cached;
+		icc->trans = cached->trans;
+
+		return 0;
+	}
+
+	g_mutex_unlock(&vips_icc_cache_lock);
+
+	/* Linking can take a while, so don't hold the lock.
+	 */
+	if (!(trans = cmsCreateTransform(
+			  icc->in_profile, icc->in_icc_format,
+			  icc->out_profile, icc->out_icc_format,
+			  icc->selected_intent, flags))) {
+		g_free(key);
+		return -1;
+	}
+
+	cached = g_new(VipsIccCached, 1);
+	cached->ref_count = 2;
+	cached->key = key;
+	cached->trans = trans;
+	cached->size = 0;
+	if (icc->in_blob)
+		cached->size += VIPS_AREA(icc->in_blob)->length;
+	if (icc->out_blob)
+		cached->size += VIPS_AREA(icc->out_blob)->length;
+
+	g_mutex_lock(&vips_icc_cache_lock);
+
+	/* Someone else may have made this transform while we were linking.
+	 * We just keep ours out of the cache.
+	 */
+	if (g_hash_table_contains(vips_icc_cache_table, key))
+		cached->ref_count = 1;
+	else {
+		g_queue_push_head(&vips_icc_cache_lru, cached);
+		g_hash_table_insert(vips_icc_cache_table,
+			cached->key, vips_icc_cache_lru.head);
+		vips_icc_cache_memory += cached->size;
+		vips_icc_cache_trim();
+	}
+
+	g_mutex_unlock(&vips_icc_cache_lock);
+
+	icc->cached = cached;
+	icc->trans = cached->trans;
+
+	return 0;
+}
+
 static void
 vips_icc_dispose(GObject *gobject)
 {
 	VipsIcc *icc = (VipsIcc *) gobject;
 
-	VIPS_FREEF(cmsDeleteTransform, icc->trans);
+	/* The transform belongs to the cache entry.
+	 */
+	icc->trans = NULL;
+	VIPS_FREEF(vips_icc_cached_unref, icc->cached);
+	VIPS_FREEF(vips__icc_lut_unref, icc->lut);
 	VIPS_FREEF(cmsCloseProfile, icc->in_profile);
 	VIPS_FREEF(cmsCloseProfile, icc->out_profile);
 
@@ -456,10 +623,17 @@ vips_icc_build(VipsObject *object)
 	if (icc->black_point_compensation)
 		flags |= cmsFLAGS_BLACKPOINTCOMPENSATION;
 
-	if (!(icc->trans = cmsCreateTransform(
-			  icc->in_profile, icc->in_icc_format,
-			  icc->out_profile, icc->out_icc_format,
-			  icc->selected_intent, flags)))
+	/* 8-bit device to device transforms can use a cached LUT. This
+	 * saves linking the profiles again if we've seen this pair before.
+	 */
+	if (vips__icc_lut_can_use(icc->in_icc_format, icc->out_icc_format))
+		icc->lut = vips__icc_lut_get(icc->in_profile, icc->in_blob,
+			icc->out_profile, icc->out_blob,
+			icc->in_icc_format, icc->out_icc_format,
+			icc->selected_intent, flags);
+
+	if (!icc->lut &&
+		vips_icc_cache_get(icc, flags))
 		return -1;
 
 	if (VIPS_OBJECT_CLASS(vips_icc_parent_class)->build(object))
@@ -1216,7 +1390,10 @@ vips_icc_transform_line(VipsColour *colour,
 {
 	VipsIcc *icc = (VipsIcc *) colour;
 
-	cmsDoTransform(icc->trans, in[0], out, width);
+	if (icc->lut)
+		vips__icc_lut_line(icc->lut, out, in[0], width);
+	else
+		cmsDoTransform(icc->trans, in[0], out, width);
 }
 
 static void
@@ -31,6 +31,8 @@
 #ifndef VIPS_PCOLOUR_H
 #define VIPS_PCOLOUR_H
 
+#include <math.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif /*__cplusplus*/
@@ -193,6 +195,12 @@ typedef struct _VipsColourDifference {
 	 */
 	VipsInterpretation interpretation;
 
+	/* If one side is a constant image, 0 for left or 1 for right, and
+	 * its colour in @interpretation. Otherwise -1.
+	 */
+	int reference_index;
+	float reference[3];
+
 } VipsColourDifference;
 
 typedef struct _VipsColourDifferenceClass {
@@ -305,6 +313,150 @@ vips_cicp_apply_matrix(const float *matrix, float r, float g, float b,
 	*out_b = matrix[6] * r + matrix[7] * g + matrix[8] * b;
 }
 
+/* Size of the cube root table used by XYZ2Lab.
+ */
+#define VIPS__XYZ2LAB_QUANT (100000)
+
+const float *vips__XYZ2Lab_table(void);
+
+/* Per-pixel forms of the line functions, so the fused sRGB2PCS path gives
+ * exactly the same results as running the steps one by one.
+ */
+static inline void
+vips__scRGB2XYZ_pixel(const float *p, float *q)
+{
+	const float R = p[0] * VIPS_D65_Y0;
+	const float G = p[1] * VIPS_D65_Y0;
+	const float B = p[2] * VIPS_D65_Y0;
+
+	q[0] = 0.4124F * R + 0.3576F * G + 0.1805F * B;
+	q[1] = 0.2126F * R + 0.7152F * G + 0.0722F * B;
+	q[2] = 0.0193F * R + 0.1192F * G + 0.9505F * B;
+}
+
+static inline float
+vips__XYZ2Lab_cbrt(const float *table, float n)
+{
+	/* CLIP is much faster than FCLIP, and we want an int result.
+	 */
+	const int i = VIPS_CLIP(0, (int) n, VIPS__XYZ2LAB_QUANT - 2);
+	const float f = n - i;
+
+	return table[i] + f * (table[i + 1] - table[i]);
+}
+
+static inline void
+vips__XYZ2Lab_pixel(const float *table, double X0, double Y0, double Z0,
+	const float *p, float *q)
+{
+	const float nX = VIPS__XYZ2LAB_QUANT * p[0] / X0;
+	const float nY = VIPS__XYZ2LAB_QUANT * p[1] / Y0;
+	const float nZ = VIPS__XYZ2LAB_QUANT * p[2] / Z0;
+
+	const float cbx = vips__XYZ2Lab_cbrt(table, nX);
+	const float cby = vips__XYZ2Lab_cbrt(table, nY);
+	const float cbz = vips__XYZ2Lab_cbrt(table, nZ);
+
+	q[0] = 116.0F * cby - 16.0F;
+	q[1] = 500.0F * (cbx - cby);
+	q[2] = 200.0F * (cby - cbz);
+}
+
+// see https://en.wikipedia.org/wiki/Oklab_color_space#Conversion_from_CIE_XYZ
+static inline void
+vips__XYZ2Oklab_pixel(const float *p, float *q)
+{
+	// to D65 normalised XYZ ... M1 already has D65_X0 included etc.
+	const float X = p[0] / 100.0;
+	const float Y = p[1] / 100.0;
+	const float Z = p[2] / 100.0;
+
+	// convert to LMS
+	const float l = X * 0.8189330101 + Y * 0.3618667424 + Z * -0.1288597137;
+	const float m = X * 0.0329845436 + Y * 0.9293118715 + Z *  0.0361456387;
+	const float s = X * 0.0482003018 + Y * 0.2643662691 + Z *  0.6338517070;
+
+	const float lp = cbrtf(l);
+	const float mp = cbrtf(m);
+	const float sp = cbrtf(s);
+
+	// to Oklab
+	q[0] = lp * 0.2104542553 + mp *  0.7936177850 + sp * -0.0040720468;
+	q[1] = lp * 1.9779984951 + mp * -2.4285922050 + sp *  0.4505937099;
+	q[2] = lp * 0.0259040371 + mp *  0.7827717662 + sp * -0.8086757660;
+}
+
+/* sRGB (or RGB16) straight to XYZ, Lab or Oklab, see sRGB2PCS.c.
+ */
+int vips__sRGB2PCS(VipsImage *in, VipsImage **out, VipsInterpretation space);
+
+/* SIMD paths, see colour_hwy.cpp. Three-band pixels, each returns the number
+ * of pixels processed and the caller does the rest.
+ */
+int vips_sRGB2scRGB_uchar_hwy(float *out, const VipsPel *in, int width);
+int vips_sRGB2scRGB_ushort_hwy(float *out, const unsigned short *in,
+	int width);
+int vips_scRGB2XYZ_hwy(float *out, const float *in, int width);
+int vips_XYZ2scRGB_hwy(float *out, const float *in, int width);
+int vips_XYZ2Lab_hwy(float *out, const float *in, int width,
+	const float *table, double X0, double Y0, double Z0);
+int vips_XYZ2Oklab_hwy(float *out, const float *in, int width);
+int vips_sRGB2PCS_uchar_hwy(float *out, const VipsPel *in, int width,
+	VipsInterpretation space, const float *table);
+int vips_sRGB2PCS_ushort_hwy(float *out, const unsigned short *in,
+	int width, VipsInterpretation space, const float *table);
+int vips_uhdr2scRGB_hwy(float *out, const VipsPel *in, const VipsPel *gain,
+	int gain_bands, const float *scale, const float *offset, int width);
+
+/* Colour difference, see dE_hwy.cpp. A NULL @in1 or @in2 means use @ref
+ * for every pixel.
+ */
+int vips_dE76_hwy(float *out, const float *in1, const float *in2,
+	const float *ref, int width);
+int vips_dECMC_hwy(float *out, const float *in1, const float *in2,
+	const float *ref, int width);
+int vips_dE00_hwy(float *out, const float *in1, const float *in2,
+	const float *ref, int width);
+
+/* A cached LUT for an 8-bit device to device ICC transform, see icc_lut.c.
+ */
+typedef struct _VipsIccLut {
+	int ref_count;
+
+	/* Number of input and output channels.
+	 */
+	int n_in;
+	int n_out;
+
+	/* Nodes per input axis, and the stride in floats of each axis.
+	 */
+	int grid;
+	int stride[4];
+
+	/* For each 8-bit input value, the node below and the distance past
+	 * it.
+	 */
+	int index[256];
+	float frac[256];
+
+	/* grid ** n_in nodes of n_out floats, scaled to 0 - 255.
+	 */
+	float *table;
+} VipsIccLut;
+
+gboolean vips__icc_lut_can_use(guint32 in_format, guint32 out_format);
+VipsIccLut *vips__icc_lut_get(void *in_profile, VipsBlob *in_blob,
+	void *out_profile, VipsBlob *out_blob,
+	guint32 in_format, guint32 out_format, int intent, guint32 flags);
+void vips__icc_lut_unref(VipsIccLut *lut);
+void vips__icc_lut_line(VipsIccLut *lut, VipsPel *out, VipsPel *in, int width);
+
+/* SIMD path, see icc_lut_hwy.cpp. RGB or CMYK in, RGB out, returns the number
+ * of pixels processed.
+ */
+int vips_icc_lut_uchar_hwy(VipsIccLut *lut,
+	VipsPel *out, VipsPel *in, int width);
+
 #ifdef __cplusplus
 }
 #endif /*__cplusplus*/
@@ -0,0 +1,238 @@
+/* Turn sRGB straight into XYZ, Lab or Oklab.
+ *
+ * 14/10/26
+ * 	- from sRGB2scRGB.c
+ */
+
+/*
+
+	This file is part of VIPS.
+
+	VIPS is free software; you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+	02110-1301  USA
+
+ */
+
+/*
+
+	These files are distributed with VIPS - http://www.vips.ecs.soton.ac.uk
+
+ */
+
+/* colourspace used to run sRGB -> Lab as sRGB2scRGB, scRGB2XYZ and XYZ2Lab,
+ * with a float image between each step. This does the whole chain for each
+ * pixel in one pass. Results are the same as running the steps one by one.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /*HAVE_CONFIG_H*/
+#include <glib/gi18n-lib.h>
+
+#include <stdio.h>
+#include <math.h>
+
+#include <vips/vips.h>
+#include <vips/vector.h>
+#include <vips/internal.h>
+
+#include "pcolour.h"
+
+typedef struct _VipssRGB2PCS {
+	VipsColourCode parent_instance;
+
+	/* XYZ, LAB or OKLAB.
+	 */
+	VipsInterpretation space;
+
+	/* The cube root table from XYZ2Lab.
+	 */
+	const float *table;
+
+} VipssRGB2PCS;
+
+typedef VipsColourCodeClass VipssRGB2PCSClass;
+
+G_DEFINE_TYPE(VipssRGB2PCS, vips_sRGB2PCS, VIPS_TYPE_COLOUR_CODE);
+
+static inline void
+vips_sRGB2PCS_pixel(VipssRGB2PCS *sRGB2PCS, const float *p, float *q)
+{
+	float XYZ[3];
+
+	vips__scRGB2XYZ_pixel(p, XYZ);
+
+	switch (sRGB2PCS->space) {
+	case VIPS_INTERPRETATION_LAB:
+		vips__XYZ2Lab_pixel(sRGB2PCS->table,
+			VIPS_D65_X0, VIPS_D65_Y0, VIPS_D65_Z0, XYZ, q);
+		break;
+
+	case VIPS_INTERPRETATION_OKLAB:
+		vips__XYZ2Oklab_pixel(XYZ, q);
+		break;
+
+	default:
+		q[0] = XYZ[0];
+		q[1] = XYZ[1];
+		q[2] = XYZ[2];
+		break;
+	}
+}
+
+static void
+vips_sRGB2PCS_line(VipsColour *colour, VipsPel *out, VipsPel **in, int width)
+{
+	VipssRGB2PCS *sRGB2PCS = (VipssRGB2PCS *) colour;
+	float *restrict q = (float *) out;
+
+	int i;
+
+	i = 0;
+
+	if (colour->in[0]->BandFmt == VIPS_FORMAT_UCHAR) {
+		VipsPel *restrict p = in[0];
+
+#ifdef HAVE_HWY
+		if (vips_vector_isenabled()) {
+			i = vips_sRGB2PCS_uchar_hwy(q, p, width,
+				sRGB2PCS->space, sRGB2PCS->table);
+			p += i * 3;
+			q += i * 3;
+		}
+#endif /*HAVE_HWY*/
+
+		for (; i < width; i++) {
+			float rgb[3];
+
+			rgb[0] = vips_v2Y_8[p[0]];
+			rgb[1] = vips_v2Y_8[p[1]];
+			rgb[2] = vips_v2Y_8[p[2]];
+			vips_sRGB2PCS_pixel(sRGB2PCS, rgb, q);
+
+			p += 3;
+			q += 3;
+		}
+	}
+	else if (colour->in[0]->BandFmt == VIPS_FORMAT_USHORT) {
+		unsigned short *restrict p = (unsigned short *) in[0];
+
+#ifdef HAVE_HWY
+		if (vips_vector_isenabled()) {
+			i = vips_sRGB2PCS_ushort_hwy(q, p, width,
+				sRGB2PCS->space, sRGB2PCS->table);
+			p += i * 3;
+			q += i * 3;
+		}
+#endif /*HAVE_HWY*/
+
+		for (; i < width; i++) {
+			float rgb[3];
+
+			rgb[0] = vips_v2Y_16[p[0]];
+			rgb[1] = vips_v2Y_16[p[1]];
+			rgb[2] = vips_v2Y_16[p[2]];
+			vips_sRGB2PCS_pixel(sRGB2PCS, rgb, q);
+
+			p += 3;
+			q += 3;
+		}
+	}
+	else
+		g_assert_not_reached();
+}
+
+static int
+vips_sRGB2PCS_build(VipsObject *object)
+{
+	VipsObjectClass *class = VIPS_OBJECT_GET_CLASS(object);
+	VipsColour *colour = (VipsColour *) object;
+	VipsColourCode *code = (VipsColourCode *) object;
+	VipssRGB2PCS *sRGB2PCS = (VipssRGB2PCS *) object;
+
+	if (sRGB2PCS->space != VIPS_INTERPRETATION_XYZ &&
+		sRGB2PCS->space != VIPS_INTERPRETATION_LAB &&
+		sRGB2PCS->space != VIPS_INTERPRETATION_OKLAB) {
+		vips_error(class->nickname,
+			"%s", _("space must be one of xyz, lab or oklab"));
+		return -1;
+	}
+
+	// input image we want
+	if (vips_object_argument_isset(object, "in") &&
+		code->in->Type == VIPS_INTERPRETATION_RGB16) {
+		vips_col_make_tables_RGB_16();
+		code->input_format = VIPS_FORMAT_USHORT;
+	}
+	else {
+		vips_col_make_tables_RGB_8();
+		code->input_format = VIPS_FORMAT_UCHAR;
+	}
+	colour->input_bands = 3;
+
+	sRGB2PCS->table = vips__XYZ2Lab_table();
+
+	// output image we make
+	colour->interpretation = sRGB2PCS->space;
+	colour->format = VIPS_FORMAT_FLOAT;
+	colour->bands = 3;
+
+	return VIPS_OBJECT_CLASS(vips_sRGB2PCS_parent_class)->build(object);
+}
+
+static void
+vips_sRGB2PCS_class_init(VipssRGB2PCSClass *class)
+{
+	GObjectClass *gobject_class = G_OBJECT_CLASS(class);
+	VipsObjectClass *object_class = (VipsObjectClass *) class;
+	VipsOperationClass *operation_class = VIPS_OPERATION_CLASS(class);
+	VipsColourClass *colour_class = VIPS_COLOUR_CLASS(class);
+
+	gobject_class->set_property = vips_object_set_property;
+	gobject_class->get_property = vips_object_get_property;
+
+	object_class->nickname = "sRGB2PCS";
+	object_class->description =
+		_("convert an sRGB image to XYZ, Lab or Oklab");
+	object_class->build = vips_sRGB2PCS_build;
+
+	/* Only used by colourspace, hide it.
+	 */
+	operation_class->flags |= VIPS_OPERATION_DEPRECATED;
+
+	colour_class->process_line = vips_sRGB2PCS_line;
+
+	VIPS_ARG_ENUM(class, "space", 110,
+		_("Space"),
+		_("Destination color space"),
+		VIPS_ARGUMENT_OPTIONAL_INPUT,
+		G_STRUCT_OFFSET(VipssRGB2PCS, space),
+		VIPS_TYPE_INTERPRETATION, VIPS_INTERPRETATION_LAB);
+}
+
+static void
+vips_sRGB2PCS_init(VipssRGB2PCS *sRGB2PCS)
+{
+	sRGB2PCS->space = VIPS_INTERPRETATION_LAB;
+}
+
+/* Same as vips_sRGB2scRGB(), then vips_scRGB2XYZ(), then optionally
+ * vips_XYZ2Lab() or vips_XYZ2Oklab().
+ */
+int
+vips__sRGB2PCS(VipsImage *in, VipsImage **out, VipsInterpretation space)
+{
+	return vips_call("sRGB2PCS", in, out, "space", space, NULL);
+}
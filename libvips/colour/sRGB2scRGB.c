@@ -21,6 +21,8 @@
  * 	- special path for 3 and 4 band images
  * 16/4/25
  *	- move on top of ColourCode
+ * 14/10/26
+ * 	- add a SIMD path
  */
 
 /*
@@ -59,6 +61,7 @@
 #include <math.h>
 
 #include <vips/vips.h>
+#include <vips/vector.h>
 #include <vips/internal.h>
 
 #include "pcolour.h"
@@ -75,9 +78,21 @@ vips_sRGB2scRGB_line(VipsColour *colour, VipsPel *out, VipsPel **in, int width)
 		float *restrict q;
 		VipsPel *restrict p;
 
+		int i;
+
 		q = (float *) out;
 		p = in[0];
-		for (int i = 0; i < width; i++) {
+		i = 0;
+
+#ifdef HAVE_HWY
+		if (vips_vector_isenabled()) {
+			i = vips_sRGB2scRGB_uchar_hwy(q, p, width);
+			p += i * 3;
+			q += i * 3;
+		}
+#endif /*HAVE_HWY*/
+
+		for (; i < width; i++) {
 			q[0] = vips_v2Y_8[p[0]];
 			q[1] = vips_v2Y_8[p[1]];
 			q[2] = vips_v2Y_8[p[2]];
@@ -90,9 +105,21 @@ vips_sRGB2scRGB_line(VipsColour *colour, VipsPel *out, VipsPel **in, int width)
 		float *restrict q;
 		unsigned short *restrict p;
 
+		int i;
+
 		q = (float *) out;
 		p = (unsigned short *) in[0];
-		for (int i = 0; i < width; i++) {
+		i = 0;
+
+#ifdef HAVE_HWY
+		if (vips_vector_isenabled()) {
+			i = vips_sRGB2scRGB_ushort_hwy(q, p, width);
+			p += i * 3;
+			q += i * 3;
+		}
+#endif /*HAVE_HWY*/
+
+		for (; i < width; i++) {
 			q[0] = vips_v2Y_16[p[0]];
 			q[1] = vips_v2Y_16[p[1]];
 			q[2] = vips_v2Y_16[p[2]];
@@ -8,6 +8,8 @@
  * 	- cleanups
  * 20/9/12
  * 	redo as a class
+ * 14/10/26
+ * 	- add a SIMD path
  */
 
 /*
@@ -46,6 +48,7 @@
 #include <math.h>
 
 #include <vips/vips.h>
+#include <vips/vector.h>
 
 #include "pcolour.h"
 
@@ -59,19 +62,20 @@ vips_scRGB2XYZ_line(VipsColour *colour, VipsPel *out, VipsPel **in, int width)
 {
 	float *restrict p = (float *) in[0];
 	float *restrict q = (float *) out;
+	int i;
 
-	for (int i = 0; i < width; i++) {
-		const float R = p[0] * VIPS_D65_Y0;
-		const float G = p[1] * VIPS_D65_Y0;
-		const float B = p[2] * VIPS_D65_Y0;
-
-		/* Manually inlined logic from the vips_col_scRGB2XYZ function
-		 * as the original is defined in a separate file and is part of
-		 * the public API so a compiler will not inline.
-		 */
-		q[0] = 0.4124F * R + 0.3576F * G + 0.1805F * B;
-		q[1] = 0.2126F * R + 0.7152F * G + 0.0722F * B;
-		q[2] = 0.0193F * R + 0.1192F * G + 0.9505F * B;
+	i = 0;
+
+#ifdef HAVE_HWY
+	if (vips_vector_isenabled()) {
+		i = vips_scRGB2XYZ_hwy(q, p, width);
+		p += i * 3;
+		q += i * 3;
+	}
+#endif /*HAVE_HWY*/
+
+	for (; i < width; i++) {
+		vips__scRGB2XYZ_pixel(p, q);
 
 		p += 3;
 		q += 3;
@@ -2,6 +2,8 @@
  *
  * 26/11/25
  * 	- from XYZ2scRGB.c.c
+ * 15/10/26
+ * 	- precompute gain tables, add a highway path
  */
 
 /*
@@ -37,9 +39,11 @@
 #include <glib/gi18n-lib.h>
 
 #include <stdio.h>
+#include <string.h>
 #include <math.h>
 
 #include <vips/vips.h>
+#include <vips/vector.h>
 
 #include "pcolour.h"
 
@@ -60,6 +64,13 @@ typedef struct _VipsUhdr2scRGB {
 	 */
 	VipsImage *gainmap;
 
+	/* The gainmap is 8-bit, so we can tabulate the whole transform. For
+	 * each channel and gainmap value, output is linear sRGB * scale +
+	 * offset.
+	 */
+	float scale[3][256];
+	float offset[3][256];
+
 } VipsUhdr2scRGB;
 
 typedef VipsColourClass VipsUhdr2scRGBClass;
@@ -67,106 +78,76 @@ typedef VipsColourClass VipsUhdr2scRGBClass;
 G_DEFINE_TYPE(VipsUhdr2scRGB, vips_uhdr2scRGB, VIPS_TYPE_COLOUR);
 
 /* Derived from the apache-licensed applyGain() method of libuhdr.
- */
-
-/* Monochrome gainmap, colour image. Probably the most common case.
+ *
+ * Fill the tables for channel i. The gain for a gainmap value is
+ * exp2(mix(log2(min_boost), log2(max_boost), g)), then output is
+ *
+ *   VIPS_UHDR_TO_SCRGB * ((v + offset_sdr) * gain - offset_hdr)
+ *
+ * which we rearrange as v * scale + offset.
  */
 static void
-vips_uhdr2scRGB_mono(VipsUhdr2scRGB *uhdr,
-	VipsPel *out, VipsPel **in, int width)
+vips_uhdr2scRGB_build_table(VipsUhdr2scRGB *uhdr, int i, gboolean mono)
 {
-	VipsPel *restrict p1 = in[0];
-	VipsPel *restrict p2 = in[1];
-	float *restrict q = (float *) out;
-
-	for (int i = 0; i < width; i++) {
-		float r = vips_v2Y_8[p1[0]];
-		float g = vips_v2Y_8[p1[1]];
-		float b = vips_v2Y_8[p1[2]];
-		p1 += 3;
+	float log2_min = log2(uhdr->min_content_boost[i]);
+	float log2_max = log2(uhdr->max_content_boost[i]);
 
-		// the gainmap is not gamma corrected in libultrahdr, confusingly
-		float gg = p2[0] / 255.0;
-		p2 += 1;
+	for (int v = 0; v < 256; v++) {
+		// the mono gainmap is not gamma corrected in libultrahdr,
+		// confusingly
+		float g = mono ? v / 255.0 : vips_v2Y_8[v];
 
-		if (uhdr->gamma[1] != 1.0f)
-			gg = pow(gg, 1.0f / uhdr->gamma[1]);
+		if (uhdr->gamma[i] != 1.0f)
+			g = pow(g, 1.0f / uhdr->gamma[i]);
 
-		float boostg = log2(uhdr->min_content_boost[1]) * (1.0f - gg) +
-			log2(uhdr->max_content_boost[1]) * gg;
+		float gain = exp2(log2_min * (1.0f - g) + log2_max * g);
 
-		float gaing = exp2(boostg);
-
-		q[0] = VIPS_UHDR_TO_SCRGB *
-			(((r + uhdr->offset_sdr[1]) * gaing) - uhdr->offset_hdr[1]);
-		q[1] = VIPS_UHDR_TO_SCRGB *
-			(((g + uhdr->offset_sdr[1]) * gaing) - uhdr->offset_hdr[1]);
-		q[2] = VIPS_UHDR_TO_SCRGB *
-			(((b + uhdr->offset_sdr[1]) * gaing) - uhdr->offset_hdr[1]);
-		q += 3;
+		uhdr->scale[i][v] = VIPS_UHDR_TO_SCRGB * gain;
+		uhdr->offset[i][v] = VIPS_UHDR_TO_SCRGB *
+			(uhdr->offset_sdr[i] * gain - uhdr->offset_hdr[i]);
 	}
 }
 
-/* Colour image, colour gainmap. Allowed, but not common.
- */
 static void
-vips_uhdr2scRGB_rgb(VipsUhdr2scRGB *uhdr, VipsPel *out, VipsPel **in, int width)
+vips_uhdr2scRGB_line(VipsColour *colour, VipsPel *out, VipsPel **in, int width)
 {
+	VipsUhdr2scRGB *uhdr = (VipsUhdr2scRGB *) colour;
 	VipsPel *restrict p1 = in[0];
 	VipsPel *restrict p2 = in[1];
 	float *restrict q = (float *) out;
+	int gain_bands = uhdr->gainmap->Bands;
 
-	for (int i = 0; i < width; i++) {
-		float r = vips_v2Y_8[p1[0]];
-		float g = vips_v2Y_8[p1[1]];
-		float b = vips_v2Y_8[p1[2]];
-		p1 += 3;
+	int i;
 
-		float gr = vips_v2Y_8[p2[0]];
-		float gg = vips_v2Y_8[p2[1]];
-		float gb = vips_v2Y_8[p2[2]];
-		p2 += 3;
-
-		if (uhdr->gamma[0] != 1.0f)
-			gr = pow(gr, 1.0f / uhdr->gamma[0]);
-		if (uhdr->gamma[1] != 1.0f)
-			gg = pow(gg, 1.0f / uhdr->gamma[1]);
-		if (uhdr->gamma[2] != 1.0f)
-			gb = pow(gb, 1.0f / uhdr->gamma[2]);
-
-		float boostr = log2(uhdr->min_content_boost[0]) * (1.0f - gr) +
-			log2(uhdr->max_content_boost[0]) * gr;
-		float boostg = log2(uhdr->min_content_boost[1]) * (1.0f - gg) +
-			log2(uhdr->max_content_boost[1]) * gg;
-		float boostb = log2(uhdr->min_content_boost[2]) * (1.0f - gb) +
-			log2(uhdr->max_content_boost[2]) * gb;
-
-		float gainr = exp2(boostr);
-		float gaing = exp2(boostg);
-		float gainb = exp2(boostb);
-
-		q[0] = VIPS_UHDR_TO_SCRGB *
-			(((r + uhdr->offset_sdr[0]) * gainr) - uhdr->offset_hdr[0]);
-		q[1] = VIPS_UHDR_TO_SCRGB *
-			(((g + uhdr->offset_sdr[1]) * gaing) - uhdr->offset_hdr[1]);
-		q[2] = VIPS_UHDR_TO_SCRGB *
-			(((b + uhdr->offset_sdr[2]) * gainb) - uhdr->offset_hdr[2]);
-		q += 3;
+	g_assert(colour->in[0]->Xsize == colour->in[1]->Xsize);
+	g_assert(colour->in[0]->Ysize == colour->in[1]->Ysize);
+
+	i = 0;
+#ifdef HAVE_HWY
+	if (vips_vector_isenabled()) {
+		i = vips_uhdr2scRGB_hwy(q, p1, p2, gain_bands,
+			&uhdr->scale[0][0], &uhdr->offset[0][0], width);
+		p1 += i * 3;
+		p2 += i * gain_bands;
+		q += i * 3;
 	}
-}
+#endif /*HAVE_HWY*/
 
-static void
-vips_uhdr2scRGB_line(VipsColour *colour, VipsPel *out, VipsPel **in, int width)
-{
-	VipsUhdr2scRGB *uhdr = (VipsUhdr2scRGB *) colour;
+	for (; i < width; i++) {
+		/* A mono gainmap has the same value for all three channels.
+		 */
+		int gr = p2[0];
+		int gg = p2[gain_bands == 1 ? 0 : 1];
+		int gb = p2[gain_bands == 1 ? 0 : 2];
 
-	g_assert(colour->in[0]->Xsize == colour->in[1]->Xsize);
-	g_assert(colour->in[0]->Ysize == colour->in[1]->Ysize);
+		q[0] = vips_v2Y_8[p1[0]] * uhdr->scale[0][gr] + uhdr->offset[0][gr];
+		q[1] = vips_v2Y_8[p1[1]] * uhdr->scale[1][gg] + uhdr->offset[1][gg];
+		q[2] = vips_v2Y_8[p1[2]] * uhdr->scale[2][gb] + uhdr->offset[2][gb];
 
-	if (uhdr->gainmap->Bands == 1)
-		vips_uhdr2scRGB_mono(uhdr, out, in, width);
-	else
-		vips_uhdr2scRGB_rgb(uhdr, out, in, width);
+		p1 += 3;
+		p2 += gain_bands;
+		q += 3;
+	}
 }
 
 // pass in the array to fill, size must match
@@ -249,6 +230,22 @@ vips_uhdr2scRGB_build(VipsObject *object)
 		colour->in[0] = uhdr->in;
 		g_object_ref(uhdr->in);
 		colour->in[1] = uhdr->gainmap;
+
+		/* A mono gainmap uses the green parameters for all three
+		 * channels.
+		 */
+		if (uhdr->gainmap->Bands == 1) {
+			vips_uhdr2scRGB_build_table(uhdr, 1, TRUE);
+			memcpy(uhdr->scale[0], uhdr->scale[1], sizeof(uhdr->scale[1]));
+			memcpy(uhdr->scale[2], uhdr->scale[1], sizeof(uhdr->scale[1]));
+			memcpy(uhdr->offset[0], uhdr->offset[1],
+				sizeof(uhdr->offset[1]));
+			memcpy(uhdr->offset[2], uhdr->offset[1],
+				sizeof(uhdr->offset[1]));
+		}
+		else
+			for (int i = 0; i < 3; i++)
+				vips_uhdr2scRGB_build_table(uhdr, i, FALSE);
 	}
 
 	if (VIPS_OBJECT_CLASS(vips_uhdr2scRGB_parent_class)->build(object))
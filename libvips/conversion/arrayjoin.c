@@ -8,6 +8,9 @@
  *	- much faster with large arrays
  * 29/1/24
  *	- render and don't forward pixels for complete subregions
+ * 15/10/26
+ * 	- minimise whole rows of inputs, and don't scan every input for each
+ * 	  tile
  */
 
 /*
@@ -72,7 +75,12 @@ typedef struct _VipsArrayjoin {
 
 	int down;
 	VipsRect *rects;
-	gboolean *minimised;
+
+	/* In sequential mode, we minimise each row of inputs once the
+	 * output is well past it. This many rows, from the top, are done.
+	 */
+	GMutex lock;
+	int n_minimised;
 
 } VipsArrayjoin;
 
@@ -80,6 +88,25 @@ typedef VipsConversionClass VipsArrayjoinClass;
 
 G_DEFINE_TYPE(VipsArrayjoin, vips_arrayjoin, VIPS_TYPE_CONVERSION);
 
+static void
+vips_arrayjoin_finalize(GObject *gobject)
+{
+	VipsArrayjoin *join = (VipsArrayjoin *) gobject;
+
+	g_mutex_clear(&join->lock);
+
+	G_OBJECT_CLASS(vips_arrayjoin_parent_class)->finalize(gobject);
+}
+
+/* Has the output moved well past the bottom of this row of inputs?
+ */
+static gboolean
+vips_arrayjoin_row_done(VipsArrayjoin *join, int row, VipsRect *r)
+{
+	return row < join->down &&
+		r->top > VIPS_RECT_BOTTOM(&join->rects[row * join->across]) + 1024;
+}
+
 static int
 vips_arrayjoin_gen(VipsRegion *out_region,
 	void *seq, void *a, void *b, gboolean *stop)
@@ -160,21 +187,29 @@ vips_arrayjoin_gen(VipsRegion *out_region,
 	 * is well past the end of it. This can save a lot of memory and file
 	 * descriptors on large image arrays.
 	 *
-	 * minimise_all is quite expensive, so only trigger once for each input.
-	 *
-	 * We don't lock for minimised[], but it's harmless.
+	 * All inputs in a row of the grid end together, and rows finish in
+	 * order, so we just move a row cursor down. minimise_all is quite
+	 * expensive, so we only trigger once for each input, and we only
+	 * lock if there's a row to do.
 	 */
-	if (vips_image_is_sequential(conversion->out))
-		for (i = 0; i < n; i++) {
-			int bottom_edge = VIPS_RECT_BOTTOM(&join->rects[i]);
+	if (vips_image_is_sequential(conversion->out) &&
+		vips_arrayjoin_row_done(join,
+			g_atomic_int_get(&join->n_minimised), r)) {
+		g_mutex_lock(&join->lock);
+
+		while (vips_arrayjoin_row_done(join, join->n_minimised, r)) {
+			int first = join->n_minimised * join->across;
+			int last = VIPS_MIN(n, first + join->across);
 
-			if (!join->minimised[i] &&
-				r->top > bottom_edge + 1024) {
-				join->minimised[i] = TRUE;
+			for (i = first; i < last; i++)
 				vips_image_minimise_all(in[i]);
-			}
+
+			g_atomic_int_inc(&join->n_minimised);
 		}
 
+		g_mutex_unlock(&join->lock);
+	}
+
 	return 0;
 }
 
@@ -289,12 +324,6 @@ vips_arrayjoin_build(VipsObject *object)
 				output_width - join->rects[i].left;
 	}
 
-	/* A thing to track which inputs we've signalled minimise on.
-	 */
-	join->minimised = VIPS_ARRAY(join, n, gboolean);
-	for (i = 0; i < n; i++)
-		join->minimised[i] = FALSE;
-
 	/* Each image must be cropped and aligned within an @hspacing by
 	 * @vspacing box.
 	 */
@@ -381,6 +410,7 @@ vips_arrayjoin_class_init(VipsArrayjoinClass *class)
 
 	VIPS_DEBUG_MSG("vips_arrayjoin_class_init\n");
 
+	gobject_class->finalize = vips_arrayjoin_finalize;
 	gobject_class->set_property = vips_object_set_property;
 	gobject_class->get_property = vips_object_get_property;
 
@@ -453,6 +483,8 @@ vips_arrayjoin_init(VipsArrayjoin *join)
 	/* Init our instance fields.
 	 */
 	join->background = vips_array_double_newv(1, 0.0);
+
+	g_mutex_init(&join->lock);
 }
 
 static int
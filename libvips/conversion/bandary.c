@@ -28,6 +28,8 @@
  * 	- from bandjoin
  * 15/12/17
  * 	- remove max images restriction
+ * 15/10/26
+ * 	- fold constant images
  */
 
 /*
@@ -238,6 +240,8 @@ vips_bandary_build(VipsObject *object)
 			bandary->ready, bandary))
 		return -1;
 
+	vips__image_fold_constant(conversion->out, bandary->ready);
+
 	return 0;
 }
 
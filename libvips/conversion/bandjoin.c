@@ -26,6 +26,9 @@
  * 	- rewrite as a class
  * 7/11/15
  * 	- added bandjoin_const
+ * 15/10/26
+ * 	- add a highway path for joining one-band images
+ * 	- and for joining a pair of images, eg. RGB plus alpha
  */
 
 /*
@@ -70,6 +73,7 @@
 #include <math.h>
 
 #include <vips/vips.h>
+#include <vips/vector.h>
 #include <vips/internal.h>
 #include <vips/debug.h>
 
@@ -95,12 +99,30 @@ vips_bandjoin_buffer(VipsBandarySequence *seq,
 	VipsConversion *conversion = (VipsConversion *) bandary;
 	VipsImage **in = bandary->ready;
 
-	/* Output pel size.
+	/* Output pel and element size.
 	 */
 	const int ops = VIPS_IMAGE_SIZEOF_PEL(conversion->out);
+	const int es = VIPS_IMAGE_SIZEOF_ELEMENT(conversion->out);
 
 	int i;
 
+#ifdef HAVE_HWY
+	/* Up to four bands out, in whole vectors. This is one-band planes,
+	 * or a pair of images like RGB plus alpha.
+	 */
+	if (bandary->n <= 4 &&
+		ops <= 4 * es &&
+		(es == 1 || es == 2 || es == 4) &&
+		vips_vector_isenabled()) {
+		int bands[4];
+
+		for (i = 0; i < bandary->n; i++)
+			bands[i] = in[i]->Bands;
+		vips_bandjoin_hwy(q, p, width, bandary->n, bands, es);
+		return;
+	}
+#endif /*HAVE_HWY*/
+
 	/* Loop for each input image. Scattered write is faster than
 	 * scattered read.
 	 */
@@ -56,6 +56,8 @@
  * 	- remove old overflow/underflow detect
  * 8/12/20
  * 	- fix range clip in int32 -> unsigned casts [ewelot]
+ * 15/10/26
+ * 	- fold constant images
  */
 
 /*
@@ -100,6 +102,7 @@
 #include <math.h>
 
 #include <vips/vips.h>
+#include <vips/vector.h>
 #include <vips/internal.h>
 #include <vips/debug.h>
 
@@ -112,6 +115,10 @@ typedef struct _VipsCast {
 	VipsBandFormat format;
 	gboolean shift;
 
+	/* Use the SIMD paths, if there is one for this format pair.
+	 */
+	gboolean vector;
+
 } VipsCast;
 
 typedef VipsConversionClass VipsCastClass;
@@ -354,6 +361,45 @@ G_DEFINE_TYPE(VipsCast, vips_cast, VIPS_TYPE_CONVERSION);
 		} \
 	}
 
+#ifdef HAVE_HWY
+/* SIMD paths for the common uchar and ushort <-> float casts. Return TRUE if
+ * we did the line.
+ */
+static gboolean
+vips_cast_vector(VipsBandFormat from, VipsBandFormat to,
+	VipsPel *out, VipsPel *in, int sz)
+{
+	if (to == VIPS_FORMAT_FLOAT)
+		switch (from) {
+		case VIPS_FORMAT_UCHAR:
+			vips_cast_uchar_float_hwy(out, in, sz);
+			return TRUE;
+
+		case VIPS_FORMAT_USHORT:
+			vips_cast_ushort_float_hwy(out, in, sz);
+			return TRUE;
+
+		default:
+			break;
+		}
+	else if (from == VIPS_FORMAT_FLOAT)
+		switch (to) {
+		case VIPS_FORMAT_UCHAR:
+			vips_cast_float_uchar_hwy(out, in, sz);
+			return TRUE;
+
+		case VIPS_FORMAT_USHORT:
+			vips_cast_float_ushort_hwy(out, in, sz);
+			return TRUE;
+
+		default:
+			break;
+		}
+
+	return FALSE;
+}
+#endif /*HAVE_HWY*/
+
 static int
 vips_cast_gen(VipsRegion *out_region,
 	void *vseq, void *a, void *b, gboolean *stop)
@@ -375,6 +421,13 @@ vips_cast_gen(VipsRegion *out_region,
 		VipsPel *in = VIPS_REGION_ADDR(ir, r->left, r->top + y);
 		VipsPel *out = VIPS_REGION_ADDR(out_region, r->left, r->top + y);
 
+#ifdef HAVE_HWY
+		if (cast->vector &&
+			vips_cast_vector(ir->im->BandFmt, conversion->out->BandFmt,
+				out, in, sz))
+			continue;
+#endif /*HAVE_HWY*/
+
 		switch (ir->im->BandFmt) {
 		case VIPS_FORMAT_UCHAR:
 			BAND_SWITCH_INNER(unsigned char,
@@ -465,6 +518,7 @@ vips_cast_build(VipsObject *object)
 		vips_object_local_array(object, 2);
 
 	VipsImage *in;
+	VipsImage *ins[2];
 
 	if (VIPS_OBJECT_CLASS(vips_cast_parent_class)->build(object))
 		return -1;
@@ -499,11 +553,17 @@ vips_cast_build(VipsObject *object)
 
 	conversion->out->BandFmt = cast->format;
 
+	cast->vector = vips_vector_isenabled();
+
 	if (vips_image_generate(conversion->out,
 			vips_start_one, vips_cast_gen, vips_stop_one,
 			in, cast))
 		return -1;
 
+	ins[0] = in;
+	ins[1] = NULL;
+	vips__image_fold_constant(conversion->out, ins);
+
 	return 0;
 }
 
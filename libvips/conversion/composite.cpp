@@ -15,6 +15,12 @@
  *	- do our own subimage positioning
  * 8/5/19
  * 	- revise in/out/dest-in/dest-out to make smoother alpha
+ * 14/10/26
+ * 	- add a Highway path for RGBA over/dest-over/add/multiply/screen
+ * 	- fix scaling of the incoming pixel in the general path
+ * 	- copy runs of transparent and opaque overlay pixels without blending
+ * 15/10/26
+ * 	- fold constant images
  */
 
 /*
@@ -63,6 +69,7 @@
 #endif
 
 #include <vips/vips.h>
+#include <vips/vector.h>
 #include <vips/internal.h>
 #include <vips/debug.h>
 
@@ -130,6 +137,15 @@ typedef struct _VipsCompositeBase {
 	 */
 	gboolean skippable;
 
+	/* TRUE if we can use the Highway path: RGBA uchar, ushort or float,
+	 * and only modes which have a SIMD kernel.
+	 */
+	gboolean hwy;
+
+	/* max_band as float, for the Highway path.
+	 */
+	float max_band_hwy[4];
+
 } VipsCompositeBase;
 
 typedef VipsConversionClass VipsCompositeBaseClass;
@@ -196,6 +212,10 @@ typedef struct {
 	 */
 	VipsPel **p;
 
+	/* For each enabled image after the base, the blend mode to use.
+	 */
+	int *mode;
+
 } VipsCompositeSequence;
 
 #ifdef HAVE_VECTOR_ARITH
@@ -252,6 +272,7 @@ vips_composite_stop(void *vseq, void *a, void *b)
 
 	VIPS_FREE(seq->enabled);
 	VIPS_FREE(seq->p);
+	VIPS_FREE(seq->mode);
 
 #ifdef HAVE_VECTOR_ARITH
 	VIPS_FREEF(vips_free_aligned, seq);
@@ -285,6 +306,7 @@ vips_composite_start(VipsImage *out, void *a, void *b)
 	seq->input_regions = nullptr;
 	seq->enabled = nullptr;
 	seq->p = nullptr;
+	seq->mode = nullptr;
 
 	/* How many images?
 	 */
@@ -310,8 +332,10 @@ vips_composite_start(VipsImage *out, void *a, void *b)
 
 	seq->enabled = VIPS_ARRAY(NULL, n, int);
 	seq->p = VIPS_ARRAY(NULL, n, VipsPel *);
+	seq->mode = VIPS_ARRAY(NULL, n, int);
 	if (!seq->enabled ||
-		!seq->p) {
+		!seq->p ||
+		!seq->mode) {
 		vips_composite_stop(seq, nullptr, nullptr);
 		return nullptr;
 	}
@@ -590,7 +614,7 @@ vips_composite_base_blend(VipsCompositeBase *composite,
 	/* Load and scale the pixel to 0 - 1.
 	 */
 	for (int b = 0; b <= bands; b++)
-		A[b] = p[b] * composite->max_band[b];
+		A[b] = p[b] / composite->max_band[b];
 
 	aA = A[bands];
 	aB = B[bands];
@@ -1263,6 +1287,257 @@ vips_combine_pixels3(VipsCompositeSequence *seq, VipsPel *q)
 }
 #endif /*HAVE_VECTOR_ARITH*/
 
+/* Blend @width pixels from the enabled layers to @q, advancing the input
+ * pointers.
+ */
+static int
+vips_composite_base_blend_row(VipsCompositeSequence *seq,
+	VipsPel *q, int width, int ps)
+{
+	VipsCompositeBase *composite = seq->composite;
+	int x = 0;
+
+#ifdef HAVE_HWY
+	/* The SIMD path does as many whole vectors as it can, the
+	 * per-pixel code below does any remainder.
+	 */
+	if (composite->hwy) {
+		switch (seq->input_regions[0]->im->BandFmt) {
+		case VIPS_FORMAT_UCHAR:
+			x = vips_composite_uchar_hwy(q, seq->p, seq->mode,
+				seq->n, width, composite->max_band_hwy,
+				composite->premultiplied);
+			break;
+
+		case VIPS_FORMAT_USHORT:
+			x = vips_composite_ushort_hwy(q, seq->p, seq->mode,
+				seq->n, width, composite->max_band_hwy,
+				composite->premultiplied);
+			break;
+
+		case VIPS_FORMAT_FLOAT:
+			x = vips_composite_float_hwy(q, seq->p, seq->mode,
+				seq->n, width, composite->max_band_hwy,
+				composite->premultiplied);
+			break;
+
+		default:
+			break;
+		}
+
+		for (int i = 0; i < seq->n; i++)
+			seq->p[i] += x * ps;
+		q += x * ps;
+	}
+#endif /*HAVE_HWY*/
+
+	for (; x < width; x++) {
+		switch (seq->input_regions[0]->im->BandFmt) {
+		case VIPS_FORMAT_UCHAR:
+#ifdef HAVE_VECTOR_ARITH
+			if (composite->bands == 3)
+				vips_combine_pixels3<unsigned char,
+					0, UCHAR_MAX>(seq, q);
+			else
+#endif
+				vips_combine_pixels<unsigned char,
+					0, UCHAR_MAX>(seq, q);
+			break;
+
+		case VIPS_FORMAT_CHAR:
+			vips_combine_pixels<signed char,
+				SCHAR_MIN, SCHAR_MAX>(seq, q);
+			break;
+
+		case VIPS_FORMAT_USHORT:
+#ifdef HAVE_VECTOR_ARITH
+			if (composite->bands == 3)
+				vips_combine_pixels3<unsigned short,
+					0, USHRT_MAX>(seq, q);
+			else
+#endif
+				vips_combine_pixels<unsigned short,
+					0, USHRT_MAX>(seq, q);
+			break;
+
+		case VIPS_FORMAT_SHORT:
+			vips_combine_pixels<signed short,
+				SHRT_MIN, SHRT_MAX>(seq, q);
+			break;
+
+		case VIPS_FORMAT_UINT:
+			vips_combine_pixels<unsigned int,
+				0, UINT_MAX>(seq, q);
+			break;
+
+		case VIPS_FORMAT_INT:
+			vips_combine_pixels<signed int,
+				INT_MIN, INT_MAX>(seq, q);
+			break;
+
+		case VIPS_FORMAT_FLOAT:
+#ifdef HAVE_VECTOR_ARITH
+			if (composite->bands == 3)
+				vips_combine_pixels3<float,
+					0, USHRT_MAX>(seq, q);
+			else
+#endif
+				vips_combine_pixels<float,
+					0, 0>(seq, q);
+			break;
+
+		case VIPS_FORMAT_DOUBLE:
+			vips_combine_pixels<double,
+				0, 0>(seq, q);
+			break;
+
+		default:
+			g_assert_not_reached();
+			return -1;
+		}
+
+		for (int i = 0; i < seq->n; i++)
+			seq->p[i] += ps;
+		q += ps;
+	}
+
+	return 0;
+}
+
+/* Runs of pixels we can handle without blending.
+ */
+typedef enum {
+	VIPS_COMPOSITE_SPAN_BLEND, /* Blend the whole stack */
+	VIPS_COMPOSITE_SPAN_BASE,  /* All layers transparent, copy the base */
+	VIPS_COMPOSITE_SPAN_TOP	   /* Top layer opaque OVER, copy the top */
+} VipsCompositeSpan;
+
+template <typename T>
+static inline VipsCompositeSpan
+vips_composite_classify(VipsCompositeSequence *seq, int x)
+{
+	VipsCompositeBase *composite = seq->composite;
+	const int bands = composite->bands;
+	const int n = seq->n;
+	T **tp = (T **) seq->p;
+
+	/* An opaque top layer with OVER hides everything beneath it.
+	 */
+	if (seq->mode[n - 2] == VIPS_BLEND_MODE_OVER &&
+		tp[n - 1][x * (bands + 1) + bands] == composite->max_band[bands])
+		return VIPS_COMPOSITE_SPAN_TOP;
+
+	/* Transparent layers have no effect with skippable modes. If we're
+	 * premultiplied, all the bands must be zero too.
+	 */
+	if (!composite->skippable)
+		return VIPS_COMPOSITE_SPAN_BLEND;
+
+	for (int i = 1; i < n; i++) {
+		T *p = tp[i] + x * (bands + 1);
+
+		if (p[bands] != 0)
+			return VIPS_COMPOSITE_SPAN_BLEND;
+
+		if (composite->premultiplied)
+			for (int b = 0; b < bands; b++)
+				if (p[b] != 0)
+					return VIPS_COMPOSITE_SPAN_BLEND;
+	}
+
+	return VIPS_COMPOSITE_SPAN_BASE;
+}
+
+/* Find the length of the run of pixels like the first one.
+ */
+template <typename T>
+static int
+vips_composite_span(VipsCompositeSequence *seq, int width,
+	VipsCompositeSpan *span)
+{
+	int x;
+
+	*span = vips_composite_classify<T>(seq, 0);
+	for (x = 1; x < width; x++)
+		if (vips_composite_classify<T>(seq, x) != *span)
+			break;
+
+	return x;
+}
+
+/* Composite a line of pixels, copying runs of transparent or opaque pixels
+ * straight through rather than blending them.
+ */
+static int
+vips_composite_base_line(VipsCompositeSequence *seq,
+	VipsPel *q, int width, int ps)
+{
+	while (width > 0) {
+		VipsCompositeSpan span;
+		int n;
+
+		switch (seq->input_regions[0]->im->BandFmt) {
+		case VIPS_FORMAT_UCHAR:
+			n = vips_composite_span<unsigned char>(seq, width, &span);
+			break;
+
+		case VIPS_FORMAT_CHAR:
+			n = vips_composite_span<signed char>(seq, width, &span);
+			break;
+
+		case VIPS_FORMAT_USHORT:
+			n = vips_composite_span<unsigned short>(seq, width, &span);
+			break;
+
+		case VIPS_FORMAT_SHORT:
+			n = vips_composite_span<signed short>(seq, width, &span);
+			break;
+
+		case VIPS_FORMAT_UINT:
+			n = vips_composite_span<unsigned int>(seq, width, &span);
+			break;
+
+		case VIPS_FORMAT_INT:
+			n = vips_composite_span<signed int>(seq, width, &span);
+			break;
+
+		case VIPS_FORMAT_FLOAT:
+			n = vips_composite_span<float>(seq, width, &span);
+			break;
+
+		case VIPS_FORMAT_DOUBLE:
+			n = vips_composite_span<double>(seq, width, &span);
+			break;
+
+		default:
+			g_assert_not_reached();
+			return -1;
+		}
+
+		if (span == VIPS_COMPOSITE_SPAN_BLEND) {
+			/* This moves the input pointers on for us.
+			 */
+			if (vips_composite_base_blend_row(seq, q, n, ps))
+				return -1;
+		}
+		else {
+			VipsPel *p = span == VIPS_COMPOSITE_SPAN_BASE
+				? seq->p[0]
+				: seq->p[seq->n - 1];
+
+			memcpy(q, p, (size_t) n * ps);
+
+			for (int i = 0; i < seq->n; i++)
+				seq->p[i] += (size_t) n * ps;
+		}
+
+		q += (size_t) n * ps;
+		width -= n;
+	}
+
+	return 0;
+}
+
 static int
 vips_composite_base_gen(VipsRegion *output_region,
 	void *vseq, void *a, void *b, gboolean *stop)
@@ -1346,6 +1621,16 @@ vips_composite_base_gen(VipsRegion *output_region,
 		}
 	}
 
+	/* The blend mode for each enabled layer.
+	 */
+	for (int i = 1; i < seq->n; i++) {
+		int *mode = (int *) composite->mode->area.data;
+
+		seq->mode[i - 1] = composite->mode->area.n == 1
+			? mode[0]
+			: mode[seq->enabled[i] - 1];
+	}
+
 	VIPS_GATE_START("vips_composite_base_gen: work");
 
 	for (int y = 0; y < r->height; y++) {
@@ -1359,75 +1644,8 @@ vips_composite_base_gen(VipsRegion *output_region,
 		}
 		q = VIPS_REGION_ADDR(output_region, r->left, r->top + y);
 
-		for (int x = 0; x < r->width; x++) {
-			switch (seq->input_regions[0]->im->BandFmt) {
-			case VIPS_FORMAT_UCHAR:
-#ifdef HAVE_VECTOR_ARITH
-				if (composite->bands == 3)
-					vips_combine_pixels3<unsigned char,
-						0, UCHAR_MAX>(seq, q);
-				else
-#endif
-					vips_combine_pixels<unsigned char,
-						0, UCHAR_MAX>(seq, q);
-				break;
-
-			case VIPS_FORMAT_CHAR:
-				vips_combine_pixels<signed char,
-					SCHAR_MIN, SCHAR_MAX>(seq, q);
-				break;
-
-			case VIPS_FORMAT_USHORT:
-#ifdef HAVE_VECTOR_ARITH
-				if (composite->bands == 3)
-					vips_combine_pixels3<unsigned short,
-						0, USHRT_MAX>(seq, q);
-				else
-#endif
-					vips_combine_pixels<unsigned short,
-						0, USHRT_MAX>(seq, q);
-				break;
-
-			case VIPS_FORMAT_SHORT:
-				vips_combine_pixels<signed short,
-					SHRT_MIN, SHRT_MAX>(seq, q);
-				break;
-
-			case VIPS_FORMAT_UINT:
-				vips_combine_pixels<unsigned int,
-					0, UINT_MAX>(seq, q);
-				break;
-
-			case VIPS_FORMAT_INT:
-				vips_combine_pixels<signed int,
-					INT_MIN, INT_MAX>(seq, q);
-				break;
-
-			case VIPS_FORMAT_FLOAT:
-#ifdef HAVE_VECTOR_ARITH
-				if (composite->bands == 3)
-					vips_combine_pixels3<float,
-						0, USHRT_MAX>(seq, q);
-				else
-#endif
-					vips_combine_pixels<float,
-						0, 0>(seq, q);
-				break;
-
-			case VIPS_FORMAT_DOUBLE:
-				vips_combine_pixels<double,
-					0, 0>(seq, q);
-				break;
-
-			default:
-				g_assert_not_reached();
-				return -1;
-			}
-
-			for (int i = 0; i < seq->n; i++)
-				seq->p[i] += ps;
-			q += ps;
-		}
+		if (vips_composite_base_line(seq, q, r->width, ps))
+			return -1;
 	}
 
 	VIPS_GATE_STOP("vips_composite_base_gen: work");
@@ -1475,6 +1693,24 @@ vips_composite_mode_non_separable(VipsBlendMode mode)
 	}
 }
 
+/* Does a mode have a Highway kernel?
+ */
+static gboolean
+vips_composite_mode_hwy(VipsBlendMode mode)
+{
+	switch (mode) {
+	case VIPS_BLEND_MODE_OVER:
+	case VIPS_BLEND_MODE_DEST_OVER:
+	case VIPS_BLEND_MODE_ADD:
+	case VIPS_BLEND_MODE_MULTIPLY:
+	case VIPS_BLEND_MODE_SCREEN:
+		return TRUE;
+
+	default:
+		return FALSE;
+	}
+}
+
 static int
 vips_composite_base_build(VipsObject *object)
 {
@@ -1656,6 +1892,19 @@ vips_composite_base_build(VipsObject *object)
 		return -1;
 	in = format;
 
+	/* Can we use the SIMD path?
+	 */
+	composite->hwy = vips_vector_isenabled() &&
+		composite->bands == 3 &&
+		(in[0]->BandFmt == VIPS_FORMAT_UCHAR ||
+			in[0]->BandFmt == VIPS_FORMAT_USHORT ||
+			in[0]->BandFmt == VIPS_FORMAT_FLOAT);
+	for (int i = 0; i < composite->mode->area.n; i++)
+		if (!vips_composite_mode_hwy((VipsBlendMode) mode[i]))
+			composite->hwy = FALSE;
+	for (int b = 0; b < 4 && composite->hwy; b++)
+		composite->max_band_hwy[b] = composite->max_band[b];
+
 	/* We want locality, so that we only prepare a few subimages each
 	 * time.
 	 */
@@ -1675,6 +1924,17 @@ vips_composite_base_build(VipsObject *object)
 			in, composite))
 		return -1;
 
+	/* If every overlay covers the whole base and everything is
+	 * constant, so is the output.
+	 */
+	gboolean covered = TRUE;
+	for (int i = 1; i < n; i++)
+		if (!vips_rect_includesrect(&composite->subimages[i],
+				&composite->subimages[0]))
+			covered = FALSE;
+	if (covered)
+		vips__image_fold_constant(conversion->out, in);
+
 	return 0;
 }
 
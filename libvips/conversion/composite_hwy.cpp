@@ -0,0 +1,357 @@
+/* Highway kernels for the common composite blend modes.
+ *
+ * 14/10/26
+ * 	- initial implementation
+ */
+
+/*
+
+	This file is part of VIPS.
+
+	VIPS is free software; you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+	02110-1301  USA
+
+ */
+
+/*
+
+	These files are distributed with VIPS - http://www.vips.ecs.soton.ac.uk
+
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /*HAVE_CONFIG_H*/
+#include <glib/gi18n-lib.h>
+
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <cmath>
+
+#include <vips/vips.h>
+#include <vips/vector.h>
+#include <vips/debug.h>
+#include <vips/internal.h>
+
+#include "pconversion.h"
+
+#ifdef HAVE_HWY
+
+#undef HWY_TARGET_INCLUDE
+#define HWY_TARGET_INCLUDE "libvips/conversion/composite_hwy.cpp"
+#include <hwy/foreach_target.h>
+#include <hwy/highway.h>
+
+namespace HWY_NAMESPACE {
+
+using namespace hwy::HWY_NAMESPACE;
+
+using DF32 = ScalableTag<float>;
+using DI32 = ScalableTag<int32_t>;
+constexpr DF32 df32;
+constexpr DI32 di32;
+
+/* Narrow vectors with one lane for each float lane, for loading before a
+ * promote, or storing after a demote.
+ */
+constexpr Rebind<uint8_t, DI32> du8x32;
+constexpr Rebind<uint16_t, DI32> du16x32;
+
+using VF32 = Vec<DF32>;
+
+// Compat for Highway versions < 1.3.0
+#ifndef HWY_LANES_CONSTEXPR
+#define HWY_LANES_CONSTEXPR
+#endif
+
+/* The vector loop only runs on SIMD targets, the caller does any remaining
+ * pixels (or all of them for HWY_SCALAR).
+ */
+#if HWY_TARGET != HWY_SCALAR
+#define VECTOR_LOOP 1
+#else
+#define VECTOR_LOOP 0
+#endif
+
+/* Load N RGBA pixels as four planes of float.
+ */
+HWY_ATTR HWY_INLINE void
+load_rgba(const uint8_t *HWY_RESTRICT p,
+	VF32 &r, VF32 &g, VF32 &b, VF32 &a)
+{
+	Vec<decltype(du8x32)> r8, g8, b8, a8;
+
+	LoadInterleaved4(du8x32, p, r8, g8, b8, a8);
+	r = ConvertTo(df32, PromoteTo(di32, r8));
+	g = ConvertTo(df32, PromoteTo(di32, g8));
+	b = ConvertTo(df32, PromoteTo(di32, b8));
+	a = ConvertTo(df32, PromoteTo(di32, a8));
+}
+
+HWY_ATTR HWY_INLINE void
+load_rgba(const uint16_t *HWY_RESTRICT p,
+	VF32 &r, VF32 &g, VF32 &b, VF32 &a)
+{
+	Vec<decltype(du16x32)> r16, g16, b16, a16;
+
+	LoadInterleaved4(du16x32, p, r16, g16, b16, a16);
+	r = ConvertTo(df32, PromoteTo(di32, r16));
+	g = ConvertTo(df32, PromoteTo(di32, g16));
+	b = ConvertTo(df32, PromoteTo(di32, b16));
+	a = ConvertTo(df32, PromoteTo(di32, a16));
+}
+
+HWY_ATTR HWY_INLINE void
+load_rgba(const float *HWY_RESTRICT p,
+	VF32 &r, VF32 &g, VF32 &b, VF32 &a)
+{
+	LoadInterleaved4(df32, p, r, g, b, a);
+}
+
+/* Store N RGBA pixels. Values have already been clipped to range, and
+ * convert to int truncates, as the scalar path does.
+ */
+HWY_ATTR HWY_INLINE void
+store_rgba(uint8_t *HWY_RESTRICT q, VF32 r, VF32 g, VF32 b, VF32 a)
+{
+	StoreInterleaved4(
+		DemoteTo(du8x32, ConvertTo(di32, r)),
+		DemoteTo(du8x32, ConvertTo(di32, g)),
+		DemoteTo(du8x32, ConvertTo(di32, b)),
+		DemoteTo(du8x32, ConvertTo(di32, a)),
+		du8x32, q);
+}
+
+HWY_ATTR HWY_INLINE void
+store_rgba(uint16_t *HWY_RESTRICT q, VF32 r, VF32 g, VF32 b, VF32 a)
+{
+	StoreInterleaved4(
+		DemoteTo(du16x32, ConvertTo(di32, r)),
+		DemoteTo(du16x32, ConvertTo(di32, g)),
+		DemoteTo(du16x32, ConvertTo(di32, b)),
+		DemoteTo(du16x32, ConvertTo(di32, a)),
+		du16x32, q);
+}
+
+HWY_ATTR HWY_INLINE void
+store_rgba(float *HWY_RESTRICT q, VF32 r, VF32 g, VF32 b, VF32 a)
+{
+	StoreInterleaved4(r, g, b, a, df32, q);
+}
+
+/* Blend one layer of N pixels into B, following
+ * vips_composite_base_blend3() exactly.
+ *
+ * Vectors are sizeless on some targets and can't go into arrays, so we pass
+ * each channel separately.
+ */
+HWY_ATTR HWY_INLINE void
+blend_rgba(int mode, VF32 &Br, VF32 &Bg, VF32 &Bb, VF32 &aB,
+	VF32 Ar, VF32 Ag, VF32 Ab, VF32 aA)
+{
+	const VF32 one = Set(df32, 1.0f);
+
+	switch (mode) {
+	case VIPS_BLEND_MODE_OVER: {
+		const VF32 t1 = Sub(one, aA);
+
+		Br = Add(Ar, Mul(t1, Br));
+		Bg = Add(Ag, Mul(t1, Bg));
+		Bb = Add(Ab, Mul(t1, Bb));
+		aB = Add(aA, Mul(aB, t1));
+	} break;
+
+	case VIPS_BLEND_MODE_DEST_OVER: {
+		const VF32 t1 = Sub(one, aB);
+
+		Br = Add(Br, Mul(t1, Ar));
+		Bg = Add(Bg, Mul(t1, Ag));
+		Bb = Add(Bb, Mul(t1, Ab));
+		aB = Add(aB, Mul(aA, t1));
+	} break;
+
+	case VIPS_BLEND_MODE_ADD:
+		Br = Add(Ar, Br);
+		Bg = Add(Ag, Bg);
+		Bb = Add(Ab, Bb);
+		aB = Min(one, Add(aA, aB));
+		break;
+
+	case VIPS_BLEND_MODE_MULTIPLY:
+	case VIPS_BLEND_MODE_SCREEN: {
+		const VF32 t1 = Sub(one, aB);
+		const VF32 t2 = Sub(one, aA);
+		const VF32 t3 = Mul(aA, aB);
+
+		/* PDF modes: B = t1 * A + t2 * B + t3 * f.
+		 */
+#define PDF_BLEND(A, B) \
+	{ \
+		const VF32 f = mode == VIPS_BLEND_MODE_MULTIPLY \
+			? Mul(A, B) \
+			: Sub(Add(A, B), Mul(A, B)); \
+\
+		B = Add(Add(Mul(t1, A), Mul(t2, B)), Mul(t3, f)); \
+	}
+
+		PDF_BLEND(Ar, Br);
+		PDF_BLEND(Ag, Bg);
+		PDF_BLEND(Ab, Bb);
+
+#undef PDF_BLEND
+
+		aB = Add(aA, Mul(aB, t2));
+	} break;
+
+	default:
+		/* The caller checks the mode set before picking this path.
+		 */
+		break;
+	}
+}
+
+template <typename T>
+HWY_ATTR HWY_INLINE int32_t
+composite_rgba(VipsPel *pout, VipsPel **pin, const int *mode,
+	int32_t n, int32_t width, const float *max_band, int32_t premultiplied,
+	float high)
+{
+	T *HWY_RESTRICT q = (T *) pout;
+	int32_t x = 0;
+
+	if (VECTOR_LOOP) {
+		HWY_LANES_CONSTEXPR int32_t N = Lanes(df32);
+		const VF32 zero = Zero(df32);
+		const VF32 vhigh = Set(df32, high);
+		const VF32 max_r = Set(df32, max_band[0]);
+		const VF32 max_g = Set(df32, max_band[1]);
+		const VF32 max_b = Set(df32, max_band[2]);
+		const VF32 max_a = Set(df32, max_band[3]);
+
+		for (; x + N <= width; x += N) {
+			VF32 Br, Bg, Bb, aB;
+
+			/* Scale the base pixel to 0 - 1.
+			 */
+			load_rgba((const T *) pin[0] + x * 4, Br, Bg, Bb, aB);
+			Br = Div(Br, max_r);
+			Bg = Div(Bg, max_g);
+			Bb = Div(Bb, max_b);
+			aB = Div(aB, max_a);
+
+			if (!premultiplied) {
+				Br = Mul(Br, aB);
+				Bg = Mul(Bg, aB);
+				Bb = Mul(Bb, aB);
+			}
+
+			for (int32_t i = 1; i < n; i++) {
+				VF32 Ar, Ag, Ab, aA;
+
+				load_rgba((const T *) pin[i] + x * 4, Ar, Ag, Ab, aA);
+				Ar = Div(Ar, max_r);
+				Ag = Div(Ag, max_g);
+				Ab = Div(Ab, max_b);
+				aA = Div(aA, max_a);
+
+				if (!premultiplied) {
+					Ar = Mul(Ar, aA);
+					Ag = Mul(Ag, aA);
+					Ab = Mul(Ab, aA);
+				}
+
+				blend_rgba(mode[i - 1], Br, Bg, Bb, aB, Ar, Ag, Ab, aA);
+			}
+
+			/* Unpremultiply, with zero alpha giving zero.
+			 */
+			if (!premultiplied) {
+				const auto transparent = Eq(aB, zero);
+
+				Br = IfThenZeroElse(transparent, Div(Br, aB));
+				Bg = IfThenZeroElse(transparent, Div(Bg, aB));
+				Bb = IfThenZeroElse(transparent, Div(Bb, aB));
+			}
+
+			/* Back to full range, clipping.
+			 */
+			Br = Min(Max(Mul(Br, max_r), zero), vhigh);
+			Bg = Min(Max(Mul(Bg, max_g), zero), vhigh);
+			Bb = Min(Max(Mul(Bb, max_b), zero), vhigh);
+			aB = Min(Max(Mul(aB, max_a), zero), vhigh);
+
+			store_rgba(q + x * 4, Br, Bg, Bb, aB);
+		}
+	}
+
+	return x;
+}
+
+HWY_ATTR int32_t
+vips_composite_uchar_hwy(VipsPel *out, VipsPel **in, const int *mode,
+	int32_t n, int32_t width, const float *max_band, int32_t premultiplied)
+{
+	return composite_rgba<uint8_t>(out, in, mode,
+		n, width, max_band, premultiplied, UCHAR_MAX);
+}
+
+HWY_ATTR int32_t
+vips_composite_ushort_hwy(VipsPel *out, VipsPel **in, const int *mode,
+	int32_t n, int32_t width, const float *max_band, int32_t premultiplied)
+{
+	return composite_rgba<uint16_t>(out, in, mode,
+		n, width, max_band, premultiplied, USHRT_MAX);
+}
+
+/* Float clips to the ushort range, as the RGBA vector path does.
+ */
+HWY_ATTR int32_t
+vips_composite_float_hwy(VipsPel *out, VipsPel **in, const int *mode,
+	int32_t n, int32_t width, const float *max_band, int32_t premultiplied)
+{
+	return composite_rgba<float>(out, in, mode,
+		n, width, max_band, premultiplied, USHRT_MAX);
+}
+
+/* This file is included once per target, and VECTOR_LOOP differs between
+ * them.
+ */
+#undef VECTOR_LOOP
+
+} /*namespace HWY_NAMESPACE*/
+
+#if HWY_ONCE
+HWY_EXPORT(vips_composite_uchar_hwy);
+HWY_EXPORT(vips_composite_ushort_hwy);
+HWY_EXPORT(vips_composite_float_hwy);
+
+/* clang-format off */
+#define DISPATCH_COMPOSITE(NAME) \
+	int \
+	NAME(VipsPel *out, VipsPel **in, const int *mode, \
+		int n, int width, const float *max_band, int premultiplied) \
+	{ \
+		return HWY_DYNAMIC_DISPATCH(NAME)(out, in, mode, \
+			n, width, max_band, premultiplied); \
+	}
+/* clang-format on */
+
+DISPATCH_COMPOSITE(vips_composite_uchar_hwy)
+DISPATCH_COMPOSITE(vips_composite_ushort_hwy)
+DISPATCH_COMPOSITE(vips_composite_float_hwy)
+#endif /*HWY_ONCE*/
+
+#endif /*HAVE_HWY*/
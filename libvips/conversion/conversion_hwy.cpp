@@ -0,0 +1,1160 @@
+/* Highway kernels for cast, premultiply, unpremultiply, flatten, recomb,
+ * band extract and join, and ifthenelse.
+ *
+ * 15/10/26
+ * 	- initial implementation
+ * 	- add planar extract_band and bandjoin
+ * 	- extract_band and bandjoin do several bands, eg. RGB <-> RGBA
+ * 	- add pixel reverse for embed
+ * 	- add ifthenelse select and blend
+ */
+
+/*
+
+	This file is part of VIPS.
+
+	VIPS is free software; you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+	02110-1301  USA
+
+ */
+
+/*
+
+	These files are distributed with VIPS - http://www.vips.ecs.soton.ac.uk
+
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /*HAVE_CONFIG_H*/
+#include <glib/gi18n-lib.h>
+
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <climits>
+#include <cmath>
+
+#include <vips/vips.h>
+#include <vips/vector.h>
+#include <vips/debug.h>
+#include <vips/internal.h>
+
+#include "pconversion.h"
+
+#ifdef HAVE_HWY
+
+#undef HWY_TARGET_INCLUDE
+#define HWY_TARGET_INCLUDE "libvips/conversion/conversion_hwy.cpp"
+#include <hwy/foreach_target.h>
+#include <hwy/highway.h>
+
+namespace HWY_NAMESPACE {
+
+using namespace hwy::HWY_NAMESPACE;
+
+using DF32 = ScalableTag<float>;
+using DI32 = ScalableTag<int32_t>;
+constexpr DF32 df32;
+constexpr DI32 di32;
+
+/* Narrow vectors with one lane for each 32-bit lane, for loading before a
+ * promote, or storing after a demote.
+ */
+constexpr Rebind<uint8_t, DI32> du8x32;
+constexpr Rebind<uint16_t, DI32> du16x32;
+
+using VF32 = Vec<DF32>;
+
+// Compat for Highway versions < 1.3.0
+#ifndef HWY_LANES_CONSTEXPR
+#define HWY_LANES_CONSTEXPR
+#endif
+
+/* The vector loops only run on SIMD targets, the scalar tail handles any
+ * remaining elements (or all of them for HWY_SCALAR).
+ */
+#if HWY_TARGET != HWY_SCALAR
+#define VECTOR_LOOP 1
+#else
+#define VECTOR_LOOP 0
+#endif
+
+HWY_ATTR HWY_INLINE VF32
+load_float(const uint8_t *HWY_RESTRICT p)
+{
+	return ConvertTo(df32, PromoteTo(di32, LoadU(du8x32, p)));
+}
+
+HWY_ATTR HWY_INLINE VF32
+load_float(const uint16_t *HWY_RESTRICT p)
+{
+	return ConvertTo(df32, PromoteTo(di32, LoadU(du16x32, p)));
+}
+
+HWY_ATTR HWY_INLINE VF32
+load_float(const float *HWY_RESTRICT p)
+{
+	return LoadU(df32, p);
+}
+
+/* Load N RGBA pixels as four planes of float.
+ */
+HWY_ATTR HWY_INLINE void
+load_rgba(const uint8_t *HWY_RESTRICT p,
+	VF32 &r, VF32 &g, VF32 &b, VF32 &a)
+{
+	Vec<decltype(du8x32)> r8, g8, b8, a8;
+
+	LoadInterleaved4(du8x32, p, r8, g8, b8, a8);
+	r = ConvertTo(df32, PromoteTo(di32, r8));
+	g = ConvertTo(df32, PromoteTo(di32, g8));
+	b = ConvertTo(df32, PromoteTo(di32, b8));
+	a = ConvertTo(df32, PromoteTo(di32, a8));
+}
+
+HWY_ATTR HWY_INLINE void
+load_rgba(const uint16_t *HWY_RESTRICT p,
+	VF32 &r, VF32 &g, VF32 &b, VF32 &a)
+{
+	Vec<decltype(du16x32)> r16, g16, b16, a16;
+
+	LoadInterleaved4(du16x32, p, r16, g16, b16, a16);
+	r = ConvertTo(df32, PromoteTo(di32, r16));
+	g = ConvertTo(df32, PromoteTo(di32, g16));
+	b = ConvertTo(df32, PromoteTo(di32, b16));
+	a = ConvertTo(df32, PromoteTo(di32, a16));
+}
+
+HWY_ATTR HWY_INLINE void
+load_rgba(const float *HWY_RESTRICT p,
+	VF32 &r, VF32 &g, VF32 &b, VF32 &a)
+{
+	LoadInterleaved4(df32, p, r, g, b, a);
+}
+
+/* Widen to float. This is exact, so no rounding issues.
+ */
+template <typename T>
+HWY_ATTR HWY_INLINE void
+cast_float(float *HWY_RESTRICT q, const T *HWY_RESTRICT p, int32_t n)
+{
+	HWY_LANES_CONSTEXPR int32_t N = Lanes(df32);
+
+	int32_t x = 0;
+
+	if (VECTOR_LOOP)
+		for (; x + N <= n; x += N)
+			StoreU(load_float(p + x), df32, q + x);
+
+	for (; x < n; x++)
+		q[x] = p[x];
+}
+
+HWY_ATTR void
+vips_cast_uchar_float_hwy(float *HWY_RESTRICT q,
+	const uint8_t *HWY_RESTRICT p, int32_t n)
+{
+	cast_float(q, p, n);
+}
+
+HWY_ATTR void
+vips_cast_ushort_float_hwy(float *HWY_RESTRICT q,
+	const uint16_t *HWY_RESTRICT p, int32_t n)
+{
+	cast_float(q, p, n);
+}
+
+/* Clip to range, then truncate towards zero, as CAST_FLOAT_INT in cast.c.
+ */
+HWY_ATTR void
+vips_cast_float_uchar_hwy(uint8_t *HWY_RESTRICT q,
+	const float *HWY_RESTRICT p, int32_t n)
+{
+	HWY_LANES_CONSTEXPR int32_t N = Lanes(df32);
+	const auto zero = Zero(df32);
+	const auto max = Set(df32, UCHAR_MAX);
+
+	int32_t x = 0;
+
+	if (VECTOR_LOOP)
+		for (; x + N <= n; x += N) {
+			auto v = Min(Max(LoadU(df32, p + x), zero), max);
+
+			StoreU(DemoteTo(du8x32, ConvertTo(di32, v)), du8x32, q + x);
+		}
+
+	for (; x < n; x++)
+		q[x] = VIPS_CLIP(0, (double) p[x], UCHAR_MAX);
+}
+
+HWY_ATTR void
+vips_cast_float_ushort_hwy(uint16_t *HWY_RESTRICT q,
+	const float *HWY_RESTRICT p, int32_t n)
+{
+	HWY_LANES_CONSTEXPR int32_t N = Lanes(df32);
+	const auto zero = Zero(df32);
+	const auto max = Set(df32, USHRT_MAX);
+
+	int32_t x = 0;
+
+	if (VECTOR_LOOP)
+		for (; x + N <= n; x += N) {
+			auto v = Min(Max(LoadU(df32, p + x), zero), max);
+
+			StoreU(DemoteTo(du16x32, ConvertTo(di32, v)), du16x32, q + x);
+		}
+
+	for (; x < n; x++)
+		q[x] = VIPS_CLIP(0, (double) p[x], USHRT_MAX);
+}
+
+/* Premultiply RGBA to float, as PRE_RGBA in premultiply.c.
+ */
+template <typename T>
+HWY_ATTR HWY_INLINE void
+premultiply_rgba(float *HWY_RESTRICT q, const T *HWY_RESTRICT p,
+	int32_t width, double max_alpha)
+{
+	HWY_LANES_CONSTEXPR int32_t N = Lanes(df32);
+	const auto zero = Zero(df32);
+	const auto max = Set(df32, static_cast<float>(max_alpha));
+
+	int32_t x = 0;
+
+	if (VECTOR_LOOP)
+		for (; x + N <= width; x += N) {
+			VF32 r, g, b, a;
+
+			load_rgba(p + x * 4, r, g, b, a);
+			auto nalpha = Div(Min(Max(a, zero), max), max);
+			StoreInterleaved4(Mul(r, nalpha), Mul(g, nalpha),
+				Mul(b, nalpha), a, df32, q + x * 4);
+		}
+
+	for (; x < width; x++) {
+		const T *HWY_RESTRICT p1 = p + x * 4;
+		float *HWY_RESTRICT q1 = q + x * 4;
+		T alpha = p1[3];
+		T clip_alpha = VIPS_CLIP(0, alpha, max_alpha);
+		float nalpha = (float) clip_alpha / max_alpha;
+
+		q1[0] = p1[0] * nalpha;
+		q1[1] = p1[1] * nalpha;
+		q1[2] = p1[2] * nalpha;
+		q1[3] = alpha;
+	}
+}
+
+HWY_ATTR void
+vips_premultiply_uchar_hwy(float *HWY_RESTRICT q,
+	const uint8_t *HWY_RESTRICT p, int32_t width, double max_alpha)
+{
+	premultiply_rgba(q, p, width, max_alpha);
+}
+
+HWY_ATTR void
+vips_premultiply_ushort_hwy(float *HWY_RESTRICT q,
+	const uint16_t *HWY_RESTRICT p, int32_t width, double max_alpha)
+{
+	premultiply_rgba(q, p, width, max_alpha);
+}
+
+HWY_ATTR void
+vips_premultiply_float_hwy(float *HWY_RESTRICT q,
+	const float *HWY_RESTRICT p, int32_t width, double max_alpha)
+{
+	premultiply_rgba(q, p, width, max_alpha);
+}
+
+/* Unpremultiply float RGBA, as FUNPRE_RGBA in unpremultiply.c. Alpha near
+ * zero gives zero. fabs(alpha) < 0.01 in double is the same as
+ * fabs(alpha) <= 0.01f in float.
+ */
+HWY_ATTR void
+vips_unpremultiply_float_hwy(float *HWY_RESTRICT q,
+	const float *HWY_RESTRICT p, int32_t width, double max_alpha)
+{
+	HWY_LANES_CONSTEXPR int32_t N = Lanes(df32);
+	const auto zero = Zero(df32);
+	const auto max = Set(df32, static_cast<float>(max_alpha));
+	const auto threshold = Set(df32, 0.01f);
+
+	int32_t x = 0;
+
+	if (VECTOR_LOOP)
+		for (; x + N <= width; x += N) {
+			VF32 r, g, b, a;
+
+			load_rgba(p + x * 4, r, g, b, a);
+			auto factor = IfThenZeroElse(Le(Abs(a), threshold),
+				Div(max, a));
+			StoreInterleaved4(Mul(factor, r), Mul(factor, g),
+				Mul(factor, b), Min(Max(a, zero), max),
+				df32, q + x * 4);
+		}
+
+	for (; x < width; x++) {
+		const float *HWY_RESTRICT p1 = p + x * 4;
+		float *HWY_RESTRICT q1 = q + x * 4;
+		float alpha = p1[3];
+		float factor = fabs(alpha) < 0.01 ? 0 : max_alpha / alpha;
+
+		q1[0] = factor * p1[0];
+		q1[1] = factor * p1[1];
+		q1[2] = factor * p1[2];
+		q1[3] = VIPS_CLIP(0, alpha, max_alpha);
+	}
+}
+
+/* Flatten uchar RGBA against a background, as the LUT paths in flatten.c.
+ * With max_alpha 255, float division gives the same factors as the LUT.
+ * A black background gives exactly p * alpha.
+ */
+HWY_ATTR void
+vips_flatten_uchar_hwy(uint8_t *HWY_RESTRICT q,
+	const uint8_t *HWY_RESTRICT p, int32_t width,
+	const uint8_t *HWY_RESTRICT bg)
+{
+	HWY_LANES_CONSTEXPR int32_t N = Lanes(df32);
+	const auto max = Set(df32, 255.0f);
+	const auto bg_r = Set(df32, bg[0]);
+	const auto bg_g = Set(df32, bg[1]);
+	const auto bg_b = Set(df32, bg[2]);
+
+	int32_t x = 0;
+
+	if (VECTOR_LOOP)
+		for (; x + N <= width; x += N) {
+			VF32 r, g, b, a;
+
+			load_rgba(p + x * 4, r, g, b, a);
+			auto fa = Div(a, max);
+			auto fn = Div(Sub(max, a), max);
+			r = Add(Mul(r, fa), Mul(bg_r, fn));
+			g = Add(Mul(g, fa), Mul(bg_g, fn));
+			b = Add(Mul(b, fa), Mul(bg_b, fn));
+			StoreInterleaved3(
+				DemoteTo(du8x32, ConvertTo(di32, r)),
+				DemoteTo(du8x32, ConvertTo(di32, g)),
+				DemoteTo(du8x32, ConvertTo(di32, b)),
+				du8x32, q + x * 3);
+		}
+
+	for (; x < width; x++) {
+		const uint8_t *HWY_RESTRICT p1 = p + x * 4;
+		uint8_t *HWY_RESTRICT q1 = q + x * 3;
+		float fa = (float) (p1[3] / 255.0);
+		float fn = (float) ((255.0 - p1[3]) / 255.0);
+
+		q1[0] = p1[0] * fa + bg[0] * fn;
+		q1[1] = p1[1] * fa + bg[1] * fn;
+		q1[2] = p1[2] * fa + bg[2] * fn;
+	}
+}
+
+/* Load N pixels of 3 or 4 bands as planes of float. @c3 is zero for 3 bands.
+ */
+HWY_ATTR HWY_INLINE void
+load_pixels(int bands, const uint8_t *HWY_RESTRICT p,
+	VF32 &c0, VF32 &c1, VF32 &c2, VF32 &c3)
+{
+	if (bands == 3) {
+		Vec<decltype(du8x32)> c08, c18, c28;
+
+		LoadInterleaved3(du8x32, p, c08, c18, c28);
+		c0 = ConvertTo(df32, PromoteTo(di32, c08));
+		c1 = ConvertTo(df32, PromoteTo(di32, c18));
+		c2 = ConvertTo(df32, PromoteTo(di32, c28));
+		c3 = Zero(df32);
+	}
+	else
+		load_rgba(p, c0, c1, c2, c3);
+}
+
+HWY_ATTR HWY_INLINE void
+load_pixels(int bands, const uint16_t *HWY_RESTRICT p,
+	VF32 &c0, VF32 &c1, VF32 &c2, VF32 &c3)
+{
+	if (bands == 3) {
+		Vec<decltype(du16x32)> c016, c116, c216;
+
+		LoadInterleaved3(du16x32, p, c016, c116, c216);
+		c0 = ConvertTo(df32, PromoteTo(di32, c016));
+		c1 = ConvertTo(df32, PromoteTo(di32, c116));
+		c2 = ConvertTo(df32, PromoteTo(di32, c216));
+		c3 = Zero(df32);
+	}
+	else
+		load_rgba(p, c0, c1, c2, c3);
+}
+
+HWY_ATTR HWY_INLINE void
+load_pixels(int bands, const float *HWY_RESTRICT p,
+	VF32 &c0, VF32 &c1, VF32 &c2, VF32 &c3)
+{
+	if (bands == 3) {
+		LoadInterleaved3(df32, p, c0, c1, c2);
+		c3 = Zero(df32);
+	}
+	else
+		load_rgba(p, c0, c1, c2, c3);
+}
+
+/* One row of the matrix times a plane of pixels.
+ */
+HWY_ATTR HWY_INLINE VF32
+recomb_row(int mwidth, const float *HWY_RESTRICT m,
+	VF32 c0, VF32 c1, VF32 c2, VF32 c3)
+{
+	auto t = Mul(Set(df32, m[0]), c0);
+	t = MulAdd(Set(df32, m[1]), c1, t);
+	t = MulAdd(Set(df32, m[2]), c2, t);
+	if (mwidth == 4)
+		t = MulAdd(Set(df32, m[3]), c3, t);
+
+	return t;
+}
+
+/* Multiply @width pixels of @mwidth bands by the @mwidth x @mheight matrix
+ * @m, both 3 or 4, accumulating in float.
+ */
+template <typename T>
+HWY_ATTR HWY_INLINE void
+recomb_line(float *HWY_RESTRICT q, const T *HWY_RESTRICT p, int32_t width,
+	int32_t mwidth, int32_t mheight, const float *HWY_RESTRICT m)
+{
+	HWY_LANES_CONSTEXPR int32_t N = Lanes(df32);
+
+	int32_t x = 0;
+
+	if (VECTOR_LOOP)
+		for (; x + N <= width; x += N) {
+			VF32 c0, c1, c2, c3;
+
+			load_pixels(mwidth, p + x * mwidth, c0, c1, c2, c3);
+
+			auto o0 = recomb_row(mwidth, m, c0, c1, c2, c3);
+			auto o1 = recomb_row(mwidth, m + mwidth, c0, c1, c2, c3);
+			auto o2 = recomb_row(mwidth, m + 2 * mwidth, c0, c1, c2, c3);
+
+			if (mheight == 3)
+				StoreInterleaved3(o0, o1, o2, df32, q + x * 3);
+			else {
+				auto o3 = recomb_row(mwidth, m + 3 * mwidth,
+					c0, c1, c2, c3);
+
+				StoreInterleaved4(o0, o1, o2, o3, df32, q + x * 4);
+			}
+		}
+
+	for (; x < width; x++) {
+		const T *HWY_RESTRICT px = p + x * mwidth;
+		float *HWY_RESTRICT qx = q + x * mheight;
+
+		for (int32_t v = 0; v < mheight; v++) {
+			const float *HWY_RESTRICT mv = m + v * mwidth;
+
+			float t = 0.0F;
+			for (int32_t u = 0; u < mwidth; u++)
+				t += mv[u] * px[u];
+
+			qx[v] = t;
+		}
+	}
+}
+
+HWY_ATTR void
+vips_recomb_uchar_hwy(float *HWY_RESTRICT q, const uint8_t *HWY_RESTRICT p,
+	int32_t width, int32_t mwidth, int32_t mheight,
+	const float *HWY_RESTRICT m)
+{
+	recomb_line(q, p, width, mwidth, mheight, m);
+}
+
+HWY_ATTR void
+vips_recomb_ushort_hwy(float *HWY_RESTRICT q, const uint16_t *HWY_RESTRICT p,
+	int32_t width, int32_t mwidth, int32_t mheight,
+	const float *HWY_RESTRICT m)
+{
+	recomb_line(q, p, width, mwidth, mheight, m);
+}
+
+HWY_ATTR void
+vips_recomb_float_hwy(float *HWY_RESTRICT q, const float *HWY_RESTRICT p,
+	int32_t width, int32_t mwidth, int32_t mheight,
+	const float *HWY_RESTRICT m)
+{
+	recomb_line(q, p, width, mwidth, mheight, m);
+}
+
+/* Load N pixels of @bands elements, up to 4, as planes. Unused planes are
+ * left alone.
+ */
+template <class D, typename T>
+HWY_ATTR HWY_INLINE void
+load_bands(D d, const T *HWY_RESTRICT p, int32_t bands,
+	Vec<D> &v0, Vec<D> &v1, Vec<D> &v2, Vec<D> &v3)
+{
+	if (bands == 1)
+		v0 = LoadU(d, p);
+	else if (bands == 2)
+		LoadInterleaved2(d, p, v0, v1);
+	else if (bands == 3)
+		LoadInterleaved3(d, p, v0, v1, v2);
+	else
+		LoadInterleaved4(d, p, v0, v1, v2, v3);
+}
+
+/* Store the first @bands planes as N interleaved pixels.
+ */
+template <class D, typename T>
+HWY_ATTR HWY_INLINE void
+store_bands(D d, T *HWY_RESTRICT q, int32_t bands,
+	Vec<D> v0, Vec<D> v1, Vec<D> v2, Vec<D> v3)
+{
+	if (bands == 1)
+		StoreU(v0, d, q);
+	else if (bands == 2)
+		StoreInterleaved2(v0, v1, d, q);
+	else if (bands == 3)
+		StoreInterleaved3(v0, v1, v2, d, q);
+	else
+		StoreInterleaved4(v0, v1, v2, v3, d, q);
+}
+
+/* Copy @n bands starting at @band out of @width pixels of @bands elements,
+ * eg. one band to a plane, or RGB from RGBA. Bands are just moved, so we can
+ * use unsigned ints of the element size for any format. Elements are 1, 2
+ * or 4 bytes.
+ */
+template <typename T>
+HWY_ATTR HWY_INLINE void
+extract_band_line(T *HWY_RESTRICT q, const T *HWY_RESTRICT p,
+	int32_t width, int32_t bands, int32_t band, int32_t n)
+{
+	const ScalableTag<T> d;
+	HWY_LANES_CONSTEXPR int32_t N = Lanes(d);
+
+	int32_t x = 0;
+
+	if (VECTOR_LOOP &&
+		bands <= 4) {
+		auto v0 = Zero(d), v1 = Zero(d), v2 = Zero(d), v3 = Zero(d);
+
+		for (; x + N <= width; x += N) {
+			load_bands(d, p + x * bands, bands, v0, v1, v2, v3);
+
+			/* Shift the bands we want down to v0.
+			 */
+			if (band == 1) {
+				v0 = v1;
+				v1 = v2;
+				v2 = v3;
+			}
+			else if (band == 2) {
+				v0 = v2;
+				v1 = v3;
+			}
+			else if (band == 3)
+				v0 = v3;
+
+			store_bands(d, q + x * n, n, v0, v1, v2, v3);
+		}
+	}
+
+	for (; x < width; x++)
+		for (int32_t i = 0; i < n; i++)
+			q[x * n + i] = p[x * bands + band + i];
+}
+
+/* Interleave @n lines of @width pixels, where line i has @bands[i]
+ * elements per pixel. The vector paths do up to four one-band planes, or
+ * a pair of images with up to four bands between them, eg. RGB plus alpha.
+ */
+template <typename T>
+HWY_ATTR HWY_INLINE void
+bandjoin_line(T *HWY_RESTRICT q, const T **HWY_RESTRICT p,
+	int32_t width, int32_t n, const int32_t *HWY_RESTRICT bands)
+{
+	const ScalableTag<T> d;
+	HWY_LANES_CONSTEXPR int32_t N = Lanes(d);
+
+	int32_t total;
+	int32_t x = 0;
+
+	total = 0;
+	for (int32_t i = 0; i < n; i++)
+		total += bands[i];
+
+	if (VECTOR_LOOP &&
+		total == n) {
+		if (n == 2)
+			for (; x + N <= width; x += N)
+				StoreInterleaved2(LoadU(d, p[0] + x),
+					LoadU(d, p[1] + x),
+					d, q + x * 2);
+		else if (n == 3)
+			for (; x + N <= width; x += N)
+				StoreInterleaved3(LoadU(d, p[0] + x),
+					LoadU(d, p[1] + x),
+					LoadU(d, p[2] + x),
+					d, q + x * 3);
+		else if (n == 4)
+			for (; x + N <= width; x += N)
+				StoreInterleaved4(LoadU(d, p[0] + x),
+					LoadU(d, p[1] + x),
+					LoadU(d, p[2] + x),
+					LoadU(d, p[3] + x),
+					d, q + x * 4);
+	}
+	else if (VECTOR_LOOP &&
+		n == 2 &&
+		total <= 4) {
+		const int32_t b0 = bands[0];
+		const int32_t b1 = bands[1];
+
+		auto v0 = Zero(d), v1 = Zero(d), v2 = Zero(d), v3 = Zero(d);
+		auto v4 = Zero(d), v5 = Zero(d), v6 = Zero(d), v7 = Zero(d);
+
+		for (; x + N <= width; x += N) {
+			load_bands(d, p[0] + x * b0, b0, v0, v1, v2, v3);
+			load_bands(d, p[1] + x * b1, b1, v4, v5, v6, v7);
+
+			/* Pack the second image's bands up against the
+			 * first's.
+			 */
+			if (b0 == 1) {
+				v1 = v4;
+				v2 = v5;
+				v3 = v6;
+			}
+			else if (b0 == 2) {
+				v2 = v4;
+				v3 = v5;
+			}
+			else
+				v3 = v4;
+
+			store_bands(d, q + x * total, total, v0, v1, v2, v3);
+		}
+	}
+
+	for (; x < width; x++) {
+		T *HWY_RESTRICT q1 = q + x * total;
+
+		for (int32_t i = 0; i < n; i++)
+			for (int32_t z = 0; z < bands[i]; z++)
+				*q1++ = p[i][x * bands[i] + z];
+	}
+}
+
+HWY_ATTR void
+vips_extract_band_hwy(VipsPel *HWY_RESTRICT q, const VipsPel *HWY_RESTRICT p,
+	int32_t width, int32_t bands, int32_t band, int32_t n, int32_t es)
+{
+	switch (es) {
+	case 1:
+		extract_band_line(q, p, width, bands, band, n);
+		break;
+
+	case 2:
+		extract_band_line((uint16_t *) q, (const uint16_t *) p,
+			width, bands, band, n);
+		break;
+
+	case 4:
+		extract_band_line((uint32_t *) q, (const uint32_t *) p,
+			width, bands, band, n);
+		break;
+
+	default:
+		g_assert_not_reached();
+	}
+}
+
+HWY_ATTR void
+vips_bandjoin_hwy(VipsPel *HWY_RESTRICT q, const VipsPel **HWY_RESTRICT p,
+	int32_t width, int32_t n, const int32_t *HWY_RESTRICT bands, int32_t es)
+{
+	switch (es) {
+	case 1:
+		bandjoin_line(q, p, width, n, bands);
+		break;
+
+	case 2:
+		bandjoin_line((uint16_t *) q, (const uint16_t **) p,
+			width, n, bands);
+		break;
+
+	case 4:
+		bandjoin_line((uint32_t *) q, (const uint32_t **) p,
+			width, n, bands);
+		break;
+
+	default:
+		g_assert_not_reached();
+	}
+}
+
+/* Reverse the order of @n pixels of @B elements of type T, so q[x] is
+ * p[n - 1 - x]. Return the number of pixels done, the caller does the rest.
+ */
+template <typename T, int B>
+HWY_ATTR HWY_INLINE int32_t
+reverse_line(T *HWY_RESTRICT q, const T *HWY_RESTRICT p, int32_t n)
+{
+	const ScalableTag<T> d;
+	HWY_LANES_CONSTEXPR int32_t N = Lanes(d);
+
+	int32_t x = 0;
+
+	if (VECTOR_LOOP) {
+		auto v0 = Zero(d), v1 = Zero(d), v2 = Zero(d), v3 = Zero(d);
+
+		for (; x + N <= n; x += N) {
+			const T *HWY_RESTRICT p1 = p + (n - x - N) * B;
+
+			load_bands(d, p1, B, v0, v1, v2, v3);
+			store_bands(d, q + x * B, B,
+				Reverse(d, v0), Reverse(d, v1),
+				Reverse(d, v2), Reverse(d, v3));
+		}
+	}
+
+	return x;
+}
+
+HWY_ATTR int32_t
+vips_reverse_hwy(VipsPel *HWY_RESTRICT q, const VipsPel *HWY_RESTRICT p,
+	int32_t n, int32_t ps)
+{
+	switch (ps) {
+	case 1:
+		return reverse_line<uint8_t, 1>(q, p, n);
+
+	case 2:
+		return reverse_line<uint16_t, 1>((uint16_t *) q,
+			(const uint16_t *) p, n);
+
+	case 3:
+		return reverse_line<uint8_t, 3>(q, p, n);
+
+	case 4:
+		return reverse_line<uint32_t, 1>((uint32_t *) q,
+			(const uint32_t *) p, n);
+
+	case 6:
+		return reverse_line<uint16_t, 3>((uint16_t *) q,
+			(const uint16_t *) p, n);
+
+	case 8:
+		return reverse_line<uint64_t, 1>((uint64_t *) q,
+			(const uint64_t *) p, n);
+
+	case 12:
+		return reverse_line<uint32_t, 3>((uint32_t *) q,
+			(const uint32_t *) p, n);
+
+	case 16:
+		return reverse_line<uint32_t, 4>((uint32_t *) q,
+			(const uint32_t *) p, n);
+
+	case 24:
+		return reverse_line<uint64_t, 3>((uint64_t *) q,
+			(const uint64_t *) p, n);
+
+	case 32:
+		return reverse_line<uint64_t, 4>((uint64_t *) q,
+			(const uint64_t *) p, n);
+
+	default:
+		return 0;
+	}
+}
+
+/* A mask of the non-zero elements of @c, a uchar condition image, with a
+ * lane for each lane of @d.
+ */
+HWY_ATTR HWY_INLINE Mask<ScalableTag<uint8_t>>
+cond_mask(ScalableTag<uint8_t> d, const uint8_t *HWY_RESTRICT c)
+{
+	return Ne(LoadU(d, c), Zero(d));
+}
+
+template <class D>
+HWY_ATTR HWY_INLINE Mask<D>
+cond_mask(D d, const uint8_t *HWY_RESTRICT c)
+{
+	const Rebind<uint8_t, D> d8;
+
+	return Ne(PromoteTo(d, LoadU(d8, c)), Zero(d));
+}
+
+/* Pick @n elements from @a where @c is non-zero, @b otherwise. We just move
+ * bits, so unsigned ints of the element size do for any format.
+ */
+template <typename T>
+HWY_ATTR HWY_INLINE int32_t
+ifthenelse_line(T *HWY_RESTRICT q, const uint8_t *HWY_RESTRICT c,
+	const T *HWY_RESTRICT a, const T *HWY_RESTRICT b, int32_t n)
+{
+	const ScalableTag<T> d;
+	HWY_LANES_CONSTEXPR int32_t N = Lanes(d);
+
+	int32_t x = 0;
+
+	if (VECTOR_LOOP)
+		for (; x + N <= n; x += N)
+			StoreU(IfThenElse(cond_mask(d, c + x),
+				LoadU(d, a + x), LoadU(d, b + x)), d, q + x);
+
+	return x;
+}
+
+HWY_ATTR int32_t
+vips_ifthenelse_hwy(VipsPel *HWY_RESTRICT q, const VipsPel *HWY_RESTRICT c,
+	const VipsPel *HWY_RESTRICT a, const VipsPel *HWY_RESTRICT b,
+	int32_t n, int32_t es)
+{
+	switch (es) {
+	case 1:
+		return ifthenelse_line(q, c, a, b, n);
+
+	case 2:
+		return ifthenelse_line((uint16_t *) q, c,
+			(const uint16_t *) a, (const uint16_t *) b, n);
+
+	case 4:
+		return ifthenelse_line((uint32_t *) q, c,
+			(const uint32_t *) a, (const uint32_t *) b, n);
+
+	default:
+		return 0;
+	}
+}
+
+/* Blend uchar in 16 bits. (v * a + (255 - v) * b + 128) is at most 65153,
+ * and (x + 1 + (x >> 8)) >> 8 is exactly x / 255 over that range, so we
+ * match the C path bit for bit.
+ */
+HWY_ATTR HWY_INLINE int32_t
+blend_uchar_line(uint8_t *HWY_RESTRICT q, const uint8_t *HWY_RESTRICT c,
+	const uint8_t *HWY_RESTRICT a, const uint8_t *HWY_RESTRICT b, int32_t n)
+{
+	const ScalableTag<uint16_t> du16;
+	const Rebind<uint8_t, decltype(du16)> du8;
+	HWY_LANES_CONSTEXPR int32_t N = Lanes(du16);
+
+	int32_t x = 0;
+
+	if (VECTOR_LOOP) {
+		const auto v0 = Zero(du16);
+		const auto v255 = Set(du16, 255);
+		const auto v128 = Set(du16, 128);
+		const auto v1 = Set(du16, 1);
+
+		for (; x + N <= n; x += N) {
+			const auto v = PromoteTo(du16, LoadU(du8, c + x));
+
+			/* Spans of all then or all else are just a copy.
+			 */
+			if (AllTrue(du16, Eq(v, v255)))
+				StoreU(LoadU(du8, a + x), du8, q + x);
+			else if (AllTrue(du16, Eq(v, v0)))
+				StoreU(LoadU(du8, b + x), du8, q + x);
+			else {
+				const auto pa = PromoteTo(du16, LoadU(du8, a + x));
+				const auto pb = PromoteTo(du16, LoadU(du8, b + x));
+				const auto t = Add(Add(Mul(v, pa),
+					Mul(Sub(v255, v), pb)), v128);
+				const auto r = ShiftRight<8>(Add(Add(t, v1),
+					ShiftRight<8>(t)));
+
+				StoreU(DemoteTo(du8, r), du8, q + x);
+			}
+		}
+	}
+
+	return x;
+}
+
+/* Blend ushort in float. All the products and sums are integers below
+ * 2^24, so they are exact, and a correctly rounded divide by 255 never
+ * rounds up to the next integer, so truncating matches the C path.
+ */
+HWY_ATTR HWY_INLINE int32_t
+blend_ushort_line(uint16_t *HWY_RESTRICT q, const uint8_t *HWY_RESTRICT c,
+	const uint16_t *HWY_RESTRICT a, const uint16_t *HWY_RESTRICT b,
+	int32_t n)
+{
+	HWY_LANES_CONSTEXPR int32_t N = Lanes(df32);
+
+	int32_t x = 0;
+
+	if (VECTOR_LOOP) {
+		const auto v255 = Set(df32, 255.0f);
+		const auto v128 = Set(df32, 128.0f);
+
+		for (; x + N <= n; x += N) {
+			const auto v = ConvertTo(df32,
+				PromoteTo(di32, LoadU(du8x32, c + x)));
+			const auto pa = ConvertTo(df32,
+				PromoteTo(di32, LoadU(du16x32, a + x)));
+			const auto pb = ConvertTo(df32,
+				PromoteTo(di32, LoadU(du16x32, b + x)));
+			const auto t = MulAdd(v, pa,
+				MulAdd(Sub(v255, v), pb, v128));
+			const auto r = ConvertTo(di32, Div(t, v255));
+
+			StoreU(DemoteTo(du16x32, r), du16x32, q + x);
+		}
+	}
+
+	return x;
+}
+
+HWY_ATTR HWY_INLINE int32_t
+blend_float_line(float *HWY_RESTRICT q, const uint8_t *HWY_RESTRICT c,
+	const float *HWY_RESTRICT a, const float *HWY_RESTRICT b, int32_t n)
+{
+	HWY_LANES_CONSTEXPR int32_t N = Lanes(df32);
+
+	int32_t x = 0;
+
+	if (VECTOR_LOOP) {
+		const auto v255 = Set(df32, 255.0f);
+		const auto one = Set(df32, 1.0f);
+
+		for (; x + N <= n; x += N) {
+			const auto v = Div(ConvertTo(df32,
+				PromoteTo(di32, LoadU(du8x32, c + x))), v255);
+			const auto r = MulAdd(v, LoadU(df32, a + x),
+				Mul(Sub(one, v), LoadU(df32, b + x)));
+
+			StoreU(r, df32, q + x);
+		}
+	}
+
+	return x;
+}
+
+HWY_ATTR int32_t
+vips_blend_hwy(VipsPel *HWY_RESTRICT q, const VipsPel *HWY_RESTRICT c,
+	const VipsPel *HWY_RESTRICT a, const VipsPel *HWY_RESTRICT b,
+	int32_t n, int32_t format)
+{
+	switch (format) {
+	case VIPS_FORMAT_UCHAR:
+		return blend_uchar_line(q, c, a, b, n);
+
+	case VIPS_FORMAT_USHORT:
+		return blend_ushort_line((uint16_t *) q, c,
+			(const uint16_t *) a, (const uint16_t *) b, n);
+
+	case VIPS_FORMAT_FLOAT:
+		return blend_float_line((float *) q, c,
+			(const float *) a, (const float *) b, n);
+
+	default:
+		return 0;
+	}
+}
+
+} /*namespace HWY_NAMESPACE*/
+
+#if HWY_ONCE
+HWY_EXPORT(vips_cast_uchar_float_hwy);
+HWY_EXPORT(vips_cast_ushort_float_hwy);
+HWY_EXPORT(vips_cast_float_uchar_hwy);
+HWY_EXPORT(vips_cast_float_ushort_hwy);
+HWY_EXPORT(vips_premultiply_uchar_hwy);
+HWY_EXPORT(vips_premultiply_ushort_hwy);
+HWY_EXPORT(vips_premultiply_float_hwy);
+HWY_EXPORT(vips_unpremultiply_float_hwy);
+HWY_EXPORT(vips_flatten_uchar_hwy);
+HWY_EXPORT(vips_recomb_uchar_hwy);
+HWY_EXPORT(vips_recomb_ushort_hwy);
+HWY_EXPORT(vips_recomb_float_hwy);
+HWY_EXPORT(vips_extract_band_hwy);
+HWY_EXPORT(vips_bandjoin_hwy);
+HWY_EXPORT(vips_reverse_hwy);
+HWY_EXPORT(vips_ifthenelse_hwy);
+HWY_EXPORT(vips_blend_hwy);
+
+void
+vips_cast_uchar_float_hwy(VipsPel *out, VipsPel *in, int n)
+{
+	/* clang-format off */
+	HWY_DYNAMIC_DISPATCH(vips_cast_uchar_float_hwy)((float *) out,
+		(uint8_t *) in, n);
+	/* clang-format on */
+}
+
+void
+vips_cast_ushort_float_hwy(VipsPel *out, VipsPel *in, int n)
+{
+	/* clang-format off */
+	HWY_DYNAMIC_DISPATCH(vips_cast_ushort_float_hwy)((float *) out,
+		(uint16_t *) in, n);
+	/* clang-format on */
+}
+
+void
+vips_cast_float_uchar_hwy(VipsPel *out, VipsPel *in, int n)
+{
+	/* clang-format off */
+	HWY_DYNAMIC_DISPATCH(vips_cast_float_uchar_hwy)((uint8_t *) out,
+		(float *) in, n);
+	/* clang-format on */
+}
+
+void
+vips_cast_float_ushort_hwy(VipsPel *out, VipsPel *in, int n)
+{
+	/* clang-format off */
+	HWY_DYNAMIC_DISPATCH(vips_cast_float_ushort_hwy)((uint16_t *) out,
+		(float *) in, n);
+	/* clang-format on */
+}
+
+void
+vips_premultiply_uchar_hwy(VipsPel *out, VipsPel *in, int width,
+	double max_alpha)
+{
+	/* clang-format off */
+	HWY_DYNAMIC_DISPATCH(vips_premultiply_uchar_hwy)((float *) out,
+		(uint8_t *) in, width, max_alpha);
+	/* clang-format on */
+}
+
+void
+vips_premultiply_ushort_hwy(VipsPel *out, VipsPel *in, int width,
+	double max_alpha)
+{
+	/* clang-format off */
+	HWY_DYNAMIC_DISPATCH(vips_premultiply_ushort_hwy)((float *) out,
+		(uint16_t *) in, width, max_alpha);
+	/* clang-format on */
+}
+
+void
+vips_premultiply_float_hwy(VipsPel *out, VipsPel *in, int width,
+	double max_alpha)
+{
+	/* clang-format off */
+	HWY_DYNAMIC_DISPATCH(vips_premultiply_float_hwy)((float *) out,
+		(float *) in, width, max_alpha);
+	/* clang-format on */
+}
+
+void
+vips_unpremultiply_float_hwy(VipsPel *out, VipsPel *in, int width,
+	double max_alpha)
+{
+	/* clang-format off */
+	HWY_DYNAMIC_DISPATCH(vips_unpremultiply_float_hwy)((float *) out,
+		(float *) in, width, max_alpha);
+	/* clang-format on */
+}
+
+void
+vips_flatten_uchar_hwy(VipsPel *out, VipsPel *in, int width,
+	const VipsPel *bg)
+{
+	/* clang-format off */
+	HWY_DYNAMIC_DISPATCH(vips_flatten_uchar_hwy)((uint8_t *) out,
+		(uint8_t *) in, width, bg);
+	/* clang-format on */
+}
+
+void
+vips_recomb_uchar_hwy(VipsPel *out, VipsPel *in, int width,
+	int mwidth, int mheight, const float *m)
+{
+	/* clang-format off */
+	HWY_DYNAMIC_DISPATCH(vips_recomb_uchar_hwy)((float *) out,
+		(uint8_t *) in, width, mwidth, mheight, m);
+	/* clang-format on */
+}
+
+void
+vips_recomb_ushort_hwy(VipsPel *out, VipsPel *in, int width,
+	int mwidth, int mheight, const float *m)
+{
+	/* clang-format off */
+	HWY_DYNAMIC_DISPATCH(vips_recomb_ushort_hwy)((float *) out,
+		(uint16_t *) in, width, mwidth, mheight, m);
+	/* clang-format on */
+}
+
+void
+vips_recomb_float_hwy(VipsPel *out, VipsPel *in, int width,
+	int mwidth, int mheight, const float *m)
+{
+	/* clang-format off */
+	HWY_DYNAMIC_DISPATCH(vips_recomb_float_hwy)((float *) out,
+		(float *) in, width, mwidth, mheight, m);
+	/* clang-format on */
+}
+
+void
+vips_extract_band_hwy(VipsPel *out, VipsPel *in, int width,
+	int bands, int band, int n, int es)
+{
+	/* clang-format off */
+	HWY_DYNAMIC_DISPATCH(vips_extract_band_hwy)(out, in,
+		width, bands, band, n, es);
+	/* clang-format on */
+}
+
+void
+vips_bandjoin_hwy(VipsPel *out, VipsPel **in, int width,
+	int n, const int *bands, int es)
+{
+	/* clang-format off */
+	HWY_DYNAMIC_DISPATCH(vips_bandjoin_hwy)(out, (const VipsPel **) in,
+		width, n, bands, es);
+	/* clang-format on */
+}
+
+int
+vips_reverse_hwy(VipsPel *out, VipsPel *in, int n, int ps)
+{
+	return HWY_DYNAMIC_DISPATCH(vips_reverse_hwy)(out, in, n, ps);
+}
+
+int
+vips_ifthenelse_hwy(VipsPel *out, VipsPel *c, VipsPel *a, VipsPel *b,
+	int n, int es)
+{
+	/* clang-format off */
+	return HWY_DYNAMIC_DISPATCH(vips_ifthenelse_hwy)(out, c, a, b,
+		n, es);
+	/* clang-format on */
+}
+
+int
+vips_blend_hwy(VipsPel *out, VipsPel *c, VipsPel *a, VipsPel *b,
+	int n, VipsBandFormat format)
+{
+	/* clang-format off */
+	return HWY_DYNAMIC_DISPATCH(vips_blend_hwy)(out, c, a, b,
+		n, format);
+	/* clang-format on */
+}
+#endif /*HWY_ONCE*/
+
+#endif /*HAVE_HWY*/
@@ -54,6 +54,8 @@
  * 5/6/15
  * 	- move byteswap out to vips_byteswap()
  * 	- move band folding out to vips_bandfold()/vips_unfold()
+ * 15/10/26
+ * 	- pass constant images through
  */
 
 /*
@@ -241,6 +243,11 @@ vips_copy_build(VipsObject *object)
 			copy->in, copy))
 		return -1;
 
+	/* Pels are copied unchanged, so a constant stays constant.
+	 */
+	if (copy->in->constant)
+		vips__image_set_constant(conversion->out, copy->in->constant);
+
 	return 0;
 }
 
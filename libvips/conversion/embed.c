@@ -27,6 +27,10 @@
  *	- add @background
  * 19/9/17
  * 	- break into embed and gravity
+ * 15/10/26
+ * 	- embedding a constant image in the same value is constant
+ * 	- copy, repeat and mirror share one edge engine: fetch the input
+ * 	  once per block and make the border a line at a time
  */
 
 /*
@@ -68,9 +72,11 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <limits.h>
 #include <math.h>
 
 #include <vips/vips.h>
+#include <vips/vector.h>
 #include <vips/internal.h>
 #include <vips/debug.h>
 
@@ -112,114 +118,248 @@ typedef VipsConversionClass VipsEmbedBaseClass;
 
 G_DEFINE_ABSTRACT_TYPE(VipsEmbedBase, vips_embed_base, VIPS_TYPE_CONVERSION);
 
-/* r is the bit we are trying to paint, guaranteed to be entirely within
- * border area i. Set out to be the edge of the image we need to paint the
- * pixels in r.
+/* Copy a single pixel sideways into a line of pixels.
  */
 static void
-vips_embed_base_find_edge(VipsEmbedBase *base,
-	VipsRect *r, int i, VipsRect *out)
+vips_embed_base_copy_pixel(VipsEmbedBase *base,
+	VipsPel *q, VipsPel *p, int n)
 {
-	/* Expand the border by 1 pixel, intersect with the image area, and we
-	 * get the edge. Usually too much though: eg. we could make the entire
-	 * right edge.
-	 */
-	*out = base->border[i];
-	vips_rect_marginadjust(out, 1);
-	vips_rect_intersectrect(out, &base->rsub, out);
+	const size_t ps = VIPS_IMAGE_SIZEOF_PEL(base->in);
 
-	/* Usually too much though: eg. we could make the entire
-	 * right edge. If we're strictly up/down/left/right of the image, we
-	 * can trim.
-	 */
-	if (i == 0 ||
-		i == 2) {
-		VipsRect extend;
+	for (int x = 0; x < n; x++) {
+		VIPS_MEMCPY(q, p, ps);
+		q += ps;
+	}
+}
 
-		/* Above or below.
-		 */
-		extend = *r;
-		extend.top = 0;
-		extend.height = base->height;
-		vips_rect_intersectrect(out, &extend, out);
+/* Map @u, an output coordinate relative to the image origin, to an input
+ * coordinate @p for the copy, repeat and mirror extend modes. Return the
+ * direction we move through the input as @u increases: 1 forward, -1
+ * backward (the mirrored half), or 0 for a repeated edge pixel (copy).
+ * @n is set to the number of steps before that changes.
+ */
+static int
+vips_embed_base_map(VipsExtend extend, int u, int size, int *p, int *n)
+{
+	int m;
+
+	switch (extend) {
+	case VIPS_EXTEND_COPY:
+		if (u < 0) {
+			*p = 0;
+			*n = -u;
+			return 0;
+		}
+		else if (u >= size) {
+			*p = size - 1;
+			*n = INT_MAX;
+			return 0;
+		}
+		else {
+			*p = u;
+			*n = size - u;
+			return 1;
+		}
+
+	case VIPS_EXTEND_REPEAT:
+		m = u % size;
+		if (m < 0)
+			m += size;
+
+		*p = m;
+		*n = size - m;
+		return 1;
+
+	case VIPS_EXTEND_MIRROR:
+		m = u % (2 * size);
+		if (m < 0)
+			m += 2 * size;
+
+		if (m < size) {
+			*p = m;
+			*n = size - m;
+			return 1;
+		}
+		else {
+			*p = 2 * size - 1 - m;
+			*n = 2 * size - m;
+			return -1;
+		}
+
+	default:
+		g_assert_not_reached();
+		return 0;
 	}
-	if (i == 1 ||
-		i == 3) {
-		VipsRect extend;
+}
 
-		/* Left or right.
-		 */
-		extend = *r;
-		extend.left = 0;
-		extend.width = base->width;
-		vips_rect_intersectrect(out, &extend, out);
+/* Find the run of output coordinates from @start (and before @end) whose
+ * input pixels are a single span, and set @lo and @hi to the ends of that
+ * span. Copy and mirror always fold back onto one span, repeat breaks
+ * where the input wraps around.
+ */
+static int
+vips_embed_base_span(VipsEmbedBase *base,
+	int origin, int size, int start, int end, int *lo, int *hi)
+{
+	int u;
+
+	*lo = INT_MAX;
+	*hi = INT_MIN;
+	for (u = start; u < end;) {
+		int p, n, dir;
+		int a, b;
+
+		dir = vips_embed_base_map(base->extend, u - origin, size, &p, &n);
+		n = VIPS_MIN(n, end - u);
+		if (dir == 1) {
+			a = p;
+			b = p + n - 1;
+		}
+		else if (dir == -1) {
+			a = p - n + 1;
+			b = p;
+		}
+		else {
+			a = p;
+			b = p;
+		}
+
+		if (u > start &&
+			(b < *lo - 1 ||
+				a > *hi + 1))
+			break;
+
+		*lo = VIPS_MIN(*lo, a);
+		*hi = VIPS_MAX(*hi, b);
+		u += n;
 	}
+
+	return u - start;
 }
 
-/* Copy a single pixel sideways into a line of pixels.
+/* Reverse the order of @n pixels.
  */
 static void
-vips_embed_base_copy_pixel(VipsEmbedBase *base,
-	VipsPel *q, VipsPel *p, int n)
+vips_embed_base_reverse(VipsEmbedBase *base, VipsPel *q, VipsPel *p, int n)
 {
 	const size_t ps = VIPS_IMAGE_SIZEOF_PEL(base->in);
 
-	for (int x = 0; x < n; x++) {
-		VIPS_MEMCPY(q, p, ps);
-		q += ps;
-	}
+	int x;
+
+	x = 0;
+#ifdef HAVE_HWY
+	if (vips_vector_isenabled())
+		x = vips_reverse_hwy(q, p, n, ps);
+#endif /*HAVE_HWY*/
+
+	for (; x < n; x++)
+		VIPS_MEMCPY(q + x * ps, p + (n - 1 - x) * ps, ps);
 }
 
-/* Paint r of region or. It's a border area, lying entirely within
- * base->border[i]. p points to the top-left source pixel to fill with.
- * plsk is the line stride.
+/* Make @width pixels of output line @q, starting at output column @left,
+ * from line @y of @ir.
  */
 static void
-vips_embed_base_paint_edge(VipsEmbedBase *base,
-	VipsRegion *out_region, int i, VipsRect *r, VipsPel *p, int plsk)
+vips_embed_base_extend_line(VipsEmbedBase *base,
+	VipsRegion *ir, int y, VipsPel *q, int left, int width)
 {
-	const int bs = VIPS_IMAGE_SIZEOF_PEL(base->in);
+	const size_t ps = VIPS_IMAGE_SIZEOF_PEL(base->in);
 
-	VipsRect todo;
-	VipsPel *q;
+	int x;
 
-	VIPS_GATE_START("vips_embed_base_paint_edge: work");
+	for (x = 0; x < width;) {
+		int p, n, dir;
 
-	/* Pixels left to paint.
-	 */
-	todo = *r;
+		dir = vips_embed_base_map(base->extend,
+			left + x - base->x, base->in->Xsize, &p, &n);
+		n = VIPS_MIN(n, width - x);
 
-	/* Corner pieces ... copy the single pixel to paint the top line of
-	 * todo, then use the line copier below to paint the rest of it.
-	 */
-	if (i > 3) {
-		q = VIPS_REGION_ADDR(out_region, todo.left, todo.top);
-		vips_embed_base_copy_pixel(base, q, p, todo.width);
+		if (dir == 1)
+			memcpy(q, VIPS_REGION_ADDR(ir, p, y), n * ps);
+		else if (dir == -1)
+			vips_embed_base_reverse(base,
+				q, VIPS_REGION_ADDR(ir, p - n + 1, y), n);
+		else
+			vips_embed_base_copy_pixel(base,
+				q, VIPS_REGION_ADDR(ir, p, y), n);
 
-		p = q;
-		todo.top += 1;
-		todo.height -= 1;
+		q += n * ps;
+		x += n;
 	}
+}
 
-	if (i == 1 || i == 3) {
-		/* Vertical line of pixels to copy.
-		 */
-		for (int y = 0; y < todo.height; y++) {
-			q = VIPS_REGION_ADDR(out_region, todo.left, todo.top + y);
-			vips_embed_base_copy_pixel(base, q, p, todo.width);
-			p += plsk;
-		}
-	}
-	else {
-		/* Horizontal line of pixels to copy.
-		 */
-		for (int y = 0; y < todo.height; y++) {
-			q = VIPS_REGION_ADDR(out_region, todo.left, todo.top + y);
-			memcpy(q, p, (size_t) bs * todo.width);
+/* Make r for the copy, repeat and mirror modes. We split r into blocks
+ * which each need a single span of input, fetch that once, then make the
+ * block a line at a time. Only repeat ever needs more than one block per
+ * tile, and only where the input wraps around.
+ */
+static int
+vips_embed_base_extend(VipsEmbedBase *base,
+	VipsRegion *out_region, VipsRegion *ir)
+{
+	const size_t ps = VIPS_IMAGE_SIZEOF_PEL(base->in);
+	VipsRect *r = &out_region->valid;
+
+	VipsRect block;
+	VipsRect need;
+	int lo, hi;
+
+	VIPS_GATE_START("vips_embed_base_extend: work");
+
+	for (block.top = r->top;
+		 block.top < VIPS_RECT_BOTTOM(r);
+		 block.top += block.height) {
+		block.height = vips_embed_base_span(base,
+			base->y, base->in->Ysize,
+			block.top, VIPS_RECT_BOTTOM(r), &lo, &hi);
+		need.top = lo;
+		need.height = hi - lo + 1;
+
+		for (block.left = r->left;
+			 block.left < VIPS_RECT_RIGHT(r);
+			 block.left += block.width) {
+			int prev;
+
+			block.width = vips_embed_base_span(base,
+				base->x, base->in->Xsize,
+				block.left, VIPS_RECT_RIGHT(r), &lo, &hi);
+			need.left = lo;
+			need.width = hi - lo + 1;
+
+			if (vips_region_prepare(ir, &need)) {
+				VIPS_GATE_STOP("vips_embed_base_extend: work");
+				return -1;
+			}
+
+			prev = -1;
+			for (int y = 0; y < block.height; y++) {
+				VipsPel *q = VIPS_REGION_ADDR(out_region,
+					block.left, block.top + y);
+
+				int p, n;
+
+				vips_embed_base_map(base->extend,
+					block.top + y - base->y, base->in->Ysize,
+					&p, &n);
+
+				/* Copy and mirror often repeat an input line,
+				 * we can just copy the line we made before.
+				 */
+				if (p == prev)
+					memcpy(q, q - VIPS_REGION_LSKIP(out_region),
+						block.width * ps);
+				else
+					vips_embed_base_extend_line(base, ir, p,
+						q, block.left, block.width);
+
+				prev = p;
+			}
 		}
 	}
 
-	VIPS_GATE_STOP("vips_embed_base_paint_edge: work");
+	VIPS_GATE_STOP("vips_embed_base_extend: work");
+
+	return 0;
 }
 
 static int
@@ -231,8 +371,6 @@ vips_embed_base_gen(VipsRegion *out_region,
 	VipsRect *r = &out_region->valid;
 
 	VipsRect ovl;
-	VipsPel *p;
-	int plsk;
 	int ink;
 
 	/* Entirely within the input image? Generate the subimage and copy
@@ -251,6 +389,11 @@ vips_embed_base_gen(VipsRegion *out_region,
 		return 0;
 	}
 
+	if (base->extend == VIPS_EXTEND_COPY ||
+		base->extend == VIPS_EXTEND_REPEAT ||
+		base->extend == VIPS_EXTEND_MIRROR)
+		return vips_embed_base_extend(base, out_region, ir);
+
 	/* Does any of the input image appear in the area we have been asked
 	 * to make? Paste it in.
 	 */
@@ -297,44 +440,6 @@ vips_embed_base_gen(VipsRegion *out_region,
 
 		break;
 
-	case VIPS_EXTEND_COPY:
-		/* Extend the borders.
-		 */
-		for (int i = 0; i < 8; i++) {
-			VipsRect todo;
-			VipsRect edge;
-
-			vips_rect_intersectrect(r, &base->border[i], &todo);
-			if (!vips_rect_isempty(&todo)) {
-				vips_embed_base_find_edge(base,
-					&todo, i, &edge);
-
-				/* Did we paint any of the input image? If we
-				 * did, we can fetch the edge pixels from
-				 * that.
-				 */
-				if (!vips_rect_isempty(&ovl)) {
-					p = VIPS_REGION_ADDR(out_region, edge.left, edge.top);
-					plsk = VIPS_REGION_LSKIP(out_region);
-				}
-				else {
-					/* No pixels painted ... fetch
-					 * directly from the input image.
-					 */
-					edge.left -= base->x;
-					edge.top -= base->y;
-					if (vips_region_prepare(ir, &edge))
-						return -1;
-					p = VIPS_REGION_ADDR(ir, edge.left, edge.top);
-					plsk = VIPS_REGION_LSKIP(ir);
-				}
-
-				vips_embed_base_paint_edge(base, out_region, i, &todo, p, plsk);
-			}
-		}
-
-		break;
-
 	default:
 		g_assert_not_reached();
 	}
@@ -342,13 +447,44 @@ vips_embed_base_gen(VipsRegion *out_region,
 	return 0;
 }
 
+/* Is every output pixel the same? Only if @in is constant and the borders
+ * are painted with that same value.
+ */
+static gboolean
+vips_embed_base_isconstant(VipsEmbedBase *base)
+{
+	VipsImage *in = base->in;
+	size_t ps = VIPS_IMAGE_SIZEOF_PEL(in);
+
+	if (!in->constant)
+		return FALSE;
+
+	switch (base->extend) {
+	case VIPS_EXTEND_COPY:
+	case VIPS_EXTEND_REPEAT:
+	case VIPS_EXTEND_MIRROR:
+		return TRUE;
+
+	case VIPS_EXTEND_BLACK:
+		for (size_t i = 0; i < ps; i++)
+			if (in->constant[i])
+				return FALSE;
+		return TRUE;
+
+	case VIPS_EXTEND_BACKGROUND:
+		return memcmp(base->ink, in->constant, ps) == 0;
+
+	default:
+		return FALSE;
+	}
+}
+
 static int
 vips_embed_base_build(VipsObject *object)
 {
 	VipsObjectClass *class = VIPS_OBJECT_GET_CLASS(object);
 	VipsConversion *conversion = VIPS_CONVERSION(object);
 	VipsEmbedBase *base = (VipsEmbedBase *) object;
-	VipsImage **t = (VipsImage **) vips_object_local_array(object, 7);
 
 	VipsRect want;
 
@@ -375,65 +511,12 @@ vips_embed_base_build(VipsObject *object)
 			return -1;
 
 	switch (base->extend) {
-	case VIPS_EXTEND_REPEAT: {
-		/* Clock arithmetic: we want negative x/y to wrap around
-		 * nicely.
-		 */
-		const int nx = base->x < 0
-			? -base->x % base->in->Xsize
-			: base->in->Xsize - base->x % base->in->Xsize;
-		const int ny = base->y < 0
-			? -base->y % base->in->Ysize
-			: base->in->Ysize - base->y % base->in->Ysize;
-
-		if (vips_replicate(base->in, &t[0],
-				base->width / base->in->Xsize + 2,
-				base->height / base->in->Ysize + 2, NULL) ||
-			vips_extract_area(t[0], &t[1],
-				nx, ny, base->width, base->height, NULL) ||
-			vips_image_write(t[1], conversion->out))
-			return -1;
-	} break;
-
-	case VIPS_EXTEND_MIRROR: {
-		/* As repeat, but the tiles are twice the size because of
-		 * mirroring.
-		 */
-		const int w2 = base->in->Xsize * 2;
-		const int h2 = base->in->Ysize * 2;
-
-		const int nx = base->x < 0 ? -base->x % w2 : w2 - base->x % w2;
-		const int ny = base->y < 0 ? -base->y % h2 : h2 - base->y % h2;
-
-		if (
-			/* Make a 2x2 mirror tile.
-			 */
-			vips_flip(base->in, &t[0], VIPS_DIRECTION_HORIZONTAL, NULL) ||
-			vips_join(base->in, t[0], &t[1], VIPS_DIRECTION_HORIZONTAL, NULL) ||
-			vips_flip(t[1], &t[2], VIPS_DIRECTION_VERTICAL, NULL) ||
-			vips_join(t[1], t[2], &t[3], VIPS_DIRECTION_VERTICAL, NULL) ||
-
-			/* Repeat, then cut out the centre.
-			 */
-			vips_replicate(t[3], &t[4],
-				base->width / t[3]->Xsize + 2,
-				base->height / t[3]->Ysize + 2, NULL) ||
-			vips_extract_area(t[4], &t[5],
-				nx, ny, base->width, base->height, NULL) ||
-
-			/* Overwrite the centre with the in, much faster
-			 * for centre pixels.
-			 */
-			vips_insert(t[5], base->in, &t[6], base->x, base->y, NULL) ||
-
-			vips_image_write(t[6], conversion->out))
-			return -1;
-	} break;
-
 	case VIPS_EXTEND_BLACK:
 	case VIPS_EXTEND_WHITE:
 	case VIPS_EXTEND_BACKGROUND:
 	case VIPS_EXTEND_COPY:
+	case VIPS_EXTEND_REPEAT:
+	case VIPS_EXTEND_MIRROR:
 		/* embed is used in many places. We don't really care about
 		 * geometry, so use ANY to avoid disturbing all pipelines.
 		 */
@@ -459,11 +542,13 @@ vips_embed_base_build(VipsObject *object)
 		want.height = base->in->Ysize;
 		vips_rect_intersectrect(&want, &base->rout, &base->rsub);
 
-		/* FIXME ... actually, it can't. base_find_edge() will fail
-		 * if rsub is empty. Make this more general at some point
-		 * and remove this test.
+		/* Copy, repeat and mirror can make any area, but the border
+		 * rects below need some of the image to be in the output.
 		 */
-		if (vips_rect_isempty(&base->rsub)) {
+		if (base->extend != VIPS_EXTEND_COPY &&
+			base->extend != VIPS_EXTEND_REPEAT &&
+			base->extend != VIPS_EXTEND_MIRROR &&
+			vips_rect_isempty(&base->rsub)) {
 			vips_error(class->nickname, "%s", _("bad dimensions"));
 			return -1;
 		}
@@ -525,6 +610,9 @@ vips_embed_base_build(VipsObject *object)
 				base->in, base))
 			return -1;
 
+		if (vips_embed_base_isconstant(base))
+			vips__image_set_constant(conversion->out, base->in->constant);
+
 		break;
 
 	default:
@@ -37,6 +37,11 @@
  * 	- gtkdoc
  * 26/10/11
  * 	- redone as a class
+ * 15/10/26
+ * 	- push the crop down into the loader, if we can
+ * 	- add a highway path for extract_band of one band
+ * 	- pass constant images through extract_area
+ * 	- extract_band highway path does several bands, eg. RGB from RGBA
  */
 
 /*
@@ -80,6 +85,7 @@
 #include <stdlib.h>
 
 #include <vips/vips.h>
+#include <vips/vector.h>
 #include <vips/internal.h>
 #include <vips/debug.h>
 
@@ -141,6 +147,7 @@ vips_extract_area_build(VipsObject *object)
 	VipsExtractArea *extract = (VipsExtractArea *) object;
 
 	VipsImage *in;
+	VipsImage *cropped;
 
 	if (VIPS_OBJECT_CLASS(vips_extract_area_parent_class)->build(object))
 		return -1;
@@ -159,6 +166,25 @@ vips_extract_area_build(VipsObject *object)
 		vips_check_coding_known(class->nickname, in))
 		return -1;
 
+	/* If @in comes straight from a loader that can decode just part of
+	 * an image, ask it for only this area.
+	 */
+	if ((cropped = vips__foreign_load_crop(in,
+			 extract->left, extract->top,
+			 extract->width, extract->height))) {
+		int result;
+
+		result = vips_image_write(cropped, conversion->out);
+		g_object_unref(cropped);
+		if (result)
+			return -1;
+
+		conversion->out->Xoffset = -extract->left;
+		conversion->out->Yoffset = -extract->top;
+
+		return 0;
+	}
+
 	if (vips_image_pipelinev(conversion->out,
 			VIPS_DEMAND_STYLE_THINSTRIP, in, NULL))
 		return -1;
@@ -173,6 +199,9 @@ vips_extract_area_build(VipsObject *object)
 			in, extract))
 		return -1;
 
+	if (in->constant)
+		vips__image_set_constant(conversion->out, in->constant);
+
 	return 0;
 }
 
@@ -364,6 +393,18 @@ vips_extract_band_buffer(VipsBandarySequence *seq,
 	VipsPel *restrict q;
 	int x, z;
 
+#ifdef HAVE_HWY
+	/* From up to four bands, in whole vectors.
+	 */
+	if (im->Bands <= 4 &&
+		(es == 1 || es == 2 || es == 4) &&
+		vips_vector_isenabled()) {
+		vips_extract_band_hwy(out, in[0],
+			width, im->Bands, extract->band, extract->n, es);
+		return;
+	}
+#endif /*HAVE_HWY*/
+
 	p = in[0] + extract->band * es;
 	q = out;
 	if (ops == 1) {
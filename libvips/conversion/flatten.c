@@ -11,6 +11,8 @@
  * 	- max_alpha defaults to 65535 for RGB16/GREY16
  * 12/9/21
  * 	- out of range alpha and max_alpha correctly
+ * 15/10/26
+ * 	- add a SIMD path for uchar RGBA
  */
 
 /*
@@ -55,6 +57,7 @@
 #include <math.h>
 
 #include <vips/vips.h>
+#include <vips/vector.h>
 #include <vips/internal.h>
 #include <vips/debug.h>
 
@@ -77,6 +80,10 @@ typedef struct _VipsFlatten {
 	 */
 	double max_alpha;
 
+	/* Use the SIMD path for uchar RGBA.
+	 */
+	gboolean vector;
+
 } VipsFlatten;
 
 typedef VipsConversionClass VipsFlattenClass;
@@ -195,6 +202,16 @@ vips_flatten_black_gen_uchar(VipsRegion *out_region,
 			(unsigned char *) VIPS_REGION_ADDR(out_region, r->left,
 				r->top + y);
 
+#ifdef HAVE_HWY
+		if (flatten->vector &&
+			bands == 4) {
+			static const VipsPel black[3] = { 0 };
+
+			vips_flatten_uchar_hwy(q, p, width, black);
+			continue;
+		}
+#endif /*HAVE_HWY*/
+
 		if (bands == 4) {
 			for (x = 0; x < width; x++) {
 				float f = factor_lut[p[3]];
@@ -322,6 +339,14 @@ vips_flatten_gen_uchar(VipsRegion *out_region,
 				r->top + y);
 		unsigned char *restrict bg = (unsigned char *) flatten->ink;
 
+#ifdef HAVE_HWY
+		if (flatten->vector &&
+			bands == 4) {
+			vips_flatten_uchar_hwy(q, p, width, bg);
+			continue;
+		}
+#endif /*HAVE_HWY*/
+
 		if (bands == 4) {
 			for (x = 0; x < width; x++) {
 				float fa = alpha_lut[p[3]];
@@ -474,6 +499,11 @@ vips_flatten_build(VipsObject *object)
 		return -1;
 	t[2]->Bands -= 1;
 
+	/* The SIMD path is only exact for the usual max_alpha.
+	 */
+	flatten->vector = vips_vector_isenabled() &&
+		flatten->max_alpha == 255.0;
+
 	/* Is the background black? We have a special path for this.
 	 */
 	black = TRUE;
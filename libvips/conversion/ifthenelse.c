@@ -25,6 +25,10 @@
  * 19/4/12
  * 	- fix blend
  * 	- small blend speedup
+ * 15/10/26
+ * 	- test constant conditions without computing them
+ * 	- fold constant images
+ * 	- add highway paths for select and for uchar, ushort and float blend
  */
 
 /*
@@ -68,6 +72,7 @@
 #include <math.h>
 
 #include <vips/vips.h>
+#include <vips/vector.h>
 #include <vips/internal.h>
 #include <vips/debug.h>
 
@@ -342,13 +347,30 @@ vips_blend_gen(VipsRegion *out_region,
 			VipsPel *bp = VIPS_REGION_ADDR(ir[1], le, y);
 			VipsPel *cp = VIPS_REGION_ADDR(ir[2], le, y);
 			VipsPel *q = VIPS_REGION_ADDR(out_region, le, y);
+			int ps = VIPS_IMAGE_SIZEOF_PEL(a);
+
+			/* The vector path does whole pixels from the left,
+			 * the buffer functions finish the line.
+			 */
+			x = 0;
+#ifdef HAVE_HWY
+			if (c->Bands == a->Bands &&
+				vips_vector_isenabled())
+				x = vips_blend_hwy(q, cp, ap, bp,
+						r->width * a->Bands, a->BandFmt) /
+					a->Bands;
+#endif /*HAVE_HWY*/
+			ap += x * ps;
+			bp += x * ps;
+			cp += x * c->Bands;
+			q += x * ps;
 
 			if (c->Bands == 1)
 				vips_blend1_buffer(q, cp, ap, bp,
-					r->width, a);
+					r->width - x, a);
 			else
 				vips_blendn_buffer(q, cp, ap, bp,
-					r->width, a);
+					r->width - x, a);
 		}
 	}
 
@@ -386,24 +408,35 @@ vips_ifthenelse_gen(VipsRegion *out_region,
 		width = r->width * a->Bands;
 	}
 
-	if (vips_region_prepare(ir[2], r))
-		return -1;
-
 	/* Is the conditional all zero or all non-zero? We can avoid asking
-	 * for one of the inputs to be calculated.
+	 * for one of the inputs to be calculated. A constant conditional
+	 * can be tested without computing it at all.
 	 */
-	all0 = *VIPS_REGION_ADDR(ir[2], le, to) == 0;
-	alln0 = *VIPS_REGION_ADDR(ir[2], le, to) != 0;
-	for (y = to; y < bo; y++) {
-		VipsPel *p = VIPS_REGION_ADDR(ir[2], le, y);
-
-		for (x = 0; x < width; x++) {
-			all0 &= p[x] == 0;
-			alln0 &= p[x] != 0;
+	if (c->constant) {
+		all0 = TRUE;
+		alln0 = TRUE;
+		for (i = 0; i < c->Bands; i++) {
+			all0 &= c->constant[i] == 0;
+			alln0 &= c->constant[i] != 0;
 		}
+	}
+	else {
+		if (vips_region_prepare(ir[2], r))
+			return -1;
 
-		if (!all0 && !alln0)
-			break;
+		all0 = *VIPS_REGION_ADDR(ir[2], le, to) == 0;
+		alln0 = *VIPS_REGION_ADDR(ir[2], le, to) != 0;
+		for (y = to; y < bo; y++) {
+			VipsPel *p = VIPS_REGION_ADDR(ir[2], le, y);
+
+			for (x = 0; x < width; x++) {
+				all0 &= p[x] == 0;
+				alln0 &= p[x] != 0;
+			}
+
+			if (!all0 && !alln0)
+				break;
+		}
 	}
 
 	if (alln0) {
@@ -422,10 +455,13 @@ vips_ifthenelse_gen(VipsRegion *out_region,
 	}
 	else {
 		/* Mix of set and clear ... ask for both then and else parts
-		 * and interleave.
+		 * and interleave. A constant conditional with mixed bands has
+		 * not been computed yet.
 		 */
 		if (vips_region_prepare(ir[0], r) ||
-			vips_region_prepare(ir[1], r))
+			vips_region_prepare(ir[1], r) ||
+			(c->constant &&
+				vips_region_prepare(ir[2], r)))
 			return -1;
 
 		for (y = to; y < bo; y++) {
@@ -434,7 +470,14 @@ vips_ifthenelse_gen(VipsRegion *out_region,
 			VipsPel *cp = VIPS_REGION_ADDR(ir[2], le, y);
 			VipsPel *q = VIPS_REGION_ADDR(out_region, le, y);
 
-			for (x = 0, i = 0; i < width; i++, x += size)
+			i = 0;
+#ifdef HAVE_HWY
+			if ((size == 1 || size == 2 || size == 4) &&
+				vips_vector_isenabled())
+				i = vips_ifthenelse_hwy(q, cp, ap, bp, width, size);
+#endif /*HAVE_HWY*/
+
+			for (x = i * size; i < width; i++, x += size)
 				if (cp[i])
 					for (z = x; z < x + size; z++)
 						q[z] = ap[z];
@@ -507,6 +550,8 @@ vips_ifthenelse_build(VipsObject *object)
 			format, ifthenelse))
 		return -1;
 
+	vips__image_fold_constant(conversion->out, format);
+
 	return 0;
 }
 
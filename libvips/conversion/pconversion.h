@@ -66,6 +66,67 @@ typedef struct _VipsConversionClass {
 
 GType vips_conversion_get_type(void);
 
+/* SIMD paths, see composite_hwy.cpp. These do RGBA pixels in whole vectors
+ * and return the number of pixels processed.
+ */
+int vips_composite_uchar_hwy(VipsPel *out, VipsPel **in, const int *mode,
+	int n, int width, const float *max_band, int premultiplied);
+int vips_composite_ushort_hwy(VipsPel *out, VipsPel **in, const int *mode,
+	int n, int width, const float *max_band, int premultiplied);
+int vips_composite_float_hwy(VipsPel *out, VipsPel **in, const int *mode,
+	int n, int width, const float *max_band, int premultiplied);
+
+/* SIMD paths, see conversion_hwy.cpp. The casts work on @n elements, the
+ * alpha ops on @width RGBA pixels.
+ */
+void vips_cast_uchar_float_hwy(VipsPel *out, VipsPel *in, int n);
+void vips_cast_ushort_float_hwy(VipsPel *out, VipsPel *in, int n);
+void vips_cast_float_uchar_hwy(VipsPel *out, VipsPel *in, int n);
+void vips_cast_float_ushort_hwy(VipsPel *out, VipsPel *in, int n);
+void vips_premultiply_uchar_hwy(VipsPel *out, VipsPel *in, int width,
+	double max_alpha);
+void vips_premultiply_ushort_hwy(VipsPel *out, VipsPel *in, int width,
+	double max_alpha);
+void vips_premultiply_float_hwy(VipsPel *out, VipsPel *in, int width,
+	double max_alpha);
+void vips_unpremultiply_float_hwy(VipsPel *out, VipsPel *in, int width,
+	double max_alpha);
+void vips_flatten_uchar_hwy(VipsPel *out, VipsPel *in, int width,
+	const VipsPel *bg);
+
+/* Recomb @width pixels of @mwidth bands with a float matrix 3 or 4 wide and
+ * 3 or 4 high, see conversion_hwy.cpp.
+ */
+void vips_recomb_uchar_hwy(VipsPel *out, VipsPel *in, int width,
+	int mwidth, int mheight, const float *m);
+void vips_recomb_ushort_hwy(VipsPel *out, VipsPel *in, int width,
+	int mwidth, int mheight, const float *m);
+void vips_recomb_float_hwy(VipsPel *out, VipsPel *in, int width,
+	int mwidth, int mheight, const float *m);
+
+/* Move bands between pixels with elements @es bytes wide, see
+ * conversion_hwy.cpp. Extract takes @n bands of @bands, join interleaves @n
+ * lines with @bands[i] bands each.
+ */
+void vips_extract_band_hwy(VipsPel *out, VipsPel *in, int width,
+	int bands, int band, int n, int es);
+void vips_bandjoin_hwy(VipsPel *out, VipsPel **in, int width,
+	int n, const int *bands, int es);
+
+/* Reverse the order of @n pixels of @ps bytes, see conversion_hwy.cpp.
+ * Returns the number of pixels done.
+ */
+int vips_reverse_hwy(VipsPel *out, VipsPel *in, int n, int ps);
+
+/* ifthenelse on @n elements with an element-wise uchar condition @c, see
+ * conversion_hwy.cpp. Select moves elements of @es bytes, blend does uchar,
+ * ushort and float. They return the number of elements done.
+ */
+int vips_ifthenelse_hwy(VipsPel *out, VipsPel *c, VipsPel *a, VipsPel *b,
+	int n, int es);
+int vips_blend_hwy(VipsPel *out, VipsPel *c, VipsPel *a, VipsPel *b,
+	int n, VipsBandFormat format);
+
 #ifdef __cplusplus
 }
 #endif /*__cplusplus*/
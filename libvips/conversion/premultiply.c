@@ -9,6 +9,8 @@
  * 	- max_alpha defaults to 65535 for RGB16/GREY16
  * 24/11/17 lovell
  * 	- match normalised alpha to output type
+ * 15/10/26
+ * 	- add SIMD paths for RGBA
  */
 
 /*
@@ -53,6 +55,7 @@
 #include <math.h>
 
 #include <vips/vips.h>
+#include <vips/vector.h>
 #include <vips/internal.h>
 #include <vips/debug.h>
 
@@ -66,6 +69,10 @@ typedef struct _VipsPremultiply {
 	double max_alpha;
 	gboolean uchar;
 
+	/* Use the SIMD paths for RGBA.
+	 */
+	gboolean vector;
+
 	/* LUT for fast uchar -> uchar path. 8.8 bits of precision.
 	 */
 	int scale[256];
@@ -152,6 +159,26 @@ vips_premultiply_gen(VipsRegion *out_region,
 		VipsPel * restrict out =
 			VIPS_REGION_ADDR(out_region, r->left, r->top + y);
 
+#ifdef HAVE_HWY
+		if (premultiply->vector)
+			switch (im->BandFmt) {
+			case VIPS_FORMAT_UCHAR:
+				vips_premultiply_uchar_hwy(out, in, width, max_alpha);
+				continue;
+
+			case VIPS_FORMAT_USHORT:
+				vips_premultiply_ushort_hwy(out, in, width, max_alpha);
+				continue;
+
+			case VIPS_FORMAT_FLOAT:
+				vips_premultiply_float_hwy(out, in, width, max_alpha);
+				continue;
+
+			default:
+				break;
+			}
+#endif /*HAVE_HWY*/
+
 		if (premultiply->uchar &&
 			im->BandFmt == VIPS_FORMAT_UCHAR)
 			// fast uchar -> uchar path
@@ -263,6 +290,12 @@ vips_premultiply_build(VipsObject *object)
 	else
 		conversion->out->BandFmt = VIPS_FORMAT_FLOAT;
 
+	/* The SIMD paths do RGBA to float.
+	 */
+	premultiply->vector = vips_vector_isenabled() &&
+		in->Bands == 4 &&
+		conversion->out->BandFmt == VIPS_FORMAT_FLOAT;
+
 	if (vips_image_generate(conversion->out,
 			vips_start_one, vips_premultiply_gen, vips_stop_one,
 			in, premultiply))
@@ -7,6 +7,8 @@
  * 	- gtkdoc
  * 9/11/11
  * 	- redo as a class
+ * 15/10/26
+ * 	- add a Highway path for 3 and 4 band uchar/ushort/float
  */
 
 /*
@@ -50,6 +52,7 @@
 #include <math.h>
 
 #include <vips/vips.h>
+#include <vips/vector.h>
 #include <vips/internal.h>
 
 #include "pconversion.h"
@@ -64,6 +67,11 @@ typedef struct _VipsRecomb {
 	 */
 	VipsImage *coeff;
 
+	/* Set if we can use the SIMD path, with the matrix as float.
+	 */
+	gboolean vector;
+	float *fcoeff;
+
 } VipsRecomb;
 
 typedef VipsConversionClass VipsRecombClass;
@@ -118,6 +126,32 @@ vips_recomb_gen(VipsRegion *out_region,
 		VipsPel *out = VIPS_REGION_ADDR(out_region,
 			out_region->valid.left, out_region->valid.top + y);
 
+#ifdef HAVE_HWY
+		if (recomb->vector) {
+			int width = out_region->valid.width;
+
+			switch (vips_image_get_format(im)) {
+			case VIPS_FORMAT_UCHAR:
+				vips_recomb_uchar_hwy(out, in, width,
+					mwidth, mheight, recomb->fcoeff);
+				break;
+			case VIPS_FORMAT_USHORT:
+				vips_recomb_ushort_hwy(out, in, width,
+					mwidth, mheight, recomb->fcoeff);
+				break;
+			case VIPS_FORMAT_FLOAT:
+				vips_recomb_float_hwy(out, in, width,
+					mwidth, mheight, recomb->fcoeff);
+				break;
+
+			default:
+				g_assert_not_reached();
+			}
+
+			continue;
+		}
+#endif /*HAVE_HWY*/
+
 		switch (vips_image_get_format(im)) {
 		case VIPS_FORMAT_UCHAR:
 			LOOP(unsigned char, float);
@@ -188,6 +222,28 @@ vips_recomb_build(VipsObject *object)
 		return -1;
 	recomb->coeff = t[1];
 
+	/* The common 3 and 4 band cases have a SIMD path. This accumulates
+	 * in float rather than double.
+	 */
+	if (vips_vector_isenabled() &&
+		(in->BandFmt == VIPS_FORMAT_UCHAR ||
+			in->BandFmt == VIPS_FORMAT_USHORT ||
+			in->BandFmt == VIPS_FORMAT_FLOAT) &&
+		(recomb->m->Xsize == 3 || recomb->m->Xsize == 4) &&
+		(recomb->m->Ysize == 3 || recomb->m->Ysize == 4)) {
+		int n = recomb->m->Xsize * recomb->m->Ysize;
+		double *m = VIPS_MATRIX(recomb->coeff, 0, 0);
+
+		int i;
+
+		if (!(recomb->fcoeff = VIPS_ARRAY(object, n, float)))
+			return -1;
+		for (i = 0; i < n; i++)
+			recomb->fcoeff[i] = m[i];
+
+		recomb->vector = TRUE;
+	}
+
 	if (vips_image_pipelinev(conversion->out,
 			VIPS_DEMAND_STYLE_THINSTRIP, in, NULL))
 		return -1;
@@ -30,6 +30,8 @@
  * 	- added 90/180/270 convenience functions
  * 10/11/22 alantudyk
  * 	- swapped memcpy() in d180 for a loop
+ * 15/10/26
+ * 	- copy in cache-sized blocks, specialised by pixel size
  */
 
 /*
@@ -96,6 +98,92 @@ typedef VipsConversionClass VipsRotClass;
 
 G_DEFINE_TYPE(VipsRot, vips_rot, VIPS_TYPE_CONVERSION);
 
+/* Copy in blocks of this many pixels square. The input lines a block touches
+ * then stay in cache while we sweep across them.
+ */
+#define VIPS_ROT_BLOCK (32)
+
+/* Odd pixel sizes, copied as structs.
+ */
+typedef struct {
+	VipsPel b[3];
+} VipsRotPel3;
+
+typedef struct {
+	VipsPel b[6];
+} VipsRotPel6;
+
+#define BLOCK(TYPE) \
+	{ \
+		for (int y = by; y < ylim; y++) { \
+			TYPE *restrict q1 = (TYPE *) (q + y * qls) + bx; \
+			VipsPel *restrict p1 = p + y * pstep_y + bx * pstep_x; \
+\
+			for (int x = bx; x < xlim; x++) { \
+				*q1++ = *((TYPE *) p1); \
+				p1 += pstep_x; \
+			} \
+		} \
+	}
+
+/* Fill a @width by @height area of output at @q, line skip @qls. Output
+ * pixel (x, y) comes from @p + x * @pstep_x + y * @pstep_y, with steps in
+ * bytes.
+ */
+static void
+vips_rot_copy(VipsPel *q, int qls,
+	VipsPel *p, int pstep_x, int pstep_y,
+	int width, int height, int ps)
+{
+	for (int by = 0; by < height; by += VIPS_ROT_BLOCK) {
+		int ylim = VIPS_MIN(height, by + VIPS_ROT_BLOCK);
+
+		for (int bx = 0; bx < width; bx += VIPS_ROT_BLOCK) {
+			int xlim = VIPS_MIN(width, bx + VIPS_ROT_BLOCK);
+
+			switch (ps) {
+			case 1:
+				BLOCK(guint8);
+				break;
+
+			case 2:
+				BLOCK(guint16);
+				break;
+
+			case 3:
+				BLOCK(VipsRotPel3);
+				break;
+
+			case 4:
+				BLOCK(guint32);
+				break;
+
+			case 6:
+				BLOCK(VipsRotPel6);
+				break;
+
+			case 8:
+				BLOCK(guint64);
+				break;
+
+			default:
+				for (int y = by; y < ylim; y++) {
+					VipsPel *restrict q1 = q + y * qls + bx * ps;
+					VipsPel *restrict p1 =
+						p + y * pstep_y + bx * pstep_x;
+
+					for (int x = bx; x < xlim; x++) {
+						memcpy(q1, p1, ps);
+						q1 += ps;
+						p1 += pstep_x;
+					}
+				}
+				break;
+			}
+		}
+	}
+}
+
 static int
 vips_rot90_gen(VipsRegion *out_region,
 	void *seq, void *a, void *b, gboolean *stop)
@@ -109,7 +197,6 @@ vips_rot90_gen(VipsRegion *out_region,
 	int le = r->left;
 	int ri = VIPS_RECT_RIGHT(r);
 	int to = r->top;
-	int bo = VIPS_RECT_BOTTOM(r);
 
 	/* Pixel geometry.
 	 */
@@ -131,26 +218,13 @@ vips_rot90_gen(VipsRegion *out_region,
 	ps = VIPS_IMAGE_SIZEOF_PEL(in);
 	ls = VIPS_REGION_LSKIP(ir);
 
-	/* Rotate the bit we now have.
+	/* Output lines run up input columns, starting at the bottom left.
 	 */
-	for (int y = to; y < bo; y++) {
-		/* Start of this output line.
-		 */
-		VipsPel * restrict q = VIPS_REGION_ADDR(out_region, le, y);
-
-		/* Corresponding position in ir.
-		 */
-		VipsPel * restrict p = VIPS_REGION_ADDR(ir,
-			need.left + y - to,
-			need.top + need.height - 1);
-
-		for (int x = le; x < ri; x++) {
-			VIPS_MEMCPY(q, p, ps);
-
-			q += ps;
-			p -= ls;
-		}
-	}
+	vips_rot_copy(VIPS_REGION_ADDR(out_region, le, to),
+		VIPS_REGION_LSKIP(out_region),
+		VIPS_REGION_ADDR(ir, need.left, need.top + need.height - 1),
+		-ls, ps,
+		r->width, r->height, ps);
 
 	return 0;
 }
@@ -172,7 +246,7 @@ vips_rot180_gen(VipsRegion *out_region,
 
 	/* Pixel geometry.
 	 */
-	int ps;
+	int ps, ls;
 
 	/* Find the area of the input image we need.
 	 */
@@ -188,29 +262,17 @@ vips_rot180_gen(VipsRegion *out_region,
 	/* Find PEL size and line skip for ir.
 	 */
 	ps = VIPS_IMAGE_SIZEOF_PEL(in);
+	ls = VIPS_REGION_LSKIP(ir);
 
-	/* Rotate the bit we now have.
+	/* Output lines run right to left along input lines, starting at the
+	 * bottom right.
 	 */
-	for (int y = to; y < bo; y++) {
-		/* Start of this output line.
-		 */
-		VipsPel *q = VIPS_REGION_ADDR(out_region, le, y);
-
-		/* Corresponding position in ir.
-		 */
-		VipsPel *p = VIPS_REGION_ADDR(ir,
-			need.left + need.width - 1,
-			need.top + need.height - (y - to) - 1);
-
-		/* Blap across!
-		 */
-		for (int x = le; x < ri; x++) {
-			VIPS_MEMCPY(q, p, ps);
-
-			q += ps;
-			p -= ps;
-		}
-	}
+	vips_rot_copy(VIPS_REGION_ADDR(out_region, le, to),
+		VIPS_REGION_LSKIP(out_region),
+		VIPS_REGION_ADDR(ir,
+			need.left + need.width - 1, need.top + need.height - 1),
+		-ps, -ls,
+		r->width, r->height, ps);
 
 	return 0;
 }
@@ -226,7 +288,6 @@ vips_rot270_gen(VipsRegion *out_region,
 	 */
 	VipsRect *r = &out_region->valid;
 	int le = r->left;
-	int ri = VIPS_RECT_RIGHT(r);
 	int to = r->top;
 	int bo = VIPS_RECT_BOTTOM(r);
 
@@ -250,26 +311,13 @@ vips_rot270_gen(VipsRegion *out_region,
 	ps = VIPS_IMAGE_SIZEOF_PEL(in);
 	ls = VIPS_REGION_LSKIP(ir);
 
-	/* Rotate the bit we now have.
+	/* Output lines run down input columns, starting at the top right.
 	 */
-	for (int y = to; y < bo; y++) {
-		/* Start of this output line.
-		 */
-		VipsPel *q = VIPS_REGION_ADDR(out_region, le, y);
-
-		/* Corresponding position in ir.
-		 */
-		VipsPel *p = VIPS_REGION_ADDR(ir,
-			need.left + need.width - (y - to) - 1,
-			need.top);
-
-		for (int x = le; x < ri; x++) {
-			VIPS_MEMCPY(q, p, ps);
-
-			q += ps;
-			p += ls;
-		}
-	}
+	vips_rot_copy(VIPS_REGION_ADDR(out_region, le, to),
+		VIPS_REGION_LSKIP(out_region),
+		VIPS_REGION_ADDR(ir, need.left + need.width - 1, need.top),
+		ls, -ps,
+		r->width, r->height, ps);
 
 	return 0;
 }
@@ -25,6 +25,10 @@
  * 	- deprecate @trace, @access now seq is much simpler
  * 6/9/21
  * 	- don't set "persistent", it can cause huge memory use
+ * 14/10/26
+ * 	- add @prefetch, read ahead on a background thread
+ * 15/10/26
+ * 	- default @tile_height to the natural tile of @in, advertise it on @out
  */
 
 /*
@@ -95,22 +99,281 @@ typedef struct _VipsSequential {
 	 * can stall and never wake.
 	 */
 	int error;
+
+	/* Read ahead by this many strips.
+	 */
+	int prefetch;
+
+	/* In prefetch mode, a reader thread decodes strips into a ring of
+	 * n_slots strips, signalling @ready as each one arrives. Workers
+	 * signal @wanted as they move @bottom, the furthest line anyone has
+	 * asked for. All under @lock.
+	 */
+	GThread *reader;
+	gboolean reader_stop;
+	GCond ready;
+	GCond wanted;
+	int n_slots;
+	VipsPel *ring;
+	int *slot_strip;
+	int next_strip;
+	int bottom;
 } VipsSequential;
 
 typedef VipsConversionClass VipsSequentialClass;
 
 G_DEFINE_TYPE(VipsSequential, vips_sequential, VIPS_TYPE_CONVERSION);
 
+/* The prefetching sequential on an image, if any, is attached here.
+ */
+static GQuark vips_sequential_prefetch_quark = 0;
+static GMutex vips_sequential_prefetch_lock;
+
+/* Stop and join the reader thread. The ring and the read position are kept,
+ * so the next request can start a new reader where this one left off.
+ */
+static void
+vips_sequential_reader_stop(VipsSequential *sequential)
+{
+	GThread *reader;
+
+	g_mutex_lock(&sequential->lock);
+	reader = sequential->reader;
+	sequential->reader_stop = TRUE;
+	g_cond_broadcast(&sequential->wanted);
+	g_mutex_unlock(&sequential->lock);
+
+	if (reader)
+		(void) g_thread_join(reader);
+
+	g_mutex_lock(&sequential->lock);
+	sequential->reader = NULL;
+	sequential->reader_stop = FALSE;
+	g_mutex_unlock(&sequential->lock);
+}
+
+/* Loaders close their input on "minimise", and images upstream are
+ * minimised before images downstream, so a "minimise" handler on our output
+ * would run too late. An emission hook runs before any handlers, so we can
+ * park the reader before the loader drops its file.
+ */
+static gboolean
+vips_sequential_minimise_hook(GSignalInvocationHint *ihint,
+	guint n_param_values, const GValue *param_values, gpointer data)
+{
+	GObject *image = g_value_get_object(&param_values[0]);
+
+	VipsSequential *sequential;
+
+	g_mutex_lock(&vips_sequential_prefetch_lock);
+
+	if ((sequential = (VipsSequential *)
+				g_object_get_qdata(image, vips_sequential_prefetch_quark)))
+		vips_sequential_reader_stop(sequential);
+
+	g_mutex_unlock(&vips_sequential_prefetch_lock);
+
+	return TRUE;
+}
+
+static void *
+vips_sequential_prefetch_init(void *client)
+{
+	vips_sequential_prefetch_quark =
+		g_quark_from_static_string("vips-sequential-prefetch");
+	g_signal_add_emission_hook(
+		g_signal_lookup("minimise", VIPS_TYPE_IMAGE), 0,
+		vips_sequential_minimise_hook, NULL, NULL);
+
+	return NULL;
+}
+
+static void
+vips_sequential_dispose(GObject *gobject)
+{
+	VipsSequential *sequential = (VipsSequential *) gobject;
+
+	if (sequential->prefetch > 0 &&
+		sequential->ring) {
+		g_mutex_lock(&vips_sequential_prefetch_lock);
+		if (sequential->in &&
+			g_object_get_qdata(G_OBJECT(sequential->in),
+				vips_sequential_prefetch_quark) == sequential)
+			g_object_set_qdata(G_OBJECT(sequential->in),
+				vips_sequential_prefetch_quark, NULL);
+		g_mutex_unlock(&vips_sequential_prefetch_lock);
+
+		vips_sequential_reader_stop(sequential);
+	}
+
+	G_OBJECT_CLASS(vips_sequential_parent_class)->dispose(gobject);
+}
+
 static void
 vips_sequential_finalize(GObject *gobject)
 {
 	VipsSequential *sequential = (VipsSequential *) gobject;
 
 	g_mutex_clear(&sequential->lock);
+	g_cond_clear(&sequential->ready);
+	g_cond_clear(&sequential->wanted);
 
 	G_OBJECT_CLASS(vips_sequential_parent_class)->finalize(gobject);
 }
 
+/* The reader thread: decode strips top to bottom, running up to @prefetch
+ * strips past the furthest request.
+ */
+static void *
+vips_sequential_reader(void *data)
+{
+	VipsSequential *sequential = (VipsSequential *) data;
+	VipsImage *in = sequential->in;
+	const int th = sequential->tile_height;
+	const int n_strips = VIPS_ROUND_UP(in->Ysize, th) / th;
+	const size_t ls = VIPS_IMAGE_SIZEOF_LINE(in);
+
+	VipsRegion *ir;
+
+	if (!(ir = vips_region_new(in))) {
+		g_mutex_lock(&sequential->lock);
+		sequential->error = -1;
+		g_cond_broadcast(&sequential->ready);
+		g_mutex_unlock(&sequential->lock);
+
+		return NULL;
+	}
+
+	g_mutex_lock(&sequential->lock);
+
+	while (!sequential->reader_stop &&
+		!sequential->error &&
+		sequential->next_strip < n_strips) {
+		int s = sequential->next_strip;
+		int slot = s % sequential->n_slots;
+
+		VipsRect area;
+		int result;
+		int y;
+
+		if (s * th >= sequential->bottom + sequential->prefetch * th) {
+			g_cond_wait(&sequential->wanted, &sequential->lock);
+			continue;
+		}
+
+		/* This slot is about to be overwritten.
+		 */
+		sequential->slot_strip[slot] = -1;
+
+		g_mutex_unlock(&sequential->lock);
+
+		area.left = 0;
+		area.top = s * th;
+		area.width = in->Xsize;
+		area.height = VIPS_MIN(th, in->Ysize - area.top);
+		result = vips_region_prepare(ir, &area);
+		if (!result)
+			for (y = 0; y < area.height; y++)
+				memcpy(sequential->ring + ((gint64) slot * th + y) * ls,
+					VIPS_REGION_ADDR(ir, 0, area.top + y), ls);
+
+		g_mutex_lock(&sequential->lock);
+
+		if (result)
+			sequential->error = -1;
+		else {
+			sequential->slot_strip[slot] = s;
+			sequential->next_strip = s + 1;
+		}
+
+		g_cond_broadcast(&sequential->ready);
+	}
+
+	g_mutex_unlock(&sequential->lock);
+
+	g_object_unref(ir);
+
+	return NULL;
+}
+
+static int
+vips_sequential_prefetch_generate(VipsRegion *out_region,
+	void *seq, void *a, void *b, gboolean *stop)
+{
+	VipsSequential *sequential = (VipsSequential *) b;
+	VipsImage *in = sequential->in;
+	VipsRect *r = &out_region->valid;
+	const int th = sequential->tile_height;
+	const size_t ls = VIPS_IMAGE_SIZEOF_LINE(in);
+	const size_t ps = VIPS_IMAGE_SIZEOF_PEL(in);
+
+	int s;
+
+	VIPS_GATE_START("vips_sequential_prefetch_generate: wait");
+
+	vips__worker_lock(&sequential->lock);
+
+	VIPS_GATE_STOP("vips_sequential_prefetch_generate: wait");
+
+	if (sequential->error) {
+		g_mutex_unlock(&sequential->lock);
+		return -1;
+	}
+
+	if (!sequential->reader &&
+		!(sequential->reader = vips_g_thread_new("sequential",
+			  vips_sequential_reader, sequential))) {
+		sequential->error = -1;
+		g_mutex_unlock(&sequential->lock);
+		return -1;
+	}
+
+	if (VIPS_RECT_BOTTOM(r) > sequential->bottom) {
+		sequential->bottom = VIPS_RECT_BOTTOM(r);
+		g_cond_broadcast(&sequential->wanted);
+	}
+
+	for (s = r->top / th; s * th < VIPS_RECT_BOTTOM(r); s++) {
+		int slot = s % sequential->n_slots;
+		int top = VIPS_MAX(r->top, s * th);
+		int bottom = VIPS_MIN(VIPS_RECT_BOTTOM(r), (s + 1) * th);
+
+		int y;
+
+		while (!sequential->error &&
+			sequential->next_strip <= s)
+			vips__worker_cond_wait(&sequential->ready, &sequential->lock);
+
+		if (sequential->error) {
+			g_mutex_unlock(&sequential->lock);
+			return -1;
+		}
+
+		/* The strip has dropped out of the ring. This request is
+		 * too far behind the others.
+		 */
+		if (sequential->slot_strip[slot] != s) {
+			vips_error("VipsSequential",
+				_("out of order read at line %d"), top);
+			sequential->error = -1;
+			g_cond_broadcast(&sequential->ready);
+			g_mutex_unlock(&sequential->lock);
+			return -1;
+		}
+
+		for (y = top; y < bottom; y++)
+			memcpy(VIPS_REGION_ADDR(out_region, r->left, y),
+				sequential->ring +
+					((gint64) slot * th + y - s * th) * ls +
+					r->left * ps,
+				r->width * ps);
+	}
+
+	g_mutex_unlock(&sequential->lock);
+
+	return 0;
+}
+
 static int
 vips_sequential_generate(VipsRegion *out_region,
 	void *seq, void *a, void *b, gboolean *stop)
@@ -196,6 +459,79 @@ vips_sequential_build(VipsObject *object)
 	if (VIPS_OBJECT_CLASS(vips_sequential_parent_class)->build(object))
 		return -1;
 
+	/* Default to the decode unit of the loader, if it has one, so we
+	 * never split a strip between two cache tiles.
+	 */
+	if (!vips_object_argument_isset(object, "tile_height")) {
+		int natural_width;
+		int natural_height;
+
+		if (vips__image_get_natural_tile(sequential->in,
+				&natural_width, &natural_height))
+			sequential->tile_height = natural_height;
+	}
+
+	/* Only one prefetcher per image, since the minimise hook can only
+	 * find one.
+	 */
+	if (sequential->prefetch > 0) {
+		static GOnce once = G_ONCE_INIT;
+
+		VIPS_ONCE(&once, vips_sequential_prefetch_init, NULL);
+
+		g_mutex_lock(&vips_sequential_prefetch_lock);
+		if (g_object_get_qdata(G_OBJECT(sequential->in),
+				vips_sequential_prefetch_quark))
+			sequential->prefetch = 0;
+		else
+			g_object_set_qdata(G_OBJECT(sequential->in),
+				vips_sequential_prefetch_quark, sequential);
+		g_mutex_unlock(&vips_sequential_prefetch_lock);
+	}
+
+	if (sequential->prefetch > 0) {
+		int tile_width;
+		int tile_height;
+		int n_lines;
+
+		if (vips_image_pio_input(sequential->in))
+			return -1;
+
+		/* Keep enough strips behind the read point for the
+		 * non-locality of threading, as vips_linecache() does.
+		 */
+		vips_get_tile_size(sequential->in,
+			&tile_width, &tile_height, &n_lines);
+		sequential->n_slots = sequential->prefetch +
+			VIPS_MAX(2, VIPS_ROUND_UP(4 * n_lines, sequential->tile_height) /
+					sequential->tile_height);
+		if (!(sequential->ring = VIPS_ARRAY(object,
+				  (gint64) sequential->n_slots *
+					  sequential->tile_height *
+					  VIPS_IMAGE_SIZEOF_LINE(sequential->in),
+				  VipsPel)) ||
+			!(sequential->slot_strip = VIPS_ARRAY(object,
+				  sequential->n_slots, int)))
+			return -1;
+		memset(sequential->slot_strip, 0xff,
+			sequential->n_slots * sizeof(int));
+
+		if (vips_image_pipelinev(conversion->out,
+				VIPS_DEMAND_STYLE_THINSTRIP, sequential->in, NULL))
+			return -1;
+
+		vips_image_set_int(conversion->out, VIPS_META_SEQUENTIAL, 1);
+		vips__image_set_natural_tile(conversion->out,
+			conversion->out->Xsize, sequential->tile_height);
+
+		if (vips_image_generate(conversion->out,
+				NULL, vips_sequential_prefetch_generate, NULL,
+				sequential->in, sequential))
+			return -1;
+
+		return 0;
+	}
+
 	/* We've gone forwards and backwards on sequential caches being
 	 * persistent. Persistent caches can be useful if you want to eg.
 	 * make several crop() operations on a seq image source, but they use
@@ -215,6 +551,17 @@ vips_sequential_build(VipsObject *object)
 	if (vips_image_pipelinev(conversion->out,
 			VIPS_DEMAND_STYLE_THINSTRIP, t, NULL))
 		return -1;
+
+	/* Make sure sinks keep requests in order, even if there's no seq
+	 * loader upstream.
+	 */
+	vips_image_set_int(conversion->out, VIPS_META_SEQUENTIAL, 1);
+
+	/* Sinks can line up with our cache tiles.
+	 */
+	vips__image_set_natural_tile(conversion->out,
+		conversion->out->Xsize, sequential->tile_height);
+
 	if (vips_image_generate(conversion->out,
 			vips_start_one, vips_sequential_generate, vips_stop_one,
 			t, sequential))
@@ -231,6 +578,7 @@ vips_sequential_class_init(VipsSequentialClass *class)
 
 	VIPS_DEBUG_MSG("vips_sequential_class_init\n");
 
+	gobject_class->dispose = vips_sequential_dispose;
 	gobject_class->finalize = vips_sequential_finalize;
 	gobject_class->set_property = vips_object_set_property;
 	gobject_class->get_property = vips_object_get_property;
@@ -252,6 +600,13 @@ vips_sequential_class_init(VipsSequentialClass *class)
 		G_STRUCT_OFFSET(VipsSequential, tile_height),
 		1, 1000000, 1);
 
+	VIPS_ARG_INT(class, "prefetch", 4,
+		_("Prefetch"),
+		_("Read ahead by this many strips"),
+		VIPS_ARGUMENT_OPTIONAL_INPUT,
+		G_STRUCT_OFFSET(VipsSequential, prefetch),
+		0, 1000000, 0);
+
 	VIPS_ARG_ENUM(class, "access", 6,
 		_("Strategy"),
 		_("Expected access pattern"),
@@ -271,9 +626,16 @@ static void
 vips_sequential_init(VipsSequential *sequential)
 {
 	g_mutex_init(&sequential->lock);
+	g_cond_init(&sequential->ready);
+	g_cond_init(&sequential->wanted);
 	sequential->tile_height = 1;
 	sequential->error = 0;
 	sequential->trace = FALSE;
+	sequential->prefetch = 0;
+	sequential->reader = NULL;
+	sequential->reader_stop = FALSE;
+	sequential->next_strip = 0;
+	sequential->bottom = 0;
 }
 
 /**
@@ -288,10 +650,17 @@ vips_sequential_init(VipsSequential *sequential)
  * strictly top-to-bottom, like PNG.
  *
  * @tile_height can be used to set the size of the tiles that
- * [method@Image.sequential] uses. The default value is 1.
+ * [method@Image.sequential] uses. The default is the strip height the
+ * loader decodes in, if it advertises one, or 1.
+ *
+ * Set @prefetch to have a background thread read @in @prefetch strips
+ * ahead of the furthest request, so decode can overlap with downstream
+ * processing. This is intended for use directly on the output of a
+ * sequential loader.
  *
  * ::: tip "Optional arguments"
  *     * @tile_height: `gint`, height of cache strips
+ *     * @prefetch: `gint`, read ahead by this many strips
  *
  * ::: seealso
  *     [method@Image.linecache], [method@Image.tilecache].
@@ -16,6 +16,10 @@
  * 	- add all
  * 26/11/22 ejoebstl
  *  - expose location of interest when using attention based cropping
+ * 14/10/26
+ * 	- search in a cache scope, so repeated scores share work
+ * 15/10/26
+ * 	- add "fast": score a small proxy and search with summed-area tables
  */
 
 /*
@@ -65,6 +69,14 @@
 
 #include "bandary.h"
 
+/* In fast mode, we score a proxy this many pixels across.
+ */
+#define VIPS_SMARTCROP_PROXY (64)
+
+/* And quantise each band to this many levels for entropy.
+ */
+#define VIPS_SMARTCROP_BINS (32)
+
 typedef struct _VipsSmartcrop {
 	VipsConversion parent_instance;
 
@@ -75,6 +87,7 @@ typedef struct _VipsSmartcrop {
 	int interesting_x;
 	int interesting_y;
 	gboolean premultiplied;
+	gboolean fast;
 
 	int attention_x;
 	int attention_y;
@@ -201,9 +214,11 @@ pythagoras(VipsSmartcrop *smartcrop, VipsImage *in, VipsImage **out)
 	return 0;
 }
 
+/* Make a one-band interest score for each pixel of a small image.
+ */
 static int
-vips_smartcrop_attention(VipsSmartcrop *smartcrop,
-	VipsImage *in, int *left, int *top, int *attention_x, int *attention_y)
+vips_smartcrop_attention_score(VipsSmartcrop *smartcrop,
+	VipsImage *in, VipsImage **out)
 {
 	/* From smartcrop.js.
 	 */
@@ -211,28 +226,7 @@ vips_smartcrop_attention(VipsSmartcrop *smartcrop,
 	static double ones[] = { 1.0, 1.0, 1.0 };
 
 	VipsImage **t = (VipsImage **)
-		vips_object_local_array(VIPS_OBJECT(smartcrop), 24);
-
-	double hscale;
-	double vscale;
-	double sigma;
-	double max;
-	int x_pos;
-	int y_pos;
-
-	/* The size we shrink to gives the precision with which we can place
-	 * the crop
-	 */
-	hscale = 32.0 / in->Xsize;
-	vscale = 32.0 / in->Ysize;
-	sigma = sqrt(pow(smartcrop->width * hscale, 2) +
-		pow(smartcrop->height * vscale, 2));
-	sigma = VIPS_MAX(sigma / 10, 1.0);
-
-	if (vips_resize(in, &t[17], hscale,
-			"vscale", vscale,
-			NULL))
-		return -1;
+		vips_object_local_array(VIPS_OBJECT(smartcrop), 22);
 
 	/* Simple edge detect.
 	 */
@@ -244,7 +238,7 @@ vips_smartcrop_attention(VipsSmartcrop *smartcrop,
 
 	/* Convert to XYZ and just use the first three bands.
 	 */
-	if (vips_colourspace(t[17], &t[0], VIPS_INTERPRETATION_XYZ, NULL) ||
+	if (vips_colourspace(in, &t[0], VIPS_INTERPRETATION_XYZ, NULL) ||
 		vips_extract_band(t[0], &t[1], 0, "n", 3, NULL))
 		return -1;
 
@@ -290,16 +284,47 @@ vips_smartcrop_attention(VipsSmartcrop *smartcrop,
 		vips_ifthenelse(t[10], t[13], t[11], &t[16], NULL))
 		return -1;
 
-	/* Sum, blur and find maxpos.
+	if (vips_sum(&t[14], out, 3, NULL))
+		return -1;
+
+	return 0;
+}
+
+static int
+vips_smartcrop_attention(VipsSmartcrop *smartcrop,
+	VipsImage *in, int *left, int *top, int *attention_x, int *attention_y)
+{
+	VipsImage **t = (VipsImage **)
+		vips_object_local_array(VIPS_OBJECT(smartcrop), 3);
+
+	double hscale;
+	double vscale;
+	double sigma;
+	double max;
+	int x_pos;
+	int y_pos;
+
+	/* The size we shrink to gives the precision with which we can place
+	 * the crop
+	 */
+	hscale = 32.0 / in->Xsize;
+	vscale = 32.0 / in->Ysize;
+	sigma = sqrt(pow(smartcrop->width * hscale, 2) +
+		pow(smartcrop->height * vscale, 2));
+	sigma = VIPS_MAX(sigma / 10, 1.0);
+
+	/* Score, blur and find maxpos.
 	 *
 	 * The amount of blur is related to the size of the crop
 	 * area: how large an area we want to consider for the scoring
 	 * function.
 	 */
-
-	if (vips_sum(&t[14], &t[18], 3, NULL) ||
-		vips_gaussblur(t[18], &t[19], sigma, NULL) ||
-		vips_max(t[19], &max, "x", &x_pos, "y", &y_pos, NULL))
+	if (vips_resize(in, &t[0], hscale,
+			"vscale", vscale,
+			NULL) ||
+		vips_smartcrop_attention_score(smartcrop, t[0], &t[1]) ||
+		vips_gaussblur(t[1], &t[2], sigma, NULL) ||
+		vips_max(t[2], &max, "x", &x_pos, "y", &y_pos, NULL))
 		return -1;
 
 	/* Transform back into image coordinates.
@@ -319,6 +344,233 @@ vips_smartcrop_attention(VipsSmartcrop *smartcrop,
 	return 0;
 }
 
+/* Box-filter @in down to a proxy about VIPS_SMARTCROP_PROXY pixels across,
+ * and make a memory copy we can walk.
+ */
+static int
+vips_smartcrop_proxy(VipsSmartcrop *smartcrop, VipsImage *in, VipsImage **out)
+{
+	VipsImage **t = (VipsImage **)
+		vips_object_local_array(VIPS_OBJECT(smartcrop), 1);
+
+	double hshrink = VIPS_MAX(1.0, (double) in->Xsize / VIPS_SMARTCROP_PROXY);
+	double vshrink = VIPS_MAX(1.0, (double) in->Ysize / VIPS_SMARTCROP_PROXY);
+
+	if (vips_shrink(in, &t[0], hshrink, vshrink, NULL) ||
+		!(*out = vips_image_copy_memory(t[0])))
+		return -1;
+
+	return 0;
+}
+
+/* Size of the crop window within a proxy.
+ */
+static void
+vips_smartcrop_window(VipsSmartcrop *smartcrop, VipsImage *in,
+	VipsImage *proxy, int *ww, int *wh)
+{
+	*ww = VIPS_CLIP(1,
+		VIPS_RINT((double) smartcrop->width * proxy->Xsize / in->Xsize),
+		proxy->Xsize);
+	*wh = VIPS_CLIP(1,
+		VIPS_RINT((double) smartcrop->height * proxy->Ysize / in->Ysize),
+		proxy->Ysize);
+}
+
+/* Map a window position in a proxy back to a crop position in @in.
+ */
+static void
+vips_smartcrop_unproxy(VipsSmartcrop *smartcrop, VipsImage *in,
+	VipsImage *proxy, int x, int y, int *left, int *top)
+{
+	*left = VIPS_CLIP(0,
+		VIPS_RINT((double) x * in->Xsize / proxy->Xsize),
+		in->Xsize - smartcrop->width);
+	*top = VIPS_CLIP(0,
+		VIPS_RINT((double) y * in->Ysize / proxy->Ysize),
+		in->Ysize - smartcrop->height);
+}
+
+/* Fast entropy: quantise a proxy, build a summed-area table for each
+ * histogram bin, then find the window with the highest entropy in a single
+ * pass.
+ */
+static int
+vips_smartcrop_entropy_fast(VipsSmartcrop *smartcrop,
+	VipsImage *in, int *left, int *top)
+{
+	VipsImage **t = (VipsImage **)
+		vips_object_local_array(VIPS_OBJECT(smartcrop), 3);
+
+	VipsImage *proxy;
+	int pw, ph, bands, n_bins;
+	int ww, wh;
+	int *sat;
+	int *counts;
+	double best;
+	int best_x, best_y;
+	int x, y, b;
+
+	if (vips_smartcrop_proxy(smartcrop, in, &t[0]))
+		return -1;
+	proxy = t[0];
+
+	if (proxy->BandFmt != VIPS_FORMAT_UCHAR) {
+		if (vips_scale(proxy, &t[1], NULL) ||
+			!(t[2] = vips_image_copy_memory(t[1])))
+			return -1;
+		proxy = t[2];
+	}
+
+	pw = proxy->Xsize;
+	ph = proxy->Ysize;
+	bands = proxy->Bands;
+	n_bins = bands * VIPS_SMARTCROP_BINS;
+	vips_smartcrop_window(smartcrop, in, proxy, &ww, &wh);
+
+	/* sat[(y * (pw + 1) + x) * n_bins + bin] is the count for bin in the
+	 * rectangle to the left of and above x, y. Row and column zero stay
+	 * zero.
+	 */
+	sat = VIPS_ARRAY(smartcrop, (size_t) (pw + 1) * (ph + 1) * n_bins, int);
+	counts = VIPS_ARRAY(smartcrop, n_bins, int);
+	if (!sat ||
+		!counts)
+		return -1;
+
+#define SAT(X, Y) (sat + ((size_t) (Y) * (pw + 1) + (X)) * n_bins)
+
+	for (y = 0; y < ph; y++) {
+		VipsPel *p = VIPS_IMAGE_ADDR(proxy, 0, y);
+
+		for (x = 0; x < pw; x++) {
+			int *above = SAT(x + 1, y);
+			int *before = SAT(x, y + 1);
+			int *diag = SAT(x, y);
+			int *here = SAT(x + 1, y + 1);
+
+			for (b = 0; b < n_bins; b++)
+				here[b] = above[b] + before[b] - diag[b];
+
+			for (b = 0; b < bands; b++)
+				here[b * VIPS_SMARTCROP_BINS +
+					p[b] * VIPS_SMARTCROP_BINS / 256] += 1;
+
+			p += bands;
+		}
+	}
+
+	best = -1.0;
+	best_x = 0;
+	best_y = 0;
+	for (y = 0; y <= ph - wh; y++)
+		for (x = 0; x <= pw - ww; x++) {
+			int *tl = SAT(x, y);
+			int *tr = SAT(x + ww, y);
+			int *bl = SAT(x, y + wh);
+			int *br = SAT(x + ww, y + wh);
+			double total = (double) ww * wh * bands;
+
+			double entropy;
+
+			entropy = 0.0;
+			for (b = 0; b < n_bins; b++) {
+				counts[b] = br[b] - bl[b] - tr[b] + tl[b];
+				if (counts[b] > 0) {
+					double p = counts[b] / total;
+
+					entropy -= p * log2(p);
+				}
+			}
+
+			if (entropy > best) {
+				best = entropy;
+				best_x = x;
+				best_y = y;
+			}
+		}
+
+#undef SAT
+
+	vips_smartcrop_unproxy(smartcrop, in, proxy, best_x, best_y, left, top);
+
+	return 0;
+}
+
+/* Fast attention: score a proxy, then find the window with the highest
+ * total score with a summed-area table, rather than blurring and searching
+ * for a single peak.
+ */
+static int
+vips_smartcrop_attention_fast(VipsSmartcrop *smartcrop,
+	VipsImage *in, int *left, int *top, int *attention_x, int *attention_y)
+{
+	VipsImage **t = (VipsImage **)
+		vips_object_local_array(VIPS_OBJECT(smartcrop), 4);
+
+	VipsImage *score;
+	int pw, ph;
+	int ww, wh;
+	double *sat;
+	double best;
+	int best_x, best_y;
+	int x, y;
+
+	if (vips_smartcrop_proxy(smartcrop, in, &t[0]) ||
+		vips_smartcrop_attention_score(smartcrop, t[0], &t[1]) ||
+		vips_cast(t[1], &t[2], VIPS_FORMAT_DOUBLE, NULL) ||
+		!(t[3] = vips_image_copy_memory(t[2])))
+		return -1;
+	score = t[3];
+
+	pw = score->Xsize;
+	ph = score->Ysize;
+	vips_smartcrop_window(smartcrop, in, score, &ww, &wh);
+
+	if (!(sat = VIPS_ARRAY(smartcrop, (size_t) (pw + 1) * (ph + 1), double)))
+		return -1;
+
+#define SAT(X, Y) (sat[(size_t) (Y) * (pw + 1) + (X)])
+
+	for (y = 0; y < ph; y++) {
+		double *p = (double *) VIPS_IMAGE_ADDR(score, 0, y);
+
+		for (x = 0; x < pw; x++)
+			SAT(x + 1, y + 1) = p[x] +
+				SAT(x + 1, y) + SAT(x, y + 1) - SAT(x, y);
+	}
+
+	best = -INFINITY;
+	best_x = 0;
+	best_y = 0;
+	for (y = 0; y <= ph - wh; y++)
+		for (x = 0; x <= pw - ww; x++) {
+			double sum = SAT(x + ww, y + wh) - SAT(x, y + wh) -
+				SAT(x + ww, y) + SAT(x, y);
+
+			if (sum > best) {
+				best = sum;
+				best_x = x;
+				best_y = y;
+			}
+		}
+
+#undef SAT
+
+	vips_smartcrop_unproxy(smartcrop, in, score, best_x, best_y, left, top);
+
+	/* The attention centre is the middle of the best window.
+	 */
+	*attention_x = VIPS_CLIP(0,
+		VIPS_RINT((best_x + ww / 2.0) * in->Xsize / pw),
+		in->Xsize - 1);
+	*attention_y = VIPS_CLIP(0,
+		VIPS_RINT((best_y + wh / 2.0) * in->Ysize / ph),
+		in->Ysize - 1);
+
+	return 0;
+}
+
 static int
 vips_smartcrop_build(VipsObject *object)
 {
@@ -333,6 +585,7 @@ vips_smartcrop_build(VipsObject *object)
 
 	int attention_x = 0;
 	int attention_y = 0;
+	int result;
 
 	if (VIPS_OBJECT_CLASS(vips_smartcrop_parent_class)->build(object))
 		return -1;
@@ -369,14 +622,30 @@ vips_smartcrop_build(VipsObject *object)
 		break;
 
 	case VIPS_INTERESTING_ENTROPY:
-		if (vips_smartcrop_entropy(smartcrop, in, &left, &top))
+		vips_cache_scope_begin();
+		if (smartcrop->fast)
+			result = vips_smartcrop_entropy_fast(smartcrop, in,
+				&left, &top);
+		else
+			result = vips_smartcrop_entropy(smartcrop, in,
+				&left, &top);
+		vips_cache_scope_end();
+		if (result)
 			return -1;
 		break;
 
 	case VIPS_INTERESTING_ATTENTION:
-		if (vips_smartcrop_attention(smartcrop, in,
+		vips_cache_scope_begin();
+		if (smartcrop->fast)
+			result = vips_smartcrop_attention_fast(smartcrop, in,
+				&left, &top,
+				&attention_x, &attention_y);
+		else
+			result = vips_smartcrop_attention(smartcrop, in,
 				&left, &top,
-				&attention_x, &attention_y))
+				&attention_x, &attention_y);
+		vips_cache_scope_end();
+		if (result)
 			return -1;
 		break;
 
@@ -499,6 +768,13 @@ vips_smartcrop_class_init(VipsSmartcropClass *class)
 		VIPS_ARGUMENT_OPTIONAL_INPUT,
 		G_STRUCT_OFFSET(VipsSmartcrop, premultiplied),
 		FALSE);
+
+	VIPS_ARG_BOOL(class, "fast", 10,
+		_("Fast"),
+		_("Score a small proxy and search with summed-area tables"),
+		VIPS_ARGUMENT_OPTIONAL_INPUT,
+		G_STRUCT_OFFSET(VipsSmartcrop, fast),
+		FALSE);
 }
 
 static void
@@ -524,6 +800,12 @@ vips_smartcrop_init(VipsSmartcrop *smartcrop)
  * You can test xoffset / yoffset on @out to find the location of the crop
  * within the input image.
  *
+ * Set @fast to score [enum@Vips.Interesting.ENTROPY] and
+ * [enum@Vips.Interesting.ATTENTION] on a small box-filtered proxy of
+ * @in, and to find the best crop window in a single pass over summed-area
+ * tables. This is much quicker for large images, at the cost of placing the
+ * crop to within about 1/64th of the image size.
+ *
  * ::: tip "Optional arguments"
  *     * @interesting: [enum@Interesting] to use to find interesting areas
  *       (default: [enum@Vips.Interesting.ATTENTION])
@@ -532,6 +814,8 @@ vips_smartcrop_init(VipsSmartcrop *smartcrop)
  *     * @interesting_y: `gint`, vertical position of the specific point of
  *       interest when using [enum@Vips.Interesting.SPECIFIC])
  *     * @premultiplied: `gboolean`, input image already has premultiplied alpha
+ *     * @fast: `gboolean`, score a small proxy and search with summed-area
+ *       tables
  *     * @attention_x: `gint`, output, horizontal position of attention centre when
  *       using attention based cropping
  *     * @attention_y: `gint`, output, vertical position of attention centre when
@@ -35,6 +35,12 @@
  * 	- terminate on tile calc error
  * 7/3/17
  * 	- remove "access" on linecache, use the base class instead
+ * 14/10/26
+ * 	- stripe threaded random access caches over several locks, wait on
+ * 	  per-tile conditions, recycle from a linked list
+ * 	- add "disc" to spill evicted tiles to a temporary file
+ * 15/10/26
+ * 	- tilecache advertises its tiles to sinks
  */
 
 /*
@@ -77,6 +83,14 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif /*HAVE_UNISTD_H*/
+#ifdef G_OS_WIN32
+#include <io.h>
+#endif /*G_OS_WIN32*/
+
+#include <glib/gstdio.h>
 
 #include <vips/vips.h>
 #include <vips/internal.h>
@@ -96,10 +110,16 @@ typedef enum VipsTileState {
 	VIPS_TILE_STATE_PEND
 } VipsTileState;
 
+/* Threaded random access caches are split into this many stripes, each with
+ * its own lock, hash table and recycle list, so threads working on
+ * different parts of the image don't queue on one lock.
+ */
+#define VIPS_TILE_CACHE_STRIPES (16)
+
 /* A tile in our cache.
  */
 typedef struct _VipsTile {
-	struct _VipsBlockCache *cache;
+	struct _VipsTileStripe *stripe;
 
 	VipsTileState state;
 
@@ -115,8 +135,33 @@ typedef struct _VipsTile {
 	 * pointer is NULL.
 	 */
 	VipsRect pos;
+
+	/* Blacked out after a calculation error, never spill this.
+	 */
+	gboolean black;
+
+	/* Threads waiting for this tile to become DATA wait here.
+	 */
+	GCond done;
+
+	/* Tiles with ref_count == 0 are on the stripe's recycle list,
+	 * oldest first.
+	 */
+	struct _VipsTile *prev;
+	struct _VipsTile *next;
 } VipsTile;
 
+/* A part of the cache.
+ */
+typedef struct _VipsTileStripe {
+	struct _VipsBlockCache *cache;
+
+	GMutex lock;	   /* Lock everything in this stripe */
+	GHashTable *tiles; /* Tiles, hashed by coordinates */
+	VipsTile *head;	   /* Unreffed tiles to reuse, oldest first */
+	VipsTile *tail;
+} VipsTileStripe;
+
 typedef struct _VipsBlockCache {
 	VipsConversion parent_instance;
 
@@ -129,10 +174,22 @@ typedef struct _VipsBlockCache {
 	gboolean threaded;
 	gboolean persistent;
 
-	GMutex lock;	   /* Lock everything here */
-	GCond new_tile;	   /* A new tile is ready */
-	GHashTable *tiles; /* Tiles, hashed by coordinates */
-	GQueue *recycle;   /* Queue of unreffed tiles to reuse */
+	/* Unthreaded caches hold this for the whole of a request.
+	 */
+	GMutex lock;
+
+	int n_stripes;
+	VipsTileStripe *stripes;
+
+	/* Tiles evicted from a disc cache go to fixed size slots in a
+	 * temporary file, and are read back rather than recalculated.
+	 */
+	gboolean disc;
+	GMutex spill_lock;
+	int spill_fd;
+	GHashTable *spill; /* Slot + 1 for each spilled tile, by position */
+	gint64 n_slots;
+	VipsPel *spill_buf;
 } VipsBlockCache;
 
 typedef VipsConversionClass VipsBlockCacheClass;
@@ -142,14 +199,186 @@ G_DEFINE_ABSTRACT_TYPE(VipsBlockCache, vips_block_cache,
 
 #define VIPS_TYPE_BLOCK_CACHE (vips_block_cache_get_type())
 
+static unsigned int
+vips_rect_hash(VipsRect *pos)
+{
+	guint hash;
+
+	/* We could shift down by the tile size?
+	 *
+	 * X discrimination is more important than Y, since
+	 * most tiles will have a similar Y.
+	 */
+	hash = (guint) pos->left ^ ((guint) pos->top << 16);
+
+	return hash;
+}
+
+static gboolean
+vips_rect_equal(VipsRect *a, VipsRect *b)
+{
+	return a->left == b->left && a->top == b->top;
+}
+
+/* Forget all spilled tiles.
+ */
+static void
+vips_block_cache_spill_drop(VipsBlockCache *cache)
+{
+	g_mutex_lock(&cache->spill_lock);
+
+	if (cache->spill)
+		g_hash_table_remove_all(cache->spill);
+	if (cache->spill_fd != -1)
+		(void) vips__ftruncate(cache->spill_fd, 0);
+	cache->n_slots = 0;
+
+	g_mutex_unlock(&cache->spill_lock);
+}
+
+/* Write a DATA tile to the spill file. Any failure just turns spilling off,
+ * we can always recalculate.
+ */
+static void
+vips_block_cache_spill(VipsBlockCache *cache, VipsTile *tile)
+{
+	VipsRegion *region = tile->region;
+	VipsRect *r = &region->valid;
+	size_t ls = VIPS_IMAGE_SIZEOF_PEL(cache->in) * r->width;
+	size_t slot_size = VIPS_IMAGE_SIZEOF_PEL(cache->in) *
+		cache->tile_width * cache->tile_height;
+
+	VipsRect *key;
+	VipsPel *q;
+	int y;
+
+	g_mutex_lock(&cache->spill_lock);
+
+	if (!cache->disc ||
+		(cache->spill &&
+			g_hash_table_lookup(cache->spill, &tile->pos))) {
+		g_mutex_unlock(&cache->spill_lock);
+		return;
+	}
+
+	if (cache->spill_fd == -1) {
+		char *filename;
+
+		if (!(filename = vips__temp_name("%s.tiles")) ||
+			(cache->spill_fd =
+					vips__open_image_write(filename, TRUE)) == -1) {
+			g_free(filename);
+			g_warning("unable to open tile spill file: %s",
+				vips_error_buffer());
+			vips_error_clear();
+			cache->disc = FALSE;
+			g_mutex_unlock(&cache->spill_lock);
+			return;
+		}
+
+		/* We don't need the name again, unlink now so we don't
+		 * leave junk behind.
+		 */
+		(void) g_unlink(filename);
+		g_free(filename);
+
+		cache->spill = g_hash_table_new_full(
+			(GHashFunc) vips_rect_hash,
+			(GEqualFunc) vips_rect_equal,
+			g_free,
+			NULL);
+		cache->spill_buf = VIPS_ARRAY(NULL, slot_size, VipsPel);
+	}
+
+	q = cache->spill_buf;
+	for (y = 0; y < r->height; y++) {
+		memcpy(q, VIPS_REGION_ADDR(region, r->left, r->top + y), ls);
+		q += ls;
+	}
+
+	if (vips__seek(cache->spill_fd,
+			cache->n_slots * slot_size, SEEK_SET) == -1 ||
+		vips__write(cache->spill_fd, cache->spill_buf, slot_size)) {
+		g_warning("unable to spill tile: %s", vips_error_buffer());
+		vips_error_clear();
+		cache->disc = FALSE;
+		g_mutex_unlock(&cache->spill_lock);
+		return;
+	}
+
+	key = g_new(VipsRect, 1);
+	*key = tile->pos;
+	g_hash_table_insert(cache->spill, key,
+		GSIZE_TO_POINTER(cache->n_slots + 1));
+	cache->n_slots += 1;
+
+	VIPS_DEBUG_MSG_RED("vips_block_cache_spill: tile %d x %d to slot %d\n",
+		tile->pos.left, tile->pos.top, (int) (cache->n_slots - 1));
+
+	g_mutex_unlock(&cache->spill_lock);
+}
+
+/* Fill a tile from the spill file, if it's there.
+ */
+static gboolean
+vips_block_cache_unspill(VipsBlockCache *cache, VipsTile *tile)
+{
+	VipsRegion *region = tile->region;
+	VipsRect *r = &region->valid;
+	size_t ls = VIPS_IMAGE_SIZEOF_PEL(cache->in) * r->width;
+	size_t slot_size = VIPS_IMAGE_SIZEOF_PEL(cache->in) *
+		cache->tile_width * cache->tile_height;
+
+	gsize slot;
+	VipsPel *p;
+	int y;
+
+	g_mutex_lock(&cache->spill_lock);
+
+	if (!cache->spill ||
+		!(slot = GPOINTER_TO_SIZE(
+			  g_hash_table_lookup(cache->spill, &tile->pos)))) {
+		g_mutex_unlock(&cache->spill_lock);
+		return FALSE;
+	}
+	slot -= 1;
+
+	if (vips__seek(cache->spill_fd, slot * slot_size, SEEK_SET) == -1 ||
+		read(cache->spill_fd, cache->spill_buf, slot_size) !=
+			(gssize) slot_size) {
+		/* Recalculate instead.
+		 */
+		vips_error_clear();
+		g_hash_table_remove(cache->spill, &tile->pos);
+		g_mutex_unlock(&cache->spill_lock);
+		return FALSE;
+	}
+
+	p = cache->spill_buf;
+	for (y = 0; y < r->height; y++) {
+		memcpy(VIPS_REGION_ADDR(region, r->left, r->top + y), p, ls);
+		p += ls;
+	}
+
+	VIPS_DEBUG_MSG_RED("vips_block_cache_unspill: tile %d x %d\n",
+		tile->pos.left, tile->pos.top);
+
+	g_mutex_unlock(&cache->spill_lock);
+
+	return TRUE;
+}
+
 static void
 vips_block_cache_drop_all(VipsBlockCache *cache)
 {
+	int i;
+
 	/* FIXME this is a disaster if active threads are working on tiles. We
 	 * should have something to block new requests, and only dispose once
 	 * all tiles are unreffed.
 	 */
-	g_hash_table_remove_all(cache->tiles);
+	for (i = 0; i < cache->n_stripes; i++)
+		g_hash_table_remove_all(cache->stripes[i].tiles);
 }
 
 static void
@@ -158,7 +387,7 @@ vips_block_cache_finalize(GObject *gobject)
 	VipsBlockCache *cache = (VipsBlockCache *) gobject;
 
 	g_mutex_clear(&cache->lock);
-	g_cond_clear(&cache->new_tile);
+	g_mutex_clear(&cache->spill_lock);
 
 	G_OBJECT_CLASS(vips_block_cache_parent_class)->finalize(gobject);
 }
@@ -168,30 +397,112 @@ vips_block_cache_dispose(GObject *gobject)
 {
 	VipsBlockCache *cache = (VipsBlockCache *) gobject;
 
+	int i;
+
 	vips_block_cache_drop_all(cache);
 
-	if (cache->tiles)
-		g_assert(g_hash_table_size(cache->tiles) == 0);
-	VIPS_FREEF(g_hash_table_destroy, cache->tiles);
-	VIPS_FREEF(g_queue_free, cache->recycle);
+	for (i = 0; i < cache->n_stripes; i++) {
+		VipsTileStripe *stripe = &cache->stripes[i];
+
+		g_assert(g_hash_table_size(stripe->tiles) == 0);
+		VIPS_FREEF(g_hash_table_destroy, stripe->tiles);
+		g_mutex_clear(&stripe->lock);
+	}
+	VIPS_FREE(cache->stripes);
+	cache->n_stripes = 0;
+
+	if (cache->spill_fd != -1) {
+		vips_tracked_close(cache->spill_fd);
+		cache->spill_fd = -1;
+	}
+	VIPS_FREEF(g_hash_table_destroy, cache->spill);
+	VIPS_FREE(cache->spill_buf);
 
 	G_OBJECT_CLASS(vips_block_cache_parent_class)->dispose(gobject);
 }
 
+/* Add to the end of the recycle list.
+ */
+static void
+vips_tile_recycle_append(VipsTile *tile)
+{
+	VipsTileStripe *stripe = tile->stripe;
+
+	tile->prev = stripe->tail;
+	tile->next = NULL;
+	if (stripe->tail)
+		stripe->tail->next = tile;
+	else
+		stripe->head = tile;
+	stripe->tail = tile;
+}
+
+static void
+vips_tile_recycle_remove(VipsTile *tile)
+{
+	VipsTileStripe *stripe = tile->stripe;
+
+	if (tile->prev)
+		tile->prev->next = tile->next;
+	else
+		stripe->head = tile->next;
+	if (tile->next)
+		tile->next->prev = tile->prev;
+	else
+		stripe->tail = tile->prev;
+	tile->prev = NULL;
+	tile->next = NULL;
+}
+
+/* The stripe that holds the tile at x, y. Tiles are always recycled within
+ * a stripe, so a moved tile stays in the same place.
+ */
+static VipsTileStripe *
+vips_tile_stripe(VipsBlockCache *cache, int x, int y)
+{
+	guint tx = x / cache->tile_width;
+	guint ty = y / cache->tile_height;
+
+	return &cache->stripes[(tx * 73856093U ^ ty * 19349663U) %
+		cache->n_stripes];
+}
+
+/* Number of tiles each stripe may hold before it starts recycling.
+ */
+static int
+vips_tile_stripe_max_tiles(VipsBlockCache *cache)
+{
+	if (cache->max_tiles == -1)
+		return -1;
+
+	return VIPS_MAX(1,
+		(cache->max_tiles + cache->n_stripes - 1) / cache->n_stripes);
+}
+
 static int
 vips_tile_move(VipsTile *tile, int x, int y)
 {
+	VipsTileStripe *stripe = tile->stripe;
+
+	/* Save the old pixels for later, if we can.
+	 */
+	if (stripe->cache->disc &&
+		tile->state == VIPS_TILE_STATE_DATA &&
+		!tile->black)
+		vips_block_cache_spill(stripe->cache, tile);
+	tile->black = FALSE;
+
 	/* We are changing x/y and therefore the hash value. We must unlink
 	 * from the old hash position and relink at the new place.
 	 */
-	g_hash_table_steal(tile->cache->tiles, &tile->pos);
+	g_hash_table_steal(stripe->tiles, &tile->pos);
 
 	tile->pos.left = x;
 	tile->pos.top = y;
-	tile->pos.width = tile->cache->tile_width;
-	tile->pos.height = tile->cache->tile_height;
+	tile->pos.width = stripe->cache->tile_width;
+	tile->pos.height = stripe->cache->tile_height;
 
-	g_hash_table_insert(tile->cache->tiles, &tile->pos, tile);
+	g_hash_table_insert(stripe->tiles, &tile->pos, tile);
 
 	if (vips_region_buffer(tile->region, &tile->pos))
 		return -1;
@@ -204,14 +515,16 @@ vips_tile_move(VipsTile *tile, int x, int y)
 }
 
 static VipsTile *
-vips_tile_new(VipsBlockCache *cache, int x, int y)
+vips_tile_new(VipsTileStripe *stripe, int x, int y)
 {
+	VipsBlockCache *cache = stripe->cache;
+
 	VipsTile *tile;
 
 	if (!(tile = VIPS_NEW(NULL, VipsTile)))
 		return NULL;
 
-	tile->cache = cache;
+	tile->stripe = stripe;
 	tile->state = VIPS_TILE_STATE_PEND;
 	tile->ref_count = 0;
 	tile->region = NULL;
@@ -219,18 +532,20 @@ vips_tile_new(VipsBlockCache *cache, int x, int y)
 	tile->pos.top = y;
 	tile->pos.width = cache->tile_width;
 	tile->pos.height = cache->tile_height;
-	g_hash_table_insert(cache->tiles, &tile->pos, tile);
-	g_queue_push_tail(tile->cache->recycle, tile);
+	tile->black = FALSE;
+	g_cond_init(&tile->done);
+	g_hash_table_insert(stripe->tiles, &tile->pos, tile);
+	vips_tile_recycle_append(tile);
 
 	if (!(tile->region = vips_region_new(cache->in))) {
-		g_hash_table_remove(cache->tiles, &tile->pos);
+		g_hash_table_remove(stripe->tiles, &tile->pos);
 		return NULL;
 	}
 
 	vips__region_no_ownership(tile->region);
 
 	if (vips_region_buffer(tile->region, &tile->pos)) {
-		g_hash_table_remove(cache->tiles, &tile->pos);
+		g_hash_table_remove(stripe->tiles, &tile->pos);
 		return NULL;
 	}
 
@@ -240,67 +555,63 @@ vips_tile_new(VipsBlockCache *cache, int x, int y)
 /* Do we have a tile in the cache?
  */
 static VipsTile *
-vips_tile_search(VipsBlockCache *cache, int x, int y)
+vips_tile_search(VipsTileStripe *stripe, int x, int y)
 {
 	VipsRect pos;
 	VipsTile *tile;
 
 	pos.left = x;
 	pos.top = y;
-	pos.width = cache->tile_width;
-	pos.height = cache->tile_height;
-	tile = (VipsTile *) g_hash_table_lookup(cache->tiles, &pos);
+	pos.width = stripe->cache->tile_width;
+	pos.height = stripe->cache->tile_height;
+	tile = (VipsTile *) g_hash_table_lookup(stripe->tiles, &pos);
 
 	return tile;
 }
 
-static void
-vips_tile_find_is_topper(gpointer element, gpointer user_data)
-{
-	VipsTile *this = (VipsTile *) element;
-	VipsTile **best = (VipsTile **) user_data;
-
-	if (!*best ||
-		this->pos.top < (*best)->pos.top)
-		*best = this;
-}
-
 /* Search the recycle list for the topmost tile.
  */
 static VipsTile *
-vips_tile_find_topmost(GQueue *recycle)
+vips_tile_find_topmost(VipsTileStripe *stripe)
 {
+	VipsTile *best;
 	VipsTile *tile;
 
-	tile = NULL;
-	g_queue_foreach(recycle, vips_tile_find_is_topper, &tile);
+	best = NULL;
+	for (tile = stripe->head; tile; tile = tile->next)
+		if (!best ||
+			tile->pos.top < best->pos.top)
+			best = tile;
 
-	return tile;
+	return best;
 }
 
 /* Find existing tile, make a new tile, or if we have a full set of tiles,
  * reuse one.
  */
 static VipsTile *
-vips_tile_find(VipsBlockCache *cache, int x, int y)
+vips_tile_find(VipsTileStripe *stripe, int x, int y)
 {
+	VipsBlockCache *cache = stripe->cache;
+	int max_tiles = vips_tile_stripe_max_tiles(cache);
+
 	VipsTile *tile;
 
 	/* In cache already?
 	 */
-	if ((tile = vips_tile_search(cache, x, y))) {
+	if ((tile = vips_tile_search(stripe, x, y))) {
 		VIPS_DEBUG_MSG_RED(
 			"vips_tile_find: tile %d x %d in cache\n", x, y);
 		return tile;
 	}
 
-	/* VipsBlockCache not full?
+	/* Stripe not full?
 	 */
-	if (cache->max_tiles == -1 ||
-		g_hash_table_size(cache->tiles) < cache->max_tiles) {
+	if (max_tiles == -1 ||
+		g_hash_table_size(stripe->tiles) < max_tiles) {
 		VIPS_DEBUG_MSG_RED(
 			"vips_tile_find: making new tile at %d x %d\n", x, y);
-		if (!(tile = vips_tile_new(cache, x, y)))
+		if (!(tile = vips_tile_new(stripe, x, y)))
 			return NULL;
 
 		return tile;
@@ -309,21 +620,19 @@ vips_tile_find(VipsBlockCache *cache, int x, int y)
 	/* Reuse an old one, if there are any. We just peek the tile pointer,
 	 * it is removed from the recycle list later on _ref.
 	 */
-	if (cache->recycle) {
-		if (cache->access == VIPS_ACCESS_RANDOM)
-			tile = g_queue_peek_head(cache->recycle);
-		else
-			/* This is slower :( We have to search the recycle
-			 * queue.
-			 */
-			tile = vips_tile_find_topmost(cache->recycle);
-	}
+	if (cache->access == VIPS_ACCESS_RANDOM)
+		tile = stripe->head;
+	else
+		/* This is slower :( We have to search the recycle
+		 * list.
+		 */
+		tile = vips_tile_find_topmost(stripe);
 
 	if (!tile) {
 		/* There are no tiles we can reuse -- we have to make another
 		 * for now. They will get culled down again next time around.
 		 */
-		if (!(tile = vips_tile_new(cache, x, y)))
+		if (!(tile = vips_tile_new(stripe, x, y)))
 			return NULL;
 
 		return tile;
@@ -349,16 +658,24 @@ vips_tile_unlocked(gpointer key, gpointer value, gpointer user_data)
 static void
 vips_block_cache_minimise(VipsImage *image, VipsBlockCache *cache)
 {
+	int i;
+
 	VIPS_DEBUG_MSG("vips_block_cache_minimise:\n");
 
-	g_mutex_lock(&cache->lock);
+	for (i = 0; i < cache->n_stripes; i++) {
+		VipsTileStripe *stripe = &cache->stripes[i];
 
-	/* We can't drop tiles that are in use.
-	 */
-	g_hash_table_foreach_remove(cache->tiles,
-		vips_tile_unlocked, NULL);
+		g_mutex_lock(&stripe->lock);
+
+		/* We can't drop tiles that are in use.
+		 */
+		g_hash_table_foreach_remove(stripe->tiles,
+			vips_tile_unlocked, NULL);
 
-	g_mutex_unlock(&cache->lock);
+		g_mutex_unlock(&stripe->lock);
+	}
+
+	vips_block_cache_spill_drop(cache);
 }
 
 static int
@@ -439,48 +756,51 @@ vips_block_cache_class_init(VipsBlockCacheClass *class)
 		FALSE);
 }
 
-static unsigned int
-vips_rect_hash(VipsRect *pos)
-{
-	guint hash;
-
-	/* We could shift down by the tile size?
-	 *
-	 * X discrimination is more important than Y, since
-	 * most tiles will have a similar Y.
-	 */
-	hash = (guint) pos->left ^ ((guint) pos->top << 16);
-
-	return hash;
-}
-
-static gboolean
-vips_rect_equal(VipsRect *a, VipsRect *b)
-{
-	return a->left == b->left && a->top == b->top;
-}
-
 static void
 vips_tile_destroy(VipsTile *tile)
 {
-	VipsBlockCache *cache = tile->cache;
-
 	VIPS_DEBUG_MSG_RED("vips_tile_destroy: tile %d, %d (%p)\n",
 		tile->pos.left, tile->pos.top, tile);
 
 	/* 0 ref tiles should be on the recycle list.
 	 */
 	g_assert(tile->ref_count == 0);
-	g_assert(g_queue_find(tile->cache->recycle, tile));
-	g_queue_remove(cache->recycle, tile);
+	vips_tile_recycle_remove(tile);
 
-	tile->cache = NULL;
+	tile->stripe = NULL;
 
 	VIPS_UNREF(tile->region);
+	g_cond_clear(&tile->done);
 
 	g_free(tile);
 }
 
+/* Split the cache into @n_stripes parts. Call from subclass build.
+ */
+static void
+vips_block_cache_stripes(VipsBlockCache *cache, int n_stripes)
+{
+	int i;
+
+	g_assert(!cache->stripes);
+
+	cache->n_stripes = n_stripes;
+	cache->stripes = VIPS_ARRAY(NULL, n_stripes, VipsTileStripe);
+	for (i = 0; i < n_stripes; i++) {
+		VipsTileStripe *stripe = &cache->stripes[i];
+
+		stripe->cache = cache;
+		g_mutex_init(&stripe->lock);
+		stripe->tiles = g_hash_table_new_full(
+			(GHashFunc) vips_rect_hash,
+			(GEqualFunc) vips_rect_equal,
+			NULL,
+			(GDestroyNotify) vips_tile_destroy);
+		stripe->head = NULL;
+		stripe->tail = NULL;
+	}
+}
+
 static void
 vips_block_cache_init(VipsBlockCache *cache)
 {
@@ -492,13 +812,15 @@ vips_block_cache_init(VipsBlockCache *cache)
 	cache->persistent = FALSE;
 
 	g_mutex_init(&cache->lock);
-	g_cond_init(&cache->new_tile);
-	cache->tiles = g_hash_table_new_full(
-		(GHashFunc) vips_rect_hash,
-		(GEqualFunc) vips_rect_equal,
-		NULL,
-		(GDestroyNotify) vips_tile_destroy);
-	cache->recycle = g_queue_new();
+	cache->n_stripes = 0;
+	cache->stripes = NULL;
+
+	cache->disc = FALSE;
+	g_mutex_init(&cache->spill_lock);
+	cache->spill_fd = -1;
+	cache->spill = NULL;
+	cache->n_slots = 0;
+	cache->spill_buf = NULL;
 }
 
 typedef struct _VipsTileCache {
@@ -517,14 +839,11 @@ vips_tile_unref(VipsTile *tile)
 
 	tile->ref_count -= 1;
 
-	if (tile->ref_count == 0) {
-		/* Place at the end of the recycle queue. We pop from the
-		 * front when selecting an unused tile for reuse.
-		 */
-		g_assert(!g_queue_find(tile->cache->recycle, tile));
-
-		g_queue_push_tail(tile->cache->recycle, tile);
-	}
+	/* Place at the end of the recycle list. We take from the front when
+	 * selecting an unused tile for reuse.
+	 */
+	if (tile->ref_count == 0)
+		vips_tile_recycle_append(tile);
 }
 
 static void
@@ -534,64 +853,8 @@ vips_tile_ref(VipsTile *tile)
 
 	g_assert(tile->ref_count > 0);
 
-	if (tile->ref_count == 1) {
-		g_assert(g_queue_find(tile->cache->recycle, tile));
-
-		g_queue_remove(tile->cache->recycle, tile);
-	}
-}
-
-static void
-vips_tile_cache_unref(GSList *work)
-{
-	GSList *p;
-
-	for (p = work; p; p = p->next)
-		vips_tile_unref((VipsTile *) p->data);
-
-	g_slist_free(work);
-}
-
-/* Make a set of work tiles.
- */
-static GSList *
-vips_tile_cache_ref(VipsBlockCache *cache, VipsRect *r)
-{
-	const int tw = cache->tile_width;
-	const int th = cache->tile_height;
-
-	/* Find top left of tiles we need.
-	 */
-	const int xs = (r->left / tw) * tw;
-	const int ys = (r->top / th) * th;
-
-	GSList *work;
-	VipsTile *tile;
-	int x, y;
-
-	/* Ref all the tiles we will need.
-	 */
-	work = NULL;
-	for (y = ys; y < VIPS_RECT_BOTTOM(r); y += th)
-		for (x = xs; x < VIPS_RECT_RIGHT(r); x += tw) {
-			if (!(tile = vips_tile_find(cache, x, y))) {
-				vips_tile_cache_unref(work);
-				return NULL;
-			}
-
-			vips_tile_ref(tile);
-
-			/* We must append, since we want to keep tile ordering
-			 * for sequential sources.
-			 */
-			work = g_slist_append(work, tile);
-
-			VIPS_DEBUG_MSG_RED(
-				"vips_tile_cache_ref: tile %d, %d (%p)\n",
-				x, y, tile);
-		}
-
-	return work;
+	if (tile->ref_count == 1)
+		vips_tile_recycle_remove(tile);
 }
 
 static void
@@ -615,62 +878,60 @@ vips_tile_cache_gen(VipsRegion *out_region,
 	VipsRegion *in = (VipsRegion *) seq;
 	VipsBlockCache *cache = (VipsBlockCache *) b;
 	VipsRect *r = &out_region->valid;
+	const int tw = cache->tile_width;
+	const int th = cache->tile_height;
+
+	/* Find top left of tiles we need.
+	 */
+	const int xs = (r->left / tw) * tw;
+	const int ys = (r->top / th) * th;
 
+	VipsTileStripe *stripe;
 	VipsTile *tile;
-	GSList *work;
+	GSList *wait;
 	GSList *p;
 	int result;
+	int x, y;
 
 	result = 0;
 
-	VIPS_GATE_START("vips_tile_cache_gen: wait1");
+	/* In non-threaded mode, only one thread at once can be in here, and
+	 * it keeps the cache while it calculates.
+	 */
+	if (!cache->threaded) {
+		VIPS_GATE_START("vips_tile_cache_gen: wait1");
 
-	vips__worker_lock(&cache->lock);
+		vips__worker_lock(&cache->lock);
 
-	VIPS_GATE_STOP("vips_tile_cache_gen: wait1");
+		VIPS_GATE_STOP("vips_tile_cache_gen: wait1");
+	}
 
 	VIPS_DEBUG_MSG_RED(
 		"vips_tile_cache_gen: "
 		"left = %d, top = %d, width = %d, height = %d\n",
 		r->left, r->top, r->width, r->height);
 
-	/* Ref all the tiles we will need.
+	/* Paste any DATA tiles and calculate any PEND tiles, in order, since
+	 * we want to keep tile ordering for sequential sources. Tiles other
+	 * threads are calculating go on a wait list for later.
 	 */
-	work = vips_tile_cache_ref(cache, r);
-
-	while (work) {
-		/* Search for data tiles: easy, we can just paste those in.
-		 */
-		for (;;) {
-			for (p = work; p; p = p->next) {
-				tile = (VipsTile *) p->data;
-
-				if (tile->state == VIPS_TILE_STATE_DATA)
-					break;
-			}
-
-			if (!p)
-				break;
+	wait = NULL;
+	for (y = ys; y < VIPS_RECT_BOTTOM(r); y += th)
+		for (x = xs; x < VIPS_RECT_RIGHT(r); x += tw) {
+			stripe = vips_tile_stripe(cache, x, y);
 
-			VIPS_DEBUG_MSG_RED(
-				"vips_tile_cache_gen: pasting %p\n",
-				tile);
+			VIPS_GATE_START("vips_tile_cache_gen: wait2");
 
-			vips_tile_paste(tile, out_region);
+			vips__worker_lock(&stripe->lock);
 
-			/* We're done with this tile.
-			 */
-			work = g_slist_remove(work, tile);
-			vips_tile_unref(tile);
-		}
+			VIPS_GATE_STOP("vips_tile_cache_gen: wait2");
 
-		/* Calculate the first PEND tile we find on the work list. We
-		 * don't calculate all PEND tiles since after the first, more
-		 * DATA tiles might heve been made available by other threads
-		 * and we want to get them out of the way as soon as we can.
-		 */
-		for (p = work; p; p = p->next) {
-			tile = (VipsTile *) p->data;
+			if (!(tile = vips_tile_find(stripe, x, y))) {
+				g_mutex_unlock(&stripe->lock);
+				result = -1;
+				continue;
+			}
+			vips_tile_ref(tile);
 
 			if (tile->state == VIPS_TILE_STATE_PEND) {
 				tile->state = VIPS_TILE_STATE_CALC;
@@ -679,29 +940,24 @@ vips_tile_cache_gen(VipsRegion *out_region,
 					"vips_tile_cache_gen: calc of %p\n",
 					tile);
 
-				/* In threaded mode, we let other threads run
-				 * while we calc this tile. In non-threaded
-				 * mode, we keep the lock and make 'em wait.
+				/* Let other threads use the stripe while we
+				 * calc this tile. Our ref keeps it in place.
 				 */
-				if (cache->threaded)
-					g_mutex_unlock(&cache->lock);
+				g_mutex_unlock(&stripe->lock);
 
 				/* Don't compute if we've seen an error
-				 * previously.
+				 * previously. Tiles we spilled to disc
+				 * can just be read back.
 				 */
-				if (!result)
+				if (!result &&
+					!(cache->disc &&
+						vips_block_cache_unspill(cache, tile)))
 					result = vips_region_prepare_to(in,
 						tile->region,
 						&tile->pos,
 						tile->pos.left, tile->pos.top);
 
-				if (cache->threaded) {
-					VIPS_GATE_START("vips_tile_cache_gen: wait2");
-
-					g_mutex_lock(&cache->lock);
-
-					VIPS_GATE_STOP("vips_tile_cache_gen: wait2");
-				}
+				vips__worker_lock(&stripe->lock);
 
 				/* If there was an error calculating this
 				 * tile, black it out and terminate
@@ -719,47 +975,62 @@ vips_tile_cache_gen(VipsRegion *out_region,
 						tile->pos.left, tile->pos.top);
 
 					vips_region_black(tile->region);
+					tile->black = TRUE;
 
 					*stop = TRUE;
 				}
 
 				tile->state = VIPS_TILE_STATE_DATA;
 
-				/* Let everyone know there's a new DATA tile.
-				 * They need to all check their work lists.
+				/* Wake anyone waiting for this tile.
 				 */
-				g_cond_broadcast(&cache->new_tile);
+				g_cond_broadcast(&tile->done);
+			}
+
+			if (tile->state == VIPS_TILE_STATE_DATA) {
+				VIPS_DEBUG_MSG_RED(
+					"vips_tile_cache_gen: pasting %p\n",
+					tile);
 
-				break;
+				vips_tile_paste(tile, out_region);
+				vips_tile_unref(tile);
 			}
+			else
+				wait = g_slist_prepend(wait, tile);
+
+			g_mutex_unlock(&stripe->lock);
 		}
 
-		/* There are no PEND or DATA tiles, we must need a tile some
-		 * other thread is currently calculating.
-		 *
-		 * We must block until the CALC tiles we need are done.
-		 */
-		if (!p &&
-			work) {
-			for (p = work; p; p = p->next) {
-				tile = (VipsTile *) p->data;
+	/* Block until the tiles other threads are calculating are done. We
+	 * still hold a ref to each, so they can't be recycled.
+	 */
+	for (p = wait; p; p = p->next) {
+		tile = (VipsTile *) p->data;
+		stripe = tile->stripe;
 
-				g_assert(tile->state == VIPS_TILE_STATE_CALC);
-			}
+		vips__worker_lock(&stripe->lock);
 
+		while (tile->state != VIPS_TILE_STATE_DATA) {
 			VIPS_DEBUG_MSG_RED("vips_tile_cache_gen: waiting\n");
 
 			VIPS_GATE_START("vips_tile_cache_gen: wait3");
 
-			vips__worker_cond_wait(&cache->new_tile, &cache->lock);
+			vips__worker_cond_wait(&tile->done, &stripe->lock);
 
 			VIPS_GATE_STOP("vips_tile_cache_gen: wait3");
 
 			VIPS_DEBUG_MSG("vips_tile_cache_gen: awake!\n");
 		}
+
+		vips_tile_paste(tile, out_region);
+		vips_tile_unref(tile);
+
+		g_mutex_unlock(&stripe->lock);
 	}
+	g_slist_free(wait);
 
-	g_mutex_unlock(&cache->lock);
+	if (!cache->threaded)
+		g_mutex_unlock(&cache->lock);
 
 	return result;
 }
@@ -779,6 +1050,20 @@ vips_tile_cache_build(VipsObject *object)
 	if (vips_image_pio_input(block_cache->in))
 		return -1;
 
+	/* Only threaded random access gains from striping. Sequential access
+	 * needs to see every tile to find the topmost, and non-threaded
+	 * access is serialised anyway.
+	 */
+	if (block_cache->threaded &&
+		block_cache->access == VIPS_ACCESS_RANDOM)
+		vips_block_cache_stripes(block_cache,
+			block_cache->max_tiles == -1
+				? VIPS_TILE_CACHE_STRIPES
+				: VIPS_CLIP(1, block_cache->max_tiles,
+					  VIPS_TILE_CACHE_STRIPES));
+	else
+		vips_block_cache_stripes(block_cache, 1);
+
 	if (vips_image_pipelinev(conversion->out,
 			VIPS_DEMAND_STYLE_SMALLTILE, block_cache->in, NULL))
 		return -1;
@@ -787,6 +1072,8 @@ vips_tile_cache_build(VipsObject *object)
 		VIPS_META_TILE_WIDTH, block_cache->tile_width);
 	vips_image_set_int(conversion->out,
 		VIPS_META_TILE_HEIGHT, block_cache->tile_height);
+	vips__image_set_natural_tile(conversion->out,
+		block_cache->tile_width, block_cache->tile_height);
 
 	if (vips_image_generate(conversion->out,
 			vips_start_one, vips_tile_cache_gen, vips_stop_one,
@@ -824,6 +1111,13 @@ vips_tile_cache_class_init(VipsTileCacheClass *class)
 		VIPS_ARGUMENT_OPTIONAL_INPUT,
 		G_STRUCT_OFFSET(VipsBlockCache, max_tiles),
 		-1, 1000000, 1000);
+
+	VIPS_ARG_BOOL(class, "disc", 9,
+		_("Disc"),
+		_("Spill evicted tiles to disc"),
+		VIPS_ARGUMENT_OPTIONAL_INPUT,
+		G_STRUCT_OFFSET(VipsBlockCache, disc),
+		FALSE);
 }
 
 static void
@@ -858,10 +1152,18 @@ vips_tile_cache_init(VipsTileCache *cache)
  * Normally, only a single thread at once is allowed to calculate tiles. If
  * you set @threaded to `TRUE`, [method@Image.tilecache] will allow many
  * threads to calculate tiles at once, and share the cache between them.
+ * With random access, a threaded cache is split into several independently
+ * locked parts, and @max_tiles is shared between them.
  *
  * Normally the cache is dropped when computation finishes. Set @persistent to
  * `TRUE` to keep the cache between computations.
  *
+ * Set @disc to `TRUE` to write tiles to a temporary file as they are
+ * evicted. When they are needed again, they are read back rather than
+ * recalculated. This is useful with @persistent for interactive viewers,
+ * where revisiting an area of a large image would otherwise recompute
+ * it. Only @max_tiles tiles are held in memory.
+ *
  * ::: tip "Optional arguments"
  *     * @tile_width: `gint`, width of tiles in cache
  *     * @tile_height: `gint`, height of tiles in cache
@@ -869,6 +1171,7 @@ vips_tile_cache_init(VipsTileCache *cache)
  *     * @access: [enum@Access], hint expected access pattern
  *     * @threaded: `gboolean`, allow many threads
  *     * @persistent: `gboolean`, don't drop cache at end of computation
+ *     * @disc: `gboolean`, spill evicted tiles to disc
  *
  * ::: seealso
  *     [method@Image.linecache].
@@ -976,6 +1279,10 @@ vips_line_cache_build(VipsObject *object)
 	if (vips_image_pio_input(block_cache->in))
 		return -1;
 
+	/* max_tiles can grow during computation, so use a single stripe.
+	 */
+	vips_block_cache_stripes(block_cache, 1);
+
 	if (vips_image_pipelinev(conversion->out,
 			VIPS_DEMAND_STYLE_THINSTRIP, block_cache->in, NULL))
 		return -1;
@@ -11,6 +11,8 @@
  * 	- revise range clipping and 1/x, again
  * 8/8/22
  *      - look for alpha near 0, not just exactly 0
+ * 15/10/26
+ * 	- add a SIMD path for float RGBA
  */
 
 /*
@@ -55,6 +57,7 @@
 #include <math.h>
 
 #include <vips/vips.h>
+#include <vips/vector.h>
 #include <vips/internal.h>
 #include <vips/debug.h>
 
@@ -69,6 +72,10 @@ typedef struct _VipsUnpremultiply {
 	int alpha_band;
 	gboolean uchar;
 
+	/* Use the SIMD path for float RGBA.
+	 */
+	gboolean vector;
+
 	/* LUT for fast uchar -> uchar path. 8.8 bits of precision.
 	 */
 	int scale[256];
@@ -206,6 +213,13 @@ vips_unpremultiply_gen(VipsRegion *out_region,
 		VipsPel *in = VIPS_REGION_ADDR(ir, r->left, r->top + y);
 		VipsPel *out = VIPS_REGION_ADDR(out_region, r->left, r->top + y);
 
+#ifdef HAVE_HWY
+		if (unpremultiply->vector) {
+			vips_unpremultiply_float_hwy(out, in, width, max_alpha);
+			continue;
+		}
+#endif /*HAVE_HWY*/
+
 		if (unpremultiply->uchar)
 			// fast uchar -> uchar path
 			for (int x = 0; x < width; x++) {
@@ -327,6 +341,12 @@ vips_unpremultiply_build(VipsObject *object)
 	else
 		conversion->out->BandFmt = VIPS_FORMAT_FLOAT;
 
+	unpremultiply->vector = vips_vector_isenabled() &&
+		!unpremultiply->uchar &&
+		in->Bands == 4 &&
+		in->BandFmt == VIPS_FORMAT_FLOAT &&
+		unpremultiply->alpha_band == 3;
+
 	if (vips_image_generate(conversion->out,
 			vips_start_one, vips_unpremultiply_gen, vips_stop_one,
 			in, unpremultiply))
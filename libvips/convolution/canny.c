@@ -1,4 +1,7 @@
 /* Canny edge detector
+ *
+ * 15/10/26
+ * 	- find G/theta in a single pass
  */
 
 /*
@@ -43,6 +46,8 @@
 
 #include <vips/vips.h>
 
+#include "pconvolution.h"
+
 typedef struct _VipsCanny {
 	VipsOperation parent_instance;
 
@@ -51,25 +56,25 @@ typedef struct _VipsCanny {
 
 	double sigma;
 	VipsPrecision precision;
-
-	/* Need an image vector for start_many.
-	 */
-	VipsImage *args[3];
 } VipsCanny;
 
 typedef VipsOperationClass VipsCannyClass;
 
 G_DEFINE_TYPE(VipsCanny, vips_canny, VIPS_TYPE_OPERATION);
 
-/* Simple 2x2 -1/+1 difference. For uchar, we try to hit the vector path and
- * use an offset rather than -ves. Otherwise it's float or double output.
+/* Calculate G/theta in a single pass with a simple 2x2 -1/+1 difference. We
+ * code theta as 0-256 for 0-360 and skip the sqrt on G. uchar images make
+ * uchar G/theta, everything else is float or double.
+ *
+ * For a white disc on a black background, theta is 0 at the top, 64 on the
+ * left, 128 on the right and 192 on the right edge.
  */
 static int
-vips_canny_gradient(VipsImage *in, VipsImage **Gx, VipsImage **Gy)
+vips_canny_polar(VipsImage *in, VipsImage **out)
 {
 	VipsImage *scope;
 	VipsImage **t;
-	VipsPrecision precision;
+	VipsBandFormat format;
 
 	scope = vips_image_new();
 	t = (VipsImage **) vips_object_local_array((VipsObject *) scope, 2);
@@ -78,16 +83,15 @@ vips_canny_gradient(VipsImage *in, VipsImage **Gx, VipsImage **Gy)
 		-1.0, 1.0,
 		-1.0, 1.0);
 
-	if (in->BandFmt == VIPS_FORMAT_UCHAR) {
-		precision = VIPS_PRECISION_INTEGER;
-		vips_image_set_double(t[0], "offset", 128.0);
-	}
+	if (in->BandFmt == VIPS_FORMAT_UCHAR)
+		format = VIPS_FORMAT_UCHAR;
+	else if (in->BandFmt == VIPS_FORMAT_DOUBLE)
+		format = VIPS_FORMAT_DOUBLE;
 	else
-		precision = VIPS_PRECISION_FLOAT;
+		format = VIPS_FORMAT_FLOAT;
 
-	if (vips_conv(in, Gx, t[0], "precision", precision, NULL) ||
-		vips_rot90(t[0], &t[1], NULL) ||
-		vips_conv(in, Gy, t[1], "precision", precision, NULL)) {
+	if (vips_rot90(t[0], &t[1], NULL) ||
+		vips__convmulti(in, out, t, 2, VIPS_CONVMULTI_POLAR, format)) {
 		g_object_unref(scope);
 		return -1;
 	}
@@ -97,158 +101,6 @@ vips_canny_gradient(VipsImage *in, VipsImage **Gx, VipsImage **Gy)
 	return 0;
 }
 
-/* LUT for calculating atan2() with +/- 4 bits of precision in each axis.
- */
-static VipsPel vips_canny_polar_atan2[256];
-
-/* For the uchar path, gx/gy are -128 to +127, and we need -8 to +7 for the
- * atan2 LUT.
- *
- * For G, we should calculate sqrt(gx * gx + gy * gy), however we are only
- * interested in relative magnitude (max of sqrt), so we can skip the sqrt
- * itself. We need a result that will fit in 0 - 255, so shift down.
- */
-#define POLAR_UCHAR \
-	{ \
-		for (x = 0; x < r->width; x++) { \
-			for (band = 0; band < Gx->Bands; band++) { \
-				int gx = p1[band] - 128; \
-				int gy = p2[band] - 128; \
-\
-				int i = ((gx >> 4) & 0xf) | (gy & 0xf0); \
-\
-				q[0] = (gx * gx + gy * gy + 256) >> 9; \
-				q[1] = vips_canny_polar_atan2[i]; \
-\
-				q += 2; \
-			} \
-\
-			p1 += Gx->Bands; \
-			p2 += Gx->Bands; \
-		} \
-	}
-
-/* Float/double path. We keep the same ranges as the uchar path to reduce
- * confusion.
- */
-#define POLAR(TYPE) \
-	{ \
-		TYPE *tp1 = (TYPE *) p1; \
-		TYPE *tp2 = (TYPE *) p2; \
-		TYPE *tq = (TYPE *) q; \
-\
-		for (x = 0; x < r->width; x++) { \
-			for (band = 0; band < Gx->Bands; band++) { \
-				double gx = tp1[band]; \
-				double gy = tp2[band]; \
-				double theta = VIPS_DEG(atan2(gx, gy)); \
-\
-				tq[0] = (gx * gx + gy * gy + 256.0) / 512.0; \
-				tq[1] = 256.0 * fmod(theta + 360.0, 360.0) / 360.0; \
-\
-				tq += 2; \
-			} \
-\
-			tp1 += Gx->Bands; \
-			tp2 += Gx->Bands; \
-		} \
-	}
-
-static int
-vips_canny_polar_generate(VipsRegion *out_region,
-	void *vseq, void *a, void *b, gboolean *stop)
-{
-	VipsRegion **in = (VipsRegion **) vseq;
-	VipsRect *r = &out_region->valid;
-	VipsImage *Gx = in[0]->im;
-
-	int x, y, band;
-
-	if (vips_reorder_prepare_many(out_region->im, in, r))
-		return -1;
-
-	for (y = 0; y < r->height; y++) {
-		VipsPel *p1 = (VipsPel *restrict)
-			VIPS_REGION_ADDR(in[0], r->left, r->top + y);
-		VipsPel *p2 = (VipsPel *restrict)
-			VIPS_REGION_ADDR(in[1], r->left, r->top + y);
-		VipsPel *q = (VipsPel *restrict)
-			VIPS_REGION_ADDR(out_region, r->left, r->top + y);
-
-		switch (Gx->BandFmt) {
-		case VIPS_FORMAT_UCHAR:
-			POLAR_UCHAR;
-			break;
-
-		case VIPS_FORMAT_FLOAT:
-			POLAR(float);
-			break;
-
-		case VIPS_FORMAT_DOUBLE:
-			POLAR(double);
-			break;
-
-		default:
-			g_assert(FALSE);
-		}
-	}
-
-	return 0;
-}
-
-static void *
-vips_atan2_init(void *null)
-{
-	int i;
-
-	for (i = 0; i < 256; i++) {
-		/* Use the bottom 4 bits for x, the top 4 for y. Interpret the
-		 * 4-bit values as signed 2s complement and sign-extend to int.
-		 */
-		int x = i & 0xF;
-		if (x & 0x8)
-			x -= 0x10;
-		int y = (i >> 4) & 0xF;
-		if (y & 0x8)
-			y -= 0x10;
-		double theta = VIPS_DEG(atan2(x, y)) + 360;
-
-		/* Map angle to 0-255 with wraparound.
-		 */
-		int value = 256 * theta / 360;
-		vips_canny_polar_atan2[i] = value & 0xFF;
-	}
-
-	return NULL;
-}
-
-/* Calculate G/theta from Gx/Gy. We code theta as 0-256 for 0-360
- * and skip the sqrt on G.
- *
- * For a white disc on a black background, theta is 0 at the top, 64 on the
- * left, 128 on the right and 192 on the right edge.
- */
-static int
-vips_canny_polar(VipsImage **args, VipsImage **out)
-{
-	static GOnce once = G_ONCE_INIT;
-
-	g_once(&once, vips_atan2_init, NULL);
-
-	*out = vips_image_new();
-	if (vips_image_pipeline_array(*out,
-			VIPS_DEMAND_STYLE_THINSTRIP, args))
-		return -1;
-	(*out)->Bands *= 2;
-
-	if (vips_image_generate(*out,
-			vips_start_many, vips_canny_polar_generate, vips_stop_many,
-			args, NULL))
-		return -1;
-
-	return 0;
-}
-
 #define THIN(TYPE) \
 	{ \
 		TYPE *tp = (TYPE *) p; \
@@ -396,15 +248,9 @@ vips_canny_build(VipsObject *object)
 		return -1;
 	in = t[0];
 
-	if (vips_canny_gradient(in, &t[1], &t[2]))
-		return -1;
-
 	/* Form (G, theta).
 	 */
-	canny->args[0] = t[1];
-	canny->args[1] = t[2];
-	canny->args[2] = NULL;
-	if (vips_canny_polar(canny->args, &t[3]))
+	if (vips_canny_polar(in, &t[3]))
 		return -1;
 	in = t[3];
 
@@ -7,6 +7,8 @@
  *        the default
  * 2/11/17
  * 	- add MIN mode
+ * 15/10/26
+ * 	- float compass runs all the masks in a single pass
  */
 
 /*
@@ -62,13 +64,66 @@ typedef VipsConvolutionClass VipsCompassClass;
 
 G_DEFINE_TYPE(VipsCompass, vips_compass, VIPS_TYPE_CONVOLUTION);
 
+/* Float convolutions of uncoded, non-complex images can be done in a single
+ * pass.
+ */
+static gboolean
+vips_compass_fusable(VipsCompass *compass)
+{
+	VipsImage *in = ((VipsConvolution *) compass)->in;
+
+	return compass->precision == VIPS_PRECISION_FLOAT &&
+		in->Coding == VIPS_CODING_NONE &&
+		!vips_band_format_iscomplex(in->BandFmt);
+}
+
+static int
+vips_compass_build_fused(VipsCompass *compass, VipsImage **masks)
+{
+	VipsObject *object = (VipsObject *) compass;
+	VipsConvolution *convolution = (VipsConvolution *) compass;
+	VipsImage **t = (VipsImage **) vips_object_local_array(object, 1);
+
+	VipsConvmultiMode mode;
+
+	switch (compass->combine) {
+	case VIPS_COMBINE_MAX:
+		mode = VIPS_CONVMULTI_MAX;
+		break;
+
+	case VIPS_COMBINE_MIN:
+		mode = VIPS_CONVMULTI_MIN;
+		break;
+
+	case VIPS_COMBINE_SUM:
+		mode = VIPS_CONVMULTI_SUM;
+		break;
+
+	default:
+		g_assert_not_reached();
+
+		/* Stop compiler warnings.
+		 */
+		mode = VIPS_CONVMULTI_MAX;
+	}
+
+	if (vips__convmulti(convolution->in, &t[0], masks, compass->times,
+			mode,
+			convolution->in->BandFmt == VIPS_FORMAT_DOUBLE
+				? VIPS_FORMAT_DOUBLE
+				: VIPS_FORMAT_FLOAT) ||
+		vips_image_write(t[0], convolution->out))
+		return -1;
+
+	return 0;
+}
+
 static int
 vips_compass_build(VipsObject *object)
 {
 	VipsConvolution *convolution = (VipsConvolution *) object;
 	VipsCompass *compass = (VipsCompass *) object;
 	VipsImage **masks;
-	VipsImage *mask;
 	VipsImage **images;
 	int i;
 	VipsImage **abs;
@@ -89,21 +144,26 @@ vips_compass_build(VipsObject *object)
 	combine = (VipsImage **)
 		vips_object_local_array(object, compass->times);
 
-	mask = convolution->M;
-	for (i = 0; i < compass->times; i++) {
-		if (vips_conv(convolution->in, &images[i], mask,
+	/* All the rotated masks, starting from the original.
+	 */
+	masks[0] = convolution->M;
+	g_object_ref(masks[0]);
+	for (i = 1; i < compass->times; i++)
+		if (vips_rot45(masks[i - 1], &masks[i],
+				"angle", compass->angle,
+				NULL))
+			return -1;
+
+	if (vips_compass_fusable(compass))
+		return vips_compass_build_fused(compass, masks);
+
+	for (i = 0; i < compass->times; i++)
+		if (vips_conv(convolution->in, &images[i], masks[i],
 				"precision", compass->precision,
 				"layers", compass->layers,
 				"cluster", compass->cluster,
 				NULL))
 			return -1;
-		if (vips_rot45(mask, &masks[i],
-				"angle", compass->angle,
-				NULL))
-			return -1;
-
-		mask = masks[i];
-	}
 
 	for (i = 0; i < compass->times; i++)
 		if (vips_abs(images[i], &abs[i], NULL))
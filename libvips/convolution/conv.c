@@ -5,6 +5,8 @@
  * 8/5/17
  * 	- default to float ... int will often lose precision and should not be
  * 	  the default
+ * 14/10/26
+ * 	- cache the input if overlaps would recompute a lot
  */
 
 /*
@@ -81,9 +83,11 @@ vips_conv_build(VipsObject *object)
 
 	/* Unpack for processing.
 	 */
-	if (vips_image_decode(in, &t[0]))
+	if (vips_image_decode(in, &t[0]) ||
+		vips__reorder_cache(t[0], &t[2],
+			convolution->M->Xsize, convolution->M->Ysize))
 		return -1;
-	in = t[0];
+	in = t[2];
 
 	switch (conv->precision) {
 	case VIPS_PRECISION_FLOAT:
@@ -194,6 +198,12 @@ vips_conv_init(VipsConv *conv)
  * Disable the vector path with `--vips-novector` or `VIPS_NOVECTOR` or
  * [func@vector_set_enabled].
  *
+ * If libvips was built with OpenCL and there is a GPU,
+ * [enum@Vips.Precision.FLOAT] convolution of
+ * [enum@Vips.BandFormat.FLOAT] images with masks of 25 or more non-zero
+ * elements runs on the GPU. Disable this with `--vips-nogpu` or
+ * `VIPS_NOGPU` or [func@gpu_set_enabled].
+ *
  * If @precision is [enum@Vips.Precision.APPROXIMATE] then, like
  * [enum@Vips.Precision.INTEGER], @mask is converted to int before
  * convolution, and the output image
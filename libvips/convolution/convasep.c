@@ -9,6 +9,8 @@
  *      - from im_conv()
  * 5/7/16
  * 	- redone as a class
+ * 14/10/26
+ * 	- cache the input if overlaps would recompute a lot
  */
 
 /*
@@ -849,7 +851,7 @@ vips_convasep_build(VipsObject *object)
 	VipsObjectClass *class = VIPS_OBJECT_GET_CLASS(object);
 	VipsConvolution *convolution = (VipsConvolution *) object;
 	VipsConvasep *convasep = (VipsConvasep *) object;
-	VipsImage **t = (VipsImage **) vips_object_local_array(object, 4);
+	VipsImage **t = (VipsImage **) vips_object_local_array(object, 5);
 
 	VipsImage *in;
 
@@ -867,8 +869,11 @@ vips_convasep_build(VipsObject *object)
 	convasep->width = convasep->iM->Xsize * convasep->iM->Ysize;
 	in = convolution->in;
 
-	if (vips_convasep_decompose(convasep))
+	if (vips_convasep_decompose(convasep) ||
+		vips__reorder_cache(in, &t[4],
+			convasep->width, convasep->width))
 		return -1;
+	in = t[4];
 
 	g_object_set(convasep, "out", vips_image_new(), NULL);
 	if (
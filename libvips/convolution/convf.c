@@ -51,6 +51,10 @@
  * 	- remove pts for a small speedup
  * 2/8/22 kleisauke
  * 	- bake the scale into the mask
+ * 14/10/26
+ * 	- add a highway path for uchar, float and double images
+ * 15/10/26
+ * 	- offload large masks on float images to the GPU, if we can
  */
 
 /*
@@ -94,6 +98,9 @@
 #include <limits.h>
 
 #include <vips/vips.h>
+#include <vips/vector.h>
+#include <vips/gpu.h>
+#include <vips/internal.h>
 
 #include "pconvolution.h"
 
@@ -105,8 +112,18 @@ typedef struct {
 	int nnz;		/* Number of non-zero mask elements */
 	double *coeff;	/* Array of non-zero mask coefficients */
 	int *coeff_pos; /* Index of each nnz element in mask->coeff */
+	float *fcoeff;	/* coeff as float, for the vector path */
+
+	/* Try to compute tiles on the GPU.
+	 */
+	gboolean gpu;
 } VipsConvf;
 
+/* Smaller masks don't do enough work per pixel to pay for the copy to the
+ * device and back.
+ */
+#define VIPS_CONVF_GPU_MIN_NNZ (25)
+
 typedef VipsConvolutionClass VipsConvfClass;
 
 G_DEFINE_TYPE(VipsConvf, vips_convf, VIPS_TYPE_CONVOLUTION);
@@ -166,7 +183,8 @@ vips_convf_start(VipsImage *out, void *a, void *b)
 		OTYPE *restrict q = (OTYPE *) VIPS_REGION_ADDR(out_region, le, y); \
 		int *restrict offsets = seq->offsets; \
 \
-		for (x = 0; x < sz; x++) { \
+		p += x0; \
+		for (x = x0; x < sz; x++) { \
 			double sum; \
 			int i; \
 \
@@ -179,6 +197,39 @@ vips_convf_start(VipsImage *out, void *a, void *b)
 		} \
 	}
 
+#ifdef HAVE_HWY
+/* Vector path for a line. Returns the number of elements done, the scalar
+ * loop finishes the line.
+ */
+static int
+vips_convf_hwy(VipsConvf *convf, VipsConvfSequence *seq,
+	VipsRegion *out_region, int y, int sz, double offset)
+{
+	VipsRegion *ir = seq->ir;
+	VipsPel *p = VIPS_REGION_ADDR(ir, out_region->valid.left, y);
+	VipsPel *q = VIPS_REGION_ADDR(out_region, out_region->valid.left, y);
+
+	switch (ir->im->BandFmt) {
+	case VIPS_FORMAT_UCHAR:
+		return vips_convf_uchar_hwy((float *) q, p, sz,
+			convf->nnz, seq->offsets, convf->fcoeff, offset);
+
+	case VIPS_FORMAT_FLOAT:
+	case VIPS_FORMAT_COMPLEX:
+		return vips_convf_float_hwy((float *) q, (float *) p, sz,
+			convf->nnz, seq->offsets, convf->fcoeff, offset);
+
+	case VIPS_FORMAT_DOUBLE:
+	case VIPS_FORMAT_DPCOMPLEX:
+		return vips_convf_double_hwy((double *) q, (double *) p, sz,
+			convf->nnz, seq->offsets, convf->coeff, offset);
+
+	default:
+		return 0;
+	}
+}
+#endif /*HAVE_HWY*/
+
 /* Convolve!
  */
 static int
@@ -200,9 +251,11 @@ vips_convf_gen(VipsRegion *out_region,
 	int bo = VIPS_RECT_BOTTOM(r);
 	int sz = VIPS_REGION_N_ELEMENTS(out_region) *
 		(vips_band_format_iscomplex(in->BandFmt) ? 2 : 1);
+	gboolean vector = vips_vector_isenabled();
 
 	VipsRect s;
 	int x, y, z, i;
+	int x0;
 
 	/* Prepare the section of the input image we need. A little larger
 	 * than the section of the output image we are producing.
@@ -231,9 +284,31 @@ vips_convf_gen(VipsRegion *out_region,
 		}
 	}
 
+	/* The GPU will fail and turn itself off if the device goes away, and
+	 * we then fall back to the CPU.
+	 */
+	if (convf->gpu &&
+		!vips__gpu_convf(
+			(float *) VIPS_REGION_ADDR(out_region, le, to),
+			VIPS_REGION_LSKIP(out_region) / sizeof(float),
+			(float *) VIPS_REGION_ADDR(ir, le, to),
+			VIPS_REGION_LSKIP(ir) / sizeof(float),
+			r->width, r->height, in->Bands,
+			M->Xsize, M->Ysize,
+			convf->fcoeff, convf->coeff_pos, nnz, offset)) {
+		VIPS_COUNT_PIXELS(out_region, "vips_convf_gen");
+		return 0;
+	}
+
 	VIPS_GATE_START("vips_convf_gen: work");
 
 	for (y = to; y < bo; y++) {
+		x0 = 0;
+#ifdef HAVE_HWY
+		if (vector)
+			x0 = vips_convf_hwy(convf, seq, out_region, y, sz, offset);
+#endif /*HAVE_HWY*/
+
 		switch (in->BandFmt) {
 		case VIPS_FORMAT_UCHAR:
 			CONV_FLOAT(unsigned char, float);
@@ -309,7 +384,8 @@ vips_convf_build(VipsObject *object)
 		coeff[i] /= scale;
 
 	if (!(convf->coeff = VIPS_ARRAY(object, ne, double)) ||
-		!(convf->coeff_pos = VIPS_ARRAY(object, ne, int)))
+		!(convf->coeff_pos = VIPS_ARRAY(object, ne, int)) ||
+		!(convf->fcoeff = VIPS_ARRAY(object, ne, float)))
 		return -1;
 
 	/* Find non-zero mask elements.
@@ -330,8 +406,16 @@ vips_convf_build(VipsObject *object)
 		convf->nnz = 1;
 	}
 
+	for (i = 0; i < convf->nnz; i++)
+		convf->fcoeff[i] = convf->coeff[i];
+
 	in = convolution->in;
 
+	convf->gpu = in->BandFmt == VIPS_FORMAT_FLOAT &&
+		convf->nnz >= VIPS_CONVF_GPU_MIN_NNZ &&
+		convf->nnz <= VIPS_GPU_MAX_NNZ &&
+		vips_gpu_isenabled();
+
 	if (vips_embed(in, &t[0],
 			M->Xsize / 2, M->Ysize / 2,
 			in->Xsize + M->Xsize - 1, in->Ysize + M->Ysize - 1,
@@ -382,6 +466,7 @@ vips_convf_init(VipsConvf *convf)
 	convf->nnz = 0;
 	convf->coeff = NULL;
 	convf->coeff_pos = NULL;
+	convf->fcoeff = NULL;
 }
 
 /**
@@ -0,0 +1,301 @@
+/* Highway kernels for float convolution.
+ *
+ * 14/10/26
+ * 	- initial implementation
+ */
+
+/*
+
+	This file is part of VIPS.
+
+	VIPS is free software; you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+	02110-1301  USA
+
+ */
+
+/*
+
+	These files are distributed with VIPS - http://www.vips.ecs.soton.ac.uk
+
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /*HAVE_CONFIG_H*/
+#include <glib/gi18n-lib.h>
+
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <cmath>
+
+#include <vips/vips.h>
+#include <vips/vector.h>
+#include <vips/debug.h>
+#include <vips/internal.h>
+
+#include "pconvolution.h"
+
+#ifdef HAVE_HWY
+
+#undef HWY_TARGET_INCLUDE
+#define HWY_TARGET_INCLUDE "libvips/convolution/convf_hwy.cpp"
+#include <hwy/foreach_target.h>
+#include <hwy/highway.h>
+
+namespace HWY_NAMESPACE {
+
+using namespace hwy::HWY_NAMESPACE;
+
+using DF32 = ScalableTag<float>;
+using DI32 = ScalableTag<int32_t>;
+constexpr DF32 df32;
+constexpr DI32 di32;
+constexpr Rebind<uint8_t, DI32> du8x32;
+#if HWY_HAVE_FLOAT64
+using DF64 = ScalableTag<double>;
+constexpr DF64 df64;
+#endif
+
+// Compat for Highway versions < 1.3.0
+#ifndef HWY_LANES_CONSTEXPR
+#define HWY_LANES_CONSTEXPR
+#endif
+
+/* The vector loops only run on SIMD targets, the scalar tail in convf.c
+ * handles any remaining elements (or all of them for HWY_SCALAR).
+ */
+#if HWY_TARGET != HWY_SCALAR
+#define VECTOR_LOOP 1
+#else
+#define VECTOR_LOOP 0
+#endif
+
+/* Load a vector of pixels as float (or double).
+ */
+HWY_INLINE Vec<DF32>
+load_pixels(DF32 d, const float *HWY_RESTRICT p)
+{
+	return LoadU(d, p);
+}
+
+HWY_INLINE Vec<DF32>
+load_pixels(DF32 d, const uint8_t *HWY_RESTRICT p)
+{
+	return ConvertTo(d, PromoteTo(di32, LoadU(du8x32, p)));
+}
+
+#if HWY_HAVE_FLOAT64
+HWY_INLINE Vec<DF64>
+load_pixels(DF64 d, const double *HWY_RESTRICT p)
+{
+	return LoadU(d, p);
+}
+#endif
+
+/* Masks with up to 9 non-zero elements (3, 5 and 7 for separable masks, 9
+ * for 3x3) have their coefficients and offsets held in registers for the
+ * whole line. Sizeless vectors can't go in arrays, hence the long hand.
+ */
+#define TAP(I) \
+	if (NNZ > I) \
+		sum = MulAdd(c##I, load_pixels(d, p + x + o##I), sum);
+
+#define COEFF(I) \
+	const auto c##I = Set(d, coeff[NNZ > I ? I : 0]); \
+	const int32_t o##I = offsets[NNZ > I ? I : 0];
+
+template <int NNZ, class D, typename TI, typename TO>
+HWY_INLINE int32_t
+convf_line_fixed(D d, TO *HWY_RESTRICT q, const TI *HWY_RESTRICT p,
+	int32_t sz, const int32_t *HWY_RESTRICT offsets,
+	const TO *HWY_RESTRICT coeff, TO offset)
+{
+	int32_t x = 0;
+
+#if VECTOR_LOOP
+	HWY_LANES_CONSTEXPR int32_t N = Lanes(d);
+	const auto v_offset = Set(d, offset);
+
+	COEFF(0);
+	COEFF(1);
+	COEFF(2);
+	COEFF(3);
+	COEFF(4);
+	COEFF(5);
+	COEFF(6);
+	COEFF(7);
+	COEFF(8);
+
+	for (; x + N <= sz; x += N) {
+		auto sum = v_offset;
+
+		TAP(0);
+		TAP(1);
+		TAP(2);
+		TAP(3);
+		TAP(4);
+		TAP(5);
+		TAP(6);
+		TAP(7);
+		TAP(8);
+
+		StoreU(sum, d, q + x);
+	}
+#endif /*VECTOR_LOOP*/
+
+	return x;
+}
+
+#undef TAP
+#undef COEFF
+
+/* Any number of non-zero elements. Two accumulators hide the latency of
+ * the fused multiply-add.
+ */
+template <class D, typename TI, typename TO>
+HWY_INLINE int32_t
+convf_line_any(D d, TO *HWY_RESTRICT q, const TI *HWY_RESTRICT p,
+	int32_t sz, int32_t nnz, const int32_t *HWY_RESTRICT offsets,
+	const TO *HWY_RESTRICT coeff, TO offset)
+{
+	int32_t x = 0;
+
+#if VECTOR_LOOP
+	HWY_LANES_CONSTEXPR int32_t N = Lanes(d);
+	const auto v_offset = Set(d, offset);
+
+	for (; x + N <= sz; x += N) {
+		auto sum0 = v_offset;
+		auto sum1 = Zero(d);
+
+		int32_t i = 0;
+		for (; i + 2 <= nnz; i += 2) {
+			sum0 = MulAdd(Set(d, coeff[i]),
+				load_pixels(d, p + x + offsets[i]), sum0);
+			sum1 = MulAdd(Set(d, coeff[i + 1]),
+				load_pixels(d, p + x + offsets[i + 1]), sum1);
+		}
+		for (; i < nnz; i++)
+			sum0 = MulAdd(Set(d, coeff[i]),
+				load_pixels(d, p + x + offsets[i]), sum0);
+
+		StoreU(Add(sum0, sum1), d, q + x);
+	}
+#endif /*VECTOR_LOOP*/
+
+	return x;
+}
+
+template <class D, typename TI, typename TO>
+HWY_INLINE int32_t
+convf_line(D d, TO *HWY_RESTRICT q, const TI *HWY_RESTRICT p,
+	int32_t sz, int32_t nnz, const int32_t *HWY_RESTRICT offsets,
+	const TO *HWY_RESTRICT coeff, TO offset)
+{
+	switch (nnz) {
+	case 1:
+		return convf_line_fixed<1>(d, q, p, sz, offsets, coeff, offset);
+	case 2:
+		return convf_line_fixed<2>(d, q, p, sz, offsets, coeff, offset);
+	case 3:
+		return convf_line_fixed<3>(d, q, p, sz, offsets, coeff, offset);
+	case 4:
+		return convf_line_fixed<4>(d, q, p, sz, offsets, coeff, offset);
+	case 5:
+		return convf_line_fixed<5>(d, q, p, sz, offsets, coeff, offset);
+	case 6:
+		return convf_line_fixed<6>(d, q, p, sz, offsets, coeff, offset);
+	case 7:
+		return convf_line_fixed<7>(d, q, p, sz, offsets, coeff, offset);
+	case 8:
+		return convf_line_fixed<8>(d, q, p, sz, offsets, coeff, offset);
+	case 9:
+		return convf_line_fixed<9>(d, q, p, sz, offsets, coeff, offset);
+
+	default:
+		return convf_line_any(d, q, p, sz, nnz, offsets, coeff, offset);
+	}
+}
+
+HWY_ATTR int32_t
+vips_convf_uchar_hwy(float *HWY_RESTRICT q, const uint8_t *HWY_RESTRICT p,
+	int32_t sz, int32_t nnz, const int32_t *HWY_RESTRICT offsets,
+	const float *HWY_RESTRICT coeff, float offset)
+{
+	return convf_line(df32, q, p, sz, nnz, offsets, coeff, offset);
+}
+
+HWY_ATTR int32_t
+vips_convf_float_hwy(float *HWY_RESTRICT q, const float *HWY_RESTRICT p,
+	int32_t sz, int32_t nnz, const int32_t *HWY_RESTRICT offsets,
+	const float *HWY_RESTRICT coeff, float offset)
+{
+	return convf_line(df32, q, p, sz, nnz, offsets, coeff, offset);
+}
+
+HWY_ATTR int32_t
+vips_convf_double_hwy(double *HWY_RESTRICT q, const double *HWY_RESTRICT p,
+	int32_t sz, int32_t nnz, const int32_t *HWY_RESTRICT offsets,
+	const double *HWY_RESTRICT coeff, double offset)
+{
+#if HWY_HAVE_FLOAT64
+	return convf_line(df64, q, p, sz, nnz, offsets, coeff, offset);
+#else
+	return 0;
+#endif
+}
+
+#undef VECTOR_LOOP
+
+} /*namespace HWY_NAMESPACE*/
+
+#if HWY_ONCE
+HWY_EXPORT(vips_convf_uchar_hwy);
+HWY_EXPORT(vips_convf_float_hwy);
+HWY_EXPORT(vips_convf_double_hwy);
+
+int
+vips_convf_uchar_hwy(float *q, const VipsPel *p, int sz,
+	int nnz, const int *offsets, const float *coeff, float offset)
+{
+	/* clang-format off */
+	return HWY_DYNAMIC_DISPATCH(vips_convf_uchar_hwy)(q, p, sz,
+		nnz, offsets, coeff, offset);
+	/* clang-format on */
+}
+
+int
+vips_convf_float_hwy(float *q, const float *p, int sz,
+	int nnz, const int *offsets, const float *coeff, float offset)
+{
+	/* clang-format off */
+	return HWY_DYNAMIC_DISPATCH(vips_convf_float_hwy)(q, p, sz,
+		nnz, offsets, coeff, offset);
+	/* clang-format on */
+}
+
+int
+vips_convf_double_hwy(double *q, const double *p, int sz,
+	int nnz, const int *offsets, const double *coeff, double offset)
+{
+	/* clang-format off */
+	return HWY_DYNAMIC_DISPATCH(vips_convf_double_hwy)(q, p, sz,
+		nnz, offsets, coeff, offset);
+	/* clang-format on */
+}
+#endif /*HWY_ONCE*/
+
+#endif /*HAVE_HWY*/
@@ -0,0 +1,587 @@
+/* convolve with several masks at once and combine the results
+ *
+ * 15/10/26
+ * 	- from convf.c and canny.c
+ */
+
+/*
+
+	This file is part of VIPS.
+
+	VIPS is free software; you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+	02110-1301  USA
+
+ */
+
+/*
+
+	These files are distributed with VIPS - http://www.vips.ecs.soton.ac.uk
+
+ */
+
+/* Edge detectors convolve the same image with several masks and then
+ * combine the results pixel by pixel. Running a separate vips_conv() for each
+ * mask reads every input window once per mask and needs an intermediate
+ * image for each result.
+ *
+ * Here we find the union of the non-zero elements of all the masks, load each
+ * of those input elements once, and update every mask sum from it. The sums
+ * are combined as soon as they are complete.
+ */
+
+/*
+#define DEBUG
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /*HAVE_CONFIG_H*/
+#include <glib/gi18n-lib.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <math.h>
+
+#include <vips/vips.h>
+#include <vips/vector.h>
+#include <vips/debug.h>
+
+#include "pconvolution.h"
+
+typedef struct _VipsConvmulti {
+	VipsConvmultiMode mode;
+	VipsBandFormat format;
+
+	/* The number of masks, and their size.
+	 */
+	int n;
+	int width;
+	int height;
+
+	/* The union of the non-zero elements of all the masks. coeff has n
+	 * coefficients for each tap, with the mask scale baked in.
+	 */
+	int ntaps;
+	int *tap_pos;
+	double *coeff;
+	double *offset;
+
+	/* As float, for the vector path.
+	 */
+	float *fcoeff;
+	float *foffset;
+} VipsConvmulti;
+
+typedef struct {
+	VipsConvmulti *convmulti;
+	VipsRegion *ir;
+
+	int *offsets; /* Offsets for each tap */
+	int last_bpl; /* Avoid recalcing offsets, if we can */
+
+	double *sum; /* One sum per mask */
+} VipsConvmultiSequence;
+
+/* LUT for calculating atan2() with +/- 4 bits of precision in each axis.
+ */
+static VipsPel vips_convmulti_atan2[256];
+
+static void *
+vips_convmulti_atan2_init(void *null)
+{
+	int i;
+
+	for (i = 0; i < 256; i++) {
+		/* Use the bottom 4 bits for x, the top 4 for y. Interpret the
+		 * 4-bit values as signed 2s complement and sign-extend to int.
+		 */
+		int x = i & 0xF;
+		if (x & 0x8)
+			x -= 0x10;
+		int y = (i >> 4) & 0xF;
+		if (y & 0x8)
+			y -= 0x10;
+		double theta = VIPS_DEG(atan2(x, y)) + 360;
+
+		/* Map angle to 0-255 with wraparound.
+		 */
+		int value = 256 * theta / 360;
+		vips_convmulti_atan2[i] = value & 0xFF;
+	}
+
+	return NULL;
+}
+
+static int
+vips_convmulti_stop(void *vseq, void *a, void *b)
+{
+	VipsConvmultiSequence *seq = (VipsConvmultiSequence *) vseq;
+
+	VIPS_UNREF(seq->ir);
+	VIPS_FREE(seq->offsets);
+	VIPS_FREE(seq->sum);
+	VIPS_FREE(seq);
+
+	return 0;
+}
+
+static void *
+vips_convmulti_start(VipsImage *out, void *a, void *b)
+{
+	VipsImage *in = (VipsImage *) a;
+	VipsConvmulti *convmulti = (VipsConvmulti *) b;
+	VipsConvmultiSequence *seq;
+
+	if (!(seq = VIPS_NEW(NULL, VipsConvmultiSequence)))
+		return NULL;
+
+	seq->convmulti = convmulti;
+	seq->ir = vips_region_new(in);
+	seq->offsets = VIPS_ARRAY(NULL, convmulti->ntaps, int);
+	seq->last_bpl = -1;
+	seq->sum = VIPS_ARRAY(NULL, convmulti->n, double);
+	if (!seq->ir ||
+		!seq->offsets ||
+		!seq->sum) {
+		vips_convmulti_stop(seq, in, convmulti);
+		return NULL;
+	}
+
+	return (void *) seq;
+}
+
+/* Combine the sums for element x and write to q.
+ */
+static inline void
+vips_convmulti_combine(VipsConvmulti *convmulti,
+	const double *restrict sum, VipsPel *restrict q, int x)
+{
+	const int n = convmulti->n;
+
+	double v;
+	int k;
+
+	switch (convmulti->mode) {
+	case VIPS_CONVMULTI_MAX:
+		v = fabs(sum[0]);
+		for (k = 1; k < n; k++)
+			v = VIPS_MAX(v, fabs(sum[k]));
+		break;
+
+	case VIPS_CONVMULTI_MIN:
+		v = fabs(sum[0]);
+		for (k = 1; k < n; k++)
+			v = VIPS_MIN(v, fabs(sum[k]));
+		break;
+
+	case VIPS_CONVMULTI_SUM:
+		v = 0.0;
+		for (k = 0; k < n; k++)
+			v += fabs(sum[k]);
+		break;
+
+	case VIPS_CONVMULTI_MAGNITUDE:
+		v = sqrt(sum[0] * sum[0] + sum[1] * sum[1]);
+		break;
+
+	case VIPS_CONVMULTI_POLAR:
+		/* Two output elements for each input element. For uchar, gx
+		 * and gy are clipped to -128 to +127, and we use the top 4 bits
+		 * of each for the atan2 LUT. We only need relative magnitude,
+		 * so skip the sqrt and shift G down to fit 0 - 255.
+		 */
+		if (convmulti->format == VIPS_FORMAT_UCHAR) {
+			int gx = VIPS_CLIP(-128, rint(sum[0]), 127);
+			int gy = VIPS_CLIP(-128, rint(sum[1]), 127);
+			int i = ((gx >> 4) & 0xf) | (gy & 0xf0);
+
+			q[2 * x] = (gx * gx + gy * gy + 256) >> 9;
+			q[2 * x + 1] = vips_convmulti_atan2[i];
+		}
+		else {
+			double gx = sum[0];
+			double gy = sum[1];
+			double theta = VIPS_DEG(atan2(gx, gy));
+			double G = (gx * gx + gy * gy + 256.0) / 512.0;
+
+			theta = 256.0 * fmod(theta + 360.0, 360.0) / 360.0;
+			if (convmulti->format == VIPS_FORMAT_FLOAT) {
+				((float *) q)[2 * x] = G;
+				((float *) q)[2 * x + 1] = theta;
+			}
+			else {
+				((double *) q)[2 * x] = G;
+				((double *) q)[2 * x + 1] = theta;
+			}
+		}
+		return;
+
+	default:
+		g_assert_not_reached();
+		v = 0.0;
+	}
+
+	switch (convmulti->format) {
+	case VIPS_FORMAT_UCHAR:
+		q[x] = VIPS_CLIP(0, v, UCHAR_MAX);
+		break;
+
+	case VIPS_FORMAT_FLOAT:
+		((float *) q)[x] = v;
+		break;
+
+	case VIPS_FORMAT_DOUBLE:
+		((double *) q)[x] = v;
+		break;
+
+	default:
+		g_assert_not_reached();
+	}
+}
+
+#define CONVMULTI(TYPE) \
+	{ \
+		TYPE *restrict p = (TYPE *) VIPS_REGION_ADDR(ir, le, y); \
+\
+		for (x = x0; x < sz; x++) { \
+			for (k = 0; k < n; k++) \
+				sum[k] = offset[k]; \
+\
+			for (i = 0; i < ntaps; i++) { \
+				double v = p[x + offsets[i]]; \
+				double *restrict c = coeff + i * n; \
+\
+				for (k = 0; k < n; k++) \
+					sum[k] += c[k] * v; \
+			} \
+\
+			vips_convmulti_combine(convmulti, sum, q, x); \
+		} \
+	}
+
+#ifdef HAVE_HWY
+/* Vector path for a line. Returns the number of elements done, the scalar
+ * loop finishes the line.
+ */
+static int
+vips_convmulti_hwy(VipsConvmulti *convmulti, VipsConvmultiSequence *seq,
+	VipsPel *q, VipsPel *p, int sz)
+{
+	/* Polar needs atan2, and doubles need a double accumulator.
+	 */
+	if (convmulti->mode == VIPS_CONVMULTI_POLAR ||
+		convmulti->format == VIPS_FORMAT_DOUBLE)
+		return 0;
+
+	switch (seq->ir->im->BandFmt) {
+	case VIPS_FORMAT_UCHAR:
+		return vips_convmulti_uchar_hwy(q, p, sz,
+			convmulti->ntaps, seq->offsets,
+			convmulti->n, convmulti->fcoeff, convmulti->foffset,
+			convmulti->mode, convmulti->format == VIPS_FORMAT_UCHAR);
+
+	case VIPS_FORMAT_FLOAT:
+		return vips_convmulti_float_hwy(q, (float *) p, sz,
+			convmulti->ntaps, seq->offsets,
+			convmulti->n, convmulti->fcoeff, convmulti->foffset,
+			convmulti->mode, convmulti->format == VIPS_FORMAT_UCHAR);
+
+	default:
+		return 0;
+	}
+}
+#endif /*HAVE_HWY*/
+
+static int
+vips_convmulti_gen(VipsRegion *out_region,
+	void *vseq, void *a, void *b, gboolean *stop)
+{
+	VipsConvmultiSequence *seq = (VipsConvmultiSequence *) vseq;
+	VipsConvmulti *convmulti = (VipsConvmulti *) b;
+	VipsImage *in = (VipsImage *) a;
+	VipsRegion *ir = seq->ir;
+	const int n = convmulti->n;
+	const int ntaps = convmulti->ntaps;
+	double *restrict coeff = convmulti->coeff;
+	double *restrict offset = convmulti->offset;
+	int *restrict offsets = seq->offsets;
+	double *restrict sum = seq->sum;
+	VipsRect *r = &out_region->valid;
+	int le = r->left;
+	int to = r->top;
+	int bo = VIPS_RECT_BOTTOM(r);
+	int sz = r->width * in->Bands;
+	gboolean vector = vips_vector_isenabled();
+
+	VipsRect s;
+	int x, y, z, i, k;
+	int x0;
+
+	/* Prepare the section of the input image we need. A little larger
+	 * than the section of the output image we are producing.
+	 */
+	s = *r;
+	s.width += convmulti->width - 1;
+	s.height += convmulti->height - 1;
+	if (vips_region_prepare(ir, &s))
+		return -1;
+
+	/* Fill offset array. Only do this if the bpl has changed since the
+	 * previous vips_region_prepare().
+	 */
+	if (seq->last_bpl != VIPS_REGION_LSKIP(ir)) {
+		seq->last_bpl = VIPS_REGION_LSKIP(ir);
+
+		for (i = 0; i < ntaps; i++) {
+			z = convmulti->tap_pos[i];
+			x = z % convmulti->width;
+			y = z / convmulti->width;
+
+			offsets[i] =
+				(VIPS_REGION_ADDR(ir, x + le, y + to) -
+					VIPS_REGION_ADDR(ir, le, to)) /
+				VIPS_IMAGE_SIZEOF_ELEMENT(ir->im);
+		}
+	}
+
+	VIPS_GATE_START("vips_convmulti_gen: work");
+
+	for (y = to; y < bo; y++) {
+		VipsPel *q = VIPS_REGION_ADDR(out_region, le, y);
+
+		x0 = 0;
+#ifdef HAVE_HWY
+		if (vector)
+			x0 = vips_convmulti_hwy(convmulti, seq,
+				q, VIPS_REGION_ADDR(ir, le, y), sz);
+#endif /*HAVE_HWY*/
+
+		switch (in->BandFmt) {
+		case VIPS_FORMAT_UCHAR:
+			CONVMULTI(unsigned char);
+			break;
+
+		case VIPS_FORMAT_CHAR:
+			CONVMULTI(signed char);
+			break;
+
+		case VIPS_FORMAT_USHORT:
+			CONVMULTI(unsigned short);
+			break;
+
+		case VIPS_FORMAT_SHORT:
+			CONVMULTI(signed short);
+			break;
+
+		case VIPS_FORMAT_UINT:
+			CONVMULTI(unsigned int);
+			break;
+
+		case VIPS_FORMAT_INT:
+			CONVMULTI(signed int);
+			break;
+
+		case VIPS_FORMAT_FLOAT:
+			CONVMULTI(float);
+			break;
+
+		case VIPS_FORMAT_DOUBLE:
+			CONVMULTI(double);
+			break;
+
+		default:
+			g_assert_not_reached();
+		}
+	}
+
+	VIPS_GATE_STOP("vips_convmulti_gen: work");
+
+	VIPS_COUNT_PIXELS(out_region, "vips_convmulti_gen");
+
+	return 0;
+}
+
+/* Load the masks and find the union of their non-zero elements.
+ */
+static int
+vips_convmulti_masks(VipsConvmulti *convmulti, VipsImage **masks)
+{
+	const int n = convmulti->n;
+
+	VipsImage **M;
+	int ne;
+	int i, k;
+	int result;
+
+	M = g_new0(VipsImage *, n);
+
+	result = -1;
+	for (k = 0; k < n; k++)
+		if (vips_check_matrix("convmulti", masks[k], &M[k]))
+			goto out;
+
+	convmulti->width = M[0]->Xsize;
+	convmulti->height = M[0]->Ysize;
+	for (k = 1; k < n; k++)
+		if (M[k]->Xsize != convmulti->width ||
+			M[k]->Ysize != convmulti->height) {
+			vips_error("convmulti", "%s", _("masks differ in size"));
+			goto out;
+		}
+	ne = convmulti->width * convmulti->height;
+
+	for (i = 0; i < ne; i++)
+		for (k = 0; k < n; k++)
+			if (*VIPS_MATRIX(M[k], i % convmulti->width,
+					i / convmulti->width)) {
+				convmulti->tap_pos[convmulti->ntaps] = i;
+				convmulti->ntaps += 1;
+				break;
+			}
+
+	/* Were all the masks zero? We must have at least 1 tap.
+	 */
+	if (convmulti->ntaps == 0) {
+		convmulti->tap_pos[0] = 0;
+		convmulti->ntaps = 1;
+	}
+
+	for (k = 0; k < n; k++) {
+		double scale = vips_image_get_scale(M[k]);
+
+		for (i = 0; i < convmulti->ntaps; i++) {
+			int z = convmulti->tap_pos[i];
+			double c = *VIPS_MATRIX(M[k],
+				z % convmulti->width, z / convmulti->width);
+
+			convmulti->coeff[i * n + k] = c / scale;
+			convmulti->fcoeff[i * n + k] = c / scale;
+		}
+
+		convmulti->offset[k] = vips_image_get_offset(M[k]);
+		convmulti->foffset[k] = convmulti->offset[k];
+	}
+
+	result = 0;
+
+out:
+	for (k = 0; k < n; k++)
+		VIPS_UNREF(M[k]);
+	g_free(M);
+
+	return result;
+}
+
+/**
+ * vips__convmulti: (skip)
+ * @in: input image
+ * @out: (out): output image
+ * @masks: (array length=n): convolve with these masks
+ * @n: number of masks
+ * @mode: combine the convolutions like this
+ * @format: output format
+ *
+ * Convolve @in with every mask in @masks, then combine the results. Each
+ * convolution is sigma[i]{pixel[i] * mask[i]} / scale + offset, as
+ * [method@Image.convf], and the masks must all be the same size.
+ *
+ * [enum@Vips.ConvmultiMode.MAX], [enum@Vips.ConvmultiMode.MIN] and
+ * [enum@Vips.ConvmultiMode.SUM] combine the absolute values of any number of
+ * convolutions, [enum@Vips.ConvmultiMode.MAGNITUDE] is the length of the
+ * vector made by two convolutions.
+ *
+ * [enum@Vips.ConvmultiMode.POLAR] makes a (G, theta) pair for each band from
+ * two convolutions, with theta coded as 0 - 256 for 0 - 360 degrees and
+ * G as (gx * gx + gy * gy + 256) / 512. For uchar output, gx and gy are
+ * clipped to -128 to +127 and theta has 4 bits of precision in each axis.
+ *
+ * @format can be uchar, float or double, and double only for double @in.
+ *
+ * Returns: 0 on success, -1 on error.
+ */
+int
+vips__convmulti(VipsImage *in, VipsImage **out,
+	VipsImage **masks, int n, VipsConvmultiMode mode, VipsBandFormat format)
+{
+	static GOnce once = G_ONCE_INIT;
+
+	VipsConvmulti *convmulti;
+	VipsImage *t;
+	int ne;
+
+	g_once(&once, vips_convmulti_atan2_init, NULL);
+
+	if (vips_check_uncoded("convmulti", in) ||
+		vips_check_noncomplex("convmulti", in))
+		return -1;
+	if (n < 1 ||
+		((mode == VIPS_CONVMULTI_MAGNITUDE ||
+			 mode == VIPS_CONVMULTI_POLAR) &&
+			n != 2)) {
+		vips_error("convmulti", "%s", _("bad number of masks"));
+		return -1;
+	}
+
+	*out = vips_image_new();
+
+	if (!(convmulti = VIPS_NEW(VIPS_OBJECT(*out), VipsConvmulti)))
+		return -1;
+	convmulti->mode = mode;
+	convmulti->format = format;
+	convmulti->n = n;
+	convmulti->ntaps = 0;
+
+	ne = masks[0]->Xsize * masks[0]->Ysize;
+	if (!(convmulti->tap_pos = VIPS_ARRAY(VIPS_OBJECT(*out), ne, int)) ||
+		!(convmulti->coeff =
+				VIPS_ARRAY(VIPS_OBJECT(*out), ne * n, double)) ||
+		!(convmulti->fcoeff =
+				VIPS_ARRAY(VIPS_OBJECT(*out), ne * n, float)) ||
+		!(convmulti->offset = VIPS_ARRAY(VIPS_OBJECT(*out), n, double)) ||
+		!(convmulti->foffset = VIPS_ARRAY(VIPS_OBJECT(*out), n, float)))
+		return -1;
+
+	if (vips_convmulti_masks(convmulti, masks))
+		return -1;
+
+	if (vips_embed(in, &t,
+			convmulti->width / 2, convmulti->height / 2,
+			in->Xsize + convmulti->width - 1,
+			in->Ysize + convmulti->height - 1,
+			"extend", VIPS_EXTEND_COPY,
+			NULL))
+		return -1;
+	vips_object_local(*out, t);
+
+	if (vips_image_pipelinev(*out, VIPS_DEMAND_STYLE_SMALLTILE, t, NULL))
+		return -1;
+
+	(*out)->Xsize -= convmulti->width - 1;
+	(*out)->Ysize -= convmulti->height - 1;
+	(*out)->BandFmt = format;
+	if (mode == VIPS_CONVMULTI_POLAR)
+		(*out)->Bands *= 2;
+
+	if (vips_image_generate(*out,
+			vips_convmulti_start, vips_convmulti_gen, vips_convmulti_stop,
+			t, convmulti))
+		return -1;
+
+	(*out)->Xoffset = -convmulti->width / 2;
+	(*out)->Yoffset = -convmulti->height / 2;
+
+	return 0;
+}
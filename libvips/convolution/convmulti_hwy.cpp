@@ -0,0 +1,276 @@
+/* Highway kernels for convolving with several masks at once.
+ *
+ * 15/10/26
+ * 	- from convf_hwy.cpp
+ */
+
+/*
+
+	This file is part of VIPS.
+
+	VIPS is free software; you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+	02110-1301  USA
+
+ */
+
+/*
+
+	These files are distributed with VIPS - http://www.vips.ecs.soton.ac.uk
+
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /*HAVE_CONFIG_H*/
+#include <glib/gi18n-lib.h>
+
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+
+#include <vips/vips.h>
+#include <vips/vector.h>
+#include <vips/debug.h>
+#include <vips/internal.h>
+
+#include "pconvolution.h"
+
+#ifdef HAVE_HWY
+
+#undef HWY_TARGET_INCLUDE
+#define HWY_TARGET_INCLUDE "libvips/convolution/convmulti_hwy.cpp"
+#include <hwy/foreach_target.h>
+#include <hwy/highway.h>
+
+namespace HWY_NAMESPACE {
+
+using namespace hwy::HWY_NAMESPACE;
+
+using DF32 = ScalableTag<float>;
+using DI32 = ScalableTag<int32_t>;
+constexpr DF32 df32;
+constexpr DI32 di32;
+constexpr Rebind<uint8_t, DI32> du8x32;
+
+// Compat for Highway versions < 1.3.0
+#ifndef HWY_LANES_CONSTEXPR
+#define HWY_LANES_CONSTEXPR
+#endif
+
+/* The vector loops only run on SIMD targets, the scalar tail in
+ * convmulti.c handles any remaining elements (or all of them for
+ * HWY_SCALAR).
+ */
+#if HWY_TARGET != HWY_SCALAR
+#define VECTOR_LOOP 1
+#else
+#define VECTOR_LOOP 0
+#endif
+
+HWY_INLINE Vec<DF32>
+load_pixels(DF32 d, const float *HWY_RESTRICT p)
+{
+	return LoadU(d, p);
+}
+
+HWY_INLINE Vec<DF32>
+load_pixels(DF32 d, const uint8_t *HWY_RESTRICT p)
+{
+	return ConvertTo(d, PromoteTo(di32, LoadU(du8x32, p)));
+}
+
+/* Up to 8 masks keep their sums in registers. Sizeless vectors can't go in
+ * arrays, hence the long hand.
+ */
+#define SUM(I) \
+	auto a##I = Set(d, offset[K > I ? I : 0]);
+
+#define TAP(I) \
+	if (K > I) \
+		a##I = MulAdd(Set(d, c[I]), v, a##I);
+
+#define COMBINE(I) \
+	if (K > I) { \
+		if (mode == VIPS_CONVMULTI_MAX) \
+			r = Max(r, Abs(a##I)); \
+		else if (mode == VIPS_CONVMULTI_MIN) \
+			r = Min(r, Abs(a##I)); \
+		else \
+			r = Add(r, Abs(a##I)); \
+	}
+
+template <int K, class D, typename TI>
+HWY_INLINE int32_t
+convmulti_line(D d, uint8_t *HWY_RESTRICT q, const TI *HWY_RESTRICT p,
+	int32_t sz, int32_t ntaps, const int32_t *HWY_RESTRICT offsets,
+	const float *HWY_RESTRICT coeff, const float *HWY_RESTRICT offset,
+	int32_t mode, bool uchar_out)
+{
+	int32_t x = 0;
+
+#if VECTOR_LOOP
+	HWY_LANES_CONSTEXPR int32_t N = Lanes(d);
+	const auto zero = Zero(d);
+	const auto max_uchar = Set(d, 255.0f);
+
+	for (; x + N <= sz; x += N) {
+		SUM(0);
+		SUM(1);
+		SUM(2);
+		SUM(3);
+		SUM(4);
+		SUM(5);
+		SUM(6);
+		SUM(7);
+
+		/* Each input element is loaded once for all the masks.
+		 */
+		for (int32_t i = 0; i < ntaps; i++) {
+			const auto v = load_pixels(d, p + x + offsets[i]);
+			const float *HWY_RESTRICT c = coeff + i * K;
+
+			TAP(0);
+			TAP(1);
+			TAP(2);
+			TAP(3);
+			TAP(4);
+			TAP(5);
+			TAP(6);
+			TAP(7);
+		}
+
+		auto r = Abs(a0);
+		if (mode == VIPS_CONVMULTI_MAGNITUDE)
+			r = Sqrt(MulAdd(a0, a0, Mul(a1, a1)));
+		else {
+			COMBINE(1);
+			COMBINE(2);
+			COMBINE(3);
+			COMBINE(4);
+			COMBINE(5);
+			COMBINE(6);
+			COMBINE(7);
+		}
+
+		if (uchar_out) {
+			/* Clip and truncate, as vips_cast() does.
+			 */
+			r = Min(Max(r, zero), max_uchar);
+			StoreU(DemoteTo(du8x32, ConvertTo(di32, r)), du8x32, q + x);
+		}
+		else
+			StoreU(r, d, reinterpret_cast<float *>(q) + x);
+	}
+#endif /*VECTOR_LOOP*/
+
+	return x;
+}
+
+#undef SUM
+#undef TAP
+#undef COMBINE
+
+template <class D, typename TI>
+HWY_INLINE int32_t
+convmulti_dispatch(D d, uint8_t *HWY_RESTRICT q, const TI *HWY_RESTRICT p,
+	int32_t sz, int32_t ntaps, const int32_t *HWY_RESTRICT offsets,
+	int32_t n, const float *HWY_RESTRICT coeff,
+	const float *HWY_RESTRICT offset, int32_t mode, bool uchar_out)
+{
+	switch (n) {
+	case 1:
+		return convmulti_line<1>(d, q, p, sz, ntaps, offsets,
+			coeff, offset, mode, uchar_out);
+	case 2:
+		return convmulti_line<2>(d, q, p, sz, ntaps, offsets,
+			coeff, offset, mode, uchar_out);
+	case 3:
+		return convmulti_line<3>(d, q, p, sz, ntaps, offsets,
+			coeff, offset, mode, uchar_out);
+	case 4:
+		return convmulti_line<4>(d, q, p, sz, ntaps, offsets,
+			coeff, offset, mode, uchar_out);
+	case 5:
+		return convmulti_line<5>(d, q, p, sz, ntaps, offsets,
+			coeff, offset, mode, uchar_out);
+	case 6:
+		return convmulti_line<6>(d, q, p, sz, ntaps, offsets,
+			coeff, offset, mode, uchar_out);
+	case 7:
+		return convmulti_line<7>(d, q, p, sz, ntaps, offsets,
+			coeff, offset, mode, uchar_out);
+	case 8:
+		return convmulti_line<8>(d, q, p, sz, ntaps, offsets,
+			coeff, offset, mode, uchar_out);
+
+	default:
+		return 0;
+	}
+}
+
+HWY_ATTR int32_t
+vips_convmulti_uchar_hwy(uint8_t *HWY_RESTRICT q,
+	const uint8_t *HWY_RESTRICT p, int32_t sz,
+	int32_t ntaps, const int32_t *HWY_RESTRICT offsets,
+	int32_t n, const float *HWY_RESTRICT coeff,
+	const float *HWY_RESTRICT offset, int32_t mode, bool uchar_out)
+{
+	return convmulti_dispatch(df32, q, p, sz, ntaps, offsets,
+		n, coeff, offset, mode, uchar_out);
+}
+
+HWY_ATTR int32_t
+vips_convmulti_float_hwy(uint8_t *HWY_RESTRICT q,
+	const float *HWY_RESTRICT p, int32_t sz,
+	int32_t ntaps, const int32_t *HWY_RESTRICT offsets,
+	int32_t n, const float *HWY_RESTRICT coeff,
+	const float *HWY_RESTRICT offset, int32_t mode, bool uchar_out)
+{
+	return convmulti_dispatch(df32, q, p, sz, ntaps, offsets,
+		n, coeff, offset, mode, uchar_out);
+}
+
+#undef VECTOR_LOOP
+
+} /*namespace HWY_NAMESPACE*/
+
+#if HWY_ONCE
+HWY_EXPORT(vips_convmulti_uchar_hwy);
+HWY_EXPORT(vips_convmulti_float_hwy);
+
+int
+vips_convmulti_uchar_hwy(VipsPel *q, const VipsPel *p, int sz,
+	int ntaps, const int *offsets, int n, const float *coeff,
+	const float *offset, VipsConvmultiMode mode, gboolean uchar_out)
+{
+	/* clang-format off */
+	return HWY_DYNAMIC_DISPATCH(vips_convmulti_uchar_hwy)(q, p, sz,
+		ntaps, offsets, n, coeff, offset, mode, uchar_out);
+	/* clang-format on */
+}
+
+int
+vips_convmulti_float_hwy(VipsPel *q, const float *p, int sz,
+	int ntaps, const int *offsets, int n, const float *coeff,
+	const float *offset, VipsConvmultiMode mode, gboolean uchar_out)
+{
+	/* clang-format off */
+	return HWY_DYNAMIC_DISPATCH(vips_convmulti_float_hwy)(q, p, sz,
+		ntaps, offsets, n, coeff, offset, mode, uchar_out);
+	/* clang-format on */
+}
+#endif /*HWY_ONCE*/
+
+#endif /*HAVE_HWY*/
@@ -2,6 +2,8 @@
  *
  * 7/11/13
  * 	- from convolution.c
+ * 15/10/26
+ * 	- subclasses can make an aux image for the correlation method
  */
 
 /*
@@ -52,7 +54,7 @@ static int
 vips_correlation_gen(VipsRegion *out_region,
 	void *seq, void *a, void *b, gboolean *stop)
 {
-	VipsRegion *ir = (VipsRegion *) seq;
+	VipsRegion **ir = (VipsRegion **) seq;
 	VipsCorrelation *correlation = (VipsCorrelation *) b;
 	VipsCorrelationClass *cclass =
 		VIPS_CORRELATION_GET_CLASS(correlation);
@@ -67,10 +69,12 @@ vips_correlation_gen(VipsRegion *out_region,
 	irect.width = r->width + correlation->ref_ready->Xsize - 1;
 	irect.height = r->height + correlation->ref_ready->Ysize - 1;
 
-	if (vips_region_prepare(ir, &irect))
+	if (vips_region_prepare(ir[0], &irect) ||
+		(ir[1] &&
+			vips_region_prepare(ir[1], r)))
 		return -1;
 
-	cclass->correlation(correlation, ir, out_region);
+	cclass->correlation(correlation, ir[0], ir[1], out_region);
 
 	return 0;
 }
@@ -105,23 +109,29 @@ vips_correlation_build(VipsObject *object)
 
 	g_object_set(object, "out", vips_image_new(), NULL);
 
+	if (cclass->pre_generate &&
+		cclass->pre_generate(correlation))
+		return -1;
+
 	/* FATSTRIP is good for us as THINSTRIP will cause
 	 * too many recalculations on overlaps.
 	 */
 	if (vips_image_pipelinev(correlation->out,
 			VIPS_DEMAND_STYLE_FATSTRIP,
-			correlation->in_ready, correlation->ref_ready, NULL))
+			correlation->in_ready, correlation->ref_ready,
+			correlation->aux, NULL))
 		return -1;
 	correlation->out->Xsize = correlation->in->Xsize;
 	correlation->out->Ysize = correlation->in->Ysize;
 	correlation->out->BandFmt =
 		cclass->format_table[correlation->in_ready->BandFmt];
-	if (cclass->pre_generate &&
-		cclass->pre_generate(correlation))
-		return -1;
+
+	correlation->args[0] = correlation->in_ready;
+	correlation->args[1] = correlation->aux;
+	correlation->args[2] = NULL;
 	if (vips_image_generate(correlation->out,
-			vips_start_one, vips_correlation_gen, vips_stop_one,
-			correlation->in_ready, correlation))
+			vips_start_many, vips_correlation_gen, vips_stop_many,
+			correlation->args, correlation))
 		return -1;
 
 	vips_reorder_margin_hint(correlation->out,
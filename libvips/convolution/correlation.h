@@ -65,6 +65,15 @@ typedef struct {
 	VipsImage *in_ready;
 	VipsImage *ref_ready;
 
+	/* Optionally made by pre_generate: an image the size of @out which
+	 * the correlation method needs as well.
+	 */
+	VipsImage *aux;
+
+	/* Need an image vector for start_many.
+	 */
+	VipsImage *args[3];
+
 } VipsCorrelation;
 
 typedef struct {
@@ -74,12 +83,16 @@ typedef struct {
 	 */
 	const VipsBandFormat *format_table;
 
-	/* Run just before generate. The subclass can fill in some stuff.
+	/* Run just before generate. The subclass can fill in some stuff,
+	 * and set @aux.
 	 */
 	int (*pre_generate)(VipsCorrelation *);
 
+	/* @aux is NULL unless pre_generate set an aux image, in which case
+	 * it's ready on the same area as @out.
+	 */
 	void (*correlation)(VipsCorrelation *,
-		VipsRegion *in, VipsRegion *out);
+		VipsRegion *in, VipsRegion *aux, VipsRegion *out);
 
 } VipsCorrelationClass;
 
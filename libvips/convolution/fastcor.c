@@ -135,7 +135,7 @@ G_DEFINE_TYPE(VipsFastcor, vips_fastcor, VIPS_TYPE_CORRELATION);
 
 static void
 vips_fastcor_correlation(VipsCorrelation *correlation,
-	VipsRegion *in, VipsRegion *out)
+	VipsRegion *in, VipsRegion *aux, VipsRegion *out)
 {
 	VipsRect *r = &out->valid;
 	VipsImage *ref = correlation->ref_ready;
@@ -71,10 +71,37 @@ typedef struct _VipsConvolutionClass {
 
 GType vips_convolution_get_type(void);
 
+/* How vips__convmulti() combines the convolutions.
+ */
+typedef enum {
+	VIPS_CONVMULTI_MAX,
+	VIPS_CONVMULTI_MIN,
+	VIPS_CONVMULTI_SUM,
+	VIPS_CONVMULTI_MAGNITUDE,
+	VIPS_CONVMULTI_POLAR
+} VipsConvmultiMode;
+
+int vips__convmulti(VipsImage *in, VipsImage **out,
+	VipsImage **masks, int n, VipsConvmultiMode mode, VipsBandFormat format);
+
 void vips_convi_uchar_hwy(VipsRegion *out_region, VipsRegion *ir, VipsRect *r,
 	int ne, int nnz, int offset, const int *restrict offsets,
 	const short *restrict mant, int exp);
 
+int vips_convf_uchar_hwy(float *q, const VipsPel *p, int sz,
+	int nnz, const int *offsets, const float *coeff, float offset);
+int vips_convf_float_hwy(float *q, const float *p, int sz,
+	int nnz, const int *offsets, const float *coeff, float offset);
+int vips_convf_double_hwy(double *q, const double *p, int sz,
+	int nnz, const int *offsets, const double *coeff, double offset);
+
+int vips_convmulti_uchar_hwy(VipsPel *q, const VipsPel *p, int sz,
+	int ntaps, const int *offsets, int n, const float *coeff,
+	const float *offset, VipsConvmultiMode mode, gboolean uchar_out);
+int vips_convmulti_float_hwy(VipsPel *q, const float *p, int sz,
+	int ntaps, const int *offsets, int n, const float *coeff,
+	const float *offset, VipsConvmultiMode mode, gboolean uchar_out);
+
 #ifdef __cplusplus
 }
 #endif /*__cplusplus*/
@@ -41,6 +41,9 @@
  * 	- move to defaults suitable for screen output
  * 28/8/19
  * 	- fix sigma 0.5 case (thanks 2h4dl)
+ * 15/10/26
+ * 	- fuse the blur and the LUT into a single pass with a rolling row
+ * 	  buffer
  */
 
 /*
@@ -81,6 +84,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <limits.h>
 #include <math.h>
 
 #include <vips/vips.h>
@@ -102,6 +106,13 @@ typedef struct _VipsSharpen {
 	 */
 	int *lut;
 
+	/* The 1D blur mask, as ints, plus its scale and offset.
+	 */
+	int *coeff;
+	int n_coeff;
+	int scale;
+	int offset;
+
 	/* We used to have a radius control.
 	 */
 	int radius;
@@ -112,53 +123,156 @@ typedef VipsOperationClass VipsSharpenClass;
 
 G_DEFINE_TYPE(VipsSharpen, vips_sharpen, VIPS_TYPE_OPERATION);
 
+/* Per-thread state: the input region, a ring of horizontally blurred rows
+ * and a row of vertical sums.
+ */
+typedef struct _VipsSharpenSequence {
+	VipsRegion *ir;
+
+	int *ring;
+	int *sum;
+	int width;
+} VipsSharpenSequence;
+
+static int
+vips_sharpen_stop(void *vseq, void *a, void *b)
+{
+	VipsSharpenSequence *seq = (VipsSharpenSequence *) vseq;
+
+	VIPS_UNREF(seq->ir);
+	VIPS_FREE(seq->ring);
+	VIPS_FREE(seq->sum);
+	VIPS_FREE(seq);
+
+	return 0;
+}
+
+static void *
+vips_sharpen_start(VipsImage *out, void *a, void *b)
+{
+	VipsImage *in = (VipsImage *) a;
+
+	VipsSharpenSequence *seq;
+
+	if (!(seq = VIPS_NEW(NULL, VipsSharpenSequence)))
+		return NULL;
+
+	seq->ir = vips_region_new(in);
+	seq->ring = NULL;
+	seq->sum = NULL;
+	seq->width = 0;
+
+	return seq;
+}
+
+/* Blur L with the separable mask and apply the LUT to the difference in one
+ * pass over the tile. We keep the last n_coeff horizontally blurred rows in
+ * a ring, so each input row is read and blurred just once. The arithmetic
+ * matches two integer passes of vips_conv(), so the result is the same as
+ * vips_convsep() followed by the LUT.
+ */
 static int
 vips_sharpen_generate(VipsRegion *out_region,
 	void *vseq, void *a, void *b, gboolean *stop)
 {
-	VipsRegion **in = (VipsRegion **) vseq;
+	VipsSharpenSequence *seq = (VipsSharpenSequence *) vseq;
 	VipsSharpen *sharpen = (VipsSharpen *) b;
+	VipsRegion *ir = seq->ir;
 	VipsRect *r = &out_region->valid;
-	int *lut = sharpen->lut;
-
-	int x, y;
-
-	if (vips_reorder_prepare_many(out_region->im, in, r))
+	const int *restrict lut = sharpen->lut;
+	const int *restrict coeff = sharpen->coeff;
+	const int n = sharpen->n_coeff;
+	const int radius = n / 2;
+	const int scale = sharpen->scale;
+	const int rounding = scale / 2;
+	const int offset = sharpen->offset;
+
+	VipsRect s;
+	int x, y, i;
+
+	/* Prepare the section of the input image we need. A little larger
+	 * than the section of the output image we are producing.
+	 */
+	s = *r;
+	s.width += n - 1;
+	s.height += n - 1;
+	if (vips_region_prepare(ir, &s))
 		return -1;
 
+	if (seq->width < r->width) {
+		VIPS_FREE(seq->ring);
+		VIPS_FREE(seq->sum);
+		if (!(seq->ring = VIPS_ARRAY(NULL, n * r->width, int)) ||
+			!(seq->sum = VIPS_ARRAY(NULL, r->width, int)))
+			return -1;
+		seq->width = r->width;
+	}
+
 	VIPS_GATE_START("vips_sharpen_generate: work");
 
-	for (y = 0; y < r->height; y++) {
-		short *p1 = (short *restrict)
-			VIPS_REGION_ADDR(in[0], r->left, r->top + y);
-		short *p2 = (short *restrict)
-			VIPS_REGION_ADDR(in[1], r->left, r->top + y);
-		short *q = (short *restrict)
-			VIPS_REGION_ADDR(out_region, r->left, r->top + y);
+	for (y = 0; y < s.height; y++) {
+		short *restrict p = (short *) VIPS_REGION_ADDR(ir, s.left, s.top + y);
+		int *restrict h = seq->ring + (y % n) * r->width;
 
+		/* Blur this input row horizontally into the ring.
+		 */
 		for (x = 0; x < r->width; x++) {
-			int v1 = p1[x];
-			int v2 = p2[x];
-
-			/* Our LUT is -32768 - 32767. For the v1, v2
-			 * difference to be in this range, both must be 0 -
-			 * 32767.
-			 */
-			int diff = ((v1 & 0x7fff) - (v2 & 0x7fff));
-
-			int out;
-
-			g_assert(diff + 32768 >= 0);
-			g_assert(diff + 32768 < 65536);
+			int sum;
 
-			out = v1 + lut[diff + 32768];
+			sum = 0;
+			for (i = 0; i < n; i++)
+				sum += coeff[i] * p[x + i];
 
-			if (out < 0)
-				out = 0;
-			if (out > 32767)
-				out = 32767;
+			h[x] = VIPS_CLIP(SHRT_MIN,
+				(sum + rounding) / scale + offset, SHRT_MAX);
+		}
 
-			q[x] = out;
+		/* Once the ring is full, we can make an output row.
+		 */
+		if (y >= n - 1) {
+			int oy = y - (n - 1);
+			short *restrict centre = (short *)
+				VIPS_REGION_ADDR(ir, s.left + radius, s.top + oy + radius);
+			short *restrict q = (short *)
+				VIPS_REGION_ADDR(out_region, r->left, r->top + oy);
+			int *restrict sum = seq->sum;
+
+			for (x = 0; x < r->width; x++)
+				sum[x] = 0;
+
+			for (i = 0; i < n; i++) {
+				int *restrict row = seq->ring + ((oy + i) % n) * r->width;
+				int c = coeff[i];
+
+				for (x = 0; x < r->width; x++)
+					sum[x] += c * row[x];
+			}
+
+			for (x = 0; x < r->width; x++) {
+				int v1 = centre[x];
+				int v2 = VIPS_CLIP(SHRT_MIN,
+					(sum[x] + rounding) / scale + offset, SHRT_MAX);
+
+				/* Our LUT is -32768 - 32767. For the v1, v2
+				 * difference to be in this range, both must be 0 -
+				 * 32767.
+				 */
+				int diff = ((v1 & 0x7fff) - (v2 & 0x7fff));
+
+				int out;
+
+				g_assert(diff + 32768 >= 0);
+				g_assert(diff + 32768 < 65536);
+
+				out = v1 + lut[diff + 32768];
+
+				if (out < 0)
+					out = 0;
+				if (out > 32767)
+					out = 32767;
+
+				q[x] = out;
+			}
 		}
 	}
 
@@ -172,8 +286,7 @@ vips_sharpen_build(VipsObject *object)
 {
 	VipsObjectClass *class = VIPS_OBJECT_GET_CLASS(object);
 	VipsSharpen *sharpen = (VipsSharpen *) object;
-	VipsImage **t = (VipsImage **) vips_object_local_array(object, 8);
-	VipsImage **args = (VipsImage **) vips_object_local_array(object, 2);
+	VipsImage **t = (VipsImage **) vips_object_local_array(object, 9);
 
 	VipsImage *in;
 	VipsInterpretation old_interpretation;
@@ -269,23 +382,37 @@ vips_sharpen_build(VipsObject *object)
 	}
 #endif /*DEBUG*/
 
-	/* Extract L and the rest, convolve L.
+	/* The blur mask as ints. gaussmat makes a 1 x n mask, n odd.
 	 */
-	if (vips_extract_band(in, &args[0], 0, NULL) ||
+	sharpen->n_coeff = t[1]->Xsize * t[1]->Ysize;
+	sharpen->scale = rint(vips_image_get_scale(t[1]));
+	sharpen->offset = rint(vips_image_get_offset(t[1]));
+	if (!(sharpen->coeff = VIPS_ARRAY(object, sharpen->n_coeff, int)))
+		return -1;
+	for (i = 0; i < sharpen->n_coeff; i++)
+		sharpen->coeff[i] = rint(*VIPS_MATRIX(t[1], i, 0));
+
+	/* Extract L and the rest, then edge-extend L ready for the blur.
+	 */
+	if (vips_extract_band(in, &t[4], 0, NULL) ||
 		vips_extract_band(in, &t[3], 1, "n", in->Bands - 1, NULL) ||
-		vips_convsep(args[0], &args[1], t[1],
-			"precision", VIPS_PRECISION_INTEGER,
+		vips_embed(t[4], &t[8],
+			sharpen->n_coeff / 2, sharpen->n_coeff / 2,
+			t[4]->Xsize + sharpen->n_coeff - 1,
+			t[4]->Ysize + sharpen->n_coeff - 1,
+			"extend", VIPS_EXTEND_COPY,
 			NULL))
 		return -1;
 
 	t[5] = vips_image_new();
-	if (vips_image_pipeline_array(t[5],
-			VIPS_DEMAND_STYLE_FATSTRIP, args))
+	if (vips_image_pipelinev(t[5], VIPS_DEMAND_STYLE_FATSTRIP, t[8], NULL))
 		return -1;
+	t[5]->Xsize -= sharpen->n_coeff - 1;
+	t[5]->Ysize -= sharpen->n_coeff - 1;
 
 	if (vips_image_generate(t[5],
-			vips_start_many, vips_sharpen_generate, vips_stop_many,
-			args, sharpen))
+			vips_sharpen_start, vips_sharpen_generate, vips_sharpen_stop,
+			t[8], sharpen))
 		return -1;
 
 	g_object_set(object, "out", vips_image_new(), NULL);
@@ -38,6 +38,9 @@
  * 	- redone as a class
  * 8/4/15
  * 	- avoid /0 for constant reference or zero image
+ * 15/10/26
+ * 	- window sums are now running sums, and the numerator is a
+ * 	  convolution, with an FFT for large ref
  */
 
 /*
@@ -73,6 +76,8 @@
 #include <glib/gi18n-lib.h>
 
 #include <stdio.h>
+#include <string.h>
+#include <float.h>
 #include <math.h>
 
 #include <vips/vips.h>
@@ -80,6 +85,10 @@
 #include "pconvolution.h"
 #include "correlation.h"
 
+/* Use an FFT for the numerator when ref has at least this many pixels.
+ */
+#define VIPS_SPCOR_FFT_AREA (32 * 32)
+
 typedef struct _VipsSpcor {
 	VipsCorrelation parent_instance;
 
@@ -96,6 +105,75 @@ typedef VipsCorrelationClass VipsSpcorClass;
 
 G_DEFINE_TYPE(VipsSpcor, vips_spcor, VIPS_TYPE_CORRELATION);
 
+/* Correlate each band of in_ready with the matching band of the
+ * zero-mean ref. conv and convfft both centre the mask, so crop to line
+ * the result up with our output.
+ */
+static int
+vips_spcor_numerator(VipsSpcor *spcor)
+{
+	VipsCorrelation *correlation = (VipsCorrelation *) spcor;
+	VipsImage *in = correlation->in_ready;
+	VipsImage *ref = correlation->ref_ready;
+	int bands = ref->Bands;
+	VipsImage **r = (VipsImage **)
+		vips_object_local_array(VIPS_OBJECT(spcor), bands);
+	VipsImage **rd = (VipsImage **)
+		vips_object_local_array(VIPS_OBJECT(spcor), bands);
+	VipsImage **m = (VipsImage **)
+		vips_object_local_array(VIPS_OBJECT(spcor), bands);
+	VipsImage **b = (VipsImage **)
+		vips_object_local_array(VIPS_OBJECT(spcor), bands);
+	VipsImage **c = (VipsImage **)
+		vips_object_local_array(VIPS_OBJECT(spcor), bands);
+	VipsImage **d = (VipsImage **)
+		vips_object_local_array(VIPS_OBJECT(spcor), bands);
+	VipsImage **t = (VipsImage **)
+		vips_object_local_array(VIPS_OBJECT(spcor), 2);
+
+	int i;
+
+	for (i = 0; i < bands; i++) {
+		if (vips_extract_band(ref, &r[i], i, NULL) ||
+			vips_cast(r[i], &rd[i], VIPS_FORMAT_DOUBLE, NULL) ||
+			vips_linear1(rd[i], &m[i], 1.0, -spcor->rmean[i], NULL) ||
+			vips_extract_band(in, &b[i], i, NULL))
+			return -1;
+
+		/* ref might have come from a matrix file with a scale and
+		 * offset, we don't want them.
+		 */
+		vips_image_set_double(m[i], "scale", 1.0);
+		vips_image_set_double(m[i], "offset", 0.0);
+
+#ifdef HAVE_FFTW
+		if (VIPS_IMAGE_N_PELS(ref) >= VIPS_SPCOR_FFT_AREA) {
+			if (vips_convfft(b[i], &c[i], m[i], NULL))
+				return -1;
+			continue;
+		}
+#endif /*HAVE_FFTW*/
+
+		/* Small refs are cheap to do directly, and we can afford
+		 * to sum in double.
+		 */
+		if (vips_cast(b[i], &d[i], VIPS_FORMAT_DOUBLE, NULL) ||
+			vips_conv(d[i], &c[i], m[i],
+				"precision", VIPS_PRECISION_FLOAT,
+				NULL))
+			return -1;
+	}
+
+	if (vips_bandjoin(c, &t[0], bands, NULL) ||
+		vips_extract_area(t[0], &t[1],
+			ref->Xsize / 2, ref->Ysize / 2,
+			correlation->in->Xsize, correlation->in->Ysize, NULL))
+		return -1;
+	correlation->aux = t[1];
+
+	return 0;
+}
+
 static int
 vips_spcor_pre_generate(VipsCorrelation *correlation)
 {
@@ -148,145 +226,164 @@ vips_spcor_pre_generate(VipsCorrelation *correlation)
 		spcor->c1[i] = sqrt(spcor->c1[i]);
 	}
 
+	/* The numerator, sumij (ref(i,j)-mean(ref))(inkl(i,j)-mean(inkl)),
+	 * is just the correlation of in with the zero-mean ref, since the
+	 * ref terms sum to zero.
+	 */
+	if (vips_spcor_numerator(spcor))
+		return -1;
+
 	return 0;
 }
 
-#define LOOP(IN) \
+/* Add or subtract a line of @in to the column sums.
+ */
+#define ADD_LINE(TYPE) \
 	{ \
-		IN *r1 = ((IN *) ref->data) + b; \
-		IN *p1 = ((IN *) p) + b; \
-		int in_lsk = lsk / sizeof(IN); \
-		IN *r1a; \
-		IN *p1a; \
+		TYPE *p = (TYPE *) VIPS_REGION_ADDR(in, r->left, r->top + y) + b; \
 \
-		/* Mean of area of in corresponding to ref. \
-		 */ \
-		p1a = p1; \
-		sum1 = 0.0; \
-		for (j = 0; j < ref->Ysize; j++) { \
-			for (i = 0; i < sz; i += bands) \
-				sum1 += p1a[i]; \
-			p1a += in_lsk; \
-		} \
-		imean = sum1 / VIPS_IMAGE_N_PELS(ref); \
-\
-		/* Calculate sum-of-squares-of-differences for this window on \
-		 * in, and also sum-of-products-of-differences from mean. \
-		 */ \
-		p1a = p1; \
-		r1a = r1; \
-		sum2 = 0.0; \
-		sum3 = 0.0; \
-		for (j = 0; j < ref->Ysize; j++) { \
-			for (i = 0; i < sz; i += bands) { \
-				/* Reference pel and input pel. \
-				 */ \
-				IN ip = p1a[i]; \
-				IN rp = r1a[i]; \
-\
-				/* Accumulate sum-of-squares-of-differences for \
-				 * input image. \
-				 */ \
-				double t = ip - imean; \
-				sum2 += t * t; \
+		for (x = 0; x < width; x++) { \
+			double v = p[x * bands]; \
 \
-				/* Accumulate product-of-difference from mean. \
-				 */ \
-				sum3 += (rp - spcor->rmean[b]) * t; \
-			} \
-\
-			p1a += in_lsk; \
-			r1a += sz; \
+			sum[x] += sign * v; \
+			sum2[x] += sign * v * v; \
 		} \
 	}
 
 static void
+vips_spcor_add_line(VipsRegion *in, VipsRect *r, int y, int b,
+	int width, double sign, double *sum, double *sum2)
+{
+	int bands = in->im->Bands;
+
+	int x;
+
+	switch (in->im->BandFmt) {
+	case VIPS_FORMAT_UCHAR:
+		ADD_LINE(unsigned char);
+		break;
+
+	case VIPS_FORMAT_CHAR:
+		ADD_LINE(signed char);
+		break;
+
+	case VIPS_FORMAT_USHORT:
+		ADD_LINE(unsigned short);
+		break;
+
+	case VIPS_FORMAT_SHORT:
+		ADD_LINE(signed short);
+		break;
+
+	case VIPS_FORMAT_UINT:
+		ADD_LINE(unsigned int);
+		break;
+
+	case VIPS_FORMAT_INT:
+		ADD_LINE(signed int);
+		break;
+
+	case VIPS_FORMAT_FLOAT:
+		ADD_LINE(float);
+		break;
+
+	case VIPS_FORMAT_DOUBLE:
+		ADD_LINE(double);
+		break;
+
+	default:
+		g_assert_not_reached();
+	}
+}
+
+/* The numerator comes from @aux. The sum and sum of squares of @in under
+ * each window come from column sums over the height of ref, and a
+ * running sum of those along each line, so the cost per output pixel does
+ * not depend on the size of ref.
+ */
+static void
 vips_spcor_correlation(VipsCorrelation *correlation,
-	VipsRegion *in, VipsRegion *out)
+	VipsRegion *in, VipsRegion *aux, VipsRegion *out)
 {
 	VipsSpcor *spcor = (VipsSpcor *) correlation;
 	VipsRect *r = &out->valid;
 	VipsImage *ref = correlation->ref_ready;
-	int bands = vips_band_format_iscomplex(ref->BandFmt)
-		? ref->Bands * 2
-		: ref->Bands;
-	int sz = ref->Xsize * bands;
-	int lsk = VIPS_REGION_LSKIP(in);
-
-	int x, y, b, j, i;
-
-	double imean;
-	double sum1;
-	double sum2, sum3;
-	double c2, cc;
-
-	for (y = 0; y < r->height; y++) {
-		float *q = (float *)
-			VIPS_REGION_ADDR(out, r->left, r->top + y);
-
-		for (x = 0; x < r->width; x++) {
-			VipsPel *p =
-				VIPS_REGION_ADDR(in, r->left + x, r->top + y);
-
-			for (b = 0; b < bands; b++) {
-				switch (vips_image_get_format(ref)) {
-				case VIPS_FORMAT_UCHAR:
-					LOOP(unsigned char);
-					break;
-
-				case VIPS_FORMAT_CHAR:
-					LOOP(signed char);
-					break;
-
-				case VIPS_FORMAT_USHORT:
-					LOOP(unsigned short);
-					break;
-
-				case VIPS_FORMAT_SHORT:
-					LOOP(signed short);
-					break;
-
-				case VIPS_FORMAT_UINT:
-					LOOP(unsigned int);
-					break;
-
-				case VIPS_FORMAT_INT:
-					LOOP(signed int);
-					break;
-
-				case VIPS_FORMAT_FLOAT:
-				case VIPS_FORMAT_COMPLEX:
-					LOOP(float);
-					break;
-
-				case VIPS_FORMAT_DOUBLE:
-				case VIPS_FORMAT_DPCOMPLEX:
-					LOOP(double);
-					break;
-
-				default:
-					g_assert_not_reached();
-
-					/* Stop compiler warnings.
-					 */
-					sum2 = 0;
-					sum3 = 0;
-				}
+	int bands = ref->Bands;
+	int width = r->width + ref->Xsize - 1;
+	double n = VIPS_IMAGE_N_PELS(ref);
+
+	double *sum;
+	double *sum2;
+	int x, y, b;
+
+	sum = g_new(double, 2 * width);
+	sum2 = sum + width;
+
+	for (b = 0; b < bands; b++) {
+		memset(sum, 0, 2 * width * sizeof(double));
+		for (y = 0; y < ref->Ysize; y++)
+			vips_spcor_add_line(in, r, y, b, width, 1.0, sum, sum2);
+
+		for (y = 0; y < r->height; y++) {
+			VipsPel *p = VIPS_REGION_ADDR(aux, r->left, r->top + y);
+			float *q = (float *)
+				VIPS_REGION_ADDR(out, r->left, r->top + y) + b;
+
+			double s;
+			double s2;
+
+			s = 0.0;
+			s2 = 0.0;
+			for (x = 0; x < ref->Xsize; x++) {
+				s += sum[x];
+				s2 += sum2[x];
+			}
 
-				c2 = spcor->c1[b] * sqrt(sum2);
+			for (x = 0; x < r->width; x++) {
+				/* n^2 times the variance of this window.
+				 */
+				double var = n * s2 - s * s;
+
+				double num;
+				double c2;
+
+				if (aux->im->BandFmt == VIPS_FORMAT_DOUBLE)
+					num = ((double *) p)[x * bands + b];
+				else
+					num = ((float *) p)[x * bands + b];
+
+				/* A constant window can leave a little
+				 * rounding error rather than zero.
+				 */
+				if (var > n * s2 * DBL_EPSILON * 8)
+					c2 = spcor->c1[b] * sqrt(var / n);
+				else
+					c2 = 0.0;
 
 				if (c2 == 0.0)
 					/* Something like constant ref.
 					 * We regard this as uncorrelated.
 					 */
-					cc = 0.0;
+					q[x * bands] = 0.0;
 				else
-					cc = sum3 / c2;
+					q[x * bands] = num / c2;
+
+				if (x + ref->Xsize < width) {
+					s += sum[x + ref->Xsize] - sum[x];
+					s2 += sum2[x + ref->Xsize] - sum2[x];
+				}
+			}
 
-				*q++ = cc;
+			if (y + 1 < r->height) {
+				vips_spcor_add_line(in, r, y, b,
+					width, -1.0, sum, sum2);
+				vips_spcor_add_line(in, r, y + ref->Ysize, b,
+					width, 1.0, sum, sum2);
 			}
 		}
 	}
+
+	g_free(sum);
 }
 
 /* Save a bit of typing.
@@ -357,6 +454,11 @@ vips_spcor_init(VipsSpcor *spcor)
  * from Niblack "An Introduction to Digital Image Processing",
  * Prentice/Hall, pp 138.
  *
+ * The window sums of @in are running sums, and the numerator is a
+ * convolution of @in with the zero-mean @ref, done with an FFT when @ref
+ * is large, so the cost per output pixel does not grow with the size of
+ * @ref.
+ *
  * If the number of bands differs, one of the images
  * must have one band. In this case, an n-band image is formed from the
  * one-band image by joining n copies of the one-band image together, and then
@@ -18,6 +18,8 @@
  * 3/4/18
  * 	- always write MULTIBAND, otherwise when we join up these things it'll
  * 	  look like we have an alpha
+ * 15/10/26
+ * 	- mark the output as constant
  */
 
 /*
@@ -118,6 +120,8 @@ vips_black_build(VipsObject *object)
 			NULL, vips_black_gen, NULL, NULL, NULL))
 		return -1;
 
+	vips__image_set_constant(create->out, NULL);
+
 	return 0;
 }
 
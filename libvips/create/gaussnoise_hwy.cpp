@@ -0,0 +1,156 @@
+/* 15/10/26
+ * 	- initial implementation
+ */
+
+/*
+
+	This file is part of VIPS.
+
+	VIPS is free software; you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+	02110-1301  USA
+
+ */
+
+/*
+
+	These files are distributed with VIPS - http://www.vips.ecs.soton.ac.uk
+
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /*HAVE_CONFIG_H*/
+#include <glib/gi18n-lib.h>
+
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+#include <vips/vips.h>
+#include <vips/vector.h>
+#include <vips/debug.h>
+#include <vips/internal.h>
+
+#include "pcreate.h"
+
+#ifdef HAVE_HWY
+
+#undef HWY_TARGET_INCLUDE
+#define HWY_TARGET_INCLUDE "libvips/create/gaussnoise_hwy.cpp"
+#include <hwy/foreach_target.h>
+#include <hwy/highway.h>
+
+namespace HWY_NAMESPACE {
+
+using namespace hwy::HWY_NAMESPACE;
+
+using DU32 = ScalableTag<uint32_t>;
+constexpr DU32 du32;
+using DI32 = ScalableTag<int32_t>;
+constexpr DI32 di32;
+using DF32 = ScalableTag<float>;
+constexpr DF32 df32;
+
+// Compat for Highway versions < 1.3.0
+#ifndef HWY_LANES_CONSTEXPR
+#define HWY_LANES_CONSTEXPR
+#endif
+
+/* The same FNV-1a steps as vips__random_add(), but for a vector of values.
+ */
+template <typename V>
+HWY_INLINE V
+fnv_add(V hash, V value)
+{
+	const auto prime = Set(du32, 16777619u);
+	const auto mask = Set(du32, 0xff);
+
+	hash = Mul(Xor(hash, And(value, mask)), prime);
+	hash = Mul(Xor(hash, And(ShiftRight<8>(value), mask)), prime);
+	hash = Mul(Xor(hash, And(ShiftRight<16>(value), mask)), prime);
+	hash = Mul(Xor(hash, ShiftRight<24>(value)), prime);
+
+	return hash;
+}
+
+/* Noise for the N pixels starting at x. Each lane only depends on the seed
+ * and its own coordinate, so pixels come out the same however the image is
+ * split into tiles.
+ */
+HWY_INLINE Vec<DF32>
+gaussnoise_vector(uint32_t seed, int32_t x, int32_t y,
+	Vec<DF32> scale, Vec<DF32> offset)
+{
+	const auto basis = Set(du32, 2166136261u);
+
+	auto hash = fnv_add(Set(du32, seed),
+		BitCast(du32, Iota(di32, x)));
+	hash = fnv_add(hash, Set(du32, (uint32_t) y));
+
+	/* 12 values of 24 bits each will fit in a signed int.
+	 */
+	auto sum = Zero(du32);
+	for (int i = 0; i < 12; i++) {
+		hash = fnv_add(basis, hash);
+		sum = Add(sum, ShiftRight<8>(hash));
+	}
+
+	return MulAdd(ConvertTo(df32, BitCast(di32, sum)), scale, offset);
+}
+
+HWY_ATTR void
+vips_gaussnoise_line_hwy(float *HWY_RESTRICT q, int32_t n,
+	uint32_t seed, int32_t left, int32_t top, float scale, float offset)
+{
+	HWY_LANES_CONSTEXPR int32_t N = Lanes(df32);
+	const auto v_scale = Set(df32, scale);
+	const auto v_offset = Set(df32, offset);
+
+	int32_t x = 0;
+	for (; x + N <= n; x += N)
+		StoreU(gaussnoise_vector(seed, left + x, top, v_scale, v_offset),
+			df32, q + x);
+
+	/* Make the final few pixels with a whole vector too, rather than a
+	 * scalar loop, so a pixel has the same value whether it lands in the
+	 * body or the tail of a line.
+	 */
+	if (x < n) {
+		HWY_ALIGN float tail[MaxLanes(df32)];
+
+		Store(gaussnoise_vector(seed, left + x, top, v_scale, v_offset),
+			df32, tail);
+		memcpy(q + x, tail, (n - x) * sizeof(float));
+	}
+}
+
+} /*namespace HWY_NAMESPACE*/
+
+#if HWY_ONCE
+HWY_EXPORT(vips_gaussnoise_line_hwy);
+
+void
+vips_gaussnoise_line_hwy(float *q, int n,
+	guint32 seed, int left, int top, float scale, float offset)
+{
+	/* clang-format off */
+	HWY_DYNAMIC_DISPATCH(vips_gaussnoise_line_hwy)(q, n,
+		seed, left, top, scale, offset);
+	/* clang-format on */
+}
+#endif /*HWY_ONCE*/
+
+#endif /*HAVE_HWY*/
@@ -66,6 +66,12 @@ typedef struct _VipsCreateClass {
 
 GType vips_create_get_type(void);
 
+/* SIMD path, see gaussnoise_hwy.cpp. Makes @n pixels of line @top,
+ * starting at column @left.
+ */
+void vips_gaussnoise_line_hwy(float *q, int n,
+	guint32 seed, int left, int top, float scale, float offset);
+
 #ifdef __cplusplus
 }
 #endif /*__cplusplus*/
@@ -41,6 +41,10 @@
  *	- make our own fontmap to prevent conflict with other API users
  * 15/2/23
  *	- allow negative line spacing
+ * 15/10/26
+ *	- keep a small cache of rendered text
+ *	- use a pool of fontmaps and set dpi on the context, so we no longer
+ *	  need to lock around rendering
  */
 
 /*
@@ -127,22 +131,46 @@ typedef VipsCreateClass VipsTextClass;
 
 G_DEFINE_TYPE(VipsText, vips_text, VIPS_TYPE_CREATE);
 
-/* These are expensive and do not unref cleanly on many platforms. We keep a
- * single value for libvips and reuse it behind a lock.
- *
- * Have one shared between libvips threads.
+/* The max number of rendered texts we keep, and the largest image we will
+ * cache.
  */
-static PangoFontMap *vips_text_fontmap = NULL;
+#define VIPS_TEXT_CACHE_MAX (100)
+#define VIPS_TEXT_CACHE_MAX_PELS (1024 * 1024)
 
-/* ... single-thread vips_text_fontfiles with this.
+/* Fontmaps are expensive and do not unref cleanly on many platforms, so we
+ * never free them. Each render takes a fontmap from this pool, or makes a
+ * new one if the pool is empty, and returns it when done. This means
+ * renders on different threads never share a fontmap.
  */
-static GMutex vips_text_lock;
+static GSList *vips_text_fontmaps = NULL;
+
+/* Bumped every time we load a fontfile. Each fontmap records the serial it
+ * last saw, and clears its fontconfig cache if it's out of date.
+ */
+static int vips_text_fontfile_serial = 0;
 
 /* All the fontfiles we've loaded. fontconfig lets you add a fontfile
  * repeatedly, and we obviously don't want that.
  */
 static GHashTable *vips_text_fontfiles = NULL;
 
+/* Rendered texts, keyed by a string made from all the params that change
+ * the pixels, most recently used at the head of the queue.
+ */
+typedef struct _VipsTextCacheEntry {
+	char *key;
+	VipsImage *image;
+	int dpi;
+} VipsTextCacheEntry;
+
+static GHashTable *vips_text_cache = NULL;
+static GQueue vips_text_cache_lru = G_QUEUE_INIT;
+
+/* Lock the fontmap pool, the fontfile table and the cache with this. It is
+ * never held during layout or rendering.
+ */
+static GMutex vips_text_lock;
+
 static void
 vips_text_dispose(GObject *gobject)
 {
@@ -230,8 +258,7 @@ vips_text_get_extents(VipsText *text, VipsRect *extents)
 	PangoRectangle ink_rect;
 	PangoRectangle logical_rect;
 
-	pango_cairo_font_map_set_resolution(
-		PANGO_CAIRO_FONT_MAP(vips_text_fontmap), text->dpi);
+	pango_cairo_context_set_resolution(text->context, text->dpi);
 
 	VIPS_UNREF(text->layout);
 	if (!(text->layout = text_layout_new(text->context,
@@ -381,57 +408,61 @@ vips_text_autofit(VipsText *text)
 static void *
 vips_text_init_once(void *client)
 {
-	vips_text_fontmap = pango_cairo_font_map_new();
 	vips_text_fontfiles = g_hash_table_new(g_str_hash, g_str_equal);
+	vips_text_cache = g_hash_table_new(g_str_hash, g_str_equal);
 
 	return NULL;
 }
 
-static int
-vips_text_build(VipsObject *object)
+static PangoFontMap *
+vips_text_fontmap_get(void)
 {
-	static GOnce once = G_ONCE_INIT;
-
-	VipsObjectClass *class = VIPS_OBJECT_GET_CLASS(object);
-	VipsCreate *create = VIPS_CREATE(object);
-	VipsText *text = (VipsText *) object;
-	VipsImage **t = (VipsImage **) vips_object_local_array(object, 3);
-
-	VipsRect extents;
-	VipsImage *in;
-	cairo_surface_t *surface;
-	cairo_t *cr;
-	cairo_status_t status;
+	PangoFontMap *fontmap;
+	int serial;
 
-	if (VIPS_OBJECT_CLASS(vips_text_parent_class)->build(object))
-		return -1;
-
-	if (!pango_parse_markup(text->text, -1, 0, NULL, NULL, NULL, NULL)) {
-		vips_error(class->nickname,
-			"%s", _("invalid markup in text"));
-		return -1;
+	g_mutex_lock(&vips_text_lock);
+	if (vips_text_fontmaps) {
+		fontmap = (PangoFontMap *) vips_text_fontmaps->data;
+		vips_text_fontmaps = g_slist_delete_link(vips_text_fontmaps,
+			vips_text_fontmaps);
 	}
-
-	VIPS_ONCE(&once, vips_text_init_once, NULL);
-
-	text->context = pango_font_map_create_context(vips_text_fontmap);
-
-	if (text->rgba) {
-		/* Prevent use of subpixel anti-aliasing to avoid artefacts.
-		 */
-		cairo_font_options_t *opts = cairo_font_options_create();
-		cairo_font_options_set_antialias(opts, CAIRO_ANTIALIAS_GRAY);
-		pango_cairo_context_set_font_options(text->context, opts);
-		cairo_font_options_destroy(opts);
+	else {
+		fontmap = pango_cairo_font_map_new();
+		g_object_set_data(G_OBJECT(fontmap),
+			"vips-text-serial", GINT_TO_POINTER(0));
 	}
+	serial = vips_text_fontfile_serial;
+	g_mutex_unlock(&vips_text_lock);
 
-	/* Because we set resolution on vips_text_fontmap and that's shared
-	 * between all vips_text instances, we must lock all the way to the
-	 * end of text rendering.
+#ifdef HAVE_FONTCONFIG
+	/* Pango must invalidate its fontconfig cache if any fontfiles have
+	 * been loaded since this fontmap was last used.
 	 */
+	if (GPOINTER_TO_INT(g_object_get_data(G_OBJECT(fontmap),
+			"vips-text-serial")) != serial) {
+		if (PANGO_IS_FC_FONT_MAP(fontmap))
+			pango_fc_font_map_cache_clear(PANGO_FC_FONT_MAP(fontmap));
+		g_object_set_data(G_OBJECT(fontmap),
+			"vips-text-serial", GINT_TO_POINTER(serial));
+	}
+#endif /*HAVE_FONTCONFIG*/
+
+	return fontmap;
+}
+
+static void
+vips_text_fontmap_put(PangoFontMap *fontmap)
+{
 	g_mutex_lock(&vips_text_lock);
+	vips_text_fontmaps = g_slist_prepend(vips_text_fontmaps, fontmap);
+	g_mutex_unlock(&vips_text_lock);
+}
 
+static void
+vips_text_add_fontfile(VipsText *text)
+{
 #ifdef HAVE_FONTCONFIG
+	g_mutex_lock(&vips_text_lock);
 	if (text->fontfile &&
 		!g_hash_table_contains(vips_text_fontfiles, text->fontfile)) {
 		/* This can fail if you eg. add the same font from two
@@ -443,69 +474,166 @@ vips_text_build(VipsObject *object)
 				text->fontfile);
 		g_hash_table_insert(vips_text_fontfiles,
 			g_strdup(text->fontfile), NULL);
-
-		/* We need to inform that pango should invalidate its
-		 * fontconfig cache whenever any changes are made.
-		 */
-		if (PANGO_IS_FC_FONT_MAP(vips_text_fontmap))
-			pango_fc_font_map_cache_clear(
-				PANGO_FC_FONT_MAP(vips_text_fontmap));
+		vips_text_fontfile_serial += 1;
 	}
+	g_mutex_unlock(&vips_text_lock);
 #else  /*!HAVE_FONTCONFIG*/
 	if (text->fontfile)
 		g_warning("ignoring fontfile (no fontconfig support)");
 #endif /*HAVE_FONTCONFIG*/
+}
+
+/* Make a key for the cache from everything which can change the pixels. If
+ * we are autofitting, dpi is an output and height is an input.
+ */
+static char *
+vips_text_cache_key(VipsText *text, gboolean autofit)
+{
+	return g_strdup_printf("%s\n%s\n%s\n%d %d %d %d %d %d %d %d",
+		text->text,
+		text->font ? text->font : "",
+		text->fontfile ? text->fontfile : "",
+		text->width,
+		autofit ? text->height : -1,
+		autofit ? -1 : text->dpi,
+		text->spacing,
+		text->align,
+		text->justify,
+		text->wrap,
+		text->rgba);
+}
+
+/* Look up a rendered text. Return a new ref, or NULL for not found.
+ */
+static VipsImage *
+vips_text_cache_lookup(const char *key, int *dpi)
+{
+	VipsImage *image;
+	GList *link;
+
+	image = NULL;
+
+	g_mutex_lock(&vips_text_lock);
+	if ((link = g_hash_table_lookup(vips_text_cache, key))) {
+		VipsTextCacheEntry *entry = (VipsTextCacheEntry *) link->data;
+
+		g_queue_unlink(&vips_text_cache_lru, link);
+		g_queue_push_head_link(&vips_text_cache_lru, link);
+
+		image = entry->image;
+		g_object_ref(image);
+		*dpi = entry->dpi;
+	}
+	g_mutex_unlock(&vips_text_lock);
+
+	return image;
+}
+
+static void
+vips_text_cache_insert(const char *key, VipsImage *image, int dpi)
+{
+	if (VIPS_IMAGE_N_PELS(image) > VIPS_TEXT_CACHE_MAX_PELS)
+		return;
+
+	g_mutex_lock(&vips_text_lock);
+
+	/* Another thread could have rendered the same text.
+	 */
+	if (!g_hash_table_contains(vips_text_cache, key)) {
+		VipsTextCacheEntry *entry = g_new(VipsTextCacheEntry, 1);
+
+		entry->key = g_strdup(key);
+		entry->image = image;
+		g_object_ref(image);
+		entry->dpi = dpi;
+		g_queue_push_head(&vips_text_cache_lru, entry);
+		g_hash_table_insert(vips_text_cache,
+			entry->key, vips_text_cache_lru.head);
+
+		while (g_queue_get_length(&vips_text_cache_lru) >
+			VIPS_TEXT_CACHE_MAX) {
+			entry = (VipsTextCacheEntry *)
+				g_queue_pop_tail(&vips_text_cache_lru);
+
+			g_hash_table_remove(vips_text_cache, entry->key);
+			VIPS_UNREF(entry->image);
+			g_free(entry->key);
+			g_free(entry);
+		}
+	}
+
+	g_mutex_unlock(&vips_text_lock);
+}
+
+/* Lay out and render to a new memory image, RGBA or premultiplied BGRA.
+ */
+static int
+vips_text_render(VipsText *text, PangoFontMap *fontmap, VipsImage **out)
+{
+	VipsObjectClass *class = VIPS_OBJECT_GET_CLASS(text);
+	VipsObject *object = VIPS_OBJECT(text);
+
+	VipsRect extents;
+	VipsImage *image;
+	cairo_surface_t *surface;
+	cairo_t *cr;
+	cairo_status_t status;
+
+	text->context = pango_font_map_create_context(fontmap);
+
+	if (text->rgba) {
+		/* Prevent use of subpixel anti-aliasing to avoid artefacts.
+		 */
+		cairo_font_options_t *opts = cairo_font_options_create();
+		cairo_font_options_set_antialias(opts, CAIRO_ANTIALIAS_GRAY);
+		pango_cairo_context_set_font_options(text->context, opts);
+		cairo_font_options_destroy(opts);
+	}
 
 	/* If our caller set height and not dpi, we adjust dpi until
 	 * we get a fit.
 	 */
 	if (vips_object_argument_isset(object, "height") &&
 		!vips_object_argument_isset(object, "dpi")) {
-		if (vips_text_autofit(text)) {
-			g_mutex_unlock(&vips_text_lock);
+		if (vips_text_autofit(text))
 			return -1;
-		}
 	}
 
 	/* Layout. Can fail for "", for example.
 	 */
-	if (vips_text_get_extents(text, &extents)) {
-		g_mutex_unlock(&vips_text_lock);
+	if (vips_text_get_extents(text, &extents))
 		return -1;
-	}
 
 	if (extents.width == 0 ||
 		extents.height == 0) {
-		g_mutex_unlock(&vips_text_lock);
 		vips_error(class->nickname, "%s", _("no text to render"));
 		return -1;
 	}
 
-	t[0] = vips_image_new_memory();
-	vips_image_init_fields(t[0],
+	image = vips_image_new_memory();
+	vips_image_init_fields(image,
 		extents.width, extents.height, 4,
 		VIPS_FORMAT_UCHAR, VIPS_CODING_NONE, VIPS_INTERPRETATION_sRGB,
 		text->dpi / 25.4, text->dpi / 25.4);
-	t[0]->Xoffset = extents.left;
-	t[0]->Yoffset = extents.top;
+	image->Xoffset = extents.left;
+	image->Yoffset = extents.top;
 
-	if (vips_image_pipelinev(t[0], VIPS_DEMAND_STYLE_ANY, NULL) ||
-		vips_image_write_prepare(t[0])) {
-		g_mutex_unlock(&vips_text_lock);
+	if (vips_image_pipelinev(image, VIPS_DEMAND_STYLE_ANY, NULL) ||
+		vips_image_write_prepare(image)) {
+		VIPS_UNREF(image);
 		return -1;
 	}
-	in = t[0];
 
 	surface = cairo_image_surface_create_for_data(
-		VIPS_IMAGE_ADDR(in, 0, 0),
+		VIPS_IMAGE_ADDR(image, 0, 0),
 		CAIRO_FORMAT_ARGB32,
-		in->Xsize, in->Ysize,
-		VIPS_IMAGE_SIZEOF_LINE(in));
+		image->Xsize, image->Ysize,
+		VIPS_IMAGE_SIZEOF_LINE(image));
 
 	status = cairo_surface_status(surface);
 	if (status) {
 		cairo_surface_destroy(surface);
-		g_mutex_unlock(&vips_text_lock);
+		VIPS_UNREF(image);
 		vips_error(class->nickname,
 			"%s", cairo_status_to_string(status));
 		return -1;
@@ -520,18 +648,84 @@ vips_text_build(VipsObject *object)
 
 	cairo_destroy(cr);
 
-	g_mutex_unlock(&vips_text_lock);
-
 	if (text->rgba) {
 		/* Cairo makes pre-multipled BRGA -- we must byteswap and
 		 * unpremultiply.
 		 */
-		for (int y = 0; y < in->Ysize; y++)
+		for (int y = 0; y < image->Ysize; y++)
 			vips__premultiplied_bgra2rgba(
-				(guint32 *) VIPS_IMAGE_ADDR(in, 0, y),
-				in->Xsize);
+				(guint32 *) VIPS_IMAGE_ADDR(image, 0, y),
+				image->Xsize);
+	}
+
+	*out = image;
+
+	return 0;
+}
+
+static int
+vips_text_build(VipsObject *object)
+{
+	static GOnce once = G_ONCE_INIT;
+
+	VipsObjectClass *class = VIPS_OBJECT_GET_CLASS(object);
+	VipsCreate *create = VIPS_CREATE(object);
+	VipsText *text = (VipsText *) object;
+	VipsImage **t = (VipsImage **) vips_object_local_array(object, 3);
+
+	gboolean autofit;
+	char *key;
+	VipsImage *in;
+	int dpi;
+
+	if (VIPS_OBJECT_CLASS(vips_text_parent_class)->build(object))
+		return -1;
+
+	if (!pango_parse_markup(text->text, -1, 0, NULL, NULL, NULL, NULL)) {
+		vips_error(class->nickname,
+			"%s", _("invalid markup in text"));
+		return -1;
+	}
+
+	VIPS_ONCE(&once, vips_text_init_once, NULL);
+
+	vips_text_add_fontfile(text);
+
+	autofit = vips_object_argument_isset(object, "height") &&
+		!vips_object_argument_isset(object, "dpi");
+	key = vips_text_cache_key(text, autofit);
+
+	if ((t[0] = vips_text_cache_lookup(key, &dpi))) {
+		if (autofit) {
+			text->dpi = dpi;
+			g_object_set(text, "autofit_dpi", text->dpi, NULL);
+		}
 	}
 	else {
+		PangoFontMap *fontmap;
+		int result;
+
+		fontmap = vips_text_fontmap_get();
+		result = vips_text_render(text, fontmap, &t[0]);
+
+		/* The layout and context ref the fontmap, so we must drop
+		 * them before another thread can use it.
+		 */
+		VIPS_UNREF(text->layout);
+		VIPS_UNREF(text->context);
+		vips_text_fontmap_put(fontmap);
+
+		if (result) {
+			g_free(key);
+			return -1;
+		}
+
+		vips_text_cache_insert(key, t[0], text->dpi);
+	}
+	g_free(key);
+	in = t[0];
+
+	if (!text->rgba) {
 		/* We just want the alpha channel.
 		 */
 		if (vips_extract_band(in, &t[1], 3, NULL) ||
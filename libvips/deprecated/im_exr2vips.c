@@ -54,7 +54,7 @@ int
 im_exr2vips(const char *filename, IMAGE *out)
 {
 #ifdef HAVE_OPENEXR
-	return vips__openexr_read(filename, out);
+	return vips__openexr_read(filename, out, 0);
 #else
 	vips_error("im_exr2vips",
 		"%s", _("no OpenEXR support in your libvips"));
@@ -116,7 +116,7 @@ jpeg2vips(const char *name, IMAGE *out, gboolean header_only)
 		if (!(source = vips_source_new_from_file(filename)))
 			return -1;
 		if (vips__jpeg_read_source(source, out,
-				header_only, shrink, fail_on, FALSE, FALSE)) {
+				header_only, 8 / shrink, fail_on, FALSE, FALSE, NULL)) {
 			VIPS_UNREF(source);
 			return -1;
 		}
@@ -32,6 +32,9 @@
  * 	- redo as a class
  * 5/4/20
  * 	- could fail to complete for some very complex shapes
+ * 15/10/26
+ * 	- fill large images by labelling runs in parallel strips, then
+ * 	  joining them with a union-find
  */
 
 /*
@@ -404,6 +407,418 @@ flood_around(Flood *flood, Scan *scan)
 	}
 }
 
+/* For large images, we can label all the connected runs in the image in
+ * parallel strips, join the strips with a union-find, and then paint
+ * the set of runs holding the start point.
+ */
+#define FLOOD_STRIP_HEIGHT (128)
+
+/* Images with fewer pixels than this are faster with the serial fill.
+ */
+#define FLOOD_PARALLEL_PELS (4 * 1024 * 1024)
+
+/* A run of connected pixels on a line, x1 and x2 inclusive. Parent is the
+ * index of a run in the same set, always an earlier one, or itself for the
+ * root.
+ */
+typedef struct {
+	int x1, x2;
+	int y;
+	int parent;
+} Run;
+
+typedef struct {
+	/* The lines we cover.
+	 */
+	int top;
+	int height;
+
+	/* Runs in raster order, and the index of the first run on each line,
+	 * plus one for the end.
+	 */
+	Run *runs;
+	int n_runs;
+	int size;
+	int *line;
+
+	/* Index of our first run in the joined parent table.
+	 */
+	int offset;
+
+	/* Bounding box of the pixels we paint.
+	 */
+	int left;
+	int right;
+	int ptop;
+	int bottom;
+} FloodStrip;
+
+typedef struct _FloodParallel {
+	Flood *flood;
+
+	int n_strips;
+	FloodStrip *strips;
+
+	/* Parent for every run in the image, and the root of the set we
+	 * paint.
+	 */
+	int *parent;
+	int root;
+
+	/* FALSE for the labelling pass, TRUE for painting.
+	 */
+	gboolean paint;
+
+	GMutex lock;
+	GCond cond;
+	int next;
+	int n_running;
+	gboolean failed;
+} FloodParallel;
+
+static inline int
+flood_find(Run *runs, int i)
+{
+	while (runs[i].parent != i) {
+		runs[i].parent = runs[runs[i].parent].parent;
+		i = runs[i].parent;
+	}
+
+	return i;
+}
+
+static inline void
+flood_union(Run *runs, int i, int j)
+{
+	i = flood_find(runs, i);
+	j = flood_find(runs, j);
+
+	if (i < j)
+		runs[j].parent = i;
+	else
+		runs[i].parent = j;
+}
+
+static inline int
+flood_find_parent(int *parent, int i)
+{
+	while (parent[i] != i) {
+		parent[i] = parent[parent[i]];
+		i = parent[i];
+	}
+
+	return i;
+}
+
+static inline gboolean
+flood_overlap(Run *a, Run *b)
+{
+	return a->x1 <= b->x2 && b->x1 <= a->x2;
+}
+
+/* Find the runs of connected pixels in a strip, and join runs which touch
+ * on adjacent lines.
+ */
+static int
+flood_strip_label(Flood *flood, FloodStrip *strip)
+{
+	const int width = flood->test->Xsize;
+
+	for (int y = 0; y < strip->height; y++) {
+		VipsPel *p = VIPS_IMAGE_ADDR(flood->test, 0, strip->top + y);
+
+		int x;
+
+		strip->line[y] = strip->n_runs;
+
+		x = 0;
+		while (x < width) {
+			int x1;
+
+			for (; x < width && !flood_connected(flood, p); x++)
+				p += flood->tsize;
+			if (x == width)
+				break;
+
+			x1 = x;
+			for (; x < width && flood_connected(flood, p); x++)
+				p += flood->tsize;
+
+			if (strip->n_runs == strip->size) {
+				int size = VIPS_MAX(256, strip->size * 2);
+				Run *runs;
+
+				if (!(runs = g_try_renew(Run, strip->runs, size)))
+					return -1;
+				strip->runs = runs;
+				strip->size = size;
+			}
+
+			strip->runs[strip->n_runs].x1 = x1;
+			strip->runs[strip->n_runs].x2 = x - 1;
+			strip->runs[strip->n_runs].y = strip->top + y;
+			strip->runs[strip->n_runs].parent = strip->n_runs;
+			strip->n_runs += 1;
+		}
+
+		/* Join to any runs we touch on the line above.
+		 */
+		if (y > 0) {
+			int i = strip->line[y - 1];
+			int j = strip->line[y];
+
+			while (i < strip->line[y] &&
+				j < strip->n_runs) {
+				if (flood_overlap(&strip->runs[i], &strip->runs[j]))
+					flood_union(strip->runs, i, j);
+
+				if (strip->runs[i].x2 < strip->runs[j].x2)
+					i++;
+				else
+					j++;
+			}
+		}
+	}
+
+	strip->line[strip->height] = strip->n_runs;
+
+	return 0;
+}
+
+/* Paint the runs in a strip which are in the set of the start point.
+ */
+static void
+flood_strip_paint(FloodParallel *parallel, FloodStrip *strip)
+{
+	for (int i = 0; i < strip->n_runs; i++)
+		if (parallel->parent[strip->offset + i] == parallel->root) {
+			Run *run = &strip->runs[i];
+
+			flood_draw_scanline(parallel->flood,
+				run->y, run->x1, run->x2);
+
+			strip->left = VIPS_MIN(strip->left, run->x1);
+			strip->right = VIPS_MAX(strip->right, run->x2);
+			strip->ptop = VIPS_MIN(strip->ptop, run->y);
+			strip->bottom = VIPS_MAX(strip->bottom, run->y);
+		}
+}
+
+static void
+flood_parallel_work(void *a, void *b)
+{
+	FloodParallel *parallel = (FloodParallel *) a;
+
+	for (;;) {
+		FloodStrip *strip;
+		int i;
+
+		g_mutex_lock(&parallel->lock);
+		i = parallel->failed ? parallel->n_strips : parallel->next++;
+		g_mutex_unlock(&parallel->lock);
+
+		if (i >= parallel->n_strips)
+			break;
+
+		strip = &parallel->strips[i];
+		if (parallel->paint)
+			flood_strip_paint(parallel, strip);
+		else if (flood_strip_label(parallel->flood, strip)) {
+			g_mutex_lock(&parallel->lock);
+			parallel->failed = TRUE;
+			g_mutex_unlock(&parallel->lock);
+		}
+	}
+
+	/* We can be freed as soon as we unlock, so this must be the last
+	 * thing we do.
+	 */
+	g_mutex_lock(&parallel->lock);
+	parallel->n_running -= 1;
+	g_cond_broadcast(&parallel->cond);
+	g_mutex_unlock(&parallel->lock);
+}
+
+/* Run a pass over all the strips on a set of workers, and wait for them all
+ * to finish.
+ */
+static int
+flood_parallel_run(FloodParallel *parallel, gboolean paint)
+{
+	int n_workers;
+
+	parallel->paint = paint;
+	parallel->next = 0;
+	parallel->n_running = 0;
+	parallel->failed = FALSE;
+
+	n_workers = VIPS_MIN(vips_concurrency_get(), parallel->n_strips);
+
+	vips__worker_lock(&parallel->lock);
+	for (int i = 0; i < n_workers; i++) {
+		parallel->n_running += 1;
+		if (vips_thread_execute("flood", flood_parallel_work, parallel))
+			parallel->n_running -= 1;
+	}
+
+	/* If we couldn't start any workers, do it ourselves.
+	 */
+	if (parallel->n_running == 0) {
+		parallel->n_running += 1;
+		g_mutex_unlock(&parallel->lock);
+		flood_parallel_work(parallel, NULL);
+		vips__worker_lock(&parallel->lock);
+	}
+
+	while (parallel->n_running > 0)
+		vips__worker_cond_wait(&parallel->cond, &parallel->lock);
+	g_mutex_unlock(&parallel->lock);
+
+	return parallel->failed ? -1 : 0;
+}
+
+/* Join the strips into a single parent table, and find the root of the set
+ * holding (x, y), or -1 if (x, y) is not connected.
+ */
+static int
+flood_parallel_join(FloodParallel *parallel, int x, int y)
+{
+	FloodStrip *start;
+	int n_runs;
+	int root;
+
+	n_runs = 0;
+	for (int k = 0; k < parallel->n_strips; k++) {
+		parallel->strips[k].offset = n_runs;
+		n_runs += parallel->strips[k].n_runs;
+	}
+
+	if (!(parallel->parent = VIPS_ARRAY(NULL, VIPS_MAX(1, n_runs), int)))
+		return -1;
+
+	for (int k = 0; k < parallel->n_strips; k++) {
+		FloodStrip *strip = &parallel->strips[k];
+
+		for (int i = 0; i < strip->n_runs; i++)
+			parallel->parent[strip->offset + i] =
+				strip->offset + strip->runs[i].parent;
+	}
+
+	/* Join the last line of each strip to the first line of the next.
+	 */
+	for (int k = 0; k < parallel->n_strips - 1; k++) {
+		FloodStrip *upper = &parallel->strips[k];
+		FloodStrip *lower = &parallel->strips[k + 1];
+		int i = upper->line[upper->height - 1];
+		int j = lower->line[0];
+
+		while (i < upper->n_runs &&
+			j < lower->line[1]) {
+			if (flood_overlap(&upper->runs[i], &lower->runs[j])) {
+				int a = flood_find_parent(parallel->parent,
+					upper->offset + i);
+				int b = flood_find_parent(parallel->parent,
+					lower->offset + j);
+
+				if (a < b)
+					parallel->parent[b] = a;
+				else
+					parallel->parent[a] = b;
+			}
+
+			if (upper->runs[i].x2 < lower->runs[j].x2)
+				i++;
+			else
+				j++;
+		}
+	}
+
+	/* Every run points at an earlier one, so one pass in order takes
+	 * every run straight to its root.
+	 */
+	for (int i = 0; i < n_runs; i++)
+		parallel->parent[i] = parallel->parent[parallel->parent[i]];
+
+	start = &parallel->strips[y / FLOOD_STRIP_HEIGHT];
+	root = -1;
+	for (int i = start->line[y - start->top];
+		i < start->line[y - start->top + 1]; i++)
+		if (start->runs[i].x1 <= x &&
+			x <= start->runs[i].x2) {
+			root = parallel->parent[start->offset + i];
+			break;
+		}
+
+	return root;
+}
+
+/* Fill from (x, y) by labelling the whole image in parallel. Return -1 if we
+ * couldn't, and the caller should use the serial fill.
+ */
+static int
+flood_parallel(Flood *flood, int x, int y)
+{
+	const int height = flood->test->Ysize;
+
+	FloodParallel parallel;
+	int result;
+
+	parallel.flood = flood;
+	parallel.n_strips = VIPS_ROUND_UP(height, FLOOD_STRIP_HEIGHT) /
+		FLOOD_STRIP_HEIGHT;
+	parallel.parent = NULL;
+	if (!(parallel.strips = VIPS_ARRAY(NULL, parallel.n_strips, FloodStrip)))
+		return -1;
+	g_mutex_init(&parallel.lock);
+	g_cond_init(&parallel.cond);
+
+	result = 0;
+	for (int k = 0; k < parallel.n_strips; k++) {
+		FloodStrip *strip = &parallel.strips[k];
+
+		strip->top = k * FLOOD_STRIP_HEIGHT;
+		strip->height =
+			VIPS_MIN(FLOOD_STRIP_HEIGHT, height - strip->top);
+		strip->runs = NULL;
+		strip->n_runs = 0;
+		strip->size = 0;
+		strip->line = VIPS_ARRAY(NULL, strip->height + 1, int);
+		strip->left = flood->left;
+		strip->right = flood->right;
+		strip->ptop = flood->top;
+		strip->bottom = flood->bottom;
+
+		if (!strip->line)
+			result = -1;
+	}
+
+	if (!result &&
+		!flood_parallel_run(&parallel, FALSE) &&
+		(parallel.root = flood_parallel_join(&parallel, x, y)) >= 0 &&
+		!flood_parallel_run(&parallel, TRUE))
+		for (int k = 0; k < parallel.n_strips; k++) {
+			FloodStrip *strip = &parallel.strips[k];
+
+			flood->left = VIPS_MIN(flood->left, strip->left);
+			flood->right = VIPS_MAX(flood->right, strip->right);
+			flood->top = VIPS_MIN(flood->top, strip->ptop);
+			flood->bottom = VIPS_MAX(flood->bottom, strip->bottom);
+		}
+	else
+		result = -1;
+
+	for (int k = 0; k < parallel.n_strips; k++) {
+		VIPS_FREE(parallel.strips[k].runs);
+		VIPS_FREE(parallel.strips[k].line);
+	}
+	VIPS_FREE(parallel.strips);
+	VIPS_FREE(parallel.parent);
+	g_mutex_clear(&parallel.lock);
+	g_cond_clear(&parallel.cond);
+
+	return result;
+}
+
 static void
 flood_all(Flood *flood, int x, int y)
 {
@@ -414,6 +829,16 @@ flood_all(Flood *flood, int x, int y)
 	if (!flood_connected(flood, VIPS_IMAGE_ADDR(flood->test, x, y)))
 		return;
 
+	/* Large images are labelled in parallel. This needs test and image to
+	 * be the same, since with a separate @image the serial fill also
+	 * stops at pixels which are already painted.
+	 */
+	if (flood->test == flood->image &&
+		VIPS_IMAGE_N_PELS(flood->test) >= FLOOD_PARALLEL_PELS &&
+		vips_concurrency_get() > 1 &&
+		!flood_parallel(flood, x, y))
+		return;
+
 	flood->in = buffer_build();
 	flood->out = buffer_build();
 
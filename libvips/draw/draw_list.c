@@ -0,0 +1,674 @@
+/* draw many rects, circles, lines and points on an image in one operation
+ *
+ * 15/10/26
+ * 	- from draw_rect.c, draw_circle.c and draw_line.c
+ */
+
+/*
+
+	This file is part of VIPS.
+
+	VIPS is free software; you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+	02110-1301  USA
+
+ */
+
+/*
+
+	These files are distributed with VIPS - http://www.vips.ecs.soton.ac.uk
+
+ */
+
+/*
+#define VIPS_DEBUG
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /*HAVE_CONFIG_H*/
+#include <glib/gi18n-lib.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vips/vips.h>
+#include <vips/internal.h>
+#include <vips/debug.h>
+
+/* Primitives are binned into cells of this size.
+ */
+#define VIPS_DRAW_LIST_CELL (128)
+
+typedef enum {
+	VIPS_DRAW_LIST_RECT,
+	VIPS_DRAW_LIST_CIRCLE,
+	VIPS_DRAW_LIST_LINE,
+	VIPS_DRAW_LIST_POINT,
+	VIPS_DRAW_LIST_LAST
+} VipsDrawListType;
+
+/* Number of ints in the argument array for each primitive.
+ */
+static const int vips_draw_list_stride[VIPS_DRAW_LIST_LAST] = {
+	4, 3, 4, 2
+};
+
+typedef struct _VipsDrawList {
+	VipsOperation parent_instance;
+
+	VipsImage *in;
+	VipsImage *out;
+	VipsArrayDouble *ink;
+	VipsArrayInt *rects;
+	VipsArrayInt *circles;
+	VipsArrayInt *lines;
+	VipsArrayInt *points;
+	gboolean fill;
+
+	/* Ink in the image format.
+	 */
+	VipsPel *pixel_ink;
+
+	/* All primitives, as (type, args) pairs. Primitive i is type[i] with
+	 * its arguments at args[i].
+	 */
+	int n_primitives;
+	VipsDrawListType *type;
+	int **args;
+
+	/* cell_start[i] .. cell_start[i + 1] - 1 in cell_primitives are the
+	 * primitives which touch cell i.
+	 */
+	int cells_across;
+	int cells_down;
+	int *cell_start;
+	int *cell_primitives;
+} VipsDrawList;
+
+typedef VipsOperationClass VipsDrawListClass;
+
+G_DEFINE_TYPE(VipsDrawList, vips_draw_list, VIPS_TYPE_OPERATION);
+
+/* Per-thread state.
+ */
+typedef struct _VipsDrawListSequence {
+	VipsRegion *ir;
+
+	/* Mark primitives we've drawn for this request, since big ones will
+	 * be in several cells.
+	 */
+	int *seen;
+	int generation;
+} VipsDrawListSequence;
+
+/* Clip and ink for one request.
+ */
+typedef struct _VipsDrawListClip {
+	VipsRegion *region;
+	VipsRect rect;
+	VipsPel *ink;
+	int psize;
+} VipsDrawListClip;
+
+static void
+vips_draw_list_finalize(GObject *gobject)
+{
+	VipsDrawList *draw_list = (VipsDrawList *) gobject;
+
+	VIPS_FREE(draw_list->type);
+	VIPS_FREE(draw_list->args);
+	VIPS_FREE(draw_list->cell_start);
+	VIPS_FREE(draw_list->cell_primitives);
+
+	G_OBJECT_CLASS(vips_draw_list_parent_class)->finalize(gobject);
+}
+
+static int
+vips_draw_list_stop(void *vseq, void *a, void *b)
+{
+	VipsDrawListSequence *seq = (VipsDrawListSequence *) vseq;
+
+	VIPS_UNREF(seq->ir);
+	VIPS_FREE(seq->seen);
+	VIPS_FREE(seq);
+
+	return 0;
+}
+
+static void *
+vips_draw_list_start(VipsImage *out, void *a, void *b)
+{
+	VipsImage *in = (VipsImage *) a;
+	VipsDrawList *draw_list = (VipsDrawList *) b;
+
+	VipsDrawListSequence *seq;
+
+	if (!(seq = VIPS_NEW(NULL, VipsDrawListSequence)))
+		return NULL;
+
+	seq->ir = vips_region_new(in);
+	seq->seen = VIPS_ARRAY(NULL,
+		VIPS_MAX(1, draw_list->n_primitives), int);
+	seq->generation = 0;
+	if (!seq->seen) {
+		vips_draw_list_stop(seq, NULL, NULL);
+		return NULL;
+	}
+	memset(seq->seen, 0, VIPS_MAX(1, draw_list->n_primitives) * sizeof(int));
+
+	return (void *) seq;
+}
+
+/* Fill a rect, clipped to the request.
+ */
+static void
+vips_draw_list_fill(VipsDrawListClip *clip,
+	int left, int top, int width, int height)
+{
+	VipsRect rect;
+	VipsPel *to;
+	VipsPel *q;
+	size_t lsize;
+	int x, y, j;
+
+	rect.left = left;
+	rect.top = top;
+	rect.width = width;
+	rect.height = height;
+	vips_rect_intersectrect(&rect, &clip->rect, &rect);
+	if (vips_rect_isempty(&rect))
+		return;
+
+	to = VIPS_REGION_ADDR(clip->region, rect.left, rect.top);
+	lsize = VIPS_REGION_LSKIP(clip->region);
+
+	/* Plot the first line pointwise, then memcpy() it for the
+	 * subsequent lines.
+	 */
+	q = to;
+	for (x = 0; x < rect.width; x++) {
+		for (j = 0; j < clip->psize; j++)
+			q[j] = clip->ink[j];
+		q += clip->psize;
+	}
+
+	q = to + lsize;
+	for (y = 1; y < rect.height; y++) {
+		memcpy(q, to, (size_t) rect.width * clip->psize);
+		q += lsize;
+	}
+}
+
+static void
+vips_draw_list_point(VipsImage *image, int x, int y, void *client)
+{
+	VipsDrawListClip *clip = (VipsDrawListClip *) client;
+
+	if (vips_rect_includespoint(&clip->rect, x, y)) {
+		VipsPel *q = VIPS_REGION_ADDR(clip->region, x, y);
+
+		int j;
+
+		for (j = 0; j < clip->psize; j++)
+			q[j] = clip->ink[j];
+	}
+}
+
+static void
+vips_draw_list_endpoints(VipsImage *image,
+	int y, int x1, int x2, int quadrant, void *client)
+{
+	vips_draw_list_point(image, x1, y, client);
+	vips_draw_list_point(image, x2, y, client);
+}
+
+static void
+vips_draw_list_scanline(VipsImage *image,
+	int y, int x1, int x2, int quadrant, void *client)
+{
+	vips_draw_list_fill((VipsDrawListClip *) client,
+		x1, y, x2 - x1 + 1, 1);
+}
+
+/* Draw a primitive, clipped to the request. This must match the single
+ * draw operations exactly.
+ */
+static void
+vips_draw_list_draw(VipsDrawList *draw_list, VipsDrawListClip *clip, int i)
+{
+	int *args = draw_list->args[i];
+
+	switch (draw_list->type[i]) {
+	case VIPS_DRAW_LIST_RECT:
+		/* As draw_rect, narrow unfilled rects are solid.
+		 */
+		if (!draw_list->fill &&
+			args[2] > 2 &&
+			args[3] > 2) {
+			vips_draw_list_fill(clip,
+				args[0], args[1], args[2], 1);
+			vips_draw_list_fill(clip,
+				args[0] + args[2] - 1, args[1], 1, args[3]);
+			vips_draw_list_fill(clip,
+				args[0], args[1] + args[3] - 1, args[2], 1);
+			vips_draw_list_fill(clip,
+				args[0], args[1], 1, args[3]);
+		}
+		else
+			vips_draw_list_fill(clip,
+				args[0], args[1], args[2], args[3]);
+		break;
+
+	case VIPS_DRAW_LIST_CIRCLE:
+		vips__draw_circle_direct(NULL, args[0], args[1], args[2],
+			draw_list->fill
+				? vips_draw_list_scanline
+				: vips_draw_list_endpoints,
+			clip);
+		break;
+
+	case VIPS_DRAW_LIST_LINE:
+		vips__draw_line_direct(NULL,
+			args[0], args[1], args[2], args[3],
+			vips_draw_list_point, clip);
+		break;
+
+	case VIPS_DRAW_LIST_POINT:
+		vips_draw_list_fill(clip, args[0], args[1], 1, 1);
+		break;
+
+	default:
+		g_assert_not_reached();
+	}
+}
+
+static int
+vips_draw_list_gen(VipsRegion *out_region,
+	void *vseq, void *a, void *b, gboolean *stop)
+{
+	VipsDrawListSequence *seq = (VipsDrawListSequence *) vseq;
+	VipsDrawList *draw_list = (VipsDrawList *) b;
+	VipsRect *r = &out_region->valid;
+
+	VipsDrawListClip clip;
+	int cx, cy, i;
+
+	if (vips_region_prepare_to(seq->ir, out_region, r, r->left, r->top))
+		return -1;
+
+	clip.region = out_region;
+	clip.rect = *r;
+	clip.ink = draw_list->pixel_ink;
+	clip.psize = VIPS_IMAGE_SIZEOF_PEL(out_region->im);
+
+	/* Primitives are drawn in the order they were given.
+	 */
+	seq->generation += 1;
+	for (cy = r->top / VIPS_DRAW_LIST_CELL;
+		 cy <= (VIPS_RECT_BOTTOM(r) - 1) / VIPS_DRAW_LIST_CELL; cy++)
+		for (cx = r->left / VIPS_DRAW_LIST_CELL;
+			 cx <= (VIPS_RECT_RIGHT(r) - 1) / VIPS_DRAW_LIST_CELL; cx++) {
+			int cell = cy * draw_list->cells_across + cx;
+
+			for (i = draw_list->cell_start[cell];
+				 i < draw_list->cell_start[cell + 1]; i++) {
+				int p = draw_list->cell_primitives[i];
+
+				if (seq->seen[p] != seq->generation) {
+					seq->seen[p] = seq->generation;
+					vips_draw_list_draw(draw_list, &clip, p);
+				}
+			}
+		}
+
+	return 0;
+}
+
+/* The area a primitive can touch.
+ */
+static void
+vips_draw_list_bounds(VipsDrawList *draw_list, int i, VipsRect *bounds)
+{
+	int *args = draw_list->args[i];
+
+	switch (draw_list->type[i]) {
+	case VIPS_DRAW_LIST_RECT:
+		bounds->left = args[0];
+		bounds->top = args[1];
+		bounds->width = args[2];
+		bounds->height = args[3];
+		break;
+
+	case VIPS_DRAW_LIST_CIRCLE:
+		bounds->left = args[0] - args[2];
+		bounds->top = args[1] - args[2];
+		bounds->width = 2 * args[2] + 1;
+		bounds->height = 2 * args[2] + 1;
+		break;
+
+	case VIPS_DRAW_LIST_LINE:
+		bounds->left = VIPS_MIN(args[0], args[2]);
+		bounds->top = VIPS_MIN(args[1], args[3]);
+		bounds->width = abs(args[2] - args[0]) + 1;
+		bounds->height = abs(args[3] - args[1]) + 1;
+		break;
+
+	case VIPS_DRAW_LIST_POINT:
+		bounds->left = args[0];
+		bounds->top = args[1];
+		bounds->width = 1;
+		bounds->height = 1;
+		break;
+
+	default:
+		g_assert_not_reached();
+	}
+}
+
+/* Run fn for every cell a primitive touches.
+ */
+static void
+vips_draw_list_cells(VipsDrawList *draw_list, int i,
+	void (*fn)(VipsDrawList *draw_list, int cell, int i))
+{
+	VipsRect image;
+	VipsRect bounds;
+	int cx, cy;
+
+	image.left = 0;
+	image.top = 0;
+	image.width = draw_list->in->Xsize;
+	image.height = draw_list->in->Ysize;
+	vips_draw_list_bounds(draw_list, i, &bounds);
+	vips_rect_intersectrect(&bounds, &image, &bounds);
+	if (vips_rect_isempty(&bounds))
+		return;
+
+	for (cy = bounds.top / VIPS_DRAW_LIST_CELL;
+		 cy <= (VIPS_RECT_BOTTOM(&bounds) - 1) / VIPS_DRAW_LIST_CELL; cy++)
+		for (cx = bounds.left / VIPS_DRAW_LIST_CELL;
+			 cx <= (VIPS_RECT_RIGHT(&bounds) - 1) / VIPS_DRAW_LIST_CELL;
+			 cx++)
+			fn(draw_list, cy * draw_list->cells_across + cx, i);
+}
+
+static void
+vips_draw_list_count(VipsDrawList *draw_list, int cell, int i)
+{
+	draw_list->cell_start[cell + 1] += 1;
+}
+
+static void
+vips_draw_list_add(VipsDrawList *draw_list, int cell, int i)
+{
+	/* cell_start[cell] is used as the fill point while we build, see
+	 * vips_draw_list_bin().
+	 */
+	draw_list->cell_primitives[draw_list->cell_start[cell]++] = i;
+}
+
+/* Sort primitives into cells.
+ */
+static int
+vips_draw_list_bin(VipsDrawList *draw_list)
+{
+	int n_cells = draw_list->cells_across * draw_list->cells_down;
+
+	int i;
+
+	if (!(draw_list->cell_start = VIPS_ARRAY(NULL, n_cells + 1, int)))
+		return -1;
+	memset(draw_list->cell_start, 0, (n_cells + 1) * sizeof(int));
+
+	for (i = 0; i < draw_list->n_primitives; i++)
+		vips_draw_list_cells(draw_list, i, vips_draw_list_count);
+	for (i = 0; i < n_cells; i++)
+		draw_list->cell_start[i + 1] += draw_list->cell_start[i];
+
+	if (!(draw_list->cell_primitives = VIPS_ARRAY(NULL,
+			  VIPS_MAX(1, draw_list->cell_start[n_cells]), int)))
+		return -1;
+
+	/* Fill, using each cell start as a pointer, then shift back.
+	 */
+	for (i = 0; i < draw_list->n_primitives; i++)
+		vips_draw_list_cells(draw_list, i, vips_draw_list_add);
+	for (i = n_cells; i > 0; i--)
+		draw_list->cell_start[i] = draw_list->cell_start[i - 1];
+	draw_list->cell_start[0] = 0;
+
+	return 0;
+}
+
+static int
+vips_draw_list_build(VipsObject *object)
+{
+	VipsObjectClass *class = VIPS_OBJECT_GET_CLASS(object);
+	VipsDrawList *draw_list = (VipsDrawList *) object;
+	VipsArrayInt *arrays[VIPS_DRAW_LIST_LAST];
+
+	int t, i, j;
+
+	if (VIPS_OBJECT_CLASS(vips_draw_list_parent_class)->build(object))
+		return -1;
+
+	if (vips_check_uncoded(class->nickname, draw_list->in) ||
+		vips_image_pio_input(draw_list->in))
+		return -1;
+
+	if (!(draw_list->pixel_ink = vips__vector_to_ink(class->nickname,
+			  draw_list->in,
+			  VIPS_AREA(draw_list->ink)->data, NULL,
+			  VIPS_AREA(draw_list->ink)->n)))
+		return -1;
+
+	arrays[VIPS_DRAW_LIST_RECT] = draw_list->rects;
+	arrays[VIPS_DRAW_LIST_CIRCLE] = draw_list->circles;
+	arrays[VIPS_DRAW_LIST_LINE] = draw_list->lines;
+	arrays[VIPS_DRAW_LIST_POINT] = draw_list->points;
+
+	draw_list->n_primitives = 0;
+	for (t = 0; t < VIPS_DRAW_LIST_LAST; t++)
+		if (arrays[t]) {
+			if (VIPS_AREA(arrays[t])->n %
+				vips_draw_list_stride[t]) {
+				vips_error(class->nickname,
+					"%s", _("bad primitive array length"));
+				return -1;
+			}
+
+			draw_list->n_primitives += VIPS_AREA(arrays[t])->n /
+				vips_draw_list_stride[t];
+		}
+
+	if (!(draw_list->type = VIPS_ARRAY(NULL,
+			  VIPS_MAX(1, draw_list->n_primitives), VipsDrawListType)) ||
+		!(draw_list->args = VIPS_ARRAY(NULL,
+			  VIPS_MAX(1, draw_list->n_primitives), int *)))
+		return -1;
+
+	j = 0;
+	for (t = 0; t < VIPS_DRAW_LIST_LAST; t++)
+		if (arrays[t]) {
+			int *data = (int *) VIPS_AREA(arrays[t])->data;
+			int n = VIPS_AREA(arrays[t])->n / vips_draw_list_stride[t];
+
+			for (i = 0; i < n; i++) {
+				draw_list->type[j] = t;
+				draw_list->args[j] = data + i * vips_draw_list_stride[t];
+				j += 1;
+			}
+		}
+
+	draw_list->cells_across =
+		VIPS_ROUND_UP(draw_list->in->Xsize, VIPS_DRAW_LIST_CELL) /
+		VIPS_DRAW_LIST_CELL;
+	draw_list->cells_down =
+		VIPS_ROUND_UP(draw_list->in->Ysize, VIPS_DRAW_LIST_CELL) /
+		VIPS_DRAW_LIST_CELL;
+	if (vips_draw_list_bin(draw_list))
+		return -1;
+
+	VIPS_DEBUG_MSG("vips_draw_list_build: %d primitives, "
+				   "%d cell entries\n",
+		draw_list->n_primitives,
+		draw_list->cell_start[draw_list->cells_across *
+			draw_list->cells_down]);
+
+	g_object_set(object, "out", vips_image_new(), NULL);
+
+	if (vips_image_pipelinev(draw_list->out,
+			VIPS_DEMAND_STYLE_ANY, draw_list->in, NULL))
+		return -1;
+
+	if (vips_image_generate(draw_list->out,
+			vips_draw_list_start, vips_draw_list_gen, vips_draw_list_stop,
+			draw_list->in, draw_list))
+		return -1;
+
+	return 0;
+}
+
+static void
+vips_draw_list_class_init(VipsDrawListClass *class)
+{
+	GObjectClass *gobject_class = G_OBJECT_CLASS(class);
+	VipsObjectClass *vobject_class = VIPS_OBJECT_CLASS(class);
+	VipsOperationClass *operation_class = VIPS_OPERATION_CLASS(class);
+
+	gobject_class->finalize = vips_draw_list_finalize;
+	gobject_class->set_property = vips_object_set_property;
+	gobject_class->get_property = vips_object_get_property;
+
+	vobject_class->nickname = "draw_list";
+	vobject_class->description =
+		_("draw many rects, circles, lines and points on an image");
+	vobject_class->build = vips_draw_list_build;
+
+	operation_class->flags = VIPS_OPERATION_SEQUENTIAL;
+
+	VIPS_ARG_IMAGE(class, "in", 1,
+		_("Input"),
+		_("Input image"),
+		VIPS_ARGUMENT_REQUIRED_INPUT,
+		G_STRUCT_OFFSET(VipsDrawList, in));
+
+	VIPS_ARG_IMAGE(class, "out", 2,
+		_("Output"),
+		_("Output image"),
+		VIPS_ARGUMENT_REQUIRED_OUTPUT,
+		G_STRUCT_OFFSET(VipsDrawList, out));
+
+	VIPS_ARG_BOXED(class, "ink", 3,
+		_("Ink"),
+		_("Color for pixels"),
+		VIPS_ARGUMENT_REQUIRED_INPUT,
+		G_STRUCT_OFFSET(VipsDrawList, ink),
+		VIPS_TYPE_ARRAY_DOUBLE);
+
+	VIPS_ARG_BOXED(class, "rects", 10,
+		_("Rects"),
+		_("Rects as left, top, width, height"),
+		VIPS_ARGUMENT_OPTIONAL_INPUT,
+		G_STRUCT_OFFSET(VipsDrawList, rects),
+		VIPS_TYPE_ARRAY_INT);
+
+	VIPS_ARG_BOXED(class, "circles", 11,
+		_("Circles"),
+		_("Circles as cx, cy, radius"),
+		VIPS_ARGUMENT_OPTIONAL_INPUT,
+		G_STRUCT_OFFSET(VipsDrawList, circles),
+		VIPS_TYPE_ARRAY_INT);
+
+	VIPS_ARG_BOXED(class, "lines", 12,
+		_("Lines"),
+		_("Lines as x1, y1, x2, y2"),
+		VIPS_ARGUMENT_OPTIONAL_INPUT,
+		G_STRUCT_OFFSET(VipsDrawList, lines),
+		VIPS_TYPE_ARRAY_INT);
+
+	VIPS_ARG_BOXED(class, "points", 13,
+		_("Points"),
+		_("Points as x, y"),
+		VIPS_ARGUMENT_OPTIONAL_INPUT,
+		G_STRUCT_OFFSET(VipsDrawList, points),
+		VIPS_TYPE_ARRAY_INT);
+
+	VIPS_ARG_BOOL(class, "fill", 14,
+		_("Fill"),
+		_("Draw a solid object"),
+		VIPS_ARGUMENT_OPTIONAL_INPUT,
+		G_STRUCT_OFFSET(VipsDrawList, fill),
+		FALSE);
+}
+
+static void
+vips_draw_list_init(VipsDrawList *draw_list)
+{
+}
+
+/**
+ * vips_draw_list: (method)
+ * @in: input image
+ * @out: (out): output image
+ * @ink: (array length=n): ink to draw with
+ * @n: length of ink array
+ * @...: `NULL`-terminated list of optional named arguments
+ *
+ * Draw many rects, circles, lines and points on @in in a single operation.
+ *
+ * Each primitive is given as a run of ints in @rects (`left, top, width,
+ * height`), @circles (`cx, cy, radius`), @lines (`x1, y1, x2, y2`) or
+ * @points (`x, y`). Set @fill to draw solid rects and circles. Pixels are
+ * set exactly as [method@Image.draw_rect], [method@Image.draw_circle],
+ * [method@Image.draw_line] and [method@Image.draw_point] would set them.
+ *
+ * Unlike the draw operations, this is not in-place: @in is not modified and
+ * does not need to be in memory. Primitives are binned by the area they
+ * touch, and each tile of @out is rendered by a worker thread from just
+ * the primitives which touch it, so it's quick even for hundreds of
+ * thousands of primitives.
+ *
+ * ::: tip "Optional arguments"
+ *     * @rects: [struct@ArrayInt], rects to draw
+ *     * @circles: [struct@ArrayInt], circles to draw
+ *     * @lines: [struct@ArrayInt], lines to draw
+ *     * @points: [struct@ArrayInt], points to draw
+ *     * @fill: `gboolean`, draw solid rects and circles
+ *
+ * ::: seealso
+ *     [method@Image.draw_rect], [method@Image.draw_circle],
+ *     [method@Image.draw_line].
+ *
+ * Returns: 0 on success, or -1 on error.
+ */
+int
+vips_draw_list(VipsImage *in, VipsImage **out, double *ink, int n, ...)
+{
+	va_list ap;
+	VipsArrayDouble *array_ink;
+	int result;
+
+	array_ink = vips_array_double_new(ink, n);
+
+	va_start(ap, n);
+	result = vips_call_split("draw_list", ap, in, out, array_ink);
+	va_end(ap);
+
+	vips_area_unref(VIPS_AREA(array_ink));
+
+	return result;
+}
@@ -2,6 +2,10 @@
  *
  * 8/9/23
  *	- extracted from dzsave
+ * 14/10/26
+ *	- write zip ourselves with a per-archive lock, deflate outside the lock
+ * 15/10/26
+ *	- add vips__archive_link()
  */
 
 /*
@@ -46,6 +50,12 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <sys/stat.h>
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif /*HAVE_UNISTD_H*/
+
+#include <glib/gstdio.h>
 
 #include <vips/vips.h>
 #include <vips/internal.h>
@@ -53,53 +63,313 @@
 #include "pforeign.h"
 
 #ifdef HAVE_LIBARCHIVE
-#include <archive.h>
-#include <archive_entry.h>
 
-static GMutex vips_libarchive_mutex;
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif /*HAVE_ZLIB*/
+
+/* We write zip files directly, rather than via libarchive. Tiles arrive
+ * already encoded from many threads, we crc and (optionally) deflate them on
+ * the calling thread, then only take the per-archive lock to append the
+ * bytes to the target. There's no process-wide lock, so several dzsaves can
+ * run in parallel.
+ */
+
+/* Marks a field as being in the zip64 extra block.
+ */
+#define ZIP_MAX32 (0xffffffffU)
+#define ZIP_MAX16 (0xffff)
+
+/* Zip methods we use.
+ */
+#define ZIP_STORE (0)
+#define ZIP_DEFLATE (8)
+
+/* Version 4.5 supports zip64, made on unix.
+ */
+#define ZIP_VERSION (45)
+#define ZIP_MADE_BY ((3 << 8) | ZIP_VERSION)
+
+/* Filenames are UTF-8.
+ */
+#define ZIP_FLAG_UTF8 (1 << 11)
+
+/* 1/1/1980, the DOS epoch, so output is reproducible.
+ */
+#define ZIP_DOS_TIME (0)
+#define ZIP_DOS_DATE ((1 << 5) | 1)
+
+typedef struct _VipsArchiveEntry {
+	char *name;
+	guint32 crc;
+	guint64 compressed_size;
+	guint64 size;
+	guint64 offset;
+	guint16 method;
+} VipsArchiveEntry;
 
 struct _VipsArchive {
 	// prepend filenames with this for filesystem output
 	char *base_dirname;
 
 	// write a zip to a target
-	struct archive *archive;
 	VipsTarget *target;
+	int compression;
+
+	// the entries we've written, for the central directory, and the next
+	// write position ... all protected by lock
+	GMutex lock;
+	GArray *entries;
+	guint64 offset;
 };
 
-void
-vips__archive_free(VipsArchive *archive)
+/* Fallback crc32 if we have no zlib.
+ */
+#ifndef HAVE_ZLIB
+static guint32 vips_archive_crc_table[256];
+
+static void *
+vips_archive_crc_init(void *data)
 {
-	// flush any pending writes to zip output
-	if (archive->archive)
-		archive_write_close(archive->archive);
+	for (guint32 n = 0; n < 256; n++) {
+		guint32 c = n;
 
-	VIPS_FREE(archive->base_dirname);
-	VIPS_FREEF(archive_write_free, archive->archive);
-	VIPS_FREE(archive);
+		for (int k = 0; k < 8; k++)
+			c = c & 1 ? 0xedb88320U ^ (c >> 1) : c >> 1;
+		vips_archive_crc_table[n] = c;
+	}
+
+	return NULL;
 }
+#endif /*!HAVE_ZLIB*/
 
-static la_ssize_t
-zip_write_target_cb(struct archive *a, void *client_data,
-	const void *data, size_t length)
+static guint32
+vips_archive_crc32(const void *buf, size_t len)
 {
-	VipsArchive *archive = (VipsArchive *) client_data;
+#ifdef HAVE_ZLIB
+	const Bytef *p = (const Bytef *) buf;
+	uLong crc = crc32(0L, Z_NULL, 0);
+
+	/* zlib takes uInt lengths.
+	 */
+	while (len > 0) {
+		uInt n = VIPS_MIN(len, 1 << 30);
+
+		crc = crc32(crc, p, n);
+		p += n;
+		len -= n;
+	}
+
+	return crc;
+#else  /*!HAVE_ZLIB*/
+	static GOnce once = G_ONCE_INIT;
+
+	const VipsPel *p = (const VipsPel *) buf;
+	guint32 c = 0xffffffffU;
+
+	VIPS_ONCE(&once, vips_archive_crc_init, NULL);
 
+	for (size_t i = 0; i < len; i++)
+		c = vips_archive_crc_table[(c ^ p[i]) & 0xff] ^ (c >> 8);
+
+	return c ^ 0xffffffffU;
+#endif /*HAVE_ZLIB*/
+}
+
+#ifdef HAVE_ZLIB
+/* Raw deflate, as used in zip. Return NULL if this would not save any space.
+ */
+static void *
+vips_archive_deflate(int compression, const void *buf, size_t len,
+	size_t *compressed_len)
+{
+	z_stream stream = { 0 };
+	void *out;
+	size_t bound;
+
+	if (len > ZIP_MAX32 ||
+		deflateInit2(&stream, compression, Z_DEFLATED,
+			-15, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+		return NULL;
+
+	bound = deflateBound(&stream, len);
+	out = g_malloc(bound);
+
+	stream.next_in = (Bytef *) buf;
+	stream.avail_in = len;
+	stream.next_out = (Bytef *) out;
+	stream.avail_out = bound;
+	if (deflate(&stream, Z_FINISH) != Z_STREAM_END ||
+		stream.total_out >= len) {
+		deflateEnd(&stream);
+		g_free(out);
+		return NULL;
+	}
+
+	*compressed_len = stream.total_out;
+	deflateEnd(&stream);
+
+	return out;
+}
+#endif /*HAVE_ZLIB*/
+
+static VipsPel *
+vips_archive_put16(VipsPel *p, guint16 v)
+{
+	p[0] = v & 0xff;
+	p[1] = v >> 8;
+
+	return p + 2;
+}
+
+static VipsPel *
+vips_archive_put32(VipsPel *p, guint32 v)
+{
+	p = vips_archive_put16(p, v & 0xffff);
+
+	return vips_archive_put16(p, v >> 16);
+}
+
+static VipsPel *
+vips_archive_put64(VipsPel *p, guint64 v)
+{
+	p = vips_archive_put32(p, v & 0xffffffffU);
+
+	return vips_archive_put32(p, v >> 32);
+}
+
+/* Append to the target, the lock must be held.
+ */
+static int
+vips_archive_write(VipsArchive *archive, const void *data, size_t length)
+{
 	if (vips_target_write(archive->target, data, length))
 		return -1;
+	archive->offset += length;
 
-	return length;
+	return 0;
 }
 
+/* Write the central directory and end records, the lock must be held.
+ */
 static int
-zip_close_target_cb(struct archive *a, void *client_data)
+vips_archive_finish(VipsArchive *archive)
 {
-	VipsArchive *archive = (VipsArchive *) client_data;
+	guint64 n_entries = archive->entries->len;
+	guint64 directory_offset = archive->offset;
+
+	VipsPel buf[128];
+	VipsPel *p;
+	guint64 directory_size;
+
+	for (guint i = 0; i < archive->entries->len; i++) {
+		VipsArchiveEntry *entry =
+			&g_array_index(archive->entries, VipsArchiveEntry, i);
+		size_t name_length = strlen(entry->name);
+		gboolean zip64 = entry->size >= ZIP_MAX32 ||
+			entry->compressed_size >= ZIP_MAX32 ||
+			entry->offset >= ZIP_MAX32;
+
+		p = buf;
+		p = vips_archive_put32(p, 0x02014b50);
+		p = vips_archive_put16(p, ZIP_MADE_BY);
+		p = vips_archive_put16(p, ZIP_VERSION);
+		p = vips_archive_put16(p, ZIP_FLAG_UTF8);
+		p = vips_archive_put16(p, entry->method);
+		p = vips_archive_put16(p, ZIP_DOS_TIME);
+		p = vips_archive_put16(p, ZIP_DOS_DATE);
+		p = vips_archive_put32(p, entry->crc);
+		p = vips_archive_put32(p, zip64 ? ZIP_MAX32 : entry->compressed_size);
+		p = vips_archive_put32(p, zip64 ? ZIP_MAX32 : entry->size);
+		p = vips_archive_put16(p, name_length);
+		p = vips_archive_put16(p, zip64 ? 28 : 0);
+		p = vips_archive_put16(p, 0); // comment length
+		p = vips_archive_put16(p, 0); // disk number
+		p = vips_archive_put16(p, 0); // internal attributes
+		p = vips_archive_put32(p, (S_IFREG | 0664) << 16);
+		p = vips_archive_put32(p, zip64 ? ZIP_MAX32 : entry->offset);
+
+		if (vips_archive_write(archive, buf, p - buf) ||
+			vips_archive_write(archive, entry->name, name_length))
+			return -1;
+
+		if (zip64) {
+			p = buf;
+			p = vips_archive_put16(p, 0x0001);
+			p = vips_archive_put16(p, 24);
+			p = vips_archive_put64(p, entry->size);
+			p = vips_archive_put64(p, entry->compressed_size);
+			p = vips_archive_put64(p, entry->offset);
+
+			if (vips_archive_write(archive, buf, p - buf))
+				return -1;
+		}
+	}
+
+	directory_size = archive->offset - directory_offset;
+
+	if (n_entries >= ZIP_MAX16 ||
+		directory_size >= ZIP_MAX32 ||
+		directory_offset >= ZIP_MAX32) {
+		guint64 zip64_offset = archive->offset;
+
+		// zip64 end of central directory record
+		p = buf;
+		p = vips_archive_put32(p, 0x06064b50);
+		p = vips_archive_put64(p, 44);
+		p = vips_archive_put16(p, ZIP_MADE_BY);
+		p = vips_archive_put16(p, ZIP_VERSION);
+		p = vips_archive_put32(p, 0);
+		p = vips_archive_put32(p, 0);
+		p = vips_archive_put64(p, n_entries);
+		p = vips_archive_put64(p, n_entries);
+		p = vips_archive_put64(p, directory_size);
+		p = vips_archive_put64(p, directory_offset);
+
+		// zip64 end of central directory locator
+		p = vips_archive_put32(p, 0x07064b50);
+		p = vips_archive_put32(p, 0);
+		p = vips_archive_put64(p, zip64_offset);
+		p = vips_archive_put32(p, 1);
+
+		if (vips_archive_write(archive, buf, p - buf))
+			return -1;
+	}
+
+	p = buf;
+	p = vips_archive_put32(p, 0x06054b50);
+	p = vips_archive_put16(p, 0);
+	p = vips_archive_put16(p, 0);
+	p = vips_archive_put16(p, VIPS_MIN(n_entries, ZIP_MAX16));
+	p = vips_archive_put16(p, VIPS_MIN(n_entries, ZIP_MAX16));
+	p = vips_archive_put32(p, VIPS_MIN(directory_size, ZIP_MAX32));
+	p = vips_archive_put32(p, VIPS_MIN(directory_offset, ZIP_MAX32));
+	p = vips_archive_put16(p, 0);
+
+	if (vips_archive_write(archive, buf, p - buf))
+		return -1;
+
+	return vips_target_end(archive->target);
+}
 
-	if (vips_target_end(archive->target))
-		return ARCHIVE_FATAL;
+void
+vips__archive_free(VipsArchive *archive)
+{
+	// flush the central directory to zip output
+	if (archive->target &&
+		vips_archive_finish(archive))
+		g_warning("%s", vips_error_buffer());
+
+	if (archive->entries) {
+		for (guint i = 0; i < archive->entries->len; i++)
+			g_free(g_array_index(archive->entries,
+				VipsArchiveEntry, i).name);
+		VIPS_FREEF(g_array_unref, archive->entries);
+	}
 
-	return ARCHIVE_OK;
+	g_mutex_clear(&archive->lock);
+	VIPS_FREE(archive->base_dirname);
+	VIPS_FREE(archive);
 }
 
 // write to a filesystem directory
@@ -111,6 +381,7 @@ vips__archive_new_to_dir(const char *base_dirname)
 	if (!(archive = VIPS_NEW(NULL, VipsArchive)))
 		return NULL;
 
+	g_mutex_init(&archive->lock);
 	archive->base_dirname = g_strdup(base_dirname);
 
 	return archive;
@@ -131,52 +402,22 @@ vips__archive_new_to_target(VipsTarget *target,
 	if (!(archive = VIPS_NEW(NULL, VipsArchive)))
 		return NULL;
 
+	g_mutex_init(&archive->lock);
 	archive->target = target;
 	archive->base_dirname = g_strdup(base_dirname);
+	archive->entries = g_array_new(FALSE, FALSE, sizeof(VipsArchiveEntry));
 
-	if (!(archive->archive = archive_write_new())) {
-		vips_error("archive", "%s", _("unable to create archive"));
-		vips__archive_free(archive);
-		return NULL;
-	}
-
-	/* Set format to zip.
-	 */
-	if (archive_write_set_format(archive->archive, ARCHIVE_FORMAT_ZIP)) {
-		vips_error("archive", "%s", _("unable to set zip format"));
-		vips__archive_free(archive);
-		return NULL;
-	}
-
-	/* Remap compression=-1 to compression=6.
+#ifdef HAVE_ZLIB
+	/* compression=-1 means the zlib default.
 	 */
-	if (compression == -1)
-		compression = 6; /* Z_DEFAULT_COMPRESSION */
-
-	char compression_string[2] = { '0' + compression, 0 };
-	if (archive_write_set_format_option(archive->archive, "zip",
-			"compression-level", compression_string)) {
-		vips_error("archive", "%s", _("unable to set compression"));
-		vips__archive_free(archive);
-		return NULL;
-	}
-
-	/* Do not pad last block.
-	 */
-	if (archive_write_set_bytes_in_last_block(archive->archive, 1)) {
-		vips_error("archive", "%s", _("unable to set padding"));
-		vips__archive_free(archive);
-		return NULL;
-	}
-
-	/* Register target callback functions.
+	archive->compression = compression == -1
+		? Z_DEFAULT_COMPRESSION
+		: VIPS_CLIP(0, compression, 9);
+#else  /*!HAVE_ZLIB*/
+	/* Without zlib we can only store.
 	 */
-	if (archive_write_open(archive->archive, archive, NULL,
-			zip_write_target_cb, zip_close_target_cb)) {
-		vips_error("archive", "%s", _("unable to open for write"));
-		vips__archive_free(archive);
-		return NULL;
-	}
+	archive->compression = 0;
+#endif /*HAVE_ZLIB*/
 
 	return archive;
 }
@@ -214,7 +455,7 @@ vips__archive_mkdir(VipsArchive *archive, const char *dirname)
 	/* The ZIP format maintains a hierarchical structure, avoiding
 	 * the need to create individual entries for each (sub-)directory.
 	 */
-	if (archive->archive)
+	if (archive->target)
 		return 0;
 
 	return vips__archive_mkdir_file(archive, dirname);
@@ -224,42 +465,90 @@ static int
 vips__archive_mkfile_zip(VipsArchive *archive,
 	const char *filename, void *buf, size_t len)
 {
-	struct archive_entry *entry;
-
-	vips__worker_lock(&vips_libarchive_mutex);
-
-	if (!(entry = archive_entry_new())) {
-		vips_error("archive", "%s", _("unable to create entry"));
-		g_mutex_unlock(&vips_libarchive_mutex);
+	VipsArchiveEntry entry;
+	void *data;
+	void *compressed;
+	size_t name_length;
+	gboolean zip64;
+	VipsPel header[64];
+	VipsPel *p;
+
+	/* All the expensive work happens outside the lock.
+	 */
+	entry.crc = vips_archive_crc32(buf, len);
+	entry.size = len;
+	entry.method = ZIP_STORE;
+	entry.compressed_size = len;
+	data = buf;
+	compressed = NULL;
+
+#ifdef HAVE_ZLIB
+	if (archive->compression != 0 &&
+		(compressed = vips_archive_deflate(archive->compression,
+			 buf, len, &len))) {
+		entry.method = ZIP_DEFLATE;
+		entry.compressed_size = len;
+		data = compressed;
+	}
+#endif /*HAVE_ZLIB*/
+
+	// zip paths always use '/'
+	entry.name = g_build_path("/", archive->base_dirname, filename, NULL);
+	name_length = strlen(entry.name);
+	zip64 = entry.size >= ZIP_MAX32;
+
+	vips__worker_lock(&archive->lock);
+
+	entry.offset = archive->offset;
+
+	p = header;
+	p = vips_archive_put32(p, 0x04034b50);
+	p = vips_archive_put16(p, ZIP_VERSION);
+	p = vips_archive_put16(p, ZIP_FLAG_UTF8);
+	p = vips_archive_put16(p, entry.method);
+	p = vips_archive_put16(p, ZIP_DOS_TIME);
+	p = vips_archive_put16(p, ZIP_DOS_DATE);
+	p = vips_archive_put32(p, entry.crc);
+	p = vips_archive_put32(p, zip64 ? ZIP_MAX32 : entry.compressed_size);
+	p = vips_archive_put32(p, zip64 ? ZIP_MAX32 : entry.size);
+	p = vips_archive_put16(p, name_length);
+	p = vips_archive_put16(p, zip64 ? 20 : 0);
+
+	if (vips_archive_write(archive, header, p - header) ||
+		vips_archive_write(archive, entry.name, name_length)) {
+		g_mutex_unlock(&archive->lock);
+		g_free(entry.name);
+		g_free(compressed);
 		return -1;
 	}
 
-	char *path;
-
-	path = g_build_filename(archive->base_dirname, filename, NULL);
-
-	archive_entry_set_pathname(entry, path);
-	archive_entry_set_mode(entry, S_IFREG | 0664);
-	archive_entry_set_size(entry, len);
-
-	g_free(path);
+	if (zip64) {
+		p = header;
+		p = vips_archive_put16(p, 0x0001);
+		p = vips_archive_put16(p, 16);
+		p = vips_archive_put64(p, entry.size);
+		p = vips_archive_put64(p, entry.compressed_size);
+
+		if (vips_archive_write(archive, header, p - header)) {
+			g_mutex_unlock(&archive->lock);
+			g_free(entry.name);
+			g_free(compressed);
+			return -1;
+		}
+	}
 
-	if (archive_write_header(archive->archive, entry)) {
-		vips_error("archive", "%s", _("unable to write header"));
-		archive_entry_free(entry);
-		g_mutex_unlock(&vips_libarchive_mutex);
+	if (vips_archive_write(archive, data, entry.compressed_size)) {
+		g_mutex_unlock(&archive->lock);
+		g_free(entry.name);
+		g_free(compressed);
 		return -1;
 	}
 
-	archive_entry_free(entry);
+	g_array_append_val(archive->entries, entry);
 
-	if (archive_write_data(archive->archive, buf, len) != len) {
-		vips_error("archive", "%s", _("unable to write data"));
-		g_mutex_unlock(&vips_libarchive_mutex);
-		return -1;
-	}
+	g_mutex_unlock(&archive->lock);
 
-	g_mutex_unlock(&vips_libarchive_mutex);
+	g_free(compressed);
 
 	return 0;
 }
@@ -273,6 +562,11 @@ vips__archive_mkfile_file(VipsArchive *archive,
 
 	path = g_build_filename(archive->base_dirname, filename, NULL);
 
+	/* Any old file might be a hard link to another tile from an earlier
+	 * dedupe save, so we must remove it rather than write through it.
+	 */
+	(void) g_unlink(path);
+
 	if (!(f = vips__file_open_write(path, FALSE))) {
 		g_free(path);
 		return -1;
@@ -294,9 +588,39 @@ int
 vips__archive_mkfile(VipsArchive *archive,
 	const char *filename, void *buf, size_t len)
 {
-	return ((archive->archive)
+	return ((archive->target)
 			? vips__archive_mkfile_zip
 			: vips__archive_mkfile_file)(archive, filename, buf, len);
 }
 
+/* Make @to a hard link to the file @from. This only works for filesystem
+ * output on platforms with hard links, and the caller should write the file
+ * instead if we return FALSE.
+ */
+gboolean
+vips__archive_link(VipsArchive *archive, const char *from, const char *to)
+{
+#ifndef G_OS_WIN32
+	char *from_path;
+	char *to_path;
+	gboolean linked;
+
+	if (archive->target)
+		return FALSE;
+
+	from_path = g_build_filename(archive->base_dirname, from, NULL);
+	to_path = g_build_filename(archive->base_dirname, to, NULL);
+
+	(void) g_unlink(to_path);
+	linked = link(from_path, to_path) == 0;
+
+	g_free(from_path);
+	g_free(to_path);
+
+	return linked;
+#else  /*G_OS_WIN32*/
+	return FALSE;
+#endif /*!G_OS_WIN32*/
+}
+
 #endif /*HAVE_LIBARCHIVE*/
@@ -5,6 +5,9 @@
  * 	- fix change detector
  * 3/12/22
  * 	- deprecate reoptimise, add reuse
+ * 15/10/26
+ * 	- quantise the next frame while a background thread encodes this one
+ * 	- add global_palette
  */
 
 /*
@@ -70,14 +73,54 @@
  * 	Each frame is dithered to single global colour table taken from the
  * 	input image "gif-palette" metadata item.
  *
+ * VIPS_FOREIGN_SAVE_CGIF_MODE_SAMPLED:
+ *
+ * 	We make a single global palette from a sample of frames (or the
+ * 	"gif-palette" metadata item), then map each frame to it with a
+ * 	nearest-colour lookup table. libimagequant only runs once.
+ *
  * We use LOCAL by default. We use GLOBAL if @reuse is set and there's
- * a palette attached to the image to be saved.
+ * a palette attached to the image to be saved, and SAMPLED if
+ * @global_palette is set.
  */
 typedef enum _VipsForeignSaveCgifMode {
 	VIPS_FOREIGN_SAVE_CGIF_MODE_GLOBAL,
-	VIPS_FOREIGN_SAVE_CGIF_MODE_LOCAL
+	VIPS_FOREIGN_SAVE_CGIF_MODE_LOCAL,
+	VIPS_FOREIGN_SAVE_CGIF_MODE_SAMPLED
 } VipsForeignSaveCgifMode;
 
+/* The most frames we sample for SAMPLED mode, and the most pixels we pass
+ * to libimagequant.
+ */
+#define VIPS_CGIF_SAMPLE_FRAMES (8)
+#define VIPS_CGIF_SAMPLE_PELS (1000000)
+
+/* The nearest-colour table for SAMPLED mode has this many bits per RGB
+ * channel.
+ */
+#define VIPS_CGIF_LUT_BITS (5)
+#define VIPS_CGIF_LUT_SIZE (1 << VIPS_CGIF_LUT_BITS)
+
+/* A frame on its way through the writer. The sink thread thresholds,
+ * quantises and dithers a frame, then the encode thread does the
+ * transparency trick and hands it to cgif.
+ */
+typedef struct _VipsForeignSaveCgifFrame {
+	/* The RGBA frame and the index frame libimagequant makes from it.
+	 */
+	VipsPel *bytes;
+	VipsPel *index;
+
+	int page_number;
+
+	/* The palette the index refers to.
+	 */
+	VipsPel palette_rgb[256 * 3];
+	int n_colours;
+	gboolean has_transparency;
+	gboolean use_local;
+} VipsForeignSaveCgifFrame;
+
 typedef struct _VipsForeignSaveCgif {
 	VipsForeignSave parent_object;
 
@@ -89,6 +132,7 @@ typedef struct _VipsForeignSaveCgif {
 	gboolean interlace;
 	gboolean keep_duplicate_frames;
 	double interpalette_maxerror;
+	gboolean global_palette;
 	VipsTarget *target;
 
 	/* Derived write params.
@@ -104,14 +148,27 @@ typedef struct _VipsForeignSaveCgif {
 	int *palette;
 	int n_colours;
 
-	/* The frame we are building, the y position in the frame.
+	/* The frame we are building, the y position in the frame. For
+	 * animations we have two frames, and build one while the other is
+	 * encoded.
 	 */
 	int frame_width;
 	int frame_height;
-	VipsPel *frame_bytes;
+	VipsForeignSaveCgifFrame frames[2];
+	VipsForeignSaveCgifFrame *frame;
 	int write_y;
 	int page_number;
 
+	/* The background encode thread, and the frame it's working on.
+	 */
+	VipsForeignSaveCgifFrame *encode_frame;
+	VipsSemaphore encode_go;
+	VipsSemaphore encode_done;
+	VipsSemaphore encode_finish;
+	gboolean encode_running;
+	gboolean encode_busy;
+	gboolean encode_kill;
+
 	/* The current frame as seen by libimagequant.
 	 */
 	VipsQuantiseAttr *attr;
@@ -127,9 +184,9 @@ typedef struct _VipsForeignSaveCgif {
 	 */
 	VipsQuantiseResult *free_quantisation_result;
 
-	/* The index frame we get libimagequant to generate.
+	/* Maps RGB to palette index in SAMPLED mode.
 	 */
-	VipsPel *index;
+	VipsPel *lut;
 
 	/* The previous RGBA frame (needed for transparency trick).
 	 */
@@ -152,11 +209,28 @@ typedef VipsForeignSaveClass VipsForeignSaveCgifClass;
 G_DEFINE_ABSTRACT_TYPE(VipsForeignSaveCgif, vips_foreign_save_cgif,
 	VIPS_TYPE_FOREIGN_SAVE);
 
+/* Stop the encode thread, if it's running.
+ */
+static void
+vips_foreign_save_cgif_encode_stop(VipsForeignSaveCgif *cgif)
+{
+	if (cgif->encode_running) {
+		cgif->encode_kill = TRUE;
+		vips_semaphore_up(&cgif->encode_go);
+		vips_semaphore_down(&cgif->encode_finish);
+
+		cgif->encode_running = FALSE;
+		cgif->encode_busy = FALSE;
+	}
+}
+
 static void
 vips_foreign_save_cgif_dispose(GObject *gobject)
 {
 	VipsForeignSaveCgif *cgif = (VipsForeignSaveCgif *) gobject;
 
+	vips_foreign_save_cgif_encode_stop(cgif);
+
 	g_info("cgifsave: %d frames", cgif->page_number);
 	g_info("cgifsave: %d unique palettes", cgif->n_palettes_generated);
 
@@ -169,13 +243,28 @@ vips_foreign_save_cgif_dispose(GObject *gobject)
 
 	VIPS_UNREF(cgif->target);
 
-	VIPS_FREE(cgif->index);
-	VIPS_FREE(cgif->frame_bytes);
+	for (int i = 0; i < 2; i++) {
+		VIPS_FREE(cgif->frames[i].bytes);
+		VIPS_FREE(cgif->frames[i].index);
+	}
 	VIPS_FREE(cgif->previous_frame);
+	VIPS_FREE(cgif->lut);
 
 	G_OBJECT_CLASS(vips_foreign_save_cgif_parent_class)->dispose(gobject);
 }
 
+static void
+vips_foreign_save_cgif_finalize(GObject *gobject)
+{
+	VipsForeignSaveCgif *cgif = (VipsForeignSaveCgif *) gobject;
+
+	vips_semaphore_destroy(&cgif->encode_go);
+	vips_semaphore_destroy(&cgif->encode_done);
+	vips_semaphore_destroy(&cgif->encode_finish);
+
+	G_OBJECT_CLASS(vips_foreign_save_cgif_parent_class)->finalize(gobject);
+}
+
 static int
 vips__cgif_write(void *client, const uint8_t *buffer, const size_t length)
 {
@@ -499,41 +588,11 @@ vips_foreign_save_cgif_pick_quantiser(VipsForeignSaveCgif *cgif,
 	return 0;
 }
 
-/* We have a complete frame -- write!
+/* Threshold the alpha channel, and zero transparent pixels.
  */
-static int
-vips_foreign_save_cgif_write_frame(VipsForeignSaveCgif *cgif)
+static void
+vips_foreign_save_cgif_threshold(VipsPel *restrict p, int n_pels)
 {
-	VipsObjectClass *class = VIPS_OBJECT_GET_CLASS(cgif);
-	int n_pels = cgif->frame_height * cgif->frame_width;
-
-	gboolean has_transparency;
-	gboolean has_alpha_constraint;
-	VipsPel *restrict p;
-	VipsQuantiseImage *image;
-	gboolean use_local;
-	VipsQuantiseResult *quantisation_result;
-	const VipsQuantisePalette *lp;
-	CGIF_FrameConfig frame_config = { 0 };
-	int n_colours;
-	VipsPel palette_rgb[256 * 3];
-
-#ifdef DEBUG_VERBOSE
-	printf("vips_foreign_save_cgif_write_frame: %d\n", cgif->page_number);
-#endif /*DEBUG_VERBOSE*/
-
-	/* Threshold the alpha channel.
-	 *
-	 * Also, check if the alpha channel of the current frame matches the
-	 * frame before.
-	 *
-	 * If the current frame has an alpha component which is not identical
-	 * to the previous frame we are forced to use the transparency index
-	 * for the alpha channel instead of for the transparency size
-	 * optimization (maxerror).
-	 */
-	p = cgif->frame_bytes;
-	has_alpha_constraint = FALSE;
 	for (int i = 0; i < n_pels; i++) {
 		if (p[3] >= 128)
 			p[3] = 255;
@@ -544,47 +603,268 @@ vips_foreign_save_cgif_write_frame(VipsForeignSaveCgif *cgif)
 			p[1] = 0;
 			p[2] = 0;
 			p[3] = 0;
-
-			if (cgif->previous_frame &&
-				cgif->page_number > 0 &&
-				cgif->previous_frame[i * 4 + 3])
-				has_alpha_constraint = TRUE;
 		}
 
 		p += 4;
 	}
+}
+
+/* Make the global palette for SAMPLED mode from frames spread through
+ * the animation. This reads those frames an extra time.
+ */
+static int
+vips_foreign_save_cgif_sample_palette(VipsForeignSaveCgif *cgif)
+{
+	VipsObjectClass *class = VIPS_OBJECT_GET_CLASS(cgif);
+	int n_pages = cgif->in->Ysize / cgif->frame_height;
+	int n_samples = VIPS_MIN(n_pages, VIPS_CGIF_SAMPLE_FRAMES);
+	VipsImage **t = (VipsImage **)
+		vips_object_local_array(VIPS_OBJECT(cgif), n_samples + 2);
+
+	VipsImage *x;
+	guint64 n_pels;
+	VipsPel *data;
+	size_t size;
+	VipsPel *sample;
+	VipsQuantiseImage *image;
+
+	for (int i = 0; i < n_samples; i++) {
+		int page = i * n_pages / n_samples;
+
+		if (vips_crop(cgif->in, &t[i],
+				0, page * cgif->frame_height,
+				cgif->frame_width, cgif->frame_height, NULL))
+			return -1;
+	}
+	if (vips_arrayjoin(t, &t[n_samples], n_samples, "across", 1, NULL))
+		return -1;
+	x = t[n_samples];
+
+	/* Point-sample down to a size libimagequant can handle quickly. This
+	 * keeps colours exact.
+	 */
+	n_pels = (guint64) x->Xsize * x->Ysize;
+	if (n_pels > VIPS_CGIF_SAMPLE_PELS) {
+		int factor = ceil(sqrt((double) n_pels / VIPS_CGIF_SAMPLE_PELS));
+
+		if (vips_subsample(x, &t[n_samples + 1], factor, factor, NULL))
+			return -1;
+		x = t[n_samples + 1];
+	}
+
+	if (!(data = vips_image_write_to_memory(x, &size)))
+		return -1;
+
+	/* Add a zero pixel (transparent) in case later frames have
+	 * transparency.
+	 */
+	n_pels = (guint64) x->Xsize * x->Ysize;
+	sample = g_malloc((n_pels + 1) * 4);
+	memcpy(sample, data, n_pels * 4);
+	memset(sample + n_pels * 4, 0, 4);
+	g_free(data);
+
+	vips_foreign_save_cgif_threshold(sample, n_pels + 1);
+
+	image = vips__quantise_image_create_rgba(cgif->attr,
+		sample, n_pels + 1, 1, 0);
+	if (vips__quantise_image_quantize_fixed(image,
+			cgif->attr, &cgif->quantisation_result)) {
+		vips_error(class->nickname, "%s", _("quantisation failed"));
+		VIPS_FREEF(vips__quantise_image_destroy, image);
+		g_free(sample);
+		return -1;
+	}
+	cgif->n_palettes_generated += 1;
+
+	VIPS_FREEF(vips__quantise_image_destroy, image);
+	g_free(sample);
+
+	return 0;
+}
+
+/* Build the nearest-colour table for the global palette. We search the
+ * palette once for the centre of each cell, rather than once per pixel.
+ */
+static void
+vips_foreign_save_cgif_build_lut(VipsForeignSaveCgif *cgif)
+{
+	const VipsQuantisePalette *lp =
+		vips__quantise_get_palette(cgif->quantisation_result);
+	int shift = 8 - VIPS_CGIF_LUT_BITS;
+	int half = 1 << (shift - 1);
+
+	VipsPel *q;
+
+	cgif->lut = g_malloc(VIPS_CGIF_LUT_SIZE *
+		VIPS_CGIF_LUT_SIZE * VIPS_CGIF_LUT_SIZE);
+
+	q = cgif->lut;
+	for (int r = 0; r < VIPS_CGIF_LUT_SIZE; r++)
+		for (int g = 0; g < VIPS_CGIF_LUT_SIZE; g++)
+			for (int b = 0; b < VIPS_CGIF_LUT_SIZE; b++) {
+				int cr = (r << shift) + half;
+				int cg = (g << shift) + half;
+				int cb = (b << shift) + half;
+
+				int best_dist = INT_MAX;
+				int best = 0;
+
+				for (int i = 0; i < lp->count; i++) {
+					int rd, gd, bd, dist;
+
+					/* Transparent entries only match transparent
+					 * pixels.
+					 */
+					if (!lp->entries[i].a)
+						continue;
+
+					rd = cr - lp->entries[i].r;
+					gd = cg - lp->entries[i].g;
+					bd = cb - lp->entries[i].b;
+					dist = rd * rd + gd * gd + bd * bd;
+
+					if (dist < best_dist) {
+						best_dist = dist;
+						best = i;
+					}
+				}
+
+				*q++ = best;
+			}
+}
+
+/* Map a thresholded RGBA frame to the global palette with the lookup
+ * table. @trans is the index for transparent pixels, or -1 for none.
+ */
+static void
+vips_foreign_save_cgif_remap(VipsForeignSaveCgif *cgif,
+	const VipsPel *restrict p, VipsPel *restrict q, int n_pels, int trans)
+{
+	const VipsPel *restrict lut = cgif->lut;
+	int shift = 8 - VIPS_CGIF_LUT_BITS;
+
+	for (int i = 0; i < n_pels; i++) {
+		if (trans >= 0 &&
+			!p[3])
+			q[i] = trans;
+		else
+			q[i] = lut[((p[0] >> shift) << (2 * VIPS_CGIF_LUT_BITS)) |
+				((p[1] >> shift) << VIPS_CGIF_LUT_BITS) |
+				(p[2] >> shift)];
+
+		p += 4;
+	}
+}
+
+/* Map a thresholded frame to the global palette in SAMPLED mode.
+ */
+static int
+vips_foreign_save_cgif_lut_frame(VipsForeignSaveCgif *cgif,
+	VipsForeignSaveCgifFrame *frame)
+{
+	VipsObjectClass *class = VIPS_OBJECT_GET_CLASS(cgif);
+	int n_pels = cgif->frame_height * cgif->frame_width;
+
+	const VipsQuantisePalette *lp;
+
+	/* We couldn't sample ahead (perhaps the source is sequential), so
+	 * the first frame sets the palette.
+	 */
+	if (!cgif->quantisation_result) {
+		VipsQuantiseImage *image;
+
+		image = vips__quantise_image_create_rgba(cgif->attr,
+			frame->bytes, cgif->frame_width, cgif->frame_height, 0);
+		if (vips__quantise_image_quantize_fixed(image,
+				cgif->attr, &cgif->quantisation_result)) {
+			vips_error(class->nickname, "%s", _("quantisation failed"));
+			VIPS_FREEF(vips__quantise_image_destroy, image);
+			return -1;
+		}
+		cgif->n_palettes_generated += 1;
+
+		VIPS_FREEF(vips__quantise_image_destroy, image);
+	}
+
+	if (!cgif->lut)
+		vips_foreign_save_cgif_build_lut(cgif);
+
+	lp = vips__quantise_get_palette(cgif->quantisation_result);
+	frame->has_transparency = lp->entries[0].a == 0;
+	frame->n_colours = lp->count;
+	frame->use_local = FALSE;
+	vips_foreign_save_cgif_get_rgb_palette(cgif,
+		cgif->quantisation_result, frame->palette_rgb);
+
+	vips_foreign_save_cgif_remap(cgif, frame->bytes, frame->index, n_pels,
+		frame->has_transparency ? 0 : -1);
+
+	vips_image_eval(cgif->in, n_pels);
+	if (vips_image_iskilled(cgif->in))
+		return -1;
+
+	return 0;
+}
+
+/* Threshold, quantise and dither a complete frame. This runs on the sink
+ * thread, in frame order, since picking a palette depends on the palettes
+ * picked for earlier frames.
+ */
+static int
+vips_foreign_save_cgif_quantise_frame(VipsForeignSaveCgif *cgif,
+	VipsForeignSaveCgifFrame *frame)
+{
+	VipsObjectClass *class = VIPS_OBJECT_GET_CLASS(cgif);
+	int n_pels = cgif->frame_height * cgif->frame_width;
+
+	VipsQuantiseImage *image;
+	VipsQuantiseResult *quantisation_result;
+	const VipsQuantisePalette *lp;
+
+#ifdef DEBUG_VERBOSE
+	printf("vips_foreign_save_cgif_quantise_frame: %d\n",
+		frame->page_number);
+#endif /*DEBUG_VERBOSE*/
+
+	vips_foreign_save_cgif_threshold(frame->bytes, n_pels);
+
+	if (cgif->mode == VIPS_FOREIGN_SAVE_CGIF_MODE_SAMPLED)
+		return vips_foreign_save_cgif_lut_frame(cgif, frame);
 
 	/* Set up new frame for libimagequant.
 	 */
 	image = vips__quantise_image_create_rgba(cgif->attr,
-		cgif->frame_bytes, cgif->frame_width, cgif->frame_height, 0);
+		frame->bytes, cgif->frame_width, cgif->frame_height, 0);
 
 	if (cgif->mode == VIPS_FOREIGN_SAVE_CGIF_MODE_LOCAL ||
 		!cgif->quantisation_result) {
 		/* Reoptimising each frame, or no global palette set up yet.
 		 */
 		if (vips_foreign_save_cgif_pick_quantiser(cgif,
-				image, &quantisation_result, &use_local))
+				image, &quantisation_result, &frame->use_local)) {
+			VIPS_FREEF(vips__quantise_image_destroy, image);
 			return -1;
+		}
 	}
 	else {
 		quantisation_result = cgif->quantisation_result;
-		use_local = FALSE;
+		frame->use_local = FALSE;
 	}
 
 	lp = vips__quantise_get_palette(quantisation_result);
 	/* If there's a transparent pixel, it's always first.
 	 */
-	has_transparency = lp->entries[0].a == 0;
-	n_colours = lp->count;
+	frame->has_transparency = lp->entries[0].a == 0;
+	frame->n_colours = lp->count;
 	vips_foreign_save_cgif_get_rgb_palette(cgif,
-		quantisation_result, palette_rgb);
+		quantisation_result, frame->palette_rgb);
 
 	/* Dither frame into @index.
 	 */
 	vips__quantise_set_dithering_level(quantisation_result, cgif->dither);
 	if (vips__quantise_write_remapped_image(quantisation_result,
-			image, cgif->index, n_pels)) {
+			image, frame->index, n_pels)) {
 		vips_error(class->nickname, "%s", _("dither failed"));
 		VIPS_FREEF(vips__quantise_image_destroy, image);
 		return -1;
@@ -598,6 +878,43 @@ vips_foreign_save_cgif_write_frame(VipsForeignSaveCgif *cgif)
 	if (vips_image_iskilled(cgif->in))
 		return -1;
 
+	return 0;
+}
+
+/* Pass a quantised frame to cgif. Frames arrive here in order, either on
+ * the sink thread or on the encode thread.
+ */
+static void
+vips_foreign_save_cgif_encode_frame(VipsForeignSaveCgif *cgif,
+	VipsForeignSaveCgifFrame *frame)
+{
+	int n_pels = cgif->frame_height * cgif->frame_width;
+
+	gboolean has_alpha_constraint;
+	CGIF_FrameConfig frame_config = { 0 };
+
+#ifdef DEBUG_VERBOSE
+	printf("vips_foreign_save_cgif_encode_frame: %d\n", frame->page_number);
+#endif /*DEBUG_VERBOSE*/
+
+	/* Check if the alpha channel of the current frame matches the
+	 * frame before.
+	 *
+	 * If the current frame has an alpha component which is not identical
+	 * to the previous frame we are forced to use the transparency index
+	 * for the alpha channel instead of for the transparency size
+	 * optimization (maxerror).
+	 */
+	has_alpha_constraint = FALSE;
+	if (cgif->previous_frame &&
+		frame->page_number > 0)
+		for (int i = 0; i < n_pels; i++)
+			if (!frame->bytes[i * 4 + 3] &&
+				cgif->previous_frame[i * 4 + 3]) {
+				has_alpha_constraint = TRUE;
+				break;
+			}
+
 	/* Set up cgif on first use.
 	 */
 	if (!cgif->cgif_context) {
@@ -619,8 +936,8 @@ vips_foreign_save_cgif_write_frame(VipsForeignSaveCgif *cgif)
 
 		cgif->cgif_config.width = cgif->frame_width;
 		cgif->cgif_config.height = cgif->frame_height;
-		cgif->cgif_config.pGlobalPalette = palette_rgb;
-		cgif->cgif_config.numGlobalPaletteEntries = n_colours;
+		cgif->cgif_config.pGlobalPalette = frame->palette_rgb;
+		cgif->cgif_config.numGlobalPaletteEntries = frame->n_colours;
 		cgif->cgif_config.pWriteFn = vips__cgif_write;
 		cgif->cgif_config.pContext = (void *) cgif->target;
 
@@ -638,7 +955,7 @@ vips_foreign_save_cgif_write_frame(VipsForeignSaveCgif *cgif)
 	/* Switch per-frame alpha channel on. Index 0 is used for pixels
 	 * with alpha channel.
 	 */
-	if (has_transparency) {
+	if (frame->has_transparency) {
 		frame_config.attrFlags |= CGIF_FRAME_ATTR_HAS_ALPHA;
 		frame_config.transIndex = 0;
 	}
@@ -647,16 +964,16 @@ vips_foreign_save_cgif_write_frame(VipsForeignSaveCgif *cgif)
 	 * transparent, provided no alpha channel constraint is present.
 	 */
 	if (cgif->previous_frame) {
-		if (cgif->page_number > 0 &&
+		if (frame->page_number > 0 &&
 			!has_alpha_constraint) {
-			int trans = has_transparency ? 0 : n_colours;
+			int trans = frame->has_transparency ? 0 : frame->n_colours;
 
 			vips_foreign_save_cgif_set_transparent(cgif,
-				cgif->previous_frame, cgif->frame_bytes,
-				cgif->index,
+				cgif->previous_frame, frame->bytes,
+				frame->index,
 				n_pels, cgif->frame_width, trans);
 
-			if (has_transparency)
+			if (frame->has_transparency)
 				frame_config.attrFlags &=
 					~CGIF_FRAME_ATTR_HAS_ALPHA;
 			frame_config.attrFlags |=
@@ -666,21 +983,20 @@ vips_foreign_save_cgif_write_frame(VipsForeignSaveCgif *cgif)
 		else {
 			/* Take a copy of the RGBA frame.
 			 */
-			memcpy(cgif->previous_frame, cgif->frame_bytes,
-				4 * n_pels);
+			memcpy(cgif->previous_frame, frame->bytes, 4 * n_pels);
 		}
 	}
 
 	if (cgif->delay &&
-		cgif->page_number < cgif->delay_length)
-		frame_config.delay = rint(cgif->delay[cgif->page_number] / 10.0);
+		frame->page_number < cgif->delay_length)
+		frame_config.delay = rint(cgif->delay[frame->page_number] / 10.0);
 
 	/* Attach a local palette, if we need one.
 	 */
-	if (use_local) {
+	if (frame->use_local) {
 		frame_config.attrFlags |= CGIF_FRAME_ATTR_USE_LOCAL_TABLE;
-		frame_config.pLocalPalette = palette_rgb;
-		frame_config.numLocalPaletteEntries = n_colours;
+		frame_config.pLocalPalette = frame->palette_rgb;
+		frame_config.numLocalPaletteEntries = frame->n_colours;
 	}
 
 	/* Write an interlaced GIF, if requested.
@@ -695,8 +1011,80 @@ vips_foreign_save_cgif_write_frame(VipsForeignSaveCgif *cgif)
 
 	/* Write frame to cgif.
 	 */
-	frame_config.pImageData = cgif->index;
+	frame_config.pImageData = frame->index;
 	cgif_addframe(cgif->cgif_context, &frame_config);
+}
+
+/* Run this as a thread to encode frames in the background.
+ */
+static void
+vips_foreign_save_cgif_encode_thread(void *data, void *user_data)
+{
+	VipsForeignSaveCgif *cgif = (VipsForeignSaveCgif *) data;
+
+	for (;;) {
+		/* Wait for a frame.
+		 */
+		vips_semaphore_down(&cgif->encode_go);
+
+		if (cgif->encode_kill)
+			break;
+
+		VIPS_GATE_START("vips_foreign_save_cgif_encode_thread: work");
+
+		vips_foreign_save_cgif_encode_frame(cgif, cgif->encode_frame);
+
+		VIPS_GATE_STOP("vips_foreign_save_cgif_encode_thread: work");
+
+		vips_semaphore_up(&cgif->encode_done);
+	}
+
+	/* We are exiting: tell the main thread.
+	 */
+	vips_semaphore_up(&cgif->encode_finish);
+}
+
+/* Block until the encode thread has finished any frame it's working on.
+ */
+static void
+vips_foreign_save_cgif_encode_wait(VipsForeignSaveCgif *cgif)
+{
+	if (cgif->encode_busy) {
+		vips_semaphore_down(&cgif->encode_done);
+		cgif->encode_busy = FALSE;
+	}
+}
+
+/* We have a complete frame -- quantise, then encode it here or in the
+ * background.
+ */
+static int
+vips_foreign_save_cgif_write_frame(VipsForeignSaveCgif *cgif)
+{
+	VipsForeignSaveCgifFrame *frame = cgif->frame;
+
+	frame->page_number = cgif->page_number;
+
+	if (vips_foreign_save_cgif_quantise_frame(cgif, frame))
+		return -1;
+
+	if (!cgif->encode_running) {
+		vips_foreign_save_cgif_encode_frame(cgif, frame);
+		return 0;
+	}
+
+	/* Frames must reach cgif in order, so wait for the previous one,
+	 * then set the encoder going on this frame and build the next frame
+	 * in the other buffer.
+	 */
+	vips_foreign_save_cgif_encode_wait(cgif);
+	cgif->encode_frame = frame;
+	cgif->encode_busy = TRUE;
+	vips_semaphore_up(&cgif->encode_go);
+
+	cgif->frame = frame == &cgif->frames[0]
+		? &cgif->frames[1]
+		: &cgif->frames[0];
 
 	return 0;
 }
@@ -716,7 +1104,7 @@ vips_foreign_save_cgif_sink_disc(VipsRegion *region, VipsRect *area, void *a)
 #endif /*DEBUG_VERBOSE*/
 
 	for (int y = 0; y < area->height; y++) {
-		memcpy(cgif->frame_bytes + cgif->write_y * line_size,
+		memcpy(cgif->frame->bytes + cgif->write_y * line_size,
 			VIPS_REGION_ADDR(region, 0, area->top + y),
 			line_size);
 		cgif->write_y += 1;
@@ -779,21 +1167,34 @@ vips_foreign_save_cgif_build(VipsObject *object)
 		return -1;
 	}
 
-	/* This RGBA frame as a contiguous buffer.
+	/* The RGBA frame as a contiguous buffer, and the frame index buffer.
 	 */
-	cgif->frame_bytes = g_malloc0((size_t) 4 *
+	cgif->frames[0].bytes = g_malloc0((size_t) 4 *
 		cgif->frame_width * cgif->frame_height);
+	cgif->frames[0].index = g_malloc0((size_t)
+		cgif->frame_width * cgif->frame_height);
+	cgif->frame = &cgif->frames[0];
 
-	/* The previous RGBA frame (for spotting pixels which haven't changed).
-	 * Only needed for multi-frame animations.
-	 */
-	if (cgif->in->Ysize > cgif->frame_height)
+	if (cgif->in->Ysize > cgif->frame_height) {
+		/* The previous RGBA frame (for spotting pixels which haven't
+		 * changed). Only needed for multi-frame animations.
+		 */
 		cgif->previous_frame = g_malloc0((size_t) 4 *
 			cgif->frame_width * cgif->frame_height);
 
-	/* The frame index buffer.
-	 */
-	cgif->index = g_malloc0((size_t) cgif->frame_width * cgif->frame_height);
+		/* A second frame, so we can quantise one frame while the
+		 * encode thread compresses the one before.
+		 */
+		cgif->frames[1].bytes = g_malloc0((size_t) 4 *
+			cgif->frame_width * cgif->frame_height);
+		cgif->frames[1].index = g_malloc0((size_t)
+			cgif->frame_width * cgif->frame_height);
+
+		if (vips_thread_execute("cgifsave",
+				vips_foreign_save_cgif_encode_thread, cgif))
+			return -1;
+		cgif->encode_running = TRUE;
+	}
 
 	/* Set up libimagequant.
 	 */
@@ -845,18 +1246,35 @@ vips_foreign_save_cgif_build(VipsObject *object)
 		VIPS_FREEF(vips__quantise_image_destroy, image);
 	}
 
-	/* Global mode if there's an input palette, or palette maxerror is
-	 * huge.
+	/* Sampled mode if asked for, global mode if there's an input palette,
+	 * or palette maxerror is huge.
 	 */
-	if (cgif->palette ||
+	if (cgif->global_palette)
+		cgif->mode = VIPS_FOREIGN_SAVE_CGIF_MODE_SAMPLED;
+	else if (cgif->palette ||
 		cgif->interpalette_maxerror > 255)
 		cgif->mode = VIPS_FOREIGN_SAVE_CGIF_MODE_GLOBAL;
 	else
 		cgif->mode = VIPS_FOREIGN_SAVE_CGIF_MODE_LOCAL;
 
+	/* Sample animations for the global palette now, unless we have one
+	 * already, or the source can only be read once.
+	 */
+	if (cgif->mode == VIPS_FOREIGN_SAVE_CGIF_MODE_SAMPLED &&
+		!cgif->quantisation_result &&
+		cgif->in->Ysize > cgif->frame_height &&
+		!vips_image_is_sequential(cgif->in) &&
+		vips_foreign_save_cgif_sample_palette(cgif))
+		return -1;
+
 	if (vips_sink_disc(cgif->in, vips_foreign_save_cgif_sink_disc, cgif))
 		return -1;
 
+	/* Flush the last frame through the encoder.
+	 */
+	vips_foreign_save_cgif_encode_wait(cgif);
+	vips_foreign_save_cgif_encode_stop(cgif);
+
 	VIPS_FREEF(cgif_close, cgif->cgif_context);
 
 	if (vips_target_end(cgif->target))
@@ -885,6 +1303,7 @@ vips_foreign_save_cgif_class_init(VipsForeignSaveCgifClass *class)
 	VipsForeignSaveClass *save_class = (VipsForeignSaveClass *) class;
 
 	gobject_class->dispose = vips_foreign_save_cgif_dispose;
+	gobject_class->finalize = vips_foreign_save_cgif_finalize;
 	gobject_class->set_property = vips_object_set_property;
 	gobject_class->get_property = vips_object_get_property;
 
@@ -963,6 +1382,13 @@ vips_foreign_save_cgif_class_init(VipsForeignSaveCgifClass *class)
 		VIPS_ARGUMENT_OPTIONAL_INPUT,
 		G_STRUCT_OFFSET(VipsForeignSaveCgif, keep_duplicate_frames),
 		FALSE);
+
+	VIPS_ARG_BOOL(class, "global_palette", 19,
+		_("Global palette"),
+		_("Map all frames to one palette made from a sample of frames"),
+		VIPS_ARGUMENT_OPTIONAL_INPUT,
+		G_STRUCT_OFFSET(VipsForeignSaveCgif, global_palette),
+		FALSE);
 }
 
 static void
@@ -976,6 +1402,10 @@ vips_foreign_save_cgif_init(VipsForeignSaveCgif *gif)
 	gif->interlace = FALSE;
 	gif->interpalette_maxerror = 3.0;
 	gif->mode = VIPS_FOREIGN_SAVE_CGIF_MODE_GLOBAL;
+
+	vips_semaphore_init(&gif->encode_go, 0, "encode_go");
+	vips_semaphore_init(&gif->encode_done, 0, "encode_done");
+	vips_semaphore_init(&gif->encode_finish, 0, "encode_finish");
 }
 
 typedef struct _VipsForeignSaveCgifTarget {
@@ -1176,6 +1606,13 @@ vips_foreign_save_cgif_buffer_init(VipsForeignSaveCgifBuffer *buffer)
  * If @keep_duplicate_frames is `TRUE`, duplicate frames in the input will be
  * kept in the output instead of combining them.
  *
+ * If @global_palette is `TRUE`, a single palette is made from a sample of
+ * up to 8 frames, and each frame is mapped to it with a nearest-colour
+ * lookup table instead of being quantised. This is much faster for
+ * animations whose frames share colours, but does not dither. Sequential
+ * sources take the palette from the first frame. If @reuse finds a
+ * palette on @in, that palette is used instead of a sample.
+ *
  * ::: tip "Optional arguments"
  *     * @dither: `gdouble`, quantisation dithering level
  *     * @effort: `gint`, quantisation CPU effort
@@ -1188,6 +1625,7 @@ vips_foreign_save_cgif_buffer_init(VipsForeignSaveCgifBuffer *buffer)
  *       palette reusage
  *     * @keep_duplicate_frames: `gboolean`, keep duplicate frames in the output
  *       instead of combining them
+ *     * @global_palette: `gboolean`, map all frames to one sampled palette
  *
  * ::: seealso
  *     [ctor@Image.new_from_file].
@@ -1232,6 +1670,7 @@ vips_gifsave(VipsImage *in, const char *filename, ...)
  *       palette reusage
  *     * @keep_duplicate_frames: `gboolean`, keep duplicate frames in the output
  *       instead of combining them
+ *     * @global_palette: `gboolean`, map all frames to one sampled palette
  *
  * ::: seealso
  *     [method@Image.gifsave], [method@Image.write_to_file].
@@ -1286,6 +1725,7 @@ vips_gifsave_buffer(VipsImage *in, void **buf, size_t *len, ...)
  *       palette reusage
  *     * @keep_duplicate_frames: `gboolean`, keep duplicate frames in the output
  *       instead of combining them
+ *     * @global_palette: `gboolean`, map all frames to one sampled palette
  *
  * ::: seealso
  *     [method@Image.gifsave], [method@Image.write_to_target].
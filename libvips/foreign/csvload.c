@@ -4,6 +4,8 @@
  * 	- from csvload.c
  * 21/2/20
  * 	- rewrite for new source API
+ * 15/10/26
+ * 	- parse mappable sources in parallel
  */
 
 /*
@@ -57,6 +59,11 @@
  */
 #define MAX_ITEM_SIZE (256)
 
+/* Mappable sources are parsed in batches of lines, each batch split into
+ * jobs of about this many bytes of output for the workers.
+ */
+#define JOB_SIZE (256 * 1024)
+
 typedef struct _VipsForeignLoadCsv {
 	VipsForeignLoad parent_object;
 
@@ -94,6 +101,28 @@ typedef struct _VipsForeignLoadCsv {
 	 */
 	double *linebuf;
 
+	/* If we can map the source, the whole thing, and the first line after
+	 * @skip.
+	 */
+	const char *data;
+	const char *end;
+	const char *start;
+
+	/* A batch of lines for the workers. @line has @batch_lines + 1
+	 * entries, so line i is from line[i] to line[i + 1].
+	 */
+	GMutex lock;
+	GCond cond;
+	const char **line;
+	double *batch;
+	int batch_lines;
+	int batch_y;
+	int job_lines;
+	int n_jobs;
+	int next;
+	int n_running;
+	gboolean failed;
+
 } VipsForeignLoadCsv;
 
 typedef VipsForeignLoadClass VipsForeignLoadCsvClass;
@@ -109,10 +138,23 @@ vips_foreign_load_csv_dispose(GObject *gobject)
 	VIPS_UNREF(csv->source);
 	VIPS_UNREF(csv->sbuf);
 	VIPS_FREE(csv->linebuf);
+	VIPS_FREE(csv->line);
+	VIPS_FREE(csv->batch);
 
 	G_OBJECT_CLASS(vips_foreign_load_csv_parent_class)->dispose(gobject);
 }
 
+static void
+vips_foreign_load_csv_finalize(GObject *gobject)
+{
+	VipsForeignLoadCsv *csv = (VipsForeignLoadCsv *) gobject;
+
+	g_mutex_clear(&csv->lock);
+	g_cond_clear(&csv->cond);
+
+	G_OBJECT_CLASS(vips_foreign_load_csv_parent_class)->finalize(gobject);
+}
+
 static int
 vips_foreign_load_csv_build(VipsObject *object)
 {
@@ -321,6 +363,57 @@ vips_foreign_load_csv_read_double(VipsForeignLoadCsv *csv, double *out)
 	return ch;
 }
 
+/* Map the source, if we can, and find the first line after @skip.
+ */
+static int
+vips_foreign_load_csv_map(VipsForeignLoadCsv *csv)
+{
+	VipsObjectClass *class = VIPS_OBJECT_GET_CLASS(csv);
+
+	size_t length;
+	const char *p;
+	int i;
+
+	if (csv->data ||
+		vips_source_is_mappable(csv->source) != TRUE)
+		return 0;
+
+	if (!(csv->data = vips_source_map(csv->source, &length)))
+		return -1;
+	csv->end = csv->data + length;
+
+	p = csv->data;
+	for (i = 0; i < csv->skip; i++) {
+		const char *q;
+
+		if (!(q = memchr(p, '\n', csv->end - p))) {
+			vips_error(class->nickname,
+				"%s", _("unexpected end of file"));
+			return -1;
+		}
+		p = q + 1;
+	}
+	csv->start = p;
+
+	return 0;
+}
+
+/* Count the lines after @p. An unterminated final line counts.
+ */
+static int
+vips_foreign_load_csv_count_lines(VipsForeignLoadCsv *csv, const char *p)
+{
+	const char *q;
+	int height;
+
+	for (height = 0; (q = memchr(p, '\n', csv->end - p)); height++)
+		p = q + 1;
+	if (p < csv->end)
+		height += 1;
+
+	return height;
+}
+
 static int
 vips_foreign_load_csv_header(VipsForeignLoad *load)
 {
@@ -369,10 +462,19 @@ vips_foreign_load_csv_header(VipsForeignLoad *load)
 		return -1;
 
 	/* If @lines is -1, we must scan the whole file to get the height.
+	 * memchr() is much quicker than the sbuf, if we can map the source.
 	 */
-	if (csv->lines == -1)
-		for (height = 0; vips_sbuf_get_line(csv->sbuf); height++)
-			;
+	if (csv->lines == -1) {
+		if (vips_foreign_load_csv_map(csv))
+			return -1;
+
+		if (csv->data)
+			height = vips_foreign_load_csv_count_lines(csv,
+				csv->start);
+		else
+			for (height = 0; vips_sbuf_get_line(csv->sbuf); height++)
+				;
+	}
 	else
 		height = csv->lines;
 
@@ -390,6 +492,226 @@ vips_foreign_load_csv_header(VipsForeignLoad *load)
 	return 0;
 }
 
+/* Parse a line of a mapped source into @linebuf, following the same rules
+ * as vips_foreign_load_csv_read_double().
+ */
+static int
+vips_foreign_load_csv_parse_line(VipsForeignLoadCsv *csv,
+	const char *p, const char *end, gboolean eof,
+	int lineno, double *linebuf)
+{
+	VipsForeignLoad *load = (VipsForeignLoad *) csv;
+	VipsObjectClass *class = VIPS_OBJECT_GET_CLASS(csv);
+	int width = load->real->Xsize;
+
+	int colno;
+
+	memset(linebuf, 0, width * sizeof(double));
+
+	for (colno = 1;; colno++) {
+		double value;
+
+		value = 0.0;
+
+		while (p < end &&
+			csv->whitemap[(unsigned char) *p])
+			p++;
+		if (p >= end)
+			break;
+
+		if (*p == '"') {
+			/* Skip to just after the close quotes, ignoring
+			 * \anything.
+			 */
+			for (p++; p < end; p++)
+				if (*p == '\\')
+					p++;
+				else if (*p == '"')
+					break;
+			p = VIPS_MIN(p + 1, end);
+		}
+		else if (!csv->sepmap[(unsigned char) *p]) {
+			const char *q;
+
+			for (q = p; q < end &&
+				 !csv->whitemap[(unsigned char) *q] &&
+				 !csv->sepmap[(unsigned char) *q];
+				 q++)
+				;
+
+			if (!vips__strtod_fast(p, q, &value)) {
+				char item[MAX_ITEM_SIZE];
+				int length = VIPS_MIN(q - p, MAX_ITEM_SIZE - 1);
+
+				memcpy(item, p, length);
+				item[length] = '\0';
+				if (vips_strtod(item, &value))
+					g_warning("bad number, line %d, column %d",
+						lineno, colno);
+			}
+
+			p = q;
+		}
+
+		while (p < end &&
+			csv->whitemap[(unsigned char) *p])
+			p++;
+		if (p >= end)
+			break;
+
+		if (csv->sepmap[(unsigned char) *p])
+			p++;
+
+		if (colno <= width)
+			linebuf[colno - 1] = value;
+	}
+
+	/* The final item on the line.
+	 */
+	if (colno <= width)
+		linebuf[colno - 1] = value;
+
+	if (eof &&
+		load->fail_on >= VIPS_FAIL_ON_TRUNCATED) {
+		vips_error(class->nickname, "%s", _("unexpected end of file"));
+		return -1;
+	}
+
+	if (!eof &&
+		colno < width) {
+		vips_error(class->nickname,
+			_("line %d has only %d columns"), lineno, colno);
+		if (load->fail_on >= VIPS_FAIL_ON_ERROR)
+			return -1;
+	}
+
+	return 0;
+}
+
+static void
+vips_foreign_load_csv_work(void *a, void *b)
+{
+	VipsForeignLoadCsv *csv = (VipsForeignLoadCsv *) a;
+	VipsForeignLoad *load = (VipsForeignLoad *) csv;
+	int width = load->real->Xsize;
+
+	for (;;) {
+		int i;
+		int y;
+
+		g_mutex_lock(&csv->lock);
+		i = csv->failed ? csv->n_jobs : csv->next++;
+		g_mutex_unlock(&csv->lock);
+
+		if (i >= csv->n_jobs)
+			break;
+
+		for (y = i * csv->job_lines;
+			 y < VIPS_MIN((i + 1) * csv->job_lines, csv->batch_lines);
+			 y++) {
+			const char *p = csv->line[y];
+			const char *q = csv->line[y + 1];
+			gboolean eof = q == p || q[-1] != '\n';
+
+			if (vips_foreign_load_csv_parse_line(csv,
+					p, eof ? q : q - 1, eof,
+					csv->skip + 1 + csv->batch_y + y,
+					csv->batch + (size_t) y * width)) {
+				g_mutex_lock(&csv->lock);
+				csv->failed = TRUE;
+				g_mutex_unlock(&csv->lock);
+				break;
+			}
+		}
+	}
+
+	/* We can be freed as soon as we unlock, so this must be the last
+	 * thing we do.
+	 */
+	g_mutex_lock(&csv->lock);
+	csv->n_running -= 1;
+	g_cond_broadcast(&csv->cond);
+	g_mutex_unlock(&csv->lock);
+}
+
+/* The lines are independent once we've found the newlines, so parse a
+ * mapped source in batches, with the lines in each batch shared out between
+ * a set of workers.
+ */
+static int
+vips_foreign_load_csv_load_mapped(VipsForeignLoadCsv *csv)
+{
+	VipsForeignLoad *load = (VipsForeignLoad *) csv;
+	int width = load->real->Xsize;
+	int height = load->real->Ysize;
+	int n_workers = vips_concurrency_get();
+
+	const char *p;
+	int y;
+
+	csv->job_lines = VIPS_MAX(1, JOB_SIZE / (width * sizeof(double)));
+	csv->batch_lines = VIPS_MIN(height, csv->job_lines * n_workers * 4);
+	if (!(csv->line = VIPS_ARRAY(NULL, csv->batch_lines + 1, const char *)) ||
+		!(csv->batch = VIPS_ARRAY(NULL,
+			  (size_t) csv->batch_lines * width, double)))
+		return -1;
+
+	p = csv->start;
+	for (csv->batch_y = 0; csv->batch_y < height;
+		 csv->batch_y += csv->batch_lines) {
+		int lines = VIPS_MIN(csv->batch_lines, height - csv->batch_y);
+
+		/* Find the start of each line. A line past the end of the
+		 * source is empty.
+		 */
+		for (y = 0; y < lines; y++) {
+			const char *q;
+
+			csv->line[y] = p;
+			q = memchr(p, '\n', csv->end - p);
+			p = q ? q + 1 : csv->end;
+		}
+		csv->line[lines] = p;
+
+		csv->n_jobs = VIPS_ROUND_UP(lines, csv->job_lines) /
+			csv->job_lines;
+		csv->next = 0;
+		csv->n_running = 0;
+		csv->failed = FALSE;
+
+		vips__worker_lock(&csv->lock);
+		for (int i = 0; i < VIPS_MIN(n_workers, csv->n_jobs); i++) {
+			csv->n_running += 1;
+			if (vips_thread_execute("csvload",
+					vips_foreign_load_csv_work, csv))
+				csv->n_running -= 1;
+		}
+
+		/* If we couldn't start any workers, do it ourselves.
+		 */
+		if (csv->n_running == 0) {
+			csv->n_running += 1;
+			g_mutex_unlock(&csv->lock);
+			vips_foreign_load_csv_work(csv, NULL);
+			vips__worker_lock(&csv->lock);
+		}
+
+		while (csv->n_running > 0)
+			vips__worker_cond_wait(&csv->cond, &csv->lock);
+		g_mutex_unlock(&csv->lock);
+
+		if (csv->failed)
+			return -1;
+
+		for (y = 0; y < lines; y++)
+			if (vips_image_write_line(load->real, csv->batch_y + y,
+					(VipsPel *) (csv->batch + (size_t) y * width)))
+				return -1;
+	}
+
+	return 0;
+}
+
 static int
 vips_foreign_load_csv_load(VipsForeignLoad *load)
 {
@@ -400,6 +722,19 @@ vips_foreign_load_csv_load(VipsForeignLoad *load)
 	int x, y;
 	int ch;
 
+	vips_image_init_fields(load->real,
+		load->out->Xsize, load->out->Ysize, 1,
+		VIPS_FORMAT_DOUBLE,
+		VIPS_CODING_NONE, VIPS_INTERPRETATION_B_W, 1.0, 1.0);
+	if (vips_image_pipelinev(load->real,
+			VIPS_DEMAND_STYLE_THINSTRIP, NULL))
+		return -1;
+
+	if (vips_foreign_load_csv_map(csv))
+		return -1;
+	if (csv->data)
+		return vips_foreign_load_csv_load_mapped(csv);
+
 	/* Rewind.
 	 */
 	vips_sbuf_unbuffer(csv->sbuf);
@@ -415,14 +750,6 @@ vips_foreign_load_csv_load(VipsForeignLoad *load)
 			return -1;
 		}
 
-	vips_image_init_fields(load->real,
-		load->out->Xsize, load->out->Ysize, 1,
-		VIPS_FORMAT_DOUBLE,
-		VIPS_CODING_NONE, VIPS_INTERPRETATION_B_W, 1.0, 1.0);
-	if (vips_image_pipelinev(load->real,
-			VIPS_DEMAND_STYLE_THINSTRIP, NULL))
-		return -1;
-
 	csv->lineno = csv->skip + 1;
 	for (y = 0; y < load->real->Ysize; y++) {
 		csv->colno = 0;
@@ -484,6 +811,7 @@ vips_foreign_load_csv_class_init(VipsForeignLoadCsvClass *class)
 	VipsForeignLoadClass *load_class = (VipsForeignLoadClass *) class;
 
 	gobject_class->dispose = vips_foreign_load_csv_dispose;
+	gobject_class->finalize = vips_foreign_load_csv_finalize;
 	gobject_class->set_property = vips_object_set_property;
 	gobject_class->get_property = vips_object_get_property;
 
@@ -532,6 +860,9 @@ vips_foreign_load_csv_class_init(VipsForeignLoadCsvClass *class)
 static void
 vips_foreign_load_csv_init(VipsForeignLoadCsv *csv)
 {
+	g_mutex_init(&csv->lock);
+	g_cond_init(&csv->cond);
+
 	csv->lines = -1;
 	csv->whitespace = g_strdup(" ");
 	csv->separator = g_strdup(";,\t");
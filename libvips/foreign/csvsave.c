@@ -4,6 +4,8 @@
  * 	- wrap a class around the csv writer
  * 21/2/20
  * 	- rewrite for the VipsTarget API
+ * 15/10/26
+ * 	- format lines in parallel with vips__dtoa()
  */
 
 /*
@@ -48,6 +50,7 @@
 #include <string.h>
 
 #include <vips/vips.h>
+#include <vips/internal.h>
 
 #include "pforeign.h"
 
@@ -57,6 +60,17 @@ typedef struct _VipsForeignSaveCsv {
 	VipsTarget *target;
 
 	const char *separator;
+
+	/* The lines of each block are formatted in parallel into @lines,
+	 * then written in order.
+	 */
+	GMutex lock;
+	GCond cond;
+	VipsRegion *region;
+	VipsRect *area;
+	GPtrArray *lines;
+	int next;
+	int n_running;
 } VipsForeignSaveCsv;
 
 typedef VipsForeignSaveClass VipsForeignSaveCsvClass;
@@ -70,101 +84,192 @@ vips_foreign_save_csv_dispose(GObject *gobject)
 	VipsForeignSaveCsv *csv = (VipsForeignSaveCsv *) gobject;
 
 	VIPS_UNREF(csv->target);
+	VIPS_FREEF(g_ptr_array_unref, csv->lines);
 
 	G_OBJECT_CLASS(vips_foreign_save_csv_parent_class)->dispose(gobject);
 }
 
+static void
+vips_foreign_save_csv_finalize(GObject *gobject)
+{
+	VipsForeignSaveCsv *csv = (VipsForeignSaveCsv *) gobject;
+
+	g_mutex_clear(&csv->lock);
+	g_cond_clear(&csv->cond);
+
+	G_OBJECT_CLASS(vips_foreign_save_csv_parent_class)->finalize(gobject);
+}
+
+static void
+vips_foreign_save_csv_free_line(GString *line)
+{
+	g_string_free(line, TRUE);
+}
+
 #define PRINT_INT(TYPE) \
 	{ \
 		TYPE *pt = (TYPE *) p; \
 \
-		for (x = 0; x < image->Xsize; x++) { \
+		for (x = 0; x < width; x++) { \
 			if (x > 0) \
-				vips_target_writes(csv->target, csv->separator); \
-			vips_target_writef(csv->target, "%d", pt[x]); \
+				g_string_append(line, csv->separator); \
+			n = vips__itoa(buf, pt[x]); \
+			g_string_append_len(line, buf, n); \
 		} \
 	}
 
 #define PRINT_FLOAT(TYPE) \
 	{ \
 		TYPE *pt = (TYPE *) p; \
-		char buf[G_ASCII_DTOSTR_BUF_SIZE]; \
 \
-		for (x = 0; x < image->Xsize; x++) { \
+		for (x = 0; x < width; x++) { \
 			if (x > 0) \
-				vips_target_writes(csv->target, csv->separator); \
-			g_ascii_dtostr(buf, G_ASCII_DTOSTR_BUF_SIZE, pt[x]); \
-			vips_target_writes(csv->target, buf); \
+				g_string_append(line, csv->separator); \
+			n = vips__dtoa(buf, pt[x]); \
+			g_string_append_len(line, buf, n); \
 		} \
 	}
 
 #define PRINT_COMPLEX(TYPE) \
 	{ \
 		TYPE *pt = (TYPE *) p; \
-		char buf[G_ASCII_DTOSTR_BUF_SIZE]; \
 \
-		for (x = 0; x < image->Xsize; x++) { \
+		for (x = 0; x < width; x++) { \
 			if (x > 0) \
-				vips_target_writes(csv->target, csv->separator); \
-			VIPS_TARGET_PUTC(csv->target, '('); \
-			g_ascii_dtostr(buf, G_ASCII_DTOSTR_BUF_SIZE, pt[0]); \
-			vips_target_writes(csv->target, buf); \
-			VIPS_TARGET_PUTC(csv->target, ','); \
-			g_ascii_dtostr(buf, G_ASCII_DTOSTR_BUF_SIZE, pt[1]); \
-			vips_target_writes(csv->target, buf); \
-			VIPS_TARGET_PUTC(csv->target, ')'); \
+				g_string_append(line, csv->separator); \
+			g_string_append_c(line, '('); \
+			n = vips__dtoa(buf, pt[0]); \
+			g_string_append_len(line, buf, n); \
+			g_string_append_c(line, ','); \
+			n = vips__dtoa(buf, pt[1]); \
+			g_string_append_len(line, buf, n); \
+			g_string_append_c(line, ')'); \
 			pt += 2; \
 		} \
 	}
 
+static void
+vips_foreign_save_csv_line(VipsForeignSaveCsv *csv, int y, GString *line)
+{
+	VipsImage *image = csv->region->im;
+	int width = image->Xsize;
+	VipsPel *p = VIPS_REGION_ADDR(csv->region, 0, csv->area->top + y);
+
+	char buf[VIPS__DTOA_BUF_SIZE];
+	int x;
+	int n;
+
+	g_string_truncate(line, 0);
+
+	switch (image->BandFmt) {
+	case VIPS_FORMAT_UCHAR:
+		PRINT_INT(unsigned char);
+		break;
+	case VIPS_FORMAT_CHAR:
+		PRINT_INT(char);
+		break;
+	case VIPS_FORMAT_USHORT:
+		PRINT_INT(unsigned short);
+		break;
+	case VIPS_FORMAT_SHORT:
+		PRINT_INT(short);
+		break;
+	case VIPS_FORMAT_UINT:
+		PRINT_INT(unsigned int);
+		break;
+	case VIPS_FORMAT_INT:
+		PRINT_INT(int);
+		break;
+	case VIPS_FORMAT_FLOAT:
+		PRINT_FLOAT(float);
+		break;
+	case VIPS_FORMAT_DOUBLE:
+		PRINT_FLOAT(double);
+		break;
+	case VIPS_FORMAT_COMPLEX:
+		PRINT_COMPLEX(float);
+		break;
+	case VIPS_FORMAT_DPCOMPLEX:
+		PRINT_COMPLEX(double);
+		break;
+
+	default:
+		g_assert_not_reached();
+	}
+
+	g_string_append_c(line, '\n');
+}
+
+static void
+vips_foreign_save_csv_work(void *a, void *b)
+{
+	VipsForeignSaveCsv *csv = (VipsForeignSaveCsv *) a;
+
+	for (;;) {
+		int y;
+
+		g_mutex_lock(&csv->lock);
+		y = csv->next++;
+		g_mutex_unlock(&csv->lock);
+
+		if (y >= csv->area->height)
+			break;
+
+		vips_foreign_save_csv_line(csv, y,
+			g_ptr_array_index(csv->lines, y));
+	}
+
+	/* We can be freed as soon as we unlock, so this must be the last
+	 * thing we do.
+	 */
+	g_mutex_lock(&csv->lock);
+	csv->n_running -= 1;
+	g_cond_broadcast(&csv->cond);
+	g_mutex_unlock(&csv->lock);
+}
+
 static int
 vips_foreign_save_csv_block(VipsRegion *region, VipsRect *area, void *a)
 {
 	VipsForeignSaveCsv *csv = (VipsForeignSaveCsv *) a;
-	VipsImage *image = region->im;
 
-	int x, y;
+	int n_workers;
+	int y;
 
-	for (y = 0; y < area->height; y++) {
-		VipsPel *p = VIPS_REGION_ADDR(region, 0, area->top + y);
+	while (csv->lines->len < (guint) area->height)
+		g_ptr_array_add(csv->lines, g_string_new(NULL));
 
-		switch (image->BandFmt) {
-		case VIPS_FORMAT_UCHAR:
-			PRINT_INT(unsigned char);
-			break;
-		case VIPS_FORMAT_CHAR:
-			PRINT_INT(char);
-			break;
-		case VIPS_FORMAT_USHORT:
-			PRINT_INT(unsigned short);
-			break;
-		case VIPS_FORMAT_SHORT:
-			PRINT_INT(short);
-			break;
-		case VIPS_FORMAT_UINT:
-			PRINT_INT(unsigned int);
-			break;
-		case VIPS_FORMAT_INT:
-			PRINT_INT(int);
-			break;
-		case VIPS_FORMAT_FLOAT:
-			PRINT_FLOAT(float);
-			break;
-		case VIPS_FORMAT_DOUBLE:
-			PRINT_FLOAT(double);
-			break;
-		case VIPS_FORMAT_COMPLEX:
-			PRINT_COMPLEX(float);
-			break;
-		case VIPS_FORMAT_DPCOMPLEX:
-			PRINT_COMPLEX(double);
-			break;
+	csv->region = region;
+	csv->area = area;
+	csv->next = 0;
+	csv->n_running = 0;
+
+	n_workers = VIPS_MIN(vips_concurrency_get(), area->height);
+
+	vips__worker_lock(&csv->lock);
+	for (int i = 0; i < n_workers; i++) {
+		csv->n_running += 1;
+		if (vips_thread_execute("csvsave", vips_foreign_save_csv_work, csv))
+			csv->n_running -= 1;
+	}
+
+	/* If we couldn't start any workers, do it ourselves.
+	 */
+	if (csv->n_running == 0) {
+		csv->n_running += 1;
+		g_mutex_unlock(&csv->lock);
+		vips_foreign_save_csv_work(csv, NULL);
+		vips__worker_lock(&csv->lock);
+	}
 
-		default:
-			g_assert_not_reached();
-		}
+	while (csv->n_running > 0)
+		vips__worker_cond_wait(&csv->cond, &csv->lock);
+	g_mutex_unlock(&csv->lock);
 
-		if (vips_target_writes(csv->target, "\n"))
+	for (y = 0; y < area->height; y++) {
+		GString *line = g_ptr_array_index(csv->lines, y);
+
+		if (vips_target_write(csv->target, line->str, line->len))
 			return -1;
 	}
 
@@ -208,6 +313,7 @@ vips_foreign_save_csv_class_init(VipsForeignSaveCsvClass *class)
 	VipsForeignSaveClass *save_class = (VipsForeignSaveClass *) class;
 
 	gobject_class->dispose = vips_foreign_save_csv_dispose;
+	gobject_class->finalize = vips_foreign_save_csv_finalize;
 	gobject_class->set_property = vips_object_set_property;
 	gobject_class->get_property = vips_object_get_property;
 
@@ -230,6 +336,11 @@ vips_foreign_save_csv_class_init(VipsForeignSaveCsvClass *class)
 static void
 vips_foreign_save_csv_init(VipsForeignSaveCsv *csv)
 {
+	g_mutex_init(&csv->lock);
+	g_cond_init(&csv->cond);
+	csv->lines = g_ptr_array_new_with_free_func(
+		(GDestroyNotify) vips_foreign_save_csv_free_line);
+
 	csv->separator = g_strdup("\t");
 }
 
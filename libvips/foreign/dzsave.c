@@ -100,6 +100,12 @@
  *	- add direct mode
  * 24/11/25
  *	- add gainmap support
+ * 15/10/26
+ *	- add @dedupe
+ *	- add @update
+ *	- add @band, @merge
+ *	- shrink pyramid levels in parallel
+ *	- add @checkpoint
  */
 
 /*
@@ -182,6 +188,8 @@
 #include <string.h>
 #include <errno.h>
 
+#include <glib/gstdio.h>
+
 #include <vips/vips.h>
 #include <vips/internal.h>
 
@@ -233,6 +241,11 @@ struct _Level {
 	int sub; /* Subsample factor for this level */
 	int n;	 /* Level number ... 0 for smallest */
 
+	/* With @update, the pixels in this level which might have changed.
+	 * With @band, the pixels in this level we can make from the band.
+	 */
+	VipsRect dirty;
+
 	Level *below; /* Tiles go to here */
 	Level *above; /* Tiles come from here */
 };
@@ -264,6 +277,36 @@ struct _VipsForeignSaveDz {
 	char *id;
 	int Q;
 
+	/* Write identical tiles only once. The table maps a hash of the
+	 * tile pixels to a TileDedupe.
+	 */
+	gboolean dedupe;
+	GMutex dedupe_lock;
+	GHashTable *dedupe_table;
+	size_t dedupe_bytes;
+
+	/* Only rewrite the tiles of an existing pyramid which overlap this
+	 * left, top, width, height.
+	 */
+	VipsArrayInt *update;
+
+	/* Only write the tiles which lie entirely within this top, height
+	 * band of rows, so a pyramid can be made in parts.
+	 */
+	VipsArrayInt *band;
+
+	/* Write any tiles which are not already present, then the metadata.
+	 */
+	gboolean merge;
+
+	/* Save enough state to restart every this many rows of tiles, and
+	 * resume from any saved state. The count of rows since the last
+	 * checkpoint, and the file we keep the state in.
+	 */
+	int checkpoint;
+	int checkpoint_strips;
+	char *checkpoint_filename;
+
 	/* In direct save mode, we write regions of pixels to the output and
 	 * avoid creating a pipeline for each tile. This must be disabled if
 	 * --suffix has been used.
@@ -366,9 +409,89 @@ iszip(VipsForeignDzContainer container)
 	}
 }
 
+/* A tile we've written, for dedupe. For zip output there's no way to link
+ * entries, so we also keep the encoded bytes, up to a limit, and add them
+ * again without encoding.
+ */
+typedef struct _TileDedupe {
+	char *filename;
+	void *buf;
+	size_t len;
+} TileDedupe;
+
+#define DEDUPE_MAX_BYTES (64 * 1024 * 1024)
+
+static void
+tile_dedupe_free(TileDedupe *tile)
+{
+	VIPS_FREE(tile->filename);
+	VIPS_FREE(tile->buf);
+	g_free(tile);
+}
+
+/* Remember that @filename has the pixels in @hash.
+ */
+static void
+tile_dedupe_add(VipsForeignSaveDz *dz,
+	const char *hash, const char *filename, void *buf, size_t len)
+{
+	g_mutex_lock(&dz->dedupe_lock);
+
+	if (!g_hash_table_lookup(dz->dedupe_table, hash)) {
+		TileDedupe *tile;
+
+		tile = g_new0(TileDedupe, 1);
+		tile->filename = g_strdup(filename);
+		if (iszip(dz->container) &&
+			dz->dedupe_bytes + len <= DEDUPE_MAX_BYTES) {
+			tile->buf = g_malloc(len);
+			memcpy(tile->buf, buf, len);
+			tile->len = len;
+			dz->dedupe_bytes += len;
+		}
+
+		g_hash_table_insert(dz->dedupe_table, g_strdup(hash), tile);
+	}
+
+	g_mutex_unlock(&dz->dedupe_lock);
+}
+
+/* If we've already written a tile with the pixels in @hash, reuse it for
+ * @filename and set @done.
+ */
+static int
+tile_dedupe_reuse(VipsForeignSaveDz *dz,
+	const char *hash, const char *filename, gboolean *done)
+{
+	TileDedupe *tile;
+
+	*done = FALSE;
+
+	/* Entries are never changed or removed during a save, so we only
+	 * need the lock for the lookup.
+	 */
+	g_mutex_lock(&dz->dedupe_lock);
+	tile = g_hash_table_lookup(dz->dedupe_table, hash);
+	g_mutex_unlock(&dz->dedupe_lock);
+
+	if (!tile)
+		return 0;
+
+	if (vips__archive_link(dz->archive, tile->filename, filename))
+		*done = TRUE;
+	else if (tile->buf) {
+		if (vips__archive_mkfile(dz->archive,
+				filename, tile->buf, tile->len))
+			return -1;
+		*done = TRUE;
+	}
+
+	return 0;
+}
+
 static int
-write_image(VipsForeignSaveDz *dz,
-	VipsImage *image, const char *filename, const char *format)
+write_image(VipsForeignSaveDz *dz, VipsImage *image,
+	const char *filename, const char *format, const char *hash)
 {
 	VipsForeignSave *save = VIPS_FOREIGN_SAVE(dz);
 	VipsImage *t;
@@ -396,6 +519,10 @@ write_image(VipsForeignSaveDz *dz,
 		g_free(buf);
 		return -1;
 	}
+
+	if (hash)
+		tile_dedupe_add(dz, hash, filename, buf, len);
+
 	g_free(buf);
 
 	return 0;
@@ -421,6 +548,7 @@ vips_foreign_save_dz_dispose(GObject *gobject)
 	VIPS_FREEF(vips__archive_free, dz->archive);
 	VIPS_UNREF(dz->target);
 	VIPS_UNREF(dz->gainmap);
+	VIPS_FREEF(g_hash_table_destroy, dz->dedupe_table);
 
 	VIPS_FREEF(level_free, dz->level);
 
@@ -428,10 +556,21 @@ vips_foreign_save_dz_dispose(GObject *gobject)
 	VIPS_FREE(dz->dirname);
 	VIPS_FREE(dz->root_name);
 	VIPS_FREE(dz->file_suffix);
+	VIPS_FREE(dz->checkpoint_filename);
 
 	G_OBJECT_CLASS(vips_foreign_save_dz_parent_class)->dispose(gobject);
 }
 
+static void
+vips_foreign_save_dz_finalize(GObject *gobject)
+{
+	VipsForeignSaveDz *dz = (VipsForeignSaveDz *) gobject;
+
+	g_mutex_clear(&dz->dedupe_lock);
+
+	G_OBJECT_CLASS(vips_foreign_save_dz_parent_class)->finalize(gobject);
+}
+
 /* Build a pyramid.
  *
  * width/height is the size of this level, real_* the subsection of the level
@@ -693,7 +832,7 @@ write_blank(VipsForeignSaveDz *dz)
 
 	filename = g_build_filename(dz->root_name, "blank.png", NULL);
 
-	if (write_image(dz, x, filename, ".png")) {
+	if (write_image(dz, x, filename, ".png", NULL)) {
 		g_free(filename);
 		g_object_unref(x);
 
@@ -1008,7 +1147,7 @@ write_associated_images(VipsImage *image,
 
 		out = g_build_filename("associated_images", buf, NULL);
 
-		if (write_image(dz, associated, out, ".jpg")) {
+		if (write_image(dz, associated, out, ".jpg", NULL)) {
 			g_free(out);
 			g_object_unref(associated);
 
@@ -1296,6 +1435,82 @@ tile_name(Level *level, int x, int y)
 	return out;
 }
 
+/* A tile is blank and won't be written. If we're updating an existing
+ * pyramid, remove any old version.
+ */
+static int
+tile_remove(Level *level, int x, int y)
+{
+	VipsForeignSaveDz *dz = level->dz;
+
+	char *name;
+	char *path;
+
+	if (!dz->update)
+		return 0;
+
+	if (!(name = tile_name(level, x, y)))
+		return -1;
+	path = g_build_filename(dz->dirname, name, NULL);
+	(void) g_unlink(path);
+	g_free(path);
+	g_free(name);
+
+	return 0;
+}
+
+/* Should we skip this tile with @update or @band?
+ */
+static gboolean
+tile_skip(Level *level, VipsThreadState *state)
+{
+	VipsForeignSaveDz *dz = level->dz;
+
+	if (dz->update)
+		return !vips_rect_overlapsrect(&state->pos, &level->dirty);
+
+	if (dz->band) {
+		VipsRect image;
+		VipsRect core;
+
+		/* Tiles are owned by the band that holds their core pixels,
+		 * ie. without the overlap.
+		 */
+		image.left = 0;
+		image.top = 0;
+		image.width = level->width;
+		image.height = level->height;
+		core.left = state->x;
+		core.top = state->y;
+		core.width = dz->tile_step;
+		core.height = dz->tile_step;
+		vips_rect_intersectrect(&image, &core, &core);
+
+		return vips_rect_isempty(&core) ||
+			!vips_rect_includesrect(&level->dirty, &core);
+	}
+
+	return FALSE;
+}
+
+/* With @merge, skip tiles which have been written by an earlier @band save.
+ */
+static gboolean
+tile_exists(VipsForeignSaveDz *dz, const char *name)
+{
+	char *path;
+	gboolean exists;
+
+	if (!dz->merge)
+		return FALSE;
+
+	path = g_build_filename(dz->dirname, name, NULL);
+	exists = g_file_test(path, G_FILE_TEST_EXISTS);
+	g_free(path);
+
+	return exists;
+}
+
 /* Test for region nearly equal to background colour. In google maps mode, we
  * skip blank background tiles.
  *
@@ -1355,6 +1570,57 @@ image_tile_equal(VipsImage *image, int threshold, VipsPel *restrict ink)
 	return TRUE;
 }
 
+/* Hash the pixels in @rect, plus the size, so we can spot repeated tiles.
+ */
+static char *
+region_tile_hash(VipsRegion *region, VipsRect *rect)
+{
+	size_t line_size = VIPS_REGION_SIZEOF_PEL(region) * rect->width;
+
+	GChecksum *checksum;
+	char *hash;
+	int y;
+
+	checksum = g_checksum_new(G_CHECKSUM_SHA256);
+	g_checksum_update(checksum,
+		(guchar *) &rect->width, sizeof(rect->width));
+	g_checksum_update(checksum,
+		(guchar *) &rect->height, sizeof(rect->height));
+	for (y = 0; y < rect->height; y++)
+		g_checksum_update(checksum,
+			VIPS_REGION_ADDR(region, rect->left, rect->top + y),
+			line_size);
+	hash = g_strdup(g_checksum_get_string(checksum));
+	g_checksum_free(checksum);
+
+	return hash;
+}
+
+static char *
+image_tile_hash(VipsImage *image)
+{
+	VipsRect rect;
+	VipsRegion *region;
+	char *hash;
+
+	region = vips_region_new(image);
+
+	rect.left = 0;
+	rect.top = 0;
+	rect.width = image->Xsize;
+	rect.height = image->Ysize;
+	if (vips_region_prepare(region, &rect)) {
+		g_object_unref(region);
+		return NULL;
+	}
+
+	hash = region_tile_hash(region, &rect);
+
+	g_object_unref(region);
+
+	return hash;
+}
+
 static int
 image_strip_work(VipsThreadState *state, void *a)
 {
@@ -1368,6 +1634,7 @@ image_strip_work(VipsThreadState *state, void *a)
 	VipsRect tile;
 	VipsImage *x;
 	char *out;
+	char *hash;
 
 #ifdef DEBUG_VERBOSE
 	printf("image_strip_work\n");
@@ -1392,6 +1659,9 @@ image_strip_work(VipsThreadState *state, void *a)
 		return 0;
 	}
 
+	if (tile_skip(level, state))
+		return 0;
+
 	g_assert(vips_object_sanity(VIPS_OBJECT(strip->image)));
 
 	/* Extract relative to the strip top-left corner.
@@ -1409,7 +1679,7 @@ image_strip_work(VipsThreadState *state, void *a)
 #endif /*DEBUG_VERBOSE*/
 
 		VIPS_UNREF(x);
-		return 0;
+		return tile_remove(level, tile_x, tile_y);
 	}
 
 	/* If there's a gainmap, generate and attach that too.
@@ -1446,18 +1716,49 @@ image_strip_work(VipsThreadState *state, void *a)
 		return -1;
 	}
 
+	if (tile_exists(dz, out)) {
+		VIPS_FREE(out);
+		VIPS_UNREF(x);
+		return 0;
+	}
+
+	/* Tiles with a gainmap attached are never deduped.
+	 */
+	hash = NULL;
+	if (dz->dedupe &&
+		!dz->gainmap) {
+		gboolean done;
+
+		if (!(hash = image_tile_hash(x)) ||
+			tile_dedupe_reuse(dz, hash, out, &done)) {
+			VIPS_FREE(hash);
+			VIPS_FREE(out);
+			VIPS_UNREF(x);
+			return -1;
+		}
+
+		if (done) {
+			VIPS_FREE(hash);
+			VIPS_FREE(out);
+			VIPS_UNREF(x);
+			return 0;
+		}
+	}
+
 	/* Don't do a threaded write -- this pipeline is too small to have useful
 	 * concurrency, and we are already writing tiles in parallel.
 	 */
 	vips_image_set_int(x, VIPS_META_CONCURRENCY, 1);
 
-	if (write_image(dz, x, out, dz->suffix)) {
+	if (write_image(dz, x, out, dz->suffix, hash)) {
+		VIPS_FREE(hash);
 		VIPS_FREE(out);
 		VIPS_UNREF(x);
 
 		return -1;
 	}
 
+	VIPS_FREE(hash);
 	VIPS_FREE(out);
 	VIPS_UNREF(x);
 
@@ -1554,8 +1855,8 @@ direct_strip_allocate(VipsThreadState *state, void *a, gboolean *stop)
 }
 
 static int
-direct_image_write(VipsForeignSaveDz *dz,
-	VipsRegion *region, VipsRect *rect, const char *filename)
+direct_image_write(VipsForeignSaveDz *dz, VipsRegion *region,
+	VipsRect *rect, const char *filename, const char *hash)
 {
 	VipsForeignSave *save = VIPS_FOREIGN_SAVE(dz);
 	VipsTarget *target;
@@ -1584,6 +1885,9 @@ direct_image_write(VipsForeignSaveDz *dz,
 		return -1;
 	}
 
+	if (hash)
+		tile_dedupe_add(dz, hash, filename, (void *) buf, len);
+
 	vips_area_unref(VIPS_AREA(blob));
 	g_object_unref(target);
 
@@ -1623,6 +1927,9 @@ direct_strip_work(VipsThreadState *state, void *a)
 		return 0;
 	}
 
+	if (tile_skip(level, state))
+		return 0;
+
 	if (dz->skip_blanks >= 0 &&
 		region_tile_equal(level->strip, &state->pos,
 			dz->skip_blanks, dz->ink)) {
@@ -1631,18 +1938,43 @@ direct_strip_work(VipsThreadState *state, void *a)
 			level->n, tile_x, tile_y);
 #endif /*DEBUG_VERBOSE*/
 
-		return 0;
+		return tile_remove(level, tile_x, tile_y);
 	}
 
 	char *name;
 	if (!(name = tile_name(level, tile_x, tile_y)))
 		return -1;
 
-	if (direct_image_write(dz, level->strip, &state->pos, name)) {
+	if (tile_exists(dz, name)) {
+		g_free(name);
+		return 0;
+	}
+
+	char *hash = NULL;
+	if (dz->dedupe) {
+		gboolean done;
+
+		hash = region_tile_hash(level->strip, &state->pos);
+		if (tile_dedupe_reuse(dz, hash, name, &done)) {
+			g_free(hash);
+			g_free(name);
+			return -1;
+		}
+
+		if (done) {
+			g_free(hash);
+			g_free(name);
+			return 0;
+		}
+	}
+
+	if (direct_image_write(dz, level->strip, &state->pos, name, hash)) {
+		g_free(hash);
 		g_free(name);
 		return -1;
 	}
 
+	g_free(hash);
 	g_free(name);
 
 	return 0;
@@ -1657,6 +1989,21 @@ strip_save(Level *level)
 	printf("strip_save: n = %d, y = %d\n", level->n, level->y);
 #endif /*DEBUG_VERBOSE*/
 
+	/* When updating or writing a band, skip strips with no pixels for us.
+	 */
+	if (level->dz->update ||
+		level->dz->band) {
+		VipsForeignSaveDz *dz = level->dz;
+		VipsRect area;
+
+		area.left = 0;
+		area.top = level->y - dz->tile_margin;
+		area.width = level->width;
+		area.height = dz->tile_size + 2 * dz->tile_margin;
+		if (!vips_rect_overlapsrect(&area, &level->dirty))
+			return 0;
+	}
+
 	if (level->dz->direct) {
 		DirectStrip strip;
 
@@ -1815,7 +2162,8 @@ strip_shrink(Level *level)
 		if (vips_rect_isempty(&target))
 			break;
 
-		(void) vips_region_shrink_method(from, to, &target, region_shrink);
+		(void) vips__region_shrink_threaded(from, to, &target,
+			region_shrink);
 
 		below->write_y += target.height;
 
@@ -1936,6 +2284,238 @@ strip_flush(Level *level)
 	return 0;
 }
 
+/* A checkpoint file is a magic string, a header describing the save, then
+ * for each level its position, the area of its strip, and the lines of the
+ * strip we have filled so far. Everything is a gint64 in host byte order,
+ * since it only needs to be read back by the same machine.
+ */
+#define CHECKPOINT_MAGIC "vips-dzsave-checkpoint-1\n"
+#define CHECKPOINT_HEADER (10)
+#define CHECKPOINT_LEVEL (9)
+
+/* The lines at the top of the strip which have pixels in.
+ */
+static int
+checkpoint_lines(Level *level)
+{
+	VipsRect *valid = &level->strip->valid;
+
+	return VIPS_CLIP(0, level->write_y - valid->top, valid->height);
+}
+
+/* Everything except the last item (the tile count) must match for us to
+ * resume.
+ */
+static void
+checkpoint_header(VipsForeignSaveDz *dz, gint64 *header)
+{
+	VipsForeignSave *save = (VipsForeignSave *) dz;
+
+	Level *p;
+	int n_levels;
+
+	n_levels = 0;
+	for (p = dz->level; p; p = p->below)
+		n_levels += 1;
+
+	header[0] = save->ready->Xsize;
+	header[1] = save->ready->Ysize;
+	header[2] = save->ready->Bands;
+	header[3] = save->ready->BandFmt;
+	header[4] = dz->tile_size;
+	header[5] = dz->overlap;
+	header[6] = dz->layout;
+	header[7] = dz->depth;
+	header[8] = n_levels;
+	header[9] = g_atomic_int_get(&dz->tile_count);
+}
+
+static int
+checkpoint_write(VipsForeignSaveDz *dz, FILE *fp)
+{
+	gint64 header[CHECKPOINT_HEADER];
+	Level *p;
+
+	checkpoint_header(dz, header);
+	if (vips__file_write(CHECKPOINT_MAGIC,
+			1, strlen(CHECKPOINT_MAGIC), fp) ||
+		vips__file_write(header, sizeof(gint64), CHECKPOINT_HEADER, fp))
+		return -1;
+
+	for (p = dz->level; p; p = p->below) {
+		VipsRect *valid = &p->strip->valid;
+		int lines = checkpoint_lines(p);
+		gint64 state[CHECKPOINT_LEVEL] = {
+			p->width, p->height, p->y, p->write_y,
+			valid->left, valid->top, valid->width, valid->height,
+			lines
+		};
+
+		int y;
+
+		if (vips__file_write(state, sizeof(gint64), CHECKPOINT_LEVEL, fp))
+			return -1;
+
+		for (y = 0; y < lines; y++)
+			if (vips__file_write(
+					VIPS_REGION_ADDR(p->strip, valid->left, valid->top + y),
+					VIPS_REGION_SIZEOF_LINE(p->strip), 1, fp))
+				return -1;
+	}
+
+	return 0;
+}
+
+/* Save the state of the pyramid. We write to a temp file and rename, so
+ * there's always a complete checkpoint on disc.
+ */
+static int
+checkpoint_save(VipsForeignSaveDz *dz)
+{
+	char *tmp;
+	FILE *fp;
+
+#ifdef DEBUG
+	printf("checkpoint_save: at line %d\n", dz->level->write_y);
+#endif /*DEBUG*/
+
+	tmp = g_strconcat(dz->checkpoint_filename, ".tmp", NULL);
+	if (!(fp = vips__file_open_write(tmp, FALSE))) {
+		g_free(tmp);
+		return -1;
+	}
+
+	if (checkpoint_write(dz, fp)) {
+		fclose(fp);
+		(void) g_unlink(tmp);
+		g_free(tmp);
+		return -1;
+	}
+
+	if (fclose(fp) ||
+		g_rename(tmp, dz->checkpoint_filename)) {
+		vips_error_system(errno, "dzsave",
+			_("unable to write checkpoint \"%s\""),
+			dz->checkpoint_filename);
+		(void) g_unlink(tmp);
+		g_free(tmp);
+		return -1;
+	}
+
+	g_free(tmp);
+
+	return 0;
+}
+
+static int
+checkpoint_read(VipsForeignSaveDz *dz, FILE *fp)
+{
+	size_t magic_length = strlen(CHECKPOINT_MAGIC);
+
+	char magic[sizeof(CHECKPOINT_MAGIC)];
+	gint64 header[CHECKPOINT_HEADER];
+	gint64 saved[CHECKPOINT_HEADER];
+	Level *p;
+
+	checkpoint_header(dz, header);
+	if (fread(magic, 1, magic_length, fp) != magic_length ||
+		memcmp(magic, CHECKPOINT_MAGIC, magic_length) != 0 ||
+		fread(saved, sizeof(gint64), CHECKPOINT_HEADER, fp) !=
+			CHECKPOINT_HEADER ||
+		memcmp(header, saved,
+			sizeof(gint64) * (CHECKPOINT_HEADER - 1)) != 0) {
+		vips_error("dzsave",
+			_("checkpoint \"%s\" does not match this save"),
+			dz->checkpoint_filename);
+		return -1;
+	}
+
+	for (p = dz->level; p; p = p->below) {
+		gint64 state[CHECKPOINT_LEVEL];
+		VipsRect image;
+		VipsRect valid;
+		int y;
+
+		if (fread(state, sizeof(gint64), CHECKPOINT_LEVEL, fp) !=
+				CHECKPOINT_LEVEL ||
+			state[0] != p->width ||
+			state[1] != p->height ||
+			state[3] < 0 ||
+			state[3] > p->height) {
+			vips_error("dzsave",
+				_("bad checkpoint \"%s\""), dz->checkpoint_filename);
+			return -1;
+		}
+
+		image.left = 0;
+		image.top = 0;
+		image.width = p->image->Xsize;
+		image.height = p->image->Ysize;
+		valid.left = state[4];
+		valid.top = state[5];
+		valid.width = state[6];
+		valid.height = state[7];
+		if (valid.width != image.width ||
+			!vips_rect_includesrect(&image, &valid) ||
+			state[8] < 0 ||
+			state[8] > valid.height) {
+			vips_error("dzsave",
+				_("bad checkpoint \"%s\""), dz->checkpoint_filename);
+			return -1;
+		}
+
+		p->y = state[2];
+		p->write_y = state[3];
+		if (vips_region_buffer(p->strip, &valid))
+			return -1;
+
+		for (y = 0; y < state[8]; y++)
+			if (fread(VIPS_REGION_ADDR(p->strip, valid.left, valid.top + y),
+					VIPS_REGION_SIZEOF_LINE(p->strip), 1, fp) != 1) {
+				vips_error("dzsave",
+					_("bad checkpoint \"%s\""), dz->checkpoint_filename);
+				return -1;
+			}
+	}
+
+	/* We only checkpoint between strips, so there must be some of the
+	 * image left to do.
+	 */
+	if (dz->level->write_y >= dz->level->height) {
+		vips_error("dzsave",
+			_("bad checkpoint \"%s\""), dz->checkpoint_filename);
+		return -1;
+	}
+
+	g_atomic_int_set(&dz->tile_count, saved[CHECKPOINT_HEADER - 1]);
+
+	return 0;
+}
+
+/* Restore the pyramid state from any checkpoint.
+ */
+static int
+checkpoint_load(VipsForeignSaveDz *dz)
+{
+	FILE *fp;
+	int result;
+
+	if (!g_file_test(dz->checkpoint_filename, G_FILE_TEST_EXISTS))
+		return 0;
+
+#ifdef DEBUG
+	printf("checkpoint_load: resuming from \"%s\"\n",
+		dz->checkpoint_filename);
+#endif /*DEBUG*/
+
+	if (!(fp = vips__file_open_read(dz->checkpoint_filename, NULL, FALSE)))
+		return -1;
+	result = checkpoint_read(dz, fp);
+	fclose(fp);
+
+	return result;
+}
+
 /* Another strip of image pixels from vips_sink_disc(). Write into the top
  * pyramid level.
  */
@@ -1990,6 +2570,17 @@ pyramid_strip(VipsRegion *region, VipsRect *area, void *a)
 			level->write_y == level->height) {
 			if (strip_arrived(level))
 				return -1;
+
+			/* Every level is complete up to here, so this is a good
+			 * moment to save the pyramid state.
+			 */
+			if (dz->checkpoint > 0 &&
+				level->write_y < level->height &&
+				++dz->checkpoint_strips >= dz->checkpoint) {
+				if (checkpoint_save(dz))
+					return -1;
+				dz->checkpoint_strips = 0;
+			}
 		}
 	}
 
@@ -2028,14 +2619,97 @@ vips_foreign_save_dz_build(VipsObject *object)
 	VipsForeignSave *save = (VipsForeignSave *) object;
 	VipsForeignSaveDz *dz = (VipsForeignSaveDz *) object;
 	VipsObjectClass *class = VIPS_OBJECT_GET_CLASS(dz);
+	VipsImage **t = (VipsImage **) vips_object_local_array(object, 2);
 
 	VipsRect save_area;
+	VipsImage *in;
+	int margin;
 	char *p;
 
+	margin = 0;
+
 	// direct mode won't work if the suffix has been set
 	if (!vips_object_argument_isset(object, "suffix"))
 		dz->direct = TRUE;
 
+	if (dz->update) {
+		int n;
+		int *update = vips_array_int_get(dz->update, &n);
+
+		if (n != 4 ||
+			update[0] < 0 ||
+			update[1] < 0 ||
+			update[2] <= 0 ||
+			update[3] <= 0) {
+			vips_error(class->nickname,
+				"%s", _("update must be left, top, width, height"));
+			return -1;
+		}
+
+		if (iszip(dz->container)) {
+			vips_error(class->nickname,
+				"%s", _("update needs filesystem output"));
+			return -1;
+		}
+
+		if (dz->angle != VIPS_ANGLE_D0) {
+			vips_error(class->nickname,
+				"%s", _("can't update a rotated pyramid"));
+			return -1;
+		}
+	}
+
+	if (dz->band ||
+		dz->merge) {
+		if ((dz->band && dz->merge) ||
+			dz->update) {
+			vips_error(class->nickname,
+				"%s", _("only one of band, merge and update can be set"));
+			return -1;
+		}
+
+		if (iszip(dz->container)) {
+			vips_error(class->nickname,
+				"%s", _("band and merge need filesystem output"));
+			return -1;
+		}
+
+		if (dz->angle != VIPS_ANGLE_D0) {
+			vips_error(class->nickname,
+				"%s", _("can't write a rotated pyramid in parts"));
+			return -1;
+		}
+	}
+
+	if (dz->checkpoint) {
+		if (dz->update ||
+			dz->band) {
+			vips_error(class->nickname,
+				"%s", _("can't checkpoint an update or a band"));
+			return -1;
+		}
+
+		if (iszip(dz->container)) {
+			vips_error(class->nickname,
+				"%s", _("checkpoint needs filesystem output"));
+			return -1;
+		}
+	}
+
+	if (dz->band) {
+		int n;
+		int *band = vips_array_int_get(dz->band, &n);
+
+		if (n != 2 ||
+			band[0] < 0 ||
+			band[1] <= 0 ||
+			band[0] + band[1] > save->ready->Ysize) {
+			vips_error(class->nickname,
+				"%s", _("band must be top, height within the image"));
+			return -1;
+		}
+	}
+
 	/* We default to stripping all metadata as most people
 	 * don't want metadata on every tile. Setting "keep"
 	 * or the deprecated "no_strip" turns this off.
@@ -2316,6 +2990,66 @@ vips_foreign_save_dz_build(VipsObject *object)
 			  save->ready->Xsize, save->ready->Ysize, &save_area)))
 		return -1;
 
+	/* Each output pixel depends on a sub x sub block of input pixels, so
+	 * project the update area down the pyramid.
+	 */
+	if (dz->update) {
+		int n;
+		int *update = vips_array_int_get(dz->update, &n);
+		VipsRect dirty;
+		Level *p;
+
+		dirty.left = save_area.left + update[0];
+		dirty.top = save_area.top + update[1];
+		dirty.width = update[2];
+		dirty.height = update[3];
+
+		for (p = dz->level; p; p = p->below) {
+			int left = dirty.left / p->sub;
+			int top = dirty.top / p->sub;
+			int right = VIPS_ROUND_UP(VIPS_RECT_RIGHT(&dirty), p->sub) /
+				p->sub;
+			int bottom = VIPS_ROUND_UP(VIPS_RECT_BOTTOM(&dirty), p->sub) /
+				p->sub;
+
+			p->dirty.left = left;
+			p->dirty.top = top;
+			p->dirty.width = right - left;
+			p->dirty.height = bottom - top;
+		}
+	}
+
+	/* Project the band down the pyramid. Unlike update, we round inwards,
+	 * since we can only make pixels whose whole sub x sub block is in the
+	 * band. The bottom band takes any odd pixels at the image edge.
+	 */
+	if (dz->band) {
+		int n;
+		int *band = vips_array_int_get(dz->band, &n);
+		int top = band[0] == 0 ? 0 : save_area.top + band[0];
+		int bottom = save_area.top + band[0] + band[1];
+		gboolean at_bottom = band[0] + band[1] == save_area.height;
+		Level *p;
+
+		for (p = dz->level; p; p = p->below) {
+			int first;
+
+			p->dirty.left = 0;
+			p->dirty.top = VIPS_ROUND_UP(top, p->sub) / p->sub;
+			p->dirty.width = p->width;
+			p->dirty.height = (at_bottom ? p->height : bottom / p->sub) -
+				p->dirty.top;
+
+			/* If the band holds the core of at least one row of
+			 * tiles, we'll need the overlap around it.
+			 */
+			first = VIPS_ROUND_UP(p->dirty.top, dz->tile_step);
+			if (VIPS_MIN(first + dz->tile_step, p->height) <=
+				VIPS_RECT_BOTTOM(&p->dirty))
+				margin = VIPS_MAX(margin, (dz->tile_margin + 1) * p->sub);
+		}
+	}
+
 	if (dz->layout == VIPS_FOREIGN_DZ_LAYOUT_DZ)
 		dz->root_name = g_strdup_printf("%s_files", dz->imagename);
 	else
@@ -2353,9 +3087,73 @@ vips_foreign_save_dz_build(VipsObject *object)
 			return -1;
 	}
 
-	if (vips_sink_disc(save->ready, pyramid_strip, dz))
+	if (dz->dedupe)
+		dz->dedupe_table = g_hash_table_new_full(g_str_hash, g_str_equal,
+			g_free, (GDestroyNotify) tile_dedupe_free);
+
+	/* Pick up where an earlier save stopped, if we can.
+	 */
+	if (dz->checkpoint) {
+		char *name = g_strdup_printf("%s.checkpoint", dz->imagename);
+
+		dz->checkpoint_filename = g_build_filename(dz->dirname, name, NULL);
+		g_free(name);
+
+		if (checkpoint_load(dz))
+			return -1;
+	}
+
+	/* For a band, only compute the rows we need and leave the rest of
+	 * the image black.
+	 */
+	in = save->ready;
+	if (dz->band) {
+		VipsRect image;
+		VipsRect rows;
+
+		image.left = 0;
+		image.top = 0;
+		image.width = in->Xsize;
+		image.height = in->Ysize;
+		rows.left = 0;
+		rows.top = dz->level->dirty.top - margin;
+		rows.width = in->Xsize;
+		rows.height = dz->level->dirty.height + 2 * margin;
+		vips_rect_intersectrect(&rows, &image, &rows);
+
+		if (vips_extract_area(save->ready, &t[0],
+				rows.left, rows.top, rows.width, rows.height, NULL) ||
+			vips_embed(t[0], &t[1],
+				rows.left, rows.top, in->Xsize, in->Ysize, NULL))
+			return -1;
+		in = t[1];
+	}
+	else if (dz->level->write_y > 0) {
+		/* Resuming from a checkpoint ... only compute the rows we
+		 * have not made yet.
+		 */
+		int top = dz->level->write_y;
+
+		if (vips_extract_area(save->ready, &t[0],
+				0, top, in->Xsize, in->Ysize - top, NULL) ||
+			vips_embed(t[0], &t[1],
+				0, top, in->Xsize, in->Ysize, NULL))
+			return -1;
+		in = t[1];
+	}
+
+	if (vips_sink_disc(in, pyramid_strip, dz))
 		return -1;
 
+	/* An update or a band only writes tiles, the pyramid must otherwise
+	 * be unchanged.
+	 */
+	if (dz->update ||
+		dz->band) {
+		VIPS_FREEF(vips__archive_free, dz->archive);
+		return 0;
+	}
+
 	switch (dz->layout) {
 	case VIPS_FOREIGN_DZ_LAYOUT_DZ:
 		if (write_dzi(dz))
@@ -2397,6 +3195,11 @@ vips_foreign_save_dz_build(VipsObject *object)
 	 */
 	VIPS_FREEF(vips__archive_free, dz->archive);
 
+	/* The pyramid is complete, so we won't need to resume.
+	 */
+	if (dz->checkpoint_filename)
+		(void) g_unlink(dz->checkpoint_filename);
+
 	return 0;
 }
 
@@ -2429,6 +3232,7 @@ vips_foreign_save_dz_class_init(VipsForeignSaveDzClass *class)
 	VipsForeignSaveClass *save_class = (VipsForeignSaveClass *) class;
 
 	gobject_class->dispose = vips_foreign_save_dz_dispose;
+	gobject_class->finalize = vips_foreign_save_dz_finalize;
 	gobject_class->set_property = vips_object_set_property;
 	gobject_class->get_property = vips_object_get_property;
 
@@ -2540,6 +3344,41 @@ vips_foreign_save_dz_class_init(VipsForeignSaveDzClass *class)
 		G_STRUCT_OFFSET(VipsForeignSaveDz, Q),
 		1, 100, 75);
 
+	VIPS_ARG_BOOL(class, "dedupe", 24,
+		_("Dedupe"),
+		_("Write identical tiles only once"),
+		VIPS_ARGUMENT_OPTIONAL_INPUT,
+		G_STRUCT_OFFSET(VipsForeignSaveDz, dedupe),
+		FALSE);
+
+	VIPS_ARG_BOXED(class, "update", 25,
+		_("Update"),
+		_("Only rewrite tiles overlapping this left, top, width, height"),
+		VIPS_ARGUMENT_OPTIONAL_INPUT,
+		G_STRUCT_OFFSET(VipsForeignSaveDz, update),
+		VIPS_TYPE_ARRAY_INT);
+
+	VIPS_ARG_BOXED(class, "band", 26,
+		_("Band"),
+		_("Only write tiles within this top, height band of rows"),
+		VIPS_ARGUMENT_OPTIONAL_INPUT,
+		G_STRUCT_OFFSET(VipsForeignSaveDz, band),
+		VIPS_TYPE_ARRAY_INT);
+
+	VIPS_ARG_BOOL(class, "merge", 27,
+		_("Merge"),
+		_("Only write tiles which are missing, then the metadata"),
+		VIPS_ARGUMENT_OPTIONAL_INPUT,
+		G_STRUCT_OFFSET(VipsForeignSaveDz, merge),
+		FALSE);
+
+	VIPS_ARG_INT(class, "checkpoint", 28,
+		_("Checkpoint"),
+		_("Save state to resume from every this many rows of tiles"),
+		VIPS_ARGUMENT_OPTIONAL_INPUT,
+		G_STRUCT_OFFSET(VipsForeignSaveDz, checkpoint),
+		0, 1000000, 0);
+
 	/* How annoying. We stupidly had these in earlier versions.
 	 */
 
@@ -2601,6 +3440,7 @@ vips_foreign_save_dz_init(VipsForeignSaveDz *dz)
 	dz->region_shrink = VIPS_REGION_SHRINK_MEAN;
 	dz->skip_blanks = -1;
 	dz->Q = 75;
+	g_mutex_init(&dz->dedupe_lock);
 
 	// we default background to 255 (not 0), see vips_foreign_save_init()
 	VipsForeignSave *save = (VipsForeignSave *) dz;
@@ -2842,6 +3682,38 @@ vips_foreign_save_dz_buffer_init(VipsForeignSaveDzBuffer *buffer)
  * This can save a lot of space for some image types. This option defaults to
  * 5 in Google layout mode, -1 otherwise.
  *
+ * Set @dedupe to write tiles with identical pixels only once, for example
+ * large areas of sea or glass. Tiles are matched by a hash of their pixels.
+ * On the filesystem, repeated tiles are hard links to the first copy. In
+ * zip containers, the encoded bytes of repeated tiles are written again, but
+ * not re-encoded.
+ *
+ * Set @update to a left, top, width, height rectangle to update a pyramid
+ * you have already written to the filesystem after part of the image has
+ * changed. Only tiles which overlap the rectangle at each level are encoded
+ * and written, and the metadata files are left alone. The pyramid must have
+ * been made with the same image size and options.
+ *
+ * Use @band and @merge to make a large pyramid on several machines. Split the
+ * image into bands of rows, and on each machine, save with @band set to a
+ * top, height pair. Only tiles whose pixels, not counting the overlap, lie
+ * entirely within the band are written, and only the rows the band needs
+ * are computed. Bands which are a multiple of @tile_size high and start on a
+ * multiple of @tile_size will share the most work. Copy the outputs into one
+ * directory, then save again with @merge set. This computes the whole image
+ * again, but only encodes and writes the tiles the bands could not make,
+ * which are mostly in the smaller levels, then writes the metadata files.
+ * Each save must use the same image and options.
+ *
+ * Set @checkpoint to make long saves to the filesystem resumable. Every
+ * @checkpoint rows of tiles, the state of the pyramid is written to
+ * `imagename.checkpoint` next to the output. This holds the partly filled
+ * strip of every level, so it can be large for very wide images. If
+ * a save with @checkpoint set finds a checkpoint file, it skips the rows
+ * of the image the earlier save completed and carries on from there. The
+ * checkpoint is removed when the save finishes. The resumed save must use
+ * the same image, options and machine.
+ *
  * In IIIF layout, you can set the base of the `id` property in `info.json`
  * with @id. The default is `https://example.com/iiif`.
  *
@@ -2864,6 +3736,12 @@ vips_foreign_save_dz_buffer_init(VipsForeignSaveDzBuffer *buffer)
  *       background
  *     * @id: `gchararray`, id for IIIF properties
  *     * @Q: `gint`, quality factor
+ *     * @dedupe: `gboolean`, write identical tiles only once
+ *     * @update: [struct@ArrayInt], only rewrite tiles overlapping this area
+ *     * @band: [struct@ArrayInt], only write tiles within this band of rows
+ *     * @merge: `gboolean`, only write missing tiles, then the metadata
+ *     * @checkpoint: `gint`, save state to resume from every this many rows
+ *       of tiles
  *
  * ::: seealso
  *     [method@Image.tiffsave].
@@ -2916,6 +3794,12 @@ vips_dzsave(VipsImage *in, const char *name, ...)
  *       background
  *     * @id: `gchararray`, id for IIIF properties
  *     * @Q: `gint`, quality factor
+ *     * @dedupe: `gboolean`, write identical tiles only once
+ *     * @update: [struct@ArrayInt], only rewrite tiles overlapping this area
+ *     * @band: [struct@ArrayInt], only write tiles within this band of rows
+ *     * @merge: `gboolean`, only write missing tiles, then the metadata
+ *     * @checkpoint: `gint`, save state to resume from every this many rows
+ *       of tiles
  *
  * ::: seealso
  *     [method@Image.dzsave], [method@Image.write_to_file].
@@ -2975,6 +3859,12 @@ vips_dzsave_buffer(VipsImage *in, void **buf, size_t *len, ...)
  *       background
  *     * @id: `gchararray`, id for IIIF properties
  *     * @Q: `gint`, quality factor
+ *     * @dedupe: `gboolean`, write identical tiles only once
+ *     * @update: [struct@ArrayInt], only rewrite tiles overlapping this area
+ *     * @band: [struct@ArrayInt], only write tiles within this band of rows
+ *     * @merge: `gboolean`, only write missing tiles, then the metadata
+ *     * @checkpoint: `gint`, save state to resume from every this many rows
+ *       of tiles
  *
  * ::: seealso
  *     [method@Image.dzsave], [method@Image.write_to_target].
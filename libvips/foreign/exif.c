@@ -13,6 +13,9 @@
  * 	- get tag name from tag plus ifd
  * 13/11/21
  * 	- better handling of strings with embedded metacharacters
+ * 15/10/26
+ * 	- only read resolution and orientation on load, expand the other tags
+ * 	  on first use
  */
 
 /*
@@ -557,8 +560,12 @@ vips_image_resolution_from_exif(VipsImage *image, ExifData *ed)
 static void
 vips_exif_resolution_from_image(ExifData *ed, VipsImage *image);
 
-/* Scan the exif block on the image, if any, and make a set of vips metadata
- * tags for what we find.
+/* Scan the exif block on the image, if any, and set resolution and
+ * orientation.
+ *
+ * Expanding every tag into a string field is slow and most callers only want
+ * pixels, so we just mark the tags as pending. vips__exif_expand() makes them
+ * the first time anyone asks for an exif- field.
  */
 int
 vips__exif_parse(VipsImage *image)
@@ -566,8 +573,7 @@ vips__exif_parse(VipsImage *image)
 	const void *data;
 	size_t size;
 	ExifData *ed;
-	VipsExifParams params;
-	const char *str;
+	int orientation;
 
 	if (!vips_image_get_typeof(image, VIPS_META_EXIF_NAME))
 		return 0;
@@ -583,11 +589,57 @@ vips__exif_parse(VipsImage *image)
 
 	/* Look for resolution fields and use them to set the VIPS xres/yres
 	 * fields.
-	 *
-	 * If the fields are missing, set them from the image, which will have
-	 * previously had them set from something like JFIF.
 	 */
-	if (vips_image_resolution_from_exif(image, ed))
+	(void) vips_image_resolution_from_exif(image, ed);
+
+	/* Orientation handling. ifd0 has the Orientation tag for the main
+	 * image.
+	 */
+	if (!vips_exif_entry_get_int(ed, 0, EXIF_TAG_ORIENTATION, &orientation)) {
+		if (orientation < 1 ||
+			orientation > 8)
+			orientation = 1;
+		vips_image_set_int(image, VIPS_META_ORIENTATION, orientation);
+	}
+
+	exif_data_free(ed);
+
+	vips__meta_set_exif_pending(image, TRUE);
+
+	return 0;
+}
+
+/* Make a set of vips metadata tags for everything in the exif block, if
+ * vips__exif_parse() has left them pending.
+ */
+int
+vips__exif_expand(VipsImage *image)
+{
+	const void *data;
+	size_t size;
+	ExifData *ed;
+	VipsExifParams params;
+	double xres;
+	double yres;
+
+	if (!vips__meta_get_exif_pending(image))
+		return 0;
+
+	if (!vips_image_get_typeof(image, VIPS_META_EXIF_NAME)) {
+		vips__meta_set_exif_pending(image, FALSE);
+		return 0;
+	}
+	if (vips_image_get_blob(image, VIPS_META_EXIF_NAME, &data, &size) ||
+		!(ed = vips_exif_load_data_without_fix(data, size))) {
+		vips__meta_set_exif_pending(image, FALSE);
+		return -1;
+	}
+
+	/* If the resolution fields are missing, set them from the image,
+	 * which will have previously had them set from something like JFIF.
+	 */
+	if (vips_exif_entry_get_double(ed, 0, EXIF_TAG_X_RESOLUTION, &xres) ||
+		vips_exif_entry_get_double(ed, 0, EXIF_TAG_Y_RESOLUTION, &yres))
 		vips_exif_resolution_from_image(ed, image);
 
 	/* Make sure all required fields are there before we attach the vips
@@ -607,20 +659,10 @@ vips__exif_parse(VipsImage *image)
 
 	exif_data_free(ed);
 
-	/* Orientation handling. ifd0 has the Orientation tag for the main
-	 * image.
+	/* Clear this last, so other threads don't see a half-expanded set
+	 * of tags. meta_exif_expand() stops the sets above recursing back here.
 	 */
-	if (vips_image_get_typeof(image, "exif-ifd0-Orientation") != 0 &&
-		!vips_image_get_string(image,
-			"exif-ifd0-Orientation", &str)) {
-		int orientation;
-
-		orientation = atoi(str);
-		if (orientation < 1 ||
-			orientation > 8)
-			orientation = 1;
-		vips_image_set_int(image, VIPS_META_ORIENTATION, orientation);
-	}
+	vips__meta_set_exif_pending(image, FALSE);
 
 	return 0;
 }
@@ -1470,6 +1512,12 @@ vips__exif_update(VipsImage *image)
 	unsigned int idl;
 	ExifData *ed;
 
+	/* Tags the user has not changed must be there, or we'll remove them
+	 * from the block.
+	 */
+	if (vips__exif_expand(image))
+		return -1;
+
 	/* Either parse from the embedded EXIF, or if there's none, make
 	 * some fresh EXIF we can write the resolution to.
 	 */
@@ -1551,6 +1599,12 @@ vips__exif_parse(VipsImage *image)
 	return 0;
 }
 
+int
+vips__exif_expand(VipsImage *image)
+{
+	return 0;
+}
+
 int
 vips__exif_update(VipsImage *image)
 {
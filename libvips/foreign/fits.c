@@ -40,6 +40,8 @@
  *	- save mono images as NAXIS=2
  * 18/1/23 ewelot
  *	- dedupe header fields
+ * 15/10/26
+ * 	- map uncompressed, unscaled images directly
  */
 
 /*
@@ -506,15 +508,134 @@ vips_fits_generate(VipsRegion *out,
 	return 0;
 }
 
+/* Can we map the pixels in this HDU directly? The file must not be
+ * compressed and cfitsio must not be scaling pixel values. Set @data_start to
+ * the offset of the first pixel.
+ */
+static gboolean
+vips_fits_can_map(VipsFits *fits, guint64 *data_start)
+{
+	VipsImage *image = fits->image;
+
+	unsigned char magic[6];
+	int status;
+	int bitpix;
+	int equivtype;
+	double bscale;
+	double bzero;
+	LONGLONG head_start;
+	LONGLONG data_start_ll;
+	LONGLONG data_end;
+
+	/* cfitsio will unpack gzipped files to memory, so check the file on
+	 * disc is plain FITS.
+	 */
+	if (vips__get_bytes(fits->filename, magic, 6) != 6 ||
+		memcmp(magic, "SIMPLE", 6) != 0)
+		return FALSE;
+
+	/* We map all planes as a single tall image.
+	 */
+	if ((guint64) image->Ysize * image->Bands > INT_MAX)
+		return FALSE;
+
+	status = 0;
+	if (fits_is_compressed_image(fits->fptr, &status) ||
+		fits_get_img_type(fits->fptr, &bitpix, &status) ||
+		fits_get_img_equivtype(fits->fptr, &equivtype, &status) ||
+		bitpix != equivtype)
+		return FALSE;
+
+	/* These are optional.
+	 */
+	if (fits_read_key(fits->fptr, TDOUBLE, "BSCALE", &bscale, NULL, &status))
+		bscale = 1.0;
+	status = 0;
+	if (fits_read_key(fits->fptr, TDOUBLE, "BZERO", &bzero, NULL, &status))
+		bzero = 0.0;
+	status = 0;
+	if (bscale != 1.0 ||
+		bzero != 0.0)
+		return FALSE;
+
+	if (fits_get_hduaddrll(fits->fptr,
+			&head_start, &data_start_ll, &data_end, &status))
+		return FALSE;
+	*data_start = data_start_ll;
+
+	return TRUE;
+}
+
+/* Map the data section of the file, then byteswap (FITS is always
+ * big-endian) and join the planes up lazily.
+ */
+static int
+vips_fits_read_mapped(VipsFits *fits, guint64 data_start, VipsImage *out)
+{
+	int width = out->Xsize;
+	int height = out->Ysize;
+	int bands = out->Bands;
+	VipsImage **t = (VipsImage **)
+		vips_object_local_array(VIPS_OBJECT(out), 4);
+	VipsImage **planes = (VipsImage **)
+		vips_object_local_array(VIPS_OBJECT(out), bands);
+
+	if (!(t[0] = vips_image_new_from_file_raw(fits->filename,
+			  width, height * bands,
+			  VIPS_IMAGE_SIZEOF_ELEMENT(out), data_start)) ||
+		vips_copy(t[0], &t[1],
+			"bands", 1,
+			"format", out->BandFmt,
+			"interpretation", out->Type,
+			NULL) ||
+		vips__byteswap_bool(t[1], &t[2], !vips_amiMSBfirst()))
+		return -1;
+
+	for (int i = 0; i < bands; i++)
+		if (vips_extract_area(t[2], &planes[i],
+				0, i * height, width, height, NULL))
+			return -1;
+
+	if (vips_bandjoin(planes, &t[3], bands, NULL) ||
+		vips_image_write(t[3], out))
+		return -1;
+
+	return 0;
+}
+
 int
 vips__fits_read(const char *filename, VipsImage *out)
 {
 	VipsFits *fits;
+	guint64 data_start;
 
 	if (!(fits = vips_fits_new_read(filename, out)))
 		return -1;
-	if (vips_fits_get_header(fits, out) ||
-		vips_image_generate(out,
+	if (vips_fits_get_header(fits, out)) {
+		vips_fits_close(fits);
+		return -1;
+	}
+
+	/* Uncompressed and unscaled images can be mapped directly, so huge
+	 * files open instantly and page in as they are read.
+	 */
+	if (vips_fits_can_map(fits, &data_start)) {
+		VIPS_DEBUG_MSG("vips__fits_read: mapping from %" G_GUINT64_FORMAT
+			"\n", data_start);
+
+		if (vips_fits_read_mapped(fits, data_start, out)) {
+			vips_fits_close(fits);
+			return -1;
+		}
+
+		/* We don't need cfitsio any more.
+		 */
+		vips_fits_close(fits);
+
+		return 0;
+	}
+
+	if (vips_image_generate(out,
 			NULL, vips_fits_generate, NULL, fits, NULL)) {
 		vips_fits_close(fits);
 		return -1;
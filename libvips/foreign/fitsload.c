@@ -355,6 +355,9 @@ vips_foreign_load_fits_source_init(VipsForeignLoadFitsSource *fits)
  * It can read 8, 16 and 32-bit integer images, signed and unsigned, float and
  * double.
  *
+ * Uncompressed images with no BSCALE or BZERO scaling are mapped directly
+ * from the file, so even very large images open quickly.
+ *
  * FITS metadata is attached with the "fits-" prefix.
  *
  * ::: seealso
@@ -26,6 +26,16 @@
  * 	- drop incompatible ICC profiles before save
  * 24/7/21
  * 	- add fail_on
+ * 14/10/26
+ * 	- add VIPS_FOREIGN_ZERO_COPY
+ * 15/10/26
+ * 	- only open modules when builtin formats can't handle a file
+ * 	- skip is_a checks for loaders whose signatures don't match
+ * 	- add vips_foreign_probe()
+ * 	- share decoded images between processes, see vips_cache_set_shared()
+ * 	- add vips__foreign_load_crop()
+ * 	- add vips__image_shrink_on_load()
+ * 	- add vips__sequential_plan()
  */
 
 /*
@@ -66,6 +76,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <vips/vips.h>
 #include <vips/internal.h>
@@ -348,12 +359,28 @@
  */
 static GQuark vips__foreign_load_operation = 0;
 
+/* And this links the output of a load back to the load, so we can push
+ * crops down into the loader, see vips__foreign_load_crop(). It's cleared
+ * when the load is disposed.
+ */
+static GQuark vips__foreign_load_out = 0;
+
+/* Set on images which can be computed top-to-bottom from a sequential
+ * source, see vips__sequential_plan().
+ */
+static GQuark vips__foreign_sequential_ok = 0;
+
+/* Set from VIPS_NOAUTOSEQ to turn access planning off.
+ */
+static gboolean vips__foreign_noautoseq = FALSE;
+
 /**
  * VipsForeignFlags:
  * @VIPS_FOREIGN_NONE: no flags set
  * @VIPS_FOREIGN_PARTIAL: the image may be read lazilly
  * @VIPS_FOREIGN_BIGENDIAN: image pixels are most-significant byte first
  * @VIPS_FOREIGN_SEQUENTIAL: top-to-bottom lazy reading
+ * @VIPS_FOREIGN_ZERO_COPY: the loader never copies the whole input
  *
  * Some hints about the image loader.
  *
@@ -370,6 +397,12 @@ static GQuark vips__foreign_load_operation = 0;
  * [flags@Vips.ForeignFlags.BIGENDIAN] means that image pixels are
  * most-significant byte first. Depending on the native byte order of the
  * host machine, you may need to swap bytes. See [method@Image.copy].
+ *
+ * [flags@Vips.ForeignFlags.ZERO_COPY] means that the loader never makes a
+ * copy of the whole input. Memory sources, see
+ * [ctor@Source.new_from_memory], are decoded in place, files are mapped or
+ * streamed, and pipes are read to memory at most once, so peak memory use
+ * never includes a second copy of the file.
  */
 
 G_DEFINE_ABSTRACT_TYPE(VipsForeign, vips_foreign, VIPS_TYPE_OPERATION);
@@ -454,6 +487,36 @@ file_compare(VipsForeignClass *a, VipsForeignClass *b, void *user_data)
 	return b->priority - a->priority;
 }
 
+static void *
+vips_foreign_map_sub(const char *base, VipsSListMap2Fn fn, void *a, void *b)
+{
+	GSList *files;
+	void *result;
+
+	files = NULL;
+	(void) vips__class_map_all(g_type_from_name(base),
+		(VipsClassMapFn) file_add_class, (void *) &files);
+
+	files = g_slist_sort(files, (GCompareFunc) file_compare);
+#ifdef DEBUG
+	{
+		GSList *p;
+
+		printf("vips_foreign_map: search order\n");
+		for (p = files; p; p = p->next) {
+			VipsForeignClass *class = (VipsForeignClass *) p->data;
+
+			printf("\t%s\n", VIPS_OBJECT_CLASS(class)->nickname);
+		}
+	}
+#endif /*DEBUG*/
+	result = vips_slist_map2(files, fn, a, b);
+
+	g_slist_free(files);
+
+	return result;
+}
+
 /**
  * vips_foreign_map:
  * @base: base class to search below (eg. "VipsForeignLoad")
@@ -476,29 +539,29 @@ file_compare(VipsForeignClass *a, VipsForeignClass *b, void *user_data)
 void *
 vips_foreign_map(const char *base, VipsSListMap2Fn fn, void *a, void *b)
 {
-	GSList *files;
-	void *result;
-
-	files = NULL;
-	(void) vips_class_map_all(g_type_from_name(base),
-		(VipsClassMapFn) file_add_class, (void *) &files);
-
-	files = g_slist_sort(files, (GCompareFunc) file_compare);
-#ifdef DEBUG
-	{
-		GSList *p;
+	/* Make sure we see every format.
+	 */
+	vips__module_load_all();
 
-		printf("vips_foreign_map: search order\n");
-		for (p = files; p; p = p->next) {
-			VipsForeignClass *class = (VipsForeignClass *) p->data;
+	return vips_foreign_map_sub(base, fn, a, b);
+}
 
-			printf("\t%s\n", VIPS_OBJECT_CLASS(class)->nickname);
-		}
-	}
-#endif /*DEBUG*/
-	result = vips_slist_map2(files, fn, a, b);
+/* Search the formats we have, and only open modules if that fails.
+ *
+ * Loaders and savers in modules either handle files no builtin format
+ * handles, or are lower priority, so this finds the same class as searching
+ * everything. The exception is openslide, which is higher priority than
+ * tiffload, so vips_foreign_find_load() opens modules by filename suffix
+ * first.
+ */
+static void *
+vips_foreign_map_lazy(const char *base, VipsSListMap2Fn fn, void *a, void *b)
+{
+	void *result;
 
-	g_slist_free(files);
+	if (!(result = vips_foreign_map_sub(base, fn, a, b)) &&
+		vips__module_load_all())
+		result = vips_foreign_map_sub(base, fn, a, b);
 
 	return result;
 }
@@ -513,6 +576,8 @@ vips_foreign_load_dispose(GObject *gobject)
 {
 	VipsForeignLoad *load = VIPS_FOREIGN_LOAD(gobject);
 
+	if (load->out)
+		g_object_set_qdata(G_OBJECT(load->out), vips__foreign_load_out, NULL);
 	VIPS_UNREF(load->real);
 
 	G_OBJECT_CLASS(vips_foreign_load_parent_class)->dispose(gobject);
@@ -548,11 +613,38 @@ vips_foreign_load_summary_class(VipsObjectClass *object_class, VipsBuf *buf)
 	}
 }
 
+/* The first few bytes of a file, for checking signatures.
+ */
+typedef struct _VipsForeignSniff {
+	unsigned char data[VIPS_FOREIGN_MAGIC_SIZE];
+	size_t length;
+} VipsForeignSniff;
+
+/* Could these bytes be in the format @load_class loads? We can only rule a
+ * format out if it has signatures.
+ */
+static gboolean
+vips_foreign_magic_match(VipsForeignLoadClass *load_class,
+	const unsigned char *data, size_t length)
+{
+	const VipsForeignMagic *magic;
+
+	if (!load_class->magic)
+		return TRUE;
+
+	for (magic = load_class->magic; magic->bytes; magic++)
+		if ((size_t) (magic->offset + magic->length) <= length &&
+			memcmp(data + magic->offset, magic->bytes, magic->length) == 0)
+			return TRUE;
+
+	return FALSE;
+}
+
 /* Can this VipsForeign open this file?
  */
 static void *
 vips_foreign_find_load_sub(VipsForeignLoadClass *load_class,
-	const char *filename, void *b)
+	const char *filename, VipsForeignSniff *sniff)
 {
 	VipsObjectClass *object_class = VIPS_OBJECT_CLASS(load_class);
 	VipsForeignClass *class = VIPS_FOREIGN_CLASS(load_class);
@@ -572,6 +664,14 @@ vips_foreign_find_load_sub(VipsForeignLoadClass *load_class,
 	 * otherwise fall back to checking the filename suffix.
 	 */
 	if (load_class->is_a) {
+		/* Skip the is_a(), and the file open it does, if no
+		 * signature matches.
+		 */
+		if (sniff &&
+			!vips_foreign_magic_match(load_class,
+				sniff->data, sniff->length))
+			return NULL;
+
 		if (load_class->is_a(filename))
 			return load_class;
 
@@ -607,6 +707,8 @@ vips_foreign_find_load(const char *name)
 {
 	char filename[VIPS_PATH_MAX];
 	char option_string[VIPS_PATH_MAX];
+	VipsForeignSniff sniff;
+	gint64 length;
 	VipsForeignLoadClass *load_class;
 
 	vips__filename_split8(name, filename, option_string);
@@ -624,10 +726,21 @@ vips_foreign_find_load(const char *name)
 		return NULL;
 	}
 
-	if (!(load_class = (VipsForeignLoadClass *) vips_foreign_map(
+	/* Open any modules which could load this file, see
+	 * vips_foreign_map_lazy().
+	 */
+	vips__module_load_filename(filename);
+
+	/* Read the start of the file once for all the signature checks. If
+	 * we can't, let every loader try.
+	 */
+	length = vips__get_bytes(filename, sniff.data, VIPS_FOREIGN_MAGIC_SIZE);
+	sniff.length = VIPS_MAX(0, length);
+
+	if (!(load_class = (VipsForeignLoadClass *) vips_foreign_map_lazy(
 			  "VipsForeignLoad",
 			  (VipsSListMap2Fn) vips_foreign_find_load_sub,
-			  (void *) filename, NULL))) {
+			  (void *) filename, length > 0 ? &sniff : NULL))) {
 		vips_error("VipsForeignLoad",
 			_("\"%s\" is not a known file format"), name);
 		return NULL;
@@ -666,6 +779,667 @@ vips_foreign_load(const char *name, VipsImage **out, ...)
 	return result;
 }
 
+typedef struct _VipsForeignProbeRun {
+	const char **filenames;
+	VipsForeignProbe *probe;
+	int n;
+
+	GMutex lock;
+	GCond cond;
+	int next;
+	int n_running;
+} VipsForeignProbeRun;
+
+static void
+vips_foreign_probe_one(const char *filename, VipsForeignProbe *probe)
+{
+	VipsImage *image;
+	const char *loader;
+
+	memset(probe, 0, sizeof(VipsForeignProbe));
+
+	/* new_from_file only runs the loader's header() method, no pixels
+	 * are decoded and no pipeline is built.
+	 */
+	if (!(image = vips_image_new_from_file(filename, NULL))) {
+		probe->result = -1;
+		return;
+	}
+
+	if (vips_image_get_typeof(image, VIPS_META_LOADER) &&
+		!vips_image_get_string(image, VIPS_META_LOADER, &loader))
+		probe->loader = g_intern_string(loader);
+	probe->width = image->Xsize;
+	probe->height = image->Ysize;
+	probe->bands = image->Bands;
+	probe->format = image->BandFmt;
+	probe->n_pages = vips_image_get_n_pages(image);
+	probe->orientation = vips_image_get_orientation(image);
+
+	g_object_unref(image);
+}
+
+static void
+vips_foreign_probe_work(void *a, void *b)
+{
+	VipsForeignProbeRun *run = (VipsForeignProbeRun *) a;
+
+	for (;;) {
+		int i;
+
+		g_mutex_lock(&run->lock);
+		i = run->next++;
+		g_mutex_unlock(&run->lock);
+
+		if (i >= run->n)
+			break;
+
+		vips_foreign_probe_one(run->filenames[i], &run->probe[i]);
+	}
+
+	/* run can be freed as soon as we unlock, so this must be the last
+	 * thing we do.
+	 */
+	g_mutex_lock(&run->lock);
+	run->n_running -= 1;
+	g_cond_broadcast(&run->cond);
+	g_mutex_unlock(&run->lock);
+}
+
+/**
+ * vips_foreign_probe:
+ * @filenames: (array length=n): files to probe
+ * @n: number of files
+ * @probe: (array length=n) (out caller-allocates): results
+ * @jobs: number of files to probe at once, or 0 for the default
+ *
+ * Read the header of each of @filenames and set the matching element of
+ * @probe to the image width, height, bands, format, number of pages and
+ * orientation. Only the loader's header method runs, so this is much
+ * cheaper than opening each image.
+ *
+ * Up to @jobs files are probed at the same time. If @jobs is zero or less,
+ * [func@concurrency_get] is used. The results are in the same order as
+ * @filenames.
+ *
+ * The @result field of each probe is 0 on success, or -1 if the header
+ * could not be read, with the reason in the error buffer.
+ *
+ * ::: seealso
+ *     [ctor@Image.new_from_file], [func@Foreign.find_load].
+ *
+ * Returns: 0 if every header was read, -1 otherwise
+ */
+int
+vips_foreign_probe(const char **filenames, int n,
+	VipsForeignProbe *probe, int jobs)
+{
+	VipsForeignProbeRun run;
+	int n_workers;
+	int result;
+
+	run.filenames = filenames;
+	run.probe = probe;
+	run.n = n;
+	g_mutex_init(&run.lock);
+	g_cond_init(&run.cond);
+	run.next = 0;
+	run.n_running = 0;
+
+	if (jobs <= 0)
+		jobs = vips_concurrency_get();
+	n_workers = VIPS_MIN(jobs, n);
+
+	vips__worker_lock(&run.lock);
+	for (int i = 0; i < n_workers; i++) {
+		run.n_running += 1;
+		if (vips_thread_execute("probe", vips_foreign_probe_work, &run))
+			run.n_running -= 1;
+	}
+
+	/* If we couldn't start any workers, do it ourselves.
+	 */
+	if (run.n_running == 0) {
+		run.n_running += 1;
+		g_mutex_unlock(&run.lock);
+		vips_foreign_probe_work(&run, NULL);
+		vips__worker_lock(&run.lock);
+	}
+
+	while (run.n_running > 0)
+		vips__worker_cond_wait(&run.cond, &run.lock);
+	g_mutex_unlock(&run.lock);
+
+	g_mutex_clear(&run.lock);
+	g_cond_clear(&run.cond);
+
+	result = 0;
+	for (int i = 0; i < n; i++)
+		if (probe[i].result)
+			result = -1;
+
+	return result;
+}
+
+static void *
+vips_foreign_load_copy_arg(VipsObject *object,
+	GParamSpec *pspec,
+	VipsArgumentClass *argument_class,
+	VipsArgumentInstance *argument_instance,
+	void *a, void *b)
+{
+	VipsObject *new_object = VIPS_OBJECT(a);
+
+	if ((argument_class->flags & VIPS_ARGUMENT_CONSTRUCT) &&
+		(argument_class->flags & VIPS_ARGUMENT_INPUT) &&
+		argument_instance->assigned) {
+		const char *name = g_param_spec_get_name(pspec);
+		GValue value = G_VALUE_INIT;
+
+		g_value_init(&value, G_PARAM_SPEC_VALUE_TYPE(pspec));
+		g_object_get_property(G_OBJECT(object), name, &value);
+		g_object_set_property(G_OBJECT(new_object), name, &value);
+		g_value_unset(&value);
+	}
+
+	return NULL;
+}
+
+/* If @image is the output of a loader which supports "area", and no pixels
+ * have been decoded yet, make a new load of just this area. This lets
+ * vips_extract_area() skip decoding the parts of the image it doesn't
+ * need.
+ *
+ * Source loaders are skipped, since we can't read a source twice.
+ *
+ * Returns a new ref to the cropped image, or NULL.
+ */
+VipsImage *
+vips__foreign_load_crop(VipsImage *image,
+	int left, int top, int width, int height)
+{
+	VipsForeignLoad *load;
+	GObjectClass *class;
+	VipsOperation *operation;
+	VipsArrayInt *area;
+	VipsImage *out;
+	int result;
+
+	if (!(load = g_object_get_qdata(G_OBJECT(image),
+			  vips__foreign_load_out)) ||
+		load->real ||
+		(width == image->Xsize &&
+			height == image->Ysize))
+		return NULL;
+
+	class = G_OBJECT_GET_CLASS(load);
+	if (!g_object_class_find_property(class, "area") ||
+		g_object_class_find_property(class, "source") ||
+		vips_object_argument_isset(VIPS_OBJECT(load), "area"))
+		return NULL;
+
+	operation = VIPS_OPERATION(g_object_new(G_OBJECT_TYPE(load), NULL));
+	(void) vips_argument_map(VIPS_OBJECT(load),
+		vips_foreign_load_copy_arg, operation, NULL);
+	area = vips_array_int_newv(4, left, top, width, height);
+	g_object_set(operation, "area", area, NULL);
+	vips_area_unref(VIPS_AREA(area));
+
+	/* Any failure just means we crop in the usual way.
+	 */
+	vips_error_freeze();
+	result = vips_cache_operation_buildp(&operation);
+	vips_error_thaw();
+	if (result) {
+		vips_object_unref_outputs(VIPS_OBJECT(operation));
+		g_object_unref(operation);
+		return NULL;
+	}
+
+#ifdef DEBUG
+	printf("vips__foreign_load_crop: pushed crop into %s\n",
+		G_OBJECT_TYPE_NAME(operation));
+#endif /*DEBUG*/
+
+	g_object_get(operation, "out", &out, NULL);
+	vips_object_unref_outputs(VIPS_OBJECT(operation));
+	g_object_unref(operation);
+
+	return out;
+}
+
+/* Test an optional argument without setting an error if the loader doesn't
+ * have it.
+ */
+static gboolean
+vips_foreign_load_isset(VipsObject *object, const char *name)
+{
+	return g_object_class_find_property(G_OBJECT_GET_CLASS(object), name) &&
+		vips_object_argument_isset(object, name);
+}
+
+/* Reload at up to @shrink times smaller. Loaders with "shrink" get the
+ * largest power of two they allow, those with only "scale" (pdf, svg) get
+ * exactly 1 / @shrink.
+ */
+static VipsImage *
+vips_foreign_load_shrink(VipsImage *image, int shrink)
+{
+	VipsForeignLoad *load;
+	VipsObject *object;
+	GObjectClass *class;
+	GParamSpec *pspec;
+	int factor;
+	double scale;
+	VipsOperation *operation;
+	VipsImage *out;
+	int result;
+
+	if (!(load = g_object_get_qdata(G_OBJECT(image),
+			  vips__foreign_load_out)) ||
+		load->real ||
+		vips_image_get_page_height(image) != image->Ysize)
+		return NULL;
+
+	/* If shrink or scale is set, the caller has already picked a decode
+	 * size (thumbnail does this, for example).
+	 */
+	object = VIPS_OBJECT(load);
+	class = G_OBJECT_GET_CLASS(load);
+	if (g_object_class_find_property(class, "source") ||
+		vips_foreign_load_isset(object, "area") ||
+		vips_foreign_load_isset(object, "shrink") ||
+		vips_foreign_load_isset(object, "scale"))
+		return NULL;
+
+	factor = 1;
+	scale = 1.0;
+	if ((pspec = g_object_class_find_property(class, "shrink")) &&
+		G_IS_PARAM_SPEC_INT(pspec))
+		while (factor * 2 <= shrink &&
+			factor * 2 <= G_PARAM_SPEC_INT(pspec)->maximum)
+			factor *= 2;
+	else if ((pspec = g_object_class_find_property(class, "scale")) &&
+		G_IS_PARAM_SPEC_DOUBLE(pspec) &&
+		1.0 / shrink >= G_PARAM_SPEC_DOUBLE(pspec)->minimum)
+		scale = 1.0 / shrink;
+	if (factor == 1 &&
+		scale == 1.0)
+		return NULL;
+
+	operation = VIPS_OPERATION(g_object_new(G_OBJECT_TYPE(load), NULL));
+	(void) vips_argument_map(object,
+		vips_foreign_load_copy_arg, operation, NULL);
+	if (factor > 1)
+		g_object_set(operation, "shrink", factor, NULL);
+	else
+		g_object_set(operation, "scale", scale, NULL);
+
+	/* Any failure just means we shrink in the usual way.
+	 */
+	vips_error_freeze();
+	result = vips_cache_operation_buildp(&operation);
+	vips_error_thaw();
+	if (result) {
+		vips_object_unref_outputs(VIPS_OBJECT(operation));
+		g_object_unref(operation);
+		return NULL;
+	}
+
+	g_object_get(operation, "out", &out, NULL);
+	vips_object_unref_outputs(VIPS_OBJECT(operation));
+	g_object_unref(operation);
+
+	return out;
+}
+
+/* Count the image inputs to an operation and note the name of the last one.
+ * Image arrays count twice, so they never look like a single input.
+ */
+static void *
+vips_foreign_find_image_arg(VipsObject *object,
+	GParamSpec *pspec,
+	VipsArgumentClass *argument_class,
+	VipsArgumentInstance *argument_instance,
+	void *a, void *b)
+{
+	const char **name = (const char **) a;
+	int *n = (int *) b;
+	GType type = G_PARAM_SPEC_VALUE_TYPE(pspec);
+
+	if ((argument_class->flags & VIPS_ARGUMENT_CONSTRUCT) &&
+		(argument_class->flags & VIPS_ARGUMENT_INPUT) &&
+		argument_instance->assigned &&
+		(g_type_is_a(type, VIPS_TYPE_IMAGE) ||
+			g_type_is_a(type, VIPS_TYPE_ARRAY_IMAGE))) {
+		*name = g_param_spec_get_name(pspec);
+		*n += g_type_is_a(type, VIPS_TYPE_IMAGE) ? 1 : 2;
+	}
+
+	return NULL;
+}
+
+/**
+ * vips__image_shrink_on_load: (skip)
+ * @image: image to shrink
+ * @shrink: largest acceptable integer shrink
+ *
+ * Walk back from @image through any point operations (arithmetic and
+ * colour) with a single image input to the load that made it. If that
+ * loader can decode at a reduced size and no pixels have been decoded yet,
+ * reload at up to @shrink times smaller and replay the point operations on
+ * the result. This lets [method@Image.resize] get the same shrink-on-load
+ * as [ctor@Image.thumbnail].
+ *
+ * Source loaders are skipped, since we can't read a source twice, as are
+ * multi-page images.
+ *
+ * Returns: a new ref to the shrunk image, or NULL.
+ */
+VipsImage *
+vips__image_shrink_on_load(VipsImage *image, int shrink)
+{
+	VipsOperation *producer;
+	const char *name;
+	int n;
+	VipsImage *in;
+	VipsImage *shrunk;
+	VipsOperation *operation;
+	VipsImage *out;
+	int result;
+
+	if (shrink < 2)
+		return NULL;
+
+	if (g_object_get_qdata(G_OBJECT(image), vips__foreign_load_out))
+		return vips_foreign_load_shrink(image, shrink);
+
+	if (!(producer = vips__arithmetic_producer(image)) &&
+		!(producer = vips__colour_producer(image)))
+		return NULL;
+
+	name = NULL;
+	n = 0;
+	(void) vips_argument_map(VIPS_OBJECT(producer),
+		vips_foreign_find_image_arg, &name, &n);
+	if (n != 1)
+		return NULL;
+
+	g_object_get(producer, name, &in, NULL);
+	shrunk = vips__image_shrink_on_load(in, shrink);
+	g_object_unref(in);
+	if (!shrunk)
+		return NULL;
+
+	operation = VIPS_OPERATION(g_object_new(G_OBJECT_TYPE(producer), NULL));
+	(void) vips_argument_map(VIPS_OBJECT(producer),
+		vips_foreign_load_copy_arg, operation, NULL);
+	g_object_set(operation, name, shrunk, NULL);
+	g_object_unref(shrunk);
+
+	vips_error_freeze();
+	result = vips_cache_operation_buildp(&operation);
+	vips_error_thaw();
+	if (result) {
+		vips_object_unref_outputs(VIPS_OBJECT(operation));
+		g_object_unref(operation);
+		return NULL;
+	}
+
+#ifdef DEBUG
+	printf("vips__image_shrink_on_load: replayed %s\n",
+		G_OBJECT_TYPE_NAME(operation));
+#endif /*DEBUG*/
+
+	g_object_get(operation, "out", &out, NULL);
+	vips_object_unref_outputs(VIPS_OBJECT(operation));
+	g_object_unref(operation);
+
+	return out;
+}
+
+/**
+ * vips__sequential_tag: (skip)
+ * @image: image to mark
+ *
+ * Mark @image as safe to compute top-to-bottom from a sequential source,
+ * for example because it's a plain copy of its input.
+ */
+void
+vips__sequential_tag(VipsImage *image)
+{
+	if (vips__foreign_sequential_ok)
+		g_object_set_qdata(G_OBJECT(image),
+			vips__foreign_sequential_ok, GINT_TO_POINTER(TRUE));
+}
+
+static void *
+vips_sequential_tag_output(VipsObject *object,
+	GParamSpec *pspec,
+	VipsArgumentClass *argument_class,
+	VipsArgumentInstance *argument_instance,
+	void *a, void *b)
+{
+	if ((argument_class->flags & VIPS_ARGUMENT_CONSTRUCT) &&
+		(argument_class->flags & VIPS_ARGUMENT_OUTPUT) &&
+		argument_instance->assigned &&
+		g_type_is_a(G_PARAM_SPEC_VALUE_TYPE(pspec), VIPS_TYPE_IMAGE)) {
+		VipsImage *image;
+
+		g_object_get(object, g_param_spec_get_name(pspec), &image, NULL);
+		if (image) {
+			vips__sequential_tag(image);
+			g_object_unref(image);
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * vips__sequential_tag_outputs: (skip)
+ * @operation: a freshly built operation
+ *
+ * If @operation is flagged [flags@Vips.OperationFlags.SEQUENTIAL], mark its
+ * output images with [func@_sequential_tag].
+ */
+void
+vips__sequential_tag_outputs(VipsOperation *operation)
+{
+	if (vips_operation_get_flags(operation) & VIPS_OPERATION_SEQUENTIAL)
+		(void) vips_argument_map(VIPS_OBJECT(operation),
+			vips_sequential_tag_output, NULL, NULL);
+}
+
+typedef struct _VipsSequentialVisit {
+	VipsImage *image;
+	gboolean ok;
+} VipsSequentialVisit;
+
+/* Bits in the seen table: we visit each image at most once on a path which
+ * is all sequential, and once on a path which isn't.
+ */
+#define SEEN_OK (1)
+#define SEEN_BAD (2)
+
+static void
+vips_sequential_push(GArray *stack, VipsImage *image, gboolean ok)
+{
+	VipsSequentialVisit visit = { image, ok };
+
+	g_array_append_val(stack, visit);
+}
+
+/**
+ * vips__sequential_plan: (skip)
+ * @image: image about to be computed top-to-bottom by a sink
+ *
+ * Walk the graph behind @image. Any loaders which would decode to a memory
+ * or disc temp, where every path from the loader to @image runs through
+ * operations which work with sequential input, where every image on the
+ * way, the loader output included, has only one consumer, and where nothing
+ * vertically shrinks by more than two, are switched to sequential access for
+ * this computation.
+ *
+ * Loaders which have already started, or where access was set explicitly,
+ * are left alone.
+ *
+ * Returns: the list of loaders switched, to pass to
+ * [func@_sequential_unplan] when the sink is done.
+ */
+GSList *
+vips__sequential_plan(VipsImage *image)
+{
+	GHashTable *seen;
+	GHashTable *loads;
+	GArray *stack;
+	GSList *candidates;
+	GSList *planned;
+	GHashTableIter iter;
+	gpointer key;
+	gpointer value;
+	GSList *p;
+
+	if (vips__foreign_noautoseq ||
+		!vips__foreign_sequential_ok)
+		return NULL;
+
+	seen = g_hash_table_new(NULL, NULL);
+	loads = g_hash_table_new(NULL, NULL);
+	stack = g_array_new(FALSE, FALSE, sizeof(VipsSequentialVisit));
+
+	/* The upstream links can change under us, so walk with the global
+	 * lock held. Region start takes sslock and then the global lock, so
+	 * we must not take sslock in here.
+	 */
+	g_mutex_lock(&vips__global_lock);
+
+	vips_sequential_push(stack, image, TRUE);
+	while (stack->len > 0) {
+		VipsSequentialVisit visit =
+			g_array_index(stack, VipsSequentialVisit, stack->len - 1);
+		int flag = visit.ok ? SEEN_OK : SEEN_BAD;
+
+		VipsForeignLoad *load;
+		int seen_flags;
+		gboolean ok;
+
+		g_array_set_size(stack, stack->len - 1);
+
+		seen_flags = GPOINTER_TO_INT(g_hash_table_lookup(seen, visit.image));
+		if (seen_flags & flag)
+			continue;
+		g_hash_table_insert(seen, visit.image,
+			GINT_TO_POINTER(seen_flags | flag));
+
+		/* An image read by more than one consumer, perhaps two crops
+		 * at different offsets in this pipeline, or some other
+		 * pipeline sharing a cached load, can see requests in any
+		 * order.
+		 */
+		ok = visit.ok &&
+			g_slist_length(visit.image->downstream) <= 1;
+
+		if ((load = g_object_get_qdata(G_OBJECT(visit.image),
+				 vips__foreign_load_out))) {
+			if (g_hash_table_lookup_extended(loads, load, NULL, &value))
+				ok = ok && GPOINTER_TO_INT(value);
+			g_hash_table_insert(loads, load, GINT_TO_POINTER(ok));
+			continue;
+		}
+
+		ok = ok &&
+			g_object_get_qdata(G_OBJECT(visit.image),
+				vips__foreign_sequential_ok);
+		for (p = visit.image->upstream; p; p = p->next) {
+			VipsImage *upstream = VIPS_IMAGE(p->data);
+
+			vips_sequential_push(stack, upstream,
+				ok &&
+					upstream->Ysize <= 2 * visit.image->Ysize);
+		}
+	}
+
+	candidates = NULL;
+	g_hash_table_iter_init(&iter, loads);
+	while (g_hash_table_iter_next(&iter, &key, &value))
+		if (GPOINTER_TO_INT(value))
+			candidates = g_slist_prepend(candidates, g_object_ref(key));
+
+	g_mutex_unlock(&vips__global_lock);
+
+	g_array_free(stack, TRUE);
+	g_hash_table_destroy(loads);
+	g_hash_table_destroy(seen);
+
+	/* Now switch under each load's start lock, so we can't race with a
+	 * start creating ->real.
+	 */
+	planned = NULL;
+	for (p = candidates; p; p = p->next) {
+		VipsForeignLoad *load = VIPS_FOREIGN_LOAD(p->data);
+		VipsImage *out = load->out;
+		gboolean switched;
+
+		switched = FALSE;
+		if (out) {
+			g_mutex_lock(&out->sslock);
+			if (!load->real &&
+				!load->error &&
+				!load->memory &&
+				load->disc &&
+				(load->flags & VIPS_FOREIGN_SEQUENTIAL) &&
+				load->access == VIPS_ACCESS_RANDOM &&
+				!vips_object_argument_isset(VIPS_OBJECT(load), "access")) {
+				load->access = VIPS_ACCESS_SEQUENTIAL;
+				switched = TRUE;
+			}
+			g_mutex_unlock(&out->sslock);
+		}
+
+		if (switched) {
+			g_info("streaming %s sequentially",
+				VIPS_OBJECT_GET_CLASS(load)->nickname);
+			planned = g_slist_prepend(planned, load);
+		}
+		else
+			g_object_unref(load);
+	}
+	g_slist_free(candidates);
+
+	return planned;
+}
+
+/**
+ * vips__sequential_unplan: (skip)
+ * @planned: (transfer full): loaders from [func@_sequential_plan]
+ *
+ * The sink is done. Put the loaders back to random access and drop the
+ * sequential decode, so any later use of the image decodes again.
+ */
+void
+vips__sequential_unplan(GSList *planned)
+{
+	GSList *p;
+
+	for (p = planned; p; p = p->next) {
+		VipsForeignLoad *load = VIPS_FOREIGN_LOAD(p->data);
+		VipsImage *real;
+
+		g_mutex_lock(&load->out->sslock);
+		load->access = VIPS_ACCESS_RANDOM;
+		load->error = FALSE;
+		real = load->real;
+		load->real = NULL;
+		g_mutex_unlock(&load->out->sslock);
+
+		VIPS_UNREF(real);
+		g_object_unref(load);
+	}
+
+	g_slist_free(planned);
+}
+
 /* Can this VipsForeign open this buffer?
  */
 static void *
@@ -680,7 +1454,8 @@ vips_foreign_find_load_buffer_sub(VipsForeignLoadClass *load_class,
 		return NULL;
 
 	if (load_class->is_a_buffer) {
-		if (load_class->is_a_buffer(*buf, *len))
+		if (vips_foreign_magic_match(load_class, *buf, *len) &&
+			load_class->is_a_buffer(*buf, *len))
 			return load_class;
 	}
 	else
@@ -712,7 +1487,7 @@ vips_foreign_find_load_buffer(const void *data, size_t size)
 {
 	VipsForeignLoadClass *load_class;
 
-	if (!(load_class = (VipsForeignLoadClass *) vips_foreign_map(
+	if (!(load_class = (VipsForeignLoadClass *) vips_foreign_map_lazy(
 			  "VipsForeignLoad",
 			  (VipsSListMap2Fn) vips_foreign_find_load_buffer_sub,
 			  &data, &size))) {
@@ -732,12 +1507,17 @@ vips_foreign_find_load_source_sub(void *item, void *a, void *b)
 	VipsObjectClass *object_class = VIPS_OBJECT_CLASS(item);
 	VipsForeignLoadClass *load_class = VIPS_FOREIGN_LOAD_CLASS(item);
 	VipsSource *source = VIPS_SOURCE(a);
+	VipsForeignSniff *sniff = (VipsForeignSniff *) b;
 
 	/* Skip non-source loaders.
 	 */
 	if (!g_str_has_suffix(object_class->nickname, "_source"))
 		return NULL;
 
+	if (sniff &&
+		!vips_foreign_magic_match(load_class, sniff->data, sniff->length))
+		return NULL;
+
 	if (load_class->is_a_source) {
 		/* We may have done a _read() rather than a _sniff() in one of
 		 * the is_a testers. Always rewind.
@@ -772,12 +1552,25 @@ vips_foreign_find_load_source_sub(void *item, void *a, void *b)
 const char *
 vips_foreign_find_load_source(VipsSource *source)
 {
+	VipsForeignSniff sniff;
+	unsigned char *data;
+	gint64 length;
 	VipsForeignLoadClass *load_class;
 
-	if (!(load_class = (VipsForeignLoadClass *) vips_foreign_map(
+	/* Sniff once for all the signature checks. Copy the bytes, since
+	 * the is_a_source() calls can move the sniff buffer.
+	 */
+	length = vips_source_sniff_at_most(source,
+		&data, VIPS_FOREIGN_MAGIC_SIZE);
+	if (length > 0) {
+		sniff.length = length;
+		memcpy(sniff.data, data, length);
+	}
+
+	if (!(load_class = (VipsForeignLoadClass *) vips_foreign_map_lazy(
 			  "VipsForeignLoad",
 			  vips_foreign_find_load_source_sub,
-			  source, NULL))) {
+			  source, length > 0 ? &sniff : NULL))) {
 		vips_error("VipsForeignLoad",
 			"%s", _("source is not in a known format"));
 		return NULL;
@@ -1021,6 +1814,16 @@ vips_foreign_load_start(VipsImage *out, void *a, void *b)
 		return NULL;
 	}
 
+	/* Another process may have decoded this image already, see
+	 * vips_cache_set_shared().
+	 */
+	if (!load->real &&
+		(load->real = vips__shm_cache_lookup(load, out))) {
+		if (vips_image_pipelinev(load->out, load->out->dhint,
+				load->real, NULL))
+			return NULL;
+	}
+
 	if (!load->real) {
 		if (!(load->real = vips_foreign_load_temp(load)))
 			return NULL;
@@ -1065,6 +1868,8 @@ vips_foreign_load_start(VipsImage *out, void *a, void *b)
 			return NULL;
 		}
 
+		vips__shm_cache_add(load, load->real);
+
 		/* We have to tell vips that out depends on real. We've set
 		 * the demand hint below, but not given an input there.
 		 */
@@ -1149,6 +1954,7 @@ vips_foreign_load_build(VipsObject *object)
 				  "please use \"access\" instead");
 
 	g_object_set(object, "out", vips_image_new(), NULL);
+	g_object_set_qdata(G_OBJECT(load->out), vips__foreign_load_out, load);
 
 	vips_image_set_string(load->out, VIPS_META_LOADER, class->nickname);
 
@@ -1998,7 +2804,7 @@ vips_foreign_find_save(const char *name)
 
 	vips__filename_split8(name, filename, option_string);
 
-	if (!(save_class = (VipsForeignSaveClass *) vips_foreign_map(
+	if (!(save_class = (VipsForeignSaveClass *) vips_foreign_map_lazy(
 			  "VipsForeignSave",
 			  (VipsSListMap2Fn) vips_foreign_find_save_sub,
 			  (void *) filename, NULL))) {
@@ -2154,7 +2960,7 @@ vips_foreign_find_save_target(const char *name)
 
 	vips__filename_split8(name, suffix, option_string);
 
-	if (!(save_class = (VipsForeignSaveClass *) vips_foreign_map(
+	if (!(save_class = (VipsForeignSaveClass *) vips_foreign_map_lazy(
 			  "VipsForeignSave",
 			  (VipsSListMap2Fn) vips_foreign_find_save_target_sub,
 			  (void *) suffix, NULL))) {
@@ -2213,7 +3019,7 @@ vips_foreign_find_save_buffer(const char *name)
 
 	vips__filename_split8(name, suffix, option_string);
 
-	if (!(save_class = (VipsForeignSaveClass *) vips_foreign_map(
+	if (!(save_class = (VipsForeignSaveClass *) vips_foreign_map_lazy(
 			  "VipsForeignSave",
 			  (VipsSListMap2Fn) vips_foreign_find_save_buffer_sub,
 			  (void *) suffix, NULL))) {
@@ -2253,6 +3059,14 @@ vips_foreign_find_save_buffer(const char *name)
  * By default, input image dimensions are limited to 16384x16384.
  * If @unlimited is `TRUE`, this increases to the maximum of 65535x65535.
  *
+ * Set @parallel to decode pages in parallel when loading more than one.
+ * Each page is read by a separate loader, so this needs a file or memory
+ * source, and needs more memory.
+ *
+ * Use @threads to set the number of threads the decoder may use. The
+ * default of 0 means the vips concurrency. Single page grid images are
+ * decoded a tile at a time, so only the tiles you read are decoded.
+ *
  * The bitdepth of the heic image is recorded in the metadata item
  * `heif-bitdepth`.
  *
@@ -2261,6 +3075,8 @@ vips_foreign_find_save_buffer(const char *name)
  *     * @n: `gint`, load this many pages
  *     * @thumbnail: `gboolean`, fetch thumbnail instead of image
  *     * @unlimited: `gboolean`, remove all denial of service limits
+ *     * @parallel: `gboolean`, decode pages in parallel
+ *     * @threads: `gint`, decoder threads, 0 for the vips concurrency
  *
  * ::: seealso
  *     [ctor@Image.new_from_file].
@@ -2298,6 +3114,8 @@ vips_heifload(const char *filename, VipsImage **out, ...)
  *     * @n: `gint`, load this many pages
  *     * @thumbnail: `gboolean`, fetch thumbnail instead of image
  *     * @unlimited: `gboolean`, remove all denial of service limits
+ *     * @parallel: `gboolean`, decode pages in parallel
+ *     * @threads: `gint`, decoder threads, 0 for the vips concurrency
  *
  * ::: seealso
  *     [ctor@Image.heifload].
@@ -2337,6 +3155,8 @@ vips_heifload_buffer(void *buf, size_t len, VipsImage **out, ...)
  *     * @n: `gint`, load this many pages
  *     * @thumbnail: `gboolean`, fetch thumbnail instead of image
  *     * @unlimited: `gboolean`, remove all denial of service limits
+ *     * @parallel: `gboolean`, decode pages in parallel
+ *     * @threads: `gint`, decoder threads, 0 for the vips concurrency
  *
  * ::: seealso
  *     [ctor@Image.heifload].
@@ -2387,6 +3207,12 @@ vips_heifload_source(VipsSource *source, VipsImage **out, ...)
  * Use @tune to pass a set of tuning parameters to the encoder, see the
  * libheif documentation.
  *
+ * Set @tile_width and @tile_height to write each page as a grid of tiles.
+ * Each strip of tiles is encoded in parallel as soon as it arrives from the
+ * pipeline, so memory use depends on the tile height rather than the page
+ * size. Pages larger than 16384 pixels in either dimension are always
+ * written as a grid of 512 x 512 tiles.
+ *
  * ::: tip "Optional arguments"
  *     * @Q: `gint`, quality factor
  *     * @bitdepth: `gint`, set write bit depth to 8, 10, or 12 bits
@@ -2397,6 +3223,8 @@ vips_heifload_source(VipsSource *source, VipsImage **out, ...)
  *     * @subsample_mode: [enum@ForeignSubsample], chroma subsampling mode
  *     * @encoder: [enum@ForeignHeifEncoder], select encoder to use
  *     * @tune: `gchararray`, encoder tuning parameters
+ *     * @tile_width: `gint`, tile width for grid write
+ *     * @tile_height: `gint`, tile height for grid write
  *
  * ::: seealso
  *     [method@Image.write_to_file], [ctor@Image.heifload].
@@ -2439,6 +3267,8 @@ vips_heifsave(VipsImage *in, const char *filename, ...)
  *     * @subsample_mode: [enum@ForeignSubsample], chroma subsampling mode
  *     * @encoder: [enum@ForeignHeifEncoder], select encoder to use
  *     * @tune: `gchararray`, encoder tuning parameters
+ *     * @tile_width: `gint`, tile width for grid write
+ *     * @tile_height: `gint`, tile height for grid write
  *
  * ::: seealso
  *     [method@Image.heifsave], [method@Image.write_to_file].
@@ -2491,6 +3321,8 @@ vips_heifsave_buffer(VipsImage *in, void **buf, size_t *len, ...)
  *     * @subsample_mode: [enum@ForeignSubsample], chroma subsampling mode
  *     * @encoder: [enum@ForeignHeifEncoder], select encoder to use
  *     * @tune: `gchararray`, encoder tuning parameters
+ *     * @tile_width: `gint`, tile width for grid write
+ *     * @tile_height: `gint`, tile height for grid write
  *
  * ::: seealso
  *     [method@Image.heifsave], [method@Image.write_to_target].
@@ -2762,6 +3594,15 @@ vips_jxlsave_target(VipsImage *in, VipsTarget *target, ...)
  * When using pdfium, the region of a page to render can be selected with
  * @page_box, defaulting to the crop box.
  *
+ * pdfium is not threadsafe, so renders are normally serialised. Set the
+ * environment variable `VIPS_PDFIUM_WORKERS` to a number of processes and
+ * pages will instead be rendered by a pool of `vips-pdfium-worker`
+ * processes, so throughput scales with cores. This needs Linux.
+ *
+ * When using pdfium, set @parallel to render the pages of a multi-page load
+ * in parallel, each with a separate loader. This needs a file or memory
+ * source, and is most useful together with `VIPS_PDFIUM_WORKERS`.
+ *
  * The operation fills a number of header fields with metadata, for example
  * "pdf-author". They may be useful.
  *
@@ -2775,6 +3616,7 @@ vips_jxlsave_target(VipsImage *in, VipsTarget *target, ...)
  *     * @scale: `gdouble`, scale render by this factor
  *     * @background: [struct@ArrayDouble], background colour
  *     * @page_box: [enum@ForeignPdfPageBox], use this page box (pdfium only)
+ *     * @parallel: `gboolean`, render pages in parallel (pdfium only)
  *
  * ::: seealso
  *     [ctor@Image.new_from_file], [ctor@Image.magickload].
@@ -2814,6 +3656,7 @@ vips_pdfload(const char *filename, VipsImage **out, ...)
  *     * @scale: `gdouble`, scale render by this factor
  *     * @background: [struct@ArrayDouble], background colour
  *     * @page_box: [enum@ForeignPdfPageBox], use this page box (pdfium only)
+ *     * @parallel: `gboolean`, render pages in parallel (pdfium only)
  *
  * ::: seealso
  *     [ctor@Image.pdfload].
@@ -2855,6 +3698,7 @@ vips_pdfload_buffer(void *buf, size_t len, VipsImage **out, ...)
  *     * @scale: `gdouble`, scale render by this factor
  *     * @background: [struct@ArrayDouble], background colour
  *     * @page_box: [enum@ForeignPdfPageBox], use this page box (pdfium only)
+ *     * @parallel: `gboolean`, render pages in parallel (pdfium only)
  *
  * ::: seealso
  *     [ctor@Image.pdfload]
@@ -2904,6 +3748,10 @@ vips_pdfload_source(VipsSource *source, VipsImage **out, ...)
  * By default, the output of this operator is RGBA. Set @rgb to enable RGB
  * output.
  *
+ * Opened slides and decoded associated images are kept and shared between
+ * loads of the same file. They are dropped if the file changes on disc, or
+ * if you set @revalidate.
+ *
  * ::: tip "Optional arguments"
  *     * @level: `gint`, load this level
  *     * @associated: `gchararray`, load this associated image
@@ -3029,6 +3877,7 @@ vips_foreign_operation_init(void)
 	extern GType vips_foreign_save_jpeg_buffer_get_type(void);
 	extern GType vips_foreign_save_jpeg_target_get_type(void);
 	extern GType vips_foreign_save_jpeg_mime_get_type(void);
+	extern GType vips_jpegtran_get_type(void);
 
 	extern GType vips_foreign_load_tiff_file_get_type(void);
 	extern GType vips_foreign_load_tiff_buffer_get_type(void);
@@ -3268,6 +4117,7 @@ vips_foreign_operation_init(void)
 	vips_foreign_save_jpeg_buffer_get_type();
 	vips_foreign_save_jpeg_target_get_type();
 	vips_foreign_save_jpeg_mime_get_type();
+	vips_jpegtran_get_type();
 #endif /*HAVE_JPEG*/
 
 #ifdef HAVE_LIBWEBP
@@ -3345,4 +4195,11 @@ vips_foreign_operation_init(void)
 
 	vips__foreign_load_operation =
 		g_quark_from_static_string("vips-foreign-load-operation");
+	vips__foreign_load_out =
+		g_quark_from_static_string("vips-foreign-load-out");
+	vips__foreign_sequential_ok =
+		g_quark_from_static_string("vips-foreign-sequential-ok");
+
+	if (g_getenv("VIPS_NOAUTOSEQ"))
+		vips__foreign_noautoseq = TRUE;
 }
@@ -0,0 +1,1322 @@
+/* assemble HEIF grid images from separately encoded tiles
+ *
+ * 14/10/26
+ * 	- from heifsave.c
+ * 15/10/26
+ * 	- keep premultiplied alpha, refuse cropped tiles
+ */
+
+/*
+
+	This file is part of VIPS.
+
+	VIPS is free software; you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+	02110-1301  USA
+
+ */
+
+/*
+
+	These files are distributed with VIPS - http://www.vips.ecs.soton.ac.uk
+
+ */
+
+/* libheif can only add tiles to a context from one thread, so to encode
+ * tiles in parallel heifsave encodes each tile to a complete single-image
+ * HEIF in memory. We parse these, keep the coded data and item properties,
+ * and write a grid image of our own at the end.
+ *
+ * Properties are shared between items where they are identical, transforms
+ * (irot, imir) move from the tiles to the grid, and codec configuration
+ * stays with the tiles. A clap on a tile would crop the tile, not the grid,
+ * so we refuse tiles with one. The prem reference from the image to its
+ * alpha moves to the grids.
+ */
+
+/*
+#define DEBUG
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /*HAVE_CONFIG_H*/
+#include <glib/gi18n-lib.h>
+
+#ifdef HAVE_HEIF
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vips/vips.h>
+#include <vips/internal.h>
+
+#include "pforeign.h"
+
+#define FOURCC(A, B, C, D) \
+	((guint32) (A) << 24 | (guint32) (B) << 16 | (guint32) (C) << 8 | (D))
+
+/* Limits for the single-image files we parse.
+ */
+#define MAX_ITEMS (16)
+#define MAX_EXTENTS (16)
+#define MAX_PROPERTIES (32)
+
+/* Item IDs are 16 bits in the boxes we write.
+ */
+#define MAX_ITEM_ID (65535)
+
+/* A property box, with header.
+ */
+typedef struct _VipsHeifGridProperty {
+	guint32 type;
+	gboolean essential;
+	VipsPel *box;
+	size_t length;
+} VipsHeifGridProperty;
+
+/* A coded image item copied from a tile file.
+ */
+typedef struct _VipsHeifGridItem {
+	guint32 type;
+	VipsPel *data;
+	size_t length;
+	int n_properties;
+	VipsHeifGridProperty property[MAX_PROPERTIES];
+} VipsHeifGridItem;
+
+typedef struct _VipsHeifGridTile {
+	gboolean valid;
+	VipsHeifGridItem image;
+	gboolean has_alpha;
+	gboolean premultiplied;
+	VipsHeifGridItem alpha;
+} VipsHeifGridTile;
+
+/* Exif or XMP for a page.
+ */
+typedef struct _VipsHeifGridMetadata {
+	guint32 type;
+	const char *content_type;
+	VipsPel *data;
+	size_t length;
+} VipsHeifGridMetadata;
+
+typedef struct _VipsHeifGridPage {
+	int width;
+	int height;
+	int tile_columns;
+	int tile_rows;
+	VipsHeifGridTile *tile;
+
+	int n_metadata;
+	VipsHeifGridMetadata metadata[2];
+
+	/* The ImageGrid structure.
+	 */
+	VipsPel grid[12];
+	size_t grid_length;
+} VipsHeifGridPage;
+
+struct _VipsHeifGrid {
+	/* Protects pages and ftyp, tiles are set from many threads.
+	 */
+	GMutex lock;
+
+	/* ftyp from the first tile.
+	 */
+	VipsPel *ftyp;
+	size_t ftyp_length;
+
+	int n_pages;
+	VipsHeifGridPage **page;
+
+	int primary;
+};
+
+/* Read big-endian numbers from a bounded area.
+ */
+typedef struct _VipsHeifGridCursor {
+	const VipsPel *p;
+	const VipsPel *end;
+	gboolean error;
+} VipsHeifGridCursor;
+
+static guint64
+vips_heif_grid_read(VipsHeifGridCursor *c, int bytes)
+{
+	guint64 value;
+
+	if (c->end - c->p < bytes) {
+		c->error = TRUE;
+		c->p = c->end;
+		return 0;
+	}
+
+	value = 0;
+	for (int i = 0; i < bytes; i++)
+		value = (value << 8) | *c->p++;
+
+	return value;
+}
+
+static void *
+vips_heif_grid_dup(const void *data, size_t length)
+{
+	void *copy = g_malloc(length);
+
+	memcpy(copy, data, length);
+
+	return copy;
+}
+
+#define READ8(C) ((guint32) vips_heif_grid_read(C, 1))
+#define READ16(C) ((guint32) vips_heif_grid_read(C, 2))
+#define READ32(C) ((guint32) vips_heif_grid_read(C, 4))
+
+typedef struct _VipsHeifGridBox {
+	guint32 type;
+	const VipsPel *start;
+	size_t length;
+	VipsHeifGridCursor body;
+} VipsHeifGridBox;
+
+/* Get the next box from a cursor, FALSE at the end or on error.
+ */
+static gboolean
+vips_heif_grid_box_next(VipsHeifGridCursor *c, VipsHeifGridBox *box)
+{
+	const VipsPel *start = c->p;
+	guint64 size;
+
+	if (c->error ||
+		c->end - c->p < 8)
+		return FALSE;
+
+	size = READ32(c);
+	box->type = READ32(c);
+	if (size == 1)
+		size = vips_heif_grid_read(c, 8);
+	else if (size == 0)
+		size = c->end - start;
+
+	if (c->error ||
+		size < (guint64) (c->p - start) ||
+		size > (guint64) (c->end - start)) {
+		c->error = TRUE;
+		return FALSE;
+	}
+
+	box->start = start;
+	box->length = size;
+	box->body.p = c->p;
+	box->body.end = start + size;
+	box->body.error = FALSE;
+	c->p = start + size;
+
+	return TRUE;
+}
+
+/* The items we find in a tile file.
+ */
+typedef struct _VipsHeifGridReaderItem {
+	guint32 id;
+	guint32 type;
+	int construction_method;
+	int n_extents;
+	guint64 offset[MAX_EXTENTS];
+	guint64 length[MAX_EXTENTS];
+	int n_associations;
+	int association[MAX_PROPERTIES];
+	gboolean essential[MAX_PROPERTIES];
+} VipsHeifGridReaderItem;
+
+typedef struct _VipsHeifGridReader {
+	const VipsPel *buf;
+	size_t length;
+
+	const VipsPel *ftyp;
+	size_t ftyp_length;
+
+	guint32 primary;
+	guint32 alpha;
+	gboolean premultiplied;
+
+	int n_items;
+	VipsHeifGridReaderItem item[MAX_ITEMS];
+
+	int n_properties;
+	VipsHeifGridBox property[MAX_PROPERTIES * 2];
+
+	VipsHeifGridCursor idat;
+} VipsHeifGridReader;
+
+static VipsHeifGridReaderItem *
+vips_heif_grid_reader_item(VipsHeifGridReader *reader, guint32 id)
+{
+	for (int i = 0; i < reader->n_items; i++)
+		if (reader->item[i].id == id)
+			return &reader->item[i];
+
+	if (reader->n_items >= MAX_ITEMS)
+		return NULL;
+
+	VipsHeifGridReaderItem *item = &reader->item[reader->n_items++];
+	memset(item, 0, sizeof(VipsHeifGridReaderItem));
+	item->id = id;
+
+	return item;
+}
+
+static int
+vips_heif_grid_parse_iloc(VipsHeifGridReader *reader, VipsHeifGridCursor *c)
+{
+	int version = READ8(c);
+	(void) vips_heif_grid_read(c, 3);
+	int sizes = READ8(c);
+	int offset_size = sizes >> 4;
+	int length_size = sizes & 0xf;
+	sizes = READ8(c);
+	int base_offset_size = sizes >> 4;
+	int index_size = version > 0 ? sizes & 0xf : 0;
+	guint32 n = version < 2 ? READ16(c) : READ32(c);
+
+	for (guint32 i = 0; i < n && !c->error; i++) {
+		guint32 id = version < 2 ? READ16(c) : READ32(c);
+		VipsHeifGridReaderItem *item;
+
+		if (!(item = vips_heif_grid_reader_item(reader, id)))
+			return -1;
+
+		if (version > 0)
+			item->construction_method = READ16(c) & 0xf;
+		(void) READ16(c);
+		guint64 base = vips_heif_grid_read(c, base_offset_size);
+		int n_extents = READ16(c);
+		if (n_extents > MAX_EXTENTS)
+			return -1;
+
+		item->n_extents = n_extents;
+		for (int j = 0; j < n_extents; j++) {
+			(void) vips_heif_grid_read(c, index_size);
+			item->offset[j] = base + vips_heif_grid_read(c, offset_size);
+			item->length[j] = vips_heif_grid_read(c, length_size);
+		}
+	}
+
+	return c->error ? -1 : 0;
+}
+
+static int
+vips_heif_grid_parse_iinf(VipsHeifGridReader *reader, VipsHeifGridCursor *c)
+{
+	int version = READ8(c);
+	(void) vips_heif_grid_read(c, 3);
+	(void) (version == 0 ? READ16(c) : READ32(c));
+
+	VipsHeifGridBox box;
+	while (vips_heif_grid_box_next(c, &box))
+		if (box.type == FOURCC('i', 'n', 'f', 'e')) {
+			VipsHeifGridCursor *b = &box.body;
+			int infe_version = READ8(b);
+			(void) vips_heif_grid_read(b, 3);
+
+			if (infe_version >= 2) {
+				guint32 id = infe_version == 2 ? READ16(b) : READ32(b);
+				VipsHeifGridReaderItem *item;
+
+				(void) READ16(b);
+				if (!(item = vips_heif_grid_reader_item(reader, id)))
+					return -1;
+				item->type = READ32(b);
+			}
+		}
+
+	return c->error ? -1 : 0;
+}
+
+static int
+vips_heif_grid_parse_iref(VipsHeifGridReader *reader, VipsHeifGridCursor *c)
+{
+	int version = READ8(c);
+	(void) vips_heif_grid_read(c, 3);
+	int id_size = version == 0 ? 2 : 4;
+
+	VipsHeifGridBox box;
+	while (vips_heif_grid_box_next(c, &box)) {
+		VipsHeifGridCursor *b = &box.body;
+		guint32 from = vips_heif_grid_read(b, id_size);
+		int n = READ16(b);
+
+		for (int i = 0; i < n; i++) {
+			guint32 to = vips_heif_grid_read(b, id_size);
+
+			if (box.type == FOURCC('a', 'u', 'x', 'l') &&
+				to == reader->primary)
+				reader->alpha = from;
+
+			/* prem goes from the image to its alpha.
+			 */
+			if (box.type == FOURCC('p', 'r', 'e', 'm') &&
+				from == reader->primary)
+				reader->premultiplied = TRUE;
+		}
+	}
+
+	return c->error ? -1 : 0;
+}
+
+static int
+vips_heif_grid_parse_iprp(VipsHeifGridReader *reader, VipsHeifGridCursor *c)
+{
+	VipsHeifGridBox box;
+
+	while (vips_heif_grid_box_next(c, &box))
+		if (box.type == FOURCC('i', 'p', 'c', 'o')) {
+			VipsHeifGridBox property;
+
+			while (vips_heif_grid_box_next(&box.body, &property)) {
+				if (reader->n_properties >= VIPS_NUMBER(reader->property))
+					return -1;
+				reader->property[reader->n_properties++] = property;
+			}
+		}
+		else if (box.type == FOURCC('i', 'p', 'm', 'a')) {
+			VipsHeifGridCursor *b = &box.body;
+			int version = READ8(b);
+			guint32 flags = vips_heif_grid_read(b, 3);
+			guint32 n = READ32(b);
+
+			for (guint32 i = 0; i < n && !b->error; i++) {
+				guint32 id = version < 1 ? READ16(b) : READ32(b);
+				int n_associations = READ8(b);
+				VipsHeifGridReaderItem *item;
+
+				if (!(item = vips_heif_grid_reader_item(reader, id)) ||
+					n_associations > MAX_PROPERTIES)
+					return -1;
+
+				item->n_associations = n_associations;
+				for (int j = 0; j < n_associations; j++) {
+					guint32 v = flags & 1 ? READ16(b) : READ8(b);
+					int top = flags & 1 ? 0x8000 : 0x80;
+
+					item->essential[j] = (v & top) != 0;
+					item->association[j] = v & (top - 1);
+				}
+			}
+
+			if (b->error)
+				return -1;
+		}
+
+	return c->error ? -1 : 0;
+}
+
+static int
+vips_heif_grid_parse(VipsHeifGridReader *reader,
+	const VipsPel *buf, size_t length)
+{
+	VipsHeifGridCursor file = { buf, buf + length, FALSE };
+	VipsHeifGridBox box;
+
+	memset(reader, 0, sizeof(VipsHeifGridReader));
+	reader->buf = buf;
+	reader->length = length;
+
+	while (vips_heif_grid_box_next(&file, &box))
+		if (box.type == FOURCC('f', 't', 'y', 'p')) {
+			reader->ftyp = box.start;
+			reader->ftyp_length = box.length;
+		}
+		else if (box.type == FOURCC('m', 'e', 't', 'a')) {
+			VipsHeifGridCursor *meta = &box.body;
+			VipsHeifGridBox child;
+
+			(void) READ32(meta);
+
+			/* pitm must be known before iref, so find it first.
+			 */
+			VipsHeifGridCursor scan = *meta;
+			while (vips_heif_grid_box_next(&scan, &child))
+				if (child.type == FOURCC('p', 'i', 't', 'm')) {
+					int version = READ8(&child.body);
+					(void) vips_heif_grid_read(&child.body, 3);
+					reader->primary = version == 0
+						? READ16(&child.body)
+						: READ32(&child.body);
+				}
+
+			while (vips_heif_grid_box_next(meta, &child)) {
+				int result = 0;
+
+				switch (child.type) {
+				case FOURCC('i', 'l', 'o', 'c'):
+					result = vips_heif_grid_parse_iloc(reader, &child.body);
+					break;
+
+				case FOURCC('i', 'i', 'n', 'f'):
+					result = vips_heif_grid_parse_iinf(reader, &child.body);
+					break;
+
+				case FOURCC('i', 'r', 'e', 'f'):
+					result = vips_heif_grid_parse_iref(reader, &child.body);
+					break;
+
+				case FOURCC('i', 'p', 'r', 'p'):
+					result = vips_heif_grid_parse_iprp(reader, &child.body);
+					break;
+
+				case FOURCC('i', 'd', 'a', 't'):
+					reader->idat = child.body;
+					break;
+
+				default:
+					break;
+				}
+
+				if (result)
+					return -1;
+			}
+
+			if (meta->error)
+				return -1;
+		}
+
+	if (file.error ||
+		!reader->ftyp ||
+		!reader->primary)
+		return -1;
+
+	return 0;
+}
+
+/* Copy an item's data and properties out of a tile file.
+ */
+static int
+vips_heif_grid_item_copy(VipsHeifGridReader *reader, guint32 id,
+	VipsHeifGridItem *out)
+{
+	VipsHeifGridReaderItem *item;
+	guint64 length;
+
+	if (!(item = vips_heif_grid_reader_item(reader, id)) ||
+		!item->type ||
+		item->construction_method > 1)
+		return -1;
+
+	length = 0;
+	for (int i = 0; i < item->n_extents; i++) {
+		const VipsPel *base = item->construction_method == 0
+			? reader->buf
+			: reader->idat.p;
+		size_t size = item->construction_method == 0
+			? reader->length
+			: reader->idat.end - reader->idat.p;
+
+		if (!base ||
+			item->length[i] == 0 ||
+			item->offset[i] > size ||
+			item->length[i] > size - item->offset[i])
+			return -1;
+		length += item->length[i];
+	}
+
+	out->type = item->type;
+	out->length = length;
+	if (!(out->data = g_try_malloc(length)))
+		return -1;
+
+	length = 0;
+	for (int i = 0; i < item->n_extents; i++) {
+		const VipsPel *base = item->construction_method == 0
+			? reader->buf
+			: reader->idat.p;
+
+		memcpy(out->data + length, base + item->offset[i], item->length[i]);
+		length += item->length[i];
+	}
+
+	for (int i = 0; i < item->n_associations; i++) {
+		int index = item->association[i];
+		VipsHeifGridBox *box;
+		VipsHeifGridProperty *property;
+
+		/* Index 0 means no property.
+		 */
+		if (index == 0)
+			continue;
+		if (index > reader->n_properties)
+			return -1;
+
+		box = &reader->property[index - 1];
+		property = &out->property[out->n_properties++];
+		property->type = box->type;
+		property->essential = item->essential[i];
+		property->length = box->length;
+		property->box = vips_heif_grid_dup(box->start, box->length);
+	}
+
+	return 0;
+}
+
+static gboolean
+vips_heif_grid_item_is_cropped(VipsHeifGridItem *item)
+{
+	for (int i = 0; i < item->n_properties; i++)
+		if (item->property[i].type == FOURCC('c', 'l', 'a', 'p'))
+			return TRUE;
+
+	return FALSE;
+}
+
+static void
+vips_heif_grid_item_free(VipsHeifGridItem *item)
+{
+	VIPS_FREE(item->data);
+	for (int i = 0; i < item->n_properties; i++)
+		VIPS_FREE(item->property[i].box);
+	item->n_properties = 0;
+}
+
+static void
+vips_heif_grid_tile_free(VipsHeifGridTile *tile)
+{
+	vips_heif_grid_item_free(&tile->image);
+	vips_heif_grid_item_free(&tile->alpha);
+	tile->valid = FALSE;
+}
+
+VipsHeifGrid *
+vips__heif_grid_new(void)
+{
+	VipsHeifGrid *grid;
+
+	grid = g_new0(VipsHeifGrid, 1);
+	g_mutex_init(&grid->lock);
+
+	return grid;
+}
+
+void
+vips__heif_grid_free(VipsHeifGrid *grid)
+{
+	for (int i = 0; i < grid->n_pages; i++) {
+		VipsHeifGridPage *page = grid->page[i];
+
+		for (int j = 0; j < page->tile_columns * page->tile_rows; j++)
+			vips_heif_grid_tile_free(&page->tile[j]);
+		VIPS_FREE(page->tile);
+		for (int j = 0; j < page->n_metadata; j++)
+			VIPS_FREE(page->metadata[j].data);
+		VIPS_FREE(page);
+	}
+	VIPS_FREE(grid->page);
+	VIPS_FREE(grid->ftyp);
+	g_mutex_clear(&grid->lock);
+
+	g_free(grid);
+}
+
+/* Add a page to the grid. Pages are numbered from zero in order.
+ */
+int
+vips__heif_grid_add_page(VipsHeifGrid *grid, int width, int height,
+	int tile_columns, int tile_rows)
+{
+	VipsHeifGridPage *page;
+	gboolean large;
+
+	/* The ImageGrid structure stores rows and columns in a byte.
+	 */
+	if (tile_columns > 256 ||
+		tile_rows > 256) {
+		vips_error("heifsave", "%s", _("too many tiles"));
+		return -1;
+	}
+
+	page = g_new0(VipsHeifGridPage, 1);
+	page->width = width;
+	page->height = height;
+	page->tile_columns = tile_columns;
+	page->tile_rows = tile_rows;
+	page->tile = g_new0(VipsHeifGridTile, tile_columns * tile_rows);
+
+	large = width > 65535 || height > 65535;
+	page->grid[0] = 0;
+	page->grid[1] = large ? 1 : 0;
+	page->grid[2] = tile_rows - 1;
+	page->grid[3] = tile_columns - 1;
+	if (large) {
+		for (int i = 0; i < 4; i++) {
+			page->grid[4 + i] = width >> (24 - i * 8);
+			page->grid[8 + i] = height >> (24 - i * 8);
+		}
+		page->grid_length = 12;
+	}
+	else {
+		page->grid[4] = width >> 8;
+		page->grid[5] = width;
+		page->grid[6] = height >> 8;
+		page->grid[7] = height;
+		page->grid_length = 8;
+	}
+
+	g_mutex_lock(&grid->lock);
+	grid->page = g_renew(VipsHeifGridPage *, grid->page, grid->n_pages + 1);
+	grid->page[grid->n_pages++] = page;
+	g_mutex_unlock(&grid->lock);
+
+	return 0;
+}
+
+/* Set a tile from a single-image HEIF file. Safe to call from many threads.
+ */
+int
+vips__heif_grid_set_tile(VipsHeifGrid *grid, int page_number, int index,
+	const VipsPel *buf, size_t length)
+{
+	VipsHeifGridReader *reader;
+	VipsHeifGridTile tile = { 0 };
+	VipsHeifGridPage *page;
+
+	reader = g_new(VipsHeifGridReader, 1);
+	if (vips_heif_grid_parse(reader, buf, length) ||
+		vips_heif_grid_item_copy(reader, reader->primary, &tile.image) ||
+		(reader->alpha &&
+			vips_heif_grid_item_copy(reader, reader->alpha, &tile.alpha))) {
+		vips_heif_grid_tile_free(&tile);
+		g_free(reader);
+		vips_error("heifsave", "%s", _("unable to parse encoded tile"));
+		return -1;
+	}
+	tile.has_alpha = reader->alpha != 0;
+	tile.premultiplied = tile.has_alpha && reader->premultiplied;
+	tile.valid = TRUE;
+
+	if (vips_heif_grid_item_is_cropped(&tile.image) ||
+		vips_heif_grid_item_is_cropped(&tile.alpha)) {
+		vips_heif_grid_tile_free(&tile);
+		g_free(reader);
+		vips_error("heifsave", "%s", _("encoded tile is cropped"));
+		return -1;
+	}
+
+	g_mutex_lock(&grid->lock);
+
+	if (!grid->ftyp) {
+		grid->ftyp = vips_heif_grid_dup(reader->ftyp, reader->ftyp_length);
+		grid->ftyp_length = reader->ftyp_length;
+	}
+
+	g_assert(page_number < grid->n_pages);
+	page = grid->page[page_number];
+	g_assert(index < page->tile_columns * page->tile_rows);
+	vips_heif_grid_tile_free(&page->tile[index]);
+	page->tile[index] = tile;
+
+	g_mutex_unlock(&grid->lock);
+
+	g_free(reader);
+
+	return 0;
+}
+
+/* Attach Exif ("Exif") or XMP ("mime") to a page.
+ */
+int
+vips__heif_grid_add_metadata(VipsHeifGrid *grid, int page_number,
+	const char *type, const void *data, size_t length)
+{
+	VipsHeifGridPage *page;
+	VipsHeifGridMetadata *metadata;
+
+	g_mutex_lock(&grid->lock);
+	page = grid->page[page_number];
+	g_mutex_unlock(&grid->lock);
+
+	if (page->n_metadata >= VIPS_NUMBER(page->metadata))
+		return 0;
+	metadata = &page->metadata[page->n_metadata++];
+
+	if (g_str_equal(type, "Exif")) {
+		const VipsPel *p = (const VipsPel *) data;
+		size_t offset;
+
+		/* Exif items start with the offset to the TIFF header.
+		 */
+		for (offset = 0; offset + 4 <= length; offset++)
+			if ((p[offset] == 'I' && p[offset + 1] == 'I' &&
+					p[offset + 2] == 42 && p[offset + 3] == 0) ||
+				(p[offset] == 'M' && p[offset + 1] == 'M' &&
+					p[offset + 2] == 0 && p[offset + 3] == 42))
+				break;
+		if (offset + 4 > length)
+			offset = 0;
+
+		metadata->type = FOURCC('E', 'x', 'i', 'f');
+		metadata->length = length + 4;
+		metadata->data = g_malloc(metadata->length);
+		metadata->data[0] = offset >> 24;
+		metadata->data[1] = offset >> 16;
+		metadata->data[2] = offset >> 8;
+		metadata->data[3] = offset;
+		memcpy(metadata->data + 4, data, length);
+	}
+	else {
+		metadata->type = FOURCC('m', 'i', 'm', 'e');
+		metadata->content_type = "application/rdf+xml";
+		metadata->length = length;
+		metadata->data = vips_heif_grid_dup(data, length);
+	}
+
+	return 0;
+}
+
+void
+vips__heif_grid_set_primary(VipsHeifGrid *grid, int page_number)
+{
+	grid->primary = page_number;
+}
+
+/* An item we write.
+ */
+typedef struct _VipsHeifGridOutItem {
+	guint32 id;
+	guint32 type;
+	gboolean hidden;
+	const char *content_type;
+	const VipsPel *data;
+	size_t length;
+	int n_associations;
+	guint16 association[MAX_PROPERTIES + 1];
+} VipsHeifGridOutItem;
+
+/* A reference from one item to a set of items.
+ */
+typedef struct _VipsHeifGridOutReference {
+	guint32 type;
+	guint32 from;
+	int n_to;
+	guint32 *to;
+} VipsHeifGridOutReference;
+
+typedef struct _VipsHeifGridWriter {
+	VipsHeifGrid *grid;
+
+	GArray *items;
+	GArray *references;
+
+	/* Unique property boxes. Boxes are owned by the tiles, except for the
+	 * ispe boxes we make, which are in owned.
+	 */
+	GPtrArray *properties;
+	GArray *property_lengths;
+	GSList *owned;
+
+	guint32 next_id;
+	guint32 primary;
+} VipsHeifGridWriter;
+
+static int
+vips_heif_grid_writer_property(VipsHeifGridWriter *writer,
+	const VipsPel *box, size_t length)
+{
+	for (guint i = 0; i < writer->properties->len; i++)
+		if (g_array_index(writer->property_lengths, size_t, i) == length &&
+			memcmp(g_ptr_array_index(writer->properties, i),
+				box, length) == 0)
+			return i + 1;
+
+	g_ptr_array_add(writer->properties, (gpointer) box);
+	g_array_append_val(writer->property_lengths, length);
+
+	return writer->properties->len;
+}
+
+static int
+vips_heif_grid_writer_ispe(VipsHeifGridWriter *writer, int width, int height)
+{
+	VipsPel *box = g_malloc0(20);
+
+	box[3] = 20;
+	memcpy(box + 4, "ispe", 4);
+	for (int i = 0; i < 4; i++) {
+		box[12 + i] = width >> (24 - i * 8);
+		box[16 + i] = height >> (24 - i * 8);
+	}
+	writer->owned = g_slist_prepend(writer->owned, box);
+
+	return vips_heif_grid_writer_property(writer, box, 20);
+}
+
+static gboolean
+vips_heif_grid_is_transform(guint32 type)
+{
+	return type == FOURCC('i', 'r', 'o', 't') ||
+		type == FOURCC('i', 'm', 'i', 'r');
+}
+
+
+/* Properties which describe the reconstructed image, and so go on the grid
+ * item as well as the tiles.
+ */
+static gboolean
+vips_heif_grid_is_descriptive(guint32 type)
+{
+	return type == FOURCC('c', 'o', 'l', 'r') ||
+		type == FOURCC('p', 'i', 'x', 'i') ||
+		type == FOURCC('a', 'u', 'x', 'C') ||
+		type == FOURCC('c', 'l', 'l', 'i') ||
+		type == FOURCC('m', 'd', 'c', 'v') ||
+		type == FOURCC('p', 'a', 's', 'p');
+}
+
+static void
+vips_heif_grid_writer_associate(VipsHeifGridWriter *writer,
+	VipsHeifGridOutItem *out, const VipsHeifGridProperty *property)
+{
+	int index = vips_heif_grid_writer_property(writer,
+		property->box, property->length);
+
+	out->association[out->n_associations++] =
+		index | (property->essential ? 0x8000 : 0);
+}
+
+static VipsHeifGridOutItem *
+vips_heif_grid_writer_item(VipsHeifGridWriter *writer, guint32 type)
+{
+	VipsHeifGridOutItem item = { 0 };
+
+	item.id = writer->next_id++;
+	item.type = type;
+	g_array_append_val(writer->items, item);
+
+	return &g_array_index(writer->items, VipsHeifGridOutItem,
+		writer->items->len - 1);
+}
+
+static void
+vips_heif_grid_writer_reference(VipsHeifGridWriter *writer,
+	guint32 type, guint32 from, int n_to, guint32 *to)
+{
+	VipsHeifGridOutReference reference;
+
+	reference.type = type;
+	reference.from = from;
+	reference.n_to = n_to;
+	reference.to = vips_heif_grid_dup(to, n_to * sizeof(guint32));
+	g_array_append_val(writer->references, reference);
+}
+
+/* Add a grid item and its tiles. Select the image or alpha items with
+ * alpha.
+ */
+static guint32
+vips_heif_grid_writer_add_grid(VipsHeifGridWriter *writer,
+	VipsHeifGridPage *page, gboolean alpha)
+{
+	int n_tiles = page->tile_columns * page->tile_rows;
+	VipsHeifGridItem *first = alpha
+		? &page->tile[0].alpha
+		: &page->tile[0].image;
+
+	VipsHeifGridOutItem *item;
+	guint32 grid_id;
+	guint32 *to;
+
+	item = vips_heif_grid_writer_item(writer, FOURCC('g', 'r', 'i', 'd'));
+	grid_id = item->id;
+	item->data = page->grid;
+	item->length = page->grid_length;
+
+	/* ispe, then descriptive properties, then transforms, as the spec
+	 * requires.
+	 */
+	item->association[item->n_associations++] =
+		vips_heif_grid_writer_ispe(writer, page->width, page->height);
+	for (int i = 0; i < first->n_properties; i++)
+		if (vips_heif_grid_is_descriptive(first->property[i].type))
+			vips_heif_grid_writer_associate(writer,
+				item, &first->property[i]);
+	for (int i = 0; i < first->n_properties; i++)
+		if (vips_heif_grid_is_transform(first->property[i].type))
+			vips_heif_grid_writer_associate(writer,
+				item, &first->property[i]);
+
+	to = g_new(guint32, n_tiles);
+	for (int i = 0; i < n_tiles; i++) {
+		VipsHeifGridItem *tile = alpha
+			? &page->tile[i].alpha
+			: &page->tile[i].image;
+
+		item = vips_heif_grid_writer_item(writer, tile->type);
+		item->hidden = TRUE;
+		item->data = tile->data;
+		item->length = tile->length;
+		for (int j = 0; j < tile->n_properties; j++)
+			if (!vips_heif_grid_is_transform(tile->property[j].type))
+				vips_heif_grid_writer_associate(writer,
+					item, &tile->property[j]);
+
+		to[i] = item->id;
+	}
+
+	vips_heif_grid_writer_reference(writer,
+		FOURCC('d', 'i', 'm', 'g'), grid_id, n_tiles, to);
+	g_free(to);
+
+	return grid_id;
+}
+
+static int
+vips_heif_grid_writer_add_page(VipsHeifGridWriter *writer,
+	VipsHeifGridPage *page, gboolean primary)
+{
+	int n_tiles = page->tile_columns * page->tile_rows;
+
+	guint32 grid_id;
+
+	for (int i = 0; i < n_tiles; i++)
+		if (!page->tile[i].valid ||
+			page->tile[i].has_alpha != page->tile[0].has_alpha ||
+			page->tile[i].premultiplied != page->tile[0].premultiplied) {
+			vips_error("heifsave", "%s", _("missing tile"));
+			return -1;
+		}
+
+	/* Tiles, alpha tiles, a grid for each, and metadata.
+	 */
+	if (writer->next_id + 2 * (n_tiles + 1) + page->n_metadata >
+		MAX_ITEM_ID) {
+		vips_error("heifsave", "%s", _("too many tiles"));
+		return -1;
+	}
+
+	grid_id = vips_heif_grid_writer_add_grid(writer, page, FALSE);
+	if (primary)
+		writer->primary = grid_id;
+
+	if (page->tile[0].has_alpha) {
+		guint32 alpha_id =
+			vips_heif_grid_writer_add_grid(writer, page, TRUE);
+
+		vips_heif_grid_writer_reference(writer,
+			FOURCC('a', 'u', 'x', 'l'), alpha_id, 1, &grid_id);
+		if (page->tile[0].premultiplied)
+			vips_heif_grid_writer_reference(writer,
+				FOURCC('p', 'r', 'e', 'm'), grid_id, 1, &alpha_id);
+	}
+
+	for (int i = 0; i < page->n_metadata; i++) {
+		VipsHeifGridMetadata *metadata = &page->metadata[i];
+		VipsHeifGridOutItem *item;
+
+		item = vips_heif_grid_writer_item(writer, metadata->type);
+		item->content_type = metadata->content_type;
+		item->data = metadata->data;
+		item->length = metadata->length;
+
+		vips_heif_grid_writer_reference(writer,
+			FOURCC('c', 'd', 's', 'c'), item->id, 1, &grid_id);
+	}
+
+	return 0;
+}
+
+/* Write big-endian numbers.
+ */
+static void
+vips_heif_grid_put(VipsDbuf *dbuf, guint64 value, int bytes)
+{
+	VipsPel buf[8];
+
+	for (int i = 0; i < bytes; i++)
+		buf[i] = value >> ((bytes - i - 1) * 8);
+	vips_dbuf_write(dbuf, buf, bytes);
+}
+
+static void
+vips_heif_grid_put_fourcc(VipsDbuf *dbuf, guint32 type)
+{
+	vips_heif_grid_put(dbuf, type, 4);
+}
+
+/* Start a box, return the offset for vips_heif_grid_box_end().
+ */
+static off_t
+vips_heif_grid_box_start(VipsDbuf *dbuf, guint32 type)
+{
+	off_t start = vips_dbuf_tell(dbuf);
+
+	vips_heif_grid_put(dbuf, 0, 4);
+	vips_heif_grid_put_fourcc(dbuf, type);
+
+	return start;
+}
+
+static off_t
+vips_heif_grid_full_box_start(VipsDbuf *dbuf, guint32 type,
+	int version, guint32 flags)
+{
+	off_t start = vips_heif_grid_box_start(dbuf, type);
+
+	vips_heif_grid_put(dbuf, version, 1);
+	vips_heif_grid_put(dbuf, flags, 3);
+
+	return start;
+}
+
+static void
+vips_heif_grid_box_end(VipsDbuf *dbuf, off_t start)
+{
+	off_t end = vips_dbuf_tell(dbuf);
+
+	vips_dbuf_seek(dbuf, start, SEEK_SET);
+	vips_heif_grid_put(dbuf, end - start, 4);
+	vips_dbuf_seek(dbuf, end, SEEK_SET);
+}
+
+/* Write the meta box, with item data starting at base in the file.
+ */
+static void
+vips_heif_grid_writer_meta(VipsHeifGridWriter *writer, VipsDbuf *dbuf,
+	guint64 base, int offset_size)
+{
+	VipsHeifGridOutItem *items = (VipsHeifGridOutItem *) writer->items->data;
+	int n_items = writer->items->len;
+	int n_properties = writer->properties->len;
+
+	off_t meta;
+	off_t box;
+	guint64 offset;
+
+	meta = vips_heif_grid_full_box_start(dbuf, FOURCC('m', 'e', 't', 'a'),
+		0, 0);
+
+	box = vips_heif_grid_full_box_start(dbuf, FOURCC('h', 'd', 'l', 'r'),
+		0, 0);
+	vips_heif_grid_put(dbuf, 0, 4);
+	vips_heif_grid_put_fourcc(dbuf, FOURCC('p', 'i', 'c', 't'));
+	vips_heif_grid_put(dbuf, 0, 4);
+	vips_heif_grid_put(dbuf, 0, 4);
+	vips_heif_grid_put(dbuf, 0, 4);
+	vips_heif_grid_put(dbuf, 0, 1);
+	vips_heif_grid_box_end(dbuf, box);
+
+	box = vips_heif_grid_full_box_start(dbuf, FOURCC('p', 'i', 't', 'm'),
+		0, 0);
+	vips_heif_grid_put(dbuf, writer->primary, 2);
+	vips_heif_grid_box_end(dbuf, box);
+
+	box = vips_heif_grid_full_box_start(dbuf, FOURCC('i', 'l', 'o', 'c'),
+		1, 0);
+	vips_heif_grid_put(dbuf, offset_size << 4 | offset_size, 1);
+	vips_heif_grid_put(dbuf, 0, 1);
+	vips_heif_grid_put(dbuf, n_items, 2);
+	offset = base;
+	for (int i = 0; i < n_items; i++) {
+		vips_heif_grid_put(dbuf, items[i].id, 2);
+		vips_heif_grid_put(dbuf, 0, 2);
+		vips_heif_grid_put(dbuf, 0, 2);
+		vips_heif_grid_put(dbuf, 1, 2);
+		vips_heif_grid_put(dbuf, offset, offset_size);
+		vips_heif_grid_put(dbuf, items[i].length, offset_size);
+		offset += items[i].length;
+	}
+	vips_heif_grid_box_end(dbuf, box);
+
+	box = vips_heif_grid_full_box_start(dbuf, FOURCC('i', 'i', 'n', 'f'),
+		0, 0);
+	vips_heif_grid_put(dbuf, n_items, 2);
+	for (int i = 0; i < n_items; i++) {
+		off_t infe = vips_heif_grid_full_box_start(dbuf,
+			FOURCC('i', 'n', 'f', 'e'), 2, items[i].hidden ? 1 : 0);
+
+		vips_heif_grid_put(dbuf, items[i].id, 2);
+		vips_heif_grid_put(dbuf, 0, 2);
+		vips_heif_grid_put_fourcc(dbuf, items[i].type);
+		vips_heif_grid_put(dbuf, 0, 1);
+		if (items[i].content_type)
+			vips_dbuf_write(dbuf, (VipsPel *) items[i].content_type,
+				strlen(items[i].content_type) + 1);
+		vips_heif_grid_box_end(dbuf, infe);
+	}
+	vips_heif_grid_box_end(dbuf, box);
+
+	box = vips_heif_grid_full_box_start(dbuf, FOURCC('i', 'r', 'e', 'f'),
+		0, 0);
+	for (guint i = 0; i < writer->references->len; i++) {
+		VipsHeifGridOutReference *reference = &g_array_index(
+			writer->references, VipsHeifGridOutReference, i);
+		off_t ref = vips_heif_grid_box_start(dbuf, reference->type);
+
+		vips_heif_grid_put(dbuf, reference->from, 2);
+		vips_heif_grid_put(dbuf, reference->n_to, 2);
+		for (int j = 0; j < reference->n_to; j++)
+			vips_heif_grid_put(dbuf, reference->to[j], 2);
+		vips_heif_grid_box_end(dbuf, ref);
+	}
+	vips_heif_grid_box_end(dbuf, box);
+
+	box = vips_heif_grid_box_start(dbuf, FOURCC('i', 'p', 'r', 'p'));
+
+	off_t ipco = vips_heif_grid_box_start(dbuf, FOURCC('i', 'p', 'c', 'o'));
+	for (int i = 0; i < n_properties; i++)
+		vips_dbuf_write(dbuf, g_ptr_array_index(writer->properties, i),
+			g_array_index(writer->property_lengths, size_t, i));
+	vips_heif_grid_box_end(dbuf, ipco);
+
+	gboolean large = n_properties > 127;
+	int n_associated = 0;
+	for (int i = 0; i < n_items; i++)
+		if (items[i].n_associations > 0)
+			n_associated += 1;
+
+	off_t ipma = vips_heif_grid_full_box_start(dbuf,
+		FOURCC('i', 'p', 'm', 'a'), 0, large ? 1 : 0);
+	vips_heif_grid_put(dbuf, n_associated, 4);
+	for (int i = 0; i < n_items; i++)
+		if (items[i].n_associations > 0) {
+			vips_heif_grid_put(dbuf, items[i].id, 2);
+			vips_heif_grid_put(dbuf, items[i].n_associations, 1);
+			for (int j = 0; j < items[i].n_associations; j++) {
+				guint16 v = items[i].association[j];
+
+				if (large)
+					vips_heif_grid_put(dbuf, v, 2);
+				else
+					vips_heif_grid_put(dbuf,
+						(v & 0x8000 ? 0x80 : 0) | (v & 0x7f), 1);
+			}
+		}
+	vips_heif_grid_box_end(dbuf, ipma);
+
+	vips_heif_grid_box_end(dbuf, box);
+
+	vips_heif_grid_box_end(dbuf, meta);
+}
+
+static void
+vips_heif_grid_writer_free(VipsHeifGridWriter *writer)
+{
+	for (guint i = 0; i < writer->references->len; i++)
+		g_free(g_array_index(writer->references,
+			VipsHeifGridOutReference, i).to);
+	g_array_free(writer->references, TRUE);
+	g_array_free(writer->items, TRUE);
+	g_ptr_array_free(writer->properties, TRUE);
+	g_array_free(writer->property_lengths, TRUE);
+	g_slist_free_full(writer->owned, g_free);
+}
+
+/* Write the whole file to a target.
+ */
+int
+vips__heif_grid_write(VipsHeifGrid *grid, VipsTarget *target)
+{
+	VipsHeifGridWriter writer = { 0 };
+	VipsDbuf dbuf;
+	VipsHeifGridOutItem *items;
+	guint64 data_length;
+	gboolean large;
+	const VipsPel *meta;
+	size_t meta_length;
+	guint64 base;
+	int result;
+
+	if (grid->n_pages == 0 ||
+		!grid->ftyp) {
+		vips_error("heifsave", "%s", _("no tiles"));
+		return -1;
+	}
+
+	writer.grid = grid;
+	writer.items = g_array_new(FALSE, FALSE, sizeof(VipsHeifGridOutItem));
+	writer.references =
+		g_array_new(FALSE, FALSE, sizeof(VipsHeifGridOutReference));
+	writer.properties = g_ptr_array_new();
+	writer.property_lengths = g_array_new(FALSE, FALSE, sizeof(size_t));
+	writer.next_id = 1;
+
+	for (int i = 0; i < grid->n_pages; i++)
+		if (vips_heif_grid_writer_add_page(&writer, grid->page[i],
+				i == grid->primary)) {
+			vips_heif_grid_writer_free(&writer);
+			return -1;
+		}
+
+	items = (VipsHeifGridOutItem *) writer.items->data;
+	data_length = 0;
+	for (guint i = 0; i < writer.items->len; i++)
+		data_length += items[i].length;
+
+	/* Leave plenty of room for the meta box.
+	 */
+	large = data_length > 0xffffffffu - 64 * 1024 * 1024;
+
+	/* We need the meta size for the item offsets, so write it twice.
+	 */
+	vips_dbuf_init(&dbuf);
+	vips_heif_grid_writer_meta(&writer, &dbuf, 0, large ? 8 : 4);
+	meta_length = vips_dbuf_tell(&dbuf);
+	base = grid->ftyp_length + meta_length + (large ? 16 : 8);
+	vips_dbuf_reset(&dbuf);
+	vips_heif_grid_writer_meta(&writer, &dbuf, base, large ? 8 : 4);
+	meta = vips_dbuf_string(&dbuf, &meta_length);
+
+	result = 0;
+	if (vips_target_write(target, grid->ftyp, grid->ftyp_length) ||
+		vips_target_write(target, meta, meta_length))
+		result = -1;
+
+	if (!result) {
+		VipsPel header[16];
+		int header_length;
+
+		if (large) {
+			guint64 size = data_length + 16;
+
+			header[0] = header[1] = header[2] = 0;
+			header[3] = 1;
+			memcpy(header + 4, "mdat", 4);
+			for (int i = 0; i < 8; i++)
+				header[8 + i] = size >> (56 - i * 8);
+			header_length = 16;
+		}
+		else {
+			guint32 size = data_length + 8;
+
+			for (int i = 0; i < 4; i++)
+				header[i] = size >> (24 - i * 8);
+			memcpy(header + 4, "mdat", 4);
+			header_length = 8;
+		}
+
+		if (vips_target_write(target, header, header_length))
+			result = -1;
+	}
+
+	for (guint i = 0; !result && i < writer.items->len; i++)
+		if (vips_target_write(target, items[i].data, items[i].length))
+			result = -1;
+
+	vips_dbuf_destroy(&dbuf);
+	vips_heif_grid_writer_free(&writer);
+
+	return result;
+}
+
+#endif /*HAVE_HEIF*/
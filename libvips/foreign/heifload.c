@@ -28,6 +28,13 @@
  * 	- add @unlimited
  * 13/03/23 MathemanFlo
  * 	- add bits per sample metadata
+ * 14/10/26
+ * 	- parse mappable sources in place
+ * 	- cancel decode on kill or deadline, with libheif 1.19+
+ * 15/10/26
+ * 	- add @parallel
+ * 	- add @threads
+ * 	- decode grid images a tile at a time, with libheif 1.19+
  */
 
 /*
@@ -143,6 +150,14 @@ typedef struct _VipsForeignLoadHeif {
 	 */
 	gboolean unlimited;
 
+	/* Decode pages in parallel.
+	 */
+	gboolean parallel;
+
+	/* Decoder threads, 0 for the vips concurrency.
+	 */
+	int threads;
+
 	/* Context for this image.
 	 */
 	struct heif_context *ctx;
@@ -194,6 +209,13 @@ typedef struct _VipsForeignLoadHeif {
 	 */
 	struct heif_image *img;
 
+#ifdef HAVE_HEIF_DECODE_IMAGE_TILE
+	/* The grid layout of @handle, if we are decoding a tile at a time.
+	 */
+	gboolean tiled;
+	struct heif_image_tiling tiling;
+#endif /*HAVE_HEIF_DECODE_IMAGE_TILE*/
+
 	/* Valid until img is released.
 	 */
 	int stride;
@@ -355,6 +377,12 @@ vips_foreign_load_heif_build(VipsObject *object)
 		 */
 		heif_context_set_maximum_image_size_limit(heif->ctx,
 			heif->unlimited ? USHRT_MAX : 0x4000);
+#ifdef HAVE_HEIF_CONTEXT_SET_MAX_DECODING_THREADS
+		/* libheif decodes grid tiles on this many threads.
+		 */
+		heif_context_set_max_decoding_threads(heif->ctx,
+			heif->threads > 0 ? heif->threads : vips_concurrency_get());
+#endif /*HAVE_HEIF_CONTEXT_SET_MAX_DECODING_THREADS*/
 #ifdef HAVE_HEIF_MAX_TOTAL_MEMORY
 		if (!heif->unlimited) {
 			heif_security_limits *limits =
@@ -370,8 +398,22 @@ vips_foreign_load_heif_build(VipsObject *object)
 			heif_context_set_security_limits(heif->ctx,
 				heif_get_disabled_security_limits());
 #endif /* HAVE_HEIF_GET_DISABLED_SECURITY_LIMITS */
-		error = heif_context_read_from_reader(heif->ctx,
-			heif->reader, heif, NULL);
+		/* If we can see the whole input in memory, libheif can
+		 * parse it in place. Otherwise it must buffer what it reads.
+		 */
+		if (heif->source &&
+			vips_source_is_mappable(heif->source)) {
+			const void *data;
+			size_t length;
+
+			if (!(data = vips_source_map(heif->source, &length)))
+				return -1;
+			error = heif_context_read_from_memory_without_copy(heif->ctx,
+				data, length, NULL);
+		}
+		else
+			error = heif_context_read_from_reader(heif->ctx,
+				heif->reader, heif, NULL);
 		if (error.code) {
 			vips__heif_error(&error);
 			return -1;
@@ -434,9 +476,18 @@ vips_foreign_load_heif_is_a(const char *buf, int len)
 static VipsForeignFlags
 vips_foreign_load_heif_get_flags(VipsForeignLoad *load)
 {
+	VipsForeignLoadHeif *heif = (VipsForeignLoadHeif *) load;
+
+	VipsForeignFlags flags;
+
 	/* FIXME .. could support random access for grid images.
 	 */
-	return VIPS_FOREIGN_SEQUENTIAL;
+	flags = VIPS_FOREIGN_SEQUENTIAL;
+	if (heif->source &&
+		vips_source_is_mappable(heif->source))
+		flags |= VIPS_FOREIGN_ZERO_COPY;
+
+	return flags;
 }
 
 /* We've selected the page. Try to select the associated thumbnail instead,
@@ -1006,6 +1057,52 @@ vips_foreign_load_heif_header(VipsForeignLoad *load)
 	return 0;
 }
 
+#ifdef HAVE_HEIF_DECODING_OPTIONS_CANCEL_DECODING
+/* libheif polls this during long decodes.
+ */
+static int
+vips_foreign_load_heif_cancel(void *progress_user_data)
+{
+	VipsImage *image = (VipsImage *) progress_user_data;
+
+	return vips_image_iskilled(image);
+}
+#endif /*HAVE_HEIF_DECODING_OPTIONS_CANCEL_DECODING*/
+
+static struct heif_decoding_options *
+vips_foreign_load_heif_options(VipsImage *image)
+{
+	struct heif_decoding_options *options;
+
+	options = heif_decoding_options_alloc();
+#ifdef HAVE_HEIF_DECODING_OPTIONS_CANCEL_DECODING
+	options->progress_user_data = image;
+	options->cancel_decoding = vips_foreign_load_heif_cancel;
+#endif /*HAVE_HEIF_DECODING_OPTIONS_CANCEL_DECODING*/
+
+	return options;
+}
+
+/* We ask for big endian for high bit depth images, we must swap to native
+ * and shift to fill 16 bits.
+ */
+static void
+vips_foreign_load_heif_unpack(VipsForeignLoadHeif *heif, VipsPel *p, int ne)
+{
+	if (heif->bits_per_pixel > 8) {
+		int shift = 16 - heif->bits_per_pixel;
+
+		int i;
+
+		for (i = 0; i < ne; i++) {
+			guint16 v = ((p[0] << 8) | p[1]) << shift;
+
+			*((guint16 *) p) = v;
+			p += 2;
+		}
+	}
+}
+
 static int
 vips_foreign_load_heif_generate(VipsRegion *out_region,
 	void *seq, void *a, void *b, gboolean *stop)
@@ -1033,7 +1130,7 @@ vips_foreign_load_heif_generate(VipsRegion *out_region,
 		struct heif_error error;
 		struct heif_decoding_options *options;
 
-		options = heif_decoding_options_alloc();
+		options = vips_foreign_load_heif_options(out_region->im);
 		error = heif_decode_image(heif->handle, &heif->img,
 			heif_colorspace_RGB,
 			chroma,
@@ -1077,30 +1174,108 @@ vips_foreign_load_heif_generate(VipsRegion *out_region,
 	memcpy(VIPS_REGION_ADDR(out_region, 0, r->top),
 		heif->data + (size_t) heif->stride * line,
 		VIPS_IMAGE_SIZEOF_LINE(out_region->im));
+	vips_foreign_load_heif_unpack(heif,
+		VIPS_REGION_ADDR(out_region, 0, r->top),
+		VIPS_REGION_N_ELEMENTS(out_region));
 
-	/* We may need to swap bytes and shift to fill 16 bits.
-	 */
-	if (heif->bits_per_pixel > 8) {
-		int shift = 16 - heif->bits_per_pixel;
-		int ne = VIPS_REGION_N_ELEMENTS(out_region);
+	return 0;
+}
 
-		int i;
-		VipsPel *p;
+#ifdef HAVE_HEIF_DECODE_IMAGE_TILE
+/* Single page grid images can decode just the tiles we need. We are inside a
+ * tilecache with the grid tile size, so each request is a single tile.
+ */
+static int
+vips_foreign_load_heif_generate_tile(VipsRegion *out_region,
+	void *seq, void *a, void *b, gboolean *stop)
+{
+	VipsForeignLoadHeif *heif = (VipsForeignLoadHeif *) a;
+	VipsObjectClass *class = VIPS_OBJECT_GET_CLASS(heif);
+	VipsRect *r = &out_region->valid;
+	int tile_x = r->left / heif->tiling.tile_width;
+	int tile_y = r->top / heif->tiling.tile_height;
+	size_t sizeof_line = VIPS_REGION_SIZEOF_LINE(out_region);
+	int ne = r->width * out_region->im->Bands;
 
-		p = VIPS_REGION_ADDR(out_region, 0, r->top);
-		for (i = 0; i < ne; i++) {
-			/* We've asked for big endian, we must write native.
-			 */
-			guint16 v = ((p[0] << 8) | p[1]) << shift;
+	enum heif_chroma chroma =
+		vips__heif_chroma(heif->bits_per_pixel, heif->has_alpha);
 
-			*((guint16 *) p) = v;
-			p += 2;
-		}
+	struct heif_error error;
+	struct heif_decoding_options *options;
+	struct heif_image *img;
+	const uint8_t *data;
+	int stride;
+	int y;
+
+#ifdef DEBUG_VERBOSE
+	printf("vips_foreign_load_heif_generate_tile: %d x %d\n",
+		tile_x, tile_y);
+#endif /*DEBUG_VERBOSE*/
+
+	g_assert(r->left % heif->tiling.tile_width == 0);
+	g_assert(r->top % heif->tiling.tile_height == 0);
+
+	options = vips_foreign_load_heif_options(out_region->im);
+	error = heif_image_handle_decode_image_tile(heif->handle, &img,
+		heif_colorspace_RGB,
+		chroma,
+		options,
+		tile_x, tile_y);
+	heif_decoding_options_free(options);
+	if (error.code) {
+		vips__heif_error(&error);
+		return -1;
+	}
+
+	/* Edge tiles can be larger than the part of the image they cover.
+	 */
+	if (heif_image_get_width(img, heif_channel_interleaved) < r->width ||
+		heif_image_get_height(img, heif_channel_interleaved) < r->height ||
+		!(data = heif_image_get_plane_readonly(img,
+			  heif_channel_interleaved, &stride))) {
+		heif_image_release(img);
+		vips_error(class->nickname,
+			"%s", _("bad tile dimensions on decode"));
+		return -1;
+	}
+
+	for (y = 0; y < r->height; y++) {
+		VipsPel *q = VIPS_REGION_ADDR(out_region, r->left, r->top + y);
+
+		memcpy(q, data + (size_t) stride * y, sizeof_line);
+		vips_foreign_load_heif_unpack(heif, q, ne);
 	}
 
+	heif_image_release(img);
+
 	return 0;
 }
 
+/* Decide if we can decode a tile at a time. We need a single page with a
+ * grid layout that matches the header.
+ */
+static gboolean
+vips_foreign_load_heif_is_tiled(VipsForeignLoadHeif *heif)
+{
+	struct heif_error error;
+
+	if (heif->n != 1 ||
+		vips_foreign_load_heif_set_page(heif, heif->page, heif->thumbnail))
+		return FALSE;
+
+	error = heif_image_handle_get_image_tiling(heif->handle, 1,
+		&heif->tiling);
+	if (error.code)
+		return FALSE;
+
+	return heif->tiling.num_columns * heif->tiling.num_rows > 1 &&
+		heif->tiling.tile_width > 0 &&
+		heif->tiling.tile_height > 0 &&
+		heif->tiling.image_width == heif->page_width &&
+		heif->tiling.image_height == heif->page_height;
+}
+#endif /*HAVE_HEIF_DECODE_IMAGE_TILE*/
+
 static void
 vips_foreign_load_heif_minimise(VipsObject *object, VipsForeignLoadHeif *heif)
 {
@@ -1119,6 +1294,11 @@ vips_foreign_load_heif_load(VipsForeignLoad *load)
 	printf("vips_foreign_load_heif_load: loading image\n");
 #endif /*DEBUG*/
 
+	if (heif->parallel &&
+		heif->n > 1 &&
+		vips__foreign_load_pages_can(load))
+		return vips__foreign_load_pages(load, load->real, 0, NULL);
+
 	t[0] = vips_image_new();
 	if (vips_foreign_load_heif_set_header(heif, t[0]))
 		return -1;
@@ -1128,6 +1308,29 @@ vips_foreign_load_heif_load(VipsForeignLoad *load)
 	g_signal_connect(t[0], "minimise",
 		G_CALLBACK(vips_foreign_load_heif_minimise), heif);
 
+#ifdef HAVE_HEIF_DECODE_IMAGE_TILE
+	if ((heif->tiled = vips_foreign_load_heif_is_tiled(heif))) {
+		/* Enough tiles for two complete rows, plus 50%.
+		 */
+		if (vips_image_pipelinev(t[0], VIPS_DEMAND_STYLE_SMALLTILE, NULL) ||
+			vips_image_generate(t[0],
+				NULL, vips_foreign_load_heif_generate_tile, NULL,
+				heif, NULL) ||
+			vips_tilecache(t[0], &t[1],
+				"tile_width", heif->tiling.tile_width,
+				"tile_height", heif->tiling.tile_height,
+				"max_tiles", 3 * heif->tiling.num_columns,
+				NULL) ||
+			vips_image_write(t[1], load->real))
+			return -1;
+
+		if (vips_source_decode(heif->source))
+			return -1;
+
+		return 0;
+	}
+#endif /*HAVE_HEIF_DECODE_IMAGE_TILE*/
+
 	if (vips_image_generate(t[0],
 			NULL, vips_foreign_load_heif_generate, NULL, heif, NULL) ||
 		vips_sequential(t[0], &t[1], NULL) ||
@@ -1140,6 +1343,13 @@ vips_foreign_load_heif_load(VipsForeignLoad *load)
 	return 0;
 }
 
+/* An ISOBMFF ftyp box.
+ */
+static const VipsForeignMagic vips_foreign_load_heif_magic[] = {
+	{ 4, 4, "ftyp" },
+	{ 0, 0, NULL }
+};
+
 static void
 vips_foreign_load_heif_class_init(VipsForeignLoadHeifClass *class)
 {
@@ -1164,6 +1374,7 @@ vips_foreign_load_heif_class_init(VipsForeignLoadHeifClass *class)
 
 	load_class->get_flags = vips_foreign_load_heif_get_flags;
 	load_class->header = vips_foreign_load_heif_header;
+	load_class->magic = vips_foreign_load_heif_magic;
 	load_class->load = vips_foreign_load_heif_load;
 
 	VIPS_ARG_INT(class, "page", 2,
@@ -1202,6 +1413,20 @@ vips_foreign_load_heif_class_init(VipsForeignLoadHeifClass *class)
 		G_STRUCT_OFFSET(VipsForeignLoadHeif, unlimited),
 		FALSE);
 #endif
+
+	VIPS_ARG_BOOL(class, "parallel", 23,
+		_("Parallel"),
+		_("Decode pages in parallel"),
+		VIPS_ARGUMENT_OPTIONAL_INPUT,
+		G_STRUCT_OFFSET(VipsForeignLoadHeif, parallel),
+		FALSE);
+
+	VIPS_ARG_INT(class, "threads", 24,
+		_("Threads"),
+		_("Decoder threads, 0 for the vips concurrency"),
+		VIPS_ARGUMENT_OPTIONAL_INPUT,
+		G_STRUCT_OFFSET(VipsForeignLoadHeif, threads),
+		0, 1024, 0);
 }
 
 static gint64
@@ -18,6 +18,12 @@
  *  - improve rules for 16-bit write [johntrunc]
  * xx/01/26 [Starbix]
  *  - write nclx tag if in CICP colour space
+ * 14/10/26
+ *  - add tile_width, tile_height to write grid images a strip at a time
+ *  - encode grid tiles in parallel and assemble the grid ourselves
+ * 15/10/26
+ *  - round grid tiles up to an even size
+ *  - check for kill and deadline before each page encode
  */
 
 /*
@@ -136,6 +142,34 @@ typedef struct _VipsForeignSaveHeif {
 	 */
 	const char *tune;
 
+	/* Write a grid image with tiles of this size. Zero means a single
+	 * image per page.
+	 */
+	int tile_width;
+	int tile_height;
+
+	/* Grid write. We build a strip of tiles as we scan down the page, and
+	 * encode them in parallel as soon as the strip fills.
+	 */
+	int tile_columns;
+	int tile_rows;
+	struct heif_image **tile;
+	uint8_t **tile_data;
+	int tile_stride;
+
+	/* Bytes per pixel in tiles.
+	 */
+	int pixel_size;
+
+	/* Each tile is encoded to a separate HEIF in memory, then the
+	 * encoded tiles are assembled into the grid file here.
+	 */
+	VipsHeifGrid *grid;
+
+	/* The encoder we looked up in build, or NULL for the default.
+	 */
+	const struct heif_encoder_descriptor *descriptor;
+
 } VipsForeignSaveHeif;
 
 typedef VipsForeignSaveClass VipsForeignSaveHeifClass;
@@ -150,6 +184,12 @@ vips_foreign_save_heif_dispose(GObject *gobject)
 
 	VIPS_UNREF(heif->target);
 	VIPS_FREEF(heif_image_release, heif->img);
+	if (heif->tile)
+		for (int i = 0; i < heif->tile_columns; i++)
+			VIPS_FREEF(heif_image_release, heif->tile[i]);
+	VIPS_FREE(heif->tile);
+	VIPS_FREE(heif->tile_data);
+	VIPS_FREEF(vips__heif_grid_free, heif->grid);
 	VIPS_FREEF(heif_image_handle_release, heif->handle);
 	VIPS_FREEF(heif_encoder_release, heif->encoder);
 	VIPS_FREEF(heif_context_free, heif->ctx);
@@ -207,7 +247,7 @@ vips_foreign_save_heif_write_metadata(VipsForeignSaveHeif *heif)
 }
 
 static int
-vips_foreign_save_heif_add_icc(VipsForeignSaveHeif *heif,
+vips_foreign_save_heif_add_icc(struct heif_image *img,
 	const void *profile, size_t length)
 {
 #ifdef DEBUG
@@ -215,7 +255,7 @@ vips_foreign_save_heif_add_icc(VipsForeignSaveHeif *heif,
 #endif /*DEBUG*/
 
 	struct heif_error error;
-	error = heif_image_set_raw_color_profile(heif->img,
+	error = heif_image_set_raw_color_profile(img,
 		"rICC", profile, length);
 
 	if (error.code) {
@@ -227,7 +267,7 @@ vips_foreign_save_heif_add_icc(VipsForeignSaveHeif *heif,
 }
 
 static int
-vips_foreign_save_heif_add_custom_icc(VipsForeignSaveHeif *heif,
+vips_foreign_save_heif_add_custom_icc(struct heif_image *img,
 	const char *profile)
 {
 	VipsBlob *blob;
@@ -239,7 +279,7 @@ vips_foreign_save_heif_add_custom_icc(VipsForeignSaveHeif *heif,
 		size_t length;
 		const void *data = vips_blob_get(blob, &length);
 
-		if (vips_foreign_save_heif_add_icc(heif, data, length)) {
+		if (vips_foreign_save_heif_add_icc(img, data, length)) {
 			vips_area_unref((VipsArea *) blob);
 			return -1;
 		}
@@ -251,7 +291,8 @@ vips_foreign_save_heif_add_custom_icc(VipsForeignSaveHeif *heif,
 }
 
 static int
-vips_foreign_save_heif_add_orig_icc(VipsForeignSaveHeif *heif)
+vips_foreign_save_heif_add_orig_icc(VipsForeignSaveHeif *heif,
+	struct heif_image *img)
 {
 	VipsForeignSave *save = (VipsForeignSave *) heif;
 
@@ -261,7 +302,7 @@ vips_foreign_save_heif_add_orig_icc(VipsForeignSaveHeif *heif)
 	if (vips_image_get_blob(save->ready, VIPS_META_ICC_NAME, &data, &length))
 		return -1;
 
-	if (vips_foreign_save_heif_add_icc(heif, data, length))
+	if (vips_foreign_save_heif_add_icc(img, data, length))
 		return -1;
 
 	return 0;
@@ -326,33 +367,57 @@ vips_foreign_save_heif_get_clli(VipsImage *image,
 }
 #endif /*HAVE_HEIF_CONTENT_LIGHT_LEVEL*/
 
+/* Attach the profile and light level to an image we will encode.
+ */
 static int
-vips_foreign_save_heif_write_page(VipsForeignSaveHeif *heif, int page)
+vips_foreign_save_heif_set_profile(VipsForeignSaveHeif *heif,
+	struct heif_image *img)
 {
 	VipsForeignSave *save = (VipsForeignSave *) heif;
 
-	struct heif_error error;
-	struct heif_encoding_options *options;
-#ifdef HAVE_HEIF_ENCODING_OPTIONS_OUTPUT_NCLX_PROFILE
-	struct heif_color_profile_nclx *nclx = NULL;
-#endif
-
 	/* A profile supplied as an argument overrides an embedded
 	 * profile.
 	 */
 	if (save->profile) {
-		if (vips_foreign_save_heif_add_custom_icc(heif, save->profile))
+		if (vips_foreign_save_heif_add_custom_icc(img, save->profile))
 			return -1;
 	}
 	else if (vips_image_get_typeof(save->ready, VIPS_META_ICC_NAME)) {
-		if (vips_foreign_save_heif_add_orig_icc(heif))
+		if (vips_foreign_save_heif_add_orig_icc(heif, img))
 			return -1;
 	}
 
+#ifdef HAVE_HEIF_CONTENT_LIGHT_LEVEL
+	heif_content_light_level clli;
+
+	if (vips_foreign_save_heif_get_clli(save->ready, &clli))
+		heif_image_set_content_light_level(img, &clli);
+#endif /*HAVE_HEIF_CONTENT_LIGHT_LEVEL*/
+
+	return 0;
+}
+
+static void
+vips_foreign_save_heif_options_free(struct heif_encoding_options *options)
+{
+#ifdef HAVE_HEIF_ENCODING_OPTIONS_OUTPUT_NCLX_PROFILE
+	VIPS_FREEF(heif_nclx_color_profile_free, options->output_nclx_profile);
+#endif /*HAVE_HEIF_ENCODING_OPTIONS_OUTPUT_NCLX_PROFILE*/
+	heif_encoding_options_free(options);
+}
+
+static struct heif_encoding_options *
+vips_foreign_save_heif_options_new(VipsForeignSaveHeif *heif)
+{
+	VipsForeignSave *save = (VipsForeignSave *) heif;
+
+	struct heif_encoding_options *options;
+
 	options = heif_encoding_options_alloc();
 	options->save_alpha_channel = save->ready->Bands > 3;
 
 #ifdef HAVE_HEIF_ENCODING_OPTIONS_OUTPUT_NCLX_PROFILE
+	struct heif_color_profile_nclx *nclx;
 	int colour_primaries;
 	int transfer_characteristics;
 	int matrix_coefficients;
@@ -364,7 +429,7 @@ vips_foreign_save_heif_write_page(VipsForeignSaveHeif *heif, int page)
 
 		if (!(nclx = heif_nclx_color_profile_alloc())) {
 			heif_encoding_options_free(options);
-			return -1;
+			return NULL;
 		}
 
 		nclx->color_primaries = colour_primaries;
@@ -391,7 +456,7 @@ vips_foreign_save_heif_write_page(VipsForeignSaveHeif *heif, int page)
 	else if (heif->lossless) {
 		if (!(nclx = heif_nclx_color_profile_alloc())) {
 			heif_encoding_options_free(options);
-			return -1;
+			return NULL;
 		}
 
 		nclx->matrix_coefficients = heif_matrix_coefficients_RGB_GBR;
@@ -410,35 +475,17 @@ vips_foreign_save_heif_write_page(VipsForeignSaveHeif *heif, int page)
 	options->image_orientation = vips_image_get_orientation(save->ready);
 #endif
 
-#ifdef HAVE_HEIF_CONTENT_LIGHT_LEVEL
-	heif_content_light_level clli;
-
-	if (vips_foreign_save_heif_get_clli(save->ready, &clli))
-		heif_image_set_content_light_level(heif->img, &clli);
-#endif /*HAVE_HEIF_CONTENT_LIGHT_LEVEL*/
-
-#ifdef DEBUG
-	GTimer *timer = g_timer_new();
-	printf("calling heif_context_encode_image() ...\n");
-#endif /*DEBUG*/
-
-	error = heif_context_encode_image(heif->ctx,
-		heif->img, heif->encoder, options, &heif->handle);
-
-#ifdef DEBUG
-	printf("... libheif took %.2g seconds\n", g_timer_elapsed(timer, NULL));
-	g_timer_destroy(timer);
-#endif /*DEBUG*/
+	return options;
+}
 
-	heif_encoding_options_free(options);
-#ifdef HAVE_HEIF_ENCODING_OPTIONS_OUTPUT_NCLX_PROFILE
-	VIPS_FREEF(heif_nclx_color_profile_free, nclx);
-#endif
+/* The current page has been encoded to heif->handle, add the final bits.
+ */
+static int
+vips_foreign_save_heif_finish_page(VipsForeignSaveHeif *heif, int page)
+{
+	VipsForeignSave *save = (VipsForeignSave *) heif;
 
-	if (error.code) {
-		vips__heif_error(&error);
-		return -1;
-	}
+	struct heif_error error;
 
 	if (vips_image_get_typeof(save->ready, "heif-primary")) {
 		int primary;
@@ -463,6 +510,47 @@ vips_foreign_save_heif_write_page(VipsForeignSaveHeif *heif, int page)
 	return 0;
 }
 
+static int
+vips_foreign_save_heif_write_page(VipsForeignSaveHeif *heif, int page)
+{
+	struct heif_error error;
+	struct heif_encoding_options *options;
+
+	VipsForeignSave *save = (VipsForeignSave *) heif;
+
+	/* libheif can't stop an encode once it's started, so check before
+	 * each page.
+	 */
+	if (vips_image_iskilled(save->ready))
+		return -1;
+
+	if (vips_foreign_save_heif_set_profile(heif, heif->img) ||
+		!(options = vips_foreign_save_heif_options_new(heif)))
+		return -1;
+
+#ifdef DEBUG
+	GTimer *timer = g_timer_new();
+	printf("calling heif_context_encode_image() ...\n");
+#endif /*DEBUG*/
+
+	error = heif_context_encode_image(heif->ctx,
+		heif->img, heif->encoder, options, &heif->handle);
+
+#ifdef DEBUG
+	printf("... libheif took %.2g seconds\n", g_timer_elapsed(timer, NULL));
+	g_timer_destroy(timer);
+#endif /*DEBUG*/
+
+	vips_foreign_save_heif_options_free(options);
+
+	if (error.code) {
+		vips__heif_error(&error);
+		return -1;
+	}
+
+	return vips_foreign_save_heif_finish_page(heif, page);
+}
+
 static int
 vips_foreign_save_heif_pack(VipsForeignSaveHeif *heif,
 	VipsPel *q, VipsPel *p, int ne)
@@ -541,6 +629,432 @@ vips_foreign_save_heif_pack(VipsForeignSaveHeif *heif,
 	return 0;
 }
 
+/* Make and configure an encoder for ctx.
+ */
+static struct heif_encoder *
+vips_foreign_save_heif_encoder_new(VipsForeignSaveHeif *heif,
+	struct heif_context *ctx, int threads)
+{
+	struct heif_error error;
+	struct heif_encoder *encoder;
+	char *chroma;
+#ifdef HAVE_HEIF_ENCODER_PARAMETER_GET_VALID_INTEGER_VALUES
+	const struct heif_encoder_parameter *const *param;
+#endif
+
+	if (heif->descriptor)
+		error = heif_context_get_encoder(ctx, heif->descriptor, &encoder);
+	else
+		error = heif_context_get_encoder_for_format(ctx,
+			(enum heif_compression_format) heif->compression,
+			&encoder);
+	if (error.code) {
+		if (error.code == heif_error_Unsupported_filetype)
+			vips_error("heifsave", "%s", _("Unsupported compression"));
+		else
+			vips__heif_error(&error);
+
+		return NULL;
+	}
+
+	error = heif_encoder_set_lossy_quality(encoder, heif->Q);
+	if (error.code)
+		goto error;
+
+	error = heif_encoder_set_lossless(encoder, heif->lossless);
+	if (error.code)
+		goto error;
+
+	error = heif_encoder_set_parameter_integer(encoder,
+		"speed", 9 - heif->effort);
+	if (error.code &&
+		error.subcode != heif_suberror_Unsupported_parameter)
+		goto error;
+
+	chroma = heif->subsample_mode == VIPS_FOREIGN_SUBSAMPLE_OFF ||
+			(heif->subsample_mode == VIPS_FOREIGN_SUBSAMPLE_AUTO &&
+				heif->Q >= 90)
+		? "444"
+		: "420";
+	error = heif_encoder_set_parameter_string(encoder,
+		"chroma", chroma);
+	if (error.code &&
+		error.subcode != heif_suberror_Unsupported_parameter)
+		goto error;
+
+#ifdef HAVE_HEIF_ENCODER_PARAMETER_GET_VALID_INTEGER_VALUES
+	for (param = heif_encoder_list_parameters(encoder);
+		*param; param++) {
+		int have_minimum;
+		int have_maximum;
+		int minimum;
+		int maximum;
+
+		if (strcmp(heif_encoder_parameter_get_name(*param), "threads") != 0)
+			continue;
+
+		error = heif_encoder_parameter_get_valid_integer_values(*param,
+			&have_minimum, &have_maximum, &minimum, &maximum, NULL, NULL);
+		if (error.code)
+			goto error;
+
+		error = heif_encoder_set_parameter_integer(encoder,
+			"threads", VIPS_CLIP(minimum, threads, maximum));
+		if (error.code &&
+			error.subcode != heif_suberror_Unsupported_parameter)
+			goto error;
+	}
+#endif /*HAVE_HEIF_ENCODER_PARAMETER_GET_VALID_INTEGER_VALUES*/
+
+	/* Try to enable auto_tiles. This can make AVIF encoding a lot faster,
+	 * with only a very small increase in file size.
+	 */
+	error = heif_encoder_set_parameter_boolean(encoder,
+		"auto-tiles", TRUE);
+	if (error.code &&
+		error.subcode != heif_suberror_Unsupported_parameter)
+		goto error;
+
+	/* Try to prevent the AVIF encoder from using intra block copy,
+	 * helps ensure encoding time is more predictable.
+	 */
+	error = heif_encoder_set_parameter_boolean(encoder,
+		"enable-intrabc", FALSE);
+	if (error.code &&
+		error.subcode != heif_suberror_Unsupported_parameter)
+		goto error;
+
+	if (heif->tune) {
+		error = heif_encoder_set_parameter_string(encoder,
+			"tune", heif->tune);
+		if (error.code &&
+			error.subcode != heif_suberror_Unsupported_parameter)
+			goto error;
+	}
+
+	/* TODO .. support extra per-encoder params with
+	 * heif_encoder_list_parameters().
+	 */
+
+	return encoder;
+
+error:
+	vips__heif_error(&error);
+	heif_encoder_release(encoder);
+
+	return NULL;
+}
+
+/* Make the image for one tile in the strip.
+ */
+static int
+vips_foreign_save_heif_tile_new(VipsForeignSaveHeif *heif, int i)
+{
+	VipsForeignSave *save = (VipsForeignSave *) heif;
+
+	struct heif_error error;
+
+	error = heif_image_create(heif->tile_width, heif->tile_height,
+		heif_colorspace_RGB,
+		vips__heif_chroma(heif->bitdepth, save->ready->Bands > 3),
+		&heif->tile[i]);
+	if (error.code) {
+		vips__heif_error(&error);
+		return -1;
+	}
+
+	error = heif_image_add_plane(heif->tile[i], heif_channel_interleaved,
+		heif->tile_width, heif->tile_height,
+		heif->bitdepth);
+	if (error.code) {
+		vips__heif_error(&error);
+		return -1;
+	}
+
+	heif->tile_data[i] = heif_image_get_plane(heif->tile[i],
+		heif_channel_interleaved, &heif->tile_stride);
+
+	if (vips_foreign_save_heif_set_profile(heif, heif->tile[i]))
+		return -1;
+
+	return 0;
+}
+
+/* Pack a line of the page into the strip of tiles.
+ */
+static int
+vips_foreign_save_heif_pack_tiles(VipsForeignSaveHeif *heif,
+	VipsPel *p, int line)
+{
+	VipsForeignSave *save = (VipsForeignSave *) heif;
+	int sizeof_pel = VIPS_IMAGE_SIZEOF_PEL(save->ready);
+	int y = line % heif->tile_height;
+
+	for (int i = 0; i < heif->tile_columns; i++) {
+		int left = i * heif->tile_width;
+		int width = VIPS_MIN(heif->tile_width, heif->page_width - left);
+
+		VipsPel *q;
+
+		if (!heif->tile[i] &&
+			vips_foreign_save_heif_tile_new(heif, i))
+			return -1;
+
+		q = heif->tile_data[i] + (size_t) heif->tile_stride * y;
+
+		if (vips_foreign_save_heif_pack(heif,
+				q, p + (size_t) left * sizeof_pel,
+				width * save->ready->Bands))
+			return -1;
+
+		/* Tiles on the right edge are padded with the last pixel.
+		 */
+		for (int x = width; x < heif->tile_width; x++)
+			memcpy(q + (size_t) x * heif->pixel_size,
+				q + (size_t) (width - 1) * heif->pixel_size,
+				heif->pixel_size);
+	}
+
+	return 0;
+}
+
+static struct heif_error
+vips_foreign_save_heif_write_dbuf(struct heif_context *ctx,
+	const void *data, size_t length, void *userdata)
+{
+	VipsDbuf *dbuf = (VipsDbuf *) userdata;
+
+	struct heif_error error;
+
+	error.code = 0;
+	if (!vips_dbuf_write(dbuf, data, length))
+		error.code = heif_error_Encoding_error;
+
+	return error;
+}
+
+/* Encode a tile as a complete HEIF in a private context, then hand the
+ * result to the grid. libheif can't encode into a shared context from
+ * several threads.
+ */
+static int
+vips_foreign_save_heif_tile_encode(VipsForeignSaveHeif *heif,
+	int page, int index, struct heif_image *img)
+{
+	struct heif_context *ctx;
+	struct heif_encoder *encoder;
+	struct heif_encoding_options *options;
+	struct heif_writer writer;
+	struct heif_error error;
+	VipsDbuf dbuf;
+	unsigned char *buf;
+	size_t length;
+
+	ctx = heif_context_alloc();
+	if (!(encoder = vips_foreign_save_heif_encoder_new(heif, ctx, 1))) {
+		heif_context_free(ctx);
+		return -1;
+	}
+	if (!(options = vips_foreign_save_heif_options_new(heif))) {
+		heif_encoder_release(encoder);
+		heif_context_free(ctx);
+		return -1;
+	}
+
+	error = heif_context_encode_image(ctx, img, encoder, options, NULL);
+
+	vips_foreign_save_heif_options_free(options);
+	heif_encoder_release(encoder);
+
+	if (error.code) {
+		heif_context_free(ctx);
+		vips__heif_error(&error);
+		return -1;
+	}
+
+	vips_dbuf_init(&dbuf);
+	writer.writer_api_version = 1;
+	writer.write = vips_foreign_save_heif_write_dbuf;
+	error = heif_context_write(ctx, &writer, &dbuf);
+	heif_context_free(ctx);
+	if (error.code) {
+		vips_dbuf_destroy(&dbuf);
+		vips__heif_error(&error);
+		return -1;
+	}
+
+	buf = vips_dbuf_get_write(&dbuf, &length);
+	if (vips__heif_grid_set_tile(heif->grid, page, index, buf, length)) {
+		vips_dbuf_destroy(&dbuf);
+		return -1;
+	}
+	vips_dbuf_destroy(&dbuf);
+
+	return 0;
+}
+
+/* A strip of tiles being encoded by a threadpool.
+ */
+typedef struct _VipsForeignSaveHeifStrip {
+	VipsForeignSaveHeif *heif;
+	int page;
+	int tile_y;
+
+	/* The next column to hand out.
+	 */
+	int i;
+} VipsForeignSaveHeifStrip;
+
+static int
+vips_foreign_save_heif_strip_allocate(VipsThreadState *state, void *a,
+	gboolean *stop)
+{
+	VipsForeignSaveHeifStrip *strip = (VipsForeignSaveHeifStrip *) a;
+
+	if (strip->i >= strip->heif->tile_columns) {
+		*stop = TRUE;
+		return 0;
+	}
+
+	state->x = strip->i;
+	strip->i += 1;
+
+	return 0;
+}
+
+static int
+vips_foreign_save_heif_strip_work(VipsThreadState *state, void *a)
+{
+	VipsForeignSaveHeifStrip *strip = (VipsForeignSaveHeifStrip *) a;
+	VipsForeignSaveHeif *heif = strip->heif;
+	int i = state->x;
+
+	return vips_foreign_save_heif_tile_encode(heif, strip->page,
+		strip->tile_y * heif->tile_columns + i, heif->tile[i]);
+}
+
+/* The strip of tiles ending at line is complete, encode it.
+ */
+static int
+vips_foreign_save_heif_write_strip(VipsForeignSaveHeif *heif,
+	int page, int line)
+{
+	VipsForeignSave *save = (VipsForeignSave *) heif;
+	int lines = line % heif->tile_height + 1;
+	VipsForeignSaveHeifStrip strip = { heif, page, line / heif->tile_height };
+
+	VipsImage *x;
+
+	for (int i = 0; i < heif->tile_columns; i++) {
+		uint8_t *data = heif->tile_data[i];
+
+		/* Tiles on the bottom edge are padded with the last line.
+		 */
+		for (int y = lines; y < heif->tile_height; y++)
+			memcpy(data + (size_t) heif->tile_stride * y,
+				data + (size_t) heif->tile_stride * (lines - 1),
+				(size_t) heif->tile_width * heif->pixel_size);
+	}
+
+	if (vips_copy(save->ready, &x, NULL))
+		return -1;
+
+	/* We don't want threadpool_run to minimise on completion -- we need to
+	 * keep the cache on the pipeline before us.
+	 */
+	vips_image_set_int(x, "vips-no-minimise", 1);
+
+	if (vips_threadpool_run(x,
+			vips_thread_state_new,
+			vips_foreign_save_heif_strip_allocate,
+			vips_foreign_save_heif_strip_work,
+			NULL,
+			&strip)) {
+		VIPS_UNREF(x);
+		return -1;
+	}
+	VIPS_UNREF(x);
+
+	return 0;
+}
+
+/* All tiles for this page have been encoded, add the final bits.
+ */
+static int
+vips_foreign_save_heif_grid_finish_page(VipsForeignSaveHeif *heif, int page)
+{
+	VipsForeignSave *save = (VipsForeignSave *) heif;
+
+	if (vips_image_get_typeof(save->ready, "heif-primary")) {
+		int primary;
+
+		if (vips_image_get_int(save->ready, "heif-primary", &primary))
+			return -1;
+
+		if (page == primary)
+			vips__heif_grid_set_primary(heif->grid, page);
+	}
+
+	if (vips_image_get_typeof(save->ready, VIPS_META_EXIF_NAME)) {
+		const void *data;
+		size_t length;
+
+		if (vips_image_get_blob(save->ready, VIPS_META_EXIF_NAME,
+				&data, &length) ||
+			vips__heif_grid_add_metadata(heif->grid, page,
+				"Exif", data, length))
+			return -1;
+	}
+
+	if (vips_image_get_typeof(save->ready, VIPS_META_XMP_NAME)) {
+		const void *data;
+		size_t length;
+
+		if (vips_image_get_blob(save->ready, VIPS_META_XMP_NAME,
+				&data, &length) ||
+			vips__heif_grid_add_metadata(heif->grid, page,
+				"mime", data, length))
+			return -1;
+	}
+
+	return 0;
+}
+
+/* Set up the strip of tiles we fill from the pipeline.
+ */
+static int
+vips_foreign_save_heif_grid_build(VipsForeignSaveHeif *heif,
+	gboolean has_alpha)
+{
+	heif->tile_columns =
+		VIPS_ROUND_UP(heif->page_width, heif->tile_width) / heif->tile_width;
+	heif->tile_rows =
+		VIPS_ROUND_UP(heif->page_height, heif->tile_height) /
+		heif->tile_height;
+
+	/* The grid item stores rows and columns in a byte.
+	 */
+	if (heif->tile_columns > 256 ||
+		heif->tile_rows > 256) {
+		vips_error("heifsave", "%s", _("too many tiles"));
+		return -1;
+	}
+
+	heif->pixel_size = (has_alpha ? 4 : 3) * (heif->bitdepth > 8 ? 2 : 1);
+
+	/* Tile images are made as we need them, see pack_tiles().
+	 */
+	if (!(heif->tile = VIPS_ARRAY(NULL,
+			  heif->tile_columns, struct heif_image *)) ||
+		!(heif->tile_data = VIPS_ARRAY(NULL, heif->tile_columns, uint8_t *)))
+		return -1;
+	memset(heif->tile, 0, heif->tile_columns * sizeof(struct heif_image *));
+
+	heif->grid = vips__heif_grid_new();
+
+	return 0;
+}
+
 static int
 vips_foreign_save_heif_write_block(VipsRegion *region, VipsRect *area,
 	void *a)
@@ -562,6 +1076,31 @@ vips_foreign_save_heif_write_block(VipsRegion *region, VipsRect *area,
 		int page = (area->top + y) / heif->page_height;
 		int line = (area->top + y) % heif->page_height;
 		VipsPel *p = VIPS_REGION_ADDR(region, 0, area->top + y);
+
+		if (heif->grid) {
+			/* Grid write: encode each strip of tiles as it fills.
+			 */
+			if (line == 0 &&
+				vips__heif_grid_add_page(heif->grid,
+					heif->page_width, heif->page_height,
+					heif->tile_columns, heif->tile_rows))
+				return -1;
+
+			if (vips_foreign_save_heif_pack_tiles(heif, p, line))
+				return -1;
+
+			if ((line % heif->tile_height == heif->tile_height - 1 ||
+					line == heif->page_height - 1) &&
+				vips_foreign_save_heif_write_strip(heif, page, line))
+				return -1;
+
+			if (line == heif->page_height - 1 &&
+				vips_foreign_save_heif_grid_finish_page(heif, page))
+				return -1;
+
+			continue;
+		}
+
 		VipsPel *q = heif->data + (size_t) heif->stride * line;
 
 		if (vips_foreign_save_heif_pack(heif,
@@ -610,11 +1149,6 @@ vips_foreign_save_heif_build(VipsObject *object)
 
 	struct heif_error error;
 	struct heif_writer writer;
-	char *chroma;
-	const struct heif_encoder_descriptor *out_encoder;
-#ifdef HAVE_HEIF_ENCODER_PARAMETER_GET_VALID_INTEGER_VALUES
-	const struct heif_encoder_parameter *const *param;
-#endif
 	gboolean has_alpha;
 
 	if (VIPS_OBJECT_CLASS(vips_foreign_save_heif_parent_class)->build(object))
@@ -669,187 +1203,122 @@ vips_foreign_save_heif_build(VipsObject *object)
 			(enum heif_compression_format) heif->compression,
 			vips_enum_nick(VIPS_TYPE_FOREIGN_HEIF_ENCODER,
 				heif->selected_encoder),
-			&out_encoder, 1);
+			&heif->descriptor, 1);
 
-		if (count > 0)
-			error = heif_context_get_encoder(heif->ctx,
-				out_encoder, &heif->encoder);
-		else
+		if (count <= 0) {
 			g_warning("heifsave: could not find %s",
 				vips_enum_nick(VIPS_TYPE_FOREIGN_HEIF_ENCODER,
 					heif->selected_encoder));
-	}
-
-	/* Fallback to default encoder.
-	 */
-	if (!heif->encoder)
-		error = heif_context_get_encoder_for_format(heif->ctx,
-			(enum heif_compression_format) heif->compression,
-			&heif->encoder);
-
-	if (error.code) {
-		if (error.code == heif_error_Unsupported_filetype)
-			vips_error("heifsave", "%s", _("Unsupported compression"));
-		else
-			vips__heif_error(&error);
-
-		return -1;
-	}
-
-	error = heif_encoder_set_lossy_quality(heif->encoder, heif->Q);
-	if (error.code) {
-		vips__heif_error(&error);
-		return -1;
-	}
-
-	error = heif_encoder_set_lossless(heif->encoder, heif->lossless);
-	if (error.code) {
-		vips__heif_error(&error);
-		return -1;
-	}
-
-	error = heif_encoder_set_parameter_integer(heif->encoder,
-		"speed", 9 - heif->effort);
-	if (error.code &&
-		error.subcode != heif_suberror_Unsupported_parameter) {
-		vips__heif_error(&error);
-		return -1;
-	}
-
-	chroma = heif->subsample_mode == VIPS_FOREIGN_SUBSAMPLE_OFF ||
-			(heif->subsample_mode == VIPS_FOREIGN_SUBSAMPLE_AUTO &&
-				heif->Q >= 90)
-		? "444"
-		: "420";
-	error = heif_encoder_set_parameter_string(heif->encoder,
-		"chroma", chroma);
-	if (error.code &&
-		error.subcode != heif_suberror_Unsupported_parameter) {
-		vips__heif_error(&error);
-		return -1;
-	}
-
-#ifdef HAVE_HEIF_ENCODER_PARAMETER_GET_VALID_INTEGER_VALUES
-	for (param = heif_encoder_list_parameters(heif->encoder);
-		*param; param++) {
-		int have_minimum;
-		int have_maximum;
-		int minimum;
-		int maximum;
-
-		if (strcmp(heif_encoder_parameter_get_name(*param), "threads") != 0)
-			continue;
-
-		error = heif_encoder_parameter_get_valid_integer_values(*param,
-			&have_minimum, &have_maximum, &minimum, &maximum, NULL, NULL);
-		if (error.code) {
-			vips__heif_error(&error);
-			return -1;
-		}
-
-		error = heif_encoder_set_parameter_integer(heif->encoder,
-			"threads", VIPS_CLIP(minimum, vips_concurrency_get(), maximum));
-		if (error.code &&
-			error.subcode != heif_suberror_Unsupported_parameter) {
-			vips__heif_error(&error);
-			return -1;
+			heif->descriptor = NULL;
 		}
 	}
-#endif /*HAVE_HEIF_ENCODER_PARAMETER_GET_VALID_INTEGER_VALUES*/
 
-	/* Try to enable auto_tiles. This can make AVIF encoding a lot faster,
-	 * with only a very small increase in file size.
+	/* Make the main encoder. NULL descriptor means the default encoder
+	 * for this format.
 	 */
-	error = heif_encoder_set_parameter_boolean(heif->encoder,
-		"auto-tiles", TRUE);
-	if (error.code &&
-		error.subcode != heif_suberror_Unsupported_parameter) {
-		vips__heif_error(&error);
+	if (!(heif->encoder = vips_foreign_save_heif_encoder_new(heif,
+			  heif->ctx, vips_concurrency_get())))
 		return -1;
-	}
-
-	/* Try to prevent the AVIF encoder from using intra block copy,
-	 * helps ensure encoding time is more predictable.
-	 */
-	error = heif_encoder_set_parameter_boolean(heif->encoder,
-		"enable-intrabc", FALSE);
-	if (error.code &&
-		error.subcode != heif_suberror_Unsupported_parameter) {
-		vips__heif_error(&error);
-		return -1;
-	}
-
-	if (heif->tune) {
-		error = heif_encoder_set_parameter_string(heif->encoder,
-			"tune", heif->tune);
-		if (error.code &&
-			error.subcode != heif_suberror_Unsupported_parameter) {
-			vips__heif_error(&error);
-			return -1;
-		}
-	}
-
-	/* TODO .. support extra per-encoder params with
-	 * heif_encoder_list_parameters().
-	 */
 
 	heif->page_width = save->ready->Xsize;
 	heif->page_height = vips_image_get_page_height(save->ready);
 	heif->n_pages = save->ready->Ysize / heif->page_height;
 	has_alpha = save->ready->Bands > 3;
 
-	if (heif->page_width > 16384 || heif->page_height > 16384) {
-		vips_error("heifsave", _("image too large"));
-		return -1;
+	/* Pages too large for a single image must be written as a grid.
+	 */
+	if (!heif->tile_width &&
+		!heif->tile_height &&
+		(heif->page_width > 16384 || heif->page_height > 16384)) {
+		heif->tile_width = 512;
+		heif->tile_height = 512;
 	}
 
-	/* Make a heif image the size of a page. We send sink_disc() output
-	 * here and write a frame each time it fills.
+	/* Square tiles by default.
+	 */
+	if (!heif->tile_width)
+		heif->tile_width = heif->tile_height;
+	if (!heif->tile_height)
+		heif->tile_height = heif->tile_width;
+
+	/* libheif crops odd sized images with clap, and a grid can't hold
+	 * cropped tiles. Edge tiles are padded anyway, so just round up.
 	 */
+	heif->tile_width = VIPS_ROUND_UP(heif->tile_width, 2);
+	heif->tile_height = VIPS_ROUND_UP(heif->tile_height, 2);
+
 #ifdef DEBUG
 	printf("vips_foreign_save_heif_build:\n");
 	printf("\twidth = %d\n", heif->page_width);
 	printf("\theight = %d\n", heif->page_height);
 	printf("\talpha = %d\n", has_alpha);
+	printf("\ttile_width = %d\n", heif->tile_width);
+	printf("\ttile_height = %d\n", heif->tile_height);
 #endif /*DEBUG*/
-	error = heif_image_create(heif->page_width, heif->page_height,
-		heif_colorspace_RGB,
-		vips__heif_chroma(heif->bitdepth, has_alpha),
-		&heif->img);
-	if (error.code) {
-		vips__heif_error(&error);
-		return -1;
-	}
 
-	error = heif_image_add_plane(heif->img, heif_channel_interleaved,
-		heif->page_width, heif->page_height,
-		heif->bitdepth);
-	if (error.code) {
-		vips__heif_error(&error);
-		return -1;
+	if (heif->tile_width) {
+		/* Make a strip of tiles. We send sink_disc() output here and
+		 * encode each time a strip fills.
+		 */
+		if (vips_foreign_save_heif_grid_build(heif, has_alpha))
+			return -1;
 	}
+	else {
+		if (heif->page_width > 16384 || heif->page_height > 16384) {
+			vips_error("heifsave", _("image too large"));
+			return -1;
+		}
+
+		/* Make a heif image the size of a page. We send sink_disc()
+		 * output here and write a frame each time it fills.
+		 */
+		error = heif_image_create(heif->page_width, heif->page_height,
+			heif_colorspace_RGB,
+			vips__heif_chroma(heif->bitdepth, has_alpha),
+			&heif->img);
+		if (error.code) {
+			vips__heif_error(&error);
+			return -1;
+		}
+
+		error = heif_image_add_plane(heif->img, heif_channel_interleaved,
+			heif->page_width, heif->page_height,
+			heif->bitdepth);
+		if (error.code) {
+			vips__heif_error(&error);
+			return -1;
+		}
 
 #ifdef DEBUG
-	vips__heif_image_print(heif->img);
+		vips__heif_image_print(heif->img);
 #endif /*DEBUG*/
 
-	heif->data = heif_image_get_plane(heif->img,
-		heif_channel_interleaved, &heif->stride);
+		heif->data = heif_image_get_plane(heif->img,
+			heif_channel_interleaved, &heif->stride);
+	}
 
 	/* Write data.
 	 */
 	if (vips_sink_disc(save->ready, vips_foreign_save_heif_write_block, heif))
 		return -1;
 
-	/* This has to come right at the end :-( so there's no support for
-	 * incremental writes.
-	 */
-	writer.writer_api_version = 1;
-	writer.write = vips_foreign_save_heif_write;
-	error = heif_context_write(heif->ctx, &writer, heif);
-	if (error.code) {
-		vips__heif_error(&error);
-		return -1;
+	if (heif->grid) {
+		/* Assemble the encoded tiles.
+		 */
+		if (vips__heif_grid_write(heif->grid, heif->target))
+			return -1;
+	}
+	else {
+		/* This has to come right at the end :-( so there's no support
+		 * for incremental writes.
+		 */
+		writer.writer_api_version = 1;
+		writer.write = vips_foreign_save_heif_write;
+		error = heif_context_write(heif->ctx, &writer, heif);
+		if (error.code) {
+			vips__heif_error(&error);
+			return -1;
+		}
 	}
 
 	if (vips_target_end(heif->target))
@@ -956,6 +1425,20 @@ vips_foreign_save_heif_class_init(VipsForeignSaveHeifClass *class)
 		G_STRUCT_OFFSET(VipsForeignSaveHeif, tune),
 		NULL);
 
+	VIPS_ARG_INT(class, "tile_width", 20,
+		_("Tile width"),
+		_("Tile width in pixels for grid write"),
+		VIPS_ARGUMENT_OPTIONAL_INPUT,
+		G_STRUCT_OFFSET(VipsForeignSaveHeif, tile_width),
+		0, 16384, 0);
+
+	VIPS_ARG_INT(class, "tile_height", 21,
+		_("Tile height"),
+		_("Tile height in pixels for grid write"),
+		VIPS_ARGUMENT_OPTIONAL_INPUT,
+		G_STRUCT_OFFSET(VipsForeignSaveHeif, tile_height),
+		0, 16384, 0);
+
 }
 
 static void
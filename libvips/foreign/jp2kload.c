@@ -11,6 +11,11 @@
  * 18/9/24
  *	- revise offset handling
  *	- test that decoded image matches header
+ * 15/10/26
+ *	- decode just the area we need from large untiled images with random
+ *	  access
+ *	- single-threaded decode for tiff tiles, since they are decoded on
+ *	  vips workers
  */
 
 /*
@@ -68,6 +73,11 @@
  */
 #define MAX_BANDS (100)
 
+/* With random access, we decode large untiled images in areas this size,
+ * rather than all at once.
+ */
+#define ROI_SIZE (1024)
+
 typedef struct _VipsForeignLoadJp2k {
 	VipsForeignLoad parent_object;
 
@@ -1173,9 +1183,24 @@ vips_foreign_load_jp2k_load(VipsForeignLoad *load)
 	 */
 	if (jp2k->oneshot ||
 		(jp2k->info->tw == 1 && jp2k->info->th == 1)) {
-		tile_width = jp2k->width;
-		tile_height = jp2k->height;
-		tiles_across = 1;
+		/* Decoding all at once is fastest for a full read, but with
+		 * random access we are probably being used for a viewport, so
+		 * only decode the part we need. openjpeg keeps the compressed
+		 * tile, so each extra area is cheap.
+		 */
+		if (!jp2k->oneshot &&
+			load->access == VIPS_ACCESS_RANDOM &&
+			(jp2k->width > ROI_SIZE ||
+				jp2k->height > ROI_SIZE)) {
+			tile_width = ROI_SIZE;
+			tile_height = ROI_SIZE;
+			tiles_across = VIPS_ROUND_UP(jp2k->width, ROI_SIZE) / ROI_SIZE;
+		}
+		else {
+			tile_width = jp2k->width;
+			tile_height = jp2k->height;
+			tiles_across = 1;
+		}
 
 		if (vips_image_generate(t[0],
 				NULL, vips_foreign_load_jp2k_generate_untiled, NULL,
@@ -1211,6 +1236,15 @@ vips_foreign_load_jp2k_load(VipsForeignLoad *load)
 	return 0;
 }
 
+/* A jp2 file, or a bare codestream.
+ */
+static const VipsForeignMagic vips_foreign_load_jp2k_magic[] = {
+	{ 0, 12, JP2_RFC3745_MAGIC },
+	{ 0, 4, JP2_MAGIC },
+	{ 0, 4, J2K_CODESTREAM_MAGIC },
+	{ 0, 0, NULL }
+};
+
 static void
 vips_foreign_load_jp2k_class_init(VipsForeignLoadJp2kClass *class)
 {
@@ -1233,6 +1267,7 @@ vips_foreign_load_jp2k_class_init(VipsForeignLoadJp2kClass *class)
 
 	load_class->get_flags = vips_foreign_load_jp2k_get_flags;
 	load_class->header = vips_foreign_load_jp2k_header;
+	load_class->magic = vips_foreign_load_jp2k_magic;
 	load_class->load = vips_foreign_load_jp2k_load;
 
 	VIPS_ARG_INT(class, "page", 20,
@@ -1549,6 +1584,11 @@ vips__foreign_load_jp2k_decompress(VipsImage *out,
 	opj_set_error_handler(decompress.codec, error_callback, NULL);
 	opj_setup_decoder(decompress.codec, &parameters);
 
+	/* tiff2vips calls us from many vips workers at once, so decode each
+	 * tile on a single thread.
+	 */
+	opj_codec_set_threads(decompress.codec, 1);
+
 	decompress.source = vips_source_new_from_memory(from, from_length);
 	decompress.stream = vips_foreign_load_jp2k_stream(decompress.source);
 
@@ -1630,6 +1670,9 @@ vips__foreign_load_jp2k_decompress(VipsImage *out,
  *
  * It will only load images where all channels have the same format.
  *
+ * High-throughput JPEG2000 (HTJ2K, part 15) codestreams load too, if libvips
+ * was built with OpenJPEG 2.5 or later.
+ *
  * Use @page to set the page to load, where page 0 is the base resolution
  * image and higher-numbered pages are x2 reductions. Use the metadata item
  * "n-pages" to find the number of pyramid layers.
@@ -1638,6 +1681,9 @@ vips__foreign_load_jp2k_decompress(VipsImage *out,
  * Setting @oneshot will force the loader to decode tiled images in a single
  * operation and can improve compatibility.
  *
+ * Large untiled images opened for random access are decoded in sections
+ * as pixels are needed, so reading a small area is cheap.
+ *
  * Use @fail_on to set the type of error that will cause load to fail. By
  * default, loaders are permissive, that is, [enum@Vips.FailOn.NONE].
  *
@@ -2,6 +2,9 @@
  *
  * 18/3/20
  * 	- from jp2kload.c
+ * 15/10/26
+ * 	- tiles for tiff are compressed on vips workers, so don't start an
+ * 	  openjpeg threadpool for each one
  */
 
 /*
@@ -1320,7 +1323,8 @@ vips__foreign_save_jp2k_compress_free(TileCompress *compress)
 
 /* Compress area @tile within @region and write to @target as a @tile_width by
  * @tile_height jp2k compressed image. This is called from eg. vips2tiff to
- * write jp2k-compressed tiles.
+ * write jp2k-compressed tiles. Tiles are independent codestreams, so it's
+ * safe to call this from many threads at once.
  *
  * You'd think we could reuse things like the encoder between calls but ...
  * nope, openjpeg does not allow that.
@@ -1380,7 +1384,11 @@ vips__foreign_save_jp2k_compress(VipsRegion *region,
 		return -1;
 	}
 
-	opj_codec_set_threads(compress.codec, vips_concurrency_get());
+	/* Our caller runs many of these at once on vips workers, one per
+	 * tile, so an openjpeg threadpool per tile would just oversubscribe
+	 * the CPUs.
+	 */
+	opj_codec_set_threads(compress.codec, 1);
 
 	if (save_as_ycc)
 		vips_foreign_save_jp2k_rgb_to_ycc(region,
@@ -1460,6 +1468,11 @@ vips__foreign_save_jp2k_compress(VipsRegion *region,
  *
  * This operation always writes a pyramid.
  *
+ * The file is a single codestream, so tiles are written in order and
+ * OpenJPEG's own threadpool encodes the code blocks within each tile. The
+ * part 1 block coder is always used, since OpenJPEG can decode, but not
+ * encode, high-throughput JPEG2000 (HTJ2K, part 15).
+ *
  * ::: tip "Optional arguments"
  *     * @Q: `gint`, quality factor
  *     * @lossless: `gboolean`, enables lossless compression
@@ -79,9 +79,10 @@ typedef struct {
 typedef struct _ReadJpeg {
 	VipsImage *out;
 
-	/* Shrink by this much during load. 1, 2, 4, 8.
+	/* Decode at scale / 8, using libjpeg's scaled IDCT. 1 to 16, where 8
+	 * is full size.
 	 */
-	int shrink;
+	int scale;
 
 	/* Types of error to cause failure.
 	 */
@@ -101,7 +102,7 @@ typedef struct _ReadJpeg {
 	gboolean unlimited;
 
 	/* cinfo->output_width and height can be larger than we want since
-	 * libjpeg rounds up on shrink-on-load. This is the real size we will
+	 * libjpeg rounds up on scaled decode. This is the real size we will
 	 * output, as opposed to the size we decompress to.
 	 */
 	int output_width;
@@ -111,6 +112,39 @@ typedef struct _ReadJpeg {
 	 */
 	VipsSource *source;
 
+	/* For parallel decode of images with restart markers: a copy of the
+	 * file header without metadata, the offset of the SOF marker in that,
+	 * and the offset of the start of each restart interval in the mapped
+	 * file.
+	 */
+	const VipsPel *data;
+	size_t length;
+	VipsPel *header;
+	size_t header_length;
+	size_t sof_offset;
+	size_t *interval;
+	int n_intervals;
+	size_t scan_end;
+
+	/* MCU geometry, and chunk size in MCU rows. Chunks always start on a
+	 * restart interval. If chroma is subsampled vertically, chunks are
+	 * decoded with an extra boundary_rows either side to give libjpeg's
+	 * upsampler the same context it has in a sequential decode.
+	 */
+	int mcu_height;
+	int mcus_per_row;
+	int mcu_rows;
+	int boundary_rows;
+	int chunk_rows;
+	gboolean needs_context;
+
+	/* Only read this area of the output image, if width is non-zero.
+	 * skip_rows is the number of scanlines we skipped before the first
+	 * one we decode.
+	 */
+	VipsRect area;
+	int skip_rows;
+
 } ReadJpeg;
 
 extern const char *vips__jpeg_message_table[];
@@ -119,7 +153,7 @@ void vips__new_output_message(j_common_ptr cinfo);
 void vips__new_error_exit(j_common_ptr cinfo);
 
 ReadJpeg *vips__readjpeg_new(VipsSource *source, VipsImage *out,
-	int shrink, VipsFailOn fail_on, gboolean autorotate,
+	int scale, VipsFailOn fail_on, gboolean autorotate,
 	gboolean unlimited);
 int vips__readjpeg_open_input(ReadJpeg *jpeg);
 
@@ -114,6 +114,13 @@
  * 	- add fail_on support
  * 2/8/22
  *      - add "unlimited"
+ * 14/10/26
+ * 	- decode baseline images with restart markers in parallel
+ * 	- decode ahead on a background thread
+ * 15/10/26
+ * 	- decode at any M/8 scale, not just 1/1, 1/2, 1/4 and 1/8
+ * 	- add area, decode only the rows and MCU columns we need
+ * 	- cache strips are whole MCU rows
  */
 
 /*
@@ -317,6 +324,11 @@ vips__readjpeg_open_input(ReadJpeg *jpeg)
 			src->pub.skip_input_data = skip_input_data_mappable;
 			src->pub.bytes_in_buffer = src_len;
 			src->pub.next_input_byte = src_data;
+
+			/* Keep the mapped file for parallel decode.
+			 */
+			jpeg->data = src_data;
+			jpeg->length = src_len;
 		}
 		else {
 			src->pub.fill_input_buffer = source_fill_input_buffer;
@@ -386,6 +398,8 @@ readjpeg_free(ReadJpeg *jpeg)
 	 */
 	jpeg_destroy_decompress(&jpeg->cinfo);
 
+	VIPS_FREE(jpeg->header);
+	VIPS_FREE(jpeg->interval);
 	VIPS_UNREF(jpeg->source);
 
 	return 0;
@@ -407,7 +421,7 @@ readjpeg_minimise_cb(VipsImage *image, ReadJpeg *jpeg)
  */
 ReadJpeg *
 vips__readjpeg_new(VipsSource *source, VipsImage *out,
-	int shrink, VipsFailOn fail_on, gboolean autorotate,
+	int scale, VipsFailOn fail_on, gboolean autorotate,
 	gboolean unlimited)
 {
 	ReadJpeg *jpeg;
@@ -418,7 +432,7 @@ vips__readjpeg_new(VipsSource *source, VipsImage *out,
 	jpeg->out = out;
 	jpeg->source = source;
 	g_object_ref(source);
-	jpeg->shrink = shrink;
+	jpeg->scale = scale;
 	jpeg->fail_on = fail_on;
 	jpeg->cinfo.err = jpeg_std_error(&jpeg->eman.pub);
 	jpeg->cinfo.err->addon_message_table = vips__jpeg_message_table;
@@ -534,10 +548,20 @@ read_jpeg_header(ReadJpeg *jpeg, VipsImage *out)
 	 * for YUV YCCK etc.
 	 */
 	jpeg_read_header(cinfo, TRUE);
-	cinfo->scale_denom = jpeg->shrink;
-	cinfo->scale_num = 1;
+	cinfo->scale_num = jpeg->scale;
+	cinfo->scale_denom = 8;
 	jpeg_calc_output_dimensions(cinfo);
 
+	/* Very old libjpegs only support 1/1, 1/2, 1/4 and 1/8 and will
+	 * silently pick one of those.
+	 */
+	if (cinfo->output_width !=
+		VIPS_ROUND_UP((guint64) cinfo->image_width * jpeg->scale, 8) / 8) {
+		vips_error("jpeg2vips",
+			_("unsupported decode scale %d/8"), jpeg->scale);
+		return -1;
+	}
+
 	jpeg->invert_pels = FALSE;
 	switch (cinfo->out_color_space) {
 	case JCS_GRAYSCALE:
@@ -636,8 +660,8 @@ read_jpeg_header(ReadJpeg *jpeg, VipsImage *out)
 	 * We must strictly round down, since we don't want fractional pixels
 	 * along the bottom and right.
 	 */
-	jpeg->output_width = cinfo->image_width / jpeg->shrink;
-	jpeg->output_height = cinfo->image_height / jpeg->shrink;
+	jpeg->output_width = (guint64) cinfo->image_width * jpeg->scale / 8;
+	jpeg->output_height = (guint64) cinfo->image_height * jpeg->scale / 8;
 
 	/* Interlaced jpegs need lots of memory to read, so our caller needs
 	 * to know.
@@ -836,9 +860,10 @@ read_jpeg_generate(VipsRegion *out_region,
 	g_assert(r->height == VIPS_MIN(8, out_region->im->Ysize - r->top));
 
 	/* And check that the y position is correct. It should be, since we are
-	 * inside a vips_sequential().
+	 * inside a vips_sequential(). We may have skipped some lines at the
+	 * top, see read_jpeg_image().
 	 */
-	if (r->top != cinfo->output_scanline) {
+	if (r->top + jpeg->skip_rows != cinfo->output_scanline) {
 		VIPS_GATE_STOP("read_jpeg_generate: work");
 		vips_error("VipsJpeg", _("out of order read at line %d"),
 			cinfo->output_scanline);
@@ -891,6 +916,448 @@ read_jpeg_generate(VipsRegion *out_region,
 	return 0;
 }
 
+/* Chunks should be about this many scanlines high before shrink.
+ */
+#define CHUNK_HEIGHT (256)
+
+static guint64
+read_jpeg_gcd(guint64 a, guint64 b)
+{
+	while (b) {
+		guint64 t = a % b;
+
+		a = b;
+		b = t;
+	}
+
+	return a;
+}
+
+/* Is this an APPn or COM marker we can drop from chunk headers? We must keep
+ * APP0 (JFIF) and APP14 (Adobe), since libjpeg uses them to pick the
+ * colourspace.
+ */
+static gboolean
+read_jpeg_is_metadata(int marker)
+{
+	return (marker > JPEG_APP0 &&
+			   marker <= JPEG_APP0 + 15 &&
+			   marker != JPEG_APP0 + 14) ||
+		marker == JPEG_COM;
+}
+
+/* Is this a start of frame marker (not DHT, JPG or DAC).
+ */
+static gboolean
+read_jpeg_is_sof(int marker)
+{
+	return marker >= 0xc0 &&
+		marker <= 0xcf &&
+		marker != 0xc4 &&
+		marker != 0xc8 &&
+		marker != 0xcc;
+}
+
+/* Copy the file header, without metadata, for the chunk decoders.
+ */
+static gboolean
+read_jpeg_index_header(ReadJpeg *jpeg, size_t scan_start)
+{
+	const VipsPel *data = jpeg->data;
+
+	GByteArray *header;
+	size_t p;
+	gboolean found_sof;
+
+	header = g_byte_array_new();
+	g_byte_array_append(header, data, 2);
+	found_sof = FALSE;
+	p = 2;
+	while (p + 4 <= scan_start) {
+		int marker;
+		size_t end;
+
+		if (data[p] != 0xff) {
+			g_byte_array_unref(header);
+			return FALSE;
+		}
+
+		/* Skip fill bytes.
+		 */
+		if (data[p + 1] == 0xff) {
+			p += 1;
+			continue;
+		}
+
+		marker = data[p + 1];
+		end = p + 2 + ((data[p + 2] << 8) | data[p + 3]);
+		if (end > scan_start) {
+			g_byte_array_unref(header);
+			return FALSE;
+		}
+
+		if (!read_jpeg_is_metadata(marker)) {
+			if (read_jpeg_is_sof(marker)) {
+				jpeg->sof_offset = header->len;
+				found_sof = TRUE;
+			}
+
+			g_byte_array_append(header, data + p, end - p);
+		}
+
+		p = end;
+	}
+
+	if (p != scan_start ||
+		!found_sof) {
+		g_byte_array_unref(header);
+		return FALSE;
+	}
+
+	jpeg->header_length = header->len;
+	jpeg->header = g_byte_array_free(header, FALSE);
+
+	return TRUE;
+}
+
+/* Find the start of each restart interval in the scan, and the end of the
+ * scan.
+ */
+static gboolean
+read_jpeg_index_intervals(ReadJpeg *jpeg, size_t scan_start)
+{
+	const VipsPel *data = jpeg->data;
+	size_t length = jpeg->length;
+
+	size_t p;
+	int n;
+
+	jpeg->interval = VIPS_ARRAY(NULL, jpeg->n_intervals, size_t);
+	jpeg->interval[0] = scan_start;
+	n = 1;
+
+	p = scan_start;
+	for (;;) {
+		const VipsPel *q;
+
+		if (!(q = memchr(data + p, 0xff, length - p)))
+			/* Truncated, leave it to libjpeg.
+			 */
+			return FALSE;
+
+		/* Skip fill bytes.
+		 */
+		p = q - data + 1;
+		while (p < length &&
+			data[p] == 0xff)
+			p += 1;
+		if (p >= length)
+			return FALSE;
+
+		/* A stuffed zero byte.
+		 */
+		if (data[p] == 0) {
+			p += 1;
+			continue;
+		}
+
+		/* Restart markers must be in sequence.
+		 */
+		if (data[p] >= JPEG_RST0 &&
+			data[p] <= JPEG_RST0 + 7) {
+			if (n >= jpeg->n_intervals ||
+				data[p] != JPEG_RST0 + ((n - 1) & 7))
+				return FALSE;
+
+			jpeg->interval[n++] = p + 1;
+			p += 1;
+			continue;
+		}
+
+		/* Any other marker ends the scan.
+		 */
+		jpeg->scan_end = q - data;
+		break;
+	}
+
+	return n == jpeg->n_intervals;
+}
+
+/* Look for restart markers we can use for parallel decode. We need a
+ * mapped, baseline, single scan image where the restart intervals line up
+ * with MCU rows often enough to give at least two chunks.
+ */
+static gboolean
+read_jpeg_index(ReadJpeg *jpeg)
+{
+	struct jpeg_decompress_struct *cinfo = &jpeg->cinfo;
+
+	size_t scan_start;
+	int mcu_width;
+	guint64 n_mcus;
+	int i;
+
+	if (!jpeg->data ||
+		cinfo->progressive_mode ||
+		jpeg_has_multiple_scans(cinfo) ||
+		cinfo->restart_interval == 0 ||
+		cinfo->comps_in_scan != cinfo->num_components ||
+		cinfo->src->next_input_byte < jpeg->data ||
+		cinfo->src->next_input_byte >= jpeg->data + jpeg->length)
+		return FALSE;
+
+	/* jpeg_read_header() stops just after the SOS marker, so we are at
+	 * the start of the entropy coded data.
+	 */
+	scan_start = cinfo->src->next_input_byte - jpeg->data;
+
+	if (cinfo->comps_in_scan == 1) {
+		mcu_width = DCTSIZE;
+		jpeg->mcu_height = DCTSIZE;
+	}
+	else {
+		mcu_width = cinfo->max_h_samp_factor * DCTSIZE;
+		jpeg->mcu_height = cinfo->max_v_samp_factor * DCTSIZE;
+	}
+	jpeg->mcus_per_row = VIPS_ROUND_UP(cinfo->image_width, mcu_width) /
+		mcu_width;
+	jpeg->mcu_rows = VIPS_ROUND_UP(cinfo->image_height, jpeg->mcu_height) /
+		jpeg->mcu_height;
+	n_mcus = (guint64) jpeg->mcus_per_row * jpeg->mcu_rows;
+	if ((n_mcus + cinfo->restart_interval - 1) / cinfo->restart_interval >
+		INT_MAX)
+		return FALSE;
+	jpeg->n_intervals =
+		(n_mcus + cinfo->restart_interval - 1) / cinfo->restart_interval;
+
+	/* Chunks must start on an MCU row that starts an interval.
+	 */
+	jpeg->boundary_rows = cinfo->restart_interval /
+		read_jpeg_gcd(jpeg->mcus_per_row, cinfo->restart_interval);
+
+	/* Fancy upsampling looks at the rows above and below.
+	 */
+	jpeg->needs_context = FALSE;
+	for (i = 0; i < cinfo->num_components; i++)
+		if (cinfo->comp_info[i].v_samp_factor < cinfo->max_v_samp_factor)
+			jpeg->needs_context = TRUE;
+
+	jpeg->chunk_rows = VIPS_ROUND_UP(
+		VIPS_MAX(1, CHUNK_HEIGHT / jpeg->mcu_height), jpeg->boundary_rows);
+	if (jpeg->needs_context)
+		jpeg->chunk_rows = VIPS_MAX(jpeg->chunk_rows, 4 * jpeg->boundary_rows);
+	if (jpeg->chunk_rows >= jpeg->mcu_rows)
+		return FALSE;
+
+	if (!read_jpeg_index_header(jpeg, scan_start) ||
+		!read_jpeg_index_intervals(jpeg, scan_start)) {
+		VIPS_FREE(jpeg->header);
+		VIPS_FREE(jpeg->interval);
+		return FALSE;
+	}
+
+#ifdef DEBUG
+	printf("read_jpeg_index: %d intervals, %d rows per chunk\n",
+		jpeg->n_intervals, jpeg->chunk_rows);
+#endif /*DEBUG*/
+
+	return TRUE;
+}
+
+static boolean
+chunk_fill_input_buffer(j_decompress_ptr cinfo)
+{
+	static const JOCTET eoi[2] = { 0xFF, JPEG_EOI };
+
+	/* Chunks always end with EOI, so this is a corrupt chunk.
+	 */
+	WARNMS(cinfo, JWRN_VIPS_IMAGE_EOF);
+
+	cinfo->src->next_input_byte = eoi;
+	cinfo->src->bytes_in_buffer = 2;
+
+	return TRUE;
+}
+
+/* Make a small JPEG for MCU rows [top, bottom): the file header with the
+ * height patched, the intervals for those rows with the restart markers
+ * renumbered from zero, then EOI.
+ */
+static VipsPel *
+read_jpeg_chunk_build(ReadJpeg *jpeg, int top, int bottom, size_t *length)
+{
+	struct jpeg_decompress_struct *cinfo = &jpeg->cinfo;
+	int ri = cinfo->restart_interval;
+	int first = (guint64) top * jpeg->mcus_per_row / ri;
+	int last = VIPS_MIN(jpeg->n_intervals,
+		((guint64) bottom * jpeg->mcus_per_row + ri - 1) / ri);
+	size_t start = jpeg->interval[first];
+	size_t end = last < jpeg->n_intervals
+		? jpeg->interval[last] - 2
+		: jpeg->scan_end;
+	int height = VIPS_MIN((guint64) bottom * jpeg->mcu_height,
+					 cinfo->image_height) -
+		top * jpeg->mcu_height;
+
+	VipsPel *buf;
+	VipsPel *q;
+	int i;
+
+	*length = jpeg->header_length + (end - start) + 2;
+	buf = g_malloc(*length);
+
+	memcpy(buf, jpeg->header, jpeg->header_length);
+	q = buf + jpeg->header_length;
+	memcpy(q, jpeg->data + start, end - start);
+
+	/* SOF is marker, length, precision, then height.
+	 */
+	buf[jpeg->sof_offset + 5] = height >> 8;
+	buf[jpeg->sof_offset + 6] = height & 0xff;
+
+	if (first & 7)
+		for (i = first + 1; i < last; i++)
+			q[jpeg->interval[i] - 1 - start] =
+				JPEG_RST0 + ((i - first - 1) & 7);
+
+	q += end - start;
+	q[0] = 0xff;
+	q[1] = JPEG_EOI;
+
+	return buf;
+}
+
+/* Decode one chunk, writing any scanlines which fall inside the region.
+ */
+static int
+read_jpeg_chunk(ReadJpeg *jpeg, VipsRegion *out_region, int chunk)
+{
+	VipsRect *r = &out_region->valid;
+	int sz = jpeg->cinfo.output_width * jpeg->cinfo.output_components;
+	int top = chunk * jpeg->chunk_rows;
+	int bottom = VIPS_MIN(jpeg->mcu_rows, top + jpeg->chunk_rows);
+
+	struct jpeg_decompress_struct cinfo;
+	struct jpeg_source_mgr src;
+	ErrorManager eman;
+	VipsPel *buf;
+	size_t length;
+	VipsPel *line;
+	int y;
+
+	/* Decode a boundary either side to get the upsampler context right.
+	 */
+	if (jpeg->needs_context) {
+		top = VIPS_MAX(0, top - jpeg->boundary_rows);
+		bottom = VIPS_MIN(jpeg->mcu_rows, bottom + jpeg->boundary_rows);
+	}
+
+	buf = read_jpeg_chunk_build(jpeg, top, bottom, &length);
+	line = g_malloc(sz);
+
+	cinfo.err = jpeg_std_error(&eman.pub);
+	cinfo.err->addon_message_table = vips__jpeg_message_table;
+	cinfo.err->first_addon_message = 1000;
+	cinfo.err->last_addon_message = 1001;
+	eman.pub.error_exit = vips__new_error_exit;
+	eman.pub.emit_message = readjpeg_emit_message;
+	eman.pub.output_message = vips__new_output_message;
+	eman.fp = NULL;
+	cinfo.client_data = jpeg;
+
+	if (setjmp(eman.jmp)) {
+		jpeg_destroy_decompress(&cinfo);
+		g_free(line);
+		g_free(buf);
+
+		return -1;
+	}
+
+	jpeg_create_decompress(&cinfo);
+
+	src.init_source = source_init_source;
+	src.fill_input_buffer = chunk_fill_input_buffer;
+	src.skip_input_data = skip_input_data_mappable;
+	src.resync_to_restart = jpeg_resync_to_restart;
+	src.term_source = source_init_source;
+	src.next_input_byte = buf;
+	src.bytes_in_buffer = length;
+	cinfo.src = &src;
+
+	jpeg_read_header(&cinfo, TRUE);
+	cinfo.scale_num = jpeg->scale;
+	cinfo.scale_denom = 8;
+	jpeg_start_decompress(&cinfo);
+
+	y = top * jpeg->mcu_height * jpeg->scale / 8;
+	while (cinfo.output_scanline < cinfo.output_height &&
+		y < VIPS_RECT_BOTTOM(r)) {
+		JSAMPROW row_pointer[1];
+
+		if (y >= r->top)
+			row_pointer[0] = (JSAMPLE *) VIPS_REGION_ADDR(out_region, 0, y);
+		else
+			row_pointer[0] = (JSAMPLE *) line;
+
+		jpeg_read_scanlines(&cinfo, &row_pointer[0], 1);
+
+		if (y >= r->top &&
+			jpeg->invert_pels) {
+			int x;
+
+			for (x = 0; x < sz; x++)
+				row_pointer[0][x] = 255 - row_pointer[0][x];
+		}
+
+		y += 1;
+	}
+
+	jpeg_destroy_decompress(&cinfo);
+	g_free(line);
+	g_free(buf);
+
+	if (eman.pub.num_warnings > 0 &&
+		jpeg->fail_on >= VIPS_FAIL_ON_WARNING)
+		return -1;
+
+	return 0;
+}
+
+/* Generate with many threads, each decoding a set of restart intervals.
+ */
+static int
+read_jpeg_generate_parallel(VipsRegion *out_region,
+	void *seq, void *a, void *b, gboolean *stop)
+{
+	VipsRect *r = &out_region->valid;
+	ReadJpeg *jpeg = (ReadJpeg *) a;
+	int chunk_height =
+		jpeg->chunk_rows * jpeg->mcu_height * jpeg->scale / 8;
+
+	int chunk;
+
+#ifdef DEBUG_VERBOSE
+	printf("read_jpeg_generate_parallel: %p line %d, %d rows\n",
+		g_thread_self(), r->top, r->height);
+#endif /*DEBUG_VERBOSE*/
+
+	VIPS_GATE_START("read_jpeg_generate_parallel: work");
+
+	g_assert(r->left == 0);
+	g_assert(r->width == out_region->im->Xsize);
+
+	for (chunk = r->top / chunk_height;
+		 chunk <= (VIPS_RECT_BOTTOM(r) - 1) / chunk_height; chunk++)
+		if (read_jpeg_chunk(jpeg, out_region, chunk)) {
+			VIPS_GATE_STOP("read_jpeg_generate_parallel: work");
+			return -1;
+		}
+
+	VIPS_GATE_STOP("read_jpeg_generate_parallel: work");
+
+	return 0;
+}
+
 /* Read a cinfo to a VIPS image.
  */
 static int
@@ -898,9 +1365,12 @@ read_jpeg_image(ReadJpeg *jpeg, VipsImage *out)
 {
 	struct jpeg_decompress_struct *cinfo = &jpeg->cinfo;
 	VipsImage **t = (VipsImage **)
-		vips_object_local_array(VIPS_OBJECT(out), 5);
+		vips_object_local_array(VIPS_OBJECT(out), 6);
 
 	VipsImage *im;
+	gboolean rotate;
+	gboolean cropping;
+	VipsRect crop;
 
 	/* Here for longjmp() from vips__new_error_exit() during
 	 * jpeg_read_header() or jpeg_start_decompress().
@@ -912,33 +1382,101 @@ read_jpeg_image(ReadJpeg *jpeg, VipsImage *out)
 	if (read_jpeg_header(jpeg, t[0]))
 		return -1;
 
+	/* The area is in the coordinates of the rotated image, so if we will
+	 * rotate, we must decode everything and crop at the end.
+	 */
+	rotate = jpeg->autorotate &&
+		vips_image_get_orientation(t[0]) != 1;
+
+	/* The part of the decoded image we output.
+	 */
+	crop.left = 0;
+	crop.top = 0;
+	crop.width = jpeg->output_width;
+	crop.height = jpeg->output_height;
+	cropping = jpeg->area.width &&
+		!rotate;
+	if (cropping)
+		crop = jpeg->area;
+
 	/* Switch to pixel decode.
 	 */
 	if (vips_source_decode(jpeg->source))
 		return -1;
 
-	jpeg_start_decompress(cinfo);
+	if (read_jpeg_index(jpeg)) {
+		int chunk_height =
+			jpeg->chunk_rows * jpeg->mcu_height * jpeg->scale / 8;
 
 #ifdef DEBUG
-	printf("read_jpeg_image: starting decompress\n");
+		printf("read_jpeg_image: starting parallel decompress\n");
 #endif /*DEBUG*/
 
-	/* We must crop after the seq, or our generate may not be asked for
-	 * full lines of pixels and will attempt to write beyond the buffer.
-	 */
-	if (vips_image_generate(t[0],
-			NULL, read_jpeg_generate, NULL,
-			jpeg, NULL) ||
-		vips_sequential(t[0], &t[1],
-			"tile_height", 8,
-			NULL) ||
-		vips_extract_area(t[1], &t[2],
-			0, 0, jpeg->output_width, jpeg->output_height, NULL))
-		return -1;
+		/* Chunks are independent, so we can decode in any order, and
+		 * the tilecache will only decode the chunks the area touches.
+		 */
+		if (vips_image_generate(t[0],
+				NULL, read_jpeg_generate_parallel, NULL,
+				jpeg, NULL) ||
+			vips_tilecache(t[0], &t[1],
+				"tile_width", t[0]->Xsize,
+				"tile_height", chunk_height,
+				"max_tiles", 2 * vips_concurrency_get(),
+				"threaded", TRUE,
+				NULL) ||
+			vips_extract_area(t[1], &t[2],
+				crop.left, crop.top, crop.width, crop.height, NULL))
+			return -1;
+	}
+	else {
+		/* libjpeg decodes a row of MCUs at a time, so keep cache strips
+		 * to whole MCU rows, and at least 8 lines.
+		 */
+		int mcu_height = VIPS_MAX(1,
+			cinfo->max_v_samp_factor * DCTSIZE * jpeg->scale / 8);
+		int tile_height = VIPS_ROUND_UP(8, mcu_height);
+
+		jpeg_start_decompress(cinfo);
+
+#ifdef HAVE_JPEG_CROP_SCANLINE
+		/* Only decode the MCU columns and scanlines we need. libjpeg
+		 * will widen the crop out to MCU boundaries.
+		 */
+		if (cropping) {
+			JDIMENSION xoffset = crop.left;
+			JDIMENSION width = crop.width;
+
+			jpeg_crop_scanline(cinfo, &xoffset, &width);
+			t[0]->Xsize = cinfo->output_width;
+			crop.left -= xoffset;
+
+			jpeg->skip_rows = jpeg_skip_scanlines(cinfo, crop.top);
+			crop.top -= jpeg->skip_rows;
+			t[0]->Ysize = crop.top + crop.height;
+		}
+#endif /*HAVE_JPEG_CROP_SCANLINE*/
+
+#ifdef DEBUG
+		printf("read_jpeg_image: starting decompress\n");
+#endif /*DEBUG*/
+
+		/* We must crop after the seq, or our generate may not be asked for
+		 * full lines of pixels and will attempt to write beyond the buffer.
+		 */
+		if (vips_image_generate(t[0],
+				NULL, read_jpeg_generate, NULL,
+				jpeg, NULL) ||
+			vips_sequential(t[0], &t[1],
+				"tile_height", tile_height,
+				"prefetch", 8,
+				NULL) ||
+			vips_extract_area(t[1], &t[2],
+				crop.left, crop.top, crop.width, crop.height, NULL))
+			return -1;
+	}
 	im = t[2];
 
-	if (jpeg->autorotate &&
-		vips_image_get_orientation(im) != 1) {
+	if (rotate) {
 		/* We have to copy to memory before calling autorot, since it
 		 * needs random access.
 		 */
@@ -946,6 +1484,14 @@ read_jpeg_image(ReadJpeg *jpeg, VipsImage *out)
 			vips_autorot(t[3], &t[4], NULL))
 			return -1;
 		im = t[4];
+
+		if (jpeg->area.width) {
+			if (vips_extract_area(im, &t[5],
+					jpeg->area.left, jpeg->area.top,
+					jpeg->area.width, jpeg->area.height, NULL))
+				return -1;
+			im = t[5];
+		}
 	}
 
 	if (vips_image_write(im, out))
@@ -998,6 +1544,20 @@ jpeg_read(ReadJpeg *jpeg, VipsImage *out, gboolean header_only)
 
 			vips_autorot_remove_angle(out);
 		}
+
+		/* And crop to the area, if there is one.
+		 */
+		if (jpeg->area.width) {
+			VipsRect whole = { 0, 0, out->Xsize, out->Ysize };
+
+			if (!vips_rect_includesrect(&whole, &jpeg->area)) {
+				vips_error("jpeg2vips", "%s", _("bad area"));
+				return -1;
+			}
+
+			out->Xsize = jpeg->area.width;
+			out->Ysize = jpeg->area.height;
+		}
 	}
 	else {
 		if (read_jpeg_image(jpeg, out))
@@ -1009,14 +1569,16 @@ jpeg_read(ReadJpeg *jpeg, VipsImage *out, gboolean header_only)
 
 int
 vips__jpeg_read_source(VipsSource *source, VipsImage *out,
-	gboolean header_only, int shrink, VipsFailOn fail_on,
-	gboolean autorotate, gboolean unlimited)
+	gboolean header_only, int scale, VipsFailOn fail_on,
+	gboolean autorotate, gboolean unlimited, const VipsRect *area)
 {
 	ReadJpeg *jpeg;
 
-	if (!(jpeg = vips__readjpeg_new(source, out, shrink, fail_on,
+	if (!(jpeg = vips__readjpeg_new(source, out, scale, fail_on,
 			  autorotate, unlimited)))
 		return -1;
+	if (area)
+		jpeg->area = *area;
 
 	/* Here for longjmp() from vips__new_error_exit() during
 	 * cinfo->mem->alloc_small() or jpeg_read_header().
@@ -6,6 +6,11 @@
  * 	- split to make load, load from buffer and load from file
  * 24/7/21
  * 	- add fail_on support
+ * 14/10/26
+ * 	- set VIPS_FOREIGN_ZERO_COPY
+ * 15/10/26
+ * 	- add "scale" for M/8 scaled decode
+ * 	- add "area" to decode just part of an image
  */
 
 /*
@@ -42,6 +47,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <math.h>
 #include <string.h>
 #include <setjmp.h>
 
@@ -82,10 +88,23 @@ typedef struct _VipsForeignLoadJpeg {
 	 */
 	int shrink;
 
+	/* Or decode at this scale, rounded up to eighths.
+	 */
+	double scale;
+
+	/* The decode scale we use, in eighths.
+	 */
+	int scale_num;
+
 	/* Autorotate using exif orientation tag.
 	 */
 	gboolean autorotate;
 
+	/* Only load this left, top, width, height, and as a rect.
+	 */
+	VipsArrayInt *area;
+	VipsRect area_rect;
+
 } VipsForeignLoadJpeg;
 
 typedef VipsForeignLoadClass VipsForeignLoadJpegClass;
@@ -117,6 +136,42 @@ vips_foreign_load_jpeg_build(VipsObject *object)
 		return -1;
 	}
 
+	if (vips_object_argument_isset(object, "scale")) {
+		if (vips_object_argument_isset(object, "shrink")) {
+			vips_error("VipsFormatLoadJpeg",
+				"%s", _("specify only one of shrink and scale"));
+			return -1;
+		}
+
+		/* libjpeg can decode at any M/8 for M in 1 - 16. Pick the
+		 * nearest one at or above the requested scale, with a little
+		 * slack for rounding.
+		 */
+		jpeg->scale_num = VIPS_CLIP(1, ceil(jpeg->scale * 8 - 0.001), 16);
+	}
+	else
+		jpeg->scale_num = 8 / jpeg->shrink;
+
+	if (jpeg->area) {
+		int n;
+		int *area = vips_array_int_get(jpeg->area, &n);
+
+		if (n != 4 ||
+			area[0] < 0 ||
+			area[1] < 0 ||
+			area[2] <= 0 ||
+			area[3] <= 0) {
+			vips_error("VipsFormatLoadJpeg",
+				"%s", _("area must be left, top, width, height"));
+			return -1;
+		}
+
+		jpeg->area_rect.left = area[0];
+		jpeg->area_rect.top = area[1];
+		jpeg->area_rect.width = area[2];
+		jpeg->area_rect.height = area[3];
+	}
+
 	return VIPS_OBJECT_CLASS(vips_foreign_load_jpeg_parent_class)
 		->build(object);
 }
@@ -124,13 +179,13 @@ vips_foreign_load_jpeg_build(VipsObject *object)
 static VipsForeignFlags
 vips_foreign_load_jpeg_get_flags(VipsForeignLoad *load)
 {
-	return VIPS_FOREIGN_SEQUENTIAL;
+	return VIPS_FOREIGN_SEQUENTIAL | VIPS_FOREIGN_ZERO_COPY;
 }
 
 static VipsForeignFlags
 vips_foreign_load_jpeg_get_flags_filename(const char *filename)
 {
-	return VIPS_FOREIGN_SEQUENTIAL;
+	return VIPS_FOREIGN_SEQUENTIAL | VIPS_FOREIGN_ZERO_COPY;
 }
 
 static int
@@ -139,8 +194,9 @@ vips_foreign_load_jpeg_header(VipsForeignLoad *load)
 	VipsForeignLoadJpeg *jpeg = (VipsForeignLoadJpeg *) load;
 
 	if (vips__jpeg_read_source(jpeg->source,
-			load->out, TRUE, jpeg->shrink, load->fail_on,
-			jpeg->autorotate, jpeg->unlimited))
+			load->out, TRUE, jpeg->scale_num, load->fail_on,
+			jpeg->autorotate, jpeg->unlimited,
+			jpeg->area ? &jpeg->area_rect : NULL))
 		return -1;
 
 	return 0;
@@ -152,13 +208,19 @@ vips_foreign_load_jpeg_load(VipsForeignLoad *load)
 	VipsForeignLoadJpeg *jpeg = (VipsForeignLoadJpeg *) load;
 
 	if (vips__jpeg_read_source(jpeg->source,
-			load->real, FALSE, jpeg->shrink, load->fail_on,
-			jpeg->autorotate, jpeg->unlimited))
+			load->real, FALSE, jpeg->scale_num, load->fail_on,
+			jpeg->autorotate, jpeg->unlimited,
+			jpeg->area ? &jpeg->area_rect : NULL))
 		return -1;
 
 	return 0;
 }
 
+static const VipsForeignMagic vips_foreign_load_jpeg_magic[] = {
+	{ 0, 2, "\xff\xd8" },
+	{ 0, 0, NULL }
+};
+
 static void
 vips_foreign_load_jpeg_class_init(VipsForeignLoadJpegClass *class)
 {
@@ -182,6 +244,7 @@ vips_foreign_load_jpeg_class_init(VipsForeignLoadJpegClass *class)
 	load_class->get_flags_filename = vips_foreign_load_jpeg_get_flags_filename;
 	load_class->get_flags = vips_foreign_load_jpeg_get_flags;
 	load_class->header = vips_foreign_load_jpeg_header;
+	load_class->magic = vips_foreign_load_jpeg_magic;
 	load_class->load = vips_foreign_load_jpeg_load;
 
 	VIPS_ARG_INT(class, "shrink", 20,
@@ -206,12 +269,28 @@ vips_foreign_load_jpeg_class_init(VipsForeignLoadJpegClass *class)
 		G_STRUCT_OFFSET(VipsForeignLoadJpeg, unlimited),
 		FALSE);
 #endif
+
+	VIPS_ARG_DOUBLE(class, "scale", 23,
+		_("Scale"),
+		_("Decode at this scale, rounded up to a multiple of 1/8"),
+		VIPS_ARGUMENT_OPTIONAL_INPUT,
+		G_STRUCT_OFFSET(VipsForeignLoadJpeg, scale),
+		0.125, 2.0, 1.0);
+
+	VIPS_ARG_BOXED(class, "area", 24,
+		_("Area"),
+		_("Only load this left, top, width, height"),
+		VIPS_ARGUMENT_OPTIONAL_INPUT,
+		G_STRUCT_OFFSET(VipsForeignLoadJpeg, area),
+		VIPS_TYPE_ARRAY_INT);
 }
 
 static void
 vips_foreign_load_jpeg_init(VipsForeignLoadJpeg *jpeg)
 {
 	jpeg->shrink = 1;
+	jpeg->scale = 1.0;
+	jpeg->scale_num = 8;
 	jpeg->unlimited = vips_unlimited_get();
 }
 
@@ -439,6 +518,16 @@ vips_foreign_load_jpeg_buffer_init(VipsForeignLoadJpegBuffer *buffer)
  * are 1, 2, 4 and 8. Shrinking during read is very much faster than
  * decompressing the whole image and then shrinking later.
  *
+ * Alternatively, @scale decodes at any multiple of 1/8 from 1/8 to 2,
+ * rounding up. For example, a @scale of 0.3 will decode at 3/8 size. Use
+ * this to get closer to a target size than @shrink allows.
+ *
+ * @area is an array of left, top, width and height, and loads just that
+ * part of the image, after any shrink and autorotate. Only the scanlines
+ * and MCU columns which touch the area are decoded, so this is much faster
+ * than cropping later. [method@Image.extract_area] on a jpeg image which
+ * has not been decoded yet will do this for you.
+ *
  * Use @fail_on to set the type of error that will cause load to fail. By
  * default, loaders are permissive, that is, [enum@Vips.FailOn.NONE].
  *
@@ -485,9 +574,11 @@ vips_foreign_load_jpeg_buffer_init(VipsForeignLoadJpegBuffer *buffer)
  *
  * ::: tip "Optional arguments"
  *     * @shrink: `gint`, shrink by this much on load
+ *     * @scale: `gdouble`, decode at this scale
  *     * @fail_on: [enum@FailOn], types of read error to fail on
  *     * @autorotate: `gboolean`, use exif Orientation tag to rotate the image
  *       during load
+ *     * @area: [struct@ArrayInt], only load this left, top, width, height
  *
  * ::: seealso
  *     [ctor@Image.jpegload_buffer], [method@Image.autorot].
@@ -522,9 +613,11 @@ vips_jpegload(const char *filename, VipsImage **out, ...)
  *
  * ::: tip "Optional arguments"
  *     * @shrink: `gint`, shrink by this much on load
+ *     * @scale: `gdouble`, decode at this scale
  *     * @fail_on: [enum@FailOn], types of read error to fail on
  *     * @autorotate: `gboolean`, use exif Orientation tag to rotate the image
  *       during load
+ *     * @area: [struct@ArrayInt], only load this left, top, width, height
  *
  * ::: seealso
  *     [ctor@Image.jpegload].
@@ -562,9 +655,11 @@ vips_jpegload_buffer(void *buf, size_t len, VipsImage **out, ...)
  *
  * ::: tip "Optional arguments"
  *     * @shrink: `gint`, shrink by this much on load
+ *     * @scale: `gdouble`, decode at this scale
  *     * @fail_on: [enum@FailOn], types of read error to fail on
  *     * @autorotate: `gboolean`, use exif Orientation tag to rotate the image
  *       during load
+ *     * @area: [struct@ArrayInt], only load this left, top, width, height
  *
  * ::: seealso
  *     [ctor@Image.jpegload].
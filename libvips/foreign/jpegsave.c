@@ -587,7 +587,8 @@ vips_foreign_save_jpeg_mime_init(VipsForeignSaveJpegMime *mime)
  * restart_interval is specified, a restart marker will be added after each
  * specified number of MCU blocks.  This makes the stream more recoverable
  * if there are transmission errors, but also allows for some decoders to read
- * part of the JPEG without decoding the whole stream.
+ * part of the JPEG without decoding the whole stream. Baseline images with
+ * a restart interval are compressed in parallel bands.
  *
  * The image is automatically converted to RGB, Monochrome or CMYK before
  * saving.
@@ -0,0 +1,492 @@
+/* lossless rotate, flip and crop of jpeg images
+ *
+ * 15/10/26
+ * 	- from jpegsave.c
+ */
+
+/*
+
+	This file is part of VIPS.
+
+	VIPS is free software; you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+	02110-1301  USA
+
+ */
+
+/*
+
+	These files are distributed with VIPS - http://www.vips.ecs.soton.ac.uk
+
+ */
+
+/*
+#define DEBUG
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /*HAVE_CONFIG_H*/
+#include <glib/gi18n-lib.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vips/vips.h>
+#include <vips/internal.h>
+
+#include "pforeign.h"
+
+#ifdef HAVE_JPEG
+
+typedef struct _VipsJpegtran {
+	VipsOperation parent_instance;
+
+	VipsSource *source;
+	VipsTarget *target;
+
+	/* The transform: the orientation tag, if autorotate is set, then
+	 * rotate by angle, then flip.
+	 */
+	gboolean autorotate;
+	VipsAngle angle;
+	gboolean flip;
+
+	/* Crop in output coordinates, width and height of zero mean to the
+	 * edge.
+	 */
+	int left;
+	int top;
+	int width;
+	int height;
+
+	/* Drop partial edge MCUs rather than decoding.
+	 */
+	gboolean trim;
+
+	/* For the decode fallback.
+	 */
+	int Q;
+
+	VipsForeignKeep keep;
+
+	/* Set if we could transform without decoding.
+	 */
+	gboolean lossless;
+
+} VipsJpegtran;
+
+typedef VipsOperationClass VipsJpegtranClass;
+
+G_DEFINE_TYPE(VipsJpegtran, vips_jpegtran, VIPS_TYPE_OPERATION);
+
+/* Our transforms are a transpose followed by flips, all in output
+ * coordinates. Append a rotate by @angle and a horizontal flip.
+ */
+static void
+vips_jpegtran_append(gboolean *transpose, gboolean *flip_x, gboolean *flip_y,
+	VipsAngle angle, gboolean flip)
+{
+	gboolean transposed;
+	gboolean fx;
+	gboolean fy;
+
+	switch (angle) {
+	case VIPS_ANGLE_D90:
+		transposed = TRUE;
+		fx = TRUE;
+		fy = FALSE;
+		break;
+
+	case VIPS_ANGLE_D180:
+		transposed = FALSE;
+		fx = TRUE;
+		fy = TRUE;
+		break;
+
+	case VIPS_ANGLE_D270:
+		transposed = TRUE;
+		fx = FALSE;
+		fy = TRUE;
+		break;
+
+	case VIPS_ANGLE_D0:
+	default:
+		transposed = FALSE;
+		fx = FALSE;
+		fy = FALSE;
+		break;
+	}
+
+	if (flip)
+		fx = !fx;
+
+	/* Flips that come before a transpose swap axis.
+	 */
+	if (transposed)
+		VIPS_SWAP(gboolean, *flip_x, *flip_y);
+
+	*transpose ^= transposed;
+	*flip_x ^= fx;
+	*flip_y ^= fy;
+}
+
+/* As vips_autorot().
+ */
+static void
+vips_jpegtran_orientation(VipsImage *image, VipsAngle *angle, gboolean *flip)
+{
+	switch (vips_image_get_orientation(image)) {
+	case 2:
+		*angle = VIPS_ANGLE_D0;
+		*flip = TRUE;
+		break;
+
+	case 3:
+		*angle = VIPS_ANGLE_D180;
+		*flip = FALSE;
+		break;
+
+	case 4:
+		*angle = VIPS_ANGLE_D180;
+		*flip = TRUE;
+		break;
+
+	case 5:
+		*angle = VIPS_ANGLE_D90;
+		*flip = TRUE;
+		break;
+
+	case 6:
+		*angle = VIPS_ANGLE_D90;
+		*flip = FALSE;
+		break;
+
+	case 7:
+		*angle = VIPS_ANGLE_D270;
+		*flip = TRUE;
+		break;
+
+	case 8:
+		*angle = VIPS_ANGLE_D270;
+		*flip = FALSE;
+		break;
+
+	case 1:
+	default:
+		*angle = VIPS_ANGLE_D0;
+		*flip = FALSE;
+		break;
+	}
+}
+
+/* The transform can't be done on the coefficients, so decode, transform
+ * and encode again.
+ */
+static int
+vips_jpegtran_decode(VipsJpegtran *jpegtran)
+{
+	VipsImage **t = (VipsImage **)
+		vips_object_local_array(VIPS_OBJECT(jpegtran), 4);
+
+	VipsImage *in;
+
+	if (vips_jpegload_source(jpegtran->source, &t[0],
+			"autorotate", jpegtran->autorotate,
+			NULL))
+		return -1;
+	in = t[0];
+
+	if (jpegtran->angle != VIPS_ANGLE_D0) {
+		if (vips_rot(in, &t[1], jpegtran->angle, NULL))
+			return -1;
+		in = t[1];
+	}
+
+	if (jpegtran->flip) {
+		if (vips_flip(in, &t[2], VIPS_DIRECTION_HORIZONTAL, NULL))
+			return -1;
+		in = t[2];
+	}
+
+	if (jpegtran->left ||
+		jpegtran->top ||
+		jpegtran->width ||
+		jpegtran->height) {
+		int width = jpegtran->width > 0
+			? jpegtran->width
+			: in->Xsize - jpegtran->left;
+		int height = jpegtran->height > 0
+			? jpegtran->height
+			: in->Ysize - jpegtran->top;
+
+		if (vips_extract_area(in, &t[3],
+				jpegtran->left, jpegtran->top, width, height, NULL))
+			return -1;
+		in = t[3];
+	}
+
+	if (vips_jpegsave_target(in, jpegtran->target,
+			"Q", jpegtran->Q,
+			"keep", jpegtran->keep,
+			NULL))
+		return -1;
+
+	return 0;
+}
+
+static int
+vips_jpegtran_build(VipsObject *object)
+{
+	VipsJpegtran *jpegtran = (VipsJpegtran *) object;
+	VipsImage **t = (VipsImage **) vips_object_local_array(object, 1);
+
+	gboolean transpose;
+	gboolean flip_x;
+	gboolean flip_y;
+	VipsRect crop;
+	int result;
+
+	if (VIPS_OBJECT_CLASS(vips_jpegtran_parent_class)->build(object))
+		return -1;
+
+	/* Read the header for the metadata and the orientation.
+	 */
+	t[0] = vips_image_new();
+	if (vips__jpeg_read_source(jpegtran->source, t[0],
+			TRUE, 8, VIPS_FAIL_ON_NONE, FALSE, FALSE, NULL))
+		return -1;
+
+	transpose = FALSE;
+	flip_x = FALSE;
+	flip_y = FALSE;
+
+	if (jpegtran->autorotate) {
+		VipsAngle angle;
+		gboolean flip;
+
+		vips_jpegtran_orientation(t[0], &angle, &flip);
+		vips_jpegtran_append(&transpose, &flip_x, &flip_y, angle, flip);
+		vips_autorot_remove_angle(t[0]);
+	}
+
+	vips_jpegtran_append(&transpose, &flip_x, &flip_y,
+		jpegtran->angle, jpegtran->flip);
+
+	crop.left = jpegtran->left;
+	crop.top = jpegtran->top;
+	crop.width = jpegtran->width;
+	crop.height = jpegtran->height;
+
+#ifdef DEBUG
+	printf("vips_jpegtran_build: transpose = %d, flip_x = %d, flip_y = %d\n",
+		transpose, flip_x, flip_y);
+#endif /*DEBUG*/
+
+	if ((result = vips__jpeg_transform_target(jpegtran->source,
+			 jpegtran->target, t[0],
+			 transpose, flip_x, flip_y, jpegtran->trim, &crop,
+			 jpegtran->keep)) < 0)
+		return -1;
+
+	if (result == 0)
+		g_object_set(object, "lossless", TRUE, NULL);
+	else if (vips_jpegtran_decode(jpegtran))
+		return -1;
+
+	return 0;
+}
+
+static void
+vips_jpegtran_class_init(VipsJpegtranClass *class)
+{
+	GObjectClass *gobject_class = G_OBJECT_CLASS(class);
+	VipsObjectClass *object_class = (VipsObjectClass *) class;
+	VipsOperationClass *operation_class = VIPS_OPERATION_CLASS(class);
+
+	gobject_class->set_property = vips_object_set_property;
+	gobject_class->get_property = vips_object_get_property;
+
+	object_class->nickname = "jpegtran";
+	object_class->description = _("rotate, flip and crop a jpeg losslessly");
+	object_class->build = vips_jpegtran_build;
+
+	/* This writes to a target, so it can't be cached.
+	 */
+	operation_class->flags |= VIPS_OPERATION_NOCACHE;
+
+	VIPS_ARG_OBJECT(class, "source", 1,
+		_("Source"),
+		_("Source to load from"),
+		VIPS_ARGUMENT_REQUIRED_INPUT,
+		G_STRUCT_OFFSET(VipsJpegtran, source),
+		VIPS_TYPE_SOURCE);
+
+	VIPS_ARG_OBJECT(class, "target", 2,
+		_("Target"),
+		_("Target to save to"),
+		VIPS_ARGUMENT_REQUIRED_INPUT,
+		G_STRUCT_OFFSET(VipsJpegtran, target),
+		VIPS_TYPE_TARGET);
+
+	VIPS_ARG_BOOL(class, "autorotate", 3,
+		_("Autorotate"),
+		_("Rotate image using exif orientation"),
+		VIPS_ARGUMENT_OPTIONAL_INPUT,
+		G_STRUCT_OFFSET(VipsJpegtran, autorotate),
+		FALSE);
+
+	VIPS_ARG_ENUM(class, "angle", 4,
+		_("Angle"),
+		_("Angle to rotate image"),
+		VIPS_ARGUMENT_OPTIONAL_INPUT,
+		G_STRUCT_OFFSET(VipsJpegtran, angle),
+		VIPS_TYPE_ANGLE, VIPS_ANGLE_D0);
+
+	VIPS_ARG_BOOL(class, "flip", 5,
+		_("Flip"),
+		_("Flip horizontally after rotating"),
+		VIPS_ARGUMENT_OPTIONAL_INPUT,
+		G_STRUCT_OFFSET(VipsJpegtran, flip),
+		FALSE);
+
+	VIPS_ARG_INT(class, "left", 6,
+		_("Left"),
+		_("Left edge of crop"),
+		VIPS_ARGUMENT_OPTIONAL_INPUT,
+		G_STRUCT_OFFSET(VipsJpegtran, left),
+		0, VIPS_MAX_COORD, 0);
+
+	VIPS_ARG_INT(class, "top", 7,
+		_("Top"),
+		_("Top edge of crop"),
+		VIPS_ARGUMENT_OPTIONAL_INPUT,
+		G_STRUCT_OFFSET(VipsJpegtran, top),
+		0, VIPS_MAX_COORD, 0);
+
+	VIPS_ARG_INT(class, "width", 8,
+		_("Width"),
+		_("Width of crop, zero for to the right edge"),
+		VIPS_ARGUMENT_OPTIONAL_INPUT,
+		G_STRUCT_OFFSET(VipsJpegtran, width),
+		0, VIPS_MAX_COORD, 0);
+
+	VIPS_ARG_INT(class, "height", 9,
+		_("Height"),
+		_("Height of crop, zero for to the bottom edge"),
+		VIPS_ARGUMENT_OPTIONAL_INPUT,
+		G_STRUCT_OFFSET(VipsJpegtran, height),
+		0, VIPS_MAX_COORD, 0);
+
+	VIPS_ARG_BOOL(class, "trim", 10,
+		_("Trim"),
+		_("Trim partial edge MCUs rather than decoding"),
+		VIPS_ARGUMENT_OPTIONAL_INPUT,
+		G_STRUCT_OFFSET(VipsJpegtran, trim),
+		FALSE);
+
+	VIPS_ARG_INT(class, "Q", 11,
+		_("Q"),
+		_("Q factor if we have to decode"),
+		VIPS_ARGUMENT_OPTIONAL_INPUT,
+		G_STRUCT_OFFSET(VipsJpegtran, Q),
+		1, 100, 75);
+
+	VIPS_ARG_FLAGS(class, "keep", 12,
+		_("Keep"),
+		_("Which metadata to retain"),
+		VIPS_ARGUMENT_OPTIONAL_INPUT,
+		G_STRUCT_OFFSET(VipsJpegtran, keep),
+		VIPS_TYPE_FOREIGN_KEEP,
+		VIPS_FOREIGN_KEEP_ALL);
+
+	VIPS_ARG_BOOL(class, "lossless", 13,
+		_("Lossless"),
+		_("Set if the transform was done without decoding"),
+		VIPS_ARGUMENT_OPTIONAL_OUTPUT,
+		G_STRUCT_OFFSET(VipsJpegtran, lossless),
+		FALSE);
+}
+
+static void
+vips_jpegtran_init(VipsJpegtran *jpegtran)
+{
+	jpegtran->angle = VIPS_ANGLE_D0;
+	jpegtran->Q = 75;
+	jpegtran->keep = VIPS_FOREIGN_KEEP_ALL;
+}
+
+#endif /*HAVE_JPEG*/
+
+/**
+ * vips_jpegtran:
+ * @source: source to load from
+ * @target: target to save to
+ * @...: `NULL`-terminated list of optional named arguments
+ *
+ * Rotate, flip and crop a JPEG from @source to @target, working on the
+ * DCT coefficients rather than decoding and encoding the pixels, like the
+ * `jpegtran` program. This is lossless and much faster than
+ * [ctor@Image.jpegload_source], [method@Image.rot] and
+ * [method@Image.jpegsave_target].
+ *
+ * Set @autorotate to apply the orientation tag first, then @angle and @flip
+ * (a horizontal flip after rotating), as [method@Image.autorot]. The
+ * orientation tag is reset if @autorotate is set.
+ *
+ * @left, @top, @width and @height crop the result. @left and @top must be
+ * multiples of the MCU size (usually 8 or 16 pixels) for a lossless crop.
+ * @width and @height of zero mean to the edge of the image.
+ *
+ * Flips are only lossless if there are no partial MCUs on the edge being
+ * flipped. Set @trim to drop these edge pixels instead, as `jpegtran -trim`.
+ *
+ * If the transform can't be done losslessly, the image is decoded and
+ * encoded again with quality @Q. Read @lossless to see which path was
+ * taken.
+ *
+ * Use @keep to control which metadata is retained. EXIF is updated for the
+ * new size.
+ *
+ * ::: tip "Optional arguments"
+ *     * @autorotate: `gboolean`, apply the orientation tag first
+ *     * @angle: [enum@Angle], rotate by this much
+ *     * @flip: `gboolean`, flip horizontally after rotating
+ *     * @left: `gint`, left edge of crop
+ *     * @top: `gint`, top edge of crop
+ *     * @width: `gint`, width of crop
+ *     * @height: `gint`, height of crop
+ *     * @trim: `gboolean`, trim partial edge MCUs
+ *     * @Q: `gint`, quality factor if we need to decode
+ *     * @keep: [flags@ForeignKeep], which metadata to retain
+ *     * @lossless: `gboolean`, output, set if no decode was needed
+ *
+ * ::: seealso
+ *     [ctor@Image.jpegload_source], [method@Image.jpegsave_target].
+ *
+ * Returns: 0 on success, -1 on error.
+ */
+int
+vips_jpegtran(VipsSource *source, VipsTarget *target, ...)
+{
+	va_list ap;
+	int result;
+
+	va_start(ap, target);
+	result = vips_call_split("jpegtran", ap, source, target);
+	va_end(ap);
+
+	return result;
+}
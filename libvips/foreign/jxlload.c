@@ -6,6 +6,8 @@
  * 	- reset read point for _load
  * 13/3/23 MathemanFlo
  * 	- add bits per sample metadata
+ * 14/10/26
+ * 	- set VIPS_FOREIGN_ZERO_COPY
  */
 
 /*
@@ -227,7 +229,7 @@ vips_foreign_load_jxl_get_flags(VipsForeignLoad *load)
 {
 	/* FIXME .. could support random access for non-animated images.
 	 */
-	return VIPS_FOREIGN_SEQUENTIAL;
+	return VIPS_FOREIGN_SEQUENTIAL | VIPS_FOREIGN_ZERO_COPY;
 }
 
 static int
@@ -1245,6 +1247,14 @@ vips_foreign_load_jxl_load(VipsForeignLoad *load)
 	return 0;
 }
 
+/* A bare codestream, or a container.
+ */
+static const VipsForeignMagic vips_foreign_load_jxl_magic[] = {
+	{ 0, 2, "\xff\x0a" },
+	{ 0, 12, "\x00\x00\x00\x0cJXL \r\n\x87\n" },
+	{ 0, 0, NULL }
+};
+
 static void
 vips_foreign_load_jxl_class_init(VipsForeignLoadJxlClass *class)
 {
@@ -1268,6 +1278,7 @@ vips_foreign_load_jxl_class_init(VipsForeignLoadJxlClass *class)
 
 	load_class->get_flags = vips_foreign_load_jxl_get_flags;
 	load_class->header = vips_foreign_load_jxl_header;
+	load_class->magic = vips_foreign_load_jxl_magic;
 	load_class->load = vips_foreign_load_jxl_load;
 
 	VIPS_ARG_INT(class, "page", 20,
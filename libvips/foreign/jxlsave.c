@@ -6,6 +6,9 @@
  * 	- add ICC profile support
  * 8/5/25
  *	- write with JxlEncoderAddChunkedFrame() for lower memory use
+ * 15/10/26
+ *	- generate chunks with a region per libjxl thread, not a pipeline per
+ *	  chunk, and allow threaded access to the line cache
  */
 
 /*
@@ -128,9 +131,11 @@ typedef struct _VipsForeignSaveJxl {
 	 */
 	struct JxlChunkedFrameInputSource input_source;
 
-	/* Map thread ids to regions with this hash table, gate access to it with
-	 * the mutex.
+	/* Map thread ids to regions with this hash table, and track the pixel
+	 * buffers we have lent to libjxl in this set. Gate access to both
+	 * with the mutex.
 	 */
+	GHashTable *region_hash;
 	GHashTable *tile_hash;
 	GMutex tile_lock;
 
@@ -367,6 +372,10 @@ vips_foreign_save_jxl_extra_pixel_format(void *opaque,
 	return vips_foreign_save_jxl_pixel_format(opaque, format);
 }
 
+/* libjxl calls this from its worker threads, often several at once. Each
+ * thread gets its own region on the page, so chunks are computed in parallel
+ * with no new pipeline per chunk.
+ */
 static const void *
 vips_foreign_save_jxl_data_at(void *opaque,
 	size_t xpos, size_t ypos, size_t xsize, size_t ysize,
@@ -375,6 +384,12 @@ vips_foreign_save_jxl_data_at(void *opaque,
 	VipsForeignSave *save = (VipsForeignSave *) opaque;
 	VipsForeignSaveJxl *jxl = (VipsForeignSaveJxl *) opaque;
 
+	VipsRect rect;
+	VipsRegion *region;
+	VipsPel *pels;
+	size_t sizeof_line;
+	guint64 processed;
+
 #ifdef DEBUG
 	printf("vips_foreign_save_jxl_data_at: "
 		"left = %zd, top = %zd, width = %zd, height = %zd\n",
@@ -389,33 +404,61 @@ vips_foreign_save_jxl_data_at(void *opaque,
 	}
 	 */
 
-	VipsImage *tile;
-	if (vips_crop(jxl->page, &tile, xpos, ypos, xsize, ysize, NULL)) {
-		jxl->error = TRUE;
-		/* Returning NULL from data_at won't crash, but will cause a lot of
-		 * messy libjxl diagnostic output. At least it stops save.
-		 */
-		return NULL;
+	g_mutex_lock(&jxl->tile_lock);
+	region = g_hash_table_lookup(jxl->region_hash, g_thread_self());
+	g_mutex_unlock(&jxl->tile_lock);
+
+	if (!region) {
+		if (!(region = vips_region_new(jxl->page))) {
+			/* Returning NULL from data_at won't crash, but will cause a
+			 * lot of messy libjxl diagnostic output. At least it stops
+			 * save.
+			 */
+			jxl->error = TRUE;
+			return NULL;
+		}
+
+		g_mutex_lock(&jxl->tile_lock);
+		g_hash_table_insert(jxl->region_hash, g_thread_self(), region);
+		g_mutex_unlock(&jxl->tile_lock);
 	}
+	else
+		vips__region_take_ownership(region);
 
-	// disable progress reporting from this copy_memory()
-	vips_image_set_int(tile, "hide-progress", 1);
+	rect.left = xpos;
+	rect.top = ypos;
+	rect.width = xsize;
+	rect.height = ysize;
+	sizeof_line = VIPS_IMAGE_SIZEOF_PEL(jxl->page) * xsize;
 
-	VipsImage *memory;
-	if (!(memory = vips_image_copy_memory(tile))) {
-		VIPS_UNREF(tile);
+	/* libjxl can ask for several chunks from one thread before releasing
+	 * any, so we must copy out of the region.
+	 */
+	if (vips_region_prepare(region, &rect) ||
+		!(pels = vips_tracked_malloc(sizeof_line * ysize))) {
+		vips__region_no_ownership(region);
 		jxl->error = TRUE;
 		return NULL;
 	}
-	VIPS_UNREF(tile);
 
-	VipsPel *pels = VIPS_IMAGE_ADDR(memory, 0, 0);
-	*row_offset = VIPS_IMAGE_SIZEOF_LINE(memory);
+	for (int y = 0; y < rect.height; y++)
+		memcpy(pels + y * sizeof_line,
+			VIPS_REGION_ADDR(region, rect.left, rect.top + y),
+			sizeof_line);
+
+	/* The region can be freed by another thread at the end of the page.
+	 */
+	vips__region_no_ownership(region);
+
+	*row_offset = sizeof_line;
 
 	g_mutex_lock(&jxl->tile_lock);
 
-	g_assert(!g_hash_table_lookup(jxl->tile_hash, pels));
-	g_hash_table_insert(jxl->tile_hash, pels, memory);
+	g_assert(!g_hash_table_contains(jxl->tile_hash, pels));
+	g_hash_table_add(jxl->tile_hash, pels);
+
+	jxl->processed += xsize * ysize;
+	processed = jxl->processed;
 
 #ifdef DEBUG
 	printf("\tgenerated pels = %p\n", pels);
@@ -426,8 +469,7 @@ vips_foreign_save_jxl_data_at(void *opaque,
 	/* Trigger any eval callbacks on our source image and
 	 * check for cancel.
 	 */
-	jxl->processed += xsize * ysize;
-	vips_image_eval(save->ready, jxl->processed);
+	vips_image_eval(save->ready, processed);
 	if (vips_image_iskilled(save->ready))
 		return NULL;
 
@@ -455,8 +497,17 @@ vips_foreign_save_jxl_input_release_buffer(void *opaque, const void *pels)
 	printf("vips_foreign_save_jxl_input_release_buffer: pels = %p\n", pels);
 #endif /*DEBUG*/
 
-	g_assert(g_hash_table_lookup(jxl->tile_hash, pels));
+	g_mutex_lock(&jxl->tile_lock);
+	g_assert(g_hash_table_contains(jxl->tile_hash, pels));
 	g_hash_table_remove(jxl->tile_hash, pels);
+	g_mutex_unlock(&jxl->tile_lock);
+}
+
+static void
+vips_foreign_save_jxl_page_free(VipsForeignSaveJxl *jxl)
+{
+	VIPS_FREEF(g_hash_table_destroy, jxl->region_hash);
+	VIPS_FREEF(g_hash_table_destroy, jxl->tile_hash);
 }
 
 static void
@@ -596,7 +647,7 @@ vips_foreign_save_jxl_dispose(GObject *gobject)
 
 	VIPS_UNREF(jxl->target);
 #ifdef HAVE_LIBJXL_0_9
-	VIPS_FREEF(g_hash_table_destroy, jxl->tile_hash);
+	vips_foreign_save_jxl_page_free(jxl);
 #else
 	VIPS_FREEF(vips_tracked_free, jxl->scanline_buffer);
 #endif
@@ -862,8 +913,10 @@ vips_foreign_save_jxl_save_page(VipsForeignSaveJxl *jxl,
 	int n, VipsImage *page)
 {
 	jxl->page = page;
+	jxl->region_hash = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+		NULL, (GDestroyNotify) g_object_unref);
 	jxl->tile_hash = g_hash_table_new_full(g_direct_hash, g_direct_equal,
-			NULL, (GDestroyNotify) g_object_unref);
+		(GDestroyNotify) vips_tracked_free, NULL);
 
 	JxlEncoderFrameSettings *frame_settings =
 		JxlEncoderFrameSettingsCreate(jxl->encoder, NULL);
@@ -875,7 +928,7 @@ vips_foreign_save_jxl_save_page(VipsForeignSaveJxl *jxl,
 			JXL_ENC_FRAME_SETTING_EFFORT, jxl->effort) != JXL_ENC_SUCCESS ||
 		JxlEncoderSetFrameLossless(frame_settings,
 			jxl->lossless) != JXL_ENC_SUCCESS) {
-		VIPS_FREEF(g_hash_table_destroy, jxl->tile_hash);
+		vips_foreign_save_jxl_page_free(jxl);
 		vips_foreign_save_jxl_error(jxl, "JxlEncoderFrameSettings");
 		return -1;
 	}
@@ -889,7 +942,7 @@ vips_foreign_save_jxl_save_page(VipsForeignSaveJxl *jxl,
 				JXL_ENC_FRAME_SETTING_RESPONSIVE, 1) != JXL_ENC_SUCCESS ||
 			JxlEncoderFrameSettingsSetOption(frame_settings,
 				JXL_ENC_FRAME_SETTING_GROUP_ORDER, 1) != JXL_ENC_SUCCESS) {
-			VIPS_FREEF(g_hash_table_destroy, jxl->tile_hash);
+			vips_foreign_save_jxl_page_free(jxl);
 			vips_foreign_save_jxl_error(jxl, "JxlEncoderFrameSettings");
 			return -1;
 		}
@@ -904,7 +957,7 @@ vips_foreign_save_jxl_save_page(VipsForeignSaveJxl *jxl,
 			header.duration = vips_foreign_save_jxl_get_delay(jxl, n);
 
 		if (JxlEncoderSetFrameHeader(frame_settings, &header) != JXL_ENC_SUCCESS) {
-			VIPS_FREEF(g_hash_table_destroy, jxl->tile_hash);
+			vips_foreign_save_jxl_page_free(jxl);
 			vips_foreign_save_jxl_error(jxl, "JxlEncoderSetFrameHeader");
 			return -1;
 		}
@@ -912,7 +965,7 @@ vips_foreign_save_jxl_save_page(VipsForeignSaveJxl *jxl,
 
 	if (JxlEncoderAddChunkedFrame(frame_settings,
 		n == jxl->page_count - 1, jxl->input_source) != JXL_ENC_SUCCESS) {
-		VIPS_FREEF(g_hash_table_destroy, jxl->tile_hash);
+		vips_foreign_save_jxl_page_free(jxl);
 		vips_foreign_save_jxl_error(jxl, "JxlEncoderAddImageFrame");
 		return -1;
 	}
@@ -922,7 +975,7 @@ vips_foreign_save_jxl_save_page(VipsForeignSaveJxl *jxl,
 		g_hash_table_size(jxl->tile_hash));
 #endif /*DEBUG*/
 
-	VIPS_FREEF(g_hash_table_destroy, jxl->tile_hash);
+	vips_foreign_save_jxl_page_free(jxl);
 
 	return 0;
 }
@@ -1225,6 +1278,18 @@ vips_foreign_save_jxl_build(VipsObject *object)
 		return -1;
 	in = t[2];
 
+#ifdef HAVE_LIBJXL_0_9
+	/* libjxl fetches 2k x 2k chunks from several threads at once, so we
+	 * need threaded access and enough lines for two rows of chunks.
+	 */
+	if (vips_tilecache(in, &t[3],
+		"tile-width", in->Xsize,
+		"tile-height", 512,
+		"max_tiles", 2 * 2048 / 512 + 1,
+		"threaded", TRUE,
+		NULL))
+		return -1;
+#else /*!defined(HAVE_LIBJXL_0_9)*/
 	/* We need to cache a complete line of jxl 2k x 2k tiles, plus a bit.
 	 * We don't need to allow threaded access -- libjxl will never try to
 	 * encode tiles in parallel (sadly).
@@ -1235,6 +1300,7 @@ vips_foreign_save_jxl_build(VipsObject *object)
 		"max_tiles", 3500 / 512,
 		NULL))
 		return -1;
+#endif /*defined(HAVE_LIBJXL_0_9)*/
 	in = t[3];
 
 	if (vips_foreign_save_jxl_set_header(jxl, in))
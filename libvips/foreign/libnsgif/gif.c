@@ -1980,6 +1980,47 @@ nsgif_error nsgif_frame_decode(
 	return ret;
 }
 
+/* exported function documented in nsgif.h */
+nsgif_error nsgif_frame_restore(
+		nsgif_t *gif,
+		uint32_t frame,
+		const void *pixels)
+{
+	size_t width = gif->info.width;
+	size_t height = gif->info.height;
+	uint32_t *bitmap;
+
+	if (frame >= gif->info.frame_count ||
+	    gif->frames[frame].info.disposal == NSGIF_DISPOSAL_RESTORE_PREV) {
+		return NSGIF_ERR_BAD_FRAME;
+	}
+
+	bitmap = nsgif__bitmap_get(gif);
+	if (bitmap == NULL) {
+		return NSGIF_ERR_OOM;
+	}
+
+	for (size_t y = 0; y < height; y++) {
+		uint32_t *scanline = bitmap + y * gif->rowspan;
+
+		if (pixels == NULL) {
+			memset(scanline, NSGIF_TRANSPARENT_COLOUR,
+					width * sizeof(*bitmap));
+		} else {
+			memcpy(scanline,
+					(const uint32_t *)pixels + y * width,
+					width * sizeof(*bitmap));
+		}
+	}
+
+	nsgif__bitmap_modified(gif);
+
+	gif->decoded_frame = frame;
+	gif->prev_index = NSGIF_FRAME_INVALID;
+
+	return NSGIF_OK;
+}
+
 /* exported function documented in nsgif.h */
 const nsgif_info_t *nsgif_get_info(const nsgif_t *gif)
 {
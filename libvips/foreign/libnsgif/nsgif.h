@@ -359,6 +359,26 @@ nsgif_error nsgif_frame_decode(
 		uint32_t frame,
 		nsgif_bitmap_t **bitmap);
 
+/**
+ * Restore the decoder to the state just after a frame was decoded.
+ *
+ * The next call to \ref nsgif_frame_decode for a later frame continues
+ * from here, rather than decoding every frame from the start.
+ *
+ * \param[in]  gif     The \ref nsgif_t object.
+ * \param[in]  frame   The frame that pixels is the result of decoding.
+ *                     This frame must not have restore-previous disposal.
+ * \param[in]  pixels  Copy of the bitmap returned by \ref nsgif_frame_decode
+ *                     for frame, tightly packed, or NULL to clear the
+ *                     bitmap.
+ *
+ * \return NSGIF_OK on success, or appropriate error otherwise.
+ */
+nsgif_error nsgif_frame_restore(
+		nsgif_t *gif,
+		uint32_t frame,
+		const void *pixels);
+
 /**
  * Reset a GIF animation.
  *
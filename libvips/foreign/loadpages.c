@@ -0,0 +1,598 @@
+/* decode the pages of a multi-page load in parallel
+ *
+ * 15/10/26
+ * 	- first version
+ */
+
+/*
+
+	This file is part of VIPS.
+
+	VIPS is free software; you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+	02110-1301  USA
+
+ */
+
+/*
+
+	These files are distributed with VIPS - http://www.vips.ecs.soton.ac.uk
+
+ */
+
+/* Multi-page loaders (tiff, pdf, heif, etc.) normally decode a tall image
+ * with a single handle, so pages are decoded one after the other as the
+ * pipeline moves down the image.
+ *
+ * Here, each page is loaded by a separate instance of the loader, with its
+ * own handle, and decoded to memory in a background thread. We keep a window
+ * of pages ahead of the most recent request in flight, so a top-to-bottom
+ * read of the tall image can use every core.
+ */
+
+/*
+#define DEBUG
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /*HAVE_CONFIG_H*/
+#include <glib/gi18n-lib.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vips/vips.h>
+#include <vips/internal.h>
+
+#include "pforeign.h"
+
+typedef enum _VipsForeignLoadPageState {
+	VIPS_FOREIGN_LOAD_PAGE_NONE,
+	VIPS_FOREIGN_LOAD_PAGE_LOADING,
+	VIPS_FOREIGN_LOAD_PAGE_DONE,
+	VIPS_FOREIGN_LOAD_PAGE_ERROR
+} VipsForeignLoadPageState;
+
+typedef struct _VipsForeignLoadPages VipsForeignLoadPages;
+
+typedef struct _VipsForeignLoadPage {
+	VipsForeignLoadPages *pages;
+
+	/* Index into the set of pages we load, and the position of this page
+	 * in the output.
+	 */
+	int i;
+	VipsRect rect;
+
+	VipsForeignLoadPageState state;
+
+	/* The decoded page, once we reach DONE.
+	 */
+	VipsImage *image;
+
+	/* The image we are computing while LOADING, so we can kill it.
+	 */
+	VipsImage *running;
+} VipsForeignLoadPage;
+
+struct _VipsForeignLoadPages {
+	const char *nickname;
+
+	/* First page number, and number of pages.
+	 */
+	int page_no;
+	int n;
+	VipsForeignLoadPage *page;
+
+	/* Decode up to this many pages ahead.
+	 */
+	int window;
+
+	/* Output image size and format.
+	 */
+	int width;
+	int bands;
+	VipsBandFormat format;
+
+	/* Each page load is made from a copy of this unbuilt operation.
+	 */
+	VipsOperation *template;
+
+	/* The source argument, if any, and how to reopen it for each page.
+	 */
+	const char *source_name;
+	char *filename;
+	VipsBlob *blob;
+
+	/* Pad narrow pages with this, if the loader has a background.
+	 */
+	VipsArrayDouble *background;
+
+	/* Protects everything above that changes after setup.
+	 */
+	GMutex lock;
+	GCond cond;
+	int n_running;
+	gboolean kill;
+};
+
+static void *
+vips_foreign_load_pages_copy_argument(VipsObject *object,
+	GParamSpec *pspec,
+	VipsArgumentClass *argument_class,
+	VipsArgumentInstance *argument_instance,
+	void *a, void *b)
+{
+	VipsOperation *new = VIPS_OPERATION(a);
+	const char *name = g_param_spec_get_name(pspec);
+	GType type = G_PARAM_SPEC_VALUE_TYPE(pspec);
+
+	/* Sources are reopened per page, and we set page and n ourselves.
+	 */
+	if ((argument_class->flags & VIPS_ARGUMENT_CONSTRUCT) &&
+		(argument_class->flags & VIPS_ARGUMENT_INPUT) &&
+		argument_instance->assigned &&
+		!g_type_is_a(type, VIPS_TYPE_SOURCE) &&
+		strcmp(name, "page") != 0 &&
+		strcmp(name, "n") != 0 &&
+		strcmp(name, "parallel") != 0) {
+		GValue value = G_VALUE_INIT;
+
+		g_value_init(&value, type);
+		g_object_get_property(G_OBJECT(object), name, &value);
+		g_object_set_property(G_OBJECT(new), name, &value);
+		g_value_unset(&value);
+	}
+
+	return NULL;
+}
+
+/* Find a source input we can't reopen.
+ */
+static void *
+vips_foreign_load_pages_fixed_source(VipsObject *object,
+	GParamSpec *pspec,
+	VipsArgumentClass *argument_class,
+	VipsArgumentInstance *argument_instance,
+	void *a, void *b)
+{
+	if ((argument_class->flags & VIPS_ARGUMENT_INPUT) &&
+		argument_instance->assigned &&
+		g_type_is_a(G_PARAM_SPEC_VALUE_TYPE(pspec), VIPS_TYPE_SOURCE)) {
+		VipsSource *source = *((VipsSource **)
+			G_STRUCT_MEMBER_P(object, argument_class->offset));
+
+		if (!vips_connection_filename(VIPS_CONNECTION(source)) &&
+			!source->data)
+			return pspec;
+	}
+
+	return NULL;
+}
+
+static void *
+vips_foreign_load_pages_find_source(VipsObject *object,
+	GParamSpec *pspec,
+	VipsArgumentClass *argument_class,
+	VipsArgumentInstance *argument_instance,
+	void *a, void *b)
+{
+	VipsForeignLoadPages *pages = (VipsForeignLoadPages *) a;
+
+	if ((argument_class->flags & VIPS_ARGUMENT_INPUT) &&
+		argument_instance->assigned &&
+		g_type_is_a(G_PARAM_SPEC_VALUE_TYPE(pspec), VIPS_TYPE_SOURCE)) {
+		VipsSource *source = *((VipsSource **)
+			G_STRUCT_MEMBER_P(object, argument_class->offset));
+		const char *filename =
+			vips_connection_filename(VIPS_CONNECTION(source));
+
+		pages->source_name = g_param_spec_get_name(pspec);
+		if (filename)
+			pages->filename = g_strdup(filename);
+		else
+			pages->blob = vips_source_map_blob(source);
+
+		return pspec;
+	}
+
+	return NULL;
+}
+
+/**
+ * vips__foreign_load_pages_can:
+ * @load: loader to test
+ *
+ * Test if @load can decode pages in parallel. It needs `page` and `n`
+ * arguments, and any source it reads must be a file or a memory area we can
+ * open again for each page.
+ */
+gboolean
+vips__foreign_load_pages_can(VipsForeignLoad *load)
+{
+	GObjectClass *class = G_OBJECT_GET_CLASS(load);
+
+	return g_object_class_find_property(class, "page") &&
+		g_object_class_find_property(class, "n") &&
+		!vips_argument_map(VIPS_OBJECT(load),
+			vips_foreign_load_pages_fixed_source, NULL, NULL);
+}
+
+/* Make a loader for a single page. Call with the lock held.
+ */
+static VipsOperation *
+vips_foreign_load_pages_new_operation(VipsForeignLoadPages *pages,
+	VipsForeignLoadPage *page)
+{
+	VipsOperation *operation;
+
+	if (!(operation = vips_operation_new(pages->nickname)))
+		return NULL;
+	(void) vips_argument_map(VIPS_OBJECT(pages->template),
+		vips_foreign_load_pages_copy_argument, operation, NULL);
+	g_object_set(operation,
+		"page", pages->page_no + page->i,
+		"n", 1,
+		NULL);
+
+	if (pages->source_name) {
+		VipsSource *source;
+
+		if (pages->filename)
+			source = vips_source_new_from_file(pages->filename);
+		else
+			source = vips_source_new_from_blob(pages->blob);
+		if (!source) {
+			g_object_unref(operation);
+			return NULL;
+		}
+
+		g_object_set(operation, pages->source_name, source, NULL);
+		g_object_unref(source);
+	}
+
+	return operation;
+}
+
+/* Decode a page to memory.
+ */
+static VipsImage *
+vips_foreign_load_pages_decode(VipsForeignLoadPages *pages,
+	VipsForeignLoadPage *page, VipsOperation *operation)
+{
+	VipsImage *x;
+	VipsImage *memory;
+	int result;
+
+	if (vips_object_build(VIPS_OBJECT(operation))) {
+		g_object_unref(operation);
+		return NULL;
+	}
+	g_object_get(operation, "out", &x, NULL);
+	vips_object_unref_outputs(VIPS_OBJECT(operation));
+	g_object_unref(operation);
+
+	/* Pages can be narrower than the image, for example PDFs with a mix
+	 * of page sizes.
+	 */
+	if (x->Xsize < pages->width) {
+		VipsImage *y;
+
+		if (pages->background)
+			result = vips_embed(x, &y, 0, 0, pages->width, x->Ysize,
+				"extend", VIPS_EXTEND_BACKGROUND,
+				"background", pages->background,
+				NULL);
+		else
+			result = vips_embed(x, &y, 0, 0, pages->width, x->Ysize,
+				"extend", VIPS_EXTEND_BLACK,
+				NULL);
+		g_object_unref(x);
+		if (result)
+			return NULL;
+		x = y;
+	}
+
+	if (x->Xsize != pages->width ||
+		x->Ysize != page->rect.height ||
+		x->Bands != pages->bands ||
+		x->BandFmt != pages->format ||
+		x->Coding != VIPS_CODING_NONE) {
+		vips_error(pages->nickname,
+			_("page %d does not match the first page"),
+			pages->page_no + page->i);
+		g_object_unref(x);
+		return NULL;
+	}
+
+#ifdef DEBUG
+	printf("vips_foreign_load_pages_decode: decoding page %d\n",
+		pages->page_no + page->i);
+#endif /*DEBUG*/
+
+	memory = vips_image_new_memory();
+
+	g_mutex_lock(&pages->lock);
+	page->running = x;
+	if (pages->kill)
+		vips_image_set_kill(x, TRUE);
+	g_mutex_unlock(&pages->lock);
+
+	result = vips_image_write(x, memory);
+
+	g_mutex_lock(&pages->lock);
+	page->running = NULL;
+	g_mutex_unlock(&pages->lock);
+
+	g_object_unref(x);
+	if (result) {
+		g_object_unref(memory);
+		return NULL;
+	}
+
+	return memory;
+}
+
+static void
+vips_foreign_load_pages_work(void *a, void *b)
+{
+	VipsForeignLoadPage *page = (VipsForeignLoadPage *) a;
+	VipsForeignLoadPages *pages = page->pages;
+
+	VipsOperation *operation;
+	VipsImage *image;
+
+	g_mutex_lock(&pages->lock);
+	operation = pages->kill ?
+		NULL : vips_foreign_load_pages_new_operation(pages, page);
+	g_mutex_unlock(&pages->lock);
+
+	image = operation ?
+		vips_foreign_load_pages_decode(pages, page, operation) : NULL;
+
+	/* pages can be freed as soon as we unlock, so this must be the last
+	 * thing we do.
+	 */
+	g_mutex_lock(&pages->lock);
+	page->image = image;
+	page->state = image ?
+		VIPS_FOREIGN_LOAD_PAGE_DONE : VIPS_FOREIGN_LOAD_PAGE_ERROR;
+	pages->n_running -= 1;
+	g_cond_broadcast(&pages->cond);
+	g_mutex_unlock(&pages->lock);
+}
+
+/* Start decoding a page. Call with the lock held.
+ */
+static void
+vips_foreign_load_pages_start(VipsForeignLoadPages *pages, int i)
+{
+	VipsForeignLoadPage *page = &pages->page[i];
+
+	page->state = VIPS_FOREIGN_LOAD_PAGE_LOADING;
+	pages->n_running += 1;
+	if (vips_thread_execute("page", vips_foreign_load_pages_work, page)) {
+		page->state = VIPS_FOREIGN_LOAD_PAGE_ERROR;
+		pages->n_running -= 1;
+	}
+}
+
+/* Get a ref to decoded page @i, waiting if necessary.
+ */
+static VipsImage *
+vips_foreign_load_pages_get(VipsForeignLoadPages *pages, int i)
+{
+	VipsImage *image;
+	int j;
+
+	vips__worker_lock(&pages->lock);
+
+	/* Reads are mostly top to bottom, so we can drop pages more than one
+	 * behind this one. They will be decoded again if we need them.
+	 */
+	for (j = 0; j < i - 1; j++)
+		if (pages->page[j].state == VIPS_FOREIGN_LOAD_PAGE_DONE) {
+			VIPS_UNREF(pages->page[j].image);
+			pages->page[j].state = VIPS_FOREIGN_LOAD_PAGE_NONE;
+		}
+
+	for (j = i; j < VIPS_MIN(pages->n, i + pages->window); j++)
+		if (pages->page[j].state == VIPS_FOREIGN_LOAD_PAGE_NONE)
+			vips_foreign_load_pages_start(pages, j);
+
+	while (pages->page[i].state == VIPS_FOREIGN_LOAD_PAGE_LOADING)
+		vips__worker_cond_wait(&pages->cond, &pages->lock);
+
+	if (pages->page[i].state == VIPS_FOREIGN_LOAD_PAGE_DONE)
+		image = g_object_ref(pages->page[i].image);
+	else {
+		vips_error(pages->nickname,
+			_("unable to load page %d"), pages->page_no + i);
+		image = NULL;
+	}
+
+	g_mutex_unlock(&pages->lock);
+
+	return image;
+}
+
+static int
+vips_foreign_load_pages_generate(VipsRegion *out_region,
+	void *seq, void *a, void *b, gboolean *stop)
+{
+	VipsForeignLoadPages *pages = (VipsForeignLoadPages *) a;
+	VipsRect *r = &out_region->valid;
+
+	for (int i = 0; i < pages->n; i++) {
+		VipsForeignLoadPage *page = &pages->page[i];
+
+		VipsRect hit;
+		VipsImage *image;
+		size_t sizeof_line;
+
+		vips_rect_intersectrect(r, &page->rect, &hit);
+		if (vips_rect_isempty(&hit))
+			continue;
+
+		if (!(image = vips_foreign_load_pages_get(pages, i)))
+			return -1;
+
+		sizeof_line = VIPS_IMAGE_SIZEOF_PEL(image) * hit.width;
+		for (int y = 0; y < hit.height; y++)
+			memcpy(VIPS_REGION_ADDR(out_region, hit.left, hit.top + y),
+				VIPS_IMAGE_ADDR(image,
+					hit.left - page->rect.left,
+					hit.top + y - page->rect.top),
+				sizeof_line);
+
+		g_object_unref(image);
+	}
+
+	return 0;
+}
+
+static void
+vips_foreign_load_pages_close(VipsImage *image, VipsForeignLoadPages *pages)
+{
+	/* Stop any decodes, and wait for the workers to leave.
+	 */
+	g_mutex_lock(&pages->lock);
+	pages->kill = TRUE;
+	for (int i = 0; i < pages->n; i++)
+		if (pages->page[i].running)
+			vips_image_set_kill(pages->page[i].running, TRUE);
+	while (pages->n_running > 0)
+		g_cond_wait(&pages->cond, &pages->lock);
+	g_mutex_unlock(&pages->lock);
+
+	for (int i = 0; i < pages->n; i++)
+		VIPS_UNREF(pages->page[i].image);
+	VIPS_UNREF(pages->template);
+	VIPS_FREE(pages->filename);
+	VIPS_FREEF(vips_area_unref, pages->blob);
+	VIPS_FREEF(vips_area_unref, pages->background);
+	g_mutex_clear(&pages->lock);
+	g_cond_clear(&pages->cond);
+	VIPS_FREE(pages->page);
+	g_free(pages);
+}
+
+/**
+ * vips__foreign_load_pages:
+ * @load: loader to decode with
+ * @out: write the pages here
+ * @n: number of pages
+ * @rects: (nullable): position of each page in the output
+ *
+ * Decode the pages of a multi-page load in parallel and assemble them into
+ * @out, a tall image the same size as @load's header.
+ *
+ * If @rects is `NULL`, pages are all `page-height` high and @n is ignored.
+ * Otherwise, page @i is at @rects[@i] and pages narrower than the image are
+ * padded with the loader's `background`.
+ *
+ * Check vips__foreign_load_pages_can() first.
+ *
+ * Returns: 0 on success, -1 on error.
+ */
+int
+vips__foreign_load_pages(VipsForeignLoad *load, VipsImage *out,
+	int n, const VipsRect *rects)
+{
+	VipsObjectClass *class = VIPS_OBJECT_GET_CLASS(load);
+	VipsImage *header = load->out;
+
+	VipsForeignLoadPages *pages;
+	VipsImage *t;
+	int page_height;
+
+	if (!rects) {
+		page_height = vips_image_get_page_height(header);
+		n = header->Ysize / page_height;
+	}
+
+#ifdef DEBUG
+	printf("vips__foreign_load_pages: %d pages\n", n);
+#endif /*DEBUG*/
+
+	pages = g_new0(VipsForeignLoadPages, 1);
+	pages->nickname = class->nickname;
+	g_object_get(load, "page", &pages->page_no, NULL);
+	pages->n = n;
+	pages->page = g_new0(VipsForeignLoadPage, n);
+	pages->window = VIPS_CLIP(1, vips_concurrency_get(), n);
+	pages->width = header->Xsize;
+	pages->bands = header->Bands;
+	pages->format = header->BandFmt;
+	g_mutex_init(&pages->lock);
+	g_cond_init(&pages->cond);
+
+	for (int i = 0; i < n; i++) {
+		VipsForeignLoadPage *page = &pages->page[i];
+
+		page->pages = pages;
+		page->i = i;
+		if (rects)
+			page->rect = rects[i];
+		else {
+			page->rect.top = i * page_height;
+			page->rect.height = page_height;
+		}
+
+		/* Narrow pages are padded to the full width.
+		 */
+		page->rect.left = 0;
+		page->rect.width = header->Xsize;
+	}
+
+	/* From here, pages is freed when t closes.
+	 */
+	t = vips_image_new();
+	g_signal_connect(t, "close",
+		G_CALLBACK(vips_foreign_load_pages_close), pages);
+
+	if (!(pages->template = vips_operation_new(class->nickname))) {
+		g_object_unref(t);
+		return -1;
+	}
+	(void) vips_argument_map(VIPS_OBJECT(load),
+		vips_foreign_load_pages_copy_argument, pages->template, NULL);
+	(void) vips_argument_map(VIPS_OBJECT(load),
+		vips_foreign_load_pages_find_source, pages, NULL);
+	if (pages->source_name &&
+		!pages->filename &&
+		!pages->blob) {
+		g_object_unref(t);
+		return -1;
+	}
+
+	if (g_object_class_find_property(G_OBJECT_GET_CLASS(load), "background"))
+		g_object_get(load, "background", &pages->background, NULL);
+
+	vips_image_init_fields(t,
+		header->Xsize, header->Ysize, header->Bands, header->BandFmt,
+		header->Coding, header->Type, header->Xres, header->Yres);
+	if (vips_image_pipelinev(t, VIPS_DEMAND_STYLE_THINSTRIP, NULL) ||
+		vips_image_generate(t,
+			NULL, vips_foreign_load_pages_generate, NULL, pages, NULL) ||
+		vips_image_write(t, out)) {
+		g_object_unref(t);
+		return -1;
+	}
+	g_object_unref(t);
+
+	return 0;
+}
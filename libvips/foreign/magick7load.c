@@ -12,6 +12,8 @@
  * 	- set "orientation"
  * 22/3/23 MathemanFlo
  * 	- add bits per sample metadata
+ * 15/10/26
+ * 	- read with a virtual cache view per thread, no more global lock
  */
 
 /*
@@ -85,15 +87,10 @@ typedef struct _VipsForeignLoadMagick7 {
 	 */
 	int n_pages;
 
-	int n_frames;			/* Number of frames we will read */
-	Image **frames;			/* An Image* for each frame */
-	CacheView **cache_view; /* A CacheView for each frame */
+	int n_frames;	/* Number of frames we will read */
+	Image **frames; /* An Image* for each frame */
 	int frame_height;
 
-	/* Mutex to serialise calls to libMagick during threaded read.
-	 */
-	GMutex lock;
-
 } VipsForeignLoadMagick7;
 
 typedef VipsForeignLoadClass VipsForeignLoadMagick7Class;
@@ -272,21 +269,14 @@ vips_foreign_load_magick7_finalize(GObject *gobject)
 {
 	VipsForeignLoadMagick7 *magick7 = (VipsForeignLoadMagick7 *) gobject;
 
-	int i;
-
 #ifdef DEBUG
 	printf("vips_foreign_load_magick7_finalize: %p\n", gobject);
 #endif /*DEBUG*/
 
-	for (i = 0; i < magick7->n_frames; i++) {
-		VIPS_FREEF(DestroyCacheView, magick7->cache_view[i]);
-	}
 	VIPS_FREEF(DestroyImageList, magick7->image);
 	VIPS_FREEF(DestroyImageInfo, magick7->image_info);
 	VIPS_FREE(magick7->frames);
-	VIPS_FREE(magick7->cache_view);
 	VIPS_FREEF(magick_destroy_exception, magick7->exception);
-	g_mutex_clear(&magick7->lock);
 
 	G_OBJECT_CLASS(vips_foreign_load_magick7_parent_class)->finalize(gobject);
 }
@@ -401,7 +391,6 @@ static void
 vips_foreign_load_magick7_init(VipsForeignLoadMagick7 *magick7)
 {
 	magick7->n = 1;
-	g_mutex_init(&magick7->lock);
 }
 
 static void
@@ -661,62 +650,105 @@ vips_foreign_load_magick7_parse(VipsForeignLoadMagick7 *magick7,
 		} \
 	}
 
+/* Each thread reads through its own set of virtual cache views. A cache view
+ * keeps the buffer it reads pixels into, so views can't be shared, but reads
+ * on separate views can run at the same time, with no lock.
+ */
+static void *
+vips_foreign_load_magick7_start(VipsImage *out, void *a, void *b)
+{
+	VipsForeignLoadMagick7 *magick7 = (VipsForeignLoadMagick7 *) a;
+
+	CacheView **views;
+	int i;
+
+	if (!(views = VIPS_ARRAY(NULL, magick7->n_frames, CacheView *)))
+		return NULL;
+	for (i = 0; i < magick7->n_frames; i++)
+		views[i] = AcquireVirtualCacheView(magick7->frames[i],
+			magick7->exception);
+
+	return views;
+}
+
+static int
+vips_foreign_load_magick7_stop(void *seq, void *a, void *b)
+{
+	VipsForeignLoadMagick7 *magick7 = (VipsForeignLoadMagick7 *) a;
+	CacheView **views = (CacheView **) seq;
+
+	int i;
+
+	for (i = 0; i < magick7->n_frames; i++)
+		VIPS_FREEF(DestroyCacheView, views[i]);
+	g_free(views);
+
+	return 0;
+}
+
 static int
 vips_foreign_load_magick7_fill_region(VipsRegion *out_region,
 	void *seq, void *a, void *b, gboolean *stop)
 {
 	VipsForeignLoadMagick7 *magick7 = (VipsForeignLoadMagick7 *) a;
+	CacheView **views = (CacheView **) seq;
 	VipsRect *r = &out_region->valid;
 	VipsImage *im = out_region->im;
 
 	int y;
 
-	for (y = 0; y < r->height; y++) {
+	/* Fetch all the lines we need from each frame in one call.
+	 */
+	for (y = 0; y < r->height;) {
 		int top = r->top + y;
 		int frame = top / magick7->frame_height;
 		int line = top % magick7->frame_height;
+		int height = VIPS_MIN(r->height - y, magick7->frame_height - line);
 		Image *image = magick7->frames[frame];
 
-		Quantum *restrict p;
-		VipsPel *restrict q;
-
-		vips__worker_lock(&magick7->lock);
+		const Quantum *restrict p;
+		int z;
 
-		p = GetCacheViewAuthenticPixels(magick7->cache_view[frame],
-			r->left, line, r->width, 1,
+		p = GetCacheViewVirtualPixels(views[frame],
+			r->left, line, r->width, height,
 			magick7->exception);
 
-		g_mutex_unlock(&magick7->lock);
-
-		if (!p)
+		if (!p) {
 			/* This can happen if, for example, some frames of a
 			 * gif are shorter than others. It's not always
 			 * an error.
 			 */
+			y += height;
 			continue;
+		}
 
-		q = VIPS_REGION_ADDR(out_region, r->left, top);
+		for (z = 0; z < height; z++) {
+			VipsPel *restrict q =
+				VIPS_REGION_ADDR(out_region, r->left, top + z);
 
-		switch (im->BandFmt) {
-		case VIPS_FORMAT_UCHAR:
-			UNPACK(unsigned char);
-			break;
+			switch (im->BandFmt) {
+			case VIPS_FORMAT_UCHAR:
+				UNPACK(unsigned char);
+				break;
 
-		case VIPS_FORMAT_USHORT:
-			UNPACK(unsigned short);
-			break;
+			case VIPS_FORMAT_USHORT:
+				UNPACK(unsigned short);
+				break;
 
-		case VIPS_FORMAT_FLOAT:
-			UNPACK(float);
-			break;
+			case VIPS_FORMAT_FLOAT:
+				UNPACK(float);
+				break;
 
-		case VIPS_FORMAT_DOUBLE:
-			UNPACK(double);
-			break;
+			case VIPS_FORMAT_DOUBLE:
+				UNPACK(double);
+				break;
 
-		default:
-			g_assert_not_reached();
+			default:
+				g_assert_not_reached();
+			}
 		}
+
+		y += height;
 	}
 
 	return 0;
@@ -749,17 +781,6 @@ vips_foreign_load_magick7_load(VipsForeignLoadMagick7 *magick7)
 		p = GetNextImageInList(p);
 	}
 
-	/* And a cache_view for each frame.
-	 */
-	g_assert(!magick7->cache_view);
-	if (!(magick7->cache_view = VIPS_ARRAY(NULL,
-			  magick7->n_frames, CacheView *)))
-		return -1;
-	for (i = 0; i < magick7->n_frames; i++) {
-		magick7->cache_view[i] = AcquireAuthenticCacheView(
-			magick7->frames[i], magick7->exception);
-	}
-
 #ifdef DEBUG
 	/* Only display the traits from frame0, they should all be the same.
 	 */
@@ -768,7 +789,9 @@ vips_foreign_load_magick7_load(VipsForeignLoadMagick7 *magick7)
 #endif /*DEBUG*/
 
 	if (vips_image_generate(load->out,
-			NULL, vips_foreign_load_magick7_fill_region, NULL,
+			vips_foreign_load_magick7_start,
+			vips_foreign_load_magick7_fill_region,
+			vips_foreign_load_magick7_stop,
 			magick7, NULL))
 		return -1;
 
@@ -239,7 +239,9 @@ vips_foreign_load_matrix_load(VipsForeignLoad *load)
 			 (q = vips_break_token(p, " \t")) &&
 			 x < load->out->Xsize;
 			 x++, p = q)
-			if (vips_strtod(p, &matrix->linebuf[x])) {
+			if (!vips__strtod_fast(p, p + strlen(p),
+					&matrix->linebuf[x]) &&
+				vips_strtod(p, &matrix->linebuf[x])) {
 				vips_error(class->nickname,
 					_("bad number \"%s\""), p);
 				g_free(line);
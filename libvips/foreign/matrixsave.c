@@ -4,6 +4,8 @@
  * 	- wrap a class around the matrix writer
  * 21/2/20
  * 	- rewrite for the VipsTarget API
+ * 15/10/26
+ * 	- format numbers with vips__dtoa()
  */
 
 /*
@@ -48,6 +50,7 @@
 #include <string.h>
 
 #include <vips/vips.h>
+#include <vips/internal.h>
 
 #include "pforeign.h"
 
@@ -85,14 +88,14 @@ vips_foreign_save_matrix_block(VipsRegion *region, VipsRect *area, void *a)
 		double *p = (double *)
 			VIPS_REGION_ADDR(region, 0, area->top + y);
 
-		char buf[G_ASCII_DTOSTR_BUF_SIZE];
+		char buf[VIPS__DTOA_BUF_SIZE];
 
 		for (x = 0; x < area->width; x++) {
 			if (x > 0)
-				vips_target_writes(matrix->target, " ");
+				VIPS_TARGET_PUTC(matrix->target, ' ');
 
-			g_ascii_dtostr(buf, G_ASCII_DTOSTR_BUF_SIZE, p[x]);
-			vips_target_writes(matrix->target, buf);
+			vips_target_write(matrix->target,
+				buf, vips__dtoa(buf, p[x]));
 		}
 
 		if (vips_target_writes(matrix->target, "\n"))
@@ -5,6 +5,8 @@
  * 9/9/19
  * 	- use double for all floating point scalar metadata, like other loaders
  * 	- remove stray use of "n" property
+ * 15/10/26
+ * 	- map uncompressed images directly
  */
 
 /*
@@ -41,7 +43,6 @@
 
 /* TODO
  *
- * - for uncompressed images, we could do direct mapping of the input
  * - perhaps we could stream compressed images? but only if ext is defined at
  *   the start of the file
  *   	(yes, file format is magic number, 348-byte header, extension data,
@@ -545,6 +546,51 @@ vips_foreign_load_nifti_header(VipsForeignLoad *load)
 	return 0;
 }
 
+/* Uncompressed binary files can be mapped directly, so huge volumes open
+ * instantly and page in as they are read.
+ */
+static gboolean
+vips_foreign_load_nifti_can_map(VipsForeignLoadNifti *nifti)
+{
+	nifti_image *nim = nifti->nim;
+
+	return nim->iname &&
+		nim->iname_offset >= 0 &&
+		nim->nifti_type != NIFTI_FTYPE_ASCII &&
+		!nifti_is_gzfile(nim->iname);
+}
+
+static int
+vips_foreign_load_nifti_load_mapped(VipsForeignLoadNifti *nifti)
+{
+	VipsForeignLoad *load = (VipsForeignLoad *) nifti;
+	nifti_image *nim = nifti->nim;
+	VipsImage **t = (VipsImage **)
+		vips_object_local_array(VIPS_OBJECT(load), 3);
+
+#ifdef DEBUG
+	printf("vips_foreign_load_nifti_load_mapped: mapping %s at %d\n",
+		nim->iname, nim->iname_offset);
+#endif /*DEBUG*/
+
+	/* Swap lazily if the file is not in our byte order.
+	 */
+	if (!(t[0] = vips_image_new_from_file_raw(nim->iname,
+			  load->out->Xsize, load->out->Ysize,
+			  VIPS_IMAGE_SIZEOF_PEL(load->out), nim->iname_offset)) ||
+		vips_copy(t[0], &t[1],
+			"bands", load->out->Bands,
+			"format", load->out->BandFmt,
+			"interpretation", load->out->Type,
+			NULL) ||
+		vips__byteswap_bool(t[1], &t[2],
+			nim->byteorder != nifti_short_order()) ||
+		vips_image_write(t[2], load->real))
+		return -1;
+
+	return 0;
+}
+
 static int
 vips_foreign_load_nifti_load(VipsForeignLoad *load)
 {
@@ -555,7 +601,10 @@ vips_foreign_load_nifti_load(VipsForeignLoad *load)
 	printf("vips_foreign_load_nifti_load: loading image\n");
 #endif /*DEBUG*/
 
-	/* We just read the entire image to memory.
+	if (vips_foreign_load_nifti_can_map(nifti))
+		return vips_foreign_load_nifti_load_mapped(nifti);
+
+	/* Otherwise read the entire image to memory.
 	 */
 	if (nifti_image_load(nifti->nim)) {
 		vips_error(class->nickname,
@@ -803,6 +852,9 @@ vips_foreign_load_nifti_source_init(
  *
  * Read a NIFTI image file into a VIPS image.
  *
+ * Uncompressed files are mapped directly, so even very large volumes open
+ * quickly. Compressed files are decompressed to memory.
+ *
  * NIFTI metadata is attached with the "nifti-" prefix.
  *
  * ::: seealso
@@ -12,6 +12,10 @@
  * 	- set interlaced=1 for interlaced images
  * 13/3/23 MathemanFlo
  * 	- add bits per sample metadata
+ * 14/10/26
+ * 	- set VIPS_FOREIGN_ZERO_COPY
+ * 15/10/26
+ * 	- seek from independent frames and a cache of keyframes
  */
 
 /*
@@ -79,6 +83,32 @@
 
 #include <libnsgif/nsgif.h>
 
+/* While seeking, snapshot the canvas every this many frames.
+ */
+#define VIPS_NSGIF_KEYFRAME_INTERVAL (16)
+
+/* Keep at most this many bytes of keyframes, for all GIFs.
+ */
+#define VIPS_NSGIF_KEYFRAME_MAX_BYTES (64 * 1024 * 1024)
+
+/* A snapshot of the canvas just after a frame was decoded. Keyframes are
+ * shared between loaders, so loading a late page of a GIF we've seen before
+ * only decodes from the nearest keyframe.
+ */
+typedef struct _VipsNsgifKeyframe {
+	/* Checksum of the GIF data.
+	 */
+	char *key;
+
+	int frame;
+	size_t length;
+	void *pixels;
+} VipsNsgifKeyframe;
+
+static GMutex vips_nsgif_keyframe_lock;
+static GQueue vips_nsgif_keyframes = G_QUEUE_INIT;
+static size_t vips_nsgif_keyframe_bytes = 0;
+
 #define VIPS_TYPE_FOREIGN_LOAD_GIF (vips_foreign_load_nsgif_get_type())
 #define VIPS_FOREIGN_LOAD_GIF(obj) \
 	(G_TYPE_CHECK_INSTANCE_CAST((obj), \
@@ -118,6 +148,16 @@ typedef struct _VipsForeignLoadNsgif {
 	unsigned char *data;
 	size_t size;
 
+	/* Checksum of data for the keyframe cache, made on the first long
+	 * seek.
+	 */
+	char *key;
+
+	/* Frames which replace the whole canvas, so decode can start there.
+	 * Array of length @info->frame_count.
+	 */
+	gboolean *independent;
+
 	/* Information about the current GIF.
 	 */
 	const nsgif_info_t *info;
@@ -177,20 +217,45 @@ vips_foreign_load_nsgif_dispose(GObject *gobject)
 	VIPS_FREEF(nsgif_destroy, gif->anim);
 	VIPS_UNREF(gif->source);
 	VIPS_FREE(gif->delay);
+	VIPS_FREE(gif->independent);
+	VIPS_FREE(gif->key);
 
 	G_OBJECT_CLASS(vips_foreign_load_nsgif_parent_class)->dispose(gobject);
 }
 
+static void
+vips_nsgif_keyframe_free(VipsNsgifKeyframe *keyframe)
+{
+	g_free(keyframe->key);
+	g_free(keyframe->pixels);
+	g_free(keyframe);
+}
+
+/* Drop the oldest keyframes until we are under @max_bytes. Call with the
+ * lock held.
+ */
+static void
+vips_nsgif_keyframe_trim(size_t max_bytes)
+{
+	VipsNsgifKeyframe *keyframe;
+
+	while (vips_nsgif_keyframe_bytes > max_bytes &&
+		(keyframe = g_queue_pop_head(&vips_nsgif_keyframes))) {
+		vips_nsgif_keyframe_bytes -= keyframe->length;
+		vips_nsgif_keyframe_free(keyframe);
+	}
+}
+
 static VipsForeignFlags
 vips_foreign_load_nsgif_get_flags_filename(const char *filename)
 {
-	return VIPS_FOREIGN_SEQUENTIAL;
+	return VIPS_FOREIGN_SEQUENTIAL | VIPS_FOREIGN_ZERO_COPY;
 }
 
 static VipsForeignFlags
 vips_foreign_load_nsgif_get_flags(VipsForeignLoad *load)
 {
-	return VIPS_FOREIGN_SEQUENTIAL;
+	return VIPS_FOREIGN_SEQUENTIAL | VIPS_FOREIGN_ZERO_COPY;
 }
 
 static gboolean
@@ -377,6 +442,8 @@ vips_foreign_load_nsgif_header(VipsForeignLoad *load)
 	 */
 	if (!(data = vips_source_map(gif->source, &size)))
 		return -1;
+	gif->data = (unsigned char *) data;
+	gif->size = size;
 
 	/* Treat errors from _scan() as warnings. If libnsgif really can't do
 	 * something it'll fail gracefully later when we try to read out
@@ -468,11 +535,187 @@ vips_foreign_load_nsgif_header(VipsForeignLoad *load)
 
 	gif->gif_delay = gif->delay[0] / 10;
 
+	/* A frame is independent if it paints every pixel of the canvas, and
+	 * we can restore the decoder to the frame before it.
+	 */
+	VIPS_FREE(gif->independent);
+	if (!(gif->independent = VIPS_ARRAY(NULL,
+			  gif->info->frame_count, gboolean)))
+		return -1;
+	for (i = 0; i < gif->info->frame_count; i++) {
+		const nsgif_frame_info_t *frame_info =
+			nsgif_get_frame_info(gif->anim, i);
+		const nsgif_frame_info_t *prev_info = i > 0
+			? nsgif_get_frame_info(gif->anim, i - 1)
+			: NULL;
+
+		gif->independent[i] = frame_info->display &&
+			!frame_info->transparency &&
+			frame_info->rect.x0 == 0 &&
+			frame_info->rect.y0 == 0 &&
+			frame_info->rect.x1 >= gif->info->width &&
+			frame_info->rect.y1 >= gif->info->height &&
+			(!prev_info ||
+				prev_info->disposal != NSGIF_DISPOSAL_RESTORE_PREV);
+	}
+
 	vips_foreign_load_nsgif_set_header(gif, load->out);
 
 	return 0;
 }
 
+/* Restore the latest cached keyframe for this GIF in [start, page). Return
+ * the frame we restored, or -1.
+ */
+static int
+vips_foreign_load_nsgif_keyframe_restore(VipsForeignLoadNsgif *gif,
+	int start, int page)
+{
+	VipsNsgifKeyframe *best;
+	GList *p;
+	int frame;
+
+	g_mutex_lock(&vips_nsgif_keyframe_lock);
+
+	best = NULL;
+	for (p = vips_nsgif_keyframes.head; p; p = p->next) {
+		VipsNsgifKeyframe *keyframe = (VipsNsgifKeyframe *) p->data;
+
+		if (keyframe->frame >= start &&
+			keyframe->frame < page &&
+			(!best || keyframe->frame > best->frame) &&
+			strcmp(keyframe->key, gif->key) == 0)
+			best = keyframe;
+	}
+
+	frame = -1;
+	if (best) {
+		/* Move to the end of the queue, so it's the last to go.
+		 */
+		g_queue_remove(&vips_nsgif_keyframes, best);
+		g_queue_push_tail(&vips_nsgif_keyframes, best);
+
+		if (nsgif_frame_restore(gif->anim,
+				best->frame, best->pixels) == NSGIF_OK)
+			frame = best->frame;
+	}
+
+	g_mutex_unlock(&vips_nsgif_keyframe_lock);
+
+	return frame;
+}
+
+/* Snapshot the canvas for @frame, which has just been decoded.
+ */
+static void
+vips_foreign_load_nsgif_keyframe_add(VipsForeignLoadNsgif *gif, int frame)
+{
+	size_t length = (size_t) gif->info->width * gif->info->height * 4;
+
+	VipsNsgifKeyframe *keyframe;
+	GList *p;
+
+	/* Don't let one huge GIF flush everything.
+	 */
+	if (length > VIPS_NSGIF_KEYFRAME_MAX_BYTES / 4)
+		return;
+
+	g_mutex_lock(&vips_nsgif_keyframe_lock);
+
+	/* Another loader might have added this one.
+	 */
+	for (p = vips_nsgif_keyframes.head; p; p = p->next) {
+		keyframe = (VipsNsgifKeyframe *) p->data;
+
+		if (keyframe->frame == frame &&
+			strcmp(keyframe->key, gif->key) == 0) {
+			g_mutex_unlock(&vips_nsgif_keyframe_lock);
+			return;
+		}
+	}
+
+	keyframe = g_new(VipsNsgifKeyframe, 1);
+	keyframe->key = g_strdup(gif->key);
+	keyframe->frame = frame;
+	keyframe->length = length;
+	keyframe->pixels = g_malloc(length);
+	memcpy(keyframe->pixels, gif->bitmap, length);
+
+	g_queue_push_tail(&vips_nsgif_keyframes, keyframe);
+	vips_nsgif_keyframe_bytes += length;
+	vips_nsgif_keyframe_trim(VIPS_NSGIF_KEYFRAME_MAX_BYTES);
+
+	g_mutex_unlock(&vips_nsgif_keyframe_lock);
+}
+
+/* Decode @page to gif->bitmap. libnsgif can only decode forwards from the
+ * last frame it decoded or from the start, so we find a closer place to
+ * begin: the last independent frame, or a keyframe from an earlier decode.
+ */
+static int
+vips_foreign_load_nsgif_decode(VipsForeignLoadNsgif *gif, int page)
+{
+	int start;
+	int frame;
+	nsgif_error result;
+
+	/* Where libnsgif would start from.
+	 */
+	start = gif->frame_number >= 0 && gif->frame_number < page
+		? gif->frame_number + 1
+		: 0;
+
+	for (frame = page; frame > start; frame--)
+		if (gif->independent[frame])
+			break;
+	if (frame > start &&
+		nsgif_frame_restore(gif->anim, frame - 1, NULL) == NSGIF_OK)
+		start = frame;
+
+	if (page - start > VIPS_NSGIF_KEYFRAME_INTERVAL) {
+		if (!gif->key)
+			gif->key = g_compute_checksum_for_data(G_CHECKSUM_SHA256,
+				gif->data, gif->size);
+
+		if ((frame = vips_foreign_load_nsgif_keyframe_restore(gif,
+				 start, page)) >= 0)
+			start = frame + 1;
+	}
+
+	VIPS_DEBUG_MSG("vips_foreign_load_nsgif_decode: "
+				   "page %d from frame %d\n",
+		page, start);
+
+	for (frame = start; frame <= page; frame++) {
+		const nsgif_frame_info_t *frame_info;
+
+		result = nsgif_frame_decode(gif->anim, frame, &gif->bitmap);
+		VIPS_DEBUG_MSG("  nsgif_frame_decode(%d) = %d\n",
+			frame, result);
+		if (result != NSGIF_OK) {
+			gif->frame_number = -1;
+			vips_foreign_load_nsgif_error(gif, result);
+			return -1;
+		}
+
+		frame_info = nsgif_get_frame_info(gif->anim, frame);
+		if (gif->key &&
+			frame < page &&
+			(frame + 1) % VIPS_NSGIF_KEYFRAME_INTERVAL == 0 &&
+			frame_info->display &&
+			frame_info->disposal != NSGIF_DISPOSAL_RESTORE_PREV)
+			vips_foreign_load_nsgif_keyframe_add(gif, frame);
+	}
+
+#ifdef VERBOSE
+	print_frame(nsgif_get_frame_info(gif->anim, page));
+#endif /*VERBOSE*/
+
+	gif->frame_number = page;
+
+	return 0;
+}
+
 static int
 vips_foreign_load_nsgif_generate(VipsRegion *out_region,
 	void *seq, void *a, void *b, gboolean *stop)
@@ -494,28 +737,14 @@ vips_foreign_load_nsgif_generate(VipsRegion *out_region,
 		int page = (r->top + y) / gif->info->height + gif->page;
 		int line = (r->top + y) % gif->info->height;
 
-		nsgif_error result;
 		VipsPel *p, *q;
 
 		g_assert(line >= 0 && line < gif->info->height);
 		g_assert(page >= 0 && page < gif->info->frame_count);
 
-		if (gif->frame_number != page) {
-			result = nsgif_frame_decode(gif->anim,
-				page, &gif->bitmap);
-			VIPS_DEBUG_MSG("  nsgif_frame_decode(%d) = %d\n",
-				page, result);
-			if (result != NSGIF_OK) {
-				vips_foreign_load_nsgif_error(gif, result);
-				return -1;
-			}
-
-#ifdef VERBOSE
-			print_frame(nsgif_get_frame_info(gif->anim, page));
-#endif /*VERBOSE*/
-
-			gif->frame_number = page;
-		}
+		if (gif->frame_number != page &&
+			vips_foreign_load_nsgif_decode(gif, page))
+			return -1;
 
 		p = (VipsPel *) gif->bitmap + (size_t) line * gif->info->width * sizeof(int);
 		q = VIPS_REGION_ADDR(out_region, 0, r->top + y);
@@ -591,6 +820,11 @@ vips_foreign_load_nsgif_load(VipsForeignLoad *load)
 	return 0;
 }
 
+static const VipsForeignMagic vips_foreign_load_nsgif_magic[] = {
+	{ 0, 4, "GIF8" },
+	{ 0, 0, NULL }
+};
+
 static void
 vips_foreign_load_nsgif_class_init(VipsForeignLoadNsgifClass *class)
 {
@@ -614,6 +848,7 @@ vips_foreign_load_nsgif_class_init(VipsForeignLoadNsgifClass *class)
 		vips_foreign_load_nsgif_get_flags_filename;
 	load_class->get_flags = vips_foreign_load_nsgif_get_flags;
 	load_class->header = vips_foreign_load_nsgif_header;
+	load_class->magic = vips_foreign_load_nsgif_magic;
 	load_class->load = vips_foreign_load_nsgif_load;
 
 	VIPS_ARG_INT(class, "page", 10,
@@ -914,6 +1149,16 @@ vips_foreign_load_nsgif_source_init(VipsForeignLoadNsgifSource *source)
 
 #endif /*HAVE_NSGIF*/
 
+void
+vips__nsgif_keyframe_shutdown(void)
+{
+#ifdef HAVE_NSGIF
+	g_mutex_lock(&vips_nsgif_keyframe_lock);
+	vips_nsgif_keyframe_trim(0);
+	g_mutex_unlock(&vips_nsgif_keyframe_lock);
+#endif /*HAVE_NSGIF*/
+}
+
 /**
  * vips_gifload:
  * @filename: file to load
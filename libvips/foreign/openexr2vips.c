@@ -16,6 +16,9 @@
  * 	- tag output as scRGB
  * 16/8/18
  * 	- shut down the input file as soon as we can [kleisauke]
+ * 15/10/26
+ * 	- use the OpenEXR core API when we can, decode chunks in parallel
+ * 	- load mip levels as pages
  */
 
 /*
@@ -86,6 +89,9 @@
 #include <vips/internal.h>
 
 #include <ImfCRgbaFile.h>
+#ifdef HAVE_OPENEXR_CORE
+#include <openexr.h>
+#endif /*HAVE_OPENEXR_CORE*/
 
 #include "pforeign.h"
 
@@ -195,8 +201,8 @@ read_new(const char *filename, VipsImage *out)
 	return read;
 }
 
-gboolean
-vips__openexr_istiled(const char *filename)
+static gboolean
+read_istiled(const char *filename)
 {
 	Read *read;
 	gboolean tiled;
@@ -242,8 +248,8 @@ read_header(Read *read, VipsImage *out)
 	(void) vips_image_pipelinev(out, hint, NULL);
 }
 
-int
-vips__openexr_read_header(const char *filename, VipsImage *out)
+static int
+read_legacy_header(const char *filename, VipsImage *out)
 {
 	Read *read;
 
@@ -354,8 +360,8 @@ vips__openexr_generate(VipsRegion *out,
 	return 0;
 }
 
-int
-vips__openexr_read(const char *filename, VipsImage *out)
+static int
+read_legacy(const char *filename, VipsImage *out)
 {
 	Read *read;
 
@@ -434,4 +440,544 @@ vips__openexr_read(const char *filename, VipsImage *out)
 	return 0;
 }
 
+#ifdef HAVE_OPENEXR_CORE
+
+/* The core API reads chunks (tiles, or groups of scanlines) independently
+ * and is safe to use from many threads at once, so each vips worker decodes
+ * the chunks it needs with its own decode pipeline.
+ *
+ * We handle the first part of scanline and tiled files with R, G, B, A or Y
+ * channels at full resolution. Anything else (deep data, subsampled
+ * chroma) goes to the old RGBA interface.
+ */
+
+/* Indexes into the channel map.
+ */
+enum {
+	CORE_R,
+	CORE_G,
+	CORE_B,
+	CORE_A,
+	CORE_Y,
+	CORE_LAST
+};
+
+typedef struct _Core {
+	char *filename;
+	VipsImage *out;
+	exr_context_t context;
+	exr_storage_t storage;
+
+	/* The data window of the full-res image.
+	 */
+	VipsRect window;
+
+	/* The mip level we load, and the number of levels.
+	 */
+	int page;
+	int n_pages;
+
+	/* Size of this level.
+	 */
+	int width;
+	int height;
+
+	/* Chunks are tiles, or groups of whole scanlines.
+	 */
+	int chunk_width;
+	int chunk_height;
+
+	/* Set if we found this channel.
+	 */
+	gboolean has[CORE_LAST];
+} Core;
+
+/* Per-thread decode state.
+ */
+typedef struct _CoreSeq {
+	Core *core;
+	exr_decode_pipeline_t decoder;
+	gboolean initialized;
+
+	/* A chunk, as RGBA float.
+	 */
+	float *buffer;
+} CoreSeq;
+
+static void
+core_error_handler(exr_const_context_t context,
+	exr_result_t code, const char *msg)
+{
+	vips_error("exr2vips", _("EXR error: %s"),
+		msg ? msg : exr_get_error_code_as_string(code));
+}
+
+static void
+core_destroy(VipsImage *out, Core *core)
+{
+	if (core->context)
+		exr_finish(&core->context);
+	VIPS_FREE(core->filename);
+	g_free(core);
+}
+
+/* Find the channels we can load, FALSE if we can't load this file.
+ */
+static gboolean
+core_channels(Core *core)
+{
+	static const char *names[CORE_LAST] = { "R", "G", "B", "A", "Y" };
+
+	const exr_attr_chlist_t *chlist;
+
+	if (exr_get_channels(core->context, 0, &chlist))
+		return FALSE;
+
+	for (int i = 0; i < chlist->num_channels; i++) {
+		const exr_attr_chlist_entry_t *entry = &chlist->entries[i];
+
+		for (int j = 0; j < CORE_LAST; j++)
+			if (strcmp(entry->name.str, names[j]) == 0) {
+				if (entry->x_sampling != 1 ||
+					entry->y_sampling != 1)
+					return FALSE;
+
+				core->has[j] = TRUE;
+			}
+	}
+
+	return core->has[CORE_R] ||
+		core->has[CORE_G] ||
+		core->has[CORE_B] ||
+		core->has[CORE_Y];
+}
+
+/* Open with the core API. If we can't handle this file, return NULL and
+ * set @fallback, and the caller should try the old API instead.
+ */
+static Core *
+core_new(const char *filename, VipsImage *out, int page, gboolean *fallback)
+{
+	exr_context_initializer_t init = EXR_DEFAULT_CONTEXT_INITIALIZER;
+	exr_attr_box2i_t box;
+	int n_parts;
+	int32_t lines;
+	Core *core;
+
+	*fallback = TRUE;
+
+	core = g_new0(Core, 1);
+	core->filename = g_strdup(filename);
+	core->out = out;
+	core->page = page;
+
+	init.error_handler_fn = core_error_handler;
+
+	/* Errors just mean we try the old API.
+	 */
+	vips_error_freeze();
+	if (exr_start_read(&core->context, filename, &init) ||
+		exr_get_count(core->context, &n_parts) ||
+		n_parts < 1 ||
+		exr_get_storage(core->context, 0, &core->storage) ||
+		(core->storage != EXR_STORAGE_SCANLINE &&
+			core->storage != EXR_STORAGE_TILED) ||
+		exr_get_data_window(core->context, 0, &box) ||
+		!core_channels(core)) {
+		vips_error_thaw();
+		core_destroy(NULL, core);
+		return NULL;
+	}
+	vips_error_thaw();
+
+	core->window.left = box.min.x;
+	core->window.top = box.min.y;
+	core->window.width = box.max.x - box.min.x + 1;
+	core->window.height = box.max.y - box.min.y + 1;
+
+	core->n_pages = 1;
+	core->width = core->window.width;
+	core->height = core->window.height;
+
+	if (core->storage == EXR_STORAGE_TILED) {
+		uint32_t tile_width;
+		uint32_t tile_height;
+		exr_tile_level_mode_t level_mode;
+		exr_tile_round_mode_t round_mode;
+		int32_t levels_x;
+		int32_t levels_y;
+		int32_t width;
+		int32_t height;
+
+		if (exr_get_tile_descriptor(core->context, 0,
+				&tile_width, &tile_height,
+				&level_mode, &round_mode) ||
+			exr_get_tile_levels(core->context, 0,
+				&levels_x, &levels_y)) {
+			core_destroy(NULL, core);
+			return NULL;
+		}
+
+		/* For ripmaps, just the levels which shrink in both axes.
+		 */
+		core->n_pages = VIPS_MAX(1, VIPS_MIN(levels_x, levels_y));
+
+		*fallback = FALSE;
+		if (page < 0 ||
+			page >= core->n_pages) {
+			vips_error("exr2vips", "%s", _("bad page number"));
+			core_destroy(NULL, core);
+			return NULL;
+		}
+
+		if (exr_get_level_sizes(core->context, 0, page, page,
+				&width, &height)) {
+			core_destroy(NULL, core);
+			return NULL;
+		}
+
+		core->width = width;
+		core->height = height;
+		core->chunk_width = tile_width;
+		core->chunk_height = tile_height;
+	}
+	else {
+		*fallback = FALSE;
+		if (page != 0) {
+			vips_error("exr2vips", "%s", _("bad page number"));
+			core_destroy(NULL, core);
+			return NULL;
+		}
+
+		if (exr_get_scanlines_per_chunk(core->context, 0, &lines)) {
+			core_destroy(NULL, core);
+			return NULL;
+		}
+
+		core->chunk_width = core->width;
+		core->chunk_height = lines;
+	}
+
+	if (core->width <= 0 ||
+		core->height <= 0 ||
+		core->chunk_width <= 0 ||
+		core->chunk_height <= 0) {
+		vips_error("exr2vips", "%s", _("bad image dimensions"));
+		core_destroy(NULL, core);
+		return NULL;
+	}
+
+	if (out)
+		g_signal_connect(out, "close",
+			G_CALLBACK(core_destroy), core);
+
+#ifdef DEBUG
+	printf("exr2vips: core API, %s, page %d of %d, %d x %d\n",
+		core->storage == EXR_STORAGE_TILED ? "tiled" : "scanline",
+		core->page, core->n_pages, core->width, core->height);
+#endif /*DEBUG*/
+
+	return core;
+}
+
+static void
+core_header(Core *core, VipsImage *out)
+{
+	vips_image_init_fields(out,
+		core->width, core->height, 4,
+		VIPS_FORMAT_FLOAT,
+		VIPS_CODING_NONE, VIPS_INTERPRETATION_scRGB, 1.0, 1.0);
+
+	if (core->storage == EXR_STORAGE_TILED) {
+		vips_image_set_int(out, VIPS_META_TILE_WIDTH, core->chunk_width);
+		vips_image_set_int(out, VIPS_META_TILE_HEIGHT, core->chunk_height);
+	}
+
+	vips_image_set_int(out, VIPS_META_N_PAGES, core->n_pages);
+
+	(void) vips_image_pipelinev(out, VIPS_DEMAND_STYLE_THINSTRIP, NULL);
+}
+
+static void *
+core_start(VipsImage *out, void *a, void *b)
+{
+	Core *core = (Core *) a;
+	CoreSeq *seq;
+
+	seq = g_new0(CoreSeq, 1);
+	seq->core = core;
+	seq->buffer = g_try_new(float,
+		(size_t) core->chunk_width * core->chunk_height * 4);
+	if (!seq->buffer) {
+		vips_error("exr2vips", "%s", _("out of memory"));
+		g_free(seq);
+		return NULL;
+	}
+
+	return seq;
+}
+
+static int
+core_stop(void *vseq, void *a, void *b)
+{
+	CoreSeq *seq = (CoreSeq *) vseq;
+
+	if (seq->initialized)
+		exr_decoding_destroy(seq->core->context, &seq->decoder);
+	g_free(seq->buffer);
+	g_free(seq);
+
+	return 0;
+}
+
+/* Point the decoder at our chunk buffer.
+ */
+static void
+core_set_channels(CoreSeq *seq)
+{
+	Core *core = seq->core;
+
+	for (int i = 0; i < seq->decoder.channel_count; i++) {
+		exr_coding_channel_info_t *channel = &seq->decoder.channels[i];
+
+		int band;
+
+		if (strcmp(channel->channel_name, "R") == 0 ||
+			strcmp(channel->channel_name, "Y") == 0)
+			band = 0;
+		else if (strcmp(channel->channel_name, "G") == 0)
+			band = 1;
+		else if (strcmp(channel->channel_name, "B") == 0)
+			band = 2;
+		else if (strcmp(channel->channel_name, "A") == 0)
+			band = 3;
+		else
+			band = -1;
+
+		/* Y only goes to band 0 for mono images.
+		 */
+		if (strcmp(channel->channel_name, "Y") == 0 &&
+			core->has[CORE_R])
+			band = -1;
+
+		if (band >= 0) {
+			channel->decode_to_ptr = (uint8_t *) (seq->buffer + band);
+			channel->user_pixel_stride = 4 * sizeof(float);
+			channel->user_line_stride =
+				core->chunk_width * 4 * sizeof(float);
+			channel->user_bytes_per_element = sizeof(float);
+			channel->user_data_type = EXR_PIXEL_FLOAT;
+		}
+		else
+			channel->decode_to_ptr = NULL;
+	}
+}
+
+/* Decode the chunk at @x, @y (level coordinates) to seq->buffer.
+ */
+static int
+core_decode(CoreSeq *seq, int x, int y, VipsRect *chunk)
+{
+	Core *core = seq->core;
+	exr_chunk_info_t info;
+	exr_result_t result;
+	size_t n_pels;
+
+	chunk->left = x;
+	chunk->top = y;
+	chunk->width = VIPS_MIN(core->chunk_width, core->width - x);
+	chunk->height = VIPS_MIN(core->chunk_height, core->height - y);
+
+	if (core->storage == EXR_STORAGE_TILED)
+		result = exr_read_tile_chunk_info(core->context, 0,
+			x / core->chunk_width, y / core->chunk_height,
+			core->page, core->page, &info);
+	else
+		result = exr_read_scanline_chunk_info(core->context, 0,
+			core->window.top + y, &info);
+	if (result)
+		return -1;
+
+	if (!seq->initialized) {
+		if (exr_decoding_initialize(core->context, 0,
+				&info, &seq->decoder))
+			return -1;
+		seq->initialized = TRUE;
+		core_set_channels(seq);
+		if (exr_decoding_choose_default_routines(core->context, 0,
+				&seq->decoder))
+			return -1;
+	}
+	else {
+		if (exr_decoding_update(core->context, 0, &info, &seq->decoder))
+			return -1;
+		core_set_channels(seq);
+	}
+
+	/* Missing colour is black, missing alpha is opaque.
+	 */
+	n_pels = (size_t) core->chunk_width * core->chunk_height;
+	if (!core->has[CORE_A] ||
+		(!core->has[CORE_Y] &&
+			(!core->has[CORE_R] ||
+				!core->has[CORE_G] ||
+				!core->has[CORE_B])))
+		for (size_t i = 0; i < n_pels; i++) {
+			float *p = seq->buffer + i * 4;
+
+			p[0] = 0.0;
+			p[1] = 0.0;
+			p[2] = 0.0;
+			p[3] = 1.0;
+		}
+
+	if (exr_decoding_run(core->context, 0, &seq->decoder))
+		return -1;
+
+	/* Mono images: copy Y to G and B.
+	 */
+	if (core->has[CORE_Y] &&
+		!core->has[CORE_R])
+		for (size_t i = 0; i < n_pels; i++) {
+			float *p = seq->buffer + i * 4;
+
+			p[1] = p[0];
+			p[2] = p[0];
+		}
+
+	return 0;
+}
+
+static int
+core_generate(VipsRegion *out_region,
+	void *vseq, void *a, void *b, gboolean *stop)
+{
+	CoreSeq *seq = (CoreSeq *) vseq;
+	Core *core = (Core *) a;
+	VipsRect *r = &out_region->valid;
+	int cw = core->chunk_width;
+	int ch = core->chunk_height;
+
+	for (int y = (r->top / ch) * ch; y < VIPS_RECT_BOTTOM(r); y += ch)
+		for (int x = (r->left / cw) * cw; x < VIPS_RECT_RIGHT(r); x += cw) {
+			VipsRect chunk;
+			VipsRect hit;
+
+			if (core_decode(seq, x, y, &chunk)) {
+				vips_foreign_load_invalidate(core->out);
+				return -1;
+			}
+
+			vips_rect_intersectrect(&chunk, r, &hit);
+			for (int z = 0; z < hit.height; z++) {
+				float *p = seq->buffer +
+					((hit.top - chunk.top + z) * cw +
+						hit.left - chunk.left) * 4;
+				VipsPel *q = VIPS_REGION_ADDR(out_region,
+					hit.left, hit.top + z);
+
+				memcpy(q, p, hit.width * 4 * sizeof(float));
+			}
+		}
+
+	return 0;
+}
+
+static int
+core_read(Core *core, VipsImage *out)
+{
+	VipsImage **t = (VipsImage **)
+		vips_object_local_array(VIPS_OBJECT(out), 2);
+
+	t[0] = vips_image_new();
+	core_header(core, t[0]);
+
+	/* Keep enough chunks for two complete rows of chunks, plus 50%.
+	 * Threaded, so many chunks can decode at once.
+	 */
+	if (vips_image_generate(t[0],
+			core_start, core_generate, core_stop, core, NULL) ||
+		vips_tilecache(t[0], &t[1],
+			"tile_width", core->chunk_width,
+			"tile_height", core->chunk_height,
+			"max_tiles",
+			(int) (2.5 * (1 + core->width / core->chunk_width)),
+			"threaded", TRUE,
+			NULL) ||
+		vips_image_write(t[1], out))
+		return -1;
+
+	return 0;
+}
+
+#endif /*HAVE_OPENEXR_CORE*/
+
+/* Can we read this file a region at a time.
+ */
+gboolean
+vips__openexr_ispartial(const char *filename)
+{
+#ifdef HAVE_OPENEXR_CORE
+	Core *core;
+	gboolean fallback;
+
+	if ((core = core_new(filename, NULL, 0, &fallback))) {
+		core_destroy(NULL, core);
+		return TRUE;
+	}
+	vips_error_clear();
+#endif /*HAVE_OPENEXR_CORE*/
+
+	return read_istiled(filename);
+}
+
+int
+vips__openexr_read_header(const char *filename, VipsImage *out, int page)
+{
+#ifdef HAVE_OPENEXR_CORE
+	{
+		Core *core;
+		gboolean fallback;
+
+		if ((core = core_new(filename, NULL, page, &fallback))) {
+			core_header(core, out);
+			core_destroy(NULL, core);
+			return 0;
+		}
+		if (!fallback)
+			return -1;
+	}
+#endif /*HAVE_OPENEXR_CORE*/
+
+	if (page != 0) {
+		vips_error("exr2vips", "%s", _("bad page number"));
+		return -1;
+	}
+
+	return read_legacy_header(filename, out);
+}
+
+int
+vips__openexr_read(const char *filename, VipsImage *out, int page)
+{
+#ifdef HAVE_OPENEXR_CORE
+	{
+		Core *core;
+		gboolean fallback;
+
+		if ((core = core_new(filename, out, page, &fallback)))
+			return core_read(core, out);
+		if (!fallback)
+			return -1;
+	}
+#endif /*HAVE_OPENEXR_CORE*/
+
+	if (page != 0) {
+		vips_error("exr2vips", "%s", _("bad page number"));
+		return -1;
+	}
+
+	return read_legacy(filename, out);
+}
+
 #endif /*HAVE_OPENEXR*/
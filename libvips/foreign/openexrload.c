@@ -2,6 +2,8 @@
  *
  * 5/12/11
  * 	- from openslideload.c
+ * 15/10/26
+ * 	- add @page to load mip levels
  */
 
 /*
@@ -59,6 +61,10 @@ typedef struct _VipsForeignLoadOpenexr {
 	 */
 	char *filename;
 
+	/* Load this mip level.
+	 */
+	int page;
+
 } VipsForeignLoadOpenexr;
 
 typedef VipsForeignLoadClass VipsForeignLoadOpenexrClass;
@@ -72,7 +78,7 @@ vips_foreign_load_openexr_get_flags_filename(const char *filename)
 	VipsForeignFlags flags;
 
 	flags = 0;
-	if (vips__openexr_istiled(filename))
+	if (vips__openexr_ispartial(filename))
 		flags |= VIPS_FOREIGN_PARTIAL;
 
 	return flags;
@@ -92,7 +98,8 @@ vips_foreign_load_openexr_header(VipsForeignLoad *load)
 {
 	VipsForeignLoadOpenexr *openexr = (VipsForeignLoadOpenexr *) load;
 
-	if (vips__openexr_read_header(openexr->filename, load->out))
+	if (vips__openexr_read_header(openexr->filename, load->out,
+			openexr->page))
 		return -1;
 
 	VIPS_SETSTR(load->out->filename, openexr->filename);
@@ -105,7 +112,8 @@ vips_foreign_load_openexr_load(VipsForeignLoad *load)
 {
 	VipsForeignLoadOpenexr *openexr = (VipsForeignLoadOpenexr *) load;
 
-	if (vips__openexr_read(openexr->filename, load->real))
+	if (vips__openexr_read(openexr->filename, load->real,
+			openexr->page))
 		return -1;
 
 	return 0;
@@ -151,6 +159,13 @@ vips_foreign_load_openexr_class_init(VipsForeignLoadOpenexrClass *class)
 		VIPS_ARGUMENT_REQUIRED_INPUT,
 		G_STRUCT_OFFSET(VipsForeignLoadOpenexr, filename),
 		NULL);
+
+	VIPS_ARG_INT(class, "page", 10,
+		_("Page"),
+		_("Load this mip level"),
+		VIPS_ARGUMENT_OPTIONAL_INPUT,
+		G_STRUCT_OFFSET(VipsForeignLoadOpenexr, page),
+		0, 100000, 0);
 }
 
 static void
@@ -172,8 +187,14 @@ vips_foreign_load_openexr_init(VipsForeignLoadOpenexr *openexr)
  * OpenEXR colour management, image attributes, many pixel formats, anything
  * other than RGBA.
  *
- * This reader uses the rather limited OpenEXR C API. It should really be
- * redone in C++.
+ * With OpenEXR 3.1 and later, the file is read a chunk at a time with the
+ * core API, and chunks are decoded in parallel. Mip-mapped and rip-mapped
+ * tiled files have one page per level, use @page to pick a level, and
+ * [ctor@Image.thumbnail] will use the smallest level it can. Files with
+ * subsampled channels or deep data are read with the older RGBA API.
+ *
+ * ::: tip "Optional arguments"
+ *     * @page: `gint`, load this mip level
  *
  * ::: seealso
  *     [ctor@Image.new_from_file].
@@ -2,6 +2,9 @@
  *
  * 1/4/25
  *	- first version!
+ * 15/10/26
+ * 	- reopen slides which have changed on disc
+ * 	- cache associated images
  */
 
 /*
@@ -34,6 +37,7 @@
 #include <config.h>
 #endif /*HAVE_CONFIG_H*/
 #include <glib/gi18n-lib.h>
+#include <glib/gstdio.h>
 
 #ifdef HAVE_OPENSLIDE
 
@@ -53,9 +57,17 @@
 typedef struct _VipsOpenslideConnection {
 	char *filename;
 
+	// the mtime and size of the file when we opened it
+	gint64 mtime;
+	gint64 size;
+
 	// protected by vips_openslideconnection_lock
 	int ref_count;
 
+	// associated images we've decoded, "name:rgb" -> VipsImage, protected by
+	// vips_openslideconnection_lock
+	GHashTable *associated;
+
 	// first access protected by separate lock, since initialization
 	// is slow
 	openslide_t *osr;
@@ -93,6 +105,7 @@ vips_openslideconnection_free(VipsOpenslideConnection *connection)
 	VIPS_FREEF(openslide_close, connection->osr);
 	g_mutex_unlock(&connection->osr_lock);
 	g_mutex_clear(&connection->osr_lock);
+	VIPS_FREEF(g_hash_table_destroy, connection->associated);
 	VIPS_FREE(connection->filename);
 	g_free(connection);
 }
@@ -147,8 +160,27 @@ vips_openslideconnection_ref(VipsOpenslideConnection *connection)
 	connection->ref_count += 1;
 }
 
+/* Get the mtime and size of a file, or zero if we can't stat it.
+ */
+static void
+vips_openslideconnection_stat(const char *filename,
+	gint64 *mtime, gint64 *size)
+{
+	GStatBuf st;
+
+	if (g_stat(filename, &st)) {
+		*mtime = 0;
+		*size = 0;
+	}
+	else {
+		*mtime = st.st_mtime;
+		*size = st.st_size;
+	}
+}
+
 static VipsOpenslideConnection *
-vips_openslideconnection_new(const char *filename)
+vips_openslideconnection_new(const char *filename,
+	gint64 mtime, gint64 size)
 {
 #ifdef DEBUG
 	printf("vips_openslideconnection_new: %s\n", filename);
@@ -158,6 +190,10 @@ vips_openslideconnection_new(const char *filename)
 
 	connection = g_new0(VipsOpenslideConnection, 1);
 	connection->filename = g_strdup(filename);
+	connection->mtime = mtime;
+	connection->size = size;
+	connection->associated = g_hash_table_new_full(g_str_hash, g_str_equal,
+		g_free, g_object_unref);
 	g_mutex_init(&connection->osr_lock);
 
 	g_assert(!g_hash_table_lookup(vips_openslideconnection_cache, filename));
@@ -176,6 +212,11 @@ vips__openslideconnection_open(const char *filename, gboolean revalidate)
 		filename, revalidate);
 #endif /*DEBUG*/
 
+	gint64 mtime;
+	gint64 size;
+
+	vips_openslideconnection_stat(filename, &mtime, &size);
+
 	g_mutex_lock(&vips_openslideconnection_lock);
 
 	if (!vips_openslideconnection_cache) {
@@ -193,14 +234,17 @@ vips__openslideconnection_open(const char *filename, gboolean revalidate)
 
 	connection = g_hash_table_lookup(vips_openslideconnection_cache, filename);
 
-	// discard any cached connection on revalidate
+	// discard any unused cached connection on revalidate, or if the file
+	// has been replaced since we opened it
 	if (connection &&
 		connection->ref_count == 0 &&
-		revalidate)
+		(revalidate ||
+			connection->mtime != mtime ||
+			connection->size != size))
 		VIPS_FREEF(vips_openslideconnection_free, connection);
 
 	if (!connection)
-		connection = vips_openslideconnection_new(filename);
+		connection = vips_openslideconnection_new(filename, mtime, size);
 
 	vips_openslideconnection_ref(connection);
 
@@ -260,6 +304,61 @@ vips__openslideconnection_close(const char *filename)
 	g_mutex_unlock(&vips_openslideconnection_lock);
 }
 
+static char *
+vips_openslideconnection_associated_key(const char *name, gboolean rgb)
+{
+	return g_strdup_printf("%s:%d", name, rgb ? 1 : 0);
+}
+
+/* Get a ref to a decoded associated image, or NULL if we've not seen it.
+ */
+VipsImage *
+vips__openslideconnection_get_associated(const char *filename,
+	const char *name, gboolean rgb)
+{
+	char *key = vips_openslideconnection_associated_key(name, rgb);
+
+	VipsOpenslideConnection *connection;
+	VipsImage *image;
+
+	g_mutex_lock(&vips_openslideconnection_lock);
+
+	image = NULL;
+	if (vips_openslideconnection_cache &&
+		(connection = g_hash_table_lookup(vips_openslideconnection_cache,
+			 filename)) &&
+		(image = g_hash_table_lookup(connection->associated, key)))
+		g_object_ref(image);
+
+	g_mutex_unlock(&vips_openslideconnection_lock);
+
+	g_free(key);
+
+	return image;
+}
+
+/* Keep a decoded associated image for future loads from this slide. The
+ * cache takes a ref.
+ */
+void
+vips__openslideconnection_set_associated(const char *filename,
+	const char *name, gboolean rgb, VipsImage *image)
+{
+	VipsOpenslideConnection *connection;
+
+	g_mutex_lock(&vips_openslideconnection_lock);
+
+	if (vips_openslideconnection_cache &&
+		(connection = g_hash_table_lookup(vips_openslideconnection_cache,
+			 filename))) {
+		g_object_ref(image);
+		g_hash_table_replace(connection->associated,
+			vips_openslideconnection_associated_key(name, rgb), image);
+	}
+
+	g_mutex_unlock(&vips_openslideconnection_lock);
+}
+
 int
 vips__openslideconnection_leak(void)
 {
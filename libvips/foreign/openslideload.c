@@ -59,6 +59,8 @@
  *	- add "rgb" option
  * 1/10/23
  *	- add openslide4 icc profile support
+ * 15/10/26
+ * 	- reuse associated images decoded by earlier loads
  */
 
 /*
@@ -110,6 +112,10 @@
 openslide_t *vips__openslideconnection_open(const char *filename,
 	gboolean revalidate);
 void vips__openslideconnection_close(const char *filename);
+VipsImage *vips__openslideconnection_get_associated(const char *filename,
+	const char *name, gboolean rgb);
+void vips__openslideconnection_set_associated(const char *filename,
+	const char *name, gboolean rgb, VipsImage *image);
 
 typedef struct {
 	/* Params.
@@ -317,7 +323,8 @@ argb2rgb(uint32_t *restrict buf, VipsPel *restrict q, int64_t n)
 }
 
 static VipsImage *
-vips__openslide_get_associated(ReadSlide *rslide, const char *associated_name)
+vips__openslide_decode_associated(ReadSlide *rslide,
+	const char *associated_name)
 {
 	VipsImage *associated;
 	int64_t w, h;
@@ -406,6 +413,29 @@ vips__openslide_get_associated(ReadSlide *rslide, const char *associated_name)
 	return associated;
 }
 
+/* Associated images can be large and slow to decode, and every load of a
+ * slide with attach_associated needs all of them, so share them via the
+ * connection.
+ */
+static VipsImage *
+vips__openslide_get_associated(ReadSlide *rslide, const char *associated_name)
+{
+	VipsImage *associated;
+
+	if ((associated = vips__openslideconnection_get_associated(
+			 rslide->filename, associated_name, rslide->rgb)))
+		return associated;
+
+	if (!(associated = vips__openslide_decode_associated(rslide,
+			  associated_name)))
+		return NULL;
+
+	vips__openslideconnection_set_associated(rslide->filename,
+		associated_name, rslide->rgb, associated);
+
+	return associated;
+}
+
 static int
 readslide_attach_associated(ReadSlide *rslide, VipsImage *image)
 {
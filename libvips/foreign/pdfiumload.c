@@ -18,6 +18,9 @@
  * 	- improve transparency handling [DarthSim]
  * 21/4/23
  * 	- add support for forms [kleisauke]
+ * 15/10/26
+ * 	- render with a pool of worker processes if VIPS_PDFIUM_WORKERS is set
+ * 	- add "parallel"
  */
 
 /*
@@ -97,12 +100,16 @@ EOF
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif /*HAVE_UNISTD_H*/
 
 #include <vips/vips.h>
 #include <vips/buf.h>
 #include <vips/internal.h>
 
 #include "pforeign.h"
+#include "pdfiumworker.h"
 
 #ifdef HAVE_PDFIUM
 
@@ -174,6 +181,15 @@ typedef struct _VipsForeignLoadPdf {
 	 */
 	VipsForeignPdfPageBox page_box;
 
+	/* Render pages in parallel.
+	 */
+	gboolean parallel;
+
+	/* If we render with worker processes, a memfd copy of the PDF.
+	 */
+	int worker_doc_fd;
+	guint64 worker_doc_serial;
+
 } VipsForeignLoadPdf;
 
 typedef VipsForeignLoadClass VipsForeignLoadPdfClass;
@@ -216,6 +232,11 @@ vips_foreign_load_pdf_close(VipsForeignLoadPdf *pdf)
 	VIPS_UNREF(pdf->source);
 
 	g_mutex_unlock(&vips_pdfium_mutex);
+
+	if (pdf->worker_doc_fd >= 0) {
+		close(pdf->worker_doc_fd);
+		pdf->worker_doc_fd = -1;
+	}
 }
 
 static void
@@ -330,6 +351,17 @@ vips_foreign_load_pdf_build(VipsObject *object)
 		}
 
 		g_mutex_unlock(&vips_pdfium_mutex);
+
+		/* We still parse the header in-process, but workers can do
+		 * the rendering.
+		 */
+		if (vips__pdfium_worker_n() > 0 &&
+			(!pdf->password ||
+				strlen(pdf->password) <
+					VIPS_PDFIUM_WORKER_PASSWORD_MAX) &&
+			(pdf->worker_doc_fd = vips__pdfium_worker_doc_new(
+				 pdf->source, &pdf->worker_doc_serial)) < 0)
+			return -1;
 	}
 
 	return VIPS_OBJECT_CLASS(vips_foreign_load_pdf_parent_class)
@@ -648,8 +680,29 @@ vips_foreign_load_pdf_generate(VipsRegion *out_region,
 		VipsRect rect;
 		vips_rect_intersectrect(r, &pdf->pages[i], &rect);
 		if (rect.width > 0 &&
+			rect.height > 0 &&
+			pdf->worker_doc_fd >= 0) {
+			VipsPdfiumWorkerRequest request = { 0 };
+
+			request.doc_serial = pdf->worker_doc_serial;
+			request.doc_length = pdf->file_access.m_FileLen;
+			if (pdf->password)
+				g_strlcpy(request.password, pdf->password,
+					VIPS_PDFIUM_WORKER_PASSWORD_MAX);
+			request.page_no = pdf->page_no + i;
+			request.page_box = pdf->page_box;
+			request.page_left = pdf->pages[i].left - rect.left;
+			request.page_top = pdf->pages[i].top - rect.top;
+			request.page_width = pdf->pages[i].width;
+			request.page_height = pdf->pages[i].height;
+			request.ink = *((guint32 *) pdf->ink);
+
+			if (vips__pdfium_worker_render(pdf->worker_doc_fd,
+					&request, out_region, &rect))
+				return -1;
+		}
+		else if (rect.width > 0 &&
 			rect.height > 0) {
-
 			if (vips_foreign_load_pdf_get_page(pdf, pdf->page_no + i))
 				return -1;
 
@@ -706,6 +759,12 @@ vips_foreign_load_pdf_load(VipsForeignLoad *load)
 	printf("vips_foreign_load_pdf_load: %p\n", pdf);
 #endif /*DEBUG*/
 
+	if (pdf->parallel &&
+		pdf->n > 1 &&
+		vips__foreign_load_pages_can(load))
+		return vips__foreign_load_pages(load, load->real,
+			pdf->n, pdf->pages);
+
 	/* Read to this image, then cache to out, see below.
 	 */
 	t[0] = vips_image_new();
@@ -800,6 +859,13 @@ vips_foreign_load_pdf_class_init(VipsForeignLoadPdfClass *class)
 		G_STRUCT_OFFSET(VipsForeignLoadPdf, page_box),
 		VIPS_TYPE_FOREIGN_PDF_PAGE_BOX,
 		VIPS_FOREIGN_PDF_PAGE_BOX_CROP);
+
+	VIPS_ARG_BOOL(class, "parallel", 27,
+		_("Parallel"),
+		_("Render pages in parallel"),
+		VIPS_ARGUMENT_OPTIONAL_INPUT,
+		G_STRUCT_OFFSET(VipsForeignLoadPdf, parallel),
+		FALSE);
 }
 
 static void
@@ -811,6 +877,7 @@ vips_foreign_load_pdf_init(VipsForeignLoadPdf *pdf)
 	pdf->current_page = -1;
 	pdf->background = vips_array_double_newv(1, 255.0);
 	pdf->page_box = VIPS_FOREIGN_PDF_PAGE_BOX_CROP;
+	pdf->worker_doc_fd = -1;
 }
 
 typedef struct _VipsForeignLoadPdfFile {
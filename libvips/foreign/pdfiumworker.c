@@ -0,0 +1,460 @@
+/* render PDF pages with a pool of pdfium worker processes
+ *
+ * pdfium is not threadsafe, so in-process rendering is serialised behind
+ * a single lock. Set VIPS_PDFIUM_WORKERS to a number of processes and
+ * pdfiumload will send page renders to them instead.
+ *
+ * 15/10/26
+ * 	- from pdfiumload.c
+ */
+
+/*
+
+	This file is part of VIPS.
+
+	VIPS is free software; you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+	02110-1301  USA
+
+ */
+
+/*
+
+	These files are distributed with VIPS - http://www.vips.ecs.soton.ac.uk
+
+ */
+
+/*
+#define DEBUG
+ */
+
+/* memfd_create() is a GNU extension.
+ */
+#define _GNU_SOURCE
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /*HAVE_CONFIG_H*/
+#include <glib/gi18n-lib.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <vips/vips.h>
+#include <vips/internal.h>
+
+#include "pdfiumworker.h"
+
+#if defined(HAVE_PDFIUM) && defined(HAVE_MEMFD_CREATE)
+
+#include <unistd.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+
+typedef struct _VipsPdfiumWorker {
+	/* The process, or 0 if we need to start one.
+	 */
+	GPid pid;
+
+	/* Our end of the socketpair.
+	 */
+	int sock;
+
+	/* Shared output buffer.
+	 */
+	int out_fd;
+	VipsPel *out;
+	size_t out_size;
+
+	gboolean busy;
+} VipsPdfiumWorker;
+
+static GMutex vips_pdfium_worker_lock;
+static GCond vips_pdfium_worker_cond;
+static VipsPdfiumWorker *vips_pdfium_workers = NULL;
+static int vips_pdfium_worker_n_workers = 0;
+
+static void *
+vips_pdfium_worker_init_cb(void *dummy)
+{
+	const char *str;
+
+	if ((str = g_getenv("VIPS_PDFIUM_WORKERS")))
+		vips_pdfium_worker_n_workers = VIPS_CLIP(0, atoi(str), 1024);
+
+	if (vips_pdfium_worker_n_workers > 0) {
+		vips_pdfium_workers = g_new0(VipsPdfiumWorker,
+			vips_pdfium_worker_n_workers);
+
+		for (int i = 0; i < vips_pdfium_worker_n_workers; i++) {
+			vips_pdfium_workers[i].sock = -1;
+			vips_pdfium_workers[i].out_fd = -1;
+		}
+	}
+
+	return NULL;
+}
+
+/* The number of worker processes we are allowed, or 0 for in-process
+ * rendering.
+ */
+int
+vips__pdfium_worker_n(void)
+{
+	static GOnce once = G_ONCE_INIT;
+
+	VIPS_ONCE(&once, vips_pdfium_worker_init_cb, NULL);
+
+	return vips_pdfium_worker_n_workers;
+}
+
+static void
+vips_pdfium_worker_stop(VipsPdfiumWorker *worker)
+{
+	if (worker->pid) {
+		kill(worker->pid, SIGKILL);
+		waitpid(worker->pid, NULL, 0);
+		g_spawn_close_pid(worker->pid);
+		worker->pid = 0;
+	}
+
+	if (worker->sock >= 0) {
+		close(worker->sock);
+		worker->sock = -1;
+	}
+
+	if (worker->out) {
+		munmap(worker->out, worker->out_size);
+		worker->out = NULL;
+	}
+
+	if (worker->out_fd >= 0) {
+		close(worker->out_fd);
+		worker->out_fd = -1;
+	}
+}
+
+/* Runs in the child between fork and exec: put our socket on stdin.
+ */
+static void
+vips_pdfium_worker_child_setup(gpointer user_data)
+{
+	int sock = GPOINTER_TO_INT(user_data);
+
+	dup2(sock, 0);
+}
+
+static int
+vips_pdfium_worker_start(VipsPdfiumWorker *worker)
+{
+	const char *path;
+	char *default_path;
+	int sv[2];
+	char *argv[2];
+	GError *error = NULL;
+	gboolean ok;
+
+	if (!(path = g_getenv("VIPS_PDFIUM_WORKER_PATH")))
+		path = default_path = g_build_filename(VIPS_LIBEXECDIR,
+			VIPS_PDFIUM_WORKER_NAME, NULL);
+	else
+		default_path = NULL;
+
+	worker->sock = -1;
+	worker->out_fd = -1;
+
+	if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv)) {
+		vips_error_system(errno, "pdfload", "%s", _("unable to make socket"));
+		g_free(default_path);
+		return -1;
+	}
+
+	argv[0] = (char *) path;
+	argv[1] = NULL;
+	ok = g_spawn_async(NULL, argv, NULL,
+		G_SPAWN_DO_NOT_REAP_CHILD,
+		vips_pdfium_worker_child_setup, GINT_TO_POINTER(sv[1]),
+		&worker->pid, &error);
+	close(sv[1]);
+	g_free(default_path);
+
+	if (!ok) {
+		vips_g_error(&error);
+		close(sv[0]);
+		worker->pid = 0;
+		return -1;
+	}
+
+	worker->sock = sv[0];
+
+	/* The output buffer is sparse, so pages are only allocated as renders
+	 * touch them.
+	 */
+	worker->out_size = (size_t) 4 * VIPS_PDFIUM_WORKER_MAX_PELS;
+	if ((worker->out_fd = memfd_create("vips-pdfium-out",
+			 MFD_CLOEXEC)) < 0 ||
+		ftruncate(worker->out_fd, worker->out_size) ||
+		(worker->out = mmap(NULL, worker->out_size,
+			 PROT_READ | PROT_WRITE, MAP_SHARED,
+			 worker->out_fd, 0)) == MAP_FAILED) {
+		vips_error_system(errno, "pdfload",
+			"%s", _("unable to make render buffer"));
+		worker->out = NULL;
+		vips_pdfium_worker_stop(worker);
+		return -1;
+	}
+
+#ifdef DEBUG
+	printf("vips_pdfium_worker_start: started %d\n", (int) worker->pid);
+#endif /*DEBUG*/
+
+	return 0;
+}
+
+/* Wait for a free worker, starting one if necessary.
+ */
+static VipsPdfiumWorker *
+vips_pdfium_worker_acquire(void)
+{
+	VipsPdfiumWorker *worker;
+
+	g_mutex_lock(&vips_pdfium_worker_lock);
+
+	for (;;) {
+		worker = NULL;
+		for (int i = 0; i < vips_pdfium_worker_n_workers; i++)
+			if (!vips_pdfium_workers[i].busy) {
+				worker = &vips_pdfium_workers[i];
+				break;
+			}
+
+		if (worker)
+			break;
+
+		g_cond_wait(&vips_pdfium_worker_cond, &vips_pdfium_worker_lock);
+	}
+
+	worker->busy = TRUE;
+
+	g_mutex_unlock(&vips_pdfium_worker_lock);
+
+	/* Start outside the lock, it can take a while.
+	 */
+	if (!worker->pid &&
+		vips_pdfium_worker_start(worker)) {
+		g_mutex_lock(&vips_pdfium_worker_lock);
+		worker->busy = FALSE;
+		g_cond_signal(&vips_pdfium_worker_cond);
+		g_mutex_unlock(&vips_pdfium_worker_lock);
+
+		return NULL;
+	}
+
+	return worker;
+}
+
+static void
+vips_pdfium_worker_release(VipsPdfiumWorker *worker)
+{
+	g_mutex_lock(&vips_pdfium_worker_lock);
+	worker->busy = FALSE;
+	g_cond_signal(&vips_pdfium_worker_cond);
+	g_mutex_unlock(&vips_pdfium_worker_lock);
+}
+
+/* Send a request, plus the doc and output buffer fds.
+ */
+static int
+vips_pdfium_worker_send(VipsPdfiumWorker *worker,
+	VipsPdfiumWorkerRequest *request, int doc_fd)
+{
+	struct msghdr msg = { 0 };
+	struct iovec iov;
+	union {
+		char buf[CMSG_SPACE(2 * sizeof(int))];
+		struct cmsghdr align;
+	} control;
+	struct cmsghdr *cmsg;
+	int fds[2];
+	ssize_t n;
+
+	iov.iov_base = request;
+	iov.iov_len = sizeof(VipsPdfiumWorkerRequest);
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control.buf;
+	msg.msg_controllen = sizeof(control.buf);
+
+	fds[0] = doc_fd;
+	fds[1] = worker->out_fd;
+	cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(2 * sizeof(int));
+	memcpy(CMSG_DATA(cmsg), fds, 2 * sizeof(int));
+
+	do
+		n = sendmsg(worker->sock, &msg, MSG_NOSIGNAL);
+	while (n < 0 && errno == EINTR);
+
+	return n == (ssize_t) iov.iov_len ? 0 : -1;
+}
+
+static int
+vips_pdfium_worker_recv(VipsPdfiumWorker *worker,
+	VipsPdfiumWorkerReply *reply)
+{
+	char *p = (char *) reply;
+	size_t remaining = sizeof(VipsPdfiumWorkerReply);
+
+	while (remaining > 0) {
+		ssize_t n = read(worker->sock, p, remaining);
+
+		if (n < 0 &&
+			errno == EINTR)
+			continue;
+		if (n <= 0)
+			return -1;
+
+		p += n;
+		remaining -= n;
+	}
+
+	return 0;
+}
+
+/* Copy a PDF into a memfd that workers can map.
+ */
+int
+vips__pdfium_worker_doc_new(VipsSource *source, guint64 *serial)
+{
+	static gint doc_serial = 0;
+
+	const void *data;
+	size_t length;
+	int fd;
+
+	if (!(data = vips_source_map(source, &length)))
+		return -1;
+
+	if ((fd = memfd_create("vips-pdfium-doc", MFD_CLOEXEC)) < 0) {
+		vips_error_system(errno, "pdfload", "%s", _("unable to make memfd"));
+		return -1;
+	}
+
+	while (length > 0) {
+		ssize_t n = write(fd, data, length);
+
+		if (n < 0 &&
+			errno == EINTR)
+			continue;
+		if (n <= 0) {
+			vips_error_system(errno, "pdfload",
+				"%s", _("unable to write memfd"));
+			close(fd);
+			return -1;
+		}
+
+		data = (const char *) data + n;
+		length -= n;
+	}
+
+	*serial = g_atomic_int_add(&doc_serial, 1) + 1;
+
+	return fd;
+}
+
+/* Render @area of @region with a worker.
+ */
+int
+vips__pdfium_worker_render(int doc_fd, VipsPdfiumWorkerRequest *request,
+	VipsRegion *region, VipsRect *area)
+{
+	VipsPdfiumWorker *worker;
+	VipsPdfiumWorkerReply reply;
+	int strip_height;
+	int page_top;
+
+	if (!(worker = vips_pdfium_worker_acquire()))
+		return -1;
+
+	/* Render in strips that fit the output buffer.
+	 */
+	strip_height = VIPS_MAX(1, VIPS_PDFIUM_WORKER_MAX_PELS / area->width);
+	page_top = request->page_top;
+
+	for (int y = 0; y < area->height; y += strip_height) {
+		request->width = area->width;
+		request->height = VIPS_MIN(strip_height, area->height - y);
+		request->page_top = page_top - y;
+
+		if (vips_pdfium_worker_send(worker, request, doc_fd) ||
+			vips_pdfium_worker_recv(worker, &reply)) {
+			/* The worker has died, perhaps pdfium crashed. Start a new
+			 * one next time.
+			 */
+			vips_pdfium_worker_stop(worker);
+			vips_pdfium_worker_release(worker);
+			vips_error("pdfload", "%s", _("pdfium worker failed"));
+			return -1;
+		}
+
+		if (reply.result) {
+			vips_pdfium_worker_release(worker);
+			vips_error("pdfload",
+				_("unable to render page %d (pdfium error %d)"),
+				request->page_no, reply.error);
+			return -1;
+		}
+
+		for (int i = 0; i < request->height; i++)
+			memcpy(VIPS_REGION_ADDR(region, area->left, area->top + y + i),
+				worker->out + (size_t) i * area->width * 4,
+				(size_t) area->width * 4);
+	}
+
+	vips_pdfium_worker_release(worker);
+
+	return 0;
+}
+
+#else /*!(defined(HAVE_PDFIUM) && defined(HAVE_MEMFD_CREATE))*/
+
+int
+vips__pdfium_worker_n(void)
+{
+	return 0;
+}
+
+int
+vips__pdfium_worker_doc_new(VipsSource *source, guint64 *serial)
+{
+	vips_error("pdfload", "%s", _("pdfium workers not supported"));
+	return -1;
+}
+
+int
+vips__pdfium_worker_render(int doc_fd, VipsPdfiumWorkerRequest *request,
+	VipsRegion *region, VipsRect *area)
+{
+	vips_error("pdfload", "%s", _("pdfium workers not supported"));
+	return -1;
+}
+
+#endif /*defined(HAVE_PDFIUM) && defined(HAVE_MEMFD_CREATE)*/
@@ -0,0 +1,102 @@
+/* common defs for the pdfium worker pool
+ */
+
+/*
+
+	This file is part of VIPS.
+
+	VIPS is free software; you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+	02110-1301  USA
+
+ */
+
+/*
+
+	These files are distributed with VIPS - http://www.vips.ecs.soton.ac.uk
+
+ */
+
+#ifndef VIPS_PDFIUMWORKER_H
+#define VIPS_PDFIUMWORKER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif /*__cplusplus*/
+
+/* The name of the worker executable. We look for it in $libexecdir, or
+ * at the path in VIPS_PDFIUM_WORKER_PATH.
+ */
+#define VIPS_PDFIUM_WORKER_NAME "vips-pdfium-worker"
+
+/* The longest document password we pass to workers.
+ */
+#define VIPS_PDFIUM_WORKER_PASSWORD_MAX (256)
+
+/* The largest render a worker does in one go, in pixels. Bigger areas
+ * are rendered in strips.
+ */
+#define VIPS_PDFIUM_WORKER_MAX_PELS (4000 * 4000)
+
+/* Render part of a page. Each request comes with two file descriptors:
+ * a memfd holding the whole PDF, and the worker's shared output buffer.
+ *
+ * Workers keep the document for the most recent @doc_serial open, so
+ * rendering many tiles from one document only parses it once per worker.
+ */
+typedef struct _VipsPdfiumWorkerRequest {
+	guint64 doc_serial;
+	gint64 doc_length;
+	char password[VIPS_PDFIUM_WORKER_PASSWORD_MAX];
+
+	/* A VipsForeignPdfPageBox.
+	 */
+	int page_no;
+	int page_box;
+
+	/* Render this many pixels, with the page at this offset and size.
+	 */
+	int width;
+	int height;
+	int page_left;
+	int page_top;
+	int page_width;
+	int page_height;
+
+	/* Fill with this RGBA if the page has no transparency.
+	 */
+	guint32 ink;
+} VipsPdfiumWorkerRequest;
+
+/* A worker replies with the FPDF_GetLastError() code on failure.
+ */
+typedef struct _VipsPdfiumWorkerReply {
+	int result;
+	int error;
+} VipsPdfiumWorkerReply;
+
+#ifndef VIPS_PDFIUM_WORKER_MAIN
+
+int vips__pdfium_worker_n(void);
+int vips__pdfium_worker_doc_new(VipsSource *source, guint64 *serial);
+int vips__pdfium_worker_render(int doc_fd, VipsPdfiumWorkerRequest *request,
+	VipsRegion *region, VipsRect *area);
+
+#endif /*!VIPS_PDFIUM_WORKER_MAIN*/
+
+#ifdef __cplusplus
+}
+#endif /*__cplusplus*/
+
+#endif /*VIPS_PDFIUMWORKER_H*/
@@ -42,6 +42,17 @@ extern "C" {
 int vips__foreign_update_metadata(VipsImage *in,
 	VipsForeignKeep keep);
 
+/* VIPS_API is required by the heif module.
+ */
+VIPS_API
+gboolean vips__foreign_load_pages_can(VipsForeignLoad *load);
+VIPS_API
+int vips__foreign_load_pages(VipsForeignLoad *load, VipsImage *out,
+	int n, const VipsRect *rects);
+
+VipsImage *vips__shm_cache_lookup(VipsForeignLoad *load, VipsImage *out);
+void vips__shm_cache_add(VipsForeignLoad *load, VipsImage *real);
+
 void vips__tiff_init(void);
 
 int vips__tiff_write_target(VipsImage *in, VipsTarget *target,
@@ -62,6 +73,7 @@ int vips__tiff_write_target(VipsImage *in, VipsTarget *target,
 	VipsForeignDzDepth depth,
 	gboolean subifd,
 	gboolean premultiply,
+	gboolean cog,
 	int page_height);
 
 gboolean vips__istiff_source(VipsSource *source);
@@ -71,7 +83,7 @@ int vips__tiff_read_header_source(VipsSource *source, VipsImage *out,
 	gboolean unlimited);
 int vips__tiff_read_source(VipsSource *source, VipsImage *out,
 	int page, int n, gboolean autorotate, int subifd, VipsFailOn fail_on,
-	gboolean unlimited);
+	gboolean unlimited, VipsAccess access);
 
 extern const char *vips__foreign_tiff_suffs[];
 
@@ -84,9 +96,9 @@ extern const char *vips__foreign_csv_suffs[];
 extern const char *vips__foreign_matrix_suffs[];
 
 int vips__openexr_isexr(const char *filename);
-gboolean vips__openexr_istiled(const char *filename);
-int vips__openexr_read_header(const char *filename, VipsImage *out);
-int vips__openexr_read(const char *filename, VipsImage *out);
+gboolean vips__openexr_ispartial(const char *filename);
+int vips__openexr_read_header(const char *filename, VipsImage *out, int page);
+int vips__openexr_read(const char *filename, VipsImage *out, int page);
 
 extern const char *vips__fits_suffs[];
 
@@ -136,9 +148,13 @@ int vips__jpeg_region_write_target(VipsRegion *region, VipsRect *rect,
 	int quant_table, VipsForeignSubsample subsample_mode,
 	int restart_interval);
 
+int vips__jpeg_transform_target(VipsSource *source, VipsTarget *target,
+	VipsImage *meta, gboolean transpose, gboolean flip_x, gboolean flip_y,
+	gboolean trim, VipsRect *crop, VipsForeignKeep keep);
+
 int vips__jpeg_read_source(VipsSource *source, VipsImage *out,
-	gboolean header_only, int shrink, VipsFailOn fail_on,
-	gboolean autorotate, gboolean unlimited);
+	gboolean header_only, int scale, VipsFailOn fail_on,
+	gboolean autorotate, gboolean unlimited, const VipsRect *area);
 int vips__isjpeg_source(VipsSource *source);
 
 int vips__png_ispng_source(VipsSource *source);
@@ -155,6 +171,21 @@ int vips__png_write_target(VipsImage *in, VipsTarget *target,
 	gboolean palette, int Q, double dither,
 	int bitdepth, int effort);
 
+gboolean vips__png_can_write_parallel(VipsImage *in, int bitdepth);
+int vips__png_write_parallel(VipsImage *in, VipsTarget *target,
+	int bitdepth, int compression, VipsForeignPngFilter filter);
+
+/* The tiled layout of the vips format has its own magic, so older
+ * readers refuse it. Read MSB first, as VIPS_MAGIC_INTEL.
+ */
+#define VIPS_MAGIC_TILED_INTEL (0xb6a6f209U)
+#define VIPS_MAGIC_TILED_SPARC (0x09f2a6b6U)
+
+gboolean vips__vipstiled_ismagic(const char *filename);
+int vips__vipstiled_write(VipsImage *in, const char *filename,
+	int tile_width, int tile_height, int level);
+int vips__vipstiled_read(const char *filename, VipsImage *out);
+
 /* Map WEBP metadata names to vips names.
  */
 typedef struct _VipsWebPNames {
@@ -170,9 +201,9 @@ extern const char *vips__webp_suffs[];
 int vips__iswebp_source(VipsSource *source);
 
 int vips__webp_read_header_source(VipsSource *source, VipsImage *out,
-	int page, int n, double scale);
+	int page, int n, double scale, const VipsRect *area);
 int vips__webp_read_source(VipsSource *source, VipsImage *out,
-	int page, int n, double scale);
+	int page, int n, double scale, const VipsRect *area);
 
 extern const char *vips_foreign_nifti_suffs[];
 
@@ -193,6 +224,18 @@ int vips__heif_chroma(int bits_per_pixel, gboolean has_alpha);
 void vips__heif_image_print(struct heif_image *img);
 void vips__heif_error(struct heif_error *error);
 
+typedef struct _VipsHeifGrid VipsHeifGrid;
+VipsHeifGrid *vips__heif_grid_new(void);
+void vips__heif_grid_free(VipsHeifGrid *grid);
+int vips__heif_grid_add_page(VipsHeifGrid *grid, int width, int height,
+	int tile_columns, int tile_rows);
+int vips__heif_grid_set_tile(VipsHeifGrid *grid, int page_number, int index,
+	const VipsPel *buf, size_t length);
+int vips__heif_grid_add_metadata(VipsHeifGrid *grid, int page_number,
+	const char *type, const void *data, size_t length);
+void vips__heif_grid_set_primary(VipsHeifGrid *grid, int page_number);
+int vips__heif_grid_write(VipsHeifGrid *grid, VipsTarget *target);
+
 extern const char *vips__jp2k_suffs[];
 int vips__foreign_load_jp2k_decompress(VipsImage *out,
 	int width, int height, gboolean ycc_to_rgb,
@@ -214,6 +257,8 @@ VipsArchive *vips__archive_new_to_target(VipsTarget *target,
 int vips__archive_mkdir(VipsArchive *archive, const char *dirname);
 int vips__archive_mkfile(VipsArchive *archive,
 	const char *filename, void *buf, size_t len);
+gboolean vips__archive_link(VipsArchive *archive,
+	const char *from, const char *to);
 
 extern const char *vips__pdf_suffs[];
 gboolean vips__pdf_is_a_buffer(const void *buf, size_t len);
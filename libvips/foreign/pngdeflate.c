@@ -0,0 +1,675 @@
+/* filter and deflate PNG image data on many threads
+ *
+ * 14/10/26
+ * 	- from vips2jpeg.c
+ */
+
+/*
+
+	This file is part of VIPS.
+
+	VIPS is free software; you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+	02110-1301  USA
+
+ */
+
+/*
+
+	These files are distributed with VIPS - http://www.vips.ecs.soton.ac.uk
+
+ */
+
+/* libpng and libspng push every scanline through a single zlib stream. For
+ * large images we do the IDAT ourselves instead, in the style of pigz: the
+ * image is cut into bands of scanlines, each band is filtered and deflated
+ * on a worker thread with its own raw deflate stream, and the bands are
+ * joined in order.
+ *
+ * Each band but the last ends with a sync flush, so it finishes on a byte
+ * boundary and the next band can simply be appended. A band's stream is
+ * primed with the filtered scanlines just above it, so matches can still
+ * reach back into the previous band. The zlib header goes in front of the
+ * first band, and the Adler-32 of the whole stream is assembled from the
+ * band checksums with adler32_combine().
+ *
+ * The saver writes the signature and all chunks up to the first IDAT,
+ * then calls vips__png_write_parallel() to write IDAT and IEND.
+ */
+
+/*
+#define DEBUG
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /*HAVE_CONFIG_H*/
+#include <glib/gi18n-lib.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vips/vips.h>
+#include <vips/internal.h>
+
+#include "pforeign.h"
+
+#ifdef HAVE_ZLIB
+
+#include <zlib.h>
+
+/* Bands should be about this many bytes of scanline.
+ */
+#define BAND_SIZE (256 * 1024)
+
+/* Prime each band with at most this many scanlines from the band above.
+ * Sequential sources don't like us reaching back too far.
+ */
+#define MAX_DICT_ROWS (8)
+
+/* The deflate window.
+ */
+#define WINDOW_SIZE (32768)
+
+typedef struct _VipsPngParallel {
+	VipsImage *in;
+	VipsTarget *target;
+	int compression;
+
+	/* Set of PNG filter types (0 - 4) we can pick from, as a bitmask.
+	 */
+	int filters;
+
+	/* Bytes in a scanline (excluding the filter type byte), and bytes per
+	 * complete pixel.
+	 */
+	size_t sizeof_line;
+	int bpp;
+
+	/* Samples are 16-bit and must be swapped to PNG byte order.
+	 */
+	gboolean swap;
+
+	/* Band geometry.
+	 */
+	int band_height;
+	int n_bands;
+	int dict_rows;
+
+	/* The next band to allocate.
+	 */
+	int next_band;
+
+	/* Compressed bands waiting to be written, and the next band we
+	 * write. Protected by lock.
+	 */
+	GMutex lock;
+	VipsPel **band;
+	size_t *band_length;
+	uLong *band_adler;
+	size_t *band_raw_length;
+	int write_band;
+
+	/* The Adler-32 of all the bands we've written so far.
+	 */
+	uLong adler;
+} VipsPngParallel;
+
+/* Compute the band layout. FALSE means serial write is better.
+ */
+static gboolean
+vips_png_parallel_layout(VipsPngParallel *parallel,
+	VipsImage *in, int bitdepth)
+{
+	if (bitdepth != 8 &&
+		bitdepth != 16)
+		return FALSE;
+
+	parallel->bpp = in->Bands * (bitdepth >> 3);
+	parallel->sizeof_line = (size_t) in->Xsize * parallel->bpp;
+	parallel->band_height = VIPS_CLIP(1,
+		BAND_SIZE / parallel->sizeof_line, in->Ysize);
+	parallel->n_bands = VIPS_ROUND_UP(in->Ysize, parallel->band_height) /
+		parallel->band_height;
+	parallel->dict_rows = VIPS_MIN(MAX_DICT_ROWS,
+		VIPS_ROUND_UP(WINDOW_SIZE, parallel->sizeof_line + 1) /
+			(parallel->sizeof_line + 1));
+
+	return parallel->n_bands > 1;
+}
+
+/* TRUE if vips__png_write_parallel() will write this image. Interlaced and
+ * animated images must never get here.
+ */
+gboolean
+vips__png_can_write_parallel(VipsImage *in, int bitdepth)
+{
+	VipsPngParallel parallel = { 0 };
+
+	return (in->BandFmt == VIPS_FORMAT_UCHAR ||
+			   in->BandFmt == VIPS_FORMAT_USHORT) &&
+		vips_png_parallel_layout(&parallel, in, bitdepth);
+}
+
+/* Swap 16-bit native samples to PNG (big endian) order.
+ */
+static void
+vips_png_parallel_swap(VipsPel *p, size_t n)
+{
+	for (size_t i = 0; i < n; i += 2) {
+		VipsPel t = p[i];
+
+		p[i] = p[i + 1];
+		p[i + 1] = t;
+	}
+}
+
+static int
+vips_png_parallel_paeth(int a, int b, int c)
+{
+	int p = a + b - c;
+	int pa = abs(p - a);
+	int pb = abs(p - b);
+	int pc = abs(p - c);
+
+	if (pa <= pb &&
+		pa <= pc)
+		return a;
+	else if (pb <= pc)
+		return b;
+	else
+		return c;
+}
+
+/* Filter scanline p with filter type, prev is the unfiltered line above.
+ */
+static void
+vips_png_parallel_filter(int type, VipsPel *q,
+	const VipsPel *p, const VipsPel *prev, size_t n, int bpp)
+{
+	size_t i;
+
+	switch (type) {
+	case 0:
+		memcpy(q, p, n);
+		break;
+
+	case 1:
+		for (i = 0; i < bpp; i++)
+			q[i] = p[i];
+		for (; i < n; i++)
+			q[i] = p[i] - p[i - bpp];
+		break;
+
+	case 2:
+		for (i = 0; i < n; i++)
+			q[i] = p[i] - prev[i];
+		break;
+
+	case 3:
+		for (i = 0; i < bpp; i++)
+			q[i] = p[i] - (prev[i] >> 1);
+		for (; i < n; i++)
+			q[i] = p[i] - ((p[i - bpp] + prev[i]) >> 1);
+		break;
+
+	case 4:
+		for (i = 0; i < bpp; i++)
+			q[i] = p[i] - prev[i];
+		for (; i < n; i++)
+			q[i] = p[i] - vips_png_parallel_paeth(p[i - bpp],
+				prev[i], prev[i - bpp]);
+		break;
+
+	default:
+		g_assert_not_reached();
+	}
+}
+
+/* Filter a scanline to q, with the filter type in q[0]. If we have a choice
+ * of filter, pick the one with the smallest sum of absolute differences,
+ * as libpng does. scratch is a line of space.
+ */
+static void
+vips_png_parallel_filter_line(VipsPngParallel *parallel,
+	VipsPel *q, const VipsPel *p, const VipsPel *prev, VipsPel *scratch)
+{
+	size_t n = parallel->sizeof_line;
+
+	guint64 best_sum;
+	int best_type;
+
+	best_sum = 0;
+	best_type = -1;
+	for (int type = 0; type < 5; type++) {
+		guint64 sum;
+
+		if (!(parallel->filters & (1 << type)))
+			continue;
+
+		/* Only one choice? No need to test.
+		 */
+		if (parallel->filters == (1 << type)) {
+			best_type = type;
+			break;
+		}
+
+		vips_png_parallel_filter(type, scratch, p, prev, n, parallel->bpp);
+
+		sum = 0;
+		for (size_t i = 0; i < n; i++)
+			sum += abs((signed char) scratch[i]);
+
+		if (best_type == -1 ||
+			sum < best_sum) {
+			best_sum = sum;
+			best_type = type;
+		}
+	}
+
+	q[0] = best_type;
+	vips_png_parallel_filter(best_type, q + 1, p, prev, n, parallel->bpp);
+}
+
+/* Filter and deflate a band. region holds the band, plus the lines above
+ * it we use for the dictionary and for the first line's filter.
+ */
+static VipsPel *
+vips_png_parallel_band(VipsPngParallel *parallel, VipsRegion *region,
+	int band, size_t *length, uLong *adler, size_t *raw_length)
+{
+	VipsImage *in = parallel->in;
+	size_t sizeof_line = parallel->sizeof_line;
+	size_t sizeof_filtered = sizeof_line + 1;
+	int top = band * parallel->band_height;
+	int height = VIPS_MIN(parallel->band_height, in->Ysize - top);
+	int first = VIPS_MAX(0, top - parallel->dict_rows);
+	gboolean last = band == parallel->n_bands - 1;
+
+	VipsPel *line[2];
+	VipsPel *zero;
+	VipsPel *scratch;
+	VipsPel *filtered;
+	const VipsPel *prev;
+	VipsPel *dict;
+	size_t dict_length;
+	VipsPel *data;
+	size_t data_length;
+	z_stream zs = { 0 };
+	VipsPel *buf;
+	size_t bound;
+	int result;
+
+	/* Swapped copies of the current and previous lines, a zero line to
+	 * filter the first line against, and space to try filters in.
+	 */
+	line[0] = vips_malloc(NULL, sizeof_line);
+	line[1] = vips_malloc(NULL, sizeof_line);
+	zero = vips_malloc(NULL, sizeof_line);
+	scratch = vips_malloc(NULL, sizeof_line);
+	filtered = vips_malloc(NULL, sizeof_filtered * (top + height - first));
+	if (!line[0] ||
+		!line[1] ||
+		!zero ||
+		!scratch ||
+		!filtered) {
+		g_free(line[0]);
+		g_free(line[1]);
+		g_free(zero);
+		g_free(scratch);
+		g_free(filtered);
+		return NULL;
+	}
+	memset(zero, 0, sizeof_line);
+
+	prev = zero;
+	for (int y = VIPS_MAX(0, first - 1); y < top + height; y++) {
+		const VipsPel *p = VIPS_REGION_ADDR(region, 0, y);
+
+		if (parallel->swap) {
+			VipsPel *q = line[y & 1];
+
+			memcpy(q, p, sizeof_line);
+			vips_png_parallel_swap(q, sizeof_line);
+			p = q;
+		}
+
+		/* The line above the first line we filter.
+		 */
+		if (y < first) {
+			prev = p;
+			continue;
+		}
+
+		vips_png_parallel_filter_line(parallel,
+			filtered + sizeof_filtered * (y - first), p, prev, scratch);
+
+		prev = p;
+	}
+
+	g_free(line[0]);
+	g_free(line[1]);
+	g_free(zero);
+	g_free(scratch);
+
+	dict_length = VIPS_MIN(WINDOW_SIZE, sizeof_filtered * (top - first));
+	dict = filtered + sizeof_filtered * (top - first) - dict_length;
+	data = filtered + sizeof_filtered * (top - first);
+	data_length = sizeof_filtered * height;
+
+	*adler = adler32(adler32(0, NULL, 0), data, data_length);
+	*raw_length = data_length;
+
+	if (deflateInit2(&zs, parallel->compression, Z_DEFLATED, -15, 8,
+			parallel->filters == 1 ? Z_DEFAULT_STRATEGY : Z_FILTERED) !=
+		Z_OK) {
+		g_free(filtered);
+		vips_error("vips2png", "%s", _("unable to init deflate"));
+		return NULL;
+	}
+
+	if (dict_length > 0 &&
+		deflateSetDictionary(&zs, dict, dict_length) != Z_OK) {
+		deflateEnd(&zs);
+		g_free(filtered);
+		vips_error("vips2png", "%s", _("unable to set dictionary"));
+		return NULL;
+	}
+
+	/* Room for the sync flush marker too.
+	 */
+	bound = deflateBound(&zs, data_length) + 16;
+	if (!(buf = vips_malloc(NULL, bound))) {
+		deflateEnd(&zs);
+		g_free(filtered);
+		return NULL;
+	}
+
+	zs.next_in = data;
+	zs.avail_in = data_length;
+	zs.next_out = buf;
+	zs.avail_out = bound;
+	result = deflate(&zs, last ? Z_FINISH : Z_SYNC_FLUSH);
+	*length = bound - zs.avail_out;
+	deflateEnd(&zs);
+	g_free(filtered);
+
+	if ((last && result != Z_STREAM_END) ||
+		(!last && (result != Z_OK || zs.avail_out == 0)) ||
+		zs.avail_in != 0) {
+		g_free(buf);
+		vips_error("vips2png", "%s", _("deflate failed"));
+		return NULL;
+	}
+
+	return buf;
+}
+
+/* Write and checksum part of a chunk.
+ */
+static int
+vips_png_parallel_write(VipsTarget *target,
+	const VipsPel *data, size_t length, uLong *crc)
+{
+	*crc = crc32(*crc, data, length);
+
+	return vips_target_write(target, data, length);
+}
+
+static void
+vips_png_parallel_put32(VipsPel *q, guint32 value)
+{
+	q[0] = value >> 24;
+	q[1] = value >> 16;
+	q[2] = value >> 8;
+	q[3] = value;
+}
+
+/* Write any bands that are ready, in order, one IDAT per band.
+ */
+static int
+vips_png_parallel_flush(VipsPngParallel *parallel)
+{
+	VipsTarget *target = parallel->target;
+
+	while (parallel->write_band < parallel->n_bands &&
+		parallel->band[parallel->write_band]) {
+		int i = parallel->write_band;
+		gboolean first = i == 0;
+		gboolean last = i == parallel->n_bands - 1;
+		size_t length = parallel->band_length[i] +
+			(first ? 2 : 0) + (last ? 4 : 0);
+
+		VipsPel buf[8];
+		uLong crc;
+
+		if (first)
+			parallel->adler = parallel->band_adler[i];
+		else
+			parallel->adler = adler32_combine(parallel->adler,
+				parallel->band_adler[i], parallel->band_raw_length[i]);
+
+		if (length > 0x7fffffff) {
+			vips_error("vips2png", "%s", _("band too large"));
+			return -1;
+		}
+
+		vips_png_parallel_put32(buf, length);
+		if (vips_target_write(target, buf, 4))
+			return -1;
+
+		crc = crc32(0, NULL, 0);
+		if (vips_png_parallel_write(target,
+				(VipsPel *) "IDAT", 4, &crc))
+			return -1;
+
+		/* The zlib header. FLEVEL is informational, but set it as
+		 * zlib would.
+		 */
+		if (first) {
+			int level = parallel->compression;
+			int flevel = level < 2 ? 0 : level < 6 ? 1 : level == 6 ? 2 : 3;
+			int header = (0x78 << 8) | (flevel << 6);
+
+			header += 31 - header % 31;
+			buf[0] = header >> 8;
+			buf[1] = header;
+			if (vips_png_parallel_write(target, buf, 2, &crc))
+				return -1;
+		}
+
+		if (vips_png_parallel_write(target,
+				parallel->band[i], parallel->band_length[i], &crc))
+			return -1;
+
+		if (last) {
+			vips_png_parallel_put32(buf, parallel->adler);
+			if (vips_png_parallel_write(target, buf, 4, &crc))
+				return -1;
+		}
+
+		vips_png_parallel_put32(buf, crc);
+		if (vips_target_write(target, buf, 4))
+			return -1;
+
+		VIPS_FREE(parallel->band[i]);
+		parallel->write_band += 1;
+	}
+
+	return 0;
+}
+
+static int
+vips_png_parallel_allocate(VipsThreadState *state, void *a, gboolean *stop)
+{
+	VipsPngParallel *parallel = (VipsPngParallel *) a;
+	VipsImage *in = parallel->in;
+
+	int top;
+	int first;
+
+	if (parallel->next_band >= parallel->n_bands) {
+		*stop = TRUE;
+		return 0;
+	}
+
+	/* We need the lines above the band for the dictionary, and one more
+	 * line to filter the first of those against.
+	 */
+	top = parallel->next_band * parallel->band_height;
+	first = VIPS_MAX(0, top - parallel->dict_rows - 1);
+	state->pos.left = 0;
+	state->pos.top = first;
+	state->pos.width = in->Xsize;
+	state->pos.height = VIPS_MIN(top + parallel->band_height, in->Ysize) -
+		first;
+	state->y = parallel->next_band;
+	parallel->next_band += 1;
+
+	return 0;
+}
+
+static int
+vips_png_parallel_work(VipsThreadState *state, void *a)
+{
+	VipsPngParallel *parallel = (VipsPngParallel *) a;
+	int i = state->y;
+
+	VipsPel *buf;
+	size_t length;
+	uLong adler;
+	size_t raw_length;
+	int result;
+
+	if (vips_region_prepare(state->reg, &state->pos) ||
+		!(buf = vips_png_parallel_band(parallel, state->reg, i,
+			  &length, &adler, &raw_length)))
+		return -1;
+
+	vips__worker_lock(&parallel->lock);
+
+	parallel->band[i] = buf;
+	parallel->band_length[i] = length;
+	parallel->band_adler[i] = adler;
+	parallel->band_raw_length[i] = raw_length;
+	result = vips_png_parallel_flush(parallel);
+
+	g_mutex_unlock(&parallel->lock);
+
+	return result;
+}
+
+static int
+vips_png_parallel_progress(void *a)
+{
+	VipsPngParallel *parallel = (VipsPngParallel *) a;
+	VipsImage *in = parallel->in;
+
+	vips_image_eval(in, (guint64) in->Xsize *
+			VIPS_MIN(in->Ysize,
+				parallel->write_band * parallel->band_height));
+	if (vips_image_iskilled(in))
+		return -1;
+
+	return 0;
+}
+
+/* Write the IDAT chunks and IEND for in. Call
+ * vips__png_can_write_parallel() first to check the image is suitable.
+ */
+int
+vips__png_write_parallel(VipsImage *in, VipsTarget *target,
+	int bitdepth, int compression, VipsForeignPngFilter filter)
+{
+	static const VipsPel iend[] = {
+		0, 0, 0, 0, 'I', 'E', 'N', 'D', 0xae, 0x42, 0x60, 0x82
+	};
+
+	VipsPngParallel parallel = { 0 };
+	int result;
+
+	if (!vips_png_parallel_layout(&parallel, in, bitdepth)) {
+		vips_error("vips2png", "%s", _("unable to write in parallel"));
+		return -1;
+	}
+
+	parallel.in = in;
+	parallel.target = target;
+	parallel.compression = VIPS_CLIP(0, compression, 9);
+	parallel.swap = bitdepth == 16 && !vips_amiMSBfirst();
+
+	/* VipsForeignPngFilter has NONE in bit 3, SUB in bit 4, and so on.
+	 */
+	parallel.filters = (filter >> 3) & 0x1f;
+	if (!parallel.filters)
+		parallel.filters = 1;
+
+#ifdef DEBUG
+	printf("vips__png_write_parallel: %d bands of %d lines\n",
+		parallel.n_bands, parallel.band_height);
+#endif /*DEBUG*/
+
+	g_mutex_init(&parallel.lock);
+	parallel.band = VIPS_ARRAY(NULL, parallel.n_bands, VipsPel *);
+	parallel.band_length = VIPS_ARRAY(NULL, parallel.n_bands, size_t);
+	parallel.band_adler = VIPS_ARRAY(NULL, parallel.n_bands, uLong);
+	parallel.band_raw_length = VIPS_ARRAY(NULL, parallel.n_bands, size_t);
+	memset(parallel.band, 0, parallel.n_bands * sizeof(VipsPel *));
+
+	vips_image_preeval(in);
+
+	result = vips_threadpool_run(in,
+		vips_thread_state_new,
+		vips_png_parallel_allocate,
+		vips_png_parallel_work,
+		vips_png_parallel_progress,
+		&parallel);
+
+	vips_image_posteval(in);
+
+	if (!result &&
+		parallel.write_band == parallel.n_bands)
+		result = vips_target_write(target, iend, sizeof(iend));
+	else
+		result = -1;
+
+	for (int i = 0; i < parallel.n_bands; i++)
+		VIPS_FREE(parallel.band[i]);
+	VIPS_FREE(parallel.band);
+	VIPS_FREE(parallel.band_length);
+	VIPS_FREE(parallel.band_adler);
+	VIPS_FREE(parallel.band_raw_length);
+	g_mutex_clear(&parallel.lock);
+
+	return result;
+}
+
+#else /*!HAVE_ZLIB*/
+
+gboolean
+vips__png_can_write_parallel(VipsImage *in, int bitdepth)
+{
+	return FALSE;
+}
+
+int
+vips__png_write_parallel(VipsImage *in, VipsTarget *target,
+	int bitdepth, int compression, VipsForeignPngFilter filter)
+{
+	vips_error("vips2png", "%s", _("zlib support disabled"));
+	return -1;
+}
+
+#endif /*HAVE_ZLIB*/
@@ -4,6 +4,8 @@
  * 	- from tiffload.c
  * 29/8/21 joshuamsager
  *	-  add "unlimited" flag to png load
+ * 14/10/26
+ * 	- set VIPS_FOREIGN_ZERO_COPY
  */
 
 /*
@@ -87,7 +89,7 @@ vips_foreign_load_png_get_flags_source(VipsSource *source)
 {
 	VipsForeignFlags flags;
 
-	flags = 0;
+	flags = VIPS_FOREIGN_ZERO_COPY;
 	if (vips__png_isinterlaced_source(source))
 		flags |= VIPS_FOREIGN_PARTIAL;
 	else
@@ -144,6 +146,11 @@ vips_foreign_load_png_load(VipsForeignLoad *load)
 	return 0;
 }
 
+static const VipsForeignMagic vips_foreign_load_png_magic[] = {
+	{ 0, 8, "\x89PNG\r\n\x1a\n" },
+	{ 0, 0, NULL }
+};
+
 static void
 vips_foreign_load_png_class_init(VipsForeignLoadPngClass *class)
 {
@@ -167,6 +174,7 @@ vips_foreign_load_png_class_init(VipsForeignLoadPngClass *class)
 		vips_foreign_load_png_get_flags_filename;
 	load_class->get_flags = vips_foreign_load_png_get_flags;
 	load_class->header = vips_foreign_load_png_header;
+	load_class->magic = vips_foreign_load_png_magic;
 	load_class->load = vips_foreign_load_png_load;
 
 #ifndef FUZZING_BUILD_MODE_UNSAFE_FOR_PRODUCTION
@@ -420,9 +428,14 @@ vips_foreign_load_png_buffer_init(VipsForeignLoadPngBuffer *buffer)
  * block some denial of service attacks. Set @unlimited to disable these
  * limits.
  *
+ * Set @shrink to 2, 4 or 8 to take every 2nd, 4th or 8th pixel in each
+ * direction. Interlaced images only decode the passes they need for this, so
+ * it's much faster than a full load. This needs libspng.
+ *
  * ::: tip "Optional arguments"
  *     * @fail_on: [enum@FailOn], types of read error to fail on
  *     * @unlimited: `gboolean`, Remove all denial of service limits
+ *     * @shrink: `gint`, shrink by this much on load
  *
  * ::: seealso
  *     [ctor@Image.new_from_file].
@@ -22,6 +22,8 @@
  * 	- include GObject part from pdfload.c
  * 28/1/22
  * 	- add password
+ * 15/10/26
+ * 	- render each page once to a recording surface, replay in parallel
  */
 
 /*
@@ -84,6 +86,11 @@
  */
 #define TILE_SIZE (4000)
 
+/* Keep at most this many recorded pages. Tiles are generated roughly top to
+ * bottom, so we only need a few.
+ */
+#define MAX_RECORDINGS (4)
+
 #define VIPS_TYPE_FOREIGN_LOAD_PDF (vips_foreign_load_pdf_get_type())
 #define VIPS_FOREIGN_LOAD_PDF(obj) \
 	(G_TYPE_CHECK_INSTANCE_CAST((obj), \
@@ -136,14 +143,22 @@ typedef struct _VipsForeignLoadPdf {
 	 */
 	const char *password;
 
-	/* Poppler is not thread-safe, so we run inside a single-threaded
-	 * cache. On the plus side, this means we only need one @page pointer,
-	 * even though we change this during _generate().
+	/* Poppler is not thread-safe, so all poppler calls during _generate()
+	 * are made with @lock held. This means we only need one @page
+	 * pointer, even though we change this during _generate().
 	 */
+	GMutex lock;
 	PopplerDocument *doc;
 	PopplerPage *page;
 	int current_page;
 
+	/* Each page is rendered once to a cairo recording surface at
+	 * @total_scale, then replayed in parallel to make tiles. Also
+	 * protected by @lock.
+	 */
+	cairo_surface_t **recordings;
+	int n_recordings;
+
 	/* Doc has this many pages.
 	 */
 	int n_pages;
@@ -177,6 +192,10 @@ vips_foreign_load_pdf_dispose(GObject *gobject)
 {
 	VipsForeignLoadPdf *pdf = VIPS_FOREIGN_LOAD_PDF(gobject);
 
+	if (pdf->recordings)
+		for (int i = 0; i < pdf->n; i++)
+			VIPS_FREEF(cairo_surface_destroy, pdf->recordings[i]);
+	pdf->n_recordings = 0;
 	VIPS_UNREF(pdf->page);
 	VIPS_UNREF(pdf->doc);
 	VIPS_UNREF(pdf->source);
@@ -185,6 +204,16 @@ vips_foreign_load_pdf_dispose(GObject *gobject)
 	G_OBJECT_CLASS(vips_foreign_load_pdf_parent_class)->dispose(gobject);
 }
 
+static void
+vips_foreign_load_pdf_finalize(GObject *gobject)
+{
+	VipsForeignLoadPdf *pdf = VIPS_FOREIGN_LOAD_PDF(gobject);
+
+	g_mutex_clear(&pdf->lock);
+
+	G_OBJECT_CLASS(vips_foreign_load_pdf_parent_class)->finalize(gobject);
+}
+
 static int
 vips_foreign_load_pdf_build(VipsObject *object)
 {
@@ -337,8 +366,10 @@ vips_foreign_load_pdf_header(VipsForeignLoad *load)
 
 	/* Lay out the pages in our output image.
 	 */
-	if (!(pdf->pages = VIPS_ARRAY(pdf, pdf->n, VipsRect)))
+	if (!(pdf->pages = VIPS_ARRAY(pdf, pdf->n, VipsRect)) ||
+		!(pdf->recordings = VIPS_ARRAY(pdf, pdf->n, cairo_surface_t *)))
 		return -1;
+	memset(pdf->recordings, 0, pdf->n * sizeof(cairo_surface_t *));
 
 	if (pdf->page_box != VIPS_FOREIGN_PDF_PAGE_BOX_CROP)
 		g_warning("only crop page box is supported");
@@ -417,6 +448,89 @@ vips_foreign_load_pdf_minimise(VipsImage *image, VipsForeignLoadPdf *pdf)
 	vips_source_minimise(pdf->source);
 }
 
+/* Drop the recording furthest from page @i.
+ */
+static void
+vips_foreign_load_pdf_evict(VipsForeignLoadPdf *pdf, int i)
+{
+	int furthest;
+
+	furthest = -1;
+	for (int j = 0; j < pdf->n; j++)
+		if (pdf->recordings[j] &&
+			(furthest == -1 ||
+				abs(j - i) > abs(furthest - i)))
+			furthest = j;
+
+	if (furthest != -1) {
+		VIPS_FREEF(cairo_surface_destroy, pdf->recordings[furthest]);
+		pdf->n_recordings -= 1;
+	}
+}
+
+/* Get a reference to the recording for page @i, making it if necessary.
+ */
+static cairo_surface_t *
+vips_foreign_load_pdf_get_recording(VipsForeignLoadPdf *pdf, int i)
+{
+	cairo_surface_t *recording;
+
+	g_mutex_lock(&pdf->lock);
+
+	if (!pdf->recordings[i]) {
+		cairo_rectangle_t extents;
+		cairo_surface_t *surface;
+		cairo_t *cr;
+
+		if (vips_foreign_load_pdf_get_page(pdf, pdf->page_no + i)) {
+			g_mutex_unlock(&pdf->lock);
+			return NULL;
+		}
+
+		if (pdf->n_recordings >= MAX_RECORDINGS)
+			vips_foreign_load_pdf_evict(pdf, i);
+
+#ifdef DEBUG
+		printf("vips_foreign_load_pdf_get_recording: recording page %d\n",
+			pdf->page_no + i);
+#endif /*DEBUG*/
+
+		/* Record in output pixels, so poppler picks the right
+		 * resolution for things like patterns and masks.
+		 */
+		extents.x = 0;
+		extents.y = 0;
+		extents.width = pdf->pages[i].width;
+		extents.height = pdf->pages[i].height;
+		recording = cairo_recording_surface_create(
+			CAIRO_CONTENT_COLOR_ALPHA, &extents);
+		cr = cairo_create(recording);
+		cairo_scale(cr, pdf->total_scale, pdf->total_scale);
+		poppler_page_render(pdf->page, cr);
+		cairo_destroy(cr);
+
+		/* Replay a single pixel. cairo builds the spatial index for a
+		 * recording on first partial replay, so this makes it now,
+		 * while we hold the lock, rather than in parallel later.
+		 */
+		surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, 1, 1);
+		cr = cairo_create(surface);
+		cairo_set_source_surface(cr, recording, 0, 0);
+		cairo_paint(cr);
+		cairo_destroy(cr);
+		cairo_surface_destroy(surface);
+
+		pdf->recordings[i] = recording;
+		pdf->n_recordings += 1;
+	}
+
+	recording = cairo_surface_reference(pdf->recordings[i]);
+
+	g_mutex_unlock(&pdf->lock);
+
+	return recording;
+}
+
 static int
 vips_foreign_load_pdf_generate(VipsRegion *out_region,
 	void *seq, void *a, void *b, gboolean *stop)
@@ -449,11 +563,15 @@ vips_foreign_load_pdf_generate(VipsRegion *out_region,
 	top = r->top;
 	while (top < VIPS_RECT_BOTTOM(r)) {
 		VipsRect rect;
+		cairo_surface_t *recording;
 		cairo_surface_t *surface;
 		cairo_t *cr;
 
 		vips_rect_intersectrect(r, &pdf->pages[i], &rect);
 
+		if (!(recording = vips_foreign_load_pdf_get_recording(pdf, i)))
+			return -1;
+
 		surface = cairo_image_surface_create_for_data(
 			VIPS_REGION_ADDR(out_region, rect.left, rect.top),
 			CAIRO_FORMAT_ARGB32,
@@ -462,19 +580,16 @@ vips_foreign_load_pdf_generate(VipsRegion *out_region,
 		cr = cairo_create(surface);
 		cairo_surface_destroy(surface);
 
-		cairo_scale(cr, pdf->total_scale, pdf->total_scale);
-		cairo_translate(cr,
-			(pdf->pages[i].left - rect.left) / pdf->total_scale,
-			(pdf->pages[i].top - rect.top) / pdf->total_scale);
-
-		/* poppler is single-threaded, but we don't need to lock since
-		 * we're running inside a non-threaded tilecache.
+		/* Replaying a recording is threadsafe, so there's no need to
+		 * lock.
 		 */
-		if (vips_foreign_load_pdf_get_page(pdf, pdf->page_no + i))
-			return -1;
-		poppler_page_render(pdf->page, cr);
+		cairo_set_source_surface(cr, recording,
+			pdf->pages[i].left - rect.left,
+			pdf->pages[i].top - rect.top);
+		cairo_paint(cr);
 
 		cairo_destroy(cr);
+		cairo_surface_destroy(recording);
 
 		top += rect.height;
 		i += 1;
@@ -519,6 +634,7 @@ vips_foreign_load_pdf_load(VipsForeignLoad *load)
 			"tile_width", TILE_SIZE,
 			"tile_height", TILE_SIZE,
 			"max_tiles", 2 * (1 + t[0]->Xsize / TILE_SIZE),
+			"threaded", TRUE,
 			NULL) ||
 		vips_image_write(t[1], load->real))
 		return -1;
@@ -535,6 +651,7 @@ vips_foreign_load_pdf_class_init(VipsForeignLoadPdfClass *class)
 	VipsForeignLoadClass *load_class = (VipsForeignLoadClass *) class;
 
 	gobject_class->dispose = vips_foreign_load_pdf_dispose;
+	gobject_class->finalize = vips_foreign_load_pdf_finalize;
 	gobject_class->set_property = vips_object_set_property;
 	gobject_class->get_property = vips_object_get_property;
 
@@ -612,6 +729,7 @@ vips_foreign_load_pdf_init(VipsForeignLoadPdf *pdf)
 	pdf->current_page = -1;
 	pdf->background = vips_array_double_newv(1, 255.0);
 	pdf->page_box = VIPS_FOREIGN_PDF_PAGE_BOX_CROP;
+	g_mutex_init(&pdf->lock);
 }
 
 typedef struct _VipsForeignLoadPdfFile {
@@ -723,6 +723,13 @@ vips_foreign_load_ppm_load(VipsForeignLoad *load)
 	return 0;
 }
 
+/* The second character says which type, see magic_names[].
+ */
+static const VipsForeignMagic vips_foreign_load_ppm_magic[] = {
+	{ 0, 1, "P" },
+	{ 0, 0, NULL }
+};
+
 static void
 vips_foreign_load_ppm_class_init(VipsForeignLoadPpmClass *class)
 {
@@ -752,6 +759,7 @@ vips_foreign_load_ppm_class_init(VipsForeignLoadPpmClass *class)
 
 	load_class->get_flags = vips_foreign_load_ppm_get_flags;
 	load_class->header = vips_foreign_load_ppm_header;
+	load_class->magic = vips_foreign_load_ppm_magic;
 	load_class->load = vips_foreign_load_ppm_load;
 }
 
@@ -110,6 +110,11 @@ vips_foreign_load_rad_load(VipsForeignLoad *load)
 	return 0;
 }
 
+static const VipsForeignMagic vips_foreign_load_rad_magic[] = {
+	{ 0, 10, "#?RADIANCE" },
+	{ 0, 0, NULL }
+};
+
 static void
 vips_foreign_load_rad_class_init(VipsForeignLoadRadClass *class)
 {
@@ -136,6 +141,7 @@ vips_foreign_load_rad_class_init(VipsForeignLoadRadClass *class)
 		vips_foreign_load_rad_get_flags_filename;
 	load_class->get_flags = vips_foreign_load_rad_get_flags;
 	load_class->header = vips_foreign_load_rad_header;
+	load_class->magic = vips_foreign_load_rad_magic;
 	load_class->load = vips_foreign_load_rad_load;
 }
 
@@ -0,0 +1,492 @@
+/* share decoded images between processes
+ *
+ * 15/10/26
+ * 	- first version
+ * 	- check entry offsets on lookup
+ * 	- trim the directory to vips_cache_get_shared_max_mem()
+ */
+
+/*
+
+	This file is part of VIPS.
+
+	VIPS is free software; you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+	02110-1301  USA
+
+ */
+
+/*
+
+	These files are distributed with VIPS - http://www.vips.ecs.soton.ac.uk
+
+ */
+
+/* The operation cache is per-process, so a server with one process per core
+ * decodes a popular image once in every process. If vips_cache_set_shared()
+ * has been called, file loaders which decode to memory also write the
+ * pixels to a file in the shared directory, and loaders in other processes
+ * map that file read-only instead of decoding again.
+ *
+ * Entries are named by a checksum of a key made from the loader nickname,
+ * its input arguments as text, and the size, mtime and inode of the file.
+ * The full key is stored in the entry and checked on lookup. We can't use
+ * vips_operation_hash(), since that includes the GType, and that varies
+ * between processes.
+ *
+ * Entries are written to a temporary name and renamed into place, so
+ * readers never see a partial entry. Any failure here just means we decode
+ * as usual, so we never set an error.
+ *
+ * Before adding an entry, we remove the least recently used entries until
+ * the directory fits in vips_cache_get_shared_max_mem(). A hit sets the
+ * mtime of the entry, so mtime is the time of last use. Processes with the
+ * entry mapped keep their pixels after the unlink.
+ */
+
+/*
+#define DEBUG
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /*HAVE_CONFIG_H*/
+#include <glib/gi18n-lib.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib/gstdio.h>
+
+#include <vips/vips.h>
+#include <vips/internal.h>
+
+#include "pforeign.h"
+
+#ifndef G_OS_WIN32
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#define VIPS_SHM_MAGIC "vipsshm1"
+
+/* Pixels start on a cache line.
+ */
+#define VIPS_SHM_ALIGN (64)
+
+typedef struct _VipsShmHeader {
+	char magic[8];
+	gint32 width;
+	gint32 height;
+	gint32 bands;
+	gint32 format;
+	gint32 key_length;
+	gint32 padding;
+	gint64 data_offset;
+	gint64 data_length;
+} VipsShmHeader;
+
+/* A mapped entry, unmapped when the image closes.
+ */
+typedef struct _VipsShmMapping {
+	void *baseaddr;
+	size_t length;
+} VipsShmMapping;
+
+static void *
+vips_shm_cache_key_arg(VipsObject *object,
+	GParamSpec *pspec,
+	VipsArgumentClass *argument_class,
+	VipsArgumentInstance *argument_instance,
+	void *a, void *b)
+{
+	GString *key = (GString *) a;
+
+	if ((argument_class->flags & VIPS_ARGUMENT_CONSTRUCT) &&
+		(argument_class->flags & VIPS_ARGUMENT_INPUT) &&
+		!(argument_class->flags & VIPS_ARGUMENT_NON_HASHABLE) &&
+		argument_instance->assigned) {
+		const char *name = g_param_spec_get_name(pspec);
+		GType type = G_PARAM_SPEC_VALUE_TYPE(pspec);
+		GValue value = G_VALUE_INIT;
+		char *contents;
+
+		g_value_init(&value, type);
+		g_object_get_property(G_OBJECT(object), name, &value);
+		contents = g_strdup_value_contents(&value);
+		g_string_append_printf(key, " %s=%s", name, contents);
+		g_free(contents);
+		g_value_unset(&value);
+	}
+
+	return NULL;
+}
+
+/* The key and entry filename for a load, or NULL if this load can't be
+ * shared.
+ */
+static char *
+vips_shm_cache_key(VipsForeignLoad *load, char **path)
+{
+	const char *dir;
+	char *filename;
+	GStatBuf st;
+	GString *key;
+	char *checksum;
+	char *name;
+
+	if (!(dir = vips_cache_get_shared()) ||
+		!g_object_class_find_property(G_OBJECT_GET_CLASS(load),
+			"filename"))
+		return NULL;
+
+	g_object_get(load, "filename", &filename, NULL);
+	if (!filename ||
+		g_stat(filename, &st)) {
+		g_free(filename);
+		return NULL;
+	}
+	g_free(filename);
+
+	key = g_string_new(VIPS_OBJECT_GET_CLASS(load)->nickname);
+	(void) vips_argument_map(VIPS_OBJECT(load),
+		vips_shm_cache_key_arg, key, NULL);
+	g_string_append_printf(key,
+		" size=%" G_GINT64_FORMAT
+		" mtime=%" G_GINT64_FORMAT
+		" dev=%" G_GUINT64_FORMAT
+		" ino=%" G_GUINT64_FORMAT,
+		(gint64) st.st_size,
+		(gint64) st.st_mtime,
+		(guint64) st.st_dev,
+		(guint64) st.st_ino);
+
+	checksum = g_compute_checksum_for_string(G_CHECKSUM_SHA256,
+		key->str, key->len);
+	name = g_strdup_printf("vips-%s.v", checksum);
+	*path = g_build_filename(dir, name, NULL);
+	g_free(name);
+	g_free(checksum);
+
+	return g_string_free(key, FALSE);
+}
+
+static void
+vips_shm_cache_unmap(VipsObject *object, VipsShmMapping *mapping)
+{
+	munmap(mapping->baseaddr, mapping->length);
+	g_free(mapping);
+}
+
+/* Map a shared copy of the pixels for @load, if there is one. @out has
+ * the header from ->header(), and the entry must match it exactly.
+ */
+VipsImage *
+vips__shm_cache_lookup(VipsForeignLoad *load, VipsImage *out)
+{
+	char *key;
+	char *path;
+	int fd;
+	struct stat st;
+	void *baseaddr;
+	VipsShmHeader *header;
+	VipsShmMapping *mapping;
+	VipsImage *image;
+
+	if (out->Coding != VIPS_CODING_NONE ||
+		!(key = vips_shm_cache_key(load, &path)))
+		return NULL;
+
+	fd = g_open(path, O_RDONLY, 0);
+	g_free(path);
+	if (fd == -1) {
+		g_free(key);
+		return NULL;
+	}
+
+	if (fstat(fd, &st) ||
+		(size_t) st.st_size < sizeof(VipsShmHeader)) {
+		close(fd);
+		g_free(key);
+		return NULL;
+	}
+
+	baseaddr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	if (baseaddr == MAP_FAILED) {
+		close(fd);
+		g_free(key);
+		return NULL;
+	}
+
+	/* The entry could be truncated or damaged, so check the offsets
+	 * without overflow: the key must fit after the header, and the pixels
+	 * must fit between the key and the end of the file.
+	 */
+	header = (VipsShmHeader *) baseaddr;
+	if (memcmp(header->magic, VIPS_SHM_MAGIC, 8) != 0 ||
+		header->key_length != (gint32) strlen(key) ||
+		(gint64) header->key_length >
+			(gint64) st.st_size - (gint64) sizeof(VipsShmHeader) ||
+		memcmp((char *) baseaddr + sizeof(VipsShmHeader),
+			key, header->key_length) != 0 ||
+		header->width != out->Xsize ||
+		header->height != out->Ysize ||
+		header->bands != out->Bands ||
+		header->format != out->BandFmt ||
+		header->data_length != (gint64) VIPS_IMAGE_SIZEOF_IMAGE(out) ||
+		header->data_offset <
+			(gint64) (sizeof(VipsShmHeader) + header->key_length) ||
+		header->data_offset > (gint64) st.st_size ||
+		header->data_length > (gint64) st.st_size - header->data_offset) {
+		munmap(baseaddr, st.st_size);
+		close(fd);
+		g_free(key);
+		return NULL;
+	}
+	g_free(key);
+
+	/* Mark the entry as recently used. This can fail if another user
+	 * made the entry, which just makes it an earlier candidate for
+	 * eviction.
+	 */
+	(void) futimens(fd, NULL);
+	close(fd);
+
+	if (!(image = vips_image_new_from_memory(
+			  (char *) baseaddr + header->data_offset,
+			  header->data_length,
+			  out->Xsize, out->Ysize, out->Bands, out->BandFmt))) {
+		munmap(baseaddr, st.st_size);
+		vips_error_clear();
+		return NULL;
+	}
+
+	mapping = g_new(VipsShmMapping, 1);
+	mapping->baseaddr = baseaddr;
+	mapping->length = st.st_size;
+	g_signal_connect(image, "postclose",
+		G_CALLBACK(vips_shm_cache_unmap), mapping);
+
+#ifdef DEBUG
+	printf("vips__shm_cache_lookup: hit for %s\n",
+		VIPS_OBJECT_GET_CLASS(load)->nickname);
+#endif /*DEBUG*/
+
+	return image;
+}
+
+static int
+vips_shm_cache_write(int fd, const void *buf, size_t length)
+{
+	const char *p = (const char *) buf;
+
+	while (length > 0) {
+		ssize_t n = write(fd, p, VIPS_MIN(length, 1024 * 1024 * 1024));
+
+		if (n <= 0)
+			return -1;
+		p += n;
+		length -= n;
+	}
+
+	return 0;
+}
+
+typedef struct _VipsShmEntry {
+	char *path;
+	gint64 mtime;
+	gint64 size;
+} VipsShmEntry;
+
+static void
+vips_shm_entry_free(VipsShmEntry *entry)
+{
+	g_free(entry->path);
+	g_free(entry);
+}
+
+static int
+vips_shm_entry_compare(const void *a, const void *b)
+{
+	const VipsShmEntry *ea = *((VipsShmEntry **) a);
+	const VipsShmEntry *eb = *((VipsShmEntry **) b);
+
+	return ea->mtime < eb->mtime ? -1 : ea->mtime > eb->mtime ? 1 : 0;
+}
+
+/* Unlink the least recently used entries in @dir until there's room for
+ * @length more bytes. FALSE if the new entry will never fit.
+ */
+static gboolean
+vips_shm_cache_trim(const char *dir, gint64 length)
+{
+	gint64 max_mem = (gint64) vips_cache_get_shared_max_mem();
+	GDir *gdir;
+	const char *name;
+	GPtrArray *entries;
+	gint64 total;
+	guint i;
+
+	if (length > max_mem)
+		return FALSE;
+
+	if (!(gdir = g_dir_open(dir, 0, NULL)))
+		return FALSE;
+
+	entries = g_ptr_array_new_with_free_func(
+		(GDestroyNotify) vips_shm_entry_free);
+	total = 0;
+	while ((name = g_dir_read_name(gdir))) {
+		char *path;
+		GStatBuf st;
+		VipsShmEntry *entry;
+
+		if (!g_str_has_prefix(name, "vips-") ||
+			!g_str_has_suffix(name, ".v"))
+			continue;
+
+		path = g_build_filename(dir, name, NULL);
+		if (g_stat(path, &st) ||
+			!S_ISREG(st.st_mode)) {
+			g_free(path);
+			continue;
+		}
+
+		entry = g_new(VipsShmEntry, 1);
+		entry->path = path;
+		entry->mtime = st.st_mtime;
+		entry->size = st.st_size;
+		g_ptr_array_add(entries, entry);
+		total += st.st_size;
+	}
+	g_dir_close(gdir);
+
+	g_ptr_array_sort(entries, vips_shm_entry_compare);
+
+	for (i = 0; i < entries->len && total + length > max_mem; i++) {
+		VipsShmEntry *entry = g_ptr_array_index(entries, i);
+
+#ifdef DEBUG
+		printf("vips_shm_cache_trim: removing %s\n", entry->path);
+#endif /*DEBUG*/
+
+		/* Another process may have removed it already.
+		 */
+		(void) g_unlink(entry->path);
+		total -= entry->size;
+	}
+
+	g_ptr_array_unref(entries);
+
+	return TRUE;
+}
+
+/* @real has been decoded to memory, share a copy.
+ */
+void
+vips__shm_cache_add(VipsForeignLoad *load, VipsImage *real)
+{
+	char *key;
+	char *path;
+	char *tmp;
+	int fd;
+	VipsShmHeader header;
+	char pad[VIPS_SHM_ALIGN] = { 0 };
+	gint64 data_offset;
+	int result;
+
+	if (real->dtype != VIPS_IMAGE_SETBUF ||
+		!real->data ||
+		real->Coding != VIPS_CODING_NONE ||
+		!(key = vips_shm_cache_key(load, &path)))
+		return;
+
+	/* Someone else has already shared this image.
+	 */
+	if (g_file_test(path, G_FILE_TEST_EXISTS)) {
+		g_free(path);
+		g_free(key);
+		return;
+	}
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, VIPS_SHM_MAGIC, 8);
+	header.width = real->Xsize;
+	header.height = real->Ysize;
+	header.bands = real->Bands;
+	header.format = real->BandFmt;
+	header.key_length = strlen(key);
+	data_offset = VIPS_ROUND_UP(
+		(gint64) (sizeof(header) + header.key_length), VIPS_SHM_ALIGN);
+	header.data_offset = data_offset;
+	header.data_length = VIPS_IMAGE_SIZEOF_IMAGE(real);
+
+	if (!vips_shm_cache_trim(vips_cache_get_shared(),
+			data_offset + header.data_length)) {
+		g_free(path);
+		g_free(key);
+		return;
+	}
+
+	tmp = g_strdup_printf("%s.XXXXXX", path);
+	if ((fd = g_mkstemp(tmp)) == -1) {
+		g_free(tmp);
+		g_free(path);
+		g_free(key);
+		return;
+	}
+
+	result = vips_shm_cache_write(fd, &header, sizeof(header)) ||
+		vips_shm_cache_write(fd, key, header.key_length) ||
+		vips_shm_cache_write(fd, pad,
+			data_offset - sizeof(header) - header.key_length) ||
+		vips_shm_cache_write(fd, real->data, header.data_length);
+	if (close(fd))
+		result = -1;
+
+	/* Make the entry readable by the other processes sharing the
+	 * directory.
+	 */
+	if (result ||
+		g_chmod(tmp, 0644) ||
+		g_rename(tmp, path))
+		g_unlink(tmp);
+
+#ifdef DEBUG
+	printf("vips__shm_cache_add: shared %s as %s\n", key, path);
+#endif /*DEBUG*/
+
+	g_free(tmp);
+	g_free(path);
+	g_free(key);
+}
+
+#else /*G_OS_WIN32*/
+
+VipsImage *
+vips__shm_cache_lookup(VipsForeignLoad *load, VipsImage *out)
+{
+	return NULL;
+}
+
+void
+vips__shm_cache_add(VipsForeignLoad *load, VipsImage *real)
+{
+}
+
+#endif /*!G_OS_WIN32*/
@@ -8,6 +8,10 @@
  *	-  add "unlimited" flag to png load
  * 3/2/23 MathemanFlo
  * 	- add bits per sample metadata
+ * 14/10/26
+ * 	- add "shrink", interlaced images only decode the passes they need
+ * 	- decode ahead on a background thread
+ * 	- set VIPS_FOREIGN_ZERO_COPY
  */
 
 /*
@@ -71,6 +75,14 @@ typedef struct _VipsForeignLoadPng {
 	 */
 	gboolean unlimited;
 
+	/* Shrink by this much during load.
+	 */
+	int shrink;
+
+	/* A full-width line, for decoding when we shrink.
+	 */
+	VipsPel *row_buffer;
+
 	spng_ctx *ctx;
 	struct spng_ihdr ihdr;
 	enum spng_format fmt;
@@ -137,7 +149,7 @@ vips_foreign_load_png_get_flags_source(VipsSource *source)
 	}
 	spng_ctx_free(ctx);
 
-	flags = 0;
+	flags = VIPS_FOREIGN_ZERO_COPY;
 	if (ihdr.interlace_method != SPNG_INTERLACE_NONE)
 		flags |= VIPS_FOREIGN_PARTIAL;
 	else
@@ -230,10 +242,14 @@ vips_foreign_load_png_set_header(VipsForeignLoadPng *png, VipsImage *image)
 			: phys.ppu_y;
 	}
 
+	/* Strict round down, like jpegload.
+	 */
 	vips_image_init_fields(image,
-		png->ihdr.width, png->ihdr.height, png->bands,
+		VIPS_MAX(1, png->ihdr.width / png->shrink),
+		VIPS_MAX(1, png->ihdr.height / png->shrink),
+		png->bands,
 		png->format, VIPS_CODING_NONE, png->interpretation,
-		xres, yres);
+		xres / png->shrink, yres / png->shrink);
 
 	VIPS_SETSTR(image->filename,
 		vips_connection_filename(VIPS_CONNECTION(png->source)));
@@ -373,6 +389,15 @@ vips_foreign_load_png_header(VipsForeignLoad *load)
 		return -1;
 	}
 
+	if (png->shrink != 1 &&
+		png->shrink != 2 &&
+		png->shrink != 4 &&
+		png->shrink != 8) {
+		vips_error(class->nickname,
+			_("bad shrink factor %d"), png->shrink);
+		return -1;
+	}
+
 #ifdef DEBUG
 	printf("width: %d\nheight: %d\nbit depth: %d\ncolor type: %d\n",
 		png->ihdr.width, png->ihdr.height,
@@ -524,6 +549,10 @@ vips_foreign_load_png_generate(VipsRegion *out_region,
 	g_assert(r->height ==
 		VIPS_MIN(VIPS__FATSTRIP_HEIGHT, out_region->im->Ysize - r->top));
 
+	const int shrink = png->shrink;
+	const size_t sizeof_pel = VIPS_IMAGE_SIZEOF_PEL(out_region->im);
+	const size_t sizeof_row = sizeof_pel * png->ihdr.width;
+
 	/* And check that y_pos is correct. It should be, since we are inside
 	 * a vips_sequential().
 	 */
@@ -534,12 +563,31 @@ vips_foreign_load_png_generate(VipsRegion *out_region,
 	}
 
 	for (y = 0; y < r->height; y++) {
+		VipsPel *q = VIPS_REGION_ADDR(out_region, 0, r->top + y);
+
 		/* libspng returns EOI when successfully reading the
 		 * final line of input.
 		 */
-		error = spng_decode_row(png->ctx,
-			VIPS_REGION_ADDR(out_region, 0, r->top + y),
-			VIPS_REGION_SIZEOF_LINE(out_region));
+		if (shrink == 1)
+			error = spng_decode_row(png->ctx,
+				q, VIPS_REGION_SIZEOF_LINE(out_region));
+		else {
+			/* Keep every shrink'th pixel of the first line, then
+			 * skip the next shrink - 1 lines.
+			 */
+			error = spng_decode_row(png->ctx,
+				png->row_buffer, sizeof_row);
+
+			for (int x = 0; x < r->width; x++)
+				memcpy(q + x * sizeof_pel,
+					png->row_buffer + x * shrink * sizeof_pel,
+					sizeof_pel);
+
+			for (int i = 1; i < shrink && !error; i++)
+				error = spng_decode_row(png->ctx,
+					png->row_buffer, sizeof_row);
+		}
+
 		if (error != 0 &&
 			error != SPNG_EOI) {
 			/* We've failed to read some pixels. Knock this
@@ -573,6 +621,70 @@ vips_foreign_load_png_generate(VipsRegion *out_region,
 	return 0;
 }
 
+/* Pixels in each Adam7 pass start at x_start and are x_delta apart.
+ */
+static const int vips_adam7_x_start[7] = { 0, 4, 0, 2, 0, 1, 0 };
+static const int vips_adam7_x_delta[7] = { 8, 8, 4, 4, 2, 2, 1 };
+
+/* Decode just enough Adam7 passes for every shrink'th pixel in both
+ * directions. Pass 1 is a 1/8 image, passes 1-3 make a 1/4 image, and 1-5 a
+ * 1/2 image.
+ */
+static int
+vips_foreign_load_png_interlaced_shrink(VipsForeignLoadPng *png,
+	VipsImage *out, enum spng_decode_flags flags)
+{
+	VipsObjectClass *class = VIPS_OBJECT_GET_CLASS(png);
+	const int shrink = png->shrink;
+	const int n_passes = shrink == 8 ? 1 : shrink == 4 ? 3 : 5;
+	const size_t sizeof_pel = VIPS_IMAGE_SIZEOF_PEL(out);
+	const size_t sizeof_row = sizeof_pel * png->ihdr.width;
+
+	int error;
+
+	if ((error = spng_decode_image(png->ctx, NULL, 0,
+			 png->fmt, flags | SPNG_DECODE_PROGRESSIVE))) {
+		vips_error(class->nickname, "%s", spng_strerror(error));
+		return -1;
+	}
+
+	for (;;) {
+		struct spng_row_info row_info;
+
+		if (spng_get_row_info(png->ctx, &row_info) ||
+			row_info.pass >= n_passes)
+			break;
+
+		/* Each decode writes just the pixels in this pass to their
+		 * final positions in the line.
+		 */
+		error = spng_decode_row(png->ctx, png->row_buffer, sizeof_row);
+		if (error != 0 &&
+			error != SPNG_EOI) {
+			vips_error(class->nickname, "%s", spng_strerror(error));
+			return -1;
+		}
+
+		if (row_info.row_num % shrink == 0 &&
+			row_info.row_num / shrink < out->Ysize) {
+			const int x_start = vips_adam7_x_start[row_info.pass];
+			const int x_delta = vips_adam7_x_delta[row_info.pass];
+			VipsPel *q = VIPS_IMAGE_ADDR(out, 0, row_info.row_num / shrink);
+
+			for (int x = x_start; x < out->Xsize * shrink; x += x_delta)
+				if (x % shrink == 0)
+					memcpy(q + x / shrink * sizeof_pel,
+						png->row_buffer + x * sizeof_pel,
+						sizeof_pel);
+		}
+
+		if (error == SPNG_EOI)
+			break;
+	}
+
+	return 0;
+}
+
 static int
 vips_foreign_load_png_load(VipsForeignLoad *load)
 {
@@ -587,6 +699,12 @@ vips_foreign_load_png_load(VipsForeignLoad *load)
 	if (vips_source_decode(png->source))
 		return -1;
 
+	if (png->shrink > 1 &&
+		!(png->row_buffer = VIPS_ARRAY(load,
+			  VIPS_IMAGE_SIZEOF_PEL(load->out) * png->ihdr.width,
+			  VipsPel)))
+		return -1;
+
 	/* Decode transparency, if available.
 	 */
 	flags = SPNG_DECODE_TRNS;
@@ -600,10 +718,15 @@ vips_foreign_load_png_load(VipsForeignLoad *load)
 			vips_image_write_prepare(t[0]))
 			return -1;
 
-		if ((error = spng_decode_image(png->ctx,
-				 VIPS_IMAGE_ADDR(t[0], 0, 0),
-				 VIPS_IMAGE_SIZEOF_IMAGE(t[0]),
-				 png->fmt, flags))) {
+		if (png->shrink > 1) {
+			if (vips_foreign_load_png_interlaced_shrink(png,
+					t[0], flags))
+				return -1;
+		}
+		else if ((error = spng_decode_image(png->ctx,
+					  VIPS_IMAGE_ADDR(t[0], 0, 0),
+					  VIPS_IMAGE_SIZEOF_IMAGE(t[0]),
+					  png->fmt, flags))) {
 			vips_error(class->nickname,
 				"%s", spng_strerror(error));
 			return -1;
@@ -643,6 +766,7 @@ vips_foreign_load_png_load(VipsForeignLoad *load)
 				png, NULL) ||
 			vips_sequential(t[0], &t[1],
 				"tile_height", VIPS__FATSTRIP_HEIGHT,
+				"prefetch", 4,
 				NULL) ||
 			vips_image_write(t[1], load->real))
 			return -1;
@@ -651,6 +775,11 @@ vips_foreign_load_png_load(VipsForeignLoad *load)
 	return 0;
 }
 
+static const VipsForeignMagic vips_foreign_load_png_magic[] = {
+	{ 0, 8, "\x89PNG\r\n\x1a\n" },
+	{ 0, 0, NULL }
+};
+
 static void
 vips_foreign_load_png_class_init(VipsForeignLoadPngClass *class)
 {
@@ -674,6 +803,7 @@ vips_foreign_load_png_class_init(VipsForeignLoadPngClass *class)
 		vips_foreign_load_png_get_flags_filename;
 	load_class->get_flags = vips_foreign_load_png_get_flags;
 	load_class->header = vips_foreign_load_png_header;
+	load_class->magic = vips_foreign_load_png_magic;
 	load_class->load = vips_foreign_load_png_load;
 
 #ifndef FUZZING_BUILD_MODE_UNSAFE_FOR_PRODUCTION
@@ -684,12 +814,20 @@ vips_foreign_load_png_class_init(VipsForeignLoadPngClass *class)
 		G_STRUCT_OFFSET(VipsForeignLoadPng, unlimited),
 		FALSE);
 #endif
+
+	VIPS_ARG_INT(class, "shrink", 24,
+		_("Shrink"),
+		_("Shrink factor on load"),
+		VIPS_ARGUMENT_OPTIONAL_INPUT,
+		G_STRUCT_OFFSET(VipsForeignLoadPng, shrink),
+		1, 8, 1);
 }
 
 static void
 vips_foreign_load_png_init(VipsForeignLoadPng *png)
 {
 	png->unlimited = vips_unlimited_get();
+	png->shrink = 1;
 }
 
 typedef struct _VipsForeignLoadPngSource {
@@ -14,6 +14,8 @@
  * 	- default filter to none
  * 17/11/22
  * 	- add exif save
+ * 14/10/26
+ * 	- filter and deflate large images in parallel
  */
 
 /*
@@ -540,7 +542,17 @@ vips_foreign_save_spng_write(VipsForeignSaveSpng *spng, VipsImage *in)
 		return -1;
 	}
 
-	if (spng->interlace) {
+	if (!spng->interlace &&
+		vips__png_can_write_parallel(in, spng->bitdepth)) {
+		/* spng has written everything up to the image data. Large
+		 * images are filtered and deflated on many threads, and we
+		 * write the IDAT and IEND chunks ourselves.
+		 */
+		if (vips__png_write_parallel(in, spng->target,
+				spng->bitdepth, spng->compression, spng->filter))
+			return -1;
+	}
+	else if (spng->interlace) {
 		/* Force the input into memory, if it's not there already.
 		 */
 		if (!spng->memory) {
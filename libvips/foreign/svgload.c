@@ -30,6 +30,8 @@
  * 	- allow random access
  * 20/5/25
  * 	- support high bitdepth rendering (128-bit)
+ * 15/10/26
+ * 	- render once to a recording surface, replay tiles in parallel
  */
 
 /*
@@ -131,6 +133,13 @@ typedef struct _VipsForeignLoadSvg {
 
 	RsvgHandle *page;
 
+	/* The document is rendered once to a cairo recording surface, then
+	 * replayed in parallel to make tiles. rsvg is not threadsafe, so
+	 * @lock protects @page and @recording.
+	 */
+	GMutex lock;
+	cairo_surface_t *recording;
+
 } VipsForeignLoadSvg;
 
 typedef VipsForeignLoadClass VipsForeignLoadSvgClass;
@@ -338,11 +347,22 @@ vips_foreign_load_svg_dispose(GObject *gobject)
 {
 	VipsForeignLoadSvg *svg = (VipsForeignLoadSvg *) gobject;
 
+	VIPS_FREEF(cairo_surface_destroy, svg->recording);
 	VIPS_UNREF(svg->page);
 
 	G_OBJECT_CLASS(vips_foreign_load_svg_parent_class)->dispose(gobject);
 }
 
+static void
+vips_foreign_load_svg_finalize(GObject *gobject)
+{
+	VipsForeignLoadSvg *svg = (VipsForeignLoadSvg *) gobject;
+
+	g_mutex_clear(&svg->lock);
+
+	G_OBJECT_CLASS(vips_foreign_load_svg_parent_class)->finalize(gobject);
+}
+
 static int
 vips_foreign_load_svg_build(VipsObject *object)
 {
@@ -616,43 +636,29 @@ vips_foreign_load_svg_header(VipsForeignLoad *load)
 	return vips_foreign_load_svg_parse(svg, load->out);
 }
 
+/* Render the whole document to a recording surface. Call with @lock held.
+ */
 static int
-vips_foreign_load_svg_generate(VipsRegion *out_region,
-	void *seq, void *a, void *b, gboolean *stop)
+vips_foreign_load_svg_record(VipsForeignLoadSvg *svg, VipsImage *image)
 {
-	const VipsForeignLoadSvg *svg = (VipsForeignLoadSvg *) a;
-	const VipsObjectClass *class = VIPS_OBJECT_GET_CLASS(svg);
-	const VipsRect *r = &out_region->valid;
+	VipsObjectClass *class = VIPS_OBJECT_GET_CLASS(svg);
 
+	cairo_rectangle_t extents;
+	cairo_surface_t *recording;
 	cairo_surface_t *surface;
 	cairo_t *cr;
-	int y;
 
 #ifdef DEBUG
-	printf("vips_foreign_load_svg_generate: %p \n     "
-		   "left = %d, top = %d, width = %d, height = %d\n",
-		svg,
-		r->left, r->top, r->width, r->height);
+	printf("vips_foreign_load_svg_record: %p\n", svg);
 #endif /*DEBUG*/
 
-	/* rsvg won't always paint the background.
-	 */
-	vips_region_black(out_region);
-
-#ifdef HAVE_CAIRO_FORMAT_RGBA128F
-	cairo_format_t format =
-		svg->high_bitdepth ? CAIRO_FORMAT_RGBA128F : CAIRO_FORMAT_ARGB32;
-#else
-	cairo_format_t format = CAIRO_FORMAT_ARGB32;
-#endif /*HAVE_CAIRO_FORMAT_RGBA128F*/
-
-	surface = cairo_image_surface_create_for_data(
-		VIPS_REGION_ADDR(out_region, r->left, r->top),
-		format,
-		r->width, r->height,
-		VIPS_REGION_LSKIP(out_region));
-	cr = cairo_create(surface);
-	cairo_surface_destroy(surface);
+	extents.x = 0;
+	extents.y = 0;
+	extents.width = image->Xsize;
+	extents.height = image->Ysize;
+	recording = cairo_recording_surface_create(
+		CAIRO_CONTENT_COLOR_ALPHA, &extents);
+	cr = cairo_create(recording);
 
 #if LIBRSVG_CHECK_VERSION(2, 48, 0)
 	if (svg->stylesheet &&
@@ -662,6 +668,7 @@ vips_foreign_load_svg_generate(VipsRegion *out_region,
 				(const guint8 *) svg->stylesheet,
 				g_utf8_strlen(svg->stylesheet, -1), &error)) {
 			cairo_destroy(cr);
+			cairo_surface_destroy(recording);
 			vips_operation_invalidate(VIPS_OPERATION(svg));
 			vips_error(class->nickname, "Invalid custom CSS");
 			vips_g_error(&error);
@@ -670,54 +677,122 @@ vips_foreign_load_svg_generate(VipsRegion *out_region,
 	}
 #endif
 
-	/* rsvg is single-threaded, but we don't need to lock since we're
-	 * running inside a non-threaded tilecache.
-	 */
 #if LIBRSVG_CHECK_VERSION(2, 46, 0)
 
 	{
 		RsvgRectangle viewport;
 		GError *error = NULL;
 
-		viewport.x = 0;
-		viewport.y = 0;
-		viewport.width = out_region->im->Xsize;
-		viewport.height = out_region->im->Ysize;
-
 		/* No need to scale -- we always set the viewport to the
-		 * whole image, and set the region to draw on the surface.
+		 * whole image.
 		 */
-		cairo_translate(cr, -r->left, -r->top);
+		viewport.x = 0;
+		viewport.y = 0;
+		viewport.width = image->Xsize;
+		viewport.height = image->Ysize;
 
 		if (!rsvg_handle_render_document(svg->page, cr, &viewport, &error)) {
 			cairo_destroy(cr);
+			cairo_surface_destroy(recording);
 			vips_operation_invalidate(VIPS_OPERATION(svg));
 			vips_error(class->nickname,
 				"%s", _("SVG rendering failed"));
 			vips_g_error(&error);
 			return -1;
 		}
-
-		cairo_destroy(cr);
 	}
 
 #else /*!LIBRSVG_CHECK_VERSION(2, 46, 0)*/
 
 	cairo_scale(cr, svg->total_scale, svg->total_scale);
-	cairo_translate(cr, -r->left / svg->total_scale,
-		-r->top / svg->total_scale);
 
 	if (!rsvg_handle_render_cairo(svg->page, cr)) {
 		cairo_destroy(cr);
+		cairo_surface_destroy(recording);
 		vips_operation_invalidate(VIPS_OPERATION(svg));
 		vips_error(class->nickname,
 			"%s", _("SVG rendering failed"));
 		return -1;
 	}
 
+#endif /*LIBRSVG_CHECK_VERSION(2, 46, 0)*/
+
 	cairo_destroy(cr);
 
-#endif /*LIBRSVG_CHECK_VERSION(2, 46, 0)*/
+	/* Replay a single pixel. cairo builds the spatial index for a
+	 * recording on first partial replay, so this makes it now, while we
+	 * hold the lock, rather than in parallel later.
+	 */
+	surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, 1, 1);
+	cr = cairo_create(surface);
+	cairo_set_source_surface(cr, recording, 0, 0);
+	cairo_paint(cr);
+	cairo_destroy(cr);
+	cairo_surface_destroy(surface);
+
+	svg->recording = recording;
+
+	return 0;
+}
+
+static int
+vips_foreign_load_svg_generate(VipsRegion *out_region,
+	void *seq, void *a, void *b, gboolean *stop)
+{
+	VipsForeignLoadSvg *svg = (VipsForeignLoadSvg *) a;
+	const VipsRect *r = &out_region->valid;
+
+	cairo_surface_t *recording;
+	cairo_surface_t *surface;
+	cairo_t *cr;
+	int y;
+
+#ifdef DEBUG
+	printf("vips_foreign_load_svg_generate: %p \n     "
+		   "left = %d, top = %d, width = %d, height = %d\n",
+		svg,
+		r->left, r->top, r->width, r->height);
+#endif /*DEBUG*/
+
+	/* rsvg is single-threaded, so the first tile makes the recording
+	 * with the lock held.
+	 */
+	g_mutex_lock(&svg->lock);
+	if (!svg->recording &&
+		vips_foreign_load_svg_record(svg, out_region->im)) {
+		g_mutex_unlock(&svg->lock);
+		return -1;
+	}
+	recording = cairo_surface_reference(svg->recording);
+	g_mutex_unlock(&svg->lock);
+
+	/* rsvg won't always paint the background.
+	 */
+	vips_region_black(out_region);
+
+#ifdef HAVE_CAIRO_FORMAT_RGBA128F
+	cairo_format_t format =
+		svg->high_bitdepth ? CAIRO_FORMAT_RGBA128F : CAIRO_FORMAT_ARGB32;
+#else
+	cairo_format_t format = CAIRO_FORMAT_ARGB32;
+#endif /*HAVE_CAIRO_FORMAT_RGBA128F*/
+
+	surface = cairo_image_surface_create_for_data(
+		VIPS_REGION_ADDR(out_region, r->left, r->top),
+		format,
+		r->width, r->height,
+		VIPS_REGION_LSKIP(out_region));
+	cr = cairo_create(surface);
+	cairo_surface_destroy(surface);
+
+	/* Replaying a recording is threadsafe, so there's no need to lock.
+	 */
+	cairo_set_source_surface(cr, recording, -r->left, -r->top);
+	cairo_paint(cr);
+
+	cairo_destroy(cr);
+	cairo_surface_destroy(recording);
+
 	if (svg->high_bitdepth) {
 		/* Assuming the surface is RGBA128F and the data is premultiplied.
 		   Loop through each row and unpremultiply the float data.
@@ -756,6 +831,7 @@ vips_foreign_load_svg_load(VipsForeignLoad *load)
 			"tile_width", TILE_SIZE,
 			"tile_height", TILE_SIZE,
 			"max_tiles", 2 * (1 + t[0]->Xsize / TILE_SIZE),
+			"threaded", TRUE,
 			NULL) ||
 		vips_image_write(t[1], load->real))
 		return -1;
@@ -773,6 +849,7 @@ vips_foreign_load_svg_class_init(VipsForeignLoadSvgClass *class)
 	VipsForeignLoadClass *load_class = (VipsForeignLoadClass *) class;
 
 	gobject_class->dispose = vips_foreign_load_svg_dispose;
+	gobject_class->finalize = vips_foreign_load_svg_finalize;
 	gobject_class->set_property = vips_object_set_property;
 	gobject_class->get_property = vips_object_get_property;
 
@@ -838,6 +915,7 @@ vips_foreign_load_svg_init(VipsForeignLoadSvg *svg)
 	svg->dpi = 72.0;
 	svg->scale = 1.0;
 	svg->unlimited = vips_unlimited_get();
+	g_mutex_init(&svg->lock);
 }
 
 typedef struct _VipsForeignLoadSvgSource {
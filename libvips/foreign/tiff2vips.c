@@ -213,6 +213,11 @@
  *  - fix demand hinting
  * 3/2/23 MathemanFlo
  * 	- add bits per sample metadata
+ * 14/10/26
+ * 	- decode deflate, zstd, lzw and webp tiles outside the lock
+ * 15/10/26
+ * 	- use vips__half_to_float() for 16-bit float
+ * 	- share decoded tiles between random access loads of the same file
  */
 
 /*
@@ -251,6 +256,7 @@
 #include <config.h>
 #endif /*HAVE_CONFIG_H*/
 #include <glib/gi18n-lib.h>
+#include <glib/gstdio.h>
 
 #ifdef HAVE_TIFF
 
@@ -271,6 +277,18 @@
 #include "jpeg.h"
 #endif /*HAVE_JPEG*/
 
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif /*HAVE_ZLIB*/
+
+#if defined(HAVE_ZSTD) && defined(HAVE_TIFF_COMPRESSION_WEBP)
+#include <zstd.h>
+#endif /*defined(HAVE_ZSTD) && defined(HAVE_TIFF_COMPRESSION_WEBP)*/
+
+#if defined(HAVE_LIBWEBP) && defined(HAVE_TIFF_COMPRESSION_WEBP)
+#include <webp/decode.h>
+#endif /*defined(HAVE_LIBWEBP) && defined(HAVE_TIFF_COMPRESSION_WEBP)*/
+
 /* Compression types we handle ourselves.
  */
 static int rtiff_we_decompress[] = {
@@ -282,6 +300,24 @@ static int rtiff_we_decompress[] = {
 	JP2K_LOSSY
 };
 
+/* Lossless (and webp) compression types we can also handle ourselves, but
+ * only for simple tile layouts. If we can't decode a tile, we fall back to
+ * libtiff.
+ */
+static int rtiff_we_decompress_simple[] = {
+#ifdef HAVE_ZLIB
+	COMPRESSION_ADOBE_DEFLATE,
+	COMPRESSION_DEFLATE,
+#endif /*HAVE_ZLIB*/
+#if defined(HAVE_ZSTD) && defined(HAVE_TIFF_COMPRESSION_WEBP)
+	COMPRESSION_ZSTD,
+#endif /*defined(HAVE_ZSTD) && defined(HAVE_TIFF_COMPRESSION_WEBP)*/
+#if defined(HAVE_LIBWEBP) && defined(HAVE_TIFF_COMPRESSION_WEBP)
+	COMPRESSION_WEBP,
+#endif /*defined(HAVE_LIBWEBP) && defined(HAVE_TIFF_COMPRESSION_WEBP)*/
+	COMPRESSION_LZW
+};
+
 /* What we read from the tiff dir to set our read strategy. For multipage
  * read, we need to read and compare lots of these, so it needs to be broken
  * out as a separate thing.
@@ -349,6 +385,12 @@ typedef struct _RtiffHeader {
 	 */
 	gboolean we_decompress;
 
+	/* TRUE if we_decompress is for one of rtiff_we_decompress_simple, so
+	 * we must undo the predictor and fix byte order ourselves, and can
+	 * fall back to libtiff on error.
+	 */
+	gboolean we_decompress_simple;
+
 	/* TRUE if we use TIFFRGBAImage or TIFFReadRGBATile.
 	 * Used for COMPRESSION_OJPEG
 	 */
@@ -422,28 +464,16 @@ typedef struct _Rtiff {
 	/* Stop processing due to an error or warning.
 	 */
 	gboolean failed;
-} Rtiff;
 
-/* Convert IEEE 754-2008 16-bit float to 32-bit float
- */
-static inline float
-half_2_float(gushort h)
-{
-	const float sign = (h >> 15) * -2 + 1;
-	const int exp = ((h & 0x7C00) >> 10) - 15;
-	const float prec = (h & 0x03FF);
-
-	switch (exp) {
-	case 16:
-		return INFINITY * sign;
-	case -15:
-		return sign / (float) (1 << 14) * (prec / 1024.0F);
-	default:
-		return exp > 0
-			? sign * (float) (1 << exp) * (1.0F + prec / 1024.0F)
-			: sign / (float) (1 << -exp) * (1.0F + prec / 1024.0F);
-	}
-}
+	/* Set if decoded tiles can go into the shared tile cache. We only
+	 * share tiles for random access loads from files, and identify the
+	 * file by name, mtime and size.
+	 */
+	gboolean share_tiles;
+	char *filename;
+	gint64 mtime;
+	gint64 size;
+} Rtiff;
 
 /* Test for field exists.
  */
@@ -589,6 +619,7 @@ rtiff_free(Rtiff *rtiff)
 	VIPS_FREEF(TIFFClose, rtiff->tiff);
 	g_rec_mutex_clear(&rtiff->lock);
 	VIPS_UNREF(rtiff->source);
+	VIPS_FREE(rtiff->filename);
 }
 
 static void
@@ -674,6 +705,10 @@ rtiff_new(VipsSource *source, VipsImage *out,
 	rtiff->contig_buf = NULL;
 	rtiff->y_pos = 0;
 	rtiff->failed = FALSE;
+	rtiff->share_tiles = FALSE;
+	rtiff->filename = NULL;
+	rtiff->mtime = 0;
+	rtiff->size = 0;
 
 	g_signal_connect(out, "close",
 		G_CALLBACK(rtiff_close_cb), rtiff);
@@ -1334,23 +1369,14 @@ rtiff_parse_fourbit(Rtiff *rtiff, VipsImage *out)
  */
 #define GREY_LOOP_F16 \
 	{ \
-		gushort *p1; \
-		float *q1; \
+		float *q1 = (float *) q; \
 \
-		p1 = (gushort *) p; \
-		q1 = (float *) q; \
-		for (x = 0; x < n; x++) { \
-			if (invert) \
-				q1[0] = 1.0 - half_2_float(p1[0]); \
-			else \
-				q1[0] = half_2_float(p1[0]); \
-\
-			for (i = 1; i < samples_per_pixel; i++) \
-				q1[i] = half_2_float(p1[i]); \
-\
-			q1 += samples_per_pixel; \
-			p1 += samples_per_pixel; \
-		} \
+		vips__half_to_float(q1, (guint16 *) p, \
+			(size_t) n * samples_per_pixel); \
+		if (invert) \
+			for (x = 0; x < n; x++) \
+				q1[x * samples_per_pixel] = \
+					1.0 - q1[x * samples_per_pixel]; \
 	}
 
 /* Per-scanline process function for greyscale images.
@@ -1707,13 +1733,7 @@ rtiff_memcpy_f16_line(Rtiff *rtiff, VipsPel *q, VipsPel *p, int n, void *client)
 		im->BandFmt == VIPS_FORMAT_DPCOMPLEX)
 		len *= 2;
 
-	int i;
-
-	gushort *restrict hp = (gushort *) p;
-	float *restrict fq = (float *) q;
-
-	for (i = 0; i < len; i++)
-		fq[i] = half_2_float(hp[i]);
+	vips__half_to_float((float *) q, (guint16 *) p, len);
 }
 
 /* Read a regular multiband image where we can just copy pixels from the tiff
@@ -2240,11 +2260,314 @@ rtiff_decompress_jpeg(Rtiff *rtiff, void *data, size_t data_len, void *out)
 }
 #endif /*HAVE_JPEG*/
 
+/* Decode a TIFF LZW stream, MSB-first codes with early change. Old-style
+ * (LSB-first) LZW is rejected, libtiff will handle that.
+ */
 static int
-rtiff_decompress_tile(Rtiff *rtiff, tdata_t *in, tsize_t size, tdata_t *out)
+rtiff_decompress_lzw(VipsPel *in, size_t in_length,
+	VipsPel *out, size_t out_length)
+{
+	guint16 prefix[4096];
+	VipsPel suffix[4096];
+	VipsPel first[4096];
+	guint16 length[4096];
+
+	guint32 bits;
+	int n_bits;
+	int code_width;
+	int next_code;
+	int old;
+	size_t in_pos;
+	size_t out_pos;
+	int i;
+
+	if (in_length >= 2 &&
+		in[0] == 0 &&
+		(in[1] & 0x1))
+		return -1;
+
+	for (i = 0; i < 256; i++) {
+		prefix[i] = 0;
+		suffix[i] = i;
+		first[i] = i;
+		length[i] = 1;
+	}
+
+	bits = 0;
+	n_bits = 0;
+	code_width = 9;
+	next_code = 258;
+	old = -1;
+	in_pos = 0;
+	out_pos = 0;
+
+	while (out_pos < out_length) {
+		int code;
+		int c;
+		int k;
+
+		while (n_bits < code_width &&
+			in_pos < in_length) {
+			bits = (bits << 8) | in[in_pos++];
+			n_bits += 8;
+		}
+		if (n_bits < code_width)
+			break;
+
+		code = (bits >> (n_bits - code_width)) & ((1 << code_width) - 1);
+		n_bits -= code_width;
+
+		if (code == 256) {
+			code_width = 9;
+			next_code = 258;
+			old = -1;
+			continue;
+		}
+		if (code == 257)
+			break;
+
+		if (old == -1) {
+			if (code > 255)
+				return -1;
+			out[out_pos++] = code;
+			old = code;
+			continue;
+		}
+
+		if (code > next_code ||
+			(code == next_code && next_code >= 4096))
+			return -1;
+
+		/* Add the new entry first, so the KwKwK case (code == next_code)
+		 * works.
+		 */
+		if (next_code < 4096) {
+			prefix[next_code] = old;
+			suffix[next_code] = code < next_code ? first[code] : first[old];
+			first[next_code] = first[old];
+			length[next_code] = length[old] + 1;
+			next_code += 1;
+
+			if (next_code >= (1 << code_width) - 1 &&
+				code_width < 12)
+				code_width += 1;
+		}
+
+		/* Write the string for code backwards from the end. Clip to the
+		 * output buffer.
+		 */
+		c = code;
+		for (k = length[code] - 1; k >= 0; k--) {
+			if (out_pos + k < out_length)
+				out[out_pos + k] = suffix[c];
+			c = prefix[c];
+		}
+		out_pos += VIPS_MIN(length[code], out_length - out_pos);
+
+		old = code;
+	}
+
+	return out_pos == out_length ? 0 : -1;
+}
+
+/* Decompress one of the simple codecs. Return -1 (with no error message)
+ * if we can't, and the caller will try again with libtiff.
+ */
+static int
+rtiff_decompress_simple(Rtiff *rtiff, tdata_t *in, tsize_t size, tdata_t *out)
+{
+	size_t tile_size = rtiff->header.tile_size;
+
+	switch (rtiff->header.compression) {
+#ifdef HAVE_ZLIB
+	case COMPRESSION_ADOBE_DEFLATE:
+	case COMPRESSION_DEFLATE: {
+		uLongf length = tile_size;
+
+		if (uncompress((Bytef *) out, &length, (Bytef *) in, size) != Z_OK ||
+			length != tile_size)
+			return -1;
+		break;
+	}
+#endif /*HAVE_ZLIB*/
+
+#if defined(HAVE_ZSTD) && defined(HAVE_TIFF_COMPRESSION_WEBP)
+	case COMPRESSION_ZSTD: {
+		size_t length = ZSTD_decompress(out, tile_size, in, size);
+
+		if (ZSTD_isError(length) ||
+			length != tile_size)
+			return -1;
+		break;
+	}
+#endif /*defined(HAVE_ZSTD) && defined(HAVE_TIFF_COMPRESSION_WEBP)*/
+
+#if defined(HAVE_LIBWEBP) && defined(HAVE_TIFF_COMPRESSION_WEBP)
+	case COMPRESSION_WEBP: {
+		int width, height;
+		int stride = rtiff->header.tile_row_size;
+
+		if (!WebPGetInfo((uint8_t *) in, size, &width, &height) ||
+			width != rtiff->header.tile_width ||
+			height != rtiff->header.tile_height)
+			return -1;
+
+		if (rtiff->header.samples_per_pixel == 4) {
+			if (!WebPDecodeRGBAInto((uint8_t *) in, size,
+					(uint8_t *) out, tile_size, stride))
+				return -1;
+		}
+		else {
+			if (!WebPDecodeRGBInto((uint8_t *) in, size,
+					(uint8_t *) out, tile_size, stride))
+				return -1;
+		}
+		break;
+	}
+#endif /*defined(HAVE_LIBWEBP) && defined(HAVE_TIFF_COMPRESSION_WEBP)*/
+
+	case COMPRESSION_LZW:
+		if (rtiff_decompress_lzw((VipsPel *) in, size,
+				(VipsPel *) out, tile_size))
+			return -1;
+		break;
+
+	default:
+		g_assert_not_reached();
+		return -1;
+	}
+
+	return 0;
+}
+
+/* libtiff does this after decode for files in the other byte order.
+ */
+static void
+rtiff_swab_tile(Rtiff *rtiff, tdata_t *buf)
+{
+	tsize_t n = rtiff->header.tile_size;
+
+	switch (rtiff->header.bits_per_sample) {
+	case 16:
+		TIFFSwabArrayOfShort((guint16 *) buf, n / 2);
+		break;
+
+	case 32:
+		TIFFSwabArrayOfLong((guint32 *) buf, n / 4);
+		break;
+
+	default:
+		break;
+	}
+}
+
+#define HORIZONTAL_ACC(TYPE) \
+	{ \
+		TYPE *p = (TYPE *) row; \
+\
+		for (x = spp; x < n; x++) \
+			p[x] += p[x - spp]; \
+	}
+
+/* Undo the horizontal or floating point predictor on a decoded tile.
+ */
+static int
+rtiff_predictor_tile(Rtiff *rtiff, int predictor, tdata_t *buf)
+{
+	int spp = rtiff->header.samples_per_pixel;
+	int bps = rtiff->header.bits_per_sample;
+	int n = rtiff->header.tile_width * spp;
+	tsize_t row_size = rtiff->header.tile_row_size;
+
+	VipsPel *row;
+	VipsPel *tmp;
+	int x, y;
+
+	if (predictor == PREDICTOR_HORIZONTAL)
+		for (y = 0; y < rtiff->header.tile_height; y++) {
+			row = (VipsPel *) buf + y * row_size;
+
+			switch (bps) {
+			case 8:
+				HORIZONTAL_ACC(guint8);
+				break;
+
+			case 16:
+				HORIZONTAL_ACC(guint16);
+				break;
+
+			case 32:
+				HORIZONTAL_ACC(guint32);
+				break;
+
+			default:
+				return -1;
+			}
+		}
+	else if (predictor == PREDICTOR_FLOATINGPOINT) {
+		int bytes = bps / 8;
+		int wc = n;
+		int cc = n * bytes;
+
+		if (bps != 16 &&
+			bps != 32)
+			return -1;
+
+		tmp = g_malloc(cc);
+
+		for (y = 0; y < rtiff->header.tile_height; y++) {
+			int i, b;
+
+			row = (VipsPel *) buf + y * row_size;
+
+			/* Sum bytes, then reassemble byte planes into samples.
+			 */
+			for (x = spp; x < cc; x++)
+				row[x] += row[x - spp];
+
+			memcpy(tmp, row, cc);
+			for (i = 0; i < wc; i++)
+				for (b = 0; b < bytes; b++)
+#if G_BYTE_ORDER == G_BIG_ENDIAN
+					row[bytes * i + b] = tmp[b * wc + i];
+#else
+					row[bytes * i + b] = tmp[(bytes - b - 1) * wc + i];
+#endif
+		}
+
+		g_free(tmp);
+	}
+
+	return 0;
+}
+
+static int
+rtiff_decompress_tile(Rtiff *rtiff, tdata_t *in, tsize_t size, tdata_t *out,
+	int predictor)
 {
 	g_assert(rtiff->header.we_decompress);
 
+	/* The simple codecs don't set an error message on failure, since we
+	 * can retry with libtiff.
+	 */
+	if (rtiff->header.we_decompress_simple) {
+		if (rtiff_decompress_simple(rtiff, in, size, out))
+			return -1;
+
+		/* The floating point predictor works on bytes and is byte order
+		 * independent.
+		 */
+		if (predictor != PREDICTOR_FLOATINGPOINT &&
+			TIFFIsByteSwapped(rtiff->tiff))
+			rtiff_swab_tile(rtiff, out);
+
+		if (predictor != PREDICTOR_NONE &&
+			rtiff_predictor_tile(rtiff, predictor, out))
+			return -1;
+
+		return 0;
+	}
+
 	switch (rtiff->header.compression) {
 	case JP2K_YCC:
 	case JP2K_RGB:
@@ -2303,11 +2626,283 @@ rtiff_read_rgba_tile(Rtiff *rtiff, int x, int y, tdata_t *buf)
 	return 0;
 }
 
+/* Select a page and read a tile with libtiff.
+ */
+static int
+rtiff_read_tile_libtiff(Rtiff *rtiff, tdata_t *buf, int page, int x, int y)
+{
+	int result;
+
+	g_rec_mutex_lock(&rtiff->lock);
+
+	if (rtiff_set_page(rtiff, page)) {
+		g_rec_mutex_unlock(&rtiff->lock);
+		return -1;
+	}
+
+	if (rtiff->header.read_as_rgba)
+		result = rtiff_read_rgba_tile(rtiff, x, y, buf);
+	else
+		result = TIFFReadTile(rtiff->tiff, buf, x, y, 0, 0) < 0;
+	if (result && rtiff->fail_on >= VIPS_FAIL_ON_WARNING) {
+		vips_foreign_load_invalidate(rtiff->out);
+		g_rec_mutex_unlock(&rtiff->lock);
+		return -1;
+	}
+
+	g_rec_mutex_unlock(&rtiff->lock);
+
+	return 0;
+}
+
+/* For the simple codecs, check that this page is something we can decode,
+ * and get the predictor. Call with the lock held and the page set.
+ */
+static gboolean
+rtiff_simple_tile_ok(Rtiff *rtiff, int *predictor)
+{
+	guint16 fill_order;
+	guint16 v;
+
+	TIFFGetFieldDefaulted(rtiff->tiff, TIFFTAG_FILLORDER, &fill_order);
+	if (fill_order != FILLORDER_MSB2LSB)
+		return FALSE;
+
+	TIFFGetFieldDefaulted(rtiff->tiff, TIFFTAG_PREDICTOR, &v);
+	if (v != PREDICTOR_NONE &&
+		v != PREDICTOR_HORIZONTAL &&
+		v != PREDICTOR_FLOATINGPOINT)
+		return FALSE;
+	*predictor = v;
+
+	return TRUE;
+}
+
+/* Make sure the compressed tile buffer can hold this tile.
+ */
+static int
+rtiff_seq_compressed_buf(RtiffSeq *seq, ttile_t tile_no)
+{
+	Rtiff *rtiff = seq->rtiff;
+
+	guint64 *byte_counts;
+
+	if (TIFFGetField(rtiff->tiff, TIFFTAG_TILEBYTECOUNTS, &byte_counts) &&
+		byte_counts[tile_no] > (guint64) seq->compressed_buf_length) {
+		/* Same sanity limit as tile_size.
+		 */
+		if (byte_counts[tile_no] > 100 * 1000 * 1000)
+			return -1;
+
+		VIPS_FREE(seq->compressed_buf);
+		seq->compressed_buf_length = byte_counts[tile_no];
+		if (!(seq->compressed_buf =
+					VIPS_MALLOC(NULL, seq->compressed_buf_length)))
+			return -1;
+	}
+
+	return 0;
+}
+
+/* A cache of decoded tiles shared between all random access loads. Tile
+ * viewers make many small loads from the same pyramid, and without this each
+ * load would decode again any tile that spans two viewer tiles.
+ */
+#define RTIFF_TILE_CACHE_SIZE (64 * 1024 * 1024)
+
+typedef struct _RtiffTileKey {
+	char *filename;
+	gint64 mtime;
+	gint64 size;
+	int subifd;
+	int page;
+	int x;
+	int y;
+
+	/* These can change the decoded pixels.
+	 */
+	gboolean read_as_rgba;
+	VipsFailOn fail_on;
+} RtiffTileKey;
+
+typedef struct _RtiffTile {
+	RtiffTileKey key;
+
+	tsize_t length;
+	VipsPel *data;
+
+	/* Our link in the LRU queue.
+	 */
+	GList *link;
+} RtiffTile;
+
+static GHashTable *rtiff_tile_cache = NULL;
+static GQueue rtiff_tile_cache_lru = G_QUEUE_INIT;
+static size_t rtiff_tile_cache_bytes = 0;
+static GMutex rtiff_tile_cache_lock;
+
+static guint
+rtiff_tile_key_hash(gconstpointer p)
+{
+	const RtiffTileKey *key = (const RtiffTileKey *) p;
+
+	return g_str_hash(key->filename) ^
+		(guint) key->mtime ^
+		(guint) key->page << 24 ^
+		(guint) key->subifd << 20 ^
+		(guint) key->y << 10 ^
+		(guint) key->x;
+}
+
+static gboolean
+rtiff_tile_key_equal(gconstpointer a, gconstpointer b)
+{
+	const RtiffTileKey *key1 = (const RtiffTileKey *) a;
+	const RtiffTileKey *key2 = (const RtiffTileKey *) b;
+
+	return key1->x == key2->x &&
+		key1->y == key2->y &&
+		key1->page == key2->page &&
+		key1->subifd == key2->subifd &&
+		key1->mtime == key2->mtime &&
+		key1->size == key2->size &&
+		key1->read_as_rgba == key2->read_as_rgba &&
+		key1->fail_on == key2->fail_on &&
+		g_str_equal(key1->filename, key2->filename);
+}
+
+static void
+rtiff_tile_free(RtiffTile *tile)
+{
+	VIPS_FREE(tile->key.filename);
+	VIPS_FREE(tile->data);
+	g_free(tile);
+}
+
+static void
+rtiff_tile_key_init(RtiffTileKey *key, Rtiff *rtiff, int page, int x, int y)
+{
+	key->filename = rtiff->filename;
+	key->mtime = rtiff->mtime;
+	key->size = rtiff->size;
+	key->subifd = rtiff->subifd;
+	key->page = page;
+	key->x = x;
+	key->y = y;
+	key->read_as_rgba = rtiff->header.read_as_rgba;
+	key->fail_on = rtiff->fail_on;
+}
+
+/* Copy a tile from the cache to @buf, if we can.
+ */
+static gboolean
+rtiff_tile_cache_get(Rtiff *rtiff, int page, int x, int y, tdata_t *buf)
+{
+	RtiffTileKey key;
+	RtiffTile *tile;
+
+	rtiff_tile_key_init(&key, rtiff, page, x, y);
+
+	g_mutex_lock(&rtiff_tile_cache_lock);
+
+	if (rtiff_tile_cache &&
+		(tile = g_hash_table_lookup(rtiff_tile_cache, &key)) &&
+		tile->length == rtiff->header.tile_size) {
+		memcpy(buf, tile->data, tile->length);
+
+		/* Move to the most-recently-used end.
+		 */
+		g_queue_unlink(&rtiff_tile_cache_lru, tile->link);
+		g_queue_push_tail_link(&rtiff_tile_cache_lru, tile->link);
+
+		g_mutex_unlock(&rtiff_tile_cache_lock);
+
+		return TRUE;
+	}
+
+	g_mutex_unlock(&rtiff_tile_cache_lock);
+
+	return FALSE;
+}
+
+/* Add a freshly decoded tile to the cache, and trim.
+ */
+static void
+rtiff_tile_cache_put(Rtiff *rtiff, int page, int x, int y, tdata_t *buf)
+{
+	tsize_t length = rtiff->header.tile_size;
+
+	RtiffTile *tile;
+
+	/* Very large tiles would flush the whole cache.
+	 */
+	if (length > RTIFF_TILE_CACHE_SIZE / 16)
+		return;
+
+	/* Copy outside the lock.
+	 */
+	tile = g_new0(RtiffTile, 1);
+	rtiff_tile_key_init(&tile->key, rtiff, page, x, y);
+	tile->key.filename = g_strdup(rtiff->filename);
+	tile->length = length;
+	tile->data = g_malloc(length);
+	memcpy(tile->data, buf, length);
+
+	g_mutex_lock(&rtiff_tile_cache_lock);
+
+	if (!rtiff_tile_cache)
+		rtiff_tile_cache = g_hash_table_new(
+			rtiff_tile_key_hash, rtiff_tile_key_equal);
+
+	/* Another thread may have decoded this tile at the same time.
+	 */
+	if (g_hash_table_contains(rtiff_tile_cache, &tile->key)) {
+		g_mutex_unlock(&rtiff_tile_cache_lock);
+		rtiff_tile_free(tile);
+		return;
+	}
+
+	g_hash_table_insert(rtiff_tile_cache, &tile->key, tile);
+	g_queue_push_tail(&rtiff_tile_cache_lru, tile);
+	tile->link = rtiff_tile_cache_lru.tail;
+	rtiff_tile_cache_bytes += length;
+
+	while (rtiff_tile_cache_bytes > RTIFF_TILE_CACHE_SIZE) {
+		RtiffTile *oldest = g_queue_pop_head(&rtiff_tile_cache_lru);
+
+		g_hash_table_remove(rtiff_tile_cache, &oldest->key);
+		rtiff_tile_cache_bytes -= oldest->length;
+		rtiff_tile_free(oldest);
+	}
+
+	g_mutex_unlock(&rtiff_tile_cache_lock);
+}
+
+/* Decide if this load can use the shared tile cache.
+ */
+static void
+rtiff_tile_cache_attach(Rtiff *rtiff, VipsAccess access)
+{
+	const char *filename;
+	GStatBuf st;
+
+	if (access == VIPS_ACCESS_RANDOM &&
+		rtiff->header.tiled &&
+		(filename = vips_connection_filename(
+			 VIPS_CONNECTION(rtiff->source))) &&
+		!g_stat(filename, &st)) {
+		rtiff->share_tiles = TRUE;
+		rtiff->filename = g_strdup(filename);
+		rtiff->mtime = st.st_mtime;
+		rtiff->size = st.st_size;
+	}
+}
+
 /* Select a page and decompress a tile. This has to be a single operation,
  * since it changes the current page number in TIFF.
  */
 static int
-rtiff_read_tile(RtiffSeq *seq, tdata_t *buf, int page, int x, int y)
+rtiff_read_tile_decode(RtiffSeq *seq, tdata_t *buf, int page, int x, int y)
 {
 	Rtiff *rtiff = seq->rtiff;
 
@@ -2323,6 +2918,7 @@ rtiff_read_tile(RtiffSeq *seq, tdata_t *buf, int page, int x, int y)
 	 */
 	if (rtiff->header.we_decompress) {
 		ttile_t tile_no;
+		int predictor;
 
 		g_rec_mutex_lock(&rtiff->lock);
 
@@ -2333,6 +2929,22 @@ rtiff_read_tile(RtiffSeq *seq, tdata_t *buf, int page, int x, int y)
 
 		tile_no = TIFFComputeTile(rtiff->tiff, x, y, 0, 0);
 
+		predictor = PREDICTOR_NONE;
+		if (rtiff->header.we_decompress_simple) {
+			int result;
+
+			/* Not a page we can decode, or a tile too large for our
+			 * buffer? Let libtiff do it.
+			 */
+			if (!rtiff_simple_tile_ok(rtiff, &predictor) ||
+				rtiff_seq_compressed_buf(seq, tile_no)) {
+				result = rtiff_read_tile_libtiff(rtiff, buf, page, x, y);
+				g_rec_mutex_unlock(&rtiff->lock);
+
+				return result;
+			}
+		}
+
 		size = TIFFReadRawTile(rtiff->tiff, tile_no,
 			seq->compressed_buf, seq->compressed_buf_length);
 		if (size <= 0) {
@@ -2345,32 +2957,42 @@ rtiff_read_tile(RtiffSeq *seq, tdata_t *buf, int page, int x, int y)
 
 		/* Decompress outside the lock, so we get parallelism.
 		 */
-		if (rtiff_decompress_tile(rtiff, seq->compressed_buf, size, buf)) {
+		if (rtiff_decompress_tile(rtiff,
+				seq->compressed_buf, size, buf, predictor)) {
+			/* libtiff might do better, and will handle fail_on for us.
+			 */
+			if (rtiff->header.we_decompress_simple)
+				return rtiff_read_tile_libtiff(rtiff, buf, page, x, y);
+
 			vips_error("tiff2vips", _("decompress error tile %d x %d"), x, y);
 			return -1;
 		}
 	}
-	else {
-		g_rec_mutex_lock(&rtiff->lock);
+	else if (rtiff_read_tile_libtiff(rtiff, buf, page, x, y))
+		return -1;
 
-		if (rtiff_set_page(rtiff, page)) {
-			g_rec_mutex_unlock(&rtiff->lock);
-			return -1;
-		}
+	return 0;
+}
 
-		int result;
-		if (rtiff->header.read_as_rgba)
-			result = rtiff_read_rgba_tile(rtiff, x, y, buf);
-		else
-			result = TIFFReadTile(rtiff->tiff, buf, x, y, 0, 0) < 0;
-		if (result && rtiff->fail_on >= VIPS_FAIL_ON_WARNING) {
-			vips_foreign_load_invalidate(rtiff->out);
-			g_rec_mutex_unlock(&rtiff->lock);
-			return -1;
-		}
+/* Read a tile, going via the shared tile cache if we can.
+ */
+static int
+rtiff_read_tile(RtiffSeq *seq, tdata_t *buf, int page, int x, int y)
+{
+	Rtiff *rtiff = seq->rtiff;
 
-		g_rec_mutex_unlock(&rtiff->lock);
-	}
+	if (rtiff->share_tiles &&
+		rtiff_tile_cache_get(rtiff, page, x, y, buf))
+		return 0;
+
+	if (rtiff_read_tile_decode(seq, buf, page, x, y))
+		return -1;
+
+	/* Don't share tiles from a load that has hit an error.
+	 */
+	if (rtiff->share_tiles &&
+		!rtiff->failed)
+		rtiff_tile_cache_put(rtiff, page, x, y, buf);
 
 	return 0;
 }
@@ -3160,8 +3782,43 @@ rtiff_header_read(Rtiff *rtiff, RtiffHeader *header)
 	 */
 	header->tiled = TIFFIsTiled(rtiff->tiff);
 
+	/* We can decode the simple codecs outside the lock for contiguous
+	 * tiles with whole-byte or packed samples. Anything odd stays with
+	 * libtiff.
+	 */
+	header->we_decompress_simple = FALSE;
+	if (header->tiled &&
+		!header->read_as_rgba &&
+		!header->separate &&
+		(header->bits_per_sample == 1 ||
+			header->bits_per_sample == 2 ||
+			header->bits_per_sample == 4 ||
+			header->bits_per_sample == 8 ||
+			header->bits_per_sample == 16 ||
+			header->bits_per_sample == 32))
+		for (i = 0; i < VIPS_NUMBER(rtiff_we_decompress_simple); i++)
+			if (header->compression == rtiff_we_decompress_simple[i]) {
+				header->we_decompress = TRUE;
+				header->we_decompress_simple = TRUE;
+				break;
+			}
+
+#if defined(HAVE_LIBWEBP) && defined(HAVE_TIFF_COMPRESSION_WEBP)
+	/* libwebp can only make 8-bit RGB and RGBA.
+	 */
+	if (header->we_decompress_simple &&
+		header->compression == COMPRESSION_WEBP &&
+		(header->bits_per_sample != 8 ||
+			(header->samples_per_pixel != 3 &&
+				header->samples_per_pixel != 4))) {
+		header->we_decompress = FALSE;
+		header->we_decompress_simple = FALSE;
+	}
+#endif /*defined(HAVE_LIBWEBP) && defined(HAVE_TIFF_COMPRESSION_WEBP)*/
+
 	if (header->read_as_rgba) {
 		header->we_decompress = FALSE;
+		header->we_decompress_simple = FALSE;
 		header->photometric_interpretation = PHOTOMETRIC_RGB;
 		header->samples_per_pixel = 4;
 		header->bits_per_sample = 8;
@@ -3514,7 +4171,7 @@ vips__tiff_read_header_source(VipsSource *source, VipsImage *out,
 int
 vips__tiff_read_source(VipsSource *source, VipsImage *out,
 	int page, int n, gboolean autorotate, int subifd, VipsFailOn fail_on,
-	gboolean unlimited)
+	gboolean unlimited, VipsAccess access)
 {
 	Rtiff *rtiff;
 
@@ -3530,6 +4187,8 @@ vips__tiff_read_source(VipsSource *source, VipsImage *out,
 		return -1;
 
 	if (rtiff->header.tiled) {
+		rtiff_tile_cache_attach(rtiff, access);
+
 		if (rtiff_read_tilewise(rtiff, out))
 			return -1;
 	}
@@ -4,6 +4,9 @@
  * 	- from tiffload.c
  * 27/1/17
  * 	- add get_flags for buffer loader
+ * 15/10/26
+ * 	- add @parallel
+ * 	- pass access to the reader for the shared tile cache
  */
 
 /*
@@ -81,6 +84,10 @@ typedef struct _VipsForeignLoadTiff {
 	 */
 	gboolean unlimited;
 
+	/* Decode pages in parallel.
+	 */
+	gboolean parallel;
+
 } VipsForeignLoadTiff;
 
 typedef VipsForeignLoadClass VipsForeignLoadTiffClass;
@@ -155,14 +162,29 @@ vips_foreign_load_tiff_load(VipsForeignLoad *load)
 {
 	VipsForeignLoadTiff *tiff = (VipsForeignLoadTiff *) load;
 
+	if (tiff->parallel &&
+		vips_image_get_page_height(load->out) < load->out->Ysize &&
+		vips__foreign_load_pages_can(load))
+		return vips__foreign_load_pages(load, load->real, 0, NULL);
+
 	if (vips__tiff_read_source(tiff->source, load->real,
 			tiff->page, tiff->n, tiff->autorotate, tiff->subifd,
-			load->fail_on, tiff->unlimited))
+			load->fail_on, tiff->unlimited, load->access))
 		return -1;
 
 	return 0;
 }
 
+/* Little and big endian, classic and BigTIFF.
+ */
+static const VipsForeignMagic vips_foreign_load_tiff_magic[] = {
+	{ 0, 4, "II\x2a\x00" },
+	{ 0, 4, "MM\x00\x2a" },
+	{ 0, 4, "II\x2b\x00" },
+	{ 0, 4, "MM\x00\x2b" },
+	{ 0, 0, NULL }
+};
+
 static void
 vips_foreign_load_tiff_class_init(VipsForeignLoadTiffClass *class)
 {
@@ -193,6 +215,7 @@ vips_foreign_load_tiff_class_init(VipsForeignLoadTiffClass *class)
 		vips_foreign_load_tiff_get_flags_filename;
 	load_class->get_flags = vips_foreign_load_tiff_get_flags;
 	load_class->header = vips_foreign_load_tiff_header;
+	load_class->magic = vips_foreign_load_tiff_magic;
 	load_class->load = vips_foreign_load_tiff_load;
 
 	VIPS_ARG_INT(class, "page", 20,
@@ -231,6 +254,13 @@ vips_foreign_load_tiff_class_init(VipsForeignLoadTiffClass *class)
 		G_STRUCT_OFFSET(VipsForeignLoadTiff, unlimited),
 		FALSE);
 #endif
+
+	VIPS_ARG_BOOL(class, "parallel", 25,
+		_("Parallel"),
+		_("Decode pages in parallel"),
+		VIPS_ARGUMENT_OPTIONAL_INPUT,
+		G_STRUCT_OFFSET(VipsForeignLoadTiff, parallel),
+		FALSE);
 }
 
 static void
@@ -510,6 +540,14 @@ vips_foreign_load_tiff_buffer_init(VipsForeignLoadTiffBuffer *buffer)
  * for decoding each input file to 50MB to prevent denial of service attacks.
  * Set @unlimited to remove this limit.
  *
+ * Set @parallel to decode pages in parallel when loading more than one.
+ * Each page is read by a separate loader, so this needs a file or memory
+ * source, and needs more memory.
+ *
+ * Random access loads of tiled files share a process-wide cache of decoded
+ * tiles, so many small loads from the same pyramid (for example, from a tile
+ * server) only decode each TIFF tile once.
+ *
  * Any ICC profile is read and attached to the VIPS image as
  * [const@META_ICC_NAME]. Any XMP metadata is read and attached to the image
  * as [const@META_XMP_NAME]. Any IPTC is attached as [const@META_IPTC_NAME]. The
@@ -525,6 +563,7 @@ vips_foreign_load_tiff_buffer_init(VipsForeignLoadTiffBuffer *buffer)
  *     * @subifd: `gint`, select this subifd index
  *     * @fail_on: [enum@FailOn], types of read error to fail on
  *     * @unlimited: `gboolean`, remove all denial of service limits
+ *     * @parallel: `gboolean`, decode pages in parallel
  *
  * ::: seealso
  *     [ctor@Image.new_from_file], [method@Image.autorot].
@@ -565,6 +604,7 @@ vips_tiffload(const char *filename, VipsImage **out, ...)
  *     * @subifd: `gint`, select this subifd index
  *     * @fail_on: [enum@FailOn], types of read error to fail on
  *     * @unlimited: `gboolean`, remove all denial of service limits
+ *     * @parallel: `gboolean`, decode pages in parallel
  *
  * ::: seealso
  *     [ctor@Image.tiffload].
@@ -607,6 +647,7 @@ vips_tiffload_buffer(void *buf, size_t len, VipsImage **out, ...)
  *     * @subifd: `gint`, select this subifd index
  *     * @fail_on: [enum@FailOn], types of read error to fail on
  *     * @unlimited: `gboolean`, remove all denial of service limits
+ *     * @parallel: `gboolean`, decode pages in parallel
  *
  * ::: seealso
  *     [ctor@Image.tiffload].
@@ -30,6 +30,9 @@
  * 	- add "premultiply" flag
  * 10/5/22
  * 	- add vips_tiffsave_target()
+ * 15/10/26
+ * 	- add "cog"
+ * 	- add bitdepth 16 for half float
  */
 
 /*
@@ -113,6 +116,7 @@ typedef struct _VipsForeignSaveTiff {
 	VipsForeignDzDepth depth;
 	gboolean subifd;
 	gboolean premultiply;
+	gboolean cog;
 
 } VipsForeignSaveTiff;
 
@@ -219,6 +223,7 @@ vips_foreign_save_tiff_build(VipsObject *object)
 			tiff->depth,
 			tiff->subifd,
 			tiff->premultiply,
+			tiff->cog,
 			save->page_height)) {
 		VIPS_UNREF(ready);
 		return -1;
@@ -313,10 +318,10 @@ vips_foreign_save_tiff_class_init(VipsForeignSaveTiffClass *class)
 
 	VIPS_ARG_INT(class, "bitdepth", 15,
 		_("Bit depth"),
-		_("Write as a 1, 2, 4 or 8 bit image"),
+		_("Write as a 1, 2, 4, 8 or 16 bit image"),
 		VIPS_ARGUMENT_OPTIONAL_INPUT,
 		G_STRUCT_OFFSET(VipsForeignSaveTiff, bitdepth),
-		0, 8, 0);
+		0, 16, 0);
 
 	VIPS_ARG_ENUM(class, "resunit", 16,
 		_("Resolution unit"),
@@ -408,6 +413,13 @@ vips_foreign_save_tiff_class_init(VipsForeignSaveTiffClass *class)
 		VIPS_ARGUMENT_OPTIONAL_INPUT | VIPS_ARGUMENT_DEPRECATED,
 		G_STRUCT_OFFSET(VipsForeignSaveTiff, squash),
 		FALSE);
+
+	VIPS_ARG_BOOL(class, "cog", 30,
+		_("COG"),
+		_("Write a cloud optimised GeoTIFF layout"),
+		VIPS_ARGUMENT_OPTIONAL_INPUT,
+		G_STRUCT_OFFSET(VipsForeignSaveTiff, cog),
+		FALSE);
 }
 
 static void
@@ -642,7 +654,8 @@ vips_foreign_save_tiff_buffer_init(VipsForeignSaveTiffBuffer *buffer)
  * tile. Use @depth to stop when the image fits in one pixel, or to only write
  * a single layer.
  *
- * Set @bitdepth to save 8-bit uchar images as 1, 2 or 4-bit TIFFs.
+ * Set @bitdepth to save 8-bit uchar images as 1, 2 or 4-bit TIFFs. Set it
+ * to 16 to save float images as 16-bit half float, halving the file size.
  *
  * In case of depth 1: Values >128 are written as white, values <=128 as black.
  * Normally vips will write MINISBLACK TIFFs where black is a 0 bit, but if you
@@ -685,6 +698,13 @@ vips_foreign_save_tiff_buffer_init(VipsForeignSaveTiffBuffer *buffer)
  * Set @premultiply to save with premultiplied alpha. Some programs, such as
  * InDesign, will only work with premultiplied alpha.
  *
+ * Set @cog to write a cloud optimised GeoTIFF (COG) layout. This turns on
+ * @pyramid, and writes all the IFDs and tile indexes at the front of the
+ * file, then the tiles, smallest overview first, so readers using HTTP range
+ * requests can fetch any area in a few reads. A GDAL-style "ghost area"
+ * after the header marks the layout. @cog can't be used with @subifd or
+ * with multi-page images.
+ *
  * ::: tip "Optional arguments"
  *     * @compression: [enum@ForeignTiffCompression], write with this
  *       compression
@@ -694,7 +714,7 @@ vips_foreign_save_tiff_buffer_init(VipsForeignSaveTiffBuffer *buffer)
  *     * @tile_width: `gint`, for tile size
  *     * @tile_height: `gint`, for tile size
  *     * @pyramid: `gboolean`, write an image pyramid
- *     * @bitdepth: `gint`, change bit depth to 1,2, or 4 bit
+ *     * @bitdepth: `gint`, change bit depth to 1, 2, 4 or 16 bit
  *     * @miniswhite: `gboolean`, write 1-bit images as MINISWHITE
  *     * @resunit: [enum@ForeignTiffResunit] for resolution unit
  *     * @xres: `gdouble`, horizontal resolution in pixels/mm
@@ -707,6 +727,7 @@ vips_foreign_save_tiff_buffer_init(VipsForeignSaveTiffBuffer *buffer)
  *     * @depth: [enum@ForeignDzDepth] how deep to make the pyramid
  *     * @subifd: `gboolean`, write pyr layers as sub-ifds
  *     * @premultiply: `gboolean`, write premultiplied alpha
+ *     * @cog: `gboolean`, write a cloud optimised layout
  *
  * ::: seealso
  *     [ctor@Image.tiffload], [method@Image.write_to_file].
@@ -748,7 +769,7 @@ vips_tiffsave(VipsImage *in, const char *filename, ...)
  *     * @tile_width: `gint`, for tile size
  *     * @tile_height: `gint`, for tile size
  *     * @pyramid: `gboolean`, write an image pyramid
- *     * @bitdepth: `gint`, change bit depth to 1,2, or 4 bit
+ *     * @bitdepth: `gint`, change bit depth to 1, 2, 4 or 16 bit
  *     * @miniswhite: `gboolean`, write 1-bit images as MINISWHITE
  *     * @resunit: [enum@ForeignTiffResunit] for resolution unit
  *     * @xres: `gdouble`, horizontal resolution in pixels/mm
@@ -761,6 +782,7 @@ vips_tiffsave(VipsImage *in, const char *filename, ...)
  *     * @depth: [enum@ForeignDzDepth] how deep to make the pyramid
  *     * @subifd: `gboolean`, write pyr layers as sub-ifds
  *     * @premultiply: `gboolean`, write premultiplied alpha
+ *     * @cog: `gboolean`, write a cloud optimised layout
  *
  * ::: seealso
  *     [method@Image.tiffsave], [method@Image.write_to_file].
@@ -812,7 +834,7 @@ vips_tiffsave_buffer(VipsImage *in, void **buf, size_t *len, ...)
  *     * @tile_width: `gint`, for tile size
  *     * @tile_height: `gint`, for tile size
  *     * @pyramid: `gboolean`, write an image pyramid
- *     * @bitdepth: `gint`, change bit depth to 1,2, or 4 bit
+ *     * @bitdepth: `gint`, change bit depth to 1, 2, 4 or 16 bit
  *     * @miniswhite: `gboolean`, write 1-bit images as MINISWHITE
  *     * @resunit: [enum@ForeignTiffResunit] for resolution unit
  *     * @xres: `gdouble`, horizontal resolution in pixels/mm
@@ -825,6 +847,7 @@ vips_tiffsave_buffer(VipsImage *in, void **buf, size_t *len, ...)
  *     * @depth: [enum@ForeignDzDepth] how deep to make the pyramid
  *     * @subifd: `gboolean`, write pyr layers as sub-ifds
  *     * @premultiply: `gboolean`, write premultiplied alpha
+ *     * @cog: `gboolean`, write a cloud optimised layout
  *
  * ::: seealso
  *     [method@Image.tiffsave], [method@Image.write_to_target].
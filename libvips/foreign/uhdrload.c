@@ -103,7 +103,7 @@ vips_foreign_load_uhdr_is_a(VipsSource *source)
 	VipsImage *context = vips_image_new();
 
 	ReadJpeg *jpeg;
-	if (!(jpeg = vips__readjpeg_new(source, context, 1, VIPS_FAIL_ON_NONE,
+	if (!(jpeg = vips__readjpeg_new(source, context, 8, VIPS_FAIL_ON_NONE,
 			  FALSE, FALSE))) {
 		VIPS_UNREF(context);
 		return 0;
@@ -583,6 +583,13 @@ vips_foreign_load_uhdr_load(VipsForeignLoad *load)
 	return 0;
 }
 
+/* Ultra HDR is JPEG with a gainmap.
+ */
+static const VipsForeignMagic vips_foreign_load_uhdr_magic[] = {
+	{ 0, 2, "\xff\xd8" },
+	{ 0, 0, NULL }
+};
+
 static void
 vips_foreign_load_uhdr_class_init(VipsForeignLoadUhdrClass *class)
 {
@@ -605,6 +612,7 @@ vips_foreign_load_uhdr_class_init(VipsForeignLoadUhdrClass *class)
 
 	load_class->get_flags = vips_foreign_load_uhdr_get_flags;
 	load_class->header = vips_foreign_load_uhdr_header;
+	load_class->magic = vips_foreign_load_uhdr_magic;
 	load_class->load = vips_foreign_load_uhdr_load;
 
 	VIPS_ARG_INT(class, "shrink", 11,
@@ -0,0 +1,305 @@
+/* a pdfium render process for pdfiumload
+ *
+ * libvips starts a set of these when VIPS_PDFIUM_WORKERS is set. Each
+ * reads render requests from a socket on stdin, renders with pdfium into
+ * a shared buffer, and replies with a status. A crash here only loses
+ * this process.
+ *
+ * 15/10/26
+ * 	- from pdfiumload.c
+ */
+
+/*
+
+	This file is part of VIPS.
+
+	VIPS is free software; you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+	02110-1301  USA
+
+ */
+
+/*
+
+	These files are distributed with VIPS - http://www.vips.ecs.soton.ac.uk
+
+ */
+
+/*
+#define DEBUG
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+
+#include <vips/vips.h>
+
+#define VIPS_PDFIUM_WORKER_MAIN
+#include "pdfiumworker.h"
+
+#include <fpdfview.h>
+#include <fpdf_doc.h>
+#include <fpdf_edit.h>
+#include <fpdf_formfill.h>
+#include <fpdf_transformpage.h>
+
+/* The document and page we have open.
+ */
+static guint64 doc_serial = 0;
+static void *doc_data = NULL;
+static size_t doc_length = 0;
+static FPDF_DOCUMENT doc = NULL;
+static FPDF_FORMFILLINFO form_callbacks;
+static FPDF_FORMHANDLE form = NULL;
+static FPDF_PAGE page = NULL;
+static int page_no = -1;
+
+/* The shared output buffer.
+ */
+static VipsPel *out = NULL;
+
+static void
+close_doc(void)
+{
+	if (page) {
+		FPDF_ClosePage(page);
+		page = NULL;
+	}
+	page_no = -1;
+
+	if (form) {
+		FPDFDOC_ExitFormFillEnvironment(form);
+		form = NULL;
+	}
+
+	if (doc) {
+		FPDF_CloseDocument(doc);
+		doc = NULL;
+	}
+
+	if (doc_data) {
+		munmap(doc_data, doc_length);
+		doc_data = NULL;
+	}
+
+	doc_serial = 0;
+}
+
+static int
+open_doc(VipsPdfiumWorkerRequest *request, int fd)
+{
+	close_doc();
+
+	doc_length = request->doc_length;
+	if ((doc_data = mmap(NULL, doc_length,
+			 PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+		doc_data = NULL;
+		return -1;
+	}
+
+	request->password[VIPS_PDFIUM_WORKER_PASSWORD_MAX - 1] = '\0';
+	if (!(doc = FPDF_LoadMemDocument(doc_data, doc_length,
+			  request->password[0] ? request->password : NULL)))
+		return -1;
+
+	form_callbacks.version = 2;
+	if (!(form = FPDFDOC_InitFormFillEnvironment(doc, &form_callbacks)))
+		return -1;
+
+	doc_serial = request->doc_serial;
+
+	return 0;
+}
+
+/* As vips_foreign_load_pdf_apply_page_box().
+ */
+static void
+apply_page_box(FPDF_PAGE page, VipsForeignPdfPageBox box)
+{
+	float left, bottom, right, top;
+	FPDF_BOOL found;
+
+	switch (box) {
+	case VIPS_FOREIGN_PDF_PAGE_BOX_MEDIA:
+		found = FPDFPage_GetMediaBox(page, &left, &bottom, &right, &top);
+		break;
+	case VIPS_FOREIGN_PDF_PAGE_BOX_TRIM:
+		found = FPDFPage_GetTrimBox(page, &left, &bottom, &right, &top);
+		break;
+	case VIPS_FOREIGN_PDF_PAGE_BOX_BLEED:
+		found = FPDFPage_GetBleedBox(page, &left, &bottom, &right, &top);
+		break;
+	case VIPS_FOREIGN_PDF_PAGE_BOX_ART:
+		found = FPDFPage_GetArtBox(page, &left, &bottom, &right, &top);
+		break;
+	case VIPS_FOREIGN_PDF_PAGE_BOX_CROP:
+	default:
+		found = FALSE;
+		break;
+	}
+
+	if (found)
+		FPDFPage_SetCropBox(page, left, bottom, right, top);
+}
+
+static int
+render(VipsPdfiumWorkerRequest *request)
+{
+	FPDF_BITMAP bitmap;
+
+	if (page_no != request->page_no) {
+		if (page) {
+			FPDF_ClosePage(page);
+			page = NULL;
+		}
+		page_no = -1;
+
+		if (!(page = FPDF_LoadPage(doc, request->page_no)))
+			return -1;
+		page_no = request->page_no;
+
+		apply_page_box(page, request->page_box);
+	}
+
+	bitmap = FPDFBitmap_CreateEx(request->width, request->height, 4,
+		out, request->width * 4);
+
+	/* Only paint the background if there's no transparency.
+	 */
+	if (FPDFPage_HasTransparency(page))
+		memset(out, 0, (size_t) request->width * request->height * 4);
+	else
+		FPDFBitmap_FillRect(bitmap,
+			0, 0, request->width, request->height, request->ink);
+
+	FPDF_RenderPageBitmap(bitmap, page,
+		request->page_left, request->page_top,
+		request->page_width, request->page_height,
+		0, FPDF_ANNOT | FPDF_REVERSE_BYTE_ORDER);
+
+	FPDF_FFLDraw(form, bitmap, page,
+		request->page_left, request->page_top,
+		request->page_width, request->page_height,
+		0, FPDF_ANNOT | FPDF_REVERSE_BYTE_ORDER);
+
+	FPDFBitmap_Destroy(bitmap);
+
+	return 0;
+}
+
+/* Read a request and its two fds. Return -1 for EOF or error.
+ */
+static int
+receive(VipsPdfiumWorkerRequest *request, int *doc_fd, int *out_fd)
+{
+	struct msghdr msg = { 0 };
+	struct iovec iov;
+	union {
+		char buf[CMSG_SPACE(2 * sizeof(int))];
+		struct cmsghdr align;
+	} control;
+	struct cmsghdr *cmsg;
+	int fds[2];
+	ssize_t n;
+
+	iov.iov_base = request;
+	iov.iov_len = sizeof(VipsPdfiumWorkerRequest);
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control.buf;
+	msg.msg_controllen = sizeof(control.buf);
+
+	do
+		n = recvmsg(0, &msg, MSG_WAITALL | MSG_CMSG_CLOEXEC);
+	while (n < 0 && errno == EINTR);
+
+	if (n != (ssize_t) sizeof(VipsPdfiumWorkerRequest))
+		return -1;
+
+	if (!(cmsg = CMSG_FIRSTHDR(&msg)) ||
+		cmsg->cmsg_level != SOL_SOCKET ||
+		cmsg->cmsg_type != SCM_RIGHTS ||
+		cmsg->cmsg_len != CMSG_LEN(2 * sizeof(int)))
+		return -1;
+
+	memcpy(fds, CMSG_DATA(cmsg), 2 * sizeof(int));
+	*doc_fd = fds[0];
+	*out_fd = fds[1];
+
+	return 0;
+}
+
+int
+main(int argc, char **argv)
+{
+	FPDF_LIBRARY_CONFIG config;
+	VipsPdfiumWorkerRequest request;
+	VipsPdfiumWorkerReply reply;
+	int doc_fd;
+	int out_fd;
+
+	config.version = 2;
+	config.m_pUserFontPaths = NULL;
+	config.m_pIsolate = NULL;
+	config.m_v8EmbedderSlot = 0;
+	FPDF_InitLibraryWithConfig(&config);
+
+	while (!receive(&request, &doc_fd, &out_fd)) {
+		/* The output buffer is the same for every request, so we only
+		 * need to map it once.
+		 */
+		if (!out &&
+			(out = mmap(NULL, (size_t) 4 * VIPS_PDFIUM_WORKER_MAX_PELS,
+				 PROT_READ | PROT_WRITE, MAP_SHARED,
+				 out_fd, 0)) == MAP_FAILED)
+			break;
+		close(out_fd);
+
+		reply.result = 0;
+		reply.error = 0;
+
+		if (request.width <= 0 ||
+			request.height <= 0 ||
+			(gint64) request.width * request.height >
+				VIPS_PDFIUM_WORKER_MAX_PELS)
+			reply.result = -1;
+		else if ((doc_serial != request.doc_serial &&
+					 open_doc(&request, doc_fd)) ||
+			render(&request)) {
+			reply.result = -1;
+			reply.error = FPDF_GetLastError();
+			close_doc();
+		}
+
+		close(doc_fd);
+
+#ifdef DEBUG
+		fprintf(stderr, "vips-pdfium-worker: page %d, %d x %d, result %d\n",
+			request.page_no, request.width, request.height, reply.result);
+#endif /*DEBUG*/
+
+		if (write(0, &reply, sizeof(reply)) != sizeof(reply))
+			break;
+	}
+
+	close_doc();
+	FPDF_DestroyLibrary();
+
+	return 0;
+}
@@ -100,6 +100,10 @@
  *	- add restart_interval
  * 21/10/21 usualuse
  *	- raise single-chunk limit on APP to 65533
+ * 14/10/26
+ *	- compress baseline images in parallel bands split by restart markers
+ * 15/10/26
+ *	- add vips__jpeg_transform_target() for lossless rotate, flip and crop
  */
 
 /*
@@ -723,6 +727,11 @@ write_metadata(Write *write, VipsImage *in,
 	return 0;
 }
 
+static int write_vips_parallel(Write *write, VipsImage *in,
+	int Q, const char *profile,
+	gboolean overshoot_deringing, int quant_table,
+	VipsForeignSubsample subsample_mode, int restart_interval);
+
 /* Write a VIPS image to a JPEG compress struct.
  */
 static int
@@ -753,6 +762,23 @@ write_vips(Write *write, VipsImage *in, int Q, const char *profile,
 		 */
 		write->invert = TRUE;
 
+	/* Baseline images with fixed Huffman tables and restart markers can be
+	 * compressed in parallel bands.
+	 */
+	if (!write->cinfo.optimize_coding &&
+		!write->cinfo.arith_code &&
+		!progressive &&
+		!optimize_scans) {
+		int result = write_vips_parallel(write, in, Q, profile,
+			overshoot_deringing, quant_table,
+			subsample_mode, restart_interval);
+
+		/* 1 means not parallel, fall back to a serial write.
+		 */
+		if (result <= 0)
+			return result;
+	}
+
 	/* Build VIPS output stuff now we know the image we'll be writing.
 	 */
 	if (!(write->row_pointer = VIPS_ARRAY(NULL, in->Ysize, JSAMPROW)))
@@ -865,6 +891,417 @@ vips__jpeg_target_dest(j_compress_ptr cinfo, VipsTarget *target)
 	dest->target = target;
 }
 
+/* Bands should be about this many scanlines high.
+ */
+#define BAND_HEIGHT (256)
+
+/* Compress bands of a baseline image on many threads, then stitch them
+ * together with restart markers. Since each restart interval is coded
+ * independently, and bands always end on an interval, the result is
+ * identical to a serial encode with the same restart interval.
+ */
+typedef struct _WriteParallel {
+	Write *write;
+	VipsImage *in;
+
+	/* Compression settings for the band encoders.
+	 */
+	int Q;
+	gboolean overshoot_deringing;
+	int quant_table;
+	VipsForeignSubsample subsample_mode;
+	int restart_interval;
+
+	/* Band geometry.
+	 */
+	int mcus_per_row;
+	int mcu_height;
+	int band_height;
+	int n_bands;
+
+	/* The next band to allocate.
+	 */
+	int next_band;
+
+	/* Compressed bands waiting to be written, and the next band we
+	 * write. Protected by lock.
+	 */
+	GMutex lock;
+	VipsPel **band;
+	size_t *band_length;
+	int write_band;
+} WriteParallel;
+
+static guint64
+write_parallel_gcd(guint64 a, guint64 b)
+{
+	while (b) {
+		guint64 t = a % b;
+
+		a = b;
+		b = t;
+	}
+
+	return a;
+}
+
+/* Find the frame header (after any APPn from libjpeg), the SOF marker and the
+ * start of the entropy coded data in a band.
+ */
+static int
+write_parallel_parse(const VipsPel *buf, size_t length,
+	size_t *header_start, size_t *sof_offset, size_t *scan_start)
+{
+	size_t p;
+
+	*header_start = 0;
+	*sof_offset = 0;
+	p = 2;
+	while (p + 4 <= length) {
+		int marker = buf[p + 1];
+		size_t end = p + 2 + ((buf[p + 2] << 8) | buf[p + 3]);
+
+		if (buf[p] != 0xff ||
+			end > length)
+			break;
+
+		if (!*header_start &&
+			(marker < JPEG_APP0 || marker > JPEG_APP0 + 15))
+			*header_start = p;
+
+		if (marker >= 0xc0 &&
+			marker <= 0xc3)
+			*sof_offset = p;
+
+		if (marker == 0xda) {
+			*scan_start = end;
+
+			return *header_start && *sof_offset ? 0 : -1;
+		}
+
+		p = end;
+	}
+
+	return -1;
+}
+
+/* Renumber the restart markers in a band, starting from interval first.
+ */
+static void
+write_parallel_renumber(VipsPel *data, size_t length, int first)
+{
+	VipsPel *end = data + length;
+	VipsPel *p;
+	int i;
+
+	i = first;
+	for (p = data; (p = memchr(p, 0xff, end - p)) && p + 1 < end; p++)
+		if (p[1] >= JPEG_RST0 &&
+			p[1] <= JPEG_RST0 + 7) {
+			p[1] = JPEG_RST0 + (i & 7);
+			i += 1;
+		}
+}
+
+/* Write any bands which are ready, in order. The lock must be held.
+ */
+static int
+write_parallel_flush(WriteParallel *parallel)
+{
+	VipsTarget *target = ((Dest *) parallel->write->cinfo.dest)->target;
+	int intervals_per_band = (guint64) parallel->band_height /
+		parallel->mcu_height * parallel->mcus_per_row /
+		parallel->restart_interval;
+
+	while (parallel->write_band < parallel->n_bands &&
+		parallel->band[parallel->write_band]) {
+		int i = parallel->write_band;
+		VipsPel *buf = parallel->band[i];
+		size_t length = parallel->band_length[i];
+		int first = i * intervals_per_band;
+
+		size_t header_start;
+		size_t sof_offset;
+		size_t scan_start;
+
+		if (write_parallel_parse(buf, length,
+				&header_start, &sof_offset, &scan_start) ||
+			length < scan_start + 2) {
+			vips_error("vips2jpeg", "%s", _("bad band"));
+			return -1;
+		}
+
+		/* The first band supplies the frame and scan headers, with the
+		 * full image height.
+		 */
+		if (i == 0) {
+			buf[sof_offset + 5] = parallel->in->Ysize >> 8;
+			buf[sof_offset + 6] = parallel->in->Ysize & 0xff;
+
+			if (vips_target_write(target,
+					buf + header_start, scan_start - header_start))
+				return -1;
+		}
+
+		/* Drop the EOI, and separate bands with a restart marker.
+		 */
+		if (first & 7)
+			write_parallel_renumber(buf + scan_start,
+				length - 2 - scan_start, first);
+		if (vips_target_write(target,
+				buf + scan_start, length - 2 - scan_start))
+			return -1;
+
+		if (i < parallel->n_bands - 1) {
+			int next = (i + 1) * intervals_per_band;
+			VipsPel marker[2] = { 0xff, JPEG_RST0 + ((next - 1) & 7) };
+
+			if (vips_target_write(target, marker, 2))
+				return -1;
+		}
+
+		VIPS_FREE(parallel->band[i]);
+		parallel->write_band += 1;
+	}
+
+	return 0;
+}
+
+static int
+write_parallel_allocate(VipsThreadState *state, void *a, gboolean *stop)
+{
+	WriteParallel *parallel = (WriteParallel *) a;
+	VipsImage *in = parallel->in;
+
+	if (parallel->next_band >= parallel->n_bands) {
+		*stop = TRUE;
+		return 0;
+	}
+
+	state->pos.left = 0;
+	state->pos.top = parallel->next_band * parallel->band_height;
+	state->pos.width = in->Xsize;
+	state->pos.height = VIPS_MIN(parallel->band_height,
+		in->Ysize - state->pos.top);
+	parallel->next_band += 1;
+
+	return 0;
+}
+
+/* Compress a band to a complete JPEG in memory.
+ */
+static VipsPel *
+write_parallel_band(WriteParallel *parallel, VipsRegion *region,
+	VipsRect *area, size_t *length)
+{
+	VipsTarget *target;
+	Write *write;
+	VipsPel *buf;
+
+	if (!(target = vips_target_new_to_memory()))
+		return NULL;
+	if (!(write = write_new())) {
+		VIPS_UNREF(target);
+		return NULL;
+	}
+
+	if (setjmp(write->eman.jmp)) {
+		write_destroy(write);
+		VIPS_UNREF(target);
+		return NULL;
+	}
+
+	jpeg_create_compress(&write->cinfo);
+	vips__jpeg_target_dest(&write->cinfo, target);
+	set_cinfo(&write->cinfo, parallel->in, area->width, area->height,
+		parallel->Q, FALSE, FALSE,
+		FALSE, parallel->overshoot_deringing, FALSE,
+		parallel->quant_table, parallel->subsample_mode,
+		parallel->restart_interval);
+	write->invert = parallel->write->invert;
+	if (!(write->row_pointer = VIPS_ARRAY(NULL, area->height, JSAMPROW))) {
+		write_destroy(write);
+		VIPS_UNREF(target);
+		return NULL;
+	}
+
+	jpeg_start_compress(&write->cinfo, TRUE);
+
+	if (write_jpeg_block(region, area, write)) {
+		write_destroy(write);
+		VIPS_UNREF(target);
+		return NULL;
+	}
+
+	if (setjmp(write->eman.jmp)) {
+		write_destroy(write);
+		VIPS_UNREF(target);
+		return NULL;
+	}
+
+	jpeg_finish_compress(&write->cinfo);
+	write_destroy(write);
+
+	buf = vips_target_steal(target, length);
+	VIPS_UNREF(target);
+
+	return buf;
+}
+
+static int
+write_parallel_work(VipsThreadState *state, void *a)
+{
+	WriteParallel *parallel = (WriteParallel *) a;
+	int i = state->pos.top / parallel->band_height;
+
+	VipsPel *buf;
+	size_t length;
+	int result;
+
+	if (vips_region_prepare(state->reg, &state->pos) ||
+		!(buf = write_parallel_band(parallel,
+			  state->reg, &state->pos, &length)))
+		return -1;
+
+	vips__worker_lock(&parallel->lock);
+
+	parallel->band[i] = buf;
+	parallel->band_length[i] = length;
+	result = write_parallel_flush(parallel);
+
+	g_mutex_unlock(&parallel->lock);
+
+	return result;
+}
+
+static int
+write_parallel_progress(void *a)
+{
+	WriteParallel *parallel = (WriteParallel *) a;
+	VipsImage *in = parallel->in;
+
+	vips_image_eval(in, (guint64) in->Xsize *
+			VIPS_MIN(in->Ysize,
+				parallel->write_band * parallel->band_height));
+	if (vips_image_iskilled(in))
+		return -1;
+
+	return 0;
+}
+
+/* Return 1 if we can't write this image in parallel, and the caller should
+ * write serially.
+ */
+static int
+write_vips_parallel(Write *write, VipsImage *in,
+	int Q, const char *profile,
+	gboolean overshoot_deringing, int quant_table,
+	VipsForeignSubsample subsample_mode, int restart_interval)
+{
+	struct jpeg_compress_struct *cinfo = &write->cinfo;
+
+	WriteParallel parallel = { 0 };
+	int mcu_width;
+	int mcu_rows;
+	int band_rows;
+	int boundary_rows;
+	int result;
+
+	/* We can only join bands at restart markers, and we must not add
+	 * markers the caller did not ask for.
+	 */
+	if (restart_interval <= 0)
+		return 1;
+
+	/* A single component scan is not interleaved, so MCUs are always one
+	 * block.
+	 */
+	mcu_width = DCTSIZE;
+	parallel.mcu_height = DCTSIZE;
+	if (cinfo->num_components > 1)
+		for (int i = 0; i < cinfo->num_components; i++) {
+			jpeg_component_info *comp = &cinfo->comp_info[i];
+
+			mcu_width = VIPS_MAX(mcu_width,
+				comp->h_samp_factor * DCTSIZE);
+			parallel.mcu_height = VIPS_MAX(parallel.mcu_height,
+				comp->v_samp_factor * DCTSIZE);
+		}
+	parallel.mcus_per_row = VIPS_ROUND_UP(in->Xsize, mcu_width) / mcu_width;
+	mcu_rows = VIPS_ROUND_UP(in->Ysize, parallel.mcu_height) /
+		parallel.mcu_height;
+
+	/* Bands must end on an interval.
+	 */
+	boundary_rows = restart_interval /
+		write_parallel_gcd(parallel.mcus_per_row, restart_interval);
+	if (boundary_rows * parallel.mcu_height > 16 * BAND_HEIGHT)
+		return 1;
+	band_rows = VIPS_MAX(1, BAND_HEIGHT / parallel.mcu_height);
+	band_rows = VIPS_ROUND_UP(band_rows, boundary_rows);
+	parallel.restart_interval = restart_interval;
+
+	parallel.band_height = band_rows * parallel.mcu_height;
+	parallel.n_bands = VIPS_ROUND_UP(mcu_rows, band_rows) / band_rows;
+	if (parallel.n_bands < 2)
+		return 1;
+
+#ifdef DEBUG
+	printf("write_vips_parallel: %d bands, restart interval %d\n",
+		parallel.n_bands, parallel.restart_interval);
+#endif /*DEBUG*/
+
+	parallel.write = write;
+	parallel.in = in;
+	parallel.Q = Q;
+	parallel.overshoot_deringing = overshoot_deringing;
+	parallel.quant_table = quant_table;
+	parallel.subsample_mode = subsample_mode;
+
+	/* SOI, JFIF or Adobe, then our metadata, then flush and abort. The
+	 * frame and scan headers come from the first band.
+	 */
+	jpeg_start_compress(cinfo, TRUE);
+	if (write_metadata(write, in, profile))
+		return -1;
+	term_destination(cinfo);
+	jpeg_abort_compress(cinfo);
+
+	g_mutex_init(&parallel.lock);
+	parallel.band = VIPS_ARRAY(NULL, parallel.n_bands, VipsPel *);
+	parallel.band_length = VIPS_ARRAY(NULL, parallel.n_bands, size_t);
+	memset(parallel.band, 0, parallel.n_bands * sizeof(VipsPel *));
+
+	vips_image_preeval(in);
+
+	result = vips_threadpool_run(in,
+		vips_thread_state_new,
+		write_parallel_allocate,
+		write_parallel_work,
+		write_parallel_progress,
+		&parallel);
+
+	vips_image_posteval(in);
+
+	if (!result &&
+		parallel.write_band == parallel.n_bands) {
+		VipsTarget *target = ((Dest *) cinfo->dest)->target;
+		VipsPel eoi[2] = { 0xff, JPEG_EOI };
+
+		result = vips_target_write(target, eoi, 2);
+	}
+	else
+		result = -1;
+
+	for (int i = 0; i < parallel.n_bands; i++)
+		VIPS_FREE(parallel.band[i]);
+	VIPS_FREE(parallel.band);
+	VIPS_FREE(parallel.band_length);
+	g_mutex_clear(&parallel.lock);
+
+	return result;
+}
+
 int
 vips__jpeg_write_target(VipsImage *in, VipsTarget *target,
 	int Q, const char *profile,
@@ -911,6 +1348,320 @@ vips__jpeg_write_target(VipsImage *in, VipsTarget *target,
 	return 0;
 }
 
+/* Copy one block of DCT coefficients, transposing and flipping as we go.
+ * Flipping pixels horizontally negates the odd horizontal frequencies,
+ * flipping vertically negates the odd vertical frequencies.
+ */
+static void
+transform_block(JCOEFPTR out, JCOEFPTR in,
+	gboolean transpose, gboolean flip_x, gboolean flip_y)
+{
+	for (int v = 0; v < DCTSIZE; v++)
+		for (int u = 0; u < DCTSIZE; u++) {
+			JCOEF c = transpose
+				? in[u * DCTSIZE + v]
+				: in[v * DCTSIZE + u];
+
+			if ((flip_x && (u & 1)) ^ (flip_y && (v & 1)))
+				c = -c;
+
+			out[v * DCTSIZE + u] = c;
+		}
+}
+
+/* Transform the coefficients of a JPEG. Return 1 if we can't do this
+ * transform without decoding.
+ */
+static int
+transform_coefficients(ReadJpeg *jpeg, Write *write, VipsImage *meta,
+	gboolean transpose, gboolean flip_x, gboolean flip_y,
+	gboolean trim, VipsRect *crop, VipsForeignKeep keep)
+{
+	struct jpeg_decompress_struct *src = &jpeg->cinfo;
+	struct jpeg_compress_struct *dst = &write->cinfo;
+
+	jvirt_barray_ptr dst_coef[MAX_COMPONENTS];
+	jvirt_barray_ptr *src_coef;
+
+	if (vips__readjpeg_open_input(jpeg))
+		return -1;
+
+	/* Metadata comes from @meta, so we don't need to save markers.
+	 */
+	jpeg_read_header(src, TRUE);
+
+	if (src->num_components > MAX_COMPONENTS)
+		return 1;
+	for (int ci = 0; ci < src->num_components; ci++) {
+		jpeg_component_info *comp = &src->comp_info[ci];
+
+		if (src->max_h_samp_factor % comp->h_samp_factor ||
+			src->max_v_samp_factor % comp->v_samp_factor)
+			return 1;
+	}
+
+	/* Flips in the output move blocks along source x or y. That's only
+	 * lossless if there are no partial MCUs along that edge, or if we
+	 * can trim them off.
+	 */
+	int mcu_width = src->max_h_samp_factor * DCTSIZE;
+	int mcu_height = src->max_v_samp_factor * DCTSIZE;
+	gboolean flip_src_x = transpose ? flip_y : flip_x;
+	gboolean flip_src_y = transpose ? flip_x : flip_y;
+	int width = src->image_width;
+	int height = src->image_height;
+
+	if (flip_src_x &&
+		width % mcu_width) {
+		if (!trim)
+			return 1;
+		width -= width % mcu_width;
+	}
+	if (flip_src_y &&
+		height % mcu_height) {
+		if (!trim)
+			return 1;
+		height -= height % mcu_height;
+	}
+	if (width == 0 ||
+		height == 0)
+		return 1;
+
+	/* Transformed geometry.
+	 */
+	int out_width = transpose ? height : width;
+	int out_height = transpose ? width : height;
+	int out_max_h = transpose
+		? src->max_v_samp_factor
+		: src->max_h_samp_factor;
+	int out_max_v = transpose
+		? src->max_h_samp_factor
+		: src->max_v_samp_factor;
+
+	/* Width and height <= 0 mean to the edge.
+	 */
+	VipsRect whole = { 0, 0, out_width, out_height };
+	VipsRect area = *crop;
+	if (area.width <= 0)
+		area.width = out_width - area.left;
+	if (area.height <= 0)
+		area.height = out_height - area.top;
+	if (vips_rect_isempty(&area) ||
+		!vips_rect_includesrect(&whole, &area)) {
+		vips_error("jpegtran", "%s", _("bad crop area"));
+		return -1;
+	}
+
+	/* Crops must start on an MCU boundary.
+	 */
+	if (area.left % (out_max_h * DCTSIZE) ||
+		area.top % (out_max_v * DCTSIZE))
+		return 1;
+
+	/* Output arrays must be requested before we read the coefficients.
+	 * The compressor reads v_samp_factor rows at a time.
+	 */
+	for (int ci = 0; ci < src->num_components; ci++) {
+		jpeg_component_info *comp = &src->comp_info[ci];
+		int h = transpose ? comp->v_samp_factor : comp->h_samp_factor;
+		int v = transpose ? comp->h_samp_factor : comp->v_samp_factor;
+		int blocks_across = VIPS_ROUND_UP(area.width * h,
+								out_max_h * DCTSIZE) /
+			(out_max_h * DCTSIZE);
+		int blocks_down = VIPS_ROUND_UP(area.height * v,
+							  out_max_v * DCTSIZE) /
+			(out_max_v * DCTSIZE);
+
+		dst_coef[ci] = (*src->mem->request_virt_barray)((j_common_ptr) src,
+			JPOOL_IMAGE, TRUE,
+			VIPS_ROUND_UP(blocks_across, h),
+			VIPS_ROUND_UP(blocks_down, v),
+			v);
+	}
+
+	src_coef = jpeg_read_coefficients(src);
+
+	for (int ci = 0; ci < src->num_components; ci++) {
+		jpeg_component_info *comp = &src->comp_info[ci];
+		int h = transpose ? comp->v_samp_factor : comp->h_samp_factor;
+		int v = transpose ? comp->h_samp_factor : comp->v_samp_factor;
+
+		/* Size of one block of this component in output pixels.
+		 */
+		int block_width = out_max_h * DCTSIZE / h;
+		int block_height = out_max_v * DCTSIZE / v;
+
+		/* The crop origin and the transformed image size, in blocks. The
+		 * size is exact along any axis we flip.
+		 */
+		int left = area.left / block_width;
+		int top = area.top / block_height;
+		int blocks_across = out_width / block_width;
+		int blocks_down = out_height / block_height;
+
+		int dst_across = VIPS_ROUND_UP(
+			VIPS_ROUND_UP(area.width, block_width) / block_width, h);
+		int dst_down = VIPS_ROUND_UP(
+			VIPS_ROUND_UP(area.height, block_height) / block_height, v);
+
+		for (int by = 0; by < dst_down; by++) {
+			JBLOCKARRAY out = (*src->mem->access_virt_barray)(
+				(j_common_ptr) src, dst_coef[ci], by, 1, TRUE);
+
+			for (int bx = 0; bx < dst_across; bx++) {
+				int tx = bx + left;
+				int ty = by + top;
+
+				if (flip_x)
+					tx = blocks_across - 1 - tx;
+				if (flip_y)
+					ty = blocks_down - 1 - ty;
+
+				int sx = transpose ? ty : tx;
+				int sy = transpose ? tx : ty;
+
+				/* Padding blocks can fall outside the source. The
+				 * array is pre-zeroed, so just skip them.
+				 */
+				if (sx < 0 ||
+					sy < 0 ||
+					sx >= (int) comp->width_in_blocks ||
+					sy >= (int) comp->height_in_blocks)
+					continue;
+
+				JBLOCKARRAY in = (*src->mem->access_virt_barray)(
+					(j_common_ptr) src, src_coef[ci], sy, 1, FALSE);
+
+				transform_block(out[0][bx], in[0][sx],
+					transpose, flip_x, flip_y);
+			}
+		}
+	}
+
+	/* Set up the output with the same quantisation and sampling.
+	 * Coefficients are transposed, so the tables and sampling factors
+	 * must be too.
+	 */
+	jpeg_copy_critical_parameters(src, dst);
+	dst->image_width = area.width;
+	dst->image_height = area.height;
+	if (transpose) {
+		for (int ci = 0; ci < dst->num_components; ci++) {
+			jpeg_component_info *comp = &dst->comp_info[ci];
+
+			VIPS_SWAP(int, comp->h_samp_factor, comp->v_samp_factor);
+		}
+
+		for (int i = 0; i < NUM_QUANT_TBLS; i++) {
+			JQUANT_TBL *table = dst->quant_tbl_ptrs[i];
+
+			if (table)
+				for (int v = 0; v < DCTSIZE; v++)
+					for (int u = v + 1; u < DCTSIZE; u++)
+						VIPS_SWAP(UINT16,
+							table->quantval[v * DCTSIZE + u],
+							table->quantval[u * DCTSIZE + v]);
+		}
+	}
+
+	/* Huffman optimisation is lossless and cheap here.
+	 */
+	dst->optimize_coding = TRUE;
+	if (src->progressive_mode)
+		jpeg_simple_progression(dst);
+
+	/* Update the metadata for the new geometry.
+	 */
+	meta->Xsize = area.width;
+	meta->Ysize = area.height;
+	if (transpose)
+		VIPS_SWAP(double, meta->Xres, meta->Yres);
+	if (vips__foreign_update_metadata(meta, keep))
+		return -1;
+
+	/* As set_cinfo(), only write JFIF if we have no EXIF.
+	 */
+	dst->write_JFIF_header = FALSE;
+#ifndef HAVE_EXIF
+	vips_jfif_resolution_from_image(dst, meta);
+	dst->write_JFIF_header = TRUE;
+#endif /*HAVE_EXIF*/
+
+	jpeg_write_coefficients(dst, dst_coef);
+
+	if (write_metadata(write, meta, NULL))
+		return -1;
+
+	jpeg_finish_compress(dst);
+
+	return 0;
+}
+
+/* Rotate, flip and crop a JPEG without decoding, like jpegtran. The
+ * transform is a transpose, then flips, all in output coordinates. @meta is
+ * the header of @source, and is updated for the new geometry.
+ *
+ * Return 1 if the transform can't be done losslessly, for example if
+ * there's a partial MCU that would need to move, or the crop is not on an
+ * MCU boundary. Nothing will have been written to @target.
+ */
+int
+vips__jpeg_transform_target(VipsSource *source, VipsTarget *target,
+	VipsImage *meta, gboolean transpose, gboolean flip_x, gboolean flip_y,
+	gboolean trim, VipsRect *crop, VipsForeignKeep keep)
+{
+	VipsImage *context;
+	ReadJpeg *jpeg;
+	Write *write;
+	int result;
+
+	/* The ReadJpeg is freed when context closes.
+	 */
+	context = vips_image_new();
+	if (!(jpeg = vips__readjpeg_new(source, context,
+			  8, VIPS_FAIL_ON_NONE, FALSE, FALSE))) {
+		g_object_unref(context);
+		return -1;
+	}
+
+	if (!(write = write_new())) {
+		g_object_unref(context);
+		return -1;
+	}
+
+	if (setjmp(write->eman.jmp)) {
+		/* Here for longjmp() during compress.
+		 */
+		write_destroy(write);
+		g_object_unref(context);
+
+		return -1;
+	}
+	jpeg_create_compress(&write->cinfo);
+	vips__jpeg_target_dest(&write->cinfo, target);
+
+	if (setjmp(jpeg->eman.jmp)) {
+		/* Here for longjmp() during decompress.
+		 */
+		write_destroy(write);
+		g_object_unref(context);
+
+		return -1;
+	}
+
+	result = transform_coefficients(jpeg, write, meta,
+		transpose, flip_x, flip_y, trim, crop, keep);
+
+	write_destroy(write);
+	g_object_unref(context);
+
+	if (result == 0 &&
+		vips_target_end(target))
+		return -1;
+
+	return result;
+}
+
 /* Some people want to be able to save as xxx.jfif. libjpeg will write as
  * JFIF if it can, but if you use features like CMYK or YCCK, you'll get a
  * regular JPEG. So saving as .jfif won't (by itself) guarantee strict JFIF
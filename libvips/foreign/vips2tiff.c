@@ -206,6 +206,12 @@
  * 	- switch to terget API for output
  * 24/9/23
  *  - add threaded write of tiled JPEG and JP2K
+ * 14/10/26
+ * 	- add threaded write of tiled deflate, zstd, lzw and webp
+ * 15/10/26
+ * 	- add cog layout
+ * 	- shrink pyramid layers in parallel
+ * 	- add bitdepth 16 for half float
  */
 
 /*
@@ -266,6 +272,18 @@
 #include "jpeg.h"
 #endif /*HAVE_JPEG*/
 
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif /*HAVE_ZLIB*/
+
+#if defined(HAVE_ZSTD) && defined(HAVE_TIFF_COMPRESSION_WEBP)
+#include <zstd.h>
+#endif /*defined(HAVE_ZSTD) && defined(HAVE_TIFF_COMPRESSION_WEBP)*/
+
+#if defined(HAVE_LIBWEBP) && defined(HAVE_TIFF_COMPRESSION_WEBP)
+#include <webp/encode.h>
+#endif /*defined(HAVE_LIBWEBP) && defined(HAVE_TIFF_COMPRESSION_WEBP)*/
+
 /* TODO:
  *
  * - add a flag for plane-separate write
@@ -294,6 +312,22 @@ static int wtiff_we_compress[] = {
 	JP2K_LOSSY
 };
 
+/* Simple codecs we can also run outside the lock. Tiles are packed as for
+ * libtiff, then we apply the predictor and compress.
+ */
+static int wtiff_we_compress_simple[] = {
+#ifdef HAVE_ZLIB
+	COMPRESSION_ADOBE_DEFLATE,
+#endif /*HAVE_ZLIB*/
+#if defined(HAVE_ZSTD) && defined(HAVE_TIFF_COMPRESSION_WEBP)
+	COMPRESSION_ZSTD,
+#endif /*defined(HAVE_ZSTD) && defined(HAVE_TIFF_COMPRESSION_WEBP)*/
+#if defined(HAVE_LIBWEBP) && defined(HAVE_TIFF_COMPRESSION_WEBP)
+	COMPRESSION_WEBP,
+#endif /*defined(HAVE_LIBWEBP) && defined(HAVE_TIFF_COMPRESSION_WEBP)*/
+	COMPRESSION_LZW
+};
+
 typedef struct _Layer Layer;
 typedef struct _Wtiff Wtiff;
 
@@ -354,6 +388,7 @@ struct _Wtiff {
 	int tilew, tileh;				/* Tile size */
 	int pyramid;					/* Wtiff pyramid */
 	int bitdepth;					/* Write as 1, 2 or 4 bit */
+	gboolean half;					/* Write float as half float */
 	int miniswhite;					/* Wtiff as 0 == white */
 	int resunit;					/* Resolution unit (inches or cm) */
 	double xres;					/* Resolution in X */
@@ -368,6 +403,7 @@ struct _Wtiff {
 	VipsForeignDzDepth depth;		/* Pyr depth */
 	gboolean subifd;				/* Write pyr layers into subifds */
 	gboolean premultiply;			/* Premultiply alpha */
+	gboolean cog;					/* Cloud optimised layout */
 
 	/* True if we've detected a toilet-roll image, plus the page height,
 	 * which has been checked to be a factor of im->Ysize. page_number
@@ -387,6 +423,12 @@ struct _Wtiff {
 	 */
 	gboolean we_compress;
 
+	/* TRUE if we_compress is one of the simple codecs, and bits per
+	 * sample for the predictor.
+	 */
+	gboolean we_compress_simple;
+	int bits_per_sample;
+
 	/* Lock thread calls into libtiff with this.
 	 */
 	GMutex lock;
@@ -491,9 +533,12 @@ wtiff_layer_init(Wtiff *wtiff, Layer **layer, Layer *above,
 		(*layer)->above = above;
 
 		/* The target we write to. The base layer writes to the main
-		 * output, each layer smaller writes to a memory temp.
+		 * output, each layer smaller writes to a memory temp. In cog
+		 * mode, the base layer is a temp too and we assemble the
+		 * output at the end.
 		 */
-		if (!above) {
+		if (!above &&
+			!wtiff->cog) {
 			(*layer)->target = wtiff->target;
 			g_object_ref((*layer)->target);
 		}
@@ -857,6 +902,20 @@ wtiff_compress_jpeg_tables(Wtiff *wtiff,
 }
 #endif /*HAVE_JPEG*/
 
+/* The predictor we apply for the simple codecs. libtiff's webp codec does
+ * not use one.
+ */
+static int
+wtiff_simple_predictor(Wtiff *wtiff)
+{
+#ifdef HAVE_TIFF_COMPRESSION_WEBP
+	if (wtiff->compression == COMPRESSION_WEBP)
+		return VIPS_FOREIGN_TIFF_PREDICTOR_NONE;
+#endif /*HAVE_TIFF_COMPRESSION_WEBP*/
+
+	return wtiff->predictor;
+}
+
 /* Write a TIFF header for this layer.
  */
 static int
@@ -920,6 +979,64 @@ wtiff_write_header(Wtiff *wtiff, Layer *layer)
 		!wtiff->tile)
 		wtiff->we_compress = FALSE;
 
+	/* The simple codecs need tiles, and a predictor we know how to apply.
+	 */
+	if (wtiff->ready->Coding == VIPS_CODING_LABQ)
+		wtiff->bits_per_sample = 8;
+	else if (wtiff->bitdepth)
+		wtiff->bits_per_sample = wtiff->bitdepth;
+	else if (wtiff->half)
+		wtiff->bits_per_sample = 16;
+	else
+		wtiff->bits_per_sample =
+			vips_format_sizeof(wtiff->ready->BandFmt) << 3;
+
+	wtiff->we_compress_simple = FALSE;
+	if (wtiff->tile &&
+		wtiff->input->Type != VIPS_INTERPRETATION_XYZ)
+		for (i = 0; i < VIPS_NUMBER(wtiff_we_compress_simple); i++)
+			if (wtiff->compression == wtiff_we_compress_simple[i]) {
+				wtiff->we_compress_simple = TRUE;
+				break;
+			}
+
+	if (wtiff->we_compress_simple) {
+		int bps = wtiff->bits_per_sample;
+		gboolean complex = vips_band_format_iscomplex(wtiff->ready->BandFmt);
+
+		switch (wtiff_simple_predictor(wtiff)) {
+		case VIPS_FOREIGN_TIFF_PREDICTOR_NONE:
+			break;
+
+		case VIPS_FOREIGN_TIFF_PREDICTOR_HORIZONTAL:
+			if (complex ||
+				(bps != 8 && bps != 16 && bps != 32))
+				wtiff->we_compress_simple = FALSE;
+			break;
+
+		case VIPS_FOREIGN_TIFF_PREDICTOR_FLOAT:
+			if (complex ||
+				(bps != 16 && bps != 32))
+				wtiff->we_compress_simple = FALSE;
+			break;
+
+		default:
+			wtiff->we_compress_simple = FALSE;
+			break;
+		}
+
+#if defined(HAVE_LIBWEBP) && defined(HAVE_TIFF_COMPRESSION_WEBP)
+		if (wtiff->compression == COMPRESSION_WEBP &&
+			(bps != 8 ||
+				wtiff->ready->Coding != VIPS_CODING_NONE ||
+				(wtiff->ready->Bands != 3 && wtiff->ready->Bands != 4)))
+			wtiff->we_compress_simple = FALSE;
+#endif /*defined(HAVE_LIBWEBP) && defined(HAVE_TIFF_COMPRESSION_WEBP)*/
+
+		if (wtiff->we_compress_simple)
+			wtiff->we_compress = TRUE;
+	}
+
 	/* Don't write mad resolutions (eg. zero), it confuses some programs.
 	 */
 	TIFFSetField(tif, TIFFTAG_RESOLUTIONUNIT, wtiff->resunit);
@@ -968,7 +1085,9 @@ wtiff_write_header(Wtiff *wtiff, Layer *layer)
 
 		TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, wtiff->ready->Bands);
 		TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE,
-			vips_format_sizeof(wtiff->ready->BandFmt) << 3);
+			wtiff->half
+				? 16
+				: vips_format_sizeof(wtiff->ready->BandFmt) << 3);
 
 		if (wtiff->ready->Type == VIPS_INTERPRETATION_B_W ||
 			wtiff->ready->Type == VIPS_INTERPRETATION_GREY16 ||
@@ -1322,6 +1441,7 @@ ready_to_write(Wtiff *wtiff)
 	/* "squash" float LAB down to LABQ.
 	 */
 	if (wtiff->bitdepth &&
+		wtiff->bitdepth != 16 &&
 		input->Bands == 3 &&
 		input->BandFmt == VIPS_FORMAT_FLOAT &&
 		input->Type == VIPS_INTERPRETATION_LAB) {
@@ -1357,6 +1477,7 @@ wtiff_new(VipsImage *input, VipsTarget *target,
 	VipsForeignDzDepth depth,
 	gboolean subifd,
 	gboolean premultiply,
+	gboolean cog,
 	int page_height)
 {
 	Wtiff *wtiff;
@@ -1376,6 +1497,7 @@ wtiff_new(VipsImage *input, VipsTarget *target,
 	wtiff->tileh = tile_height;
 	wtiff->pyramid = pyramid;
 	wtiff->bitdepth = bitdepth;
+	wtiff->half = FALSE;
 	wtiff->miniswhite = miniswhite;
 	wtiff->resunit = get_resunit(resunit);
 	wtiff->xres = xres;
@@ -1390,6 +1512,7 @@ wtiff_new(VipsImage *input, VipsTarget *target,
 	wtiff->depth = depth;
 	wtiff->subifd = subifd;
 	wtiff->premultiply = premultiply;
+	wtiff->cog = cog;
 	wtiff->toilet_roll = FALSE;
 	wtiff->page_height = page_height;
 	wtiff->page_number = 0;
@@ -1433,6 +1556,27 @@ wtiff_new(VipsImage *input, VipsTarget *target,
 	if (wtiff->subifd)
 		wtiff->pyramid = TRUE;
 
+	/* cog turns on pyramid mode, and is a single image with overviews.
+	 */
+	if (wtiff->cog) {
+#ifdef HAVE_TIFF_DEFER_STRILE_ARRAY_WRITING
+		if (wtiff->toilet_roll ||
+			wtiff->subifd) {
+			wtiff_free(wtiff);
+			vips_error("vips2tiff",
+				"%s", _("cog can't be multi-page or use subifd"));
+			return NULL;
+		}
+
+		wtiff->pyramid = TRUE;
+#else  /*!HAVE_TIFF_DEFER_STRILE_ARRAY_WRITING*/
+		wtiff_free(wtiff);
+		vips_error("vips2tiff",
+			"%s", _("cog needs libtiff 4.1 or later"));
+		return NULL;
+#endif /*HAVE_TIFF_DEFER_STRILE_ARRAY_WRITING*/
+	}
+
 	/* Pyramid images must be tiled.
 	 */
 	if (wtiff->pyramid)
@@ -1479,6 +1623,26 @@ wtiff_new(VipsImage *input, VipsTarget *target,
 		}
 	}
 
+	/* Depth 16 writes float as half float.
+	 */
+	if (wtiff->bitdepth == 16) {
+		if (wtiff->ready->Coding == VIPS_CODING_NONE &&
+			wtiff->ready->BandFmt == VIPS_FORMAT_FLOAT &&
+			wtiff->input->Type != VIPS_INTERPRETATION_XYZ)
+			wtiff->half = TRUE;
+		else
+			g_warning("can only set bitdepth 16 for float images "
+					  "-- disabling bitdepth");
+		wtiff->bitdepth = 0;
+	}
+
+	if (wtiff->half &&
+		wtiff->miniswhite) {
+		g_warning("can't save half float as miniswhite "
+				  "-- disabling miniswhite");
+		wtiff->miniswhite = FALSE;
+	}
+
 	/* Depth 8 is handled above.
 	 */
 	if (wtiff->bitdepth &&
@@ -1528,6 +1692,9 @@ wtiff_new(VipsImage *input, VipsTarget *target,
 		wtiff->tls = VIPS_ROUND_UP(wtiff->tilew, 4) / 4;
 	else if (wtiff->bitdepth == 4)
 		wtiff->tls = VIPS_ROUND_UP(wtiff->tilew, 2) / 2;
+	else if (wtiff->half)
+		wtiff->tls = sizeof(guint16) * wtiff->ready->Bands *
+			wtiff->tilew;
 	else
 		wtiff->tls = VIPS_IMAGE_SIZEOF_PEL(wtiff->ready) *
 			wtiff->tilew;
@@ -1736,6 +1903,9 @@ wtiff_pack2tiff(Wtiff *wtiff, Layer *layer,
 			LabQ2LabC(q, p, area->width);
 		else if (wtiff->bitdepth > 0)
 			eightbit2nbit(wtiff, q, p, area->width);
+		else if (wtiff->half)
+			vips__float_to_half((guint16 *) q, (float *) p,
+				(size_t) area->width * in->im->Bands);
 		else if (wtiff->input->Type == VIPS_INTERPRETATION_XYZ)
 			XYZ2tiffxyz(q, p, area->width, in->im->Bands);
 		else if ((in->im->Bands == 1 || in->im->Bands == 2) &&
@@ -1753,6 +1923,336 @@ wtiff_pack2tiff(Wtiff *wtiff, Layer *layer,
 	}
 }
 
+/* Size of the LZW encoder hash table, must be a power of two and more than
+ * twice the number of codes.
+ */
+#define LZW_HASH_BITS (13)
+#define LZW_HASH_SIZE (1 << LZW_HASH_BITS)
+
+typedef struct _WtiffLzw {
+	VipsPel *out;
+	size_t pos;
+	guint32 bits;
+	int n_bits;
+} WtiffLzw;
+
+static void
+wtiff_lzw_put(WtiffLzw *lzw, int code, int code_width)
+{
+	lzw->bits = (lzw->bits << code_width) | code;
+	lzw->n_bits += code_width;
+
+	while (lzw->n_bits >= 8) {
+		lzw->out[lzw->pos++] = lzw->bits >> (lzw->n_bits - 8);
+		lzw->n_bits -= 8;
+	}
+}
+
+/* Encode a TIFF LZW stream, MSB-first codes with early change, exactly as
+ * libtiff's encoder does, but without the compression ratio check.
+ */
+static VipsPel *
+wtiff_compress_lzw(VipsPel *in, size_t in_length, size_t *out_length)
+{
+	gint32 *keys;
+	guint16 *codes;
+	WtiffLzw lzw;
+	int code_width;
+	int next_code;
+	int ent;
+	size_t i;
+
+	keys = g_new(gint32, LZW_HASH_SIZE);
+	codes = g_new(guint16, LZW_HASH_SIZE);
+	memset(keys, 0xff, LZW_HASH_SIZE * sizeof(gint32));
+
+	/* Every byte can make at most one 12-bit code, plus clears.
+	 */
+	lzw.out = g_malloc(in_length * 2 + 16);
+	lzw.pos = 0;
+	lzw.bits = 0;
+	lzw.n_bits = 0;
+
+	code_width = 9;
+	next_code = 258;
+	wtiff_lzw_put(&lzw, 256, code_width);
+
+	ent = in[0];
+	for (i = 1; i < in_length; i++) {
+		int c = in[i];
+		gint32 key = (ent << 8) | c;
+		guint32 h = ((guint32) key * 2654435761U) >> (32 - LZW_HASH_BITS);
+
+		while (keys[h] != -1 &&
+			keys[h] != key)
+			h = (h + 1) & (LZW_HASH_SIZE - 1);
+
+		if (keys[h] == key) {
+			ent = codes[h];
+			continue;
+		}
+
+		wtiff_lzw_put(&lzw, ent, code_width);
+		keys[h] = key;
+		codes[h] = next_code++;
+		ent = c;
+
+		if (next_code == 4094) {
+			/* Table full, emit a clear and start again.
+			 */
+			wtiff_lzw_put(&lzw, 256, code_width);
+			memset(keys, 0xff, LZW_HASH_SIZE * sizeof(gint32));
+			code_width = 9;
+			next_code = 258;
+		}
+		else if (next_code > (1 << code_width) - 1)
+			code_width += 1;
+	}
+
+	/* The decoder will add one more entry for the final code, so the code
+	 * width can change before EOI.
+	 */
+	wtiff_lzw_put(&lzw, ent, code_width);
+	next_code += 1;
+	if (next_code == 4094) {
+		wtiff_lzw_put(&lzw, 256, code_width);
+		code_width = 9;
+	}
+	else if (next_code > (1 << code_width) - 1)
+		code_width += 1;
+	wtiff_lzw_put(&lzw, 257, code_width);
+
+	if (lzw.n_bits > 0)
+		lzw.out[lzw.pos++] = lzw.bits << (8 - lzw.n_bits);
+
+	g_free(keys);
+	g_free(codes);
+
+	*out_length = lzw.pos;
+
+	return lzw.out;
+}
+
+#define HORIZONTAL_DIFF(TYPE) \
+	{ \
+		TYPE *p = (TYPE *) row; \
+\
+		for (x = n - 1; x >= spp; x--) \
+			p[x] -= p[x - spp]; \
+	}
+
+/* Apply the horizontal or floating point predictor to a packed tile, as
+ * libtiff does before encode.
+ */
+static void
+wtiff_predictor_tile(Wtiff *wtiff, VipsPel *buf)
+{
+	int spp = wtiff->ready->Bands;
+	int bps = wtiff->bits_per_sample;
+	int n = wtiff->tilew * spp;
+
+	VipsPel *row;
+	VipsPel *tmp;
+	int x, y;
+
+	if (wtiff_simple_predictor(wtiff) ==
+		VIPS_FOREIGN_TIFF_PREDICTOR_HORIZONTAL)
+		for (y = 0; y < wtiff->tileh; y++) {
+			row = buf + y * wtiff->tls;
+
+			switch (bps) {
+			case 8:
+				HORIZONTAL_DIFF(guint8);
+				break;
+
+			case 16:
+				HORIZONTAL_DIFF(guint16);
+				break;
+
+			case 32:
+				HORIZONTAL_DIFF(guint32);
+				break;
+
+			default:
+				g_assert_not_reached();
+				break;
+			}
+		}
+	else if (wtiff_simple_predictor(wtiff) ==
+		VIPS_FOREIGN_TIFF_PREDICTOR_FLOAT) {
+		int bytes = bps / 8;
+		int wc = n;
+		int cc = n * bytes;
+
+		tmp = g_malloc(cc);
+
+		for (y = 0; y < wtiff->tileh; y++) {
+			int i, b;
+
+			row = buf + y * wtiff->tls;
+
+			/* Split samples into byte planes, most significant first,
+			 * then difference the bytes.
+			 */
+			memcpy(tmp, row, cc);
+			for (i = 0; i < wc; i++)
+				for (b = 0; b < bytes; b++)
+#if G_BYTE_ORDER == G_BIG_ENDIAN
+					row[b * wc + i] = tmp[bytes * i + b];
+#else
+					row[(bytes - b - 1) * wc + i] = tmp[bytes * i + b];
+#endif
+
+			for (x = cc - 1; x >= spp; x--)
+				row[x] -= row[x - spp];
+		}
+
+		g_free(tmp);
+	}
+}
+
+#if defined(HAVE_LIBWEBP) && defined(HAVE_TIFF_COMPRESSION_WEBP)
+static int
+wtiff_compress_webp(Wtiff *wtiff, VipsPel *buf, VipsTarget *target)
+{
+	WebPConfig config;
+	WebPPicture picture;
+	WebPMemoryWriter writer;
+	int result;
+
+	if (!WebPConfigInit(&config) ||
+		!WebPPictureInit(&picture)) {
+		vips_error("vips2tiff", "%s", _("config version error"));
+		return -1;
+	}
+
+	/* Match the settings libtiff uses.
+	 */
+	config.lossless = wtiff->lossless;
+	config.quality = wtiff->Q;
+	if (wtiff->lossless) {
+		config.exact = 1;
+		picture.use_argb = 1;
+	}
+
+	picture.width = wtiff->tilew;
+	picture.height = wtiff->tileh;
+	if (wtiff->ready->Bands == 4)
+		result = WebPPictureImportRGBA(&picture, buf, wtiff->tls);
+	else
+		result = WebPPictureImportRGB(&picture, buf, wtiff->tls);
+	if (!result) {
+		vips_error("vips2tiff", "%s", _("picture memory error"));
+		return -1;
+	}
+
+	WebPMemoryWriterInit(&writer);
+	picture.writer = WebPMemoryWrite;
+	picture.custom_ptr = &writer;
+
+	result = 0;
+	if (!WebPEncode(&config, &picture)) {
+		vips_error("vips2tiff", "%s", _("unable to encode"));
+		result = -1;
+	}
+	else if (vips_target_write(target, writer.mem, writer.size))
+		result = -1;
+
+	WebPPictureFree(&picture);
+	WebPMemoryWriterClear(&writer);
+
+	return result;
+}
+#endif /*defined(HAVE_LIBWEBP) && defined(HAVE_TIFF_COMPRESSION_WEBP)*/
+
+/* Pack, predict and compress a tile with one of the simple codecs.
+ */
+static int
+wtiff_compress_simple(Wtiff *wtiff, Layer *layer,
+	VipsRegion *strip, VipsRect *tile, VipsTarget *target)
+{
+	size_t tile_size = (size_t) wtiff->tls * wtiff->tileh;
+
+	VipsPel *buf;
+	VipsPel *out;
+	size_t length;
+	int result;
+
+	/* vips_malloc() zeros the tile, so edge tiles are padded with black.
+	 */
+	if (!(buf = vips_malloc(NULL, tile_size)))
+		return -1;
+	wtiff_pack2tiff(wtiff, layer, strip, tile, buf);
+	wtiff_predictor_tile(wtiff, buf);
+
+	result = -1;
+	out = NULL;
+	length = 0;
+
+	switch (wtiff->compression) {
+#ifdef HAVE_ZLIB
+	case COMPRESSION_ADOBE_DEFLATE: {
+		int level = wtiff->level
+			? VIPS_CLIP(1, wtiff->level, 9)
+			: Z_DEFAULT_COMPRESSION;
+		uLongf bound = compressBound(tile_size);
+
+		out = g_malloc(bound);
+		if (compress2(out, &bound, buf, tile_size, level) != Z_OK)
+			vips_error("vips2tiff", "%s", _("deflate compress failed"));
+		else {
+			length = bound;
+			result = 0;
+		}
+		break;
+	}
+#endif /*HAVE_ZLIB*/
+
+#if defined(HAVE_ZSTD) && defined(HAVE_TIFF_COMPRESSION_WEBP)
+	case COMPRESSION_ZSTD: {
+		// libtiff's default zstd level is 9
+		int level = wtiff->level
+			? VIPS_CLIP(1, wtiff->level, 22)
+			: 9;
+		size_t bound = ZSTD_compressBound(tile_size);
+
+		out = g_malloc(bound);
+		length = ZSTD_compress(out, bound, buf, tile_size, level);
+		if (ZSTD_isError(length))
+			vips_error("vips2tiff", "%s", ZSTD_getErrorName(length));
+		else
+			result = 0;
+		break;
+	}
+#endif /*defined(HAVE_ZSTD) && defined(HAVE_TIFF_COMPRESSION_WEBP)*/
+
+#if defined(HAVE_LIBWEBP) && defined(HAVE_TIFF_COMPRESSION_WEBP)
+	case COMPRESSION_WEBP:
+		result = wtiff_compress_webp(wtiff, buf, target);
+		break;
+#endif /*defined(HAVE_LIBWEBP) && defined(HAVE_TIFF_COMPRESSION_WEBP)*/
+
+	case COMPRESSION_LZW:
+		out = wtiff_compress_lzw(buf, tile_size, &length);
+		result = 0;
+		break;
+
+	default:
+		g_assert_not_reached();
+		break;
+	}
+
+	if (!result &&
+		out &&
+		vips_target_write(target, out, length))
+		result = -1;
+
+	g_free(out);
+	VIPS_FREE(buf);
+
+	return result;
+}
+
 // a compressed (raw) tile waiting to be written
 typedef struct _WtiffTile {
 	// x position (sort by this)
@@ -1935,8 +2435,13 @@ wtiff_layer_row_work(VipsThreadState *state, void *a)
 #endif /*HAVE_JPEG*/
 
 	default:
-		result = -1;
-		g_assert_not_reached();
+		if (wtiff->we_compress_simple)
+			result = wtiff_compress_simple(wtiff, layer,
+				strip, &tile, target);
+		else {
+			result = -1;
+			g_assert_not_reached();
+		}
 		break;
 	}
 
@@ -2074,6 +2579,11 @@ wtiff_layer_write_strip(Wtiff *wtiff, Layer *layer, VipsRegion *strip)
 			eightbit2nbit(wtiff, wtiff->tbuf, p, im->Xsize);
 			p = wtiff->tbuf;
 		}
+		else if (wtiff->half) {
+			vips__float_to_half((guint16 *) wtiff->tbuf, (float *) p,
+				(size_t) im->Xsize * im->Bands);
+			p = wtiff->tbuf;
+		}
 		else if ((im->Bands == 1 || im->Bands == 2) &&
 			wtiff->miniswhite) {
 			invert_band0(wtiff, wtiff->tbuf, p, im->Xsize);
@@ -2137,7 +2647,7 @@ layer_strip_shrink(Layer *layer)
 		if (vips_rect_isempty(&target))
 			break;
 
-		(void) vips_region_shrink_method(from, to, &target,
+		(void) vips__region_shrink_threaded(from, to, &target,
 			layer->wtiff->region_shrink);
 
 		below->write_y += target.height;
@@ -2345,11 +2855,11 @@ wtiff_copy_tiles(Wtiff *wtiff, TIFF *out, TIFF *in)
 	return 0;
 }
 
-/* Copy a TIFF file ... we know we wrote it, so just copy the tags we know
- * we might have set.
+/* Copy the header of a TIFF file ... we know we wrote it, so just copy the
+ * tags we know we might have set.
  */
 static int
-wtiff_copy_tiff(Wtiff *wtiff, TIFF *out, TIFF *in)
+wtiff_copy_tags(Wtiff *wtiff, TIFF *out, TIFF *in)
 {
 	guint32 ui32;
 	guint16 ui16;
@@ -2377,6 +2887,7 @@ wtiff_copy_tiff(Wtiff *wtiff, TIFF *out, TIFF *in)
 	CopyField(TIFFTAG_SUBFILETYPE, ui32);
 	CopyField(TIFFTAG_PREDICTOR, ui16);
 	CopyField(TIFFTAG_SAMPLEFORMAT, ui16);
+	CopyField(TIFFTAG_INKSET, ui16);
 
 	if (TIFFGetField(in, TIFFTAG_EXTRASAMPLES, &ui16, &a))
 		TIFFSetField(out, TIFFTAG_EXTRASAMPLES, ui16, a);
@@ -2402,7 +2913,16 @@ wtiff_copy_tiff(Wtiff *wtiff, TIFF *out, TIFF *in)
 		wtiff_embed_profile(wtiff, out))
 		return -1;
 
-	if (wtiff_copy_tiles(wtiff, out, in))
+	return 0;
+}
+
+/* Copy a TIFF file.
+ */
+static int
+wtiff_copy_tiff(Wtiff *wtiff, TIFF *out, TIFF *in)
+{
+	if (wtiff_copy_tags(wtiff, out, in) ||
+		wtiff_copy_tiles(wtiff, out, in))
 		return -1;
 
 	return 0;
@@ -2455,6 +2975,107 @@ wtiff_gather(Wtiff *wtiff)
 	return 0;
 }
 
+#ifdef HAVE_TIFF_DEFER_STRILE_ARRAY_WRITING
+/* GDAL marks a cloud optimised layout with this block just after the TIFF
+ * header, the "ghost area", so readers can check for it without scanning
+ * the whole file.
+ */
+#define COG_GHOST_AREA \
+	"LAYOUT=IFDS_BEFORE_DATA\n" \
+	"BLOCK_ORDER=ROW_MAJOR\n" \
+	"KNOWN_INCOMPATIBLE_EDITION=NO\n"
+
+static int
+wtiff_gather_cog_layers(Wtiff *wtiff, TIFF *out, TIFF **in, int n_layers)
+{
+	Layer *layer;
+	char *ghost;
+	int i;
+
+	ghost = g_strdup_printf("GDAL_STRUCTURAL_METADATA_SIZE=%06d bytes\n%s",
+		(int) strlen(COG_GHOST_AREA), COG_GHOST_AREA);
+	if (vips_target_seek(wtiff->target, 0, SEEK_END) == -1 ||
+		vips_target_write(wtiff->target, ghost, strlen(ghost))) {
+		g_free(ghost);
+		return -1;
+	}
+	g_free(ghost);
+
+	/* All the IFDs, largest first. Writing the tile offsets and
+	 * bytecounts is deferred, so they can all go together after the
+	 * IFDs.
+	 */
+	for (i = 0, layer = wtiff->layer; layer; i++, layer = layer->below) {
+		VipsSource *source;
+
+		if (!(source = vips_source_new_from_target(layer->target)))
+			return -1;
+		in[i] = vips__tiff_openin_source(source,
+			wtiff_handler_error, wtiff_handler_warning, NULL, FALSE);
+		VIPS_UNREF(source);
+		if (!in[i])
+			return -1;
+
+		if (wtiff_copy_tags(wtiff, out, in[i]) ||
+			!TIFFWriteCheck(out, TRUE, "wtiff_gather_cog") ||
+			!TIFFDeferStrileArrayWriting(out) ||
+			!TIFFWriteDirectory(out))
+			return -1;
+	}
+
+	for (i = 0; i < n_layers; i++)
+		if (!TIFFSetDirectory(out, i) ||
+			!TIFFForceStrileArrayWriting(out))
+			return -1;
+
+	/* Now the tiles, smallest layer first, updating the offsets in
+	 * place.
+	 */
+	for (i = n_layers - 1; i >= 0; i--)
+		if (!TIFFSetDirectory(out, i) ||
+			wtiff_copy_tiles(wtiff, out, in[i]) ||
+			!TIFFForceStrileArrayWriting(out))
+			return -1;
+
+	return 0;
+}
+
+/* Write all the layers to the output in cog order: the IFDs, then the tile
+ * indexes, then the tiles, smallest overview first.
+ */
+static int
+wtiff_gather_cog(Wtiff *wtiff)
+{
+	int n_layers;
+	Layer *layer;
+	TIFF **in;
+	TIFF *out;
+	int result;
+	int i;
+
+#ifdef DEBUG
+	printf("wtiff_gather_cog:\n");
+#endif /*DEBUG*/
+
+	for (n_layers = 0, layer = wtiff->layer; layer; layer = layer->below)
+		n_layers += 1;
+
+	if (!(out = vips__tiff_openout_target(wtiff->target,
+			  wtiff->bigtiff, wtiff_handler_error,
+			  wtiff_handler_warning, wtiff)))
+		return -1;
+
+	in = g_new0(TIFF *, n_layers);
+	result = wtiff_gather_cog_layers(wtiff, out, in, n_layers);
+	for (i = 0; i < n_layers; i++)
+		VIPS_FREEF(TIFFClose, in[i]);
+	g_free(in);
+	TIFFClose(out);
+
+	return result;
+}
+#endif /*HAVE_TIFF_DEFER_STRILE_ARRAY_WRITING*/
+
 static int
 wtiff_page_start(Wtiff *wtiff)
 {
@@ -2517,6 +3138,25 @@ wtiff_page_end(Wtiff *wtiff)
 	if (!TIFFWriteDirectory(wtiff->layer->tif))
 		return -1;
 
+#ifdef HAVE_TIFF_DEFER_STRILE_ARRAY_WRITING
+	/* cog images are a single page, so we can assemble the output now.
+	 * The layers will be freed when wtiff is.
+	 */
+	if (wtiff->cog) {
+		Layer *layer;
+
+		for (layer = wtiff->layer; layer; layer = layer->below)
+			layer_free(layer);
+
+		if (wtiff_gather_cog(wtiff))
+			return -1;
+
+		wtiff->page_number += 1;
+
+		return 0;
+	}
+#endif /*HAVE_TIFF_DEFER_STRILE_ARRAY_WRITING*/
+
 	/* Append any pyr layers, if necessary.
 	 */
 	if (wtiff->layer->below) {
@@ -2631,6 +3271,7 @@ vips__tiff_write_target(VipsImage *input, VipsTarget *target,
 	VipsForeignDzDepth depth,
 	gboolean subifd,
 	gboolean premultiply,
+	gboolean cog,
 	int page_height)
 {
 	Wtiff *wtiff;
@@ -2642,7 +3283,7 @@ vips__tiff_write_target(VipsImage *input, VipsTarget *target,
 			  tile, tile_width, tile_height, pyramid, bitdepth,
 			  miniswhite, resunit, xres, yres, bigtiff, rgbjpeg,
 			  properties, region_shrink, level, lossless, depth,
-			  subifd, premultiply, page_height)))
+			  subifd, premultiply, cog, page_height)))
 		return -1;
 
 	if (vips_sink_disc(wtiff->ready, wtiff_sink_disc_strip, wtiff)) {
@@ -1,6 +1,9 @@
 /* load vips from a file
  *
  * 24/11/11
+ * 14/10/26
+ * 	- load the tiled layout
+ * 	- set the window access hint
  */
 
 /*
@@ -48,6 +51,8 @@
 #include <vips/vips.h>
 #include <vips/internal.h>
 
+#include "pforeign.h"
+
 typedef struct _VipsForeignLoadVips {
 	VipsForeignLoad parent_object;
 
@@ -81,7 +86,8 @@ vips_foreign_load_vips_get_flags_source(VipsSource *source)
 	flags = VIPS_FOREIGN_PARTIAL;
 
 	if (vips_source_sniff_at_most(source, &data, 4) == 4 &&
-		*((guint32 *) data) == VIPS_MAGIC_SPARC)
+		(*((guint32 *) data) == VIPS_MAGIC_SPARC ||
+			*((guint32 *) data) == VIPS_MAGIC_TILED_SPARC))
 		flags |= VIPS_FOREIGN_BIGENDIAN;
 
 	return flags;
@@ -130,8 +136,17 @@ vips_foreign_load_vips_header(VipsForeignLoad *load)
 		return -1;
 	}
 
-	if (!(image = vips_image_new_mode(filename, "r")))
+	if (vips__vipstiled_ismagic(filename)) {
+		image = vips_image_new();
+		if (vips__vipstiled_read(filename, image)) {
+			g_object_unref(image);
+			return -1;
+		}
+	}
+	else if (!(image = vips_image_new_mode(filename, "r")))
 		return -1;
+	else
+		vips__window_set_access(image, load->access);
 
 	/* What a hack. Remove the @out that's there now and replace it with
 	 * our image.
@@ -210,7 +225,8 @@ const char *vips__suffs[] = { ".v", ".vips", NULL };
 static gboolean
 vips_foreign_load_vips_file_is_a(const char *filename)
 {
-	return vips__file_magic(filename);
+	return vips__file_magic(filename) ||
+		vips__vipstiled_ismagic(filename);
 }
 
 static void
@@ -282,7 +298,8 @@ vips_foreign_load_vips_source_is_a_source(VipsSource *source)
 
 	return vips_source_is_file(source) &&
 		(filename = vips_connection_filename(connection)) &&
-		vips__file_magic(filename);
+		(vips__file_magic(filename) ||
+			vips__vipstiled_ismagic(filename));
 }
 
 static void
@@ -91,6 +91,9 @@
  * 	- add bits per sample metadata
  * 23/12/25 Starbix
  *  - add support for reading cICP chunk
+ * 14/10/26
+ * 	- filter and deflate large images in parallel
+ * 	- decode ahead on a background thread
  */
 
 /*
@@ -960,6 +963,7 @@ png2vips_image(Read *read, VipsImage *out)
 				read, NULL) ||
 			vips_sequential(t[0], &t[1],
 				"tile_height", VIPS__FATSTRIP_HEIGHT,
+				"prefetch", 4,
 				NULL) ||
 			vips_image_write(t[1], out))
 			return -1;
@@ -1594,6 +1598,17 @@ write_vips(Write *write,
 
 	png_write_info(write->pPng, write->pInfo);
 
+	/* Large images are filtered and deflated on many threads, and we
+	 * write the IDAT and IEND chunks ourselves.
+	 */
+	if (!interlace &&
+#ifdef PNG_APNG_SUPPORTED
+		!write->is_animated &&
+#endif /*PNG_APNG_SUPPORTED*/
+		vips__png_can_write_parallel(in, bitdepth))
+		return vips__png_write_parallel(in, write->target,
+			bitdepth, compress, filter);
+
 	/* If we're an intel byte order CPU and this is a 16bit image, we need
 	 * to swap bytes.
 	 */
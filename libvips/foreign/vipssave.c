@@ -1,6 +1,8 @@
 /* save to vips
  *
  * 24/11/11
+ * 14/10/26
+ * 	- add @tile, @tile_width, @tile_height, @level for the tiled layout
  */
 
 /*
@@ -51,11 +53,20 @@
 #include <vips/vips.h>
 #include <vips/internal.h>
 
+#include "pforeign.h"
+
 typedef struct _VipsForeignSaveVips {
 	VipsForeignSave parent_object;
 
 	VipsTarget *target;
 
+	/* Write the tiled layout, optionally with zstd.
+	 */
+	gboolean tile;
+	int tile_width;
+	int tile_height;
+	int level;
+
 } VipsForeignSaveVips;
 
 typedef VipsForeignSaveClass VipsForeignSaveVipsClass;
@@ -89,17 +100,24 @@ vips_foreign_save_vips_build(VipsObject *object)
 
 		VipsImage *x;
 
-		/* vips_image_build() has some magic for "w"
-		 * preventing recursion and sending this directly to the
-		 * saver built into iofuncs.
-		 */
-		if (!(x = vips_image_new_mode(filename, "w")))
-			return -1;
-		if (vips_image_write(save->ready, x)) {
+		if (vips->tile) {
+			if (vips__vipstiled_write(save->ready, filename,
+					vips->tile_width, vips->tile_height, vips->level))
+				return -1;
+		}
+		else {
+			/* vips_image_build() has some magic for "w"
+			 * preventing recursion and sending this directly to the
+			 * saver built into iofuncs.
+			 */
+			if (!(x = vips_image_new_mode(filename, "w")))
+				return -1;
+			if (vips_image_write(save->ready, x)) {
+				g_object_unref(x);
+				return -1;
+			}
 			g_object_unref(x);
-			return -1;
 		}
-		g_object_unref(x);
 	}
 	else {
 		VipsObjectClass *class = VIPS_OBJECT_GET_CLASS(object);
@@ -143,11 +161,41 @@ vips_foreign_save_vips_class_init(VipsForeignSaveVipsClass *class)
 
 	save_class->saveable = VIPS_FOREIGN_SAVEABLE_ANY;
 	save_class->coding = VIPS_FOREIGN_CODING_ALL;
+
+	VIPS_ARG_BOOL(class, "tile", 10,
+		_("Tile"),
+		_("Write a tiled image"),
+		VIPS_ARGUMENT_OPTIONAL_INPUT,
+		G_STRUCT_OFFSET(VipsForeignSaveVips, tile),
+		FALSE);
+
+	VIPS_ARG_INT(class, "tile_width", 11,
+		_("Tile width"),
+		_("Tile width in pixels"),
+		VIPS_ARGUMENT_OPTIONAL_INPUT,
+		G_STRUCT_OFFSET(VipsForeignSaveVips, tile_width),
+		1, 32768, 256);
+
+	VIPS_ARG_INT(class, "tile_height", 12,
+		_("Tile height"),
+		_("Tile height in pixels"),
+		VIPS_ARGUMENT_OPTIONAL_INPUT,
+		G_STRUCT_OFFSET(VipsForeignSaveVips, tile_height),
+		1, 32768, 256);
+
+	VIPS_ARG_INT(class, "level", 13,
+		_("Level"),
+		_("ZSTD compression level for tiles, 0 for none"),
+		VIPS_ARGUMENT_OPTIONAL_INPUT,
+		G_STRUCT_OFFSET(VipsForeignSaveVips, level),
+		0, 22, 0);
 }
 
 static void
 vips_foreign_save_vips_init(VipsForeignSaveVips *vips)
 {
+	vips->tile_width = 256;
+	vips->tile_height = 256;
 }
 
 typedef struct _VipsForeignSaveVipsFile {
@@ -264,6 +312,20 @@ vips_foreign_save_vips_target_init(VipsForeignSaveVipsTarget *target)
  *
  * Write @in to @filename in VIPS format.
  *
+ * Set @tile to write the pixels as a grid of @tile_width by @tile_height
+ * tiles with an index, rather than as a single raw block. Tiled files can
+ * be read in any order without mapping the whole file, which
+ * makes them useful as a disc cache for very large intermediates. Set
+ * @level to compress each tile with zstd at that level. 1 is fastest.
+ *
+ * Tiled files can only be read by libvips 8.19 and later.
+ *
+ * ::: tip "Optional arguments"
+ *     * @tile: `gboolean`, set `TRUE` to write a tiled image
+ *     * @tile_width: `gint`, for tile size
+ *     * @tile_height: `gint`, for tile size
+ *     * @level: `gint`, zstd compression level for tiles
+ *
  * ::: seealso
  *     [ctor@Image.vipsload].
  *
@@ -290,6 +352,12 @@ vips_vipssave(VipsImage *in, const char *filename, ...)
  *
  * As [method@Image.vipssave], but save to a target.
  *
+ * ::: tip "Optional arguments"
+ *     * @tile: `gboolean`, set `TRUE` to write a tiled image
+ *     * @tile_width: `gint`, for tile size
+ *     * @tile_height: `gint`, for tile size
+ *     * @level: `gint`, zstd compression level for tiles
+ *
  * Returns: 0 on success, -1 on error.
  */
 int
@@ -0,0 +1,810 @@
+/* read and write the tiled layout of the vips format
+ *
+ * 14/10/26
+ * 	- from vips.c
+ */
+
+/*
+
+	This file is part of VIPS.
+
+	VIPS is free software; you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+	02110-1301  USA
+
+ */
+
+/*
+
+	These files are distributed with VIPS - http://www.vips.ecs.soton.ac.uk
+
+ */
+
+/* A plain .v file is a header, a raw strip-ordered pixel dump, and an XML
+ * block, and is read with mmap windows. The tiled layout keeps the same
+ * header and XML, but stores the pixels as a grid of separately, optionally
+ * compressed tiles, so large files can be read in any order without
+ * touching the whole file:
+ *
+ * 	- the 64 byte vips header, but with VIPS_MAGIC_TILED_* as the magic
+ * 	  so that older readers refuse it
+ * 	- a 32 byte preamble: tile width, tile height, compression (all
+ * 	  guint32) and a guint32 pad, then the guint64 offset of the XML
+ * 	- the tile index, a guint64 offset and a guint64 length for each
+ * 	  tile, left-to-right, top-to-bottom
+ * 	- the tiles, in the order they were computed
+ * 	- the XML block
+ *
+ * Edge tiles are clipped to the image. Everything is in the byte order
+ * given by the magic, as for plain .v.
+ */
+
+/*
+#define DEBUG
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /*HAVE_CONFIG_H*/
+#include <glib/gi18n-lib.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif /*HAVE_UNISTD_H*/
+#ifdef G_OS_WIN32
+#include <io.h>
+#endif /*G_OS_WIN32*/
+
+#include <vips/vips.h>
+#include <vips/internal.h>
+#include <vips/debug.h>
+
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif /*HAVE_ZSTD*/
+
+#include "pforeign.h"
+
+/* The preamble after the header.
+ */
+#define VIPS_TILED_PREAMBLE (32)
+
+/* Largest tile we allow on read, in bytes.
+ */
+#define VIPS_TILED_MAX_TILE (256 * 1024 * 1024)
+
+/* Most tiles we allow in a file. Tile numbers and index positions are int.
+ */
+#define VIPS_TILED_MAX_TILES (INT_MAX / 2)
+
+enum {
+	VIPS_TILED_NONE = 0,
+	VIPS_TILED_ZSTD = 1
+};
+
+static void
+copy_8byte(gboolean swap, unsigned char *to, unsigned char *from)
+{
+	guint64 *in = (guint64 *) from;
+	guint64 *out = (guint64 *) to;
+
+	if (swap)
+		*out = GUINT64_SWAP_LE_BE(*in);
+	else
+		*out = *in;
+}
+
+/* Test the first four bytes of a file for a tiled magic.
+ */
+gboolean
+vips__vipstiled_ismagic(const char *filename)
+{
+	unsigned char buf[4];
+	guint32 magic;
+
+	if (vips__get_bytes(filename, buf, 4) != 4)
+		return FALSE;
+
+	/* Magic is always MSB first.
+	 */
+	magic = GUINT32_FROM_BE(*((guint32 *) buf));
+
+	return magic == VIPS_MAGIC_TILED_INTEL ||
+		magic == VIPS_MAGIC_TILED_SPARC;
+}
+
+typedef struct _VipsTiledWrite {
+	VipsImage *in;
+	int fd;
+
+	int tile_width;
+	int tile_height;
+	int level;
+	int tiles_across;
+	int tiles_down;
+
+	/* Offset and length of each tile.
+	 */
+	guint64 *index;
+
+	/* Where the next tile goes. Tiles arrive from many threads, so
+	 * appending is locked.
+	 */
+	gint64 offset;
+	GMutex lock;
+} VipsTiledWrite;
+
+typedef struct _VipsTiledWriteSeq {
+	VipsTiledWrite *write;
+
+	/* Pack tile pixels here.
+	 */
+	VipsPel *tile;
+
+	/* And compress to here.
+	 */
+	void *buf;
+	size_t buf_size;
+
+#ifdef HAVE_ZSTD
+	ZSTD_CCtx *cctx;
+#endif /*HAVE_ZSTD*/
+} VipsTiledWriteSeq;
+
+static void *
+vips_tiled_write_start(VipsImage *out, void *a, void *b)
+{
+	VipsTiledWrite *write = (VipsTiledWrite *) a;
+	size_t tile_size = VIPS_IMAGE_SIZEOF_PEL(write->in) *
+		write->tile_width * write->tile_height;
+
+	VipsTiledWriteSeq *seq;
+
+	if (!(seq = VIPS_NEW(NULL, VipsTiledWriteSeq)))
+		return NULL;
+	seq->write = write;
+	seq->buf = NULL;
+	seq->buf_size = 0;
+	if (!(seq->tile = VIPS_ARRAY(NULL, tile_size, VipsPel))) {
+		g_free(seq);
+		return NULL;
+	}
+
+#ifdef HAVE_ZSTD
+	seq->cctx = NULL;
+	if (write->level > 0) {
+		seq->buf_size = ZSTD_compressBound(tile_size);
+		if (!(seq->buf = vips_malloc(NULL, seq->buf_size)) ||
+			!(seq->cctx = ZSTD_createCCtx())) {
+			g_free(seq->buf);
+			g_free(seq->tile);
+			g_free(seq);
+			return NULL;
+		}
+	}
+#endif /*HAVE_ZSTD*/
+
+	return seq;
+}
+
+static int
+vips_tiled_write_stop(void *vseq, void *a, void *b)
+{
+	VipsTiledWriteSeq *seq = (VipsTiledWriteSeq *) vseq;
+
+#ifdef HAVE_ZSTD
+	VIPS_FREEF(ZSTD_freeCCtx, seq->cctx);
+#endif /*HAVE_ZSTD*/
+	VIPS_FREE(seq->buf);
+	VIPS_FREE(seq->tile);
+	g_free(seq);
+
+	return 0;
+}
+
+/* Called for each tile, on many threads.
+ */
+static int
+vips_tiled_write_tile(VipsRegion *region,
+	void *vseq, void *a, void *b, gboolean *stop)
+{
+	VipsTiledWriteSeq *seq = (VipsTiledWriteSeq *) vseq;
+	VipsTiledWrite *write = seq->write;
+	VipsRect *r = &region->valid;
+	size_t ls = VIPS_IMAGE_SIZEOF_PEL(write->in) * r->width;
+	int n = (r->top / write->tile_height) * write->tiles_across +
+		r->left / write->tile_width;
+
+	VipsPel *q;
+	void *data;
+	size_t length;
+	int y;
+
+	g_assert(r->left % write->tile_width == 0);
+	g_assert(r->top % write->tile_height == 0);
+
+	q = seq->tile;
+	for (y = 0; y < r->height; y++) {
+		memcpy(q, VIPS_REGION_ADDR(region, r->left, r->top + y), ls);
+		q += ls;
+	}
+	data = seq->tile;
+	length = ls * r->height;
+
+#ifdef HAVE_ZSTD
+	if (write->level > 0) {
+		size_t result;
+
+		result = ZSTD_compressCCtx(seq->cctx,
+			seq->buf, seq->buf_size, data, length,
+			VIPS_CLIP(1, write->level, 22));
+		if (ZSTD_isError(result)) {
+			vips_error("vipssave",
+				"%s", ZSTD_getErrorName(result));
+			return -1;
+		}
+		data = seq->buf;
+		length = result;
+	}
+#endif /*HAVE_ZSTD*/
+
+	g_mutex_lock(&write->lock);
+
+	if (vips__seek(write->fd, write->offset, SEEK_SET) == -1 ||
+		vips__write(write->fd, data, length)) {
+		g_mutex_unlock(&write->lock);
+		return -1;
+	}
+	write->index[2 * n] = write->offset;
+	write->index[2 * n + 1] = length;
+	write->offset += length;
+
+	g_mutex_unlock(&write->lock);
+
+	return 0;
+}
+
+/* Write @in to @filename with the tiled layout. @level > 0 means compress
+ * tiles with zstd at that level.
+ */
+int
+vips__vipstiled_write(VipsImage *in, const char *filename,
+	int tile_width, int tile_height, int level)
+{
+	VipsTiledWrite write;
+	unsigned char header[VIPS_SIZEOF_HEADER];
+	unsigned char *preamble;
+	size_t preamble_size;
+	guint32 magic;
+	guint32 v;
+	gint64 xml_offset;
+	char *xml;
+	gint64 n_tiles;
+
+#ifndef HAVE_ZSTD
+	if (level > 0) {
+		vips_error("vipssave",
+			"%s", _("libvips built without zstd support"));
+		return -1;
+	}
+#endif /*!HAVE_ZSTD*/
+
+	write.in = in;
+	write.tile_width = tile_width;
+	write.tile_height = tile_height;
+	write.level = level;
+	write.tiles_across = VIPS_ROUND_UP(in->Xsize, tile_width) / tile_width;
+	write.tiles_down = VIPS_ROUND_UP(in->Ysize, tile_height) / tile_height;
+	n_tiles = (gint64) write.tiles_across * write.tiles_down;
+	if (n_tiles > VIPS_TILED_MAX_TILES) {
+		vips_error("vipssave", "%s", _("too many tiles"));
+		return -1;
+	}
+	preamble_size = VIPS_TILED_PREAMBLE + 2 * sizeof(guint64) * n_tiles;
+	write.offset = VIPS_SIZEOF_HEADER + preamble_size;
+
+	if (!(write.index = VIPS_ARRAY(NULL, 2 * n_tiles, guint64)))
+		return -1;
+	if (!(preamble = VIPS_ARRAY(NULL, preamble_size, unsigned char))) {
+		g_free(write.index);
+		return -1;
+	}
+	memset(preamble, 0, preamble_size);
+
+	if ((write.fd = vips__open_image_write(filename, FALSE)) < 0) {
+		g_free(preamble);
+		g_free(write.index);
+		return -1;
+	}
+	g_mutex_init(&write.lock);
+
+	/* We always write in native order. Build the header with a plain
+	 * magic, then swap in the tiled one.
+	 */
+	magic = in->magic;
+	in->magic = vips_amiMSBfirst() ? VIPS_MAGIC_SPARC : VIPS_MAGIC_INTEL;
+	vips__write_header_bytes(in, header);
+	in->magic = magic;
+	magic = vips_amiMSBfirst() ? VIPS_MAGIC_TILED_SPARC : VIPS_MAGIC_TILED_INTEL;
+	vips__copy_4byte(!vips_amiMSBfirst(), header, (unsigned char *) &magic);
+
+	/* The index is filled in at the end, write zeros for now.
+	 */
+	if (vips__write(write.fd, header, VIPS_SIZEOF_HEADER) ||
+		vips__write(write.fd, preamble, preamble_size) ||
+		vips_sink_tile(in, tile_width, tile_height,
+			vips_tiled_write_start, vips_tiled_write_tile,
+			vips_tiled_write_stop, &write, NULL))
+		goto error;
+
+	xml_offset = write.offset;
+	if (!(xml = vips__build_xml(in)))
+		goto error;
+	if (vips__seek(write.fd, xml_offset, SEEK_SET) == -1 ||
+		vips__write(write.fd, xml, strlen(xml))) {
+		g_free(xml);
+		goto error;
+	}
+	g_free(xml);
+
+	v = tile_width;
+	memcpy(preamble, &v, 4);
+	v = tile_height;
+	memcpy(preamble + 4, &v, 4);
+	v = level > 0 ? VIPS_TILED_ZSTD : VIPS_TILED_NONE;
+	memcpy(preamble + 8, &v, 4);
+	memcpy(preamble + 16, &xml_offset, 8);
+	memcpy(preamble + VIPS_TILED_PREAMBLE,
+		write.index, 2 * sizeof(guint64) * n_tiles);
+
+	if (vips__seek(write.fd, VIPS_SIZEOF_HEADER, SEEK_SET) == -1 ||
+		vips__write(write.fd, preamble, preamble_size))
+		goto error;
+
+#ifdef DEBUG
+	printf("vips__vipstiled_write: %" G_GINT64_FORMAT " tiles, "
+		   "%" G_GINT64_FORMAT " bytes\n",
+		n_tiles, xml_offset);
+#endif /*DEBUG*/
+
+	vips_tracked_close(write.fd);
+	g_mutex_clear(&write.lock);
+	g_free(preamble);
+	g_free(write.index);
+
+	return 0;
+
+error:
+	vips_tracked_close(write.fd);
+	g_mutex_clear(&write.lock);
+	g_free(preamble);
+	g_free(write.index);
+
+	return -1;
+}
+
+typedef struct _VipsTiledRead {
+	char *filename;
+	int fd;
+
+	int tile_width;
+	int tile_height;
+	int compression;
+	int tiles_across;
+	int tiles_down;
+
+	/* Offset and length of each tile.
+	 */
+	guint64 *index;
+
+	/* Largest tile in the file, in bytes.
+	 */
+	size_t max_length;
+
+	/* Many threads share the fd, lock around each seek and read.
+	 */
+	GMutex lock;
+} VipsTiledRead;
+
+static void
+vips_tiled_read_free(VipsTiledRead *tiled)
+{
+	if (tiled->fd != -1) {
+		vips_tracked_close(tiled->fd);
+		tiled->fd = -1;
+	}
+	g_mutex_clear(&tiled->lock);
+	VIPS_FREE(tiled->index);
+	VIPS_FREE(tiled->filename);
+	g_free(tiled);
+}
+
+static void
+vips_tiled_read_close_cb(VipsImage *image, VipsTiledRead *tiled)
+{
+	vips_tiled_read_free(tiled);
+}
+
+typedef struct _VipsTiledReadSeq {
+	VipsTiledRead *tiled;
+
+	/* Decode tiles to here.
+	 */
+	VipsPel *tile;
+
+	/* Compressed tile bytes.
+	 */
+	void *buf;
+
+#ifdef HAVE_ZSTD
+	ZSTD_DCtx *dctx;
+#endif /*HAVE_ZSTD*/
+} VipsTiledReadSeq;
+
+static int
+vips_tiled_read_stop(void *vseq, void *a, void *b)
+{
+	VipsTiledReadSeq *seq = (VipsTiledReadSeq *) vseq;
+
+#ifdef HAVE_ZSTD
+	VIPS_FREEF(ZSTD_freeDCtx, seq->dctx);
+#endif /*HAVE_ZSTD*/
+	VIPS_FREE(seq->buf);
+	VIPS_FREE(seq->tile);
+	g_free(seq);
+
+	return 0;
+}
+
+static void *
+vips_tiled_read_start(VipsImage *out, void *a, void *b)
+{
+	VipsTiledRead *tiled = (VipsTiledRead *) a;
+	size_t tile_size = VIPS_IMAGE_SIZEOF_PEL(out) *
+		tiled->tile_width * tiled->tile_height;
+
+	VipsTiledReadSeq *seq;
+
+	if (!(seq = VIPS_NEW(NULL, VipsTiledReadSeq)))
+		return NULL;
+	seq->tiled = tiled;
+	seq->buf = NULL;
+#ifdef HAVE_ZSTD
+	seq->dctx = NULL;
+#endif /*HAVE_ZSTD*/
+
+	if (!(seq->tile = VIPS_ARRAY(NULL, tile_size, VipsPel))) {
+		vips_tiled_read_stop(seq, a, b);
+		return NULL;
+	}
+
+#ifdef HAVE_ZSTD
+	if (tiled->compression == VIPS_TILED_ZSTD &&
+		(!(seq->buf = vips_malloc(NULL, tiled->max_length)) ||
+			!(seq->dctx = ZSTD_createDCtx()))) {
+		vips_tiled_read_stop(seq, a, b);
+		return NULL;
+	}
+#endif /*HAVE_ZSTD*/
+
+	return seq;
+}
+
+/* Read and decode tile @n, @size bytes when decoded.
+ */
+static int
+vips_tiled_read_tile(VipsTiledReadSeq *seq, int n, size_t size)
+{
+	VipsTiledRead *tiled = seq->tiled;
+	gint64 offset = tiled->index[2 * n];
+	size_t length = tiled->index[2 * n + 1];
+	void *to = tiled->compression == VIPS_TILED_NONE ? seq->tile : seq->buf;
+
+	g_mutex_lock(&tiled->lock);
+	if (vips__seek(tiled->fd, offset, SEEK_SET) == -1 ||
+		read(tiled->fd, to, length) != (gssize) length) {
+		g_mutex_unlock(&tiled->lock);
+		vips_error("vipsload",
+			_("unable to read tile %d from \"%s\""), n, tiled->filename);
+		return -1;
+	}
+	g_mutex_unlock(&tiled->lock);
+
+#ifdef HAVE_ZSTD
+	if (tiled->compression == VIPS_TILED_ZSTD) {
+		size_t result;
+
+		result = ZSTD_decompressDCtx(seq->dctx,
+			seq->tile, size, seq->buf, length);
+		if (ZSTD_isError(result) ||
+			result != size) {
+			vips_error("vipsload",
+				_("corrupt tile %d in \"%s\""), n, tiled->filename);
+			return -1;
+		}
+	}
+#endif /*HAVE_ZSTD*/
+
+	return 0;
+}
+
+static int
+vips_tiled_read_gen(VipsRegion *out_region,
+	void *vseq, void *a, void *b, gboolean *stop)
+{
+	VipsTiledReadSeq *seq = (VipsTiledReadSeq *) vseq;
+	VipsTiledRead *tiled = (VipsTiledRead *) a;
+	VipsImage *im = out_region->im;
+	VipsRect *r = &out_region->valid;
+	size_t ps = VIPS_IMAGE_SIZEOF_PEL(im);
+	int x0 = r->left / tiled->tile_width;
+	int y0 = r->top / tiled->tile_height;
+	int x1 = (VIPS_RECT_RIGHT(r) - 1) / tiled->tile_width;
+	int y1 = (VIPS_RECT_BOTTOM(r) - 1) / tiled->tile_height;
+
+	int tx, ty;
+
+	for (ty = y0; ty <= y1; ty++)
+		for (tx = x0; tx <= x1; tx++) {
+			VipsRect tile;
+			VipsRect image;
+			VipsRect hit;
+			int y;
+
+			image.left = 0;
+			image.top = 0;
+			image.width = im->Xsize;
+			image.height = im->Ysize;
+			tile.left = tx * tiled->tile_width;
+			tile.top = ty * tiled->tile_height;
+			tile.width = tiled->tile_width;
+			tile.height = tiled->tile_height;
+			vips_rect_intersectrect(&tile, &image, &tile);
+			vips_rect_intersectrect(&tile, r, &hit);
+
+			if (vips_tiled_read_tile(seq,
+					ty * tiled->tiles_across + tx,
+					ps * tile.width * tile.height))
+				return -1;
+
+			for (y = 0; y < hit.height; y++) {
+				VipsPel *p = seq->tile +
+					ps * ((hit.top - tile.top + y) * tile.width +
+						hit.left - tile.left);
+				VipsPel *q = VIPS_REGION_ADDR(out_region,
+					hit.left, hit.top + y);
+
+				memcpy(q, p, ps * hit.width);
+			}
+		}
+
+	return 0;
+}
+
+/* Read the preamble and tile index and sanity check them against the file.
+ */
+static int
+vips_tiled_read_index(VipsTiledRead *tiled, VipsImage *im, gboolean swap,
+	gint64 *xml_offset_out)
+{
+	unsigned char preamble[VIPS_TILED_PREAMBLE];
+	size_t ps = VIPS_IMAGE_SIZEOF_PEL(im);
+
+	guint32 v;
+	guint64 xml_offset;
+	gint64 file_length;
+	gint64 data_start;
+	gint64 n_tiles;
+	int i;
+
+	if (read(tiled->fd, preamble, VIPS_TILED_PREAMBLE) !=
+		VIPS_TILED_PREAMBLE)
+		goto corrupt;
+
+	vips__copy_4byte(swap, (unsigned char *) &v, preamble);
+	tiled->tile_width = v;
+	vips__copy_4byte(swap, (unsigned char *) &v, preamble + 4);
+	tiled->tile_height = v;
+	vips__copy_4byte(swap, (unsigned char *) &v, preamble + 8);
+	tiled->compression = v;
+	copy_8byte(swap, (unsigned char *) &xml_offset, preamble + 16);
+
+	if (tiled->tile_width < 1 ||
+		tiled->tile_width > VIPS_MAX_COORD ||
+		tiled->tile_height < 1 ||
+		tiled->tile_height > VIPS_MAX_COORD ||
+		ps * tiled->tile_width * tiled->tile_height > VIPS_TILED_MAX_TILE)
+		goto corrupt;
+
+	switch (tiled->compression) {
+	case VIPS_TILED_NONE:
+		break;
+
+	case VIPS_TILED_ZSTD:
+#ifndef HAVE_ZSTD
+		vips_error("vipsload",
+			"%s", _("libvips built without zstd support"));
+		return -1;
+#endif /*!HAVE_ZSTD*/
+		break;
+
+	default:
+		goto corrupt;
+	}
+
+	tiled->tiles_across =
+		VIPS_ROUND_UP(im->Xsize, tiled->tile_width) / tiled->tile_width;
+	tiled->tiles_down =
+		VIPS_ROUND_UP(im->Ysize, tiled->tile_height) / tiled->tile_height;
+	n_tiles = (gint64) tiled->tiles_across * tiled->tiles_down;
+	if (n_tiles > VIPS_TILED_MAX_TILES)
+		goto corrupt;
+	data_start = VIPS_SIZEOF_HEADER + VIPS_TILED_PREAMBLE +
+		2 * (gint64) sizeof(guint64) * n_tiles;
+
+	/* The index must fit before the XML, and the XML in the file, before
+	 * we allocate anything.
+	 */
+	if ((file_length = vips_file_length(tiled->fd)) == -1)
+		return -1;
+	if (xml_offset < (guint64) data_start ||
+		xml_offset > (guint64) file_length)
+		goto corrupt;
+
+	if (!(tiled->index = VIPS_ARRAY(NULL, 2 * n_tiles, guint64)))
+		return -1;
+	if (read(tiled->fd, tiled->index, 2 * sizeof(guint64) * n_tiles) !=
+		(gssize) (2 * sizeof(guint64) * n_tiles))
+		goto corrupt;
+
+	tiled->max_length = 0;
+	for (i = 0; i < n_tiles; i++) {
+		int tx = i % tiled->tiles_across;
+		int ty = i / tiled->tiles_across;
+		size_t size = ps *
+			VIPS_MIN(tiled->tile_width, im->Xsize - tx * tiled->tile_width) *
+			VIPS_MIN(tiled->tile_height, im->Ysize - ty * tiled->tile_height);
+
+		guint64 offset;
+		guint64 length;
+
+		copy_8byte(swap, (unsigned char *) &offset,
+			(unsigned char *) &tiled->index[2 * i]);
+		copy_8byte(swap, (unsigned char *) &length,
+			(unsigned char *) &tiled->index[2 * i + 1]);
+		tiled->index[2 * i] = offset;
+		tiled->index[2 * i + 1] = length;
+
+		if (offset < (guint64) data_start ||
+			offset > xml_offset ||
+			length > xml_offset - offset ||
+			length > VIPS_TILED_MAX_TILE ||
+			(tiled->compression == VIPS_TILED_NONE &&
+				length != size))
+			goto corrupt;
+
+		tiled->max_length = VIPS_MAX(tiled->max_length, length);
+	}
+
+	*xml_offset_out = xml_offset;
+
+	return 0;
+
+corrupt:
+	vips_error("vipsload",
+		_("\"%s\" has a corrupt tile index"), tiled->filename);
+	return -1;
+}
+
+/* Open @filename, a tiled vips file, as a partial image on @out.
+ */
+int
+vips__vipstiled_read(const char *filename, VipsImage *out)
+{
+	VipsImage **t = (VipsImage **)
+		vips_object_local_array(VIPS_OBJECT(out), 3);
+
+	VipsTiledRead *tiled;
+	unsigned char header[VIPS_SIZEOF_HEADER];
+	guint32 magic;
+	gboolean swap;
+	gint64 xml_offset;
+	VipsImage *in;
+
+	/* Tie the read state to the image we generate, so it lives as long as
+	 * any pipeline using it.
+	 */
+	t[0] = vips_image_new();
+	tiled = g_new0(VipsTiledRead, 1);
+	tiled->filename = g_strdup(filename);
+	tiled->fd = -1;
+	g_mutex_init(&tiled->lock);
+	g_signal_connect(t[0], "close",
+		G_CALLBACK(vips_tiled_read_close_cb), tiled);
+
+	if ((tiled->fd = vips__open_image_read(filename)) == -1)
+		return -1;
+	if (read(tiled->fd, header, VIPS_SIZEOF_HEADER) != VIPS_SIZEOF_HEADER) {
+		vips_error_system(errno, "vipsload",
+			_("unable to read header for \"%s\""), filename);
+		return -1;
+	}
+
+	/* Swap the tiled magic for the plain one, then we can use the
+	 * standard header reader.
+	 */
+	vips__copy_4byte(!vips_amiMSBfirst(), (unsigned char *) &magic, header);
+	if (magic == VIPS_MAGIC_TILED_INTEL)
+		magic = VIPS_MAGIC_INTEL;
+	else if (magic == VIPS_MAGIC_TILED_SPARC)
+		magic = VIPS_MAGIC_SPARC;
+	else {
+		vips_error("vipsload",
+			_("\"%s\" is not a tiled VIPS image"), filename);
+		return -1;
+	}
+	vips__copy_4byte(!vips_amiMSBfirst(), header, (unsigned char *) &magic);
+	if (vips__read_header_bytes(t[0], header))
+		return -1;
+	swap = vips_amiMSBfirst() != vips_image_isMSBfirst(t[0]);
+
+	if (vips_tiled_read_index(tiled, t[0], swap, &xml_offset))
+		return -1;
+
+	/* As vips_image_open_input(), bad XML is not an error.
+	 */
+	if (vips__readhist_fd(t[0], tiled->fd, xml_offset)) {
+		g_warning("error reading vips image metadata: %s",
+			vips_error_buffer());
+		vips_error_clear();
+	}
+
+#ifdef DEBUG
+	printf("vips__vipstiled_read: %d x %d tiles of %d x %d\n",
+		tiled->tiles_across, tiled->tiles_down,
+		tiled->tile_width, tiled->tile_height);
+#endif /*DEBUG*/
+
+	/* Many threads can decode tiles at once, we only lock around the
+	 * read. Cache enough tiles for two complete rows.
+	 */
+	if (vips_image_pipelinev(t[0], VIPS_DEMAND_STYLE_SMALLTILE, NULL) ||
+		vips_image_generate(t[0],
+			vips_tiled_read_start, vips_tiled_read_gen,
+			vips_tiled_read_stop, tiled, NULL) ||
+		vips_tilecache(t[0], &t[1],
+			"tile_width", tiled->tile_width,
+			"tile_height", tiled->tile_height,
+			"max_tiles", 2 * tiled->tiles_across,
+			"threaded", TRUE,
+			NULL))
+		return -1;
+	in = t[1];
+
+	if (swap) {
+		if (vips_byteswap(in, &t[2], NULL))
+			return -1;
+		in = t[2];
+	}
+
+	if (vips_image_write(in, out))
+		return -1;
+
+	return 0;
+}
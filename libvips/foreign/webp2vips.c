@@ -28,6 +28,11 @@
  * 	- revise for source IO
  * 27/10/21
  * 	- disable shrink-on-load if we need subpixel accuracy in animations
+ * 14/10/26
+ * 	- decode ahead on a background thread
+ * 15/10/26
+ * 	- add area, crop and scale in libwebp for still images
+ * 	- scale-on-load animations with frames that don't fill the canvas
  */
 
 /*
@@ -117,6 +122,16 @@ typedef struct {
 	int width;
 	int height;
 
+	/* Only output this area of the image, if width is non-zero.
+	 */
+	VipsRect area;
+
+	/* The part of the decoded image we output. For still images with an
+	 * area, we only decode the part of the canvas we need, so this is
+	 * the area in the coordinates of that crop.
+	 */
+	VipsRect crop;
+
 	/* TRUE if we will save the final image as RGBA.
 	 */
 	int alpha;
@@ -350,7 +365,8 @@ read_close_cb(VipsImage *image, Read *read)
 }
 
 static Read *
-read_new(VipsImage *out, VipsSource *source, int page, int n, double scale)
+read_new(VipsImage *out, VipsSource *source, int page, int n, double scale,
+	const VipsRect *area)
 {
 	Read *read;
 
@@ -363,6 +379,8 @@ read_new(VipsImage *out, VipsSource *source, int page, int n, double scale)
 	read->page = page;
 	read->n = n;
 	read->scale = scale;
+	if (area)
+		read->area = *area;
 	read->delays = NULL;
 	read->demux = NULL;
 	read->frame = NULL;
@@ -469,15 +487,6 @@ read_header(Read *read, VipsImage *out)
 					iter.width != read->canvas_width ||
 					iter.height != read->canvas_height)
 					read->alpha = TRUE;
-
-				/* We must disable shrink-on-load if any frame
-				 * does not fill the whole canvas. We won't be
-				 * able to shrink-on-load it to the exact
-				 * position in a downsized canvas.
-				 */
-				if (iter.width != read->canvas_width ||
-					iter.height != read->canvas_height)
-					read->scale = 1.0;
 			} while (WebPDemuxNextFrame(&iter));
 
 			vips_image_set_array_int(out,
@@ -551,6 +560,57 @@ read_header(Read *read, VipsImage *out)
 		return -1;
 	}
 
+	read->crop.left = 0;
+	read->crop.top = 0;
+	read->crop.width = read->width;
+	read->crop.height = read->height;
+
+	if (read->area.width) {
+		VipsRect whole = { 0, 0, read->width, read->height };
+
+		if (read->n > 1 ||
+			!vips_rect_includesrect(&whole, &read->area)) {
+			vips_error("webp", "%s", _("bad area"));
+			return -1;
+		}
+
+		read->crop = read->area;
+
+		if (!(flags & ANIMATION_FLAG)) {
+			WebPDecoderOptions *options = &read->config.options;
+			int left = VIPS_ROUND_DOWN(
+				(int) floor(read->area.left / read->scale), 2);
+			int top = VIPS_ROUND_DOWN(
+				(int) floor(read->area.top / read->scale), 2);
+			int right = VIPS_MIN(read->canvas_width,
+				ceil(VIPS_RECT_RIGHT(&read->area) / read->scale));
+			int bottom = VIPS_MIN(read->canvas_height,
+				ceil(VIPS_RECT_BOTTOM(&read->area) / read->scale));
+
+			/* Have libwebp decode just the part of the canvas we
+			 * need, then scale that. The crop has an even left and
+			 * top, since libwebp needs that for chroma.
+			 */
+			options->use_cropping = 1;
+			options->crop_left = left;
+			options->crop_top = top;
+			options->crop_width = right - left;
+			options->crop_height = bottom - top;
+
+			/* Round the edges, not the size, so we land on the
+			 * same pixels as a full decode.
+			 */
+			read->frame_width = rint(right * read->scale) -
+				rint(left * read->scale);
+			read->frame_height = rint(bottom * read->scale) -
+				rint(top * read->scale);
+			read->width = read->frame_width;
+			read->height = read->frame_height;
+			read->crop.left -= rint(left * read->scale);
+			read->crop.top -= rint(top * read->scale);
+		}
+	}
+
 	for (i = 0; i < vips__n_webp_names; i++) {
 		const char *vips = vips__webp_names[i].vips;
 		const char *webp = vips__webp_names[i].webp;
@@ -652,14 +712,26 @@ read_next_frame(Read *read)
 	printf("read_next_frame:\n");
 #endif /*DEBUG*/
 
-	/* Area of this frame, in output image coordinates. We must rint(),
-	 * since we need the same rules as the overall image scale, or we'll
-	 * sometimes have missing pixels on edges.
+	/* Area of this frame, in output image coordinates. We must rint()
+	 * the edges, since we need the same rules as the overall image
+	 * scale, or we'll sometimes have missing pixels between frames.
 	 */
-	area.left = rint(read->iter.x_offset * read->scale);
-	area.top = rint(read->iter.y_offset * read->scale);
-	area.width = rint(read->iter.width * read->scale);
-	area.height = rint(read->iter.height * read->scale);
+	if (read->config.options.use_cropping) {
+		area.left = 0;
+		area.top = 0;
+		area.width = read->frame_width;
+		area.height = read->frame_height;
+	}
+	else {
+		area.left = rint(read->iter.x_offset * read->scale);
+		area.top = rint(read->iter.y_offset * read->scale);
+		area.width = rint((read->iter.x_offset + read->iter.width) *
+						 read->scale) -
+			area.left;
+		area.height = rint((read->iter.y_offset + read->iter.height) *
+						  read->scale) -
+			area.top;
+	}
 
 	/* Dispose from the previous frame.
 	 */
@@ -702,19 +774,26 @@ read_next_frame(Read *read)
 		printf("don't blend\n");
 #endif /*DEBUG*/
 
-	if (!(frame = read_frame(read,
-			  area.width, area.height,
-			  read->iter.fragment.bytes, read->iter.fragment.size)))
-		return -1;
-
-	/* Now blend or copy the new pixels into our accumulator.
+	/* Tiny frames can vanish at small scales.
 	 */
-	vips_image_paint_image(read->frame, frame,
-		area.left, area.top,
-		read->iter.frame_num > 1 &&
-			read->iter.blend_method == WEBP_MUX_BLEND);
+	if (area.width > 0 &&
+		area.height > 0) {
+		/* Each frame is decoded straight to the output scale, then
+		 * blended or copied into our accumulator.
+		 */
+		if (!(frame = read_frame(read,
+				  area.width, area.height,
+				  read->iter.fragment.bytes,
+				  read->iter.fragment.size)))
+			return -1;
 
-	g_object_unref(frame);
+		vips_image_paint_image(read->frame, frame,
+			area.left, area.top,
+			read->iter.frame_num > 1 &&
+				read->iter.blend_method == WEBP_MUX_BLEND);
+
+		g_object_unref(frame);
+	}
 
 	/* If there's another frame, move on.
 	 */
@@ -785,7 +864,7 @@ static int
 read_image(Read *read, VipsImage *out)
 {
 	VipsImage **t = (VipsImage **)
-		vips_object_local_array(VIPS_OBJECT(out), 2);
+		vips_object_local_array(VIPS_OBJECT(out), 3);
 
 	/* Make the output pipeline.
 	 */
@@ -795,8 +874,13 @@ read_image(Read *read, VipsImage *out)
 
 	if (vips_image_generate(t[0],
 			NULL, read_webp_generate, NULL, read, NULL) ||
-		vips_sequential(t[0], &t[1], NULL) ||
-		vips_image_write(t[1], out))
+		vips_sequential(t[0], &t[1],
+			"prefetch", 64,
+			NULL) ||
+		vips_extract_area(t[1], &t[2],
+			read->crop.left, read->crop.top,
+			read->crop.width, read->crop.height, NULL) ||
+		vips_image_write(t[2], out))
 		return -1;
 
 	return 0;
@@ -804,24 +888,29 @@ read_image(Read *read, VipsImage *out)
 
 int
 vips__webp_read_header_source(VipsSource *source, VipsImage *out,
-	int page, int n, double scale)
+	int page, int n, double scale, const VipsRect *area)
 {
 	Read *read;
 
-	if (!(read = read_new(out, source, page, n, scale)) ||
+	if (!(read = read_new(out, source, page, n, scale, area)) ||
 		read_header(read, out))
 		return -1;
 
+	/* Patch in the size after any crop.
+	 */
+	out->Xsize = read->crop.width;
+	out->Ysize = read->crop.height;
+
 	return 0;
 }
 
 int
 vips__webp_read_source(VipsSource *source, VipsImage *out,
-	int page, int n, double scale)
+	int page, int n, double scale, const VipsRect *area)
 {
 	Read *read;
 
-	if (!(read = read_new(out, source, page, n, scale)) ||
+	if (!(read = read_new(out, source, page, n, scale, area)) ||
 		read_image(read, out))
 		return -1;
 
@@ -8,6 +8,10 @@
  * 	- add @page, @n
  * 30/4/19
  * 	- deprecate @shrink, use @scale instead
+ * 14/10/26
+ * 	- set VIPS_FOREIGN_ZERO_COPY
+ * 15/10/26
+ * 	- add "area"
  */
 
 /*
@@ -77,6 +81,11 @@ typedef struct _VipsForeignLoadWebp {
 	/* Old and deprecated scaling path.
 	 */
 	int shrink;
+
+	/* Only load this area, after scale.
+	 */
+	VipsArrayInt *area;
+	VipsRect area_rect;
 } VipsForeignLoadWebp;
 
 typedef VipsForeignLoadClass VipsForeignLoadWebpClass;
@@ -106,6 +115,26 @@ vips_foreign_load_webp_build(VipsObject *object)
 		webp->shrink != 0)
 		webp->scale = 1.0 / webp->shrink; // FIXME: Invalidates operation cache
 
+	if (webp->area) {
+		int n;
+		int *area = vips_array_int_get(webp->area, &n);
+
+		if (n != 4 ||
+			area[0] < 0 ||
+			area[1] < 0 ||
+			area[2] <= 0 ||
+			area[3] <= 0) {
+			vips_error("webpload",
+				"%s", _("area must be left, top, width, height"));
+			return -1;
+		}
+
+		webp->area_rect.left = area[0];
+		webp->area_rect.top = area[1];
+		webp->area_rect.width = area[2];
+		webp->area_rect.height = area[3];
+	}
+
 	return VIPS_OBJECT_CLASS(vips_foreign_load_webp_parent_class)
 		->build(object);
 }
@@ -113,13 +142,13 @@ vips_foreign_load_webp_build(VipsObject *object)
 static VipsForeignFlags
 vips_foreign_load_webp_get_flags(VipsForeignLoad *load)
 {
-	return 0;
+	return VIPS_FOREIGN_ZERO_COPY;
 }
 
 static VipsForeignFlags
 vips_foreign_load_webp_get_flags_filename(const char *filename)
 {
-	return 0;
+	return VIPS_FOREIGN_ZERO_COPY;
 }
 
 static int
@@ -128,7 +157,8 @@ vips_foreign_load_webp_header(VipsForeignLoad *load)
 	VipsForeignLoadWebp *webp = (VipsForeignLoadWebp *) load;
 
 	if (vips__webp_read_header_source(webp->source, load->out,
-			webp->page, webp->n, webp->scale))
+			webp->page, webp->n, webp->scale,
+			webp->area ? &webp->area_rect : NULL))
 		return -1;
 
 	return 0;
@@ -140,12 +170,18 @@ vips_foreign_load_webp_load(VipsForeignLoad *load)
 	VipsForeignLoadWebp *webp = (VipsForeignLoadWebp *) load;
 
 	if (vips__webp_read_source(webp->source, load->real,
-			webp->page, webp->n, webp->scale))
+			webp->page, webp->n, webp->scale,
+			webp->area ? &webp->area_rect : NULL))
 		return -1;
 
 	return 0;
 }
 
+static const VipsForeignMagic vips_foreign_load_webp_magic[] = {
+	{ 8, 4, "WEBP" },
+	{ 0, 0, NULL }
+};
+
 static void
 vips_foreign_load_webp_class_init(VipsForeignLoadWebpClass *class)
 {
@@ -170,6 +206,7 @@ vips_foreign_load_webp_class_init(VipsForeignLoadWebpClass *class)
 		vips_foreign_load_webp_get_flags_filename;
 	load_class->get_flags = vips_foreign_load_webp_get_flags;
 	load_class->header = vips_foreign_load_webp_header;
+	load_class->magic = vips_foreign_load_webp_magic;
 	load_class->load = vips_foreign_load_webp_load;
 
 	VIPS_ARG_INT(class, "page", 20,
@@ -199,6 +236,13 @@ vips_foreign_load_webp_class_init(VipsForeignLoadWebpClass *class)
 		VIPS_ARGUMENT_OPTIONAL_INPUT | VIPS_ARGUMENT_DEPRECATED,
 		G_STRUCT_OFFSET(VipsForeignLoadWebp, shrink),
 		1, 1024, 1);
+
+	VIPS_ARG_BOXED(class, "area", 24,
+		_("Area"),
+		_("Only load this left, top, width, height"),
+		VIPS_ARGUMENT_OPTIONAL_INPUT,
+		G_STRUCT_OFFSET(VipsForeignLoadWebp, area),
+		VIPS_TYPE_ARRAY_INT);
 }
 
 static void
@@ -439,8 +483,13 @@ vips_foreign_load_webp_buffer_init(VipsForeignLoadWebpBuffer *buffer)
  * to change page layout.
  *
  * Use @scale to specify a scale-on-load factor. For example, 2.0 to double
- * the size on load. Animated webp images don't support shrink-on-load, so a
- * further resize may be necessary.
+ * the size on load. Each frame of an animation is decoded directly at the
+ * new scale.
+ *
+ * @area is an array of left, top, width and height, and loads just that
+ * part of the image, after any scale. For still images, libwebp only
+ * decodes the part of the image which touches the area. @area can't be
+ * used with more than one page.
  *
  * The loader supports ICC, EXIF and XMP metadata.
  *
@@ -448,6 +497,7 @@ vips_foreign_load_webp_buffer_init(VipsForeignLoadWebpBuffer *buffer)
  *     * @page: `gint`, page (frame) to read
  *     * @n: `gint`, load this many pages
  *     * @scale: `gdouble`, scale by this much on load
+ *     * @area: [struct@ArrayInt], only load this left, top, width, height
  *
  * ::: seealso
  *     [ctor@Image.new_from_file].
@@ -484,6 +534,7 @@ vips_webpload(const char *filename, VipsImage **out, ...)
  *     * @page: `gint`, page (frame) to read
  *     * @n: `gint`, load this many pages
  *     * @scale: `gdouble`, scale by this much on load
+ *     * @area: [struct@ArrayInt], only load this left, top, width, height
  *
  * ::: seealso
  *     [ctor@Image.webpload]
@@ -522,6 +573,7 @@ vips_webpload_buffer(void *buf, size_t len, VipsImage **out, ...)
  *     * @page: `gint`, page (frame) to read
  *     * @n: `gint`, load this many pages
  *     * @scale: `gdouble`, scale by this much on load
+ *     * @area: [struct@ArrayInt], only load this left, top, width, height
  *
  * ::: seealso
  *     [ctor@Image.webpload]
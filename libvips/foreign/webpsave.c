@@ -30,6 +30,8 @@
  * 	- rename "reduction_effort" as "effort"
  * 7/9/22 dloebl
  * 	- switch to sink_disc
+ * 14/10/26
+ * 	- build the WebPPicture strip by strip, no frame copy
  */
 
 /*
@@ -194,10 +196,21 @@ typedef struct _VipsForeignSaveWebp {
 	int write_y;
 	int page_number;
 
-	/* VipsRegion is not always contiguous, but we need contiguous RGB(A)
-	 * for libwebp. We need to copy each frame to a local buffer.
+	/* The frame we are building. ARGB pictures are filled directly from
+	 * the pipeline, YUV pictures are imported a strip at a time.
 	 */
-	VipsPel *frame_bytes;
+	WebPPicture pic;
+	gboolean pic_allocated;
+
+	/* Contiguous RGB(A) scanlines for the next strip of a YUV picture,
+	 * and the number of lines we have.
+	 */
+	VipsPel *strip;
+	int strip_lines;
+
+	/* Set if any strip of the current frame has transparent pixels.
+	 */
+	gboolean has_alpha;
 } VipsForeignSaveWebp;
 
 typedef VipsForeignSaveClass VipsForeignSaveWebpClass;
@@ -238,7 +251,11 @@ vips_foreign_save_webp_dispose(GObject *gobject)
 
 	vips_foreign_save_webp_unset(webp);
 	VIPS_UNREF(webp->target);
-	VIPS_FREE(webp->frame_bytes);
+	if (webp->pic_allocated) {
+		WebPPictureFree(&webp->pic);
+		webp->pic_allocated = FALSE;
+	}
+	VIPS_FREE(webp->strip);
 
 	G_OBJECT_CLASS(vips_foreign_save_webp_parent_class)->dispose(gobject);
 }
@@ -267,34 +284,128 @@ vips_foreign_save_webp_pic_init(VipsForeignSaveWebp *webp, WebPPicture *pic)
 	return TRUE;
 }
 
-/* Write a VipsImage into an uninitialised pic.
+/* Number of scanlines we gather before importing to a YUV picture. This must
+ * be even, since chroma is subsampled vertically.
+ */
+#define STRIP_HEIGHT (16)
+
+/* Allocate the picture for a new frame.
  */
 static int
-vips_foreign_save_webp_write_webp_image(VipsForeignSaveWebp *webp,
-	const VipsPel *imagedata, WebPPicture *pic)
+vips_foreign_save_webp_pic_alloc(VipsForeignSaveWebp *webp)
 {
 	VipsForeignSave *save = (VipsForeignSave *) webp;
-	int page_height = vips_image_get_page_height(save->ready);
-
-	webp_import import;
+	WebPPicture *pic = &webp->pic;
 
 	if (!vips_foreign_save_webp_pic_init(webp, pic))
 		return -1;
 
 	pic->width = save->ready->Xsize;
-	pic->height = page_height;
+	pic->height = vips_image_get_page_height(save->ready);
+	if (!pic->use_argb)
+		pic->colorspace = save->ready->Bands == 4
+			? WEBP_YUV420A
+			: WEBP_YUV420;
+
+	if (!WebPPictureAlloc(pic)) {
+		vips_error("webpsave", "%s", _("picture memory error"));
+		return -1;
+	}
+	webp->pic_allocated = TRUE;
+	webp->strip_lines = 0;
+	webp->has_alpha = FALSE;
+
+	return 0;
+}
+
+/* Pack a scanline into an ARGB picture, exactly as WebPPictureImportRGB(A)
+ * would.
+ */
+static void
+vips_foreign_save_webp_pack_argb(VipsForeignSaveWebp *webp,
+	const VipsPel *p, int y)
+{
+	VipsForeignSave *save = (VipsForeignSave *) webp;
+	uint32_t *q = webp->pic.argb + (size_t) y * webp->pic.argb_stride;
+
+	if (save->ready->Bands == 4)
+		for (int x = 0; x < webp->pic.width; x++) {
+			q[x] = ((uint32_t) p[3] << 24) |
+				(p[0] << 16) | (p[1] << 8) | p[2];
+			p += 4;
+		}
+	else
+		for (int x = 0; x < webp->pic.width; x++) {
+			q[x] = 0xff000000u | (p[0] << 16) | (p[1] << 8) | p[2];
+			p += 3;
+		}
+}
+
+/* Convert the strip ending at line y to YUV and copy into the frame. Strips
+ * always start on an even line, so chroma is the same as a whole-frame
+ * import.
+ */
+static int
+vips_foreign_save_webp_import_strip(VipsForeignSaveWebp *webp, int y)
+{
+	VipsForeignSave *save = (VipsForeignSave *) webp;
+	WebPPicture *pic = &webp->pic;
+	int top = y - webp->strip_lines + 1;
+
+	WebPPicture strip;
+	webp_import import;
+
+	if (!WebPPictureInit(&strip)) {
+		vips_error("webpsave", "%s", _("picture version error"));
+		return -1;
+	}
+	strip.use_argb = 0;
+	strip.width = pic->width;
+	strip.height = webp->strip_lines;
 
 	if (save->ready->Bands == 4)
 		import = WebPPictureImportRGBA;
 	else
 		import = WebPPictureImportRGB;
 
-	if (!import(pic, imagedata, save->ready->Xsize * save->ready->Bands)) {
-		WebPPictureFree(pic);
+	if (!import(&strip, webp->strip, pic->width * save->ready->Bands)) {
+		WebPPictureFree(&strip);
 		vips_error("webpsave", "%s", _("picture memory error"));
 		return -1;
 	}
 
+	for (int i = 0; i < strip.height; i++)
+		memcpy(pic->y + (size_t) (top + i) * pic->y_stride,
+			strip.y + (size_t) i * strip.y_stride,
+			pic->width);
+
+	for (int i = 0; i < (strip.height + 1) / 2; i++) {
+		size_t q = (size_t) (top / 2 + i) * pic->uv_stride;
+		size_t p = (size_t) i * strip.uv_stride;
+
+		memcpy(pic->u + q, strip.u + p, (pic->width + 1) / 2);
+		memcpy(pic->v + q, strip.v + p, (pic->width + 1) / 2);
+	}
+
+	/* The importer drops alpha for opaque strips.
+	 */
+	if (pic->a)
+		for (int i = 0; i < strip.height; i++) {
+			uint8_t *q = pic->a + (size_t) (top + i) * pic->a_stride;
+
+			if (strip.a)
+				memcpy(q, strip.a + (size_t) i * strip.a_stride,
+					pic->width);
+			else
+				memset(q, 255, pic->width);
+		}
+
+	if (strip.a)
+		webp->has_alpha = TRUE;
+
+	WebPPictureFree(&strip);
+	webp->strip_lines = 0;
+
 	return 0;
 }
 
@@ -323,17 +434,24 @@ vips_foreign_save_webp_write_frame(VipsForeignSaveWebp *webp)
 {
 	VipsObjectClass *class = VIPS_OBJECT_GET_CLASS(webp);
 
-	WebPPicture pic;
+	WebPPicture *pic = &webp->pic;
 
-	if (vips_foreign_save_webp_write_webp_image(webp, webp->frame_bytes, &pic))
-		return -1;
+	/* A fully opaque frame is written without alpha, as the importer
+	 * would.
+	 */
+	if (!pic->use_argb &&
+		!webp->has_alpha) {
+		pic->colorspace = WEBP_YUV420;
+		pic->a = NULL;
+	}
 
 	/* Animated write
 	 */
 	if (webp->mode == VIPS_FOREIGN_SAVE_WEBP_MODE_ANIM) {
 		if (!WebPAnimEncoderAdd(webp->enc,
-				&pic, webp->timestamp_ms, &webp->config)) {
-			WebPPictureFree(&pic);
+				pic, webp->timestamp_ms, &webp->config)) {
+			WebPPictureFree(pic);
+			webp->pic_allocated = FALSE;
 			vips_error(class->nickname, "%s", _("anim add error"));
 			return -1;
 		}
@@ -346,14 +464,16 @@ vips_foreign_save_webp_write_frame(VipsForeignSaveWebp *webp)
 	else {
 		/* Single image write
 		 */
-		if (!WebPEncode(&webp->config, &pic)) {
-			WebPPictureFree(&pic);
+		if (!WebPEncode(&webp->config, pic)) {
+			WebPPictureFree(pic);
+			webp->pic_allocated = FALSE;
 			vips_error("webpsave", "%s", _("unable to encode"));
 			return -1;
 		}
 	}
 
-	WebPPictureFree(&pic);
+	WebPPictureFree(pic);
+	webp->pic_allocated = FALSE;
 
 	return 0;
 }
@@ -371,10 +491,25 @@ vips_foreign_save_webp_sink_disc(VipsRegion *region, VipsRect *area, void *a)
 	/* Write the new pixels into the frame.
 	 */
 	for (int i = 0; i < area->height; i++) {
-		memcpy(webp->frame_bytes +
-				area->width * webp->write_y * save->ready->Bands,
-			VIPS_REGION_ADDR(region, 0, area->top + i),
-			(size_t) area->width * save->ready->Bands);
+		VipsPel *p = VIPS_REGION_ADDR(region, 0, area->top + i);
+
+		if (!webp->pic_allocated &&
+			vips_foreign_save_webp_pic_alloc(webp))
+			return -1;
+
+		if (webp->pic.use_argb)
+			vips_foreign_save_webp_pack_argb(webp, p, webp->write_y);
+		else {
+			memcpy(webp->strip + (size_t) webp->strip_lines *
+					area->width * save->ready->Bands,
+				p, (size_t) area->width * save->ready->Bands);
+			webp->strip_lines += 1;
+
+			if ((webp->strip_lines == STRIP_HEIGHT ||
+					webp->write_y == page_height - 1) &&
+				vips_foreign_save_webp_import_strip(webp, webp->write_y))
+				return -1;
+		}
 
 		webp->write_y += 1;
 
@@ -725,13 +860,13 @@ vips_foreign_save_webp_build(VipsObject *object)
 		return -1;
 	}
 
-	/* RGB(A) frame as a contiguous buffer.
+	/* Contiguous RGB(A) scanlines for YUV import.
 	 */
-	size_t frame_size =
-		(size_t) save->ready->Bands * save->ready->Xsize * page_height;
-	webp->frame_bytes = g_try_malloc(frame_size);
-	if (webp->frame_bytes == NULL) {
-		vips_error("webpsave", _("failed to allocate %zu bytes"), frame_size);
+	size_t strip_size =
+		(size_t) save->ready->Bands * save->ready->Xsize * STRIP_HEIGHT;
+	webp->strip = g_try_malloc(strip_size);
+	if (webp->strip == NULL) {
+		vips_error("webpsave", _("failed to allocate %zu bytes"), strip_size);
 		return -1;
 	}
 
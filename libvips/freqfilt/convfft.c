@@ -0,0 +1,526 @@
+/* convolve with an FFT, tile by tile
+ *
+ * 14/10/26
+ * 	- from fwfft.c
+ */
+
+/*
+
+	This file is part of VIPS.
+
+	VIPS is free software; you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+	02110-1301  USA
+
+ */
+
+/*
+
+	These files are distributed with VIPS - http://www.vips.ecs.soton.ac.uk
+
+ */
+
+/* This is overlap-save convolution. Each output tile is made from a block
+ * of input the size of the tile plus the mask, transformed, multiplied by
+ * the transformed mask, and transformed back. The parts of the block which
+ * wrapped around are thrown away.
+ *
+ * Unlike fwfft / invfft, nothing needs the whole image in memory: each
+ * sequence has three FFT-sized buffers and that's all.
+ */
+
+/*
+#define DEBUG
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /*HAVE_CONFIG_H*/
+#include <glib/gi18n-lib.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vips/vips.h>
+#include <vips/internal.h>
+#include "pfreqfilt.h"
+
+#ifdef HAVE_FFTW
+
+#include <fftw3.h>
+
+typedef struct _VipsConvfft {
+	VipsFreqfilt parent_instance;
+
+	VipsImage *mask;
+
+	/* The mask as a double matrix.
+	 */
+	VipsImage *M;
+
+	/* FFT block size, and the size of the output block each FFT block
+	 * makes.
+	 */
+	int fft_width;
+	int fft_height;
+	int block_width;
+	int block_height;
+
+	/* The transformed, flipped mask, with the scale and the FFT
+	 * normalisation baked in.
+	 */
+	double *spectrum;
+
+} VipsConvfft;
+
+typedef VipsFreqfiltClass VipsConvfftClass;
+
+G_DEFINE_TYPE(VipsConvfft, vips_convfft, VIPS_TYPE_FREQFILT);
+
+typedef struct _VipsConvfftSequence {
+	VipsRegion *ir;
+
+	/* Real input block, half-complex product, real output block. All from
+	 * fftw_malloc(), so the cached plans always see the same alignment.
+	 */
+	double *in;
+	double *product;
+	double *out;
+} VipsConvfftSequence;
+
+static void
+vips_convfft_finalize(GObject *gobject)
+{
+	VipsConvfft *convfft = (VipsConvfft *) gobject;
+
+	VIPS_FREEF(fftw_free, convfft->spectrum);
+
+	G_OBJECT_CLASS(vips_convfft_parent_class)->finalize(gobject);
+}
+
+static int
+vips_convfft_stop(void *vseq, void *a, void *b)
+{
+	VipsConvfftSequence *seq = (VipsConvfftSequence *) vseq;
+
+	VIPS_UNREF(seq->ir);
+	VIPS_FREEF(fftw_free, seq->in);
+	VIPS_FREEF(fftw_free, seq->product);
+	VIPS_FREEF(fftw_free, seq->out);
+	VIPS_FREE(seq);
+
+	return 0;
+}
+
+static void *
+vips_convfft_start(VipsImage *out, void *a, void *b)
+{
+	VipsImage *in = (VipsImage *) a;
+	VipsConvfft *convfft = (VipsConvfft *) b;
+	const size_t n_real = (size_t) convfft->fft_width * convfft->fft_height;
+	const size_t n_half =
+		(size_t) convfft->fft_height * (convfft->fft_width / 2 + 1) * 2;
+
+	VipsConvfftSequence *seq;
+
+	if (!(seq = VIPS_NEW(NULL, VipsConvfftSequence)))
+		return NULL;
+	seq->in = NULL;
+	seq->product = NULL;
+	seq->out = NULL;
+
+	if (!(seq->ir = vips_region_new(in)) ||
+		!(seq->in = fftw_malloc(n_real * sizeof(double))) ||
+		!(seq->product = fftw_malloc(n_half * sizeof(double))) ||
+		!(seq->out = fftw_malloc(n_real * sizeof(double)))) {
+		vips_convfft_stop(seq, in, convfft);
+		return NULL;
+	}
+
+	/* Partial blocks are zero padded, but start with a clean buffer
+	 * anyway.
+	 */
+	memset(seq->in, 0, n_real * sizeof(double));
+
+	return (void *) seq;
+}
+
+#define LOAD(TYPE) \
+	{ \
+		for (int y = 0; y < height; y++) { \
+			TYPE *p = (TYPE *) VIPS_REGION_ADDR(ir, left, top + y); \
+			double *q = seq->in + (size_t) y * convfft->fft_width; \
+\
+			for (int x = 0; x < width; x++) \
+				q[x] = p[x * bands + b]; \
+		} \
+	}
+
+#define SAVE(TYPE) \
+	{ \
+		for (int y = 0; y < block->height; y++) { \
+			double *p = seq->out + (size_t) y * convfft->fft_width; \
+			TYPE *q = (TYPE *) VIPS_REGION_ADDR(out_region, \
+				block->left, block->top + y); \
+\
+			for (int x = 0; x < block->width; x++) \
+				q[x * bands + b] = p[x] + offset; \
+		} \
+	}
+
+/* Convolve one band of one block of output.
+ */
+static int
+vips_convfft_block(VipsConvfft *convfft, VipsConvfftSequence *seq,
+	VipsRegion *out_region, VipsRect *block, int b,
+	fftw_plan forward, fftw_plan inverse)
+{
+	VipsRegion *ir = seq->ir;
+	const int bands = ir->im->Bands;
+	const int left = block->left;
+	const int top = block->top;
+	const int width = block->width + convfft->M->Xsize - 1;
+	const int height = block->height + convfft->M->Ysize - 1;
+	const int half_width = convfft->fft_width / 2 + 1;
+	const size_t n_half = (size_t) convfft->fft_height * half_width;
+	const double offset = vips_image_get_offset(convfft->M);
+
+	if (width < convfft->fft_width ||
+		height < convfft->fft_height)
+		memset(seq->in, 0,
+			(size_t) convfft->fft_width * convfft->fft_height *
+				sizeof(double));
+
+	switch (ir->im->BandFmt) {
+	case VIPS_FORMAT_UCHAR:
+		LOAD(unsigned char);
+		break;
+
+	case VIPS_FORMAT_CHAR:
+		LOAD(signed char);
+		break;
+
+	case VIPS_FORMAT_USHORT:
+		LOAD(unsigned short);
+		break;
+
+	case VIPS_FORMAT_SHORT:
+		LOAD(signed short);
+		break;
+
+	case VIPS_FORMAT_UINT:
+		LOAD(unsigned int);
+		break;
+
+	case VIPS_FORMAT_INT:
+		LOAD(signed int);
+		break;
+
+	case VIPS_FORMAT_FLOAT:
+		LOAD(float);
+		break;
+
+	case VIPS_FORMAT_DOUBLE:
+		LOAD(double);
+		break;
+
+	default:
+		g_assert_not_reached();
+	}
+
+	fftw_execute_dft_r2c(forward, seq->in, (fftw_complex *) seq->product);
+
+	for (size_t i = 0; i < n_half; i++) {
+		double *p = seq->product + i * 2;
+		double *m = convfft->spectrum + i * 2;
+		double re = p[0] * m[0] - p[1] * m[1];
+		double im = p[0] * m[1] + p[1] * m[0];
+
+		p[0] = re;
+		p[1] = im;
+	}
+
+	fftw_execute_dft_c2r(inverse, (fftw_complex *) seq->product, seq->out);
+
+	switch (out_region->im->BandFmt) {
+	case VIPS_FORMAT_FLOAT:
+		SAVE(float);
+		break;
+
+	case VIPS_FORMAT_DOUBLE:
+		SAVE(double);
+		break;
+
+	default:
+		g_assert_not_reached();
+	}
+
+	return 0;
+}
+
+static int
+vips_convfft_gen(VipsRegion *out_region,
+	void *vseq, void *a, void *b, gboolean *stop)
+{
+	VipsConvfftSequence *seq = (VipsConvfftSequence *) vseq;
+	VipsConvfft *convfft = (VipsConvfft *) b;
+	VipsRect *r = &out_region->valid;
+
+	VipsRect s;
+	fftw_plan forward;
+	fftw_plan inverse;
+
+	s = *r;
+	s.width += convfft->M->Xsize - 1;
+	s.height += convfft->M->Ysize - 1;
+	if (vips_region_prepare(seq->ir, &s))
+		return -1;
+
+	/* These come from the plan cache, so this is cheap after the first
+	 * time.
+	 */
+	if (!(forward = vips__fft_plan(VIPS_FFT_R2C,
+			  convfft->fft_width, convfft->fft_height,
+			  seq->in, seq->product)) ||
+		!(inverse = vips__fft_plan(VIPS_FFT_C2R,
+			  convfft->fft_width, convfft->fft_height,
+			  seq->product, seq->out))) {
+		vips_error("convfft", "%s", _("unable to create transform plan"));
+		return -1;
+	}
+
+	for (int y = 0; y < r->height; y += convfft->block_height)
+		for (int x = 0; x < r->width; x += convfft->block_width) {
+			VipsRect block;
+
+			block.left = r->left + x;
+			block.top = r->top + y;
+			block.width = VIPS_MIN(convfft->block_width, r->width - x);
+			block.height = VIPS_MIN(convfft->block_height, r->height - y);
+
+			for (int b = 0; b < out_region->im->Bands; b++)
+				if (vips_convfft_block(convfft, seq, out_region,
+						&block, b, forward, inverse))
+					return -1;
+		}
+
+	return 0;
+}
+
+/* The smallest size >= n with factors of only 2, 3, 5 and 7. fftw is
+ * fastest for these.
+ */
+static int
+vips_convfft_size(int n)
+{
+	for (;; n++) {
+		int m = n;
+
+		while (m % 2 == 0)
+			m /= 2;
+		while (m % 3 == 0)
+			m /= 3;
+		while (m % 5 == 0)
+			m /= 5;
+		while (m % 7 == 0)
+			m /= 7;
+
+		if (m == 1)
+			return n;
+	}
+}
+
+/* Transform the mask. It's flipped, since we want the same result as
+ * vips_conv(), and wrapped around the origin.
+ */
+static int
+vips_convfft_spectrum(VipsConvfft *convfft)
+{
+	VipsImage *M = convfft->M;
+	const int fft_width = convfft->fft_width;
+	const int fft_height = convfft->fft_height;
+	const size_t n_real = (size_t) fft_width * fft_height;
+	const size_t n_half = (size_t) fft_height * (fft_width / 2 + 1) * 2;
+	const double scale = vips_image_get_scale(M) * n_real;
+
+	double *kernel;
+	fftw_plan plan;
+
+	if (!(kernel = fftw_malloc(n_real * sizeof(double))) ||
+		!(convfft->spectrum = fftw_malloc(n_half * sizeof(double)))) {
+		VIPS_FREEF(fftw_free, kernel);
+		vips_error("convfft", "%s", _("out of memory"));
+		return -1;
+	}
+
+	memset(kernel, 0, n_real * sizeof(double));
+	for (int y = 0; y < M->Ysize; y++)
+		for (int x = 0; x < M->Xsize; x++) {
+			int kx = (fft_width - x) % fft_width;
+			int ky = (fft_height - y) % fft_height;
+
+			kernel[ky * fft_width + kx] = *VIPS_MATRIX(M, x, y) / scale;
+		}
+
+	if (!(plan = vips__fft_plan(VIPS_FFT_R2C, fft_width, fft_height,
+			  kernel, convfft->spectrum))) {
+		fftw_free(kernel);
+		vips_error("convfft", "%s", _("unable to create transform plan"));
+		return -1;
+	}
+	fftw_execute_dft_r2c(plan, kernel, (fftw_complex *) convfft->spectrum);
+
+	fftw_free(kernel);
+
+	return 0;
+}
+
+static int
+vips_convfft_build(VipsObject *object)
+{
+	VipsObjectClass *class = VIPS_OBJECT_GET_CLASS(object);
+	VipsFreqfilt *freqfilt = VIPS_FREQFILT(object);
+	VipsConvfft *convfft = (VipsConvfft *) object;
+	VipsImage **t = (VipsImage **) vips_object_local_array(object, 3);
+
+	VipsImage *in;
+	VipsImage *M;
+
+	if (VIPS_OBJECT_CLASS(vips_convfft_parent_class)->build(object))
+		return -1;
+
+	if (vips_check_matrix(class->nickname, convfft->mask, &t[0]))
+		return -1;
+	convfft->M = M = t[0];
+
+	in = freqfilt->in;
+	if (vips_image_decode(in, &t[1]))
+		return -1;
+	in = t[1];
+	if (vips_check_noncomplex(class->nickname, in))
+		return -1;
+
+	/* Each FFT block makes at least as many output pixels as the mask
+	 * has margin, and at least a 128x128 tile.
+	 */
+	convfft->fft_width = vips_convfft_size(
+		VIPS_MAX(2 * (M->Xsize - 1), 128 + M->Xsize - 1));
+	convfft->fft_height = vips_convfft_size(
+		VIPS_MAX(2 * (M->Ysize - 1), 128 + M->Ysize - 1));
+	convfft->block_width = convfft->fft_width - M->Xsize + 1;
+	convfft->block_height = convfft->fft_height - M->Ysize + 1;
+
+	g_info("convfft: %d x %d transforms",
+		convfft->fft_width, convfft->fft_height);
+
+	if (vips_convfft_spectrum(convfft))
+		return -1;
+
+	if (vips_embed(in, &t[2],
+			M->Xsize / 2, M->Ysize / 2,
+			in->Xsize + M->Xsize - 1, in->Ysize + M->Ysize - 1,
+			"extend", VIPS_EXTEND_COPY,
+			NULL))
+		return -1;
+	in = t[2];
+
+	if (vips_image_pipelinev(freqfilt->out,
+			VIPS_DEMAND_STYLE_SMALLTILE, in, NULL))
+		return -1;
+	freqfilt->out->Xsize -= M->Xsize - 1;
+	freqfilt->out->Ysize -= M->Ysize - 1;
+	freqfilt->out->BandFmt = in->BandFmt == VIPS_FORMAT_DOUBLE
+		? VIPS_FORMAT_DOUBLE
+		: VIPS_FORMAT_FLOAT;
+
+	if (vips_image_generate(freqfilt->out,
+			vips_convfft_start, vips_convfft_gen, vips_convfft_stop,
+			in, convfft))
+		return -1;
+
+	freqfilt->out->Xoffset = -M->Xsize / 2;
+	freqfilt->out->Yoffset = -M->Ysize / 2;
+
+	return 0;
+}
+
+static void
+vips_convfft_class_init(VipsConvfftClass *class)
+{
+	GObjectClass *gobject_class = G_OBJECT_CLASS(class);
+	VipsObjectClass *vobject_class = VIPS_OBJECT_CLASS(class);
+
+	gobject_class->finalize = vips_convfft_finalize;
+	gobject_class->set_property = vips_object_set_property;
+	gobject_class->get_property = vips_object_get_property;
+
+	vobject_class->nickname = "convfft";
+	vobject_class->description = _("convolve with an FFT, tile by tile");
+	vobject_class->build = vips_convfft_build;
+
+	VIPS_ARG_IMAGE(class, "mask", 2,
+		_("Mask"),
+		_("Input matrix image"),
+		VIPS_ARGUMENT_REQUIRED_INPUT,
+		G_STRUCT_OFFSET(VipsConvfft, mask));
+}
+
+static void
+vips_convfft_init(VipsConvfft *convfft)
+{
+}
+
+#endif /*HAVE_FFTW*/
+
+/**
+ * vips_convfft: (method)
+ * @in: input image
+ * @out: (out): output image
+ * @mask: convolve with this mask
+ * @...: `NULL`-terminated list of optional named arguments
+ *
+ * Convolve @in with @mask using the FFT. The result is the same as
+ * [method@Image.conv] with `precision` set to float: each output pixel is
+ * sigma[i]{pixel[i] * mask[i]} / scale + offset.
+ *
+ * The image is processed in blocks, so unlike [method@Image.fwfft] it does
+ * not need the whole image in memory. Each block costs a forward and an
+ * inverse transform, so the time per pixel hardly depends on the mask size.
+ * This is much faster than [method@Image.conv] for large masks, perhaps
+ * 31x31 and up, and slower for small ones.
+ *
+ * The output is float, or double for double input. Complex images are not
+ * supported.
+ *
+ * VIPS uses the fftw Fourier Transform library. If this library was not
+ * available when VIPS was configured, this function will fail.
+ *
+ * ::: seealso
+ *     [method@Image.conv], [method@Image.freqmult].
+ *
+ * Returns: 0 on success, -1 on error.
+ */
+int
+vips_convfft(VipsImage *in, VipsImage **out, VipsImage *mask, ...)
+{
+	va_list ap;
+	int result;
+
+	va_start(ap, mask);
+	result = vips_call_split("convfft", ap, in, out, mask);
+	va_end(ap);
+
+	return result;
+}
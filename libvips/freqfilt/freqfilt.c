@@ -2,6 +2,13 @@
  *
  * properties:
  * 	- single output image
+ *
+ * 14/10/26
+ * 	- add a plan cache, fftw threads and wisdom import / export
+ * 14/10/26
+ * 	- register convfft
+ * 15/10/26
+ * 	- in-place r2c / c2r plans, single precision plans with fftwf
  */
 
 /*
@@ -144,6 +151,442 @@ vips__fftproc(VipsObject *context,
 	return 0;
 }
 
+#ifdef HAVE_FFTW
+
+/* Transforms with at least this many pixels are planned with
+ * vips_concurrency_get() threads, if fftw has thread support. Smaller
+ * transforms are faster single-threaded, and callers like phasecor are
+ * usually running many of them in parallel anyway.
+ */
+#define VIPS_FFT_THREADS_MIN_PELS (512 * 512)
+
+/* Planning with FFTW_MEASURE is slow, much slower than the transform itself
+ * for small images, so we keep every plan we make. Plans are never freed:
+ * another thread could be executing one at any time.
+ *
+ * The new-array execute functions need arrays with the same alignment and
+ * in-placeness as the ones the plan was made with, so that's part of the
+ * key.
+ */
+typedef struct _VipsFftPlan {
+	VipsFftKind kind;
+	gboolean single;
+	int width;
+	int height;
+	int in_align;
+	int out_align;
+	gboolean inplace;
+	int n_threads;
+
+	/* An fftw_plan or an fftwf_plan, depending on @single.
+	 */
+	void *plan;
+} VipsFftPlan;
+
+/* Protected by vips__fft_lock.
+ */
+static GSList *vips_fft_plans = NULL;
+
+static int
+vips_fft_n_threads(gboolean single, int width, int height)
+{
+	gboolean threaded;
+
+	threaded = FALSE;
+
+#ifdef HAVE_FFTW_THREADS
+	if (!single) {
+		static gboolean threads_init = FALSE;
+
+		if (!threads_init) {
+			fftw_init_threads();
+			threads_init = TRUE;
+		}
+
+		threaded = TRUE;
+	}
+#endif /*HAVE_FFTW_THREADS*/
+
+#ifdef HAVE_FFTWF_THREADS
+	if (single) {
+		static gboolean threadsf_init = FALSE;
+
+		if (!threadsf_init) {
+			fftwf_init_threads();
+			threadsf_init = TRUE;
+		}
+
+		threaded = TRUE;
+	}
+#endif /*HAVE_FFTWF_THREADS*/
+
+	if (threaded &&
+		(guint64) width * height >= VIPS_FFT_THREADS_MIN_PELS)
+		return vips_concurrency_get();
+
+	return 1;
+}
+
+/* Look for a plan in the cache. Call with vips__fft_lock held.
+ */
+static void *
+vips_fft_plan_lookup(VipsFftPlan *key)
+{
+	GSList *p;
+
+	for (p = vips_fft_plans; p; p = p->next) {
+		VipsFftPlan *entry = (VipsFftPlan *) p->data;
+
+		if (entry->kind == key->kind &&
+			entry->single == key->single &&
+			entry->width == key->width &&
+			entry->height == key->height &&
+			entry->in_align == key->in_align &&
+			entry->out_align == key->out_align &&
+			entry->inplace == key->inplace &&
+			entry->n_threads == key->n_threads)
+			return entry->plan;
+	}
+
+	return NULL;
+}
+
+/* Add a new plan to the cache. Call with vips__fft_lock held.
+ */
+static void
+vips_fft_plan_add(VipsFftPlan *key, void *plan)
+{
+	VipsFftPlan *entry;
+
+	entry = g_new(VipsFftPlan, 1);
+	*entry = *key;
+	entry->plan = plan;
+	vips_fft_plans = g_slist_prepend(vips_fft_plans, entry);
+}
+
+/* The number of elements of size @element we need for the input and output
+ * arrays of a transform. In-place r2c and c2r transforms have the real image
+ * padded out to the width of the half-complex one.
+ */
+static void
+vips_fft_plan_sizes(VipsFftKind kind, int width, int height, gboolean inplace,
+	size_t *n_in, size_t *n_out)
+{
+	const size_t n_real = (size_t) width * height;
+	const size_t n_complex = n_real * 2;
+	const size_t n_half = (size_t) height * (width / 2 + 1) * 2;
+
+	switch (kind) {
+	case VIPS_FFT_R2C:
+		*n_in = inplace ? n_half : n_real;
+		*n_out = n_half;
+		break;
+
+	case VIPS_FFT_C2C_FORWARD:
+	case VIPS_FFT_C2C_BACKWARD:
+		*n_in = n_complex;
+		*n_out = n_complex;
+		break;
+
+	case VIPS_FFT_C2R:
+		*n_in = n_half;
+		*n_out = inplace ? n_half : n_real;
+		break;
+
+	default:
+		g_assert_not_reached();
+	}
+}
+
+/* Allocate a scratch buffer with the same fftw alignment as @align.
+ */
+static double *
+vips_fft_scratch(size_t n, int align, void **mem)
+{
+	if (!(*mem = fftw_malloc(n * sizeof(double) + 64)))
+		return NULL;
+
+	return (double *) ((char *) *mem + align);
+}
+
+/* Find or make a plan for a transform of @in to @out. The plan must only be
+ * run with the new-array execute functions. Don't free it.
+ *
+ * c2c transforms are always in place. r2c and c2r transforms can be in place
+ * if @in == @out, in which case rows of real pixels must be padded to
+ * (width / 2 + 1) * 2 elements.
+ *
+ * Yes, fftw really does use nx for height and ny for width.
+ */
+fftw_plan
+vips__fft_plan(VipsFftKind kind, int width, int height, double *in, double *out)
+{
+	VipsFftPlan key;
+	size_t n_in;
+	size_t n_out;
+	void *in_mem;
+	void *out_mem;
+	double *in_scratch;
+	double *out_scratch;
+	fftw_plan plan;
+
+	key.kind = kind;
+	key.single = FALSE;
+	key.width = width;
+	key.height = height;
+	key.in_align = fftw_alignment_of(in);
+	key.out_align = fftw_alignment_of(out);
+	key.inplace = in == out ||
+		kind == VIPS_FFT_C2C_FORWARD ||
+		kind == VIPS_FFT_C2C_BACKWARD;
+
+	g_mutex_lock(&vips__fft_lock);
+
+	key.n_threads = vips_fft_n_threads(FALSE, width, height);
+
+	if ((plan = (fftw_plan) vips_fft_plan_lookup(&key))) {
+		g_mutex_unlock(&vips__fft_lock);
+		return plan;
+	}
+
+	/* FFTW_MEASURE overwrites the arrays, so plan on scratch buffers.
+	 */
+	vips_fft_plan_sizes(kind, width, height, key.inplace, &n_in, &n_out);
+	out_mem = NULL;
+	in_scratch = vips_fft_scratch(VIPS_MAX(n_in, n_out),
+		key.in_align, &in_mem);
+	if (key.inplace)
+		out_scratch = in_scratch;
+	else
+		out_scratch = vips_fft_scratch(n_out, key.out_align, &out_mem);
+
+	plan = NULL;
+	if (in_scratch &&
+		out_scratch) {
+#ifdef HAVE_FFTW_THREADS
+		fftw_plan_with_nthreads(key.n_threads);
+#endif /*HAVE_FFTW_THREADS*/
+
+		switch (kind) {
+		case VIPS_FFT_R2C:
+			plan = fftw_plan_dft_r2c_2d(height, width,
+				in_scratch, (fftw_complex *) out_scratch,
+				FFTW_MEASURE);
+			break;
+
+		case VIPS_FFT_C2C_FORWARD:
+		case VIPS_FFT_C2C_BACKWARD:
+			plan = fftw_plan_dft_2d(height, width,
+				(fftw_complex *) in_scratch,
+				(fftw_complex *) out_scratch,
+				kind == VIPS_FFT_C2C_FORWARD
+					? FFTW_FORWARD
+					: FFTW_BACKWARD,
+				FFTW_MEASURE);
+			break;
+
+		case VIPS_FFT_C2R:
+			plan = fftw_plan_dft_c2r_2d(height, width,
+				(fftw_complex *) in_scratch, out_scratch,
+				FFTW_MEASURE);
+			break;
+
+		default:
+			g_assert_not_reached();
+		}
+	}
+
+	if (in_mem)
+		fftw_free(in_mem);
+	if (out_mem)
+		fftw_free(out_mem);
+
+	if (plan)
+		vips_fft_plan_add(&key, plan);
+
+	g_mutex_unlock(&vips__fft_lock);
+
+	return plan;
+}
+
+#ifdef HAVE_FFTWF
+
+static float *
+vips_fftf_scratch(size_t n, int align, void **mem)
+{
+	if (!(*mem = fftwf_malloc(n * sizeof(float) + 64)))
+		return NULL;
+
+	return (float *) ((char *) *mem + align);
+}
+
+/* As vips__fft_plan(), but single precision.
+ */
+fftwf_plan
+vips__fftf_plan(VipsFftKind kind, int width, int height, float *in, float *out)
+{
+	VipsFftPlan key;
+	size_t n_in;
+	size_t n_out;
+	void *in_mem;
+	void *out_mem;
+	float *in_scratch;
+	float *out_scratch;
+	fftwf_plan plan;
+
+	key.kind = kind;
+	key.single = TRUE;
+	key.width = width;
+	key.height = height;
+	key.in_align = fftwf_alignment_of(in);
+	key.out_align = fftwf_alignment_of(out);
+	key.inplace = in == out ||
+		kind == VIPS_FFT_C2C_FORWARD ||
+		kind == VIPS_FFT_C2C_BACKWARD;
+
+	g_mutex_lock(&vips__fft_lock);
+
+	key.n_threads = vips_fft_n_threads(TRUE, width, height);
+
+	if ((plan = (fftwf_plan) vips_fft_plan_lookup(&key))) {
+		g_mutex_unlock(&vips__fft_lock);
+		return plan;
+	}
+
+	vips_fft_plan_sizes(kind, width, height, key.inplace, &n_in, &n_out);
+	out_mem = NULL;
+	in_scratch = vips_fftf_scratch(VIPS_MAX(n_in, n_out),
+		key.in_align, &in_mem);
+	if (key.inplace)
+		out_scratch = in_scratch;
+	else
+		out_scratch = vips_fftf_scratch(n_out, key.out_align, &out_mem);
+
+	plan = NULL;
+	if (in_scratch &&
+		out_scratch) {
+#ifdef HAVE_FFTWF_THREADS
+		fftwf_plan_with_nthreads(key.n_threads);
+#endif /*HAVE_FFTWF_THREADS*/
+
+		switch (kind) {
+		case VIPS_FFT_R2C:
+			plan = fftwf_plan_dft_r2c_2d(height, width,
+				in_scratch, (fftwf_complex *) out_scratch,
+				FFTW_MEASURE);
+			break;
+
+		case VIPS_FFT_C2C_FORWARD:
+		case VIPS_FFT_C2C_BACKWARD:
+			plan = fftwf_plan_dft_2d(height, width,
+				(fftwf_complex *) in_scratch,
+				(fftwf_complex *) out_scratch,
+				kind == VIPS_FFT_C2C_FORWARD
+					? FFTW_FORWARD
+					: FFTW_BACKWARD,
+				FFTW_MEASURE);
+			break;
+
+		case VIPS_FFT_C2R:
+			plan = fftwf_plan_dft_c2r_2d(height, width,
+				(fftwf_complex *) in_scratch, out_scratch,
+				FFTW_MEASURE);
+			break;
+
+		default:
+			g_assert_not_reached();
+		}
+	}
+
+	if (in_mem)
+		fftwf_free(in_mem);
+	if (out_mem)
+		fftwf_free(out_mem);
+
+	if (plan)
+		vips_fft_plan_add(&key, plan);
+
+	g_mutex_unlock(&vips__fft_lock);
+
+	return plan;
+}
+
+#endif /*HAVE_FFTWF*/
+
+#endif /*HAVE_FFTW*/
+
+/**
+ * vips_fft_wisdom_import:
+ * @filename: file to read
+ *
+ * Load fftw wisdom from @filename. Wisdom records good transform plans,
+ * loading it at startup can greatly reduce the time taken to plan the first
+ * transform of each size.
+ *
+ * ::: seealso
+ *     [func@fft_wisdom_export].
+ *
+ * Returns: 0 on success, -1 on error.
+ */
+int
+vips_fft_wisdom_import(const char *filename)
+{
+#ifdef HAVE_FFTW
+	int result;
+
+	g_mutex_lock(&vips__fft_lock);
+	result = fftw_import_wisdom_from_filename(filename);
+	g_mutex_unlock(&vips__fft_lock);
+
+	if (!result) {
+		vips_error("vips_fft_wisdom_import",
+			_("unable to read wisdom from \"%s\""), filename);
+		return -1;
+	}
+
+	return 0;
+#else  /*!HAVE_FFTW*/
+	vips_error("vips_fft_wisdom_import",
+		"%s", _("libvips built without FFT support"));
+	return -1;
+#endif /*HAVE_FFTW*/
+}
+
+/**
+ * vips_fft_wisdom_export:
+ * @filename: file to write
+ *
+ * Save all the fftw wisdom gathered so far to @filename.
+ *
+ * ::: seealso
+ *     [func@fft_wisdom_import].
+ *
+ * Returns: 0 on success, -1 on error.
+ */
+int
+vips_fft_wisdom_export(const char *filename)
+{
+#ifdef HAVE_FFTW
+	int result;
+
+	g_mutex_lock(&vips__fft_lock);
+	result = fftw_export_wisdom_to_filename(filename);
+	g_mutex_unlock(&vips__fft_lock);
+
+	if (!result) {
+		vips_error("vips_fft_wisdom_export",
+			_("unable to write wisdom to \"%s\""), filename);
+		return -1;
+	}
+
+	return 0;
+#else  /*!HAVE_FFTW*/
+	vips_error("vips_fft_wisdom_export",
+		"%s", _("libvips built without FFT support"));
+	return -1;
+#endif /*HAVE_FFTW*/
+}
+
 /* Called from iofuncs to init all operations in this dir. Use a plugin system
  * instead?
  */
@@ -153,6 +596,7 @@ vips_freqfilt_operation_init(void)
 #ifdef HAVE_FFTW
 	extern GType vips_fwfft_get_type(void);
 	extern GType vips_invfft_get_type(void);
+	extern GType vips_convfft_get_type(void);
 #endif /*HAVE_FFTW*/
 	extern GType vips_freqmult_get_type(void);
 	extern GType vips_spectrum_get_type(void);
@@ -161,6 +605,7 @@ vips_freqfilt_operation_init(void)
 #ifdef HAVE_FFTW
 	vips_fwfft_get_type();
 	vips_invfft_get_type();
+	vips_convfft_get_type();
 #endif /*HAVE_FFTW*/
 	vips_freqmult_get_type();
 	vips_spectrum_get_type();
@@ -15,6 +15,8 @@
  *	- use im_invfftr() to get real back for speedup
  * 3/1/14
  * 	- redone as a class
+ * 15/10/26
+ * 	- keep real images as half spectra all the way through
  */
 
 /*
@@ -65,6 +67,35 @@ typedef VipsFreqfiltClass VipsFreqmultClass;
 
 G_DEFINE_TYPE(VipsFreqmult, vips_freqmult, VIPS_TYPE_FREQFILT);
 
+/* Multiply a spectrum by the mask. Half spectra only need the left half of
+ * a full-width mask.
+ */
+static int
+vips_freqmult_multiply(VipsFreqmult *freqmult, VipsImage *in, VipsImage **out)
+{
+	VipsImage **t = (VipsImage **)
+		vips_object_local_array(VIPS_OBJECT(freqmult), 1);
+
+	VipsImage *mask;
+	int width;
+
+	mask = freqmult->mask;
+	if (vips_image_get_typeof(in, VIPS__FFT_WIDTH)) {
+		if (vips_image_get_int(in, VIPS__FFT_WIDTH, &width))
+			return -1;
+
+		if (mask->Xsize == width &&
+			mask->Xsize != in->Xsize) {
+			if (vips_extract_area(mask, &t[0],
+					0, 0, in->Xsize, mask->Ysize, NULL))
+				return -1;
+			mask = t[0];
+		}
+	}
+
+	return vips_multiply(in, mask, out, NULL);
+}
+
 static int
 vips_freqmult_build(VipsObject *object)
 {
@@ -80,7 +111,7 @@ vips_freqmult_build(VipsObject *object)
 	in = freqfilt->in;
 
 	if (vips_band_format_iscomplex(in->BandFmt)) {
-		if (vips_multiply(in, freqmult->mask, &t[0], NULL) ||
+		if (vips_freqmult_multiply(freqmult, in, &t[0]) ||
 			vips_invfft(t[0], &t[1], "real", TRUE, NULL))
 			return -1;
 
@@ -94,11 +125,14 @@ vips_freqmult_build(VipsObject *object)
 		 *
 		 * FIXME does this actually work now we're a class? test
 		 * perhaps we need a temporary object
+		 *
+		 * The spectrum of a real image is symmetric, so we only need
+		 * to transform and filter the left half.
 		 */
 		t[4] = vips_image_new_memory();
 
-		if (vips_fwfft(in, &t[0], NULL) ||
-			vips_multiply(t[0], freqmult->mask, &t[1], NULL) ||
+		if (vips_fwfft(in, &t[0], "half", TRUE, NULL) ||
+			vips_freqmult_multiply(freqmult, t[0], &t[1]) ||
 			vips_invfft(t[1], &t[2], "real", TRUE, NULL) ||
 			vips_cast(t[2], &t[3], in->BandFmt, NULL) ||
 			vips_image_write(t[3], t[4]))
@@ -151,6 +185,10 @@ vips_freqmult_init(VipsFreqmult *freqmult)
  * transformed back to real space. If @in is already a complex image, just
  * multiply then inverse transform.
  *
+ * Real images are transformed to a half spectrum (see [method@Image.fwfft])
+ * and only multiplied by the left half of @mask, which saves a lot of
+ * memory for large images.
+ *
  * ::: seealso
  *     [method@Image.invfft], [ctor@Image.mask_ideal].
  *
@@ -39,6 +39,10 @@
  * 	- redone as a class
  * 15/12/23 [akash-akya]
  *	- add locks
+ * 14/10/26
+ *	- use the plan cache
+ * 15/10/26
+ *	- add "half" for half-spectrum output, single precision with fftwf
  */
 
 /*
@@ -75,6 +79,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <vips/vips.h>
 #include <vips/internal.h>
@@ -87,6 +92,8 @@
 typedef struct _VipsFwfft {
 	VipsFreqfilt parent_instance;
 
+	gboolean half;
+
 } VipsFwfft;
 
 typedef VipsFreqfiltClass VipsFwfftClass;
@@ -109,7 +116,6 @@ rfwfft1(VipsObject *object, VipsImage *in, VipsImage **out)
 	const int half_width = in->Xsize / 2 + 1;
 
 	double *half_complex;
-	double *planner_scratch;
 
 	fftw_plan plan;
 	double *buf, *q, *p;
@@ -126,34 +132,19 @@ rfwfft1(VipsObject *object, VipsImage *in, VipsImage **out)
 		vips_image_write(t[0], t[1]))
 		return -1;
 
-	/* Make the plan for the transform. Yes, they really do use nx for
-	 * height and ny for width. Use a separate scratch buffer for the
-	 * planner, we can't overwrite real->data
-	 */
-	if (!(planner_scratch = VIPS_ARRAY(fwfft,
-			  VIPS_IMAGE_N_PELS(in), double)))
-		return -1;
 	if (!(half_complex = VIPS_ARRAY(fwfft,
 			  in->Ysize * half_width * 2, double)))
 		return -1;
-	g_mutex_lock(&vips__fft_lock);
-	if (!(plan = fftw_plan_dft_r2c_2d(in->Ysize, in->Xsize,
-			  planner_scratch, (fftw_complex *) half_complex,
-			  0))) {
-		g_mutex_unlock(&vips__fft_lock);
+	if (!(plan = vips__fft_plan(VIPS_FFT_R2C, in->Xsize, in->Ysize,
+			  (double *) t[1]->data, half_complex))) {
 		vips_error(class->nickname,
 			"%s", _("unable to create transform plan"));
 		return -1;
 	}
-	g_mutex_unlock(&vips__fft_lock);
 
 	fftw_execute_dft_r2c(plan,
 		(double *) t[1]->data, (fftw_complex *) half_complex);
 
-	g_mutex_lock(&vips__fft_lock);
-	fftw_destroy_plan(plan);
-	g_mutex_unlock(&vips__fft_lock);
-
 	/* Write to out as another memory buffer.
 	 */
 	*out = vips_image_new_memory();
@@ -222,6 +213,111 @@ rfwfft1(VipsObject *object, VipsImage *in, VipsImage **out)
 	return 0;
 }
 
+/* Real to half-complex forward transform, done in place in the output
+ * image. We copy the real pixels in, one padded row of the output per line,
+ * then transform and normalise.
+ *
+ * Anything other than double is transformed in single precision, if we can.
+ */
+static int
+rhalffwfft1(VipsObject *object, VipsImage *in, VipsImage **out)
+{
+	VipsFwfft *fwfft = (VipsFwfft *) object;
+	VipsImage **t = (VipsImage **) vips_object_local_array(object, 1);
+	VipsObjectClass *class = VIPS_OBJECT_GET_CLASS(fwfft);
+	const guint64 size = VIPS_IMAGE_N_PELS(in);
+	const int half_width = in->Xsize / 2 + 1;
+	const guint64 n = (guint64) in->Ysize * half_width * 2;
+
+	gboolean single;
+	VipsRegion *region;
+	VipsRect strip;
+	guint64 i;
+	int y;
+
+	if (vips_check_mono(class->nickname, in) ||
+		vips_check_uncoded(class->nickname, in))
+		return -1;
+
+	single = FALSE;
+#ifdef HAVE_FFTWF
+	single = in->BandFmt != VIPS_FORMAT_DOUBLE;
+#endif /*HAVE_FFTWF*/
+
+	if (vips_cast(in, &t[0],
+			single ? VIPS_FORMAT_FLOAT : VIPS_FORMAT_DOUBLE, NULL))
+		return -1;
+
+	*out = vips_image_new_memory();
+	if (vips_image_pipelinev(*out, VIPS_DEMAND_STYLE_ANY, in, NULL))
+		return -1;
+	(*out)->Xsize = half_width;
+	(*out)->BandFmt = single ? VIPS_FORMAT_COMPLEX : VIPS_FORMAT_DPCOMPLEX;
+	(*out)->Type = VIPS_INTERPRETATION_FOURIER;
+	if (vips_image_write_prepare(*out))
+		return -1;
+
+	region = vips_region_new(t[0]);
+	for (y = 0; y < in->Ysize; y += strip.height) {
+		int z;
+
+		strip.left = 0;
+		strip.top = y;
+		strip.width = in->Xsize;
+		strip.height = VIPS_MIN(16, in->Ysize - y);
+		if (vips_region_prepare(region, &strip)) {
+			g_object_unref(region);
+			return -1;
+		}
+
+		for (z = 0; z < strip.height; z++)
+			memcpy(VIPS_IMAGE_ADDR(*out, 0, y + z),
+				VIPS_REGION_ADDR(region, 0, y + z),
+				VIPS_IMAGE_SIZEOF_LINE(t[0]));
+	}
+	g_object_unref(region);
+
+#ifdef HAVE_FFTWF
+	if (single) {
+		float *data = (float *) (*out)->data;
+
+		fftwf_plan plan;
+
+		if (!(plan = vips__fftf_plan(VIPS_FFT_R2C,
+				  in->Xsize, in->Ysize, data, data))) {
+			vips_error(class->nickname,
+				"%s", _("unable to create transform plan"));
+			return -1;
+		}
+
+		fftwf_execute_dft_r2c(plan, data, (fftwf_complex *) data);
+
+		for (i = 0; i < n; i++)
+			data[i] /= size;
+	}
+	else
+#endif /*HAVE_FFTWF*/
+	{
+		double *data = (double *) (*out)->data;
+
+		fftw_plan plan;
+
+		if (!(plan = vips__fft_plan(VIPS_FFT_R2C,
+				  in->Xsize, in->Ysize, data, data))) {
+			vips_error(class->nickname,
+				"%s", _("unable to create transform plan"));
+			return -1;
+		}
+
+		fftw_execute_dft_r2c(plan, data, (fftw_complex *) data);
+
+		for (i = 0; i < n; i++)
+			data[i] /= size;
+	}
+
+	return 0;
+}
+
 /* Complex to complex forward transform.
  */
 static int
@@ -232,7 +328,6 @@ cfwfft1(VipsObject *object, VipsImage *in, VipsImage **out)
 	VipsObjectClass *class = VIPS_OBJECT_GET_CLASS(fwfft);
 
 	fftw_plan plan;
-	double *planner_scratch;
 	double *buf, *q, *p;
 	int x, y;
 
@@ -247,34 +342,16 @@ cfwfft1(VipsObject *object, VipsImage *in, VipsImage **out)
 		vips_image_write(t[0], t[1]))
 		return -1;
 
-	/* We have to have a separate buffer for the planner to work on.
-	 */
-	if (!(planner_scratch = VIPS_ARRAY(fwfft,
-			  VIPS_IMAGE_N_PELS(in) * 2, double)))
-		return -1;
-
-	/* Make the plan for the transform.
-	 */
-	g_mutex_lock(&vips__fft_lock);
-	if (!(plan = fftw_plan_dft_2d(in->Ysize, in->Xsize,
-			  (fftw_complex *) planner_scratch,
-			  (fftw_complex *) planner_scratch,
-			  FFTW_FORWARD,
-			  0))) {
-		g_mutex_unlock(&vips__fft_lock);
+	if (!(plan = vips__fft_plan(VIPS_FFT_C2C_FORWARD, in->Xsize, in->Ysize,
+			  (double *) t[1]->data, (double *) t[1]->data))) {
 		vips_error(class->nickname,
 			"%s", _("unable to create transform plan"));
 		return -1;
 	}
-	g_mutex_unlock(&vips__fft_lock);
 
 	fftw_execute_dft(plan,
 		(fftw_complex *) t[1]->data, (fftw_complex *) t[1]->data);
 
-	g_mutex_lock(&vips__fft_lock);
-	fftw_destroy_plan(plan);
-	g_mutex_unlock(&vips__fft_lock);
-
 	/* Write to out as another memory buffer.
 	 */
 	*out = vips_image_new_memory();
@@ -330,6 +407,11 @@ vips_fwfft_build(VipsObject *object)
 				cfwfft1))
 			return -1;
 	}
+	else if (fwfft->half) {
+		if (vips__fftproc(VIPS_OBJECT(fwfft), in, &t[1],
+				rhalffwfft1))
+			return -1;
+	}
 	else {
 		if (vips__fftproc(VIPS_OBJECT(fwfft), in, &t[1],
 				rfwfft1))
@@ -339,17 +421,37 @@ vips_fwfft_build(VipsObject *object)
 	if (vips_image_write(t[1], freqfilt->out))
 		return -1;
 
+	/* invfft and freqmult need the original width to undo a half
+	 * spectrum.
+	 */
+	if (fwfft->half &&
+		!vips_band_format_iscomplex(in->BandFmt))
+		vips_image_set_int(freqfilt->out, VIPS__FFT_WIDTH, in->Xsize);
+	else
+		(void) vips_image_remove(freqfilt->out, VIPS__FFT_WIDTH);
+
 	return 0;
 }
 
 static void
 vips_fwfft_class_init(VipsFwfftClass *class)
 {
+	GObjectClass *gobject_class = G_OBJECT_CLASS(class);
 	VipsObjectClass *vobject_class = VIPS_OBJECT_CLASS(class);
 
+	gobject_class->set_property = vips_object_set_property;
+	gobject_class->get_property = vips_object_get_property;
+
 	vobject_class->nickname = "fwfft";
 	vobject_class->description = _("forward FFT");
 	vobject_class->build = vips_fwfft_build;
+
+	VIPS_ARG_BOOL(class, "half", 4,
+		_("Half"),
+		_("Output just the left half of the spectrum"),
+		VIPS_ARGUMENT_OPTIONAL_INPUT,
+		G_STRUCT_OFFSET(VipsFwfft, half),
+		FALSE);
 }
 
 static void
@@ -367,11 +469,24 @@ vips_fwfft_init(VipsFwfft *fwfft)
  *
  * Transform an image to Fourier space.
  *
+ * Set @half to output just the left half of the spectrum of a real image,
+ * `width / 2 + 1` pixels across. The right half is the conjugate of the
+ * left, so this holds the whole transform in about half the memory.
+ * [method@Image.freqmult] and [method@Image.invfft] understand half
+ * spectra, so they stay half-width all the way through. If libvips was
+ * built with single precision fftw, non-double images are transformed to
+ * [enum@Vips.BandFormat.COMPLEX] rather than
+ * [enum@Vips.BandFormat.DPCOMPLEX], halving memory use again. @half is
+ * ignored for complex images.
+ *
  * VIPS uses the fftw Fourier Transform library. If this library was not
  * available when VIPS was configured, these functions will fail.
  *
+ * ::: tip "Optional arguments"
+ *     * @half: `gboolean`, output a half spectrum
+ *
  * ::: seealso
- *     [method@Image.invfft].
+ *     [method@Image.invfft], [method@Image.freqmult].
  *
  * Returns: 0 on success, -1 on error.
  */
@@ -28,6 +28,10 @@
  * 	- redone as a class
  * 15/12/23 [akash-akya]
  *	- add locks
+ * 14/10/26
+ *	- use the plan cache
+ * 15/10/26
+ *	- transform half spectra from fwfft in place
  */
 
 /*
@@ -94,7 +98,6 @@ cinvfft1(VipsObject *object, VipsImage *in, VipsImage **out)
 	VipsObjectClass *class = VIPS_OBJECT_GET_CLASS(invfft);
 
 	fftw_plan plan;
-	double *planner_scratch;
 
 	if (vips_check_mono(class->nickname, in) ||
 		vips_check_uncoded(class->nickname, in))
@@ -107,32 +110,16 @@ cinvfft1(VipsObject *object, VipsImage *in, VipsImage **out)
 		vips_image_write(t[0], *out))
 		return -1;
 
-	/* Make the plan for the transform. Yes, they really do use nx for
-	 * height and ny for width.
-	 */
-	if (!(planner_scratch = VIPS_ARRAY(invfft,
-			  VIPS_IMAGE_N_PELS(in) * 2, double)))
-		return -1;
-	g_mutex_lock(&vips__fft_lock);
-	if (!(plan = fftw_plan_dft_2d(in->Ysize, in->Xsize,
-			  (fftw_complex *) planner_scratch,
-			  (fftw_complex *) planner_scratch,
-			  FFTW_BACKWARD,
-			  0))) {
-		g_mutex_unlock(&vips__fft_lock);
+	if (!(plan = vips__fft_plan(VIPS_FFT_C2C_BACKWARD, in->Xsize, in->Ysize,
+			  (double *) (*out)->data, (double *) (*out)->data))) {
 		vips_error(class->nickname,
 			"%s", _("unable to create transform plan"));
 		return -1;
 	}
-	g_mutex_unlock(&vips__fft_lock);
 
 	fftw_execute_dft(plan,
 		(fftw_complex *) (*out)->data, (fftw_complex *) (*out)->data);
 
-	g_mutex_lock(&vips__fft_lock);
-	fftw_destroy_plan(plan);
-	g_mutex_unlock(&vips__fft_lock);
-
 	(*out)->Type = VIPS_INTERPRETATION_B_W;
 
 	return 0;
@@ -149,7 +136,6 @@ rinvfft1(VipsObject *object, VipsImage *in, VipsImage **out)
 	const int half_width = in->Xsize / 2 + 1;
 
 	double *half_complex;
-	double *planner_scratch;
 	fftw_plan plan;
 	int x, y;
 	double *q, *p;
@@ -188,29 +174,98 @@ rinvfft1(VipsObject *object, VipsImage *in, VipsImage **out)
 	if (vips_image_write_prepare(*out))
 		return -1;
 
-	/* Make the plan for the transform. Yes, they really do use nx for
-	 * height and ny for width.
-	 */
-	if (!(planner_scratch = VIPS_ARRAY(invfft,
-			  t[1]->Ysize * half_width * 2, double)))
-		return -1;
-	g_mutex_lock(&vips__fft_lock);
-	if (!(plan = fftw_plan_dft_c2r_2d(t[1]->Ysize, t[1]->Xsize,
-			  (fftw_complex *) planner_scratch, (double *) (*out)->data,
-			  0))) {
-		g_mutex_unlock(&vips__fft_lock);
+	if (!(plan = vips__fft_plan(VIPS_FFT_C2R, t[1]->Xsize, t[1]->Ysize,
+			  half_complex, (double *) (*out)->data))) {
 		vips_error(class->nickname,
 			"%s", _("unable to create transform plan"));
 		return -1;
 	}
-	g_mutex_unlock(&vips__fft_lock);
 
 	fftw_execute_dft_c2r(plan,
 		(fftw_complex *) half_complex, (double *) (*out)->data);
 
-	g_mutex_lock(&vips__fft_lock);
-	fftw_destroy_plan(plan);
-	g_mutex_unlock(&vips__fft_lock);
+	return 0;
+}
+
+/* Half-complex to real inverse transform of a half spectrum from fwfft.
+ *
+ * c2r trashes its input, so we need a copy anyway: transform in place in
+ * that and view the padded rows of the result as the output image.
+ */
+static int
+rhalfinvfft1(VipsObject *object, VipsImage *in, VipsImage **out)
+{
+	VipsImage **t = (VipsImage **) vips_object_local_array(object, 4);
+	VipsInvfft *invfft = (VipsInvfft *) object;
+	VipsObjectClass *class = VIPS_OBJECT_GET_CLASS(invfft);
+
+	int width;
+	gboolean single;
+
+	if (vips_check_mono(class->nickname, in) ||
+		vips_check_uncoded(class->nickname, in) ||
+		vips_image_get_int(in, VIPS__FFT_WIDTH, &width))
+		return -1;
+	if (width / 2 + 1 != in->Xsize) {
+		vips_error(class->nickname,
+			"%s", _("bad half spectrum width"));
+		return -1;
+	}
+
+	single = FALSE;
+#ifdef HAVE_FFTWF
+	single = in->BandFmt == VIPS_FORMAT_COMPLEX;
+#endif /*HAVE_FFTWF*/
+
+	t[1] = vips_image_new_memory();
+	if (vips_cast(in, &t[0],
+			single ? VIPS_FORMAT_COMPLEX : VIPS_FORMAT_DPCOMPLEX,
+			NULL) ||
+		vips_image_write(t[0], t[1]))
+		return -1;
+
+#ifdef HAVE_FFTWF
+	if (single) {
+		float *data = (float *) t[1]->data;
+
+		fftwf_plan plan;
+
+		if (!(plan = vips__fftf_plan(VIPS_FFT_C2R,
+				  width, in->Ysize, data, data))) {
+			vips_error(class->nickname,
+				"%s", _("unable to create transform plan"));
+			return -1;
+		}
+
+		fftwf_execute_dft_c2r(plan, (fftwf_complex *) data, data);
+	}
+	else
+#endif /*HAVE_FFTWF*/
+	{
+		double *data = (double *) t[1]->data;
+
+		fftw_plan plan;
+
+		if (!(plan = vips__fft_plan(VIPS_FFT_C2R,
+				  width, in->Ysize, data, data))) {
+			vips_error(class->nickname,
+				"%s", _("unable to create transform plan"));
+			return -1;
+		}
+
+		fftw_execute_dft_c2r(plan, (fftw_complex *) data, data);
+	}
+
+	/* Each complex pixel now holds two real pixels.
+	 */
+	if (vips_copy(t[1], &t[2],
+			"format", single ? VIPS_FORMAT_FLOAT : VIPS_FORMAT_DOUBLE,
+			"bands", 2,
+			"interpretation", VIPS_INTERPRETATION_B_W,
+			NULL) ||
+		vips_bandunfold(t[2], &t[3], NULL) ||
+		vips_extract_area(t[3], out, 0, 0, width, in->Ysize, NULL))
+		return -1;
 
 	return 0;
 }
@@ -233,19 +288,40 @@ vips_invfft_build(VipsObject *object)
 		return -1;
 	in = t[0];
 
-	if (invfft->real) {
+	if (vips_image_get_typeof(in, VIPS__FFT_WIDTH)) {
+		/* The inverse of a half spectrum is always real.
+		 */
+		if (vips__fftproc(VIPS_OBJECT(invfft),
+				in, &t[1], rhalfinvfft1))
+			return -1;
+		in = t[1];
+
+		if (!invfft->real) {
+			if (vips_cast(in, &t[2],
+					in->BandFmt == VIPS_FORMAT_FLOAT
+						? VIPS_FORMAT_COMPLEX
+						: VIPS_FORMAT_DPCOMPLEX,
+					NULL))
+				return -1;
+			in = t[2];
+		}
+	}
+	else if (invfft->real) {
 		if (vips__fftproc(VIPS_OBJECT(invfft),
 				in, &t[1], rinvfft1))
 			return -1;
+		in = t[1];
 	}
 	else {
 		if (vips__fftproc(VIPS_OBJECT(invfft),
 				in, &t[1], cinvfft1))
 			return -1;
+		in = t[1];
 	}
 
-	if (vips_image_write(t[1], freqfilt->out))
+	if (vips_image_write(in, freqfilt->out))
 		return -1;
+	(void) vips_image_remove(freqfilt->out, VIPS__FFT_WIDTH);
 
 	return 0;
 }
@@ -289,6 +365,9 @@ vips_invfft_init(VipsInvfft *invfft)
  * The result is complex. If you are OK with a real result, set @real,
  * it's quicker.
  *
+ * Half spectra made by [method@Image.fwfft] with @half set are transformed
+ * directly back to a real image the width of the original.
+ *
  * VIPS uses the fftw Fourier Transform library. If this library was not
  * available when VIPS was configured, these functions will fail.
  *
@@ -31,10 +31,19 @@
 #ifndef VIPS_PFREQFILT_H
 #define VIPS_PFREQFILT_H
 
+#ifdef HAVE_FFTW
+#include <fftw3.h>
+#endif /*HAVE_FFTW*/
+
 #ifdef __cplusplus
 extern "C" {
 #endif /*__cplusplus*/
 
+/* Half-spectrum images from fwfft carry the width of the image they were
+ * made from, since odd and even widths give the same half width.
+ */
+#define VIPS__FFT_WIDTH "fft-width"
+
 /* All fftw3 calls except execute() need to be locked.
  */
 extern GMutex vips__fft_lock;
@@ -74,6 +83,22 @@ typedef int (*VipsFftProcessFn)(VipsObject *, VipsImage *, VipsImage **);
 int vips__fftproc(VipsObject *context,
 	VipsImage *in, VipsImage **out, VipsFftProcessFn fn);
 
+typedef enum {
+	VIPS_FFT_R2C,		  /* real to half-complex */
+	VIPS_FFT_C2C_FORWARD,  /* complex to complex, in place */
+	VIPS_FFT_C2C_BACKWARD, /* complex to complex, in place */
+	VIPS_FFT_C2R		  /* half-complex to real */
+} VipsFftKind;
+
+#ifdef HAVE_FFTW
+fftw_plan vips__fft_plan(VipsFftKind kind,
+	int width, int height, double *in, double *out);
+#ifdef HAVE_FFTWF
+fftwf_plan vips__fftf_plan(VipsFftKind kind,
+	int width, int height, float *in, float *out);
+#endif /*HAVE_FFTWF*/
+#endif /*HAVE_FFTW*/
+
 #ifdef __cplusplus
 }
 #endif /*__cplusplus*/
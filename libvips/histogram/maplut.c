@@ -33,6 +33,8 @@
  * 	- convert to a class
  * 2/10/13
  * 	- add --band arg, replacing im_tone_map()
+ * 15/10/26
+ * 	- add a Highway gather path for uchar and ushort indexes
  */
 
 /*
@@ -72,6 +74,9 @@
 #include <string.h>
 
 #include <vips/vips.h>
+#include <vips/vector.h>
+
+#include "phistogram.h"
 
 typedef struct _VipsMaplut {
 	VipsOperation parent_instance;
@@ -89,6 +94,12 @@ typedef struct _VipsMaplut {
 	VipsPel **table; /* Lut converted to 2d array */
 	int overflow;	 /* Number of overflows for non-uchar lut */
 
+	/* Set if we can use the SIMD path. This needs the lut for each band
+	 * interleaved into one table, with uchar and ushort widened to int.
+	 */
+	gboolean vector;
+	void *wide;
+
 } VipsMaplut;
 
 typedef VipsOperationClass VipsMaplutClass;
@@ -505,6 +516,19 @@ vips_maplut_gen(VipsRegion *out_region,
 	if (vips_region_prepare(ir, r))
 		return -1;
 
+#ifdef HAVE_HWY
+	if (maplut->vector) {
+		for (y = to; y < bo; y++)
+			seq->overflow += vips_maplut_hwy(
+				VIPS_REGION_ADDR(out_region, le, y),
+				VIPS_REGION_ADDR(ir, le, y),
+				ne, maplut->nb, maplut->clp, maplut->wide,
+				ir->im->BandFmt, maplut->fmt);
+
+		return 0;
+	}
+#endif /*HAVE_HWY*/
+
 	/* clang-format off */
 	if (maplut->nb == 1) {
 		/* One band lut.
@@ -739,6 +763,50 @@ vips_maplut_build(VipsObject *object)
 		g_assert_not_reached();
 	}
 
+	/* uchar and ushort indexes through uchar, ushort and float luts have
+	 * a vector path, as long as each image band has its own lut, or they
+	 * all share one.
+	 */
+#ifdef HAVE_HWY
+	if (vips_vector_isenabled() &&
+		(in->BandFmt == VIPS_FORMAT_UCHAR ||
+			in->BandFmt == VIPS_FORMAT_USHORT) &&
+		(maplut->fmt == VIPS_FORMAT_UCHAR ||
+			maplut->fmt == VIPS_FORMAT_USHORT ||
+			maplut->fmt == VIPS_FORMAT_FLOAT) &&
+		(maplut->nb == 1 ||
+			maplut->nb == in->Bands)) {
+		if (maplut->fmt == VIPS_FORMAT_FLOAT) {
+			float *wide;
+
+			if (!(wide = VIPS_ARRAY(maplut,
+					  maplut->sz * maplut->nb, float)))
+				return -1;
+			for (i = 0; i < maplut->sz; i++)
+				for (int b = 0; b < maplut->nb; b++)
+					wide[i * maplut->nb + b] =
+						((float *) maplut->table[b])[i];
+			maplut->wide = wide;
+		}
+		else {
+			gint32 *wide;
+
+			if (!(wide = VIPS_ARRAY(maplut,
+					  maplut->sz * maplut->nb, gint32)))
+				return -1;
+			for (i = 0; i < maplut->sz; i++)
+				for (int b = 0; b < maplut->nb; b++)
+					wide[i * maplut->nb + b] =
+						maplut->fmt == VIPS_FORMAT_UCHAR
+						? ((unsigned char *) maplut->table[b])[i]
+						: ((unsigned short *) maplut->table[b])[i];
+			maplut->wide = wide;
+		}
+
+		maplut->vector = TRUE;
+	}
+#endif /*HAVE_HWY*/
+
 	if (vips_image_generate(maplut->out,
 			vips_maplut_start, vips_maplut_gen, vips_maplut_stop,
 			in, maplut))
@@ -0,0 +1,228 @@
+/* Highway kernels for maplut.
+ *
+ * 15/10/26
+ * 	- initial implementation
+ */
+
+/*
+
+	This file is part of VIPS.
+
+	VIPS is free software; you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+	02110-1301  USA
+
+ */
+
+/*
+
+	These files are distributed with VIPS - http://www.vips.ecs.soton.ac.uk
+
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /*HAVE_CONFIG_H*/
+#include <glib/gi18n-lib.h>
+
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+
+#include <vips/vips.h>
+#include <vips/vector.h>
+#include <vips/debug.h>
+#include <vips/internal.h>
+
+#include "phistogram.h"
+
+#ifdef HAVE_HWY
+
+#undef HWY_TARGET_INCLUDE
+#define HWY_TARGET_INCLUDE "libvips/histogram/maplut_hwy.cpp"
+#include <hwy/foreach_target.h>
+#include <hwy/highway.h>
+
+namespace HWY_NAMESPACE {
+
+using namespace hwy::HWY_NAMESPACE;
+
+using DF32 = ScalableTag<float>;
+using DI32 = ScalableTag<int32_t>;
+constexpr DF32 df32;
+constexpr DI32 di32;
+
+/* Narrow vectors with one lane for each 32-bit lane, for loading before a
+ * promote, or storing after a demote.
+ */
+constexpr Rebind<uint8_t, DI32> du8x32;
+constexpr Rebind<uint16_t, DI32> du16x32;
+
+using VI32 = Vec<DI32>;
+
+// Compat for Highway versions < 1.3.0
+#ifndef HWY_LANES_CONSTEXPR
+#define HWY_LANES_CONSTEXPR
+#endif
+
+/* The vector loops only run on SIMD targets, the scalar tail handles any
+ * remaining elements (or all of them for HWY_SCALAR).
+ */
+#if HWY_TARGET != HWY_SCALAR
+#define VECTOR_LOOP 1
+#else
+#define VECTOR_LOOP 0
+#endif
+
+HWY_ATTR HWY_INLINE VI32
+load_index(const uint8_t *HWY_RESTRICT p)
+{
+	return PromoteTo(di32, LoadU(du8x32, p));
+}
+
+HWY_ATTR HWY_INLINE VI32
+load_index(const uint16_t *HWY_RESTRICT p)
+{
+	return PromoteTo(di32, LoadU(du16x32, p));
+}
+
+/* Gather from the table and store. uchar and ushort LUTs are widened to int
+ * so we can gather 32-bit lanes, and are narrowed again here.
+ */
+HWY_ATTR HWY_INLINE void
+gather_store(uint8_t *HWY_RESTRICT q,
+	const int32_t *HWY_RESTRICT table, VI32 index)
+{
+	StoreU(DemoteTo(du8x32, GatherIndex(di32, table, index)), du8x32, q);
+}
+
+HWY_ATTR HWY_INLINE void
+gather_store(uint16_t *HWY_RESTRICT q,
+	const int32_t *HWY_RESTRICT table, VI32 index)
+{
+	StoreU(DemoteTo(du16x32, GatherIndex(di32, table, index)), du16x32, q);
+}
+
+HWY_ATTR HWY_INLINE void
+gather_store(float *HWY_RESTRICT q,
+	const float *HWY_RESTRICT table, VI32 index)
+{
+	StoreU(GatherIndex(df32, table, index), df32, q);
+}
+
+/* Map @n elements of @nb interleaved bands through @table, which has the LUT
+ * for each band interleaved too, ie. entry i of band b is at i * nb + b.
+ * Indexes are clipped to @clp, and we return the number we clip.
+ */
+template <typename TI, typename TO, typename TT>
+HWY_ATTR HWY_INLINE int
+maplut_line(TO *HWY_RESTRICT q, const TI *HWY_RESTRICT p, int32_t n,
+	int32_t nb, int32_t clp, const TT *HWY_RESTRICT table)
+{
+	HWY_LANES_CONSTEXPR int32_t N = Lanes(di32);
+
+	int overflow = 0;
+	int32_t x = 0;
+
+	if (VECTOR_LOOP &&
+		n >= N) {
+		const auto clpv = Set(di32, clp);
+		const auto nbv = Set(di32, nb);
+		const auto step = Set(di32, N % nb);
+
+		/* The band of each lane. The first element of a line is
+		 * always band 0.
+		 */
+		auto band = Iota(di32, 0);
+		for (int32_t i = 0; i < N; i += nb)
+			band = IfThenElse(Ge(band, nbv), Sub(band, nbv), band);
+
+		for (; x + N <= n; x += N) {
+			auto index = load_index(p + x);
+			auto over = Gt(index, clpv);
+
+			overflow += CountTrue(di32, over);
+			index = Add(Mul(Min(index, clpv), nbv), band);
+			gather_store(q + x, table, index);
+
+			band = Add(band, step);
+			band = IfThenElse(Ge(band, nbv), Sub(band, nbv), band);
+		}
+	}
+
+	for (; x < n; x++) {
+		int32_t index = p[x];
+
+		if (index > clp) {
+			index = clp;
+			overflow += 1;
+		}
+
+		q[x] = (TO) table[index * nb + x % nb];
+	}
+
+	return overflow;
+}
+
+HWY_ATTR int
+vips_maplut_hwy(void *HWY_RESTRICT q, const void *HWY_RESTRICT p,
+	int32_t n, int32_t nb, int32_t clp, const void *HWY_RESTRICT table,
+	int32_t in_format, int32_t out_format)
+{
+	const int32_t *itable = (const int32_t *) table;
+	const float *ftable = (const float *) table;
+
+	if (in_format == VIPS_FORMAT_UCHAR) {
+		const uint8_t *p8 = (const uint8_t *) p;
+
+		switch (out_format) {
+		case VIPS_FORMAT_UCHAR:
+			return maplut_line((uint8_t *) q, p8, n, nb, clp, itable);
+		case VIPS_FORMAT_USHORT:
+			return maplut_line((uint16_t *) q, p8, n, nb, clp, itable);
+		default:
+			return maplut_line((float *) q, p8, n, nb, clp, ftable);
+		}
+	}
+	else {
+		const uint16_t *p16 = (const uint16_t *) p;
+
+		switch (out_format) {
+		case VIPS_FORMAT_UCHAR:
+			return maplut_line((uint8_t *) q, p16, n, nb, clp, itable);
+		case VIPS_FORMAT_USHORT:
+			return maplut_line((uint16_t *) q, p16, n, nb, clp, itable);
+		default:
+			return maplut_line((float *) q, p16, n, nb, clp, ftable);
+		}
+	}
+}
+
+} /*namespace HWY_NAMESPACE*/
+
+#if HWY_ONCE
+HWY_EXPORT(vips_maplut_hwy);
+
+int
+vips_maplut_hwy(VipsPel *out, VipsPel *in, int n, int nb, int clp,
+	const void *table, VipsBandFormat in_format, VipsBandFormat out_format)
+{
+	/* clang-format off */
+	return HWY_DYNAMIC_DISPATCH(vips_maplut_hwy)(out, in, n, nb, clp,
+		table, in_format, out_format);
+	/* clang-format on */
+}
+#endif /*HWY_ONCE*/
+
+#endif /*HAVE_HWY*/
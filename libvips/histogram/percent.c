@@ -151,8 +151,12 @@ vips_percent_init(VipsPercent *percent)
  * The function works for uchar and ushort images only.  It can be used
  * to threshold the scaled result of a filtering operation.
  *
+ * Use [method@Image.percentiles] to find several percentiles of each band
+ * in one pass, or for other formats.
+ *
  * ::: seealso
- *     [method@Image.hist_find], [method@Image.profile].
+ *     [method@Image.hist_find], [method@Image.profile],
+ *     [method@Image.percentiles].
  *
  * Returns: 0 on success, -1 on error
  */
@@ -89,6 +89,13 @@ typedef struct _VipsHistogramClass {
 
 GType vips_histogram_get_type(void);
 
+/* SIMD path for maplut, see maplut_hwy.cpp. Map @n elements of @nb
+ * interleaved bands through @table, and return the number of indexes clipped
+ * to @clp.
+ */
+int vips_maplut_hwy(VipsPel *out, VipsPel *in, int n, int nb, int clp,
+	const void *table, VipsBandFormat in_format, VipsBandFormat out_format);
+
 #ifdef __cplusplus
 }
 #endif /*__cplusplus*/
@@ -551,6 +551,14 @@ VIPS_API
 int vips_getpoint(VipsImage *in, double **vector, int *n, int x, int y, ...)
 	G_GNUC_NULL_TERMINATED;
 VIPS_API
+int vips_getpoints(VipsImage *in, double **vector, int *n,
+	const double *x, const double *y, int n_points, ...)
+	G_GNUC_NULL_TERMINATED;
+VIPS_API
+int vips_percentiles(VipsImage *in, double **vector, int *n,
+	const double *percent, int n_percent, ...)
+	G_GNUC_NULL_TERMINATED;
+VIPS_API
 int vips_hist_find(VipsImage *in, VipsImage **out, ...)
 	G_GNUC_NULL_TERMINATED;
 VIPS_API
@@ -267,6 +267,13 @@ gint64 vips_source_length(VipsSource *source);
 typedef struct _VipsSourceCustom {
 	VipsSource parent_object;
 
+	/*< private >*/
+
+	/* If set, a block cache between the loader and the read and seek
+	 * signals.
+	 */
+	struct _VipsSourceBlocks *blocks;
+
 } VipsSourceCustom;
 
 typedef struct _VipsSourceCustomClass {
@@ -279,12 +286,22 @@ typedef struct _VipsSourceCustomClass {
 	gint64 (*read)(VipsSourceCustom *source, void *buffer, gint64 length);
 	gint64 (*seek)(VipsSourceCustom *source, gint64 offset, int whence);
 
+	/* A hint that a range is likely to be read soon.
+	 */
+	void (*prefetch)(VipsSourceCustom *source, gint64 offset, gint64 length);
+
 } VipsSourceCustomClass;
 
 VIPS_API
 GType vips_source_custom_get_type(void);
 VIPS_API
 VipsSourceCustom *vips_source_custom_new(void);
+VIPS_API
+int vips_source_custom_set_block_cache(VipsSourceCustom *source_custom,
+	int block_size, int max_blocks);
+VIPS_API
+void vips_source_custom_get_block_stats(VipsSourceCustom *source_custom,
+	gint64 *hits, gint64 *misses, gint64 *fetches);
 
 /* A GInputStream that wraps a VipsSource. This lets us eg.
  * hook librsvg up to libvips using their GInputStream interface.
@@ -428,6 +445,14 @@ struct _VipsTarget {
 	 */
 	gboolean delete_on_close;
 	char *delete_on_close_filename;
+
+	/* Full output buffers collect here, so runs of small writes reach
+	 * ::write() as one call. pending_size grows while we see runs of
+	 * small writes, n_small counts them.
+	 */
+	GByteArray *pending;
+	size_t pending_size;
+	int n_small;
 };
 
 typedef struct _VipsTargetClass {
@@ -486,6 +511,11 @@ VipsTarget *vips_target_new_temp(VipsTarget *based_on);
 VIPS_API
 int vips_target_write(VipsTarget *target, const void *data, size_t length);
 VIPS_API
+int vips_target_writev(VipsTarget *target,
+	const GOutputVector *vectors, int n_vectors);
+VIPS_API
+int vips_target_write_source(VipsTarget *target, VipsSource *source);
+VIPS_API
 gint64 vips_target_read(VipsTarget *target, void *buffer, size_t length);
 VIPS_API
 gint64 vips_target_seek(VipsTarget *target, gint64 offset, int whence);
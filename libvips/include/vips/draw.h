@@ -106,6 +106,10 @@ int vips_draw_smudge(VipsImage *image,
 	int left, int top, int width, int height, ...)
 	G_GNUC_NULL_TERMINATED;
 
+VIPS_API
+int vips_draw_list(VipsImage *in, VipsImage **out, double *ink, int n, ...)
+	G_GNUC_NULL_TERMINATED;
+
 #ifdef __cplusplus
 }
 #endif /*__cplusplus*/
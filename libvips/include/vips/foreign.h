@@ -102,7 +102,8 @@ typedef enum /*< flags >*/ {
 	VIPS_FOREIGN_PARTIAL = 1,	 /* Lazy read OK (eg. tiled tiff) */
 	VIPS_FOREIGN_BIGENDIAN = 2,	 /* Most-significant byte first */
 	VIPS_FOREIGN_SEQUENTIAL = 4, /* Top-to-bottom lazy read OK */
-	VIPS_FOREIGN_ALL = 7		 /* All flags set */
+	VIPS_FOREIGN_ZERO_COPY = 8,	 /* Never copies the whole input */
+	VIPS_FOREIGN_ALL = 15		 /* All flags set */
 } VipsForeignFlags;
 
 /**
@@ -198,6 +199,19 @@ typedef struct _VipsForeignLoad {
 	gboolean revalidate;
 } VipsForeignLoad;
 
+/* A byte signature for a file format: @length bytes at @offset from the
+ * start of the file.
+ */
+typedef struct _VipsForeignMagic {
+	int offset;
+	int length;
+	const char *bytes;
+} VipsForeignMagic;
+
+/* The most bytes we read to check signatures.
+ */
+#define VIPS_FOREIGN_MAGIC_SIZE (64)
+
 typedef struct _VipsForeignLoadClass {
 	VipsForeignClass parent_class;
 
@@ -266,6 +280,17 @@ typedef struct _VipsForeignLoadClass {
 	 * vips_error().
 	 */
 	int (*load)(VipsForeignLoad *load);
+
+	/* Byte signatures for this format, ending with an entry with NULL
+	 * @bytes, or NULL for none.
+	 *
+	 * A file can only be in this format if one of these matches, so when
+	 * searching for a loader we can skip @is_a(), @is_a_buffer() and
+	 * @is_a_source() for files which match none of them. @is_a() and
+	 * friends must still do the full check. Signatures must fit in
+	 * the first #VIPS_FOREIGN_MAGIC_SIZE bytes.
+	 */
+	const VipsForeignMagic *magic;
 } VipsForeignLoadClass;
 
 VIPS_API
@@ -292,6 +317,34 @@ gboolean vips_foreign_is_a_source(const char *loader,
 VIPS_API
 void vips_foreign_load_invalidate(VipsImage *image);
 
+/**
+ * VipsForeignProbe:
+ * @result: 0 on success, -1 if the header could not be read
+ * @loader: nickname of the loader that read the header
+ * @width: image width in pixels
+ * @height: image height in pixels
+ * @bands: number of image bands
+ * @format: pixel format
+ * @n_pages: number of pages in the file
+ * @orientation: EXIF orientation, 1 if not set
+ *
+ * The result of probing one file with [func@Foreign.probe].
+ */
+typedef struct _VipsForeignProbe {
+	int result;
+	const char *loader;
+	int width;
+	int height;
+	int bands;
+	VipsBandFormat format;
+	int n_pages;
+	int orientation;
+} VipsForeignProbe;
+
+VIPS_API
+int vips_foreign_probe(const char **filenames, int n,
+	VipsForeignProbe *probe, int jobs);
+
 #define VIPS_TYPE_FOREIGN_SAVE (vips_foreign_save_get_type())
 #define VIPS_FOREIGN_SAVE(obj) \
 	(G_TYPE_CHECK_INSTANCE_CAST((obj), \
@@ -524,6 +577,10 @@ VIPS_API
 int vips_jpegsave_mime(VipsImage *in, ...)
 	G_GNUC_NULL_TERMINATED;
 
+VIPS_API
+int vips_jpegtran(VipsSource *source, VipsTarget *target, ...)
+	G_GNUC_NULL_TERMINATED;
+
 /**
  * VipsForeignWebpPreset:
  * @VIPS_FOREIGN_WEBP_PRESET_DEFAULT: default preset
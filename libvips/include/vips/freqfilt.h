@@ -53,6 +53,15 @@ VIPS_API
 int vips_spectrum(VipsImage *in, VipsImage **out, ...)
 	G_GNUC_NULL_TERMINATED;
 
+VIPS_API
+int vips_convfft(VipsImage *in, VipsImage **out, VipsImage *mask, ...)
+	G_GNUC_NULL_TERMINATED;
+
+VIPS_API
+int vips_fft_wisdom_import(const char *filename);
+VIPS_API
+int vips_fft_wisdom_export(const char *filename);
+
 VIPS_API
 int vips_phasecor(VipsImage *in1, VipsImage *in2, VipsImage **out, ...)
 	G_GNUC_NULL_TERMINATED;
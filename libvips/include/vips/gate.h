@@ -71,6 +71,20 @@ extern "C" {
 
 VIPS_API
 void vips_profile_set(gboolean profile);
+VIPS_API
+void vips_profile_set_trace(gboolean trace);
+VIPS_API
+void vips_profile_set_counters(gboolean counters);
+
+typedef void (*VipsProfileSummaryFn)(const char *name,
+	gint64 time, gint64 n, void *a);
+
+VIPS_API
+void vips_profile_set_summary(gboolean summary);
+VIPS_API
+void vips_profile_summary_reset(void);
+VIPS_API
+void vips_profile_summary_map(VipsProfileSummaryFn fn, void *a);
 
 #endif /*VIPS_GATE_H*/
 
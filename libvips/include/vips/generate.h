@@ -40,6 +40,9 @@ extern "C" {
 typedef int (*VipsRegionWrite)(VipsRegion *region, VipsRect *area, void *a);
 VIPS_API
 int vips_sink_disc(VipsImage *im, VipsRegionWrite write_fn, void *a);
+VIPS_API
+int vips_sink_disc_unordered(VipsImage *im,
+	VipsRegionWrite write_fn, void *a);
 
 VIPS_API
 int vips_sink(VipsImage *im,
@@ -57,9 +60,50 @@ int vips_sink_screen(VipsImage *in, VipsImage *out, VipsImage *mask,
 	int tile_width, int tile_height, int max_tiles,
 	int priority,
 	VipsSinkNotify notify_fn, void *a);
+VIPS_API
+int vips_sink_screen_set_viewport(VipsImage *out, VipsRect *viewport);
+VIPS_API
+int vips_sink_screen_invalidate(VipsImage *out,
+	VipsImage *image, VipsRect *rect);
+VIPS_API
+void vips_sink_screen_set_max_workers(int max);
+VIPS_API
+int vips_sink_screen_get_max_workers(void);
 
 VIPS_API
 int vips_sink_memory(VipsImage *im);
+VIPS_API
+int vips_sink_memory_stride(VipsImage *im,
+	void *data, size_t size, size_t stride);
+
+typedef struct _VipsAsync VipsAsync;
+typedef void (*VipsAsyncDoneFn)(VipsAsync *async, void *a);
+
+VIPS_API
+VipsAsync *vips_sink_disc_async(VipsImage *im,
+	VipsRegionWrite write_fn, void *a,
+	VipsAsyncDoneFn done_fn, void *b);
+VIPS_API
+VipsAsync *vips_sink_memory_async(VipsImage *im,
+	VipsAsyncDoneFn done_fn, void *a);
+VIPS_API
+VipsAsync *vips_image_write_to_target_async(VipsImage *in,
+	const char *suffix, VipsTarget *target,
+	VipsAsyncDoneFn done_fn, void *a);
+VIPS_API
+int vips_async_get_fd(VipsAsync *async);
+VIPS_API
+gboolean vips_async_is_done(VipsAsync *async);
+VIPS_API
+int vips_async_get_result(VipsAsync *async);
+VIPS_API
+const char *vips_async_get_error(VipsAsync *async);
+VIPS_API
+int vips_async_wait(VipsAsync *async);
+VIPS_API
+void vips_async_cancel(VipsAsync *async);
+VIPS_API
+void vips_async_unref(VipsAsync *async);
 
 VIPS_API
 void *vips_start_one(VipsImage *out, void *a, void *b);
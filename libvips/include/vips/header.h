@@ -178,6 +178,22 @@ extern "C" {
  */
 #define VIPS_META_CONCURRENCY "concurrency"
 
+/**
+ * VIPS_META_PRIORITY:
+ *
+ * If set, the scheduling priority for computing this image, from -100 to
+ * 100. See [func@scheduler_set_max].
+ */
+#define VIPS_META_PRIORITY "vips-priority"
+
+/**
+ * VIPS_META_WEIGHT:
+ *
+ * If set, the share of workers this image gets relative to other images
+ * of the same priority, from 1 to 1000. See [func@scheduler_set_max].
+ */
+#define VIPS_META_WEIGHT "vips-weight"
+
 /**
  * VIPS_META_TILE_WIDTH
  *
@@ -251,6 +267,10 @@ gboolean vips_image_get_orientation_swap(VipsImage *image);
 VIPS_API
 int vips_image_get_concurrency(VipsImage *image, int default_concurrency);
 VIPS_API
+int vips_image_get_priority(VipsImage *image);
+VIPS_API
+int vips_image_get_weight(VipsImage *image);
+VIPS_API
 int vips_image_get_tile_width(VipsImage *image);
 VIPS_API
 int vips_image_get_tile_height(VipsImage *image);
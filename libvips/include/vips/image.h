@@ -326,6 +326,29 @@ struct _VipsImage {
 	 */
 	gboolean delete_on_close;
 	char *delete_on_close_filename;
+
+	/* Abandon evaluation after this monotonic time, or 0 for no
+	 * deadline. See vips_image_set_deadline().
+	 */
+	gint64 deadline;
+
+	/* Pixels generated, and microseconds spent generating them not
+	 * counting upstream, while metrics are on. Updated under a lock in
+	 * metrics.c. See vips_image_explain().
+	 */
+	guint64 generate_pixels;
+	guint64 generate_time;
+
+	/* The refcounted table that ->meta and ->meta_traverse point into,
+	 * possibly shared with other images. See header.c.
+	 */
+	struct _VipsMetaTable *meta_table;
+
+	/* If every pixel in the image is known to have the same value, one
+	 * pel of it, otherwise NULL. Tiles are painted with this rather
+	 * than computed. See vips__image_fold_constant().
+	 */
+	VipsPel *constant;
 };
 
 typedef struct _VipsImageClass {
@@ -458,6 +481,12 @@ VIPS_API
 gboolean vips_image_iskilled(VipsImage *image);
 VIPS_API
 void vips_image_set_kill(VipsImage *image, gboolean kill);
+VIPS_API
+void vips_image_set_deadline(VipsImage *image, double timeout);
+VIPS_API
+gboolean vips_image_deadline_passed(VipsImage *image);
+VIPS_API
+char *vips_image_explain(VipsImage *image);
 
 VIPS_API
 char *vips_filename_get_filename(const char *vips_filename);
@@ -92,8 +92,10 @@ extern "C" {
  * We don't refcount at this level ... large meta values are refcounted by
  * their GValue implementation, see eg. MetaArea.
  */
+typedef struct _VipsMetaTable VipsMetaTable;
+
 typedef struct _VipsMeta {
-	VipsImage *im;
+	VipsMetaTable *table;
 
 	char *name;	  /* strdup() of field name */
 	GValue value; /* copy of value */
@@ -103,7 +105,10 @@ typedef struct _VipsMeta {
  */
 VIPS_API
 int vips__exif_parse(VipsImage *image);
+int vips__exif_expand(VipsImage *image);
 int vips__exif_update(VipsImage *image);
+gboolean vips__meta_get_exif_pending(const VipsImage *image);
+void vips__meta_set_exif_pending(VipsImage *image, gboolean pending);
 
 void vips_check_init(void);
 
@@ -113,6 +118,23 @@ extern gboolean vips__vector_enabled;
 
 void vips__vector_init(void);
 
+/* Set from the command-line.
+ */
+extern gboolean vips__gpu_enabled;
+
+void vips__gpu_init(void);
+void vips__gpu_shutdown(void);
+
+/* Masks with more non-zero elements than this stay on the CPU.
+ */
+#define VIPS_GPU_MAX_NNZ (4096)
+
+int vips__gpu_convf(float *out, int out_stride,
+	const float *in, int in_stride,
+	int width, int height, int bands,
+	int mask_width, int mask_height,
+	const float *coeff, const int *coeff_pos, int nnz, float offset);
+
 void vips__meta_init_types(void);
 void vips__meta_destroy(VipsImage *im);
 int vips__meta_cp(VipsImage *, const VipsImage *);
@@ -123,11 +145,27 @@ extern int vips__tile_width;
 extern int vips__tile_height;
 extern int vips__fatstrip_height;
 extern int vips__thinstrip_height;
+extern gboolean vips__tile_auto;
+
+/* Loaders advertise the units they decode in, sinks line up with them.
+ */
+void vips__image_set_natural_tile(VipsImage *image,
+	int tile_width, int tile_height);
+gboolean vips__image_get_natural_tile(VipsImage *image,
+	int *tile_width, int *tile_height);
+void vips__tile_size_align(VipsImage *im,
+	int *tile_width, int *tile_height, int *n_lines);
 
 /* Default n threads.
  */
 extern int vips__concurrency;
 
+/* Pin workers to NUMA nodes.
+ */
+extern gboolean vips__numa;
+int vips__numa_get_n_nodes(void);
+void vips__numa_bind(int node);
+
 /* abort() on any error.
  */
 extern int vips__fatal;
@@ -167,9 +205,28 @@ void vips_threadset_free(VipsThreadset *set);
 VIPS_API void vips__worker_lock(GMutex *mutex);
 VIPS_API void vips__worker_cond_wait(GCond *cond, GMutex *mutex);
 gboolean vips__worker_exit(void);
+gint64 vips__worker_get_deadline(void);
+
+typedef struct _VipsSchedulerClient VipsSchedulerClient;
+void vips__scheduler_init(void);
+VipsSchedulerClient *vips__scheduler_client_new(int priority, int weight);
+void vips__scheduler_client_free(VipsSchedulerClient *client);
+gint64 vips__scheduler_acquire(VipsSchedulerClient *client);
+void vips__scheduler_release(VipsSchedulerClient *client, gint64 start);
 
 void vips__cache_init(void);
 
+gboolean vips__render_cache_enabled(void);
+void vips__render_cache_tag(VipsOperation *operation);
+char *vips__render_cache_key(VipsImage *image, const char *format);
+VipsBlob *vips__render_cache_lookup(const char *key);
+void vips__render_cache_add(const char *key, VipsBlob *blob);
+void vips__render_cache_drop(void);
+
+gboolean vips__module_load_all(void);
+void vips__module_load_filename(const char *filename);
+void *vips__class_map_all(GType type, VipsClassMapFn fn, void *a);
+
 int vips__print_renders(void);
 int vips__type_leak(void);
 int vips__object_leak(void);
@@ -197,6 +254,13 @@ void *vips__link_map(VipsImage *image, gboolean upstream,
 gboolean vips__mmap_supported(int fd);
 void *vips__mmap(int fd, int writeable, size_t length, gint64 offset);
 int vips__munmap(const void *start, size_t length);
+extern gboolean vips__mmap_hugepage;
+void vips__mmap_advise(void *baseaddr, size_t length,
+	VipsAccess access, VipsDemandStyle dhint);
+void vips__mmap_willneed(void *start, size_t length);
+void vips__window_set_access(VipsImage *image, VipsAccess access);
+void vips__window_cache_drop(const char *filename);
+void vips__window_cache_shutdown(void);
 
 /* Defined in `vips.h`, unless building with `-Ddeprecated=false`
  */
@@ -208,6 +272,7 @@ int vips_remapfilerw(VipsImage *image);
 
 void vips__buffer_init(void);
 void vips__buffer_shutdown(void);
+void vips__region_shutdown(void);
 
 void vips__copy_4byte(int swap, unsigned char *to, unsigned char *from);
 void vips__copy_2byte(gboolean swap, unsigned char *to, unsigned char *from);
@@ -226,6 +291,8 @@ void *vips__read_extension_block(VipsImage *im, size_t *size);
 VIPS_API
 int vips__write_extension_block(VipsImage *im, void *buf, size_t size);
 int vips__writehist(VipsImage *image);
+char *vips__build_xml(VipsImage *image);
+int vips__readhist_fd(VipsImage *im, int fd, gint64 offset);
 /* TODO(kleisauke): VIPS_API is required by vipsedit.
  */
 VIPS_API
@@ -239,6 +306,9 @@ int vips__image_meta_copy(VipsImage *dst, const VipsImage *src);
 extern GMutex vips__global_lock;
 
 int vips_image_written(VipsImage *image);
+void vips__image_set_constant(VipsImage *image, const VipsPel *pel);
+void vips__image_fold_constant(VipsImage *out, VipsImage **in);
+gboolean vips__image_iswrite(VipsImage *image);
 
 /* Defined in `vips.h`, unless building with `-Ddeprecated=false`
  */
@@ -286,6 +356,31 @@ void vips__draw_circle_direct(VipsImage *image, int cx, int cy, int r,
 	VipsDrawScanline draw_scanline, void *client);
 
 int vips__insert_paste_region(VipsRegion *out, VipsRegion *in, VipsRect *pos);
+int vips__region_shrink_threaded(VipsRegion *from, VipsRegion *to,
+	const VipsRect *target, VipsRegionShrink method);
+void vips__region_memory(VipsRegion *reg, VipsPel *data, size_t stride);
+int vips__sink_memory(VipsImage *image, VipsPel *data, size_t stride);
+
+/* SIMD paths for the 2x2 shrink, see region_hwy.cpp. These return the number
+ * of output pixels made.
+ */
+int vips_region_shrink_uchar_hwy(VipsPel *pout, VipsPel *pin, VipsPel *pin1,
+	int width, int bands, int method);
+int vips_region_shrink_ushort_hwy(VipsPel *pout, VipsPel *pin, VipsPel *pin1,
+	int width, int bands, int method);
+int vips_region_shrink_float_hwy(VipsPel *pout, VipsPel *pin, VipsPel *pin1,
+	int width, int bands, int method);
+int vips_region_shrink_alpha_uchar_hwy(VipsPel *pout, VipsPel *pin,
+	VipsPel *pin1, int width, int bands);
+
+void vips__half_to_float(float *out, const guint16 *in, size_t n);
+void vips__float_to_half(guint16 *out, const float *in, size_t n);
+
+/* SIMD paths for half float conversion, see half_hwy.cpp. These return the
+ * number of values converted.
+ */
+size_t vips_half_to_float_hwy(float *out, const guint16 *in, size_t n);
+size_t vips_float_to_half_hwy(guint16 *out, const float *in, size_t n);
 
 /* Register base vips interpolators, called during startup.
  */
@@ -308,6 +403,7 @@ void vips_mosaicing_operation_init(void);
 void vips_cimg_operation_init(void);
 
 guint64 vips__parse_size(const char *size_string);
+size_t vips__budget_get_free(void);
 /* TODO(kleisauke): VIPS_API is required by vipsthumbnail.
  */
 VIPS_API
@@ -348,6 +444,16 @@ typedef struct _VipsImagePixels {
 	gint64 npels; /* Number of pels calculated so far */
 } VipsImagePixels;
 
+void vips__nsgif_keyframe_shutdown(void);
+VipsImage *vips__foreign_load_crop(VipsImage *image,
+	int left, int top, int width, int height);
+VipsImage *vips__image_shrink_on_load(VipsImage *image, int shrink);
+void vips__sequential_tag(VipsImage *image);
+void vips__sequential_tag_outputs(VipsOperation *operation);
+GSList *vips__sequential_plan(VipsImage *image);
+void vips__sequential_unplan(GSList *planned);
+VipsOperation *vips__arithmetic_producer(VipsImage *image);
+VipsOperation *vips__colour_producer(VipsImage *image);
 int vips__foreign_convert_saveable(VipsImage *in, VipsImage **ready,
 	VipsForeignSaveable saveable, VipsBandFormat *format, VipsForeignCoding coding,
 	VipsArrayDouble *background);
@@ -362,6 +468,9 @@ int vips__image_intize(VipsImage *in, VipsImage **out);
 void vips__reorder_init(void);
 int vips__reorder_set_input(VipsImage *image, VipsImage **in);
 void vips__reorder_clear(VipsImage *image);
+int vips__reorder_margin(VipsImage *image);
+int vips__reorder_cache(VipsImage *in, VipsImage **out,
+	int width, int height);
 
 /* Window manager API.
  */
@@ -373,6 +482,8 @@ int vips__profile_set(VipsImage *image, const char *name);
 void vips__thread_profile_attach(const char *thread_name);
 void vips__thread_profile_detach(void);
 void vips__thread_profile_stop(void);
+void vips__metrics_shutdown(void);
+void vips__reduce_kernel_shutdown(void);
 
 int vips__lrmosaic(VipsImage *ref, VipsImage *sec, VipsImage *out,
 	int bandno,
@@ -425,6 +536,15 @@ const char *vips__find_rightmost_brackets(const char *p);
 void vips__change_suffix(const char *name, char *out, int mx,
 	const char *new_suff, const char **olds, int nolds);
 
+gboolean vips__strtod_fast(const char *p, const char *end, double *out);
+
+/* Enough for any double or integer from vips__dtoa() and vips__itoa().
+ */
+#define VIPS__DTOA_BUF_SIZE (32)
+
+int vips__dtoa(char *buf, double value);
+int vips__itoa(char *buf, gint64 value);
+
 guint32 vips__random(guint32 seed);
 guint32 vips__random_add(guint32 seed, int value);
 
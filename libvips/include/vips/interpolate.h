@@ -1,6 +1,9 @@
 /* Various interpolators.
  *
  * J.Cupitt, 15/10/08
+ *
+ * 14/10/26
+ * 	- add interpolate_span
  */
 
 /*
@@ -68,6 +71,12 @@ struct _VipsInterpolate {
 typedef void (*VipsInterpolateMethod)(VipsInterpolate *interpolate,
 	void *out, VipsRegion *in, double x, double y);
 
+/* Interpolate a run of n pixels. Positions are in x[] and y[], results are
+ * written one after the other to the memory at "out".
+ */
+typedef void (*VipsInterpolateSpanMethod)(VipsInterpolate *interpolate,
+	void *out, VipsRegion *in, const double *x, const double *y, int n);
+
 typedef struct _VipsInterpolateClass {
 	VipsObjectClass parent_class;
 
@@ -89,6 +98,11 @@ typedef struct _VipsInterpolateClass {
 	 */
 	int (*get_window_offset)(VipsInterpolate *interpolate);
 	int window_offset;
+
+	/* Interpolate a whole span of pixels. The default calls interpolate
+	 * once for each pixel.
+	 */
+	VipsInterpolateSpanMethod interpolate_span;
 } VipsInterpolateClass;
 
 VIPS_API
@@ -99,6 +113,12 @@ void vips_interpolate(VipsInterpolate *interpolate,
 VIPS_API
 VipsInterpolateMethod vips_interpolate_get_method(VipsInterpolate *interpolate);
 VIPS_API
+void vips_interpolate_span(VipsInterpolate *interpolate,
+	void *out, VipsRegion *in, const double *x, const double *y, int n);
+VIPS_API
+VipsInterpolateSpanMethod
+vips_interpolate_get_span_method(VipsInterpolate *interpolate);
+VIPS_API
 int vips_interpolate_get_window_size(VipsInterpolate *interpolate);
 VIPS_API
 int vips_interpolate_get_window_offset(VipsInterpolate *interpolate);
@@ -113,6 +113,29 @@ size_t vips_tracked_get_mem_highwater(void);
 VIPS_API
 int vips_tracked_get_allocs(void);
 
+typedef struct _VipsBudget VipsBudget;
+
+VIPS_API
+VipsBudget *vips_budget_new(size_t max_mem);
+VIPS_API
+VipsBudget *vips_budget_ref(VipsBudget *budget);
+VIPS_API
+void vips_budget_unref(VipsBudget *budget);
+VIPS_API
+void vips_budget_set_stall(VipsBudget *budget, gint64 stall);
+VIPS_API
+size_t vips_budget_get_mem(VipsBudget *budget);
+VIPS_API
+size_t vips_budget_get_mem_highwater(VipsBudget *budget);
+VIPS_API
+VipsBudget *vips_budget_set_current(VipsBudget *budget);
+VIPS_API
+VipsBudget *vips_budget_get_current(void);
+VIPS_API
+void vips_image_set_budget(VipsImage *image, VipsBudget *budget);
+VIPS_API
+VipsBudget *vips_image_get_budget(VipsImage *image);
+
 VIPS_API
 int vips_tracked_open(const char *pathname, int flags, int mode);
 VIPS_API
@@ -0,0 +1,79 @@
+/* Pipeline metrics.
+ */
+
+/*
+
+	This file is part of VIPS.
+
+	VIPS is free software; you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+	02110-1301  USA
+
+ */
+
+/*
+
+	These files are distributed with VIPS - http://www.vips.ecs.soton.ac.uk
+
+ */
+
+#ifndef VIPS_METRICS_H
+#define VIPS_METRICS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif /*__cplusplus*/
+
+/**
+ * VipsMetrics:
+ * @nickname: the operation these counters are for
+ * @tiles: number of tiles generated
+ * @pixels: number of pixels generated
+ * @generate_time: microseconds spent generating tiles, including upstream
+ * @bytes: bytes allocated with [func@tracked_malloc] while generating
+ * @buffers_reused: pixel buffers taken from a per-thread reserve
+ * @buffers_new: pixel buffers that had to be made
+ *
+ * A snapshot of the counters for one operation. See [func@metrics_map].
+ */
+typedef struct _VipsMetrics {
+	const char *nickname;
+	guint64 tiles;
+	guint64 pixels;
+	guint64 generate_time;
+	guint64 bytes;
+	guint64 buffers_reused;
+	guint64 buffers_new;
+} VipsMetrics;
+
+typedef void *(*VipsMetricsMapFn)(const VipsMetrics *metrics,
+	void *a, void *b);
+
+VIPS_API
+void vips_metrics_set(gboolean metrics);
+VIPS_API
+gboolean vips_metrics_get(void);
+VIPS_API
+void *vips_metrics_map(VipsMetricsMapFn fn, void *a, void *b);
+VIPS_API
+void vips_metrics_reset(void);
+
+VIPS_API
+void vips_metrics_arena(guint64 *hits, guint64 *misses, guint64 *peak);
+
+#ifdef __cplusplus
+}
+#endif /*__cplusplus*/
+
+#endif /*VIPS_METRICS_H*/
@@ -43,6 +43,10 @@ int vips_merge(VipsImage *ref, VipsImage *sec, VipsImage **out,
 	VipsDirection direction, int dx, int dy, ...)
 	G_GNUC_NULL_TERMINATED;
 VIPS_API
+int vips_mergen(VipsImage **in, VipsImage **out, int n,
+	const int *x, const int *y, ...)
+	G_GNUC_NULL_TERMINATED;
+VIPS_API
 int vips_mosaic(VipsImage *ref, VipsImage *sec, VipsImage **out,
 	VipsDirection direction, int xref, int yref, int xsec, int ysec, ...)
 	G_GNUC_NULL_TERMINATED;
@@ -315,6 +315,8 @@ int vips_argument_get_id(void);
 
 void vips__object_set_member(VipsObject *object, GParamSpec *pspec,
 	GObject **member, GObject *argument);
+int vips__object_set_pspec(VipsObject *object, GParamSpec *pspec,
+	const GValue *value);
 
 #endif /* !__GI_SCANNER__ */
 
@@ -347,6 +349,14 @@ VipsArgumentFlags vips_object_get_argument_flags(VipsObject *object,
 	const char *name);
 VIPS_API
 int vips_object_get_argument_priority(VipsObject *object, const char *name);
+VIPS_API
+int vips_object_class_find_argument(VipsObjectClass *object_class,
+	const char *name);
+VIPS_API
+VipsArgumentClass *vips_object_class_nth_argument(
+	VipsObjectClass *object_class, int n);
+VIPS_API
+int vips_object_set_nth(VipsObject *object, int n, const GValue *value);
 
 /* We have to loop over an objects args in several places, and we can't always
  * use vips_argument_map(), the preferred looper. Have the loop code as a
@@ -583,9 +593,14 @@ struct _VipsObjectClass {
 	 */
 	gboolean deprecated;
 
+	/* Name to argument lookup for this class, built on first use. This
+	 * takes the place of a reserved slot, so check the GType before
+	 * using it: subclasses start with a copy of their parent's pointer.
+	 */
+	struct _VipsArgumentIndex *argument_index;
+
 	/* Reserved for future expansion.
 	 */
-	void (*_vips_reserved1)(void);
 	void (*_vips_reserved2)(void);
 	void (*_vips_reserved3)(void);
 	void (*_vips_reserved4)(void);
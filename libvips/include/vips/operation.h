@@ -141,6 +141,10 @@ VipsOperation *vips_cache_operation_build(VipsOperation *operation);
 VIPS_API
 void vips_cache_print(void);
 VIPS_API
+void vips_cache_scope_begin(void);
+VIPS_API
+void vips_cache_scope_end(void);
+VIPS_API
 void vips_cache_set_max(int max);
 VIPS_API
 void vips_cache_set_max_mem(size_t max_mem);
@@ -149,6 +153,8 @@ int vips_cache_get_max(void);
 VIPS_API
 int vips_cache_get_size(void);
 VIPS_API
+void vips_cache_get_stats(guint64 *hits, guint64 *misses, guint64 *evictions);
+VIPS_API
 size_t vips_cache_get_max_mem(void);
 VIPS_API
 int vips_cache_get_max_files(void);
@@ -158,6 +164,22 @@ VIPS_API
 void vips_cache_set_dump(gboolean dump);
 VIPS_API
 void vips_cache_set_trace(gboolean trace);
+VIPS_API
+void vips_cache_set_shared(const char *dir);
+VIPS_API
+const char *vips_cache_get_shared(void);
+VIPS_API
+void vips_cache_set_shared_max_mem(size_t max_mem);
+VIPS_API
+size_t vips_cache_get_shared_max_mem(void);
+VIPS_API
+void vips_cache_set_render_max_mem(size_t max_mem);
+VIPS_API
+size_t vips_cache_get_render_max_mem(void);
+VIPS_API
+void vips_cache_set_render_dir(const char *dir);
+VIPS_API
+const char *vips_cache_get_render_dir(void);
 
 /* Part of threadpool, really, but we want these in a header that gets scanned
  * for our typelib.
@@ -167,9 +189,29 @@ void vips_concurrency_set(int concurrency);
 VIPS_API
 int vips_concurrency_get(void);
 
+VIPS_API
+void vips_scheduler_set_max(int max);
+VIPS_API
+int vips_scheduler_get_max(void);
+
 VIPS_API
 void vips_operation_block_set(const char *name, gboolean state);
 
+typedef struct _VipsPrepared VipsPrepared;
+
+VIPS_API
+VipsPrepared *vips_prepared_new(void);
+VIPS_API
+void vips_prepared_free(VipsPrepared *prepared);
+VIPS_API
+int vips_prepared_add(VipsPrepared *prepared, const char *operation_name, ...)
+	G_GNUC_NULL_TERMINATED;
+VIPS_API
+int vips_prepared_run(VipsPrepared *prepared, VipsImage *in, VipsImage **out);
+VIPS_API
+int vips_prepared_run_source(VipsPrepared *prepared,
+	VipsSource *source, VipsImage **out);
+
 #ifdef __cplusplus
 }
 #endif /*__cplusplus*/
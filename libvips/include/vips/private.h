@@ -67,12 +67,15 @@ VIPS_API
 int vips_window_unref(VipsWindow *window);
 VIPS_API
 void vips_window_print(VipsWindow *window);
+VIPS_API
+void vips_window_cache_set_max(gint64 max_bytes);
 
 /* Per-thread buffer state. Held in a GPrivate.
  */
 typedef struct {
-	GHashTable *hash; /* VipsImage -> VipsBufferCache* */
-	GThread *thread;  /* Just for sanity checking */
+	GHashTable *hash;				/* VipsImage -> VipsBufferCache* */
+	GThread *thread;				/* Just for sanity checking */
+	struct _VipsBufferArena *arena; /* Spare pixel memory, by size */
 } VipsBufferThread;
 
 /* Per-image buffer cache. This keeps a list of "done" VipsBuffer that this
@@ -155,6 +158,9 @@ typedef enum _RegionType {
 /* Functions on regions.
  */
 struct _VipsRegion;
+/* VIPS_API is required by the jxl module.
+ */
+VIPS_API
 void vips__region_take_ownership(struct _VipsRegion *reg);
 void vips__region_check_ownership(struct _VipsRegion *reg);
 /* TODO(kleisauke): VIPS_API is required by vipsdisp.
@@ -218,11 +224,37 @@ VIPS_API
 void VipsArrayImage_unref(VipsArrayImage *array);
 
 extern gboolean vips__thread_profile;
+extern gboolean vips__thread_profile_trace;
+extern gboolean vips__thread_profile_summary;
+extern gboolean vips__thread_profile_counters;
 
 void vips__thread_gate_start(const char *gate_name);
 void vips__thread_gate_stop(const char *gate_name);
 
 void vips__thread_malloc_free(gint64 size);
+void vips__thread_profile_tile(struct _VipsImage *image,
+	const VipsRect *rect, gint64 start);
+void vips__thread_profile_counters_start(void);
+void vips__thread_profile_counters_stop(struct _VipsImage *image);
+
+extern gboolean vips__metrics;
+
+/* The state for one tile being generated, so nested generates can
+ * subtract their time from their caller's.
+ */
+typedef struct _VipsMetricsTile {
+	void *previous;
+	gint64 *parent;
+	gint64 children;
+} VipsMetricsTile;
+
+void *vips__metrics_counter(const char *nickname);
+void vips__metrics_tile_start(struct _VipsImage *image,
+	VipsMetricsTile *tile);
+void vips__metrics_tile_stop(struct _VipsImage *image,
+	VipsMetricsTile *tile, const VipsRect *rect, gint64 start);
+void vips__metrics_malloc(size_t size);
+void vips__metrics_buffer(struct _VipsImage *image, gboolean reused);
 
 FILE *vips__file_open_read(const char *filename,
 	const char *fallback_dir, gboolean text_mode);
@@ -142,6 +142,15 @@ int vips_threadpool_run(VipsImage *im,
 	VipsThreadpoolProgressFn progress,
 	void *a);
 VIPS_API
+int vips_threadpool_run_steal(VipsImage *im,
+	VipsThreadStartFn start,
+	VipsThreadpoolWorkFn work,
+	VipsThreadpoolProgressFn progress,
+	int tile_width, int tile_height,
+	void *a);
+VIPS_API
+gboolean vips_threadpool_can_steal(VipsImage *im);
+VIPS_API
 void vips_get_tile_size(VipsImage *im,
 	int *tile_width, int *tile_height, int *n_lines);
 
@@ -51,6 +51,8 @@ VIPS_API
 const char *vips_vector_target_name(gint64 target);
 VIPS_API
 void vips_vector_disable_targets(gint64 disabled_targets);
+VIPS_API
+int vips_vector_set_target(const char *name);
 
 #ifdef __cplusplus
 }
@@ -101,6 +101,7 @@ extern "C" {
 #include <vips/object.h>
 #include <vips/type.h>
 #include <vips/gate.h>
+#include <vips/metrics.h>
 #include <vips/connection.h>
 #include <vips/sbuf.h>
 
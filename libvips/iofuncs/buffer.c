@@ -25,6 +25,9 @@
  * 	  buffers don't clog up the system
  * 13/10/16
  * 	- better solution: don't keep a buffercache for non-workers
+ * 14/10/26
+ * 	- add a per-thread size-classed arena for pixel memory, shared by all
+ * 	  the images a worker computes
  */
 
 /*
@@ -85,6 +88,42 @@ static GSList *vips__buffer_cache_all = NULL;
  */
 static const int buffer_cache_max_reserve = 2;
 
+/* Pixel memory is recycled through a per-thread arena of free blocks.
+ * Sizes are rounded up to one of four classes per power of two, from 4kb
+ * to 128mb, so we waste at most a quarter. Larger blocks go straight to
+ * vips_tracked_aligned_alloc().
+ */
+#define ARENA_MIN_SHIFT (12)
+#define ARENA_MAX_SHIFT (27)
+#define ARENA_N_CLASSES (4 * (ARENA_MAX_SHIFT - ARENA_MIN_SHIFT) + 1)
+
+/* Arena blocks are always aligned for the highway paths.
+ */
+#define ARENA_ALIGN (64)
+
+/* The most spare memory we hold per thread.
+ */
+static const size_t buffer_arena_max_held = 32 * 1024 * 1024;
+
+/* Free blocks are chained through their first word, so the arena
+ * never needs to malloc.
+ */
+typedef struct _VipsBufferArena {
+	void *free[ARENA_N_CLASSES];
+
+	size_t held;
+	size_t peak;
+	guint64 hits;
+	guint64 misses;
+} VipsBufferArena;
+
+/* Arena stats, totalled as each thread's arena is freed.
+ */
+static GMutex buffer_arena_lock;
+static guint64 buffer_arena_hits = 0;
+static guint64 buffer_arena_misses = 0;
+static guint64 buffer_arena_peak = 0;
+
 /* Workers have a BufferThread (and BufferCache) in a GPrivate they have
  * exclusive access to.
  */
@@ -197,10 +236,147 @@ vips_buffer_dump_all(void)
 #endif /*DEBUG*/
 }
 
+/* The size class for a block of at least @size bytes, or -1 for blocks too
+ * big for the arena.
+ */
+static int
+buffer_arena_class(size_t size)
+{
+	int shift;
+	size_t base;
+
+	if (size <= ((size_t) 1 << ARENA_MIN_SHIFT))
+		return 0;
+	if (size > ((size_t) 1 << ARENA_MAX_SHIFT))
+		return -1;
+
+	/* The power of two just below size, then which quarter of the
+	 * way up to the next power of two we need.
+	 */
+	for (shift = ARENA_MIN_SHIFT; ((size_t) 2 << shift) < size; shift++)
+		;
+	base = (size_t) 1 << shift;
+
+	return 4 * (shift - ARENA_MIN_SHIFT) +
+		(int) VIPS_ROUND_UP(size - base, base / 4) / (base / 4);
+}
+
+/* The number of bytes in blocks of class @i.
+ */
+static size_t
+buffer_arena_class_size(int i)
+{
+	size_t base;
+
+	if (i == 0)
+		return (size_t) 1 << ARENA_MIN_SHIFT;
+
+	base = (size_t) 1 << (ARENA_MIN_SHIFT + (i - 1) / 4);
+
+	return base + ((i - 1) % 4 + 1) * (base / 4);
+}
+
+static void
+buffer_arena_free(VipsBufferArena *arena)
+{
+	int i;
+
+	for (i = 0; i < ARENA_N_CLASSES; i++)
+		while (arena->free[i]) {
+			void *block = arena->free[i];
+
+			arena->free[i] = *((void **) block);
+			vips_tracked_aligned_free(block);
+		}
+
+	g_mutex_lock(&buffer_arena_lock);
+	buffer_arena_hits += arena->hits;
+	buffer_arena_misses += arena->misses;
+	buffer_arena_peak = VIPS_MAX(buffer_arena_peak, arena->peak);
+	g_mutex_unlock(&buffer_arena_lock);
+
+	g_free(arena);
+}
+
+static VipsBufferThread *buffer_thread_get(void);
+
+/* Get pixel memory for at least @size bytes. Workers try their arena first,
+ * so most tiles never touch the tracked-memory lock. @bsize is set to the
+ * size of the block we return.
+ */
+static VipsPel *
+buffer_block_alloc(size_t size, size_t align, size_t *bsize)
+{
+	VipsBufferThread *buffer_thread;
+	int i;
+
+	if ((buffer_thread = buffer_thread_get()) &&
+		(i = buffer_arena_class(size)) >= 0) {
+		VipsBufferArena *arena = buffer_thread->arena;
+		size_t class_size = buffer_arena_class_size(i);
+		void *block;
+
+		if ((block = arena->free[i])) {
+			arena->free[i] = *((void **) block);
+			arena->held -= class_size;
+			arena->hits += 1;
+		}
+		else {
+			arena->misses += 1;
+			if (!(block = vips_tracked_aligned_alloc(class_size,
+					  ARENA_ALIGN)))
+				return NULL;
+		}
+
+		*bsize = class_size;
+
+		return (VipsPel *) block;
+	}
+
+	*bsize = size;
+
+	return (VipsPel *) vips_tracked_aligned_alloc(size,
+		VIPS_MAX(align, ARENA_ALIGN));
+}
+
+/* Give a block back, to the arena if we can.
+ *
+ * This can run during thread shutdown, so we must not make a new
+ * VipsBufferThread here.
+ */
+static void
+buffer_block_free(VipsPel *buf, size_t bsize)
+{
+	VipsBufferThread *buffer_thread;
+	VipsBufferArena *arena;
+	int i;
+
+	if (!buf)
+		return;
+
+	/* Blocks made outside the arena can only go into it if they are an
+	 * exact class size.
+	 */
+	if (vips_thread_isvips() &&
+		(buffer_thread = g_private_get(&buffer_thread_key)) &&
+		(arena = buffer_thread->arena) &&
+		(i = buffer_arena_class(bsize)) >= 0 &&
+		buffer_arena_class_size(i) == bsize &&
+		arena->held + bsize <= buffer_arena_max_held) {
+		*((void **) buf) = arena->free[i];
+		arena->free[i] = buf;
+		arena->held += bsize;
+		arena->peak = VIPS_MAX(arena->peak, arena->held);
+	}
+	else
+		vips_tracked_aligned_free(buf);
+}
+
 static void
 vips_buffer_free(VipsBuffer *buffer)
 {
-	VIPS_FREEF(vips_tracked_aligned_free, buffer->buf);
+	buffer_block_free(buffer->buf, buffer->bsize);
+	buffer->buf = NULL;
 	buffer->bsize = 0;
 	g_free(buffer);
 
@@ -221,7 +397,14 @@ vips_buffer_free(VipsBuffer *buffer)
 static void
 buffer_thread_free(VipsBufferThread *buffer_thread)
 {
+	VipsBufferArena *arena = buffer_thread->arena;
+
+	/* Detach the arena first, so buffers freed by the caches go straight
+	 * back to the system.
+	 */
+	buffer_thread->arena = NULL;
 	VIPS_FREEF(g_hash_table_destroy, buffer_thread->hash);
+	VIPS_FREEF(buffer_arena_free, arena);
 	VIPS_FREE(buffer_thread);
 }
 
@@ -306,6 +489,7 @@ buffer_thread_new(void)
 		g_direct_hash, g_direct_equal,
 		NULL, (GDestroyNotify) buffer_cache_free);
 	buffer_thread->thread = g_thread_self();
+	buffer_thread->arena = g_new0(VipsBufferArena, 1);
 
 	return buffer_thread;
 }
@@ -495,9 +679,11 @@ buffer_move(VipsBuffer *buffer, VipsRect *area)
 
 	if (buffer->bsize < new_bsize ||
 		!buffer->buf) {
-		buffer->bsize = new_bsize;
-		VIPS_FREEF(vips_tracked_aligned_free, buffer->buf);
-		if (!(buffer->buf = vips_tracked_aligned_alloc(buffer->bsize, align)))
+		buffer_block_free(buffer->buf, buffer->bsize);
+		buffer->buf = NULL;
+		buffer->bsize = 0;
+		if (!(buffer->buf =
+					buffer_block_alloc(new_bsize, align, &buffer->bsize)))
 			return -1;
 	}
 
@@ -525,6 +711,9 @@ vips_buffer_new(VipsImage *im, VipsRect *area)
 		buffer->ref_count = 1;
 		buffer->done = FALSE;
 		buffer->cache = NULL;
+
+		if (vips__metrics)
+			vips__metrics_buffer(im, TRUE);
 	}
 	else {
 		buffer = g_new0(VipsBuffer, 1);
@@ -541,6 +730,9 @@ vips_buffer_new(VipsImage *im, VipsRect *area)
 			g_slist_prepend(vips__buffer_all, buffer);
 		g_mutex_unlock(&vips__global_lock);
 #endif /*DEBUG*/
+
+		if (vips__metrics)
+			vips__metrics_buffer(im, FALSE);
 	}
 
 	if (buffer_move(buffer, area)) {
@@ -645,6 +837,9 @@ vips_buffer_unref_ref(VipsBuffer *old_buffer, VipsImage *im, VipsRect *area)
 			return NULL;
 		}
 
+		if (vips__metrics)
+			vips__metrics_buffer(im, TRUE);
+
 		return old_buffer;
 	}
 
@@ -657,6 +852,32 @@ vips_buffer_unref_ref(VipsBuffer *old_buffer, VipsImage *im, VipsRect *area)
 	return buffer;
 }
 
+/**
+ * vips_metrics_arena:
+ * @hits: (out) (optional): pixel buffers recycled from an arena
+ * @misses: (out) (optional): pixel buffers which had to be allocated
+ * @peak: (out) (optional): the most spare memory any one thread has held
+ *
+ * Worker threads keep their spare pixel memory in a private arena, so most
+ * tiles can be allocated without a lock. This returns totals for the arenas
+ * of all threads which have finished a task.
+ *
+ * ::: seealso
+ *     [func@metrics_map].
+ */
+void
+vips_metrics_arena(guint64 *hits, guint64 *misses, guint64 *peak)
+{
+	g_mutex_lock(&buffer_arena_lock);
+	if (hits)
+		*hits = buffer_arena_hits;
+	if (misses)
+		*misses = buffer_arena_misses;
+	if (peak)
+		*peak = buffer_arena_peak;
+	g_mutex_unlock(&buffer_arena_lock);
+}
+
 static void
 buffer_thread_destroy_notify(gpointer data)
 {
@@ -6,6 +6,18 @@
  * 	- add a lock so we can run operations from many threads
  * 28/11/19 [MaxKellermann]
  * 	- make invalidate advisory rather than immediate
+ * 14/10/26
+ * 	- cost-aware (GreedyDual-Size) eviction
+ * 	- add vips_cache_get_stats()
+ * 	- shard the cache table, make touch lock-free
+ * 	- add vips_cache_scope_begin()/_end()
+ * 	- tag outputs reused from the cache, for vips_image_explain()
+ * 15/10/26
+ * 	- add vips_cache_set_shared()
+ * 	- tag outputs for the render cache
+ * 	- check file loads with stat() on hit
+ * 	- size entries by the pixel buffers their outputs hold
+ * 	- check mtime to the nanosecond, stat outside the shard lock
  */
 
 /*
@@ -64,6 +76,8 @@
 #endif /*HAVE_UNISTD_H*/
 #include <ctype.h>
 
+#include <glib/gstdio.h>
+
 #include <vips/vips.h>
 #include <vips/internal.h>
 #include <vips/debug.h>
@@ -93,37 +107,134 @@ static int vips_cache_max_files = 100;
  */
 static size_t vips_cache_max_mem = 100 * 1024 * 1024;
 
-/* Hold a ref to all "recent" operations.
+/* Directory for the cross-process cache of decoded images, or NULL for
+ * none.
+ */
+static char *vips_cache_shared = NULL;
+
+/* Keep the shared directory below this many bytes.
  */
-static GHashTable *vips_cache_table = NULL;
+static size_t vips_cache_shared_max_mem = 1024 * 1024 * 1024;
+
+/* The cache is split into shards by operation hash, each with its own lock,
+ * so lookups from many threads don't all serialise on one mutex.
+ */
+#define VIPS_CACHE_SHARDS (16)
+
+typedef struct _VipsCacheShard {
+	/* Protect this shard with this.
+	 */
+	GMutex lock;
+
+	/* Hold a ref to all "recent" operations in this shard.
+	 */
+	GHashTable *table;
+
+	/* Stats for vips_cache_get_stats(), protected by lock.
+	 */
+	guint64 hits;
+	guint64 misses;
+} VipsCacheShard;
+
+static VipsCacheShard vips_cache_shards[VIPS_CACHE_SHARDS];
 
-/* A 'time' counter: increment on all cache ops. Use this to detect LRU.
+/* Set once the shards have been made, cleared by vips_cache_drop_all().
+ */
+static gboolean vips_cache_ready = FALSE;
+
+/* Number of entries across all shards (atomic).
+ */
+static int vips_cache_n = 0;
+
+/* A 'time' counter: increment on all cache ops (atomic). Use this to break
+ * ties between entries of equal priority.
  */
 static int vips_cache_time = 0;
 
-/* Protect cache access with this.
+/* Only one thread trims at once. This protects the inflation value,
+ * the eviction count and the entry priorities.
+ */
+static GMutex vips_cache_trim_lock;
+
+/* The GreedyDual-Size inflation value. Each time we evict an entry, this
+ * rises to the priority of the victim, so entries which haven't been used
+ * for a while gradually lose out to fresh ones.
+ */
+static double vips_cache_inflation = 0.0;
+
+/* Entries which hold less than this are treated as if they were this
+ * large. This stops cheap, lazy operations (most of them) having a near
+ * infinite value.
+ */
+#define VIPS_CACHE_MIN_SIZE (4096)
+
+/* Number of entries dropped by vips_cache_trim().
+ */
+static guint64 vips_cache_evictions = 0;
+
+/* A stack of build scopes for this thread, innermost first. Each is a table
+ * of the operations built while it was open.
+ */
+static GPrivate vips_cache_scopes;
+
+/* The file behind a file load, as it was when we built. mtime_nsec is zero
+ * on platforms without sub-second mtimes.
  */
-static GMutex vips_cache_lock;
+typedef struct _VipsCacheFileStat {
+	guint64 dev;
+	guint64 ino;
+	gint64 mtime;
+	gint64 mtime_nsec;
+	gint64 size;
+} VipsCacheFileStat;
 
 /* A cache entry.
  */
 typedef struct _VipsOperationCacheEntry {
+	/* Output images point back to their entry, so touch can find it
+	 * without a lock. This count keeps the entry alive while a touch is
+	 * in progress (atomic).
+	 */
+	int ref_count;
+
 	VipsOperation *operation;
 
-	/* When we added this operation to cache .. used to find LRU for
-	 * flush.
+	/* When we last used this operation (atomic). Touch just sets this,
+	 * so it's lock-free and only approximate.
 	 */
 	int time;
 
+	/* How long the operation took to build, in microseconds, and how
+	 * many bytes of pixel buffers its outputs hold. Cost is what we pay
+	 * to recompute the entry if we drop it, size is what we free.
+	 */
+	gint64 cost;
+	size_t size;
+
+	/* GreedyDual-Size priority: the inflation value when we were last
+	 * touched, plus cost / size. We evict the lowest priority entry first.
+	 *
+	 * This is only updated during trim, when we see that time has moved
+	 * on since priority_time.
+	 */
+	double priority;
+	int priority_time;
+
 	/* We listen for "invalidate" from the operation. Track the id here so
 	 * we can disconnect when we drop an operation.
 	 */
 	gulong invalidate_id;
 
-	/* Set if someone thinks this cache entry should be dropped.
+	/* Set if someone thinks this cache entry should be dropped (atomic).
 	 */
 	gboolean invalid;
 
+	/* For file loaders, the file we loaded. A hit is only valid if the
+	 * file still matches, so files replaced in place are loaded again.
+	 */
+	gboolean has_file;
+	VipsCacheFileStat file;
+
 } VipsOperationCacheEntry;
 
 /* Pass in the pspec so we can get the generic type. For example, a
@@ -609,6 +720,24 @@ vips_object_unref_arg(VipsObject *object,
 	return NULL;
 }
 
+static gpointer
+vips_entry_dup(gpointer data, gpointer user_data)
+{
+	VipsOperationCacheEntry *entry = data;
+
+	if (entry)
+		g_atomic_int_inc(&entry->ref_count);
+
+	return entry;
+}
+
+static void
+vips_entry_unref(VipsOperationCacheEntry *entry)
+{
+	if (g_atomic_int_dec_and_test(&entry->ref_count))
+		g_free(entry);
+}
+
 static void
 vips_cache_free_cb(VipsOperationCacheEntry *entry)
 {
@@ -625,18 +754,26 @@ vips_cache_free_cb(VipsOperationCacheEntry *entry)
 	(void) vips_argument_map(VIPS_OBJECT(entry->operation),
 		vips_object_unref_arg, NULL, NULL);
 	g_object_unref(entry->operation);
+	entry->operation = NULL;
+
+	g_atomic_int_add(&vips_cache_n, -1);
 
-	g_free(entry);
+	vips_entry_unref(entry);
 }
 
 void *
 vips__cache_once_init(void *data)
 {
-	vips_cache_table = g_hash_table_new_full(
-		(GHashFunc) vips_operation_hash,
-		(GEqualFunc) vips_operation_equal,
-		NULL,
-		(GDestroyNotify) vips_cache_free_cb);
+	int i;
+
+	for (i = 0; i < VIPS_CACHE_SHARDS; i++)
+		vips_cache_shards[i].table = g_hash_table_new_full(
+			(GHashFunc) vips_operation_hash,
+			(GEqualFunc) vips_operation_equal,
+			NULL,
+			(GDestroyNotify) vips_cache_free_cb);
+
+	vips_cache_ready = TRUE;
 
 	return NULL;
 }
@@ -649,6 +786,13 @@ vips__cache_init(void)
 	VIPS_ONCE(&once, vips__cache_once_init, NULL);
 }
 
+static VipsCacheShard *
+vips_cache_shard(VipsOperation *operation)
+{
+	return &vips_cache_shards[vips_operation_hash(operation) %
+		VIPS_CACHE_SHARDS];
+}
+
 static void *
 vips_cache_print_fn(void *value, void *a, void *b)
 {
@@ -664,16 +808,6 @@ vips_cache_print_fn(void *value, void *a, void *b)
 	return NULL;
 }
 
-static void
-vips_cache_print_nolock(void)
-{
-	if (vips_cache_table) {
-		printf("Operation cache:\n");
-		vips_hash_table_map(vips_cache_table,
-			vips_cache_print_fn, NULL, NULL);
-	}
-}
-
 /**
  * vips_cache_print:
  *
@@ -682,25 +816,92 @@ vips_cache_print_nolock(void)
 void
 vips_cache_print(void)
 {
-	g_mutex_lock(&vips_cache_lock);
+	int i;
+
+	if (!vips_cache_ready)
+		return;
+
+	printf("Operation cache:\n");
+	for (i = 0; i < VIPS_CACHE_SHARDS; i++) {
+		VipsCacheShard *shard = &vips_cache_shards[i];
 
-	vips_cache_print_nolock();
+		g_mutex_lock(&shard->lock);
 
-	g_mutex_unlock(&vips_cache_lock);
+		if (shard->table)
+			vips_hash_table_map(shard->table,
+				vips_cache_print_fn, NULL, NULL);
+
+		g_mutex_unlock(&shard->lock);
+	}
 }
 
 static VipsOperationCacheEntry *
-vips_cache_operation_get(VipsOperation *operation)
+vips_cache_operation_get(VipsCacheShard *shard, VipsOperation *operation)
 {
-	return g_hash_table_lookup(vips_cache_table, operation);
+	return shard->table ? g_hash_table_lookup(shard->table, operation) : NULL;
+}
+
+/* Fetch the identity of the file a file loader reads, or FALSE if this is
+ * not a file load, or the file has gone.
+ */
+static gboolean
+vips_cache_file_stat(VipsOperation *operation, VipsCacheFileStat *file)
+{
+	char *filename;
+	GStatBuf st;
+	int result;
+
+	if (!VIPS_IS_FOREIGN_LOAD(operation) ||
+		!g_object_class_find_property(G_OBJECT_GET_CLASS(operation),
+			"filename"))
+		return FALSE;
+
+	g_object_get(operation, "filename", &filename, NULL);
+	result = filename ? g_stat(filename, &st) : -1;
+	g_free(filename);
+	if (result)
+		return FALSE;
+
+	file->dev = st.st_dev;
+	file->ino = st.st_ino;
+	file->mtime = st.st_mtime;
+#if defined(HAVE_STRUCT_STAT_ST_MTIM)
+	file->mtime_nsec = st.st_mtim.tv_nsec;
+#elif defined(HAVE_STRUCT_STAT_ST_MTIMESPEC)
+	file->mtime_nsec = st.st_mtimespec.tv_nsec;
+#else
+	file->mtime_nsec = 0;
+#endif
+	file->size = st.st_size;
+
+	return TRUE;
+}
+
+/* TRUE if the file behind an entry has changed since we built it. @file is
+ * the file as it is now, or NULL if it has gone.
+ */
+static gboolean
+vips_cache_entry_stale(VipsOperationCacheEntry *entry,
+	VipsCacheFileStat *file)
+{
+	if (!entry->has_file)
+		return FALSE;
+
+	return !file ||
+		file->dev != entry->file.dev ||
+		file->ino != entry->file.ino ||
+		file->mtime != entry->file.mtime ||
+		file->mtime_nsec != entry->file.mtime_nsec ||
+		file->size != entry->file.size;
 }
 
 /* Remove an operation from the cache.
  */
 static void
-vips_cache_remove(VipsOperation *operation)
+vips_cache_remove(VipsCacheShard *shard, VipsOperation *operation)
 {
-	g_hash_table_remove(vips_cache_table, operation);
+	if (shard->table)
+		g_hash_table_remove(shard->table, operation);
 }
 
 static void *
@@ -731,24 +932,35 @@ vips_object_ref_arg(VipsObject *object,
 	return NULL;
 }
 
+/* This can be called for entries in any shard, so it takes no lock and just
+ * stamps the entry with the current time. The priority is brought up to date
+ * from this during trim.
+ */
 static void
 vips_entry_touch(VipsOperationCacheEntry *entry)
 {
 	/* Don't up the time for invalid items -- we want them to fall out of
 	 * cache.
 	 */
-	if (!entry->invalid)
-		entry->time = vips_cache_time;
+	if (!g_atomic_int_get(&entry->invalid))
+		g_atomic_int_set(&entry->time, g_atomic_int_get(&vips_cache_time));
 }
 
 static void *
 vips_image_touch_cb(VipsImage *image, void *a, void *b)
 {
-	VipsOperationCacheEntry *entry =
-		g_object_get_data(G_OBJECT(image), "libvips-cache-entry");
+	VipsOperationCacheEntry *entry;
 
-	if (entry)
+	/* The entry can be dropped by another thread at any moment, so take a
+	 * ref while we touch it.
+	 */
+	entry = g_object_dup_data(G_OBJECT(image), "libvips-cache-entry",
+		vips_entry_dup, NULL);
+
+	if (entry) {
 		vips_entry_touch(entry);
+		vips_entry_unref(entry);
+	}
 
 	return NULL;
 }
@@ -793,7 +1005,7 @@ vips_entry_ref(VipsOperationCacheEntry *entry)
 	(void) vips_argument_map(VIPS_OBJECT(entry->operation),
 		vips_object_ref_arg, entry, NULL);
 
-	vips_cache_time += 1;
+	g_atomic_int_inc(&vips_cache_time);
 
 	/* Touch the cache entries on the upstream trees on all input images.
 	 */
@@ -814,11 +1026,122 @@ vips_cache_invalidate_cb(VipsOperation *operation,
 	vips_object_print_summary(VIPS_OBJECT(operation));
 #endif /*DEBUG*/
 
-	entry->invalid = TRUE;
+	g_atomic_int_set(&entry->invalid, TRUE);
+}
+
+static void *
+vips_cache_footprint_add_cb(VipsImage *image, GHashTable *images, void *b)
+{
+	size_t size;
+
+	size = 0;
+	if ((image->dtype == VIPS_IMAGE_SETBUF ||
+			image->dtype == VIPS_IMAGE_SETBUF_FOREIGN) &&
+		image->data)
+		size = VIPS_IMAGE_SIZEOF_IMAGE(image);
+
+	g_hash_table_insert(images, image, GSIZE_TO_POINTER(size));
+
+	return NULL;
+}
+
+static void *
+vips_cache_footprint_remove_cb(VipsImage *image, GHashTable *images, void *b)
+{
+	g_hash_table_remove(images, image);
+
+	return NULL;
+}
+
+static void
+vips_cache_footprint_image(VipsImage *image, gboolean output,
+	GHashTable *images)
+{
+	(void) vips__link_map(image, TRUE,
+		(VipsSListMap2Fn) (output
+				? vips_cache_footprint_add_cb
+				: vips_cache_footprint_remove_cb),
+		images, NULL);
+}
+
+static void *
+vips_cache_footprint_arg(VipsObject *object,
+	GParamSpec *pspec,
+	VipsArgumentClass *argument_class,
+	VipsArgumentInstance *argument_instance,
+	void *a, void *b)
+{
+	GHashTable *images = (GHashTable *) a;
+	gboolean output = GPOINTER_TO_INT(b);
+	VipsArgumentFlags flags = output
+		? VIPS_ARGUMENT_OUTPUT
+		: VIPS_ARGUMENT_INPUT;
+	GType type = G_PARAM_SPEC_VALUE_TYPE(pspec);
+	const char *name = g_param_spec_get_name(pspec);
+
+	if (!(argument_class->flags & VIPS_ARGUMENT_CONSTRUCT) ||
+		!(argument_class->flags & flags) ||
+		!argument_instance->assigned)
+		return NULL;
+
+	if (g_type_is_a(type, VIPS_TYPE_IMAGE)) {
+		VipsImage *image;
+
+		g_object_get(G_OBJECT(object), name, &image, NULL);
+		if (image)
+			vips_cache_footprint_image(image, output, images);
+		VIPS_UNREF(image);
+	}
+	else if (g_type_is_a(type, VIPS_TYPE_ARRAY_IMAGE)) {
+		VipsArrayImage *array;
+
+		g_object_get(G_OBJECT(object), name, &array, NULL);
+		if (array) {
+			int n;
+			VipsImage **in = vips_array_image_get(array, &n);
+
+			for (int i = 0; i < n; i++)
+				vips_cache_footprint_image(in[i], output, images);
+			vips_area_unref(VIPS_AREA(array));
+		}
+	}
+
+	return NULL;
+}
+
+/* The bytes of pixel buffers an operation's outputs hold. We count the
+ * buffers upstream of the outputs less those upstream of the inputs, so a
+ * loader is charged for the image it decoded to memory, but a lazy
+ * operation on a memory image is not charged for its input. File-backed
+ * images cost nothing, since their windows can always be mapped again.
+ */
+static size_t
+vips_cache_footprint(VipsOperation *operation)
+{
+	GHashTable *images;
+	GHashTableIter iter;
+	gpointer value;
+	size_t size;
+
+	images = g_hash_table_new(g_direct_hash, g_direct_equal);
+	(void) vips_argument_map(VIPS_OBJECT(operation),
+		vips_cache_footprint_arg, images, GINT_TO_POINTER(TRUE));
+	(void) vips_argument_map(VIPS_OBJECT(operation),
+		vips_cache_footprint_arg, images, GINT_TO_POINTER(FALSE));
+
+	size = 0;
+	g_hash_table_iter_init(&iter, images);
+	while (g_hash_table_iter_next(&iter, NULL, &value))
+		size += GPOINTER_TO_SIZE(value);
+
+	g_hash_table_destroy(images);
+
+	return size;
 }
 
 static void
-vips_cache_insert(VipsOperation *operation)
+vips_cache_insert(VipsCacheShard *shard, VipsOperation *operation,
+	gint64 cost, size_t size, VipsCacheFileStat *file)
 {
 	VipsOperationCacheEntry *entry = g_new(VipsOperationCacheEntry, 1);
 
@@ -827,12 +1150,21 @@ vips_cache_insert(VipsOperation *operation)
 	vips_object_print_dump(VIPS_OBJECT(operation));
 #endif /*VIPS_DEBUG*/
 
+	entry->ref_count = 1;
 	entry->operation = operation;
 	entry->time = 0;
+	entry->cost = cost;
+	entry->size = size;
+	entry->priority = 0.0;
+	entry->priority_time = -1;
 	entry->invalidate_id = 0;
 	entry->invalid = FALSE;
+	entry->has_file = file != NULL;
+	if (file)
+		entry->file = *file;
 
-	g_hash_table_insert(vips_cache_table, operation, entry);
+	g_hash_table_insert(shard->table, operation, entry);
+	g_atomic_int_inc(&vips_cache_n);
 	vips_entry_ref(entry);
 
 	/* If the operation signals "invalidate", we must tag this cache entry
@@ -851,74 +1183,188 @@ vips_cache_insert(VipsOperation *operation)
 void
 vips_cache_drop_all(void)
 {
+	int i;
+
 #ifdef VIPS_DEBUG
 	printf("vips_cache_drop_all:\n");
 #endif /*VIPS_DEBUG*/
 
-	g_mutex_lock(&vips_cache_lock);
+	g_mutex_lock(&vips_cache_trim_lock);
 
-	if (vips_cache_table) {
+	if (vips_cache_ready) {
 		if (vips__cache_dump)
-			vips_cache_print_nolock();
+			vips_cache_print();
+
+		for (i = 0; i < VIPS_CACHE_SHARDS; i++) {
+			VipsCacheShard *shard = &vips_cache_shards[i];
+
+			g_mutex_lock(&shard->lock);
 
-		g_hash_table_remove_all(vips_cache_table);
-		VIPS_FREEF(g_hash_table_unref, vips_cache_table);
+			if (shard->table) {
+				g_hash_table_remove_all(shard->table);
+				VIPS_FREEF(g_hash_table_unref, shard->table);
+			}
+
+			g_mutex_unlock(&shard->lock);
+		}
+
+		vips_cache_ready = FALSE;
 	}
 
-	g_mutex_unlock(&vips_cache_lock);
+	g_mutex_unlock(&vips_cache_trim_lock);
 }
 
+/* Bring the GreedyDual-Size priority up to date if the entry has been
+ * touched since we last looked. Call with the trim lock and the shard lock
+ * held.
+ */
 static void
-vips_cache_get_lru_cb(VipsOperation *key, VipsOperationCacheEntry *value,
+vips_entry_update_priority(VipsOperationCacheEntry *entry)
+{
+	int time = g_atomic_int_get(&entry->time);
+
+	if (entry->priority_time != time) {
+		entry->priority = vips_cache_inflation +
+			(double) (entry->cost + 1) /
+				(entry->size + VIPS_CACHE_MIN_SIZE);
+		entry->priority_time = time;
+	}
+}
+
+/* Is a a better eviction candidate than b? Invalid entries always go first,
+ * then lowest priority, then least recently used.
+ */
+static gboolean
+vips_cache_entry_worse(VipsOperationCacheEntry *a, VipsOperationCacheEntry *b)
+{
+	gboolean a_invalid = g_atomic_int_get(&a->invalid);
+	gboolean b_invalid = g_atomic_int_get(&b->invalid);
+
+	if (a_invalid != b_invalid)
+		return a_invalid;
+	if (a->priority != b->priority)
+		return a->priority < b->priority;
+
+	return a->priority_time < b->priority_time;
+}
+
+static void
+vips_cache_get_victim_cb(VipsOperation *key, VipsOperationCacheEntry *value,
 	VipsOperationCacheEntry **best)
 {
+	vips_entry_update_priority(value);
+
 	if (!*best ||
-		(*best)->time > value->time)
+		vips_cache_entry_worse(value, *best))
 		*best = value;
 }
 
-/* Get the least-recently-used cache item.
- *
- * TODO ... will this be too expensive? probably not
+/* Get the item in a shard that is cheapest to lose. Call with the shard
+ * lock held.
  */
-static VipsOperation *
-vips_cache_get_lru(void)
+static VipsOperationCacheEntry *
+vips_cache_shard_get_victim(VipsCacheShard *shard)
 {
 	VipsOperationCacheEntry *entry;
 
 	entry = NULL;
-	g_hash_table_foreach(vips_cache_table,
-		(GHFunc) vips_cache_get_lru_cb, &entry);
+	if (shard->table)
+		g_hash_table_foreach(shard->table,
+			(GHFunc) vips_cache_get_victim_cb, &entry);
 
-	if (entry)
-		return entry->operation;
-
-	return NULL;
+	return entry;
 }
 
-/* Is the cache full? Drop until it's not.
+/* Drop the cache item that is cheapest to lose. This is GreedyDual-Size:
+ * each entry has a priority of the inflation value when it was last used
+ * plus its rebuild cost divided by its size, and we drop the lowest.
+ * Dropping an entry raises the inflation value to its priority, so entries
+ * age out if they are not reused.
+ *
+ * We find the shard holding the victim with one lock at a time, then lock
+ * that shard again and drop its worst entry. Another thread may have
+ * changed the shard in between, so this is only approximately the global
+ * minimum.
+ *
+ * Call with the trim lock held. Return FALSE if the cache is empty.
  */
-static void
-vips_cache_trim(void)
+static gboolean
+vips_cache_trim_one(void)
 {
-	VipsOperation *operation;
+	VipsCacheShard *victim_shard;
+	gboolean victim_invalid;
+	double victim_priority;
+	int victim_time;
+	VipsOperationCacheEntry *entry;
+	int i;
+
+	victim_shard = NULL;
+	victim_invalid = FALSE;
+	victim_priority = 0.0;
+	victim_time = 0;
+	for (i = 0; i < VIPS_CACHE_SHARDS; i++) {
+		VipsCacheShard *shard = &vips_cache_shards[i];
+
+		g_mutex_lock(&shard->lock);
+
+		if ((entry = vips_cache_shard_get_victim(shard))) {
+			gboolean invalid = g_atomic_int_get(&entry->invalid);
+
+			if (!victim_shard ||
+				(invalid && !victim_invalid) ||
+				(invalid == victim_invalid &&
+					(entry->priority < victim_priority ||
+						(entry->priority == victim_priority &&
+							entry->priority_time < victim_time)))) {
+				victim_shard = shard;
+				victim_invalid = invalid;
+				victim_priority = entry->priority;
+				victim_time = entry->priority_time;
+			}
+		}
 
-	g_mutex_lock(&vips_cache_lock);
+		g_mutex_unlock(&shard->lock);
+	}
 
-	while (vips_cache_table &&
-		(g_hash_table_size(vips_cache_table) > vips_cache_max ||
-			vips_tracked_get_files() > vips_cache_max_files ||
-			vips_tracked_get_mem() > vips_cache_max_mem) &&
-		(operation = vips_cache_get_lru())) {
+	if (!victim_shard)
+		return FALSE;
+
+	g_mutex_lock(&victim_shard->lock);
+
+	if ((entry = vips_cache_shard_get_victim(victim_shard))) {
 #ifdef DEBUG
 		printf("vips_cache_trim: trimming ");
-		vips_object_print_summary(VIPS_OBJECT(operation));
+		vips_object_print_summary(VIPS_OBJECT(entry->operation));
 #endif /*DEBUG*/
 
-		vips_cache_remove(operation);
+		if (!g_atomic_int_get(&entry->invalid))
+			vips_cache_inflation =
+				VIPS_MAX(vips_cache_inflation, entry->priority);
+
+		vips_cache_remove(victim_shard, entry->operation);
+		vips_cache_evictions += 1;
 	}
 
-	g_mutex_unlock(&vips_cache_lock);
+	g_mutex_unlock(&victim_shard->lock);
+
+	return TRUE;
+}
+
+/* Is the cache full? Drop until it's not.
+ */
+static void
+vips_cache_trim(void)
+{
+	g_mutex_lock(&vips_cache_trim_lock);
+
+	while (vips_cache_ready &&
+		(g_atomic_int_get(&vips_cache_n) > vips_cache_max ||
+			vips_tracked_get_files() > vips_cache_max_files ||
+			vips_tracked_get_mem() > vips_cache_max_mem) &&
+		vips_cache_trim_one())
+		;
+
+	g_mutex_unlock(&vips_cache_trim_lock);
 }
 
 #ifdef DEBUG_LEAK
@@ -964,6 +1410,109 @@ vips_cache_find_differences(VipsObject *object,
 }
 #endif /*DEBUG_LEAK*/
 
+static void *
+vips_object_tag_hit(VipsObject *object,
+	GParamSpec *pspec,
+	VipsArgumentClass *argument_class,
+	VipsArgumentInstance *argument_instance,
+	void *a, void *b)
+{
+	if ((argument_class->flags & VIPS_ARGUMENT_OUTPUT) &&
+		argument_instance->assigned &&
+		G_IS_PARAM_SPEC_OBJECT(pspec)) {
+		GObject *value;
+
+		g_object_get(G_OBJECT(object),
+			g_param_spec_get_name(pspec), &value, NULL);
+		g_object_set_data(value, "libvips-cache-hit", GINT_TO_POINTER(1));
+		g_object_unref(value);
+	}
+
+	return NULL;
+}
+
+/* Ref an operation for a scope, or for a scope hit. The operation, plus
+ * all of its output objects, exactly as a fresh build leaves them.
+ */
+static void *
+vips_cache_scope_ref_arg(VipsObject *object,
+	GParamSpec *pspec,
+	VipsArgumentClass *argument_class,
+	VipsArgumentInstance *argument_instance,
+	void *a, void *b)
+{
+	if ((argument_class->flags & VIPS_ARGUMENT_OUTPUT) &&
+		argument_instance->assigned &&
+		G_IS_PARAM_SPEC_OBJECT(pspec)) {
+		GObject *value;
+
+		/* This will up the ref count for us.
+		 */
+		g_object_get(G_OBJECT(object),
+			g_param_spec_get_name(pspec), &value, NULL);
+	}
+
+	return NULL;
+}
+
+static void
+vips_cache_scope_ref(VipsOperation *operation)
+{
+	g_object_ref(operation);
+	(void) vips_argument_map(VIPS_OBJECT(operation),
+		vips_cache_scope_ref_arg, NULL, NULL);
+}
+
+static void
+vips_cache_scope_unref(VipsOperation *operation)
+{
+	vips_object_unref_outputs(VIPS_OBJECT(operation));
+	g_object_unref(operation);
+}
+
+/* Search the open scopes for an operation equal to this one.
+ */
+static VipsOperation *
+vips_cache_scope_get(VipsOperation *operation)
+{
+	GSList *p;
+
+	for (p = g_private_get(&vips_cache_scopes); p; p = p->next) {
+		VipsOperation *hit;
+
+		if ((hit = g_hash_table_lookup((GHashTable *) p->data,
+				 operation)))
+			return hit;
+	}
+
+	return NULL;
+}
+
+static void
+vips_cache_scope_insert(VipsOperation *operation)
+{
+	GSList *scopes = g_private_get(&vips_cache_scopes);
+	GHashTable *scope = (GHashTable *) scopes->data;
+
+	if (!g_hash_table_contains(scope, operation)) {
+		vips_cache_scope_ref(operation);
+		g_hash_table_add(scope, operation);
+	}
+}
+
+/* Operations we can share within a scope: the same rules as the main cache.
+ */
+static gboolean
+vips_cache_scope_shareable(VipsOperation *operation)
+{
+	VipsOperationFlags flags = vips_operation_get_flags(operation);
+
+	return g_private_get(&vips_cache_scopes) &&
+		!(flags & (VIPS_OPERATION_NOCACHE |
+			VIPS_OPERATION_BLOCKED |
+			VIPS_OPERATION_REVALIDATE));
+}
+
 /**
  * vips_cache_operation_buildp: (skip)
  * @operation: pointer to operation to lookup
@@ -976,6 +1525,10 @@ vips_cache_find_differences(VipsObject *object,
  * Operators that have been tagged as invalid by [signal@Image::invalidate] are
  * removed from cache.
  *
+ * File loaders record the device, inode, modification time and size of
+ * their file. A hit is only used if the file still matches, so files which
+ * are replaced in place are loaded again.
+ *
  * Operators with the [flags@Vips.OperationFlags.BLOCKED] flag are never
  * executed.
  *
@@ -993,7 +1546,10 @@ vips_cache_operation_buildp(VipsOperation **operation)
 	 */
 	VipsOperationFlags flags = vips_operation_get_flags(*operation);
 
+	VipsCacheShard *shard;
 	VipsOperationCacheEntry *hit;
+	VipsCacheFileStat file;
+	gboolean has_file;
 
 	g_assert(VIPS_IS_OPERATION(*operation));
 
@@ -1004,19 +1560,53 @@ vips_cache_operation_buildp(VipsOperation **operation)
 	vips_object_print_dump(VIPS_OBJECT(*operation));
 #endif /*VIPS_DEBUG*/
 
-	g_mutex_lock(&vips_cache_lock);
+	/* Something identical built earlier in an open scope wins, even if
+	 * the main cache has dropped it, or caching is off.
+	 */
+	if (vips_cache_scope_shareable(*operation)) {
+		VipsOperation *scope_hit;
+
+		if ((scope_hit = vips_cache_scope_get(*operation))) {
+			vips_cache_scope_ref(scope_hit);
+			g_object_unref(*operation);
+			*operation = scope_hit;
+			(void) vips_argument_map(VIPS_OBJECT(*operation),
+				vips_object_tag_hit, NULL, NULL);
+
+			if (vips__cache_trace) {
+				printf("vips scope*: ");
+				vips_object_print_summary(VIPS_OBJECT(*operation));
+			}
+
+			return 0;
+		}
+	}
+
+	/* The hash can't change during build, so this stays the right shard
+	 * for the insert below.
+	 */
+	shard = vips_cache_shard(*operation);
+
+	/* If this is a file load, stat the file now rather than with the
+	 * shard locked. Hits are checked against this, and a miss records
+	 * it, so a file which changes during the build looks stale next time.
+	 */
+	has_file = vips_cache_file_stat(*operation, &file);
+
+	g_mutex_lock(&shard->lock);
 
-	hit = vips_cache_operation_get(*operation);
+	hit = vips_cache_operation_get(shard, *operation);
 
 	/* We need to remove the existing cache entry if it's been tagged
-	 * as invalid, if it's been blocked, or someone has requested
-	 * revalidation.
+	 * as invalid, if it's been blocked, if someone has requested
+	 * revalidation, or if it loaded a file which has since changed.
 	 */
 	if (hit) {
 		if (hit->invalid ||
 			(flags & VIPS_OPERATION_BLOCKED) ||
-			(flags & VIPS_OPERATION_REVALIDATE)) {
-			vips_cache_remove(hit->operation);
+			(flags & VIPS_OPERATION_REVALIDATE) ||
+			vips_cache_entry_stale(hit, has_file ? &file : NULL)) {
+			vips_cache_remove(shard, hit->operation);
 			hit = NULL;
 		}
 	}
@@ -1025,22 +1615,31 @@ vips_cache_operation_buildp(VipsOperation **operation)
 	 * passed.
 	 */
 	if (hit) {
+		shard->hits += 1;
 		vips_entry_ref(hit);
 		g_object_unref(*operation);
 		*operation = hit->operation;
+		(void) vips_argument_map(VIPS_OBJECT(*operation),
+			vips_object_tag_hit, NULL, NULL);
 
 		if (vips__cache_trace) {
 			printf("vips cache*: ");
 			vips_object_print_summary(VIPS_OBJECT(*operation));
 		}
 	}
+	else
+		shard->misses += 1;
 
-	g_mutex_unlock(&vips_cache_lock);
+	g_mutex_unlock(&shard->lock);
 
 	/* If there was a miss, we need to build this operation and add
 	 * it to the cache, if appropriate.
 	 */
 	if (!hit) {
+		gint64 start_time;
+		gint64 cost;
+		size_t size;
+
 #ifdef DEBUG_LEAK
 		unsigned int hash_before = 0;
 		VipsOperation *operation_before = NULL;
@@ -1059,9 +1658,16 @@ vips_cache_operation_buildp(VipsOperation **operation)
 		}
 #endif /*DEBUG_LEAK*/
 
+		/* Record how long the build takes, so eviction can prefer to
+		 * keep expensive results.
+		 */
+		start_time = g_get_monotonic_time();
+
 		if (vips_object_build(VIPS_OBJECT(*operation)))
 			return -1;
 
+		cost = g_get_monotonic_time() - start_time;
+
 #ifdef DEBUG_LEAK
 		if (vips__leak &&
 			!(flags & VIPS_OPERATION_NOCACHE) &&
@@ -1079,18 +1685,37 @@ vips_cache_operation_buildp(VipsOperation **operation)
 		VIPS_UNREF(operation_before);
 #endif /*DEBUG_LEAK*/
 
+		/* Tag the outputs for the render cache while we can still see
+		 * the inputs.
+		 */
+		if (vips__render_cache_enabled())
+			vips__render_cache_tag(*operation);
+
+		/* And note which outputs can run from a sequential source, see
+		 * vips__sequential_plan().
+		 */
+		vips__sequential_tag_outputs(*operation);
+
 		/* Retrieve the flags again, as vips_foreign_load_build() may
 		 * set load->nocache.
 		 */
 		flags = vips_operation_get_flags(*operation);
 
-		g_mutex_lock(&vips_cache_lock);
+		/* And charge the entry for the memory its outputs hold. This
+		 * walks the image graph, so do it before we lock the shard.
+		 */
+		size = flags & VIPS_OPERATION_NOCACHE
+			? 0
+			: vips_cache_footprint(*operation);
+
+		g_mutex_lock(&shard->lock);
 
 		/* If two threads build the same operation at the same time,
 		 * we can get multiple adds. Let the first one win. See
 		 * https://github.com/libvips/libvips/pull/181
 		 */
-		if (!vips_cache_operation_get(*operation)) {
+		if (shard->table &&
+			!vips_cache_operation_get(shard, *operation)) {
 			/* Has to be after _build() so we can see output args.
 			 */
 			if (vips__cache_trace) {
@@ -1102,12 +1727,16 @@ vips_cache_operation_buildp(VipsOperation **operation)
 			}
 
 			if (!(flags & VIPS_OPERATION_NOCACHE))
-				vips_cache_insert(*operation);
+				vips_cache_insert(shard, *operation, cost, size,
+					has_file ? &file : NULL);
 		}
 
-		g_mutex_unlock(&vips_cache_lock);
+		g_mutex_unlock(&shard->lock);
 	}
 
+	if (vips_cache_scope_shareable(*operation))
+		vips_cache_scope_insert(*operation);
+
 	vips_cache_trim();
 
 	return 0;
@@ -1143,6 +1772,62 @@ vips_cache_operation_build(VipsOperation *operation)
 	return operation;
 }
 
+/**
+ * vips_cache_scope_begin:
+ *
+ * Start a build scope on this thread. Until the matching
+ * [func@cache_scope_end], any operation built on this thread which is
+ * identical to one built earlier in the scope is replaced by the earlier
+ * one, whatever the size of the operation cache.
+ *
+ * Since the inputs to an operation are compared by identity, whole
+ * identical subgraphs merge bottom-up: if two code paths each build
+ * `cast(colourspace(x))`, the second colourspace matches the first, so
+ * its cast does too, and both paths then share one set of upstream
+ * pixels.
+ *
+ * Scopes nest, and must be balanced. The scope holds a ref to every
+ * operation built inside it, so keep scopes to the construction of a
+ * single pipeline.
+ *
+ * ::: seealso
+ *     [func@cache_operation_buildp].
+ */
+void
+vips_cache_scope_begin(void)
+{
+	GSList *scopes = g_private_get(&vips_cache_scopes);
+	GHashTable *scope;
+
+	scope = g_hash_table_new_full(
+		(GHashFunc) vips_operation_hash,
+		(GEqualFunc) vips_operation_equal,
+		(GDestroyNotify) vips_cache_scope_unref,
+		NULL);
+
+	g_private_set(&vips_cache_scopes, g_slist_prepend(scopes, scope));
+}
+
+/**
+ * vips_cache_scope_end:
+ *
+ * End the innermost build scope started with [func@cache_scope_begin], and
+ * drop its refs.
+ */
+void
+vips_cache_scope_end(void)
+{
+	GSList *scopes = g_private_get(&vips_cache_scopes);
+	GHashTable *scope;
+
+	g_return_if_fail(scopes);
+
+	scope = (GHashTable *) scopes->data;
+	g_private_set(&vips_cache_scopes,
+		g_slist_delete_link(scopes, scopes));
+	g_hash_table_destroy(scope);
+}
+
 /**
  * vips_cache_set_max:
  * @max: maximum number of operation to cache
@@ -1200,17 +1885,51 @@ vips_cache_get_max(void)
 int
 vips_cache_get_size(void)
 {
-	guint size;
-
-	g_mutex_lock(&vips_cache_lock);
+	return g_atomic_int_get(&vips_cache_n);
+}
 
-	size = 0;
-	if (vips_cache_table)
-		size = g_hash_table_size(vips_cache_table);
+/**
+ * vips_cache_get_stats:
+ * @hits: (out) (optional): return number of cache hits here
+ * @misses: (out) (optional): return number of cache misses here
+ * @evictions: (out) (optional): return number of evicted operations here
+ *
+ * Get counters for the operation cache since startup. A miss is counted for
+ * every operation that has to be built, including operations that are then
+ * not cached. Evictions count operations dropped by the cache size, memory
+ * and file limits.
+ *
+ * ::: seealso
+ *     [func@cache_get_size].
+ */
+void
+vips_cache_get_stats(guint64 *hits, guint64 *misses, guint64 *evictions)
+{
+	guint64 total_hits;
+	guint64 total_misses;
+	int i;
+
+	total_hits = 0;
+	total_misses = 0;
+	for (i = 0; i < VIPS_CACHE_SHARDS; i++) {
+		VipsCacheShard *shard = &vips_cache_shards[i];
+
+		g_mutex_lock(&shard->lock);
+		total_hits += shard->hits;
+		total_misses += shard->misses;
+		g_mutex_unlock(&shard->lock);
+	}
 
-	g_mutex_unlock(&vips_cache_lock);
+	if (hits)
+		*hits = total_hits;
+	if (misses)
+		*misses = total_misses;
 
-	return size;
+	if (evictions) {
+		g_mutex_lock(&vips_cache_trim_lock);
+		*evictions = vips_cache_evictions;
+		g_mutex_unlock(&vips_cache_trim_lock);
+	}
 }
 
 /**
@@ -1300,3 +2019,74 @@ vips_cache_set_trace(gboolean trace)
 {
 	vips__cache_trace = trace;
 }
+
+/**
+ * vips_cache_set_shared:
+ * @dir: (nullable): directory to share decoded images in, or `NULL`
+ *
+ * Share decoded images between processes. When a file loader decodes an
+ * image to memory, a copy is written to @dir, and other processes which
+ * load the same file with the same options map that copy read-only rather
+ * than decoding again.
+ *
+ * @dir should be on a memory-backed filesystem, for example
+ * `/dev/shm/vips`, and must be writeable by all the processes sharing it.
+ * Images are keyed on the loader, its arguments, and the size, modification
+ * time and inode of the file, so changed files are decoded again. Before
+ * adding an entry, libvips removes the least recently used entries to keep
+ * @dir below [func@cache_get_shared_max_mem].
+ *
+ * You can set the environment variable `VIPS_CACHE_SHARED` to set this, or
+ * use the command-line flag `--vips-cache-shared`. Pass `NULL` to turn
+ * sharing off.
+ */
+void
+vips_cache_set_shared(const char *dir)
+{
+	char *old = vips_cache_shared;
+
+	vips_cache_shared = g_strdup(dir);
+	g_free(old);
+}
+
+/**
+ * vips_cache_get_shared:
+ *
+ * Get the directory set with [func@cache_set_shared].
+ *
+ * Returns: (nullable): the shared cache directory, or `NULL`
+ */
+const char *
+vips_cache_get_shared(void)
+{
+	return vips_cache_shared;
+}
+
+/**
+ * vips_cache_set_shared_max_mem:
+ * @max_mem: maximum number of bytes to keep in the shared directory
+ *
+ * Keep the directory set with [func@cache_set_shared] below @max_mem bytes.
+ * Images larger than this are not shared. The default is 1GB.
+ *
+ * You can also set this with the environment variable
+ * `VIPS_CACHE_SHARED_MAX_MEM`.
+ */
+void
+vips_cache_set_shared_max_mem(size_t max_mem)
+{
+	vips_cache_shared_max_mem = max_mem;
+}
+
+/**
+ * vips_cache_get_shared_max_mem:
+ *
+ * Get the limit set with [func@cache_set_shared_max_mem].
+ *
+ * Returns: the maximum number of bytes to keep in the shared directory
+ */
+size_t
+vips_cache_get_shared_max_mem(void)
+{
+	return vips_cache_shared_max_mem;
+}
@@ -1,6 +1,11 @@
 /* gate.c -- thread profiling
  *
  * Written on: 18 nov 13
+ * 14/10/26
+ * 	- add chrome trace event output, with tiles and memory
+ * 	- add summary mode, with totals for each gate across all threads
+ * 15/10/26
+ * 	- add hardware counters for each gate and operation on linux
  */
 
 /*
@@ -43,12 +48,47 @@
 #endif /*HAVE_CONFIG_H*/
 #include <glib/gi18n-lib.h>
 
+#include <string.h>
+#ifdef HAVE_LINUX_PERF_EVENT_H
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif /*HAVE_LINUX_PERF_EVENT_H*/
+
 #include <vips/vips.h>
 #include <vips/internal.h>
 #include <vips/debug.h>
 
 #define VIPS_GATE_SIZE (1000)
 
+/* The hardware counters we read, in this order.
+ */
+#define VIPS_COUNTER_N (4)
+
+static const char *vips_counter_names[VIPS_COUNTER_N] = {
+	"cycles",
+	"instructions",
+	"llc-misses",
+	"branch-misses"
+};
+
+/* Counter totals for a gate or an operation on one thread.
+ */
+typedef struct _VipsThreadCounters {
+	const char *name;
+	gint64 counter[VIPS_COUNTER_N];
+	gint64 n;
+} VipsThreadCounters;
+
+/* An operation computing a tile. Upstream tiles are computed inside
+ * downstream ones, so we total the counters for tiles inside this one and
+ * subtract them at the end.
+ */
+typedef struct _VipsThreadCountersTile {
+	gint64 start[VIPS_COUNTER_N];
+	gint64 inner[VIPS_COUNTER_N];
+} VipsThreadCountersTile;
+
 /* A set of timing records. i is the index of the next slot we fill.
  */
 typedef struct _VipsThreadGateBlock {
@@ -58,12 +98,49 @@ typedef struct _VipsThreadGateBlock {
 	int i;
 } VipsThreadGateBlock;
 
+/* A generated tile: which operation made it, where it was, and when.
+ */
+typedef struct _VipsThreadTile {
+	const char *name;
+	VipsRect rect;
+	gint64 start;
+	gint64 stop;
+} VipsThreadTile;
+
+typedef struct _VipsThreadTileBlock {
+	struct _VipsThreadTileBlock *prev;
+
+	VipsThreadTile tile[VIPS_GATE_SIZE];
+	int i;
+} VipsThreadTileBlock;
+
+/* In summary mode, the total time spent in a gate by all threads. Once
+ * made, these are never freed, so threads can update them without a lock.
+ */
+typedef struct _VipsGateTotal {
+	const char *name;
+	gsize time; // (atomic)
+	gsize n; // (atomic)
+} VipsGateTotal;
+
 /* What we track for each gate-name.
  */
 typedef struct _VipsThreadGate {
 	const char *name;
 	VipsThreadGateBlock *start;
 	VipsThreadGateBlock *stop;
+
+	/* Summary mode just needs the most recent start.
+	 */
+	gint64 last_start;
+	VipsGateTotal *total;
+
+	/* Counters mode totals the counter deltas for the outermost entry to
+	 * the gate.
+	 */
+	int depth;
+	gint64 counter_start[VIPS_COUNTER_N];
+	VipsThreadCounters counters;
 } VipsThreadGate;
 
 /* One of these in per-thread private storage.
@@ -74,16 +151,47 @@ typedef struct _VipsThreadProfile {
 	GThread *thread;
 	GHashTable *gates;
 	VipsThreadGate *memory;
+	VipsThreadTileBlock *tiles;
+
+	/* The perf event group for this thread, opened on the first read, and
+	 * name -> VipsThreadCounters for each operation.
+	 */
+	gboolean counters_opened;
+	int counter_fd[VIPS_COUNTER_N];
+	GHashTable *operations;
+	GArray *tile_stack;
 } VipsThreadProfile;
 
 gboolean vips__thread_profile = FALSE;
 
+/* Write a chrome trace file rather than vips-profile.txt.
+ */
+gboolean vips__thread_profile_trace = FALSE;
+
+/* Keep totals rather than a full profile.
+ */
+gboolean vips__thread_profile_summary = FALSE;
+
+/* Read hardware counters at each gate and tile.
+ */
+gboolean vips__thread_profile_counters = FALSE;
+
+/* name -> VipsGateTotal.
+ */
+static GMutex vips_gate_total_lock;
+static GHashTable *vips_gate_total_table = NULL;
+
 static void thread_profile_destroy_notify(gpointer data);
 static GPrivate vips_thread_profile_key =
 	G_PRIVATE_INIT(thread_profile_destroy_notify);
 
 static FILE *vips__thread_fp = NULL;
 
+/* In trace mode, the number of threads we've written so far. Each thread gets
+ * a new tid, and we need to know whether to write a separator.
+ */
+static int vips__thread_n_saved = 0;
+
 /**
  * vips_profile_set:
  * @profile: `TRUE` to enable profile recording
@@ -97,6 +205,177 @@ vips_profile_set(gboolean profile)
 	vips__thread_profile = profile;
 }
 
+/**
+ * vips_profile_set_trace:
+ * @trace: `TRUE` to write profiles as trace event JSON
+ *
+ * If set, vips will record profiling information and write it on program
+ * exit to `vips-profile.json` in Chrome trace event format. You can open
+ * this file in a standard timeline viewer, such as Perfetto or
+ * `chrome://tracing`.
+ *
+ * The trace has a track for each thread, with all gates as time slices, a
+ * slice for each tile computed labelled with the operation that made it,
+ * and a counter for the memory that thread has allocated.
+ *
+ * Setting this also turns on profile recording.
+ *
+ * You can set the environment variable `VIPS_PROFILE_TRACE` to turn this
+ * option on, or use the command-line flag `--vips-profile-trace`.
+ *
+ * ::: seealso
+ *     [func@profile_set].
+ */
+void
+vips_profile_set_trace(gboolean trace)
+{
+	vips__thread_profile_trace = trace;
+	if (trace)
+		vips__thread_profile = TRUE;
+}
+
+/**
+ * vips_profile_set_summary:
+ * @summary: `TRUE` to total time spent in each gate
+ *
+ * If set, vips will add up the time all threads spend inside each profile
+ * gate, for example waiting for locks, rather than recording a full
+ * profile. Nothing is written on exit -- use [func@profile_summary_map] to
+ * read the totals while the program runs, and [func@profile_summary_reset]
+ * to zero them between measurements.
+ *
+ * This is cheap enough to leave on while benchmarking, so you can see which
+ * lock threads are queueing on as concurrency rises.
+ *
+ * Set this before any work starts, since threads only record gates if
+ * profiling was on when they picked up their task.
+ *
+ * ::: seealso
+ *     [func@profile_set].
+ */
+void
+vips_profile_set_summary(gboolean summary)
+{
+	vips__thread_profile_summary = summary;
+	vips__thread_profile = summary;
+}
+
+/**
+ * vips_profile_set_counters:
+ * @counters: `TRUE` to record hardware counters
+ *
+ * If set, vips will read the CPU cycles, instructions retired, last level
+ * cache misses and branch misses on each thread as it enters and leaves
+ * each profile gate, and as it computes each tile. The totals for each gate
+ * and for each operation are added to the profile written on exit, so you
+ * can see whether a slow stage is compute-bound or memory-bound.
+ *
+ * Counts for an operation exclude the operations upstream of it.
+ *
+ * Counters are only available on Linux, and need `perf_event_paranoid` to
+ * allow user-space measurement. If they can't be opened, the profile is
+ * written without them.
+ *
+ * Setting this also turns on profile recording.
+ *
+ * You can set the environment variable `VIPS_PROFILE_COUNTERS` to turn this
+ * option on, or use the command-line flag `--vips-profile-counters`.
+ *
+ * ::: seealso
+ *     [func@profile_set], [func@profile_set_trace].
+ */
+void
+vips_profile_set_counters(gboolean counters)
+{
+	vips__thread_profile_counters = counters;
+	if (counters)
+		vips__thread_profile = TRUE;
+}
+
+/**
+ * vips_profile_summary_reset:
+ *
+ * Zero all the gate totals kept by [func@profile_set_summary].
+ */
+void
+vips_profile_summary_reset(void)
+{
+	GHashTableIter iter;
+	gpointer value;
+
+	g_mutex_lock(&vips_gate_total_lock);
+
+	if (vips_gate_total_table) {
+		g_hash_table_iter_init(&iter, vips_gate_total_table);
+		while (g_hash_table_iter_next(&iter, NULL, &value)) {
+			VipsGateTotal *total = (VipsGateTotal *) value;
+
+			g_atomic_pointer_set(&total->time, 0);
+			g_atomic_pointer_set(&total->n, 0);
+		}
+	}
+
+	g_mutex_unlock(&vips_gate_total_lock);
+}
+
+/**
+ * vips_profile_summary_map:
+ * @fn: (scope call): call this for every gate
+ * @a: client data
+ *
+ * Call @fn for every gate that has been entered since summary mode was
+ * turned on, with the total microseconds all threads have spent inside the
+ * gate and the number of times it was entered.
+ *
+ * @fn is called with a lock held and must not enter any gates itself.
+ *
+ * ::: seealso
+ *     [func@profile_set_summary].
+ */
+void
+vips_profile_summary_map(VipsProfileSummaryFn fn, void *a)
+{
+	GHashTableIter iter;
+	gpointer value;
+
+	g_mutex_lock(&vips_gate_total_lock);
+
+	if (vips_gate_total_table) {
+		g_hash_table_iter_init(&iter, vips_gate_total_table);
+		while (g_hash_table_iter_next(&iter, NULL, &value)) {
+			VipsGateTotal *total = (VipsGateTotal *) value;
+
+			fn(total->name,
+				(gint64) g_atomic_pointer_get(&total->time),
+				(gint64) g_atomic_pointer_get(&total->n),
+				a);
+		}
+	}
+
+	g_mutex_unlock(&vips_gate_total_lock);
+}
+
+static VipsGateTotal *
+vips_gate_total_get(const char *name)
+{
+	VipsGateTotal *total;
+
+	g_mutex_lock(&vips_gate_total_lock);
+
+	if (!vips_gate_total_table)
+		vips_gate_total_table = g_hash_table_new(g_str_hash, g_str_equal);
+
+	if (!(total = g_hash_table_lookup(vips_gate_total_table, name))) {
+		total = g_new0(VipsGateTotal, 1);
+		total->name = name;
+		g_hash_table_insert(vips_gate_total_table, (char *) name, total);
+	}
+
+	g_mutex_unlock(&vips_gate_total_lock);
+
+	return total;
+}
+
 static void
 vips_thread_gate_block_save(VipsThreadGateBlock *block, FILE *fp)
 {
@@ -109,6 +388,18 @@ vips_thread_gate_block_save(VipsThreadGateBlock *block, FILE *fp)
 		vips_thread_gate_block_save(block->prev, fp);
 }
 
+static void
+vips_thread_counters_save(VipsThreadCounters *counters, FILE *fp)
+{
+	int i;
+
+	fprintf(fp, "counters:");
+	for (i = 0; i < VIPS_COUNTER_N; i++)
+		fprintf(fp, " %s=%" G_GINT64_FORMAT,
+			vips_counter_names[i], counters->counter[i]);
+	fprintf(fp, "\n");
+}
+
 static void
 vips_thread_profile_save_gate(VipsThreadGate *gate, FILE *fp)
 {
@@ -119,9 +410,22 @@ vips_thread_profile_save_gate(VipsThreadGate *gate, FILE *fp)
 		vips_thread_gate_block_save(gate->start, fp);
 		fprintf(fp, "stop:\n");
 		vips_thread_gate_block_save(gate->stop, fp);
+		if (gate->counters.n)
+			vips_thread_counters_save(&gate->counters, fp);
 	}
 }
 
+static void
+vips_thread_profile_save_operation_cb(gpointer key, gpointer value,
+	gpointer data)
+{
+	VipsThreadCounters *counters = (VipsThreadCounters *) value;
+	FILE *fp = (FILE *) data;
+
+	fprintf(fp, "operation: %s\n", counters->name);
+	vips_thread_counters_save(counters, fp);
+}
+
 static void
 vips_thread_profile_save_cb(gpointer key, gpointer value, gpointer data)
 {
@@ -131,29 +435,287 @@ vips_thread_profile_save_cb(gpointer key, gpointer value, gpointer data)
 	vips_thread_profile_save_gate(gate, fp);
 }
 
+/* Write a string as a JSON string literal.
+ */
+static void
+vips_thread_trace_string(FILE *fp, const char *str)
+{
+	const char *p;
+
+	fputc('"', fp);
+	for (p = str; *p; p++)
+		if (*p == '"' ||
+			*p == '\\')
+			fprintf(fp, "\\%c", *p);
+		else if ((unsigned char) *p < 32)
+			fprintf(fp, "\\u%04x", *p);
+		else
+			fputc(*p, fp);
+	fputc('"', fp);
+}
+
+/* Number of times recorded in a chain of blocks.
+ */
+static int
+vips_thread_gate_block_length(VipsThreadGateBlock *block)
+{
+	int n;
+
+	for (n = 0; block; block = block->prev)
+		n += block->i;
+
+	return n;
+}
+
+/* Blocks are newest first, so flatten into an array in time order.
+ */
+static gint64 *
+vips_thread_gate_block_flatten(VipsThreadGateBlock *block, int *n)
+{
+	gint64 *times;
+	int i;
+
+	*n = vips_thread_gate_block_length(block);
+	times = g_new(gint64, VIPS_MAX(1, *n));
+
+	i = *n;
+	for (; block; block = block->prev) {
+		i -= block->i;
+		memcpy(times + i, block->time, block->i * sizeof(gint64));
+	}
+
+	return times;
+}
+
+static void
+vips_thread_trace_event_start(FILE *fp, int tid)
+{
+	fprintf(fp, ",\n{\"pid\":1,\"tid\":%d,", tid);
+}
+
+/* Pair up starts and stops into complete events. Gates can nest, so match
+ * each stop to the most recent unmatched start.
+ */
+static void
+vips_thread_trace_save_gate(VipsThreadGate *gate, FILE *fp, int tid)
+{
+	gint64 *start;
+	gint64 *stop;
+	gint64 *stack;
+	int n_start;
+	int n_stop;
+	int sp;
+	int i, j;
+
+	start = vips_thread_gate_block_flatten(gate->start, &n_start);
+	stop = vips_thread_gate_block_flatten(gate->stop, &n_stop);
+	stack = g_new(gint64, VIPS_MAX(1, n_start));
+
+	sp = 0;
+	i = 0;
+	j = 0;
+	while (j < n_stop) {
+		if (i < n_start &&
+			start[i] <= stop[j])
+			stack[sp++] = start[i++];
+		else {
+			if (sp > 0) {
+				gint64 t = stack[--sp];
+
+				vips_thread_trace_event_start(fp, tid);
+				fprintf(fp, "\"ph\":\"X\",\"cat\":\"gate\",\"name\":");
+				vips_thread_trace_string(fp, gate->name);
+				fprintf(fp, ",\"ts\":%" G_GINT64_FORMAT
+							",\"dur\":%" G_GINT64_FORMAT "}",
+					t, stop[j] - t);
+			}
+
+			j += 1;
+		}
+	}
+
+	g_free(stack);
+	g_free(stop);
+	g_free(start);
+}
+
+static void
+vips_thread_trace_save_cb(gpointer key, gpointer value, gpointer data)
+{
+	VipsThreadGate *gate = (VipsThreadGate *) value;
+	FILE *fp = (FILE *) data;
+
+	vips_thread_trace_save_gate(gate, fp, vips__thread_n_saved);
+}
+
+/* Counter totals are written as an instant event at the end of the thread,
+ * with the totals as args.
+ */
+static void
+vips_thread_trace_save_counters(VipsThreadCounters *counters,
+	const char *category, FILE *fp)
+{
+	int i;
+
+	vips_thread_trace_event_start(fp, vips__thread_n_saved);
+	fprintf(fp, "\"ph\":\"i\",\"s\":\"t\",\"cat\":\"%s\",\"name\":",
+		category);
+	vips_thread_trace_string(fp, counters->name);
+	fprintf(fp, ",\"ts\":%" G_GINT64_FORMAT ",\"args\":{\"n\":%"
+		G_GINT64_FORMAT, g_get_monotonic_time(), counters->n);
+	for (i = 0; i < VIPS_COUNTER_N; i++)
+		fprintf(fp, ",\"%s\":%" G_GINT64_FORMAT,
+			vips_counter_names[i], counters->counter[i]);
+	fprintf(fp, "}}");
+}
+
+static void
+vips_thread_trace_save_gate_counters_cb(gpointer key, gpointer value,
+	gpointer data)
+{
+	VipsThreadGate *gate = (VipsThreadGate *) value;
+	FILE *fp = (FILE *) data;
+
+	if (gate->counters.n)
+		vips_thread_trace_save_counters(&gate->counters,
+			"gate counters", fp);
+}
+
+static void
+vips_thread_trace_save_operation_cb(gpointer key, gpointer value,
+	gpointer data)
+{
+	VipsThreadCounters *counters = (VipsThreadCounters *) value;
+	FILE *fp = (FILE *) data;
+
+	vips_thread_trace_save_counters(counters, "operation counters", fp);
+}
+
+/* Memory is recorded as pairs of time and size change -- turn that into a
+ * running total for this thread.
+ */
+static void
+vips_thread_trace_save_memory(VipsThreadProfile *profile, FILE *fp, int tid)
+{
+	gint64 *time;
+	gint64 *size;
+	int n;
+	int i;
+	gint64 total;
+
+	time = vips_thread_gate_block_flatten(profile->memory->start, &n);
+	size = vips_thread_gate_block_flatten(profile->memory->stop, &n);
+
+	total = 0;
+	for (i = 0; i < n; i++) {
+		total += size[i];
+
+		vips_thread_trace_event_start(fp, tid);
+		fprintf(fp, "\"ph\":\"C\",\"name\":\"memory %d\","
+					"\"ts\":%" G_GINT64_FORMAT ","
+					"\"args\":{\"bytes\":%" G_GINT64_FORMAT "}}",
+			tid, time[i], total);
+	}
+
+	g_free(size);
+	g_free(time);
+}
+
+static void
+vips_thread_trace_save_tiles(VipsThreadTileBlock *block, FILE *fp, int tid)
+{
+	int i;
+
+	if (block->prev)
+		vips_thread_trace_save_tiles(block->prev, fp, tid);
+
+	for (i = 0; i < block->i; i++) {
+		VipsThreadTile *tile = &block->tile[i];
+
+		vips_thread_trace_event_start(fp, tid);
+		fprintf(fp, "\"ph\":\"X\",\"cat\":\"tile\",\"name\":");
+		vips_thread_trace_string(fp, tile->name);
+		fprintf(fp, ",\"ts\":%" G_GINT64_FORMAT
+					",\"dur\":%" G_GINT64_FORMAT ","
+					"\"args\":{\"left\":%d,\"top\":%d,"
+					"\"width\":%d,\"height\":%d}}",
+			tile->start, tile->stop - tile->start,
+			tile->rect.left, tile->rect.top,
+			tile->rect.width, tile->rect.height);
+	}
+}
+
+/* Write a thread as a set of chrome trace events. The file is a JSON array,
+ * opened when we write the first thread and closed in
+ * vips__thread_profile_stop().
+ */
+static void
+vips_thread_trace_save(VipsThreadProfile *profile, FILE *fp)
+{
+	int tid = vips__thread_n_saved;
+
+	/* The array starts with a process name record, so every event can
+	 * start with a separator.
+	 */
+	vips_thread_trace_event_start(fp, tid);
+	fprintf(fp, "\"ph\":\"M\",\"name\":\"thread_name\","
+				"\"args\":{\"name\":");
+	vips_thread_trace_string(fp, profile->name);
+	fprintf(fp, "}}");
+
+	g_hash_table_foreach(profile->gates, vips_thread_trace_save_cb, fp);
+	vips_thread_trace_save_memory(profile, fp, tid);
+	if (profile->tiles)
+		vips_thread_trace_save_tiles(profile->tiles, fp, tid);
+
+	g_hash_table_foreach(profile->gates,
+		vips_thread_trace_save_gate_counters_cb, fp);
+	if (profile->operations)
+		g_hash_table_foreach(profile->operations,
+			vips_thread_trace_save_operation_cb, fp);
+}
+
 static void
 vips_thread_profile_save(VipsThreadProfile *profile)
 {
+	const char *filename = vips__thread_profile_trace
+		? "vips-profile.json"
+		: "vips-profile.txt";
+
 	g_mutex_lock(&vips__global_lock);
 
 	VIPS_DEBUG_MSG("vips_thread_profile_save: %s\n", profile->name);
 
 	if (!vips__thread_fp) {
-		vips__thread_fp =
-			vips__file_open_write("vips-profile.txt", TRUE);
+		vips__thread_fp = vips__file_open_write(filename, TRUE);
 		if (!vips__thread_fp) {
 			g_mutex_unlock(&vips__global_lock);
 			g_warning("unable to create profile log");
 			return;
 		}
 
-		printf("recording profile in vips-profile.txt\n");
+		printf("recording profile in %s\n", filename);
+
+		if (vips__thread_profile_trace)
+			fprintf(vips__thread_fp, "[\n{\"pid\":1,\"ph\":\"M\","
+									 "\"name\":\"process_name\","
+									 "\"args\":{\"name\":\"libvips\"}}");
 	}
 
-	fprintf(vips__thread_fp, "thread: %s (%p)\n", profile->name, profile);
-	g_hash_table_foreach(profile->gates,
-		vips_thread_profile_save_cb, vips__thread_fp);
-	vips_thread_profile_save_gate(profile->memory, vips__thread_fp);
+	if (vips__thread_profile_trace)
+		vips_thread_trace_save(profile, vips__thread_fp);
+	else {
+		fprintf(vips__thread_fp, "thread: %s (%p)\n",
+			profile->name, profile);
+		g_hash_table_foreach(profile->gates,
+			vips_thread_profile_save_cb, vips__thread_fp);
+		vips_thread_profile_save_gate(profile->memory, vips__thread_fp);
+		if (profile->operations)
+			g_hash_table_foreach(profile->operations,
+				vips_thread_profile_save_operation_cb, vips__thread_fp);
+	}
+
+	vips__thread_n_saved += 1;
 
 	g_mutex_unlock(&vips__global_lock);
 }
@@ -173,21 +735,66 @@ vips_thread_gate_free(VipsThreadGate *gate)
 	VIPS_FREE(gate);
 }
 
+static void
+vips_thread_tile_block_free(VipsThreadTileBlock *block)
+{
+	VIPS_FREEF(vips_thread_tile_block_free, block->prev);
+	VIPS_FREE(block);
+}
+
+static void
+vips_thread_counters_close(VipsThreadProfile *profile)
+{
+#ifdef HAVE_LINUX_PERF_EVENT_H
+	int i;
+
+	for (i = VIPS_COUNTER_N - 1; i >= 0; i--)
+		if (profile->counter_fd[i] >= 0) {
+			close(profile->counter_fd[i]);
+			profile->counter_fd[i] = -1;
+		}
+#endif /*HAVE_LINUX_PERF_EVENT_H*/
+}
+
 static void
 vips_thread_profile_free(VipsThreadProfile *profile)
 {
 	VIPS_DEBUG_MSG("vips_thread_profile_free: %s\n", profile->name);
 
+	vips_thread_counters_close(profile);
+	VIPS_FREEF(g_hash_table_destroy, profile->operations);
+	VIPS_FREEF(g_array_unref, profile->tile_stack);
 	VIPS_FREEF(g_hash_table_destroy, profile->gates);
 	VIPS_FREEF(vips_thread_gate_free, profile->memory);
+	VIPS_FREEF(vips_thread_tile_block_free, profile->tiles);
 	VIPS_FREE(profile);
 }
 
 void
 vips__thread_profile_stop(void)
 {
-	if (vips__thread_profile)
+	if (vips__thread_profile) {
+		if (vips__thread_profile_trace &&
+			vips__thread_fp)
+			fprintf(vips__thread_fp, "\n]\n");
+
 		VIPS_FREEF(fclose, vips__thread_fp);
+	}
+
+	/* Any stray gates after this will go to the old per-thread records
+	 * and not touch the totals.
+	 */
+	vips__thread_profile_summary = FALSE;
+
+	if (vips_gate_total_table) {
+		GHashTableIter iter;
+		gpointer value;
+
+		g_hash_table_iter_init(&iter, vips_gate_total_table);
+		while (g_hash_table_iter_next(&iter, NULL, &value))
+			g_free(value);
+		VIPS_FREEF(g_hash_table_destroy, vips_gate_total_table);
+	}
 }
 
 static void
@@ -221,6 +828,11 @@ vips_thread_gate_new(const char *gate_name)
 	gate->name = gate_name;
 	gate->start = g_new0(VipsThreadGateBlock, 1);
 	gate->stop = g_new0(VipsThreadGateBlock, 1);
+	gate->last_start = 0;
+	gate->total = NULL;
+	gate->depth = 0;
+	memset(&gate->counters, 0, sizeof(gate->counters));
+	gate->counters.name = gate_name;
 
 	return gate;
 }
@@ -229,6 +841,7 @@ void
 vips__thread_profile_attach(const char *thread_name)
 {
 	VipsThreadProfile *profile;
+	int i;
 
 	VIPS_DEBUG_MSG("vips__thread_profile_attach: %s\n", thread_name);
 
@@ -238,6 +851,12 @@ vips__thread_profile_attach(const char *thread_name)
 		g_direct_hash, g_str_equal,
 		NULL, (GDestroyNotify) vips_thread_gate_free);
 	profile->memory = vips_thread_gate_new("memory");
+	profile->tiles = NULL;
+	profile->counters_opened = FALSE;
+	for (i = 0; i < VIPS_COUNTER_N; i++)
+		profile->counter_fd[i] = -1;
+	profile->operations = NULL;
+	profile->tile_stack = NULL;
 	g_private_replace(&vips_thread_profile_key, profile);
 }
 
@@ -247,6 +866,92 @@ vips_thread_profile_get(void)
 	return g_private_get(&vips_thread_profile_key);
 }
 
+/* Open the counters as a group on this thread, so they can all be read
+ * at once. Counters can be turned on after the thread starts, so we do this
+ * on the first read.
+ */
+static void
+vips_thread_counters_open(VipsThreadProfile *profile)
+{
+#ifdef HAVE_LINUX_PERF_EVENT_H
+	static const guint64 config[VIPS_COUNTER_N] = {
+		PERF_COUNT_HW_CPU_CYCLES,
+		PERF_COUNT_HW_INSTRUCTIONS,
+		PERF_COUNT_HW_CACHE_MISSES,
+		PERF_COUNT_HW_BRANCH_MISSES
+	};
+
+	int i;
+#endif /*HAVE_LINUX_PERF_EVENT_H*/
+
+	profile->counters_opened = TRUE;
+
+#ifdef HAVE_LINUX_PERF_EVENT_H
+	for (i = 0; i < VIPS_COUNTER_N; i++) {
+		struct perf_event_attr attr;
+
+		memset(&attr, 0, sizeof(attr));
+		attr.type = PERF_TYPE_HARDWARE;
+		attr.size = sizeof(attr);
+		attr.config = config[i];
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		attr.read_format = PERF_FORMAT_GROUP;
+
+		profile->counter_fd[i] = syscall(__NR_perf_event_open, &attr,
+			0, -1, i == 0 ? -1 : profile->counter_fd[0], 0);
+		if (profile->counter_fd[i] < 0) {
+			g_info("unable to open hardware counters for thread %s",
+				profile->name);
+			vips_thread_counters_close(profile);
+			return;
+		}
+	}
+#endif /*HAVE_LINUX_PERF_EVENT_H*/
+}
+
+/* Read all the counters for this thread. FALSE if they are not available.
+ */
+static gboolean
+vips_thread_counters_read(VipsThreadProfile *profile, gint64 *counter)
+{
+#ifdef HAVE_LINUX_PERF_EVENT_H
+	struct {
+		guint64 nr;
+		guint64 value[VIPS_COUNTER_N];
+	} group;
+	int i;
+
+	if (!profile->counters_opened)
+		vips_thread_counters_open(profile);
+	if (profile->counter_fd[0] < 0 ||
+		read(profile->counter_fd[0], &group, sizeof(group)) !=
+			sizeof(group) ||
+		group.nr != VIPS_COUNTER_N)
+		return FALSE;
+
+	for (i = 0; i < VIPS_COUNTER_N; i++)
+		counter[i] = group.value[i];
+
+	return TRUE;
+#else  /*!HAVE_LINUX_PERF_EVENT_H*/
+	if (!profile->counters_opened)
+		vips_thread_counters_open(profile);
+
+	return FALSE;
+#endif /*HAVE_LINUX_PERF_EVENT_H*/
+}
+
+static void
+vips_thread_counters_add(VipsThreadCounters *counters, gint64 *delta)
+{
+	int i;
+
+	for (i = 0; i < VIPS_COUNTER_N; i++)
+		counters->counter[i] += delta[i];
+	counters->n += 1;
+}
+
 /* This usually happens automatically when a thread shuts down, but that will
  * not happen for the main thread.
  *
@@ -260,7 +965,8 @@ vips__thread_profile_detach(void)
 	VIPS_DEBUG_MSG("vips__thread_profile_detach:\n");
 
 	if ((profile = vips_thread_profile_get())) {
-		if (vips__thread_profile)
+		if (vips__thread_profile &&
+			!vips__thread_profile_summary)
 			vips_thread_profile_save(profile);
 
 		vips_thread_profile_free(profile);
@@ -297,10 +1003,19 @@ vips__thread_gate_start(const char *gate_name)
 				(char *) gate_name, gate);
 		}
 
-		if (gate->start->i >= VIPS_GATE_SIZE)
-			vips_thread_gate_block_add(&gate->start);
+		if (vips__thread_profile_summary)
+			gate->last_start = time;
+		else {
+			if (gate->start->i >= VIPS_GATE_SIZE)
+				vips_thread_gate_block_add(&gate->start);
 
-		gate->start->time[gate->start->i++] = time;
+			gate->start->time[gate->start->i++] = time;
+
+			if (vips__thread_profile_counters &&
+				gate->depth++ == 0)
+				(void) vips_thread_counters_read(profile,
+					gate->counter_start);
+		}
 
 		VIPS_DEBUG_MSG_RED("\t %" G_GINT64_FORMAT "\n", time);
 	}
@@ -325,10 +1040,39 @@ vips__thread_gate_stop(const char *gate_name)
 				(char *) gate_name, gate);
 		}
 
-		if (gate->stop->i >= VIPS_GATE_SIZE)
-			vips_thread_gate_block_add(&gate->stop);
+		if (vips__thread_profile_summary) {
+			/* No start means that summary mode was turned on while
+			 * we were inside this gate.
+			 */
+			if (gate->last_start) {
+				if (!gate->total)
+					gate->total = vips_gate_total_get(gate_name);
+
+				g_atomic_pointer_add(&gate->total->time,
+					time - gate->last_start);
+				g_atomic_pointer_add(&gate->total->n, 1);
+				gate->last_start = 0;
+			}
+		}
+		else {
+			gint64 counter[VIPS_COUNTER_N];
 
-		gate->stop->time[gate->stop->i++] = time;
+			if (gate->stop->i >= VIPS_GATE_SIZE)
+				vips_thread_gate_block_add(&gate->stop);
+
+			gate->stop->time[gate->stop->i++] = time;
+
+			if (vips__thread_profile_counters &&
+				gate->depth > 0 &&
+				--gate->depth == 0 &&
+				vips_thread_counters_read(profile, counter)) {
+				int i;
+
+				for (i = 0; i < VIPS_COUNTER_N; i++)
+					counter[i] -= gate->counter_start[i];
+				vips_thread_counters_add(&gate->counters, counter);
+			}
+		}
 
 		VIPS_DEBUG_MSG_RED("\t %" G_GINT64_FORMAT "\n", time);
 	}
@@ -348,6 +1092,9 @@ vips__thread_malloc_free(gint64 size)
 		printf("argh no block to record free() in!\n");
 #endif /*VIPS_DEBUG*/
 
+	if (vips__thread_profile_summary)
+		return;
+
 	if ((profile = vips_thread_profile_get())) {
 		gint64 time = g_get_monotonic_time();
 		VipsThreadGate *gate = profile->memory;
@@ -361,3 +1108,113 @@ vips__thread_malloc_free(gint64 size)
 		gate->stop->time[gate->stop->i++] = size;
 	}
 }
+
+/* Record the computation of a tile of an image. Only used for trace output.
+ */
+void
+vips__thread_profile_tile(VipsImage *image, const VipsRect *rect,
+	gint64 start)
+{
+	VipsThreadProfile *profile;
+
+	if ((profile = vips_thread_profile_get())) {
+		VipsThreadTileBlock *block = profile->tiles;
+		const char *name;
+		VipsThreadTile *tile;
+
+		if (!block ||
+			block->i >= VIPS_GATE_SIZE) {
+			block = g_new0(VipsThreadTileBlock, 1);
+			block->prev = profile->tiles;
+			profile->tiles = block;
+		}
+
+		if (!(name = g_object_get_data(G_OBJECT(image),
+				  "libvips-profile-name")))
+			name = "image";
+
+		tile = &block->tile[block->i++];
+		tile->name = name;
+		tile->rect = *rect;
+		tile->start = start;
+		tile->stop = g_get_monotonic_time();
+	}
+}
+
+/* Start counting for a tile. Called before the generate function, and
+ * always paired with vips__thread_profile_counters_stop().
+ */
+void
+vips__thread_profile_counters_start(void)
+{
+	VipsThreadProfile *profile;
+
+	if ((profile = vips_thread_profile_get())) {
+		VipsThreadCountersTile tile = { 0 };
+
+		if (!profile->tile_stack)
+			profile->tile_stack =
+				g_array_new(FALSE, FALSE, sizeof(VipsThreadCountersTile));
+
+		(void) vips_thread_counters_read(profile, tile.start);
+		g_array_append_val(profile->tile_stack, tile);
+	}
+}
+
+/* Stop counting for a tile and add the counts, less any for upstream tiles
+ * computed inside this one, to the totals for the operation.
+ */
+void
+vips__thread_profile_counters_stop(VipsImage *image)
+{
+	VipsThreadProfile *profile;
+
+	if ((profile = vips_thread_profile_get()) &&
+		profile->tile_stack &&
+		profile->tile_stack->len > 0) {
+		GArray *stack = profile->tile_stack;
+		VipsThreadCountersTile tile =
+			g_array_index(stack, VipsThreadCountersTile, stack->len - 1);
+
+		gint64 counter[VIPS_COUNTER_N];
+		const char *name;
+		VipsThreadCounters *counters;
+		int i;
+
+		g_array_set_size(stack, stack->len - 1);
+
+		if (!vips_thread_counters_read(profile, counter))
+			return;
+
+		for (i = 0; i < VIPS_COUNTER_N; i++)
+			counter[i] -= tile.start[i];
+
+		if (stack->len > 0) {
+			VipsThreadCountersTile *outer = &g_array_index(stack,
+				VipsThreadCountersTile, stack->len - 1);
+
+			for (i = 0; i < VIPS_COUNTER_N; i++)
+				outer->inner[i] += counter[i];
+		}
+
+		for (i = 0; i < VIPS_COUNTER_N; i++)
+			counter[i] -= tile.inner[i];
+
+		if (!(name = g_object_get_data(G_OBJECT(image),
+				  "libvips-profile-name")))
+			name = "image";
+
+		if (!profile->operations)
+			profile->operations = g_hash_table_new_full(
+				g_str_hash, g_str_equal, NULL, g_free);
+		if (!(counters =
+					g_hash_table_lookup(profile->operations, name))) {
+			counters = g_new0(VipsThreadCounters, 1);
+			counters->name = name;
+			g_hash_table_insert(profile->operations,
+				(char *) name, counters);
+		}
+
+		vips_thread_counters_add(counters, counter);
+	}
+}
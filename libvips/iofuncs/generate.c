@@ -53,6 +53,11 @@
  * 7/7/12
  * 	- lock around link make/break so we can process an image from many
  * 	  threads
+ * 14/10/26
+ * 	- propagate deadlines downstream
+ * 15/10/26
+ * 	- add vips__image_fold_constant()
+ * 	- write .v files with pwrite() and vips_sink_disc_unordered()
  */
 
 /*
@@ -132,6 +137,13 @@ vips__link_make(VipsImage *image_up, VipsImage *image_down)
 	if (image_up->progress_signal &&
 		!image_down->progress_signal)
 		image_down->progress_signal = image_up->progress_signal;
+
+	/* And the earliest deadline.
+	 */
+	if (image_up->deadline &&
+		(!image_down->deadline ||
+			image_up->deadline < image_down->deadline))
+		image_down->deadline = image_up->deadline;
 }
 
 static void *
@@ -618,6 +630,41 @@ vips_allocate_input_array(VipsImage *out, ...)
  * Returns: 0 on success, -1 on error.
  */
 
+#ifdef HAVE_PWRITE
+/* pwrite() each strip to its place in the file, so strips can be written
+ * concurrently and in any order.
+ */
+static int
+write_vips_unordered(VipsRegion *region, VipsRect *area, void *a)
+{
+	VipsImage *image = region->im;
+	size_t line_size = VIPS_IMAGE_SIZEOF_LINE(image);
+
+	size_t count;
+	char *buf;
+	gint64 offset;
+
+	count = line_size * area->height;
+	buf = (char *) VIPS_REGION_ADDR(region, 0, area->top);
+	offset = image->sizeof_header + (gint64) line_size * area->top;
+
+	do {
+		ssize_t nwritten = pwrite(image->fd, buf, count, offset);
+
+		/* n == 0 isn't strictly an error, but we treat it as
+		 * one to make sure we don't get stuck in this loop.
+		 */
+		if (nwritten <= 0)
+			return errno;
+
+		buf += nwritten;
+		offset += nwritten;
+		count -= nwritten;
+	} while (count > 0);
+
+	return 0;
+}
+#else  /*!HAVE_PWRITE*/
 /* A write function for VIPS images. Just write() the pixel data.
  */
 static int
@@ -647,6 +694,7 @@ write_vips(VipsRegion *region, VipsRect *area, void *a)
 
 	return 0;
 }
+#endif /*HAVE_PWRITE*/
 
 /**
  * vips_image_generate:
@@ -753,7 +801,12 @@ vips_image_generate(VipsImage *image,
 			return -1;
 
 		if (image->dtype == VIPS_IMAGE_OPENOUT)
+#ifdef HAVE_PWRITE
+			res = vips_sink_disc_unordered(image,
+				write_vips_unordered, NULL);
+#else  /*!HAVE_PWRITE*/
 			res = vips_sink_disc(image, write_vips, NULL);
+#endif /*HAVE_PWRITE*/
 		else
 			res = vips_sink_memory(image);
 
@@ -786,3 +839,65 @@ vips_image_generate(VipsImage *image,
 
 	return 0;
 }
+
+/**
+ * vips__image_set_constant: (skip)
+ * @image: image to mark
+ * @pel: (nullable): value of every pixel, or `NULL` for zero
+ *
+ * Mark @image as having the same value everywhere. Regions on @image are
+ * painted with @pel and the generate function is never called.
+ */
+void
+vips__image_set_constant(VipsImage *image, const VipsPel *pel)
+{
+	size_t ps = VIPS_IMAGE_SIZEOF_PEL(image);
+	VipsPel *constant;
+
+	if (!(constant = VIPS_ARRAY(VIPS_OBJECT(image), ps, VipsPel)))
+		return;
+	if (pel)
+		memcpy(constant, pel, ps);
+	else
+		memset(constant, 0, ps);
+
+	image->constant = constant;
+}
+
+/**
+ * vips__image_fold_constant: (skip)
+ * @out: partial image, after [method@Image.generate]
+ * @in: `NULL`-terminated array of the images @out is computed from
+ *
+ * Operations which compute each output pixel from the input pixels at the
+ * same position can call this after [method@Image.generate]. If every
+ * image in @in is constant, one pixel of @out is computed now and @out is
+ * marked constant too, so whole subgraphs of constant images are folded
+ * at build time.
+ *
+ * This is only an optimisation, so errors are ignored.
+ */
+void
+vips__image_fold_constant(VipsImage *out, VipsImage **in)
+{
+	VipsRect rect = { 0, 0, 1, 1 };
+	VipsRegion *region;
+	int i;
+
+	if (out->dtype != VIPS_IMAGE_PARTIAL ||
+		out->constant ||
+		!in[0])
+		return;
+	for (i = 0; in[i]; i++)
+		if (!in[i]->constant)
+			return;
+
+	vips_error_freeze();
+	if ((region = vips_region_new(out))) {
+		if (!vips_region_prepare(region, &rect))
+			vips__image_set_constant(out,
+				VIPS_REGION_ADDR(region, 0, 0));
+		g_object_unref(region);
+	}
+	vips_error_thaw();
+}
@@ -0,0 +1,466 @@
+/* optional OpenCL compute backend
+ *
+ * 15/10/26
+ * 	- first version, offload float convolution
+ */
+
+/*
+
+	This file is part of VIPS.
+
+	VIPS is free software; you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+	02110-1301  USA
+
+ */
+
+/*
+
+	These files are distributed with VIPS - http://www.vips.ecs.soton.ac.uk
+
+ */
+
+/* The device is found and the kernels built on first use, so there's no
+ * startup cost unless an operation asks for the GPU.
+ *
+ * Each worker thread gets its own command queue, kernel objects and device
+ * buffers. cl_kernel arguments are not thread safe, and this way one thread
+ * waiting for its tile to come back from the device doesn't stop the others
+ * decoding, encoding or computing on the CPU.
+ *
+ * Operations call vips__gpu_*() for a tile. If these return non-zero, the
+ * operation must compute the tile on the CPU instead. Any run-time failure
+ * turns the GPU off for the rest of the process.
+ */
+
+/*
+#define DEBUG
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /*HAVE_CONFIG_H*/
+#include <glib/gi18n-lib.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vips/vips.h>
+#include <vips/gpu.h>
+#include <vips/internal.h>
+
+#ifdef HAVE_OPENCL
+#define CL_TARGET_OPENCL_VERSION 120
+#ifdef __APPLE__
+#include <OpenCL/opencl.h>
+#else
+#include <CL/cl.h>
+#endif
+#endif /*HAVE_OPENCL*/
+
+/* Cleared by the command-line `--vips-nogpu` switch and the `VIPS_NOGPU`
+ * env var.
+ */
+gboolean vips__gpu_enabled = TRUE;
+
+#ifdef HAVE_OPENCL
+
+/* All our kernels, built into a single program.
+ */
+static const char *vips_gpu_source =
+	"__kernel void\n"
+	"vips_convf(__global const float *in, int in_stride,\n"
+	"	__global float *out, int out_stride,\n"
+	"	__global const float *coeff, __global const int *offsets,\n"
+	"	int nnz, float offset)\n"
+	"{\n"
+	"	const int x = get_global_id(0);\n"
+	"	const int y = get_global_id(1);\n"
+	"	__global const float *p = in + y * in_stride + x;\n"
+	"	float sum = offset;\n"
+	"\n"
+	"	for (int i = 0; i < nnz; i++)\n"
+	"		sum += coeff[i] * p[offsets[i]];\n"
+	"\n"
+	"	out[y * out_stride + x] = sum;\n"
+	"}\n";
+
+static cl_device_id vips_gpu_device = NULL;
+static cl_context vips_gpu_context = NULL;
+static cl_program vips_gpu_program = NULL;
+static char vips_gpu_name[256] = "";
+
+/* Set if the device fails at run time.
+ */
+static gboolean vips_gpu_failed = FALSE;
+
+typedef struct _VipsGpuThread {
+	cl_command_queue queue;
+	cl_kernel convf;
+
+	/* Device buffers. These grow to fit the largest tile we've seen.
+	 */
+	cl_mem in;
+	size_t in_size;
+	cl_mem out;
+	size_t out_size;
+	cl_mem coeff;
+	size_t coeff_size;
+	cl_mem offsets;
+	size_t offsets_size;
+} VipsGpuThread;
+
+static void
+vips_gpu_thread_free(VipsGpuThread *thread)
+{
+	VIPS_FREEF(clReleaseMemObject, thread->in);
+	VIPS_FREEF(clReleaseMemObject, thread->out);
+	VIPS_FREEF(clReleaseMemObject, thread->coeff);
+	VIPS_FREEF(clReleaseMemObject, thread->offsets);
+	VIPS_FREEF(clReleaseKernel, thread->convf);
+	VIPS_FREEF(clReleaseCommandQueue, thread->queue);
+	g_free(thread);
+}
+
+static GPrivate vips_gpu_thread_key =
+	G_PRIVATE_INIT((GDestroyNotify) vips_gpu_thread_free);
+
+/* Turn the GPU off after a failure. Operations will use the CPU from now on.
+ */
+static void
+vips_gpu_fail(const char *what, cl_int err)
+{
+	g_info("vips_gpu: %s failed (error %d), using the CPU", what, err);
+	vips_gpu_failed = TRUE;
+}
+
+static void *
+vips_gpu_init_once(void *data)
+{
+	cl_platform_id platforms[8];
+	cl_uint n_platforms;
+	cl_device_id device;
+	cl_int err;
+	cl_uint i;
+
+	if (clGetPlatformIDs(VIPS_NUMBER(platforms), platforms, &n_platforms) !=
+		CL_SUCCESS)
+		return NULL;
+
+	device = NULL;
+	for (i = 0; i < VIPS_MIN(n_platforms, VIPS_NUMBER(platforms)); i++)
+		if (clGetDeviceIDs(platforms[i],
+				CL_DEVICE_TYPE_GPU, 1, &device, NULL) == CL_SUCCESS)
+			break;
+	if (!device)
+		return NULL;
+
+	vips_gpu_context = clCreateContext(NULL, 1, &device, NULL, NULL, &err);
+	if (err != CL_SUCCESS) {
+		vips_gpu_context = NULL;
+		return NULL;
+	}
+
+	vips_gpu_program = clCreateProgramWithSource(vips_gpu_context,
+		1, &vips_gpu_source, NULL, &err);
+	if (err != CL_SUCCESS ||
+		clBuildProgram(vips_gpu_program,
+			1, &device, NULL, NULL, NULL) != CL_SUCCESS) {
+		g_info("vips_gpu: unable to build kernels");
+		VIPS_FREEF(clReleaseProgram, vips_gpu_program);
+		VIPS_FREEF(clReleaseContext, vips_gpu_context);
+		return NULL;
+	}
+
+	clGetDeviceInfo(device, CL_DEVICE_NAME,
+		sizeof(vips_gpu_name) - 1, vips_gpu_name, NULL);
+	vips_gpu_device = device;
+
+	g_info("vips_gpu: using \"%s\"", vips_gpu_name);
+
+	return NULL;
+}
+
+/* Find a device and build the kernels, if we can.
+ */
+static gboolean
+vips_gpu_ready(void)
+{
+	static GOnce once = G_ONCE_INIT;
+
+	if (!vips__gpu_enabled ||
+		vips_gpu_failed)
+		return FALSE;
+
+	VIPS_ONCE(&once, vips_gpu_init_once, NULL);
+
+	return vips_gpu_device != NULL;
+}
+
+static VipsGpuThread *
+vips_gpu_thread_get(void)
+{
+	VipsGpuThread *thread;
+	cl_int err;
+
+	if ((thread = g_private_get(&vips_gpu_thread_key)))
+		return thread;
+
+	thread = g_new0(VipsGpuThread, 1);
+
+	thread->queue = clCreateCommandQueue(vips_gpu_context,
+		vips_gpu_device, 0, &err);
+	if (err != CL_SUCCESS) {
+		thread->queue = NULL;
+		vips_gpu_thread_free(thread);
+		vips_gpu_fail("clCreateCommandQueue", err);
+		return NULL;
+	}
+
+	thread->convf = clCreateKernel(vips_gpu_program, "vips_convf", &err);
+	if (err != CL_SUCCESS) {
+		thread->convf = NULL;
+		vips_gpu_thread_free(thread);
+		vips_gpu_fail("clCreateKernel", err);
+		return NULL;
+	}
+
+	g_private_set(&vips_gpu_thread_key, thread);
+
+	return thread;
+}
+
+/* Make sure a device buffer is at least @size bytes.
+ */
+static int
+vips_gpu_buffer(cl_mem *mem, size_t *mem_size,
+	size_t size, cl_mem_flags flags)
+{
+	cl_int err;
+
+	if (*mem &&
+		*mem_size >= size)
+		return 0;
+
+	VIPS_FREEF(clReleaseMemObject, *mem);
+	*mem_size = 0;
+
+	*mem = clCreateBuffer(vips_gpu_context, flags, size, NULL, &err);
+	if (err != CL_SUCCESS) {
+		*mem = NULL;
+		vips_gpu_fail("clCreateBuffer", err);
+		return -1;
+	}
+	*mem_size = size;
+
+	return 0;
+}
+
+#endif /*HAVE_OPENCL*/
+
+void
+vips__gpu_init(void)
+{
+	if (g_getenv("VIPS_NOGPU"))
+		vips__gpu_enabled = FALSE;
+}
+
+void
+vips__gpu_shutdown(void)
+{
+#ifdef HAVE_OPENCL
+	/* Other objects hold refs to the context, so it's only freed when
+	 * they go.
+	 */
+	VIPS_FREEF(clReleaseProgram, vips_gpu_program);
+	VIPS_FREEF(clReleaseContext, vips_gpu_context);
+	vips_gpu_device = NULL;
+#endif /*HAVE_OPENCL*/
+}
+
+/**
+ * vips_gpu_isenabled:
+ *
+ * libvips can offload some operations to a GPU with OpenCL. This is `TRUE`
+ * if libvips was built with OpenCL, offload has not been turned off, and
+ * a working device was found.
+ *
+ * The first call looks for a device and builds the kernels, so it can be
+ * slow.
+ *
+ * ::: seealso
+ *     [func@gpu_set_enabled].
+ *
+ * Returns: `TRUE` if operations can use the GPU.
+ */
+gboolean
+vips_gpu_isenabled(void)
+{
+#ifdef HAVE_OPENCL
+	return vips_gpu_ready();
+#else
+	return FALSE;
+#endif /*HAVE_OPENCL*/
+}
+
+/**
+ * vips_gpu_set_enabled:
+ * @enabled: `TRUE` to allow GPU offload
+ *
+ * Turn GPU offload on or off. It's on by default, and can be turned off
+ * with the `VIPS_NOGPU` environment variable or the `--vips-nogpu`
+ * command-line switch.
+ *
+ * Operations decide whether to use the GPU when they are built, so this
+ * won't change pipelines that already exist.
+ */
+void
+vips_gpu_set_enabled(gboolean enabled)
+{
+	vips__gpu_enabled = enabled;
+}
+
+/**
+ * vips_gpu_device_name:
+ *
+ * The name of the GPU that libvips is using, or `NULL` for none.
+ *
+ * Returns: (nullable): the device name.
+ */
+const char *
+vips_gpu_device_name(void)
+{
+#ifdef HAVE_OPENCL
+	if (vips_gpu_ready())
+		return vips_gpu_name;
+#endif /*HAVE_OPENCL*/
+
+	return NULL;
+}
+
+/* Float convolution of a tile. @in is @width + @mask_width - 1 by @height +
+ * @mask_height - 1 pixels, @out is @width by @height. Strides are in floats.
+ * @coeff_pos gives the index in the mask of each of the @nnz coefficients.
+ *
+ * The input goes to the device in one write, the result comes back in one
+ * read.
+ *
+ * Returns non-zero if the caller should compute the tile on the CPU.
+ */
+int
+vips__gpu_convf(float *out, int out_stride,
+	const float *in, int in_stride,
+	int width, int height, int bands,
+	int mask_width, int mask_height,
+	const float *coeff, const int *coeff_pos, int nnz, float offset)
+{
+#ifdef HAVE_OPENCL
+	const int in_width = (width + mask_width - 1) * bands;
+	const int in_height = height + mask_height - 1;
+	const int out_width = width * bands;
+
+	VipsGpuThread *thread;
+	int offsets[VIPS_GPU_MAX_NNZ];
+	size_t host_origin[3] = { 0, 0, 0 };
+	size_t region[3];
+	size_t global[2];
+	cl_int err;
+	int i;
+
+	if (!vips_gpu_ready() ||
+		nnz > VIPS_GPU_MAX_NNZ ||
+		!(thread = vips_gpu_thread_get()))
+		return -1;
+
+	/* Offsets of each coefficient in the packed input on the device.
+	 */
+	for (i = 0; i < nnz; i++)
+		offsets[i] = (coeff_pos[i] / mask_width) * in_width +
+			(coeff_pos[i] % mask_width) * bands;
+
+	if (vips_gpu_buffer(&thread->in, &thread->in_size,
+			(size_t) in_width * in_height * sizeof(float),
+			CL_MEM_READ_ONLY) ||
+		vips_gpu_buffer(&thread->out, &thread->out_size,
+			(size_t) out_width * height * sizeof(float),
+			CL_MEM_WRITE_ONLY) ||
+		vips_gpu_buffer(&thread->coeff, &thread->coeff_size,
+			nnz * sizeof(float), CL_MEM_READ_ONLY) ||
+		vips_gpu_buffer(&thread->offsets, &thread->offsets_size,
+			nnz * sizeof(int), CL_MEM_READ_ONLY))
+		return -1;
+
+	/* Queue everything up, then wait once for the read back.
+	 */
+	region[0] = in_width * sizeof(float);
+	region[1] = in_height;
+	region[2] = 1;
+	if ((err = clEnqueueWriteBufferRect(thread->queue, thread->in,
+			 CL_FALSE, host_origin, host_origin, region,
+			 region[0], 0, in_stride * sizeof(float), 0,
+			 in, 0, NULL, NULL)) ||
+		(err = clEnqueueWriteBuffer(thread->queue, thread->coeff,
+			 CL_FALSE, 0, nnz * sizeof(float), coeff,
+			 0, NULL, NULL)) ||
+		(err = clEnqueueWriteBuffer(thread->queue, thread->offsets,
+			 CL_FALSE, 0, nnz * sizeof(int), offsets,
+			 0, NULL, NULL))) {
+		vips_gpu_fail("write", err);
+		return -1;
+	}
+
+	if ((err = clSetKernelArg(thread->convf, 0,
+			 sizeof(cl_mem), &thread->in)) ||
+		(err = clSetKernelArg(thread->convf, 1,
+			 sizeof(int), &in_width)) ||
+		(err = clSetKernelArg(thread->convf, 2,
+			 sizeof(cl_mem), &thread->out)) ||
+		(err = clSetKernelArg(thread->convf, 3,
+			 sizeof(int), &out_width)) ||
+		(err = clSetKernelArg(thread->convf, 4,
+			 sizeof(cl_mem), &thread->coeff)) ||
+		(err = clSetKernelArg(thread->convf, 5,
+			 sizeof(cl_mem), &thread->offsets)) ||
+		(err = clSetKernelArg(thread->convf, 6,
+			 sizeof(int), &nnz)) ||
+		(err = clSetKernelArg(thread->convf, 7,
+			 sizeof(float), &offset))) {
+		vips_gpu_fail("clSetKernelArg", err);
+		return -1;
+	}
+
+	global[0] = out_width;
+	global[1] = height;
+	if ((err = clEnqueueNDRangeKernel(thread->queue, thread->convf,
+			 2, NULL, global, NULL, 0, NULL, NULL))) {
+		vips_gpu_fail("clEnqueueNDRangeKernel", err);
+		return -1;
+	}
+
+	region[0] = out_width * sizeof(float);
+	region[1] = height;
+	if ((err = clEnqueueReadBufferRect(thread->queue, thread->out,
+			 CL_TRUE, host_origin, host_origin, region,
+			 region[0], 0, out_stride * sizeof(float), 0,
+			 out, 0, NULL, NULL))) {
+		vips_gpu_fail("read", err);
+		return -1;
+	}
+
+	return 0;
+#else
+	return -1;
+#endif /*HAVE_OPENCL*/
+}
@@ -0,0 +1,164 @@
+/* convert between IEEE 754 half and single precision float
+ *
+ * 15/10/26
+ * 	- from tiff2vips.c
+ */
+
+/*
+
+	This file is part of VIPS.
+
+	VIPS is free software; you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+	02110-1301  USA
+
+ */
+
+/*
+
+	These files are distributed with VIPS - http://www.vips.ecs.soton.ac.uk
+
+ */
+
+/* libvips has no half float band format, so loaders and savers for formats
+ * which store half floats convert to and from float at the file boundary.
+ * These convert whole lines, using the highway paths where we can.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /*HAVE_CONFIG_H*/
+#include <glib/gi18n-lib.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <vips/vips.h>
+#include <vips/vector.h>
+#include <vips/internal.h>
+
+typedef union _VipsHalfBits {
+	float f;
+	guint32 u;
+} VipsHalfBits;
+
+static inline float
+vips_half_to_float(guint16 h)
+{
+	guint32 sign = (guint32) (h & 0x8000) << 16;
+	guint32 exponent = (h >> 10) & 0x1f;
+	guint32 mantissa = h & 0x3ff;
+	VipsHalfBits bits;
+
+	if (exponent == 0x1f)
+		/* Inf or NaN.
+		 */
+		bits.u = sign | 0x7f800000 | (mantissa << 13);
+	else if (exponent == 0) {
+		/* Zero or subnormal, units of 2^-24.
+		 */
+		bits.f = mantissa / 16777216.0F;
+		bits.u |= sign;
+	}
+	else
+		bits.u = sign | ((exponent + 112) << 23) | (mantissa << 13);
+
+	return bits.f;
+}
+
+/* Round to nearest even, overflowing to inf.
+ */
+static inline guint16
+vips_float_to_half(float f)
+{
+	VipsHalfBits bits;
+	guint32 sign;
+	guint32 abs;
+
+	bits.f = f;
+	sign = (bits.u >> 16) & 0x8000;
+	abs = bits.u & 0x7fffffff;
+
+	if (abs > 0x7f800000)
+		/* NaN, keep it quiet.
+		 */
+		return sign | 0x7e00 | ((abs >> 13) & 0x3ff);
+	else if (abs >= 0x477ff000)
+		/* Inf, or rounds to more than 65504.
+		 */
+		return sign | 0x7c00;
+	else if (abs < 0x38800000) {
+		/* Subnormal or zero. Adding 0.5 puts the half ulp in the last
+		 * bit of the float mantissa, and the FPU does the rounding.
+		 */
+		bits.u = abs;
+		bits.f += 0.5F;
+
+		return sign | (bits.u - 0x3f000000);
+	}
+	else {
+		/* Normal. Rebias the exponent and round the mantissa.
+		 */
+		abs += 0xfff + ((abs >> 13) & 1);
+
+		return sign | ((abs - 0x38000000) >> 13);
+	}
+}
+
+/**
+ * vips__half_to_float: (skip)
+ * @out: output floats
+ * @in: input half floats
+ * @n: number of values
+ *
+ * Convert @n IEEE 754 half floats to float.
+ */
+void
+vips__half_to_float(float *out, const guint16 *in, size_t n)
+{
+	size_t i;
+
+	i = 0;
+#ifdef HAVE_HWY
+	if (vips_vector_isenabled())
+		i = vips_half_to_float_hwy(out, in, n);
+#endif /*HAVE_HWY*/
+
+	for (; i < n; i++)
+		out[i] = vips_half_to_float(in[i]);
+}
+
+/**
+ * vips__float_to_half: (skip)
+ * @out: output half floats
+ * @in: input floats
+ * @n: number of values
+ *
+ * Convert @n floats to IEEE 754 half float, rounding to nearest even.
+ * Values too large for half float become infinity.
+ */
+void
+vips__float_to_half(guint16 *out, const float *in, size_t n)
+{
+	size_t i;
+
+	i = 0;
+#ifdef HAVE_HWY
+	if (vips_vector_isenabled())
+		i = vips_float_to_half_hwy(out, in, n);
+#endif /*HAVE_HWY*/
+
+	for (; i < n; i++)
+		out[i] = vips_float_to_half(in[i]);
+}
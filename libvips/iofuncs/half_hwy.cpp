@@ -0,0 +1,131 @@
+/* Highway kernels for half float conversion.
+ *
+ * 15/10/26
+ * 	- initial implementation
+ */
+
+/*
+
+	This file is part of VIPS.
+
+	VIPS is free software; you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+	02110-1301  USA
+
+ */
+
+/*
+
+	These files are distributed with VIPS - http://www.vips.ecs.soton.ac.uk
+
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /*HAVE_CONFIG_H*/
+#include <glib/gi18n-lib.h>
+
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+
+#include <vips/vips.h>
+#include <vips/vector.h>
+#include <vips/debug.h>
+#include <vips/internal.h>
+
+#ifdef HAVE_HWY
+
+#undef HWY_TARGET_INCLUDE
+#define HWY_TARGET_INCLUDE "libvips/iofuncs/half_hwy.cpp"
+#include <hwy/foreach_target.h>
+#include <hwy/highway.h>
+
+namespace HWY_NAMESPACE {
+
+using namespace hwy::HWY_NAMESPACE;
+
+using DF32 = ScalableTag<float>;
+constexpr DF32 df32;
+constexpr Rebind<hwy::float16_t, DF32> df16;
+
+/* The vector loops only run on SIMD targets, the caller converts any
+ * remaining values.
+ */
+#if HWY_TARGET != HWY_SCALAR
+#define VECTOR_LOOP 1
+#else
+#define VECTOR_LOOP 0
+#endif
+
+HWY_ATTR size_t
+vips_half_to_float_hwy(float *HWY_RESTRICT out,
+	const uint16_t *HWY_RESTRICT in, size_t n)
+{
+	size_t i = 0;
+
+#if VECTOR_LOOP
+	const auto *HWY_RESTRICT p =
+		reinterpret_cast<const hwy::float16_t *>(in);
+	const size_t N = Lanes(df32);
+
+	for (; i + N <= n; i += N)
+		StoreU(PromoteTo(df32, LoadU(df16, p + i)), df32, out + i);
+#endif
+
+	return i;
+}
+
+HWY_ATTR size_t
+vips_float_to_half_hwy(uint16_t *HWY_RESTRICT out,
+	const float *HWY_RESTRICT in, size_t n)
+{
+	size_t i = 0;
+
+#if VECTOR_LOOP
+	auto *HWY_RESTRICT q = reinterpret_cast<hwy::float16_t *>(out);
+	const size_t N = Lanes(df32);
+
+	for (; i + N <= n; i += N)
+		StoreU(DemoteTo(df16, LoadU(df32, in + i)), df16, q + i);
+#endif
+
+	return i;
+}
+
+/* This file is included once per target, and VECTOR_LOOP differs between
+ * them.
+ */
+#undef VECTOR_LOOP
+
+} /*namespace HWY_NAMESPACE*/
+
+#if HWY_ONCE
+HWY_EXPORT(vips_half_to_float_hwy);
+HWY_EXPORT(vips_float_to_half_hwy);
+
+size_t
+vips_half_to_float_hwy(float *out, const guint16 *in, size_t n)
+{
+	return HWY_DYNAMIC_DISPATCH(vips_half_to_float_hwy)(out, in, n);
+}
+
+size_t
+vips_float_to_half_hwy(guint16 *out, const float *in, size_t n)
+{
+	return HWY_DYNAMIC_DISPATCH(vips_float_to_half_hwy)(out, in, n);
+}
+#endif /*HWY_ONCE*/
+
+#endif /*HAVE_HWY*/
@@ -38,6 +38,12 @@
  * 	- add vips_image_get/set_array_int()
  * 31/1/19
  * 	- lock for metadata changes
+ * 14/10/26
+ * 	- add vips_image_get_priority(), vips_image_get_weight()
+ * 15/10/26
+ * 	- metadata is held in a refcounted table, shared between images
+ * 	  until one of them changes it
+ * 	- expand EXIF tags on first use
  */
 
 /*
@@ -256,8 +262,8 @@ meta_sanity_on_hash(VipsMeta *meta, VipsImage *im, void *b)
 {
 	VipsMeta *found;
 
-	if (meta->im != im)
-		printf("*** field \"%s\" has incorrect im\n",
+	if (meta->table != im->meta_table)
+		printf("*** field \"%s\" has incorrect table\n",
 			meta->name);
 
 	if (!(found = g_hash_table_lookup(im->meta, meta->name)))
@@ -278,8 +284,8 @@ meta_sanity_on_traverse(const char *name, VipsMeta *meta, VipsImage *im)
 		printf("*** field \"%s\" has incorrect name\n",
 			meta->name);
 
-	if (meta->im != im)
-		printf("*** field \"%s\" has incorrect im\n",
+	if (meta->table != im->meta_table)
+		printf("*** field \"%s\" has incorrect table\n",
 			meta->name);
 
 	if (!g_slist_find(im->meta_traverse, meta))
@@ -298,6 +304,28 @@ meta_sanity(const VipsImage *im)
 }
 #endif /*DEBUG*/
 
+/* Metadata lives in a VipsMetaTable. Copying metadata to an image with none
+ * just shares the table, so a long pipeline doesn't duplicate every EXIF
+ * field at every step. An image gets its own copy of the table the first
+ * time it changes shared metadata.
+ *
+ * image->meta and image->meta_traverse always point into the image's
+ * table. Refcounts are protected by vips__meta_lock.
+ */
+struct _VipsMetaTable {
+	int ref_count;
+
+	/* Name to VipsMeta, and the same VipsMeta in order of setting.
+	 */
+	GHashTable *hash;
+	GSList *traverse;
+
+	/* exif-data has been set, but not yet expanded into exif-ifd* fields,
+	 * see vips__exif_parse().
+	 */
+	gboolean exif_pending;
+};
+
 static void
 meta_free(VipsMeta *meta)
 {
@@ -312,22 +340,65 @@ meta_free(VipsMeta *meta)
 	}
 #endif /*DEBUG*/
 
-	if (meta->im)
-		meta->im->meta_traverse =
-			g_slist_remove(meta->im->meta_traverse, meta);
+	if (meta->table)
+		meta->table->traverse =
+			g_slist_remove(meta->table->traverse, meta);
 
 	g_value_unset(&meta->value);
 	g_free(meta->name);
 	g_free(meta);
 }
 
+static VipsMetaTable *
+meta_table_new(void)
+{
+	VipsMetaTable *table;
+
+	table = g_new(VipsMetaTable, 1);
+	table->ref_count = 1;
+	table->hash = g_hash_table_new_full(g_str_hash, g_str_equal,
+		NULL, (GDestroyNotify) meta_free);
+	table->traverse = NULL;
+	table->exif_pending = FALSE;
+
+	return table;
+}
+
+static void
+meta_table_free(VipsMetaTable *table)
+{
+	g_assert(table->ref_count == 0);
+
+	/* Drop the traverse list first, so meta_free() doesn't need to
+	 * search it for every field.
+	 */
+	VIPS_FREEF(g_slist_free, table->traverse);
+	VIPS_FREEF(g_hash_table_destroy, table->hash);
+	g_free(table);
+}
+
+/* Point the image fields at the image's table.
+ */
+static void
+meta_sync(VipsImage *image)
+{
+	if (image->meta_table) {
+		image->meta = image->meta_table->hash;
+		image->meta_traverse = image->meta_table->traverse;
+	}
+	else {
+		image->meta = NULL;
+		image->meta_traverse = NULL;
+	}
+}
+
 static VipsMeta *
-meta_new(VipsImage *image, const char *name, GValue *value)
+meta_build(VipsMetaTable *table, const char *name, const GValue *value)
 {
 	VipsMeta *meta;
 
 	meta = g_new(VipsMeta, 1);
-	meta->im = image;
+	meta->table = table;
 	meta->name = NULL;
 	memset(&meta->value, 0, sizeof(GValue));
 	meta->name = g_strdup(name);
@@ -348,8 +419,19 @@ meta_new(VipsImage *image, const char *name, GValue *value)
 	 */
 	(void) g_value_transform(value, &meta->value);
 
-	image->meta_traverse = g_slist_append(image->meta_traverse, meta);
-	g_hash_table_replace(image->meta, meta->name, meta);
+	return meta;
+}
+
+static VipsMeta *
+meta_new(VipsMetaTable *table, const char *name, const GValue *value)
+{
+	VipsMeta *meta;
+
+	g_assert(table->ref_count == 1);
+
+	meta = meta_build(table, name, value);
+	table->traverse = g_slist_append(table->traverse, meta);
+	g_hash_table_replace(table->hash, meta->name, meta);
 
 #ifdef DEBUG
 	{
@@ -364,22 +446,172 @@ meta_new(VipsImage *image, const char *name, GValue *value)
 	return meta;
 }
 
+/* A private copy of a table. Build the traverse list backwards, since
+ * appending is O(n).
+ */
+static VipsMetaTable *
+meta_table_copy(VipsMetaTable *from)
+{
+	VipsMetaTable *table;
+	GSList *p;
+
+	table = meta_table_new();
+	for (p = from->traverse; p; p = p->next) {
+		VipsMeta *field = (VipsMeta *) p->data;
+		VipsMeta *meta = meta_build(table, field->name, &field->value);
+
+		table->traverse = g_slist_prepend(table->traverse, meta);
+		g_hash_table_insert(table->hash, meta->name, meta);
+	}
+	table->traverse = g_slist_reverse(table->traverse);
+	table->exif_pending = from->exif_pending;
+
+	return table;
+}
+
 /* Destroy all the meta on an image.
  */
 void
 vips__meta_destroy(VipsImage *image)
 {
-	VIPS_FREEF(g_hash_table_destroy, image->meta);
-	g_assert(!image->meta_traverse);
+	VipsMetaTable *table;
+	gboolean last;
+
+	g_mutex_lock(&vips__meta_lock);
+	table = image->meta_table;
+	image->meta_table = NULL;
+	meta_sync(image);
+	last = table && --table->ref_count == 0;
+	g_mutex_unlock(&vips__meta_lock);
+
+	/* Free outside the lock, since unsetting a value can finalize an
+	 * image held as metadata, and that image will want the lock too.
+	 */
+	if (last)
+		meta_table_free(table);
 }
 
+/* Make sure the image has a table it can change. Call with the lock held.
+ */
 static void
 meta_init(VipsImage *im)
 {
-	if (!im->meta) {
-		g_assert(!im->meta_traverse);
-		im->meta = g_hash_table_new_full(g_str_hash, g_str_equal,
-			NULL, (GDestroyNotify) meta_free);
+	if (!im->meta_table)
+		im->meta_table = meta_table_new();
+	else if (im->meta_table->ref_count > 1) {
+		/* Still shared, so this can't be the last ref.
+		 */
+		im->meta_table->ref_count -= 1;
+		im->meta_table = meta_table_copy(im->meta_table);
+	}
+
+	meta_sync(im);
+}
+
+gboolean
+vips__meta_get_exif_pending(const VipsImage *image)
+{
+	gboolean pending;
+
+	g_mutex_lock(&vips__meta_lock);
+	pending = image->meta_table &&
+		image->meta_table->exif_pending;
+	g_mutex_unlock(&vips__meta_lock);
+
+	return pending;
+}
+
+void
+vips__meta_set_exif_pending(VipsImage *image, gboolean pending)
+{
+	g_mutex_lock(&vips__meta_lock);
+	meta_init(image);
+	image->meta_table->exif_pending = pending;
+	g_mutex_unlock(&vips__meta_lock);
+}
+
+/* Set while this thread is expanding EXIF tags, so the tag sets inside
+ * vips__exif_expand() don't recurse.
+ */
+static GPrivate meta_exif_expanding;
+
+/* EXIF tags are expanded from the exif-data blob the first time anyone
+ * looks for one. A NULL name means all fields.
+ *
+ * The getters are called on shared images from many threads, so we must
+ * not change the table under them. Expand into a private table on a
+ * scratch image, then swap it in under the lock if nothing else has
+ * changed the image meanwhile.
+ */
+static void
+meta_exif_expand(const VipsImage *image, const char *name)
+{
+	VipsImage *writeable = (VipsImage *) image;
+
+	if (g_private_get(&meta_exif_expanding) ||
+		(name &&
+			(!vips_isprefix("exif-", name) ||
+				strcmp(name, VIPS_META_EXIF_NAME) == 0) &&
+			strcmp(name, "jpeg-thumbnail-data") != 0))
+		return;
+
+	for (;;) {
+		VipsMetaTable *table;
+		VipsImage *scratch;
+		gboolean changed;
+		gboolean last;
+
+		/* Hold a ref to the table we expand from, so it can't be
+		 * freed and reused while we work.
+		 */
+		g_mutex_lock(&vips__meta_lock);
+		table = image->meta_table;
+		if (!table ||
+			!table->exif_pending) {
+			g_mutex_unlock(&vips__meta_lock);
+			return;
+		}
+		table->ref_count += 1;
+		g_mutex_unlock(&vips__meta_lock);
+
+		/* Resolution can come from the image if EXIF lacks it.
+		 */
+		scratch = vips_image_new();
+		scratch->Xres = image->Xres;
+		scratch->Yres = image->Yres;
+		(void) vips__image_meta_copy(scratch, image);
+
+		g_private_set(&meta_exif_expanding, GINT_TO_POINTER(TRUE));
+		(void) vips__exif_expand(scratch);
+		g_private_set(&meta_exif_expanding, NULL);
+
+		/* Publish, unless the image has changed under us, in which
+		 * case we go round again.
+		 */
+		g_mutex_lock(&vips__meta_lock);
+		changed = image->meta_table != table;
+		if (!changed &&
+			scratch->meta_table &&
+			scratch->meta_table != table) {
+			scratch->meta_table->ref_count += 1;
+			writeable->meta_table = scratch->meta_table;
+			meta_sync(writeable);
+
+			/* The image's ref.
+			 */
+			table->ref_count -= 1;
+		}
+		last = --table->ref_count == 0;
+		g_mutex_unlock(&vips__meta_lock);
+
+		/* Free outside the lock, see vips__meta_destroy().
+		 */
+		if (last)
+			meta_table_free(table);
+		g_object_unref(scratch);
+
+		if (!changed)
+			return;
 	}
 }
 
@@ -984,6 +1216,52 @@ vips_image_get_concurrency(VipsImage *image, int default_concurrency)
 	return default_concurrency;
 }
 
+/**
+ * vips_image_get_priority:
+ * @image: image to get from
+ *
+ * Fetch and sanity-check [const@META_PRIORITY]. Default to 0 if not
+ * present or crazy.
+ *
+ * Returns: the scheduling priority for this image
+ */
+int
+vips_image_get_priority(VipsImage *image)
+{
+	int priority;
+
+	if (vips_image_get_typeof(image, VIPS_META_PRIORITY) &&
+		!vips_image_get_int(image, VIPS_META_PRIORITY, &priority) &&
+		priority >= -100 &&
+		priority <= 100)
+		return priority;
+
+	return 0;
+}
+
+/**
+ * vips_image_get_weight:
+ * @image: image to get from
+ *
+ * Fetch and sanity-check [const@META_WEIGHT]. Default to 1 if not
+ * present or crazy.
+ *
+ * Returns: the scheduling weight for this image
+ */
+int
+vips_image_get_weight(VipsImage *image)
+{
+	int weight;
+
+	if (vips_image_get_typeof(image, VIPS_META_WEIGHT) &&
+		!vips_image_get_int(image, VIPS_META_WEIGHT, &weight) &&
+		weight >= 1 &&
+		weight <= 1000)
+		return weight;
+
+	return 1;
+}
+
 /**
  * vips_image_get_n_subifds:
  * @image: image to get from
@@ -1194,7 +1472,7 @@ vips_image_init_fields(VipsImage *image, int xsize, int ysize, int bands,
 }
 
 static void *
-meta_cp_field(VipsMeta *meta, VipsImage *dst, void *b)
+meta_cp_field(VipsMeta *meta, VipsMetaTable *table, void *b)
 {
 #ifdef DEBUG
 	{
@@ -1207,11 +1485,7 @@ meta_cp_field(VipsMeta *meta, VipsImage *dst, void *b)
 	}
 #endif /*DEBUG*/
 
-	(void) meta_new(dst, meta->name, &meta->value);
-
-#ifdef DEBUG
-	meta_sanity(dst);
-#endif /*DEBUG*/
+	(void) meta_new(table, meta->name, &meta->value);
 
 	return NULL;
 }
@@ -1221,15 +1495,30 @@ meta_cp_field(VipsMeta *meta, VipsImage *dst, void *b)
 int
 vips__image_meta_copy(VipsImage *dst, const VipsImage *src)
 {
-	if (src->meta) {
+	if (src->meta_table) {
 		/* We lock with vips_image_set() to stop races in highly-
 		 * threaded applications.
 		 */
 		g_mutex_lock(&vips__meta_lock);
-		meta_init(dst);
-		vips_slist_map2(src->meta_traverse,
-			(VipsSListMap2Fn) meta_cp_field, dst, NULL);
+		if (!dst->meta_table) {
+			/* Nothing to merge with, so we can just share.
+			 */
+			src->meta_table->ref_count += 1;
+			dst->meta_table = src->meta_table;
+			meta_sync(dst);
+		}
+		else if (dst->meta_table != src->meta_table) {
+			meta_init(dst);
+			vips_slist_map2(src->meta_table->traverse,
+				(VipsSListMap2Fn) meta_cp_field, dst->meta_table, NULL);
+			dst->meta_table->exif_pending |= src->meta_table->exif_pending;
+			meta_sync(dst);
+		}
 		g_mutex_unlock(&vips__meta_lock);
+
+#ifdef DEBUG
+		meta_sanity(dst);
+#endif /*DEBUG*/
 	}
 
 	return 0;
@@ -1326,6 +1615,10 @@ vips_image_set(VipsImage *image, const char *name, GValue *value)
 		printf("vips_image_set: set \"%s\" on shared image\n", name);
 #endif /*DEBUG_LEAK*/
 
+	/* Expand first, or pending tags would overwrite this one later.
+	 */
+	meta_exif_expand(image, name);
+
 	/* We lock between modifying metadata and copying metadata between
 	 * images, see vips__image_meta_copy().
 	 *
@@ -1335,7 +1628,8 @@ vips_image_set(VipsImage *image, const char *name, GValue *value)
 	 */
 	g_mutex_lock(&vips__meta_lock);
 	meta_init(image);
-	(void) meta_new(image, name, value);
+	(void) meta_new(image->meta_table, name, value);
+	meta_sync(image);
 	g_mutex_unlock(&vips__meta_lock);
 
 	/* If we're setting an EXIF data block, we need to automatically expand
@@ -1462,13 +1756,21 @@ vips_image_get(const VipsImage *image, const char *name, GValue *value_copy)
 		}
 	}
 
+	meta_exif_expand(image, name);
+
+	/* Other threads can swap in an expanded table, so look up under the
+	 * lock.
+	 */
+	g_mutex_lock(&vips__meta_lock);
 	if (image->meta &&
 		(meta = g_hash_table_lookup(image->meta, name))) {
 		g_value_init(value_copy, G_VALUE_TYPE(&meta->value));
 		g_value_copy(&meta->value, value_copy);
+		g_mutex_unlock(&vips__meta_lock);
 
 		return 0;
 	}
+	g_mutex_unlock(&vips__meta_lock);
 
 	vips_error("vips_image_get", _("field \"%s\" not found"), name);
 
@@ -1494,6 +1796,7 @@ vips_image_get_typeof(const VipsImage *image, const char *name)
 {
 	int i;
 	VipsMeta *meta;
+	GType type;
 
 	g_assert(name);
 
@@ -1511,9 +1814,17 @@ vips_image_get_typeof(const VipsImage *image, const char *name)
 			return g_type_from_name(field->type);
 	}
 
+	meta_exif_expand(image, name);
+
+	type = 0;
+	g_mutex_lock(&vips__meta_lock);
 	if (image->meta &&
 		(meta = g_hash_table_lookup(image->meta, name)))
-		return G_VALUE_TYPE(&meta->value);
+		type = G_VALUE_TYPE(&meta->value);
+	g_mutex_unlock(&vips__meta_lock);
+
+	if (type)
+		return type;
 
 	VIPS_DEBUG_MSG("vips_image_get_typeof: unknown field %s\n", name);
 
@@ -1548,18 +1859,23 @@ vips_image_remove(VipsImage *image, const char *name)
 		printf("vips_image_remove: remove \"%s\" on shared image\n", name);
 #endif /*DEBUG_LEAK*/
 
-	if (image->meta) {
-		/* We lock between modifying metadata and copying metadata
-		 * between images, see vips__image_meta_copy().
-		 *
-		 * This prevents modification of metadata by one thread
-		 * racing with metadata copy on another -- this can lead to
-		 * crashes in highly-threaded applications.
-		 */
-		g_mutex_lock(&vips__meta_lock);
+	meta_exif_expand(image, name);
+
+	/* We lock between modifying metadata and copying metadata
+	 * between images, see vips__image_meta_copy().
+	 *
+	 * This prevents modification of metadata by one thread
+	 * racing with metadata copy on another -- this can lead to
+	 * crashes in highly-threaded applications.
+	 */
+	g_mutex_lock(&vips__meta_lock);
+	if (image->meta &&
+		g_hash_table_contains(image->meta, name)) {
+		meta_init(image);
 		result = g_hash_table_remove(image->meta, name);
-		g_mutex_unlock(&vips__meta_lock);
+		meta_sync(image);
 	}
+	g_mutex_unlock(&vips__meta_lock);
 
 	return result;
 }
@@ -1575,7 +1891,8 @@ static const char *vips_image_header_deprecated[] = {
 };
 
 static void *
-vips_image_map_fn(VipsMeta *meta, VipsImageMapFn fn, void *a)
+vips_image_map_fn(VipsMeta *meta,
+	VipsImage *image, VipsImageMapFn fn, void *a, void *b)
 {
 	/* Hide deprecated fields.
 	 */
@@ -1583,7 +1900,7 @@ vips_image_map_fn(VipsMeta *meta, VipsImageMapFn fn, void *a)
 		if (strcmp(meta->name, vips_image_header_deprecated[i]) == 0)
 			return NULL;
 
-	return fn(meta->im, meta->name, &meta->value, a);
+	return fn(image, meta->name, &meta->value, a);
 }
 
 /**
@@ -1607,7 +1924,11 @@ vips_image_map_fn(VipsMeta *meta, VipsImageMapFn fn, void *a)
 void *
 vips_image_map(VipsImage *image, VipsImageMapFn fn, void *a)
 {
+	VipsMetaTable *table;
 	void *result;
+	gboolean last;
+
+	meta_exif_expand(image, NULL);
 
 	for (int i = 0; i < VIPS_NUMBER(vips_header_fields); i++) {
 		HeaderField *field = &vips_header_fields[i];
@@ -1621,12 +1942,28 @@ vips_image_map(VipsImage *image, VipsImageMapFn fn, void *a)
 			return result;
 	}
 
-	if (image->meta_traverse &&
-		(result = vips_slist_map2(image->meta_traverse,
-			 (VipsSListMap2Fn) vips_image_map_fn, fn, a)))
-		return result;
+	/* Hold a ref to the table while we walk it, so a swap or a set on
+	 * another thread makes a new table rather than changing this one.
+	 */
+	g_mutex_lock(&vips__meta_lock);
+	if ((table = image->meta_table))
+		table->ref_count += 1;
+	g_mutex_unlock(&vips__meta_lock);
+
+	if (!table)
+		return NULL;
 
-	return NULL;
+	result = vips_slist_map4(table->traverse,
+		(VipsSListMap4Fn) vips_image_map_fn, image, fn, a, NULL);
+
+	g_mutex_lock(&vips__meta_lock);
+	last = --table->ref_count == 0;
+	g_mutex_unlock(&vips__meta_lock);
+
+	if (last)
+		meta_table_free(table);
+
+	return result;
 }
 
 static void *
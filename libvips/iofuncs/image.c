@@ -20,6 +20,16 @@
  * 	- fix up vips_image_dump(), it was still using ints not enums
  * 10/12/19
  * 	- add vips_image_new_from_source / vips_image_write_to_target()
+ * 14/10/26
+ * 	- add vips_image_set_budget(), images made under a budget get it
+ * 	  attached
+ * 	- drop cached mmap windows of temp files before we delete them
+ * 	- add vips_image_set_deadline()
+ * 15/10/26
+ * 	- vips_image_write() to a partial image passes constant images
+ * 	  through
+ * 	- vips_image_write_to_buffer() uses the render cache
+ * 	- vips_image_write() marks @out as safe for sequential sources
  */
 
 /*
@@ -406,6 +416,7 @@ vips_image_delete(VipsImage *image)
 
 		VIPS_DEBUG_MSG("vips_image_delete: removing temp %s\n",
 			image->delete_on_close_filename);
+		vips__window_cache_drop(image->delete_on_close_filename);
 		g_unlink(image->delete_on_close_filename);
 		VIPS_FREE(image->delete_on_close_filename);
 		image->delete_on_close = FALSE;
@@ -975,11 +986,11 @@ vips_image_build(VipsObject *object)
 			return -1;
 		}
 
-		/* Just weird. Only print a warning for this, since we should
-		 * still be able to process it without coredumps.
+		/* Loaders like FITS map one section of a larger file, so this
+		 * is only worth a note.
 		 */
 		if (image->file_length - image->sizeof_header > sizeof_image)
-			g_warning("%s is longer than expected", image->filename);
+			g_info("%s is longer than expected", image->filename);
 		break;
 
 	case 'm':
@@ -1348,6 +1359,12 @@ vips_image_init(VipsImage *image)
 
 	image->mode = g_strdup("p");
 
+	/* Images made while a memory budget is current inherit it, so the
+	 * workers that compute them are charged too.
+	 */
+	if (vips_budget_get_current())
+		vips_image_set_budget(image, vips_budget_get_current());
+
 #ifdef DEBUG_LEAK
 	g_object_set_qdata_full(G_OBJECT(image), vips__image_pixels_quark,
 		g_new0(VipsImagePixels, 1), (GDestroyNotify) g_free);
@@ -1638,6 +1655,9 @@ vips_image_set_progress(VipsImage *image, gboolean progress)
  * message, clear the [class@Image].kill flag and return `TRUE`. Otherwise
  * return `FALSE`.
  *
+ * This is also `TRUE` if a deadline has passed, see
+ * [method@Image.set_deadline].
+ *
  * Handy for loops which need to run sets of threads which can fail.
  *
  * ::: seealso
@@ -1656,6 +1676,12 @@ vips_image_iskilled(VipsImage *image)
 	if (image->progress_signal)
 		kill |= image->progress_signal->kill;
 
+	/* A passed deadline is a kill with its own error.
+	 */
+	if (!kill &&
+		vips_image_deadline_passed(image))
+		return TRUE;
+
 	/* Has kill been set for this image? If yes, abort evaluation.
 	 */
 	if (kill) {
@@ -1698,6 +1724,68 @@ vips_image_set_kill(VipsImage *image, gboolean kill)
 		image->progress_signal->kill = kill;
 }
 
+/**
+ * vips_image_set_deadline:
+ * @image: image to set
+ * @timeout: seconds from now, or 0 for no deadline
+ *
+ * Give up computing @image if it takes more than @timeout seconds.
+ * Images made from @image after this call inherit the deadline.
+ *
+ * Once the deadline passes, threadpool workers stop between tiles,
+ * loaders and savers stop at their next progress check (the webp
+ * and jpeg savers test during encode, for example), and the sink
+ * fails with a "deadline" error. Use [method@Image.deadline_passed] to
+ * tell a timeout from other errors.
+ *
+ * ::: seealso
+ *     [method@Image.set_kill].
+ */
+void
+vips_image_set_deadline(VipsImage *image, double timeout)
+{
+	image->deadline = timeout > 0
+		? g_get_monotonic_time() + (gint64) (timeout * G_TIME_SPAN_SECOND)
+		: 0;
+}
+
+/**
+ * vips_image_deadline_passed:
+ * @image: image to test
+ *
+ * Test the deadline on @image, on the image it signals progress on, and
+ * on the threadpool the calling thread is working for, if any. If any has
+ * passed, set an error message and return `TRUE`.
+ *
+ * ::: seealso
+ *     [method@Image.set_deadline].
+ *
+ * Returns: `TRUE` if a deadline has passed.
+ */
+gboolean
+vips_image_deadline_passed(VipsImage *image)
+{
+	gint64 deadline;
+
+	deadline = vips__worker_get_deadline();
+	if (image->deadline &&
+		(!deadline || image->deadline < deadline))
+		deadline = image->deadline;
+	if (image->progress_signal &&
+		image->progress_signal->deadline &&
+		(!deadline || image->progress_signal->deadline < deadline))
+		deadline = image->progress_signal->deadline;
+
+	if (deadline &&
+		g_get_monotonic_time() > deadline) {
+		vips_error("deadline", _("deadline exceeded for image \"%s\""),
+			image->filename);
+		return TRUE;
+	}
+
+	return FALSE;
+}
+
 /* Fills the given buffer with a temporary filename.
  * Assuming that "int" might be 64 Bit wide a buffer size of 26 suffices.
  */
@@ -2530,6 +2618,9 @@ vips_image_set_delete_on_close(VipsImage *image, gboolean delete_on_close)
  * `VIPS_DISC_THRESHOLD` environment variable or the `--vips-disc-threshold`
  * command-line flag. See [ctor@Image.new_from_file].
  *
+ * If a [struct@Budget] is current, this is never more than the memory left
+ * in the budget.
+ *
  * Returns: disc threshold in bytes.
  */
 guint64
@@ -2562,9 +2653,48 @@ vips_get_disc_threshold(void)
 #endif /*DEBUG*/
 	}
 
+	/* Don't make memory temps that won't fit in the current budget.
+	 */
+	if (vips_budget_get_current())
+		return VIPS_MIN(threshold, vips__budget_get_free());
+
 	return threshold;
 }
 
+/**
+ * vips_image_set_budget: (skip)
+ * @image: image to attach to
+ * @budget: (nullable): budget to attach
+ *
+ * Attach a memory budget to @image. Workers computing @image charge
+ * their tracked allocations to @budget. Images made while a budget is
+ * current get it attached automatically.
+ *
+ * ::: seealso
+ *     [ctor@Budget.new], [func@budget_set_current].
+ */
+void
+vips_image_set_budget(VipsImage *image, VipsBudget *budget)
+{
+	if (budget)
+		g_object_set_data_full(G_OBJECT(image), "vips-budget",
+			vips_budget_ref(budget), (GDestroyNotify) vips_budget_unref);
+	else
+		g_object_set_data(G_OBJECT(image), "vips-budget", NULL);
+}
+
+/**
+ * vips_image_get_budget: (skip)
+ * @image: image to get from
+ *
+ * Returns: (transfer none) (nullable): the budget attached to @image.
+ */
+VipsBudget *
+vips_image_get_budget(VipsImage *image)
+{
+	return g_object_get_data(G_OBJECT(image), "vips-budget");
+}
+
 /**
  * vips_image_new_temp_file: (constructor)
  * @format: format of file
@@ -2657,6 +2787,12 @@ vips_image_write(VipsImage *image, VipsImage *out)
 		return -1;
 	}
 
+	/* A plain copy never changes the order we need pixels in. This must
+	 * be before the generate, since that runs the sink for non-partial
+	 * @out.
+	 */
+	vips__sequential_tag(out);
+
 	if (vips_image_generate(out,
 			vips_start_one, vips_image_write_gen, vips_stop_one,
 			image, NULL)) {
@@ -2673,6 +2809,9 @@ vips_image_write(VipsImage *image, VipsImage *out)
 	 */
 	if (vips_image_ispartial(out)) {
 		vips_object_local(out, image);
+
+		if (image->constant)
+			vips__image_set_constant(out, image->constant);
 	}
 	else {
 		vips__reorder_clear(out);
@@ -2683,6 +2822,14 @@ vips_image_write(VipsImage *image, VipsImage *out)
 	return 0;
 }
 
+/* Is @image a plain copy of its input made by vips_image_write()?
+ */
+gboolean
+vips__image_iswrite(VipsImage *image)
+{
+	return image->generate_fn == vips_image_write_gen;
+}
+
 /**
  * vips_image_write_to_file:
  * @image: image to write
@@ -2765,6 +2912,10 @@ vips_image_write_to_file(VipsImage *image, const char *name, ...)
  * You can call the various save operations directly if you wish, see
  * [method@Image.jpegsave_buffer], for example.
  *
+ * If the render cache is enabled and all options are in @suffix, the
+ * result may come from an earlier identical save, see
+ * [func@cache_set_render_max_mem].
+ *
  * ::: seealso
  *     [method@Image.write_to_memory], [ctor@Image.new_from_buffer].
  *
@@ -2779,20 +2930,56 @@ vips_image_write_to_buffer(VipsImage *in,
 	char option_string[VIPS_PATH_MAX];
 	const char *operation_name;
 	VipsBlob *blob;
+	char *key;
 	va_list ap;
 	int result;
 
+	/* We can only use the render cache if all the options are in the
+	 * suffix.
+	 */
+	key = NULL;
+	if (vips__render_cache_enabled()) {
+		const char *first;
+
+		va_start(ap, size);
+		first = va_arg(ap, const char *);
+		va_end(ap);
+
+		if (!first)
+			key = vips__render_cache_key(in, suffix);
+	}
+
 	vips__filename_split8(suffix, filename, option_string);
 
 	vips_error_freeze();
 	operation_name = vips_foreign_find_save_target(filename);
 	vips_error_thaw();
 
+	if (key &&
+		(blob = vips__render_cache_lookup(key))) {
+		/* The cache keeps a ref to blob, so we must copy.
+		 */
+		g_free(key);
+
+		if (buf) {
+			*buf = g_malloc(VIPS_AREA(blob)->length);
+			memcpy(*buf, VIPS_AREA(blob)->data, VIPS_AREA(blob)->length);
+		}
+		if (size)
+			*size = VIPS_AREA(blob)->length;
+
+		vips_area_unref(VIPS_AREA(blob));
+
+		return 0;
+	}
+
 	if (operation_name) {
 		VipsTarget *target;
 
-		if (!(target = vips_target_new_to_memory()))
+		if (!(target = vips_target_new_to_memory())) {
+			g_free(key);
 			return -1;
+		}
 
 		va_start(ap, size);
 		result = vips_call_split_option_string(operation_name,
@@ -2801,6 +2988,7 @@ vips_image_write_to_buffer(VipsImage *in,
 
 		if (result) {
 			VIPS_UNREF(target);
+			g_free(key);
 			return -1;
 		}
 
@@ -2813,18 +3001,33 @@ vips_image_write_to_buffer(VipsImage *in,
 			option_string, ap, in, &blob);
 		va_end(ap);
 
-		if (result)
+		if (result) {
+			g_free(key);
 			return -1;
+		}
 	}
-	else
+	else {
+		g_free(key);
 		return -1;
+	}
 
 	*buf = NULL;
 	if (size)
 		*size = 0;
 
 	if (blob) {
-		if (buf) {
+		/* If the cache keeps blob, we can't steal the bytes.
+		 */
+		if (key) {
+			vips__render_cache_add(key, blob);
+
+			if (buf) {
+				*buf = g_malloc(VIPS_AREA(blob)->length);
+				memcpy(*buf,
+					VIPS_AREA(blob)->data, VIPS_AREA(blob)->length);
+			}
+		}
+		else if (buf) {
 			*buf = VIPS_AREA(blob)->data;
 			VIPS_AREA(blob)->free_fn = NULL;
 		}
@@ -2833,6 +3036,7 @@ vips_image_write_to_buffer(VipsImage *in,
 
 		vips_area_unref(VIPS_AREA(blob));
 	}
+	g_free(key);
 
 	return 0;
 }
@@ -2891,6 +3095,7 @@ vips_image_write_to_target(VipsImage *in,
  * Writes @in to memory as a simple, unformatted C-style array.
  *
  * The caller is responsible for freeing this memory with [func@GLib.free].
+ * Use [method@Image.sink_memory_stride] to write to memory you already have.
  *
  * ::: seealso
  *     [method@Image.write_to_buffer].
@@ -3455,6 +3660,10 @@ vips_image_wio_input(VipsImage *image)
 		 */
 		g_object_unref(t1);
 
+		/* It might be drawn on now, so it's no longer constant.
+		 */
+		image->constant = NULL;
+
 		/* We need to zap any start/gen/stop callbacks. If we don't,
 		 * calling vips_region_prepare_to() later to read from this
 		 * image will fail, since it will think it needs to create the
@@ -34,6 +34,16 @@
  * 	- don't use atexit for cleanup, it's too unreliable ... users should
  * 	  call vips_shutdown explicitly if they want a clean exit, though a
  * 	  dirty exit is fine
+ * 14/10/26
+ * 	- add --vips-tile-auto
+ * 	- add --vips-numa
+ * 	- free the reduce kernel cache on shutdown
+ * 	- add VIPS_MMAP_HUGEPAGE
+ * 	- add VIPS_WINDOW_CACHE
+ * 	- start the scheduler
+ * 15/10/26
+ * 	- open modules on first use
+ * 	- add VIPS_CACHE_SHARED, VIPS_CACHE_SHARED_MAX_MEM
  */
 
 /*
@@ -282,10 +292,130 @@ vips_get_prgname(void)
  */
 
 #ifdef ENABLE_MODULES
-/* Load all plugins in a directory.
+static void
+vips_load_plugin(const char *path)
+{
+	GModule *module;
+
+	g_info("loading \"%s\"", path);
+
+	module = g_module_open(path, G_MODULE_BIND_LAZY);
+	if (module)
+		/* Modules will almost certainly create new
+		 * types, so they can't be unloaded.
+		 */
+		g_module_make_resident(module);
+	else
+		g_warning("unable to load \"%s\" -- %s",
+			path, g_module_error());
+}
+
+/* Modules we've found but not opened yet. Opening a module pulls in its
+ * libraries, which can be slow, so we wait until something looks for a
+ * class one of them might provide.
+ */
+static GRecMutex vips_module_lock;
+static GSList *vips_module_pending = NULL;
+static int vips_module_n_pending = 0; // (atomic)
+
+/* The files each of our modules can load, so we can open just the modules
+ * which might be needed for a filename. Modules we don't know about, like
+ * magick, are opened when nothing else can handle a file.
+ */
+static const char *vips_module_heif_suffs[] = {
+	".heic", ".heif", ".avif", NULL
+};
+static const char *vips_module_jxl_suffs[] = {
+	".jxl", NULL
+};
+static const char *vips_module_poppler_suffs[] = {
+	".pdf", NULL
+};
+static const char *vips_module_openslide_suffs[] = {
+	".svs", ".vms", ".vmu", ".ndpi", ".scn", ".mrxs", ".svslide", ".tif",
+	".bif", ".dcm", NULL
+};
+
+static struct {
+	const char *name;
+	const char **suffs;
+} vips_module_suffs[] = {
+	{ "vips-heif", vips_module_heif_suffs },
+	{ "vips-jxl", vips_module_jxl_suffs },
+	{ "vips-poppler", vips_module_poppler_suffs },
+	{ "vips-openslide", vips_module_openslide_suffs },
+};
+
+static gboolean
+vips_module_handles(const char *path, const char *filename)
+{
+	char *basename;
+	gboolean handles;
+
+	basename = g_path_get_basename(path);
+	handles = FALSE;
+	for (int i = 0; i < VIPS_NUMBER(vips_module_suffs); i++) {
+		const char *name = vips_module_suffs[i].name;
+		size_t len = strlen(name);
+
+		if (strncmp(basename, name, len) == 0 &&
+			basename[len] == '.') {
+			handles = vips_filename_suffix_match(filename,
+				vips_module_suffs[i].suffs);
+			break;
+		}
+	}
+	g_free(basename);
+
+	return handles;
+}
+
+/* Open pending modules. If @filename is set, only open modules which might
+ * load it. Return TRUE if we opened anything.
+ */
+static gboolean
+vips_module_load(const char *filename)
+{
+	GSList *opened;
+
+	/* Quick exit if there's nothing to do, the usual case.
+	 */
+	if (!g_atomic_int_get(&vips_module_n_pending))
+		return FALSE;
+
+	g_rec_mutex_lock(&vips_module_lock);
+
+	opened = NULL;
+	for (GSList *p = vips_module_pending; p; p = p->next) {
+		char *path = (char *) p->data;
+
+		if (!filename ||
+			vips_module_handles(path, filename)) {
+			vips_load_plugin(path);
+			opened = g_slist_prepend(opened, path);
+		}
+	}
+
+	for (GSList *p = opened; p; p = p->next) {
+		vips_module_pending = g_slist_remove(vips_module_pending, p->data);
+		g_free(p->data);
+	}
+	g_atomic_int_set(&vips_module_n_pending,
+		g_slist_length(vips_module_pending));
+
+	g_rec_mutex_unlock(&vips_module_lock);
+
+	if (!opened)
+		return FALSE;
+	g_slist_free(opened);
+
+	return TRUE;
+}
+
+/* Load or find all plugins in a directory.
  */
 static void
-vips_load_plugins(const char *fmt, ...)
+vips_load_plugins(gboolean lazy, const char *fmt, ...)
 {
 	va_list ap;
 	char dir_name[VIPS_PATH_MAX];
@@ -310,28 +440,48 @@ vips_load_plugins(const char *fmt, ...)
 
 	while ((name = g_dir_read_name(dir))) {
 		char path[VIPS_PATH_MAX];
-		GModule *module;
 
 		g_snprintf(path, VIPS_PATH_MAX,
 			"%s" G_DIR_SEPARATOR_S "%s", dir_name, name);
 
-		g_info("loading \"%s\"", path);
-
-		module = g_module_open(path, G_MODULE_BIND_LAZY);
-		if (module)
-			/* Modules will almost certainly create new
-			 * types, so they can't be unloaded.
-			 */
-			g_module_make_resident(module);
+		if (lazy) {
+			g_rec_mutex_lock(&vips_module_lock);
+			vips_module_pending = g_slist_append(vips_module_pending,
+				g_strdup(path));
+			g_atomic_int_inc(&vips_module_n_pending);
+			g_rec_mutex_unlock(&vips_module_lock);
+		}
 		else
-			g_warning("unable to load \"%s\" -- %s",
-				path, g_module_error());
+			vips_load_plugin(path);
 	}
 
 	g_dir_close(dir);
 }
 #endif /*ENABLE_MODULES*/
 
+/* Open any modules we've not opened yet. Call this before searching for
+ * all subclasses of something. Return TRUE if new classes may have appeared.
+ */
+gboolean
+vips__module_load_all(void)
+{
+#ifdef ENABLE_MODULES
+	return vips_module_load(NULL);
+#else  /*!ENABLE_MODULES*/
+	return FALSE;
+#endif /*ENABLE_MODULES*/
+}
+
+/* Open any modules which might be able to load @filename.
+ */
+void
+vips__module_load_filename(const char *filename)
+{
+#ifdef ENABLE_MODULES
+	(void) vips_module_load(filename);
+#endif /*ENABLE_MODULES*/
+}
+
 /* Install this log handler to hide warning messages.
  */
 static void
@@ -502,14 +652,39 @@ vips_init(const char *argv0)
 		vips_verbose();
 	if (g_getenv("VIPS_PROFILE"))
 		vips_profile_set(TRUE);
+	if (g_getenv("VIPS_PROFILE_TRACE"))
+		vips_profile_set_trace(TRUE);
+	if (g_getenv("VIPS_PROFILE_COUNTERS"))
+		vips_profile_set_counters(TRUE);
+	if (g_getenv("VIPS_METRICS"))
+		vips_metrics_set(TRUE);
 	if (g_getenv("VIPS_LEAK"))
 		vips_leak_set(TRUE);
 	if (g_getenv("VIPS_TRACE"))
 		vips_cache_set_trace(TRUE);
 
+	const char *cache_shared;
+	if ((cache_shared = g_getenv("VIPS_CACHE_SHARED")))
+		vips_cache_set_shared(cache_shared);
+	if ((cache_shared = g_getenv("VIPS_CACHE_SHARED_MAX_MEM")))
+		vips_cache_set_shared_max_mem(vips__parse_size(cache_shared));
+
+	const char *cache_render;
+	if ((cache_render = g_getenv("VIPS_CACHE_RENDER_MAX_MEM")))
+		vips_cache_set_render_max_mem(vips__parse_size(cache_render));
+	if ((cache_render = g_getenv("VIPS_CACHE_RENDER_DIR")))
+		vips_cache_set_render_dir(cache_render);
+
 	if (g_getenv("VIPS_UNLIMITED"))
 		vips_unlimited_set(TRUE);
 
+	if (g_getenv("VIPS_MMAP_HUGEPAGE"))
+		vips__mmap_hugepage = TRUE;
+
+	const char *window_cache;
+	if ((window_cache = g_getenv("VIPS_WINDOW_CACHE")))
+		vips_window_cache_set_max(vips__parse_size(window_cache));
+
 	const char *pipe_read_limit;
 	if ((pipe_read_limit = g_getenv("VIPS_PIPE_READ_LIMIT")))
 		vips_pipe_read_limit_set(vips__parse_size(pipe_read_limit));
@@ -526,6 +701,7 @@ vips_init(const char *argv0)
 
 	vips__thread_init();
 	vips__threadpool_init();
+	vips__scheduler_init();
 	vips__buffer_init();
 
 	if (!vips__global_timer)
@@ -613,20 +789,21 @@ vips_init(const char *argv0)
 	vips_g_input_stream_get_type();
 
 #ifdef ENABLE_MODULES
-	/* Load any vips8 modules from the vips libdir. Keep going, even if
-	 * some modules fail to load.
+	/* Find any vips8 modules in the vips libdir. They are opened on first
+	 * use, see vips__module_load_all(). Keep going, even if some modules
+	 * fail to load.
 	 *
 	 * Only do this if we have been built as a set of loadable
 	 * modules, or we might try loading an operation into a library that
 	 * already has that operation built in.
 	 */
-	vips_load_plugins("%s/vips-modules-%d.%d",
+	vips_load_plugins(TRUE, "%s/vips-modules-%d.%d",
 		libdir, VIPS_MAJOR_VERSION, VIPS_MINOR_VERSION);
 
 #ifdef ENABLE_DEPRECATED
 	/* We had vips8 plugins for a while.
 	 */
-	vips_load_plugins("%s/vips-plugins-%d.%d",
+	vips_load_plugins(FALSE, "%s/vips-plugins-%d.%d",
 		libdir, VIPS_MAJOR_VERSION, VIPS_MINOR_VERSION);
 
 	/* Load up any vips7 plugins. We don't error on
@@ -652,6 +829,10 @@ vips_init(const char *argv0)
 	 */
 	vips__vector_init();
 
+	/* GPU offload can be turned off from the environment.
+	 */
+	vips__gpu_init();
+
 #ifdef DEBUG_LEAK
 	vips__image_pixels_quark =
 		g_quark_from_static_string("vips-image-pixels");
@@ -717,6 +898,7 @@ void
 vips_thread_shutdown(void)
 {
 	vips__thread_profile_detach();
+	vips__region_shutdown();
 	vips__buffer_shutdown();
 }
 
@@ -745,6 +927,9 @@ vips_shutdown(void)
 #endif /*DEBUG*/
 
 	vips_cache_drop_all();
+	vips_cache_set_shared(NULL);
+	vips__render_cache_drop();
+	vips_cache_set_render_dir(NULL);
 
 #ifdef ENABLE_DEPRECATED
 	im_close_plugins();
@@ -763,6 +948,11 @@ vips_shutdown(void)
 	vips__render_shutdown();
 	vips_thread_shutdown();
 	vips__thread_profile_stop();
+	vips__metrics_shutdown();
+	vips__reduce_kernel_shutdown();
+	vips__window_cache_shutdown();
+	vips__gpu_shutdown();
+	vips__nsgif_keyframe_shutdown();
 	vips__threadpool_shutdown();
 
 	VIPS_FREE(vips__argv0);
@@ -866,6 +1056,48 @@ vips_cache_max_files_cb(const gchar *option_name, const gchar *value,
 	return TRUE;
 }
 
+static gboolean
+vips_cache_shared_cb(const gchar *option_name, const gchar *value,
+	gpointer data, GError **error)
+{
+	vips_cache_set_shared(value);
+
+	return TRUE;
+}
+
+static gboolean
+vips_profile_trace_cb(const gchar *option_name, const gchar *value,
+	gpointer data, GError **error)
+{
+	vips_profile_set_trace(TRUE);
+
+	return TRUE;
+}
+
+static gboolean
+vips_profile_counters_cb(const gchar *option_name, const gchar *value,
+	gpointer data, GError **error)
+{
+	vips_profile_set_counters(TRUE);
+
+	return TRUE;
+}
+
+static gboolean
+vips_vector_target_cb(const gchar *option_name, const gchar *value,
+	gpointer data, GError **error)
+{
+	if (vips_vector_set_target(value)) {
+		g_set_error(error, G_OPTION_ERROR, G_OPTION_ERROR_BAD_VALUE,
+			"%s", vips_error_buffer());
+		vips_error_clear();
+
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
 static gboolean
 vips_pipe_read_limit_cb(const gchar *option_name, const gchar *value,
 	gpointer data, GError **error)
@@ -888,6 +1120,9 @@ static GOptionEntry option_entries[] = {
 	{ "vips-concurrency", 0, 0,
 		G_OPTION_ARG_INT, &vips__concurrency,
 		N_("evaluate with N concurrent threads"), "N" },
+	{ "vips-numa", 0, 0,
+		G_OPTION_ARG_NONE, &vips__numa,
+		N_("pin worker threads to NUMA nodes"), NULL },
 	{ "vips-max-coord", 0, 0,
 		G_OPTION_ARG_STRING, &vips__max_coord_arg,
 		N_("maximum coordinate"), NULL },
@@ -897,6 +1132,9 @@ static GOptionEntry option_entries[] = {
 	{ "vips-tile-height", 0, G_OPTION_FLAG_HIDDEN,
 		G_OPTION_ARG_INT, &vips__tile_height,
 		N_("set tile height to N (DEBUG)"), "N" },
+	{ "vips-tile-auto", 0, 0,
+		G_OPTION_ARG_NONE, &vips__tile_auto,
+		N_("size tiles from the pipeline and the cache size"), NULL },
 	{ "vips-thinstrip-height", 0, G_OPTION_FLAG_HIDDEN,
 		G_OPTION_ARG_INT, &vips__thinstrip_height,
 		N_("set thinstrip height to N (DEBUG)"), "N" },
@@ -912,12 +1150,24 @@ static GOptionEntry option_entries[] = {
 	{ "vips-profile", 0, 0,
 		G_OPTION_ARG_NONE, &vips__thread_profile,
 		N_("profile and dump timing on exit"), NULL },
+	{ "vips-profile-trace", 0, G_OPTION_FLAG_NO_ARG,
+		G_OPTION_ARG_CALLBACK, (gpointer) &vips_profile_trace_cb,
+		N_("profile and dump a chrome trace on exit"), NULL },
+	{ "vips-profile-counters", 0, G_OPTION_FLAG_NO_ARG,
+		G_OPTION_ARG_CALLBACK, (gpointer) &vips_profile_counters_cb,
+		N_("add hardware counters to the profile"), NULL },
 	{ "vips-disc-threshold", 0, 0,
 		G_OPTION_ARG_STRING, &vips__disc_threshold,
 		N_("images larger than N are decompressed to disc"), "N" },
 	{ "vips-novector", 0, G_OPTION_FLAG_REVERSE,
 		G_OPTION_ARG_NONE, &vips__vector_enabled,
 		N_("disable vectorised versions of operations"), NULL },
+	{ "vips-nogpu", 0, G_OPTION_FLAG_REVERSE,
+		G_OPTION_ARG_NONE, &vips__gpu_enabled,
+		N_("disable GPU offload of operations"), NULL },
+	{ "vips-vector-target", 0, 0,
+		G_OPTION_ARG_CALLBACK, (gpointer) &vips_vector_target_cb,
+		N_("run vectorised operations with TARGET only"), "TARGET" },
 	{ "vips-cache-max", 0, 0,
 		G_OPTION_ARG_CALLBACK, (gpointer) &vips_cache_max_cb,
 		N_("cache at most N operations"), "N" },
@@ -933,6 +1183,9 @@ static GOptionEntry option_entries[] = {
 	{ "vips-cache-dump", 0, 0,
 		G_OPTION_ARG_NONE, &vips__cache_dump,
 		N_("dump operation cache on exit"), NULL },
+	{ "vips-cache-shared", 0, 0,
+		G_OPTION_ARG_CALLBACK, (gpointer) &vips_cache_shared_cb,
+		N_("share decoded images with other processes in DIR"), "DIR" },
 	{ "vips-version", 0, G_OPTION_FLAG_NO_ARG,
 		G_OPTION_ARG_CALLBACK, (gpointer) &vips_lib_version_cb,
 		N_("print libvips version"), NULL },
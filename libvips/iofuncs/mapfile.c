@@ -22,6 +22,8 @@
  * 	- set NOCACHE if we can ... helps OS X performance a lot
  * 25/3/11
  * 	- move to vips_ namespace
+ * 14/10/26
+ * 	- add vips__mmap_advise()
  */
 
 /*
@@ -249,6 +251,58 @@ vips__mmap(int fd, int writeable, size_t length, gint64 offset)
 	return baseaddr;
 }
 
+/* Set from VIPS_MMAP_HUGEPAGE. Ask for transparent huge pages on large
+ * mappings.
+ */
+gboolean vips__mmap_hugepage = FALSE;
+
+/* Tell the kernel how we will use a mapping. Sequential scans get
+ * aggressive readahead and early reclaim, small tile access to wide images
+ * touches many lines a little at a time, so readahead just wastes IO.
+ *
+ * Only a hint, so errors are ignored.
+ */
+void
+vips__mmap_advise(void *baseaddr, size_t length,
+	VipsAccess access, VipsDemandStyle dhint)
+{
+#if defined(HAVE_SYS_MMAN_H) && defined(MADV_SEQUENTIAL)
+	int advice;
+
+	if (access == VIPS_ACCESS_SEQUENTIAL ||
+		access == VIPS_ACCESS_SEQUENTIAL_UNBUFFERED)
+		advice = MADV_SEQUENTIAL;
+	else if (dhint == VIPS_DEMAND_STYLE_SMALLTILE)
+		advice = MADV_RANDOM;
+	else
+		advice = MADV_NORMAL;
+	(void) madvise(baseaddr, length, advice);
+
+#ifdef MADV_HUGEPAGE
+	/* Huge pages are 2MB on most platforms, don't bother unless we can
+	 * fill a few.
+	 */
+	if (vips__mmap_hugepage &&
+		length >= 8 * 1024 * 1024)
+		(void) madvise(baseaddr, length, MADV_HUGEPAGE);
+#endif /*MADV_HUGEPAGE*/
+#endif /*defined(HAVE_SYS_MMAN_H) && defined(MADV_SEQUENTIAL)*/
+}
+
+/* Start async read of a range we will need soon. @start need not be page
+ * aligned.
+ */
+void
+vips__mmap_willneed(void *start, size_t length)
+{
+#if defined(HAVE_SYS_MMAN_H) && defined(MADV_WILLNEED)
+	const size_t pagesize = sysconf(_SC_PAGESIZE);
+	size_t slop = (size_t) start % pagesize;
+
+	(void) madvise((char *) start - slop, length + slop, MADV_WILLNEED);
+#endif /*defined(HAVE_SYS_MMAN_H) && defined(MADV_WILLNEED)*/
+}
+
 int
 vips__munmap(const void *start, size_t length)
 {
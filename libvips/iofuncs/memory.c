@@ -22,6 +22,9 @@
  * 21/9/11
  * 	- rename as vips_tracked_malloc() to emphasise difference from
  * 	  g_malloc()/g_free()
+ * 14/10/26
+ * 	- use atomics rather than a global lock for the counters
+ * 	- add VipsBudget
  */
 
 /*
@@ -74,6 +77,7 @@
 #endif
 
 #include <vips/vips.h>
+#include <vips/internal.h>
 
 /* g_assert_not_reached() on memory errors.
 #define DEBUG
@@ -88,11 +92,13 @@
 #warning DEBUG on in libsrc/iofuncs/memory.c
 #endif /*DEBUG*/
 
-static int vips_tracked_allocs = 0;
-static size_t vips_tracked_mem = 0;
-static int vips_tracked_files = 0;
-static size_t vips_tracked_mem_highwater = 0;
-static GMutex vips_tracked_mutex;
+/* These are all updated with atomics, so allocation never takes a lock.
+ * They are pointer-sized for g_atomic_pointer_add().
+ */
+static int vips_tracked_allocs = 0;		   // (atomic)
+static gsize vips_tracked_mem = 0;		   // (atomic)
+static int vips_tracked_files = 0;		   // (atomic)
+static gsize vips_tracked_mem_highwater = 0; // (atomic)
 
 /**
  * VIPS_NEW:
@@ -200,6 +206,305 @@ vips_strdup(VipsObject *object, const char *str)
 	return str_dup;
 }
 
+/**
+ * VipsBudget:
+ *
+ * A [struct@Budget] limits the memory that a set of pipelines can allocate
+ * with [func@tracked_malloc] and friends. See [ctor@Budget.new].
+ */
+struct _VipsBudget {
+	int ref_count; // (atomic)
+
+	size_t max_mem;
+	gsize mem;			 // (atomic)
+	gsize mem_highwater; // (atomic)
+
+	/* How long allocations wait for memory to be freed before they fail,
+	 * and the lock and cond they wait on.
+	 */
+	gint64 stall;
+	GMutex lock;
+	GCond cond;
+	int n_waiting; // (atomic)
+};
+
+/* The budget allocations on this thread are charged to. This does not hold
+ * a ref.
+ */
+static GPrivate vips_budget_current_key;
+
+/**
+ * vips_budget_new: (constructor) (skip)
+ * @max_mem: most bytes that can be allocated against this budget
+ *
+ * Make a new memory budget. Tracked allocations made while a budget is
+ * current (see [func@budget_set_current]), or by workers computing an
+ * image that has a budget attached (see [method@Image.set_budget]), are
+ * charged to the budget. An allocation which would take the budget over
+ * @max_mem fails with an error, unless [method@Budget.set_stall] has been
+ * used to make it wait for memory to be freed.
+ *
+ * The disc threshold is also lowered to the memory left in the current
+ * budget, so loaders will decompress to a disc temp rather than
+ * exhaust a budget. See [func@get_disc_threshold].
+ *
+ * Returns: (transfer full): a new budget, free with [method@Budget.unref].
+ */
+VipsBudget *
+vips_budget_new(size_t max_mem)
+{
+	VipsBudget *budget;
+
+	budget = g_new0(VipsBudget, 1);
+	budget->ref_count = 1;
+	budget->max_mem = max_mem;
+	g_mutex_init(&budget->lock);
+	g_cond_init(&budget->cond);
+
+	return budget;
+}
+
+/**
+ * vips_budget_ref: (skip)
+ * @budget: budget to ref
+ *
+ * Returns: (transfer full): @budget, with an extra reference.
+ */
+VipsBudget *
+vips_budget_ref(VipsBudget *budget)
+{
+	g_atomic_int_inc(&budget->ref_count);
+
+	return budget;
+}
+
+/**
+ * vips_budget_unref: (skip)
+ * @budget: (transfer full): budget to unref
+ *
+ * Drop a reference. The budget is freed when the last reference, and the
+ * last allocation charged to it, have gone.
+ */
+void
+vips_budget_unref(VipsBudget *budget)
+{
+	if (g_atomic_int_dec_and_test(&budget->ref_count)) {
+		g_mutex_clear(&budget->lock);
+		g_cond_clear(&budget->cond);
+		g_free(budget);
+	}
+}
+
+/**
+ * vips_budget_set_stall: (skip)
+ * @budget: budget to set
+ * @stall: microseconds to wait for memory
+ *
+ * Allocations which would exceed @budget wait up to @stall microseconds for
+ * other allocations against the budget to be freed before failing. The
+ * default is 0, meaning fail at once.
+ *
+ * Stalling gives back-pressure when several threads share a budget, but a
+ * single thread can never free memory while it waits, so keep this short.
+ */
+void
+vips_budget_set_stall(VipsBudget *budget, gint64 stall)
+{
+	budget->stall = VIPS_MAX(0, stall);
+}
+
+/**
+ * vips_budget_get_mem: (skip)
+ * @budget: budget to read
+ *
+ * Returns: the number of bytes currently charged to @budget.
+ */
+size_t
+vips_budget_get_mem(VipsBudget *budget)
+{
+	return (size_t) g_atomic_pointer_get(&budget->mem);
+}
+
+/**
+ * vips_budget_get_mem_highwater: (skip)
+ * @budget: budget to read
+ *
+ * Returns: the largest number of bytes simultaneously charged to @budget.
+ */
+size_t
+vips_budget_get_mem_highwater(VipsBudget *budget)
+{
+	return (size_t) g_atomic_pointer_get(&budget->mem_highwater);
+}
+
+/**
+ * vips_budget_set_current: (skip)
+ * @budget: (nullable): budget to charge allocations on this thread to
+ *
+ * Set the budget that tracked allocations made by this thread are charged
+ * to. Images made while a budget is current have the budget attached, so
+ * the workers which later compute them are charged as well.
+ *
+ * This does not take a reference: keep @budget alive while it is current.
+ *
+ * Returns: (transfer none) (nullable): the previous current budget.
+ */
+VipsBudget *
+vips_budget_set_current(VipsBudget *budget)
+{
+	VipsBudget *previous = g_private_get(&vips_budget_current_key);
+
+	g_private_set(&vips_budget_current_key, budget);
+
+	return previous;
+}
+
+/**
+ * vips_budget_get_current: (skip)
+ *
+ * Returns: (transfer none) (nullable): the budget allocations on this
+ * thread are charged to.
+ */
+VipsBudget *
+vips_budget_get_current(void)
+{
+	return g_private_get(&vips_budget_current_key);
+}
+
+/* The bytes left in the current budget, or 0 for no current budget.
+ */
+size_t
+vips__budget_get_free(void)
+{
+	VipsBudget *budget;
+	size_t mem;
+
+	if (!(budget = vips_budget_get_current()))
+		return 0;
+
+	mem = vips_budget_get_mem(budget);
+
+	return mem < budget->max_mem ? budget->max_mem - mem : 1;
+}
+
+static void
+vips_budget_release(VipsBudget *budget, size_t size)
+{
+	g_atomic_pointer_add(&budget->mem, -(gssize) size);
+
+	if (g_atomic_int_get(&budget->n_waiting) > 0) {
+		g_mutex_lock(&budget->lock);
+		g_cond_broadcast(&budget->cond);
+		g_mutex_unlock(&budget->lock);
+	}
+}
+
+/* Charge @size bytes to the current budget. On success, return a new ref to
+ * the budget (or NULL if there's no budget), to be released on free.
+ */
+static int
+vips_budget_charge(size_t size, VipsBudget **out)
+{
+	VipsBudget *budget;
+	gint64 end_time;
+	gboolean timeout;
+	gsize mem;
+	gsize highwater;
+
+	*out = NULL;
+	if (!(budget = vips_budget_get_current()))
+		return 0;
+
+	end_time = 0;
+	for (;;) {
+		mem = (gsize) g_atomic_pointer_add(&budget->mem, size) + size;
+		if (mem <= budget->max_mem)
+			break;
+		vips_budget_release(budget, size);
+
+		if (budget->stall <= 0) {
+			vips_error("vips_tracked",
+				_("memory budget of %zd bytes exceeded"),
+				budget->max_mem);
+			return -1;
+		}
+
+		if (!end_time)
+			end_time = g_get_monotonic_time() + budget->stall;
+
+		g_atomic_int_inc(&budget->n_waiting);
+		g_mutex_lock(&budget->lock);
+		timeout = vips_budget_get_mem(budget) + size > budget->max_mem &&
+			!g_cond_wait_until(&budget->cond, &budget->lock, end_time);
+		g_mutex_unlock(&budget->lock);
+		g_atomic_int_dec_and_test(&budget->n_waiting);
+
+		if (timeout) {
+			vips_error("vips_tracked",
+				_("timeout waiting for memory budget of %zd bytes"),
+				budget->max_mem);
+			return -1;
+		}
+	}
+
+	highwater = (gsize) g_atomic_pointer_get(&budget->mem_highwater);
+	while (mem > highwater &&
+		!g_atomic_pointer_compare_and_exchange(
+			&budget->mem_highwater, highwater, mem))
+		highwater = (gsize) g_atomic_pointer_get(&budget->mem_highwater);
+
+	*out = vips_budget_ref(budget);
+
+	return 0;
+}
+
+/* Release a charge made by vips_budget_charge().
+ */
+static void
+vips_budget_uncharge(VipsBudget *budget, size_t size)
+{
+	if (budget) {
+		vips_budget_release(budget, size);
+		vips_budget_unref(budget);
+	}
+}
+
+/* Count an allocation of @size bytes.
+ */
+static void
+vips_tracked_add(size_t size)
+{
+	gsize mem;
+	gsize highwater;
+
+	mem = (gsize) g_atomic_pointer_add(&vips_tracked_mem, size) + size;
+	g_atomic_int_inc(&vips_tracked_allocs);
+
+	/* Another thread can push the highwater mark up between our read and
+	 * our update, so loop until we see a mark at least as high as our
+	 * total.
+	 */
+	highwater = (gsize) g_atomic_pointer_get(&vips_tracked_mem_highwater);
+	while (mem > highwater &&
+		!g_atomic_pointer_compare_and_exchange(
+			&vips_tracked_mem_highwater, highwater, mem))
+		highwater = (gsize) g_atomic_pointer_get(&vips_tracked_mem_highwater);
+}
+
+/* Count a free of @size bytes.
+ */
+static void
+vips_tracked_sub(size_t size)
+{
+	gsize mem;
+
+	mem = (gsize) g_atomic_pointer_add(&vips_tracked_mem, -(gssize) size);
+	if (g_atomic_int_add(&vips_tracked_allocs, -1) <= 0)
+		g_warning("vips_free: too many frees");
+	if (mem < size)
+		g_warning("vips_free: too much free");
+}
+
 /**
  * vips_tracked_free:
  * @s: (transfer full): memory to free
@@ -214,27 +519,19 @@ vips_strdup(VipsObject *object, const char *str)
 void
 vips_tracked_free(void *s)
 {
-	/* Keep the size of the alloc in the previous 16 bytes. Ensures
-	 * alignment rules are kept.
+	/* Keep the size of the alloc and the budget it was charged to in the
+	 * previous 16 bytes. Ensures alignment rules are kept.
 	 */
 	void *start = (void *) ((char *) s - 16);
-	size_t size = *((size_t *) start);
-
-	g_mutex_lock(&vips_tracked_mutex);
+	size_t size = ((size_t *) start)[0];
+	VipsBudget *budget = ((VipsBudget **) start)[1];
 
 #ifdef DEBUG_VERBOSE_MEM
 	printf("vips_tracked_free: %p, %zd bytes\n", s, size);
 #endif /*DEBUG_VERBOSE_MEM*/
 
-	if (vips_tracked_allocs <= 0)
-		g_warning("vips_free: too many frees");
-	if (vips_tracked_mem < size)
-		g_warning("vips_free: too much free");
-
-	vips_tracked_mem -= size;
-	vips_tracked_allocs -= 1;
-
-	g_mutex_unlock(&vips_tracked_mutex);
+	vips_tracked_sub(size);
+	vips_budget_uncharge(budget, size);
 
 	g_free(start);
 
@@ -255,24 +552,16 @@ vips_tracked_free(void *s)
 void
 vips_tracked_aligned_free(void *s)
 {
-	void *start = (size_t *) s - 1;
-	size_t size = *((size_t *) start);
-
-	g_mutex_lock(&vips_tracked_mutex);
+	void *start = (size_t *) s - 2;
+	size_t size = ((size_t *) start)[0];
+	VipsBudget *budget = ((VipsBudget **) start)[1];
 
 #ifdef DEBUG_VERBOSE
 	printf("vips_tracked_aligned_free: %p, %zd bytes\n", s, size);
 #endif /*DEBUG_VERBOSE*/
 
-	if (vips_tracked_allocs <= 0)
-		g_warning("vips_free: too many frees");
-	if (vips_tracked_mem < size)
-		g_warning("vips_free: too much free");
-
-	vips_tracked_mem -= size;
-	vips_tracked_allocs -= 1;
-
-	g_mutex_unlock(&vips_tracked_mutex);
+	vips_tracked_sub(size);
+	vips_budget_uncharge(budget, size);
 
 #ifdef HAVE__ALIGNED_MALLOC
 	_aligned_free(start);
@@ -303,15 +592,20 @@ vips_tracked_aligned_free(void *s)
 void *
 vips_tracked_malloc(size_t size)
 {
+	VipsBudget *budget;
 	void *buf;
 
-	/* Need an extra sizeof(size_t) bytes to track
-	 * size of this block. Ask for an extra 16 to make sure we don't break
-	 * alignment rules.
+	/* Need an extra sizeof(size_t) bytes to track size of this block,
+	 * plus a pointer for the budget. Ask for an extra 16 to make sure we
+	 * don't break alignment rules.
 	 */
 	size += 16;
 
+	if (vips_budget_charge(size, &budget))
+		return NULL;
+
 	if (!(buf = g_try_malloc0(size))) {
+		vips_budget_uncharge(budget, size);
 #ifdef DEBUG
 		g_assert_not_reached();
 #endif /*DEBUG*/
@@ -325,23 +619,19 @@ vips_tracked_malloc(size_t size)
 		return NULL;
 	}
 
-	g_mutex_lock(&vips_tracked_mutex);
-
-	*((size_t *) buf) = size;
+	((size_t *) buf)[0] = size;
+	((VipsBudget **) buf)[1] = budget;
 	buf = (void *) ((char *) buf + 16);
 
-	vips_tracked_mem += size;
-	if (vips_tracked_mem > vips_tracked_mem_highwater)
-		vips_tracked_mem_highwater = vips_tracked_mem;
-	vips_tracked_allocs += 1;
+	vips_tracked_add(size);
 
 #ifdef DEBUG_VERBOSE_MEM
 	printf("vips_tracked_malloc: %p, %zd bytes\n", buf, size);
 #endif /*DEBUG_VERBOSE_MEM*/
 
-	g_mutex_unlock(&vips_tracked_mutex);
-
 	VIPS_GATE_MALLOC(size);
+	if (vips__metrics)
+		vips__metrics_malloc(size);
 
 	return buf;
 }
@@ -368,14 +658,18 @@ vips_tracked_malloc(size_t size)
 void *
 vips_tracked_aligned_alloc(size_t size, size_t align)
 {
+	VipsBudget *budget;
 	void *buf;
 
 	g_assert(!(align & (align - 1)));
 
-	/* Need an extra sizeof(size_t) bytes to track
-	 * size of this block.
+	/* Need an extra two words to track the size of this block and the
+	 * budget it is charged to.
 	 */
-	size += sizeof(size_t);
+	size += 2 * sizeof(size_t);
+
+	if (vips_budget_charge(size, &budget))
+		return NULL;
 
 #ifdef HAVE__ALIGNED_MALLOC
 	if (!(buf = _aligned_malloc(size, align))) {
@@ -390,6 +684,7 @@ vips_tracked_aligned_alloc(size_t size, size_t align)
 		g_assert_not_reached();
 #endif /*DEBUG*/
 
+		vips_budget_uncharge(budget, size);
 		vips_error("vips_tracked",
 			_("out of memory -- size == %dMB"),
 			(int) (size / (1024.0 * 1024.0)));
@@ -401,24 +696,20 @@ vips_tracked_aligned_alloc(size_t size, size_t align)
 
 	memset(buf, 0, size);
 
-	g_mutex_lock(&vips_tracked_mutex);
-
-	*((size_t *) buf) = size;
+	((size_t *) buf)[0] = size;
+	((VipsBudget **) buf)[1] = budget;
 
-	vips_tracked_mem += size;
-	if (vips_tracked_mem > vips_tracked_mem_highwater)
-		vips_tracked_mem_highwater = vips_tracked_mem;
-	vips_tracked_allocs += 1;
+	vips_tracked_add(size);
 
 #ifdef DEBUG_VERBOSE
 	printf("vips_tracked_aligned_alloc: %p, %zd bytes\n", buf, size);
 #endif /*DEBUG_VERBOSE*/
 
-	g_mutex_unlock(&vips_tracked_mutex);
-
 	VIPS_GATE_MALLOC(size);
+	if (vips__metrics)
+		vips__metrics_malloc(size);
 
-	return (void *) ((size_t *) buf + 1);
+	return (void *) ((size_t *) buf + 2);
 }
 
 /**
@@ -449,16 +740,12 @@ vips_tracked_open(const char *pathname, int flags, int mode)
 	if ((fd = vips__open(pathname, flags, mode)) == -1)
 		return -1;
 
-	g_mutex_lock(&vips_tracked_mutex);
-
-	vips_tracked_files += 1;
+	g_atomic_int_inc(&vips_tracked_files);
 #ifdef DEBUG_VERBOSE_FD
 	printf("vips_tracked_open: %s = %d (%d)\n",
-		pathname, fd, vips_tracked_files);
+		pathname, fd, g_atomic_int_get(&vips_tracked_files));
 #endif /*DEBUG_VERBOSE_FD*/
 
-	g_mutex_unlock(&vips_tracked_mutex);
-
 	return fd;
 }
 
@@ -483,21 +770,18 @@ vips_tracked_close(int fd)
 {
 	int result;
 
-	g_mutex_lock(&vips_tracked_mutex);
-
 	/* libvips uses fd -1 to mean invalid descriptor.
 	 */
 	g_assert(fd != -1);
-	g_assert(vips_tracked_files > 0);
+	g_assert(g_atomic_int_get(&vips_tracked_files) > 0);
 
-	vips_tracked_files -= 1;
+	g_atomic_int_add(&vips_tracked_files, -1);
 #ifdef DEBUG_VERBOSE_FD
-	printf("vips_tracked_close: %d (%d)\n", fd, vips_tracked_files);
+	printf("vips_tracked_close: %d (%d)\n",
+		fd, g_atomic_int_get(&vips_tracked_files));
 	printf("   from thread %p\n", g_thread_self());
 #endif /*DEBUG_VERBOSE_FD*/
 
-	g_mutex_unlock(&vips_tracked_mutex);
-
 	result = close(fd);
 
 	return result;
@@ -515,15 +799,7 @@ vips_tracked_close(int fd)
 size_t
 vips_tracked_get_mem(void)
 {
-	size_t mem;
-
-	g_mutex_lock(&vips_tracked_mutex);
-
-	mem = vips_tracked_mem;
-
-	g_mutex_unlock(&vips_tracked_mutex);
-
-	return mem;
+	return (size_t) g_atomic_pointer_get(&vips_tracked_mem);
 }
 
 /**
@@ -538,15 +814,7 @@ vips_tracked_get_mem(void)
 size_t
 vips_tracked_get_mem_highwater(void)
 {
-	size_t mx;
-
-	g_mutex_lock(&vips_tracked_mutex);
-
-	mx = vips_tracked_mem_highwater;
-
-	g_mutex_unlock(&vips_tracked_mutex);
-
-	return mx;
+	return (size_t) g_atomic_pointer_get(&vips_tracked_mem_highwater);
 }
 
 /**
@@ -559,15 +827,7 @@ vips_tracked_get_mem_highwater(void)
 int
 vips_tracked_get_allocs(void)
 {
-	int n;
-
-	g_mutex_lock(&vips_tracked_mutex);
-
-	n = vips_tracked_allocs;
-
-	g_mutex_unlock(&vips_tracked_mutex);
-
-	return n;
+	return g_atomic_int_get(&vips_tracked_allocs);
 }
 
 /**
@@ -580,13 +840,5 @@ vips_tracked_get_allocs(void)
 int
 vips_tracked_get_files(void)
 {
-	int n;
-
-	g_mutex_lock(&vips_tracked_mutex);
-
-	n = vips_tracked_files;
-
-	g_mutex_unlock(&vips_tracked_mutex);
-
-	return n;
+	return g_atomic_int_get(&vips_tracked_files);
 }
@@ -0,0 +1,444 @@
+/* pipeline metrics
+ *
+ * 14/10/26
+ * 	- from gate.c
+ * 	- add vips_image_explain()
+ * 15/10/26
+ * 	- 64-bit counters under a lock, so they don't wrap on 32-bit
+ */
+
+/*
+
+	This file is part of VIPS.
+
+	VIPS is free software; you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+	02110-1301  USA
+
+ */
+
+/*
+
+	These files are distributed with VIPS - http://www.vips.ecs.soton.ac.uk
+
+ */
+
+/*
+#define VIPS_DEBUG
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /*HAVE_CONFIG_H*/
+#include <glib/gi18n-lib.h>
+
+#include <math.h>
+
+#include <vips/vips.h>
+#include <vips/internal.h>
+#include <vips/debug.h>
+
+/* The live counters for an operation. These are updated from many threads.
+ * GLib only has pointer-sized atomic adds, which would wrap on 32-bit
+ * machines, so each counter has a lock instead.
+ *
+ * Counters are never freed until shutdown, since images hold pointers to
+ * them.
+ */
+typedef struct _VipsMetricsCounter {
+	const char *nickname;
+
+	GMutex lock;
+
+	guint64 tiles;
+	guint64 pixels;
+	guint64 generate_time;
+	guint64 bytes;
+	guint64 buffers_reused;
+	guint64 buffers_new;
+} VipsMetricsCounter;
+
+gboolean vips__metrics = FALSE;
+
+/* Nickname -> VipsMetricsCounter.
+ */
+static GHashTable *vips_metrics_table = NULL;
+static GMutex vips_metrics_lock;
+
+/* Protects the generate_pixels and generate_time counters on images.
+ */
+static GMutex vips_metrics_image_lock;
+
+/* The counter for the tile this thread is currently generating, so we can
+ * charge mallocs to it.
+ */
+static GPrivate vips_metrics_current_key;
+
+/* The child time total of the tile this thread is currently generating.
+ */
+static GPrivate vips_metrics_children_key;
+
+/**
+ * vips_metrics_set:
+ * @metrics: `TRUE` to enable metrics collection
+ *
+ * If set, vips will count tiles, pixels, generate time, tracked memory and
+ * pixel buffer reuse for each operation. Counters are cheap to update, so
+ * this can be left on in production. Read them with [func@metrics_map].
+ *
+ * Only operations built after metrics are enabled are counted.
+ *
+ * You can set the environment variable `VIPS_METRICS` to turn this option
+ * on.
+ *
+ * ::: seealso
+ *     [func@metrics_map], [func@metrics_reset].
+ */
+void
+vips_metrics_set(gboolean metrics)
+{
+	vips__metrics = metrics;
+}
+
+/**
+ * vips_metrics_get:
+ *
+ * Returns: `TRUE` if metrics collection is enabled.
+ */
+gboolean
+vips_metrics_get(void)
+{
+	return vips__metrics;
+}
+
+static void
+vips_metrics_counter_free(VipsMetricsCounter *counter)
+{
+	g_mutex_clear(&counter->lock);
+	g_free(counter);
+}
+
+/* Find or make the counter for an operation.
+ */
+void *
+vips__metrics_counter(const char *nickname)
+{
+	VipsMetricsCounter *counter;
+
+	g_mutex_lock(&vips_metrics_lock);
+
+	if (!vips_metrics_table)
+		vips_metrics_table = g_hash_table_new_full(g_str_hash, g_str_equal,
+			NULL, (GDestroyNotify) vips_metrics_counter_free);
+
+	if (!(counter = g_hash_table_lookup(vips_metrics_table, nickname))) {
+		counter = g_new0(VipsMetricsCounter, 1);
+		counter->nickname = nickname;
+		g_mutex_init(&counter->lock);
+		g_hash_table_insert(vips_metrics_table, (char *) nickname, counter);
+	}
+
+	g_mutex_unlock(&vips_metrics_lock);
+
+	return counter;
+}
+
+/* Start generating a tile of an image. The previous state is saved in
+ * @tile, to be restored by vips__metrics_tile_stop().
+ */
+void
+vips__metrics_tile_start(VipsImage *image, VipsMetricsTile *tile)
+{
+	tile->previous = g_private_get(&vips_metrics_current_key);
+	tile->parent = g_private_get(&vips_metrics_children_key);
+	tile->children = 0;
+
+	g_private_set(&vips_metrics_current_key,
+		g_object_get_data(G_OBJECT(image), "libvips-metrics"));
+	g_private_set(&vips_metrics_children_key, &tile->children);
+}
+
+void
+vips__metrics_tile_stop(VipsImage *image, VipsMetricsTile *tile,
+	const VipsRect *rect, gint64 start)
+{
+	VipsMetricsCounter *counter = g_private_get(&vips_metrics_current_key);
+	gint64 elapsed = g_get_monotonic_time() - start;
+	guint64 pixels = (guint64) rect->width * rect->height;
+
+	if (counter) {
+		g_mutex_lock(&counter->lock);
+		counter->tiles += 1;
+		counter->pixels += pixels;
+		counter->generate_time += elapsed;
+		g_mutex_unlock(&counter->lock);
+	}
+
+	/* Per image, count only our own time, and charge the whole tile to
+	 * whoever asked for it.
+	 */
+	g_mutex_lock(&vips_metrics_image_lock);
+	image->generate_pixels += pixels;
+	image->generate_time += VIPS_MAX(0, elapsed - tile->children);
+	g_mutex_unlock(&vips_metrics_image_lock);
+	if (tile->parent)
+		*tile->parent += elapsed;
+
+	g_private_set(&vips_metrics_current_key, tile->previous);
+	g_private_set(&vips_metrics_children_key, tile->parent);
+}
+
+/* Charge a tracked allocation to the tile being generated, if any.
+ */
+void
+vips__metrics_malloc(size_t size)
+{
+	VipsMetricsCounter *counter = g_private_get(&vips_metrics_current_key);
+
+	if (counter) {
+		g_mutex_lock(&counter->lock);
+		counter->bytes += size;
+		g_mutex_unlock(&counter->lock);
+	}
+}
+
+/* A pixel buffer has been made for an image, either fresh or from a reserve.
+ */
+void
+vips__metrics_buffer(VipsImage *image, gboolean reused)
+{
+	VipsMetricsCounter *counter =
+		g_object_get_data(G_OBJECT(image), "libvips-metrics");
+
+	if (counter) {
+		g_mutex_lock(&counter->lock);
+		if (reused)
+			counter->buffers_reused += 1;
+		else
+			counter->buffers_new += 1;
+		g_mutex_unlock(&counter->lock);
+	}
+}
+
+static void
+vips_metrics_snapshot_cb(gpointer key, gpointer value, gpointer data)
+{
+	VipsMetricsCounter *counter = (VipsMetricsCounter *) value;
+	GArray *snapshot = (GArray *) data;
+
+	VipsMetrics metrics;
+
+	metrics.nickname = counter->nickname;
+	g_mutex_lock(&counter->lock);
+	metrics.tiles = counter->tiles;
+	metrics.pixels = counter->pixels;
+	metrics.generate_time = counter->generate_time;
+	metrics.bytes = counter->bytes;
+	metrics.buffers_reused = counter->buffers_reused;
+	metrics.buffers_new = counter->buffers_new;
+	g_mutex_unlock(&counter->lock);
+
+	g_array_append_val(snapshot, metrics);
+}
+
+/**
+ * vips_metrics_map:
+ * @fn: (scope call): function to call for each operation
+ * @a: user data
+ * @b: user data
+ *
+ * Call @fn with a snapshot of the counters for every operation that has
+ * generated pixels since metrics were enabled. The counters keep running
+ * while you read them, so the snapshot is only approximately consistent.
+ *
+ * @fn is called without any locks held. If @fn returns non-%NULL, the map
+ * stops and returns that value.
+ *
+ * ::: seealso
+ *     [func@metrics_set].
+ *
+ * Returns: the value returned by @fn, or %NULL
+ */
+void *
+vips_metrics_map(VipsMetricsMapFn fn, void *a, void *b)
+{
+	GArray *snapshot;
+	void *result;
+	guint i;
+
+	snapshot = g_array_new(FALSE, FALSE, sizeof(VipsMetrics));
+
+	g_mutex_lock(&vips_metrics_lock);
+	if (vips_metrics_table)
+		g_hash_table_foreach(vips_metrics_table,
+			vips_metrics_snapshot_cb, snapshot);
+	g_mutex_unlock(&vips_metrics_lock);
+
+	result = NULL;
+	for (i = 0; i < snapshot->len; i++)
+		if ((result = fn(&g_array_index(snapshot, VipsMetrics, i), a, b)))
+			break;
+
+	g_array_free(snapshot, TRUE);
+
+	return result;
+}
+
+static void
+vips_metrics_reset_cb(gpointer key, gpointer value, gpointer data)
+{
+	VipsMetricsCounter *counter = (VipsMetricsCounter *) value;
+
+	g_mutex_lock(&counter->lock);
+	counter->tiles = 0;
+	counter->pixels = 0;
+	counter->generate_time = 0;
+	counter->bytes = 0;
+	counter->buffers_reused = 0;
+	counter->buffers_new = 0;
+	g_mutex_unlock(&counter->lock);
+}
+
+/**
+ * vips_metrics_reset:
+ *
+ * Set all metrics counters back to zero. Handy for measuring a single
+ * request.
+ */
+void
+vips_metrics_reset(void)
+{
+	g_mutex_lock(&vips_metrics_lock);
+	if (vips_metrics_table)
+		g_hash_table_foreach(vips_metrics_table,
+			vips_metrics_reset_cb, NULL);
+	g_mutex_unlock(&vips_metrics_lock);
+}
+
+typedef struct _VipsExplain {
+	VipsImage *out;
+	GString *str;
+	int out_margin;
+	int tile_width;
+	int tile_height;
+	int n;
+} VipsExplain;
+
+static void *
+vips_explain_node(VipsImage *image, VipsExplain *explain, void *b)
+{
+	char txt[1024];
+	VipsBuf buf = VIPS_BUF_STATIC(txt);
+	const char *name;
+	double window;
+	double estimate;
+	guint64 out_pixels;
+	guint64 pixels;
+	guint64 generate_time;
+
+	if (!(name = g_object_get_data(G_OBJECT(image),
+			  "libvips-profile-name")))
+		name = image->filename ? "source" : "image";
+
+	/* Each output tile reads a larger area from here, by the windows of
+	 * all the operations in between.
+	 */
+	window = sqrt(VIPS_MAX(0,
+		explain->out_margin - vips__reorder_margin(image)));
+	estimate = ((double) image->Xsize * image->Ysize) /
+		((double) explain->out->Xsize * explain->out->Ysize) *
+		(explain->tile_width + window) *
+		(explain->tile_height + window) /
+		((double) explain->tile_width * explain->tile_height);
+
+	vips_buf_appendf(&buf, "%3d %-16s %5d x %-5d %-10s %-9s "
+						  "margin %-5d est %6.2f",
+		explain->n++,
+		name,
+		image->Xsize, image->Ysize,
+		vips_enum_nick(VIPS_TYPE_BAND_FORMAT, image->BandFmt),
+		vips_enum_nick(VIPS_TYPE_DEMAND_STYLE, image->dhint),
+		vips__reorder_margin(image),
+		estimate);
+
+	if (g_object_get_data(G_OBJECT(image), "libvips-cache-hit"))
+		vips_buf_appends(&buf, " cache hit");
+	else if (g_object_get_data(G_OBJECT(image), "libvips-cache-entry"))
+		vips_buf_appends(&buf, " cached");
+
+	g_mutex_lock(&vips_metrics_image_lock);
+	out_pixels = explain->out->generate_pixels;
+	pixels = image->generate_pixels;
+	generate_time = image->generate_time;
+	g_mutex_unlock(&vips_metrics_image_lock);
+	if (out_pixels > 0)
+		vips_buf_appendf(&buf, " actual %6.2f time %.3f ms",
+			(double) pixels / out_pixels,
+			generate_time / 1000.0);
+
+	g_string_append_printf(explain->str, "%s\n", vips_buf_all(&buf));
+
+	return NULL;
+}
+
+/**
+ * vips_image_explain: (method)
+ * @image: output image to describe
+ *
+ * Describe the pipeline that computes @image, one line per node, sources
+ * first and @image last. Each line shows:
+ *
+ * - the operation which made the node
+ * - its size, format and demand style
+ * - the cumulative reorder margin, see [method@Image.reorder_margin_hint]
+ * - the estimated number of pixels computed here for each pixel of @image,
+ *   allowing for the overlaps between the tiles the pipeline will use
+ * - whether the node came from, or is in, the operation cache
+ *
+ * If [func@metrics_set] was on while @image was computed, each line also
+ * gives the measured pixels per output pixel, and the time spent
+ * generating the node, not counting upstream. Sum the times over a couple
+ * of lines to find the slow stage of a long pipeline.
+ *
+ * `vips --explain` prints this for the outputs of an operation.
+ *
+ * Returns: (transfer full): a newly allocated description, free with
+ * [func@GLib.free].
+ */
+char *
+vips_image_explain(VipsImage *image)
+{
+	VipsExplain explain;
+	int n_lines;
+
+	explain.out = image;
+	explain.str = g_string_new(NULL);
+	explain.out_margin = vips__reorder_margin(image);
+	vips_get_tile_size(image,
+		&explain.tile_width, &explain.tile_height, &n_lines);
+	explain.n = 0;
+
+	(void) vips__link_map(image, TRUE,
+		(VipsSListMap2Fn) vips_explain_node, &explain, NULL);
+
+	return g_string_free(explain.str, FALSE);
+}
+
+void
+vips__metrics_shutdown(void)
+{
+	g_mutex_lock(&vips_metrics_lock);
+	VIPS_FREEF(g_hash_table_destroy, vips_metrics_table);
+	g_mutex_unlock(&vips_metrics_lock);
+}
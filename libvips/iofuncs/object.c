@@ -4,6 +4,8 @@
  *
  * 29/5/18
  * 	- added vips_argument_get_id()
+ * 15/10/26
+ * 	- add a per-class argument index, and vips_object_set_nth()
  */
 
 /*
@@ -753,6 +755,284 @@ vips__argument_get_instance(VipsArgumentClass *argument_class,
 			((VipsArgument *) argument_class)->pspec);
 }
 
+/* A compiled name to argument table for a class. Slots are the class
+ * arguments in traverse order, and a seeded hash with no collisions maps
+ * names to slots, so a lookup is a hash and a single compare.
+ */
+typedef struct _VipsArgumentIndex {
+	/* The class we were built for.
+	 */
+	GType gtype;
+
+	int n;
+	VipsArgumentClass **slots;
+
+	guint seed;
+	guint mask;
+	int *table;
+} VipsArgumentIndex;
+
+/* FNV-1a. GObject treats '-' and '_' in property names as the same, so
+ * we must too.
+ */
+static guint
+vips_argument_index_hash(const char *name, guint seed)
+{
+	guint hash = 2166136261U ^ seed;
+	const char *p;
+
+	for (p = name; *p; p++)
+		hash = (hash ^ (*p == '_' ? '-' : (guchar) *p)) * 16777619U;
+
+	return hash;
+}
+
+static gboolean
+vips_argument_index_equal(const char *name1, const char *name2)
+{
+	for (; *name1 && *name2; name1++, name2++)
+		if (*name1 != *name2 &&
+			(*name1 == '_' ? '-' : *name1) !=
+				(*name2 == '_' ? '-' : *name2))
+			return FALSE;
+
+	return *name1 == *name2;
+}
+
+static gboolean
+vips_argument_index_fill(VipsArgumentIndex *index)
+{
+	int i;
+
+	for (i = 0; i <= index->mask; i++)
+		index->table[i] = -1;
+
+	for (i = 0; i < index->n; i++) {
+		GParamSpec *pspec = ((VipsArgument *) index->slots[i])->pspec;
+		const char *name = g_param_spec_get_name(pspec);
+		guint h = vips_argument_index_hash(name, index->seed) & index->mask;
+
+		if (index->table[h] >= 0)
+			return FALSE;
+		index->table[h] = i;
+	}
+
+	return TRUE;
+}
+
+static VipsArgumentIndex *
+vips_argument_index_new(VipsObjectClass *object_class)
+{
+	VipsArgumentIndex *index = g_new0(VipsArgumentIndex, 1);
+
+	guint size;
+	GSList *p;
+	int i;
+
+	index->gtype = G_TYPE_FROM_CLASS(object_class);
+	index->n = g_slist_length(object_class->argument_table_traverse);
+	index->slots = g_new(VipsArgumentClass *, index->n);
+	for (i = 0, p = object_class->argument_table_traverse; p; p = p->next)
+		index->slots[i++] = (VipsArgumentClass *) p->data;
+
+	/* Try a few seeds at each size before growing the table. Classes
+	 * have tens of arguments, so this is quick.
+	 */
+	for (size = 4; size < 2 * index->n; size *= 2)
+		;
+	for (;;) {
+		index->mask = size - 1;
+		index->table = g_new(int, size);
+
+		for (index->seed = 0; index->seed < 32; index->seed++)
+			if (vips_argument_index_fill(index))
+				return index;
+
+		g_free(index->table);
+		size *= 2;
+	}
+}
+
+/* Get the index for a class, building it if necessary. Arguments are all
+ * installed by class init, so it never needs updating.
+ */
+static VipsArgumentIndex *
+vips_object_class_get_index(VipsObjectClass *object_class)
+{
+	VipsArgumentIndex *index;
+
+	index = g_atomic_pointer_get(&object_class->argument_index);
+	if (!index ||
+		index->gtype != G_TYPE_FROM_CLASS(object_class)) {
+		g_mutex_lock(&vips__global_lock);
+
+		index = object_class->argument_index;
+		if (!index ||
+			index->gtype != G_TYPE_FROM_CLASS(object_class)) {
+			index = vips_argument_index_new(object_class);
+			g_atomic_pointer_set(&object_class->argument_index, index);
+		}
+
+		g_mutex_unlock(&vips__global_lock);
+	}
+
+	return index;
+}
+
+static int
+vips_argument_index_find(VipsArgumentIndex *index, const char *name)
+{
+	guint h = vips_argument_index_hash(name, index->seed) & index->mask;
+	int i = index->table[h];
+
+	if (i >= 0 &&
+		vips_argument_index_equal(name,
+			((VipsArgument *) index->slots[i])->pspec->name))
+		return i;
+
+	return -1;
+}
+
+/* Find the VipsArgumentClass for a pspec without a trip through the global
+ * lock.
+ */
+static VipsArgumentClass *
+vips_object_class_lookup(VipsObjectClass *object_class, GParamSpec *pspec)
+{
+	VipsArgumentIndex *index = vips_object_class_get_index(object_class);
+	const char *name = g_param_spec_get_name(pspec);
+	guint h = vips_argument_index_hash(name, index->seed) & index->mask;
+	int i = index->table[h];
+
+	if (i >= 0 &&
+		((VipsArgument *) index->slots[i])->pspec == pspec)
+		return index->slots[i];
+
+	return (VipsArgumentClass *)
+		vips__argument_table_lookup(object_class->argument_table, pspec);
+}
+
+/**
+ * vips_object_class_find_argument:
+ * @object_class: class to search
+ * @name: argument name
+ *
+ * Look up an argument by name and return its position in the class, ready
+ * for [method@Object.set_nth]. Bindings can find the position of each
+ * argument once and skip the name lookup on every call.
+ *
+ * ::: seealso
+ *     [method@Object.set_nth].
+ *
+ * Returns: the argument position, or -1 on error.
+ */
+int
+vips_object_class_find_argument(VipsObjectClass *object_class,
+	const char *name)
+{
+	int i;
+
+	if ((i = vips_argument_index_find(
+			 vips_object_class_get_index(object_class), name)) < 0) {
+		vips_error(object_class->nickname,
+			_("no vips argument named `%s'"), name);
+		return -1;
+	}
+
+	return i;
+}
+
+/**
+ * vips_object_class_nth_argument: (skip)
+ * @object_class: class to search
+ * @n: argument position
+ *
+ * Get the [struct@ArgumentClass] at a position found with
+ * [func@Object.class_find_argument]. Positions follow argument priority.
+ *
+ * Returns: (transfer none): the argument, or `NULL` if @n is out of range.
+ */
+VipsArgumentClass *
+vips_object_class_nth_argument(VipsObjectClass *object_class, int n)
+{
+	VipsArgumentIndex *index = vips_object_class_get_index(object_class);
+
+	if (n < 0 ||
+		n >= index->n)
+		return NULL;
+
+	return index->slots[n];
+}
+
+/* g_object_set_property(), but with the pspec already found. We make the
+ * checks GObject would and go straight to the class that owns the property.
+ */
+int
+vips__object_set_pspec(VipsObject *object, GParamSpec *pspec,
+	const GValue *value)
+{
+	GType type = G_PARAM_SPEC_VALUE_TYPE(pspec);
+
+	GObjectClass *owner_class;
+	GValue tmp = G_VALUE_INIT;
+
+	/* Leave transforms, eg. int to double, to GObject.
+	 */
+	if (!g_value_type_compatible(G_VALUE_TYPE(value), type)) {
+		g_object_set_property(G_OBJECT(object),
+			g_param_spec_get_name(pspec), value);
+		return 0;
+	}
+
+	g_value_init(&tmp, type);
+	g_value_copy(value, &tmp);
+
+	if (g_param_value_validate(pspec, &tmp)) {
+		vips_error(VIPS_OBJECT_GET_CLASS(object)->nickname,
+			_("value for argument `%s' is invalid or out of range"),
+			g_param_spec_get_name(pspec));
+		g_value_unset(&tmp);
+		return -1;
+	}
+
+	owner_class = G_OBJECT_CLASS(g_type_class_peek(pspec->owner_type));
+	owner_class->set_property(G_OBJECT(object),
+		pspec->param_id, &tmp, pspec);
+
+	g_value_unset(&tmp);
+
+	return 0;
+}
+
+/**
+ * vips_object_set_nth:
+ * @object: object to set
+ * @n: argument position
+ * @value: value to set
+ *
+ * Set an argument by position. Find the position with
+ * [func@Object.class_find_argument].
+ *
+ * ::: seealso
+ *     [func@Object.class_find_argument].
+ *
+ * Returns: 0 on success, or -1 on error.
+ */
+int
+vips_object_set_nth(VipsObject *object, int n, const GValue *value)
+{
+	VipsObjectClass *class = VIPS_OBJECT_GET_CLASS(object);
+	VipsArgumentClass *argument_class;
+
+	if (!(argument_class = vips_object_class_nth_argument(class, n))) {
+		vips_error(class->nickname, _("no argument at position %d"), n);
+		return -1;
+	}
+
+	return vips__object_set_pspec(object,
+		((VipsArgument *) argument_class)->pspec, value);
+}
+
 /**
  * vips_object_get_argument: (skip)
  * @object: the object to fetch the args from
@@ -772,15 +1052,25 @@ vips_object_get_argument(VipsObject *object, const char *name,
 	VipsArgumentInstance **argument_instance)
 {
 	VipsObjectClass *class = VIPS_OBJECT_GET_CLASS(object);
+	VipsArgumentIndex *index = vips_object_class_get_index(class);
 
-	if (!(*pspec = g_object_class_find_property(G_OBJECT_CLASS(class), name))) {
-		vips_error(class->nickname, _("no property named `%s'"), name);
-		return -1;
+	int i;
+
+	if ((i = vips_argument_index_find(index, name)) >= 0) {
+		*argument_class = index->slots[i];
+		*pspec = ((VipsArgument *) *argument_class)->pspec;
 	}
+	else {
+		/* Not an argument. Search again for a helpful error.
+		 */
+		if (!(*pspec = g_object_class_find_property(
+				  G_OBJECT_CLASS(class), name)))
+			vips_error(class->nickname,
+				_("no property named `%s'"), name);
+		else
+			vips_error(class->nickname,
+				_("no vips argument named `%s'"), name);
 
-	if (!(*argument_class = (VipsArgumentClass *)
-			vips__argument_table_lookup(class->argument_table, *pspec))) {
-		vips_error(class->nickname, _("no vips argument named `%s'"), name);
 		return -1;
 	}
 
@@ -1083,8 +1373,8 @@ vips__object_set_member(VipsObject *object, GParamSpec *pspec,
 	GObject **member, GObject *argument)
 {
 	VipsObjectClass *class = VIPS_OBJECT_GET_CLASS(object);
-	VipsArgumentClass *argument_class = (VipsArgumentClass *)
-		vips__argument_table_lookup(class->argument_table, pspec);
+	VipsArgumentClass *argument_class =
+		vips_object_class_lookup(class, pspec);
 	VipsArgumentInstance *argument_instance =
 		vips__argument_get_instance(argument_class, object);
 	GType otype = G_PARAM_SPEC_VALUE_TYPE(pspec);
@@ -1177,8 +1467,8 @@ vips_object_set_property(GObject *gobject,
 {
 	VipsObject *object = VIPS_OBJECT(gobject);
 	VipsObjectClass *class = VIPS_OBJECT_GET_CLASS(gobject);
-	VipsArgumentClass *argument_class = (VipsArgumentClass *)
-		vips__argument_table_lookup(class->argument_table, pspec);
+	VipsArgumentClass *argument_class =
+		vips_object_class_lookup(class, pspec);
 	VipsArgumentInstance *argument_instance =
 		vips__argument_get_instance(argument_class, object);
 
@@ -1325,8 +1615,8 @@ vips_object_get_property(GObject *gobject,
 {
 	VipsObject *object = VIPS_OBJECT(gobject);
 	VipsObjectClass *class = VIPS_OBJECT_GET_CLASS(gobject);
-	VipsArgumentClass *argument_class = (VipsArgumentClass *)
-		vips__argument_table_lookup(class->argument_table, pspec);
+	VipsArgumentClass *argument_class =
+		vips_object_class_lookup(class, pspec);
 	VipsArgumentInstance *argument_instance =
 		vips__argument_get_instance(argument_class, object);
 
@@ -2424,7 +2714,10 @@ vips_object_set_valist(VipsObject *object, va_list ap)
 
 		VIPS_ARGUMENT_COLLECT_SET(pspec, argument_class, ap);
 
-		g_object_set_property(G_OBJECT(object), name, &value);
+		if (vips__object_set_pspec(object, pspec, &value)) {
+			g_value_unset(&value);
+			return -1;
+		}
 
 		VIPS_ARGUMENT_COLLECT_GET(pspec, argument_class, ap);
 
@@ -2811,18 +3104,28 @@ vips_type_map(GType base, VipsTypeMap2Fn fn, void *a, void *b)
  * Returns: `NULL` if @fn returns `NULL` for all arguments, otherwise the first
  * non-`NULL` value from @fn.
  */
-void *
-vips_type_map_all(GType base, VipsTypeMapFn fn, void *a)
+static void *
+vips_type_map_all_sub(GType base, VipsTypeMapFn fn, void *a)
 {
 	void *result;
 
 	if (!(result = fn(base, a)))
 		result = vips_type_map(base,
-			(VipsTypeMap2Fn) vips_type_map_all, fn, a);
+			(VipsTypeMap2Fn) vips_type_map_all_sub, fn, a);
 
 	return result;
 }
 
+void *
+vips_type_map_all(GType base, VipsTypeMapFn fn, void *a)
+{
+	/* Make sure we see every class.
+	 */
+	vips__module_load_all();
+
+	return vips_type_map_all_sub(base, fn, a);
+}
+
 /**
  * vips_class_map_all: (skip)
  * @type: base type
@@ -2838,6 +3141,18 @@ vips_type_map_all(GType base, VipsTypeMapFn fn, void *a)
  */
 void *
 vips_class_map_all(GType type, VipsClassMapFn fn, void *a)
+{
+	/* Make sure we see every class.
+	 */
+	vips__module_load_all();
+
+	return vips__class_map_all(type, fn, a);
+}
+
+/* As vips_class_map_all(), but don't open any modules.
+ */
+void *
+vips__class_map_all(GType type, VipsClassMapFn fn, void *a)
 {
 	void *result;
 
@@ -2853,7 +3168,7 @@ vips_class_map_all(GType type, VipsClassMapFn fn, void *a)
 	}
 
 	if ((result = vips_type_map(type,
-			 (VipsTypeMap2Fn) vips_class_map_all, fn, a)))
+			 (VipsTypeMap2Fn) vips__class_map_all, fn, a)))
 		return result;
 
 	return NULL;
@@ -2911,8 +3226,15 @@ vips_class_find(const char *basename, const char *nickname)
 
 	if (!(base = g_type_from_name(classname)))
 		return NULL;
-	class = vips_class_map_all(base,
+
+	/* Search the classes we have, and only open modules if that fails.
+	 */
+	class = vips__class_map_all(base,
 		(VipsClassMapFn) test_name, (void *) nickname);
+	if (!class &&
+		vips__module_load_all())
+		class = vips__class_map_all(base,
+			(VipsClassMapFn) test_name, (void *) nickname);
 
 	return class;
 }
@@ -2961,7 +3283,9 @@ vips_class_build_hash_cb(void *dummy)
 	base = g_type_from_name("VipsObject");
 	g_assert(base);
 
-	vips_class_map_all(base,
+	/* Modules opened later are found by the vips_class_find() fallback.
+	 */
+	vips__class_map_all(base,
 		(VipsClassMapFn) vips_class_add_hash,
 		(void *) vips__object_nickname_table);
 
@@ -2,6 +2,8 @@
  *
  * 30/12/14
  * 	- display default/min/max for pspec in usage
+ * 14/10/26
+ * 	- always name output images, for vips_image_explain()
  */
 
 /*
@@ -584,6 +586,37 @@ vips_operation_vips_operation_print_summary_arg(VipsObject *object,
 	return NULL;
 }
 
+static void *
+vips_operation_name_output(VipsObject *object,
+	GParamSpec *pspec,
+	VipsArgumentClass *argument_class,
+	VipsArgumentInstance *argument_instance,
+	void *a, void *b)
+{
+	if ((argument_class->flags & VIPS_ARGUMENT_OUTPUT) &&
+		argument_instance->assigned &&
+		g_type_is_a(G_PARAM_SPEC_VALUE_TYPE(pspec), VIPS_TYPE_IMAGE)) {
+		VipsImage *image;
+
+		g_object_get(G_OBJECT(object),
+			g_param_spec_get_name(pspec), &image, NULL);
+
+		if (image) {
+			const char *nickname = VIPS_OBJECT_GET_CLASS(object)->nickname;
+
+			g_object_set_data(G_OBJECT(image), "libvips-profile-name",
+				(gpointer) nickname);
+			if (vips__metrics)
+				g_object_set_data(G_OBJECT(image), "libvips-metrics",
+					vips__metrics_counter(nickname));
+
+			g_object_unref(image);
+		}
+	}
+
+	return NULL;
+}
+
 static int
 vips_operation_build(VipsObject *object)
 {
@@ -604,6 +637,12 @@ vips_operation_build(VipsObject *object)
 	if (VIPS_OBJECT_CLASS(vips_operation_parent_class)->build(object))
 		return -1;
 
+	/* Label output images with our name, so profile traces, metrics and
+	 * vips_image_explain() can show which operation computed each tile.
+	 */
+	(void) vips_argument_map(object,
+		vips_operation_name_output, object, NULL);
+
 	return 0;
 }
 
@@ -801,8 +840,11 @@ vips_operation_set_valist_required(VipsOperation *operation, va_list ap)
 			}
 #endif /*VIPS_DEBUG */
 
-			g_object_set_property(G_OBJECT(operation),
-				g_param_spec_get_name(pspec), &value);
+			if (vips__object_set_pspec(VIPS_OBJECT(operation),
+					pspec, &value)) {
+				g_value_unset(&value);
+				return -1;
+			}
 
 			VIPS_ARGUMENT_COLLECT_GET(pspec, argument_class, ap);
 
@@ -1538,6 +1580,10 @@ vips_operation_block_set(const char *name, gboolean state)
 {
 	GType base;
 
+	/* The operation might be in a module we've not opened yet.
+	 */
+	vips__module_load_all();
+
 	if ((base = g_type_from_name(name)) &&
 		g_type_is_a(base, VIPS_TYPE_OPERATION))
 		vips_class_map_all(base,
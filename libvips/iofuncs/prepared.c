@@ -0,0 +1,367 @@
+/* a chain of operations, set up once and run many times
+ *
+ * 15/10/26
+ * 	- first version
+ */
+
+/*
+
+	This file is part of VIPS.
+
+	VIPS is free software; you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+	02110-1301  USA
+
+ */
+
+/*
+
+	These files are distributed with VIPS - http://www.vips.ecs.soton.ac.uk
+
+ */
+
+/* Operations are immutable once built, so we can't swap the input of a
+ * built pipeline. Instead, each step records everything that doesn't depend
+ * on the input: the operation type, the argument values already converted
+ * to the property types, and the image input and output pspecs. A run just
+ * makes each operation, sets the values, attaches the image and builds.
+ *
+ * Sub-operations which don't depend on the input, like masks and LUTs, hit
+ * the operation cache from one run to the next.
+ */
+
+/*
+#define DEBUG
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /*HAVE_CONFIG_H*/
+#include <glib/gi18n-lib.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <vips/vips.h>
+#include <vips/internal.h>
+#include <vips/debug.h>
+
+/* An argument value set when the step was added.
+ */
+typedef struct _VipsPreparedArg {
+	GParamSpec *pspec;
+	GValue value;
+} VipsPreparedArg;
+
+typedef struct _VipsPreparedStep {
+	GType type;
+	const char *nickname;
+
+	/* The first required image input, which we attach the previous
+	 * image to, and the first required image output.
+	 */
+	GParamSpec *in;
+	GParamSpec *out;
+
+	/* All the other inputs.
+	 */
+	GArray *args;
+} VipsPreparedStep;
+
+struct _VipsPrepared {
+	GArray *steps;
+
+	/* Set if every step can run sequentially.
+	 */
+	gboolean sequential;
+};
+
+static void
+vips_prepared_arg_clear(VipsPreparedArg *arg)
+{
+	g_value_unset(&arg->value);
+}
+
+static void
+vips_prepared_step_clear(VipsPreparedStep *step)
+{
+	VIPS_FREEF(g_array_unref, step->args);
+}
+
+/**
+ * vips_prepared_new:
+ *
+ * Make a new, empty prepared pipeline. Add steps with [func@prepared_add],
+ * then run it on as many images as you like with [func@prepared_run].
+ *
+ * Returns: (transfer full): a new prepared pipeline
+ */
+VipsPrepared *
+vips_prepared_new(void)
+{
+	VipsPrepared *prepared;
+
+	prepared = g_new0(VipsPrepared, 1);
+	prepared->steps = g_array_new(FALSE, TRUE, sizeof(VipsPreparedStep));
+	g_array_set_clear_func(prepared->steps,
+		(GDestroyNotify) vips_prepared_step_clear);
+	prepared->sequential = TRUE;
+
+	return prepared;
+}
+
+/**
+ * vips_prepared_free:
+ * @prepared: (transfer full): pipeline to free
+ *
+ * Free a prepared pipeline. Images made by earlier runs are not affected.
+ */
+void
+vips_prepared_free(VipsPrepared *prepared)
+{
+	if (prepared) {
+		VIPS_FREEF(g_array_unref, prepared->steps);
+		g_free(prepared);
+	}
+}
+
+static void *
+vips_prepared_add_arg(VipsObject *object,
+	GParamSpec *pspec,
+	VipsArgumentClass *argument_class,
+	VipsArgumentInstance *argument_instance,
+	void *a, void *b)
+{
+	VipsPreparedStep *step = (VipsPreparedStep *) a;
+	const char *name = g_param_spec_get_name(pspec);
+	GType type = G_PARAM_SPEC_VALUE_TYPE(pspec);
+
+	if (!(argument_class->flags & VIPS_ARGUMENT_CONSTRUCT) ||
+		(argument_class->flags & VIPS_ARGUMENT_DEPRECATED))
+		return NULL;
+
+	if (argument_class->flags & VIPS_ARGUMENT_INPUT) {
+		if (argument_instance->assigned) {
+			VipsPreparedArg arg = { pspec, G_VALUE_INIT };
+
+			g_value_init(&arg.value, type);
+			g_object_get_property(G_OBJECT(object), name, &arg.value);
+			g_array_append_val(step->args, arg);
+		}
+		else if ((argument_class->flags & VIPS_ARGUMENT_REQUIRED) &&
+			!step->in &&
+			g_type_is_a(type, VIPS_TYPE_IMAGE))
+			step->in = pspec;
+		else if (argument_class->flags & VIPS_ARGUMENT_REQUIRED) {
+			vips_error("VipsPrepared",
+				_("parameter %s to %s not set"), name, step->nickname);
+			return pspec;
+		}
+	}
+	else if ((argument_class->flags & VIPS_ARGUMENT_OUTPUT) &&
+		(argument_class->flags & VIPS_ARGUMENT_REQUIRED) &&
+		!step->out &&
+		g_type_is_a(type, VIPS_TYPE_IMAGE))
+		step->out = pspec;
+
+	return NULL;
+}
+
+/**
+ * vips_prepared_add:
+ * @prepared: pipeline to add to
+ * @operation_name: nickname of the operation to add
+ * @...: `NULL`-terminated list of argument/value pairs
+ *
+ * Add a step to the end of a prepared pipeline. The first required image
+ * input of the operation is connected to the output of the previous step,
+ * or to the input image for the first step, and the first required image
+ * output becomes the input to the next step. Every other required input
+ * must be set here, for example:
+ *
+ * ```c
+ * VipsPrepared *prepared = vips_prepared_new();
+ *
+ * if (vips_prepared_add(prepared, "resize",
+ *         "scale", 0.5,
+ *         NULL) ||
+ *     vips_prepared_add(prepared, "sharpen",
+ *         "sigma", 1.0,
+ *         NULL))
+ *     return -1;
+ * ```
+ *
+ * Arguments are looked up and converted once, here, rather than on every
+ * run.
+ *
+ * ::: seealso
+ *     [func@prepared_run].
+ *
+ * Returns: 0 on success, -1 on error
+ */
+int
+vips_prepared_add(VipsPrepared *prepared, const char *operation_name, ...)
+{
+	VipsOperation *operation;
+	VipsPreparedStep step = { 0 };
+	va_list ap;
+	int result;
+
+	if (!(operation = vips_operation_new(operation_name)))
+		return -1;
+
+	step.type = G_OBJECT_TYPE(operation);
+	step.nickname = VIPS_OBJECT_GET_CLASS(operation)->nickname;
+	step.args = g_array_new(FALSE, FALSE, sizeof(VipsPreparedArg));
+	g_array_set_clear_func(step.args,
+		(GDestroyNotify) vips_prepared_arg_clear);
+
+	va_start(ap, operation_name);
+	result = vips_object_set_valist(VIPS_OBJECT(operation), ap);
+	va_end(ap);
+
+	if (result ||
+		vips_argument_map(VIPS_OBJECT(operation),
+			vips_prepared_add_arg, &step, NULL)) {
+		vips_prepared_step_clear(&step);
+		g_object_unref(operation);
+		return -1;
+	}
+
+	if (!step.in ||
+		!step.out) {
+		vips_error("VipsPrepared",
+			_("%s does not take and make an image"), step.nickname);
+		vips_prepared_step_clear(&step);
+		g_object_unref(operation);
+		return -1;
+	}
+
+	if (!(vips_operation_get_flags(operation) & VIPS_OPERATION_SEQUENTIAL))
+		prepared->sequential = FALSE;
+
+	g_object_unref(operation);
+
+	g_array_append_val(prepared->steps, step);
+
+	return 0;
+}
+
+/* Run one step on @in, returning a new ref to the output.
+ */
+static VipsImage *
+vips_prepared_step_run(VipsPreparedStep *step, VipsImage *in)
+{
+	VipsOperation *operation;
+	VipsImage *out;
+
+	operation = VIPS_OPERATION(g_object_new(step->type, NULL));
+
+	for (guint i = 0; i < step->args->len; i++) {
+		VipsPreparedArg *arg =
+			&g_array_index(step->args, VipsPreparedArg, i);
+
+		g_object_set_property(G_OBJECT(operation),
+			g_param_spec_get_name(arg->pspec), &arg->value);
+	}
+
+	g_object_set(operation, g_param_spec_get_name(step->in), in, NULL);
+
+	if (vips_cache_operation_buildp(&operation)) {
+		vips_object_unref_outputs(VIPS_OBJECT(operation));
+		g_object_unref(operation);
+		return NULL;
+	}
+
+	g_object_get(operation, g_param_spec_get_name(step->out), &out, NULL);
+
+	vips_object_unref_outputs(VIPS_OBJECT(operation));
+	g_object_unref(operation);
+
+	return out;
+}
+
+/**
+ * vips_prepared_run:
+ * @prepared: pipeline to run
+ * @in: input image
+ * @out: (out): output image
+ *
+ * Run a prepared pipeline on @in. The pipeline can be run many times, and
+ * from many threads at once.
+ *
+ * ::: seealso
+ *     [func@prepared_add], [func@prepared_run_source].
+ *
+ * Returns: 0 on success, -1 on error
+ */
+int
+vips_prepared_run(VipsPrepared *prepared, VipsImage *in, VipsImage **out)
+{
+	VipsImage *image;
+
+	image = in;
+	g_object_ref(image);
+
+	for (guint i = 0; i < prepared->steps->len; i++) {
+		VipsPreparedStep *step =
+			&g_array_index(prepared->steps, VipsPreparedStep, i);
+
+		VipsImage *next;
+
+		next = vips_prepared_step_run(step, image);
+		g_object_unref(image);
+		if (!next)
+			return -1;
+		image = next;
+	}
+
+	*out = image;
+
+	return 0;
+}
+
+/**
+ * vips_prepared_run_source:
+ * @prepared: pipeline to run
+ * @source: source to load the input image from
+ * @out: (out): output image
+ *
+ * Load an image from @source and run @prepared on it. The image is loaded
+ * in sequential mode if every step in the pipeline supports it.
+ *
+ * ::: seealso
+ *     [func@prepared_run].
+ *
+ * Returns: 0 on success, -1 on error
+ */
+int
+vips_prepared_run_source(VipsPrepared *prepared,
+	VipsSource *source, VipsImage **out)
+{
+	VipsImage *in;
+	int result;
+
+	if (!(in = vips_image_new_from_source(source, "",
+			  "access", prepared->sequential
+				  ? VIPS_ACCESS_SEQUENTIAL
+				  : VIPS_ACCESS_RANDOM,
+			  NULL)))
+		return -1;
+
+	result = vips_prepared_run(prepared, in, out);
+	g_object_unref(in);
+
+	return result;
+}
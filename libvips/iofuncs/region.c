@@ -51,6 +51,14 @@
  * 22/2/21 f1ac
  * 	- fix int overflow in vips_region_copy(), could cause crashes with
  * 	  very wide images
+ * 14/10/26
+ * 	- count per-image generate time and pixels for vips_image_explain()
+ * 15/10/26
+ * 	- add vips__region_shrink_threaded()
+ * 	- add highway paths for the 2x2 mean, median, mode and alpha shrink
+ * 	- add vips__region_memory()
+ * 	- paint tiles of constant images
+ * 	- keep a per-thread pool of spare region objects
  */
 
 /*
@@ -103,6 +111,7 @@
 #include <vips/vips.h>
 #include <vips/internal.h>
 #include <vips/debug.h>
+#include <vips/vector.h>
 
 /**
  * VipsRegion:
@@ -270,11 +279,49 @@ vips__region_stop(VipsRegion *region)
 	}
 }
 
+/* Each thread keeps a few spare region objects. Making a region from scratch
+ * means a trip through GObject and VipsObject construction, including a
+ * global lock, and this can show up on pipelines with many small tiles.
+ */
+#define VIPS_REGION_POOL_MAX (16)
+
+typedef struct _VipsRegionPool {
+	GSList *regions;
+	int n;
+} VipsRegionPool;
+
+static void
+vips_region_pool_free(VipsRegionPool *pool)
+{
+	/* The pool must already be detached from the thread, or dispose
+	 * would put these regions straight back.
+	 */
+	g_slist_free_full(pool->regions, g_object_unref);
+	g_free(pool);
+}
+
+static GPrivate vips_region_pool_key =
+	G_PRIVATE_INIT((GDestroyNotify) vips_region_pool_free);
+
+/* Free this thread's spare regions. Called from vips_thread_shutdown().
+ */
+void
+vips__region_shutdown(void)
+{
+	VipsRegionPool *pool;
+
+	if ((pool = g_private_get(&vips_region_pool_key))) {
+		g_private_set(&vips_region_pool_key, NULL);
+		vips_region_pool_free(pool);
+	}
+}
+
 static void
 vips_region_dispose(GObject *gobject)
 {
 	VipsRegion *region = VIPS_REGION(gobject);
 	VipsImage *image = region->im;
+	VipsRegionPool *pool;
 
 #ifdef VIPS_DEBUG
 	VIPS_DEBUG_MSG("vips_region_dispose: ");
@@ -282,32 +329,49 @@ vips_region_dispose(GObject *gobject)
 	VIPS_DEBUG_MSG("\n");
 #endif /*VIPS_DEBUG*/
 
-	vips_object_preclose(VIPS_OBJECT(gobject));
-
-	/* Stop this sequence.
+	/* Regions leaving the pool for the last time have already let go of
+	 * their image.
 	 */
-	vips__region_stop(region);
+	if (image) {
+		vips_object_preclose(VIPS_OBJECT(gobject));
 
-	/* Free any attached memory.
-	 */
-	VIPS_FREEF(vips_window_unref, region->window);
-	VIPS_FREEF(vips_buffer_unref, region->buffer);
+		/* Stop this sequence.
+		 */
+		vips__region_stop(region);
 
-	/* Detach from image.
-	 */
-	VIPS_GATE_START("vips_region_dispose: wait");
+		/* Free any attached memory.
+		 */
+		VIPS_FREEF(vips_window_unref, region->window);
+		VIPS_FREEF(vips_buffer_unref, region->buffer);
 
-	g_mutex_lock(&image->sslock);
+		/* Detach from image.
+		 */
+		VIPS_GATE_START("vips_region_dispose: wait");
 
-	VIPS_GATE_STOP("vips_region_dispose: wait");
+		g_mutex_lock(&image->sslock);
 
-	image->regions = g_slist_remove(image->regions, region);
+		VIPS_GATE_STOP("vips_region_dispose: wait");
 
-	g_mutex_unlock(&image->sslock);
+		image->regions = g_slist_remove(image->regions, region);
+
+		g_mutex_unlock(&image->sslock);
+
+		region->im = NULL;
 
-	region->im = NULL;
+		g_object_unref(image);
+	}
 
-	g_object_unref(image);
+	/* Park it for the next vips_region_new() on this thread. The extra
+	 * ref stops GObject going on to finalize.
+	 */
+	if ((pool = g_private_get(&vips_region_pool_key)) &&
+		pool->n < VIPS_REGION_POOL_MAX) {
+		pool->regions = g_slist_prepend(pool->regions,
+			g_object_ref(region));
+		pool->n += 1;
+
+		return;
+	}
 
 	G_OBJECT_CLASS(vips_region_parent_class)->dispose(gobject);
 }
@@ -420,30 +484,39 @@ vips__region_no_ownership(VipsRegion *region)
 	g_mutex_unlock(&region->im->sslock);
 }
 
-static int
-vips_region_build(VipsObject *object)
+/* Link a region to its image.
+ */
+static void
+vips_region_attach(VipsRegion *region)
 {
-	VipsRegion *region = VIPS_REGION(object);
 	VipsImage *image = region->im;
 
-	VIPS_DEBUG_MSG("vips_region_build: %p\n", region);
-
-	if (VIPS_OBJECT_CLASS(vips_region_parent_class)->build(object))
-		return -1;
-
 	vips__region_take_ownership(region);
 
 	/* We're usually inside the ss lock anyway. But be safe ...
 	 */
-	VIPS_GATE_START("vips_region_build: wait");
+	VIPS_GATE_START("vips_region_attach: wait");
 
 	g_mutex_lock(&image->sslock);
 
-	VIPS_GATE_STOP("vips_region_build: wait");
+	VIPS_GATE_STOP("vips_region_attach: wait");
 
 	image->regions = g_slist_prepend(image->regions, region);
 
 	g_mutex_unlock(&image->sslock);
+}
+
+static int
+vips_region_build(VipsObject *object)
+{
+	VipsRegion *region = VIPS_REGION(object);
+
+	VIPS_DEBUG_MSG("vips_region_build: %p\n", region);
+
+	if (VIPS_OBJECT_CLASS(vips_region_parent_class)->build(object))
+		return -1;
+
+	vips_region_attach(region);
 
 	return 0;
 }
@@ -489,6 +562,7 @@ vips_region_init(VipsRegion *region)
 VipsRegion *
 vips_region_new(VipsImage *image)
 {
+	VipsRegionPool *pool;
 	VipsRegion *region;
 
 	/* Ref quickly, we want to make sure we keep the image around.
@@ -498,12 +572,43 @@ vips_region_new(VipsImage *image)
 	g_assert(G_OBJECT(image)->ref_count > 1);
 	g_assert(vips_object_sanity(VIPS_OBJECT(image)));
 
-	region = VIPS_REGION(g_object_new(VIPS_TYPE_REGION, NULL));
-	region->im = image;
+	if (!(pool = g_private_get(&vips_region_pool_key))) {
+		pool = g_new0(VipsRegionPool, 1);
+		g_private_set(&vips_region_pool_key, pool);
+	}
+
+	if (pool->regions) {
+		/* A built region from an earlier pipeline on this thread.
+		 * Dispose has already dropped its image and memory.
+		 */
+		region = VIPS_REGION(pool->regions->data);
+		pool->regions = g_slist_delete_link(pool->regions,
+			pool->regions);
+		pool->n -= 1;
+
+		VIPS_OBJECT(region)->preclose = FALSE;
+		region->im = image;
+		region->valid.left = 0;
+		region->valid.top = 0;
+		region->valid.width = 0;
+		region->valid.height = 0;
+		region->type = VIPS_REGION_NONE;
+		region->data = NULL;
+		region->bpl = 0;
+		region->seq = NULL;
+		region->thread = NULL;
+		region->invalid = FALSE;
 
-	if (vips_object_build(VIPS_OBJECT(region))) {
-		VIPS_UNREF(region);
-		return NULL;
+		vips_region_attach(region);
+	}
+	else {
+		region = VIPS_REGION(g_object_new(VIPS_TYPE_REGION, NULL));
+		region->im = image;
+
+		if (vips_object_build(VIPS_OBJECT(region))) {
+			VIPS_UNREF(region);
+			return NULL;
+		}
 	}
 
 	g_assert(vips_object_sanity(VIPS_OBJECT(region)));
@@ -665,6 +770,30 @@ vips_region_image(VipsRegion *reg, const VipsRect *r)
 	return 0;
 }
 
+/* Make @reg address memory owned by someone else: the whole image, with
+ * lines @stride bytes apart. The memory must stay valid while @reg is
+ * attached.
+ */
+void
+vips__region_memory(VipsRegion *reg, VipsPel *data, size_t stride)
+{
+	VipsImage *image = reg->im;
+
+	vips__region_check_ownership(reg);
+
+	reg->invalid = FALSE;
+	VIPS_FREEF(vips_buffer_unref, reg->buffer);
+	VIPS_FREEF(vips_window_unref, reg->window);
+
+	reg->valid.left = 0;
+	reg->valid.top = 0;
+	reg->valid.width = image->Xsize;
+	reg->valid.height = image->Ysize;
+	reg->bpl = stride;
+	reg->data = data;
+	reg->type = VIPS_REGION_OTHER_IMAGE;
+}
+
 /**
  * vips_region_region:
  * @reg: region to operate upon
@@ -1136,8 +1265,40 @@ vips_region_shrink_labpack(VipsRegion *from,
 	}
 }
 
+/* Shrink as much of a line as we can with the highway paths, returning the
+ * number of output pixels made.
+ */
+static int
+vips_region_shrink_line_hwy(VipsRegion *from,
+	VipsPel *q, VipsPel *p, int width, VipsRegionShrink method)
+{
+#ifdef HAVE_HWY
+	if (vips_vector_isenabled()) {
+		VipsPel *p1 = p + VIPS_REGION_LSKIP(from);
+		int nb = from->im->Bands;
+
+		switch (from->im->BandFmt) {
+		case VIPS_FORMAT_UCHAR:
+			return vips_region_shrink_uchar_hwy(q, p, p1,
+				width, nb, method);
+		case VIPS_FORMAT_USHORT:
+			return vips_region_shrink_ushort_hwy(q, p, p1,
+				width, nb, method);
+		case VIPS_FORMAT_FLOAT:
+			return vips_region_shrink_float_hwy(q, p, p1,
+				width, nb, method);
+
+		default:
+			break;
+		}
+	}
+#endif /*HAVE_HWY*/
+
+	return 0;
+}
+
 #define SHRINK_TYPE_MEAN_INT(TYPE) \
-	for (x = 0; x < target->width; x++) { \
+	for (; x < target->width; x++) { \
 		TYPE *tp = (TYPE *) p; \
 		TYPE *tp1 = (TYPE *) (p + ls); \
 		TYPE *tq = (TYPE *) q; \
@@ -1156,7 +1317,7 @@ vips_region_shrink_labpack(VipsRegion *from,
 	}
 
 #define SHRINK_TYPE_MEAN_FLOAT(TYPE) \
-	for (x = 0; x < target->width; x++) { \
+	for (; x < target->width; x++) { \
 		TYPE *tp = (TYPE *) p; \
 		TYPE *tp1 = (TYPE *) (p + ls); \
 		TYPE *tq = (TYPE *) q; \
@@ -1192,7 +1353,12 @@ vips_region_shrink_uncoded_mean(VipsRegion *from,
 		VipsPel *q = VIPS_REGION_ADDR(to,
 			target->left, target->top + y);
 
-		/* Process this line of pels.
+		x = vips_region_shrink_line_hwy(from, q, p,
+			target->width, VIPS_REGION_SHRINK_MEAN);
+		p += x * (ps << 1);
+		q += x * ps;
+
+		/* Process the rest of this line of pels.
 		 */
 		switch (from->im->BandFmt) {
 		case VIPS_FORMAT_UCHAR:
@@ -1240,7 +1406,7 @@ vips_region_shrink_uncoded_mean(VipsRegion *from,
 	{ \
 		int ls = VIPS_REGION_LSKIP(from); \
 \
-		for (x = 0; x < target->width; x++) { \
+		for (; x < target->width; x++) { \
 			TYPE *tp = (TYPE *) p; \
 			TYPE *tp1 = (TYPE *) (p + ls); \
 			TYPE *tq = (TYPE *) q; \
@@ -1272,7 +1438,7 @@ vips_region_shrink_uncoded_mean(VipsRegion *from,
 	{ \
 		int ls = VIPS_REGION_LSKIP(from); \
 \
-		for (x = 0; x < target->width; x++) { \
+		for (; x < target->width; x++) { \
 			TYPE *tp = (TYPE *) p; \
 			TYPE *tp1 = (TYPE *) (p + ls); \
 			TYPE *tq = (TYPE *) q; \
@@ -1299,7 +1465,7 @@ vips_region_shrink_uncoded_mean(VipsRegion *from,
 	{ \
 		int ls = VIPS_REGION_LSKIP(from); \
 \
-		for (x = 0; x < target->width; x++) { \
+		for (; x < target->width; x++) { \
 			TYPE *tp = (TYPE *) p; \
 			TYPE *tp1 = (TYPE *) (p + ls); \
 			TYPE *tq = (TYPE *) q; \
@@ -1319,7 +1485,7 @@ vips_region_shrink_uncoded_mean(VipsRegion *from,
 	{ \
 		int ls = VIPS_REGION_LSKIP(from); \
 \
-		for (x = 0; x < target->width; x++) { \
+		for (; x < target->width; x++) { \
 			TYPE *tp = (TYPE *) p; \
 			TYPE *tp1 = (TYPE *) (p + ls); \
 			TYPE *tq = (TYPE *) q; \
@@ -1337,7 +1503,7 @@ vips_region_shrink_uncoded_mean(VipsRegion *from,
 
 #define SHRINK_TYPE_NEAREST(TYPE) \
 	{ \
-		for (x = 0; x < target->width; x++) { \
+		for (; x < target->width; x++) { \
 			TYPE *tp = (TYPE *) p; \
 			TYPE *tq = (TYPE *) q; \
 \
@@ -1365,7 +1531,12 @@ vips_region_shrink_uncoded_mean(VipsRegion *from,
 			VipsPel *q = VIPS_REGION_ADDR(to, \
 				target->left, target->top + y); \
 \
-			/* Process this line of pels. \
+			x = vips_region_shrink_line_hwy(from, q, p, \
+				target->width, VIPS_REGION_SHRINK_##OP); \
+			p += x * (ps << 1); \
+			q += x * ps; \
+\
+			/* Process the rest of this line of pels. \
 			 */ \
 			switch (from->im->BandFmt) { \
 			case VIPS_FORMAT_UCHAR: \
@@ -1449,7 +1620,7 @@ vips_region_shrink_uncoded(VipsRegion *from,
 		TYPE *tp1 = (TYPE *) (p + ls); \
 		TYPE *tq = (TYPE *) q; \
 \
-		for (x = 0; x < target->width; x++) { \
+		for (; x < target->width; x++) { \
 			/* Make the input alphas. \
 			 */ \
 			double a1 = tp[nb - 1]; \
@@ -1489,6 +1660,7 @@ vips_region_shrink_alpha(VipsRegion *from,
 	VipsRegion *to, const VipsRect *target)
 {
 	int ls = VIPS_REGION_LSKIP(from);
+	int ps = VIPS_IMAGE_SIZEOF_PEL(from->im);
 	int nb = from->im->Bands;
 
 	int x, y, z;
@@ -1499,7 +1671,17 @@ vips_region_shrink_alpha(VipsRegion *from,
 		VipsPel *q = VIPS_REGION_ADDR(to,
 			target->left, target->top + y);
 
-		/* Process this line of pels.
+		x = 0;
+#ifdef HAVE_HWY
+		if (from->im->BandFmt == VIPS_FORMAT_UCHAR &&
+			vips_vector_isenabled())
+			x = vips_region_shrink_alpha_uchar_hwy(q, p, p + ls,
+				target->width, nb);
+#endif /*HAVE_HWY*/
+		p += x * (ps << 1);
+		q += x * ps;
+
+		/* Process the rest of this line of pels.
 		 */
 		switch (from->im->BandFmt) {
 		case VIPS_FORMAT_UCHAR:
@@ -1594,6 +1776,131 @@ vips_region_shrink(VipsRegion *from, VipsRegion *to, const VipsRect *target)
 		VIPS_REGION_SHRINK_MEAN);
 }
 
+/* Below this many output bytes, it's quicker to shrink on one thread.
+ */
+#define VIPS_SHRINK_THREADED_MIN (256 * 1024)
+
+/* A threaded shrink: each worker shrinks bands of rows until there are none
+ * left.
+ */
+typedef struct _VipsRegionShrinkThreaded {
+	VipsRegion *from;
+	VipsRegion *to;
+	VipsRect target;
+	VipsRegionShrink method;
+
+	int rows_per_job;
+	int n_jobs;
+
+	GMutex lock;
+	GCond cond;
+	int next;
+	int n_running;
+} VipsRegionShrinkThreaded;
+
+static void
+vips_region_shrink_threaded_work(void *a, void *b)
+{
+	VipsRegionShrinkThreaded *shrink = (VipsRegionShrinkThreaded *) a;
+
+	for (;;) {
+		VipsRect rows;
+		int i;
+
+		g_mutex_lock(&shrink->lock);
+		i = shrink->next++;
+		g_mutex_unlock(&shrink->lock);
+
+		if (i >= shrink->n_jobs)
+			break;
+
+		rows = shrink->target;
+		rows.top += i * shrink->rows_per_job;
+		rows.height = VIPS_MIN(shrink->rows_per_job,
+			VIPS_RECT_BOTTOM(&shrink->target) - rows.top);
+
+		/* Checked in vips__region_shrink_threaded(), this can't fail.
+		 */
+		(void) vips_region_shrink_method(shrink->from, shrink->to,
+			&rows, shrink->method);
+	}
+
+	/* We can be freed as soon as we unlock, so this must be the last
+	 * thing we do.
+	 */
+	g_mutex_lock(&shrink->lock);
+	shrink->n_running -= 1;
+	g_cond_broadcast(&shrink->cond);
+	g_mutex_unlock(&shrink->lock);
+}
+
+/* As vips_region_shrink_method(), but large areas are split into bands of
+ * rows and shrunk in parallel. Used by the pyramid builders, where the x2
+ * shrink of each strip would otherwise run on the single sink thread.
+ */
+int
+vips__region_shrink_threaded(VipsRegion *from, VipsRegion *to,
+	const VipsRect *target, VipsRegionShrink method)
+{
+	VipsImage *image = from->im;
+	int n_workers = vips_concurrency_get();
+
+	VipsRegionShrinkThreaded shrink;
+
+	if (vips_check_coding_noneorlabq("vips_region_shrink_method", image) ||
+		(image->Coding == VIPS_CODING_NONE &&
+			vips_check_noncomplex("vips_region_shrink_method", image)))
+		return -1;
+
+	if (n_workers < 2 ||
+		target->height < 2 ||
+		(guint64) VIPS_IMAGE_SIZEOF_PEL(to->im) * target->width *
+				target->height <
+			VIPS_SHRINK_THREADED_MIN)
+		return vips_region_shrink_method(from, to, target, method);
+
+	shrink.from = from;
+	shrink.to = to;
+	shrink.target = *target;
+	shrink.method = method;
+	shrink.rows_per_job = VIPS_MAX(1,
+		VIPS_ROUND_UP(target->height, 2 * n_workers) / (2 * n_workers));
+	shrink.n_jobs = VIPS_ROUND_UP(target->height, shrink.rows_per_job) /
+		shrink.rows_per_job;
+	g_mutex_init(&shrink.lock);
+	g_cond_init(&shrink.cond);
+	shrink.next = 0;
+	shrink.n_running = 0;
+
+	n_workers = VIPS_MIN(n_workers, shrink.n_jobs);
+
+	vips__worker_lock(&shrink.lock);
+	for (int i = 0; i < n_workers; i++) {
+		shrink.n_running += 1;
+		if (vips_thread_execute("shrink",
+				vips_region_shrink_threaded_work, &shrink))
+			shrink.n_running -= 1;
+	}
+
+	/* If we couldn't start any workers, do it ourselves.
+	 */
+	if (shrink.n_running == 0) {
+		shrink.n_running += 1;
+		g_mutex_unlock(&shrink.lock);
+		vips_region_shrink_threaded_work(&shrink, NULL);
+		vips__worker_lock(&shrink.lock);
+	}
+
+	while (shrink.n_running > 0)
+		vips__worker_cond_wait(&shrink.cond, &shrink.lock);
+	g_mutex_unlock(&shrink.lock);
+
+	g_mutex_clear(&shrink.lock);
+	g_cond_clear(&shrink.cond);
+
+	return 0;
+}
+
 /* Generate into a region.
  */
 static int
@@ -1601,18 +1908,52 @@ vips_region_generate(VipsRegion *reg, void *a)
 {
 	VipsImage *im = reg->im;
 
+	/* Metrics can be turned on or off at any time, so only look once.
+	 */
+	gboolean metrics = vips__metrics;
+	gboolean counters = vips__thread_profile_counters;
+
 	gboolean stop;
+	gint64 start;
+	VipsMetricsTile tile;
+	int result;
+
+	/* Constant images don't need to be computed.
+	 */
+	if (im->constant) {
+		vips_region_paint_pel(reg, &reg->valid, im->constant);
+		return 0;
+	}
 
 	/* Start new sequence, if necessary.
 	 */
 	if (vips__region_start(reg))
 		return -1;
 
+	start = vips__thread_profile_trace || metrics
+		? g_get_monotonic_time()
+		: 0;
+	if (metrics)
+		vips__metrics_tile_start(im, &tile);
+	if (counters)
+		vips__thread_profile_counters_start();
+
 	/* Ask for evaluation.
 	 */
 	stop = FALSE;
-	if (im->generate_fn(reg, reg->seq, im->client1, im->client2, &stop))
+	result = im->generate_fn(reg, reg->seq, im->client1, im->client2, &stop);
+
+	if (counters)
+		vips__thread_profile_counters_stop(im);
+	if (metrics)
+		vips__metrics_tile_stop(im, &tile, &reg->valid, start);
+
+	if (result)
 		return -1;
+
+	if (vips__thread_profile_trace)
+		vips__thread_profile_tile(im, &reg->valid, start);
+
 	if (stop) {
 		vips_error("vips_region_generate", "%s", _("stop requested"));
 		return -1;
@@ -0,0 +1,519 @@
+/* Highway kernels for the 2x2 shrink in vips_region_shrink_method().
+ *
+ * 15/10/26
+ * 	- initial implementation
+ */
+
+/*
+
+	This file is part of VIPS.
+
+	VIPS is free software; you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+	02110-1301  USA
+
+ */
+
+/*
+
+	These files are distributed with VIPS - http://www.vips.ecs.soton.ac.uk
+
+ */
+
+/* Each kernel shrinks as much of a line as it can in whole vectors and
+ * returns the number of output pixels it made. The caller does the rest
+ * with the scalar code.
+ *
+ * We split each band into planes with LoadInterleaved, then split each
+ * plane into even and odd pixels by viewing pairs of lanes as a single
+ * lane twice the width. The results match the scalar paths exactly.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /*HAVE_CONFIG_H*/
+#include <glib/gi18n-lib.h>
+
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+
+#include <vips/vips.h>
+#include <vips/vector.h>
+#include <vips/debug.h>
+#include <vips/internal.h>
+
+#ifdef HAVE_HWY
+
+#undef HWY_TARGET_INCLUDE
+#define HWY_TARGET_INCLUDE "libvips/iofuncs/region_hwy.cpp"
+#include <hwy/foreach_target.h>
+#include <hwy/highway.h>
+
+namespace HWY_NAMESPACE {
+
+using namespace hwy::HWY_NAMESPACE;
+
+/* The vector loops only run on SIMD targets, and only on little-endian
+ * machines, since the even/odd split depends on lane order within the
+ * wider lane.
+ */
+#if HWY_TARGET != HWY_SCALAR && G_BYTE_ORDER == G_LITTLE_ENDIAN
+#define VECTOR_LOOP 1
+#else
+#define VECTOR_LOOP 0
+#endif
+
+#if VECTOR_LOOP
+
+using DF32 = ScalableTag<float>;
+using DI32 = ScalableTag<int32_t>;
+using DU32 = ScalableTag<uint32_t>;
+
+template <class D>
+HWY_ATTR HWY_INLINE void
+load_planes(D d, hwy::SizeTag<1>, const TFromD<D> *HWY_RESTRICT p,
+	Vec<D> &v0, Vec<D> &v1, Vec<D> &v2, Vec<D> &v3)
+{
+	v0 = LoadU(d, p);
+}
+
+template <class D>
+HWY_ATTR HWY_INLINE void
+load_planes(D d, hwy::SizeTag<2>, const TFromD<D> *HWY_RESTRICT p,
+	Vec<D> &v0, Vec<D> &v1, Vec<D> &v2, Vec<D> &v3)
+{
+	LoadInterleaved2(d, p, v0, v1);
+}
+
+template <class D>
+HWY_ATTR HWY_INLINE void
+load_planes(D d, hwy::SizeTag<3>, const TFromD<D> *HWY_RESTRICT p,
+	Vec<D> &v0, Vec<D> &v1, Vec<D> &v2, Vec<D> &v3)
+{
+	LoadInterleaved3(d, p, v0, v1, v2);
+}
+
+template <class D>
+HWY_ATTR HWY_INLINE void
+load_planes(D d, hwy::SizeTag<4>, const TFromD<D> *HWY_RESTRICT p,
+	Vec<D> &v0, Vec<D> &v1, Vec<D> &v2, Vec<D> &v3)
+{
+	LoadInterleaved4(d, p, v0, v1, v2, v3);
+}
+
+template <class D>
+HWY_ATTR HWY_INLINE void
+store_planes(D d, hwy::SizeTag<1>, TFromD<D> *HWY_RESTRICT q,
+	Vec<D> v0, Vec<D> v1, Vec<D> v2, Vec<D> v3)
+{
+	StoreU(v0, d, q);
+}
+
+template <class D>
+HWY_ATTR HWY_INLINE void
+store_planes(D d, hwy::SizeTag<2>, TFromD<D> *HWY_RESTRICT q,
+	Vec<D> v0, Vec<D> v1, Vec<D> v2, Vec<D> v3)
+{
+	StoreInterleaved2(v0, v1, d, q);
+}
+
+template <class D>
+HWY_ATTR HWY_INLINE void
+store_planes(D d, hwy::SizeTag<3>, TFromD<D> *HWY_RESTRICT q,
+	Vec<D> v0, Vec<D> v1, Vec<D> v2, Vec<D> v3)
+{
+	StoreInterleaved3(v0, v1, v2, d, q);
+}
+
+template <class D>
+HWY_ATTR HWY_INLINE void
+store_planes(D d, hwy::SizeTag<4>, TFromD<D> *HWY_RESTRICT q,
+	Vec<D> v0, Vec<D> v1, Vec<D> v2, Vec<D> v3)
+{
+	StoreInterleaved4(v0, v1, v2, v3, d, q);
+}
+
+/* Split a plane of 2N pixels into N even and N odd pixels, zero-extended
+ * to twice the width so that four can be summed without overflow.
+ */
+template <class D, class DW = RepartitionToWide<D>>
+HWY_ATTR HWY_INLINE void
+split_wide(D d, Vec<D> v, Vec<DW> &even, Vec<DW> &odd)
+{
+	constexpr int bits = 8 * sizeof(TFromD<D>);
+	const DW dw;
+	const auto w = BitCast(dw, v);
+
+	even = And(w, Set(dw, static_cast<TFromD<DW>>(
+		(static_cast<TFromD<DW>>(1) << bits) - 1)));
+	odd = ShiftRight<bits>(w);
+}
+
+/* The int ops, done in the wide type.
+ */
+struct ShrinkMean {
+	template <class DW>
+	static HWY_ATTR HWY_INLINE Vec<DW>
+	apply(DW dw, Vec<DW> a, Vec<DW> b, Vec<DW> c, Vec<DW> d)
+	{
+		return ShiftRight<2>(Add(Add(Add(a, b), Add(c, d)), Set(dw, 2)));
+	}
+};
+
+struct ShrinkMedian {
+	template <class DW>
+	static HWY_ATTR HWY_INLINE Vec<DW>
+	apply(DW dw, Vec<DW> a, Vec<DW> b, Vec<DW> c, Vec<DW> d)
+	{
+		return Min(Max(a, b), Max(c, d));
+	}
+};
+
+/* The first value which appears twice, or the third value, as
+ * SHRINK_TYPE_MODE.
+ */
+struct ShrinkMode {
+	template <class DW>
+	static HWY_ATTR HWY_INLINE Vec<DW>
+	apply(DW dw, Vec<DW> a, Vec<DW> b, Vec<DW> c, Vec<DW> d)
+	{
+		const auto ab = Eq(a, b);
+		const auto a_twice = Or(ab, Or(Eq(a, c), Eq(a, d)));
+		const auto b_twice = Or(ab, Or(Eq(b, c), Eq(b, d)));
+
+		return IfThenElse(b_twice, b, IfThenElse(a_twice, a, c));
+	}
+};
+
+template <class Op, typename TYPE>
+struct PairInt {
+	using T = TYPE;
+	using D = ScalableTag<T>;
+	using DW = RepartitionToWide<D>;
+	using DN = Rebind<T, DW>;
+
+	static HWY_ATTR HWY_INLINE Vec<DN>
+	apply(Vec<D> top, Vec<D> bottom)
+	{
+		const D d;
+		const DW dw;
+		const DN dn;
+		Vec<DW> a, b, c, e;
+
+		split_wide(d, top, a, b);
+		split_wide(d, bottom, c, e);
+
+		return TruncateTo(dn, Op::apply(dw, a, b, c, e));
+	}
+};
+
+/* Float mean sums in float in the same order as SHRINK_TYPE_MEAN_FLOAT.
+ * The divide by four is exact, so the result is the same.
+ */
+struct PairMeanFloat {
+	using T = float;
+	using D = DF32;
+	using DU64 = Repartition<uint64_t, D>;
+	using DN = Rebind<float, DU64>;
+
+	static HWY_ATTR HWY_INLINE Vec<DN>
+	apply(Vec<D> top, Vec<D> bottom)
+	{
+		const DU64 du64;
+		const Rebind<uint32_t, DU64> du32;
+		const DN dn;
+		const auto t = BitCast(du64, top);
+		const auto b = BitCast(du64, bottom);
+		const auto t0 = BitCast(dn, TruncateTo(du32, t));
+		const auto t1 = BitCast(dn, TruncateTo(du32, ShiftRight<32>(t)));
+		const auto b0 = BitCast(dn, TruncateTo(du32, b));
+		const auto b1 = BitCast(dn, TruncateTo(du32, ShiftRight<32>(b)));
+
+		return Mul(Add(Add(Add(t0, t1), b0), b1), Set(dn, 0.25f));
+	}
+};
+
+template <class Pair, int NB>
+HWY_ATTR int32_t
+shrink_line(VipsPel *pout, const VipsPel *pin, const VipsPel *pin1,
+	int32_t width)
+{
+	using T = typename Pair::T;
+	const typename Pair::D d;
+	const typename Pair::DN dn;
+	const hwy::SizeTag<NB> nb;
+	const int32_t N = Lanes(dn);
+
+	const auto *HWY_RESTRICT p = reinterpret_cast<const T *>(pin);
+	const auto *HWY_RESTRICT p1 = reinterpret_cast<const T *>(pin1);
+	auto *HWY_RESTRICT q = reinterpret_cast<T *>(pout);
+
+	int32_t x;
+
+	for (x = 0; x + N <= width; x += N) {
+		auto t0 = Zero(d), t1 = Zero(d), t2 = Zero(d), t3 = Zero(d);
+		auto b0 = Zero(d), b1 = Zero(d), b2 = Zero(d), b3 = Zero(d);
+
+		load_planes(d, nb, p + x * 2 * NB, t0, t1, t2, t3);
+		load_planes(d, nb, p1 + x * 2 * NB, b0, b1, b2, b3);
+
+		auto o0 = Pair::apply(t0, b0);
+		auto o1 = Zero(dn), o2 = Zero(dn), o3 = Zero(dn);
+		if (NB > 1)
+			o1 = Pair::apply(t1, b1);
+		if (NB > 2)
+			o2 = Pair::apply(t2, b2);
+		if (NB > 3)
+			o3 = Pair::apply(t3, b3);
+
+		store_planes(dn, nb, q + x * NB, o0, o1, o2, o3);
+	}
+
+	return x;
+}
+
+template <class Pair>
+HWY_ATTR int32_t
+shrink_line_bands(VipsPel *pout, const VipsPel *pin, const VipsPel *pin1,
+	int32_t width, int32_t bands)
+{
+	switch (bands) {
+	case 1:
+		return shrink_line<Pair, 1>(pout, pin, pin1, width);
+	case 2:
+		return shrink_line<Pair, 2>(pout, pin, pin1, width);
+	case 3:
+		return shrink_line<Pair, 3>(pout, pin, pin1, width);
+	case 4:
+		return shrink_line<Pair, 4>(pout, pin, pin1, width);
+
+	default:
+		return 0;
+	}
+}
+
+template <typename T>
+HWY_ATTR int32_t
+shrink_line_method(VipsPel *pout, const VipsPel *pin, const VipsPel *pin1,
+	int32_t width, int32_t bands, int32_t method)
+{
+	switch (method) {
+	case VIPS_REGION_SHRINK_MEAN:
+		return shrink_line_bands<PairInt<ShrinkMean, T>>(pout,
+			pin, pin1, width, bands);
+	case VIPS_REGION_SHRINK_MEDIAN:
+		return shrink_line_bands<PairInt<ShrinkMedian, T>>(pout,
+			pin, pin1, width, bands);
+	case VIPS_REGION_SHRINK_MODE:
+		return shrink_line_bands<PairInt<ShrinkMode, T>>(pout,
+			pin, pin1, width, bands);
+
+	default:
+		return 0;
+	}
+}
+
+/* Split a plane of 2N uchar pixels into N even and N odd pixels as uint.
+ */
+template <class D8>
+HWY_ATTR HWY_INLINE void
+split_uint(D8 d8, Vec<D8> v, Vec<DU32> &even, Vec<DU32> &odd)
+{
+	const DU32 du32;
+	const RepartitionToWide<D8> du16;
+	const auto w = BitCast(du16, v);
+
+	even = PromoteTo(du32, And(w, Set(du16, 0xff)));
+	odd = PromoteTo(du32, ShiftRight<8>(w));
+}
+
+/* Alpha-weight one band, as SHRINK_ALPHA_TYPE. Weighted sums are at most
+ * 4 * 255 * 255, so float is exact, and the truncated quotient is too.
+ */
+template <class D8, class DN>
+HWY_ATTR HWY_INLINE Vec<DN>
+shrink_alpha_band(D8 d8, DN dn, Vec<D8> top, Vec<D8> bottom,
+	Vec<DU32> a0, Vec<DU32> a1, Vec<DU32> a2, Vec<DU32> a3,
+	Vec<DF32> divisor)
+{
+	const DF32 df32;
+	const DI32 di32;
+	Vec<DU32> c0, c1, c2, c3;
+
+	split_uint(d8, top, c0, c1);
+	split_uint(d8, bottom, c2, c3);
+	const auto sum = Add(Add(Mul(a0, c0), Mul(a1, c1)),
+		Add(Mul(a2, c2), Mul(a3, c3)));
+	const auto value = Div(ConvertTo(df32, BitCast(di32, sum)), divisor);
+
+	return DemoteTo(dn, ConvertTo(di32, value));
+}
+
+template <int NB>
+HWY_ATTR int32_t
+shrink_alpha_line(VipsPel *pout, const VipsPel *pin, const VipsPel *pin1,
+	int32_t width)
+{
+	const DU32 du32;
+	const DI32 di32;
+	const DF32 df32;
+	const Repartition<uint8_t, Rebind<uint16_t, DU32>> d8;
+	const Rebind<uint8_t, DI32> dn;
+	const hwy::SizeTag<NB> nb;
+	const int32_t N = Lanes(du32);
+
+	const auto *HWY_RESTRICT p = reinterpret_cast<const uint8_t *>(pin);
+	const auto *HWY_RESTRICT p1 = reinterpret_cast<const uint8_t *>(pin1);
+	auto *HWY_RESTRICT q = reinterpret_cast<uint8_t *>(pout);
+
+	int32_t x;
+
+	for (x = 0; x + N <= width; x += N) {
+		auto t0 = Zero(d8), t1 = Zero(d8), t2 = Zero(d8), t3 = Zero(d8);
+		auto b0 = Zero(d8), b1 = Zero(d8), b2 = Zero(d8), b3 = Zero(d8);
+
+		load_planes(d8, nb, p + x * 2 * NB, t0, t1, t2, t3);
+		load_planes(d8, nb, p1 + x * 2 * NB, b0, b1, b2, b3);
+
+		/* Alpha is always in the last plane.
+		 */
+		if (NB == 2) {
+			t3 = t1;
+			b3 = b1;
+		}
+
+		Vec<DU32> a0, a1, a2, a3;
+		split_uint(d8, t3, a0, a1);
+		split_uint(d8, b3, a2, a3);
+		const auto alpha = Add(Add(a0, a1), Add(a2, a3));
+
+		/* Zero alpha means zero weighted sums, so we can divide by one.
+		 */
+		const auto divisor = ConvertTo(df32,
+			BitCast(di32, Max(alpha, Set(du32, 1))));
+
+		auto o0 = shrink_alpha_band(d8, dn,
+			t0, b0, a0, a1, a2, a3, divisor);
+		auto o1 = Zero(dn), o2 = Zero(dn);
+		if (NB == 4) {
+			o1 = shrink_alpha_band(d8, dn,
+				t1, b1, a0, a1, a2, a3, divisor);
+			o2 = shrink_alpha_band(d8, dn,
+				t2, b2, a0, a1, a2, a3, divisor);
+		}
+		const auto oa = DemoteTo(dn, BitCast(di32, ShiftRight<2>(alpha)));
+
+		if (NB == 2)
+			store_planes(dn, nb, q + x * NB, o0, oa, o1, o2);
+		else
+			store_planes(dn, nb, q + x * NB, o0, o1, o2, oa);
+	}
+
+	return x;
+}
+
+#endif /*VECTOR_LOOP*/
+
+HWY_ATTR int32_t
+vips_region_shrink_uchar_hwy(VipsPel *pout, VipsPel *pin, VipsPel *pin1,
+	int32_t width, int32_t bands, int32_t method)
+{
+#if VECTOR_LOOP
+	return shrink_line_method<uint8_t>(pout, pin, pin1,
+		width, bands, method);
+#else
+	return 0;
+#endif
+}
+
+HWY_ATTR int32_t
+vips_region_shrink_ushort_hwy(VipsPel *pout, VipsPel *pin, VipsPel *pin1,
+	int32_t width, int32_t bands, int32_t method)
+{
+#if VECTOR_LOOP
+	return shrink_line_method<uint16_t>(pout, pin, pin1,
+		width, bands, method);
+#else
+	return 0;
+#endif
+}
+
+HWY_ATTR int32_t
+vips_region_shrink_float_hwy(VipsPel *pout, VipsPel *pin, VipsPel *pin1,
+	int32_t width, int32_t bands, int32_t method)
+{
+#if VECTOR_LOOP
+	if (method == VIPS_REGION_SHRINK_MEAN)
+		return shrink_line_bands<PairMeanFloat>(pout,
+			pin, pin1, width, bands);
+#endif
+
+	return 0;
+}
+
+HWY_ATTR int32_t
+vips_region_shrink_alpha_uchar_hwy(VipsPel *pout, VipsPel *pin,
+	VipsPel *pin1, int32_t width, int32_t bands)
+{
+#if VECTOR_LOOP
+	if (bands == 2)
+		return shrink_alpha_line<2>(pout, pin, pin1, width);
+	else if (bands == 4)
+		return shrink_alpha_line<4>(pout, pin, pin1, width);
+#endif
+
+	return 0;
+}
+
+/* This file is included once per target, and VECTOR_LOOP differs between
+ * them.
+ */
+#undef VECTOR_LOOP
+
+} /*namespace HWY_NAMESPACE*/
+
+#if HWY_ONCE
+HWY_EXPORT(vips_region_shrink_uchar_hwy);
+HWY_EXPORT(vips_region_shrink_ushort_hwy);
+HWY_EXPORT(vips_region_shrink_float_hwy);
+HWY_EXPORT(vips_region_shrink_alpha_uchar_hwy);
+
+/* clang-format off */
+#define DISPATCH_SHRINK(NAME) \
+	int \
+	NAME(VipsPel *pout, VipsPel *pin, VipsPel *pin1, \
+		int width, int bands, int method) \
+	{ \
+		return HWY_DYNAMIC_DISPATCH(NAME)(pout, pin, pin1, \
+			width, bands, method); \
+	}
+/* clang-format on */
+
+DISPATCH_SHRINK(vips_region_shrink_uchar_hwy)
+DISPATCH_SHRINK(vips_region_shrink_ushort_hwy)
+DISPATCH_SHRINK(vips_region_shrink_float_hwy)
+
+int
+vips_region_shrink_alpha_uchar_hwy(VipsPel *pout, VipsPel *pin,
+	VipsPel *pin1, int width, int bands)
+{
+	/* clang-format off */
+	return HWY_DYNAMIC_DISPATCH(vips_region_shrink_alpha_uchar_hwy)(pout,
+		pin, pin1, width, bands);
+	/* clang-format on */
+}
+#endif /*HWY_ONCE*/
+
+#endif /*HAVE_HWY*/
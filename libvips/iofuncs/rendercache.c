@@ -0,0 +1,700 @@
+/* cache encoded images by the pipeline that made them
+ *
+ * 15/10/26
+ * 	- first version
+ */
+
+/*
+
+	This file is part of VIPS.
+
+	VIPS is free software; you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+	02110-1301  USA
+
+ */
+
+/*
+
+	These files are distributed with VIPS - http://www.vips.ecs.soton.ac.uk
+
+ */
+
+/* The operation cache holds lazy images, so once the operations behind a
+ * pipeline have been dropped, asking for the same output again runs the
+ * whole thing, decode and encode included. If a render cache has been
+ * enabled, vips_image_write_to_buffer() keeps the encoded bytes, keyed by
+ * the pipeline that made the image, and later identical requests just copy
+ * them out.
+ *
+ * While the render cache is on, each operation built by
+ * vips_cache_operation_buildp() tags its output images with a key: a
+ * checksum of the operation nickname, its input arguments, and the keys of
+ * its input images. Loaders add the size, mtime and inode of the file they
+ * read, so changed files get new keys. Images with no tag of their own (for
+ * example the output of vips_image_write()) are keyed by their upstream
+ * images. We also include the header and metadata of each image at the
+ * moment we use it, since these are often changed after build.
+ *
+ * We can't use vips_operation_hash(): it includes the GType and the
+ * addresses of the input images, so it changes between processes and
+ * when the operation cache drops the upstream operations. We use SHA-256
+ * for the same reason shmcache.c does: a collision would return the wrong
+ * image.
+ *
+ * Anything we can't identify, such as memory images, random noise, or
+ * sources which aren't files, makes the image uncacheable, and we just
+ * render as usual.
+ */
+
+/*
+#define DEBUG
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /*HAVE_CONFIG_H*/
+#include <glib/gi18n-lib.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib/gstdio.h>
+
+#include <vips/vips.h>
+#include <vips/internal.h>
+
+/* Max bytes of encoded images we hold in memory, zero for no memory tier.
+ */
+static size_t vips_render_cache_max_mem = 0;
+
+/* Directory for the disc tier, or NULL for none.
+ */
+static char *vips_render_cache_dir = NULL;
+
+/* Protect the memory tier with this.
+ */
+static GMutex vips_render_cache_lock;
+
+/* Key string -> VipsRenderCacheEntry, plus a most-recent-first list for
+ * eviction.
+ */
+static GHashTable *vips_render_cache_table = NULL;
+static GQueue vips_render_cache_lru = G_QUEUE_INIT;
+static size_t vips_render_cache_mem = 0;
+
+typedef struct _VipsRenderCacheEntry {
+	char *key;
+	VipsBlob *blob;
+
+	/* Our link in vips_render_cache_lru.
+	 */
+	GList *link;
+} VipsRenderCacheEntry;
+
+#define VIPS_RENDER_CACHE_KEY "libvips-render-key"
+
+static gboolean vips_render_cache_image(GChecksum *sum, VipsImage *image);
+
+static void
+vips_render_cache_string(GChecksum *sum, const char *str)
+{
+	/* Include the terminating zero so fields can't run together.
+	 */
+	g_checksum_update(sum, (const guchar *) str, strlen(str) + 1);
+}
+
+/* Add the identity of a file: its name, size, mtime and inode.
+ */
+static gboolean
+vips_render_cache_file(GChecksum *sum, const char *filename)
+{
+	GStatBuf st;
+	char *str;
+
+	if (!filename ||
+		g_stat(filename, &st))
+		return FALSE;
+
+	str = g_strdup_printf("%s"
+						  " size=%" G_GINT64_FORMAT
+						  " mtime=%" G_GINT64_FORMAT
+						  " dev=%" G_GUINT64_FORMAT
+						  " ino=%" G_GUINT64_FORMAT,
+		filename,
+		(gint64) st.st_size,
+		(gint64) st.st_mtime,
+		(guint64) st.st_dev,
+		(guint64) st.st_ino);
+	vips_render_cache_string(sum, str);
+	g_free(str);
+
+	return TRUE;
+}
+
+/* Add a value, or return FALSE if we can't identify it.
+ */
+static gboolean
+vips_render_cache_value(GChecksum *sum, const GValue *value)
+{
+	GType type = G_VALUE_TYPE(value);
+
+	if (G_TYPE_IS_OBJECT(type) ||
+		G_TYPE_IS_BOXED(type)) {
+		/* A NULL is an unset optional argument.
+		 */
+		if (!(G_TYPE_IS_OBJECT(type)
+					? (void *) g_value_get_object(value)
+					: g_value_get_boxed(value))) {
+			vips_render_cache_string(sum, "(null)");
+			return TRUE;
+		}
+	}
+
+	if (g_type_is_a(type, VIPS_TYPE_IMAGE))
+		return vips_render_cache_image(sum, g_value_get_object(value));
+	else if (g_type_is_a(type, VIPS_TYPE_SOURCE)) {
+		VipsConnection *connection = VIPS_CONNECTION(
+			g_value_get_object(value));
+
+		return vips_render_cache_file(sum,
+			vips_connection_filename(connection));
+	}
+	else if (g_type_is_a(type, VIPS_TYPE_INTERPOLATE)) {
+		vips_render_cache_string(sum,
+			VIPS_OBJECT_GET_CLASS(g_value_get_object(value))->nickname);
+		return TRUE;
+	}
+	else if (type == VIPS_TYPE_ARRAY_IMAGE) {
+		int n;
+		VipsImage **images = vips_value_get_array_image(value, &n);
+
+		for (int i = 0; i < n; i++)
+			if (!vips_render_cache_image(sum, images[i]))
+				return FALSE;
+
+		return TRUE;
+	}
+	else if (type == VIPS_TYPE_BLOB ||
+		type == VIPS_TYPE_ARRAY_INT ||
+		type == VIPS_TYPE_ARRAY_DOUBLE) {
+		VipsArea *area = VIPS_AREA(g_value_get_boxed(value));
+
+		g_checksum_update(sum, (const guchar *) area->data,
+			type == VIPS_TYPE_BLOB
+				? area->length
+				: (size_t) area->n * area->sizeof_type);
+		return TRUE;
+	}
+	else if (type == VIPS_TYPE_REF_STRING) {
+		vips_render_cache_string(sum, vips_value_get_ref_string(value, NULL));
+		return TRUE;
+	}
+	else if (type == G_TYPE_DOUBLE) {
+		double d = g_value_get_double(value);
+
+		g_checksum_update(sum, (const guchar *) &d, sizeof(d));
+		return TRUE;
+	}
+	else if (type == G_TYPE_FLOAT) {
+		float f = g_value_get_float(value);
+
+		g_checksum_update(sum, (const guchar *) &f, sizeof(f));
+		return TRUE;
+	}
+	else if (G_TYPE_IS_FUNDAMENTAL(type) ||
+		G_TYPE_IS_ENUM(type) ||
+		G_TYPE_IS_FLAGS(type)) {
+		char *str;
+
+		/* No pointers or objects get here, so the string form is a
+		 * faithful copy of the value.
+		 */
+		if (type == G_TYPE_POINTER)
+			return FALSE;
+
+		str = g_strdup_value_contents(value);
+		vips_render_cache_string(sum, str);
+		g_free(str);
+		return TRUE;
+	}
+
+	return FALSE;
+}
+
+static void *
+vips_render_cache_field(VipsImage *image,
+	const char *field, GValue *value, void *a)
+{
+	GChecksum *sum = (GChecksum *) a;
+
+	/* The filename is just a label, and temporary images get random
+	 * ones.
+	 */
+	if (strcmp(field, "filename") == 0)
+		return NULL;
+
+	vips_render_cache_string(sum, field);
+	if (!vips_render_cache_value(sum, value))
+		return image;
+
+	return NULL;
+}
+
+/* Add the identity of an image, or return FALSE if it has none.
+ */
+static gboolean
+vips_render_cache_image(GChecksum *sum, VipsImage *image)
+{
+	const char *key;
+
+	if ((key = g_object_get_data(G_OBJECT(image), VIPS_RENDER_CACHE_KEY)))
+		vips_render_cache_string(sum, key);
+	else if (image->dtype == VIPS_IMAGE_PARTIAL &&
+		vips__image_iswrite(image)) {
+		GSList *upstream;
+		GSList *p;
+		gboolean found;
+
+		/* A lazy copy made by vips_image_write() is defined by the
+		 * image it reads. Other partial images made outside the
+		 * cache have a generate function we can't key on.
+		 */
+		g_mutex_lock(&vips__global_lock);
+		upstream = g_slist_copy_deep(image->upstream,
+			(GCopyFunc) g_object_ref, NULL);
+		g_mutex_unlock(&vips__global_lock);
+
+		vips_render_cache_string(sum, "upstream");
+		found = upstream != NULL;
+		for (p = upstream; p && found; p = p->next)
+			found = vips_render_cache_image(sum, VIPS_IMAGE(p->data));
+
+		g_slist_free_full(upstream, g_object_unref);
+
+		if (!found)
+			return FALSE;
+	}
+	else
+		/* Memory images can be drawn on, so we can't use the key of
+		 * whatever made them, and other partials could be anything.
+		 */
+		return FALSE;
+
+	return vips_image_map(image, vips_render_cache_field, sum) == NULL;
+}
+
+static void *
+vips_render_cache_input(VipsObject *object,
+	GParamSpec *pspec,
+	VipsArgumentClass *argument_class,
+	VipsArgumentInstance *argument_instance,
+	void *a, void *b)
+{
+	GChecksum *sum = (GChecksum *) a;
+
+	if (argument_class->flags & VIPS_ARGUMENT_MODIFY)
+		return object;
+
+	/* Unset arguments are included too: some operations pick random
+	 * defaults, and this makes sure they never match.
+	 */
+	if ((argument_class->flags & VIPS_ARGUMENT_CONSTRUCT) &&
+		(argument_class->flags & VIPS_ARGUMENT_INPUT) &&
+		!(argument_class->flags & VIPS_ARGUMENT_NON_HASHABLE)) {
+		const char *name = g_param_spec_get_name(pspec);
+		GValue value = G_VALUE_INIT;
+		gboolean found;
+
+		g_value_init(&value, G_PARAM_SPEC_VALUE_TYPE(pspec));
+		g_object_get_property(G_OBJECT(object), name, &value);
+
+		vips_render_cache_string(sum, name);
+		found = vips_render_cache_value(sum, &value);
+
+		/* Loaders read files, so they depend on the file too.
+		 */
+		if (found &&
+			VIPS_IS_FOREIGN_LOAD(object) &&
+			strcmp(name, "filename") == 0)
+			found = vips_render_cache_file(sum,
+				g_value_get_string(&value));
+
+		g_value_unset(&value);
+
+		if (!found)
+			return object;
+	}
+
+	return NULL;
+}
+
+static void *
+vips_render_cache_output(VipsObject *object,
+	GParamSpec *pspec,
+	VipsArgumentClass *argument_class,
+	VipsArgumentInstance *argument_instance,
+	void *a, void *b)
+{
+	const char *base = (const char *) a;
+
+	if ((argument_class->flags & VIPS_ARGUMENT_OUTPUT) &&
+		argument_instance->assigned &&
+		g_type_is_a(G_PARAM_SPEC_VALUE_TYPE(pspec), VIPS_TYPE_IMAGE)) {
+		const char *name = g_param_spec_get_name(pspec);
+		VipsImage *image;
+		GChecksum *sum;
+
+		g_object_get(object, name, &image, NULL);
+		if (image) {
+			sum = g_checksum_new(G_CHECKSUM_SHA256);
+			vips_render_cache_string(sum, base);
+			vips_render_cache_string(sum, name);
+			g_object_set_data_full(G_OBJECT(image), VIPS_RENDER_CACHE_KEY,
+				g_strdup(g_checksum_get_string(sum)), g_free);
+			g_checksum_free(sum);
+
+			g_object_unref(image);
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * vips__render_cache_tag: (skip)
+ * @operation: a freshly built operation
+ *
+ * Tag the output images of @operation with a key made from the operation
+ * and its inputs.
+ */
+void
+vips__render_cache_tag(VipsOperation *operation)
+{
+	VipsOperationClass *class = VIPS_OPERATION_GET_CLASS(operation);
+
+	GChecksum *sum;
+
+	/* Operations which must never be cached are often random, or have
+	 * side effects. Loaders set this to protect sequential reads, which
+	 * doesn't matter to us.
+	 */
+	if ((class->flags & VIPS_OPERATION_NOCACHE) &&
+		!VIPS_IS_FOREIGN_LOAD(operation))
+		return;
+
+	sum = g_checksum_new(G_CHECKSUM_SHA256);
+	vips_render_cache_string(sum,
+		VIPS_OBJECT_GET_CLASS(operation)->nickname);
+	if (!vips_argument_map(VIPS_OBJECT(operation),
+			vips_render_cache_input, sum, NULL))
+		(void) vips_argument_map(VIPS_OBJECT(operation),
+			vips_render_cache_output,
+			(void *) g_checksum_get_string(sum), NULL);
+	g_checksum_free(sum);
+}
+
+/**
+ * vips__render_cache_enabled: (skip)
+ *
+ * Returns: %TRUE if either tier of the render cache is on.
+ */
+gboolean
+vips__render_cache_enabled(void)
+{
+	return vips_render_cache_max_mem > 0 ||
+		vips_render_cache_dir;
+}
+
+/**
+ * vips__render_cache_key: (skip)
+ * @image: image to be saved
+ * @format: saver suffix, including any options
+ *
+ * Returns: (transfer full) (nullable): the render cache key for saving
+ * @image as @format, or %NULL if @image can't be identified.
+ */
+char *
+vips__render_cache_key(VipsImage *image, const char *format)
+{
+	GChecksum *sum;
+	char *key;
+
+	sum = g_checksum_new(G_CHECKSUM_SHA256);
+
+	/* Savers change between versions, and the disc tier outlives us.
+	 */
+	vips_render_cache_string(sum, "libvips-" VIPS_VERSION);
+	vips_render_cache_string(sum, format);
+	key = vips_render_cache_image(sum, image)
+		? g_strdup(g_checksum_get_string(sum))
+		: NULL;
+	g_checksum_free(sum);
+
+	return key;
+}
+
+static char *
+vips_render_cache_path(const char *dir, const char *key)
+{
+	char *name;
+	char *path;
+
+	name = g_strdup_printf("vips-render-%s", key);
+	path = g_build_filename(dir, name, NULL);
+	g_free(name);
+
+	return path;
+}
+
+static void
+vips_render_cache_entry_free(VipsRenderCacheEntry *entry)
+{
+	g_free(entry->key);
+	vips_area_unref(VIPS_AREA(entry->blob));
+	g_free(entry);
+}
+
+static void
+vips_render_cache_remove(VipsRenderCacheEntry *entry)
+{
+	vips_render_cache_mem -= VIPS_AREA(entry->blob)->length;
+	g_queue_delete_link(&vips_render_cache_lru, entry->link);
+	g_hash_table_remove(vips_render_cache_table, entry->key);
+}
+
+/* Evict least recently used entries until we fit in max_mem. Call with the
+ * lock held.
+ */
+static void
+vips_render_cache_trim(size_t max_mem)
+{
+	while (vips_render_cache_mem > max_mem &&
+		vips_render_cache_lru.tail)
+		vips_render_cache_remove((VipsRenderCacheEntry *)
+				vips_render_cache_lru.tail->data);
+}
+
+static void
+vips_render_cache_insert(const char *key, VipsBlob *blob)
+{
+	size_t length = VIPS_AREA(blob)->length;
+
+	VipsRenderCacheEntry *entry;
+
+	g_mutex_lock(&vips_render_cache_lock);
+
+	if (length > 0 &&
+		length <= vips_render_cache_max_mem) {
+		if (!vips_render_cache_table)
+			vips_render_cache_table = g_hash_table_new_full(
+				g_str_hash, g_str_equal,
+				NULL, (GDestroyNotify) vips_render_cache_entry_free);
+
+		if (!g_hash_table_contains(vips_render_cache_table, key)) {
+			entry = g_new(VipsRenderCacheEntry, 1);
+			entry->key = g_strdup(key);
+			entry->blob = blob;
+			vips_area_copy(VIPS_AREA(blob));
+			g_queue_push_head(&vips_render_cache_lru, entry);
+			entry->link = vips_render_cache_lru.head;
+			g_hash_table_insert(vips_render_cache_table,
+				entry->key, entry);
+			vips_render_cache_mem += length;
+
+			vips_render_cache_trim(vips_render_cache_max_mem);
+		}
+	}
+
+	g_mutex_unlock(&vips_render_cache_lock);
+}
+
+/**
+ * vips__render_cache_lookup: (skip)
+ * @key: key from vips__render_cache_key()
+ *
+ * Returns: (transfer full) (nullable): the encoded image, or %NULL on a
+ * miss.
+ */
+VipsBlob *
+vips__render_cache_lookup(const char *key)
+{
+	VipsRenderCacheEntry *entry;
+	VipsBlob *blob;
+
+	blob = NULL;
+
+	g_mutex_lock(&vips_render_cache_lock);
+
+	if (vips_render_cache_table &&
+		(entry = g_hash_table_lookup(vips_render_cache_table, key))) {
+		g_queue_unlink(&vips_render_cache_lru, entry->link);
+		g_queue_push_head_link(&vips_render_cache_lru, entry->link);
+		blob = entry->blob;
+		vips_area_copy(VIPS_AREA(blob));
+	}
+
+	g_mutex_unlock(&vips_render_cache_lock);
+
+	if (!blob &&
+		vips_render_cache_dir) {
+		char *path = vips_render_cache_path(vips_render_cache_dir, key);
+
+		char *data;
+		gsize length;
+
+		if (g_file_get_contents(path, &data, &length, NULL)) {
+			blob = vips_blob_new((VipsCallbackFn) vips_area_free_cb,
+				data, length);
+			vips_render_cache_insert(key, blob);
+		}
+
+		g_free(path);
+	}
+
+#ifdef DEBUG
+	printf("vips__render_cache_lookup: %s for %s\n",
+		blob ? "hit" : "miss", key);
+#endif /*DEBUG*/
+
+	return blob;
+}
+
+/**
+ * vips__render_cache_add: (skip)
+ * @key: key from vips__render_cache_key()
+ * @blob: encoded image
+ *
+ * Add @blob to both tiers of the render cache. Any failure just means we
+ * encode again next time, so we never set an error.
+ */
+void
+vips__render_cache_add(const char *key, VipsBlob *blob)
+{
+	vips_render_cache_insert(key, blob);
+
+	if (vips_render_cache_dir) {
+		char *path = vips_render_cache_path(vips_render_cache_dir, key);
+
+		/* g_file_set_contents() writes to a temporary name and
+		 * renames into place, so other processes never see a partial
+		 * entry.
+		 */
+		if (!g_file_test(path, G_FILE_TEST_EXISTS))
+			(void) g_file_set_contents(path,
+				VIPS_AREA(blob)->data, VIPS_AREA(blob)->length, NULL);
+
+		g_free(path);
+	}
+}
+
+/**
+ * vips__render_cache_drop: (skip)
+ *
+ * Drop the memory tier of the render cache.
+ */
+void
+vips__render_cache_drop(void)
+{
+	g_mutex_lock(&vips_render_cache_lock);
+
+	vips_render_cache_trim(0);
+	VIPS_FREEF(g_hash_table_destroy, vips_render_cache_table);
+
+	g_mutex_unlock(&vips_render_cache_lock);
+}
+
+/**
+ * vips_cache_set_render_max_mem:
+ * @max_mem: maximum number of bytes of encoded images to keep
+ *
+ * Keep up to @max_mem bytes of encoded images in memory. When
+ * [method@Image.write_to_buffer] is asked to save an image that has been
+ * saved before in the same format, and by the same operations, from the
+ * same files, the earlier result is returned without running the pipeline.
+ *
+ * Images are keyed on the chain of operations and arguments that made
+ * them, the header and metadata of every image along the way, and the
+ * size, modification time and inode of any files read. Pipelines which
+ * start from memory images, random numbers or non-file sources are never
+ * cached. Only saves with all options in the suffix, for example
+ * `".jpg[Q=90]"`, are cached.
+ *
+ * The default is 0, meaning no memory tier. You can also set this with the
+ * environment variable `VIPS_CACHE_RENDER_MAX_MEM`.
+ *
+ * See also: [func@cache_set_render_dir].
+ */
+void
+vips_cache_set_render_max_mem(size_t max_mem)
+{
+	g_mutex_lock(&vips_render_cache_lock);
+
+	vips_render_cache_max_mem = max_mem;
+	vips_render_cache_trim(max_mem);
+
+	g_mutex_unlock(&vips_render_cache_lock);
+}
+
+/**
+ * vips_cache_get_render_max_mem:
+ *
+ * Get the maximum size of the memory tier of the render cache.
+ *
+ * See also: [func@cache_set_render_max_mem].
+ *
+ * Returns: the maximum number of bytes of encoded images to keep
+ */
+size_t
+vips_cache_get_render_max_mem(void)
+{
+	return vips_render_cache_max_mem;
+}
+
+/**
+ * vips_cache_set_render_dir:
+ * @dir: (nullable): directory to keep encoded images in, or `NULL`
+ *
+ * Keep a copy of every image cached by the render cache in @dir as well,
+ * so results survive the memory tier and are shared between processes.
+ * Entries are named by their key, and libvips never removes them, so clear
+ * @dir from time to time.
+ *
+ * You can also set this with the environment variable
+ * `VIPS_CACHE_RENDER_DIR`. Pass `NULL` to turn the disc tier off.
+ *
+ * See also: [func@cache_set_render_max_mem].
+ */
+void
+vips_cache_set_render_dir(const char *dir)
+{
+	char *old = vips_render_cache_dir;
+
+	vips_render_cache_dir = g_strdup(dir);
+	g_free(old);
+}
+
+/**
+ * vips_cache_get_render_dir:
+ *
+ * Get the directory set with [func@cache_set_render_dir].
+ *
+ * Returns: (nullable): the render cache directory, or `NULL`
+ */
+const char *
+vips_cache_get_render_dir(void)
+{
+	return vips_render_cache_dir;
+}
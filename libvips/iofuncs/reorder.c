@@ -2,6 +2,9 @@
  *
  * 11/1/17
  * 	- first version
+ * 14/10/26
+ * 	- add vips__reorder_margin()
+ * 	- add vips__reorder_cache()
  */
 
 /*
@@ -376,6 +379,117 @@ vips_reorder_margin_hint(VipsImage *image, int margin)
 		reorder->cumulative_margin[i] += margin;
 }
 
+/* The largest cumulative margin over all the source images, so the area of
+ * the biggest window any operation in this pipeline uses.
+ */
+int
+vips__reorder_margin(VipsImage *image)
+{
+	VipsReorder *reorder;
+	int margin;
+	int i;
+
+	if (!(reorder = g_object_get_qdata(G_OBJECT(image),
+			  vips__image_reorder_quark)))
+		return 0;
+
+	margin = 0;
+	for (i = 0; i < reorder->n_sources; i++)
+		margin = VIPS_MAX(margin, reorder->cumulative_margin[i]);
+
+	return margin;
+}
+
+/* Set VIPS_NOAUTOCACHE to stop vips__reorder_cache() adding caches.
+ */
+static gboolean vips__reorder_autocache = TRUE;
+
+/* Add a cache when the upstream work we expect to repeat is more than this
+ * many times the cost of copying the cached pixels.
+ */
+#define VIPS_REORDER_CACHE_THRESHOLD (4.0)
+
+/* Cache an image which is about to be read with a window of width x height.
+ *
+ * Adjacent tiles overlap by the window size, so every overlap is computed
+ * again by the upstream pipeline. If the upstream pipeline has large
+ * windows of its own, this can be very costly. If the reorder margin says
+ * so, put a cache sized for one band of tiles between the two.
+ *
+ * Use a line cache if the image will be read sequentially, a tile cache
+ * otherwise.
+ *
+ * @out is always set, and is just @in with a ref if no cache is needed.
+ */
+int
+vips__reorder_cache(VipsImage *in, VipsImage **out, int width, int height)
+{
+	int upstream;
+	int tile_width;
+	int tile_height;
+	int n_lines;
+	double overlap;
+	VipsReorder *reorder;
+	int i;
+
+	upstream = vips__reorder_margin(in);
+	vips_get_tile_size(in, &tile_width, &tile_height, &n_lines);
+	tile_width = VIPS_MIN(tile_width, in->Xsize);
+	tile_height = VIPS_MIN(tile_height, in->Ysize);
+
+	/* The fraction of each input tile we expect to compute more than once.
+	 */
+	overlap = (double) (tile_width + width - 1) *
+			(tile_height + height - 1) /
+			((double) tile_width * tile_height) -
+		1.0;
+
+	if (!vips__reorder_autocache ||
+		overlap * upstream <= VIPS_REORDER_CACHE_THRESHOLD) {
+		*out = in;
+		g_object_ref(in);
+
+		return 0;
+	}
+
+	g_info("reorder: caching %s, window %d x %d, upstream margin %d",
+		in->filename ? in->filename : "image", width, height, upstream);
+
+	if (vips_image_get_typeof(in, VIPS_META_SEQUENTIAL)) {
+		if (vips_linecache(in, out,
+				"tile_height", tile_height,
+				"access", VIPS_ACCESS_SEQUENTIAL,
+				"threaded", TRUE,
+				NULL))
+			return -1;
+	}
+	else {
+		/* Enough tiles for every thread to hold the tiles under one
+		 * window, plus a row of neighbours.
+		 */
+		int across = (tile_width + width - 1) / tile_width + 2;
+		int down = (tile_height + height - 1) / tile_height + 2;
+
+		if (vips_tilecache(in, out,
+				"tile_width", tile_width,
+				"tile_height", tile_height,
+				"max_tiles", across * down * vips_concurrency_get(),
+				"access", VIPS_ACCESS_RANDOM,
+				"threaded", TRUE,
+				NULL))
+			return -1;
+	}
+
+	/* Pixels from the cache are cheap, so the upstream windows no longer
+	 * count.
+	 */
+	reorder = vips_reorder_get(*out);
+	for (i = 0; i < reorder->n_sources; i++)
+		reorder->cumulative_margin[i] = 0;
+
+	return 0;
+}
+
 void
 vips__reorder_clear(VipsImage *image)
 {
@@ -386,6 +500,9 @@ vips__reorder_clear(VipsImage *image)
 void
 vips__reorder_init(void)
 {
+	if (g_getenv("VIPS_NOAUTOCACHE"))
+		vips__reorder_autocache = FALSE;
+
 	if (!vips__image_reorder_quark)
 		vips__image_reorder_quark =
 			g_quark_from_static_string("vips-image-reorder");
@@ -0,0 +1,300 @@
+/* Share a fixed number of running workers between all threadpools.
+ *
+ * 14/10/26
+ * 	- from threadpool.c
+ */
+
+/*
+
+	This file is part of VIPS.
+
+	VIPS is free software; you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+	02110-1301  USA
+
+ */
+
+/*
+
+	These files are distributed with VIPS - http://www.vips.ecs.soton.ac.uk
+
+ */
+
+/*
+#define VIPS_DEBUG
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /*HAVE_CONFIG_H*/
+#include <glib/gi18n-lib.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <vips/vips.h>
+#include <vips/internal.h>
+#include <vips/debug.h>
+
+/* Each threadpool is a client of the scheduler. Workers must hold a slot
+ * while they compute a work unit, and there are only vips__scheduler_max
+ * slots for the whole process.
+ *
+ * When slots are short, a freed slot goes to a waiting worker from the
+ * client with the highest priority, and among those, the one which has had
+ * the least compute time for its weight.
+ */
+struct _VipsSchedulerClient {
+	int priority;
+	int weight;
+
+	/* Microseconds of work done while holding slots.
+	 */
+	gsize service; // (atomic)
+
+	/* Workers waiting for a slot, and slots handed over to this client
+	 * but not yet picked up. Both protected by vips_scheduler_lock.
+	 */
+	int n_waiting;
+	int n_granted;
+	GCond cond;
+};
+
+/* The number of slots, 0 for no limit.
+ */
+static int vips__scheduler_max = 0; // (atomic)
+
+/* Slots in use, and workers waiting for a slot.
+ */
+static int vips_scheduler_running = 0; // (atomic)
+static int vips_scheduler_waiting = 0; // (atomic)
+
+/* Protects the client list and the per-client wait counts.
+ */
+static GMutex vips_scheduler_lock;
+static GSList *vips_scheduler_clients = NULL;
+
+/* Take a slot if one is free. If the limit has been turned off since a
+ * client started, there are always free slots.
+ */
+static gboolean
+vips_scheduler_try_take(void)
+{
+	for (;;) {
+		int running = g_atomic_int_get(&vips_scheduler_running);
+		int max = g_atomic_int_get(&vips__scheduler_max);
+
+		if (max > 0 &&
+			running >= max)
+			return FALSE;
+		if (g_atomic_int_compare_and_exchange(&vips_scheduler_running,
+				running, running + 1))
+			return TRUE;
+	}
+}
+
+/* The waiting client which should get the next slot.
+ */
+static VipsSchedulerClient *
+vips_scheduler_best(void)
+{
+	VipsSchedulerClient *best;
+	GSList *p;
+
+	best = NULL;
+	for (p = vips_scheduler_clients; p; p = p->next) {
+		VipsSchedulerClient *client = (VipsSchedulerClient *) p->data;
+
+		if (client->n_waiting == 0)
+			continue;
+
+		if (!best ||
+			client->priority > best->priority ||
+			(client->priority == best->priority &&
+				(double) g_atomic_pointer_get(&client->service) /
+						client->weight <
+					(double) g_atomic_pointer_get(&best->service) /
+						best->weight))
+			best = client;
+	}
+
+	return best;
+}
+
+/* Hand any free slots to waiting workers. Call with the lock held.
+ */
+static void
+vips_scheduler_dispatch(void)
+{
+	VipsSchedulerClient *client;
+
+	while ((client = vips_scheduler_best()) &&
+		vips_scheduler_try_take()) {
+		client->n_waiting -= 1;
+		client->n_granted += 1;
+		g_atomic_int_add(&vips_scheduler_waiting, -1);
+		g_cond_signal(&client->cond);
+	}
+}
+
+/**
+ * vips_scheduler_set_max:
+ * @max: number of workers which can run at once
+ *
+ * Limit the number of threadpool workers which can be computing at the
+ * same time across the whole process. Each [func@threadpool_run] still
+ * starts up to [func@concurrency_get] workers, but when several pipelines
+ * run at once, they share @max slots rather than oversubscribing the
+ * cores.
+ *
+ * Free slots go to pipelines in order of [const@META_PRIORITY] on the
+ * image being computed, then in proportion to [const@META_WEIGHT], so a
+ * background pyramid build can run alongside thumbnail requests
+ * without slowing them down.
+ *
+ * The default is 0, meaning no limit. You can also set the environment
+ * variable `VIPS_SCHEDULER` to set a limit.
+ *
+ * Threadpools started from inside a work unit of another threadpool skip
+ * the scheduler, since their parent already holds a slot.
+ *
+ * ::: seealso
+ *     [func@scheduler_get_max], [func@concurrency_set].
+ */
+void
+vips_scheduler_set_max(int max)
+{
+	g_mutex_lock(&vips_scheduler_lock);
+
+	g_atomic_int_set(&vips__scheduler_max, VIPS_MAX(0, max));
+	vips_scheduler_dispatch();
+
+	g_mutex_unlock(&vips_scheduler_lock);
+}
+
+/**
+ * vips_scheduler_get_max:
+ *
+ * ::: seealso
+ *     [func@scheduler_set_max].
+ *
+ * Returns: the number of workers which can run at once, or 0 for no limit.
+ */
+int
+vips_scheduler_get_max(void)
+{
+	return g_atomic_int_get(&vips__scheduler_max);
+}
+
+/* Register a threadpool with the scheduler. Returns NULL if there's no
+ * limit, in which case workers need not acquire slots.
+ */
+VipsSchedulerClient *
+vips__scheduler_client_new(int priority, int weight)
+{
+	VipsSchedulerClient *client;
+
+	if (g_atomic_int_get(&vips__scheduler_max) <= 0)
+		return NULL;
+
+	client = g_new0(VipsSchedulerClient, 1);
+	client->priority = priority;
+	client->weight = VIPS_MAX(1, weight);
+	g_cond_init(&client->cond);
+
+	g_mutex_lock(&vips_scheduler_lock);
+	vips_scheduler_clients =
+		g_slist_prepend(vips_scheduler_clients, client);
+	g_mutex_unlock(&vips_scheduler_lock);
+
+	return client;
+}
+
+/* All workers must have released their slots.
+ */
+void
+vips__scheduler_client_free(VipsSchedulerClient *client)
+{
+	g_mutex_lock(&vips_scheduler_lock);
+
+	g_assert(client->n_waiting == 0);
+	g_assert(client->n_granted == 0);
+	vips_scheduler_clients =
+		g_slist_remove(vips_scheduler_clients, client);
+
+	g_mutex_unlock(&vips_scheduler_lock);
+
+	g_cond_clear(&client->cond);
+	g_free(client);
+}
+
+/* Wait for a slot. Returns the time we got it, for
+ * vips__scheduler_release().
+ */
+gint64
+vips__scheduler_acquire(VipsSchedulerClient *client)
+{
+	/* Fast path: nothing is queueing, so there's no one to be fair to.
+	 */
+	if (g_atomic_int_get(&vips_scheduler_waiting) == 0 &&
+		vips_scheduler_try_take())
+		return g_get_monotonic_time();
+
+	VIPS_GATE_START("vips__scheduler_acquire: wait");
+
+	g_mutex_lock(&vips_scheduler_lock);
+
+	/* Count ourselves as waiting before we look at the slots, so a
+	 * release on another thread either sees us, or we see its slot.
+	 */
+	client->n_waiting += 1;
+	g_atomic_int_inc(&vips_scheduler_waiting);
+	vips_scheduler_dispatch();
+
+	while (client->n_granted == 0)
+		vips__worker_cond_wait(&client->cond, &vips_scheduler_lock);
+	client->n_granted -= 1;
+
+	g_mutex_unlock(&vips_scheduler_lock);
+
+	VIPS_GATE_STOP("vips__scheduler_acquire: wait");
+
+	return g_get_monotonic_time();
+}
+
+void
+vips__scheduler_release(VipsSchedulerClient *client, gint64 start)
+{
+	g_atomic_pointer_add(&client->service,
+		(gssize) (g_get_monotonic_time() - start));
+
+	g_atomic_int_add(&vips_scheduler_running, -1);
+
+	if (g_atomic_int_get(&vips_scheduler_waiting) > 0) {
+		g_mutex_lock(&vips_scheduler_lock);
+		vips_scheduler_dispatch();
+		g_mutex_unlock(&vips_scheduler_lock);
+	}
+}
+
+/* Called from vips_init().
+ */
+void
+vips__scheduler_init(void)
+{
+	const char *str;
+
+	if ((str = g_getenv("VIPS_SCHEDULER")))
+		vips_scheduler_set_max(atoi(str));
+}
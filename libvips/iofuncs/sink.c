@@ -2,6 +2,9 @@
  *
  * 28/3/10
  * 	- from im_iterate(), reworked for threadpool
+ * 15/10/26
+ * 	- plan sequential loaders in vips_sink_base_init()
+ * 	- line tiles up with loader decode units
  */
 
 /*
@@ -351,6 +354,7 @@ sink_free(Sink *sink)
 	VIPS_FREEF(sink_area_free, sink->area);
 	VIPS_FREEF(sink_area_free, sink->old_area);
 	VIPS_FREEF(g_object_unref, sink->t);
+	vips_sink_base_free(&sink->sink_base);
 }
 
 void
@@ -368,8 +372,33 @@ vips_sink_base_init(SinkBase *sink_base, VipsImage *image)
 	vips_get_tile_size(image,
 		&sink_base->tile_width, &sink_base->tile_height,
 		&sink_base->n_lines);
+	vips__tile_size_align(image,
+		&sink_base->tile_width, &sink_base->tile_height,
+		&sink_base->n_lines);
 
 	sink_base->processed = 0;
+	sink_base->n_done = 0;
+
+	/* We compute top-to-bottom, so any loaders which don't need to decode
+	 * to a temp can stream instead.
+	 */
+	sink_base->planned = vips__sequential_plan(image);
+}
+
+void
+vips_sink_base_free(SinkBase *sink_base)
+{
+	VIPS_FREEF(vips__sequential_unplan, sink_base->planned);
+}
+
+/* Pixels can arrive in any order, so sinks can use the work-stealing
+ * scheduler, unless there's a sequential source upstream.
+ */
+gboolean
+vips_sink_base_can_steal(SinkBase *sink_base)
+{
+	return !sink_base->planned &&
+		vips_threadpool_can_steal(sink_base->im);
 }
 
 static int
@@ -424,6 +453,27 @@ sink_work(VipsThreadState *state, void *a)
 	return result;
 }
 
+/* Our VipsThreadpoolWork function in work-stealing mode. There's no
+ * allocate and no areas, the threadpool supplies the tile in state->pos.
+ */
+static int
+sink_steal_work(VipsThreadState *state, void *a)
+{
+	SinkThreadState *sstate = (SinkThreadState *) state;
+	Sink *sink = (Sink *) a;
+
+	int result;
+
+	result = vips_region_prepare(sstate->reg, &state->pos);
+	if (!result)
+		result = sink->generate_fn(sstate->reg, sstate->seq,
+			sink->a, sink->b, &state->stop);
+
+	g_atomic_int_inc(&sink->sink_base.n_done);
+
+	return result;
+}
+
 int
 vips_sink_base_progress(void *a)
 {
@@ -441,6 +491,22 @@ vips_sink_base_progress(void *a)
 	return 0;
 }
 
+/* Progress in work-stealing mode: estimate pixels processed from the number
+ * of tiles done.
+ */
+int
+vips_sink_base_steal_progress(void *a)
+{
+	SinkBase *sink_base = (SinkBase *) a;
+	guint64 n_done = g_atomic_int_get(&sink_base->n_done);
+
+	sink_base->processed = VIPS_MIN(
+		n_done * sink_base->tile_width * sink_base->tile_height,
+		VIPS_IMAGE_N_PELS(sink_base->im));
+
+	return vips_sink_base_progress(a);
+}
+
 /**
  * vips_sink_tile: (method)
  * @im: scan over this image
@@ -495,13 +561,22 @@ vips_sink_tile(VipsImage *im,
 	 */
 	vips_image_preeval(im);
 
-	sink_area_position(sink.area, 0, sink.sink_base.n_lines);
-	result = vips_threadpool_run(im,
-		vips_sink_thread_state_new,
-		sink_area_allocate_fn,
-		sink_work,
-		vips_sink_base_progress,
-		&sink);
+	if (vips_sink_base_can_steal(&sink.sink_base))
+		result = vips_threadpool_run_steal(im,
+			vips_sink_thread_state_new,
+			sink_steal_work,
+			vips_sink_base_steal_progress,
+			sink.sink_base.tile_width, sink.sink_base.tile_height,
+			&sink);
+	else {
+		sink_area_position(sink.area, 0, sink.sink_base.n_lines);
+		result = vips_threadpool_run(im,
+			vips_sink_thread_state_new,
+			sink_area_allocate_fn,
+			sink_work,
+			vips_sink_base_progress,
+			&sink);
+	}
 
 	vips_image_posteval(im);
 
@@ -60,14 +60,28 @@ typedef struct _SinkBase {
 	 * feedback.
 	 */
 	guint64 processed;
+
+	/* The number of tiles done in work-stealing mode, where there's no
+	 * allocate to count pixels for us.
+	 */
+	int n_done; // (atomic)
+
+	/* Loaders we switched to sequential for this sink, see
+	 * vips__sequential_plan().
+	 */
+	GSList *planned;
+
 } SinkBase;
 
 /* Some function we can share.
  */
 void vips_sink_base_init(SinkBase *sink_base, VipsImage *image);
+void vips_sink_base_free(SinkBase *sink_base);
+gboolean vips_sink_base_can_steal(SinkBase *sink_base);
 VipsThreadState *vips_sink_thread_state_new(VipsImage *im, void *a);
 int vips_sink_base_allocate(VipsThreadState *state, void *a, gboolean *stop);
 int vips_sink_base_progress(void *a);
+int vips_sink_base_steal_progress(void *a);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,447 @@
+/* Run a sink in the background and report completion.
+ *
+ * 14/10/26
+ * 	- from sinkdisc.c
+ */
+
+/*
+
+	This file is part of VIPS.
+
+	VIPS is free software; you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+	02110-1301  USA
+
+ */
+
+/*
+
+	These files are distributed with VIPS - http://www.vips.ecs.soton.ac.uk
+
+ */
+
+/*
+#define VIPS_DEBUG
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /*HAVE_CONFIG_H*/
+#include <glib/gi18n-lib.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif /*HAVE_UNISTD_H*/
+
+#ifndef G_OS_WIN32
+#include <glib-unix.h>
+#endif /*!G_OS_WIN32*/
+
+#include <vips/vips.h>
+#include <vips/internal.h>
+#include <vips/debug.h>
+
+typedef enum _VipsAsyncSink {
+	VIPS_ASYNC_DISC,
+	VIPS_ASYNC_MEMORY,
+	VIPS_ASYNC_TARGET
+} VipsAsyncSink;
+
+struct _VipsAsync {
+	/* One ref for the caller, one for the background thread.
+	 */
+	int ref_count; // (atomic)
+
+	VipsAsyncSink sink;
+	VipsImage *image;
+
+	/* For VIPS_ASYNC_DISC.
+	 */
+	VipsRegionWrite write_fn;
+	void *a;
+
+	/* For VIPS_ASYNC_TARGET.
+	 */
+	char *suffix;
+	VipsTarget *target;
+
+	VipsAsyncDoneFn done_fn;
+	void *b;
+
+	/* Protects finished, result and error.
+	 */
+	GMutex lock;
+	GCond cond;
+	gboolean finished;
+	int result;
+	char *error;
+
+	/* The read end becomes readable on completion.
+	 */
+	int fd[2];
+};
+
+static void
+vips_async_unref_internal(VipsAsync *async)
+{
+	if (!g_atomic_int_dec_and_test(&async->ref_count))
+		return;
+
+	VIPS_UNREF(async->image);
+	VIPS_UNREF(async->target);
+	VIPS_FREE(async->suffix);
+	VIPS_FREE(async->error);
+	g_mutex_clear(&async->lock);
+	g_cond_clear(&async->cond);
+#ifndef G_OS_WIN32
+	if (async->fd[0] >= 0)
+		close(async->fd[0]);
+	if (async->fd[1] >= 0)
+		close(async->fd[1]);
+#endif /*!G_OS_WIN32*/
+	g_free(async);
+}
+
+static void
+vips_async_run(void *data, void *user_data)
+{
+	VipsAsync *async = (VipsAsync *) data;
+
+	int result;
+
+	switch (async->sink) {
+	case VIPS_ASYNC_DISC:
+		result = vips_sink_disc(async->image, async->write_fn, async->a);
+		break;
+
+	case VIPS_ASYNC_MEMORY:
+		result = vips_sink_memory(async->image);
+		break;
+
+	case VIPS_ASYNC_TARGET:
+		result = vips_image_write_to_target(async->image,
+			async->suffix, async->target, NULL);
+		break;
+
+	default:
+		g_assert_not_reached();
+		result = -1;
+	}
+
+	g_mutex_lock(&async->lock);
+	async->result = result;
+	if (result)
+		async->error = g_strdup(vips_error_buffer());
+	async->finished = TRUE;
+	g_cond_broadcast(&async->cond);
+	g_mutex_unlock(&async->lock);
+
+#ifndef G_OS_WIN32
+	if (async->fd[1] >= 0) {
+		char ch = 1;
+
+		/* The pipe is empty, so this can't block or fail.
+		 */
+		(void) !write(async->fd[1], &ch, 1);
+	}
+#endif /*!G_OS_WIN32*/
+
+	if (async->done_fn)
+		async->done_fn(async, async->b);
+
+	vips_async_unref_internal(async);
+}
+
+static VipsAsync *
+vips_async_new(VipsAsyncSink sink, VipsImage *image,
+	VipsAsyncDoneFn done_fn, void *b)
+{
+	VipsAsync *async;
+
+	async = g_new0(VipsAsync, 1);
+	async->ref_count = 2;
+	async->sink = sink;
+	async->image = image;
+	g_object_ref(image);
+	async->done_fn = done_fn;
+	async->b = b;
+	g_mutex_init(&async->lock);
+	g_cond_init(&async->cond);
+	async->fd[0] = -1;
+	async->fd[1] = -1;
+
+#ifndef G_OS_WIN32
+	{
+		GError *error = NULL;
+
+		if (!g_unix_open_pipe(async->fd, FD_CLOEXEC, &error) ||
+			!g_unix_set_fd_nonblocking(async->fd[0], TRUE, &error)) {
+			vips_g_error(&error);
+			async->ref_count = 1;
+			vips_async_unref_internal(async);
+			return NULL;
+		}
+	}
+#endif /*!G_OS_WIN32*/
+
+	return async;
+}
+
+static VipsAsync *
+vips_async_start(VipsAsync *async)
+{
+	if (vips_thread_execute("async", vips_async_run, async)) {
+		/* Drop the ref the thread would have held, and ours.
+		 */
+		vips_async_unref_internal(async);
+		vips_async_unref_internal(async);
+		return NULL;
+	}
+
+	return async;
+}
+
+/**
+ * VipsAsync:
+ *
+ * A handle on a sink running in the background, see
+ * [func@sink_disc_async].
+ */
+
+/**
+ * VipsAsyncDoneFn:
+ * @async: the job that finished
+ * @a: client data
+ *
+ * Called from a background thread when an asynchronous sink completes,
+ * successfully or not. Use [method@Async.get_result] to find out which.
+ *
+ * It must not call [method@Async.wait].
+ */
+
+/**
+ * vips_sink_disc_async: (skip)
+ * @im: image to process
+ * @write_fn: called for every batch of pixels
+ * @a: client data for @write_fn
+ * @done_fn: (nullable): called on completion
+ * @b: client data for @done_fn
+ *
+ * Start [method@Image.sink_disc] running in the background and return
+ * at once. On completion, @done_fn is called from the background thread,
+ * and the descriptor returned by [method@Async.get_fd] becomes readable,
+ * so event loops can watch for the end of a render without blocking a
+ * thread.
+ *
+ * Stop a job early with [method@Async.cancel].
+ *
+ * The handle holds a ref to @im. Free it with [method@Async.unref].
+ *
+ * ::: seealso
+ *     [func@sink_memory_async], [func@image_write_to_target_async].
+ *
+ * Returns: a new handle, or `NULL` on error.
+ */
+VipsAsync *
+vips_sink_disc_async(VipsImage *im, VipsRegionWrite write_fn, void *a,
+	VipsAsyncDoneFn done_fn, void *b)
+{
+	VipsAsync *async;
+
+	if (!(async = vips_async_new(VIPS_ASYNC_DISC, im, done_fn, b)))
+		return NULL;
+	async->write_fn = write_fn;
+	async->a = a;
+
+	return vips_async_start(async);
+}
+
+/**
+ * vips_sink_memory_async: (skip)
+ * @im: image to process
+ * @done_fn: (nullable): called on completion
+ * @a: client data for @done_fn
+ *
+ * Start [method@Image.sink_memory] running in the background. See
+ * [func@sink_disc_async].
+ *
+ * Returns: a new handle, or `NULL` on error.
+ */
+VipsAsync *
+vips_sink_memory_async(VipsImage *im, VipsAsyncDoneFn done_fn, void *a)
+{
+	VipsAsync *async;
+
+	if (!(async = vips_async_new(VIPS_ASYNC_MEMORY, im, done_fn, a)))
+		return NULL;
+
+	return vips_async_start(async);
+}
+
+/**
+ * vips_image_write_to_target_async: (skip)
+ * @in: image to write
+ * @suffix: format to write, with save options
+ * @target: target to write to
+ * @done_fn: (nullable): called on completion
+ * @a: client data for @done_fn
+ *
+ * Start [method@Image.write_to_target] running in the background. Set save
+ * options in @suffix, for example `".jpg[Q=90]"`. See
+ * [func@sink_disc_async].
+ *
+ * The handle holds a ref to @target.
+ *
+ * Returns: a new handle, or `NULL` on error.
+ */
+VipsAsync *
+vips_image_write_to_target_async(VipsImage *in,
+	const char *suffix, VipsTarget *target,
+	VipsAsyncDoneFn done_fn, void *a)
+{
+	VipsAsync *async;
+
+	if (!(async = vips_async_new(VIPS_ASYNC_TARGET, in, done_fn, a)))
+		return NULL;
+	async->suffix = g_strdup(suffix);
+	async->target = target;
+	g_object_ref(target);
+
+	return vips_async_start(async);
+}
+
+/**
+ * vips_async_get_fd: (skip)
+ * @async: job to watch
+ *
+ * A file descriptor which becomes readable when the job completes, for
+ * adding to an event loop. It is owned by @async and closed by
+ * [method@Async.unref].
+ *
+ * Returns: a descriptor, or -1 on platforms without pipes.
+ */
+int
+vips_async_get_fd(VipsAsync *async)
+{
+	return async->fd[0];
+}
+
+/**
+ * vips_async_is_done: (skip)
+ * @async: job to test
+ *
+ * Returns: `TRUE` if the job has completed.
+ */
+gboolean
+vips_async_is_done(VipsAsync *async)
+{
+	gboolean finished;
+
+	g_mutex_lock(&async->lock);
+	finished = async->finished;
+	g_mutex_unlock(&async->lock);
+
+	return finished;
+}
+
+/**
+ * vips_async_get_result: (skip)
+ * @async: job to test
+ *
+ * The result of a completed job. On failure, the text of the libvips error
+ * buffer at the time is available from [method@Async.get_error].
+ *
+ * Returns: 0 on success, -1 on error or if the job is still running.
+ */
+int
+vips_async_get_result(VipsAsync *async)
+{
+	int result;
+
+	g_mutex_lock(&async->lock);
+	result = async->finished ? async->result : -1;
+	g_mutex_unlock(&async->lock);
+
+	return result;
+}
+
+/**
+ * vips_async_get_error: (skip)
+ * @async: job to test
+ *
+ * Returns: (nullable): the error message from a failed job, or `NULL`.
+ */
+const char *
+vips_async_get_error(VipsAsync *async)
+{
+	const char *error;
+
+	g_mutex_lock(&async->lock);
+	error = async->finished ? async->error : NULL;
+	g_mutex_unlock(&async->lock);
+
+	return error;
+}
+
+/**
+ * vips_async_wait: (skip)
+ * @async: job to wait for
+ *
+ * Block until the job completes. Don't call this from a
+ * [callback@AsyncDoneFn].
+ *
+ * Returns: 0 on success, -1 on error.
+ */
+int
+vips_async_wait(VipsAsync *async)
+{
+	int result;
+
+	g_mutex_lock(&async->lock);
+	while (!async->finished)
+		g_cond_wait(&async->cond, &async->lock);
+	result = async->result;
+	g_mutex_unlock(&async->lock);
+
+	return result;
+}
+
+/**
+ * vips_async_cancel: (skip)
+ * @async: job to stop
+ *
+ * Ask a job to stop, with [method@Image.set_kill]. The job finishes with an
+ * error soon after and the completion callback runs as usual.
+ */
+void
+vips_async_cancel(VipsAsync *async)
+{
+	vips_image_set_kill(async->image, TRUE);
+}
+
+/**
+ * vips_async_unref: (skip)
+ * @async: (transfer full): handle to drop
+ *
+ * Drop the caller's reference to @async. A job which is still running
+ * carries on, and its callback still runs.
+ */
+void
+vips_async_unref(VipsAsync *async)
+{
+	vips_async_unref_internal(async);
+}
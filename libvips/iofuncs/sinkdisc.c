@@ -9,6 +9,9 @@
  * 	- we could get stuck if allocate failed (thanks Tim)
  * 23/2/12
  * 	- we could deadlock if generate failed
+ * 15/10/26
+ * 	- write behind with a ring of up to 8 buffers, not just two
+ * 	- add vips_sink_disc_unordered()
  */
 
 /*
@@ -63,6 +66,14 @@
 
 #include "sink.h"
 
+/* Bursty outputs, like object storage or compressed savers with a variable
+ * cost per strip, can stall the workers if they have to wait for the
+ * previous strip to be written. We keep a ring of up to this many buffers,
+ * within this much memory, so that generation can run ahead of output.
+ */
+#define VIPS_SINK_DISC_MAX_BUFFERS (8)
+#define VIPS_SINK_DISC_MAX_MEM (64 * 1024 * 1024)
+
 /* A buffer we are going to write to disc in a background thread.
  */
 typedef struct _WriteBuffer {
@@ -77,6 +88,8 @@ typedef struct _WriteBuffer {
 	int write_errno;	  /* Save write errors here */
 	gboolean running;	  /* Whether the bg writer thread is running */
 	gboolean kill;		  /* Set to ask thread to exit */
+	int seq;			  /* Strip number, for ordering writes */
+	gboolean pending;	  /* Handed to the bg thread, done not yet seen */
 } WriteBuffer;
 
 /* Per-call state.
@@ -84,11 +97,22 @@ typedef struct _WriteBuffer {
 typedef struct _Write {
 	SinkBase sink_base;
 
-	/* We are current writing tiles to buf, buf_back is in the hands of
-	 * the bg write thread.
+	/* We are currently writing tiles to buf, the other buffers in the ring
+	 * are in the hands of their bg write threads, or idle.
 	 */
+	WriteBuffer *ring[VIPS_SINK_DISC_MAX_BUFFERS];
+	int n_buffers;
+	int current;
 	WriteBuffer *buf;
-	WriteBuffer *buf_back;
+
+	/* Strips are numbered as they are handed to the bg threads, and
+	 * written in that order unless the write is unordered.
+	 */
+	int n_started;
+	GMutex lock;
+	GCond cond;
+	int n_written;
+	gboolean unordered;
 
 	/* The file format write operation.
 	 */
@@ -99,13 +123,15 @@ typedef struct _Write {
 static int
 write_check_error(Write *write)
 {
-	if (write->buf->write_errno ||
-		write->buf_back->write_errno) {
-		vips_error_system(write->buf->write_errno ?
-			write->buf->write_errno : write->buf_back->write_errno,
-			"wbuffer_write", "%s", _("write failed"));
-		return -1;
-	}
+	int i;
+
+	for (i = 0; i < write->n_buffers; i++)
+		if (write->ring[i] &&
+			write->ring[i]->write_errno) {
+			vips_error_system(write->ring[i]->write_errno,
+				"wbuffer_write", "%s", _("write failed"));
+			return -1;
+		}
 
 	return 0;
 }
@@ -195,6 +221,7 @@ static void
 wbuffer_write_thread(void *data, void *user_data)
 {
 	WriteBuffer *wbuffer = (WriteBuffer *) data;
+	Write *write = wbuffer->write;
 
 	for (;;) {
 		/* Wait to be told to write.
@@ -208,7 +235,23 @@ wbuffer_write_thread(void *data, void *user_data)
 		 */
 		vips_semaphore_downn(&wbuffer->nwrite, 0);
 
-		wbuffer_write(wbuffer);
+		if (write->unordered)
+			wbuffer_write(wbuffer);
+		else {
+			/* Wait for the strips above us to be written.
+			 */
+			g_mutex_lock(&write->lock);
+			while (write->n_written != wbuffer->seq)
+				g_cond_wait(&write->cond, &write->lock);
+			g_mutex_unlock(&write->lock);
+
+			wbuffer_write(wbuffer);
+
+			g_mutex_lock(&write->lock);
+			write->n_written += 1;
+			g_cond_broadcast(&write->cond);
+			g_mutex_unlock(&write->lock);
+		}
 
 		/* Signal write complete.
 		 */
@@ -236,6 +279,8 @@ wbuffer_new(Write *write)
 	wbuffer->write_errno = 0;
 	wbuffer->running = FALSE;
 	wbuffer->kill = FALSE;
+	wbuffer->seq = 0;
+	wbuffer->pending = FALSE;
 
 	if (!(wbuffer->region = vips_region_new(write->sink_base.im))) {
 		wbuffer_free(wbuffer);
@@ -258,28 +303,30 @@ wbuffer_new(Write *write)
 	return wbuffer;
 }
 
-/* Block until the previous write completes, then write the front buffer.
+/* Set the front buffer writing. The bg threads keep the strips in order, so
+ * we don't need to wait for the previous write.
  */
-static int
+static void
 wbuffer_flush(Write *write)
 {
 	VIPS_DEBUG_MSG("wbuffer_flush:\n");
 
-	/* Block until the other buffer has been written. We have to do this
-	 * before we can set this buffer writing or we'll lose output ordering.
-	 */
-	if (write->buf->area.top > 0) {
-		vips_semaphore_down(&write->buf_back->done);
+	write->buf->seq = write->n_started++;
+	write->buf->pending = TRUE;
+	vips_semaphore_up(&write->buf->go);
+}
 
-		if (write_check_error(write))
-			return -1;
+/* Wait for any write in progress on a buffer.
+ */
+static int
+wbuffer_wait(Write *write, WriteBuffer *wbuffer)
+{
+	if (wbuffer->pending) {
+		vips_semaphore_down(&wbuffer->done);
+		wbuffer->pending = FALSE;
 	}
 
-	/* Set the background writer going for this buffer.
-	 */
-	vips_semaphore_up(&write->buf->go);
-
-	return 0;
+	return write_check_error(write);
 }
 
 /* Move a wbuffer to a position.
@@ -347,13 +394,9 @@ wbuffer_allocate_fn(VipsThreadState *state, void *a, gboolean *stop)
 						   "finished top = %d, height = %d\n",
 				write->buf->area.top, write->buf->area.height);
 
-			/* Block until the write of the previous buffer
-			 * is done, then set write of this buffer going.
+			/* Set write of this buffer going.
 			 */
-			if (wbuffer_flush(write)) {
-				*stop = TRUE;
-				return -1;
-			}
+			wbuffer_flush(write);
 
 			/* End of image?
 			 */
@@ -366,9 +409,15 @@ wbuffer_allocate_fn(VipsThreadState *state, void *a, gboolean *stop)
 						   "starting top = %d, height = %d\n",
 				sink_base->y, sink_base->n_lines);
 
-			/* Swap buffers.
+			/* Move to the next buffer in the ring, blocking
+			 * until any earlier write from it is done.
 			 */
-			VIPS_SWAP(WriteBuffer *, write->buf, write->buf_back);
+			write->current = (write->current + 1) % write->n_buffers;
+			write->buf = write->ring[write->current];
+			if (wbuffer_wait(write, write->buf)) {
+				*stop = TRUE;
+				return -1;
+			}
 
 			/* Position buf at the new y.
 			 */
@@ -448,23 +497,51 @@ wbuffer_work_fn(VipsThreadState *state, void *a)
 	return result;
 }
 
-static void
-write_init(Write *write,
-	VipsImage *image, VipsRegionWrite write_fn, void *a)
+static int
+write_init(Write *write, VipsImage *image,
+	VipsRegionWrite write_fn, void *a, gboolean unordered)
 {
+	size_t strip_size;
+	int i;
+
 	vips_sink_base_init(&write->sink_base, image);
 
-	write->buf = wbuffer_new(write);
-	write->buf_back = wbuffer_new(write);
+	write->current = 0;
+	write->n_started = 0;
+	g_mutex_init(&write->lock);
+	g_cond_init(&write->cond);
+	write->n_written = 0;
+	write->unordered = unordered;
 	write->write_fn = write_fn;
 	write->a = a;
+
+	/* At least double-buffer, however large the strips are.
+	 */
+	strip_size = VIPS_MAX(1,
+		VIPS_IMAGE_SIZEOF_LINE(image) * write->sink_base.n_lines);
+	write->n_buffers = VIPS_CLIP(2,
+		VIPS_SINK_DISC_MAX_MEM / strip_size, VIPS_SINK_DISC_MAX_BUFFERS);
+
+	for (i = 0; i < write->n_buffers; i++)
+		write->ring[i] = NULL;
+	for (i = 0; i < write->n_buffers; i++)
+		if (!(write->ring[i] = wbuffer_new(write)))
+			return -1;
+	write->buf = write->ring[0];
+
+	return 0;
 }
 
 static void
 write_free(Write *write)
 {
-	VIPS_FREEF(wbuffer_free, write->buf);
-	VIPS_FREEF(wbuffer_free, write->buf_back);
+	int i;
+
+	for (i = 0; i < write->n_buffers; i++)
+		VIPS_FREEF(wbuffer_free, write->ring[i]);
+	g_mutex_clear(&write->lock);
+	g_cond_clear(&write->cond);
+	vips_sink_base_free(&write->sink_base);
 }
 
 /**
@@ -504,19 +581,18 @@ write_free(Write *write)
  *
  * Returns: 0 on success, -1 on error.
  */
-int
-vips_sink_disc(VipsImage *im, VipsRegionWrite write_fn, void *a)
+static int
+vips_sink_disc_run(VipsImage *im,
+	VipsRegionWrite write_fn, void *a, gboolean unordered)
 {
 	Write write;
 	int result;
+	int i;
 
 	vips_image_preeval(im);
 
-	write_init(&write, im, write_fn, a);
-
 	result = 0;
-	if (!write.buf ||
-		!write.buf_back ||
+	if (write_init(&write, im, write_fn, a, unordered) ||
 		wbuffer_position(write.buf, 0, write.sink_base.n_lines) ||
 		vips_threadpool_run(im,
 			write_thread_state_new,
@@ -526,23 +602,25 @@ vips_sink_disc(VipsImage *im, VipsRegionWrite write_fn, void *a)
 			&write))
 		result = -1;
 
-	/* Just before allocate signalled stop, it set write.buf writing. We
-	 * need to wait for this write to finish.
+	/* Wait for every buffer we set writing to finish, even on error.
 	 *
 	 * We can't just free the buffers (which will wait for the bg threads
-	 * to finish), since the bg thread might see the kill before it gets a
-	 * chance to write.
+	 * to finish), since a bg thread might see the kill before it gets a
+	 * chance to write, and a later strip could then wait for it forever.
 	 *
-	 * If the pool exited with an error, write.buf might not have been
-	 * started (if the allocate failed), and in any case, we don't care if
-	 * the final write went through or not.
+	 * The pool has exited, so all workers have left the buffers and
+	 * every pending write will complete.
 	 */
-	if (!result)
-		vips_semaphore_down(&write.buf->done);
+	for (i = 0; i < write.n_buffers; i++)
+		if (write.ring[i] &&
+			write.ring[i]->pending) {
+			vips_semaphore_down(&write.ring[i]->done);
+			write.ring[i]->pending = FALSE;
+		}
 
 	vips_image_posteval(im);
 
-	/* The final write might have failed, pick up any error code.
+	/* The final writes might have failed, pick up any error code.
 	 */
 	result |= write_check_error(&write);
 
@@ -552,3 +630,34 @@ vips_sink_disc(VipsImage *im, VipsRegionWrite write_fn, void *a)
 
 	return result;
 }
+
+int
+vips_sink_disc(VipsImage *im, VipsRegionWrite write_fn, void *a)
+{
+	return vips_sink_disc_run(im, write_fn, a, FALSE);
+}
+
+/**
+ * vips_sink_disc_unordered: (method)
+ * @im: image to process
+ * @write_fn: (scope call) (closure a): called for every batch of pixels
+ * @a: client data
+ *
+ * As [method@Image.sink_disc], but @write_fn may be called for several
+ * sections at once from different threads, and sections may arrive in any
+ * order.
+ *
+ * Use this for outputs which can write to any position independently, such
+ * as `pwrite()` to a file, so that a slow write does not hold up the
+ * strips below it.
+ *
+ * ::: seealso
+ *     [method@Image.sink_disc].
+ *
+ * Returns: 0 on success, -1 on error.
+ */
+int
+vips_sink_disc_unordered(VipsImage *im, VipsRegionWrite write_fn, void *a)
+{
+	return vips_sink_disc_run(im, write_fn, a, TRUE);
+}
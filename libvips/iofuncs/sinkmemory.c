@@ -8,6 +8,8 @@
  * 	- from sinkdisc.c
  * 23/2/12
  * 	- we could deadlock if generate failed
+ * 15/10/26
+ * 	- add vips_sink_memory_stride()
  */
 
 /*
@@ -48,6 +50,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <limits.h>
 
 #include <vips/vips.h>
 #include <vips/internal.h>
@@ -76,7 +79,8 @@ typedef struct _SinkMemory {
 	SinkMemoryArea *old_area;
 
 	/* A region covering the whole of the output image ... we write to
-	 * this from many workers with vips_region_prepare_to().
+	 * this from many workers with vips_region_prepare_to(). This is
+	 * either the image's own memory, or memory the caller gave us.
 	 */
 	VipsRegion *region;
 } SinkMemory;
@@ -274,16 +278,35 @@ sink_memory_area_work_fn(VipsThreadState *state, void *a)
 	return result;
 }
 
+/* The same, but for work-stealing mode, where there are no areas to track.
+ */
+static int
+sink_memory_steal_work_fn(VipsThreadState *state, void *a)
+{
+	SinkMemory *memory = (SinkMemory *) a;
+
+	int result;
+
+	result = vips_region_prepare_to(state->reg, memory->region,
+		&state->pos, state->pos.left, state->pos.top);
+
+	g_atomic_int_inc(&memory->sink_base.n_done);
+
+	return result;
+}
+
 static void
 sink_memory_free(SinkMemory *memory)
 {
 	VIPS_FREEF(sink_memory_area_free, memory->area);
 	VIPS_FREEF(sink_memory_area_free, memory->old_area);
 	VIPS_UNREF(memory->region);
+	vips_sink_base_free(&memory->sink_base);
 }
 
 static int
-sink_memory_init(SinkMemory *memory, VipsImage *image)
+sink_memory_init(SinkMemory *memory, VipsImage *image,
+	VipsPel *data, size_t stride)
 {
 	VipsRect all;
 
@@ -296,9 +319,19 @@ sink_memory_init(SinkMemory *memory, VipsImage *image)
 	all.width = image->Xsize;
 	all.height = image->Ysize;
 
-	if (!(memory->region = vips_region_new(image)) ||
-		vips_region_image(memory->region, &all) ||
-		!(memory->area = sink_memory_area_new(memory)) ||
+	if (!(memory->region = vips_region_new(image))) {
+		sink_memory_free(memory);
+		return -1;
+	}
+
+	if (data)
+		vips__region_memory(memory->region, data, stride);
+	else if (vips_region_image(memory->region, &all)) {
+		sink_memory_free(memory);
+		return -1;
+	}
+
+	if (!(memory->area = sink_memory_area_new(memory)) ||
 		!(memory->old_area = sink_memory_area_new(memory))) {
 		sink_memory_free(memory);
 		return -1;
@@ -322,22 +355,41 @@ sink_memory_init(SinkMemory *memory, VipsImage *image)
  */
 int
 vips_sink_memory(VipsImage *image)
+{
+	return vips__sink_memory(image, NULL, 0);
+}
+
+/* Generate @image to its own memory, or to @data if set.
+ */
+int
+vips__sink_memory(VipsImage *image, VipsPel *data, size_t stride)
 {
 	SinkMemory memory;
 	int result;
 
-	if (sink_memory_init(&memory, image))
+	if (sink_memory_init(&memory, image, data, stride))
 		return -1;
 
 	vips_image_preeval(image);
 
-	sink_memory_area_position(memory.area, 0, memory.sink_base.n_lines);
-	result = vips_threadpool_run(image,
-		sink_memory_thread_state_new,
-		sink_memory_area_allocate_fn,
-		sink_memory_area_work_fn,
-		vips_sink_base_progress,
-		&memory);
+	if (vips_sink_base_can_steal(&memory.sink_base))
+		result = vips_threadpool_run_steal(image,
+			sink_memory_thread_state_new,
+			sink_memory_steal_work_fn,
+			vips_sink_base_steal_progress,
+			memory.sink_base.tile_width,
+			memory.sink_base.tile_height,
+			&memory);
+	else {
+		sink_memory_area_position(memory.area,
+			0, memory.sink_base.n_lines);
+		result = vips_threadpool_run(image,
+			sink_memory_thread_state_new,
+			sink_memory_area_allocate_fn,
+			sink_memory_area_work_fn,
+			vips_sink_base_progress,
+			&memory);
+	}
 
 	vips_image_posteval(image);
 
@@ -349,3 +401,43 @@ vips_sink_memory(VipsImage *image)
 
 	return result;
 }
+
+/**
+ * vips_sink_memory_stride:
+ * @im: generate this image
+ * @data: (array length=size) (element-type guint8): write pixels here
+ * @size: size of @data in bytes
+ * @stride: bytes from the start of one line to the start of the next
+ *
+ * Loops over @im, generating it straight into @data, memory owned by the
+ * caller. Lines start @stride bytes apart, so @data can be part of a larger
+ * buffer, for example a frame with padding on each line or a strided array
+ * from another library. Each worker writes its tiles in place, so there is
+ * no copy.
+ *
+ * @data does not need to be aligned. Pixels are written as in @im, so
+ * use something like [method@Image.bandjoin] first if you need a different
+ * band order.
+ *
+ * ::: seealso
+ *     [method@Image.sink_memory], [method@Image.write_to_memory].
+ *
+ * Returns: 0 on success, or -1 on error.
+ */
+int
+vips_sink_memory_stride(VipsImage *im, void *data, size_t size, size_t stride)
+{
+	size_t line = VIPS_IMAGE_SIZEOF_LINE(im);
+
+	if (stride < line ||
+		stride > INT_MAX) {
+		vips_error("vips_sink_memory_stride", "%s", _("bad stride"));
+		return -1;
+	}
+	if (size < stride * (im->Ysize - 1) + line) {
+		vips_error("vips_sink_memory_stride", "%s", _("buffer too small"));
+		return -1;
+	}
+
+	return vips__sink_memory(im, (VipsPel *) data, stride);
+}
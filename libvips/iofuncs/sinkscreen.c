@@ -10,6 +10,13 @@
  * 1/12/15
  * 	- don't do anything to out or mask after they have closed
  * 	- only run the bg render thread when there's work to do
+ * 15/10/26
+ * 	- add vips_sink_screen_set_viewport() ... paint visible tiles first,
+ * 	  then prefetch a ring around them
+ * 	- add vips_sink_screen_invalidate() to only repaint changed tiles
+ * 	- renders take turns of RENDER_TURN_TILES tiles, round-robin within a
+ * 	  priority
+ * 	- add vips_sink_screen_set_max_workers()
  */
 
 /*
@@ -76,6 +83,12 @@
 static int render_num_renders = 0;
 #endif /*VIPS_DEBUG_AMBER*/
 
+/* The bg render thread paints at most this many tiles from a render before
+ * moving on to the next render of the same priority. This stops one busy
+ * view starving all the others.
+ */
+#define RENDER_TURN_TILES (16)
+
 /* A tile in our cache.
  */
 typedef struct {
@@ -142,6 +155,7 @@ typedef struct _Render {
 	GSList *all;			/* All our tiles */
 	int ntiles;				/* Number of tiles */
 	int ticks;				/* Inc. on each access ... used for LRU */
+	int turn;				/* Tiles painted in this turn */
 
 	/* List of dirty tiles. Most recent at the front.
 	 */
@@ -151,6 +165,14 @@ typedef struct _Render {
 	 */
 	GHashTable *tiles;
 
+	/* The area of @out the user can see, and a ring one tile wide around
+	 * it that we prefetch. Dirty tiles in the viewport are painted
+	 * first, then dirty tiles in the prefetch area, then everything else.
+	 */
+	gboolean has_viewport;
+	VipsRect viewport;
+	VipsRect prefetch;
+
 	/* A shutdown flag. If ->out or ->mask close, we must no longer do
 	 * anything to them until we shut down too.
 	 */
@@ -194,6 +216,14 @@ static VipsSemaphore n_render_dirty_sem;
  */
 static gboolean render_reschedule = FALSE;
 
+/* The number of workers which can be painting tiles at once, across all
+ * renders, or 0 for no limit. Protected by render_workers_lock.
+ */
+static GMutex render_workers_lock;
+static GCond render_workers_cond;
+static int render_workers_max = 0;
+static int render_workers_running = 0;
+
 /* Set this GPrivate to link a thread back to its Render struct.
  */
 static GPrivate render_worker_key;
@@ -327,6 +357,23 @@ render_unref(Render *render)
 	return 0;
 }
 
+/* Find the most recent dirty tile which touches @area.
+ */
+static Tile *
+render_tile_dirty_find(Render *render, VipsRect *area)
+{
+	GSList *p;
+
+	for (p = render->dirty; p; p = p->next) {
+		Tile *tile = (Tile *) p->data;
+
+		if (vips_rect_overlapsrect(&tile->area, area))
+			return tile;
+	}
+
+	return NULL;
+}
+
 /* Get the next tile to paint off the dirty list.
  */
 static Tile *
@@ -337,7 +384,13 @@ render_tile_dirty_get(Render *render)
 	if (!render->dirty)
 		tile = NULL;
 	else {
-		tile = (Tile *) render->dirty->data;
+		tile = NULL;
+		if (render->has_viewport &&
+			!(tile = render_tile_dirty_find(render, &render->viewport)))
+			tile = render_tile_dirty_find(render, &render->prefetch);
+		if (!tile)
+			tile = (Tile *) render->dirty->data;
+
 		g_assert(tile->dirty);
 		render->dirty = g_slist_remove(render->dirty, tile);
 		tile->dirty = FALSE;
@@ -358,7 +411,21 @@ render_tile_dirty_reuse(Render *render)
 	if (!render->dirty)
 		tile = NULL;
 	else {
+		GSList *p;
+
+		/* The oldest dirty tile, but try not to take one the user
+		 * can see.
+		 */
 		tile = (Tile *) g_slist_last(render->dirty)->data;
+		if (render->has_viewport)
+			for (p = render->dirty; p; p = p->next) {
+				Tile *candidate = (Tile *) p->data;
+
+				if (!vips_rect_overlapsrect(&candidate->area,
+						&render->viewport))
+					tile = candidate;
+			}
+
 		render->dirty = g_slist_remove(render->dirty, tile);
 		g_assert(tile->dirty);
 		tile->dirty = FALSE;
@@ -414,19 +481,44 @@ render_allocate(VipsThreadState *state, void *a, gboolean *stop)
 	g_mutex_lock(&render->lock);
 
 	if (render_reschedule ||
+		render->turn >= RENDER_TURN_TILES ||
 		!(tile = render_tile_dirty_get(render))) {
 		VIPS_DEBUG_MSG_GREEN("render_allocate: stopping\n");
 		*stop = TRUE;
 		rstate->tile = NULL;
 	}
-	else
+	else {
 		rstate->tile = tile;
+		render->turn += 1;
+	}
 
 	g_mutex_unlock(&render->lock);
 
 	return 0;
 }
 
+/* Wait for a render worker slot.
+ */
+static void
+render_workers_acquire(void)
+{
+	g_mutex_lock(&render_workers_lock);
+	while (render_workers_max > 0 &&
+		render_workers_running >= render_workers_max)
+		vips__worker_cond_wait(&render_workers_cond, &render_workers_lock);
+	render_workers_running += 1;
+	g_mutex_unlock(&render_workers_lock);
+}
+
+static void
+render_workers_release(void)
+{
+	g_mutex_lock(&render_workers_lock);
+	render_workers_running -= 1;
+	g_cond_signal(&render_workers_cond);
+	g_mutex_unlock(&render_workers_lock);
+}
+
 static int
 render_work(VipsThreadState *state, void *a)
 {
@@ -444,13 +536,16 @@ render_work(VipsThreadState *state, void *a)
 	 */
 	g_private_set(&render_worker_key, render);
 
+	render_workers_acquire();
 	if (vips_region_prepare_to(state->reg, tile->region,
 			&tile->area, tile->area.left, tile->area.top)) {
 		VIPS_DEBUG_MSG_RED("render_work: vips_region_prepare_to() failed: %s\n",
 			vips_error_buffer());
+		render_workers_release();
 		g_private_set(&render_worker_key, NULL);
 		return -1;
 	}
+	render_workers_release();
 	tile->painted = TRUE;
 
 	if (!render->shutdown &&
@@ -510,7 +605,10 @@ render_dirty_put(Render *render)
 
 		if (render->dirty) {
 			if (!g_slist_find(render_dirty_all, render)) {
-				render_dirty_all = g_slist_prepend(render_dirty_all, render);
+				/* Append, and the sort is stable, so renders
+				 * of the same priority take turns.
+				 */
+				render_dirty_all = g_slist_append(render_dirty_all, render);
 				render_dirty_all = g_slist_sort(render_dirty_all,
 					(GCompareFunc) render_dirty_sort);
 
@@ -621,17 +719,25 @@ render_new(VipsImage *in, VipsImage *out, VipsImage *mask,
 	render->all = NULL;
 	render->ntiles = 0;
 	render->ticks = 0;
+	render->turn = 0;
 
 	render->tiles = g_hash_table_new(tile_hash, tile_equal);
 
 	render->dirty = NULL;
 
+	render->has_viewport = FALSE;
+
 	render->shutdown = FALSE;
 
 	/* Both out and mask must close before we can free the render.
 	 */
 	g_signal_connect(out, "close", G_CALLBACK(render_close_cb), render);
 
+	/* So vips_sink_screen_set_viewport() etc. can find us. @out holds a
+	 * ref to the render, so this stays valid while @out is alive.
+	 */
+	g_object_set_data(G_OBJECT(out), "vips-sink-screen", render);
+
 	if (mask) {
 		g_signal_connect(mask, "close", G_CALLBACK(render_close_cb), render);
 		render_ref(render);
@@ -1048,6 +1154,10 @@ render_thread_main(void *client)
 		render_reschedule = FALSE;
 
 		if ((render = render_dirty_get())) {
+			g_mutex_lock(&render->lock);
+			render->turn = 0;
+			g_mutex_unlock(&render->lock);
+
 			if (vips_threadpool_run(render->in,
 					render_thread_state_new,
 					render_allocate,
@@ -1137,13 +1247,68 @@ render_work_private(void *data, void *null)
 	VIPS_DEBUG_MSG_AMBER("render_work_private: stop\n");
 }
 
+/**
+ * vips_sink_screen_set_max_workers:
+ * @max: number of render workers which can run at once
+ *
+ * Limit the number of workers which can be painting tiles for
+ * [method@Image.sink_screen] at the same time, across all renders. This is
+ * separate from [func@concurrency_set], so a server with many open views
+ * can keep interactive rendering to a few cores and leave the rest for
+ * other work.
+ *
+ * Renders also take turns: the background render thread paints a few
+ * tiles from one render, then moves on to the next render with the same
+ * priority, so every view makes progress.
+ *
+ * The default is 0, meaning no limit. You can also set the environment
+ * variable `VIPS_RENDER_WORKERS` to set a limit.
+ *
+ * ::: seealso
+ *     [func@sink_screen_get_max_workers], [func@scheduler_set_max].
+ */
+void
+vips_sink_screen_set_max_workers(int max)
+{
+	g_mutex_lock(&render_workers_lock);
+	render_workers_max = VIPS_MAX(0, max);
+	g_cond_broadcast(&render_workers_cond);
+	g_mutex_unlock(&render_workers_lock);
+}
+
+/**
+ * vips_sink_screen_get_max_workers:
+ *
+ * ::: seealso
+ *     [func@sink_screen_set_max_workers].
+ *
+ * Returns: the number of render workers which can run at once, or 0 for
+ * no limit.
+ */
+int
+vips_sink_screen_get_max_workers(void)
+{
+	int max;
+
+	g_mutex_lock(&render_workers_lock);
+	max = render_workers_max;
+	g_mutex_unlock(&render_workers_lock);
+
+	return max;
+}
+
 static void *
 vips__sink_screen_once(void *data)
 {
+	const char *str;
+
 	g_assert(!render_thread);
 
 	vips_semaphore_init(&n_render_dirty_sem, 0, "n_render_dirty");
 
+	if ((str = g_getenv("VIPS_RENDER_WORKERS")))
+		vips_sink_screen_set_max_workers(atoi(str));
+
 	/* Don't use vips_thread_execute(), since this thread will only be
 	 * ended by vips_shutdown, and that isn't always called.
 	 */
@@ -1280,3 +1445,162 @@ vips__print_renders(void)
 
 	return n_leaks;
 }
+
+static Render *
+render_from_image(const char *domain, VipsImage *out)
+{
+	Render *render;
+
+	if (!(render = (Render *)
+				g_object_get_data(G_OBJECT(out), "vips-sink-screen"))) {
+		vips_error(domain, "%s", _("not made by vips_sink_screen()"));
+		return NULL;
+	}
+
+	return render;
+}
+
+/**
+ * vips_sink_screen_set_viewport: (method)
+ * @out: output image from [method@Image.sink_screen]
+ * @viewport: the area of @out the user can see
+ *
+ * Tell a background render which part of @out is on screen. Dirty tiles
+ * which touch @viewport are painted first, then tiles in a ring one tile
+ * wide around it. Tiles in this ring which are not in cache are queued for
+ * painting too, as long as there is free space in the cache. Tiles are
+ * never evicted to make room for a prefetch.
+ *
+ * Call this again whenever the view scrolls or resizes.
+ *
+ * ::: seealso
+ *     [method@Image.sink_screen], [method@Image.sink_screen_invalidate].
+ *
+ * Returns: 0 on success, -1 on error.
+ */
+int
+vips_sink_screen_set_viewport(VipsImage *out, VipsRect *viewport)
+{
+	Render *render;
+	VipsRect image;
+	int tile_width;
+	int tile_height;
+	int xs, ys;
+	int x, y;
+
+	if (!(render = render_from_image("vips_sink_screen_set_viewport", out)))
+		return -1;
+
+	tile_width = render->tile_width;
+	tile_height = render->tile_height;
+
+	image.left = 0;
+	image.top = 0;
+	image.width = out->Xsize;
+	image.height = out->Ysize;
+
+	g_mutex_lock(&render->lock);
+
+	vips_rect_intersectrect(viewport, &image, &render->viewport);
+	render->prefetch = render->viewport;
+	vips_rect_marginadjust(&render->prefetch,
+		VIPS_MAX(tile_width, tile_height));
+	vips_rect_intersectrect(&render->prefetch, &image, &render->prefetch);
+	render->has_viewport = !vips_rect_isempty(&render->viewport);
+
+	/* Queue any uncached tiles in the viewport and the ring around it. We
+	 * can only do this for async renders.
+	 */
+	if (render->has_viewport &&
+		render->notify &&
+		!render->shutdown) {
+		xs = (render->prefetch.left / tile_width) * tile_width;
+		ys = (render->prefetch.top / tile_height) * tile_height;
+
+		for (y = ys; y < VIPS_RECT_BOTTOM(&render->prefetch);
+			 y += tile_height)
+			for (x = xs; x < VIPS_RECT_RIGHT(&render->prefetch);
+				 x += tile_width) {
+				VipsRect area;
+				Tile *tile;
+
+				area.left = x;
+				area.top = y;
+				area.width = tile_width;
+				area.height = tile_height;
+
+				if (render_tile_lookup(render, &area))
+					continue;
+
+				if ((render->max_tiles != -1 &&
+						render->ntiles >= render->max_tiles) ||
+					!(tile = tile_new(render)))
+					break;
+
+				render_tile_add(tile, &area);
+				tile_queue(tile, NULL);
+			}
+	}
+
+	g_mutex_unlock(&render->lock);
+
+	return 0;
+}
+
+/**
+ * vips_sink_screen_invalidate: (method)
+ * @out: output image from [method@Image.sink_screen]
+ * @image: the image that was modified
+ * @rect: the area of @out which changed
+ *
+ * Call this after destructively modifying @image, an image upstream of
+ * @out, for example with [method@Image.draw_circle]. It does
+ * [method@Image.invalidate_all] on @image, but then keeps any painted
+ * tiles of @out which do not touch @rect, so only the changed part of the
+ * screen is recalculated. Painted tiles which touch @rect are queued for
+ * repaint, and @notify_fn will be called as they are done.
+ *
+ * You need to map the area you changed in @image to the coordinates of
+ * @out yourself. If you don't know which part of @out changed, use
+ * [method@Image.invalidate_all] instead.
+ *
+ * ::: seealso
+ *     [method@Image.sink_screen], [method@Image.invalidate_all].
+ *
+ * Returns: 0 on success, -1 on error.
+ */
+int
+vips_sink_screen_invalidate(VipsImage *out, VipsImage *image, VipsRect *rect)
+{
+	Render *render;
+	GSList *p;
+
+	if (!(render = render_from_image("vips_sink_screen_invalidate", out)))
+		return -1;
+
+	vips_image_invalidate_all(image);
+
+	g_mutex_lock(&render->lock);
+
+	for (p = render->all; p; p = p->next) {
+		Tile *tile = (Tile *) p->data;
+
+		if (!tile->painted)
+			continue;
+
+		/* Pixels in tiles outside @rect are still good. Invalidate
+		 * only sets a flag, it doesn't free the buffer.
+		 */
+		if (!vips_rect_overlapsrect(&tile->area, rect))
+			tile->region->invalid = FALSE;
+		else if (render->notify &&
+			!render->shutdown) {
+			tile_dirty_set(tile);
+			render_dirty_put(render);
+		}
+	}
+
+	g_mutex_unlock(&render->lock);
+
+	return 0;
+}
@@ -14,6 +14,8 @@
  * 	- fix named pipes
  * 10/5/22
  * 	- add vips_source_new_from_target()
+ * 14/10/26
+ * 	- ask the kernel to read ahead of file sources in decode phase
  */
 
 /*
@@ -353,6 +355,32 @@ vips_source_build(VipsObject *object)
 	return 0;
 }
 
+/* During decode, keep this many bytes in flight ahead of the read point.
+ * Loaders read in small chunks, and on a high latency filesystem each
+ * chunk the kernel hasn't already fetched stalls the worker.
+ */
+#define VIPS_SOURCE_READAHEAD (4 * 1024 * 1024)
+
+/* Start async fetch of the next window each time the read point crosses
+ * half a window, so the window is never allowed to run dry.
+ */
+static void
+vips_source_readahead(VipsSource *source, gint64 from, gint64 to)
+{
+#ifdef HAVE_POSIX_FADVISE
+	VipsConnection *connection = VIPS_CONNECTION(source);
+	const gint64 half = VIPS_SOURCE_READAHEAD / 2;
+
+	if (source->decode &&
+		!source->is_pipe &&
+		from / half != to / half)
+		/* Only a hint, so ignore errors.
+		 */
+		(void) posix_fadvise(connection->descriptor,
+			to, VIPS_SOURCE_READAHEAD, POSIX_FADV_WILLNEED);
+#endif /*HAVE_POSIX_FADVISE*/
+}
+
 static gint64
 vips_source_read_real(VipsSource *source, void *data, size_t length)
 {
@@ -366,6 +394,10 @@ vips_source_read_real(VipsSource *source, void *data, size_t length)
 		bytes_read = read(connection->descriptor, data, length);
 	} while (bytes_read < 0 && errno == EINTR);
 
+	if (bytes_read > 0)
+		vips_source_readahead(source,
+			source->read_position, source->read_position + bytes_read);
+
 	return bytes_read;
 }
 
@@ -707,6 +739,20 @@ vips_source_unminimise(VipsSource *source)
 			if (vips__seek(connection->descriptor,
 					source->read_position, SEEK_SET) == -1)
 				return -1;
+
+#ifdef HAVE_POSIX_FADVISE
+			/* Pixel decode is a linear scan, so the kernel can
+			 * use a larger readahead window, and we prime the
+			 * first one ourselves.
+			 */
+			if (source->decode) {
+				(void) posix_fadvise(connection->descriptor,
+					0, 0, POSIX_FADV_SEQUENTIAL);
+				(void) posix_fadvise(connection->descriptor,
+					source->read_position, VIPS_SOURCE_READAHEAD,
+					POSIX_FADV_WILLNEED);
+			}
+#endif /*HAVE_POSIX_FADVISE*/
 		}
 	}
 
@@ -2,6 +2,9 @@
  * sources.
  *
  * J.Cupitt, 21/11/19
+ *
+ * 14/10/26
+ * 	- add vips_source_custom_set_block_cache() and the ::prefetch signal
  */
 
 /*
@@ -65,11 +68,90 @@ G_DEFINE_TYPE(VipsSourceCustom, vips_source_custom, VIPS_TYPE_SOURCE);
 enum {
 	SIG_SEEK,
 	SIG_READ,
+	SIG_PREFETCH,
 	SIG_LAST
 };
 
 static guint vips_source_custom_signals[SIG_LAST] = { 0 };
 
+/* A cached, block aligned chunk of the source.
+ */
+typedef struct _VipsSourceBlock {
+	gint64 index;
+
+	/* Less than block_size for the final block.
+	 */
+	size_t length;
+	unsigned char *data;
+
+	/* Our link in the LRU queue.
+	 */
+	GList link;
+} VipsSourceBlock;
+
+/* The block cache. Random access loaders make many small reads all over the
+ * file, and for remote sources every read signal can be a separate request.
+ * We serve reads from block_size chunks, and fetch runs of missing blocks
+ * with a single seek and read.
+ *
+ * Sources are only used by one thread at a time, so there's no lock.
+ */
+typedef struct _VipsSourceBlocks {
+	int block_size;
+	int max_blocks;
+
+	/* gint64 index -> VipsSourceBlock, plus an LRU queue, most recent
+	 * at the head.
+	 */
+	GHashTable *table;
+	GQueue lru;
+
+	/* We only cache once the upstream source has proved it can seek.
+	 */
+	gboolean seekable;
+
+	/* Our logical read position, and where the upstream source is
+	 * actually positioned, or -1 if we don't know.
+	 */
+	gint64 position;
+	gint64 upstream_position;
+
+	/* The index of the block after the last fetch, so we can spot
+	 * sequential scans and send a prefetch hint.
+	 */
+	gint64 next_fetch;
+
+	gint64 hits;
+	gint64 misses;
+	gint64 fetches;
+} VipsSourceBlocks;
+
+static void
+vips_source_block_free(VipsSourceBlock *block)
+{
+	VIPS_FREE(block->data);
+	g_free(block);
+}
+
+static void
+vips_source_blocks_free(VipsSourceBlocks *blocks)
+{
+	/* The table owns the blocks, the queue just links them.
+	 */
+	VIPS_FREEF(g_hash_table_destroy, blocks->table);
+	g_free(blocks);
+}
+
+static void
+vips_source_custom_finalize(GObject *gobject)
+{
+	VipsSourceCustom *source_custom = VIPS_SOURCE_CUSTOM(gobject);
+
+	VIPS_FREEF(vips_source_blocks_free, source_custom->blocks);
+
+	G_OBJECT_CLASS(vips_source_custom_parent_class)->finalize(gobject);
+}
+
 static void
 vips_source_custom_dispose(GObject *gobject)
 {
@@ -79,7 +161,7 @@ vips_source_custom_dispose(GObject *gobject)
 }
 
 static gint64
-vips_source_custom_read_real(VipsSource *source,
+vips_source_custom_upstream_read(VipsSource *source,
 	void *buffer, size_t length)
 {
 	gint64 bytes_read;
@@ -100,7 +182,7 @@ vips_source_custom_read_real(VipsSource *source,
 }
 
 static gint64
-vips_source_custom_seek_real(VipsSource *source,
+vips_source_custom_upstream_seek(VipsSource *source,
 	gint64 offset, int whence)
 {
 	GValue args[3] = { G_VALUE_INIT, G_VALUE_INIT, G_VALUE_INIT };
@@ -142,6 +224,235 @@ vips_source_custom_seek_real(VipsSource *source,
 	return new_position;
 }
 
+static VipsSourceBlock *
+vips_source_blocks_lookup(VipsSourceBlocks *blocks, gint64 index)
+{
+	VipsSourceBlock *block;
+
+	if ((block = g_hash_table_lookup(blocks->table, &index))) {
+		g_queue_unlink(&blocks->lru, &block->link);
+		g_queue_push_head_link(&blocks->lru, &block->link);
+	}
+
+	return block;
+}
+
+static gboolean
+vips_source_blocks_has(VipsSourceBlocks *blocks, gint64 index)
+{
+	return g_hash_table_contains(blocks->table, &index);
+}
+
+static void
+vips_source_blocks_insert(VipsSourceBlocks *blocks,
+	gint64 index, const unsigned char *data, size_t length)
+{
+	VipsSourceBlock *block;
+
+	while ((int) g_queue_get_length(&blocks->lru) >= blocks->max_blocks) {
+		GList *tail = g_queue_peek_tail_link(&blocks->lru);
+		VipsSourceBlock *old = (VipsSourceBlock *) tail->data;
+
+		g_queue_unlink(&blocks->lru, tail);
+		g_hash_table_remove(blocks->table, &old->index);
+	}
+
+	block = g_new0(VipsSourceBlock, 1);
+	block->index = index;
+	block->length = length;
+	block->data = g_malloc(length);
+	memcpy(block->data, data, length);
+	block->link.data = block;
+	g_hash_table_insert(blocks->table, &block->index, block);
+	g_queue_push_head_link(&blocks->lru, &block->link);
+}
+
+/* Fetch blocks [first, last] with one seek and as few reads as upstream
+ * allows.
+ */
+static int
+vips_source_blocks_fetch(VipsSource *source, gint64 first, gint64 last)
+{
+	VipsSourceBlocks *blocks = VIPS_SOURCE_CUSTOM(source)->blocks;
+	const gint64 bs = blocks->block_size;
+	const size_t size = (last - first + 1) * bs;
+
+	unsigned char *buf;
+	size_t got;
+	gint64 index;
+
+	if (blocks->upstream_position != first * bs) {
+		blocks->upstream_position = -1;
+		if (vips_source_custom_upstream_seek(source,
+				first * bs, SEEK_SET) != first * bs)
+			return -1;
+		blocks->upstream_position = first * bs;
+	}
+
+	if (!(buf = g_try_malloc(size)))
+		return -1;
+
+	got = 0;
+	while (got < size) {
+		gint64 n = vips_source_custom_upstream_read(source,
+			buf + got, size - got);
+
+		if (n < 0) {
+			blocks->upstream_position = -1;
+			g_free(buf);
+			return -1;
+		}
+		if (n == 0)
+			break;
+
+		got += n;
+	}
+	blocks->upstream_position += got;
+	blocks->fetches += 1;
+
+	/* A short block at the end of the source, or an empty block past
+	 * it, so we don't fetch again.
+	 */
+	for (index = first; index <= last; index++) {
+		size_t offset = (index - first) * bs;
+		size_t length = offset < got ? VIPS_MIN(bs, got - offset) : 0;
+
+		vips_source_blocks_insert(blocks, index, buf + offset, length);
+		blocks->misses += 1;
+		if (length < (size_t) bs)
+			break;
+	}
+
+	g_free(buf);
+
+	/* A run of sequential fetches: hint that the next run will be
+	 * wanted soon, so the application can start it in parallel.
+	 */
+	if (first == blocks->next_fetch &&
+		got == size)
+		g_signal_emit(source, vips_source_custom_signals[SIG_PREFETCH], 0,
+			(last + 1) * bs, (gint64) size);
+	blocks->next_fetch = last + 1;
+
+	return 0;
+}
+
+static gint64
+vips_source_custom_read_real(VipsSource *source,
+	void *buffer, size_t length)
+{
+	VipsSourceBlocks *blocks = VIPS_SOURCE_CUSTOM(source)->blocks;
+
+	gint64 bs;
+	gint64 last;
+	gint64 total;
+
+	if (!blocks ||
+		!blocks->seekable)
+		return vips_source_custom_upstream_read(source, buffer, length);
+
+	VIPS_DEBUG_MSG_RED("vips_source_custom_read_real: "
+					   "%zd bytes from cache at %" G_GINT64_FORMAT "\n",
+		length, blocks->position);
+
+	bs = blocks->block_size;
+	last = (blocks->position + length - 1) / bs;
+	total = 0;
+
+	while (length > 0) {
+		gint64 index = blocks->position / bs;
+		size_t offset = blocks->position - index * bs;
+
+		VipsSourceBlock *block;
+		size_t n;
+
+		if (!(block = vips_source_blocks_lookup(blocks, index))) {
+			gint64 end;
+
+			/* Coalesce the run of missing blocks this read
+			 * covers, but no more than half the cache, or we'd
+			 * evict the start of the run before we used it.
+			 */
+			for (end = index;
+				 end < last &&
+				 end - index + 1 < VIPS_MAX(1, blocks->max_blocks / 2) &&
+				 !vips_source_blocks_has(blocks, end + 1);
+				 end++)
+				;
+
+			if (vips_source_blocks_fetch(source, index, end))
+				return total > 0 ? total : -1;
+
+			block = vips_source_blocks_lookup(blocks, index);
+		}
+		else
+			blocks->hits += 1;
+
+		/* EOF.
+		 */
+		if (offset >= block->length)
+			break;
+
+		n = VIPS_MIN(length, block->length - offset);
+		memcpy(buffer, block->data + offset, n);
+		buffer = (char *) buffer + n;
+		length -= n;
+		total += n;
+		blocks->position += n;
+	}
+
+	return total;
+}
+
+static gint64
+vips_source_custom_seek_real(VipsSource *source,
+	gint64 offset, int whence)
+{
+	VipsSourceBlocks *blocks = VIPS_SOURCE_CUSTOM(source)->blocks;
+
+	gint64 new_position;
+
+	/* Until we know we can seek, and for seeks relative to the end,
+	 * ask upstream. Other seeks just move our read point.
+	 */
+	if (!blocks ||
+		!blocks->seekable ||
+		whence == SEEK_END) {
+		new_position =
+			vips_source_custom_upstream_seek(source, offset, whence);
+
+		if (blocks &&
+			new_position >= 0) {
+			blocks->seekable = TRUE;
+			blocks->position = new_position;
+			blocks->upstream_position = new_position;
+		}
+
+		return new_position;
+	}
+
+	switch (whence) {
+	case SEEK_SET:
+		new_position = offset;
+		break;
+
+	case SEEK_CUR:
+		new_position = blocks->position + offset;
+		break;
+
+	default:
+		new_position = -1;
+		break;
+	}
+
+	if (new_position < 0)
+		return -1;
+
+	blocks->position = new_position;
+
+	return new_position;
+}
+
 static gint64
 vips_source_custom_read_signal_real(VipsSourceCustom *source_custom,
 	void *data, gint64 length)
@@ -160,6 +471,13 @@ vips_source_custom_seek_signal_real(VipsSourceCustom *source_custom,
 	return -1;
 }
 
+static void
+vips_source_custom_prefetch_signal_real(VipsSourceCustom *source_custom,
+	gint64 offset, gint64 length)
+{
+	VIPS_DEBUG_MSG("vips_source_custom_prefetch_signal_real:\n");
+}
+
 static void
 vips_source_custom_class_init(VipsSourceCustomClass *class)
 {
@@ -168,6 +486,7 @@ vips_source_custom_class_init(VipsSourceCustomClass *class)
 	VipsSourceClass *source_class = VIPS_SOURCE_CLASS(class);
 
 	gobject_class->dispose = vips_source_custom_dispose;
+	gobject_class->finalize = vips_source_custom_finalize;
 
 	object_class->nickname = "source_custom";
 	object_class->description = _("Custom source");
@@ -177,6 +496,7 @@ vips_source_custom_class_init(VipsSourceCustomClass *class)
 
 	class->read = vips_source_custom_read_signal_real;
 	class->seek = vips_source_custom_seek_signal_real;
+	class->prefetch = vips_source_custom_prefetch_signal_real;
 
 	/**
 	 * VipsSourceCustom::read:
@@ -218,6 +538,28 @@ vips_source_custom_class_init(VipsSourceCustomClass *class)
 		vips_INT64__INT64_INT,
 		G_TYPE_INT64, 2,
 		G_TYPE_INT64, G_TYPE_INT);
+
+	/**
+	 * VipsSourceCustom::prefetch:
+	 * @source_custom: the source being operated on
+	 * @offset: `gint64`, start of range
+	 * @length: `gint64`, length of range
+	 *
+	 * This signal is emitted by the block cache when a sequential scan
+	 * is likely to read this range next. Handlers can start fetching it
+	 * in the background, so that the following read does not stall.
+	 *
+	 * ::: seealso
+	 *     [method@SourceCustom.set_block_cache].
+	 */
+	vips_source_custom_signals[SIG_PREFETCH] = g_signal_new("prefetch",
+		G_TYPE_FROM_CLASS(class),
+		G_SIGNAL_RUN_LAST,
+		G_STRUCT_OFFSET(VipsSourceCustomClass, prefetch),
+		NULL, NULL,
+		vips_VOID__INT64_INT64,
+		G_TYPE_NONE, 2,
+		G_TYPE_INT64, G_TYPE_INT64);
 }
 
 static void
@@ -250,3 +592,80 @@ vips_source_custom_new(void)
 
 	return source_custom;
 }
+
+/**
+ * vips_source_custom_set_block_cache:
+ * @source_custom: source to configure
+ * @block_size: cache in chunks of this many bytes, or 0 to disable
+ * @max_blocks: keep at most this many chunks
+ *
+ * Put a block cache between loaders and the read and seek signals. Reads
+ * are served from aligned chunks of @block_size bytes, and runs of missing
+ * chunks are fetched with a single seek and read. This helps random access
+ * loaders, such as TIFF, on sources where each read is expensive, for
+ * example a remote object fetched with HTTP range requests.
+ *
+ * The cache only engages if the source can seek. Call this before loading
+ * from the source.
+ *
+ * ::: seealso
+ *     [method@SourceCustom.get_block_stats].
+ *
+ * Returns: 0 on success, -1 on error.
+ */
+int
+vips_source_custom_set_block_cache(VipsSourceCustom *source_custom,
+	int block_size, int max_blocks)
+{
+	VipsSourceBlocks *blocks;
+
+	if (block_size < 0 ||
+		max_blocks < 1) {
+		vips_error(vips_connection_nick(VIPS_CONNECTION(source_custom)),
+			"%s", _("bad block cache parameters"));
+		return -1;
+	}
+
+	VIPS_FREEF(vips_source_blocks_free, source_custom->blocks);
+	if (block_size == 0)
+		return 0;
+
+	blocks = g_new0(VipsSourceBlocks, 1);
+	blocks->block_size = block_size;
+	blocks->max_blocks = max_blocks;
+	blocks->table = g_hash_table_new_full(g_int64_hash, g_int64_equal,
+		NULL, (GDestroyNotify) vips_source_block_free);
+	g_queue_init(&blocks->lru);
+	blocks->upstream_position = -1;
+	blocks->next_fetch = -1;
+	source_custom->blocks = blocks;
+
+	return 0;
+}
+
+/**
+ * vips_source_custom_get_block_stats:
+ * @source_custom: source to query
+ * @hits: (out) (optional): blocks served from the cache
+ * @misses: (out) (optional): blocks fetched from upstream
+ * @fetches: (out) (optional): number of upstream fetches
+ *
+ * Fetch statistics for the block cache. @misses / @fetches is the average
+ * number of blocks coalesced into each upstream read.
+ *
+ * ::: seealso
+ *     [method@SourceCustom.set_block_cache].
+ */
+void
+vips_source_custom_get_block_stats(VipsSourceCustom *source_custom,
+	gint64 *hits, gint64 *misses, gint64 *fetches)
+{
+	VipsSourceBlocks *blocks = source_custom->blocks;
+
+	if (hits)
+		*hits = blocks ? blocks->hits : 0;
+	if (misses)
+		*misses = blocks ? blocks->misses : 0;
+	if (fetches)
+		*fetches = blocks ? blocks->fetches : 0;
+}
@@ -6,6 +6,9 @@
  * 26/11/20
  * 	- use _setmode() on win to force binary write for previously opened
  * 	  descriptors
+ * 14/10/26
+ * 	- coalesce runs of small writes
+ * 	- add vips_target_writev() and vips_target_write_source()
  */
 
 /*
@@ -39,6 +42,10 @@
 #define VIPS_DEBUG
  */
 
+/* copy_file_range() is a GNU extension.
+ */
+#define _GNU_SOURCE
+
 #ifdef HAVE_CONFIG_H
 #include <config.h>
 #endif /*HAVE_CONFIG_H*/
@@ -54,6 +61,12 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#ifdef HAVE_WRITEV
+#include <sys/uio.h>
+#endif /*HAVE_WRITEV*/
+#ifdef HAVE_SENDFILE
+#include <sys/sendfile.h>
+#endif /*HAVE_SENDFILE*/
 
 #include <vips/vips.h>
 
@@ -69,6 +82,12 @@
  */
 #define MODE_READWRITE CLOEXEC(BINARYIZE(O_RDWR | O_CREAT | O_TRUNC))
 
+/* Writes smaller than this count towards growing the coalescing buffer, and
+ * it can grow to this size.
+ */
+#define VIPS_TARGET_SMALL_WRITE (64 * 1024)
+#define VIPS_TARGET_MAX_PENDING (1024 * 1024)
+
 G_DEFINE_TYPE(VipsTarget, vips_target, VIPS_TYPE_CONNECTION);
 
 static void
@@ -93,6 +112,7 @@ vips_target_finalize(GObject *gobject)
 		g_unlink(target->delete_on_close_filename);
 
 	VIPS_FREE(target->delete_on_close_filename);
+	VIPS_FREEF(g_byte_array_unref, target->pending);
 
 	G_OBJECT_CLASS(vips_target_parent_class)->finalize(gobject);
 }
@@ -507,16 +527,72 @@ vips_target_write_unbuffered(VipsTarget *target,
 	return 0;
 }
 
+/* Send any coalesced writes on.
+ */
 static int
-vips_target_flush(VipsTarget *target)
+vips_target_drain(VipsTarget *target)
+{
+	if (target->pending &&
+		target->pending->len > 0) {
+		if (vips_target_write_unbuffered(target,
+				target->pending->data, target->pending->len))
+			return -1;
+		g_byte_array_set_size(target->pending, 0);
+	}
+
+	return 0;
+}
+
+/* Savers which emit many small chunks would otherwise cost a syscall or a
+ * custom callback per chunk. Collect small writes into @pending, and grow it
+ * while small writes keep coming.
+ */
+static int
+vips_target_write_coalesced(VipsTarget *target,
+	const void *data, size_t length)
+{
+	/* Writes to memory are cheap.
+	 */
+	if (target->memory_buffer)
+		return vips_target_write_unbuffered(target, data, length);
+
+	if (length < VIPS_TARGET_SMALL_WRITE) {
+		target->n_small += 1;
+		if (target->n_small >= 4 &&
+			target->pending_size < VIPS_TARGET_MAX_PENDING) {
+			target->pending_size = VIPS_MAX(VIPS_TARGET_SMALL_WRITE,
+				target->pending_size * 2);
+			target->n_small = 0;
+		}
+	}
+	else
+		target->n_small = 0;
+
+	if (target->pending &&
+		target->pending->len + length > target->pending_size &&
+		vips_target_drain(target))
+		return -1;
+
+	if (length >= target->pending_size)
+		return vips_target_write_unbuffered(target, data, length);
+
+	if (!target->pending)
+		target->pending = g_byte_array_sized_new(target->pending_size);
+	g_byte_array_append(target->pending, data, length);
+
+	return 0;
+}
+
+/* The output buffer is full: move it to the coalescing buffer.
+ */
+static int
+vips_target_flush_buffer(VipsTarget *target)
 {
 	g_assert(target->write_point >= 0);
 	g_assert(target->write_point <= VIPS_TARGET_BUFFER_SIZE);
 
-	VIPS_DEBUG_MSG("vips_target_flush:\n");
-
 	if (target->write_point > 0) {
-		if (vips_target_write_unbuffered(target,
+		if (vips_target_write_coalesced(target,
 				target->output_buffer, target->write_point))
 			return -1;
 		target->write_point = 0;
@@ -525,6 +601,20 @@ vips_target_flush(VipsTarget *target)
 	return 0;
 }
 
+/* Push everything through to ::write().
+ */
+static int
+vips_target_flush(VipsTarget *target)
+{
+	VIPS_DEBUG_MSG("vips_target_flush:\n");
+
+	if (vips_target_flush_buffer(target) ||
+		vips_target_drain(target))
+		return -1;
+
+	return 0;
+}
+
 /**
  * vips_target_write:
  * @target: target to operate on
@@ -541,13 +631,13 @@ vips_target_write(VipsTarget *target, const void *data, size_t length)
 	VIPS_DEBUG_MSG("vips_target_write: %zd bytes\n", length);
 
 	if (length > VIPS_TARGET_BUFFER_SIZE - target->write_point &&
-		vips_target_flush(target))
+		vips_target_flush_buffer(target))
 		return -1;
 
 	if (length > VIPS_TARGET_BUFFER_SIZE - target->write_point) {
-		/* Still too large? Do an unbuffered write.
+		/* Still too large? Skip the output buffer.
 		 */
-		if (vips_target_write_unbuffered(target, data, length))
+		if (vips_target_write_coalesced(target, data, length))
 			return -1;
 	}
 	else {
@@ -559,6 +649,216 @@ vips_target_write(VipsTarget *target, const void *data, size_t length)
 	return 0;
 }
 
+/**
+ * vips_target_writev:
+ * @target: target to operate on
+ * @vectors: (array length=n_vectors): the buffers to write
+ * @n_vectors: number of buffers in @vectors
+ *
+ * Write the contents of @vectors to @target, in order. This is equivalent
+ * to calling [method@Target.write] for each buffer, but large gathers to a
+ * descriptor are sent in a single [`writev()`](man:writev(2)) call.
+ *
+ * Returns: 0 on success, -1 on error.
+ */
+int
+vips_target_writev(VipsTarget *target,
+	const GOutputVector *vectors, int n_vectors)
+{
+	size_t total;
+	int i;
+
+	VIPS_DEBUG_MSG("vips_target_writev: %d vectors\n", n_vectors);
+
+	total = 0;
+	for (i = 0; i < n_vectors; i++)
+		total += vectors[i].size;
+
+#ifdef HAVE_WRITEV
+	/* Too large to buffer, and a plain descriptor: gather in the kernel.
+	 */
+	if (total > VIPS_TARGET_BUFFER_SIZE - target->write_point &&
+		G_OBJECT_TYPE(target) == VIPS_TYPE_TARGET &&
+		!target->memory_buffer &&
+		!target->ended) {
+		VipsConnection *connection = VIPS_CONNECTION(target);
+
+		struct iovec *iov;
+
+		if (vips_target_flush(target) ||
+			vips_target_create_file(target))
+			return -1;
+
+		iov = g_new(struct iovec, n_vectors);
+		for (i = 0; i < n_vectors; i++) {
+			iov[i].iov_base = (void *) vectors[i].buffer;
+			iov[i].iov_len = vectors[i].size;
+		}
+
+		i = 0;
+		while (i < n_vectors) {
+			ssize_t n = writev(connection->descriptor,
+				iov + i, VIPS_MIN(n_vectors - i, 1024));
+
+			if (n < 0 &&
+				errno == EINTR)
+				continue;
+			if (n <= 0) {
+				vips_error_system(errno,
+					vips_connection_nick(connection),
+					"%s", _("write error"));
+				g_free(iov);
+				return -1;
+			}
+
+			/* Step over what was written, perhaps stopping part
+			 * way through a buffer.
+			 */
+			for (; i < n_vectors && n >= (ssize_t) iov[i].iov_len; i++)
+				n -= iov[i].iov_len;
+			if (i < n_vectors) {
+				iov[i].iov_base = (char *) iov[i].iov_base + n;
+				iov[i].iov_len -= n;
+			}
+		}
+
+		g_free(iov);
+
+		return 0;
+	}
+#endif /*HAVE_WRITEV*/
+
+	for (i = 0; i < n_vectors; i++)
+		if (vips_target_write(target, vectors[i].buffer, vectors[i].size))
+			return -1;
+
+	return 0;
+}
+
+/* Copy with copy_file_range() or sendfile(). Return the number of bytes
+ * copied, or -1 if the kernel can't do this copy and we should fall back.
+ */
+static gint64
+vips_target_copy_descriptor(int out_fd, int in_fd)
+{
+	gint64 total;
+
+	total = 0;
+
+#ifdef HAVE_COPY_FILE_RANGE
+	for (;;) {
+		ssize_t n = copy_file_range(in_fd, NULL, out_fd, NULL,
+			1024 * 1024 * 1024, 0);
+
+		if (n < 0 &&
+			errno == EINTR)
+			continue;
+		if (n < 0) {
+			/* If we've started, we can't fall back.
+			 */
+			if (total > 0)
+				return -2;
+			break;
+		}
+		if (n == 0)
+			return total;
+
+		total += n;
+	}
+#endif /*HAVE_COPY_FILE_RANGE*/
+
+#ifdef HAVE_SENDFILE
+	for (;;) {
+		ssize_t n = sendfile(out_fd, in_fd, NULL, 1024 * 1024 * 1024);
+
+		if (n < 0 &&
+			errno == EINTR)
+			continue;
+		if (n < 0)
+			return total > 0 ? -2 : -1;
+		if (n == 0)
+			return total;
+
+		total += n;
+	}
+#endif /*HAVE_SENDFILE*/
+
+	return -1;
+}
+
+/**
+ * vips_target_write_source:
+ * @target: target to operate on
+ * @source: source to copy from
+ *
+ * Write everything from the current read position of @source to the end
+ * onto @target.
+ *
+ * Memory sources are written directly. If both @source and @target are
+ * plain files, the copy is done inside the kernel with
+ * [`copy_file_range()`](man:copy_file_range(2)) or
+ * [`sendfile()`](man:sendfile(2)) where available, so the bytes never pass
+ * through userspace.
+ *
+ * Returns: 0 on success, -1 on error.
+ */
+int
+vips_target_write_source(VipsTarget *target, VipsSource *source)
+{
+	unsigned char buffer[65536];
+	gint64 n;
+
+	VIPS_DEBUG_MSG("vips_target_write_source:\n");
+
+	/* This also unminimises and tests for seek.
+	 */
+	if (vips_source_is_file(source) == -1)
+		return -1;
+
+	/* The whole thing is already in memory.
+	 */
+	if (source->data) {
+		n = source->length - source->read_position;
+		if (vips_target_write(target,
+				(const char *) source->data + source->read_position, n))
+			return -1;
+		source->read_position += n;
+
+		return 0;
+	}
+
+	if (G_OBJECT_TYPE(source) == VIPS_TYPE_SOURCE &&
+		G_OBJECT_TYPE(target) == VIPS_TYPE_TARGET &&
+		!source->is_pipe &&
+		!target->memory_buffer &&
+		!target->ended &&
+		VIPS_CONNECTION(source)->descriptor != -1) {
+		if (vips_target_flush(target) ||
+			vips_target_create_file(target))
+			return -1;
+
+		n = vips_target_copy_descriptor(
+			VIPS_CONNECTION(target)->descriptor,
+			VIPS_CONNECTION(source)->descriptor);
+		if (n == -2) {
+			vips_error_system(errno,
+				vips_connection_nick(VIPS_CONNECTION(target)),
+				"%s", _("write error"));
+			return -1;
+		}
+		if (n >= 0) {
+			source->read_position += n;
+			return 0;
+		}
+	}
+
+	while ((n = vips_source_read(source, buffer, sizeof(buffer))) > 0)
+		if (vips_target_write(target, buffer, n))
+			return -1;
+
+	return n < 0 ? -1 : 0;
+}
+
 /**
  * vips_target_read:
  * @target: target to operate on
@@ -749,7 +1049,7 @@ vips_target_putc(VipsTarget *target, int ch)
 	VIPS_DEBUG_MSG("vips_target_putc: %d\n", ch);
 
 	if (target->write_point >= VIPS_TARGET_BUFFER_SIZE &&
-		vips_target_flush(target))
+		vips_target_flush_buffer(target))
 		return -1;
 
 	target->output_buffer[target->write_point++] = ch;
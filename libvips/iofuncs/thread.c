@@ -2,6 +2,12 @@
  *
  * 29/9/22
  * 	- from threadpool.c
+ * 14/10/26
+ * 	- add VIPS_TILE_AUTO, size SMALLTILE tiles from the pipeline working
+ * 	  set and the L2 cache size
+ * 	- add VIPS_NUMA, pin workers to NUMA nodes
+ * 15/10/26
+ * 	- add vips__image_set_natural_tile(), vips__tile_size_align()
  */
 
 /*
@@ -36,6 +42,10 @@
 #define VIPS_DEBUG_RED
  */
 
+/* sched_setaffinity() and cpu_set_t are non-portable GNU extensions.
+ */
+#define _GNU_SOURCE
+
 #ifdef HAVE_CONFIG_H
 #include <config.h>
 #endif /*HAVE_CONFIG_H*/
@@ -47,6 +57,9 @@
 #include <unistd.h>
 #endif /*HAVE_UNISTD_H*/
 #include <errno.h>
+#ifdef HAVE_SCHED_SETAFFINITY
+#include <sched.h>
+#endif /*HAVE_SCHED_SETAFFINITY*/
 
 #include <vips/vips.h>
 #include <vips/internal.h>
@@ -76,6 +89,25 @@ int vips__tile_height = VIPS__TILE_HEIGHT;
 int vips__fatstrip_height = VIPS__FATSTRIP_HEIGHT;
 int vips__thinstrip_height = VIPS__THINSTRIP_HEIGHT;
 
+/* Size SMALLTILE tiles from the pipeline, see vips_get_tile_size().
+ */
+gboolean vips__tile_auto = FALSE;
+
+/* Pin workers to NUMA nodes, see vips__numa_bind().
+ */
+gboolean vips__numa = FALSE;
+
+#ifdef HAVE_SCHED_SETAFFINITY
+/* The largest node number we look for.
+ */
+#define MAX_NUMA_NODES (64)
+
+/* The CPUs on each node we found.
+ */
+static int vips__numa_n_nodes = 0;
+static cpu_set_t vips__numa_cpus[MAX_NUMA_NODES];
+#endif /*HAVE_SCHED_SETAFFINITY*/
+
 /* Set this GPrivate to indicate that is a libvips thread.
  */
 static GPrivate is_vips_thread_key;
@@ -269,6 +301,194 @@ vips_concurrency_get(void)
 	return vips__concurrency;
 }
 
+#ifdef HAVE_SCHED_SETAFFINITY
+/* Parse a sysfs cpulist, eg. "0-7,16-23", into a cpu_set_t.
+ */
+static void
+vips__numa_parse_cpulist(const char *str, cpu_set_t *cpus)
+{
+	CPU_ZERO(cpus);
+
+	while (*str) {
+		char *end;
+		long first;
+		long last;
+		long i;
+
+		first = strtol(str, &end, 10);
+		if (end == str)
+			break;
+		last = first;
+		str = end;
+
+		if (*str == '-') {
+			last = strtol(str + 1, &end, 10);
+			if (end == str + 1)
+				break;
+			str = end;
+		}
+
+		for (i = first; i <= last && i < CPU_SETSIZE; i++)
+			CPU_SET(i, cpus);
+
+		if (*str != ',')
+			break;
+		str += 1;
+	}
+}
+
+static void *
+vips__numa_init(void *data)
+{
+	int i;
+
+	for (i = 0; i < MAX_NUMA_NODES; i++) {
+		char filename[256];
+		char *contents;
+
+		g_snprintf(filename, sizeof(filename),
+			"/sys/devices/system/node/node%d/cpulist", i);
+		if (!g_file_get_contents(filename, &contents, NULL, NULL))
+			continue;
+
+		vips__numa_parse_cpulist(contents,
+			&vips__numa_cpus[vips__numa_n_nodes]);
+		g_free(contents);
+
+		/* Memory-only nodes have no CPUs to run workers on.
+		 */
+		if (CPU_COUNT(&vips__numa_cpus[vips__numa_n_nodes]) > 0)
+			vips__numa_n_nodes += 1;
+	}
+
+	g_info("found %d NUMA nodes", vips__numa_n_nodes);
+
+	return NULL;
+}
+#endif /*HAVE_SCHED_SETAFFINITY*/
+
+/* The number of NUMA nodes we spread workers over. This is 1 unless
+ * VIPS_NUMA or --vips-numa is set and the host has several nodes.
+ */
+int
+vips__numa_get_n_nodes(void)
+{
+#ifdef HAVE_SCHED_SETAFFINITY
+	static GOnce once = G_ONCE_INIT;
+
+	if (!vips__numa)
+		return 1;
+
+	VIPS_ONCE(&once, vips__numa_init, NULL);
+
+	return VIPS_MAX(1, vips__numa_n_nodes);
+#else  /*!HAVE_SCHED_SETAFFINITY*/
+	return 1;
+#endif /*HAVE_SCHED_SETAFFINITY*/
+}
+
+/* Pin the calling thread to the CPUs of a NUMA node. Threads allocate their
+ * buffers and thread-private state after they are pinned, so first-touch
+ * places all of it on the same node.
+ */
+void
+vips__numa_bind(int node)
+{
+#ifdef HAVE_SCHED_SETAFFINITY
+	if (vips__numa_get_n_nodes() > 1 &&
+		node >= 0 &&
+		node < vips__numa_n_nodes &&
+		sched_setaffinity(0, sizeof(cpu_set_t), &vips__numa_cpus[node]))
+		g_info("unable to bind thread to NUMA node %d", node);
+#endif /*HAVE_SCHED_SETAFFINITY*/
+}
+
+/* The per-core cache size we try to fit tiles into. VIPS_TILE_CACHE_SIZE
+ * overrides the value we detect.
+ */
+static size_t
+vips__tile_cache_size(void)
+{
+	static size_t cache_size = 0;
+
+	if (!cache_size) {
+		const char *str;
+		size_t size;
+
+		size = 0;
+		if ((str = g_getenv("VIPS_TILE_CACHE_SIZE")))
+			size = vips__parse_size(str);
+
+#ifdef _SC_LEVEL2_CACHE_SIZE
+		if (size == 0) {
+			long l2 = sysconf(_SC_LEVEL2_CACHE_SIZE);
+
+			if (l2 > 0)
+				size = l2;
+		}
+#endif /*_SC_LEVEL2_CACHE_SIZE*/
+
+#ifdef __APPLE__
+		if (size == 0) {
+			int64_t l2 = 0;
+			size_t len = sizeof(l2);
+
+			if (sysctlbyname("hw.l2cachesize", &l2, &len, NULL, 0) == 0 &&
+				l2 > 0)
+				size = l2;
+		}
+#endif /*__APPLE__*/
+
+		if (size == 0)
+			size = 1024 * 1024;
+
+		cache_size = size;
+	}
+
+	return cache_size;
+}
+
+static void *
+vips__tile_auto_bytes(VipsImage *image, size_t *bytes, void *b)
+{
+	*bytes += VIPS_IMAGE_SIZEOF_PEL(image);
+
+	return NULL;
+}
+
+/* Pick a square tile for a SMALLTILE pipeline. Every image in the graph
+ * will have a region of about a tile in size, plus the margins that
+ * operations like convolution add, so size the tile so that all of that
+ * fits in cache.
+ */
+static int
+vips__tile_auto_size(VipsImage *im)
+{
+	size_t bytes;
+	double margin;
+	double side;
+	int size;
+
+	bytes = 0;
+	(void) vips__link_map(im, TRUE,
+		(VipsSListMap2Fn) vips__tile_auto_bytes, &bytes, NULL);
+	bytes = VIPS_MAX(bytes, 1);
+
+	/* The reorder margin is the area of the window, not the width.
+	 */
+	margin = sqrt(vips__reorder_margin(im));
+
+	side = sqrt((double) vips__tile_cache_size() / bytes) - margin;
+	size = VIPS_ROUND_DOWN((int) VIPS_MAX(side, 0), 16);
+	size = VIPS_CLIP(16, size, 1024);
+
+	g_info("tile size %d x %d for %s, "
+		   "%zd bytes per pixel, margin %g",
+		size, size, im->filename ? im->filename : "image", bytes, margin);
+
+	return size;
+}
+
 /**
  * vips_get_tile_size: (method)
  * @im: image to guess for
@@ -283,6 +503,13 @@ vips_concurrency_get(void)
  * The buffer height is the height of each buffer we fill in sink disc. Since
  * we have two buffers, the largest range of input locality is twice the output
  * buffer size, plus whatever margin we add for things like convolution.
+ *
+ * If the environment variable `VIPS_TILE_AUTO` is set, or the
+ * `--vips-tile-auto` command-line option is given, SMALLTILE pipelines get a
+ * square tile sized from the pipeline itself: the bytes per pixel summed
+ * over every image in the graph, the margin added by operations like
+ * convolution, and the size of the L2 cache (or `VIPS_TILE_CACHE_SIZE`, if
+ * set). Run with `--vips-info` to see the sizes that are picked.
  */
 void
 vips_get_tile_size(VipsImage *im,
@@ -291,17 +518,31 @@ vips_get_tile_size(VipsImage *im,
 	const int nthr = vips_concurrency_get();
 	const int typical_image_width = 1000;
 
+	int buffer_tile_width;
+	int buffer_tile_height;
+
 	/* Compiler warnings.
 	 */
 	*tile_width = 1;
 	*tile_height = 1;
 
+	buffer_tile_width = vips__tile_width;
+	buffer_tile_height = vips__tile_height;
+
 	/* Pick a render geometry.
 	 */
 	switch (im->dhint) {
 	case VIPS_DEMAND_STYLE_SMALLTILE:
-		*tile_width = vips__tile_width;
-		*tile_height = vips__tile_height;
+		if (vips__tile_auto) {
+			*tile_width = vips__tile_auto_size(im);
+			*tile_height = *tile_width;
+			buffer_tile_width = *tile_width;
+			buffer_tile_height = *tile_height;
+		}
+		else {
+			*tile_width = vips__tile_width;
+			*tile_height = vips__tile_height;
+		}
 		break;
 
 	case VIPS_DEMAND_STYLE_ANY:
@@ -334,8 +575,8 @@ vips_get_tile_size(VipsImage *im,
 	 * Pick the maximum buffer size we might possibly need, then round up
 	 * to a multiple of tileheight.
 	 */
-	*n_lines = vips__tile_height *
-		VIPS_ROUND_UP(vips__tile_width * nthr,
+	*n_lines = buffer_tile_height *
+		VIPS_ROUND_UP(buffer_tile_width * nthr,
 			typical_image_width) /
 		typical_image_width;
 	*n_lines = VIPS_MAX(*n_lines, vips__fatstrip_height * nthr);
@@ -351,9 +592,147 @@ vips_get_tile_size(VipsImage *im,
 		*tile_width, *tile_height, *n_lines);
 }
 
+/* The natural tile of an image, see vips__image_set_natural_tile().
+ */
+typedef struct _VipsNaturalTile {
+	int width;
+	int height;
+} VipsNaturalTile;
+
+static GQuark
+vips__natural_tile_quark(void)
+{
+	static GQuark quark = 0;
+
+	if (!quark)
+		quark = g_quark_from_static_string("vips-natural-tile");
+
+	return quark;
+}
+
+/* Loaders call this to say that @image is decoded in units of @tile_width
+ * by @tile_height pixels, for example a TIFF strip, or a row of JPEG MCUs.
+ * Sinks try to make requests which line up with this, see
+ * vips__tile_size_align().
+ */
+void
+vips__image_set_natural_tile(VipsImage *image,
+	int tile_width, int tile_height)
+{
+	VipsNaturalTile *natural;
+
+	if (tile_width <= 0 ||
+		tile_height <= 0)
+		return;
+
+	natural = g_new(VipsNaturalTile, 1);
+	natural->width = VIPS_MIN(tile_width, image->Xsize);
+	natural->height = VIPS_MIN(tile_height, image->Ysize);
+	g_object_set_qdata_full(G_OBJECT(image), vips__natural_tile_quark(),
+		natural, (GDestroyNotify) g_free);
+}
+
+/* Get the natural tile for @image, or FALSE if it has none.
+ */
+gboolean
+vips__image_get_natural_tile(VipsImage *image,
+	int *tile_width, int *tile_height)
+{
+	VipsNaturalTile *natural;
+
+	if (!(natural = g_object_get_qdata(G_OBJECT(image),
+			  vips__natural_tile_quark())))
+		return FALSE;
+
+	*tile_width = natural->width;
+	*tile_height = natural->height;
+
+	return TRUE;
+}
+
+/* The largest natural tile upstream of @out. Only images the same size as
+ * @out count: anything else has been resampled and its decode units won't
+ * line up with requests on @out.
+ */
+static void *
+vips__tile_natural_max(VipsImage *image, VipsImage *out, VipsNaturalTile *max)
+{
+	int tile_width;
+	int tile_height;
+
+	if (image->Xsize == out->Xsize &&
+		image->Ysize == out->Ysize &&
+		vips__image_get_natural_tile(image, &tile_width, &tile_height)) {
+		max->width = VIPS_MAX(max->width, tile_width);
+		max->height = VIPS_MAX(max->height, tile_height);
+	}
+
+	return NULL;
+}
+
+/* Adjust @size to line up with blocks of @unit, so each block is decoded for
+ * only one request. Go up to a multiple of @unit, or down to a divisor of
+ * it, whichever is closest, but don't stray too far from @size.
+ */
+static int
+vips__tile_align(int size, int unit)
+{
+	int d;
+
+	if (unit <= 1 ||
+		size % unit == 0)
+		return size;
+
+	if (unit < size)
+		return VIPS_ROUND_UP(size, unit);
+
+	for (d = size; d >= size / 2 && d > 0; d--)
+		if (unit % d == 0)
+			return d;
+
+	if (unit <= 4 * size)
+		return unit;
+
+	return size;
+}
+
+/* Sinks call this after vips_get_tile_size() to line up their requests with
+ * the natural tiles loaders advertise, see vips__image_set_natural_tile().
+ * @n_lines stays a multiple of @tile_height.
+ */
+void
+vips__tile_size_align(VipsImage *im,
+	int *tile_width, int *tile_height, int *n_lines)
+{
+	VipsNaturalTile max = { 0, 0 };
+
+	(void) vips__link_map(im, TRUE,
+		(VipsSListMap2Fn) vips__tile_natural_max, im, &max);
+	if (max.height == 0)
+		return;
+
+	/* Strip demand styles always use the full width.
+	 */
+	if (*tile_width < im->Xsize)
+		*tile_width = vips__tile_align(*tile_width, max.width);
+	*tile_height = vips__tile_align(*tile_height, max.height);
+	*n_lines = VIPS_ROUND_UP(*n_lines, *tile_height);
+
+	g_info("tile size %d x %d for %s, aligned to %d x %d",
+		*tile_width, *tile_height,
+		im->filename ? im->filename : "image",
+		max.width, max.height);
+}
+
 void
 vips__thread_init(void)
 {
 	if (vips__concurrency == 0)
 		vips__concurrency = vips__concurrency_get_default();
+
+	if (g_getenv("VIPS_TILE_AUTO"))
+		vips__tile_auto = TRUE;
+
+	if (g_getenv("VIPS_NUMA"))
+		vips__numa = TRUE;
 }
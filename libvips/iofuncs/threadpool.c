@@ -23,6 +23,13 @@
  * 	- don't depend on image width when setting n_lines
  * 27/2/19 jtorresfabra
  * 	- free threadpool earlier
+ * 14/10/26
+ * 	- add vips_threadpool_run_steal(), a work-stealing scheduler
+ * 	- pin workers to NUMA nodes, thieves steal from their own node first
+ * 	- workers charge allocations to the image's memory budget
+ * 	- time cond waits in a profile gate
+ * 	- workers take slots from the global scheduler
+ * 	- workers stop between tiles when the image deadline passes
  */
 
 /*
@@ -93,6 +100,10 @@
  */
 static gboolean vips__stall = FALSE;
 
+/* Set to disable the work-stealing scheduler.
+ */
+static gboolean vips__nosteal = FALSE;
+
 /* The global threadset we run workers in.
  */
 static VipsThreadset *vips__threadset = NULL;
@@ -121,6 +132,9 @@ vips__threadpool_init(void)
 	if (g_getenv("VIPS_STALL"))
 		vips__stall = TRUE;
 
+	if (g_getenv("VIPS_NOSTEAL"))
+		vips__nosteal = TRUE;
+
 	/* max_threads > 0 will create a set of threads on startup. This is
 	 * necessary for wasm, but may break on systems that try to fork()
 	 * after init.
@@ -230,8 +244,26 @@ typedef struct _VipsWorker {
 
 	VipsThreadState *state;
 
+	/* Our deque in work-stealing mode.
+	 */
+	int index;
+
+	/* The NUMA node we run on.
+	 */
+	int node;
+
 } VipsWorker;
 
+/* In work-stealing mode, each worker owns a range of tile numbers. The
+ * owner takes tiles from the head, thieves take from the tail. Each deque
+ * has its own lock, so owners only ever contend with thieves.
+ */
+typedef struct _VipsTileDeque {
+	GMutex lock;
+	gint64 head;
+	gint64 tail;
+} VipsTileDeque;
+
 /* What we track for a group of threads working together.
  */
 typedef struct _VipsThreadpool {
@@ -249,6 +281,25 @@ typedef struct _VipsThreadpool {
 
 	int max_workers; /* Max number of workers in pool */
 
+	/* Workers are spread over this many NUMA nodes, and the number of
+	 * workers we've started, for round-robin placement.
+	 */
+	int n_nodes;
+	int n_started;
+
+	/* The memory budget workers charge allocations to, if any.
+	 */
+	VipsBudget *budget;
+
+	/* Our entry in the global scheduler, or NULL if workers can run
+	 * without a slot.
+	 */
+	VipsSchedulerClient *client;
+
+	/* Stop after this monotonic time, or 0 for no deadline.
+	 */
+	gint64 deadline;
+
 	/* The number of workers in the pool (as a negative number, so
 	 * -4 means 4 workers are running).
 	 */
@@ -275,8 +326,37 @@ typedef struct _VipsThreadpool {
 	/* Ask threads to exit, either set by allocate, or on free.
 	 */
 	gboolean stop;
+
+	/* Work-stealing mode: the image is cut into tiles up front and
+	 * tile numbers (in raster order) are shared out between per-worker
+	 * deques.
+	 */
+	int tile_width;
+	int tile_height;
+	int tiles_across;
+	VipsTileDeque *deques;
+	int n_deques;
+
+	/* The number of workers which have run out of tiles.
+	 */
+	int n_finished; // (atomic)
 } VipsThreadpool;
 
+/* Has the deadline for this pool passed? Set an error if it has.
+ */
+static gboolean
+vips_threadpool_expired(VipsThreadpool *pool)
+{
+	if (pool->deadline &&
+		g_get_monotonic_time() > pool->deadline) {
+		vips_error("deadline", _("deadline exceeded for image \"%s\""),
+			pool->im->filename);
+		return TRUE;
+	}
+
+	return FALSE;
+}
+
 static int
 vips_worker_allocate(VipsWorker *worker)
 {
@@ -315,6 +395,12 @@ vips_worker_work_unit(VipsWorker *worker)
 		return -1;
 	}
 
+	if (vips_threadpool_expired(pool)) {
+		pool->error = TRUE;
+		g_mutex_unlock(&pool->allocate_lock);
+		return -1;
+	}
+
 	/* Has a thread been asked to exit? Volunteer if yes.
 	 */
 	if (g_atomic_int_add(&pool->exit, -1) > 0) {
@@ -378,15 +464,27 @@ vips_thread_main_loop(void *a, void *b)
 	VIPS_GATE_START("vips_thread_main_loop: thread");
 
 	g_private_set(&worker_key, worker);
+	(void) vips_budget_set_current(pool->budget);
+
+	if (pool->n_nodes > 1)
+		vips__numa_bind(worker->node);
 
 	/* Process work units! Always tick, even if we are stopping, so the
 	 * main thread will wake up for exit.
 	 */
 	int result = 0;
 	do {
+		gint64 start = pool->client
+			? vips__scheduler_acquire(pool->client)
+			: 0;
+
 		VIPS_GATE_START("vips_worker_work_unit: u");
 		result = vips_worker_work_unit(worker);
 		VIPS_GATE_STOP("vips_worker_work_unit: u");
+
+		if (pool->client)
+			vips__scheduler_release(pool->client, start);
+
 		vips_semaphore_up(&pool->tick);
 	} while (!result);
 
@@ -403,6 +501,7 @@ vips_thread_main_loop(void *a, void *b)
 
 	VIPS_FREE(worker);
 	g_private_set(&worker_key, NULL);
+	(void) vips_budget_set_current(NULL);
 
 	/* We are done: tell the main thread.
 	 */
@@ -412,7 +511,7 @@ vips_thread_main_loop(void *a, void *b)
 /* Attach another thread to a threadpool.
  */
 static int
-vips_worker_new(VipsThreadpool *pool)
+vips_worker_new_full(VipsThreadpool *pool, GFunc loop, int index, int node)
 {
 	VipsWorker *worker;
 
@@ -420,13 +519,15 @@ vips_worker_new(VipsThreadpool *pool)
 		return -1;
 	worker->pool = pool;
 	worker->state = NULL;
+	worker->index = index;
+	worker->node = node;
 
 	/* We can't build the state here, it has to be done by the worker
 	 * itself the first time that allocate runs so that any regions are
 	 * owned by the correct thread.
 	 */
 
-	if (vips_thread_execute("worker", vips_thread_main_loop, worker)) {
+	if (vips_thread_execute("worker", loop, worker)) {
 		g_free(worker);
 		return -1;
 	}
@@ -438,6 +539,14 @@ vips_worker_new(VipsThreadpool *pool)
 	return 0;
 }
 
+static int
+vips_worker_new(VipsThreadpool *pool)
+{
+	int node = pool->n_started++ % pool->n_nodes;
+
+	return vips_worker_new_full(pool, vips_thread_main_loop, 0, node);
+}
+
 void
 vips__worker_lock(GMutex *mutex)
 {
@@ -455,11 +564,25 @@ vips__worker_cond_wait(GCond *cond, GMutex *mutex)
 {
 	VipsWorker *worker = (VipsWorker *) g_private_get(&worker_key);
 
+	VIPS_GATE_START("vips__worker_cond_wait: wait");
+
 	if (worker)
 		g_atomic_int_inc(&worker->pool->n_waiting);
 	g_cond_wait(cond, mutex);
 	if (worker)
 		g_atomic_int_dec_and_test(&worker->pool->n_waiting);
+
+	VIPS_GATE_STOP("vips__worker_cond_wait: wait");
+}
+
+/* The deadline of the threadpool the calling thread works for, or 0.
+ */
+gint64
+vips__worker_get_deadline(void)
+{
+	VipsWorker *worker = (VipsWorker *) g_private_get(&worker_key);
+
+	return worker ? worker->pool->deadline : 0;
 }
 
 static void
@@ -476,6 +599,15 @@ vips_threadpool_free(VipsThreadpool *pool)
 {
 	vips_threadpool_wait(pool);
 
+	if (pool->deques) {
+		int i;
+
+		for (i = 0; i < pool->n_deques; i++)
+			g_mutex_clear(&pool->deques[i].lock);
+		VIPS_FREE(pool->deques);
+	}
+
+	VIPS_FREEF(vips__scheduler_client_free, pool->client);
 	g_mutex_clear(&pool->allocate_lock);
 	vips_semaphore_destroy(&pool->n_workers);
 	vips_semaphore_destroy(&pool->tick);
@@ -500,11 +632,17 @@ vips_threadpool_new(VipsImage *im)
 	pool->work = NULL;
 	g_mutex_init(&pool->allocate_lock);
 	pool->max_workers = vips_concurrency_get();
+	pool->n_nodes = vips__numa_get_n_nodes();
+	pool->n_started = 0;
+	pool->budget = vips_image_get_budget(im);
 	vips_semaphore_init(&pool->n_workers, 0, "n_workers");
 	vips_semaphore_init(&pool->tick, 0, "tick");
 	pool->error = FALSE;
 	pool->stop = FALSE;
 	pool->exit = 0;
+	pool->deques = NULL;
+	pool->n_deques = 0;
+	pool->n_finished = 0;
 
 	/* If this is a tiny image, we won't need all max_workers threads.
 	 * Guess how
@@ -522,6 +660,32 @@ vips_threadpool_new(VipsImage *im)
 	 */
 	pool->max_workers = vips_image_get_concurrency(im, pool->max_workers);
 
+	/* Nested pools keep their parent's deadline.
+	 */
+	pool->deadline = im->deadline;
+	if (g_private_get(&worker_key)) {
+		VipsWorker *parent = (VipsWorker *) g_private_get(&worker_key);
+
+		if (parent->pool->deadline &&
+			(!pool->deadline ||
+				parent->pool->deadline < pool->deadline))
+			pool->deadline = parent->pool->deadline;
+	}
+
+	/* A pool started by a worker (a nested sink, perhaps) runs inside
+	 * its parent's slot, and must not wait for another or it could
+	 * deadlock.
+	 */
+	pool->client = NULL;
+	if (!g_private_get(&worker_key) &&
+		(pool->client = vips__scheduler_client_new(
+			 vips_image_get_priority(im), vips_image_get_weight(im))))
+		/* There's no point starting more workers than there are
+		 * slots.
+		 */
+		pool->max_workers = VIPS_MIN(pool->max_workers,
+			VIPS_MAX(1, vips_scheduler_get_max()));
+
 	return pool;
 }
 
@@ -710,3 +874,359 @@ vips_threadpool_run(VipsImage *im,
 
 	return result;
 }
+
+/* Take the next tile from the front of a deque, or -1 for empty.
+ */
+static gint64
+vips_tile_deque_pop(VipsTileDeque *deque)
+{
+	gint64 tile;
+
+	g_mutex_lock(&deque->lock);
+	if (deque->head < deque->tail)
+		tile = deque->head++;
+	else
+		tile = -1;
+	g_mutex_unlock(&deque->lock);
+
+	return tile;
+}
+
+/* Steal the back half of a deque. Return the number of tiles taken, and the
+ * first of them in @first.
+ */
+static gint64
+vips_tile_deque_steal(VipsTileDeque *deque, gint64 *first)
+{
+	gint64 n;
+
+	g_mutex_lock(&deque->lock);
+	n = (deque->tail - deque->head + 1) / 2;
+	if (n > 0) {
+		deque->tail -= n;
+		*first = deque->tail;
+	}
+	g_mutex_unlock(&deque->lock);
+
+	return n;
+}
+
+/* Deques are shared out between NUMA nodes in contiguous blocks, so each
+ * node works on one band of the image.
+ */
+static int
+vips_threadpool_deque_node(VipsThreadpool *pool, int index)
+{
+	return (gint64) index * pool->n_nodes / pool->n_deques;
+}
+
+/* Steal from one deque. Keep the first stolen tile for ourselves and park
+ * the rest in our deque, where other idle workers can steal them in turn.
+ * Our deque is empty and only we ever add to it, so this is safe.
+ */
+static gint64
+vips_worker_steal_from(VipsWorker *worker, VipsTileDeque *victim)
+{
+	VipsTileDeque *own = &worker->pool->deques[worker->index];
+
+	gint64 first;
+	gint64 n;
+
+	if ((n = vips_tile_deque_steal(victim, &first)) <= 0)
+		return -1;
+
+	if (n > 1) {
+		g_mutex_lock(&own->lock);
+		own->head = first + 1;
+		own->tail = first + n;
+		g_mutex_unlock(&own->lock);
+	}
+
+	return first;
+}
+
+/* Find the next tile for a worker, or -1 if every deque is empty.
+ */
+static gint64
+vips_worker_steal_next(VipsWorker *worker)
+{
+	VipsThreadpool *pool = worker->pool;
+
+	gint64 tile;
+	int pass;
+	int i;
+
+	if ((tile = vips_tile_deque_pop(&pool->deques[worker->index])) >= 0)
+		return tile;
+
+	/* We've run dry. Scan the other deques, starting with our
+	 * neighbour so that thieves spread out. With several NUMA nodes, the
+	 * first pass only tries deques on our own node, since their
+	 * upstream buffers are in our local memory.
+	 */
+	for (pass = pool->n_nodes > 1 ? 0 : 1; pass < 2; pass++) {
+		for (i = 1; i < pool->n_deques; i++) {
+			int index = (worker->index + i) % pool->n_deques;
+
+			if (pass == 0 &&
+				vips_threadpool_deque_node(pool, index) != worker->node)
+				continue;
+
+			if ((tile = vips_worker_steal_from(worker,
+					 &pool->deques[index])) >= 0)
+				return tile;
+		}
+	}
+
+	return -1;
+}
+
+/* Process a single tile in work-stealing mode.
+ */
+static int
+vips_worker_steal_unit(VipsWorker *worker, gint64 tile)
+{
+	VipsThreadpool *pool = worker->pool;
+
+	VipsRect image;
+	VipsRect rect;
+
+	if (vips_threadpool_expired(pool)) {
+		pool->error = TRUE;
+		return -1;
+	}
+
+	/* Start functions are documented as single-threaded, so build the
+	 * state under the pool lock. This only happens once per worker.
+	 */
+	if (!worker->state) {
+		g_mutex_lock(&pool->allocate_lock);
+		worker->state = pool->start(pool->im, pool->a);
+		g_mutex_unlock(&pool->allocate_lock);
+
+		if (!worker->state) {
+			pool->error = TRUE;
+			return -1;
+		}
+	}
+
+	image.left = 0;
+	image.top = 0;
+	image.width = pool->im->Xsize;
+	image.height = pool->im->Ysize;
+	rect.left = (tile % pool->tiles_across) * pool->tile_width;
+	rect.top = (tile / pool->tiles_across) * pool->tile_height;
+	rect.width = pool->tile_width;
+	rect.height = pool->tile_height;
+	vips_rect_intersectrect(&image, &rect, &worker->state->pos);
+	worker->state->x = worker->state->pos.left;
+	worker->state->y = worker->state->pos.top;
+
+	if (pool->work(worker->state, pool->a)) {
+		pool->error = TRUE;
+		return -1;
+	}
+
+	/* The work function can ask for early termination.
+	 */
+	if (worker->state->stop) {
+		pool->stop = TRUE;
+		return -1;
+	}
+
+	return 0;
+}
+
+/* The main loop for a thread in work-stealing mode. There's no shared
+ * allocate, so workers never queue on the pool lock.
+ */
+static void
+vips_thread_steal_loop(void *a, void *b)
+{
+	VipsWorker *worker = (VipsWorker *) a;
+	VipsThreadpool *pool = worker->pool;
+
+	gint64 tile;
+
+	VIPS_GATE_START("vips_thread_steal_loop: thread");
+
+	g_private_set(&worker_key, worker);
+	(void) vips_budget_set_current(pool->budget);
+
+	if (pool->n_nodes > 1)
+		vips__numa_bind(worker->node);
+
+	while (!pool->stop &&
+		!pool->error &&
+		(tile = vips_worker_steal_next(worker)) >= 0) {
+		gint64 start = pool->client
+			? vips__scheduler_acquire(pool->client)
+			: 0;
+		int result;
+
+		VIPS_GATE_START("vips_worker_steal_unit: u");
+		result = vips_worker_steal_unit(worker, tile);
+		VIPS_GATE_STOP("vips_worker_steal_unit: u");
+
+		if (pool->client)
+			vips__scheduler_release(pool->client, start);
+
+		vips_semaphore_up(&pool->tick);
+
+		if (result)
+			break;
+	}
+
+	VIPS_GATE_STOP("vips_thread_steal_loop: thread");
+
+	/* Unreffing the state will call stop functions, so single-thread.
+	 */
+	g_mutex_lock(&pool->allocate_lock);
+
+	VIPS_FREEF(g_object_unref, worker->state);
+
+	g_mutex_unlock(&pool->allocate_lock);
+
+	VIPS_FREE(worker);
+	g_private_set(&worker_key, NULL);
+	(void) vips_budget_set_current(NULL);
+
+	/* Wake the main thread so it can see we've finished.
+	 */
+	g_atomic_int_inc(&pool->n_finished);
+	vips_semaphore_up(&pool->tick);
+
+	vips_semaphore_upn(&pool->n_workers, 1);
+}
+
+/**
+ * vips_threadpool_run_steal:
+ * @im: image to loop over
+ * @start: (scope async): allocate per-thread state
+ * @work: (scope async): process a work unit
+ * @progress: (scope async): give progress feedback about a work unit, or `NULL`
+ * @tile_width: width of work units
+ * @tile_height: height of work units
+ * @a: client data
+ *
+ * Like [func@threadpool_run], but rather than calling an allocate function
+ * to hand out work, @im is cut into @tile_width by @tile_height tiles up
+ * front. Each worker is given its own run of tiles, and workers which run
+ * out steal tiles from the others. Work allocation no longer needs a shared
+ * lock, so this scales better to large numbers of threads.
+ *
+ * @work is called with @pos in the thread state set to the tile to
+ * process. Tiles are visited in no particular order, so this is only
+ * useful for sinks which can accept pixels in any order. Sinks which need
+ * strict top-to-bottom ordering (for sequential sources, for example)
+ * should use [func@threadpool_run].
+ *
+ * Set the environment variable `VIPS_NOSTEAL` to make
+ * [func@threadpool_can_steal] return `FALSE`.
+ *
+ * ::: seealso
+ *     [func@threadpool_run], [func@concurrency_set].
+ *
+ * Returns: 0 on success, or -1 on error.
+ */
+int
+vips_threadpool_run_steal(VipsImage *im,
+	VipsThreadStartFn start,
+	VipsThreadpoolWorkFn work,
+	VipsThreadpoolProgressFn progress,
+	int tile_width, int tile_height,
+	void *a)
+{
+	VipsThreadpool *pool;
+	gint64 n_tiles;
+	int tiles_down;
+	int result;
+	int i;
+
+	g_assert(tile_width > 0);
+	g_assert(tile_height > 0);
+
+	if (!(pool = vips_threadpool_new(im)))
+		return -1;
+
+	pool->start = start;
+	pool->work = work;
+	pool->a = a;
+	pool->tile_width = tile_width;
+	pool->tile_height = tile_height;
+	pool->tiles_across = VIPS_ROUND_UP(im->Xsize, tile_width) / tile_width;
+	tiles_down = VIPS_ROUND_UP(im->Ysize, tile_height) / tile_height;
+	n_tiles = (gint64) pool->tiles_across * tiles_down;
+
+	/* There's no allocate to queue on, so we can't use n_waiting to size
+	 * the pool. Just run max_workers threads.
+	 */
+	pool->n_deques = VIPS_CLIP(1, pool->max_workers, n_tiles);
+	if (!(pool->deques = VIPS_ARRAY(NULL, pool->n_deques, VipsTileDeque))) {
+		pool->n_deques = 0;
+		vips_threadpool_free(pool);
+		return -1;
+	}
+
+	/* Contiguous runs of tiles keep each worker's regions close together
+	 * in the image.
+	 */
+	for (i = 0; i < pool->n_deques; i++) {
+		g_mutex_init(&pool->deques[i].lock);
+		pool->deques[i].head = n_tiles * i / pool->n_deques;
+		pool->deques[i].tail = n_tiles * (i + 1) / pool->n_deques;
+	}
+
+	for (i = 0; i < pool->n_deques; i++)
+		if (vips_worker_new_full(pool, vips_thread_steal_loop, i,
+				vips_threadpool_deque_node(pool, i))) {
+			vips_threadpool_free(pool);
+			return -1;
+		}
+
+	for (;;) {
+		vips_semaphore_down(&pool->tick);
+
+		VIPS_DEBUG_MSG("vips_threadpool_run_steal: tick\n");
+
+		if (progress &&
+			progress(pool->a)) {
+			pool->error = TRUE;
+			break;
+		}
+
+		if (pool->stop ||
+			pool->error ||
+			g_atomic_int_get(&pool->n_finished) == pool->n_deques)
+			break;
+	}
+
+	vips_threadpool_wait(pool);
+
+	result = pool->error ? -1 : 0;
+
+	vips_threadpool_free(pool);
+
+	if (!vips_image_get_typeof(im, "vips-no-minimise"))
+		vips_image_minimise_all(im);
+
+	return result;
+}
+
+/**
+ * vips_threadpool_can_steal:
+ * @im: image to test
+ *
+ * Sinks which don't care about the order pixels arrive in can use this to
+ * decide between [func@threadpool_run_steal] and [func@threadpool_run].
+ * Images with sequential sources must be computed top-to-bottom, so this is
+ * `FALSE` for them.
+ *
+ * Returns: `TRUE` if [func@threadpool_run_steal] can compute @im.
+ */
+gboolean
+vips_threadpool_can_steal(VipsImage *im)
+{
+	return !vips__nosteal &&
+		!vips_image_is_sequential(im);
+}
@@ -46,6 +46,8 @@
 #include <string.h>
 #include <ctype.h>
 #include <errno.h>
+#include <float.h>
+#include <math.h>
 
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -2067,6 +2069,524 @@ vips__get_iso8601(void)
 	return date;
 }
 
+/* Powers of ten which are exact doubles.
+ */
+static const double vips_pow10_exact[] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+/* Convert the plain decimal number in [p, end), eg. "-12.5e3", without
+ * copying or a trip through the C library.
+ *
+ * We only handle the common case: the mantissa fits in 53 bits and the
+ * power of ten is exact, so a single multiply or divide gives the correctly
+ * rounded result (Clinger's fast path). Anything else (long mantissas, large
+ * exponents, hex, inf, trailing junk) returns FALSE and the caller should
+ * fall back to vips_strtod().
+ */
+gboolean
+vips__strtod_fast(const char *p, const char *end, double *out)
+{
+	gboolean negative;
+	guint64 mantissa;
+	int n_digits;
+	int exponent;
+	gboolean seen_digit;
+	double value;
+
+	/* With x87 excess precision the result can be double-rounded.
+	 */
+#if !defined(FLT_EVAL_METHOD) || FLT_EVAL_METHOD != 0
+	return FALSE;
+#endif
+
+	negative = FALSE;
+	if (p < end &&
+		(*p == '-' || *p == '+')) {
+		negative = *p == '-';
+		p += 1;
+	}
+
+	mantissa = 0;
+	n_digits = 0;
+	exponent = 0;
+	seen_digit = FALSE;
+
+	for (; p < end && g_ascii_isdigit(*p); p++) {
+		seen_digit = TRUE;
+
+		/* Skip leading zeros.
+		 */
+		if (mantissa == 0 &&
+			*p == '0')
+			continue;
+		if (n_digits >= 19)
+			return FALSE;
+		mantissa = mantissa * 10 + (*p - '0');
+		n_digits += 1;
+	}
+
+	if (p < end &&
+		*p == '.') {
+		p += 1;
+
+		for (; p < end && g_ascii_isdigit(*p); p++) {
+			seen_digit = TRUE;
+			exponent -= 1;
+
+			if (mantissa == 0 &&
+				*p == '0')
+				continue;
+			if (n_digits >= 19)
+				return FALSE;
+			mantissa = mantissa * 10 + (*p - '0');
+			n_digits += 1;
+		}
+	}
+
+	if (!seen_digit)
+		return FALSE;
+
+	if (p < end &&
+		(*p == 'e' || *p == 'E')) {
+		gboolean negative_exponent;
+		int e;
+
+		p += 1;
+		negative_exponent = FALSE;
+		if (p < end &&
+			(*p == '-' || *p == '+')) {
+			negative_exponent = *p == '-';
+			p += 1;
+		}
+
+		if (p >= end ||
+			!g_ascii_isdigit(*p))
+			return FALSE;
+
+		for (e = 0; p < end && g_ascii_isdigit(*p); p++) {
+			if (e > 10000)
+				return FALSE;
+			e = e * 10 + (*p - '0');
+		}
+
+		exponent += negative_exponent ? -e : e;
+	}
+
+	if (p != end)
+		return FALSE;
+
+	if (mantissa == 0)
+		value = 0.0;
+	else if (mantissa > (G_GUINT64_CONSTANT(1) << 53) ||
+		exponent < -22 ||
+		exponent > 22)
+		return FALSE;
+	else if (exponent < 0)
+		value = (double) mantissa / vips_pow10_exact[-exponent];
+	else
+		value = (double) mantissa * vips_pow10_exact[exponent];
+
+	*out = negative ? -value : value;
+
+	return TRUE;
+}
+
+/* Shortest round-trip double to string, after Grisu2 by Florian Loitsch,
+ * "Printing floating-point numbers quickly and accurately with integers"
+ * (PLDI 2010), as in Milo Yip's public domain dtoa-benchmark.
+ *
+ * A DIY floating point number is f * 2^e with a 64-bit f.
+ */
+typedef struct _VipsDiyFp {
+	guint64 f;
+	int e;
+} VipsDiyFp;
+
+#define DP_HIDDEN_BIT (G_GUINT64_CONSTANT(0x0010000000000000))
+#define DP_SIGNIFICAND_MASK (G_GUINT64_CONSTANT(0x000FFFFFFFFFFFFF))
+
+/* Normalised 10^-348, 10^-340, ..., 10^340.
+ */
+static const guint64 vips_cached_powers_f[] = {
+	G_GUINT64_CONSTANT(0xfa8fd5a0081c0288), G_GUINT64_CONSTANT(0xbaaee17fa23ebf76),
+	G_GUINT64_CONSTANT(0x8b16fb203055ac76), G_GUINT64_CONSTANT(0xcf42894a5dce35ea),
+	G_GUINT64_CONSTANT(0x9a6bb0aa55653b2d), G_GUINT64_CONSTANT(0xe61acf033d1a45df),
+	G_GUINT64_CONSTANT(0xab70fe17c79ac6ca), G_GUINT64_CONSTANT(0xff77b1fcbebcdc4f),
+	G_GUINT64_CONSTANT(0xbe5691ef416bd60c), G_GUINT64_CONSTANT(0x8dd01fad907ffc3c),
+	G_GUINT64_CONSTANT(0xd3515c2831559a83), G_GUINT64_CONSTANT(0x9d71ac8fada6c9b5),
+	G_GUINT64_CONSTANT(0xea9c227723ee8bcb), G_GUINT64_CONSTANT(0xaecc49914078536d),
+	G_GUINT64_CONSTANT(0x823c12795db6ce57), G_GUINT64_CONSTANT(0xc21094364dfb5637),
+	G_GUINT64_CONSTANT(0x9096ea6f3848984f), G_GUINT64_CONSTANT(0xd77485cb25823ac7),
+	G_GUINT64_CONSTANT(0xa086cfcd97bf97f4), G_GUINT64_CONSTANT(0xef340a98172aace5),
+	G_GUINT64_CONSTANT(0xb23867fb2a35b28e), G_GUINT64_CONSTANT(0x84c8d4dfd2c63f3b),
+	G_GUINT64_CONSTANT(0xc5dd44271ad3cdba), G_GUINT64_CONSTANT(0x936b9fcebb25c996),
+	G_GUINT64_CONSTANT(0xdbac6c247d62a584), G_GUINT64_CONSTANT(0xa3ab66580d5fdaf6),
+	G_GUINT64_CONSTANT(0xf3e2f893dec3f126), G_GUINT64_CONSTANT(0xb5b5ada8aaff80b8),
+	G_GUINT64_CONSTANT(0x87625f056c7c4a8b), G_GUINT64_CONSTANT(0xc9bcff6034c13053),
+	G_GUINT64_CONSTANT(0x964e858c91ba2655), G_GUINT64_CONSTANT(0xdff9772470297ebd),
+	G_GUINT64_CONSTANT(0xa6dfbd9fb8e5b88f), G_GUINT64_CONSTANT(0xf8a95fcf88747d94),
+	G_GUINT64_CONSTANT(0xb94470938fa89bcf), G_GUINT64_CONSTANT(0x8a08f0f8bf0f156b),
+	G_GUINT64_CONSTANT(0xcdb02555653131b6), G_GUINT64_CONSTANT(0x993fe2c6d07b7fac),
+	G_GUINT64_CONSTANT(0xe45c10c42a2b3b06), G_GUINT64_CONSTANT(0xaa242499697392d3),
+	G_GUINT64_CONSTANT(0xfd87b5f28300ca0e), G_GUINT64_CONSTANT(0xbce5086492111aeb),
+	G_GUINT64_CONSTANT(0x8cbccc096f5088cc), G_GUINT64_CONSTANT(0xd1b71758e219652c),
+	G_GUINT64_CONSTANT(0x9c40000000000000), G_GUINT64_CONSTANT(0xe8d4a51000000000),
+	G_GUINT64_CONSTANT(0xad78ebc5ac620000), G_GUINT64_CONSTANT(0x813f3978f8940984),
+	G_GUINT64_CONSTANT(0xc097ce7bc90715b3), G_GUINT64_CONSTANT(0x8f7e32ce7bea5c70),
+	G_GUINT64_CONSTANT(0xd5d238a4abe98068), G_GUINT64_CONSTANT(0x9f4f2726179a2245),
+	G_GUINT64_CONSTANT(0xed63a231d4c4fb27), G_GUINT64_CONSTANT(0xb0de65388cc8ada8),
+	G_GUINT64_CONSTANT(0x83c7088e1aab65db), G_GUINT64_CONSTANT(0xc45d1df942711d9a),
+	G_GUINT64_CONSTANT(0x924d692ca61be758), G_GUINT64_CONSTANT(0xda01ee641a708dea),
+	G_GUINT64_CONSTANT(0xa26da3999aef774a), G_GUINT64_CONSTANT(0xf209787bb47d6b85),
+	G_GUINT64_CONSTANT(0xb454e4a179dd1877), G_GUINT64_CONSTANT(0x865b86925b9bc5c2),
+	G_GUINT64_CONSTANT(0xc83553c5c8965d3d), G_GUINT64_CONSTANT(0x952ab45cfa97a0b3),
+	G_GUINT64_CONSTANT(0xde469fbd99a05fe3), G_GUINT64_CONSTANT(0xa59bc234db398c25),
+	G_GUINT64_CONSTANT(0xf6c69a72a3989f5c), G_GUINT64_CONSTANT(0xb7dcbf5354e9bece),
+	G_GUINT64_CONSTANT(0x88fcf317f22241e2), G_GUINT64_CONSTANT(0xcc20ce9bd35c78a5),
+	G_GUINT64_CONSTANT(0x98165af37b2153df), G_GUINT64_CONSTANT(0xe2a0b5dc971f303a),
+	G_GUINT64_CONSTANT(0xa8d9d1535ce3b396), G_GUINT64_CONSTANT(0xfb9b7cd9a4a7443c),
+	G_GUINT64_CONSTANT(0xbb764c4ca7a44410), G_GUINT64_CONSTANT(0x8bab8eefb6409c1a),
+	G_GUINT64_CONSTANT(0xd01fef10a657842c), G_GUINT64_CONSTANT(0x9b10a4e5e9913129),
+	G_GUINT64_CONSTANT(0xe7109bfba19c0c9d), G_GUINT64_CONSTANT(0xac2820d9623bf429),
+	G_GUINT64_CONSTANT(0x80444b5e7aa7cf85), G_GUINT64_CONSTANT(0xbf21e44003acdd2d),
+	G_GUINT64_CONSTANT(0x8e679c2f5e44ff8f), G_GUINT64_CONSTANT(0xd433179d9c8cb841),
+	G_GUINT64_CONSTANT(0x9e19db92b4e31ba9), G_GUINT64_CONSTANT(0xeb96bf6ebadf77d9),
+	G_GUINT64_CONSTANT(0xaf87023b9bf0ee6b)
+};
+
+static const gint16 vips_cached_powers_e[] = {
+	-1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980,
+	-954, -927, -901, -874, -847, -821, -794, -768, -741, -715,
+	-688, -661, -635, -608, -582, -555, -529, -502, -475, -449,
+	-422, -396, -369, -343, -316, -289, -263, -236, -210, -183,
+	-157, -130, -103, -77, -50, -24, 3, 30, 56, 83,
+	109, 136, 162, 189, 216, 242, 269, 295, 322, 348,
+	375, 402, 428, 455, 481, 508, 534, 561, 588, 614,
+	641, 667, 694, 720, 747, 774, 800, 827, 853, 880,
+	907, 933, 960, 986, 1013, 1039, 1066
+};
+
+static const guint64 vips_pow10_u64[] = {
+	G_GUINT64_CONSTANT(1),
+	G_GUINT64_CONSTANT(10),
+	G_GUINT64_CONSTANT(100),
+	G_GUINT64_CONSTANT(1000),
+	G_GUINT64_CONSTANT(10000),
+	G_GUINT64_CONSTANT(100000),
+	G_GUINT64_CONSTANT(1000000),
+	G_GUINT64_CONSTANT(10000000),
+	G_GUINT64_CONSTANT(100000000),
+	G_GUINT64_CONSTANT(1000000000),
+	G_GUINT64_CONSTANT(10000000000),
+	G_GUINT64_CONSTANT(100000000000),
+	G_GUINT64_CONSTANT(1000000000000),
+	G_GUINT64_CONSTANT(10000000000000),
+	G_GUINT64_CONSTANT(100000000000000),
+	G_GUINT64_CONSTANT(1000000000000000),
+	G_GUINT64_CONSTANT(10000000000000000),
+	G_GUINT64_CONSTANT(100000000000000000),
+	G_GUINT64_CONSTANT(1000000000000000000),
+	G_GUINT64_CONSTANT(10000000000000000000)
+};
+
+static VipsDiyFp
+vips_diyfp(guint64 f, int e)
+{
+	VipsDiyFp x = { f, e };
+
+	return x;
+}
+
+/* The rounded top 64 bits of the product.
+ */
+static VipsDiyFp
+vips_diyfp_mul(VipsDiyFp x, VipsDiyFp y)
+{
+	const guint64 m32 = 0xFFFFFFFF;
+	guint64 a = x.f >> 32;
+	guint64 b = x.f & m32;
+	guint64 c = y.f >> 32;
+	guint64 d = y.f & m32;
+	guint64 ac = a * c;
+	guint64 bc = b * c;
+	guint64 ad = a * d;
+	guint64 bd = b * d;
+	guint64 tmp = (bd >> 32) + (ad & m32) + (bc & m32) + (1U << 31);
+
+	return vips_diyfp(ac + (ad >> 32) + (bc >> 32) + (tmp >> 32),
+		x.e + y.e + 64);
+}
+
+static VipsDiyFp
+vips_diyfp_normalize(VipsDiyFp x)
+{
+	while (!(x.f & (G_GUINT64_CONSTANT(1) << 63))) {
+		x.f <<= 1;
+		x.e -= 1;
+	}
+
+	return x;
+}
+
+static void
+vips_grisu_round(char *buffer, int length,
+	guint64 delta, guint64 rest, guint64 ten_kappa, guint64 wp_w)
+{
+	while (rest < wp_w &&
+		delta - rest >= ten_kappa &&
+		(rest + ten_kappa < wp_w ||
+			wp_w - rest > rest + ten_kappa - wp_w)) {
+		buffer[length - 1] -= 1;
+		rest += ten_kappa;
+	}
+}
+
+static int
+vips_count_digits(guint32 n)
+{
+	int digits;
+
+	for (digits = 1; digits < 10 && n >= vips_pow10_u64[digits]; digits++)
+		;
+
+	return digits;
+}
+
+static void
+vips_grisu_digits(VipsDiyFp w, VipsDiyFp mp, guint64 delta,
+	char *buffer, int *length, int *k)
+{
+	VipsDiyFp one = vips_diyfp(G_GUINT64_CONSTANT(1) << -mp.e, mp.e);
+	guint64 wp_w = mp.f - w.f;
+	guint32 p1 = (guint32) (mp.f >> -one.e);
+	guint64 p2 = mp.f & (one.f - 1);
+	int kappa = vips_count_digits(p1);
+
+	*length = 0;
+
+	while (kappa > 0) {
+		guint32 d;
+		guint64 rest;
+
+		d = p1 / vips_pow10_u64[kappa - 1];
+		p1 %= vips_pow10_u64[kappa - 1];
+		if (d ||
+			*length)
+			buffer[(*length)++] = '0' + d;
+		kappa -= 1;
+
+		rest = ((guint64) p1 << -one.e) + p2;
+		if (rest <= delta) {
+			*k += kappa;
+			vips_grisu_round(buffer, *length, delta, rest,
+				vips_pow10_u64[kappa] << -one.e, wp_w);
+			return;
+		}
+	}
+
+	for (;;) {
+		int d;
+
+		p2 *= 10;
+		delta *= 10;
+		d = p2 >> -one.e;
+		if (d ||
+			*length)
+			buffer[(*length)++] = '0' + d;
+		p2 &= one.f - 1;
+		kappa -= 1;
+
+		if (p2 < delta) {
+			*k += kappa;
+			vips_grisu_round(buffer, *length, delta, p2, one.f,
+				-kappa < 20 ? wp_w * vips_pow10_u64[-kappa] : 0);
+			return;
+		}
+	}
+}
+
+/* Generate the shortest digits for positive, finite, nonzero @value, so
+ * that value ~= digits * 10^k.
+ */
+static void
+vips_grisu2(double value, char *buffer, int *length, int *k)
+{
+	union {
+		double d;
+		guint64 u;
+	} bits;
+	VipsDiyFp v, plus, minus, c_mk, w;
+	int biased_e;
+	double dk;
+	int ik;
+	int index;
+
+	bits.d = value;
+	biased_e = (bits.u >> 52) & 0x7FF;
+	if (biased_e)
+		v = vips_diyfp((bits.u & DP_SIGNIFICAND_MASK) | DP_HIDDEN_BIT,
+			biased_e - 1075);
+	else
+		v = vips_diyfp(bits.u & DP_SIGNIFICAND_MASK, -1074);
+
+	/* The boundaries halfway to the neighbouring doubles, with plus
+	 * normalised and minus scaled to the same exponent.
+	 */
+	plus = vips_diyfp_normalize(vips_diyfp((v.f << 1) + 1, v.e - 1));
+	if (v.f == DP_HIDDEN_BIT)
+		minus = vips_diyfp((v.f << 2) - 1, v.e - 2);
+	else
+		minus = vips_diyfp((v.f << 1) - 1, v.e - 1);
+	minus.f <<= minus.e - plus.e;
+	minus.e = plus.e;
+
+	/* Pick a cached power of ten to bring plus.e into range.
+	 */
+	dk = (-61 - plus.e) * 0.30102999566398114 + 347;
+	ik = (int) dk;
+	if (dk - ik > 0.0)
+		ik += 1;
+	index = (ik >> 3) + 1;
+	*k = -(-348 + (index << 3));
+	c_mk = vips_diyfp(vips_cached_powers_f[index],
+		vips_cached_powers_e[index]);
+
+	w = vips_diyfp_mul(vips_diyfp_normalize(v), c_mk);
+	plus = vips_diyfp_mul(plus, c_mk);
+	minus = vips_diyfp_mul(minus, c_mk);
+	minus.f += 1;
+	plus.f -= 1;
+
+	vips_grisu_digits(w, plus, plus.f - minus.f, buffer, length, k);
+}
+
+/* Format @value as ASCII into @buf, which must have at least
+ * VIPS__DTOA_BUF_SIZE bytes. The output reads back to exactly @value, with
+ * as few digits as we can manage, and follows printf() "%g" layout. The
+ * result is not NULL-terminated. Return the number of bytes written.
+ */
+int
+vips__dtoa(char *buf, double value)
+{
+	char digits[20];
+	char *p;
+	int length;
+	int k;
+	int exponent;
+	int i;
+
+	p = buf;
+
+	if (isnan(value)) {
+		memcpy(p, "nan", 3);
+		return 3;
+	}
+
+	if (signbit(value)) {
+		*p++ = '-';
+		value = -value;
+	}
+
+	if (isinf(value)) {
+		memcpy(p, "inf", 3);
+		return p - buf + 3;
+	}
+
+	if (value == 0.0) {
+		*p++ = '0';
+		return p - buf;
+	}
+
+	vips_grisu2(value, digits, &length, &k);
+
+	/* The exponent of the first digit.
+	 */
+	exponent = length + k - 1;
+
+	if (exponent >= -5 &&
+		exponent < 17) {
+		if (exponent < 0) {
+			*p++ = '0';
+			*p++ = '.';
+			for (i = -1; i > exponent; i--)
+				*p++ = '0';
+			memcpy(p, digits, length);
+			p += length;
+		}
+		else if (k >= 0) {
+			memcpy(p, digits, length);
+			p += length;
+			for (i = 0; i < k; i++)
+				*p++ = '0';
+		}
+		else {
+			memcpy(p, digits, exponent + 1);
+			p += exponent + 1;
+			*p++ = '.';
+			memcpy(p, digits + exponent + 1, length - exponent - 1);
+			p += length - exponent - 1;
+		}
+	}
+	else {
+		*p++ = digits[0];
+		if (length > 1) {
+			*p++ = '.';
+			memcpy(p, digits + 1, length - 1);
+			p += length - 1;
+		}
+
+		*p++ = 'e';
+		if (exponent < 0) {
+			*p++ = '-';
+			exponent = -exponent;
+		}
+		else
+			*p++ = '+';
+		if (exponent >= 100) {
+			*p++ = '0' + exponent / 100;
+			exponent %= 100;
+		}
+		*p++ = '0' + exponent / 10;
+		*p++ = '0' + exponent % 10;
+	}
+
+	return p - buf;
+}
+
+/* Format an integer into @buf, which must have at least VIPS__DTOA_BUF_SIZE
+ * bytes. The result is not NULL-terminated. Return the number of bytes
+ * written.
+ */
+int
+vips__itoa(char *buf, gint64 value)
+{
+	char digits[20];
+	guint64 n;
+	char *p;
+	int i;
+
+	p = buf;
+	if (value < 0) {
+		*p++ = '-';
+		n = -(guint64) value;
+	}
+	else
+		n = value;
+
+	i = 0;
+	do {
+		digits[i++] = '0' + n % 10;
+		n /= 10;
+	} while (n);
+
+	while (i > 0)
+		*p++ = digits[--i];
+
+	return p - buf;
+}
+
 /* Convert a string to a double in the ASCII locale (ie. decimal point is
  * ".").
  */
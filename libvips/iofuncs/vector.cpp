@@ -2,6 +2,8 @@
  *
  * 29/07/21 kleisauke
  * 	- from vector.c
+ * 15/10/26
+ * 	- add vips_vector_set_target() and VIPS_VECTOR_TARGET
  */
 
 /*
@@ -80,6 +82,11 @@ vips__vector_init()
 	/* Check whether any features are being disabled by the environment.
 	 */
 	const char *env;
+	if ((env = g_getenv("VIPS_VECTOR_TARGET")) &&
+		vips_vector_set_target(env)) {
+		g_warning("%s", vips_error_buffer());
+		vips_error_clear();
+	}
 	if ((env = g_getenv("VIPS_VECTOR")))
 		return vips_vector_disable_targets(
 			g_ascii_strtoll(env, nullptr, 0));
@@ -187,3 +194,66 @@ vips_vector_disable_targets(gint64 disabled_targets)
 		vips_vector_get_supported_targets() & ~disabled_targets);
 #endif
 }
+
+/**
+ * vips_vector_set_target:
+ * @name: (nullable): the target to use, or `NULL`
+ *
+ * Pin runtime dispatch to a single target, for example `"AVX2"` or
+ * `"NEON"`, so that kernels run with the same instructions on every host.
+ * This is handy for comparing hosts in production, or timing one target
+ * against another.
+ *
+ * The name `"scalar"` turns off the vector paths entirely, as
+ * [func@vector_set_enabled] does. `NULL` or an empty string restores
+ * dispatch to the best target this CPU supports.
+ *
+ * This can also be set using the `VIPS_VECTOR_TARGET` environment variable
+ * or the `--vips-vector-target` command-line flag.
+ *
+ * ::: seealso
+ *     [func@vector_get_supported_targets], [func@vector_target_name].
+ *
+ * Returns: 0 on success, -1 if the target was not built or is not
+ * supported by this CPU.
+ */
+int
+vips_vector_set_target(const char *name)
+{
+#ifdef HAVE_HWY
+	/* Go back to the full set, so we can pick from it.
+	 */
+	hwy::SetSupportedTargetsForTest(0);
+#endif /*HAVE_HWY*/
+
+	if (!name ||
+		!name[0]) {
+		vips__vector_enabled = TRUE;
+		return 0;
+	}
+
+	if (g_ascii_strcasecmp(name, "scalar") == 0) {
+		vips__vector_enabled = FALSE;
+		return 0;
+	}
+
+#ifdef HAVE_HWY
+	gint64 supported = vips_vector_get_supported_targets();
+
+	for (int i = 0; i < 63; i++) {
+		gint64 target = (gint64) 1 << i;
+
+		if ((supported & target) &&
+			g_ascii_strcasecmp(name, vips_vector_target_name(target)) == 0) {
+			hwy::SetSupportedTargetsForTest(target);
+			vips__vector_enabled = TRUE;
+			return 0;
+		}
+	}
+#endif /*HAVE_HWY*/
+
+	vips_error("vips_vector_set_target",
+		_("target \"%s\" is not supported"), name);
+
+	return -1;
+}
@@ -27,6 +27,8 @@
  * 	- escape ASCII control characters in XML
  * 29/8/19
  * 	- verify bands/format for coded images
+ * 14/10/26
+ * 	- export XML build and read for the tiled layout in vipstiled.c
  */
 
 /*
@@ -719,17 +721,17 @@ parser_data_handler(void *user_data, const XML_Char *data, int len)
 	vips_dbuf_write(&vep->dbuf, (unsigned char *) data, len);
 }
 
-/* Called at the end of vips open ... get any XML after the pixel data
- * and read it in.
+/* Read the XML block starting at @offset in @fd and attach it to @im. The
+ * tiled layout in vipstiled.c keeps its XML somewhere else.
  */
-static int
-readhist(VipsImage *im)
+int
+vips__readhist_fd(VipsImage *im, int fd, gint64 offset)
 {
 	VipsExpatParse vep = { 0 };
 
 	XML_Parser parser;
 
-	if (vips__seek(im->fd, image_pixel_length(im), SEEK_SET) == -1)
+	if (vips__seek(fd, offset, SEEK_SET) == -1)
 		return -1;
 
 	parser = XML_ParserCreate("UTF-8");
@@ -741,7 +743,7 @@ readhist(VipsImage *im)
 		parser_element_start_handler, parser_element_end_handler);
 	XML_SetCharacterDataHandler(parser, parser_data_handler);
 
-	if (parser_read_fd(parser, im->fd) ||
+	if (parser_read_fd(parser, fd) ||
 		vep.error) {
 		vips_dbuf_destroy(&vep.dbuf);
 		XML_ParserFree(parser);
@@ -754,6 +756,15 @@ readhist(VipsImage *im)
 	return 0;
 }
 
+/* Called at the end of vips open ... get any XML after the pixel data
+ * and read it in.
+ */
+static int
+readhist(VipsImage *im)
+{
+	return vips__readhist_fd(im, im->fd, image_pixel_length(im));
+}
+
 int
 vips__write_extension_block(VipsImage *im, void *buf, size_t size)
 {
@@ -843,10 +854,11 @@ build_xml_meta(VipsMeta *meta, VipsTarget *target, void *b)
 	return NULL;
 }
 
-/* Make the xml we append to vips images after the pixel data.
+/* Make the xml we append to vips images after the pixel data. Free with
+ * g_free().
  */
-static char *
-build_xml(VipsImage *image)
+char *
+vips__build_xml(VipsImage *image)
 {
 	VipsTarget *target;
 	const char *str;
@@ -976,7 +988,7 @@ vips__writehist(VipsImage *image)
 	assert(image->dtype == VIPS_IMAGE_OPENOUT);
 	assert(image->fd != -1);
 
-	if (!(xml = build_xml(image)))
+	if (!(xml = vips__build_xml(image)))
 		return -1;
 
 	if (vips__write_extension_block(image, xml, strlen(xml))) {
@@ -6,6 +6,9 @@
  *	- block mmaps of nodata images
  * 6/7/25
  *	- use much larger mmap windows to limit scrolling
+ * 14/10/26
+ * 	- madvise() windows from the access pattern
+ * 	- keep recently released mappings in a global LRU
  */
 
 /*
@@ -52,6 +55,8 @@
 #endif /*HAVE_UNISTD_H*/
 #include <errno.h>
 #include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
 #ifdef HAVE_SYS_MMAN_H
 #include <sys/mman.h>
 #endif
@@ -77,6 +82,42 @@ int vips__read_test;
 static gint64 vips__window_bytes =
 	(gint64) 1024 * 1024 * (sizeof(size_t) > 4 ? 10000 : 10);
 
+/* The access pattern loaders have told us to expect for an image, see
+ * vips__window_set_access(). Default to random.
+ */
+static GQuark vips__window_access_quark = 0;
+
+/* Mappings released by windows are parked here rather than unmapped, so
+ * many short regions on the same file don't map and unmap the same range
+ * over and over. Entries are detached from any image and identified by the
+ * file they map, most recently used at the head.
+ */
+typedef struct _VipsWindowCached {
+	/* The file, plus enough to spot it being rewritten in place.
+	 */
+	dev_t dev;
+	ino_t ino;
+	gint64 size;
+	gint64 mtime;
+
+	/* To drop entries for temp files as they are deleted.
+	 */
+	char *filename;
+
+	gint64 pagestart;
+	void *baseaddr;
+	size_t length;
+} VipsWindowCached;
+
+static GMutex vips_window_cache_lock;
+static GQueue vips_window_cache = G_QUEUE_INIT;
+static gint64 vips_window_cache_bytes = 0;
+
+/* Max bytes of released mappings to keep. Windows are large, and a parked
+ * mapping costs address space rather than memory, so allow a few of them.
+ */
+static gint64 vips_window_cache_max_bytes = -1;
+
 /* Track global mmap usage.
  */
 #ifdef DEBUG_TOTAL
@@ -84,13 +125,192 @@ static int total_mmap_usage = 0;
 static int max_mmap_usage = 0;
 #endif /*DEBUG_TOTAL*/
 
+static gint64
+vips_window_cache_get_max(void)
+{
+	if (vips_window_cache_max_bytes < 0)
+		vips_window_cache_max_bytes = 4 * vips__window_bytes;
+
+	return vips_window_cache_max_bytes;
+}
+
+static void
+vips_window_cached_free(VipsWindowCached *cached)
+{
+	(void) vips__munmap(cached->baseaddr, cached->length);
+	g_free(cached->filename);
+	g_free(cached);
+}
+
+/* Drop the oldest entries until we are under the limit. Call with the lock
+ * held.
+ */
+static void
+vips_window_cache_trim(gint64 max_bytes)
+{
+	while (vips_window_cache_bytes > max_bytes) {
+		VipsWindowCached *cached = g_queue_pop_tail(&vips_window_cache);
+
+		vips_window_cache_bytes -= cached->length;
+		vips_window_cached_free(cached);
+	}
+}
+
+/**
+ * vips_window_cache_set_max:
+ * @max_bytes: max bytes of released mappings to keep
+ *
+ * Windows onto mmapped images are not unmapped when the last region using
+ * them goes, but parked in a global LRU, so a later request for the same
+ * part of the same file can reuse the mapping. This sets the total size of
+ * the mappings kept, 0 disables the cache.
+ *
+ * The default is four times the window size. This can also be set with the
+ * environment variable `VIPS_WINDOW_CACHE`.
+ */
+void
+vips_window_cache_set_max(gint64 max_bytes)
+{
+	g_mutex_lock(&vips_window_cache_lock);
+	vips_window_cache_max_bytes = VIPS_MAX(0, max_bytes);
+	vips_window_cache_trim(vips_window_cache_max_bytes);
+	g_mutex_unlock(&vips_window_cache_lock);
+}
+
+/* Called from vips_image_delete(), before a temp file is unlinked, so we
+ * don't keep the disc space alive.
+ */
+void
+vips__window_cache_drop(const char *filename)
+{
+	GList *p;
+	GList *next;
+
+	g_mutex_lock(&vips_window_cache_lock);
+
+	for (p = vips_window_cache.head; p; p = next) {
+		VipsWindowCached *cached = (VipsWindowCached *) p->data;
+
+		next = p->next;
+		if (g_str_equal(cached->filename, filename)) {
+			g_queue_delete_link(&vips_window_cache, p);
+			vips_window_cache_bytes -= cached->length;
+			vips_window_cached_free(cached);
+		}
+	}
+
+	g_mutex_unlock(&vips_window_cache_lock);
+}
+
+/* Called from vips_shutdown().
+ */
+void
+vips__window_cache_shutdown(void)
+{
+	g_mutex_lock(&vips_window_cache_lock);
+	vips_window_cache_trim(0);
+	g_mutex_unlock(&vips_window_cache_lock);
+}
+
+static gboolean
+vips_window_stat(VipsImage *im, struct stat *st)
+{
+#ifdef G_OS_WIN32
+	/* No stable inode numbers.
+	 */
+	return FALSE;
+#else  /*!G_OS_WIN32*/
+	return im->fd != -1 &&
+		im->filename &&
+		fstat(im->fd, st) == 0;
+#endif /*G_OS_WIN32*/
+}
+
+/* Park a mapping in the cache. FALSE means the caller should unmap it.
+ */
+static gboolean
+vips_window_cache_add(VipsWindow *window)
+{
+	struct stat st;
+	VipsWindowCached *cached;
+	gint64 max_bytes;
+
+	if (!vips_window_stat(window->im, &st))
+		return FALSE;
+
+	g_mutex_lock(&vips_window_cache_lock);
+
+	if ((gint64) window->length > (max_bytes = vips_window_cache_get_max())) {
+		g_mutex_unlock(&vips_window_cache_lock);
+		return FALSE;
+	}
+
+	cached = g_new(VipsWindowCached, 1);
+	cached->dev = st.st_dev;
+	cached->ino = st.st_ino;
+	cached->size = st.st_size;
+	cached->mtime = st.st_mtime;
+	cached->filename = g_strdup(window->im->filename);
+	cached->pagestart = (VipsPel *) window->baseaddr - window->data +
+		window->im->sizeof_header +
+		VIPS_IMAGE_SIZEOF_LINE(window->im) * window->top;
+	cached->baseaddr = window->baseaddr;
+	cached->length = window->length;
+
+	g_queue_push_head(&vips_window_cache, cached);
+	vips_window_cache_bytes += cached->length;
+	vips_window_cache_trim(max_bytes);
+
+	g_mutex_unlock(&vips_window_cache_lock);
+
+	return TRUE;
+}
+
+/* Find a parked mapping of @im that covers the bytes from @start to @end,
+ * and take it out of the cache.
+ */
+static VipsWindowCached *
+vips_window_cache_take(VipsImage *im, gint64 start, gint64 end)
+{
+	struct stat st;
+	GList *p;
+	VipsWindowCached *cached;
+
+	if (!vips_window_stat(im, &st))
+		return NULL;
+
+	g_mutex_lock(&vips_window_cache_lock);
+
+	cached = NULL;
+	for (p = vips_window_cache.head; p; p = p->next) {
+		VipsWindowCached *c = (VipsWindowCached *) p->data;
+
+		if (c->dev == st.st_dev &&
+			c->ino == st.st_ino &&
+			c->size == st.st_size &&
+			c->mtime == st.st_mtime &&
+			c->pagestart <= start &&
+			c->pagestart + (gint64) c->length >= end) {
+			g_queue_delete_link(&vips_window_cache, p);
+			vips_window_cache_bytes -= c->length;
+			cached = c;
+			break;
+		}
+	}
+
+	g_mutex_unlock(&vips_window_cache_lock);
+
+	return cached;
+}
+
 static int
 vips_window_unmap(VipsWindow *window)
 {
 	/* unmap the old window
 	 */
 	if (window->baseaddr) {
-		if (vips__munmap(window->baseaddr, window->length))
+		if (!vips_window_cache_add(window) &&
+			vips__munmap(window->baseaddr, window->length))
 			return -1;
 
 #ifdef DEBUG_TOTAL
@@ -204,6 +424,38 @@ vips_getpagesize(void)
 	return pagesize;
 }
 
+/**
+ * vips__window_set_access: (skip)
+ * @image: image to set the hint on
+ * @access: how the image will be read
+ *
+ * Loaders call this to say how they expect an mmapped image to be read, so
+ * windows can be madvise()d to match.
+ */
+void
+vips__window_set_access(VipsImage *image, VipsAccess access)
+{
+	if (!vips__window_access_quark)
+		vips__window_access_quark =
+			g_quark_from_static_string("vips-window-access");
+
+	g_object_set_qdata(G_OBJECT(image), vips__window_access_quark,
+		GINT_TO_POINTER(access + 1));
+}
+
+static VipsAccess
+vips_window_get_access(VipsImage *image)
+{
+	int access;
+
+	if (vips__window_access_quark &&
+		(access = GPOINTER_TO_INT(g_object_get_qdata(G_OBJECT(image),
+			 vips__window_access_quark))))
+		return (VipsAccess) (access - 1);
+
+	return VIPS_ACCESS_RANDOM;
+}
+
 /* Map a window into a file.
  */
 static int
@@ -237,13 +489,24 @@ vips_window_set(VipsWindow *window, int top, int height)
 	if (vips_window_unmap(window))
 		return -1;
 
-	if (!(baseaddr = vips__mmap(window->im->fd,
-			  0, pagelength, pagestart)))
+	VipsWindowCached *cached;
+	if ((cached = vips_window_cache_take(window->im, start, end))) {
+		baseaddr = cached->baseaddr;
+		pagestart = cached->pagestart;
+		pagelength = cached->length;
+		g_free(cached->filename);
+		g_free(cached);
+	}
+	else if (!(baseaddr = vips__mmap(window->im->fd,
+				   0, pagelength, pagestart)))
 		return -1;
 
 	window->baseaddr = baseaddr;
 	window->length = pagelength;
 
+	vips__mmap_advise(baseaddr, pagelength,
+		vips_window_get_access(window->im), window->im->dhint);
+
 	window->data = (VipsPel *) baseaddr + (start - pagestart);
 	window->top = top;
 	window->height = height;
@@ -340,17 +603,39 @@ vips_window_find(VipsImage *im, int top, int height)
 	return window;
 }
 
+/* For sequential reads, start fetching the lines we are about to need,
+ * and the same number again after them.
+ */
+static void
+vips_window_willneed(VipsWindow *window, int top, int height)
+{
+	VipsImage *im = window->im;
+	gint64 line_bytes = VIPS_IMAGE_SIZEOF_LINE(im);
+	int bottom = VIPS_MIN(top + 2 * height, window->top + window->height);
+
+	if (vips_window_get_access(im) != VIPS_ACCESS_RANDOM &&
+		bottom > top)
+		vips__mmap_willneed(
+			window->data + (gint64) (top - window->top) * line_bytes,
+			(gint64) (bottom - top) * line_bytes);
+}
+
 /* Update a window to make it enclose top/height.
  */
 VipsWindow *
 vips_window_take(VipsWindow *window, VipsImage *im, int top, int height)
 {
+	int request_top = top;
+	int request_height = height;
+
 	/* We have a window and it has the pixels we need.
 	 */
 	if (window &&
 		window->top <= top &&
-		window->top + window->height >= top + height)
+		window->top + window->height >= top + height) {
+		vips_window_willneed(window, top, height);
 		return window;
+	}
 
 	g_mutex_lock(&im->sslock);
 
@@ -367,6 +652,8 @@ vips_window_take(VipsWindow *window, VipsImage *im, int top, int height)
 
 		g_mutex_unlock(&im->sslock);
 
+		vips_window_willneed(window, top, height);
+
 		return window;
 	}
 
@@ -381,6 +668,8 @@ vips_window_take(VipsWindow *window, VipsImage *im, int top, int height)
 	if ((window = vips_window_find(im, top, height))) {
 		g_mutex_unlock(&im->sslock);
 
+		vips_window_willneed(window, top, height);
+
 		return window;
 	}
 
@@ -411,6 +700,8 @@ vips_window_take(VipsWindow *window, VipsImage *im, int top, int height)
 
 	g_mutex_unlock(&im->sslock);
 
+	vips_window_willneed(window, request_top, request_height);
+
 	return window;
 }
 
@@ -0,0 +1,471 @@
+/* exact euclidean distance transform
+ *
+ * 15/10/26
+ * 	- from nearest.c
+ */
+
+/*
+
+	This file is part of VIPS.
+
+	VIPS is free software; you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+	02110-1301  USA
+
+ */
+
+/*
+
+	These files are distributed with VIPS - http://www.vips.ecs.soton.ac.uk
+
+ */
+
+/*
+#define DEBUG
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /*HAVE_CONFIG_H*/
+#include <glib/gi18n-lib.h>
+
+#include <stdio.h>
+#include <math.h>
+
+#include <vips/vips.h>
+#include <vips/internal.h>
+
+#include "pmorphology.h"
+
+/* Columns are processed in groups this wide, so that each pass down the
+ * image reads whole cache lines.
+ */
+#define VIPS_DISTANCE_COLUMNS (32)
+
+struct _VipsDistance;
+typedef void (*VipsDistanceJob)(struct _VipsDistance *distance, int i,
+	void *scratch);
+
+typedef struct _VipsDistance {
+	VipsMorphology parent_instance;
+
+	VipsImage *out;
+	VipsImage *index;
+
+	/* Size of our image.
+	 */
+	int width;
+	int height;
+
+	/* Larger than any real distance. Columns with no object pixels have
+	 * this as their distance.
+	 */
+	int infinity;
+
+	/* The result of the column pass: for each pixel, the distance to the
+	 * nearest object pixel in the same column, and the row it is on.
+	 */
+	int *g;
+	int *row;
+
+	/* Hand out jobs to workers.
+	 */
+	GMutex lock;
+	GCond cond;
+	VipsDistanceJob job;
+	int n_jobs;
+	int next;
+	int n_running;
+	gboolean failed;
+} VipsDistance;
+
+typedef VipsMorphologyClass VipsDistanceClass;
+
+G_DEFINE_TYPE(VipsDistance, vips_distance, VIPS_TYPE_MORPHOLOGY);
+
+static void
+vips_distance_finalize(GObject *gobject)
+{
+	VipsDistance *distance = (VipsDistance *) gobject;
+
+	VIPS_FREEF(vips_tracked_free, distance->g);
+	VIPS_FREEF(vips_tracked_free, distance->row);
+	g_mutex_clear(&distance->lock);
+	g_cond_clear(&distance->cond);
+
+	G_OBJECT_CLASS(vips_distance_parent_class)->finalize(gobject);
+}
+
+/* Find the distance to the nearest object pixel up and down a group of
+ * columns.
+ */
+static void
+vips_distance_columns(VipsDistance *distance, int i, void *scratch)
+{
+	VipsImage *in = VIPS_MORPHOLOGY(distance)->in;
+	int ps = VIPS_IMAGE_SIZEOF_PEL(in);
+	int width = distance->width;
+	int left = i * VIPS_DISTANCE_COLUMNS;
+	int right = VIPS_MIN(width, left + VIPS_DISTANCE_COLUMNS);
+
+	/* Down, counting from the nearest object pixel above.
+	 */
+	for (int y = 0; y < distance->height; y++) {
+		VipsPel *p = VIPS_IMAGE_ADDR(in, left, y);
+		int *g = distance->g + (size_t) y * width;
+		int *row = distance->row + (size_t) y * width;
+
+		for (int x = left; x < right; x++) {
+			int b;
+
+			for (b = 0; b < ps; b++)
+				if (p[b])
+					break;
+
+			if (b < ps) {
+				g[x] = 0;
+				row[x] = y;
+			}
+			else if (y > 0 &&
+				g[x - width] < distance->infinity) {
+				g[x] = g[x - width] + 1;
+				row[x] = row[x - width];
+			}
+			else {
+				g[x] = distance->infinity;
+				row[x] = -1;
+			}
+
+			p += ps;
+		}
+	}
+
+	/* And back up, taking the nearest object pixel below if it's closer.
+	 */
+	for (int y = distance->height - 2; y >= 0; y--) {
+		int *g = distance->g + (size_t) y * width;
+		int *row = distance->row + (size_t) y * width;
+
+		for (int x = left; x < right; x++)
+			if (g[x + width] + 1 < g[x]) {
+				g[x] = g[x + width] + 1;
+				row[x] = row[x + width];
+			}
+	}
+}
+
+/* Scratch for the row pass.
+ */
+typedef struct _VipsDistanceRow {
+	double *f; /* Squared column distance at each x */
+	int *v;	   /* Parabolas in the lower envelope */
+	double *z; /* Boundaries between parabolas */
+} VipsDistanceRow;
+
+/* Combine the column distances along a row. Each column is a parabola of
+ * squared distance, and we walk the lower envelope of the set, as
+ * Felzenszwalb and Huttenlocher.
+ */
+static void
+vips_distance_row(VipsDistance *distance, int y, void *scratch)
+{
+	VipsDistanceRow *s = (VipsDistanceRow *) scratch;
+	int width = distance->width;
+	int *g = distance->g + (size_t) y * width;
+	int *row = distance->row + (size_t) y * width;
+	float *q = (float *) VIPS_IMAGE_ADDR(distance->out, 0, y);
+	int *qi = (int *) VIPS_IMAGE_ADDR(distance->index, 0, y);
+
+	double *f = s->f;
+	int *v = s->v;
+	double *z = s->z;
+
+	int k;
+
+	for (int x = 0; x < width; x++)
+		f[x] = (double) g[x] * g[x];
+
+	k = 0;
+	v[0] = 0;
+	z[0] = -HUGE_VAL;
+	z[1] = HUGE_VAL;
+	for (int x = 1; x < width; x++) {
+		double t;
+
+		for (;;) {
+			int u = v[k];
+
+			t = ((f[x] + (double) x * x) - (f[u] + (double) u * u)) /
+				(2.0 * (x - u));
+			if (t > z[k])
+				break;
+			k -= 1;
+		}
+
+		k += 1;
+		v[k] = x;
+		z[k] = t;
+		z[k + 1] = HUGE_VAL;
+	}
+
+	k = 0;
+	for (int x = 0; x < width; x++) {
+		int u;
+
+		while (z[k + 1] < x)
+			k += 1;
+		u = v[k];
+
+		/* Only possible if there are no object pixels at all.
+		 */
+		if (g[u] >= distance->infinity) {
+			q[x] = distance->infinity;
+			qi[0] = -1;
+			qi[1] = -1;
+		}
+		else {
+			q[x] = sqrt((double) (x - u) * (x - u) + f[u]);
+			qi[0] = u;
+			qi[1] = row[u];
+		}
+
+		qi += 2;
+	}
+}
+
+/* Each worker takes the next job until there are none left.
+ */
+static void
+vips_distance_work(void *a, void *b)
+{
+	VipsDistance *distance = (VipsDistance *) a;
+	int width = distance->width;
+
+	VipsDistanceRow scratch;
+
+	scratch.f = VIPS_ARRAY(NULL, width, double);
+	scratch.v = VIPS_ARRAY(NULL, width, int);
+	scratch.z = VIPS_ARRAY(NULL, width + 1, double);
+
+	if (!scratch.f ||
+		!scratch.v ||
+		!scratch.z) {
+		g_mutex_lock(&distance->lock);
+		distance->failed = TRUE;
+		g_mutex_unlock(&distance->lock);
+	}
+
+	for (;;) {
+		int i;
+
+		g_mutex_lock(&distance->lock);
+		i = distance->failed ? distance->n_jobs : distance->next++;
+		g_mutex_unlock(&distance->lock);
+
+		if (i >= distance->n_jobs)
+			break;
+
+		distance->job(distance, i, &scratch);
+	}
+
+	VIPS_FREE(scratch.f);
+	VIPS_FREE(scratch.v);
+	VIPS_FREE(scratch.z);
+
+	/* We can be freed as soon as we unlock, so this must be the last
+	 * thing we do.
+	 */
+	g_mutex_lock(&distance->lock);
+	distance->n_running -= 1;
+	g_cond_broadcast(&distance->cond);
+	g_mutex_unlock(&distance->lock);
+}
+
+/* Run @job for 0 .. @n_jobs - 1 on a set of workers, and wait for them all
+ * to finish.
+ */
+static int
+vips_distance_run(VipsDistance *distance, VipsDistanceJob job, int n_jobs)
+{
+	int n_workers;
+
+	distance->job = job;
+	distance->n_jobs = n_jobs;
+	distance->next = 0;
+	distance->n_running = 0;
+	distance->failed = FALSE;
+
+	n_workers = VIPS_MIN(vips_concurrency_get(), n_jobs);
+
+	vips__worker_lock(&distance->lock);
+	for (int i = 0; i < n_workers; i++) {
+		distance->n_running += 1;
+		if (vips_thread_execute("distance", vips_distance_work, distance))
+			distance->n_running -= 1;
+	}
+
+	/* If we couldn't start any workers, do it ourselves.
+	 */
+	if (distance->n_running == 0) {
+		distance->n_running += 1;
+		g_mutex_unlock(&distance->lock);
+		vips_distance_work(distance, NULL);
+		vips__worker_lock(&distance->lock);
+	}
+
+	while (distance->n_running > 0)
+		vips__worker_cond_wait(&distance->cond, &distance->lock);
+	g_mutex_unlock(&distance->lock);
+
+	if (distance->failed) {
+		vips_error(VIPS_OBJECT_GET_CLASS(distance)->nickname,
+			"%s", _("out of memory"));
+		return -1;
+	}
+
+	return 0;
+}
+
+static int
+vips_distance_build(VipsObject *object)
+{
+	VipsMorphology *morphology = VIPS_MORPHOLOGY(object);
+	VipsDistance *distance = (VipsDistance *) object;
+	VipsImage *in;
+
+	size_t n;
+
+	if (VIPS_OBJECT_CLASS(vips_distance_parent_class)->build(object))
+		return -1;
+
+	in = morphology->in;
+	if (vips_image_wio_input(in))
+		return -1;
+	distance->width = in->Xsize;
+	distance->height = in->Ysize;
+	distance->infinity = in->Xsize + in->Ysize;
+
+	n = (size_t) distance->width * distance->height;
+	if (!(distance->g = vips_tracked_malloc(n * sizeof(int))) ||
+		!(distance->row = vips_tracked_malloc(n * sizeof(int))))
+		return -1;
+
+	g_object_set(object,
+		"out", vips_image_new_memory(),
+		"index", vips_image_new_memory(),
+		NULL);
+	vips_image_init_fields(distance->out,
+		distance->width, distance->height, 1,
+		VIPS_FORMAT_FLOAT, VIPS_CODING_NONE, VIPS_INTERPRETATION_B_W,
+		in->Xres, in->Yres);
+	vips_image_init_fields(distance->index,
+		distance->width, distance->height, 2,
+		VIPS_FORMAT_INT, VIPS_CODING_NONE, VIPS_INTERPRETATION_MATRIX,
+		in->Xres, in->Yres);
+	if (vips_image_write_prepare(distance->out) ||
+		vips_image_write_prepare(distance->index))
+		return -1;
+
+	/* Columns first, then combine along rows. Both passes are
+	 * independent along the other axis, so they run in parallel.
+	 */
+	if (vips_distance_run(distance, vips_distance_columns,
+			VIPS_ROUND_UP(distance->width, VIPS_DISTANCE_COLUMNS) /
+				VIPS_DISTANCE_COLUMNS) ||
+		vips_distance_run(distance, vips_distance_row,
+			distance->height))
+		return -1;
+
+	VIPS_FREEF(vips_tracked_free, distance->g);
+	VIPS_FREEF(vips_tracked_free, distance->row);
+
+	return 0;
+}
+
+static void
+vips_distance_class_init(VipsDistanceClass *class)
+{
+	GObjectClass *gobject_class = G_OBJECT_CLASS(class);
+	VipsObjectClass *vobject_class = VIPS_OBJECT_CLASS(class);
+
+	gobject_class->finalize = vips_distance_finalize;
+	gobject_class->set_property = vips_object_set_property;
+	gobject_class->get_property = vips_object_get_property;
+
+	vobject_class->nickname = "distance";
+	vobject_class->description =
+		_("euclidean distance to the nearest non-zero pixel");
+	vobject_class->build = vips_distance_build;
+
+	VIPS_ARG_IMAGE(class, "out", 2,
+		_("Out"),
+		_("Distance to nearest non-zero pixel"),
+		VIPS_ARGUMENT_REQUIRED_OUTPUT,
+		G_STRUCT_OFFSET(VipsDistance, out));
+
+	VIPS_ARG_IMAGE(class, "index", 3,
+		_("Index"),
+		_("Position of nearest non-zero pixel"),
+		VIPS_ARGUMENT_OPTIONAL_OUTPUT,
+		G_STRUCT_OFFSET(VipsDistance, index));
+}
+
+static void
+vips_distance_init(VipsDistance *distance)
+{
+	g_mutex_init(&distance->lock);
+	g_cond_init(&distance->cond);
+}
+
+/**
+ * vips_distance: (method)
+ * @in: image to test
+ * @out: (out): distance to the nearest non-zero pixel
+ * @...: `NULL`-terminated list of optional named arguments
+ *
+ * Find the exact euclidean distance transform of @in. Each pixel of @out is
+ * the distance to the nearest pixel in @in with any non-zero band, so
+ * non-zero pixels in @in are zero in @out.
+ *
+ * @out is a one-band float image. The optional output @index is a two-band
+ * int image giving the x and y coordinates of that nearest pixel, so
+ * [method@Image.mapim] with @index will fill every pixel with the value of
+ * its nearest non-zero pixel.
+ *
+ * If @in has no non-zero pixels, @out is set to @in's width plus height
+ * everywhere, and @index to -1.
+ *
+ * This is a separable algorithm, a pass down the columns and then a pass
+ * along the rows, and takes time proportional to the number of pixels.
+ *
+ * ::: tip "Optional arguments"
+ *     * @index: [class@Image], output, position of nearest non-zero pixel
+ *
+ * ::: seealso
+ *     [method@Image.fill_nearest], [method@Image.morph].
+ *
+ * Returns: 0 on success, -1 on error.
+ */
+int
+vips_distance(VipsImage *in, VipsImage **out, ...)
+{
+	va_list ap;
+	int result;
+
+	va_start(ap, out);
+	result = vips_call_split("distance", ap, in, out);
+	va_end(ap);
+
+	return result;
+}
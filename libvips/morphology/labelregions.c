@@ -4,6 +4,9 @@
  *	- renamed from im_segment()
  * 11/2/14
  * 	- redo as a class
+ * 14/10/26
+ * 	- label strips in parallel with union-find, then join
+ * 	- add "streaming"
  */
 
 /*
@@ -39,70 +42,551 @@
 #include <glib/gi18n-lib.h>
 
 #include <stdio.h>
+#include <string.h>
+#include <limits.h>
 
 #include <vips/vips.h>
 #include <vips/internal.h>
 
 #include "pmorphology.h"
 
+/* We label in strips of this many lines. Strips are labelled in parallel,
+ * then joined along their borders.
+ */
+#define STRIP_HEIGHT (128)
+
+typedef struct _VipsLabelregionsStrip {
+	/* Number of labels in this strip, labels are numbered from 0 in order
+	 * of first appearance.
+	 */
+	int n_labels;
+
+	/* Index of label 0 in the join table.
+	 */
+	int offset;
+
+	/* Labels and pixels along the first and last line, for joining.
+	 */
+	int *top;
+	int *bottom;
+	VipsPel *top_pels;
+	VipsPel *bottom_pels;
+} VipsLabelregionsStrip;
+
 typedef struct _VipsLabelregions {
 	VipsMorphology parent_instance;
 
 	VipsImage *mask;
 	int segments;
+	gboolean streaming;
+
+	int n_strips;
+	int next_strip;
+	VipsLabelregionsStrip *strips;
+
+	/* For each strip label, the final serial number.
+	 */
+	int *serial;
+
+	/* FALSE for the labelling pass, TRUE for the pass which sets final
+	 * serial numbers in the memory mask.
+	 */
+	gboolean renumber;
 } VipsLabelregions;
 
 typedef VipsMorphologyClass VipsLabelregionsClass;
 
 G_DEFINE_TYPE(VipsLabelregions, vips_labelregions, VIPS_TYPE_MORPHOLOGY);
 
+static void
+vips_labelregions_finalize(GObject *gobject)
+{
+	VipsLabelregions *labelregions = (VipsLabelregions *) gobject;
+
+	if (labelregions->strips) {
+		for (int i = 0; i < labelregions->n_strips; i++) {
+			VipsLabelregionsStrip *strip = &labelregions->strips[i];
+
+			VIPS_FREE(strip->top);
+			VIPS_FREE(strip->bottom);
+			VIPS_FREE(strip->top_pels);
+			VIPS_FREE(strip->bottom_pels);
+		}
+		VIPS_FREE(labelregions->strips);
+	}
+	VIPS_FREE(labelregions->serial);
+
+	G_OBJECT_CLASS(vips_labelregions_parent_class)->finalize(gobject);
+}
+
+static inline gboolean
+vips_labelregions_equal(VipsPel *a, VipsPel *b, int n)
+{
+	for (int i = 0; i < n; i++)
+		if (a[i] != b[i])
+			return FALSE;
+
+	return TRUE;
+}
+
+/* Sets always point at their smallest member, so roots are the first label
+ * to appear.
+ */
+static inline int
+vips_labelregions_find(int *parent, int i)
+{
+	while (parent[i] != i) {
+		parent[i] = parent[parent[i]];
+		i = parent[i];
+	}
+
+	return i;
+}
+
+static inline int
+vips_labelregions_union(int *parent, int i, int j)
+{
+	i = vips_labelregions_find(parent, i);
+	j = vips_labelregions_find(parent, j);
+
+	if (i < j)
+		parent[j] = i;
+	else
+		parent[i] = j;
+
+	return VIPS_MIN(i, j);
+}
+
+/* Renumber a set of labels in place, in order of first appearance, starting
+ * from @first. Return the next free number.
+ */
+static int
+vips_labelregions_renumber(int *parent, int n, int first)
+{
+	int serial;
+
+	/* Every label points at an earlier one, or at itself for roots, so
+	 * when we reach a label its parent has already been renumbered.
+	 */
+	serial = first;
+	for (int i = 0; i < n; i++)
+		parent[i] = parent[i] == i ? serial++ : parent[parent[i]];
+
+	return serial;
+}
+
+/* Label the 4-connected regions of equal pixels in @region with a two-pass
+ * union-find. Labels go to @labels, numbered from 0 in order of first
+ * appearance.
+ *
+ * Return the number of labels, or -1 on error.
+ */
+static int
+vips_labelregions_strip(VipsRegion *region, int *labels, int lskip)
+{
+	VipsRect *r = &region->valid;
+	int psize = VIPS_IMAGE_SIZEOF_PEL(region->im);
+	int rskip = VIPS_REGION_LSKIP(region);
+
+	int *parent;
+	int n;
+
+	if (!(parent = VIPS_ARRAY(NULL, (size_t) r->width * r->height, int)))
+		return -1;
+
+	n = 0;
+	for (int y = 0; y < r->height; y++) {
+		VipsPel *p = VIPS_REGION_ADDR(region, r->left, r->top + y);
+		int *q = labels + y * lskip;
+
+		for (int x = 0; x < r->width; x++) {
+			gboolean left = x > 0 &&
+				vips_labelregions_equal(p, p - psize, psize);
+			gboolean up = y > 0 &&
+				vips_labelregions_equal(p, p - rskip, psize);
+
+			int label;
+
+			if (left) {
+				label = q[x - 1];
+				if (up &&
+					q[x - lskip] != label)
+					label = vips_labelregions_union(parent,
+						label, q[x - lskip]);
+			}
+			else if (up)
+				label = q[x - lskip];
+			else {
+				label = n++;
+				parent[label] = label;
+			}
+
+			q[x] = label;
+			p += psize;
+		}
+	}
+
+	n = vips_labelregions_renumber(parent, n, 0);
+
+	for (int y = 0; y < r->height; y++) {
+		int *q = labels + y * lskip;
+
+		for (int x = 0; x < r->width; x++)
+			q[x] = parent[q[x]];
+	}
+
+	g_free(parent);
+
+	return n;
+}
+
+static void
+vips_labelregions_strip_rect(VipsLabelregions *labelregions, int i,
+	VipsRect *rect)
+{
+	VipsImage *in = VIPS_MORPHOLOGY(labelregions)->in;
+
+	rect->left = 0;
+	rect->top = i * STRIP_HEIGHT;
+	rect->width = in->Xsize;
+	rect->height = VIPS_MIN(STRIP_HEIGHT, in->Ysize - rect->top);
+}
+
+static int
+vips_labelregions_allocate(VipsThreadState *state, void *a, gboolean *stop)
+{
+	VipsLabelregions *labelregions = (VipsLabelregions *) a;
+
+	if (labelregions->next_strip >= labelregions->n_strips) {
+		*stop = TRUE;
+		return 0;
+	}
+
+	vips_labelregions_strip_rect(labelregions, labelregions->next_strip,
+		&state->pos);
+	state->y = labelregions->next_strip;
+	labelregions->next_strip += 1;
+
+	return 0;
+}
+
+/* Label a strip and save the borders for joining. If we're making the mask
+ * in memory, labels go straight into it.
+ */
+static int
+vips_labelregions_label_work(VipsLabelregions *labelregions,
+	VipsThreadState *state)
+{
+	VipsLabelregionsStrip *strip = &labelregions->strips[state->y];
+	VipsRect *r = &state->pos;
+	int psize = VIPS_IMAGE_SIZEOF_PEL(state->im);
+	VipsImage *mask = labelregions->streaming ? NULL : labelregions->mask;
+
+	int *labels;
+	int lskip;
+
+	if (vips_region_prepare(state->reg, r))
+		return -1;
+
+	if (mask) {
+		labels = (int *) VIPS_IMAGE_ADDR(mask, 0, r->top);
+		lskip = mask->Xsize;
+	}
+	else {
+		if (!(labels = VIPS_ARRAY(NULL,
+				  (size_t) r->width * r->height, int)))
+			return -1;
+		lskip = r->width;
+	}
+
+	strip->n_labels = vips_labelregions_strip(state->reg, labels, lskip);
+
+	if (strip->n_labels >= 0 &&
+		(strip->top = VIPS_ARRAY(NULL, r->width, int)) &&
+		(strip->bottom = VIPS_ARRAY(NULL, r->width, int)) &&
+		(strip->top_pels = VIPS_ARRAY(NULL,
+			 (size_t) r->width * psize, VipsPel)) &&
+		(strip->bottom_pels = VIPS_ARRAY(NULL,
+			 (size_t) r->width * psize, VipsPel))) {
+		memcpy(strip->top, labels, r->width * sizeof(int));
+		memcpy(strip->bottom, labels + (r->height - 1) * lskip,
+			r->width * sizeof(int));
+		memcpy(strip->top_pels,
+			VIPS_REGION_ADDR(state->reg, 0, r->top),
+			(size_t) r->width * psize);
+		memcpy(strip->bottom_pels,
+			VIPS_REGION_ADDR(state->reg, 0, VIPS_RECT_BOTTOM(r) - 1),
+			(size_t) r->width * psize);
+	}
+	else
+		strip->n_labels = -1;
+
+	if (!mask)
+		g_free(labels);
+
+	return strip->n_labels < 0 ? -1 : 0;
+}
+
+/* Swap strip labels in the memory mask for the final serial numbers.
+ */
+static int
+vips_labelregions_renumber_work(VipsLabelregions *labelregions,
+	VipsThreadState *state)
+{
+	VipsLabelregionsStrip *strip = &labelregions->strips[state->y];
+	int *serial = labelregions->serial + strip->offset;
+	VipsRect *r = &state->pos;
+
+	for (int y = 0; y < r->height; y++) {
+		int *q = (int *) VIPS_IMAGE_ADDR(labelregions->mask, 0, r->top + y);
+
+		for (int x = 0; x < r->width; x++)
+			q[x] = serial[q[x]];
+	}
+
+	return 0;
+}
+
+static int
+vips_labelregions_work(VipsThreadState *state, void *a)
+{
+	VipsLabelregions *labelregions = (VipsLabelregions *) a;
+
+	if (labelregions->renumber)
+		return vips_labelregions_renumber_work(labelregions, state);
+	else
+		return vips_labelregions_label_work(labelregions, state);
+}
+
+static int
+vips_labelregions_progress(void *a)
+{
+	VipsLabelregions *labelregions = (VipsLabelregions *) a;
+	VipsImage *in = VIPS_MORPHOLOGY(labelregions)->in;
+
+	if (vips_image_iskilled(in))
+		return -1;
+
+	return 0;
+}
+
+static int
+vips_labelregions_run(VipsLabelregions *labelregions, gboolean renumber)
+{
+	VipsImage *in = VIPS_MORPHOLOGY(labelregions)->in;
+
+	labelregions->renumber = renumber;
+	labelregions->next_strip = 0;
+
+	return vips_threadpool_run(in,
+		vips_thread_state_new,
+		vips_labelregions_allocate,
+		vips_labelregions_work,
+		vips_labelregions_progress,
+		labelregions);
+}
+
+/* Join strips along their borders and work out the final serial number for
+ * every strip label.
+ */
+static int
+vips_labelregions_join(VipsLabelregions *labelregions)
+{
+	VipsImage *in = VIPS_MORPHOLOGY(labelregions)->in;
+	int psize = VIPS_IMAGE_SIZEOF_PEL(in);
+
+	guint64 n_labels;
+	int *parent;
+
+	n_labels = 0;
+	for (int i = 0; i < labelregions->n_strips; i++) {
+		labelregions->strips[i].offset = (int) n_labels;
+		n_labels += labelregions->strips[i].n_labels;
+	}
+	if (n_labels >= INT_MAX) {
+		vips_error("labelregions", "%s", _("too many regions"));
+		return -1;
+	}
+
+	if (!(parent = VIPS_ARRAY(NULL, n_labels, int)))
+		return -1;
+	for (int i = 0; i < n_labels; i++)
+		parent[i] = i;
+
+	for (int i = 0; i < labelregions->n_strips - 1; i++) {
+		VipsLabelregionsStrip *above = &labelregions->strips[i];
+		VipsLabelregionsStrip *below = &labelregions->strips[i + 1];
+
+		for (int x = 0; x < in->Xsize; x++)
+			if (vips_labelregions_equal(
+					above->bottom_pels + x * psize,
+					below->top_pels + x * psize, psize))
+				vips_labelregions_union(parent,
+					above->offset + above->bottom[x],
+					below->offset + below->top[x]);
+	}
+
+	/* Strips are in raster order and strip labels are in order of first
+	 * appearance, so this numbers regions exactly as a scan with flood
+	 * fill would.
+	 */
+	labelregions->segments =
+		vips_labelregions_renumber(parent, n_labels, 1);
+	labelregions->serial = parent;
+
+	return 0;
+}
+
+typedef struct _VipsLabelregionsSequence {
+	VipsRegion *ir;
+
+	/* The most recently labelled strip, and its labels.
+	 */
+	int strip;
+	int *labels;
+} VipsLabelregionsSequence;
+
+static int
+vips_labelregions_stop(void *vseq, void *a, void *b)
+{
+	VipsLabelregionsSequence *seq = (VipsLabelregionsSequence *) vseq;
+
+	VIPS_UNREF(seq->ir);
+	VIPS_FREE(seq->labels);
+	VIPS_FREE(seq);
+
+	return 0;
+}
+
+static void *
+vips_labelregions_start(VipsImage *out, void *a, void *b)
+{
+	VipsImage *in = (VipsImage *) a;
+
+	VipsLabelregionsSequence *seq;
+
+	if (!(seq = VIPS_NEW(NULL, VipsLabelregionsSequence)))
+		return NULL;
+	seq->strip = -1;
+	seq->ir = vips_region_new(in);
+	seq->labels = VIPS_ARRAY(NULL, (size_t) in->Xsize * STRIP_HEIGHT, int);
+	if (!seq->ir ||
+		!seq->labels) {
+		vips_labelregions_stop(seq, a, b);
+		return NULL;
+	}
+
+	return seq;
+}
+
+/* Streaming mode: label each strip again as it's needed and map to the
+ * final serial numbers.
+ */
+static int
+vips_labelregions_gen(VipsRegion *out_region,
+	void *vseq, void *a, void *b, gboolean *stop)
+{
+	VipsLabelregionsSequence *seq = (VipsLabelregionsSequence *) vseq;
+	VipsLabelregions *labelregions = (VipsLabelregions *) b;
+	VipsRect *r = &out_region->valid;
+
+	for (int y = r->top; y < VIPS_RECT_BOTTOM(r); y++) {
+		int i = y / STRIP_HEIGHT;
+
+		if (seq->strip != i) {
+			VipsLabelregionsStrip *strip = &labelregions->strips[i];
+			int *serial = labelregions->serial + strip->offset;
+
+			VipsRect rect;
+			size_t n;
+
+			vips_labelregions_strip_rect(labelregions, i, &rect);
+			if (vips_region_prepare(seq->ir, &rect) ||
+				vips_labelregions_strip(seq->ir,
+					seq->labels, rect.width) < 0)
+				return -1;
+
+			n = (size_t) rect.width * rect.height;
+			for (size_t j = 0; j < n; j++)
+				seq->labels[j] = serial[seq->labels[j]];
+
+			seq->strip = i;
+		}
+
+		memcpy(VIPS_REGION_ADDR(out_region, r->left, y),
+			seq->labels +
+				(size_t) (y - i * STRIP_HEIGHT) * out_region->im->Xsize +
+				r->left,
+			r->width * sizeof(int));
+	}
+
+	return 0;
+}
+
 static int
 vips_labelregions_build(VipsObject *object)
 {
 	VipsMorphology *morphology = VIPS_MORPHOLOGY(object);
-	VipsImage *in = morphology->in;
-	VipsImage **t = (VipsImage **) vips_object_local_array(object, 2);
-	VipsImage *mask;
+	VipsLabelregions *labelregions = (VipsLabelregions *) object;
+	VipsImage **t = (VipsImage **) vips_object_local_array(object, 3);
 
-	int segments;
-	int *m;
-	int x, y;
+	VipsImage *in;
+	VipsImage *mask;
 
 	if (VIPS_OBJECT_CLASS(vips_labelregions_parent_class)->build(object))
 		return -1;
 
-	/* Create the zero mask image in memory.
-	 */
-	if (vips_black(&t[0], in->Xsize, in->Ysize, NULL) ||
-		vips_cast(t[0], &t[1], VIPS_FORMAT_INT, NULL) ||
-		!(t[2] = vips_image_copy_memory(t[1])))
+	in = morphology->in;
+	if (vips_check_coding_known("labelregions", in) ||
+		vips_image_pio_input(in))
 		return -1;
 
-	mask = t[2];
+	if (labelregions->streaming)
+		mask = vips_image_new();
+	else {
+		/* Create the zero mask image in memory.
+		 */
+		if (vips_black(&t[0], in->Xsize, in->Ysize, NULL) ||
+			vips_cast(t[0], &t[1], VIPS_FORMAT_INT, NULL) ||
+			!(t[2] = vips_image_copy_memory(t[1])))
+			return -1;
+		mask = t[2];
+	}
 	g_object_set(object,
 		"mask", mask,
 		NULL);
 
-	segments = 1;
-	m = (int *) mask->data;
-	for (y = 0; y < mask->Ysize; y++) {
-		for (x = 0; x < mask->Xsize; x++) {
-			if (!m[x]) {
-				/* Use a direct path for speed.
-				 */
-				if (vips__draw_flood_direct(mask, in,
-						segments, x, y))
-					return -1;
-
-				segments += 1;
-			}
-		}
+	labelregions->n_strips = VIPS_ROUND_UP(in->Ysize, STRIP_HEIGHT) /
+		STRIP_HEIGHT;
+	if (!(labelregions->strips = VIPS_ARRAY(NULL,
+			  labelregions->n_strips, VipsLabelregionsStrip)))
+		return -1;
+	memset(labelregions->strips, 0,
+		labelregions->n_strips * sizeof(VipsLabelregionsStrip));
 
-		m += mask->Xsize;
+	if (vips_labelregions_run(labelregions, FALSE) ||
+		vips_labelregions_join(labelregions))
+		return -1;
+
+	if (labelregions->streaming) {
+		if (vips_image_pipelinev(mask,
+				VIPS_DEMAND_STYLE_FATSTRIP, in, NULL))
+			return -1;
+		mask->Bands = 1;
+		mask->BandFmt = VIPS_FORMAT_INT;
+		mask->Coding = VIPS_CODING_NONE;
+		mask->Type = VIPS_INTERPRETATION_B_W;
+
+		if (vips_image_generate(mask,
+				vips_labelregions_start, vips_labelregions_gen,
+				vips_labelregions_stop, in, labelregions))
+			return -1;
 	}
+	else if (vips_labelregions_run(labelregions, TRUE))
+		return -1;
 
 	g_object_set(object,
-		"segments", segments,
+		"segments", labelregions->segments,
 		NULL);
 
 	return 0;
@@ -114,6 +598,7 @@ vips_labelregions_class_init(VipsLabelregionsClass *class)
 	GObjectClass *gobject_class = G_OBJECT_CLASS(class);
 	VipsObjectClass *vobject_class = VIPS_OBJECT_CLASS(class);
 
+	gobject_class->finalize = vips_labelregions_finalize;
 	gobject_class->set_property = vips_object_set_property;
 	gobject_class->get_property = vips_object_get_property;
 
@@ -133,6 +618,13 @@ vips_labelregions_class_init(VipsLabelregionsClass *class)
 		VIPS_ARGUMENT_OPTIONAL_OUTPUT,
 		G_STRUCT_OFFSET(VipsLabelregions, segments),
 		0, 1000000000, 0);
+
+	VIPS_ARG_BOOL(class, "streaming", 4,
+		_("Streaming"),
+		_("Generate mask strip by strip rather than in memory"),
+		VIPS_ARGUMENT_OPTIONAL_INPUT,
+		G_STRUCT_OFFSET(VipsLabelregions, streaming),
+		FALSE);
 }
 
 static void
@@ -148,15 +640,21 @@ vips_labelregions_init(VipsLabelregions *labelregions)
  *
  * Label regions of equal pixels in an image.
  *
- * Repeatedly scans @in for regions of 4-connected pixels
- * with the same pixel value. Every time a region is discovered, those
- * pixels are marked in @mask with a unique serial number. Once all pixels
+ * Scans @in for regions of 4-connected pixels
+ * with the same pixel value. Each region is marked in @mask with a unique
+ * serial number, numbered in the order in which regions are first seen in a
+ * scan from the top left. Once all pixels
  * have been labelled, the operation returns, setting @segments to the number
  * of discrete regions which were detected.
  *
  * @mask is always a 1-band [enum@Vips.BandFormat.INT] image of the same
  * dimensions as @in.
  *
+ * The image is labelled in strips in parallel, and the strips are then
+ * joined. Normally @mask is made in memory. Set @streaming to generate @mask
+ * strip by strip instead: @in is read twice, but only a small table of
+ * labels is held in memory.
+ *
  * This operation is useful for, for example, blob counting. You can use the
  * morphological operators to detect and isolate a series of objects, then use
  * [method@Image.labelregions] to number them all.
@@ -165,6 +663,7 @@ vips_labelregions_init(VipsLabelregions *labelregions)
  *
  * ::: tip "Optional arguments"
  *     * @segments: `gint`, output, number of regions found
+ *     * @streaming: `gboolean`, generate @mask strip by strip
  *
  * ::: seealso
  *     [method@Image.hist_find_indexed].
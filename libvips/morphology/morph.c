@@ -26,6 +26,9 @@
  * 25/2/20 kleisauke
  * 	- rewritten as a class
  * 	- merged with hitmiss
+ * 15/10/26
+ * 	- large rectangle and line masks run as separable van Herk/Gil-Werman
+ * 	  passes
  */
 
 /*
@@ -66,6 +69,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <limits.h>
 
 #include <vips/vips.h>
@@ -133,6 +137,12 @@ typedef struct {
 
 	guint8 *coeff; /* Mask coefficients */
 
+	/* Set if the mask is a solid rectangle of 255, perhaps with
+	 * don't-care around it, and this is the rectangle.
+	 */
+	gboolean is_rect;
+	VipsRect rect;
+
 #ifdef HAVE_ORC
 	/* The passes we generate for this mask.
 	 */
@@ -157,6 +167,14 @@ typedef struct {
 
 	int last_bpl; /* Avoid recalcing offsets, if we can */
 
+	/* Scratch for the rectangle path.
+	 */
+	VipsPel *line_g;
+	VipsPel *line_h;
+	int line_size;
+	VipsPel *area;
+	size_t area_size;
+
 #ifdef HAVE_ORC
 	/* In vector mode we need a pair of intermediate buffers to keep the
 	 * results of each pass in.
@@ -188,6 +206,9 @@ vips_morph_stop(void *vseq, void *a, void *b)
 	VipsMorphSequence *seq = (VipsMorphSequence *) vseq;
 
 	VIPS_UNREF(seq->ir);
+	VIPS_FREE(seq->line_g);
+	VIPS_FREE(seq->line_h);
+	VIPS_FREE(seq->area);
 #ifdef HAVE_ORC
 	VIPS_FREE(seq->t1);
 	VIPS_FREE(seq->t2);
@@ -218,6 +239,11 @@ vips_morph_start(VipsImage *out, void *a, void *b)
 	seq->nn128 = 0;
 	seq->coeff = NULL;
 	seq->last_bpl = -1;
+	seq->line_g = NULL;
+	seq->line_h = NULL;
+	seq->line_size = 0;
+	seq->area = NULL;
+	seq->area_size = 0;
 #ifdef HAVE_ORC
 	seq->t1 = NULL;
 	seq->t2 = NULL;
@@ -825,6 +851,205 @@ vips_erode_gen(VipsRegion *out_region,
 	return 0;
 }
 
+/* Find the OP of every window of @k elements along a line, with the van
+ * Herk/Gil-Werman algorithm. Element x of the output is the OP of inputs x to
+ * x + k - 1, and successive elements are @stride apart. We need @n + @k - 1
+ * elements of input, and two scratch lines @g and @h that size.
+ *
+ * Each block of @k inputs has a running OP forward into @g and backward into
+ * @h, and each window then spans at most two blocks, so we need about three
+ * OPs per element whatever the size of @k.
+ */
+#define VHGW(NAME, OP) \
+	static void \
+	NAME(VipsPel *restrict q, const VipsPel *restrict p, \
+		VipsPel *restrict g, VipsPel *restrict h, \
+		int n, int k, int stride) \
+	{ \
+		int len = n + k - 1; \
+\
+		for (int x = 0; x < len; x++) { \
+			const VipsPel *restrict px = p + x * stride; \
+			VipsPel *restrict gx = g + x * stride; \
+\
+			if (x % k == 0) \
+				for (int b = 0; b < stride; b++) \
+					gx[b] = px[b]; \
+			else \
+				for (int b = 0; b < stride; b++) \
+					gx[b] = gx[b - stride] OP px[b]; \
+		} \
+\
+		for (int x = len - 1; x >= 0; x--) { \
+			const VipsPel *restrict px = p + x * stride; \
+			VipsPel *restrict hx = h + x * stride; \
+\
+			if (x == len - 1 || \
+				x % k == k - 1) \
+				for (int b = 0; b < stride; b++) \
+					hx[b] = px[b]; \
+			else \
+				for (int b = 0; b < stride; b++) \
+					hx[b] = hx[b + stride] OP px[b]; \
+		} \
+\
+		for (int i = 0; i < n * stride; i++) \
+			q[i] = h[i] OP g[i + (k - 1) * stride]; \
+	}
+
+VHGW(vips_morph_vhgw_or, |)
+VHGW(vips_morph_vhgw_and, &)
+
+/* Make sure the sequence has scratch buffers for an area this size.
+ */
+static int
+vips_morph_rect_buffers(VipsMorphSequence *seq, VipsRect *r)
+{
+	VipsMorph *morph = seq->morph;
+	int bands = seq->ir->im->Bands;
+	int line = (r->width + morph->rect.width - 1) * bands;
+	int lines = r->height + morph->rect.height - 1;
+
+	/* The horizontal pass output, and the vertical pass scratch and
+	 * output, all lines @r->width wide.
+	 */
+	size_t size = (size_t) r->width * bands * (3 * lines + r->height);
+
+	if (line > seq->line_size) {
+		VIPS_FREE(seq->line_g);
+		VIPS_FREE(seq->line_h);
+		if (!(seq->line_g = VIPS_ARRAY(NULL, line, VipsPel)) ||
+			!(seq->line_h = VIPS_ARRAY(NULL, line, VipsPel)))
+			return -1;
+		seq->line_size = line;
+	}
+
+	if (size > seq->area_size) {
+		VIPS_FREE(seq->area);
+		if (!(seq->area = VIPS_ARRAY(NULL, size, VipsPel)))
+			return -1;
+		seq->area_size = size;
+	}
+
+	return 0;
+}
+
+/* Erode or dilate with a solid rectangle as two separable passes, a
+ * horizontal OP along each line, then a vertical OP down the result.
+ */
+static int
+vips_morph_rect_gen(VipsRegion *out_region,
+	void *vseq, void *a, void *b, gboolean *stop)
+{
+	VipsMorphSequence *seq = (VipsMorphSequence *) vseq;
+	VipsMorph *morph = (VipsMorph *) b;
+	VipsImage *M = morph->M;
+	VipsRegion *ir = seq->ir;
+	VipsRect *rect = &morph->rect;
+	void (*vhgw)(VipsPel *, const VipsPel *, VipsPel *, VipsPel *,
+		int, int, int) =
+		morph->morph == VIPS_OPERATION_MORPHOLOGY_DILATE
+		? vips_morph_vhgw_or
+		: vips_morph_vhgw_and;
+
+	VipsRect *r = &out_region->valid;
+	int bands = ir->im->Bands;
+	int sz = VIPS_REGION_N_ELEMENTS(out_region);
+	int lines = r->height + rect->height - 1;
+
+	VipsRect s;
+	VipsPel *horizontal;
+	VipsPel *g;
+	VipsPel *h;
+	VipsPel *vertical;
+
+	/* Prepare the section of the input image we need. A little larger
+	 * than the section of the output image we are producing.
+	 */
+	s = *r;
+	s.width += M->Xsize - 1;
+	s.height += M->Ysize - 1;
+	if (vips_region_prepare(ir, &s))
+		return -1;
+
+	if (vips_morph_rect_buffers(seq, r))
+		return -1;
+	horizontal = seq->area;
+	g = horizontal + (size_t) lines * sz;
+	h = g + (size_t) lines * sz;
+	vertical = h + (size_t) lines * sz;
+
+	VIPS_GATE_START("vips_morph_rect_gen: work");
+
+	for (int y = 0; y < lines; y++) {
+		VipsPel *p = VIPS_REGION_ADDR(ir,
+			r->left + rect->left, r->top + rect->top + y);
+
+		vhgw(horizontal + (size_t) y * sz, p,
+			seq->line_g, seq->line_h,
+			r->width, rect->width, bands);
+	}
+
+	/* Each line of the horizontal result is one element of the vertical
+	 * pass.
+	 */
+	vhgw(vertical, horizontal, g, h, r->height, rect->height, sz);
+
+	for (int y = 0; y < r->height; y++)
+		memcpy(VIPS_REGION_ADDR(out_region, r->left, r->top + y),
+			vertical + (size_t) y * sz, sz);
+
+	VIPS_GATE_STOP("vips_morph_rect_gen: work");
+
+	VIPS_COUNT_PIXELS(out_region, "vips_morph_rect_gen");
+
+	return 0;
+}
+
+/* Is the mask a solid rectangle of 255 with don't-care around it? Set
+ * morph->rect to the rectangle if it is.
+ */
+static gboolean
+vips_morph_is_rect(VipsMorph *morph)
+{
+	VipsImage *M = morph->M;
+	VipsRect *rect = &morph->rect;
+
+	int left = M->Xsize;
+	int top = M->Ysize;
+	int right = -1;
+	int bottom = -1;
+
+	for (int y = 0; y < M->Ysize; y++)
+		for (int x = 0; x < M->Xsize; x++) {
+			guint8 c = morph->coeff[x + y * M->Xsize];
+
+			if (c == 0)
+				return FALSE;
+			if (c == 255) {
+				left = VIPS_MIN(left, x);
+				top = VIPS_MIN(top, y);
+				right = VIPS_MAX(right, x);
+				bottom = VIPS_MAX(bottom, y);
+			}
+		}
+
+	if (right < 0)
+		return FALSE;
+
+	rect->left = left;
+	rect->top = top;
+	rect->width = right - left + 1;
+	rect->height = bottom - top + 1;
+
+	for (int y = rect->top; y <= bottom; y++)
+		for (int x = rect->left; x <= right; x++)
+			if (morph->coeff[x + y * M->Xsize] != 255)
+				return FALSE;
+
+	return TRUE;
+}
+
 static int
 vips_morph_build(VipsObject *object)
 {
@@ -891,6 +1116,17 @@ vips_morph_build(VipsObject *object)
 		morph->coeff[i] = (guint8) coeff[i];
 	}
 
+	/* Large rectangles and lines are much quicker as separable passes,
+	 * since the cost no longer depends on the mask size. Small masks are
+	 * quicker with the vector path.
+	 */
+	morph->is_rect = vips_morph_is_rect(morph);
+	if (morph->is_rect &&
+		morph->rect.width * morph->rect.height > 25) {
+		generate = vips_morph_rect_gen;
+		g_info("morph: using separable path");
+	}
+	else
 	/* Try to make a vector path.
 	 */
 #ifdef HAVE_HWY
@@ -1021,6 +1257,10 @@ vips_morph_init(VipsMorph *morph)
  * and [method@Image.eorimage]
  * for analogues of the usual set difference and set union operations.
  *
+ * Large masks which are a solid rectangle or line of 255, perhaps with
+ * don't-care elements around them, are computed as a pair of separable
+ * passes, so the time taken does not depend on the mask size.
+ *
  * Operations are performed using the processor's vector unit,
  * if possible. Disable this with `--vips-novector` or `VIPS_NOVECTOR` or
  * [func@vector_set_enabled].
@@ -17,6 +17,10 @@
  * 	- gtk-doc
  * 18/6/20 kleisauke
  * 	- convert to vips8
+ * 15/10/26
+ * 	- find a coarse offset for the whole overlap with vips_phasecor(), then
+ * 	  search a small area around it for each point
+ * 	- correlate points in parallel
  */
 
 /*
@@ -56,9 +60,19 @@
 #include <math.h>
 
 #include <vips/vips.h>
+#include <vips/internal.h>
 
 #include "pmosaicing.h"
 
+/* When we have a coarse offset, search this far either side of it.
+ */
+#define VIPS_CHKPAIR_MARGIN (4)
+
+/* The phase correlation peak must be this many standard deviations above
+ * the mean before we trust it.
+ */
+#define VIPS_CHKPAIR_PEAK (8.0)
+
 /* vips__correl:
  * @ref: reference image
  * @sec: secondary image
@@ -182,12 +196,143 @@ vips__correl(VipsImage *ref, VipsImage *sec,
 	return 0;
 }
 
+#ifdef HAVE_FFTW
+/* Find the offset of sec relative to ref for the whole overlap with phase
+ * correlation. Return TRUE and set dx, dy if we found a clear peak.
+ */
+static gboolean
+vips__chkpair_phasecor(VipsImage *ref, VipsImage *sec, int *dx, int *dy)
+{
+	VipsImage *surface = vips_image_new();
+	VipsImage **t = (VipsImage **)
+		vips_object_local_array(VIPS_OBJECT(surface), 1);
+
+	double peak, avg, sd;
+	int x, y;
+
+	if (vips_phasecor(ref, sec, &t[0], NULL) ||
+		vips_max(t[0], &peak, "x", &x, "y", &y, NULL) ||
+		vips_avg(t[0], &avg, NULL) ||
+		vips_deviate(t[0], &sd, NULL)) {
+		/* Not fatal, we just do the full search.
+		 */
+		vips_error_clear();
+		g_object_unref(surface);
+		return FALSE;
+	}
+	g_object_unref(surface);
+
+	if (peak - avg < VIPS_CHKPAIR_PEAK * sd)
+		return FALSE;
+
+	/* The surface wraps around, so large positions are negative offsets.
+	 */
+	if (x > ref->Xsize / 2)
+		x -= ref->Xsize;
+	if (y > ref->Ysize / 2)
+		y -= ref->Ysize;
+
+	*dx = x;
+	*dy = y;
+
+	return TRUE;
+}
+#endif /*HAVE_FFTW*/
+
+/* State for the point correlation workers.
+ */
+typedef struct {
+	GMutex lock;
+	GCond cond;
+
+	VipsImage *ref;
+	VipsImage *sec;
+	TiePoints *points;
+
+	/* Centre each search on the point plus this offset.
+	 */
+	int cdx;
+	int cdy;
+	int hsearch;
+
+	int next;
+	int n_running;
+	gboolean failed;
+} ChkpairState;
+
+static int
+vips__chkpair_point(ChkpairState *state, int i)
+{
+	TiePoints *points = state->points;
+
+	int x, y;
+	double correlation;
+
+	/* Find correlation point.
+	 */
+	if (vips__correl(state->ref, state->sec,
+			points->x_reference[i], points->y_reference[i],
+			points->x_reference[i] + state->cdx,
+			points->y_reference[i] + state->cdy,
+			points->halfcorsize, state->hsearch,
+			&correlation, &x, &y))
+		return -1;
+
+	/* And note in x_secondary.
+	 */
+	points->x_secondary[i] = x;
+	points->y_secondary[i] = y;
+	points->correlation[i] = correlation;
+
+	/* Note each dx, dy too.
+	 */
+	points->dx[i] =
+		points->x_secondary[i] - points->x_reference[i];
+	points->dy[i] =
+		points->y_secondary[i] - points->y_reference[i];
+
+	return 0;
+}
+
+/* Each worker takes the next point until there are none left.
+ */
+static void
+vips__chkpair_work(void *a, void *b)
+{
+	ChkpairState *state = (ChkpairState *) a;
+
+	for (;;) {
+		int i;
+
+		g_mutex_lock(&state->lock);
+		i = state->failed ? state->points->nopoints : state->next++;
+		g_mutex_unlock(&state->lock);
+
+		if (i >= state->points->nopoints)
+			break;
+
+		if (vips__chkpair_point(state, i)) {
+			g_mutex_lock(&state->lock);
+			state->failed = TRUE;
+			g_mutex_unlock(&state->lock);
+		}
+	}
+
+	/* state can be freed as soon as we unlock, so this must be the last
+	 * thing we do.
+	 */
+	g_mutex_lock(&state->lock);
+	state->n_running -= 1;
+	g_cond_broadcast(&state->cond);
+	g_mutex_unlock(&state->lock);
+}
+
 int
 vips__chkpair(VipsImage *ref, VipsImage *sec, TiePoints *points)
 {
+	ChkpairState state;
+	int n_workers;
 	int i;
-	int x, y;
-	double correlation;
 
 	const int hcor = points->halfcorsize;
 	const int harea = points->halfareasize;
@@ -206,29 +351,92 @@ vips__chkpair(VipsImage *ref, VipsImage *sec, TiePoints *points)
 		return -1;
 	}
 
-	for (i = 0; i < points->nopoints; i++) {
-		/* Find correlation point.
-		 */
-		if (vips__correl(ref, sec,
-				points->x_reference[i], points->y_reference[i],
-				points->x_reference[i], points->y_reference[i],
-				hcor, harea,
-				&correlation, &x, &y))
-			return -1;
+	state.ref = ref;
+	state.sec = sec;
+	state.points = points;
+	state.cdx = 0;
+	state.cdy = 0;
+	state.hsearch = harea;
+	state.next = 0;
+	state.n_running = 0;
+	state.failed = FALSE;
 
-		/* And note in x_secondary.
-		 */
-		points->x_secondary[i] = x;
-		points->y_secondary[i] = y;
-		points->correlation[i] = correlation;
+#ifdef HAVE_FFTW
+	/* If the search area is large, a coarse offset for the whole overlap
+	 * lets us search a much smaller area for each point. We only use it
+	 * if the smaller area stays inside the full search area.
+	 */
+	if (points->nopoints > 0 &&
+		harea - hcor > 2 * VIPS_CHKPAIR_MARGIN &&
+		ref->Xsize == sec->Xsize &&
+		ref->Ysize == sec->Ysize) {
+		const int range = harea - hcor - VIPS_CHKPAIR_MARGIN;
 
-		/* Note each dx, dy too.
-		 */
-		points->dx[i] =
-			points->x_secondary[i] - points->x_reference[i];
-		points->dy[i] =
-			points->y_secondary[i] - points->y_reference[i];
+		int dx, dy;
+
+		if (vips__chkpair_phasecor(ref, sec, &dx, &dy) &&
+			VIPS_ABS(dx) <= range &&
+			VIPS_ABS(dy) <= range) {
+			state.hsearch = hcor + VIPS_CHKPAIR_MARGIN;
+
+			/* The sign of the phasecor offset depends on the
+			 * image contents being a shift of each other, so
+			 * check both directions on the first point and
+			 * keep the better one.
+			 */
+			if (dx != 0 ||
+				dy != 0) {
+				double c1, c2;
+
+				state.cdx = dx;
+				state.cdy = dy;
+				if (vips__chkpair_point(&state, 0))
+					return -1;
+				c1 = points->correlation[0];
+
+				state.cdx = -dx;
+				state.cdy = -dy;
+				if (vips__chkpair_point(&state, 0))
+					return -1;
+				c2 = points->correlation[0];
+
+				if (c1 > c2) {
+					state.cdx = dx;
+					state.cdy = dy;
+				}
+			}
+		}
 	}
+#endif /*HAVE_FFTW*/
 
-	return 0;
+	g_mutex_init(&state.lock);
+	g_cond_init(&state.cond);
+
+	n_workers = VIPS_MIN(vips_concurrency_get(), points->nopoints);
+
+	vips__worker_lock(&state.lock);
+	for (i = 0; i < n_workers; i++) {
+		state.n_running += 1;
+		if (vips_thread_execute("chkpair", vips__chkpair_work, &state))
+			state.n_running -= 1;
+	}
+
+	/* If we couldn't start any workers, do it ourselves.
+	 */
+	if (state.n_running == 0 &&
+		points->nopoints > 0) {
+		state.n_running += 1;
+		g_mutex_unlock(&state.lock);
+		vips__chkpair_work(&state, NULL);
+		vips__worker_lock(&state.lock);
+	}
+
+	while (state.n_running > 0)
+		vips__worker_cond_wait(&state.cond, &state.lock);
+	g_mutex_unlock(&state.lock);
+
+	g_mutex_clear(&state.lock);
+	g_cond_clear(&state.cond);
+
+	return state.failed ? -1 : 0;
 }
@@ -60,6 +60,10 @@
  * 	  with the new base class
  * 18/6/20 kleisauke
  * 	- convert to vips8
+ * 15/10/26
+ * 	- find overlap stats in parallel
+ * 	- solve large mosaics with sparse least-squares
+ * 	- rebuild translation-only mosaics with a single vips_mergen()
  */
 
 /*
@@ -123,6 +127,11 @@
  */
 #define TRIVIAL (20 * 20)
 
+/* Mosaics with more than this many images are balanced with a sparse
+ * least-squares solver rather than by inverting the dense normal matrix.
+ */
+#define SPARSE_THRESHOLD (256)
+
 /* Break a string into a list of strings. Write '\0's into the string. out
  * needs to be MAX_FILES long. -1 for error, otherwise number of args found.
 
@@ -1109,16 +1118,19 @@ find_image_stats(VipsImage *mem,
 	return t[4];
 }
 
-/* Find the stats for an overlap struct.
+/* Find the stats for an overlap struct. This can run in parallel, so we
+ * work relative to a private context and return refs in lap.
  */
 static int
 find_overlap_stats(OverlapInfo *lap)
 {
-	VipsImage *mem = lap->node->st->im;
+	VipsImage *mem = vips_image_new();
 	VipsImage **t = (VipsImage **)
 		vips_object_local_array(VIPS_OBJECT(mem), 1);
 
 	VipsRect rarea, sarea;
+	VipsImage *nstats;
+	VipsImage *ostats;
 
 	/* Translate the overlap area into the coordinate scheme for the main
 	 * node.
@@ -1134,20 +1146,166 @@ find_overlap_stats(OverlapInfo *lap)
 	sarea.left -= lap->other->cumtrn.oarea.left;
 	sarea.top -= lap->other->cumtrn.oarea.top;
 
-	/* Make a mask for the overlap.
+	/* Make a mask for the overlap, and find stats for that area.
 	 */
 	if (make_overlap_mask(mem,
-			lap->node->trnim, lap->other->trnim, &t[0], &rarea, &sarea))
+			lap->node->trnim, lap->other->trnim, &t[0], &rarea, &sarea) ||
+		!(nstats = find_image_stats(mem,
+			  lap->node->trnim, t[0], &rarea)) ||
+		!(ostats = find_image_stats(mem,
+			  lap->other->trnim, t[0], &sarea))) {
+		g_object_unref(mem);
 		return -1;
+	}
+
+	lap->nstats = g_object_ref(nstats);
+	lap->ostats = g_object_ref(ostats);
+
+	g_object_unref(mem);
+
+	return 0;
+}
+
+/* State for the overlap stats workers.
+ */
+typedef struct {
+	GMutex lock;
+	GCond cond;
+
+	GPtrArray *laps;
+	int next;
+	int n_running;
+	gboolean failed;
+} OverlapStats;
+
+/* Each worker takes the next overlap until there are none left.
+ */
+static void
+overlap_stats_work(void *a, void *b)
+{
+	OverlapStats *stats = (OverlapStats *) a;
+
+	for (;;) {
+		int i;
+
+		g_mutex_lock(&stats->lock);
+		i = stats->failed ? (int) stats->laps->len : stats->next++;
+		g_mutex_unlock(&stats->lock);
+
+		if (i >= (int) stats->laps->len)
+			break;
+
+		if (find_overlap_stats(g_ptr_array_index(stats->laps, i))) {
+			g_mutex_lock(&stats->lock);
+			stats->failed = TRUE;
+			g_mutex_unlock(&stats->lock);
+		}
+	}
 
-	/* Find stats for that area.
+	/* stats can be freed as soon as we unlock, so this must be the last
+	 * thing we do.
 	 */
-	if (!(lap->nstats = find_image_stats(mem,
-			  lap->node->trnim, t[0], &rarea)))
-		return -1;
-	if (!(lap->ostats = find_image_stats(mem,
-			  lap->other->trnim, t[0], &sarea)))
+	g_mutex_lock(&stats->lock);
+	stats->n_running -= 1;
+	g_cond_broadcast(&stats->cond);
+	g_mutex_unlock(&stats->lock);
+}
+
+/* Sub-fn. of below.
+ */
+static void *
+gather_overlaps(JoinNode *node, GPtrArray *laps, void *b)
+{
+	GSList *p;
+
+	for (p = node->overlaps; p; p = p->next)
+		g_ptr_array_add(laps, p->data);
+
+	return NULL;
+}
+
+/* Find stats for all overlaps, in parallel, then weed out overlaps where the
+ * masked pixel count is trivial.
+ */
+static int
+find_all_overlap_stats(SymbolTable *st)
+{
+	OverlapStats stats;
+	int n_workers;
+	int i;
+
+	g_mutex_init(&stats.lock);
+	g_cond_init(&stats.cond);
+	stats.laps = g_ptr_array_new();
+	stats.next = 0;
+	stats.n_running = 0;
+	stats.failed = FALSE;
+
+	vips__map_table(st, (VipsSListMap2Fn) gather_overlaps, stats.laps, NULL);
+
+	n_workers = VIPS_MIN(vips_concurrency_get(), (int) stats.laps->len);
+
+	vips__worker_lock(&stats.lock);
+	for (i = 0; i < n_workers; i++) {
+		stats.n_running += 1;
+		if (vips_thread_execute("globalbalance", overlap_stats_work, &stats))
+			stats.n_running -= 1;
+	}
+
+	/* If we couldn't start any workers, do it ourselves.
+	 */
+	if (stats.n_running == 0 &&
+		stats.laps->len > 0) {
+		stats.n_running += 1;
+		g_mutex_unlock(&stats.lock);
+		overlap_stats_work(&stats, NULL);
+		vips__worker_lock(&stats.lock);
+	}
+
+	while (stats.n_running > 0)
+		vips__worker_cond_wait(&stats.cond, &stats.lock);
+	g_mutex_unlock(&stats.lock);
+
+	/* Stats are now owned by st->im.
+	 */
+	for (i = 0; i < (int) stats.laps->len; i++) {
+		OverlapInfo *lap = g_ptr_array_index(stats.laps, i);
+
+		if (lap->nstats)
+			vips_object_local(st->im, lap->nstats);
+		if (lap->ostats)
+			vips_object_local(st->im, lap->ostats);
+	}
+
+	if (stats.failed) {
+		g_ptr_array_free(stats.laps, TRUE);
+		g_mutex_clear(&stats.lock);
+		g_cond_clear(&stats.cond);
 		return -1;
+	}
+
+	/* If the pixel count either masked overlap is trivial, ignore this
+	 * overlap.
+	 */
+	for (i = 0; i < (int) stats.laps->len; i++) {
+		OverlapInfo *lap = g_ptr_array_index(stats.laps, i);
+
+		if (*VIPS_MATRIX(lap->nstats, 5, 0) < TRIVIAL ||
+			*VIPS_MATRIX(lap->ostats, 5, 0) < TRIVIAL) {
+#ifdef DEBUG
+			printf("trivial overlap ... junking\n");
+			printf("nstats count = %g, ostats count = %g\n",
+				*VIPS_MATRIX(lap->nstats, 5, 0),
+				*VIPS_MATRIX(lap->ostats, 5, 0));
+			print_overlap(lap, NULL, NULL);
+#endif /*DEBUG*/
+			overlap_destroy(lap);
+		}
+	}
+
+	g_ptr_array_free(stats.laps, TRUE);
+	g_mutex_clear(&stats.lock);
+	g_cond_clear(&stats.cond);
 
 	return 0;
 }
@@ -1197,31 +1355,12 @@ test_overlap(JoinNode *other, JoinNode *node, void *b)
 			(VipsSListMap2Fn) overlap_eq, node, NULL))
 		return NULL;
 
-	/* A new overlap - add to overlap list.
+	/* A new overlap - add to overlap list. We find stats for all
+	 * overlaps later, in parallel.
 	 */
 	if (!(lap = build_overlap(node, other, &overlap)))
 		return node;
 
-	/* Calculate overlap statistics. Open stuff relative to this, and
-	 * free quickly.
-	 */
-	if (find_overlap_stats(lap))
-		return node;
-
-	/* If the pixel count either masked overlap is trivial, ignore this
-	 * overlap.
-	 */
-	if (*VIPS_MATRIX(lap->nstats, 5, 0) < TRIVIAL ||
-		*VIPS_MATRIX(lap->ostats, 5, 0) < TRIVIAL) {
-#ifdef DEBUG
-		printf("trivial overlap ... junking\n");
-		printf("nstats count = %g, ostats count = %g\n",
-			*VIPS_MATRIX(lap->nstats, 5, 0), *VIPS_MATRIX(lap->ostats, 5, 0));
-		print_overlap(lap, NULL, NULL);
-#endif /*DEBUG*/
-		overlap_destroy(lap);
-	}
-
 	return NULL;
 }
 
@@ -1413,6 +1552,143 @@ make_mos_image(SymbolTable *st, JoinNode *node, transform_fn tfn, void *a)
 	return out;
 }
 
+/* Gather the leaves of a mosaic made only from translations, and the
+ * largest blend width. FALSE if there's a rotate or scale anywhere.
+ */
+static gboolean
+find_flat_leaves(JoinNode *node, GPtrArray *leaves, int *mwidth)
+{
+	switch (node->type) {
+	case JOIN_LR:
+	case JOIN_TB:
+		if (node->mwidth == -1 ||
+			*mwidth == -1)
+			*mwidth = -1;
+		else
+			*mwidth = VIPS_MAX(*mwidth, node->mwidth);
+
+		return find_flat_leaves(node->arg1, leaves, mwidth) &&
+			find_flat_leaves(node->arg2, leaves, mwidth);
+
+	case JOIN_CP:
+		return find_flat_leaves(node->arg1, leaves, mwidth);
+
+	case JOIN_LEAF:
+		/* A leaf can appear more than once.
+		 */
+		if (!node->dirty) {
+			node->dirty = 1;
+			g_ptr_array_add(leaves, node);
+		}
+
+		return TRUE;
+
+	default:
+		return FALSE;
+	}
+}
+
+/* Record the joins on the output, so the result can be taken apart again.
+ */
+static int
+add_flat_history(JoinNode *node, VipsImage *out)
+{
+	switch (node->type) {
+	case JOIN_LR:
+	case JOIN_TB:
+		if (add_flat_history(node->arg1, out) ||
+			add_flat_history(node->arg2, out) ||
+			vips_image_history_printf(out,
+				"#%s <%s> <%s> <%s> <%d> <%d> <%d>",
+				node->type == JOIN_LR ? "LRJOIN" : "TBJOIN",
+				node->arg1->name, node->arg2->name, node->name,
+				(int) node->dx, (int) node->dy, node->mwidth))
+			return -1;
+		break;
+
+	case JOIN_CP:
+		if (add_flat_history(node->arg1, out) ||
+			vips_image_history_printf(out, "copy <%s> <%s>",
+				node->arg1->name, node->name))
+			return -1;
+		break;
+
+	default:
+		break;
+	}
+
+	return 0;
+}
+
+/* If every join is a plain translation, make the whole mosaic with one
+ * vips_mergen() rather than a tree of merges. Return 1 if we can't.
+ */
+static int
+build_flat_mosaic(SymbolTable *st, VipsImage *out, transform_fn tfn, void *a)
+{
+	GPtrArray *leaves;
+	int mwidth;
+	VipsImage **in;
+	int *x;
+	int *y;
+	VipsImage *join;
+	int i;
+
+	if (st->root->type == JOIN_LEAF)
+		return 1;
+
+	leaves = g_ptr_array_new();
+	mwidth = 0;
+	clean_table(st);
+	if (!find_flat_leaves(st->root, leaves, &mwidth)) {
+		g_ptr_array_free(leaves, TRUE);
+		return 1;
+	}
+
+	in = VIPS_ARRAY(st->im, leaves->len, VipsImage *);
+	x = VIPS_ARRAY(st->im, leaves->len, int);
+	y = VIPS_ARRAY(st->im, leaves->len, int);
+	if (!in ||
+		!x ||
+		!y) {
+		g_ptr_array_free(leaves, TRUE);
+		return -1;
+	}
+
+	/* Leaves are placed by their cumulative transform, which is just an
+	 * offset here.
+	 */
+	for (i = 0; i < leaves->len; i++) {
+		JoinNode *leaf = (JoinNode *) g_ptr_array_index(leaves, i);
+
+		if (!(in[i] = tfn(leaf, a))) {
+			g_ptr_array_free(leaves, TRUE);
+			return -1;
+		}
+		x[i] = leaf->cumtrn.oarea.left;
+		y[i] = leaf->cumtrn.oarea.top;
+	}
+
+	if (vips_mergen(in, &join, leaves->len, x, y,
+			"mblend", mwidth,
+			NULL)) {
+		g_ptr_array_free(leaves, TRUE);
+		return -1;
+	}
+	g_ptr_array_free(leaves, TRUE);
+
+	if (vips_image_write(join, out)) {
+		g_object_unref(join);
+		return -1;
+	}
+	g_object_unref(join);
+
+	if (add_flat_history(st->root, out))
+		return -1;
+
+	return 0;
+}
+
 /* Re-build mosaic.
  */
 int
@@ -1421,6 +1697,12 @@ vips__build_mosaic(SymbolTable *st, VipsImage *out, transform_fn tfn, void *a)
 	JoinNode *root = st->root;
 	VipsImage *im1, *im2;
 	VipsImage *x;
+	int result;
+
+	/* Mosaics made only from translations can be rebuilt in one pass.
+	 */
+	if ((result = build_flat_mosaic(st, out, tfn, a)) <= 0)
+		return result;
 
 	switch (root->type) {
 	case JOIN_LR:
@@ -1554,16 +1836,200 @@ vips__matrixmultiply(VipsImage *in1, VipsImage *in2, VipsImage **out)
 	return 0;
 }
 
-/* Find correction factors.
+/* One row of the balance equations: a * x[i] + b * x[j] = k. i is -1 for
+ * the rows from the nominated leaf, which has no unknown.
+ */
+typedef struct {
+	int i;
+	double a;
+	int j;
+	double b;
+	double k;
+} SparseRow;
+
+/* Bundle of variables for sparse row creation.
+ */
+typedef struct {
+	JoinNode *leaf;
+	SparseRow *rows;
+	int n;
+} SparseBundle;
+
+/* Add rows for node's overlaps, as add_nominated() and add_other().
+ */
+static void *
+add_sparse_rows(JoinNode *node, SparseBundle *bun, double *gamma)
+{
+	GSList *p;
+
+	for (p = node->overlaps; p; p = p->next) {
+		OverlapInfo *ovl = (OverlapInfo *) p->data;
+		double ns = pow(*VIPS_MATRIX(ovl->nstats, 4, 0), 1.0 / (*gamma));
+		double os = pow(*VIPS_MATRIX(ovl->ostats, 4, 0), 1.0 / (*gamma));
+		SparseRow *row = &bun->rows[bun->n++];
+
+		if (node == bun->leaf) {
+			row->i = -1;
+			row->a = 0.0;
+			row->k = ns;
+		}
+		else {
+			row->i = ovl->node->index - 1;
+			row->a = -ns;
+			row->k = 0.0;
+		}
+		row->j = ovl->other->index - 1;
+		row->b = os;
+	}
+
+	return NULL;
+}
+
+/* out = A x, for the n_rows x n_col sparse matrix A in rows.
+ */
+static void
+sparse_mul(SparseRow *rows, int n_rows, const double *x, double *out)
+{
+	int r;
+
+	for (r = 0; r < n_rows; r++)
+		out[r] = rows[r].b * x[rows[r].j] +
+			(rows[r].i >= 0 ? rows[r].a * x[rows[r].i] : 0.0);
+}
+
+/* out = A' y.
+ */
+static void
+sparse_mul_transpose(SparseRow *rows, int n_rows, int n_col,
+	const double *y, double *out)
+{
+	int r;
+
+	memset(out, 0, n_col * sizeof(double));
+	for (r = 0; r < n_rows; r++) {
+		out[rows[r].j] += rows[r].b * y[r];
+		if (rows[r].i >= 0)
+			out[rows[r].i] += rows[r].a * y[r];
+	}
+}
+
+/* Solve the balance equations in the least-squares sense with conjugate
+ * gradients on the normal equations (CGLS). Each row has at most two
+ * non-zeros, so this needs O(novl) memory and time per iteration, where the
+ * dense solve needs O(nim * novl) memory and O(nim ^ 3) time.
  */
 static int
-find_factors(SymbolTable *st, double gamma)
+find_factors_sparse(SymbolTable *st, double gamma, double *x)
+{
+	int n_rows = st->novl;
+	int n_col = st->nim - 1;
+	SparseRow *rows = VIPS_ARRAY(NULL, n_rows, SparseRow);
+	double *r = VIPS_ARRAY(NULL, n_rows, double);
+	double *q = VIPS_ARRAY(NULL, n_rows, double);
+	double *s = VIPS_ARRAY(NULL, n_col, double);
+	double *p = VIPS_ARRAY(NULL, n_col, double);
+	int *seen = VIPS_ARRAY(NULL, n_col, int);
+
+	SparseBundle bun;
+	double norm, norm0;
+	int i, iter;
+	int result;
+
+	result = -1;
+
+	bun.leaf = st->leaf;
+	bun.rows = rows;
+	bun.n = 0;
+	vips__map_table(st, (VipsSListMap2Fn) add_sparse_rows, &bun, &gamma);
+	g_assert(bun.n == n_rows);
+
+	/* Every image must appear in at least one equation, or the system
+	 * is singular.
+	 */
+	for (i = 0; i < n_rows; i++) {
+		seen[rows[i].j] = 1;
+		if (rows[i].i >= 0)
+			seen[rows[i].i] = 1;
+	}
+	for (i = 0; i < n_col; i++)
+		if (!seen[i]) {
+			vips_error("vips_globalbalance",
+				"%s", _("mosaic is not connected"));
+			goto done;
+		}
+
+	/* x = 0, r = k - A x, s = p = A' r.
+	 */
+	memset(x, 0, n_col * sizeof(double));
+	for (i = 0; i < n_rows; i++)
+		r[i] = rows[i].k;
+	sparse_mul_transpose(rows, n_rows, n_col, r, s);
+	memcpy(p, s, n_col * sizeof(double));
+
+	norm0 = 0.0;
+	for (i = 0; i < n_col; i++)
+		norm0 += s[i] * s[i];
+	norm = norm0;
+
+	for (iter = 0; iter < 10 * n_col && norm > 1e-24 * norm0; iter++) {
+		double qq;
+		double alpha;
+		double beta;
+		double norm_new;
+
+		sparse_mul(rows, n_rows, p, q);
+		qq = 0.0;
+		for (i = 0; i < n_rows; i++)
+			qq += q[i] * q[i];
+		if (qq == 0.0) {
+			vips_error("vips_globalbalance",
+				"%s", _("mosaic is not connected"));
+			goto done;
+		}
+
+		alpha = norm / qq;
+		for (i = 0; i < n_col; i++)
+			x[i] += alpha * p[i];
+		for (i = 0; i < n_rows; i++)
+			r[i] -= alpha * q[i];
+
+		sparse_mul_transpose(rows, n_rows, n_col, r, s);
+		norm_new = 0.0;
+		for (i = 0; i < n_col; i++)
+			norm_new += s[i] * s[i];
+
+		beta = norm_new / norm;
+		for (i = 0; i < n_col; i++)
+			p[i] = s[i] + beta * p[i];
+		norm = norm_new;
+	}
+
+#ifdef DEBUG
+	printf("find_factors_sparse: %d iterations, residual %g\n",
+		iter, sqrt(norm / norm0));
+#endif /*DEBUG*/
+
+	result = 0;
+
+done:
+	g_free(rows);
+	g_free(r);
+	g_free(q);
+	g_free(s);
+	g_free(p);
+	g_free(seen);
+
+	return result;
+}
+
+/* Find correction factors with a dense LMS solve.
+ */
+static int
+find_factors_dense(SymbolTable *st, double gamma, double *x)
 {
 	VipsImage **t = (VipsImage **)
 		vips_object_local_array(VIPS_OBJECT(st->im), 7);
 
-	double total;
-	double avg;
 	int i;
 
 	/* Make output matrices.
@@ -1588,14 +2054,37 @@ find_factors(SymbolTable *st, double gamma)
 		vips__matrixmultiply(t[5], t[0], &t[6]))
 		return -1;
 
-	/* Make array of correction factors.
+	for (i = 0; i < t[6]->Ysize; i++)
+		x[i] = *VIPS_MATRIX(t[6], 0, i);
+
+	return 0;
+}
+
+/* Find correction factors.
+ */
+static int
+find_factors(SymbolTable *st, double gamma)
+{
+	double total;
+	double avg;
+	int i;
+
+	/* Make array of correction factors. The leaf is fac[0] and is always
+	 * 1.0, the solver finds the rest.
 	 */
 	if (!(st->fac = VIPS_ARRAY(st->im, st->nim, double)))
 		return -1;
-	for (i = 0; i < t[6]->Ysize; i++)
-		st->fac[i + 1] = *VIPS_MATRIX(t[6], 0, i);
 	st->fac[0] = 1.0;
 
+	if (st->nim - 1 > SPARSE_THRESHOLD) {
+		if (find_factors_sparse(st, gamma, st->fac + 1))
+			return -1;
+	}
+	else {
+		if (find_factors_dense(st, gamma, st->fac + 1))
+			return -1;
+	}
+
 	/* Find average balance factor, normalise to that average.
 	 */
 	total = 0.0;
@@ -1736,6 +2225,11 @@ analyse_mosaic(SymbolTable *st, VipsImage *in)
 	if (vips__map_table(st, (VipsSListMap2Fn) find_overlaps, st, NULL))
 		return -1;
 
+	/* Find stats for each overlap and drop trivial ones.
+	 */
+	if (find_all_overlap_stats(st))
+		return -1;
+
 	/* Scan table, counting and indexing input images and joins.
 	 */
 	vips__map_table(st, (VipsSListMap2Fn) count_leaves, NULL, NULL);
@@ -1960,10 +2454,12 @@ vips_globalbalance_init(VipsGlobalbalance *globalbalance)
  * images that were used to make the mosaic and the position that each ended
  * up at in the final image.
  *
- * It opens each of the source images in turn and extracts all parts which
+ * It opens each of the source images and extracts all parts which
  * overlap with any of the other images. It finds the average values in the
- * overlap areas and uses least-mean-square to find a set of correction
- * factors which will minimise overlap differences. It uses @gamma to
+ * overlap areas in parallel and uses least-mean-square to find a set of
+ * correction factors which will minimise overlap differences. Mosaics with
+ * more than a few hundred images are solved with a sparse least-squares
+ * method, so very large mosaics need little memory. It uses @gamma to
  * gamma-correct the source images before calculating the factors. A value of
  * 1.0 will stop this.
  *
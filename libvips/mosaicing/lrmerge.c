@@ -85,6 +85,8 @@
  * 	- wrap as a class
  * 18/6/20 kleisauke
  * 	- convert to vips8
+ * 15/10/26
+ * 	- add a Highway path for the blend and first/last search
  */
 
 /*
@@ -130,6 +132,7 @@
  */
 
 #include <vips/vips.h>
+#include <vips/vector.h>
 #include <vips/transform.h>
 #include <vips/internal.h>
 
@@ -191,6 +194,28 @@ find_first(VipsRegion *ir, int *pos, int x, int y, int w)
 	if (vips_band_format_iscomplex(im->BandFmt))
 		ne *= 2;
 
+#ifdef HAVE_HWY
+	/* An int element is non-zero if any of its bytes are.
+	 */
+	if (vips_vector_isenabled() &&
+		vips_band_format_isint(im->BandFmt)) {
+		int size = VIPS_IMAGE_SIZEOF_ELEMENT(im);
+
+		i = vips__merge_find_first_hwy(pr, ne * size) / size;
+		*pos = x + i / im->Bands;
+
+		return 0;
+	}
+	else if (vips_vector_isenabled() &&
+		(im->BandFmt == VIPS_FORMAT_FLOAT ||
+			im->BandFmt == VIPS_FORMAT_COMPLEX)) {
+		i = vips__merge_find_first_float_hwy((float *) pr, ne);
+		*pos = x + i / im->Bands;
+
+		return 0;
+	}
+#endif /*HAVE_HWY*/
+
 /* Search for the first non-zero band element from the left edge of the image.
  */
 #define lsearch(TYPE) \
@@ -261,6 +286,28 @@ find_last(VipsRegion *ir, int *pos, int x, int y, int w)
 	if (vips_band_format_iscomplex(im->BandFmt))
 		ne *= 2;
 
+#ifdef HAVE_HWY
+	if (vips_vector_isenabled() &&
+		vips_band_format_isint(im->BandFmt)) {
+		int size = VIPS_IMAGE_SIZEOF_ELEMENT(im);
+
+		i = vips__merge_find_last_hwy(pr, ne * size);
+		if (i >= 0)
+			i /= size;
+		*pos = x + i / im->Bands;
+
+		return 0;
+	}
+	else if (vips_vector_isenabled() &&
+		(im->BandFmt == VIPS_FORMAT_FLOAT ||
+			im->BandFmt == VIPS_FORMAT_COMPLEX)) {
+		i = vips__merge_find_last_float_hwy((float *) pr, ne);
+		*pos = x + i / im->Bands;
+
+		return 0;
+	}
+#endif /*HAVE_HWY*/
+
 /* Search for the first non-zero band element from the right.
  */
 #define rsearch(TYPE) \
@@ -576,6 +623,138 @@ make_firstlast(MergeInfo *inf, Overlapping *ovlap, VipsRect *oreg)
 		} \
 	}
 
+#ifdef HAVE_HWY
+/* Can we use the vector blend for this image? Shared with tbmerge.
+ */
+gboolean
+vips__merge_vector_ok(VipsImage *im)
+{
+	return vips_vector_isenabled() &&
+		(im->BandFmt == VIPS_FORMAT_UCHAR ||
+			im->BandFmt == VIPS_FORMAT_USHORT ||
+			im->BandFmt == VIPS_FORMAT_FLOAT);
+}
+
+/* Get the blend position buffer, making sure we have room for a scan-line
+ * of width pixels. Shared with tbmerge.
+ */
+int *
+vips__merge_get_inx(MergeInfo *inf, VipsImage *im, int width)
+{
+	if (inf->inx_size < width) {
+		int ne = width * im->Bands;
+
+		VIPS_FREE(inf->inx);
+		VIPS_FREE(inf->c1);
+		VIPS_FREE(inf->c2);
+		inf->inx = VIPS_ARRAY(NULL, width, int);
+		inf->c1 = VIPS_ARRAY(NULL, ne, double);
+		inf->c2 = VIPS_ARRAY(NULL, ne, double);
+		inf->inx_size = width;
+	}
+
+	return inf->inx;
+}
+
+/* Is this pixel all zero?
+ */
+#define VECTOR_ZERO(TYPE, P) \
+	{ \
+		TYPE *tt = (TYPE *) (P); \
+		int ii; \
+\
+		for (ii = 0; ii < bands; ii++) \
+			if (tt[ii]) \
+				break; \
+		zero = ii == bands; \
+	}
+
+/* Set the blend coefficients for each band element, then blend.
+ */
+#define VECTOR_COEFF(TYPE, CTYPE, ONE, C1, C2) \
+	{ \
+		CTYPE *c1 = (CTYPE *) inf->c1; \
+		CTYPE *c2 = (CTYPE *) inf->c2; \
+\
+		for (x = 0, i = 0; x < width; x++) { \
+			const int k = inx[x]; \
+			gboolean ref_zero; \
+			gboolean sec_zero; \
+			gboolean zero; \
+			CTYPE a, b; \
+\
+			VECTOR_ZERO(TYPE, (TYPE *) pr + i); \
+			ref_zero = zero; \
+			VECTOR_ZERO(TYPE, (TYPE *) ps + i); \
+			sec_zero = zero; \
+\
+			if (k >= 0 && \
+				!ref_zero && \
+				!sec_zero) { \
+				a = C1[k]; \
+				b = C2[k]; \
+			} \
+			else if (k == MERGE_SEC ? sec_zero : !ref_zero) { \
+				a = ONE; \
+				b = 0; \
+			} \
+			else { \
+				a = 0; \
+				b = ONE; \
+			} \
+\
+			for (bb = 0; bb < bands; bb++, i++) { \
+				c1[i] = a; \
+				c2[i] = b; \
+			} \
+		} \
+	}
+
+/* Blend a scan-line of uchar, ushort or float pixels. The caller must have
+ * set a blend position for each pixel with vips__merge_get_inx(): either
+ * MERGE_REF, MERGE_SEC, or an index into the blend LUTs. Shared with
+ * tbmerge.
+ */
+void
+vips__merge_blend_vector(MergeInfo *inf, VipsImage *im,
+	VipsPel *q, VipsPel *pr, VipsPel *ps, int width)
+{
+	const int bands = im->Bands;
+	const int ne = width * bands;
+	const int *inx = inf->inx;
+
+	int x, bb, i;
+
+	switch (im->BandFmt) {
+	case VIPS_FORMAT_UCHAR:
+		VECTOR_COEFF(unsigned char, int, BLEND_SCALE,
+			vips__icoef1, vips__icoef2);
+		vips__merge_blend_uchar_hwy(q, pr, ps,
+			(int *) inf->c1, (int *) inf->c2, ne);
+		break;
+
+	case VIPS_FORMAT_USHORT:
+		VECTOR_COEFF(unsigned short, int, BLEND_SCALE,
+			vips__icoef1, vips__icoef2);
+		vips__merge_blend_ushort_hwy((unsigned short *) q,
+			(unsigned short *) pr, (unsigned short *) ps,
+			(int *) inf->c1, (int *) inf->c2, ne);
+		break;
+
+	case VIPS_FORMAT_FLOAT:
+		VECTOR_COEFF(float, double, 1.0,
+			vips__coef1, vips__coef2);
+		vips__merge_blend_float_hwy((float *) q,
+			(float *) pr, (float *) ps,
+			(double *) inf->c1, (double *) inf->c2, ne);
+		break;
+
+	default:
+		g_assert_not_reached();
+	}
+}
+#endif /*HAVE_HWY*/
+
 /* Left-right blend function for non-labpack images.
  */
 static int
@@ -612,6 +791,40 @@ lr_blend(VipsRegion *out_region, MergeInfo *inf, Overlapping *ovlap,
 		vips_region_prepare(sir, &psr))
 		return -1;
 
+#ifdef HAVE_HWY
+	if (vips__merge_vector_ok(im)) {
+		int *inx = vips__merge_get_inx(inf, im, oreg->width);
+
+		for (y = oreg->top, yr = prr.top, ys = psr.top;
+			 y < VIPS_RECT_BOTTOM(oreg); y++, yr++, ys++) {
+			VipsPel *pr = VIPS_REGION_ADDR(rir, prr.left, yr);
+			VipsPel *ps = VIPS_REGION_ADDR(sir, psr.left, ys);
+			VipsPel *q = VIPS_REGION_ADDR(out_region, oreg->left, y);
+
+			const int j = y - ovlap->overlap.top;
+			const int first = ovlap->first[j];
+			const int last = ovlap->last[j];
+			const int bwidth = last - first;
+			const int left = VIPS_CLIP(0, first - oreg->left, oreg->width);
+			const int right =
+				VIPS_CLIP(left, last - oreg->left, oreg->width);
+
+			int x;
+
+			for (x = 0; x < left; x++)
+				inx[x] = MERGE_REF;
+			for (x = left; x < right; x++)
+				inx[x] = ((x + oreg->left - first) << BLEND_SHIFT) / bwidth;
+			for (x = right; x < oreg->width; x++)
+				inx[x] = MERGE_SEC;
+
+			vips__merge_blend_vector(inf, im, q, pr, ps, oreg->width);
+		}
+
+		return 0;
+	}
+#endif /*HAVE_HWY*/
+
 	/* Loop down overlap area.
 	 */
 	for (y = oreg->top, yr = prr.top, ys = psr.top;
@@ -1052,6 +1265,9 @@ vips__stop_merge(void *seq, void *a, void *b)
 	VIPS_FREE(inf->from1);
 	VIPS_FREE(inf->from2);
 	VIPS_FREE(inf->merge);
+	VIPS_FREE(inf->inx);
+	VIPS_FREE(inf->c1);
+	VIPS_FREE(inf->c2);
 	g_free(inf);
 
 	return 0;
@@ -1073,6 +1289,10 @@ vips__start_merge(VipsImage *out, void *a, void *b)
 	inf->from1 = NULL;
 	inf->from2 = NULL;
 	inf->merge = NULL;
+	inf->inx = NULL;
+	inf->c1 = NULL;
+	inf->c2 = NULL;
+	inf->inx_size = 0;
 
 	/* If this is going to be a VIPS_CODING_LABQ, we need VIPS_CODING_LABQ
 	 * blend buffers.
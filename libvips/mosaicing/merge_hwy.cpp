@@ -0,0 +1,304 @@
+/* 15/10/26
+ * 	- initial implementation
+ */
+
+/*
+
+	This file is part of VIPS.
+
+	VIPS is free software; you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+	02110-1301  USA
+
+ */
+
+/*
+
+	These files are distributed with VIPS - http://www.vips.ecs.soton.ac.uk
+
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /*HAVE_CONFIG_H*/
+#include <glib/gi18n-lib.h>
+
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <cmath>
+
+#include <vips/vips.h>
+#include <vips/vector.h>
+#include <vips/debug.h>
+#include <vips/internal.h>
+
+#include "pmosaicing.h"
+
+#ifdef HAVE_HWY
+
+#undef HWY_TARGET_INCLUDE
+#define HWY_TARGET_INCLUDE "libvips/mosaicing/merge_hwy.cpp"
+#include <hwy/foreach_target.h>
+#include <hwy/highway.h>
+
+namespace HWY_NAMESPACE {
+
+using namespace hwy::HWY_NAMESPACE;
+
+using DU8 = ScalableTag<uint8_t>;
+constexpr DU8 du8;
+using DF32 = ScalableTag<float>;
+constexpr DF32 df32;
+using DI32 = ScalableTag<int32_t>;
+constexpr DI32 di32;
+constexpr Rebind<uint8_t, DI32> du8x32;
+constexpr Rebind<uint16_t, DI32> du16x32;
+using DF64 = ScalableTag<double>;
+constexpr DF64 df64;
+constexpr Rebind<float, DF64> df32x64;
+
+// Compat for Highway versions < 1.3.0
+#ifndef HWY_LANES_CONSTEXPR
+#define HWY_LANES_CONSTEXPR
+#endif
+
+/* The integer blend divides by BLEND_SCALE with a shift.
+ */
+static_assert(BLEND_SCALE == 1 << 12, "BLEND_SCALE must be 4096");
+
+HWY_ATTR int
+vips__merge_find_first_hwy(const uint8_t *HWY_RESTRICT p, int32_t n)
+{
+	HWY_LANES_CONSTEXPR int32_t N = Lanes(du8);
+	const auto zero = Zero(du8);
+
+	/* Skip whole vectors of zeros, then find the byte one by one.
+	 */
+	int32_t i = 0;
+	for (; i + N <= n; i += N)
+		if (!AllTrue(du8, Eq(LoadU(du8, p + i), zero)))
+			break;
+
+	for (; i < n; i++)
+		if (p[i])
+			break;
+
+	return i;
+}
+
+HWY_ATTR int
+vips__merge_find_last_hwy(const uint8_t *HWY_RESTRICT p, int32_t n)
+{
+	HWY_LANES_CONSTEXPR int32_t N = Lanes(du8);
+	const auto zero = Zero(du8);
+
+	int32_t i = n;
+	for (; i - N >= 0; i -= N)
+		if (!AllTrue(du8, Eq(LoadU(du8, p + i - N), zero)))
+			break;
+
+	for (i -= 1; i >= 0; i--)
+		if (p[i])
+			break;
+
+	return i;
+}
+
+HWY_ATTR int
+vips__merge_find_first_float_hwy(const float *HWY_RESTRICT p, int32_t n)
+{
+	HWY_LANES_CONSTEXPR int32_t N = Lanes(df32);
+	const auto zero = Zero(df32);
+
+	int32_t i = 0;
+	for (; i + N <= n; i += N)
+		if (!AllTrue(df32, Eq(LoadU(df32, p + i), zero)))
+			break;
+
+	for (; i < n; i++)
+		if (p[i])
+			break;
+
+	return i;
+}
+
+HWY_ATTR int
+vips__merge_find_last_float_hwy(const float *HWY_RESTRICT p, int32_t n)
+{
+	HWY_LANES_CONSTEXPR int32_t N = Lanes(df32);
+	const auto zero = Zero(df32);
+
+	int32_t i = n;
+	for (; i - N >= 0; i -= N)
+		if (!AllTrue(df32, Eq(LoadU(df32, p + i - N), zero)))
+			break;
+
+	for (i -= 1; i >= 0; i--)
+		if (p[i])
+			break;
+
+	return i;
+}
+
+HWY_ATTR void
+vips__merge_blend_uchar_hwy(uint8_t *HWY_RESTRICT q,
+	const uint8_t *HWY_RESTRICT tr, const uint8_t *HWY_RESTRICT ts,
+	const int32_t *HWY_RESTRICT c1, const int32_t *HWY_RESTRICT c2,
+	int32_t n)
+{
+	HWY_LANES_CONSTEXPR int32_t N = Lanes(di32);
+
+	int32_t x = 0;
+	for (; x + N <= n; x += N) {
+		auto r = PromoteTo(di32, LoadU(du8x32, tr + x));
+		auto s = PromoteTo(di32, LoadU(du8x32, ts + x));
+		auto a = LoadU(di32, c1 + x);
+		auto b = LoadU(di32, c2 + x);
+
+		auto sum = Add(ShiftRight<12>(Mul(a, r)),
+			ShiftRight<12>(Mul(b, s)));
+
+		StoreU(DemoteTo(du8x32, sum), du8x32, q + x);
+	}
+
+	for (; x < n; x++)
+		q[x] = c1[x] * tr[x] / BLEND_SCALE + c2[x] * ts[x] / BLEND_SCALE;
+}
+
+HWY_ATTR void
+vips__merge_blend_ushort_hwy(uint16_t *HWY_RESTRICT q,
+	const uint16_t *HWY_RESTRICT tr, const uint16_t *HWY_RESTRICT ts,
+	const int32_t *HWY_RESTRICT c1, const int32_t *HWY_RESTRICT c2,
+	int32_t n)
+{
+	HWY_LANES_CONSTEXPR int32_t N = Lanes(di32);
+
+	int32_t x = 0;
+	for (; x + N <= n; x += N) {
+		auto r = PromoteTo(di32, LoadU(du16x32, tr + x));
+		auto s = PromoteTo(di32, LoadU(du16x32, ts + x));
+		auto a = LoadU(di32, c1 + x);
+		auto b = LoadU(di32, c2 + x);
+
+		auto sum = Add(ShiftRight<12>(Mul(a, r)),
+			ShiftRight<12>(Mul(b, s)));
+
+		StoreU(DemoteTo(du16x32, sum), du16x32, q + x);
+	}
+
+	for (; x < n; x++)
+		q[x] = c1[x] * tr[x] / BLEND_SCALE + c2[x] * ts[x] / BLEND_SCALE;
+}
+
+HWY_ATTR void
+vips__merge_blend_float_hwy(float *HWY_RESTRICT q,
+	const float *HWY_RESTRICT tr, const float *HWY_RESTRICT ts,
+	const double *HWY_RESTRICT c1, const double *HWY_RESTRICT c2,
+	int32_t n)
+{
+	HWY_LANES_CONSTEXPR int32_t N = Lanes(df64);
+	const auto zero = Zero(df64);
+
+	/* Blend in double, as the C path does. Pixels which just take ref or
+	 * sec have a zero coefficient, and are copied exactly.
+	 */
+	int32_t x = 0;
+	for (; x + N <= n; x += N) {
+		auto r = PromoteTo(df64, LoadU(df32x64, tr + x));
+		auto s = PromoteTo(df64, LoadU(df32x64, ts + x));
+		auto a = LoadU(df64, c1 + x);
+		auto b = LoadU(df64, c2 + x);
+
+		auto sum = Add(Mul(a, r), Mul(b, s));
+		sum = IfThenElse(Eq(b, zero), r, sum);
+		sum = IfThenElse(Eq(a, zero), s, sum);
+
+		StoreU(DemoteTo(df32x64, sum), df32x64, q + x);
+	}
+
+	for (; x < n; x++)
+		q[x] = c2[x] == 0.0
+			? tr[x]
+			: c1[x] == 0.0 ? ts[x] : c1[x] * tr[x] + c2[x] * ts[x];
+}
+
+} /*namespace HWY_NAMESPACE*/
+
+#if HWY_ONCE
+HWY_EXPORT(vips__merge_find_first_hwy);
+HWY_EXPORT(vips__merge_find_last_hwy);
+HWY_EXPORT(vips__merge_find_first_float_hwy);
+HWY_EXPORT(vips__merge_find_last_float_hwy);
+HWY_EXPORT(vips__merge_blend_uchar_hwy);
+HWY_EXPORT(vips__merge_blend_ushort_hwy);
+HWY_EXPORT(vips__merge_blend_float_hwy);
+
+int
+vips__merge_find_first_hwy(const VipsPel *p, int n)
+{
+	return HWY_DYNAMIC_DISPATCH(vips__merge_find_first_hwy)(p, n);
+}
+
+int
+vips__merge_find_last_hwy(const VipsPel *p, int n)
+{
+	return HWY_DYNAMIC_DISPATCH(vips__merge_find_last_hwy)(p, n);
+}
+
+int
+vips__merge_find_first_float_hwy(const float *p, int n)
+{
+	return HWY_DYNAMIC_DISPATCH(vips__merge_find_first_float_hwy)(p, n);
+}
+
+int
+vips__merge_find_last_float_hwy(const float *p, int n)
+{
+	return HWY_DYNAMIC_DISPATCH(vips__merge_find_last_float_hwy)(p, n);
+}
+
+void
+vips__merge_blend_uchar_hwy(VipsPel *q, const VipsPel *tr, const VipsPel *ts,
+	const int *c1, const int *c2, int n)
+{
+	/* clang-format off */
+	HWY_DYNAMIC_DISPATCH(vips__merge_blend_uchar_hwy)(q, tr, ts,
+		c1, c2, n);
+	/* clang-format on */
+}
+
+void
+vips__merge_blend_ushort_hwy(unsigned short *q,
+	const unsigned short *tr, const unsigned short *ts,
+	const int *c1, const int *c2, int n)
+{
+	/* clang-format off */
+	HWY_DYNAMIC_DISPATCH(vips__merge_blend_ushort_hwy)(q, tr, ts,
+		c1, c2, n);
+	/* clang-format on */
+}
+
+void
+vips__merge_blend_float_hwy(float *q, const float *tr, const float *ts,
+	const double *c1, const double *c2, int n)
+{
+	/* clang-format off */
+	HWY_DYNAMIC_DISPATCH(vips__merge_blend_float_hwy)(q, tr, ts,
+		c1, c2, n);
+	/* clang-format on */
+}
+#endif /*HWY_ONCE*/
+
+#endif /*HAVE_HWY*/
@@ -0,0 +1,902 @@
+/* merge an array of images in a single pass
+ *
+ * 15/10/26
+ * 	- from vips_merge()
+ */
+
+/*
+
+	This file is part of VIPS.
+
+	VIPS is free software; you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+	02110-1301  USA
+
+ */
+
+/*
+
+	These files are distributed with VIPS - http://www.vips.ecs.soton.ac.uk
+
+ */
+
+/*
+#define DEBUG
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /*HAVE_CONFIG_H*/
+#include <glib/gi18n-lib.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <vips/vips.h>
+#include <vips/internal.h>
+
+#include "pmosaicing.h"
+
+typedef struct _VipsMergen {
+	VipsOperation parent_instance;
+
+	VipsArrayImage *in;
+	VipsImage *out;
+	VipsArrayInt *x;
+	VipsArrayInt *y;
+	int mblend;
+
+	/* The inputs cast to a common format and bands, and the position of
+	 * each one in the output.
+	 */
+	int n;
+	VipsImage **ready;
+	VipsRect *area;
+
+	/* Blend weight for pixels 0 .. ramp_size - 1 in from the nearest edge
+	 * of an input. Further in than that, the weight is 1.
+	 */
+	int ramp_size;
+	double *ramp;
+
+	/* Spatial index. The output is cut into a grid of cells, and
+	 * cell_start[i] .. cell_start[i + 1] - 1 in cell_inputs are the
+	 * inputs which touch cell i, in input order.
+	 */
+	int cell_width;
+	int cell_height;
+	int cells_across;
+	int cells_down;
+	int *cell_start;
+	int *cell_inputs;
+
+	/* Inputs sorted by bottom edge. In sequential mode, we minimise the
+	 * first n_minimised of these once the output has moved well past them.
+	 */
+	int *by_bottom;
+	GMutex lock;
+	int n_minimised;
+
+} VipsMergen;
+
+typedef VipsOperationClass VipsMergenClass;
+
+G_DEFINE_TYPE(VipsMergen, vips_mergen, VIPS_TYPE_OPERATION);
+
+/* Per-thread state.
+ */
+typedef struct _VipsMergenSequence {
+	VipsMergen *mergen;
+
+	/* Inputs which touch the current request, and the part of each we
+	 * use.
+	 */
+	int *hits;
+	VipsRect *clip;
+	VipsRegion **ir;
+
+	/* Generation counter to find each input once, even if it's in
+	 * several cells.
+	 */
+	int *seen;
+	int generation;
+
+	/* A line of weighted sums, and the sum of weights for each pixel.
+	 */
+	int width;
+	double *sum;
+	double *weight;
+} VipsMergenSequence;
+
+static void
+vips_mergen_finalize(GObject *gobject)
+{
+	VipsMergen *mergen = (VipsMergen *) gobject;
+
+	g_mutex_clear(&mergen->lock);
+
+	G_OBJECT_CLASS(vips_mergen_parent_class)->finalize(gobject);
+}
+
+static int
+vips_mergen_stop(void *vseq, void *a, void *b)
+{
+	VipsMergenSequence *seq = (VipsMergenSequence *) vseq;
+
+	VIPS_FREE(seq->hits);
+	VIPS_FREE(seq->clip);
+	VIPS_FREE(seq->ir);
+	VIPS_FREE(seq->seen);
+	VIPS_FREE(seq->sum);
+	VIPS_FREE(seq->weight);
+	VIPS_FREE(seq);
+
+	return 0;
+}
+
+static void *
+vips_mergen_start(VipsImage *out, void *a, void *b)
+{
+	VipsMergen *mergen = (VipsMergen *) b;
+
+	VipsMergenSequence *seq;
+
+	if (!(seq = VIPS_NEW(NULL, VipsMergenSequence)))
+		return NULL;
+
+	seq->mergen = mergen;
+	seq->hits = VIPS_ARRAY(NULL, mergen->n, int);
+	seq->clip = VIPS_ARRAY(NULL, mergen->n, VipsRect);
+	seq->ir = VIPS_ARRAY(NULL, mergen->n, VipsRegion *);
+	seq->seen = VIPS_ARRAY(NULL, mergen->n, int);
+	seq->generation = 0;
+	seq->width = 0;
+	seq->sum = NULL;
+	seq->weight = NULL;
+	if (!seq->hits ||
+		!seq->clip ||
+		!seq->ir ||
+		!seq->seen) {
+		vips_mergen_stop(seq, NULL, NULL);
+		return NULL;
+	}
+	memset(seq->ir, 0, mergen->n * sizeof(VipsRegion *));
+	memset(seq->seen, 0, mergen->n * sizeof(int));
+
+	return seq;
+}
+
+static int
+vips_mergen_compare_int(const void *a, const void *b)
+{
+	return *((int *) a) - *((int *) b);
+}
+
+/* Find the inputs which touch @r, in input order.
+ */
+static int
+vips_mergen_find(VipsMergenSequence *seq, VipsRect *r)
+{
+	VipsMergen *mergen = seq->mergen;
+	int left = r->left / mergen->cell_width;
+	int top = r->top / mergen->cell_height;
+	int right = (VIPS_RECT_RIGHT(r) - 1) / mergen->cell_width;
+	int bottom = (VIPS_RECT_BOTTOM(r) - 1) / mergen->cell_height;
+
+	int n_hits;
+	int x, y, j;
+
+	seq->generation += 1;
+	n_hits = 0;
+	for (y = top; y <= bottom; y++)
+		for (x = left; x <= right; x++) {
+			int cell = x + y * mergen->cells_across;
+
+			for (j = mergen->cell_start[cell];
+				 j < mergen->cell_start[cell + 1]; j++) {
+				int i = mergen->cell_inputs[j];
+
+				if (seq->seen[i] != seq->generation) {
+					seq->seen[i] = seq->generation;
+					if (vips_rect_overlapsrect(r, &mergen->area[i]))
+						seq->hits[n_hits++] = i;
+				}
+			}
+		}
+
+	/* Cells are in input order, but a request over several cells can
+	 * pick inputs up out of order. Later inputs are on top, so sort.
+	 */
+	if (left != right ||
+		top != bottom)
+		qsort(seq->hits, n_hits, sizeof(int), vips_mergen_compare_int);
+
+	for (j = 0; j < n_hits; j++)
+		vips_rect_intersectrect(r,
+			&mergen->area[seq->hits[j]], &seq->clip[j]);
+
+	return n_hits;
+}
+
+/* Sum one line of one input into the accumulators.
+ */
+#define ACCUMULATE(TYPE) \
+	{ \
+		TYPE *restrict p = (TYPE *) VIPS_REGION_ADDR(ir, \
+			clip->left - area->left, y - area->top); \
+		double *restrict s = seq->sum + (clip->left - r->left) * bands; \
+		double *restrict w = seq->weight + (clip->left - r->left); \
+\
+		for (x = 0; x < clip->width; x++) { \
+			int d; \
+			double f; \
+\
+			for (b = 0; b < bands; b++) \
+				if (p[b]) \
+					break; \
+			if (b < bands) { \
+				d = VIPS_MIN(dy, \
+					VIPS_MIN(ex - x, x + sx)); \
+				f = mergen->ramp[VIPS_MIN(d, ramp_size)]; \
+\
+				if (mergen->mblend == 0) { \
+					for (b = 0; b < bands; b++) \
+						s[b] = p[b]; \
+					w[x] = 1.0; \
+				} \
+				else { \
+					for (b = 0; b < bands; b++) \
+						s[b] += f * p[b]; \
+					w[x] += f; \
+				} \
+			} \
+\
+			p += bands; \
+			s += bands; \
+		} \
+	}
+
+/* Divide through by the total weight.
+ */
+#define NORMALISE_INT(TYPE) \
+	{ \
+		TYPE *restrict q = (TYPE *) \
+			VIPS_REGION_ADDR(out_region, r->left, y); \
+\
+		for (x = 0; x < r->width; x++) { \
+			if (seq->weight[x] > 0) { \
+				double rw = 1.0 / seq->weight[x]; \
+\
+				for (b = 0; b < bands; b++) \
+					q[b] = rint(s[b] * rw); \
+			} \
+			else \
+				for (b = 0; b < bands; b++) \
+					q[b] = 0; \
+\
+			q += bands; \
+			s += bands; \
+		} \
+	}
+
+#define NORMALISE_FLOAT(TYPE) \
+	{ \
+		TYPE *restrict q = (TYPE *) \
+			VIPS_REGION_ADDR(out_region, r->left, y); \
+\
+		for (x = 0; x < r->width; x++) { \
+			if (seq->weight[x] > 0) { \
+				double rw = 1.0 / seq->weight[x]; \
+\
+				for (b = 0; b < bands; b++) \
+					q[b] = s[b] * rw; \
+			} \
+			else \
+				for (b = 0; b < bands; b++) \
+					q[b] = 0; \
+\
+			q += bands; \
+			s += bands; \
+		} \
+	}
+
+static void
+vips_mergen_accumulate(VipsMergenSequence *seq, VipsRegion *ir,
+	VipsRect *area, VipsRect *clip, VipsRect *r, int y)
+{
+	VipsMergen *mergen = seq->mergen;
+	VipsImage *im = ir->im;
+	int bands = im->Bands;
+	int ramp_size = mergen->ramp_size;
+
+	/* Distance to the top or bottom edge, and offsets to find the
+	 * distance to the left and right edges from x.
+	 */
+	int dy = VIPS_MIN(y - area->top, VIPS_RECT_BOTTOM(area) - 1 - y);
+	int sx = clip->left - area->left;
+	int ex = VIPS_RECT_RIGHT(area) - 1 - clip->left;
+
+	int x, b;
+
+	switch (im->BandFmt) {
+	case VIPS_FORMAT_UCHAR:
+		ACCUMULATE(unsigned char);
+		break;
+
+	case VIPS_FORMAT_CHAR:
+		ACCUMULATE(signed char);
+		break;
+
+	case VIPS_FORMAT_USHORT:
+		ACCUMULATE(unsigned short);
+		break;
+
+	case VIPS_FORMAT_SHORT:
+		ACCUMULATE(signed short);
+		break;
+
+	case VIPS_FORMAT_UINT:
+		ACCUMULATE(unsigned int);
+		break;
+
+	case VIPS_FORMAT_INT:
+		ACCUMULATE(signed int);
+		break;
+
+	case VIPS_FORMAT_FLOAT:
+		ACCUMULATE(float);
+		break;
+
+	case VIPS_FORMAT_DOUBLE:
+		ACCUMULATE(double);
+		break;
+
+	default:
+		g_assert_not_reached();
+	}
+}
+
+static void
+vips_mergen_normalise(VipsMergenSequence *seq, VipsRegion *out_region,
+	VipsRect *r, int y)
+{
+	VipsImage *im = out_region->im;
+	int bands = im->Bands;
+	double *restrict s = seq->sum;
+
+	int x, b;
+
+	switch (im->BandFmt) {
+	case VIPS_FORMAT_UCHAR:
+		NORMALISE_INT(unsigned char);
+		break;
+
+	case VIPS_FORMAT_CHAR:
+		NORMALISE_INT(signed char);
+		break;
+
+	case VIPS_FORMAT_USHORT:
+		NORMALISE_INT(unsigned short);
+		break;
+
+	case VIPS_FORMAT_SHORT:
+		NORMALISE_INT(signed short);
+		break;
+
+	case VIPS_FORMAT_UINT:
+		NORMALISE_INT(unsigned int);
+		break;
+
+	case VIPS_FORMAT_INT:
+		NORMALISE_INT(signed int);
+		break;
+
+	case VIPS_FORMAT_FLOAT:
+		NORMALISE_FLOAT(float);
+		break;
+
+	case VIPS_FORMAT_DOUBLE:
+		NORMALISE_FLOAT(double);
+		break;
+
+	default:
+		g_assert_not_reached();
+	}
+}
+
+/* Has the output moved well past the bottom of this input?
+ */
+static gboolean
+vips_mergen_input_done(VipsMergen *mergen, int i, VipsRect *r)
+{
+	return i < mergen->n &&
+		r->top > VIPS_RECT_BOTTOM(&mergen->area[mergen->by_bottom[i]]) +
+			1024;
+}
+
+static int
+vips_mergen_gen(VipsRegion *out_region,
+	void *vseq, void *a, void *b, gboolean *stop)
+{
+	VipsMergenSequence *seq = (VipsMergenSequence *) vseq;
+	VipsMergen *mergen = (VipsMergen *) b;
+	VipsRect *r = &out_region->valid;
+	int bands = out_region->im->Bands;
+
+	int n_hits;
+	int i, y;
+
+	n_hits = vips_mergen_find(seq, r);
+
+	if (n_hits == 0)
+		vips_region_black(out_region);
+	else if (n_hits == 1 &&
+		vips_rect_equalsrect(&seq->clip[0], r)) {
+		/* Only one input touches this request and it covers it
+		 * completely: every pixel has a weight of 1 or 0, so just
+		 * copy.
+		 */
+		VipsRect need;
+		VipsRegion *reg;
+
+		i = seq->hits[0];
+		need = *r;
+		need.left -= mergen->area[i].left;
+		need.top -= mergen->area[i].top;
+
+		if (!(reg = vips_region_new(mergen->ready[i])))
+			return -1;
+		if (vips_region_prepare_to(reg, out_region,
+				&need, r->left, r->top)) {
+			g_object_unref(reg);
+			return -1;
+		}
+		g_object_unref(reg);
+	}
+	else {
+		int result;
+
+		if (seq->width < r->width) {
+			VIPS_FREE(seq->sum);
+			VIPS_FREE(seq->weight);
+			if (!(seq->sum = VIPS_ARRAY(NULL,
+					  (size_t) r->width * bands, double)) ||
+				!(seq->weight = VIPS_ARRAY(NULL, r->width, double)))
+				return -1;
+			seq->width = r->width;
+		}
+
+		result = 0;
+		for (i = 0; i < n_hits; i++) {
+			VipsRect need = seq->clip[i];
+			VipsRect *area = &mergen->area[seq->hits[i]];
+
+			need.left -= area->left;
+			need.top -= area->top;
+			if (!(seq->ir[i] = vips_region_new(mergen->ready[seq->hits[i]])) ||
+				vips_region_prepare(seq->ir[i], &need)) {
+				result = -1;
+				break;
+			}
+		}
+
+		if (!result)
+			for (y = r->top; y < VIPS_RECT_BOTTOM(r); y++) {
+				memset(seq->sum, 0,
+					(size_t) r->width * bands * sizeof(double));
+				memset(seq->weight, 0, r->width * sizeof(double));
+
+				for (i = 0; i < n_hits; i++) {
+					VipsRect *clip = &seq->clip[i];
+
+					if (y >= clip->top &&
+						y < VIPS_RECT_BOTTOM(clip))
+						vips_mergen_accumulate(seq, seq->ir[i],
+							&mergen->area[seq->hits[i]], clip, r, y);
+				}
+
+				vips_mergen_normalise(seq, out_region, r, y);
+			}
+
+		for (i = 0; i < n_hits; i++)
+			VIPS_UNREF(seq->ir[i]);
+
+		if (result)
+			return -1;
+	}
+
+	/* In sequential mode, minimise each input once the output has moved
+	 * well past it, as vips_arrayjoin() does.
+	 */
+	if (vips_image_is_sequential(out_region->im) &&
+		vips_mergen_input_done(mergen,
+			g_atomic_int_get(&mergen->n_minimised), r)) {
+		g_mutex_lock(&mergen->lock);
+
+		while (vips_mergen_input_done(mergen, mergen->n_minimised, r)) {
+			vips_image_minimise_all(
+				mergen->ready[mergen->by_bottom[mergen->n_minimised]]);
+			g_atomic_int_inc(&mergen->n_minimised);
+		}
+
+		g_mutex_unlock(&mergen->lock);
+	}
+
+	return 0;
+}
+
+static int
+vips_mergen_compare_bottom(const void *a, const void *b, void *user_data)
+{
+	VipsMergen *mergen = (VipsMergen *) user_data;
+	int i = *((int *) a);
+	int j = *((int *) b);
+
+	return VIPS_RECT_BOTTOM(&mergen->area[i]) -
+		VIPS_RECT_BOTTOM(&mergen->area[j]);
+}
+
+/* The range of cells input @i touches.
+ */
+static void
+vips_mergen_cells(VipsMergen *mergen, int i,
+	int *x0, int *y0, int *x1, int *y1)
+{
+	VipsRect *area = &mergen->area[i];
+
+	*x0 = area->left / mergen->cell_width;
+	*y0 = area->top / mergen->cell_height;
+	*x1 = (VIPS_RECT_RIGHT(area) - 1) / mergen->cell_width;
+	*y1 = (VIPS_RECT_BOTTOM(area) - 1) / mergen->cell_height;
+}
+
+/* Make the spatial index. Cells are about the size of an average input,
+ * so each input touches a few cells and each request a few inputs.
+ */
+static int
+vips_mergen_build_index(VipsMergen *mergen, int width, int height)
+{
+	gint64 total_width;
+	gint64 total_height;
+	int n_cells;
+	int *count;
+	int i, x, y;
+	int x0, y0, x1, y1;
+
+	total_width = 0;
+	total_height = 0;
+	for (i = 0; i < mergen->n; i++) {
+		total_width += mergen->area[i].width;
+		total_height += mergen->area[i].height;
+	}
+	mergen->cell_width = VIPS_MAX(64, total_width / mergen->n);
+	mergen->cell_height = VIPS_MAX(64, total_height / mergen->n);
+	mergen->cells_across =
+		VIPS_ROUND_UP(width, mergen->cell_width) / mergen->cell_width;
+	mergen->cells_down =
+		VIPS_ROUND_UP(height, mergen->cell_height) / mergen->cell_height;
+	n_cells = mergen->cells_across * mergen->cells_down;
+
+	if (!(mergen->cell_start = VIPS_ARRAY(mergen, n_cells + 1, int)) ||
+		!(count = VIPS_ARRAY(NULL, n_cells, int)))
+		return -1;
+	memset(count, 0, n_cells * sizeof(int));
+
+	for (i = 0; i < mergen->n; i++) {
+		vips_mergen_cells(mergen, i, &x0, &y0, &x1, &y1);
+		for (y = y0; y <= y1; y++)
+			for (x = x0; x <= x1; x++)
+				count[x + y * mergen->cells_across] += 1;
+	}
+
+	mergen->cell_start[0] = 0;
+	for (i = 0; i < n_cells; i++)
+		mergen->cell_start[i + 1] = mergen->cell_start[i] + count[i];
+
+	if (!(mergen->cell_inputs = VIPS_ARRAY(mergen,
+			  VIPS_MAX(1, mergen->cell_start[n_cells]), int))) {
+		g_free(count);
+		return -1;
+	}
+
+	/* Fill in input order, so each cell's list is sorted.
+	 */
+	memset(count, 0, n_cells * sizeof(int));
+	for (i = 0; i < mergen->n; i++) {
+		vips_mergen_cells(mergen, i, &x0, &y0, &x1, &y1);
+		for (y = y0; y <= y1; y++)
+			for (x = x0; x <= x1; x++) {
+				int cell = x + y * mergen->cells_across;
+
+				mergen->cell_inputs[mergen->cell_start[cell] + count[cell]] = i;
+				count[cell] += 1;
+			}
+	}
+
+	g_free(count);
+
+	return 0;
+}
+
+static int
+vips_mergen_build(VipsObject *object)
+{
+	VipsObjectClass *class = VIPS_OBJECT_GET_CLASS(object);
+	VipsMergen *mergen = (VipsMergen *) object;
+
+	VipsImage **in;
+	VipsImage **decode;
+	VipsImage **format;
+	VipsImage **band;
+	VipsImage **t;
+	VipsImage *x;
+	int *xpos;
+	int *ypos;
+	int n_x;
+	int n_y;
+	gboolean labq;
+	int left, top, right, bottom;
+	int i;
+
+	g_object_set(mergen, "out", vips_image_new(), NULL);
+
+	if (VIPS_OBJECT_CLASS(vips_mergen_parent_class)->build(object))
+		return -1;
+
+	in = vips_array_image_get(mergen->in, &mergen->n);
+	xpos = vips_array_int_get(mergen->x, &n_x);
+	ypos = vips_array_int_get(mergen->y, &n_y);
+
+	/* Array length zero means error.
+	 */
+	if (mergen->n == 0)
+		return -1;
+	if (n_x != mergen->n ||
+		n_y != mergen->n) {
+		vips_error(class->nickname,
+			_("must be %d x and y coordinates"), mergen->n);
+		return -1;
+	}
+	if (mergen->mblend < -1) {
+		vips_error(class->nickname,
+			"%s", _("mblend must be -1 or >= 0"));
+		return -1;
+	}
+
+	/* Blend LABQ as float Lab, then pack again at the end.
+	 */
+	labq = FALSE;
+	decode = (VipsImage **) vips_object_local_array(object, mergen->n);
+	for (i = 0; i < mergen->n; i++) {
+		if (vips_image_pio_input(in[i]) ||
+			vips_check_coding_noneorlabq(class->nickname, in[i]))
+			return -1;
+
+		if (in[i]->Coding == VIPS_CODING_LABQ) {
+			if (vips_LabQ2Lab(in[i], &decode[i], NULL))
+				return -1;
+			labq = TRUE;
+		}
+		else {
+			decode[i] = in[i];
+			g_object_ref(decode[i]);
+		}
+
+		if (vips_check_noncomplex(class->nickname, decode[i]))
+			return -1;
+	}
+
+	format = (VipsImage **) vips_object_local_array(object, mergen->n);
+	band = (VipsImage **) vips_object_local_array(object, mergen->n);
+	if (vips__formatalike_vec(decode, format, mergen->n) ||
+		vips__bandalike_vec(class->nickname,
+			format, band, mergen->n, 1))
+		return -1;
+
+	/* Normalise positions so the output starts at (0, 0).
+	 */
+	left = xpos[0];
+	top = ypos[0];
+	right = xpos[0] + band[0]->Xsize;
+	bottom = ypos[0] + band[0]->Ysize;
+	for (i = 1; i < mergen->n; i++) {
+		left = VIPS_MIN(left, xpos[i]);
+		top = VIPS_MIN(top, ypos[i]);
+		right = VIPS_MAX(right, xpos[i] + band[i]->Xsize);
+		bottom = VIPS_MAX(bottom, ypos[i] + band[i]->Ysize);
+	}
+
+	if (!(mergen->ready = VIPS_ARRAY(object, mergen->n + 1, VipsImage *)) ||
+		!(mergen->area = VIPS_ARRAY(object, mergen->n, VipsRect)) ||
+		!(mergen->by_bottom = VIPS_ARRAY(object, mergen->n, int)))
+		return -1;
+	for (i = 0; i < mergen->n; i++) {
+		mergen->ready[i] = band[i];
+		mergen->area[i].left = xpos[i] - left;
+		mergen->area[i].top = ypos[i] - top;
+		mergen->area[i].width = band[i]->Xsize;
+		mergen->area[i].height = band[i]->Ysize;
+		mergen->by_bottom[i] = i;
+	}
+	mergen->ready[mergen->n] = NULL;
+	g_qsort_with_data(mergen->by_bottom, mergen->n, sizeof(int),
+		vips_mergen_compare_bottom, mergen);
+
+	if (vips_mergen_build_index(mergen, right - left, bottom - top))
+		return -1;
+
+	/* A raised cosine from the edge of each input to @mblend pixels in.
+	 * -1 means blend right to the middle of the largest input.
+	 */
+	if (mergen->mblend == -1) {
+		mergen->ramp_size = 1;
+		for (i = 0; i < mergen->n; i++)
+			mergen->ramp_size = VIPS_MAX(mergen->ramp_size,
+				VIPS_MIN(mergen->area[i].width,
+					mergen->area[i].height) /
+					2);
+	}
+	else
+		mergen->ramp_size = VIPS_MAX(1, mergen->mblend);
+	if (!(mergen->ramp = VIPS_ARRAY(object, mergen->ramp_size + 1, double)))
+		return -1;
+	for (i = 0; i < mergen->ramp_size; i++)
+		mergen->ramp[i] = 0.5 -
+			0.5 * cos(VIPS_PI * (i + 0.5) / mergen->ramp_size);
+	mergen->ramp[mergen->ramp_size] = 1.0;
+
+	t = (VipsImage **) vips_object_local_array(object, 2);
+	t[0] = vips_image_new();
+	if (vips_image_pipeline_array(t[0],
+			VIPS_DEMAND_STYLE_SMALLTILE, mergen->ready))
+		return -1;
+	t[0]->Xsize = right - left;
+	t[0]->Ysize = bottom - top;
+
+	if (vips_image_generate(t[0],
+			vips_mergen_start, vips_mergen_gen, vips_mergen_stop,
+			mergen->ready, mergen))
+		return -1;
+	x = t[0];
+
+	if (labq) {
+		if (vips_Lab2LabQ(x, &t[1], NULL))
+			return -1;
+		x = t[1];
+	}
+
+	if (vips_image_write(x, mergen->out))
+		return -1;
+
+	return 0;
+}
+
+static void
+vips_mergen_class_init(VipsMergenClass *class)
+{
+	GObjectClass *gobject_class = G_OBJECT_CLASS(class);
+	VipsObjectClass *object_class = (VipsObjectClass *) class;
+	VipsOperationClass *operation_class = VIPS_OPERATION_CLASS(class);
+
+	gobject_class->finalize = vips_mergen_finalize;
+	gobject_class->set_property = vips_object_set_property;
+	gobject_class->get_property = vips_object_get_property;
+
+	object_class->nickname = "mergen";
+	object_class->description = _("merge an array of images");
+	object_class->build = vips_mergen_build;
+
+	operation_class->flags = VIPS_OPERATION_SEQUENTIAL;
+
+	VIPS_ARG_BOXED(class, "in", 1,
+		_("Input"),
+		_("Array of input images"),
+		VIPS_ARGUMENT_REQUIRED_INPUT,
+		G_STRUCT_OFFSET(VipsMergen, in),
+		VIPS_TYPE_ARRAY_IMAGE);
+
+	VIPS_ARG_IMAGE(class, "out", 2,
+		_("Output"),
+		_("Output image"),
+		VIPS_ARGUMENT_REQUIRED_OUTPUT,
+		G_STRUCT_OFFSET(VipsMergen, out));
+
+	VIPS_ARG_BOXED(class, "x", 3,
+		_("x coordinates"),
+		_("Array of x coordinates of each input"),
+		VIPS_ARGUMENT_REQUIRED_INPUT,
+		G_STRUCT_OFFSET(VipsMergen, x),
+		VIPS_TYPE_ARRAY_INT);
+
+	VIPS_ARG_BOXED(class, "y", 4,
+		_("y coordinates"),
+		_("Array of y coordinates of each input"),
+		VIPS_ARGUMENT_REQUIRED_INPUT,
+		G_STRUCT_OFFSET(VipsMergen, y),
+		VIPS_TYPE_ARRAY_INT);
+
+	VIPS_ARG_INT(class, "mblend", 5,
+		_("Max blend"),
+		_("Maximum blend size"),
+		VIPS_ARGUMENT_OPTIONAL_INPUT,
+		G_STRUCT_OFFSET(VipsMergen, mblend),
+		-1, 10000, 10);
+}
+
+static void
+vips_mergen_init(VipsMergen *mergen)
+{
+	g_mutex_init(&mergen->lock);
+	mergen->mblend = 10;
+}
+
+/**
+ * vips_mergen:
+ * @in: (array length=n) (transfer none): array of input images
+ * @out: (out): output image
+ * @n: number of input images
+ * @x: (array length=n): x position of each input
+ * @y: (array length=n): y position of each input
+ * @...: `NULL`-terminated list of optional named arguments
+ *
+ * This operation joins an array of images, each placed at the position
+ * given by @x and @y, with smooth seams. The output is just large enough to
+ * hold every input.
+ *
+ * It makes the same kind of result as a tree of [method@Image.merge], but
+ * in a single pass: each output pixel is a blend of every input which
+ * covers it, with each input weighted by a raised cosine which rises from
+ * zero at its edge to one at @mblend pixels in. Set @mblend to -1 to blend
+ * all the way to the middle of each input, or to 0 for no blending, in which
+ * case later images are on top.
+ *
+ * As with [method@Image.merge], pixels with all bands equal to zero are
+ * transparent and do not contribute, inputs are cast up to a common format
+ * and number of bands, and [enum@Coding.LABQ] images are blended in float
+ * Lab. Complex images are not supported.
+ *
+ * ::: tip "Optional arguments"
+ *     * @mblend: `gint`, maximum blend size
+ *
+ * ::: seealso
+ *     [method@Image.merge], [method@Image.globalbalance],
+ *     [func@Image.arrayjoin].
+ *
+ * Returns: 0 on success, -1 on error
+ */
+int
+vips_mergen(VipsImage **in, VipsImage **out, int n,
+	const int *x, const int *y, ...)
+{
+	va_list ap;
+	VipsArrayImage *image_array;
+	VipsArrayInt *x_array;
+	VipsArrayInt *y_array;
+	int result;
+
+	image_array = vips_array_image_new(in, n);
+	x_array = vips_array_int_new(x, n);
+	y_array = vips_array_int_new(y, n);
+	va_start(ap, y);
+	result = vips_call_split("mergen", ap,
+		image_array, out, x_array, y_array);
+	va_end(ap);
+	vips_area_unref(VIPS_AREA(image_array));
+	vips_area_unref(VIPS_AREA(x_array));
+	vips_area_unref(VIPS_AREA(y_array));
+
+	return result;
+}
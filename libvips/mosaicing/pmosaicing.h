@@ -39,6 +39,10 @@
 /* TODO(kleisauke): This import is needed for vips__affinei */
 #include <vips/transform.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif /*__cplusplus*/
+
 /* Number of entries in blend table. As a power of two as well, for >>ing.
  */
 #define BLEND_SHIFT (10)
@@ -99,8 +103,22 @@ typedef struct _MergeInfo {
 	float *from1; /* VIPS_CODING_LABQ buffers */
 	float *from2;
 	float *merge;
+
+	/* Vector path buffers: blend position for each pixel, and blend
+	 * coefficients for each band element.
+	 */
+	int *inx;
+	void *c1;
+	void *c2;
+	int inx_size;
 } MergeInfo;
 
+/* Blend positions for pixels outside the blend area: these take ref or sec
+ * if it's non-zero.
+ */
+#define MERGE_REF (-1)
+#define MERGE_SEC (-2)
+
 /* Functions shared between lr and tb.
  */
 extern double *vips__coef1;
@@ -123,6 +141,25 @@ int vips__merge_gen(VipsRegion *out_region, void *seq, void *a, void *,
 	gboolean *stop);
 int vips__stop_merge(void *seq, void *, void *);
 
+gboolean vips__merge_vector_ok(VipsImage *im);
+int *vips__merge_get_inx(MergeInfo *inf, VipsImage *im, int width);
+void vips__merge_blend_vector(MergeInfo *inf, VipsImage *im,
+	VipsPel *q, VipsPel *pr, VipsPel *ps, int width);
+
+int vips__merge_find_first_hwy(const VipsPel *p, int n);
+int vips__merge_find_last_hwy(const VipsPel *p, int n);
+int vips__merge_find_first_float_hwy(const float *p, int n);
+int vips__merge_find_last_float_hwy(const float *p, int n);
+void vips__merge_blend_uchar_hwy(VipsPel *q,
+	const VipsPel *tr, const VipsPel *ts,
+	const int *c1, const int *c2, int n);
+void vips__merge_blend_ushort_hwy(unsigned short *q,
+	const unsigned short *tr, const unsigned short *ts,
+	const int *c1, const int *c2, int n);
+void vips__merge_blend_float_hwy(float *q,
+	const float *tr, const float *ts,
+	const double *c1, const double *c2, int n);
+
 int vips__lrmerge(VipsImage *ref, VipsImage *sec, VipsImage *out,
 	int dx, int dy, int mwidth);
 int vips__tbmerge(VipsImage *ref, VipsImage *sec, VipsImage *out,
@@ -199,3 +236,7 @@ int vips__find_best_contrast(VipsImage *image,
 	int xpos, int ypos, int xsize, int ysize,
 	int xarray[], int yarray[], int cont[],
 	int nbest, int hcorsize);
+
+#ifdef __cplusplus
+}
+#endif /*__cplusplus*/
@@ -73,6 +73,8 @@
  * 	- match formats and bands automatically
  * 18/6/20 kleisauke
  * 	- convert to vips8
+ * 15/10/26
+ * 	- use the Highway blend path
  */
 
 /*
@@ -545,6 +547,41 @@ tb_blend(VipsRegion *out_region, MergeInfo *inf, Overlapping *ovlap,
 		vips_region_prepare(sir, &psr))
 		return -1;
 
+#ifdef HAVE_HWY
+	if (vips__merge_vector_ok(im)) {
+		int *inx = vips__merge_get_inx(inf, im, oreg->width);
+
+		for (y = oreg->top, yr = prr.top, ys = psr.top;
+			 y < VIPS_RECT_BOTTOM(oreg); y++, yr++, ys++) {
+			VipsPel *pr = VIPS_REGION_ADDR(rir, prr.left, yr);
+			VipsPel *ps = VIPS_REGION_ADDR(sir, psr.left, ys);
+			VipsPel *q = VIPS_REGION_ADDR(out_region, oreg->left, y);
+
+			const int j = oreg->left - ovlap->overlap.left;
+			const int *first = ovlap->first + j;
+			const int *last = ovlap->last + j;
+
+			int x;
+
+			/* Above the bottom image, below the top image, or in the
+			 * blend area.
+			 */
+			for (x = 0; x < oreg->width; x++)
+				if (y < first[x])
+					inx[x] = MERGE_REF;
+				else if (y >= last[x])
+					inx[x] = MERGE_SEC;
+				else
+					inx[x] = ((y - first[x]) << BLEND_SHIFT) /
+						(last[x] - first[x]);
+
+			vips__merge_blend_vector(inf, im, q, pr, ps, oreg->width);
+		}
+
+		return 0;
+	}
+#endif /*HAVE_HWY*/
+
 	/* Loop down overlap area.
 	 */
 	for (y = oreg->top, yr = prr.top, ys = psr.top;
@@ -90,6 +90,9 @@
  * 	- premultiply alpha
  * 18/5/20
  * 	- add "premultiplied" flag
+ * 14/10/26
+ * 	- interpolate runs of pixels with interpolate_span
+ * 	- add a separable path for scale, translate and horizontal shear
  */
 
 /*
@@ -176,6 +179,11 @@ typedef struct _VipsAffine {
 	 */
 	gboolean premultiplied;
 
+	/* Set if we can use vips_affine_gen_separable(), with this kernel.
+	 */
+	gboolean separable;
+	VipsKernel kernel;
+
 } VipsAffine;
 
 typedef VipsResampleClass VipsAffineClass;
@@ -223,44 +231,22 @@ vips_affine_dispose(GObject *gobject)
  * output image, and that affinei_gen() is asked for.
  */
 
+/* Prepare the input pixels we need to make an area of output. If there are
+ * none, paint the background and set @empty.
+ */
 static int
-vips_affine_gen(VipsRegion *out_region,
-	void *seq, void *a, void *b, gboolean *stop)
+vips_affine_prepare(VipsRegion *out_region, VipsRegion *ir,
+	const VipsAffine *affine, gboolean *empty)
 {
-	VipsRegion *ir = (VipsRegion *) seq;
-	const VipsAffine *affine = (VipsAffine *) b;
-	const VipsImage *in = (VipsImage *) a;
+	const VipsImage *in = ir->im;
 	VipsInterpolate *interpolate = affine->affine_interpolate;
 	const int window_size = vips_interpolate_get_window_size(interpolate);
 	const int window_offset = vips_interpolate_get_window_offset(interpolate);
-	const VipsInterpolateMethod interpolate_method =
-		vips_interpolate_get_method(interpolate);
-
-	/* Area we generate in the output image.
-	 */
 	const VipsRect *r = &out_region->valid;
-	const int le = r->left;
-	const int ri = VIPS_RECT_RIGHT(r);
-	const int to = r->top;
-	const int bo = VIPS_RECT_BOTTOM(r);
-
-	const VipsRect *iarea = &affine->trn.iarea;
 	const VipsRect *oarea = &affine->trn.oarea;
 
-	int ps = VIPS_IMAGE_SIZEOF_PEL(in);
-	int x, y, z;
-
 	VipsRect image, want, need, clipped;
 
-#ifdef DEBUG_VERBOSE
-	printf("vips_affine_gen: "
-		   "generating left=%d, top=%d, width=%d, height=%d\n",
-		r->left,
-		r->top,
-		r->width,
-		r->height);
-#endif /*DEBUG_VERBOSE*/
-
 	/* We are generating this chunk of the transformed image. This takes
 	 * us to space 4.
 	 */
@@ -303,20 +289,74 @@ vips_affine_gen(VipsRegion *out_region,
 	vips_rect_intersectrect(&need, &image, &clipped);
 
 #ifdef DEBUG_VERBOSE
-	printf("vips_affine_gen: preparing left=%d, top=%d, width=%d, height=%d\n",
+	printf("vips_affine_prepare: preparing left=%d, top=%d, width=%d, height=%d\n",
 		clipped.left,
 		clipped.top,
 		clipped.width,
 		clipped.height);
 #endif /*DEBUG_VERBOSE*/
 
-	if (vips_rect_isempty(&clipped)) {
+	*empty = vips_rect_isempty(&clipped);
+	if (*empty) {
 		vips_region_paint_pel(out_region, r, affine->ink);
 		return 0;
 	}
 	if (vips_region_prepare(ir, &clipped))
 		return -1;
 
+	return 0;
+}
+
+static int
+vips_affine_gen(VipsRegion *out_region,
+	void *seq, void *a, void *b, gboolean *stop)
+{
+	VipsRegion *ir = (VipsRegion *) seq;
+	const VipsAffine *affine = (VipsAffine *) b;
+	const VipsImage *in = (VipsImage *) a;
+	VipsInterpolate *interpolate = affine->affine_interpolate;
+	const int window_size = vips_interpolate_get_window_size(interpolate);
+	const int window_offset = vips_interpolate_get_window_offset(interpolate);
+	const VipsInterpolateSpanMethod interpolate_span =
+		vips_interpolate_get_span_method(interpolate);
+
+	/* Area we generate in the output image.
+	 */
+	const VipsRect *r = &out_region->valid;
+	const int le = r->left;
+	const int ri = VIPS_RECT_RIGHT(r);
+	const int to = r->top;
+	const int bo = VIPS_RECT_BOTTOM(r);
+
+	const VipsRect *iarea = &affine->trn.iarea;
+	const VipsRect *oarea = &affine->trn.oarea;
+
+	int ps = VIPS_IMAGE_SIZEOF_PEL(in);
+	int x, y, z;
+	gboolean empty;
+
+	/* Runs of in-range pixels are collected here and interpolated in one
+	 * call.
+	 */
+	double span_x[VIPS_SPAN_SIZE];
+	double span_y[VIPS_SPAN_SIZE];
+	VipsPel *span_q;
+	int n_span;
+
+#ifdef DEBUG_VERBOSE
+	printf("vips_affine_gen: "
+		   "generating left=%d, top=%d, width=%d, height=%d\n",
+		r->left,
+		r->top,
+		r->width,
+		r->height);
+#endif /*DEBUG_VERBOSE*/
+
+	if (vips_affine_prepare(out_region, ir, affine, &empty))
+		return -1;
+	if (empty)
+		return 0;
+
 	VIPS_GATE_START("vips_affine_gen: work");
 
 	/* Resample! x/y loop over pixels in the output image (5).
@@ -362,6 +402,8 @@ vips_affine_gen(VipsRegion *out_region,
 		iy += window_offset;
 
 		q = VIPS_REGION_ADDR(out_region, le, y);
+		span_q = q;
+		n_span = 0;
 
 		for (x = le; x < ri; x++) {
 			int fx, fy;
@@ -387,9 +429,25 @@ vips_affine_gen(VipsRegion *out_region,
 					(int) iy - window_offset +
 						window_size - 1));
 
-				interpolate_method(interpolate, q, ir, ix, iy);
+				if (n_span == 0)
+					span_q = q;
+				span_x[n_span] = ix;
+				span_y[n_span] = iy;
+				n_span += 1;
+
+				if (n_span == VIPS_SPAN_SIZE) {
+					interpolate_span(interpolate,
+						span_q, ir, span_x, span_y, n_span);
+					n_span = 0;
+				}
 			}
 			else {
+				if (n_span > 0) {
+					interpolate_span(interpolate,
+						span_q, ir, span_x, span_y, n_span);
+					n_span = 0;
+				}
+
 				/* Out of range: paint the background.
 				 */
 				for (z = 0; z < ps; z++)
@@ -400,6 +458,10 @@ vips_affine_gen(VipsRegion *out_region,
 			iy += ddy;
 			q += ps;
 		}
+
+		if (n_span > 0)
+			interpolate_span(interpolate,
+				span_q, ir, span_x, span_y, n_span);
 	}
 
 	VIPS_GATE_STOP("vips_affine_gen: work");
@@ -409,6 +471,296 @@ vips_affine_gen(VipsRegion *out_region,
 	return 0;
 }
 
+/* Our sequence value for the separable path.
+ */
+typedef struct {
+	VipsRegion *ir;
+
+	/* One line of the vertical pass, as double.
+	 */
+	double *line;
+} VipsAffineSequence;
+
+static int
+vips_affine_stop(void *vseq, void *a, void *b)
+{
+	VipsAffineSequence *seq = (VipsAffineSequence *) vseq;
+
+	VIPS_UNREF(seq->ir);
+	VIPS_FREE(seq->line);
+	VIPS_FREE(seq);
+
+	return 0;
+}
+
+static void *
+vips_affine_start(VipsImage *out, void *a, void *b)
+{
+	VipsImage *in = (VipsImage *) a;
+	const int n_elements = VIPS_IMAGE_N_ELEMENTS(in) *
+		(vips_band_format_iscomplex(in->BandFmt) ? 2 : 1);
+
+	VipsAffineSequence *seq;
+
+	if (!(seq = VIPS_NEW(NULL, VipsAffineSequence)))
+		return NULL;
+
+	seq->ir = NULL;
+	seq->line = NULL;
+
+	if (!(seq->ir = vips_region_new(in)) ||
+		!(seq->line = VIPS_ARRAY(NULL, n_elements, double))) {
+		vips_affine_stop(seq, in, b);
+		return NULL;
+	}
+
+	return seq;
+}
+
+/* The 1D coefficients for interpolating at x, sampled exactly as the
+ * bilinear and bicubic interpolators do.
+ */
+static void
+vips_affine_coefficients(VipsKernel kernel, double x, double *c)
+{
+	if (kernel == VIPS_KERNEL_LINEAR) {
+		const double t = x - (int) x;
+
+		c[0] = 1.0 - t;
+		c[1] = t;
+	}
+	else {
+		/* Bicubic snaps positions to 1 / VIPS_TRANSFORM_SCALE, see
+		 * vips_interpolate_bicubic_interpolate().
+		 */
+		const int sx = x * VIPS_TRANSFORM_SCALE * 2;
+		const int six = sx & (VIPS_TRANSFORM_SCALE * 2 - 1);
+		const double t = (double) ((six + 1) >> 1) / VIPS_TRANSFORM_SCALE;
+
+		/* Catmull-Rom.
+		 */
+		c[0] = t * (-0.5 + t * (1.0 - 0.5 * t));
+		c[1] = 1.0 + t * t * (-2.5 + 1.5 * t);
+		c[2] = t * (0.5 + t * (2.0 - 1.5 * t));
+		c[3] = t * t * (-0.5 + 0.5 * t);
+	}
+}
+
+/* Vertical pass: interpolate input line iy0 onwards into line[], for all
+ * the columns we have.
+ */
+#define VERT(TYPE) \
+	{ \
+		const TYPE *restrict p = \
+			(TYPE *) VIPS_REGION_ADDR(ir, ir->valid.left, iy0); \
+		const int l1 = VIPS_REGION_LSKIP(ir) / sizeof(TYPE); \
+\
+		for (i = 0; i < ne; i++) \
+			line[i] = cy[0] * p[i]; \
+\
+		for (k = 1; k < window_size; k++) { \
+			const TYPE *restrict pk = p + k * l1; \
+			const double c = cy[k]; \
+\
+			for (i = 0; i < ne; i++) \
+				line[i] += c * pk[i]; \
+		} \
+	}
+
+/* Horizontal pass: interpolate each output pixel from line[]. RESULT
+ * converts the double "sum" to TYPE.
+ */
+#define HORIZ(TYPE, RESULT) \
+	{ \
+		TYPE *restrict tq = (TYPE *) q; \
+\
+		for (x = le; x < ri; x++) { \
+			const int fx = floor(ix); \
+\
+			if (fx >= ile && \
+				fx <= iri) { \
+				const double *restrict l = line + \
+					((int) ix - window_offset - ir->valid.left) * nb; \
+\
+				g_assert(VIPS_REGION_ADDR(ir, \
+					(int) ix - window_offset + window_size - 1, iy0)); \
+\
+				vips_affine_coefficients(affine->kernel, ix, cx); \
+\
+				for (z = 0; z < nb; z++) { \
+					double sum; \
+\
+					sum = cx[0] * l[z]; \
+					for (k = 1; k < window_size; k++) \
+						sum += cx[k] * l[k * nb + z]; \
+\
+					tq[z] = RESULT; \
+				} \
+			} \
+			else { \
+				VipsPel *restrict pq = (VipsPel *) tq; \
+\
+				for (z = 0; z < ps; z++) \
+					pq[z] = affine->ink[z]; \
+			} \
+\
+			ix += ddx; \
+			tq += nb; \
+		} \
+	}
+
+#define UNSIGNED(MAX) VIPS_CLIP(0, sum + 0.5, (MAX))
+#define SIGNED(MIN, MAX) VIPS_CLIP((MIN), rint(sum), (MAX))
+
+/* For transforms where input y does not depend on output x, ie. trn.ic == 0,
+ * we can do the vertical part of the interpolation once for each output
+ * line, then just the horizontal part for each pixel. This covers scale,
+ * translate and horizontal shear.
+ */
+static int
+vips_affine_gen_separable(VipsRegion *out_region,
+	void *vseq, void *a, void *b, gboolean *stop)
+{
+	VipsAffineSequence *seq = (VipsAffineSequence *) vseq;
+	VipsRegion *ir = seq->ir;
+	double *restrict line = seq->line;
+	const VipsAffine *affine = (VipsAffine *) b;
+	const VipsImage *in = (VipsImage *) a;
+	VipsInterpolate *interpolate = affine->affine_interpolate;
+	const int window_size = vips_interpolate_get_window_size(interpolate);
+	const int window_offset = vips_interpolate_get_window_offset(interpolate);
+
+	const VipsRect *r = &out_region->valid;
+	const int le = r->left;
+	const int ri = VIPS_RECT_RIGHT(r);
+	const int to = r->top;
+	const int bo = VIPS_RECT_BOTTOM(r);
+
+	const VipsRect *iarea = &affine->trn.iarea;
+	const VipsRect *oarea = &affine->trn.oarea;
+
+	/* Same clipping rectangle as vips_affine_gen().
+	 */
+	const int ile = iarea->left + window_offset;
+	const int ito = iarea->top + window_offset;
+	const int iri = ile + iarea->width;
+	const int ibo = ito + iarea->height;
+
+	const double ddx = affine->trn.ia;
+
+	const int ps = VIPS_IMAGE_SIZEOF_PEL(in);
+	const int nb = in->Bands *
+		(vips_band_format_iscomplex(in->BandFmt) ? 2 : 1);
+
+	double cx[4];
+	double cy[4];
+	int x, y, z, i, k;
+	gboolean empty;
+
+	g_assert(affine->trn.ic == 0.0);
+	g_assert(window_size <= 4);
+
+	if (vips_affine_prepare(out_region, ir, affine, &empty))
+		return -1;
+	if (empty)
+		return 0;
+
+	VIPS_GATE_START("vips_affine_gen_separable: work");
+
+	for (y = to; y < bo; y++) {
+		const double ox = le + oarea->left - affine->trn.odx;
+		const double oy = y + oarea->top - affine->trn.ody;
+		const int ne = ir->valid.width * nb;
+
+		VipsPel *q = VIPS_REGION_ADDR(out_region, le, y);
+
+		double ix, iy;
+		int fy, iy0;
+
+		/* To space 2, see vips_affine_gen().
+		 */
+		ix = affine->trn.ia * ox + affine->trn.ib * oy -
+			affine->trn.idx + window_offset;
+		iy = affine->trn.id * oy -
+			affine->trn.idy + window_offset;
+
+		fy = floor(iy);
+		iy0 = (int) iy - window_offset;
+
+		/* If the line is out of range, or we don't have the stencil
+		 * (which means no pixel in this line can be in range), it's
+		 * all background.
+		 */
+		if (fy < ito ||
+			fy > ibo ||
+			iy0 < ir->valid.top ||
+			iy0 + window_size > VIPS_RECT_BOTTOM(&ir->valid)) {
+			for (x = 0; x < r->width; x++) {
+				for (z = 0; z < ps; z++)
+					q[z] = affine->ink[z];
+				q += ps;
+			}
+
+			continue;
+		}
+
+		vips_affine_coefficients(affine->kernel, iy, cy);
+
+		switch (in->BandFmt) {
+		case VIPS_FORMAT_UCHAR:
+			VERT(unsigned char);
+			HORIZ(unsigned char, UNSIGNED(UCHAR_MAX));
+			break;
+
+		case VIPS_FORMAT_CHAR:
+			VERT(signed char);
+			HORIZ(signed char, SIGNED(SCHAR_MIN, SCHAR_MAX));
+			break;
+
+		case VIPS_FORMAT_USHORT:
+			VERT(unsigned short);
+			HORIZ(unsigned short, UNSIGNED(USHRT_MAX));
+			break;
+
+		case VIPS_FORMAT_SHORT:
+			VERT(signed short);
+			HORIZ(signed short, SIGNED(SHRT_MIN, SHRT_MAX));
+			break;
+
+		case VIPS_FORMAT_UINT:
+			VERT(unsigned int);
+			HORIZ(unsigned int, UNSIGNED(UINT_MAX));
+			break;
+
+		case VIPS_FORMAT_INT:
+			VERT(signed int);
+			HORIZ(signed int, SIGNED(INT_MIN, INT_MAX));
+			break;
+
+		case VIPS_FORMAT_FLOAT:
+		case VIPS_FORMAT_COMPLEX:
+			VERT(float);
+			HORIZ(float, sum);
+			break;
+
+		case VIPS_FORMAT_DOUBLE:
+		case VIPS_FORMAT_DPCOMPLEX:
+			VERT(double);
+			HORIZ(double, sum);
+			break;
+
+		default:
+			g_assert_not_reached();
+		}
+	}
+
+	VIPS_GATE_STOP("vips_affine_gen_separable: work");
+
+	VIPS_COUNT_PIXELS(out_region, "vips_affine_gen_separable");
+
+	return 0;
+}
+
 static int
 vips_affine_build(VipsObject *object)
 {
@@ -419,6 +771,10 @@ vips_affine_build(VipsObject *object)
 
 	VipsImage *in;
 	VipsDemandStyle hint;
+	VipsStartFn start_fn;
+	VipsGenerateFn generate_fn;
+	VipsStopFn stop_fn;
+	const char *nickname;
 	int window_size;
 	int window_offset;
 	int edge;
@@ -597,10 +953,41 @@ vips_affine_build(VipsObject *object)
 		t[4]->Xsize, t[4]->Ysize);
 #endif /*DEBUG*/
 
+	/* If input y only depends on output y, bilinear and bicubic can be
+	 * done as a vertical pass for each output line, then a horizontal
+	 * pass for each pixel. This needs fewer taps than the 2D window
+	 * unless we are shrinking a lot horizontally.
+	 */
+	nickname = VIPS_OBJECT_GET_CLASS(affine->affine_interpolate)->nickname;
+	affine->separable = FALSE;
+	if (affine->trn.ic == 0.0 &&
+		fabs(affine->trn.ia) < window_size - 1) {
+		if (strcmp(nickname, "bilinear") == 0) {
+			affine->separable = TRUE;
+			affine->kernel = VIPS_KERNEL_LINEAR;
+		}
+		else if (strcmp(nickname, "bicubic") == 0) {
+			affine->separable = TRUE;
+			affine->kernel = VIPS_KERNEL_CUBIC;
+		}
+	}
+
+	if (affine->separable) {
+		g_info("affine: using separable path");
+		start_fn = vips_affine_start;
+		generate_fn = vips_affine_gen_separable;
+		stop_fn = vips_affine_stop;
+	}
+	else {
+		start_fn = vips_start_one;
+		generate_fn = vips_affine_gen;
+		stop_fn = vips_stop_one;
+	}
+
 	/* Generate!
 	 */
 	if (vips_image_generate(t[4],
-			vips_start_one, vips_affine_gen, vips_stop_one,
+			start_fn, generate_fn, stop_fn,
 			in, affine))
 		return -1;
 
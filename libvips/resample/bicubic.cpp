@@ -4,6 +4,8 @@
  * 	- revise window_size / window_offset stuff again
  * 7/2/16
  * 	- double intermediate for 32-bit int types
+ * 14/10/26
+ * 	- add interpolate_span, with a vector path for uchar, ushort and float
  */
 
 /*
@@ -50,8 +52,10 @@
 #include <cstdlib>
 
 #include <vips/vips.h>
+#include <vips/vector.h>
 #include <vips/internal.h>
 
+#include "presample.h"
 #include "templates.h"
 
 #define VIPS_TYPE_INTERPOLATE_BICUBIC \
@@ -86,6 +90,25 @@ typedef VipsInterpolateClass VipsInterpolateBicubicClass;
 static int vips_bicubic_matrixi[VIPS_TRANSFORM_SCALE + 1][4];
 static double vips_bicubic_matrixf[VIPS_TRANSFORM_SCALE + 1][4];
 
+/* Pick the table for a tx or ty.
+ */
+template <typename T>
+static inline const T *bicubic_matrix(int t);
+
+template <>
+inline const int *
+bicubic_matrix<int>(int t)
+{
+	return vips_bicubic_matrixi[t];
+}
+
+template <>
+inline const double *
+bicubic_matrix<double>(int t)
+{
+	return vips_bicubic_matrixf[t];
+}
+
 /* We need C linkage for this.
  */
 extern "C" {
@@ -618,6 +641,147 @@ vips_interpolate_bicubic_interpolate(VipsInterpolate *interpolate,
 	}
 }
 
+/* Run a pixel function over a span. This hoists the format switch out of
+ * the pixel loop, see vips_interpolate_bicubic_interpolate().
+ */
+template <typename T, void (*bicubic)(void *pout, const VipsPel *pin,
+	const int bands, const int lskip, const T *cx, const T *cy)>
+static void
+bicubic_tab_span(void *pout, VipsRegion *in, int bands,
+	const double *xs, const double *ys, int i, int n)
+{
+	const int ps = VIPS_IMAGE_SIZEOF_PEL(in->im);
+	const int lskip = VIPS_REGION_LSKIP(in);
+
+	VipsPel *restrict q = (VipsPel *) pout + i * ps;
+
+	for (; i < n; i++) {
+		const double x = xs[i];
+		const double y = ys[i];
+
+		const int sx = x * VIPS_TRANSFORM_SCALE * 2;
+		const int sy = y * VIPS_TRANSFORM_SCALE * 2;
+
+		const int six = sx & (VIPS_TRANSFORM_SCALE * 2 - 1);
+		const int siy = sy & (VIPS_TRANSFORM_SCALE * 2 - 1);
+
+		const int tx = (six + 1) >> 1;
+		const int ty = (siy + 1) >> 1;
+
+		const int ix = (int) x;
+		const int iy = (int) y;
+
+		const VipsPel *p = VIPS_REGION_ADDR(in, ix - 1, iy - 1);
+
+		bicubic(q, p, bands, lskip,
+			bicubic_matrix<T>(tx), bicubic_matrix<T>(ty));
+
+		q += ps;
+	}
+}
+
+static void
+vips_interpolate_bicubic_interpolate_span(VipsInterpolate *interpolate,
+	void *out, VipsRegion *in, const double *x, const double *y, int n)
+{
+	const int ps = VIPS_IMAGE_SIZEOF_PEL(in->im);
+	const int bands = in->im->Bands;
+
+	int i;
+
+	i = 0;
+
+#ifdef HAVE_HWY
+	if (vips_vector_isenabled()) {
+		const VipsRect *valid = &in->valid;
+		const VipsPel *p = VIPS_REGION_ADDR(in, valid->left, valid->top);
+		const int lskip = VIPS_REGION_LSKIP(in);
+
+		switch (in->im->BandFmt) {
+		case VIPS_FORMAT_UCHAR:
+			i = vips_interpolate_bicubic_uchar_hwy(out, p,
+				valid->left, valid->top, lskip, bands, x, y, n,
+				&vips_bicubic_matrixi[0][0]);
+			break;
+
+		case VIPS_FORMAT_USHORT:
+			i = vips_interpolate_bicubic_ushort_hwy(out, p,
+				valid->left, valid->top, lskip, bands, x, y, n,
+				&vips_bicubic_matrixf[0][0]);
+			break;
+
+		case VIPS_FORMAT_FLOAT:
+			i = vips_interpolate_bicubic_float_hwy(out, p,
+				valid->left, valid->top, lskip, bands, x, y, n,
+				&vips_bicubic_matrixf[0][0]);
+			break;
+
+		default:
+			break;
+		}
+	}
+#endif /*HAVE_HWY*/
+
+	/* Any pixels the vector path did not do.
+	 */
+	switch (in->im->BandFmt) {
+	case VIPS_FORMAT_UCHAR:
+		bicubic_tab_span<int,
+			bicubic_unsigned_int_tab<unsigned char, UCHAR_MAX>>(
+			out, in, bands, x, y, i, n);
+		break;
+
+	case VIPS_FORMAT_CHAR:
+		bicubic_tab_span<int,
+			bicubic_signed_int_tab<signed char, SCHAR_MIN, SCHAR_MAX>>(
+			out, in, bands, x, y, i, n);
+		break;
+
+	case VIPS_FORMAT_USHORT:
+		bicubic_tab_span<double,
+			bicubic_unsigned_int32_tab<unsigned short, USHRT_MAX>>(
+			out, in, bands, x, y, i, n);
+		break;
+
+	case VIPS_FORMAT_SHORT:
+		bicubic_tab_span<double,
+			bicubic_signed_int32_tab<signed short, SHRT_MIN, SHRT_MAX>>(
+			out, in, bands, x, y, i, n);
+		break;
+
+	case VIPS_FORMAT_UINT:
+		bicubic_tab_span<double,
+			bicubic_unsigned_int32_tab<unsigned int, INT_MAX>>(
+			out, in, bands, x, y, i, n);
+		break;
+
+	case VIPS_FORMAT_INT:
+		bicubic_tab_span<double,
+			bicubic_signed_int32_tab<signed int, INT_MIN, INT_MAX>>(
+			out, in, bands, x, y, i, n);
+		break;
+
+	case VIPS_FORMAT_FLOAT:
+		bicubic_tab_span<double, bicubic_float_tab<float>>(
+			out, in, bands, x, y, i, n);
+		break;
+
+	case VIPS_FORMAT_COMPLEX:
+		bicubic_tab_span<double, bicubic_float_tab<float>>(
+			out, in, bands * 2, x, y, i, n);
+		break;
+
+	default:
+		/* double and dpcomplex don't use tables, so just call the
+		 * pixel interpolator.
+		 */
+		for (; i < n; i++)
+			vips_interpolate_bicubic_interpolate(interpolate,
+				(VipsPel *) out + i * ps, in, x[i], y[i]);
+		break;
+	}
+}
+
 static void
 vips_interpolate_bicubic_class_init(VipsInterpolateBicubicClass *iclass)
 {
@@ -629,6 +793,8 @@ vips_interpolate_bicubic_class_init(VipsInterpolateBicubicClass *iclass)
 	object_class->description = _("bicubic interpolation (Catmull-Rom)");
 
 	interpolate_class->interpolate = vips_interpolate_bicubic_interpolate;
+	interpolate_class->interpolate_span =
+		vips_interpolate_bicubic_interpolate_span;
 	interpolate_class->window_size = 4;
 
 	/* Build the tables of pre-computed coefficients.
@@ -18,6 +18,8 @@
  * 	- faster bilinear
  * 27/2/19 s-sajid-ali
  * 	- more accurate bilinear
+ * 14/10/26
+ * 	- add interpolate_span, with a vector path for bilinear
  */
 
 /*
@@ -60,8 +62,11 @@
 #include <stdlib.h>
 
 #include <vips/vips.h>
+#include <vips/vector.h>
 #include <vips/internal.h>
 
+#include "presample.h"
+
 /**
  * VipsInterpolate:
  *
@@ -94,6 +99,23 @@ G_DEFINE_ABSTRACT_TYPE(VipsInterpolate, vips_interpolate, VIPS_TYPE_OBJECT);
  *     [struct@InterpolateClass].
  */
 
+/**
+ * VipsInterpolateSpanMethod:
+ * @interpolate: the interpolator
+ * @out: write the interpolated pixels here
+ * @in: read source pixels from here
+ * @x: (array length=n): interpolate values at these positions
+ * @y: (array length=n): interpolate values at these positions
+ * @n: number of pixels to interpolate
+ *
+ * Interpolate a run of @n pixels. Pixel i is interpolated at (@x[i], @y[i])
+ * and written to @out, one pixel after the other. All the positions must
+ * satisfy the same conditions as for [callback@InterpolateMethod].
+ *
+ * ::: seealso
+ *     [struct@InterpolateClass].
+ */
+
 /**
  * VipsInterpolateClass:
  * @interpolate: the interpolation method
@@ -101,6 +123,7 @@ G_DEFINE_ABSTRACT_TYPE(VipsInterpolate, vips_interpolate, VIPS_TYPE_OBJECT);
  * @window_size: or just set this for a constant window size
  * @get_window_offset: return the window offset for this method
  * @window_offset: or just set this for a constant window offset
+ * @interpolate_span: interpolate a run of pixels
  *
  * @window_size is the size of the window that the interpolator needs. For
  * example, a bicubic interpolator needs to see a window of 4x4 pixels to be
@@ -117,6 +140,10 @@ G_DEFINE_ABSTRACT_TYPE(VipsInterpolate, vips_interpolate, VIPS_TYPE_OBJECT);
  * offset that a specific interpolator needs, or you can leave
  * @get_window_offset `NULL` and set a constant value in @window_offset.
  *
+ * @interpolate_span defaults to calling @interpolate for each pixel.
+ * Interpolators can override it to hoist per-pixel dispatch out of the
+ * loop, or to process several pixels at once.
+ *
  * You also need to set [property@Object:nickname] and
  * [property@Object:description] in [class@Object].
  *
@@ -166,6 +193,25 @@ vips_interpolate_real_get_window_offset(VipsInterpolate *interpolate)
 	}
 }
 
+static void
+vips_interpolate_real_interpolate_span(VipsInterpolate *interpolate,
+	void *out, VipsRegion *in, const double *x, const double *y, int n)
+{
+	VipsInterpolateClass *class = VIPS_INTERPOLATE_GET_CLASS(interpolate);
+	const VipsInterpolateMethod method = class->interpolate;
+	const int ps = VIPS_IMAGE_SIZEOF_PEL(in->im);
+
+	VipsPel *restrict q = (VipsPel *) out;
+	int i;
+
+	g_assert(method);
+
+	for (i = 0; i < n; i++) {
+		method(interpolate, q, in, x[i], y[i]);
+		q += ps;
+	}
+}
+
 static void
 vips_interpolate_class_init(VipsInterpolateClass *class)
 {
@@ -187,6 +233,7 @@ vips_interpolate_class_init(VipsInterpolateClass *class)
 	class->get_window_offset = vips_interpolate_real_get_window_offset;
 	class->window_size = -1;
 	class->window_offset = -1;
+	class->interpolate_span = vips_interpolate_real_interpolate_span;
 }
 
 static void
@@ -242,6 +289,52 @@ vips_interpolate_get_method(VipsInterpolate *interpolate)
 	return class->interpolate;
 }
 
+/**
+ * vips_interpolate_span: (skip)
+ * @interpolate: interpolator to use
+ * @out: write results here
+ * @in: read source data from here
+ * @x: (array length=n): interpolate values at these positions
+ * @y: (array length=n): interpolate values at these positions
+ * @n: number of pixels to interpolate
+ *
+ * Look up the @interpolate_span method in the class and call it. This
+ * interpolates @n pixels and writes them one after the other to @out. Use
+ * [method@Interpolate.get_span_method] to get a direct pointer to the
+ * function and avoid the lookup overhead.
+ *
+ * You need to set @in and @out up correctly.
+ */
+void
+vips_interpolate_span(VipsInterpolate *interpolate,
+	void *out, VipsRegion *in, const double *x, const double *y, int n)
+{
+	VipsInterpolateClass *class = VIPS_INTERPOLATE_GET_CLASS(interpolate);
+
+	g_assert(class->interpolate_span);
+
+	class->interpolate_span(interpolate, out, in, x, y, n);
+}
+
+/**
+ * vips_interpolate_get_span_method: (skip)
+ * @interpolate: interpolator to use
+ *
+ * Look up the @interpolate_span method in the class and return it. Use this
+ * instead of [func@interpolate_span] to cache method dispatch.
+ *
+ * Returns: a pointer to the span interpolation function
+ */
+VipsInterpolateSpanMethod
+vips_interpolate_get_span_method(VipsInterpolate *interpolate)
+{
+	VipsInterpolateClass *class = VIPS_INTERPOLATE_GET_CLASS(interpolate);
+
+	g_assert(class->interpolate_span);
+
+	return class->interpolate_span;
+}
+
 /**
  * vips_interpolate_get_window_size:
  * @interpolate: interpolator to use
@@ -553,6 +646,82 @@ vips_interpolate_bilinear_interpolate(VipsInterpolate *interpolate,
 	SWITCH_INTERPOLATE(in->im->BandFmt, BILINEAR_INT, BILINEAR_FLOAT);
 }
 
+/* Run one of the pixel macros above over a span, with the format switch
+ * outside the loop.
+ */
+#define BILINEAR_SPAN(TYPE, BILINEAR) \
+	{ \
+		VipsPel *restrict q = (VipsPel *) pout + i * ps; \
+\
+		for (; i < n; i++) { \
+			const double x = xs[i]; \
+			const double y = ys[i]; \
+			const int ix = (int) x; \
+			const int iy = (int) y; \
+\
+			const VipsPel *restrict p1 = VIPS_REGION_ADDR(in, ix, iy); \
+			const VipsPel *restrict p2 = p1 + ps; \
+			const VipsPel *restrict p3 = p1 + ls; \
+			const VipsPel *restrict p4 = p3 + ps; \
+\
+			void *out = q; \
+\
+			BILINEAR(TYPE); \
+\
+			q += ps; \
+		} \
+	}
+
+#define BILINEAR_INT_SPAN(TYPE) BILINEAR_SPAN(TYPE, BILINEAR_INT)
+#define BILINEAR_FLOAT_SPAN(TYPE) BILINEAR_SPAN(TYPE, BILINEAR_FLOAT)
+
+static void
+vips_interpolate_bilinear_interpolate_span(VipsInterpolate *interpolate,
+	void *pout, VipsRegion *in, const double *xs, const double *ys, int n)
+{
+	const int ps = VIPS_IMAGE_SIZEOF_PEL(in->im);
+	const int ls = VIPS_REGION_LSKIP(in);
+	const int b = in->im->Bands *
+		(vips_band_format_iscomplex(in->im->BandFmt) ? 2 : 1);
+
+	int i;
+	int z;
+
+	i = 0;
+
+#ifdef HAVE_HWY
+	if (vips_vector_isenabled()) {
+		const VipsRect *valid = &in->valid;
+		const VipsPel *p = VIPS_REGION_ADDR(in, valid->left, valid->top);
+
+		switch (in->im->BandFmt) {
+		case VIPS_FORMAT_UCHAR:
+			i = vips_interpolate_bilinear_uchar_hwy(pout, p,
+				valid->left, valid->top, ls, b, xs, ys, n);
+			break;
+
+		case VIPS_FORMAT_USHORT:
+			i = vips_interpolate_bilinear_ushort_hwy(pout, p,
+				valid->left, valid->top, ls, b, xs, ys, n);
+			break;
+
+		case VIPS_FORMAT_FLOAT:
+			i = vips_interpolate_bilinear_float_hwy(pout, p,
+				valid->left, valid->top, ls, b, xs, ys, n);
+			break;
+
+		default:
+			break;
+		}
+	}
+#endif /*HAVE_HWY*/
+
+	/* Any pixels the vector path did not do.
+	 */
+	SWITCH_INTERPOLATE(in->im->BandFmt,
+		BILINEAR_INT_SPAN, BILINEAR_FLOAT_SPAN);
+}
+
 static void
 vips_interpolate_bilinear_class_init(VipsInterpolateBilinearClass *class)
 {
@@ -564,6 +733,8 @@ vips_interpolate_bilinear_class_init(VipsInterpolateBilinearClass *class)
 	object_class->description = _("bilinear interpolation");
 
 	interpolate_class->interpolate = vips_interpolate_bilinear_interpolate;
+	interpolate_class->interpolate_span =
+		vips_interpolate_bilinear_interpolate_span;
 	interpolate_class->window_size = 2;
 }
 
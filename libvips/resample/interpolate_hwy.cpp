@@ -0,0 +1,657 @@
+/* 14/10/26
+ * 	- initial implementation
+ */
+
+/*
+
+	This file is part of VIPS.
+
+	VIPS is free software; you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+	02110-1301  USA
+
+ */
+
+/*
+
+	These files are distributed with VIPS - http://www.vips.ecs.soton.ac.uk
+
+ */
+
+/* Span interpolators for bilinear and bicubic. Lanes are output pixels.
+ *
+ * Highway has no 8- or 16-bit gathers, and 32-bit gathers are slow on many
+ * targets, so we stage a block of pixels at a time into lane buffers with
+ * scalar loads, then do all the arithmetic on whole vectors. The
+ * arithmetic is the same as the scalar interpolators, so results are
+ * identical.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /*HAVE_CONFIG_H*/
+#include <glib/gi18n-lib.h>
+
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <cmath>
+
+#include <vips/vips.h>
+#include <vips/vector.h>
+#include <vips/debug.h>
+#include <vips/internal.h>
+
+#include "presample.h"
+
+#ifdef HAVE_HWY
+
+#undef HWY_TARGET_INCLUDE
+#define HWY_TARGET_INCLUDE "libvips/resample/interpolate_hwy.cpp"
+#include <hwy/foreach_target.h>
+#include <hwy/highway.h>
+
+namespace HWY_NAMESPACE {
+
+using namespace hwy::HWY_NAMESPACE;
+
+using DI32 = ScalableTag<int32_t>;
+using DF64 = ScalableTag<double>;
+constexpr DI32 di32;
+constexpr DF64 df64;
+constexpr Rebind<float, DF64> df32;
+
+// Compat for Highway versions < 1.3.0
+#ifndef HWY_LANES_CONSTEXPR
+#define HWY_LANES_CONSTEXPR
+#endif
+
+/* Pixels per block. Lane buffers are twice this, so a block rounded up to
+ * a whole number of vectors always fits.
+ */
+#define BLOCK (64)
+
+/* Find the fixed-point mask index, exactly as bicubic.cpp does.
+ */
+HWY_INLINE int32_t
+bicubic_index(double x)
+{
+	const int32_t sx = x * VIPS_TRANSFORM_SCALE * 2;
+	const int32_t six = sx & (VIPS_TRANSFORM_SCALE * 2 - 1);
+
+	return (six + 1) >> 1;
+}
+
+/* uchar and ushort bilinear, fixed-point, see BILINEAR_INT.
+ */
+template <typename T>
+HWY_INLINE int32_t
+bilinear_int(void *pout, const VipsPel *pin,
+	int32_t left, int32_t top, int32_t lskip, int32_t bands,
+	const double *HWY_RESTRICT xs, const double *HWY_RESTRICT ys, int32_t n)
+{
+	HWY_LANES_CONSTEXPR int32_t N = Lanes(di32);
+	if (N > BLOCK)
+		return 0;
+
+	const T *HWY_RESTRICT in = (const T *) pin;
+	T *HWY_RESTRICT out = (T *) pout;
+	const int32_t l1 = lskip / sizeof(T);
+
+	const auto scale = Set(di32, VIPS_INTERPOLATE_SCALE);
+	const auto round = Set(di32, VIPS_INTERPOLATE_SCALE >> 1);
+
+	HWY_ALIGN int32_t offset[2 * BLOCK];
+	HWY_ALIGN int32_t k[4][2 * BLOCK];
+	HWY_ALIGN int32_t pel[4][2 * BLOCK];
+	HWY_ALIGN int32_t result[2 * BLOCK];
+
+	for (int32_t i = 0; i < n; i += BLOCK) {
+		const int32_t count = VIPS_MIN(BLOCK, n - i);
+		const int32_t padded = VIPS_ROUND_UP(count, N);
+
+		int32_t j;
+
+		for (j = 0; j < count; j++) {
+			const double x = xs[i + j];
+			const double y = ys[i + j];
+			const int32_t ix = (int32_t) x;
+			const int32_t iy = (int32_t) y;
+
+			offset[j] = (iy - top) * l1 + (ix - left) * bands;
+			k[0][j] = (x - ix) * VIPS_INTERPOLATE_SCALE;
+			k[1][j] = (y - iy) * VIPS_INTERPOLATE_SCALE;
+		}
+		for (; j < padded; j++) {
+			k[0][j] = 0;
+			k[1][j] = 0;
+		}
+
+		/* k[0..3] become c1 .. c4.
+		 */
+		for (j = 0; j < padded; j += N) {
+			const auto X = LoadU(di32, k[0] + j);
+			const auto Y = LoadU(di32, k[1] + j);
+			const auto Yd = Sub(scale, Y);
+
+			const auto c4 = ShiftRight<VIPS_INTERPOLATE_SHIFT>(Mul(Y, X));
+			const auto c2 = ShiftRight<VIPS_INTERPOLATE_SHIFT>(Mul(Yd, X));
+			const auto c3 = Sub(Y, c4);
+			const auto c1 = Sub(Yd, c2);
+
+			StoreU(c1, di32, k[0] + j);
+			StoreU(c2, di32, k[1] + j);
+			StoreU(c3, di32, k[2] + j);
+			StoreU(c4, di32, k[3] + j);
+		}
+
+		for (int32_t z = 0; z < bands; z++) {
+			for (j = 0; j < count; j++) {
+				const T *HWY_RESTRICT p = in + offset[j] + z;
+
+				pel[0][j] = p[0];
+				pel[1][j] = p[bands];
+				pel[2][j] = p[l1];
+				pel[3][j] = p[l1 + bands];
+			}
+			for (; j < padded; j++)
+				pel[0][j] = pel[1][j] = pel[2][j] = pel[3][j] = 0;
+
+			for (j = 0; j < padded; j += N) {
+				auto sum = round;
+
+				for (int32_t c = 0; c < 4; c++)
+					sum = Add(sum, Mul(LoadU(di32, k[c] + j),
+									   LoadU(di32, pel[c] + j)));
+
+				StoreU(ShiftRight<VIPS_INTERPOLATE_SHIFT>(sum),
+					di32, result + j);
+			}
+
+			for (j = 0; j < count; j++)
+				out[(i + j) * bands + z] = result[j];
+		}
+	}
+
+	return n;
+}
+
+/* float bilinear in double precision, see BILINEAR_FLOAT.
+ */
+HWY_INLINE int32_t
+bilinear_float(void *pout, const VipsPel *pin,
+	int32_t left, int32_t top, int32_t lskip, int32_t bands,
+	const double *HWY_RESTRICT xs, const double *HWY_RESTRICT ys, int32_t n)
+{
+	HWY_LANES_CONSTEXPR int32_t N = Lanes(df64);
+	if (N > BLOCK)
+		return 0;
+
+	const float *HWY_RESTRICT in = (const float *) pin;
+	float *HWY_RESTRICT out = (float *) pout;
+	const int32_t l1 = lskip / sizeof(float);
+
+	const auto one = Set(df64, 1.0);
+
+	HWY_ALIGN int32_t offset[2 * BLOCK];
+	HWY_ALIGN double k[4][2 * BLOCK];
+	HWY_ALIGN double pel[4][2 * BLOCK];
+	HWY_ALIGN double result[2 * BLOCK];
+
+	for (int32_t i = 0; i < n; i += BLOCK) {
+		const int32_t count = VIPS_MIN(BLOCK, n - i);
+		const int32_t padded = VIPS_ROUND_UP(count, N);
+
+		int32_t j;
+
+		for (j = 0; j < count; j++) {
+			const double x = xs[i + j];
+			const double y = ys[i + j];
+			const int32_t ix = (int32_t) x;
+			const int32_t iy = (int32_t) y;
+
+			offset[j] = (iy - top) * l1 + (ix - left) * bands;
+			k[0][j] = x - ix;
+			k[1][j] = y - iy;
+		}
+		for (; j < padded; j++) {
+			k[0][j] = 0.0;
+			k[1][j] = 0.0;
+		}
+
+		for (j = 0; j < padded; j += N) {
+			const auto X = LoadU(df64, k[0] + j);
+			const auto Y = LoadU(df64, k[1] + j);
+			const auto Yd = Sub(one, Y);
+
+			const auto c4 = Mul(Y, X);
+			const auto c2 = Mul(Yd, X);
+			const auto c3 = Sub(Y, c4);
+			const auto c1 = Sub(Yd, c2);
+
+			StoreU(c1, df64, k[0] + j);
+			StoreU(c2, df64, k[1] + j);
+			StoreU(c3, df64, k[2] + j);
+			StoreU(c4, df64, k[3] + j);
+		}
+
+		for (int32_t z = 0; z < bands; z++) {
+			for (j = 0; j < count; j++) {
+				const float *HWY_RESTRICT p = in + offset[j] + z;
+
+				pel[0][j] = p[0];
+				pel[1][j] = p[bands];
+				pel[2][j] = p[l1];
+				pel[3][j] = p[l1 + bands];
+			}
+			for (; j < padded; j++)
+				pel[0][j] = pel[1][j] = pel[2][j] = pel[3][j] = 0.0;
+
+			/* Keep the scalar evaluation order, and no fused
+			 * multiply-add.
+			 */
+			for (j = 0; j < padded; j += N) {
+				auto sum = Mul(LoadU(df64, k[0] + j),
+					LoadU(df64, pel[0] + j));
+
+				for (int32_t c = 1; c < 4; c++)
+					sum = Add(sum, Mul(LoadU(df64, k[c] + j),
+									   LoadU(df64, pel[c] + j)));
+
+				StoreU(sum, df64, result + j);
+			}
+
+			for (j = 0; j < count; j++)
+				out[(i + j) * bands + z] = result[j];
+		}
+	}
+
+	return n;
+}
+
+/* Stage the 4x4 stencil for band z of each pixel in a block, converting to
+ * the lane type. pel[] is in row-major order.
+ */
+template <typename T, typename L>
+HWY_INLINE void
+bicubic_stage(L pel[16][2 * BLOCK], const T *HWY_RESTRICT in,
+	const int32_t *HWY_RESTRICT offset, int32_t z,
+	int32_t l1, int32_t bands, int32_t count, int32_t padded)
+{
+	int32_t j;
+
+	for (j = 0; j < count; j++) {
+		const T *HWY_RESTRICT p = in + offset[j] + z;
+
+		for (int32_t r = 0; r < 4; r++) {
+			pel[r * 4 + 0][j] = p[0];
+			pel[r * 4 + 1][j] = p[bands];
+			pel[r * 4 + 2][j] = p[2 * bands];
+			pel[r * 4 + 3][j] = p[3 * bands];
+
+			p += l1;
+		}
+	}
+	for (; j < padded; j++)
+		for (int32_t c = 0; c < 16; c++)
+			pel[c][j] = 0;
+}
+
+/* uchar bicubic, fixed-point, see bicubic_unsigned_int_tab.
+ */
+HWY_INLINE int32_t
+bicubic_uchar(void *pout, const VipsPel *pin,
+	int32_t left, int32_t top, int32_t lskip, int32_t bands,
+	const double *HWY_RESTRICT xs, const double *HWY_RESTRICT ys, int32_t n,
+	const int32_t *HWY_RESTRICT matrixi)
+{
+	HWY_LANES_CONSTEXPR int32_t N = Lanes(di32);
+	if (N > BLOCK)
+		return 0;
+
+	const uint8_t *HWY_RESTRICT in = (const uint8_t *) pin;
+	uint8_t *HWY_RESTRICT out = (uint8_t *) pout;
+	const int32_t l1 = lskip;
+
+	const auto round = Set(di32, VIPS_INTERPOLATE_SCALE >> 1);
+	const auto zero = Zero(di32);
+	const auto max_value = Set(di32, UCHAR_MAX);
+
+	HWY_ALIGN int32_t offset[2 * BLOCK];
+	HWY_ALIGN int32_t cx[4][2 * BLOCK];
+	HWY_ALIGN int32_t cy[4][2 * BLOCK];
+	HWY_ALIGN int32_t pel[16][2 * BLOCK];
+	HWY_ALIGN int32_t result[2 * BLOCK];
+
+	for (int32_t i = 0; i < n; i += BLOCK) {
+		const int32_t count = VIPS_MIN(BLOCK, n - i);
+		const int32_t padded = VIPS_ROUND_UP(count, N);
+
+		int32_t j;
+
+		for (j = 0; j < count; j++) {
+			const double x = xs[i + j];
+			const double y = ys[i + j];
+			const int32_t ix = (int32_t) x;
+			const int32_t iy = (int32_t) y;
+			const int32_t *HWY_RESTRICT mx =
+				matrixi + 4 * bicubic_index(x);
+			const int32_t *HWY_RESTRICT my =
+				matrixi + 4 * bicubic_index(y);
+
+			offset[j] = (iy - 1 - top) * l1 + (ix - 1 - left) * bands;
+			for (int32_t c = 0; c < 4; c++) {
+				cx[c][j] = mx[c];
+				cy[c][j] = my[c];
+			}
+		}
+		for (; j < padded; j++)
+			for (int32_t c = 0; c < 4; c++)
+				cx[c][j] = cy[c][j] = 0;
+
+		for (int32_t z = 0; z < bands; z++) {
+			bicubic_stage(pel, in, offset, z, l1, bands, count, padded);
+
+			for (j = 0; j < padded; j += N) {
+				auto sum = round;
+
+				for (int32_t r = 0; r < 4; r++) {
+					auto row = round;
+
+					for (int32_t c = 0; c < 4; c++)
+						row = Add(row, Mul(LoadU(di32, cx[c] + j),
+										   LoadU(di32, pel[r * 4 + c] + j)));
+
+					row = ShiftRight<VIPS_INTERPOLATE_SHIFT>(row);
+					sum = Add(sum, Mul(LoadU(di32, cy[r] + j), row));
+				}
+
+				sum = ShiftRight<VIPS_INTERPOLATE_SHIFT>(sum);
+				sum = Min(Max(sum, zero), max_value);
+
+				StoreU(sum, di32, result + j);
+			}
+
+			for (j = 0; j < count; j++)
+				out[(i + j) * bands + z] = result[j];
+		}
+	}
+
+	return n;
+}
+
+/* One row of the stencil, in double. pel points to the first of four
+ * consecutive lane buffers.
+ */
+template <bool is_float>
+HWY_INLINE Vec<DF64>
+bicubic_row(double cx[4][2 * BLOCK], double pel[][2 * BLOCK], int32_t j)
+{
+	auto row = Mul(LoadU(df64, cx[0] + j), LoadU(df64, pel[0] + j));
+
+	for (int32_t c = 1; c < 4; c++)
+		row = Add(row, Mul(LoadU(df64, cx[c] + j), LoadU(df64, pel[c] + j)));
+
+	/* cubic_float<float>() returns float, so round the row.
+	 */
+	if (is_float)
+		row = PromoteTo(df64, DemoteTo(df32, row));
+
+	return row;
+}
+
+/* ushort and float bicubic in double precision, see
+ * bicubic_unsigned_int32_tab and bicubic_float_tab. The float version
+ * rounds each row to float, since cubic_float<float>() returns float.
+ */
+template <typename T, bool is_float>
+HWY_INLINE int32_t
+bicubic_double(void *pout, const VipsPel *pin,
+	int32_t left, int32_t top, int32_t lskip, int32_t bands,
+	const double *HWY_RESTRICT xs, const double *HWY_RESTRICT ys, int32_t n,
+	const double *HWY_RESTRICT matrixf)
+{
+	HWY_LANES_CONSTEXPR int32_t N = Lanes(df64);
+	if (N > BLOCK)
+		return 0;
+
+	const T *HWY_RESTRICT in = (const T *) pin;
+	T *HWY_RESTRICT out = (T *) pout;
+	const int32_t l1 = lskip / sizeof(T);
+
+	const auto zero = Zero(df64);
+	const auto max_value = Set(df64, USHRT_MAX);
+
+	HWY_ALIGN int32_t offset[2 * BLOCK];
+	HWY_ALIGN double cx[4][2 * BLOCK];
+	HWY_ALIGN double cy[4][2 * BLOCK];
+	HWY_ALIGN double pel[16][2 * BLOCK];
+	HWY_ALIGN double result[2 * BLOCK];
+
+	for (int32_t i = 0; i < n; i += BLOCK) {
+		const int32_t count = VIPS_MIN(BLOCK, n - i);
+		const int32_t padded = VIPS_ROUND_UP(count, N);
+
+		int32_t j;
+
+		for (j = 0; j < count; j++) {
+			const double x = xs[i + j];
+			const double y = ys[i + j];
+			const int32_t ix = (int32_t) x;
+			const int32_t iy = (int32_t) y;
+			const double *HWY_RESTRICT mx =
+				matrixf + 4 * bicubic_index(x);
+			const double *HWY_RESTRICT my =
+				matrixf + 4 * bicubic_index(y);
+
+			offset[j] = (iy - 1 - top) * l1 + (ix - 1 - left) * bands;
+			for (int32_t c = 0; c < 4; c++) {
+				cx[c][j] = mx[c];
+				cy[c][j] = my[c];
+			}
+		}
+		for (; j < padded; j++)
+			for (int32_t c = 0; c < 4; c++)
+				cx[c][j] = cy[c][j] = 0.0;
+
+		for (int32_t z = 0; z < bands; z++) {
+			bicubic_stage(pel, in, offset, z, l1, bands, count, padded);
+
+			/* Keep the scalar evaluation order, and no fused
+			 * multiply-add.
+			 */
+			for (j = 0; j < padded; j += N) {
+				auto sum = Mul(LoadU(df64, cy[0] + j),
+					bicubic_row<is_float>(cx, pel[0], j));
+
+				for (int32_t r = 1; r < 4; r++)
+					sum = Add(sum, Mul(LoadU(df64, cy[r] + j),
+									   bicubic_row<is_float>(cx, pel[r * 4], j)));
+
+				if (!is_float)
+					sum = Min(Max(sum, zero), max_value);
+
+				StoreU(sum, df64, result + j);
+			}
+
+			for (j = 0; j < count; j++)
+				out[(i + j) * bands + z] = result[j];
+		}
+	}
+
+	return n;
+}
+
+HWY_ATTR int32_t
+vips_interpolate_bilinear_uchar_hwy(void *pout, const VipsPel *pin,
+	int32_t left, int32_t top, int32_t lskip, int32_t bands,
+	const double *HWY_RESTRICT x, const double *HWY_RESTRICT y, int32_t n)
+{
+#if HWY_TARGET != HWY_SCALAR
+	return bilinear_int<uint8_t>(pout, pin,
+		left, top, lskip, bands, x, y, n);
+#else
+	return 0;
+#endif
+}
+
+HWY_ATTR int32_t
+vips_interpolate_bilinear_ushort_hwy(void *pout, const VipsPel *pin,
+	int32_t left, int32_t top, int32_t lskip, int32_t bands,
+	const double *HWY_RESTRICT x, const double *HWY_RESTRICT y, int32_t n)
+{
+#if HWY_TARGET != HWY_SCALAR
+	return bilinear_int<uint16_t>(pout, pin,
+		left, top, lskip, bands, x, y, n);
+#else
+	return 0;
+#endif
+}
+
+HWY_ATTR int32_t
+vips_interpolate_bilinear_float_hwy(void *pout, const VipsPel *pin,
+	int32_t left, int32_t top, int32_t lskip, int32_t bands,
+	const double *HWY_RESTRICT x, const double *HWY_RESTRICT y, int32_t n)
+{
+#if HWY_TARGET != HWY_SCALAR
+	return bilinear_float(pout, pin,
+		left, top, lskip, bands, x, y, n);
+#else
+	return 0;
+#endif
+}
+
+HWY_ATTR int32_t
+vips_interpolate_bicubic_uchar_hwy(void *pout, const VipsPel *pin,
+	int32_t left, int32_t top, int32_t lskip, int32_t bands,
+	const double *HWY_RESTRICT x, const double *HWY_RESTRICT y, int32_t n,
+	const int32_t *HWY_RESTRICT matrixi)
+{
+#if HWY_TARGET != HWY_SCALAR
+	return bicubic_uchar(pout, pin,
+		left, top, lskip, bands, x, y, n, matrixi);
+#else
+	return 0;
+#endif
+}
+
+HWY_ATTR int32_t
+vips_interpolate_bicubic_ushort_hwy(void *pout, const VipsPel *pin,
+	int32_t left, int32_t top, int32_t lskip, int32_t bands,
+	const double *HWY_RESTRICT x, const double *HWY_RESTRICT y, int32_t n,
+	const double *HWY_RESTRICT matrixf)
+{
+#if HWY_TARGET != HWY_SCALAR
+	return bicubic_double<uint16_t, false>(pout, pin,
+		left, top, lskip, bands, x, y, n, matrixf);
+#else
+	return 0;
+#endif
+}
+
+HWY_ATTR int32_t
+vips_interpolate_bicubic_float_hwy(void *pout, const VipsPel *pin,
+	int32_t left, int32_t top, int32_t lskip, int32_t bands,
+	const double *HWY_RESTRICT x, const double *HWY_RESTRICT y, int32_t n,
+	const double *HWY_RESTRICT matrixf)
+{
+#if HWY_TARGET != HWY_SCALAR
+	return bicubic_double<float, true>(pout, pin,
+		left, top, lskip, bands, x, y, n, matrixf);
+#else
+	return 0;
+#endif
+}
+
+} /*namespace HWY_NAMESPACE*/
+
+#if HWY_ONCE
+HWY_EXPORT(vips_interpolate_bilinear_uchar_hwy);
+HWY_EXPORT(vips_interpolate_bilinear_ushort_hwy);
+HWY_EXPORT(vips_interpolate_bilinear_float_hwy);
+HWY_EXPORT(vips_interpolate_bicubic_uchar_hwy);
+HWY_EXPORT(vips_interpolate_bicubic_ushort_hwy);
+HWY_EXPORT(vips_interpolate_bicubic_float_hwy);
+
+int
+vips_interpolate_bilinear_uchar_hwy(void *pout, const VipsPel *pin,
+	int left, int top, int lskip, int bands,
+	const double *x, const double *y, int n)
+{
+	/* clang-format off */
+	return HWY_DYNAMIC_DISPATCH(vips_interpolate_bilinear_uchar_hwy)(pout, pin,
+		left, top, lskip, bands, x, y, n);
+	/* clang-format on */
+}
+
+int
+vips_interpolate_bilinear_ushort_hwy(void *pout, const VipsPel *pin,
+	int left, int top, int lskip, int bands,
+	const double *x, const double *y, int n)
+{
+	/* clang-format off */
+	return HWY_DYNAMIC_DISPATCH(vips_interpolate_bilinear_ushort_hwy)(pout, pin,
+		left, top, lskip, bands, x, y, n);
+	/* clang-format on */
+}
+
+int
+vips_interpolate_bilinear_float_hwy(void *pout, const VipsPel *pin,
+	int left, int top, int lskip, int bands,
+	const double *x, const double *y, int n)
+{
+	/* clang-format off */
+	return HWY_DYNAMIC_DISPATCH(vips_interpolate_bilinear_float_hwy)(pout, pin,
+		left, top, lskip, bands, x, y, n);
+	/* clang-format on */
+}
+
+int
+vips_interpolate_bicubic_uchar_hwy(void *pout, const VipsPel *pin,
+	int left, int top, int lskip, int bands,
+	const double *x, const double *y, int n,
+	const int *matrixi)
+{
+	/* clang-format off */
+	return HWY_DYNAMIC_DISPATCH(vips_interpolate_bicubic_uchar_hwy)(pout, pin,
+		left, top, lskip, bands, x, y, n, matrixi);
+	/* clang-format on */
+}
+
+int
+vips_interpolate_bicubic_ushort_hwy(void *pout, const VipsPel *pin,
+	int left, int top, int lskip, int bands,
+	const double *x, const double *y, int n,
+	const double *matrixf)
+{
+	/* clang-format off */
+	return HWY_DYNAMIC_DISPATCH(vips_interpolate_bicubic_ushort_hwy)(pout, pin,
+		left, top, lskip, bands, x, y, n, matrixf);
+	/* clang-format on */
+}
+
+int
+vips_interpolate_bicubic_float_hwy(void *pout, const VipsPel *pin,
+	int left, int top, int lskip, int bands,
+	const double *x, const double *y, int n,
+	const double *matrixf)
+{
+	/* clang-format off */
+	return HWY_DYNAMIC_DISPATCH(vips_interpolate_bicubic_float_hwy)(pout, pin,
+		left, top, lskip, bands, x, y, n, matrixf);
+	/* clang-format on */
+}
+#endif /*HWY_ONCE*/
+
+#endif /*HAVE_HWY*/
@@ -12,6 +12,8 @@
  * 21/12/21
  * 	- improve edge antialiasing with "background" and "extend"
  * 	- add "premultiplied" param
+ * 14/10/26
+ * 	- interpolate runs of pixels with interpolate_span
  */
 
 /*
@@ -223,6 +225,38 @@ vips_mapim_region_minmax(VipsRegion *region, VipsRect *r, VipsRect *bounds)
 	bounds->height = (max_y - min_y) + 1;
 }
 
+/* Interpolate any pixels we have collected.
+ */
+#define SPAN_FLUSH() \
+	{ \
+		if (n_span > 0) { \
+			interpolate_span(mapim->interpolate, \
+				span_q, ir[0], span_x, span_y, n_span); \
+			n_span = 0; \
+		} \
+	}
+
+/* Add a pixel to the current span, or end the span and paint ink.
+ */
+#define SPAN_ADD(PX, PY) \
+	{ \
+		if (n_span == 0) \
+			span_q = q; \
+		span_x[n_span] = (PX) + window_offset + 1; \
+		span_y[n_span] = (PY) + window_offset + 1; \
+		n_span += 1; \
+\
+		if (n_span == VIPS_SPAN_SIZE) \
+			SPAN_FLUSH(); \
+	}
+
+#define SPAN_INK() \
+	{ \
+		SPAN_FLUSH(); \
+		for (z = 0; z < ps; z++) \
+			q[z] = mapim->ink[z]; \
+	}
+
 /* Unsigned int types.
  */
 #define ULOOKUP(TYPE) \
@@ -235,13 +269,11 @@ vips_mapim_region_minmax(VipsRegion *region, VipsRect *r, VipsRect *bounds)
 \
 			if (px >= clip_width || \
 				py >= clip_height) { \
-				for (z = 0; z < ps; z++) \
-					q[z] = mapim->ink[z]; \
+				SPAN_INK(); \
+			} \
+			else { \
+				SPAN_ADD(px, py); \
 			} \
-			else \
-				interpolate(mapim->interpolate, q, ir[0], \
-					px + window_offset + 1, \
-					py + window_offset + 1); \
 \
 			p1 += 2; \
 			q += ps; \
@@ -262,13 +294,11 @@ vips_mapim_region_minmax(VipsRegion *region, VipsRect *r, VipsRect *bounds)
 				px >= clip_width || \
 				py < -1 || \
 				py >= clip_height) { \
-				for (z = 0; z < ps; z++) \
-					q[z] = mapim->ink[z]; \
+				SPAN_INK(); \
+			} \
+			else { \
+				SPAN_ADD(px, py); \
 			} \
-			else \
-				interpolate(mapim->interpolate, q, ir[0], \
-					px + window_offset + 1, \
-					py + window_offset + 1); \
 \
 			p1 += 2; \
 			q += ps; \
@@ -291,13 +321,11 @@ vips_mapim_region_minmax(VipsRegion *region, VipsRect *r, VipsRect *bounds)
 				px >= clip_width || \
 				py < -1 || \
 				py >= clip_height) { \
-				for (z = 0; z < ps; z++) \
-					q[z] = mapim->ink[z]; \
+				SPAN_INK(); \
+			} \
+			else { \
+				SPAN_ADD(px, py); \
 			} \
-			else \
-				interpolate(mapim->interpolate, q, ir[0], \
-					px + window_offset + 1, \
-					py + window_offset + 1); \
 \
 			p1 += 2; \
 			q += ps; \
@@ -317,8 +345,8 @@ vips_mapim_gen(VipsRegion *out_region,
 		vips_interpolate_get_window_size(mapim->interpolate);
 	const int window_offset =
 		vips_interpolate_get_window_offset(mapim->interpolate);
-	const VipsInterpolateMethod interpolate =
-		vips_interpolate_get_method(mapim->interpolate);
+	const VipsInterpolateSpanMethod interpolate_span =
+		vips_interpolate_get_span_method(mapim->interpolate);
 	const int ps = VIPS_IMAGE_SIZEOF_PEL(in);
 	const int clip_width = in->Xsize - window_size;
 	const int clip_height = in->Ysize - window_size;
@@ -326,6 +354,14 @@ vips_mapim_gen(VipsRegion *out_region,
 	VipsRect bounds, need, image, clipped;
 	int x, y, z;
 
+	/* Runs of in-range pixels are collected here and interpolated in one
+	 * call.
+	 */
+	double span_x[VIPS_SPAN_SIZE];
+	double span_y[VIPS_SPAN_SIZE];
+	VipsPel *span_q;
+	int n_span;
+
 #ifdef DEBUG_VERBOSE
 	printf("vips_mapim_gen: generating left=%d, top=%d, width=%d, height=%d\n",
 		r->left,
@@ -389,6 +425,9 @@ vips_mapim_gen(VipsRegion *out_region,
 		VipsPel *restrict q =
 			VIPS_REGION_ADDR(out_region, r->left, y + r->top);
 
+		span_q = q;
+		n_span = 0;
+
 		switch (ir[1]->im->BandFmt) {
 		case VIPS_FORMAT_UCHAR:
 			ULOOKUP(unsigned char);
@@ -420,6 +459,8 @@ vips_mapim_gen(VipsRegion *out_region,
 		default:
 			g_assert_not_reached();
 		}
+
+		SPAN_FLUSH();
 	}
 
 	VIPS_GATE_STOP("vips_mapim_gen: work");
@@ -71,6 +71,30 @@ GType vips_resample_get_type(void);
 
 int vips_reduce_get_points(VipsKernel kernel, double shrink);
 
+/* Precalculated interpolation matrices for a kernel and shrink, shared
+ * between operations. short (used for pel sizes up to int), and double (for
+ * all others). We go to scale + 1 so we can round-to-nearest safely.
+ */
+typedef struct _VipsReduceKernel {
+	VipsKernel kernel;
+	double shrink;
+	int n_point;
+
+	short *matrixs[VIPS_TRANSFORM_SCALE + 1];
+	double *matrixf[VIPS_TRANSFORM_SCALE + 1];
+
+	/* Private.
+	 */
+	int ref_count;
+	void *tables;
+} VipsReduceKernel;
+
+VipsReduceKernel *vips_reduce_kernel_get(VipsKernel kernel, double shrink);
+void vips_reduce_kernel_unref(VipsReduceKernel *k);
+
+int vips__reduce_fused(VipsImage *in, VipsImage **out,
+	double hshrink, double vshrink, VipsKernel kernel, double gap);
+
 void vips_reduceh_uchar_hwy(VipsPel *pout, VipsPel *pin,
 	int n, int width, int bands,
 	short *restrict cs[VIPS_TRANSFORM_SCALE + 1],
@@ -85,6 +109,32 @@ void vips_shrinkv_add_line_uchar_hwy(VipsPel *pin,
 void vips_shrinkv_write_line_uchar_hwy(VipsPel *pout,
 	int ne, int vshrink, unsigned int *restrict sum);
 
+/* The size of the span buffers used by affine and mapim.
+ */
+#define VIPS_SPAN_SIZE (256)
+
+int vips_interpolate_bilinear_uchar_hwy(void *pout, const VipsPel *pin,
+	int left, int top, int lskip, int bands,
+	const double *x, const double *y, int n);
+int vips_interpolate_bilinear_ushort_hwy(void *pout, const VipsPel *pin,
+	int left, int top, int lskip, int bands,
+	const double *x, const double *y, int n);
+int vips_interpolate_bilinear_float_hwy(void *pout, const VipsPel *pin,
+	int left, int top, int lskip, int bands,
+	const double *x, const double *y, int n);
+int vips_interpolate_bicubic_uchar_hwy(void *pout, const VipsPel *pin,
+	int left, int top, int lskip, int bands,
+	const double *x, const double *y, int n,
+	const int *matrixi);
+int vips_interpolate_bicubic_ushort_hwy(void *pout, const VipsPel *pin,
+	int left, int top, int lskip, int bands,
+	const double *x, const double *y, int n,
+	const double *matrixf);
+int vips_interpolate_bicubic_float_hwy(void *pout, const VipsPel *pin,
+	int left, int top, int lskip, int bands,
+	const double *x, const double *y, int n,
+	const double *matrixf);
+
 #ifdef __cplusplus
 }
 #endif /*__cplusplus*/
@@ -0,0 +1,882 @@
+/* box shrink and kernel reduce on both axes in a single pass
+ *
+ * 14/10/26
+ * 	- from reducev.cpp, reduceh.cpp, shrinkv.c and shrinkh.c
+ */
+
+/*
+
+	This file is part of VIPS.
+
+	VIPS is free software; you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+	02110-1301  USA
+
+ */
+
+/*
+
+	These files are distributed with VIPS - http://www.vips.ecs.soton.ac.uk
+
+ */
+
+/*
+#define DEBUG
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /*HAVE_CONFIG_H*/
+#include <glib/gi18n-lib.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <climits>
+#include <cmath>
+
+#include <vips/vips.h>
+#include <vips/vector.h>
+#include <vips/debug.h>
+#include <vips/internal.h>
+
+#include "presample.h"
+#include "templates.h"
+
+/* vips_resize() used to chain shrinkv -> reducev -> shrinkh -> reduceh, each
+ * with its own regions and its own copy of the pixels in flight. Here we do
+ * all four stages for each output line from a ring of box-shrunk input
+ * lines, so the only buffered image data is the ring itself.
+ *
+ * The geometry and the rounding at each stage follow the chained operations
+ * exactly, so the two give the same pixels.
+ */
+
+/* One axis: a box shrink by an integer factor, then a kernel reduce by the
+ * residual.
+ */
+typedef struct _VipsReduceFusedAxis {
+	int size;		 /* Input size */
+	int out_size;	 /* Output size */
+	int shrink;		 /* Integer box shrink */
+	int shrunk_size; /* Size after the box shrink */
+	double residual; /* Kernel reduce after the box shrink */
+	double offset;	 /* Displacement, as hoffset/voffset in reduceh/v */
+	int margin;		 /* Edge pixels we add for the kernel */
+	int n_point;	 /* Points in kernel */
+
+	VipsReduceKernel *tables;
+} VipsReduceFusedAxis;
+
+typedef struct _VipsReduceFused {
+	VipsImage *in;
+	VipsKernel kernel;
+
+	VipsReduceFusedAxis h;
+	VipsReduceFusedAxis v;
+
+	/* Elements per pixel, doubled for complex.
+	 */
+	int bands;
+	int sizeof_pel;
+
+	/* Max widths of the line buffers, in pixels.
+	 */
+	int ring_width;
+	int shrunk_width;
+	int line_width;
+
+	/* Use the vector paths for uchar.
+	 */
+	gboolean vector;
+} VipsReduceFused;
+
+typedef struct _VipsReduceFusedSequence {
+	VipsRegion *ir;
+
+	/* The input columns the ring holds, and how many of them are inside
+	 * the image.
+	 */
+	int left;
+	int width;
+	int n_valid;
+
+	/* A ring of n_point box-shrunk lines, held twice over so that any
+	 * n_point consecutive lines are contiguous in memory, plus the
+	 * index (in the edge-extended, box-shrunk image) of the line in
+	 * each slot.
+	 */
+	size_t sizeof_line;
+	VipsPel *ring;
+	int *ring_index;
+
+	/* Box shrink sums, the vertically reduced line, that line box shrunk
+	 * horizontally, then edge-extended ready for the horizontal kernel.
+	 */
+	void *sum;
+	VipsPel *vline;
+	VipsPel *shrunk;
+	VipsPel *line;
+} VipsReduceFusedSequence;
+
+/* Box shrink accumulators, as shrinkv and shrinkh.
+ */
+template <typename T>
+struct BoxT {
+	typedef int type;
+};
+
+template <>
+struct BoxT<uint32_t> {
+	typedef gint64 type;
+};
+
+template <>
+struct BoxT<int32_t> {
+	typedef gint64 type;
+};
+
+template <>
+struct BoxT<float> {
+	typedef double type;
+};
+
+template <>
+struct BoxT<double> {
+	typedef double type;
+};
+
+/* Average a box sum, rounding as shrinkv and shrinkh do.
+ */
+template <typename T>
+static T inline box_mean(typename BoxT<T>::type sum, int shrink)
+{
+	return (sum + shrink / 2) / shrink;
+}
+
+template <>
+unsigned char inline box_mean<unsigned char>(int sum, int shrink)
+{
+	unsigned int multiplier = (1LL << 32) / ((1 << 8) * shrink);
+
+	return ((sum + shrink / 2) * multiplier) >> 24;
+}
+
+template <>
+unsigned short inline box_mean<unsigned short>(int sum, int shrink)
+{
+	guint64 multiplier = ((1ULL << 32) + shrink - 1) / shrink;
+
+	return ((gint64) (sum + shrink / 2) * multiplier) >> 32;
+}
+
+template <>
+float inline box_mean<float>(double sum, int shrink)
+{
+	return sum * (1.0 / shrink);
+}
+
+template <>
+double inline box_mean<double>(double sum, int shrink)
+{
+	return sum * (1.0 / shrink);
+}
+
+/* Coefficient tables to use.
+ */
+enum {
+	REDUCE_FUSED_FIXED, /* short tables, for int types */
+	REDUCE_FUSED_FLOAT, /* double tables, for float */
+	REDUCE_FUSED_NOTAB	/* an exact mask for every pixel, for double */
+};
+
+static void
+vips_reduce_fused_axis_free(VipsReduceFusedAxis *axis)
+{
+	VIPS_FREEF(vips_reduce_kernel_unref, axis->tables);
+}
+
+static void
+vips_reduce_fused_free(VipsReduceFused *fused)
+{
+	vips_reduce_fused_axis_free(&fused->h);
+	vips_reduce_fused_axis_free(&fused->v);
+	VIPS_UNREF(fused->in);
+	g_free(fused);
+}
+
+static void
+vips_reduce_fused_close_cb(VipsImage *image, VipsReduceFused *fused)
+{
+	vips_reduce_fused_free(fused);
+}
+
+/* Size an axis. This is the same calculation as vips_reducev_build() and
+ * vips_reduceh_build().
+ */
+static int
+vips_reduce_fused_axis_init(VipsReduceFusedAxis *axis,
+	VipsKernel kernel, int size, double shrink, double gap)
+{
+	double extra_pixels;
+
+	axis->size = size;
+	axis->out_size = VIPS_ROUND_UINT((double) size / shrink);
+	if (axis->out_size <= 0) {
+		vips_error("reduce", "%s", _("image has shrunk to nothing"));
+		return -1;
+	}
+
+	/* How many pixels we are inventing in the input, -ve for
+	 * discarding.
+	 */
+	extra_pixels = axis->out_size * shrink - size;
+
+	axis->shrink = 1;
+	axis->residual = shrink;
+	if (gap > 0.0) {
+		if (gap < 1.0) {
+			vips_error("reduce", "%s", _("reduce gap should be >= 1.0"));
+			return -1;
+		}
+
+		axis->shrink = VIPS_MAX(1,
+			floor((double) size / axis->out_size / gap));
+		axis->residual /= axis->shrink;
+		extra_pixels /= axis->shrink;
+	}
+
+	/* The box shrink rounds up, copying edge pixels.
+	 */
+	axis->shrunk_size = VIPS_ROUND_UP(size, axis->shrink) / axis->shrink;
+	axis->offset = (1 + extra_pixels) / 2.0 - 1;
+
+	return 0;
+}
+
+static int
+vips_reduce_fused_axis_build(VipsReduceFusedAxis *axis, VipsKernel kernel)
+{
+	axis->n_point = vips_reduce_get_points(kernel, axis->residual);
+	if (axis->n_point > MAX_POINT) {
+		vips_error("reduce", "%s", _("reduce factor too large"));
+		return -1;
+	}
+	axis->margin = ceil(axis->n_point / 2.0) - 1;
+
+	if (!(axis->tables = vips_reduce_kernel_get(kernel, axis->residual)))
+		return -1;
+
+	return 0;
+}
+
+static int
+vips_reduce_fused_stop(void *vseq, void *a, void *b)
+{
+	VipsReduceFusedSequence *seq = (VipsReduceFusedSequence *) vseq;
+
+	VIPS_UNREF(seq->ir);
+	VIPS_FREE(seq->ring);
+	VIPS_FREE(seq->ring_index);
+	VIPS_FREE(seq->sum);
+	VIPS_FREE(seq->vline);
+	VIPS_FREE(seq->shrunk);
+	VIPS_FREE(seq->line);
+	VIPS_FREE(seq);
+
+	return 0;
+}
+
+static void *
+vips_reduce_fused_start(VipsImage *out, void *a, void *b)
+{
+	VipsImage *in = (VipsImage *) a;
+	VipsReduceFused *fused = (VipsReduceFused *) b;
+	const int ps = fused->sizeof_pel;
+	const int n_ring = fused->v.n_point;
+
+	VipsReduceFusedSequence *seq;
+
+	if (!(seq = VIPS_NEW(nullptr, VipsReduceFusedSequence)))
+		return nullptr;
+
+	seq->ir = vips_region_new(in);
+	seq->left = -1;
+	seq->width = 0;
+	seq->n_valid = 0;
+	seq->sizeof_line = (size_t) fused->ring_width * ps;
+	seq->ring = VIPS_ARRAY(nullptr, 2 * n_ring * seq->sizeof_line, VipsPel);
+	seq->ring_index = VIPS_ARRAY(nullptr, n_ring, int);
+	seq->sum = VIPS_ARRAY(nullptr,
+		(size_t) fused->ring_width * fused->bands, double);
+	seq->vline = VIPS_ARRAY(nullptr, seq->sizeof_line, VipsPel);
+	seq->shrunk = VIPS_ARRAY(nullptr,
+		(size_t) fused->shrunk_width * ps, VipsPel);
+	seq->line = VIPS_ARRAY(nullptr,
+		(size_t) fused->line_width * ps, VipsPel);
+	if (!seq->ir ||
+		!seq->ring ||
+		!seq->ring_index ||
+		!seq->sum ||
+		!seq->vline ||
+		!seq->shrunk ||
+		!seq->line) {
+		vips_reduce_fused_stop(seq, in, fused);
+		return nullptr;
+	}
+
+	for (int i = 0; i < n_ring; i++)
+		seq->ring_index[i] = -1;
+
+	return (void *) seq;
+}
+
+/* Make sure input lines top to top + height of the ring's columns are in
+ * @ir. Fetch a fatstrip at a time so we don't call prepare for every line.
+ */
+static int
+vips_reduce_fused_prepare(VipsReduceFused *fused,
+	VipsReduceFusedSequence *seq, int top, int height)
+{
+	VipsRect need;
+
+	need.left = seq->left;
+	need.top = top;
+	need.width = seq->n_valid;
+	need.height = height;
+	if (vips_rect_includesrect(&seq->ir->valid, &need))
+		return 0;
+
+	need.height = VIPS_MIN(fused->v.size - top,
+		VIPS_MAX(height, vips__fatstrip_height));
+
+	return vips_region_prepare(seq->ir, &need);
+}
+
+/* Make line @j of the edge-extended, box-shrunk image at @q, as shrinkv
+ * followed by the embed in reducev.
+ */
+template <typename T>
+static int
+vips_reduce_fused_box(VipsReduceFused *fused, VipsReduceFusedSequence *seq,
+	VipsPel *q, int j)
+{
+	using AT = typename BoxT<T>::type;
+
+	const int shrink = fused->v.shrink;
+	const int s = VIPS_CLIP(0, j - fused->v.margin, fused->v.shrunk_size - 1);
+	const int top = s * shrink;
+	const int height = VIPS_MIN(shrink, fused->v.size - top);
+	const int ne = seq->n_valid * fused->bands;
+
+	if (vips_reduce_fused_prepare(fused, seq, top, height))
+		return -1;
+
+	if (shrink == 1) {
+		memcpy(q, VIPS_REGION_ADDR(seq->ir, seq->left, top),
+			(size_t) seq->n_valid * fused->sizeof_pel);
+		return 0;
+	}
+
+#ifdef HAVE_HWY
+	if (fused->vector) {
+		unsigned int *restrict sum = (unsigned int *) seq->sum;
+
+		memset(sum, 0, ne * sizeof(unsigned int));
+
+		/* The last box can run off the bottom of the image. The
+		 * shrink extends with copy, so repeat the last line.
+		 */
+		for (int i = 0; i < shrink; i++) {
+			const int y = VIPS_MIN(top + i, fused->v.size - 1);
+
+			vips_shrinkv_add_line_uchar_hwy(
+				VIPS_REGION_ADDR(seq->ir, seq->left, y), ne, sum);
+		}
+
+		vips_shrinkv_write_line_uchar_hwy(q, ne, shrink, sum);
+
+		return 0;
+	}
+#endif /*HAVE_HWY*/
+
+	AT *restrict sum = (AT *) seq->sum;
+	T *restrict out = (T *) q;
+
+	memset(sum, 0, ne * sizeof(AT));
+
+	for (int i = 0; i < shrink; i++) {
+		const int y = VIPS_MIN(top + i, fused->v.size - 1);
+		const T *restrict p =
+			(T *) VIPS_REGION_ADDR(seq->ir, seq->left, y);
+
+		for (int x = 0; x < ne; x++)
+			sum[x] += p[x];
+	}
+
+	for (int x = 0; x < ne; x++)
+		out[x] = box_mean<T>(sum[x], shrink);
+
+	return 0;
+}
+
+/* Box shrink @width pixels of @vline horizontally into @q, as shrinkh.
+ */
+template <typename T>
+static void
+vips_reduce_fused_shrinkh(VipsReduceFused *fused,
+	VipsPel *q, const VipsPel *vline, int width)
+{
+	using AT = typename BoxT<T>::type;
+
+	const int shrink = fused->h.shrink;
+	const int bands = fused->bands;
+	const int ne = shrink * bands;
+
+#ifdef HAVE_HWY
+	if (fused->vector) {
+		vips_shrinkh_uchar_hwy(q, (VipsPel *) vline, width, shrink, bands);
+		return;
+	}
+#endif /*HAVE_HWY*/
+
+	const T *restrict p = (T *) vline;
+	T *restrict out = (T *) q;
+
+	for (int x = 0; x < width; x++) {
+		for (int b = 0; b < bands; b++) {
+			AT sum = 0;
+
+			for (int x1 = b; x1 < ne; x1 += bands)
+				sum += p[x1];
+			out[b] = box_mean<T>(sum, shrink);
+		}
+
+		p += ne;
+		out += bands;
+	}
+}
+
+/* Generate an area of @out_region for one format. @finalize turns a kernel
+ * sum into a pixel, as in reducev and reduceh.
+ */
+template <typename T, int mode, typename Finalize>
+static int
+vips_reduce_fused_gen_format(VipsRegion *out_region,
+	VipsReduceFusedSequence *seq, VipsReduceFused *fused,
+	Finalize finalize)
+{
+	using IT = typename LongT<T>::type;
+
+	VipsRect *r = &out_region->valid;
+	VipsReduceFusedAxis *h = &fused->h;
+	VipsReduceFusedAxis *v = &fused->v;
+	const int bands = fused->bands;
+	const int ps = fused->sizeof_pel;
+	const int n_ring = v->n_point;
+
+	/* The span of the edge-extended, box-shrunk image that reduceh would
+	 * fetch for these output columns, plus slack for the vector path.
+	 */
+	const double X0 = (r->left + 0.5) * h->residual - 0.5 - h->offset;
+	const int k0 = (int) X0;
+	const int k1 = (int) (X0 + (r->width - 1) * h->residual) +
+		h->n_point + (int) ceil(h->residual) + 2;
+
+	/* And the box-shrunk columns that covers, plus one for the vector
+	 * box shrink. These come from input columns left to right.
+	 */
+	const int c0 = VIPS_CLIP(0, k0 - h->margin, h->shrunk_size - 1);
+	const int c1 = VIPS_CLIP(0, k1 - 1 - h->margin, h->shrunk_size - 1);
+	const int left = c0 * h->shrink;
+	const int width = (c1 + 2 - c0) * h->shrink;
+
+	g_assert(width <= fused->ring_width);
+	g_assert(k1 - k0 <= fused->line_width);
+
+	VipsPel *p0 = seq->line - k0 * ps;
+
+	/* A new set of columns invalidates the ring.
+	 */
+	if (seq->left != left ||
+		seq->width != width) {
+		seq->left = left;
+		seq->width = width;
+		seq->n_valid = VIPS_MIN(width, h->size - left);
+		for (int i = 0; i < n_ring; i++)
+			seq->ring_index[i] = -1;
+	}
+
+	double Y = (r->top + 0.5) * v->residual - 0.5 - v->offset;
+
+	for (int y = 0; y < r->height; y++) {
+		const int py = (int) Y;
+		const int sy = Y * VIPS_TRANSFORM_SCALE * 2;
+		const int siy = sy & (VIPS_TRANSFORM_SCALE * 2 - 1);
+		const int ty = (siy + 1) >> 1;
+		const int first = py % n_ring;
+
+		/* Fill any ring slots we are missing.
+		 */
+		for (int i = 0; i < n_ring; i++) {
+			const int j = py + i;
+			const int slot = j % n_ring;
+
+			if (seq->ring_index[slot] != j) {
+				VipsPel *q = seq->ring + slot * seq->sizeof_line;
+
+				if (vips_reduce_fused_box<T>(fused, seq, q, j))
+					return -1;
+				memcpy(q + n_ring * seq->sizeof_line, q,
+					(size_t) seq->n_valid * ps);
+				seq->ring_index[slot] = j;
+			}
+		}
+
+		VIPS_GATE_START("vips_reduce_fused_gen: work");
+
+		/* Kernel reduce vertically.
+		 */
+		VipsPel *ring = seq->ring + first * seq->sizeof_line;
+		const int ne = seq->n_valid * bands;
+
+		if (mode == REDUCE_FUSED_FIXED) {
+			const short *cys = v->tables->matrixs[ty];
+
+#ifdef HAVE_HWY
+			if (fused->vector)
+				vips_reducev_uchar_hwy(seq->vline, ring,
+					n_ring, ne, seq->sizeof_line, cys);
+			else
+#endif /*HAVE_HWY*/
+				reducev_line<T>((T *) seq->vline, (T *) ring,
+					ne, seq->sizeof_line, cys, n_ring, finalize);
+		}
+		else if (mode == REDUCE_FUSED_FLOAT)
+			reducev_line<T>((T *) seq->vline, (T *) ring,
+				ne, seq->sizeof_line, v->tables->matrixf[ty], n_ring,
+				finalize);
+		else {
+			IT cy[MAX_POINT];
+
+			vips_reduce_make_mask(cy, fused->kernel, n_ring,
+				v->residual, Y - py);
+			reducev_line<T>((T *) seq->vline, (T *) ring,
+				ne, seq->sizeof_line, cy, n_ring, finalize);
+		}
+
+		/* The horizontal box shrink extends with copy.
+		 */
+		for (int x = seq->n_valid; x < width; x++)
+			memcpy(seq->vline + x * ps,
+				seq->vline + (seq->n_valid - 1) * ps, ps);
+
+		/* Box shrink horizontally.
+		 */
+		VipsPel *shrunk;
+
+		if (h->shrink > 1) {
+			vips_reduce_fused_shrinkh<T>(fused,
+				seq->shrunk, seq->vline, c1 - c0 + 1);
+			shrunk = seq->shrunk;
+		}
+		else
+			shrunk = seq->vline;
+
+		/* Edge-extend for the kernel, as the embed in reduceh.
+		 */
+		for (int k = k0; k < k1; k++) {
+			const int c = VIPS_CLIP(0, k - h->margin, h->shrunk_size - 1);
+
+			memcpy(p0 + k * ps, shrunk + (c - c0) * ps, ps);
+		}
+
+		/* Kernel reduce horizontally.
+		 */
+		VipsPel *q = VIPS_REGION_ADDR(out_region, r->left, r->top + y);
+
+#ifdef HAVE_HWY
+		if (fused->vector)
+			vips_reduceh_uchar_hwy(q, p0, h->n_point, r->width,
+				bands, h->tables->matrixs, X0, h->residual);
+		else
+#endif /*HAVE_HWY*/
+		{
+			T *restrict out = (T *) q;
+			double X = X0;
+
+			for (int x = 0; x < r->width; x++) {
+				const int ix = (int) X;
+				const T *restrict p = (T *) (p0 + ix * ps);
+				const int sx = X * VIPS_TRANSFORM_SCALE * 2;
+				const int six = sx & (VIPS_TRANSFORM_SCALE * 2 - 1);
+				const int tx = (six + 1) >> 1;
+
+				if (mode == REDUCE_FUSED_FIXED) {
+					const short *cxs = h->tables->matrixs[tx];
+
+					for (int z = 0; z < bands; z++)
+						out[z] = finalize(
+							reduce_sum<T>(p + z, bands, cxs, h->n_point));
+				}
+				else if (mode == REDUCE_FUSED_FLOAT) {
+					const double *cxf = h->tables->matrixf[tx];
+
+					for (int z = 0; z < bands; z++)
+						out[z] = finalize(
+							reduce_sum<T>(p + z, bands, cxf, h->n_point));
+				}
+				else {
+					IT cx[MAX_POINT];
+
+					vips_reduce_make_mask(cx, fused->kernel, h->n_point,
+						h->residual, X - ix);
+					for (int z = 0; z < bands; z++)
+						out[z] = finalize(
+							reduce_sum<T>(p + z, bands, cx, h->n_point));
+				}
+
+				X += h->residual;
+				out += bands;
+			}
+		}
+
+		VIPS_GATE_STOP("vips_reduce_fused_gen: work");
+
+		Y += v->residual;
+	}
+
+	return 0;
+}
+
+static int
+vips_reduce_fused_gen(VipsRegion *out_region, void *vseq,
+	void *a, void *b, gboolean *stop)
+{
+	VipsImage *in = (VipsImage *) a;
+	VipsReduceFused *fused = (VipsReduceFused *) b;
+	VipsReduceFusedSequence *seq = (VipsReduceFusedSequence *) vseq;
+
+	int result;
+
+#ifdef DEBUG
+	printf("vips_reduce_fused_gen: generating %d x %d at %d x %d\n",
+		out_region->valid.width, out_region->valid.height,
+		out_region->valid.left, out_region->valid.top);
+#endif /*DEBUG*/
+
+	switch (in->BandFmt) {
+	case VIPS_FORMAT_UCHAR:
+		result = vips_reduce_fused_gen_format<unsigned char,
+			REDUCE_FUSED_FIXED>(out_region, seq, fused,
+			[](int s) -> unsigned char {
+				return VIPS_CLIP(0, unsigned_fixed_round(s), UCHAR_MAX);
+			});
+		break;
+
+	case VIPS_FORMAT_CHAR:
+		result = vips_reduce_fused_gen_format<signed char,
+			REDUCE_FUSED_FIXED>(out_region, seq, fused,
+			[](int s) -> signed char {
+				return VIPS_CLIP(SCHAR_MIN, signed_fixed_round(s), SCHAR_MAX);
+			});
+		break;
+
+	case VIPS_FORMAT_USHORT:
+		result = vips_reduce_fused_gen_format<unsigned short,
+			REDUCE_FUSED_FIXED>(out_region, seq, fused,
+			[](int s) -> unsigned short {
+				return VIPS_CLIP(0, unsigned_fixed_round(s), USHRT_MAX);
+			});
+		break;
+
+	case VIPS_FORMAT_SHORT:
+		result = vips_reduce_fused_gen_format<signed short,
+			REDUCE_FUSED_FIXED>(out_region, seq, fused,
+			[](int s) -> signed short {
+				return VIPS_CLIP(SHRT_MIN, signed_fixed_round(s), SHRT_MAX);
+			});
+		break;
+
+	case VIPS_FORMAT_UINT:
+		result = vips_reduce_fused_gen_format<unsigned int,
+			REDUCE_FUSED_FIXED>(out_region, seq, fused,
+			[](int64_t s) -> unsigned int {
+				return VIPS_CLIP(0, unsigned_fixed_round(s), UINT_MAX);
+			});
+		break;
+
+	case VIPS_FORMAT_INT:
+		result = vips_reduce_fused_gen_format<signed int,
+			REDUCE_FUSED_FIXED>(out_region, seq, fused,
+			[](int64_t s) -> signed int {
+				return VIPS_CLIP(INT_MIN, signed_fixed_round(s), INT_MAX);
+			});
+		break;
+
+	case VIPS_FORMAT_FLOAT:
+	case VIPS_FORMAT_COMPLEX:
+		result = vips_reduce_fused_gen_format<float,
+			REDUCE_FUSED_FLOAT>(out_region, seq, fused,
+			[](double s) -> float { return s; });
+		break;
+
+	case VIPS_FORMAT_DOUBLE:
+	case VIPS_FORMAT_DPCOMPLEX:
+		result = vips_reduce_fused_gen_format<double,
+			REDUCE_FUSED_NOTAB>(out_region, seq, fused,
+			[](long double s) -> double { return s; });
+		break;
+
+	default:
+		g_assert_not_reached();
+		result = -1;
+		break;
+	}
+
+	VIPS_COUNT_PIXELS(out_region, "vips_reduce_fused_gen");
+
+	return result;
+}
+
+/* Reduce @in by @hshrink x @vshrink with @kernel, box shrinking by up to
+ * @gap first, as vips_reducev() then vips_reduceh(), but in a single pass.
+ */
+int
+vips__reduce_fused(VipsImage *in, VipsImage **out,
+	double hshrink, double vshrink, VipsKernel kernel, double gap)
+{
+	VipsReduceFused *fused;
+	VipsImage *x;
+
+	g_assert(kernel != VIPS_KERNEL_NEAREST);
+
+	if (hshrink < 1.0 ||
+		vshrink < 1.0) {
+		vips_error("reduce", "%s", _("reduce factor should be >= 1.0"));
+		return -1;
+	}
+	if (vips_check_uncoded("reduce", in))
+		return -1;
+
+	fused = g_new0(VipsReduceFused, 1);
+	fused->kernel = kernel;
+	if (vips_reduce_fused_axis_init(&fused->h, kernel,
+			in->Xsize, hshrink, gap) ||
+		vips_reduce_fused_axis_init(&fused->v, kernel,
+			in->Ysize, vshrink, gap)) {
+		vips_reduce_fused_free(fused);
+		return -1;
+	}
+
+	/* An exact box shrink on either axis has no kernel pass to fuse
+	 * into. Chain the separate operations, they'll skip the reduce.
+	 */
+	if (fused->h.residual == 1.0 ||
+		fused->v.residual == 1.0) {
+		vips_reduce_fused_free(fused);
+
+		if (vips_reducev(in, &x, vshrink,
+				"kernel", kernel,
+				"gap", gap,
+				nullptr))
+			return -1;
+		if (vips_reduceh(x, out, hshrink,
+				"kernel", kernel,
+				"gap", gap,
+				nullptr)) {
+			g_object_unref(x);
+			return -1;
+		}
+		g_object_unref(x);
+
+		return 0;
+	}
+
+	if (vips_reduce_fused_axis_build(&fused->h, kernel) ||
+		vips_reduce_fused_axis_build(&fused->v, kernel)) {
+		vips_reduce_fused_free(fused);
+		return -1;
+	}
+
+	fused->in = in;
+	g_object_ref(in);
+	fused->bands = in->Bands *
+		(vips_band_format_iscomplex(in->BandFmt) ? 2 : 1);
+	fused->sizeof_pel = VIPS_IMAGE_SIZEOF_PEL(in);
+
+	/* The line buffers must be wide enough for a full-width tile, plus
+	 * slack for the vector paths, which can read a pixel past the end.
+	 */
+	const double X0 = 0.5 * fused->h.residual - 0.5 - fused->h.offset;
+	fused->line_width = (int) (X0 + fused->h.out_size * fused->h.residual) -
+		(int) X0 + fused->h.n_point + (int) ceil(fused->h.residual) + 4;
+	fused->shrunk_width = fused->h.shrunk_size + 2;
+	fused->ring_width = (fused->h.shrunk_size + 2) * fused->h.shrink;
+
+#ifdef HAVE_HWY
+	fused->vector = in->BandFmt == VIPS_FORMAT_UCHAR &&
+		vips_vector_isenabled();
+#endif /*HAVE_HWY*/
+
+	g_info("reduce fused: shrink by %d x %d, then %d x %d point mask",
+		fused->h.shrink, fused->v.shrink,
+		fused->h.n_point, fused->v.n_point);
+
+	x = vips_image_new();
+	g_signal_connect(x, "close",
+		G_CALLBACK(vips_reduce_fused_close_cb), fused);
+
+	if (vips_image_pipelinev(x, VIPS_DEMAND_STYLE_FATSTRIP, in, nullptr)) {
+		g_object_unref(x);
+		return -1;
+	}
+
+	/* Don't change xres/yres, leave that to the application layer.
+	 */
+	x->Xsize = fused->h.out_size;
+	x->Ysize = fused->v.out_size;
+
+#ifdef DEBUG
+	printf("vips__reduce_fused: reducing %d x %d image to %d x %d\n",
+		in->Xsize, in->Ysize, x->Xsize, x->Ysize);
+#endif /*DEBUG*/
+
+	if (vips_image_generate(x,
+			vips_reduce_fused_start, vips_reduce_fused_gen,
+			vips_reduce_fused_stop, in, fused)) {
+		g_object_unref(x);
+		return -1;
+	}
+
+	vips_reorder_margin_hint(x, fused->v.n_point * fused->v.shrink);
+
+	/* Large vertical reduces will throw off sequential mode, see
+	 * vips_reducev_build().
+	 */
+	if (vips_image_is_sequential(x)) {
+		g_info("reduce fused sequential line cache");
+
+		if (vips_sequential(x, out, "tile_height", 10, nullptr)) {
+			g_object_unref(x);
+			return -1;
+		}
+		g_object_unref(x);
+	}
+	else
+		*out = x;
+
+	return 0;
+}
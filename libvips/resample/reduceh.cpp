@@ -13,6 +13,8 @@
  * 	- fix pixel shift
  * 22/4/22 kleisauke
  * 	- add @gap option
+ * 14/10/26
+ * 	- share kernel tables through the reduce kernel cache
  */
 
 /*
@@ -88,8 +90,10 @@ typedef struct _VipsReduceh {
 
 	/* Precalculated interpolation matrices. short (used for pel
 	 * sizes up to int), and double (for all others). We go to
-	 * scale + 1 so we can round-to-nearest safely.
+	 * scale + 1 so we can round-to-nearest safely. These point into
+	 * @tables, which is shared with other operations.
 	 */
+	VipsReduceKernel *tables;
 	short *matrixs[VIPS_TRANSFORM_SCALE + 1];
 	double *matrixf[VIPS_TRANSFORM_SCALE + 1];
 
@@ -392,6 +396,16 @@ vips_reduceh_uchar_vector_gen(VipsRegion *out_region, void *seq,
 }
 #endif /*HAVE_HWY*/
 
+static void
+vips_reduceh_finalize(GObject *gobject)
+{
+	VipsReduceh *reduceh = (VipsReduceh *) gobject;
+
+	VIPS_FREEF(vips_reduce_kernel_unref, reduceh->tables);
+
+	G_OBJECT_CLASS(vips_reduceh_parent_class)->finalize(gobject);
+}
+
 static int
 vips_reduceh_build(VipsObject *object)
 {
@@ -478,24 +492,15 @@ vips_reduceh_build(VipsObject *object)
 	 */
 	reduceh->hoffset = (1 + extra_pixels) / 2.0 - 1;
 
-	/* Build the tables of pre-computed coefficients.
+	/* Fetch the tables of pre-computed coefficients. They depend only on
+	 * the kernel and the residual shrink, so they are shared.
 	 */
+	if (!(reduceh->tables = vips_reduce_kernel_get(reduceh->kernel,
+			  reduceh->residual_hshrink)))
+		return -1;
 	for (int x = 0; x < VIPS_TRANSFORM_SCALE + 1; x++) {
-		reduceh->matrixf[x] =
-			VIPS_ARRAY(object, reduceh->n_point, double);
-		reduceh->matrixs[x] =
-			VIPS_ARRAY(object, reduceh->n_point, short);
-		if (!reduceh->matrixf[x] ||
-			!reduceh->matrixs[x])
-			return -1;
-
-		vips_reduce_make_mask(reduceh->matrixf[x], reduceh->kernel,
-			reduceh->n_point, reduceh->residual_hshrink,
-			(float) x / VIPS_TRANSFORM_SCALE);
-
-		for (int i = 0; i < reduceh->n_point; i++)
-			reduceh->matrixs[x][i] = (short) (reduceh->matrixf[x][i] *
-				VIPS_INTERPOLATE_SCALE);
+		reduceh->matrixf[x] = reduceh->tables->matrixf[x];
+		reduceh->matrixs[x] = reduceh->tables->matrixs[x];
 #ifdef DEBUG
 		printf("vips_reduceh_build: mask %d\n    ", x);
 		for (int i = 0; i < reduceh->n_point; i++)
@@ -576,6 +581,7 @@ vips_reduceh_class_init(VipsReducehClass *reduceh_class)
 
 	VIPS_DEBUG_MSG("vips_reduceh_class_init\n");
 
+	gobject_class->finalize = vips_reduceh_finalize;
 	gobject_class->set_property = vips_object_set_property;
 	gobject_class->get_property = vips_object_get_property;
 
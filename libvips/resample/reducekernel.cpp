@@ -0,0 +1,232 @@
+/* a cache of precomputed reduce kernel tables
+ *
+ * 14/10/26
+ * 	- from reduceh.cpp
+ */
+
+/*
+
+	This file is part of VIPS.
+
+	VIPS is free software; you can redistribute it and/or modify
+	it under the terms of the GNU Lesser General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Lesser General Public License for more details.
+
+	You should have received a copy of the GNU Lesser General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+	02110-1301  USA
+
+ */
+
+/*
+
+	These files are distributed with VIPS - http://www.vips.ecs.soton.ac.uk
+
+ */
+
+/*
+#define DEBUG
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif /*HAVE_CONFIG_H*/
+#include <glib/gi18n-lib.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+
+#include <vips/vips.h>
+#include <vips/debug.h>
+#include <vips/internal.h>
+
+#include "presample.h"
+#include "templates.h"
+
+/* Tables depend only on the kernel and the residual shrink (the gap has
+ * already been folded into that by the time we get here), so thumbnail
+ * pipelines which resize many images by the same factor, or reduceh and
+ * reducev in the same reduce, can share one set.
+ *
+ * Once the cache holds this many sets, drop any that nothing is using.
+ */
+#define MAX_CACHED (32)
+
+static GMutex vips_reduce_kernel_lock;
+static GHashTable *vips_reduce_kernel_table = nullptr;
+
+static guint
+vips_reduce_kernel_hash(gconstpointer key)
+{
+	const VipsReduceKernel *k = (const VipsReduceKernel *) key;
+
+	return g_double_hash(&k->shrink) ^ ((guint) k->kernel << 24);
+}
+
+static gboolean
+vips_reduce_kernel_equal(gconstpointer a, gconstpointer b)
+{
+	const VipsReduceKernel *ka = (const VipsReduceKernel *) a;
+	const VipsReduceKernel *kb = (const VipsReduceKernel *) b;
+
+	return ka->kernel == kb->kernel &&
+		ka->shrink == kb->shrink;
+}
+
+static void
+vips_reduce_kernel_free(VipsReduceKernel *k)
+{
+	VIPS_FREEF(vips_tracked_free, k->tables);
+	g_free(k);
+}
+
+static VipsReduceKernel *
+vips_reduce_kernel_new(VipsKernel kernel, double shrink)
+{
+	VipsReduceKernel *k;
+
+	k = g_new0(VipsReduceKernel, 1);
+	k->kernel = kernel;
+	k->shrink = shrink;
+	k->n_point = vips_reduce_get_points(kernel, shrink);
+
+	/* One block for all the doubles, then all the shorts, so the whole
+	 * set can be freed in one go.
+	 */
+	const int n_table = VIPS_TRANSFORM_SCALE + 1;
+	k->tables = vips_tracked_malloc(n_table * k->n_point *
+		(sizeof(double) + sizeof(short)));
+	if (!k->tables) {
+		g_free(k);
+		return nullptr;
+	}
+
+	double *f = (double *) k->tables;
+	short *s = (short *) (f + n_table * k->n_point);
+
+	for (int x = 0; x < n_table; x++) {
+		k->matrixf[x] = f + x * k->n_point;
+		k->matrixs[x] = s + x * k->n_point;
+
+		vips_reduce_make_mask(k->matrixf[x], kernel,
+			k->n_point, shrink, (float) x / VIPS_TRANSFORM_SCALE);
+
+		for (int i = 0; i < k->n_point; i++)
+			k->matrixs[x][i] = (short) (k->matrixf[x][i] *
+				VIPS_INTERPOLATE_SCALE);
+	}
+
+#ifdef DEBUG
+	printf("vips_reduce_kernel_new: %d point mask, shrink %g\n",
+		k->n_point, shrink);
+#endif /*DEBUG*/
+
+	return k;
+}
+
+static gboolean
+vips_reduce_kernel_unused(gpointer key, gpointer value, gpointer user_data)
+{
+	VipsReduceKernel *k = (VipsReduceKernel *) value;
+
+	return k->ref_count == 0;
+}
+
+/**
+ * vips_reduce_kernel_get: (skip)
+ * @kernel: kernel to build
+ * @shrink: residual shrink factor, so 2 for a 50% reduction
+ *
+ * Look up the precomputed coefficient tables for @kernel and @shrink,
+ * building them on first use. Tables have @VIPS_TRANSFORM_SCALE + 1 rows
+ * of double and of short (scaled by @VIPS_INTERPOLATE_SCALE)
+ * coefficients, ready for the C and the vector paths.
+ *
+ * The tables are shared and must not be modified. Release them with
+ * vips_reduce_kernel_unref().
+ *
+ * Returns: the tables, or %NULL on error.
+ */
+VipsReduceKernel *
+vips_reduce_kernel_get(VipsKernel kernel, double shrink)
+{
+	VipsReduceKernel key;
+	VipsReduceKernel *k;
+
+	key.kernel = kernel;
+	key.shrink = shrink;
+
+	g_mutex_lock(&vips_reduce_kernel_lock);
+
+	if (!vips_reduce_kernel_table)
+		vips_reduce_kernel_table = g_hash_table_new_full(
+			vips_reduce_kernel_hash, vips_reduce_kernel_equal,
+			nullptr, (GDestroyNotify) vips_reduce_kernel_free);
+
+	if (!(k = (VipsReduceKernel *)
+			  g_hash_table_lookup(vips_reduce_kernel_table, &key))) {
+		/* Trim before we add, so the table can't grow without limit
+		 * on a long-running server.
+		 */
+		if (g_hash_table_size(vips_reduce_kernel_table) >= MAX_CACHED)
+			g_hash_table_foreach_remove(vips_reduce_kernel_table,
+				vips_reduce_kernel_unused, nullptr);
+
+		if (!(k = vips_reduce_kernel_new(kernel, shrink))) {
+			g_mutex_unlock(&vips_reduce_kernel_lock);
+			return nullptr;
+		}
+
+		g_hash_table_insert(vips_reduce_kernel_table, k, k);
+	}
+
+	k->ref_count += 1;
+
+	g_mutex_unlock(&vips_reduce_kernel_lock);
+
+	return k;
+}
+
+/**
+ * vips_reduce_kernel_unref: (skip)
+ * @k: tables to release
+ *
+ * Drop a reference to a set of tables from vips_reduce_kernel_get(). Tables
+ * stay in the cache for reuse until it is trimmed.
+ */
+void
+vips_reduce_kernel_unref(VipsReduceKernel *k)
+{
+	g_mutex_lock(&vips_reduce_kernel_lock);
+
+	g_assert(k->ref_count > 0);
+	k->ref_count -= 1;
+
+	g_mutex_unlock(&vips_reduce_kernel_lock);
+}
+
+/* Called from vips_shutdown().
+ */
+void
+vips__reduce_kernel_shutdown(void)
+{
+	g_mutex_lock(&vips_reduce_kernel_lock);
+
+	if (vips_reduce_kernel_table) {
+		g_hash_table_foreach_remove(vips_reduce_kernel_table,
+			vips_reduce_kernel_unused, nullptr);
+		if (g_hash_table_size(vips_reduce_kernel_table) == 0)
+			VIPS_FREEF(g_hash_table_destroy, vips_reduce_kernel_table);
+	}
+
+	g_mutex_unlock(&vips_reduce_kernel_lock);
+}
@@ -23,6 +23,9 @@
  * 	- speed up the mask construction for uchar/ushort images
  * 22/4/22 kleisauke
  * 	- add @gap option
+ * 14/10/26
+ * 	- share kernel tables through the reduce kernel cache
+ * 	- move the line reduce templates to templates.h
  */
 
 /*
@@ -131,8 +134,10 @@ typedef struct _VipsReducev {
 
 	/* Precalculated interpolation matrices. short (used for pel
 	 * sizes up to int), and double (for all others). We go to
-	 * scale + 1 so we can round-to-nearest safely.
+	 * scale + 1 so we can round-to-nearest safely. These point into
+	 * @tables, which is shared with other operations.
 	 */
+	VipsReduceKernel *tables;
 	short *matrixs[VIPS_TRANSFORM_SCALE + 1];
 	double *matrixf[VIPS_TRANSFORM_SCALE + 1];
 
@@ -233,19 +238,24 @@ vips_reducev_start(VipsImage *out, void *a, void *b)
 	return seq;
 }
 
-#ifdef HAVE_ORC
 static void
 vips_reducev_finalize(GObject *gobject)
 {
 	VipsReducev *reducev = (VipsReducev *) gobject;
 
+	VIPS_FREEF(vips_reduce_kernel_unref, reducev->tables);
+
+#ifdef HAVE_ORC
 	for (int i = 0; i < reducev->n_pass; i++)
 		VIPS_FREEF(orc_program_free, reducev->pass[i].program);
 	reducev->n_pass = 0;
+#endif /*HAVE_ORC*/
 
 	G_OBJECT_CLASS(vips_reducev_parent_class)->finalize(gobject);
 }
 
+#ifdef HAVE_ORC
+
 #define TEMP(N, S) orc_program_add_temporary(p, S, N)
 #define PARAM(N, S) orc_program_add_parameter(p, S, N)
 #define SCANLINE(N, S) orc_program_add_source(p, S, N)
@@ -404,60 +414,6 @@ vips_reducev_compile(VipsReducev *reducev)
 }
 #endif /*HAVE_ORC*/
 
-/* Reduce a block of "width" output elements at once (width <= REDUCEV_BLOCK),
- * with the tap loop outermost and the element loop innermost. Consecutive
- * output elements are contiguous within each input line, so the inner
- * multiply-add vectorises, and the per-element accumulators form independent
- * dependency chains for better instruction-level parallelism (ILP). Each
- * element sums its taps in the same order as reduce_sum(), so the result is
- * identical.
- *
- * finalize() maps one accumulated sum to an output pixel: identity for the
- * float formats, fixed-point round + clip for the integer formats.
- */
-static constexpr int REDUCEV_BLOCK = 32; // multiple of common SIMD widths, tuned
-
-template <typename T, typename CT, typename Finalize,
-	typename IT = typename LongT<T>::type>
-static void inline reducev_block(T *restrict out, const T *restrict in,
-	int width, int lskip, const CT *restrict cy, int n, Finalize finalize)
-{
-	const int l1 = lskip / sizeof(T);
-
-	g_assert(width <= REDUCEV_BLOCK);
-	IT sum[REDUCEV_BLOCK] = {};
-
-	for (int i = 0; i < n; i++) {
-		const IT c = cy[i];
-		const T *restrict p = in + i * l1;
-		for (int k = 0; k < width; k++)
-			sum[k] += c * p[k];
-	}
-
-	for (int k = 0; k < width; k++)
-		out[k] = finalize(sum[k]);
-}
-
-/* Reduce a whole line of "ne" output elements, one REDUCEV_BLOCK at a time.
- * finalize() is forwarded to reducev_block() and applied to each output.
- */
-template <typename T, typename CT, typename Finalize>
-static void inline reducev_line(T *restrict out, const T *restrict in,
-	int ne, int lskip, const CT *restrict cy, int n, Finalize finalize)
-{
-	int z;
-
-	/* do as many complete blocks as we can
-	 */
-	for (z = 0; z + REDUCEV_BLOCK <= ne; z += REDUCEV_BLOCK)
-		reducev_block<T>(out + z, in + z, REDUCEV_BLOCK, lskip, cy, n,
-			finalize);
-
-	/* do the tail (fewer than a full block)
-	 */
-	reducev_block<T>(out + z, in + z, ne - z, lskip, cy, n, finalize);
-}
-
 template <typename T, T max_value>
 static void inline reducev_unsigned_int_tab(VipsReducev *reducev,
 	VipsPel *pout, const VipsPel *pin,
@@ -940,22 +896,15 @@ vips_reducev_build(VipsObject *object)
 	 */
 	reducev->voffset = (1 + extra_pixels) / 2.0 - 1;
 
-	/* Build the tables of pre-computed coefficients.
+	/* Fetch the tables of pre-computed coefficients. They depend only on
+	 * the kernel and the residual shrink, so they are shared.
 	 */
+	if (!(reducev->tables = vips_reduce_kernel_get(reducev->kernel,
+			  reducev->residual_vshrink)))
+		return -1;
 	for (int y = 0; y < VIPS_TRANSFORM_SCALE + 1; y++) {
-		reducev->matrixf[y] = VIPS_ARRAY(object, reducev->n_point, double);
-		reducev->matrixs[y] = VIPS_ARRAY(object, reducev->n_point, short);
-		if (!reducev->matrixf[y] ||
-			!reducev->matrixs[y])
-			return -1;
-
-		vips_reduce_make_mask(reducev->matrixf[y], reducev->kernel,
-			reducev->n_point, reducev->residual_vshrink,
-			(float) y / VIPS_TRANSFORM_SCALE);
-
-		for (int i = 0; i < reducev->n_point; i++)
-			reducev->matrixs[y][i] =
-				(short) (reducev->matrixf[y][i] * VIPS_INTERPOLATE_SCALE);
+		reducev->matrixf[y] = reducev->tables->matrixf[y];
+		reducev->matrixs[y] = reducev->tables->matrixs[y];
 #ifdef DEBUG
 		printf("vips_reducev_build: mask %d\n    ", y);
 		for (int i = 0; i < reducev->n_point; i++)
@@ -1086,9 +1035,7 @@ vips_reducev_class_init(VipsReducevClass *reducev_class)
 
 	VIPS_DEBUG_MSG("vips_reducev_class_init\n");
 
-#ifdef HAVE_ORC
 	gobject_class->finalize = vips_reducev_finalize;
-#endif /*HAVE_ORC*/
 	gobject_class->set_property = vips_object_set_property;
 	gobject_class->get_property = vips_object_get_property;
 
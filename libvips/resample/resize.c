@@ -37,6 +37,11 @@
  * 	- much better handling of "nearest"
  * 22/4/22 kleisauke
  * 	- add @gap option
+ * 14/10/26
+ * 	- shrink and reduce both axes in a single pass
+ * 15/10/26
+ * 	- shrink-on-load through point operations, see
+ * 	  vips__image_shrink_on_load()
  */
 
 /*
@@ -110,6 +115,10 @@ typedef VipsResampleClass VipsResizeClass;
 
 G_DEFINE_TYPE(VipsResize, vips_resize, VIPS_TYPE_RESAMPLE);
 
+/* Set from VIPS_NOPUSHDOWN to turn shrink-on-load off.
+ */
+static gboolean vips__resize_nopushdown = FALSE;
+
 /* Suggest a VipsInterpolate which corresponds to a VipsKernel. We use
  * this to pick a thing for affine().
  */
@@ -158,6 +167,26 @@ vips_resize_build(VipsObject *object)
 	else
 		vscale = resize->scale;
 
+	/* If @in comes from a loader that can decode at a reduced size,
+	 * perhaps via some point operations, ask for that. Leave at least a
+	 * factor of two for the reduce, as thumbnail does.
+	 */
+	if (!vips__resize_nopushdown &&
+		resize->kernel != VIPS_KERNEL_NEAREST &&
+		hscale < 1.0 &&
+		vscale < 1.0 &&
+		(t[5] = vips__image_shrink_on_load(in,
+			 floor(VIPS_MIN(1.0 / hscale, 1.0 / vscale) / 2.0)))) {
+		int target_width = VIPS_ROUND_UINT(in->Xsize * hscale);
+		int target_height = VIPS_ROUND_UINT(in->Ysize * vscale);
+
+		g_info("shrink-on-load to %d x %d",
+			t[5]->Xsize, t[5]->Ysize);
+		hscale = (double) VIPS_MAX(1, target_width) / t[5]->Xsize;
+		vscale = (double) VIPS_MAX(1, target_height) / t[5]->Ysize;
+		in = t[5];
+	}
+
 	/* Unpack for processing.
 	 */
 	if (vips_image_decode(in, &t[0]))
@@ -208,26 +237,38 @@ vips_resize_build(VipsObject *object)
 	hscale = VIPS_MAX(hscale, 1.0 / in->Xsize);
 	vscale = VIPS_MAX(vscale, 1.0 / in->Ysize);
 
-	/* Any residual downsizing.
+	/* Any residual downsizing. If both axes are shrinking, do the box
+	 * shrinks and the kernel reduces in a single pass.
 	 */
-	if (vscale < 1.0) {
-		g_info("residual reducev by %g", vscale);
-		if (vips_reducev(in, &t[2], 1.0 / vscale,
-				"kernel", resize->kernel,
-				"gap", resize->gap,
-				NULL))
+	if (vscale < 1.0 &&
+		hscale < 1.0 &&
+		resize->kernel != VIPS_KERNEL_NEAREST) {
+		g_info("residual reduce by %g x %g", hscale, vscale);
+		if (vips__reduce_fused(in, &t[2], 1.0 / hscale, 1.0 / vscale,
+				resize->kernel, resize->gap))
 			return -1;
 		in = t[2];
 	}
+	else {
+		if (vscale < 1.0) {
+			g_info("residual reducev by %g", vscale);
+			if (vips_reducev(in, &t[2], 1.0 / vscale,
+					"kernel", resize->kernel,
+					"gap", resize->gap,
+					NULL))
+				return -1;
+			in = t[2];
+		}
 
-	if (hscale < 1.0) {
-		g_info("residual reduceh by %g", hscale);
-		if (vips_reduceh(in, &t[3], 1.0 / hscale,
-				"kernel", resize->kernel,
-				"gap", resize->gap,
-				NULL))
-			return -1;
-		in = t[3];
+		if (hscale < 1.0) {
+			g_info("residual reduceh by %g", hscale);
+			if (vips_reduceh(in, &t[3], 1.0 / hscale,
+					"kernel", resize->kernel,
+					"gap", resize->gap,
+					NULL))
+				return -1;
+			in = t[3];
+		}
 	}
 
 	/* Any upsizing.
@@ -326,6 +367,9 @@ vips_resize_class_init(VipsResizeClass *class)
 	vobject_class->description = _("resize an image");
 	vobject_class->build = vips_resize_build;
 
+	if (g_getenv("VIPS_NOPUSHDOWN"))
+		vips__resize_nopushdown = TRUE;
+
 	operation_class->flags = VIPS_OPERATION_SEQUENTIAL;
 
 	VIPS_ARG_DOUBLE(class, "scale", 113,
@@ -427,6 +471,13 @@ vips_resize_init(VipsResize *resize)
  * @vscale, that factor is used for the vertical scale and @scale for the
  * horizontal.
  *
+ * If @in comes from a file or buffer loader which can decode at a reduced
+ * size (for example JPEG, WebP, PNG, PDF or SVG), perhaps via some
+ * arithmetic or colour point operations, and no pixels have been read yet,
+ * [method@Image.resize] reloads it at up to half the final shrink and replays
+ * the point operations on the smaller image. Set `VIPS_NOPUSHDOWN` to turn
+ * this off.
+ *
  * If either axis would drop below 1px in size, the shrink in that dimension
  * is limited. This breaks the image aspect ratio, but prevents errors due to
  * fractional pixel sizes.
@@ -576,3 +576,57 @@ static IT inline reduce_sum(const T *restrict in, int stride,
 
 	return sum;
 }
+
+/* Reduce a block of "width" output elements at once (width <= REDUCEV_BLOCK),
+ * with the tap loop outermost and the element loop innermost. Consecutive
+ * output elements are contiguous within each input line, so the inner
+ * multiply-add vectorises, and the per-element accumulators form independent
+ * dependency chains for better instruction-level parallelism (ILP). Each
+ * element sums its taps in the same order as reduce_sum(), so the result is
+ * identical.
+ *
+ * finalize() maps one accumulated sum to an output pixel: identity for the
+ * float formats, fixed-point round + clip for the integer formats.
+ */
+static constexpr int REDUCEV_BLOCK = 32; // multiple of common SIMD widths, tuned
+
+template <typename T, typename CT, typename Finalize,
+	typename IT = typename LongT<T>::type>
+static void inline reducev_block(T *restrict out, const T *restrict in,
+	int width, int lskip, const CT *restrict cy, int n, Finalize finalize)
+{
+	const int l1 = lskip / sizeof(T);
+
+	g_assert(width <= REDUCEV_BLOCK);
+	IT sum[REDUCEV_BLOCK] = {};
+
+	for (int i = 0; i < n; i++) {
+		const IT c = cy[i];
+		const T *restrict p = in + i * l1;
+		for (int k = 0; k < width; k++)
+			sum[k] += c * p[k];
+	}
+
+	for (int k = 0; k < width; k++)
+		out[k] = finalize(sum[k]);
+}
+
+/* Reduce a whole line of "ne" output elements, one REDUCEV_BLOCK at a time.
+ * finalize() is forwarded to reducev_block() and applied to each output.
+ */
+template <typename T, typename CT, typename Finalize>
+static void inline reducev_line(T *restrict out, const T *restrict in,
+	int ne, int lskip, const CT *restrict cy, int n, Finalize finalize)
+{
+	int z;
+
+	/* do as many complete blocks as we can
+	 */
+	for (z = 0; z + REDUCEV_BLOCK <= ne; z += REDUCEV_BLOCK)
+		reducev_block<T>(out + z, in + z, REDUCEV_BLOCK, lskip, cy, n,
+			finalize);
+
+	/* do the tail (fewer than a full block)
+	 */
+	reducev_block<T>(out + z, in + z, ne - z, lskip, cy, n, finalize);
+}
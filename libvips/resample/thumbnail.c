@@ -43,6 +43,16 @@
  *	- make icc profile transforms always write 8 bits
  * 22/8/25 kleisauke
  *	- remove seq line cache from thumbnail_image, use hint instead
+ * 14/10/26
+ *	- shrink-on-load for interlaced PNG
+ *	- build the pipeline in a cache scope
+ * 15/10/26
+ *	- use M/8 scaled decode for jpeg shrink-on-load
+ *	- add per_frame
+ *	- shrink-on-load for EXR mip levels
+ *	- use the embedded preview or half_size for camera RAW
+ *	- linear mode for 8-bit sRGB goes via 16-bit linear with a pair of
+ *	  LUTs rather than float scRGB
  */
 
 /*
@@ -124,6 +134,7 @@ typedef struct _VipsThumbnail {
 	char *input_profile;
 	VipsIntent intent;
 	VipsFailOn fail_on;
+	gboolean per_frame;
 
 	/* Bits of info we read from the input image when we get the header of
 	 * the original.
@@ -149,6 +160,14 @@ typedef struct _VipsThumbnail {
 	int heif_thumbnail_width;
 	int heif_thumbnail_height;
 
+	/* For camera RAW, the embedded preview JPEG (if any), its size, and
+	 * whether we've picked it as the source.
+	 */
+	VipsBlob *raw_preview;
+	int raw_preview_width;
+	int raw_preview_height;
+	gboolean use_raw_preview;
+
 	/* Pyramids are stored in subifds.
 	 */
 	gboolean subifd_pyramid;
@@ -157,6 +176,10 @@ typedef struct _VipsThumbnail {
 	 */
 	gboolean page_pyramid;
 
+	/* An interlaced PNG: we can decode just some of the passes.
+	 */
+	gboolean interlaced;
+
 } VipsThumbnail;
 
 typedef struct _VipsThumbnailClass {
@@ -181,12 +204,19 @@ G_DEFINE_ABSTRACT_TYPE(VipsThumbnail, vips_thumbnail, VIPS_TYPE_OPERATION);
 static void
 vips_thumbnail_dispose(GObject *gobject)
 {
+	VipsThumbnail *thumbnail = (VipsThumbnail *) gobject;
+
 #ifdef DEBUG
 	printf("vips_thumbnail_dispose: ");
 	vips_object_print_name(VIPS_OBJECT(gobject));
 	printf("\n");
 #endif /*DEBUG*/
 
+	if (thumbnail->raw_preview) {
+		vips_area_unref(VIPS_AREA(thumbnail->raw_preview));
+		thumbnail->raw_preview = NULL;
+	}
+
 	G_OBJECT_CLASS(vips_thumbnail_parent_class)->dispose(gobject);
 }
 
@@ -227,6 +257,7 @@ vips_thumbnail_read_header(VipsThumbnail *thumbnail, VipsImage *image)
 	thumbnail->page_height = vips_image_get_page_height(image);
 	thumbnail->n_pages = vips_image_get_n_pages(image);
 	thumbnail->n_subifds = vips_image_get_n_subifds(image);
+	thumbnail->interlaced = vips_image_get_typeof(image, "interlaced") != 0;
 
 	/* VIPS_META_N_PAGES is the number of pages in the document,
 	 * not the number we've read out into this image. We calculate
@@ -257,6 +288,20 @@ vips_thumbnail_read_header(VipsThumbnail *thumbnail, VipsImage *image)
 			thumbnail->level_height[level] = get_int(image, name, 0);
 		}
 	}
+
+	/* For camera RAW, take a copy of the embedded preview, if dcrawload
+	 * found a usable one.
+	 */
+	if (vips_isprefix("VipsForeignLoadDcRaw", thumbnail->loader) &&
+		!thumbnail->raw_preview &&
+		vips_image_get_typeof(image, "raw-thumbnail-data")) {
+		const void *data;
+		size_t length;
+
+		if (!vips_image_get_blob(image, "raw-thumbnail-data",
+				&data, &length))
+			thumbnail->raw_preview = vips_blob_copy(data, length);
+	}
 }
 
 /* Detect a pyramid made of pages following a roughly /2 shrink.
@@ -402,6 +447,70 @@ vips_thumbnail_get_heif_thumb_info(VipsThumbnail *thumbnail)
 	return 0;
 }
 
+/* Load the embedded RAW preview, shrinking by factor.
+ */
+static VipsImage *
+vips_thumbnail_open_raw_preview(VipsThumbnail *thumbnail, double factor)
+{
+	VipsSource *source;
+	VipsImage *preview;
+	VipsImage *out;
+
+	if (!(source = vips_source_new_from_blob(thumbnail->raw_preview)))
+		return NULL;
+	if (vips_jpegload_source(source, &preview,
+			"access", VIPS_ACCESS_SEQUENTIAL,
+			"fail_on", thumbnail->fail_on,
+			"scale", 1.0 / factor,
+			NULL)) {
+		VIPS_UNREF(source);
+		return NULL;
+	}
+	VIPS_UNREF(source);
+
+	/* Previews are stored in sensor orientation and rarely have a tag of
+	 * their own, so use the orientation of the main image.
+	 */
+	if (vips_copy(preview, &out, NULL)) {
+		VIPS_UNREF(preview);
+		return NULL;
+	}
+	VIPS_UNREF(preview);
+	vips_image_set_int(out, VIPS_META_ORIENTATION, thumbnail->orientation);
+
+	return out;
+}
+
+/* Fetch the size of the embedded RAW preview. Ignore previews which don't
+ * match the aspect ratio of the main image, they are usually letterboxed or
+ * cropped.
+ */
+static void
+vips_thumbnail_get_raw_preview_info(VipsThumbnail *thumbnail)
+{
+	VipsImage *preview;
+	double aspect;
+	double preview_aspect;
+
+	if (!thumbnail->raw_preview ||
+		!(preview = vips_thumbnail_open_raw_preview(thumbnail, 1.0))) {
+		/* A broken preview is not an error, we just use the main
+		 * image.
+		 */
+		vips_error_clear();
+		return;
+	}
+
+	aspect = (double) thumbnail->input_width / thumbnail->input_height;
+	preview_aspect = (double) preview->Xsize / preview->Ysize;
+	if (fabs(aspect - preview_aspect) < 0.01 * aspect) {
+		thumbnail->raw_preview_width = preview->Xsize;
+		thumbnail->raw_preview_height = preview->Ysize;
+	}
+
+	VIPS_UNREF(preview);
+}
+
 /* Calculate the shrink factor, taking into account auto-rotate, the fit mode,
  * and so on.
  *
@@ -516,6 +625,31 @@ vips_thumbnail_find_jpegshrink(VipsThumbnail *thumbnail,
 		return 1;
 }
 
+/* Find the best jpeg scaled decode. libjpeg can decode at any M/8, so we
+ * can get closer to the target than with a power of two shrink.
+ */
+static double
+vips_thumbnail_find_jpegscale(VipsThumbnail *thumbnail,
+	int width, int height)
+{
+	double shrink = vips_thumbnail_calculate_common_shrink(thumbnail,
+		width, height);
+
+	int scale_num;
+
+	/* As vips_thumbnail_find_jpegshrink().
+	 */
+	if (thumbnail->linear)
+		return 1.0;
+
+	/* Leave at least a factor of two for the final resize step, so pick
+	 * the smallest M with 8 / M <= shrink / 2.
+	 */
+	scale_num = VIPS_CLIP(1, ceil(16.0 / shrink - 0.001), 8);
+
+	return 8.0 / scale_num;
+}
+
 /* Find the best pyramid (openslide, tiff, etc.) level.
  */
 static int
@@ -580,9 +714,10 @@ vips_thumbnail_open(VipsThumbnail *thumbnail)
 		}
 	}
 
-	/* jp2k uses page-based pyramids.
+	/* jp2k uses page-based pyramids, and EXR mip levels are pages.
 	 */
-	if (vips_isprefix("VipsForeignLoadJp2k", thumbnail->loader)) {
+	if (vips_isprefix("VipsForeignLoadJp2k", thumbnail->loader) ||
+		vips_isprefix("VipsForeignLoadOpenexr", thumbnail->loader)) {
 		if (thumbnail->level_count == 0) {
 			thumbnail->subifd_pyramid = FALSE;
 			thumbnail->page_pyramid = TRUE;
@@ -600,20 +735,30 @@ vips_thumbnail_open(VipsThumbnail *thumbnail)
 	if (vips_isprefix("VipsForeignLoadHeif", thumbnail->loader))
 		vips_thumbnail_get_heif_thumb_info(thumbnail);
 
+	/* Same for the preview JPEG embedded in most camera RAW files.
+	 */
+	if (vips_isprefix("VipsForeignLoadDcRaw", thumbnail->loader))
+		vips_thumbnail_get_raw_preview_info(thumbnail);
+
 	/* We read the openslide level structure in
 	 * vips_thumbnail_read_header().
 	 */
 
 	factor = 1.0;
 
-	if (vips_isprefix("VipsForeignLoadJpeg", thumbnail->loader) ||
-		vips_isprefix("VipsForeignLoadUhdr", thumbnail->loader)) {
+	if (vips_isprefix("VipsForeignLoadJpeg", thumbnail->loader)) {
+		factor = vips_thumbnail_find_jpegscale(thumbnail,
+			thumbnail->input_width, thumbnail->input_height);
+		g_info("loading with factor %g pre-shrink", factor);
+	}
+	else if (vips_isprefix("VipsForeignLoadUhdr", thumbnail->loader)) {
 		factor = vips_thumbnail_find_jpegshrink(thumbnail,
 			thumbnail->input_width, thumbnail->input_height);
 		g_info("loading with factor %g pre-shrink", factor);
 	}
 	else if (vips_isprefix("VipsForeignLoadTiff", thumbnail->loader) ||
 		vips_isprefix("VipsForeignLoadJp2k", thumbnail->loader) ||
+		vips_isprefix("VipsForeignLoadOpenexr", thumbnail->loader) ||
 		vips_isprefix("VipsForeignLoadOpenslide", thumbnail->loader)) {
 		if (thumbnail->level_count > 0) {
 			factor = vips_thumbnail_find_pyrlevel(thumbnail,
@@ -624,6 +769,17 @@ vips_thumbnail_open(VipsThumbnail *thumbnail)
 		else
 			g_info("loading with factor %g pre-shrink", factor);
 	}
+#ifdef HAVE_SPNG
+	else if (vips_isprefix("VipsForeignLoadPng", thumbnail->loader) &&
+		thumbnail->interlaced) {
+		/* Adam7 passes give the same 1/2, 1/4 and 1/8 choice as
+		 * libjpeg, and the same rules apply.
+		 */
+		factor = vips_thumbnail_find_jpegshrink(thumbnail,
+			thumbnail->input_width, thumbnail->input_height);
+		g_info("loading with factor %g pre-shrink", factor);
+	}
+#endif /*HAVE_SPNG*/
 	else if (vips_isprefix("VipsForeignLoadWebp", thumbnail->loader)) {
 		factor = vips_thumbnail_calculate_common_shrink(thumbnail,
 			thumbnail->input_width,
@@ -665,8 +821,38 @@ vips_thumbnail_open(VipsThumbnail *thumbnail)
 		else
 			g_info("selected main HEIF image for shrinking");
 	}
+	else if (vips_isprefix("VipsForeignLoadDcRaw", thumbnail->loader)) {
+		/* Use the embedded preview if it's large enough that we won't
+		 * need to expand it, as for HEIF. Otherwise, demosaic at half
+		 * size if we are shrinking by at least two.
+		 */
+		if (thumbnail->raw_preview_width > 0 &&
+			vips_thumbnail_calculate_common_shrink(thumbnail,
+				thumbnail->raw_preview_width,
+				thumbnail->raw_preview_height) > 1.0) {
+			thumbnail->use_raw_preview = TRUE;
+			factor = vips_thumbnail_find_jpegscale(thumbnail,
+				thumbnail->raw_preview_width,
+				thumbnail->raw_preview_height);
+			g_info("selected RAW preview, loading with factor %g "
+				   "pre-shrink",
+				factor);
+		}
+		else {
+			double shrink = vips_thumbnail_calculate_common_shrink(
+				thumbnail,
+				thumbnail->input_width, thumbnail->input_height);
+
+			factor = shrink >= 2.0 ? 2 : 1;
+			g_info("loading with factor %g pre-shrink", factor);
+		}
+	}
 
-	if (!(im = class->open(thumbnail, factor)))
+	if (thumbnail->use_raw_preview) {
+		if (!(im = vips_thumbnail_open_raw_preview(thumbnail, factor)))
+			return NULL;
+	}
+	else if (!(im = class->open(thumbnail, factor)))
 		return NULL;
 
 	g_info("pre-shrunk size is %d x %d", im->Xsize, im->Ysize);
@@ -709,11 +895,292 @@ vips_thumbnail_crop_pages(VipsObject *object, VipsImage *in,
 	return out;
 }
 
+/* Resize the pages of a multi-page image as separate images. Pages are
+ * decoded in order, one at a time, and handed to a set of workers to
+ * resize, with at most max_in_flight pages decoded but not yet resized.
+ */
+typedef struct _VipsThumbnailFrames {
+	VipsImage *in;
+	int page_height;
+	int n_pages;
+	double hscale;
+	double vscale;
+
+	/* Decoded pages waiting for a worker, and the resized pages.
+	 */
+	VipsImage **decoded;
+	VipsImage **resized;
+
+	GMutex lock;
+	GCond cond;
+	int next_decode;
+	int next_resize;
+	int n_in_flight;
+	int max_in_flight;
+	gboolean decoding;
+	int n_running;
+	gboolean failed;
+} VipsThumbnailFrames;
+
+static VipsImage *
+vips_thumbnail_frames_decode(VipsThumbnailFrames *frames, int i)
+{
+	VipsImage *x;
+	VipsImage *page;
+
+	if (vips_crop(frames->in, &x,
+			0, i * frames->page_height,
+			frames->in->Xsize, frames->page_height, NULL))
+		return NULL;
+	page = vips_image_copy_memory(x);
+	g_object_unref(x);
+
+	return page;
+}
+
+static VipsImage *
+vips_thumbnail_frames_resize(VipsThumbnailFrames *frames, VipsImage *page)
+{
+	VipsImage *x;
+	VipsImage *resized;
+
+	if (vips_resize(page, &x, frames->hscale,
+			"vscale", frames->vscale,
+			NULL))
+		return NULL;
+	resized = vips_image_copy_memory(x);
+	g_object_unref(x);
+
+	return resized;
+}
+
+/* Each worker resizes the next decoded page, or decodes the next page if
+ * no one else is, or waits.
+ */
+static void
+vips_thumbnail_frames_work(void *a, void *b)
+{
+	VipsThumbnailFrames *frames = (VipsThumbnailFrames *) a;
+
+	vips__worker_lock(&frames->lock);
+
+	for (;;) {
+		int i;
+
+		if (frames->failed ||
+			frames->next_resize >= frames->n_pages)
+			break;
+
+		if (frames->next_resize < frames->next_decode) {
+			VipsImage *page;
+			VipsImage *resized;
+
+			i = frames->next_resize++;
+			page = frames->decoded[i];
+			frames->decoded[i] = NULL;
+			g_mutex_unlock(&frames->lock);
+
+			resized = vips_thumbnail_frames_resize(frames, page);
+			g_object_unref(page);
+
+			vips__worker_lock(&frames->lock);
+			frames->resized[i] = resized;
+			if (!resized)
+				frames->failed = TRUE;
+			frames->n_in_flight -= 1;
+			g_cond_broadcast(&frames->cond);
+		}
+		else if (!frames->decoding &&
+			frames->next_decode < frames->n_pages &&
+			frames->n_in_flight < frames->max_in_flight) {
+			VipsImage *page;
+
+			i = frames->next_decode;
+			frames->decoding = TRUE;
+			g_mutex_unlock(&frames->lock);
+
+			page = vips_thumbnail_frames_decode(frames, i);
+
+			vips__worker_lock(&frames->lock);
+			frames->decoding = FALSE;
+			if (page) {
+				frames->decoded[i] = page;
+				frames->next_decode += 1;
+				frames->n_in_flight += 1;
+			}
+			else
+				frames->failed = TRUE;
+			g_cond_broadcast(&frames->cond);
+		}
+		else
+			vips__worker_cond_wait(&frames->cond, &frames->lock);
+	}
+
+	/* The caller can free frames as soon as we unlock, so this must be
+	 * the last thing we do.
+	 */
+	frames->n_running -= 1;
+	g_cond_broadcast(&frames->cond);
+	g_mutex_unlock(&frames->lock);
+}
+
+static VipsImage *
+vips_thumbnail_resize_frames(VipsThumbnail *thumbnail, VipsImage *in,
+	int page_height, double hscale, double vscale)
+{
+	VipsThumbnailFrames frames = { 0 };
+	int n_workers;
+	VipsImage *out;
+
+	frames.in = in;
+	frames.page_height = page_height;
+	frames.n_pages = in->Ysize / page_height;
+	frames.hscale = hscale;
+	frames.vscale = vscale;
+	frames.decoded = VIPS_ARRAY(NULL, frames.n_pages, VipsImage *);
+	frames.resized = (VipsImage **)
+		vips_object_local_array(VIPS_OBJECT(thumbnail), frames.n_pages);
+	if (!frames.decoded)
+		return NULL;
+	for (int i = 0; i < frames.n_pages; i++)
+		frames.decoded[i] = NULL;
+	g_mutex_init(&frames.lock);
+	g_cond_init(&frames.cond);
+	frames.max_in_flight = VIPS_MAX(1, vips_concurrency_get());
+
+	g_info("resizing %d pages separately", frames.n_pages);
+
+	n_workers = VIPS_MIN(frames.max_in_flight, frames.n_pages);
+
+	vips__worker_lock(&frames.lock);
+	for (int i = 0; i < n_workers; i++) {
+		frames.n_running += 1;
+		if (vips_thread_execute("thumbnail",
+				vips_thumbnail_frames_work, &frames))
+			frames.n_running -= 1;
+	}
+
+	/* If we couldn't start any workers, do it ourselves.
+	 */
+	if (frames.n_running == 0) {
+		frames.n_running += 1;
+		g_mutex_unlock(&frames.lock);
+		vips_thumbnail_frames_work(&frames, NULL);
+		vips__worker_lock(&frames.lock);
+	}
+
+	while (frames.n_running > 0)
+		vips__worker_cond_wait(&frames.cond, &frames.lock);
+	g_mutex_unlock(&frames.lock);
+
+	for (int i = 0; i < frames.n_pages; i++)
+		VIPS_UNREF(frames.decoded[i]);
+	g_free(frames.decoded);
+	g_mutex_clear(&frames.lock);
+	g_cond_clear(&frames.cond);
+
+	if (frames.failed ||
+		vips_arrayjoin(frames.resized, &out, frames.n_pages,
+			"across", 1,
+			NULL))
+		return NULL;
+
+	return out;
+}
+
+/* 8-bit sRGB to 16-bit linear light, and 16-bit linear light back to 8-bit
+ * sRGB.
+ */
+static unsigned short vips_thumbnail_v2Y[256];
+static VipsPel vips_thumbnail_Y2v[65536];
+
+static void *
+vips_thumbnail_build_tables(void *client)
+{
+	int i;
+
+	for (i = 0; i < 256; i++) {
+		float R, G, B;
+
+		(void) vips_col_sRGB2scRGB_8(i, i, i, &R, &G, &B);
+		vips_thumbnail_v2Y[i] = VIPS_CLIP(0, rint(R * 65535.0), 65535);
+	}
+
+	for (i = 0; i < 65536; i++) {
+		float Y = i / 65535.0;
+
+		int r, g, b;
+
+		(void) vips_col_scRGB2sRGB_8(Y, Y, Y, &r, &g, &b, NULL);
+		vips_thumbnail_Y2v[i] = r;
+	}
+
+	return NULL;
+}
+
+/* Can we do a linear shrink of this image with the LUT pair? We need 8-bit
+ * sRGB or B_W, and no colour management, since we never make scRGB.
+ */
+static gboolean
+vips_thumbnail_linear_lut(VipsThumbnail *thumbnail, VipsImage *in)
+{
+	VipsInterpretation interpretation = vips_image_guess_interpretation(in);
+
+	return in->Coding == VIPS_CODING_NONE &&
+		in->BandFmt == VIPS_FORMAT_UCHAR &&
+		!thumbnail->output_profile &&
+		((in->Bands >= 3 &&
+			 interpretation == VIPS_INTERPRETATION_sRGB) ||
+			(in->Bands < 3 &&
+				interpretation == VIPS_INTERPRETATION_B_W));
+}
+
+/* Make a LUT for vips_maplut() with @bands bands. The first @n_colour bands
+ * go through the gamma table, any others (eg. alpha) are just rescaled.
+ */
+static VipsImage *
+vips_thumbnail_lut_new(int bands, int n_colour, gboolean to_linear)
+{
+	static GOnce once = G_ONCE_INIT;
+
+	VipsBandFormat format = to_linear
+		? VIPS_FORMAT_USHORT
+		: VIPS_FORMAT_UCHAR;
+	int width = to_linear ? 256 : 65536;
+	size_t size = (size_t) width * bands * vips_format_sizeof(format);
+
+	void *data;
+	VipsImage *lut;
+	int x, b;
+
+	VIPS_ONCE(&once, vips_thumbnail_build_tables, NULL);
+
+	if (!(data = vips_malloc(NULL, size)))
+		return NULL;
+
+	for (x = 0; x < width; x++)
+		for (b = 0; b < bands; b++)
+			if (to_linear)
+				((unsigned short *) data)[x * bands + b] = b < n_colour
+					? vips_thumbnail_v2Y[x]
+					: x * 257;
+			else
+				((VipsPel *) data)[x * bands + b] = b < n_colour
+					? vips_thumbnail_Y2v[x]
+					: (x + 128) / 257;
+
+	lut = vips_image_new_from_memory_copy(data, size,
+		width, 1, bands, format);
+	g_free(data);
+
+	return lut;
+}
+
 static int
-vips_thumbnail_build(VipsObject *object)
+vips_thumbnail_build_pipeline(VipsObject *object)
 {
 	VipsThumbnail *thumbnail = VIPS_THUMBNAIL(object);
-	VipsImage **t = (VipsImage **) vips_object_local_array(object, 20);
+	VipsImage **t = (VipsImage **) vips_object_local_array(object, 24);
 
 	VipsImage *in;
 	int preshrunk_page_height;
@@ -730,6 +1197,12 @@ vips_thumbnail_build(VipsObject *object)
 	 */
 	gboolean needs_icc_transform;
 
+	/* TRUE if we've gone to 16-bit linear with a LUT, and the
+	 * interpretation we need to go back to.
+	 */
+	gboolean have_linear_lut;
+	VipsInterpretation linear_lut_interpretation;
+
 	/* The format we need to revert to after unpremultiply.
 	 */
 	VipsBandFormat unpremultiplied_format;
@@ -793,6 +1266,8 @@ vips_thumbnail_build(VipsObject *object)
 	 * vips_resize().
 	 */
 	have_imported = FALSE;
+	have_linear_lut = FALSE;
+	linear_lut_interpretation = VIPS_INTERPRETATION_sRGB;
 	if (has_cicp) {
 		/* Skip colourspace conversion for CICP images.
 		 */
@@ -822,6 +1297,30 @@ vips_thumbnail_build(VipsObject *object)
 
 			have_imported = TRUE;
 		}
+		else if (vips_thumbnail_linear_lut(thumbnail, in)) {
+			/* 8-bit sRGB or B_W: a 256 entry LUT takes us to 16-bit
+			 * linear light, much quicker than float scRGB. Tag it as
+			 * 16-bit so premultiply picks the right alpha range.
+			 */
+			int n_colour = in->Bands >= 3 ? 3 : 1;
+
+			linear_lut_interpretation = in->Bands >= 3
+				? VIPS_INTERPRETATION_sRGB
+				: VIPS_INTERPRETATION_B_W;
+
+			g_info("converting to 16-bit linear light with a LUT");
+			if (!(t[20] = vips_thumbnail_lut_new(in->Bands, n_colour, TRUE)) ||
+				vips_maplut(in, &t[21], t[20], NULL) ||
+				vips_copy(t[21], &t[2],
+					"interpretation", in->Bands >= 3
+						? VIPS_INTERPRETATION_RGB16
+						: VIPS_INTERPRETATION_GREY16,
+					NULL))
+				return -1;
+			in = t[2];
+
+			have_linear_lut = TRUE;
+		}
 		else {
 			/* Otherwise, use scRGB or GREY16 for linear shrink.
 			 */
@@ -895,7 +1394,18 @@ vips_thumbnail_build(VipsObject *object)
 		in = t[3];
 	}
 
-	if (vips_resize(in, &t[5], 1.0 / hshrink, "vscale", 1.0 / vshrink, NULL))
+	/* Resizing pages separately stops pixels leaking between pages, and
+	 * lets several pages resize at once.
+	 */
+	if (thumbnail->per_frame &&
+		thumbnail->n_loaded_pages > 1 &&
+		!vips_image_get_typeof(in, "gainmap")) {
+		if (!(t[5] = vips_thumbnail_resize_frames(thumbnail, in,
+				  preshrunk_page_height, 1.0 / hshrink, 1.0 / vshrink)))
+			return -1;
+	}
+	else if (vips_resize(in, &t[5],
+			1.0 / hshrink, "vscale", 1.0 / vshrink, NULL))
 		return -1;
 	in = t[5];
 
@@ -1003,6 +1513,21 @@ vips_thumbnail_build(VipsObject *object)
 			return -1;
 		in = t[10];
 	}
+	else if (have_linear_lut) {
+		/* 16-bit linear light back to 8-bit with a 65536 entry LUT.
+		 */
+		g_info("converting to output space %s with a LUT",
+			vips_enum_nick(VIPS_TYPE_INTERPRETATION,
+				linear_lut_interpretation));
+		if (!(t[22] = vips_thumbnail_lut_new(in->Bands,
+				  in->Bands >= 3 ? 3 : 1, FALSE)) ||
+			vips_maplut(in, &t[23], t[22], NULL) ||
+			vips_copy(t[23], &t[9],
+				"interpretation", linear_lut_interpretation,
+				NULL))
+			return -1;
+		in = t[9];
+	}
 	else if (thumbnail->linear) {
 		/* We are in one of the scRGB or GREY16 spaces and there's
 		 * no output profile. Output to sRGB or B_W.
@@ -1140,6 +1665,21 @@ vips_thumbnail_build(VipsObject *object)
 	return 0;
 }
 
+/* The image, alpha and gainmap paths can make the same conversions of the
+ * same input, so build inside a scope to share them.
+ */
+static int
+vips_thumbnail_build(VipsObject *object)
+{
+	int result;
+
+	vips_cache_scope_begin();
+	result = vips_thumbnail_build_pipeline(object);
+	vips_cache_scope_end();
+
+	return result;
+}
+
 static void
 vips_thumbnail_class_init(VipsThumbnailClass *class)
 {
@@ -1251,6 +1791,13 @@ vips_thumbnail_class_init(VipsThumbnailClass *class)
 		G_STRUCT_OFFSET(VipsThumbnail, fail_on),
 		VIPS_TYPE_FAIL_ON, VIPS_FAIL_ON_NONE);
 
+	VIPS_ARG_BOOL(class, "per_frame", 124,
+		_("Per frame"),
+		_("Resize the pages of a multi-page image separately"),
+		VIPS_ARGUMENT_OPTIONAL_INPUT,
+		G_STRUCT_OFFSET(VipsThumbnail, per_frame),
+		FALSE);
+
 	/* BOOL args which default TRUE arguments don't work with the
 	 * command-line -- GOption does not allow --auto-rotate=false.
 	 *
@@ -1333,8 +1880,14 @@ vips_thumbnail_file_open(VipsThumbnail *thumbnail, double factor)
 {
 	VipsThumbnailFile *file = (VipsThumbnailFile *) thumbnail;
 
-	if (vips_isprefix("VipsForeignLoadJpeg", thumbnail->loader) ||
-		vips_isprefix("VipsForeignLoadUhdr", thumbnail->loader)) {
+	if (vips_isprefix("VipsForeignLoadJpeg", thumbnail->loader)) {
+		return vips_image_new_from_file(file->filename,
+			"access", VIPS_ACCESS_SEQUENTIAL,
+			"fail_on", thumbnail->fail_on,
+			"scale", 1.0 / factor,
+			NULL);
+	}
+	else if (vips_isprefix("VipsForeignLoadUhdr", thumbnail->loader)) {
 		return vips_image_new_from_file(file->filename,
 			"access", VIPS_ACCESS_SEQUENTIAL,
 			"fail_on", thumbnail->fail_on,
@@ -1357,8 +1910,9 @@ vips_thumbnail_file_open(VipsThumbnail *thumbnail, double factor)
 			"scale", 1.0 / factor,
 			NULL);
 	}
-	else if (vips_isprefix("VipsForeignLoadJp2k", thumbnail->loader)) {
-		/* jp2k optionally uses page-based pyramids.
+	else if (vips_isprefix("VipsForeignLoadJp2k", thumbnail->loader) ||
+		vips_isprefix("VipsForeignLoadOpenexr", thumbnail->loader)) {
+		/* jp2k and EXR optionally use page-based pyramids.
 		 */
 		if (thumbnail->page_pyramid)
 			return vips_image_new_from_file(file->filename,
@@ -1400,6 +1954,23 @@ vips_thumbnail_file_open(VipsThumbnail *thumbnail, double factor)
 			"thumbnail", (int) factor,
 			NULL);
 	}
+	else if (vips_isprefix("VipsForeignLoadDcRaw", thumbnail->loader)) {
+		return vips_image_new_from_file(file->filename,
+			"access", VIPS_ACCESS_SEQUENTIAL,
+			"fail_on", thumbnail->fail_on,
+			"half_size", factor >= 2,
+			NULL);
+	}
+#ifdef HAVE_SPNG
+	else if (vips_isprefix("VipsForeignLoadPng", thumbnail->loader) &&
+		thumbnail->interlaced) {
+		return vips_image_new_from_file(file->filename,
+			"access", VIPS_ACCESS_SEQUENTIAL,
+			"fail_on", thumbnail->fail_on,
+			"shrink", (int) factor,
+			NULL);
+	}
+#endif /*HAVE_SPNG*/
 	else {
 		return vips_image_new_from_file(file->filename,
 			"access", VIPS_ACCESS_SEQUENTIAL,
@@ -1484,7 +2055,9 @@ vips_thumbnail_file_init(VipsThumbnailFile *file)
  * Shrinking is normally done in sRGB colourspace. Set @linear to shrink in
  * linear light colourspace instead. This can give better results, but can
  * also be far slower, since tricks like JPEG shrink-on-load cannot be used in
- * linear space.
+ * linear space. 8-bit sRGB images with no colour management shrink in
+ * 16-bit linear light, which is much quicker than the float scRGB used
+ * otherwise.
  *
  * If you set @output_profile to the filename of an ICC profile, the image
  * will be transformed to the target colourspace before writing to the
@@ -1498,6 +2071,12 @@ vips_thumbnail_file_init(VipsThumbnailFile *file)
  * Use @fail_on to control the types of error that will cause loading to fail.
  * The default is [enum@Vips.FailOn.NONE], ie. thumbnail is permissive.
  *
+ * Set @per_frame to resize each page of a multi-page or animated image as a
+ * separate image. Pages are decoded in order and resized by a set of
+ * workers, with a bounded number of decoded pages in memory at once. This
+ * is much quicker for animations with many small frames, and stops pixels
+ * leaking between pages. The output is computed when the operation is built.
+ *
  * ::: tip "Optional arguments"
  *     * @height: `gint`, target height in pixels
  *     * @size: [enum@Size], upsize, downsize, both or force
@@ -1511,6 +2090,7 @@ vips_thumbnail_file_init(VipsThumbnailFile *file)
  *     * @input_profile: `gchararray`, fallback input ICC profile
  *     * @output_profile: `gchararray`, output ICC profile
  *     * @intent: [enum@Intent], rendering intent
+ *     * @per_frame: `gboolean`, resize each page separately
  *     * @fail_on: [enum@FailOn], load error types to fail on
  *
  * ::: seealso
@@ -1575,8 +2155,15 @@ vips_thumbnail_buffer_open(VipsThumbnail *thumbnail, double factor)
 {
 	VipsThumbnailBuffer *buffer = (VipsThumbnailBuffer *) thumbnail;
 
-	if (vips_isprefix("VipsForeignLoadJpeg", thumbnail->loader) ||
-		vips_isprefix("VipsForeignLoadUhdr", thumbnail->loader)) {
+	if (vips_isprefix("VipsForeignLoadJpeg", thumbnail->loader)) {
+		return vips_image_new_from_buffer(
+			buffer->buf->data, buffer->buf->length,
+			buffer->option_string,
+			"access", VIPS_ACCESS_SEQUENTIAL,
+			"scale", 1.0 / factor,
+			NULL);
+	}
+	else if (vips_isprefix("VipsForeignLoadUhdr", thumbnail->loader)) {
 		return vips_image_new_from_buffer(
 			buffer->buf->data, buffer->buf->length,
 			buffer->option_string,
@@ -1653,6 +2240,25 @@ vips_thumbnail_buffer_open(VipsThumbnail *thumbnail, double factor)
 			"thumbnail", (int) factor,
 			NULL);
 	}
+	else if (vips_isprefix("VipsForeignLoadDcRaw", thumbnail->loader)) {
+		return vips_image_new_from_buffer(
+			buffer->buf->data, buffer->buf->length,
+			buffer->option_string,
+			"access", VIPS_ACCESS_SEQUENTIAL,
+			"half_size", factor >= 2,
+			NULL);
+	}
+#ifdef HAVE_SPNG
+	else if (vips_isprefix("VipsForeignLoadPng", thumbnail->loader) &&
+		thumbnail->interlaced) {
+		return vips_image_new_from_buffer(
+			buffer->buf->data, buffer->buf->length,
+			buffer->option_string,
+			"access", VIPS_ACCESS_SEQUENTIAL,
+			"shrink", (int) factor,
+			NULL);
+	}
+#endif /*HAVE_SPNG*/
 	else {
 		return vips_image_new_from_buffer(
 			buffer->buf->data, buffer->buf->length,
@@ -1724,6 +2330,7 @@ vips_thumbnail_buffer_init(VipsThumbnailBuffer *buffer)
  *     * @input_profile: `gchararray`, fallback input ICC profile
  *     * @output_profile: `gchararray`, output ICC profile
  *     * @intent: [enum@Intent], rendering intent
+ *     * @per_frame: `gboolean`, resize each page separately
  *     * @fail_on: [enum@FailOn], load error types to fail on
  *     * @option_string: `gchararray`, extra loader options
  *
@@ -1794,8 +2401,15 @@ vips_thumbnail_source_open(VipsThumbnail *thumbnail, double factor)
 {
 	VipsThumbnailSource *source = (VipsThumbnailSource *) thumbnail;
 
-	if (vips_isprefix("VipsForeignLoadJpeg", thumbnail->loader) ||
-		vips_isprefix("VipsForeignLoadUhdr", thumbnail->loader)) {
+	if (vips_isprefix("VipsForeignLoadJpeg", thumbnail->loader)) {
+		return vips_image_new_from_source(
+			source->source,
+			source->option_string,
+			"access", VIPS_ACCESS_SEQUENTIAL,
+			"scale", 1.0 / factor,
+			NULL);
+	}
+	else if (vips_isprefix("VipsForeignLoadUhdr", thumbnail->loader)) {
 		return vips_image_new_from_source(
 			source->source,
 			source->option_string,
@@ -1871,6 +2485,25 @@ vips_thumbnail_source_open(VipsThumbnail *thumbnail, double factor)
 			"thumbnail", (int) factor,
 			NULL);
 	}
+	else if (vips_isprefix("VipsForeignLoadDcRaw", thumbnail->loader)) {
+		return vips_image_new_from_source(
+			source->source,
+			source->option_string,
+			"access", VIPS_ACCESS_SEQUENTIAL,
+			"half_size", factor >= 2,
+			NULL);
+	}
+#ifdef HAVE_SPNG
+	else if (vips_isprefix("VipsForeignLoadPng", thumbnail->loader) &&
+		thumbnail->interlaced) {
+		return vips_image_new_from_source(
+			source->source,
+			source->option_string,
+			"access", VIPS_ACCESS_SEQUENTIAL,
+			"shrink", (int) factor,
+			NULL);
+	}
+#endif /*HAVE_SPNG*/
 	else {
 		return vips_image_new_from_source(
 			source->source,
@@ -1942,6 +2575,7 @@ vips_thumbnail_source_init(VipsThumbnailSource *source)
  *     * @input_profile: `gchararray`, fallback input ICC profile
  *     * @output_profile: `gchararray`, output ICC profile
  *     * @intent: [enum@Intent], rendering intent
+ *     * @per_frame: `gboolean`, resize each page separately
  *     * @fail_on: [enum@FailOn], load error types to fail on
  *     * @option_string: `gchararray`, extra loader options
  *
@@ -2060,6 +2694,7 @@ vips_thumbnail_image_init(VipsThumbnailImage *image)
  *     * @input_profile: `gchararray`, fallback input ICC profile
  *     * @output_profile: `gchararray`, output ICC profile
  *     * @intent: [enum@Intent], rendering intent
+ *     * @per_frame: `gboolean`, resize each page separately
  *     * @fail_on: [enum@FailOn], load error types to fail on
  *
  * ::: seealso
@@ -0,0 +1,794 @@
+/* Time a set of common operations and print the results as JSON.
+ *
+ * Run with "meson test --benchmark", or directly, eg.:
+ *
+ * 	./benchmark --iterations 20 --filter resize --json out.json
+ *
+ * Each case is run once to warm up, then timed over n iterations. We
+ * report throughput in megapixels per second (of input, at the median
+ * time), latency percentiles, and the peak tracked memory charged to the
+ * case.
+ *
+ * With --scaling N we instead time a convolution pipeline through
+ * vips_sink_disc(), vips_sink_memory() and vips_sink_screen() at every power
+ * of two concurrency up to N, and use the profile summary to report how long
+ * threads spent in each wait gate at each step.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <vips/vips.h>
+
+typedef struct _Bench Bench;
+
+typedef int (*BenchFn)(Bench *bench, void *a);
+
+struct _Bench {
+	const char *name;
+	BenchFn fn;
+	void *a;
+
+	/* The operation this case needs, or NULL. Cases are skipped if it's
+	 * not been built.
+	 */
+	const char *needs;
+
+	/* Input pixels processed per run, set by fn.
+	 */
+	double pixels;
+};
+
+/* The synthetic test image, and the same image encoded in each format we
+ * have a saver for.
+ */
+static VipsImage *bench_image = NULL;
+
+typedef struct _Encoded {
+	const char *suffix;
+	void *buf;
+	size_t len;
+} Encoded;
+
+static Encoded bench_encoded[] = {
+	{ ".jpg" },
+	{ ".png" },
+	{ ".webp" },
+	{ ".avif" },
+	{ ".tif" },
+};
+
+static int bench_width = 2048;
+static int bench_iterations = 10;
+static char *bench_filter = NULL;
+static char *bench_json = NULL;
+static int bench_scaling = 0;
+
+static GOptionEntry bench_options[] = {
+	{ "width", 'w', 0, G_OPTION_ARG_INT, &bench_width,
+		"test image is N x N pixels", "N" },
+	{ "iterations", 'n', 0, G_OPTION_ARG_INT, &bench_iterations,
+		"time each case N times", "N" },
+	{ "filter", 'f', 0, G_OPTION_ARG_STRING, &bench_filter,
+		"only run cases whose name contains STRING", "STRING" },
+	{ "json", 'j', 0, G_OPTION_ARG_FILENAME, &bench_json,
+		"write JSON to FILENAME, not stdout", "FILENAME" },
+	{ "scaling", 's', 0, G_OPTION_ARG_INT, &bench_scaling,
+		"sweep concurrency from 1 to N", "N" },
+	{ NULL }
+};
+
+/* Pull every pixel of @image through the pipeline.
+ */
+static int
+bench_sink(VipsImage *image)
+{
+	double avg;
+
+	return vips_avg(image, &avg, NULL);
+}
+
+static int
+bench_thumbnail(Bench *bench, void *a)
+{
+	Encoded *encoded = (Encoded *) a;
+	VipsImage *out;
+
+	if (!encoded->buf)
+		return 0;
+	if (vips_thumbnail_buffer(encoded->buf, encoded->len, &out, 256,
+			NULL))
+		return -1;
+	if (bench_sink(out)) {
+		g_object_unref(out);
+		return -1;
+	}
+	g_object_unref(out);
+
+	bench->pixels = (double) bench_image->Xsize * bench_image->Ysize;
+
+	return 0;
+}
+
+static int
+bench_resize(Bench *bench, void *a)
+{
+	VipsKernel kernel = GPOINTER_TO_INT(a);
+	VipsImage *out;
+
+	if (vips_resize(bench_image, &out, 0.37, "kernel", kernel, NULL))
+		return -1;
+	if (bench_sink(out)) {
+		g_object_unref(out);
+		return -1;
+	}
+	g_object_unref(out);
+
+	bench->pixels = (double) bench_image->Xsize * bench_image->Ysize;
+
+	return 0;
+}
+
+static int
+bench_conv(Bench *bench, void *a)
+{
+	VipsPrecision precision = GPOINTER_TO_INT(a);
+	VipsImage *mask;
+	VipsImage *out;
+
+	if (vips_gaussmat(&mask, 2.0, 0.2,
+			"precision", precision,
+			NULL))
+		return -1;
+	if (vips_conv(bench_image, &out, mask,
+			"precision", precision,
+			NULL)) {
+		g_object_unref(mask);
+		return -1;
+	}
+	g_object_unref(mask);
+	if (bench_sink(out)) {
+		g_object_unref(out);
+		return -1;
+	}
+	g_object_unref(out);
+
+	bench->pixels = (double) bench_image->Xsize * bench_image->Ysize;
+
+	return 0;
+}
+
+static int
+bench_composite(Bench *bench, void *a)
+{
+	VipsImage *overlay;
+	VipsImage *out;
+
+	if (vips_bandjoin_const1(bench_image, &overlay, 128, NULL))
+		return -1;
+	if (vips_composite2(bench_image, overlay, &out,
+			VIPS_BLEND_MODE_OVER, NULL)) {
+		g_object_unref(overlay);
+		return -1;
+	}
+	g_object_unref(overlay);
+	if (bench_sink(out)) {
+		g_object_unref(out);
+		return -1;
+	}
+	g_object_unref(out);
+
+	bench->pixels = (double) bench_image->Xsize * bench_image->Ysize;
+
+	return 0;
+}
+
+static int
+bench_icc(Bench *bench, void *a)
+{
+	VipsImage *out;
+
+	if (!vips_icc_present())
+		return 0;
+	if (vips_icc_transform(bench_image, &out, "cmyk",
+			"input_profile", "srgb",
+			NULL))
+		return -1;
+	if (bench_sink(out)) {
+		g_object_unref(out);
+		return -1;
+	}
+	g_object_unref(out);
+
+	bench->pixels = (double) bench_image->Xsize * bench_image->Ysize;
+
+	return 0;
+}
+
+static int
+bench_save(Bench *bench, void *a)
+{
+	const char *suffix = (const char *) a;
+	void *buf;
+	size_t len;
+
+	if (vips_image_write_to_buffer(bench_image, suffix, &buf, &len, NULL))
+		return -1;
+	g_free(buf);
+
+	bench->pixels = (double) bench_image->Xsize * bench_image->Ysize;
+
+	return 0;
+}
+
+static int
+bench_dzsave(Bench *bench, void *a)
+{
+	void *buf;
+	size_t len;
+
+	if (vips_dzsave_buffer(bench_image, &buf, &len, NULL))
+		return -1;
+	g_free(buf);
+
+	bench->pixels = (double) bench_image->Xsize * bench_image->Ysize;
+
+	return 0;
+}
+
+static Bench bench_cases[] = {
+	{ "thumbnail_jpeg", bench_thumbnail, &bench_encoded[0] },
+	{ "thumbnail_png", bench_thumbnail, &bench_encoded[1] },
+	{ "thumbnail_webp", bench_thumbnail, &bench_encoded[2] },
+	{ "thumbnail_avif", bench_thumbnail, &bench_encoded[3] },
+	{ "thumbnail_tiff", bench_thumbnail, &bench_encoded[4] },
+	{ "resize_nearest", bench_resize,
+		GINT_TO_POINTER(VIPS_KERNEL_NEAREST) },
+	{ "resize_linear", bench_resize,
+		GINT_TO_POINTER(VIPS_KERNEL_LINEAR) },
+	{ "resize_cubic", bench_resize,
+		GINT_TO_POINTER(VIPS_KERNEL_CUBIC) },
+	{ "resize_mitchell", bench_resize,
+		GINT_TO_POINTER(VIPS_KERNEL_MITCHELL) },
+	{ "resize_lanczos2", bench_resize,
+		GINT_TO_POINTER(VIPS_KERNEL_LANCZOS2) },
+	{ "resize_lanczos3", bench_resize,
+		GINT_TO_POINTER(VIPS_KERNEL_LANCZOS3) },
+	{ "convi", bench_conv, GINT_TO_POINTER(VIPS_PRECISION_INTEGER) },
+	{ "convf", bench_conv, GINT_TO_POINTER(VIPS_PRECISION_FLOAT) },
+	{ "composite", bench_composite, NULL, "composite2" },
+	{ "icc_transform", bench_icc, NULL, "icc_transform" },
+	{ "jpegsave", bench_save, ".jpg", "jpegsave_buffer" },
+	{ "pngsave", bench_save, ".png", "pngsave_buffer" },
+	{ "webpsave", bench_save, ".webp", "webpsave_buffer" },
+	{ "avifsave", bench_save, ".avif", "heifsave_buffer" },
+	{ "tiffsave", bench_save, ".tif", "tiffsave_buffer" },
+	{ "dzsave", bench_dzsave, NULL, "dzsave_buffer" },
+};
+
+/* A smooth gradient plus some noise, so encoders have something like a
+ * photo to work on.
+ */
+static int
+bench_make_image(void)
+{
+	VipsImage *t[6];
+	int i;
+
+	memset(t, 0, sizeof(t));
+	if (vips_xyz(&t[0], bench_width, bench_width, NULL) ||
+		vips_gaussnoise(&t[1], bench_width, bench_width,
+			"sigma", 20.0,
+			NULL) ||
+		vips_bandjoin2(t[0], t[1], &t[2], NULL) ||
+		vips_linear1(t[2], &t[3], 255.0 / bench_width, 0.0, NULL) ||
+		vips_cast_uchar(t[3], &t[4], NULL) ||
+		vips_copy(t[4], &t[5],
+			"interpretation", VIPS_INTERPRETATION_sRGB,
+			NULL) ||
+		!(bench_image = vips_image_copy_memory(t[5]))) {
+		for (i = 0; i < VIPS_NUMBER(t); i++)
+			VIPS_UNREF(t[i]);
+		return -1;
+	}
+
+	for (i = 0; i < VIPS_NUMBER(t); i++)
+		VIPS_UNREF(t[i]);
+
+	/* Formats we can't save are left NULL and their thumbnail case
+	 * reports as skipped.
+	 */
+	for (i = 0; i < VIPS_NUMBER(bench_encoded); i++) {
+		Encoded *encoded = &bench_encoded[i];
+
+		if (!vips_foreign_find_save_buffer(encoded->suffix)) {
+			vips_error_clear();
+			continue;
+		}
+		if (vips_image_write_to_buffer(bench_image, encoded->suffix,
+				&encoded->buf, &encoded->len, NULL))
+			return -1;
+	}
+
+	return 0;
+}
+
+static int
+bench_compare(const void *a, const void *b)
+{
+	double da = *((double *) a);
+	double db = *((double *) b);
+
+	return da < db ? -1 : da > db ? 1 : 0;
+}
+
+/* Nearest-rank percentile of a sorted array.
+ */
+static double
+bench_percentile(double *times, int n, double p)
+{
+	int i = (int) ceil(p * n) - 1;
+
+	return times[VIPS_CLIP(0, i, n - 1)];
+}
+
+/* Run a case and append a JSON object for it to @json. Return -1 on error,
+ * 1 if the case was skipped.
+ */
+static int
+bench_run(Bench *bench, GString *json)
+{
+	double *times;
+	VipsBudget *budget;
+	size_t highwater;
+	double p50;
+	int i;
+
+	if (bench->needs &&
+		!vips_type_find("VipsOperation", bench->needs))
+		return 1;
+
+	/* Charge everything to a private, unlimited budget so we can see
+	 * the peak memory use of just this case.
+	 */
+	budget = vips_budget_new(G_MAXSIZE);
+	vips_budget_set_current(budget);
+
+	bench->pixels = 0;
+	if (bench->fn(bench, bench->a)) {
+		vips_budget_set_current(NULL);
+		vips_budget_unref(budget);
+		return -1;
+	}
+	if (bench->pixels == 0) {
+		vips_budget_set_current(NULL);
+		vips_budget_unref(budget);
+		return 1;
+	}
+
+	times = g_new(double, bench_iterations);
+	for (i = 0; i < bench_iterations; i++) {
+		gint64 start = g_get_monotonic_time();
+
+		if (bench->fn(bench, bench->a)) {
+			vips_budget_set_current(NULL);
+			vips_budget_unref(budget);
+			g_free(times);
+			return -1;
+		}
+
+		times[i] = (g_get_monotonic_time() - start) / 1000000.0;
+	}
+
+	vips_budget_set_current(NULL);
+	highwater = vips_budget_get_mem_highwater(budget);
+	vips_budget_unref(budget);
+
+	qsort(times, bench_iterations, sizeof(double), bench_compare);
+	p50 = bench_percentile(times, bench_iterations, 0.5);
+
+	g_string_append_printf(json,
+		"    { \"name\": \"%s\", \"iterations\": %d, "
+		"\"mpix_per_s\": %g, "
+		"\"min_ms\": %g, \"p50_ms\": %g, \"p90_ms\": %g, "
+		"\"p99_ms\": %g, \"max_ms\": %g, "
+		"\"mem_highwater\": %zd }",
+		bench->name, bench_iterations,
+		bench->pixels / 1000000.0 / VIPS_MAX(p50, 1e-9),
+		times[0] * 1000.0,
+		p50 * 1000.0,
+		bench_percentile(times, bench_iterations, 0.9) * 1000.0,
+		bench_percentile(times, bench_iterations, 0.99) * 1000.0,
+		times[bench_iterations - 1] * 1000.0,
+		highwater);
+
+	fprintf(stderr, "%-20s %10.2f Mpix/s  p50 %8.2f ms  p99 %8.2f ms\n",
+		bench->name,
+		bench->pixels / 1000000.0 / VIPS_MAX(p50, 1e-9),
+		p50 * 1000.0,
+		bench_percentile(times, bench_iterations, 0.99) * 1000.0);
+
+	g_free(times);
+
+	return 0;
+}
+
+/* The sinks we sweep in scaling mode.
+ */
+typedef enum {
+	SINK_DISC,
+	SINK_MEMORY,
+	SINK_SCREEN
+} BenchSink;
+
+static const char *bench_sink_names[] = {
+	"sink_disc",
+	"sink_memory",
+	"sink_screen"
+};
+
+/* sink_screen() is asynchronous, so count tiles in as they are painted.
+ */
+typedef struct _ScreenState {
+	GMutex lock;
+	GCond cond;
+	int n_painted;
+} ScreenState;
+
+static int
+bench_discard(VipsRegion *region, VipsRect *area, void *a)
+{
+	return 0;
+}
+
+static void
+bench_screen_notify(VipsImage *image, VipsRect *rect, void *a)
+{
+	ScreenState *state = (ScreenState *) a;
+
+	g_mutex_lock(&state->lock);
+	state->n_painted += 1;
+	g_cond_signal(&state->cond);
+	g_mutex_unlock(&state->lock);
+}
+
+static int
+bench_sink_screen(VipsImage *image)
+{
+	const int tile_size = 128;
+	const int n_tiles =
+		VIPS_ROUND_UP(image->Xsize, tile_size) / tile_size *
+		(VIPS_ROUND_UP(image->Ysize, tile_size) / tile_size);
+
+	ScreenState state;
+	VipsImage *out;
+	VipsRegion *region;
+	VipsRect all;
+	gint64 end_time;
+	int result;
+
+	g_mutex_init(&state.lock);
+	g_cond_init(&state.cond);
+	state.n_painted = 0;
+
+	out = vips_image_new();
+	if (vips_sink_screen(image, out, NULL,
+			tile_size, tile_size, n_tiles, 0,
+			bench_screen_notify, &state)) {
+		g_object_unref(out);
+		return -1;
+	}
+
+	/* Asking for the whole image queues every tile for the background
+	 * threads.
+	 */
+	region = vips_region_new(out);
+	all.left = 0;
+	all.top = 0;
+	all.width = out->Xsize;
+	all.height = out->Ysize;
+	result = vips_region_prepare(region, &all);
+
+	end_time = g_get_monotonic_time() + 60 * G_TIME_SPAN_SECOND;
+	g_mutex_lock(&state.lock);
+	while (!result &&
+		state.n_painted < n_tiles)
+		if (!g_cond_wait_until(&state.cond, &state.lock, end_time)) {
+			vips_error("benchmark", "%s", "timeout in sink_screen");
+			result = -1;
+		}
+	g_mutex_unlock(&state.lock);
+
+	/* Unreffing out shuts down the render, so we can free the state.
+	 */
+	g_object_unref(region);
+	g_object_unref(out);
+	g_mutex_clear(&state.lock);
+	g_cond_clear(&state.cond);
+
+	return result;
+}
+
+/* A convolution is enough work per pixel to show scaling. Disc and memory
+ * sinks read sequentially, so they go through vips_sequential() as a loader
+ * would.
+ */
+static int
+bench_sink_run(BenchSink sink)
+{
+	VipsImage *t[3];
+	int result;
+	int i;
+
+	memset(t, 0, sizeof(t));
+	if (vips_gaussmat(&t[0], 2.0, 0.2, NULL) ||
+		(sink == SINK_SCREEN
+				? vips_copy(bench_image, &t[1], NULL)
+				: vips_sequential(bench_image, &t[1], NULL)) ||
+		vips_conv(t[1], &t[2], t[0],
+			"precision", VIPS_PRECISION_INTEGER,
+			NULL)) {
+		for (i = 0; i < VIPS_NUMBER(t); i++)
+			VIPS_UNREF(t[i]);
+		return -1;
+	}
+
+	switch (sink) {
+	case SINK_DISC:
+		result = vips_sink_disc(t[2], bench_discard, NULL);
+		break;
+
+	case SINK_MEMORY: {
+		void *buf;
+		size_t len;
+
+		result = 0;
+		if (!(buf = vips_image_write_to_memory(t[2], &len)))
+			result = -1;
+		g_free(buf);
+		break;
+	}
+
+	case SINK_SCREEN:
+		result = bench_sink_screen(t[2]);
+		break;
+
+	default:
+		g_assert_not_reached();
+		result = -1;
+	}
+
+	for (i = 0; i < VIPS_NUMBER(t); i++)
+		VIPS_UNREF(t[i]);
+
+	return result;
+}
+
+static void
+bench_gate_cb(const char *name, gint64 time, gint64 n, void *a)
+{
+	GString *json = (GString *) a;
+
+	/* Only waits are lost time, the rest are useful work.
+	 */
+	if (n == 0 ||
+		!strstr(name, "wait"))
+		return;
+
+	g_string_append_printf(json,
+		"%s\"%s\": { \"ms\": %g, \"n\": %" G_GINT64_FORMAT " }",
+		json->str[json->len - 1] == '{' ? " " : ", ",
+		name, time / 1000.0, n);
+}
+
+/* Time one sink at one concurrency, median of the iterations.
+ */
+static int
+bench_scaling_point(BenchSink sink, int threads, double base,
+	double *time, GString *json)
+{
+	double *times;
+	int i;
+
+	vips_concurrency_set(threads);
+
+	if (bench_sink_run(sink))
+		return -1;
+
+	times = g_new(double, bench_iterations);
+	vips_profile_summary_reset();
+	for (i = 0; i < bench_iterations; i++) {
+		gint64 start = g_get_monotonic_time();
+
+		if (bench_sink_run(sink)) {
+			g_free(times);
+			return -1;
+		}
+
+		times[i] = (g_get_monotonic_time() - start) / 1000000.0;
+	}
+
+	qsort(times, bench_iterations, sizeof(double), bench_compare);
+	*time = bench_percentile(times, bench_iterations, 0.5);
+	g_free(times);
+
+	if (base == 0)
+		base = *time;
+
+	/* Wait totals are for all the iterations, so scale them back to one
+	 * run.
+	 */
+	g_string_append_printf(json,
+		"        { \"threads\": %d, \"p50_ms\": %g, "
+		"\"speedup\": %g, \"efficiency\": %g, "
+		"\"iterations\": %d, \"waits\": {",
+		threads, *time * 1000.0,
+		base / VIPS_MAX(*time, 1e-9),
+		base / VIPS_MAX(*time, 1e-9) / threads,
+		bench_iterations);
+	vips_profile_summary_map(bench_gate_cb, json);
+	g_string_append(json, " } }");
+
+	fprintf(stderr, "%-12s %4d threads %8.2f ms  speedup %6.2f\n",
+		bench_sink_names[sink], threads, *time * 1000.0,
+		base / VIPS_MAX(*time, 1e-9));
+
+	return 0;
+}
+
+static int
+bench_scaling_run(GString *json)
+{
+	int sink;
+
+	g_string_append(json, "  \"scaling\": [\n");
+
+	for (sink = 0; sink < VIPS_NUMBER(bench_sink_names); sink++) {
+		double base;
+		double time;
+		int threads;
+
+		if (bench_filter &&
+			!strstr(bench_sink_names[sink], bench_filter))
+			continue;
+
+		if (json->str[json->len - 2] == '}')
+			g_string_append(json, ",\n");
+		g_string_append_printf(json,
+			"    { \"sink\": \"%s\", \"points\": [\n",
+			bench_sink_names[sink]);
+
+		base = 0;
+		for (threads = 1; threads <= bench_scaling; threads *= 2) {
+			if (threads > 1)
+				g_string_append(json, ",\n");
+			if (bench_scaling_point(sink, threads, base, &time, json))
+				return -1;
+			if (threads == 1)
+				base = time;
+
+			/* Always finish on N, even if it's not a power of two.
+			 */
+			if (threads < bench_scaling &&
+				threads * 2 > bench_scaling) {
+				g_string_append(json, ",\n");
+				if (bench_scaling_point(sink, bench_scaling, base,
+						&time, json))
+					return -1;
+			}
+		}
+
+		g_string_append(json, "\n      ] }\n");
+	}
+
+	g_string_append(json, "  ],\n");
+
+	return 0;
+}
+
+int
+main(int argc, char **argv)
+{
+	GOptionContext *context;
+	GError *error = NULL;
+	GString *json;
+	gboolean first;
+	int i;
+
+	if (VIPS_INIT(argv[0]))
+		vips_error_exit(NULL);
+
+	context = g_option_context_new("- benchmark libvips");
+	g_option_context_add_main_entries(context, bench_options, NULL);
+	if (!g_option_context_parse(context, &argc, &argv, &error)) {
+		fprintf(stderr, "%s\n", error->message);
+		g_error_free(error);
+		return 1;
+	}
+	g_option_context_free(context);
+
+	bench_iterations = VIPS_MAX(1, bench_iterations);
+	bench_width = VIPS_MAX(64, bench_width);
+
+	/* Threads only record gates if this is on when they start a task, so
+	 * it must be set before any work.
+	 */
+	if (bench_scaling > 0)
+		vips_profile_set_summary(TRUE);
+
+	/* Each iteration should run the whole pipeline, not pick up the
+	 * previous result from the operation cache.
+	 */
+	vips_cache_set_max(0);
+
+	if (bench_make_image())
+		vips_error_exit(NULL);
+
+	json = g_string_new("{\n");
+	g_string_append_printf(json,
+		"  \"version\": \"%s\",\n"
+		"  \"width\": %d,\n"
+		"  \"height\": %d,\n"
+		"  \"concurrency\": %d,\n",
+		vips_version_string(), bench_width, bench_width,
+		vips_concurrency_get());
+
+	if (bench_scaling > 0) {
+		if (bench_scaling_run(json))
+			vips_error_exit("scaling failed");
+	}
+
+	g_string_append(json, "  \"cases\": [\n");
+
+	first = TRUE;
+	for (i = 0; bench_scaling == 0 && i < VIPS_NUMBER(bench_cases); i++) {
+		Bench *bench = &bench_cases[i];
+		GString *item;
+		int result;
+
+		if (bench_filter &&
+			!strstr(bench->name, bench_filter))
+			continue;
+
+		item = g_string_new(NULL);
+		if ((result = bench_run(bench, item)) < 0)
+			vips_error_exit("%s failed", bench->name);
+		if (result == 0) {
+			if (!first)
+				g_string_append(json, ",\n");
+			g_string_append(json, item->str);
+			first = FALSE;
+		}
+		else
+			fprintf(stderr, "%-20s skipped\n", bench->name);
+		g_string_free(item, TRUE);
+	}
+
+	g_string_append_printf(json,
+		"\n  ],\n"
+		"  \"mem_highwater\": %zd\n"
+		"}\n",
+		vips_tracked_get_mem_highwater());
+
+	if (bench_json) {
+		if (!g_file_set_contents(bench_json, json->str, json->len,
+				&error)) {
+			fprintf(stderr, "%s\n", error->message);
+			g_error_free(error);
+			return 1;
+		}
+	}
+	else
+		printf("%s", json->str);
+
+	g_string_free(json, TRUE);
+	VIPS_UNREF(bench_image);
+	for (i = 0; i < VIPS_NUMBER(bench_encoded); i++)
+		g_free(bench_encoded[i].buf);
+
+	vips_shutdown();
+
+	return 0;
+}
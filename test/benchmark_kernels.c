@@ -0,0 +1,408 @@
+/* Time the vector kernels one by one, for every vector target this CPU
+ * supports plus the scalar fallback, and print the results as JSON.
+ *
+ * Run with "meson test --benchmark", or directly, eg.:
+ *
+ * 	./benchmark_kernels --filter reduceh --target AVX2 --json out.json
+ *
+ * Each kernel runs as a single operation on a small memory image, with one
+ * thread, over a matrix of formats, band counts and widths. We report time
+ * per output pixel at the median, and cycles per output pixel where the CPU
+ * has a timestamp counter we can read.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_RDTSC
+#endif
+
+#include <vips/vips.h>
+#include <vips/vector.h>
+
+typedef int (*KernelFn)(VipsImage *in, VipsImage **out);
+
+typedef struct _Kernel {
+	const char *name;
+	KernelFn fn;
+} Kernel;
+
+static int kernel_height = 256;
+static int kernel_iterations = 20;
+static char *kernel_filter = NULL;
+static char *kernel_target = NULL;
+static char *kernel_json = NULL;
+
+static GOptionEntry kernel_options[] = {
+	{ "height", 0, 0, G_OPTION_ARG_INT, &kernel_height,
+		"test images are N pixels high", "N" },
+	{ "iterations", 'n', 0, G_OPTION_ARG_INT, &kernel_iterations,
+		"time each case N times", "N" },
+	{ "filter", 'f', 0, G_OPTION_ARG_STRING, &kernel_filter,
+		"only run kernels whose name contains STRING", "STRING" },
+	{ "target", 't', 0, G_OPTION_ARG_STRING, &kernel_target,
+		"only run with TARGET, eg. AVX2 or scalar", "TARGET" },
+	{ "json", 'j', 0, G_OPTION_ARG_FILENAME, &kernel_json,
+		"write JSON to FILENAME, not stdout", "FILENAME" },
+	{ NULL }
+};
+
+static VipsBandFormat kernel_formats[] = {
+	VIPS_FORMAT_UCHAR,
+	VIPS_FORMAT_USHORT,
+	VIPS_FORMAT_FLOAT
+};
+
+static int kernel_bands[] = { 1, 3, 4 };
+
+static int kernel_widths[] = { 64, 1024, 4096 };
+
+static int
+kernel_convi(VipsImage *in, VipsImage **out)
+{
+	VipsImage *mask;
+	int result;
+
+	mask = vips_image_new_matrixv(3, 3,
+		1.0, 2.0, 1.0,
+		2.0, 4.0, 2.0,
+		1.0, 2.0, 1.0);
+	vips_image_set_double(mask, "scale", 16);
+	result = vips_conv(in, out, mask,
+		"precision", VIPS_PRECISION_INTEGER,
+		NULL);
+	g_object_unref(mask);
+
+	return result;
+}
+
+static int
+kernel_morph(VipsImage *in, VipsImage **out)
+{
+	VipsImage *mask;
+	int result;
+
+	mask = vips_image_new_matrixv(3, 3,
+		0.0, 255.0, 0.0,
+		255.0, 255.0, 255.0,
+		0.0, 255.0, 0.0);
+	result = vips_morph(in, out, mask,
+		VIPS_OPERATION_MORPHOLOGY_DILATE, NULL);
+	g_object_unref(mask);
+
+	return result;
+}
+
+static int
+kernel_reduceh(VipsImage *in, VipsImage **out)
+{
+	return vips_reduceh(in, out, 2.5,
+		"kernel", VIPS_KERNEL_LANCZOS3,
+		NULL);
+}
+
+static int
+kernel_reducev(VipsImage *in, VipsImage **out)
+{
+	return vips_reducev(in, out, 2.5,
+		"kernel", VIPS_KERNEL_LANCZOS3,
+		NULL);
+}
+
+static int
+kernel_shrinkh(VipsImage *in, VipsImage **out)
+{
+	return vips_shrinkh(in, out, 2, NULL);
+}
+
+static int
+kernel_shrinkv(VipsImage *in, VipsImage **out)
+{
+	return vips_shrinkv(in, out, 2, NULL);
+}
+
+static Kernel kernel_cases[] = {
+	{ "convi", kernel_convi },
+	{ "morph", kernel_morph },
+	{ "reduceh", kernel_reduceh },
+	{ "reducev", kernel_reducev },
+	{ "shrinkh", kernel_shrinkh },
+	{ "shrinkv", kernel_shrinkv },
+};
+
+static int
+kernel_compare(const void *a, const void *b)
+{
+	double da = *((double *) a);
+	double db = *((double *) b);
+
+	return da < db ? -1 : da > db ? 1 : 0;
+}
+
+static guint64
+kernel_cycles(void)
+{
+#ifdef HAVE_RDTSC
+	return __rdtsc();
+#else
+	return 0;
+#endif
+}
+
+/* Noise in the requested format and band count, in memory.
+ */
+static VipsImage *
+kernel_make_image(VipsBandFormat format, int bands, int width)
+{
+	VipsImage *base = vips_image_new();
+	VipsImage **t = (VipsImage **) vips_object_local_array(
+		VIPS_OBJECT(base), 3);
+	VipsImage *x[4];
+	VipsImage *image;
+	int i;
+
+	if (vips_gaussnoise(&t[0], width, kernel_height,
+			"mean", 128.0,
+			"sigma", 40.0,
+			NULL)) {
+		g_object_unref(base);
+		return NULL;
+	}
+
+	for (i = 0; i < bands; i++)
+		x[i] = t[0];
+	if (vips_bandjoin(x, &t[1], bands, NULL) ||
+		vips_cast(t[1], &t[2], format, NULL) ||
+		!(image = vips_image_copy_memory(t[2]))) {
+		g_object_unref(base);
+		return NULL;
+	}
+
+	g_object_unref(base);
+
+	return image;
+}
+
+/* Run one kernel on one image and append a JSON object to @json. Return -1
+ * on error, 1 if the kernel does not support this input.
+ */
+static int
+kernel_run(Kernel *kernel, const char *target, VipsImage *in, GString *json)
+{
+	double *times;
+	double *cycles;
+	double pixels;
+	double p50;
+	double c50;
+	int i;
+
+	times = g_new(double, kernel_iterations);
+	cycles = g_new(double, kernel_iterations);
+	pixels = 0;
+
+	/* The first run is to warm up and is not timed.
+	 */
+	for (i = -1; i < kernel_iterations; i++) {
+		VipsImage *out;
+		VipsImage *memory;
+		gint64 start;
+		guint64 start_cycles;
+
+		if (kernel->fn(in, &out)) {
+			g_free(cycles);
+			g_free(times);
+			vips_error_clear();
+			return 1;
+		}
+
+		memory = vips_image_new_memory();
+		start = g_get_monotonic_time();
+		start_cycles = kernel_cycles();
+		if (vips_image_write(out, memory)) {
+			g_object_unref(memory);
+			g_object_unref(out);
+			g_free(cycles);
+			g_free(times);
+			return -1;
+		}
+		if (i >= 0) {
+			times[i] = (g_get_monotonic_time() - start) / 1000000.0;
+			cycles[i] = kernel_cycles() - start_cycles;
+		}
+
+		pixels = (double) out->Xsize * out->Ysize;
+		g_object_unref(memory);
+		g_object_unref(out);
+	}
+
+	qsort(times, kernel_iterations, sizeof(double), kernel_compare);
+	qsort(cycles, kernel_iterations, sizeof(double), kernel_compare);
+	p50 = times[kernel_iterations / 2];
+	c50 = cycles[kernel_iterations / 2];
+
+	g_string_append_printf(json,
+		"    { \"kernel\": \"%s\", \"target\": \"%s\", "
+		"\"format\": \"%s\", \"bands\": %d, \"width\": %d, "
+		"\"ns_per_pixel\": %g",
+		kernel->name, target,
+		vips_enum_nick(VIPS_TYPE_BAND_FORMAT, in->BandFmt),
+		in->Bands, in->Xsize,
+		p50 * 1e9 / pixels);
+#ifdef HAVE_RDTSC
+	g_string_append_printf(json, ", \"cycles_per_pixel\": %g",
+		c50 / pixels);
+#endif /*HAVE_RDTSC*/
+	g_string_append(json, " }");
+
+	fprintf(stderr, "%-8s %-10s %-7s %d x %-5d %8.2f ns/pix",
+		kernel->name, target,
+		vips_enum_nick(VIPS_TYPE_BAND_FORMAT, in->BandFmt),
+		in->Bands, in->Xsize,
+		p50 * 1e9 / pixels);
+#ifdef HAVE_RDTSC
+	fprintf(stderr, " %8.2f cycles/pix", c50 / pixels);
+#endif /*HAVE_RDTSC*/
+	fprintf(stderr, "\n");
+
+	g_free(cycles);
+	g_free(times);
+
+	return 0;
+}
+
+/* Run every kernel over the whole matrix with the current target.
+ */
+static int
+kernel_run_target(const char *target, GString *json, gboolean *first)
+{
+	int f, b, w, k;
+
+	for (f = 0; f < VIPS_NUMBER(kernel_formats); f++)
+		for (b = 0; b < VIPS_NUMBER(kernel_bands); b++)
+			for (w = 0; w < VIPS_NUMBER(kernel_widths); w++) {
+				VipsImage *in;
+
+				if (!(in = kernel_make_image(kernel_formats[f],
+						  kernel_bands[b], kernel_widths[w])))
+					return -1;
+
+				for (k = 0; k < VIPS_NUMBER(kernel_cases); k++) {
+					Kernel *kernel = &kernel_cases[k];
+					GString *item;
+					int result;
+
+					if (kernel_filter &&
+						!strstr(kernel->name, kernel_filter))
+						continue;
+
+					item = g_string_new(NULL);
+					if ((result = kernel_run(kernel, target, in, item)) < 0) {
+						g_string_free(item, TRUE);
+						g_object_unref(in);
+						return -1;
+					}
+					if (result == 0) {
+						if (!*first)
+							g_string_append(json, ",\n");
+						g_string_append(json, item->str);
+						*first = FALSE;
+					}
+					g_string_free(item, TRUE);
+				}
+
+				g_object_unref(in);
+			}
+
+	return 0;
+}
+
+int
+main(int argc, char **argv)
+{
+	GOptionContext *context;
+	GError *error = NULL;
+	GString *json;
+	gint64 supported;
+	gboolean first;
+	int i;
+
+	if (VIPS_INIT(argv[0]))
+		vips_error_exit(NULL);
+
+	context = g_option_context_new("- benchmark vector kernels");
+	g_option_context_add_main_entries(context, kernel_options, NULL);
+	if (!g_option_context_parse(context, &argc, &argv, &error)) {
+		fprintf(stderr, "%s\n", error->message);
+		g_error_free(error);
+		return 1;
+	}
+	g_option_context_free(context);
+
+	kernel_iterations = VIPS_MAX(1, kernel_iterations);
+	kernel_height = VIPS_MAX(16, kernel_height);
+
+	/* One thread, and no operation cache, so we time just the kernel.
+	 */
+	vips_concurrency_set(1);
+	vips_cache_set_max(0);
+
+	/* Pick up the full set before we start pinning targets.
+	 */
+	(void) vips_vector_set_target(NULL);
+	supported = vips_vector_get_supported_targets();
+
+	json = g_string_new("{\n");
+	g_string_append_printf(json,
+		"  \"version\": \"%s\",\n"
+		"  \"height\": %d,\n"
+		"  \"cases\": [\n",
+		vips_version_string(), kernel_height);
+
+	first = TRUE;
+	for (i = 0; i < 63; i++) {
+		gint64 target = (gint64) 1 << i;
+		const char *name;
+
+		if (!(supported & target) ||
+			!(name = vips_vector_target_name(target)))
+			continue;
+		if (kernel_target &&
+			g_ascii_strcasecmp(name, kernel_target) != 0)
+			continue;
+
+		if (vips_vector_set_target(name) ||
+			kernel_run_target(name, json, &first))
+			vips_error_exit("target %s failed", name);
+	}
+
+	if (!kernel_target ||
+		g_ascii_strcasecmp(kernel_target, "scalar") == 0) {
+		if (vips_vector_set_target("scalar") ||
+			kernel_run_target("scalar", json, &first))
+			vips_error_exit("scalar failed");
+	}
+
+	(void) vips_vector_set_target(NULL);
+
+	g_string_append(json, "\n  ]\n}\n");
+
+	if (kernel_json) {
+		if (!g_file_set_contents(kernel_json, json->str, json->len,
+				&error)) {
+			fprintf(stderr, "%s\n", error->message);
+			g_error_free(error);
+			return 1;
+		}
+	}
+	else
+		printf("%s", json->str);
+
+	g_string_free(json, TRUE);
+
+	vips_shutdown();
+
+	return 0;
+}
@@ -107,6 +107,21 @@ class TestArithmetic:
         self.run_arith_const(my_pow, fmt=noncomplex_formats)
         self.run_arith(my_pow, fmt=noncomplex_formats)
 
+    def test_math_lut(self):
+        # 8- and 16-bit images are tabulated, so compare against the same
+        # image as float, which is computed directly
+        noise = pyvips.Image.gaussnoise(300, 300, mean=128, sigma=60).abs()
+        for fmt, scale in [("uchar", 1), ("char", 1),
+                           ("ushort", 200), ("short", 100)]:
+            im = (noise * scale).cast(fmt).bandjoin([noise.cast(fmt)] * 2)
+            imf = im.cast("float")
+
+            assert (im.log() - imf.log()).abs().max() < 1e-5
+            assert (im.math("sin") - imf.math("sin")).abs().max() < 1e-5
+            assert (im ** 0.45 - imf ** 0.45).abs().max() < 1e-3
+            assert (im ** [0.5, 1, 2] - imf ** [0.5, 1, 2]).abs().max() < 1e-3
+            assert (im.wop(2) - imf.wop(2)).abs().max() < 1e-3
+
     def test_and(self):
         def my_and(x, y):
             # python doesn't allow bools on float
@@ -351,6 +366,29 @@ class TestArithmetic:
             assert_almost_equal_objects(hist(20, 0), [5000])
             assert_almost_equal_objects(hist(5, 0), [0])
 
+    def test_histfind_shards(self):
+        # uchar is counted into several sub-histograms, ushort only merges
+        # the range it has seen ... check both add up, with an odd width
+        x = pyvips.Image.xyz(255, 301)[0]
+        test = x.bandjoin([254 - x, x // 2])
+
+        hist = test.cast("uchar").hist_find()
+        assert hist.width == 256
+        assert hist.min() == 0
+        assert hist.crop(0, 0, 255, 1)[0:2].min() == 301
+        assert hist[0].avg() * 256 == 255 * 301
+
+        for band in range(3):
+            one = test.cast("uchar").hist_find(band=band)
+            assert one.width == test[band].max() + 1
+            assert (one - hist[band].crop(0, 0, one.width, 1)).abs().max() == 0
+
+        hist = (test * 100 + 1000).cast("ushort").hist_find(band=0)
+        assert hist.width == 26401
+        assert hist(1000, 0)[0] == 301
+        assert hist(1001, 0)[0] == 0
+        assert pytest.approx(hist.avg() * hist.width) == 255 * 301
+
     def test_histfind_indexed(self):
         im = pyvips.Image.black(50, 100)
         test = im.insert(im + 10, 50, 0, expand=True)
@@ -381,6 +419,13 @@ class TestArithmetic:
             assert hist.height == 1
             assert hist.bands == 1
 
+        # every row is merged from every thread
+        x = pyvips.Image.xyz(256, 400)
+        hist = x.cast("uchar").hist_find_ndim(bins=16)
+        assert hist.width == 16
+        assert hist.height == 16
+        assert hist.avg() * 16 * 16 == 256 * 400
+
     def test_hough_circle(self):
         test = pyvips.Image.black(100, 100).draw_circle(100, 50, 50, 40)
 
@@ -396,6 +441,21 @@ class TestArithmetic:
             assert pytest.approx(y) == 50
             assert pytest.approx(r) == 40
 
+    def test_hough_circle_large(self):
+        # a large accumulator, so threads may share one
+        test = pyvips.Image.black(1000, 1000) \
+            .draw_circle(100, 500, 500, 300) \
+            .draw_circle(100, 180, 820, 150)
+        hough = test.hough_circle(min_radius=292, max_radius=308)
+
+        v, x, y = hough.maxpos()
+        vec = hough(x, y)
+        r = vec.index(v) + 292
+
+        assert pytest.approx(x) == 500
+        assert pytest.approx(y) == 500
+        assert pytest.approx(r) == 300
+
     def test_hough_line(self):
         # hough_line changed the way it codes parameter space (again) in 8.17
         test = pyvips.Image.black(100, 100).draw_line(100, 10, 90, 90, 10)
@@ -672,6 +732,18 @@ class TestArithmetic:
         assert width == 50
         assert height == 60
 
+        # objects touching the edges, and far from them
+        test = im.embed(0, 0, 50, 300, extend="white")
+        assert test.find_trim(line_art=True) == [0, 0, 50, 60]
+        test = im.embed(700, 500, 800, 600, extend="white")
+        assert test.find_trim(line_art=True) == [700, 500, 50, 60]
+
+        # all background
+        test = pyvips.Image.black(100, 100) + 255
+        left, top, width, height = test.find_trim()
+        assert width == 0
+        assert height == 0
+
     def test_profile(self):
         test = pyvips.Image.black(100, 100).draw_rect(100, 40, 50, 1, 1)
 
@@ -728,6 +800,14 @@ class TestArithmetic:
             assert_almost_equal_objects(matrix(4, 1), [a.avg()])
             assert_almost_equal_objects(matrix(5, 1), [a.deviate()])
 
+        # histogram and percentiles in the same pass
+        for x in ["uchar", "ushort"]:
+            a = test.cast(x)
+            matrix, opts = a.stats(percent=[10, 90], hist=True,
+                                   threshold=True)
+            assert (opts["hist"] - a.hist_find()).abs().max() == 0
+            assert opts["threshold"] == [a.percent(10), a.percent(90)]
+
     def test_sum(self):
         for fmt in all_formats:
             im = pyvips.Image.black(50, 50)
@@ -766,6 +846,69 @@ class TestArithmetic:
                 im4 = (im2 > im).ifthenelse(im2, im)
                 assert (im3 - im4).abs().max() == 0
 
+    # chains of point operations are fused into a single loop
+    def test_fused_chain(self):
+        def chain(x):
+            return abs((x * 2 + 1) - x) * x
+
+        for fmt in noncomplex_formats:
+            for x in self.all_images:
+                im = x.cast(fmt)
+                self.run_imageunary(f'fused chain {fmt}', im, chain)
+
+                # the fused chain must match one forced through memory
+                # at each step
+                im2 = ((im * 2 + 1).copy_memory() - im).copy_memory()
+                im2 = (abs(im2).copy_memory() * im).copy_memory()
+                assert (chain(im) - im2).abs().max() == 0
+
+
+    @skip_if_no("getpoints")
+    def test_getpoints(self):
+        im = self.colour
+        xs = [(i * 37) % im.width for i in range(500)]
+        ys = [(i * 53) % im.height for i in range(500)]
+
+        values = im.getpoints(xs, ys)
+        assert len(values) == len(xs) * im.bands
+        for i, (x, y) in enumerate(zip(xs, ys)):
+            b = im.bands
+            assert values[i * b:(i + 1) * b] == im.getpoint(x, y)
+
+        # bilinear halfway between two pixels is their average
+        im = im.cast("double")
+        bilinear = pyvips.Interpolate.new("bilinear")
+        values = im.getpoints([10.5], [20], interpolate=bilinear)
+        expected = [(a + b) / 2
+                    for a, b in zip(im.getpoint(10, 20), im.getpoint(11, 20))]
+        assert_almost_equal_objects(values, expected)
+
+        # points outside the image are an error
+        with pytest.raises(pyvips.error.Error):
+            im.getpoints([im.width], [0])
+
+    @skip_if_no("percentiles")
+    def test_percentiles(self):
+        im = pyvips.Image.new_from_file(JPEG_FILE)
+        percent = [1, 50, 99]
+
+        # 8-bit is exact, percent rounds its cumulative histogram a little
+        values = im.percentiles(percent)
+        assert len(values) == len(percent) * im.bands
+        for i, p in enumerate(percent):
+            for b in range(im.bands):
+                pc = im.extract_band(b).percent(p)
+                assert abs(values[i * im.bands + b] - pc) <= 1
+
+        # float goes through the sketch, and should be close
+        approx = im.cast("float").percentiles(percent)
+        for a, b in zip(values, approx):
+            assert abs(a - b) <= 2
+
+        # signed formats are offset into the histogram
+        values = (im.cast("short") - 128).cast("short").percentiles([50])
+        assert values == [x - 128 for x in im.percentiles([50])]
+
 
 if __name__ == '__main__':
     pytest.main()
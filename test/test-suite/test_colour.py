@@ -85,6 +85,27 @@ class TestColour:
 
             assert_almost_equal_objects(before, after, threshold=10)
 
+    def test_colourspace_fused(self):
+        # sRGB to XYZ, Lab and Oklab is done in a single pass, it should match
+        # running the steps one by one
+        x = pyvips.Image.xyz(203, 3)
+        test = x[0].bandjoin([x[1] * 90, 255 - x[0], 42]) \
+            .copy(interpretation="srgb").cast("uchar")
+
+        for fmt in [pyvips.Interpretation.SRGB, pyvips.Interpretation.RGB16]:
+            im = test.colourspace(fmt)
+            xyz = im.sRGB2scRGB().scRGB2XYZ()
+
+            for space, expected in [
+                (pyvips.Interpretation.XYZ, xyz),
+                (pyvips.Interpretation.LAB, xyz.XYZ2Lab()),
+                (pyvips.Interpretation.OKLAB, xyz.XYZ2Oklab())]:
+                fused = im.colourspace(space)
+                assert fused.interpretation == space
+                assert fused.bands == 4
+                assert (fused[0:3] - expected[0:3]).abs().max() < 0.01
+                assert pytest.approx(fused(10, 1)[3], 0.01) == 42
+
     # test results from Bruce Lindbloom's calculator:
     # http://www.brucelindbloom.com
     def test_dE00(self):
@@ -125,6 +146,24 @@ class TestColour:
         assert result < 6
         assert pytest.approx(alpha, 0.001) == 42.0
 
+    # a constant reference takes a shortcut, it should match comparing
+    # against the same colour computed pixel by pixel
+    def test_dE_reference(self):
+        noise = pyvips.Image.gaussnoise(200, 50, mean=0, sigma=40)
+        sample = noise.bandjoin([noise.rot180(), noise.flip("horizontal")])
+        sample = (sample + [50, 0, 0]).copy(
+            interpretation=pyvips.Interpretation.LAB)
+        constant = pyvips.Image.black(200, 50) + [50, 10, 20]
+        constant = constant.copy(interpretation=pyvips.Interpretation.LAB)
+        memory = constant.copy_memory()
+
+        for fn in ["dE00", "dE76", "dECMC"]:
+            for a, b, c, d in [(constant, sample, memory, sample),
+                               (sample, constant, sample, memory)]:
+                fast = getattr(a, fn)(b)
+                slow = getattr(c, fn)(d)
+                assert (fast - slow).abs().max() < 0.01
+
     @skip_if_no("icc_import")
     def test_icc(self):
         test = pyvips.Image.new_from_file(JPEG_FILE)
@@ -165,6 +204,46 @@ class TestColour:
         im = test.icc_import()
         assert im.interpretation == pyvips.Interpretation.LAB
 
+    # 8-bit device to device transforms use an interpolated LUT, which should
+    # be close to the direct 16-bit lcms transform
+    @skip_if_no("icc_transform")
+    def test_icc_transform_lut(self):
+        test = pyvips.Image.new_from_file(JPEG_FILE)
+
+        lut = test.icc_transform(SRGB_FILE)
+        direct = test.icc_transform(SRGB_FILE, depth=16)
+        assert lut.format == pyvips.BandFormat.UCHAR
+        assert (lut - direct / 257).abs().max() < 3
+
+        # the second time round uses the cached LUT
+        again = test.icc_transform(SRGB_FILE)
+        assert (lut - again).abs().max() == 0
+
+        # CMYK in and out
+        cmyk = test.icc_transform("cmyk")
+        assert cmyk.bands == 4
+        back = cmyk.icc_transform(SRGB_FILE)
+        back16 = cmyk.icc_transform(SRGB_FILE, depth=16)
+        assert (back - back16 / 257).abs().max() < 3
+
+    # transforms are shared between operations, check that reuse (and
+    # picking the right entry) gives the same results
+    @skip_if_no("icc_import")
+    def test_icc_transform_cache(self):
+        test = pyvips.Image.new_from_file(JPEG_FILE)
+
+        lab1 = test.icc_import()
+        xyz1 = test.icc_import(pcs=pyvips.PCS.XYZ)
+        lab2 = test.icc_import()
+        xyz2 = test.icc_import(pcs=pyvips.PCS.XYZ)
+        assert (lab1 - lab2).abs().max() == 0
+        assert (xyz1 - xyz2).abs().max() == 0
+        assert xyz2.interpretation == pyvips.Interpretation.XYZ
+
+        rgb1 = lab1.icc_export(depth=16)
+        rgb2 = lab2.icc_export(depth=16)
+        assert (rgb1 - rgb2).abs().max() == 0
+
     # a float image should transform the same as the equivalent 8-bit image
     @skip_if_no("icc_import")
     def test_icc_float_input(self):
@@ -170,6 +170,35 @@ class TestConversion:
         x = self.colour.copy(coding=pyvips.Coding.NONE)
         assert x.coding == pyvips.Coding.NONE
 
+    def test_tilecache(self):
+        # a small cache, so tiles are recycled, over a rotate, so requests
+        # come in a random order
+        for threaded in [False, True]:
+            for max_tiles in [1, 5, 1000, -1]:
+                x = self.colour.rot45()
+                y = x.tilecache(tile_width=16, tile_height=16,
+                                max_tiles=max_tiles, threaded=threaded)
+                assert (x - y).abs().max() == 0
+                assert (x.rot90() - y.rot90()).abs().max() == 0
+
+        # evicted tiles go to disc and come back on a second pass
+        x = self.colour.rot45()
+        y = x.tilecache(tile_width=16, tile_height=16, max_tiles=4,
+                        persistent=True, disc=True)
+        for i in range(2):
+            assert (x - y).abs().max() == 0
+            assert (x.rot90() - y.rot90()).abs().max() == 0
+
+    def test_sequential(self):
+        for prefetch in [0, 1, 4]:
+            y = self.colour.sequential(tile_height=8, prefetch=prefetch)
+            assert (self.colour - y).abs().max() == 0
+
+        # loaders decode ahead in sequential mode
+        x = pyvips.Image.new_from_file(JPEG_FILE)
+        y = pyvips.Image.new_from_file(JPEG_FILE, access="sequential")
+        assert (x - y).abs().max() == 0
+
     def test_bandfold(self):
         x = self.mono.bandfold()
         assert x.width == 1
@@ -242,6 +271,42 @@ class TestConversion:
             pixel = [int(x) & 0xff for x in pixel]
             assert_almost_equal_objects(pixel, [255, 255, 255])
 
+    def test_embed_extend(self):
+        # check whole images against the same thing made by hand
+        im = self.colour.crop(10, 20, 30, 25)
+        w = im.width
+        h = im.height
+        tile = im.join(im.fliphor(), "horizontal")
+        tile = tile.join(tile.flipver(), "vertical")
+
+        for fmt in all_formats:
+            test = im.cast(fmt)
+            tile_fmt = tile.cast(fmt)
+
+            for x, y in [[7, 5], [-7, -5], [3 * w + 2, -h - 1]]:
+                im2 = test.embed(x, y, 3 * w + 1, 3 * h + 2,
+                                 extend=pyvips.Extend.REPEAT)
+                ref = test.replicate(5, 5).crop((-x) % w, (-y) % h,
+                                                3 * w + 1, 3 * h + 2)
+                assert (im2 - ref).abs().max() == 0
+
+                im2 = test.embed(x, y, 3 * w + 1, 3 * h + 2,
+                                 extend=pyvips.Extend.MIRROR)
+                ref = tile_fmt.replicate(4, 4).crop((-x) % (2 * w),
+                                                    (-y) % (2 * h),
+                                                    3 * w + 1, 3 * h + 2)
+                assert (im2 - ref).abs().max() == 0
+
+            im2 = test.embed(7, 5, w + 20, h + 10,
+                             extend=pyvips.Extend.COPY)
+            assert (im2.crop(7, 5, w, h) - test).abs().max() == 0
+            left = test.crop(0, 0, 1, h).replicate(7, 1)
+            assert (im2.crop(0, 5, 7, h) - left).abs().max() == 0
+            bottom = test.crop(0, h - 1, w, 1).replicate(1, 5)
+            assert (im2.crop(7, h + 5, w, 5) - bottom).abs().max() == 0
+            corner = test.crop(w - 1, 0, 1, 1).replicate(13, 5)
+            assert (im2.crop(w + 7, 0, 13, 5) - corner).abs().max() == 0
+
     def test_gravity(self):
         im = pyvips.Image.black(1, 1) + 255
 
@@ -279,6 +344,20 @@ class TestConversion:
             pixel = sub(30, 30)
             assert_almost_equal_objects(pixel, [3, 4])
 
+    def test_alpha_split_join(self):
+        # whole images, so we test the vector paths as well as the tail
+        for fmt in all_formats:
+            colour = self.colour.cast(fmt)
+            alpha = self.mono.cast(fmt)
+
+            rgba = colour.bandjoin(alpha)
+            assert (rgba[3] - alpha).abs().max() == 0
+            assert (rgba.extract_band(0, n=3) - colour).abs().max() == 0
+
+            argb = alpha.bandjoin(colour)
+            assert (argb[0] - alpha).abs().max() == 0
+            assert (argb.extract_band(1, n=3) - colour).abs().max() == 0
+
     def test_slice(self):
         test = self.colour
         bands = [x.avg() for x in test]
@@ -332,6 +411,19 @@ class TestConversion:
         assert opts["attention_x"] == 199
         assert opts["attention_y"] == 234
 
+    def test_smartcrop_fast(self):
+        for interesting in [pyvips.enums.Interesting.ENTROPY,
+                            pyvips.enums.Interesting.ATTENTION]:
+            test, opts = self.image.smartcrop(
+                100, 100,
+                interesting=interesting,
+                fast=True,
+                attention_x=True, attention_y=True)
+            assert test.width == 100
+            assert test.height == 100
+            assert 0 <= -test.xoffset <= self.image.width - 100
+            assert 0 <= -test.yoffset <= self.image.height - 100
+
     def test_smartcrop_rgba(self):
         rgba = pyvips.Image.new_from_file(RGBA_FILE)
         test, opts = rgba.smartcrop(
@@ -431,6 +523,16 @@ class TestConversion:
                 # differs ... don't require huge accuracy
                 assert abs(x - y) < 2
 
+        # round trip a whole RGBA image, so we test every pixel of the
+        # vector paths and the scalar tails
+        rgba = pyvips.Image.new_from_file(RGBA_FILE)
+        for fmt in ["uchar", "ushort", "float"]:
+            test = rgba.cast(fmt)
+            im = test.premultiply().unpremultiply().cast(fmt)
+            diff = (im - test).abs()
+            mask = test[3] > 0
+            assert mask.ifthenelse(diff, 0).max() <= 1
+
     def test_composite(self):
         # 50% transparent image
         overlay = self.colour.bandjoin(128)
@@ -440,6 +542,17 @@ class TestConversion:
         assert_almost_equal_objects(comp(0, 0), [51.8, 52.8, 53.8, 255],
                                     threshold=0.1)
 
+    def test_composite_general(self):
+        # mono + alpha goes through the general blend path, which must scale
+        # incoming pixels to 0 - 1 ... this used to give 255
+        base = (pyvips.Image.black(1, 1) + 100).bandjoin(255) \
+            .copy(interpretation="b-w").cast("uchar")
+        overlay = (pyvips.Image.black(1, 1) + 200).bandjoin(128) \
+            .copy(interpretation="b-w").cast("uchar")
+        comp = base.composite(overlay, "over")
+
+        assert_almost_equal_objects(comp(0, 0), [150.2, 255], threshold=1)
+
     def _lum(self, c):
         return 0.3 * c[0] + 0.59 * c[1] + 0.11 * c[2]
 
@@ -546,6 +659,50 @@ class TestConversion:
                 base_rgb, base_a, over_rgb, over_a, mode)
             assert_almost_equal_objects(comp(0, 0), expected, threshold=0.6)
 
+    def test_composite_vector(self):
+        # wide RGBA images go through the SIMD path, a single pixel goes
+        # through the per-pixel code, and they should agree
+        width = 37
+        x = pyvips.Image.xyz(width, 4)
+        base = x[0].bandjoin([x[1] * 40, x[0] * 3, x[0] * 7 + 20]) \
+            .copy(interpretation="srgb")
+        overlay = (x[0] * 5).bandjoin([x[1] * 60, 200 - x[0], x[0] * 6]) \
+            .copy(interpretation="srgb")
+
+        for fmt in ["uchar", "ushort", "float"]:
+            b = base.cast(fmt)
+            o = overlay.cast(fmt)
+            for mode in ["over", "dest-over", "add", "multiply", "screen"]:
+                comp = b.composite(o, mode)
+                for (px, py) in [(0, 0), (9, 1), (31, 2), (width - 1, 3)]:
+                    expected = b.crop(px, py, 1, 1) \
+                        .composite(o.crop(px, py, 1, 1), mode)(0, 0)
+                    assert_almost_equal_objects(comp(px, py), expected,
+                                                threshold=1)
+
+    def test_composite_spans(self):
+        # runs of transparent overlay pixels should pass the base through
+        # untouched, runs of opaque pixels with OVER should give the overlay
+        x = pyvips.Image.xyz(60, 3)
+        base = (x[0] * 3).bandjoin([x[1] * 50, x[0] + 10, 200]) \
+            .copy(interpretation="srgb").cast("uchar")
+        alpha = (x[0] < 20).ifthenelse(0, (x[0] < 40).ifthenelse(128, 255))
+        overlay = (x[0] * 2).bandjoin([90, x[1] * 30, alpha]) \
+            .copy(interpretation="srgb").cast("uchar")
+
+        comp = base.composite(overlay, "over")
+        assert (comp.crop(0, 0, 20, 3) - base.crop(0, 0, 20, 3)) \
+            .abs().max() == 0
+        assert (comp.crop(40, 0, 20, 3) - overlay.crop(40, 0, 20, 3)) \
+            .abs().max() == 0
+
+        # the half transparent middle still blends
+        px = comp(30, 1)
+        expected = base.crop(30, 1, 1, 1) \
+            .composite(overlay.crop(30, 1, 1, 1), "over")(0, 0)
+        assert_almost_equal_objects(px, expected, threshold=1)
+        assert px != base(30, 1)
+
     def test_unpremultiply(self):
         for fmt in unsigned_formats + [pyvips.BandFormat.SHORT,
                                        pyvips.BandFormat.INT] + float_formats:
@@ -713,6 +870,52 @@ class TestConversion:
         result = r(50, 50)
         assert_almost_equal_objects(result, [3.0, 4.9, 6.9], threshold=0.1)
 
+    def test_ifthenelse_whole(self):
+        # whole images, so we test the vector paths as well as the tail
+        xyz = pyvips.Image.xyz(301, 20)
+        x = xyz[0]
+        y = xyz[1]
+        c = ((x * 11 + y) % 256).cast("uchar")
+        c = (c < 20).ifthenelse(0, c)
+        c = (c > 230).ifthenelse(255, c)
+        a = (x * 7 + y * 13) % 256
+        b = (x * 3 + y * 29) % 256
+        c01 = (c != 0) / 255
+
+        for scale, fmt in [[1, "uchar"], [257, "ushort"], [1, "float"]]:
+            ta = (a * scale).cast(fmt)
+            tb = (b * scale).cast(fmt)
+
+            r = c.ifthenelse(ta, tb)
+            predict = c01 * ta + (1 - c01) * tb
+            assert (r - predict).abs().max() == 0
+
+            r = c.ifthenelse(ta, tb, blend=True)
+            if fmt == "float":
+                predict = (c * ta + (255 - c) * tb) / 255
+                assert (r - predict).abs().max() < 0.01
+            else:
+                predict = ((c * ta + (255 - c) * tb + 128) / 255).floor()
+                assert (r - predict).abs().max() == 0
+
+    def test_ifthenelse_constant(self):
+        # a constant condition with a mix of zero and non-zero bands must
+        # still be computed for the mix loop
+        xyz = pyvips.Image.xyz(301, 20)
+        a = (xyz[0] + 10).bandjoin([xyz[0] + 20, xyz[0] + 30])
+        b = xyz[1].bandjoin([xyz[1] + 1, xyz[1] + 2])
+        c = (pyvips.Image.black(301, 20, bands=3) + [255, 0, 255]).cast("uchar")
+
+        r = c.ifthenelse(a, b)
+        assert (r[0] - a[0]).abs().max() == 0
+        assert (r[1] - b[1]).abs().max() == 0
+        assert (r[2] - a[2]).abs().max() == 0
+
+        r = c.ifthenelse(a, b, blend=True)
+        assert (r[0] - a[0]).abs().max() == 0
+        assert (r[1] - b[1]).abs().max() == 0
+        assert (r[2] - a[2]).abs().max() == 0
+
     def test_switch(self):
         x = pyvips.Image.grey(256, 256, uchar=True)
 
@@ -855,6 +1058,28 @@ class TestConversion:
 
         self.run_unary([self.colour], recomb, fmt=noncomplex_formats)
 
+    def test_recomb_small(self):
+        # the 3 and 4 band cases have a float SIMD path ... check against
+        # the double path
+        matrices = [
+            [[0.2, 0.5, 0.3], [0.1, 0.8, 0.1], [-0.3, 0.2, 1.1]],
+            [[0.2, 0.5, 0.3, 0], [0.1, 0.8, 0.1, 0], [-0.3, 0.2, 1.1, 0],
+             [0, 0, 0, 1]],
+            [[0.2, 0.5, 0.3, 0.5], [0.1, 0.8, 0.1, 0], [-0.3, 0.2, 1.1, 0]],
+        ]
+        rgba = self.colour.bandjoin(self.mono)
+
+        for array in matrices:
+            im = self.colour if len(array[0]) == 3 else rgba
+            for fmt in ["uchar", "ushort", "float"]:
+                test = im.cast(fmt)
+                result = test.recomb(array)
+                expected = test.cast("double").recomb(array)
+
+                assert result.format == "float"
+                assert result.bands == len(array)
+                assert (result - expected).abs().max() < 0.01
+
     def test_replicate(self):
         for fmt in all_formats:
             im = self.colour.cast(fmt)
@@ -905,6 +1130,31 @@ class TestConversion:
                 diff = (after - im).abs().max()
                 assert diff == 0
 
+    def test_rot_pixel_sizes(self):
+        # each pixel size has its own copy loop ... use a non-square image
+        # larger than a block
+        test = self.colour.crop(0, 0, 71, 53)
+        for fmt, bands in [("uchar", 1), ("ushort", 1), ("uchar", 3),
+                           ("uchar", 4), ("ushort", 3), ("float", 2),
+                           ("double", 3)]:
+            im = test.cast(fmt)
+            im = im.bandjoin([im[0]] * (bands - 3)) if bands > 3 \
+                else im.extract_band(0, n=bands)
+
+            im2 = im.rot90()
+            assert im2.width == im.height
+            assert im2.height == im.width
+            assert_almost_equal_objects(im(3, 5), im2(im.height - 6, 3))
+
+            im2 = im.rot180()
+            assert_almost_equal_objects(im(3, 5),
+                                        im2(im.width - 4, im.height - 6))
+
+            im2 = im.rot270()
+            assert_almost_equal_objects(im(3, 5), im2(5, im.width - 4))
+
+            assert (im.rot90().rot270() - im).abs().max() == 0
+
     def test_autorot(self):
         rotation_images = os.path.join(IMAGES, 'rotation')
         files = os.listdir(rotation_images)
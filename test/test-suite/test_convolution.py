@@ -135,6 +135,34 @@ class TestConvolution:
                         true = compass(im, msk, 24, 49, times, operator.add)
                         assert_almost_equal_objects(result, true)
 
+    def test_sobel(self):
+        for im in self.all_images:
+            for fmt in [pyvips.BandFormat.UCHAR, pyvips.BandFormat.FLOAT]:
+                x = (im * 20).cast(fmt)
+                edge = x.sobel()
+                assert edge.format == pyvips.BandFormat.UCHAR
+                assert edge.bands == x.bands
+
+                gx = conv(x, self.sobel, 24, 49)
+                gy = conv(x, self.sobel.rot90(), 24, 49)
+                if fmt == pyvips.BandFormat.UCHAR:
+                    true = [min(255, abs(a) + abs(b))
+                            for a, b in zip(gx, gy)]
+                else:
+                    true = [min(255, int((a * a + b * b) ** 0.5))
+                            for a, b in zip(gx, gy)]
+
+                assert_almost_equal_objects(edge(25, 50), true)
+
+    def test_canny(self):
+        for im in self.all_images:
+            for fmt in [pyvips.BandFormat.UCHAR, pyvips.BandFormat.FLOAT]:
+                x = (im * 20).cast(fmt)
+                edge = x.canny()
+                assert edge.bands == x.bands
+                assert edge.width == x.width
+                assert edge.height == x.height
+
     def test_convsep(self):
         for im in self.all_images:
             for prec in [pyvips.Precision.INTEGER, pyvips.Precision.FLOAT]:
@@ -178,6 +206,18 @@ class TestConvolution:
                 assert x == 25
                 assert y == 50
 
+    def test_spcor_large(self):
+        # big enough to use the FFT path, if we have one
+        for im in self.all_images:
+            for fmt in noncomplex_formats:
+                big = im.crop(10, 30, 40, 40).cast(fmt)
+                cor = im.spcor(big)
+                v, x, y = cor.maxpos()
+
+                assert abs(v - 1.0) < 0.001
+                assert x == 30
+                assert y == 50
+
     def test_gaussblur(self):
         for im in self.all_images:
             for prec in [pyvips.Precision.INTEGER, pyvips.Precision.FLOAT]:
@@ -195,6 +235,67 @@ class TestConvolution:
                     assert_almost_equal_objects(a_point, b_point,
                                                 threshold=0.1)
 
+    def test_conv_float_taps(self):
+        # float convolution has special cases for small masks, check them
+        # and the general case against a sum of shifted images
+        x = pyvips.Image.xyz(100, 80)
+        im = (x[0] * 2 + x[1]).bandjoin(pyvips.Image.gaussnoise(100, 80))
+        for fmt in ["uchar", "float", "double", "complex"]:
+            test = im.cast(fmt)
+            for w, h in [(1, 3), (5, 1), (1, 7), (3, 3), (4, 4)]:
+                mask = pyvips.Image.new_from_array(
+                    [[i + j * w - 6 for i in range(w)] for j in range(h)])
+                result = test.conv(mask, precision="float")
+
+                big = test.embed(w // 2, h // 2,
+                                 test.width + w - 1, test.height + h - 1,
+                                 extend="copy")
+                reference = 0
+                for j in range(h):
+                    for i in range(w):
+                        reference += big.crop(i, j, test.width,
+                                              test.height) * mask(i, j)[0]
+
+                assert (result - reference).abs().max() < 0.1
+
+    def test_gaussblur_recursive(self):
+        im = pyvips.Image.new_from_file(JPEG_FILE)
+        for sigma in [5, 30]:
+            a = im.gaussblur(sigma, min_ampl=0.01)
+            b = im.gaussblur(sigma, recursive=True)
+
+            assert b.width == im.width
+            assert b.height == im.height
+            assert b.format == im.format
+            assert (a - b).abs().avg() < 2
+
+        b = im.gaussblur(30, recursive=True, precision="float")
+        assert b.format == pyvips.BandFormat.FLOAT
+
+        # flat areas stay flat
+        flat = pyvips.Image.black(300, 200) + 100
+        b = flat.gaussblur(50, recursive=True)
+        assert b.min() == 100
+        assert b.max() == 100
+
+    @skip_if_no("convfft")
+    def test_convfft(self):
+        # several blocks across and down, and a partial block at the edges
+        x = pyvips.Image.xyz(300, 200)
+        im = (x[0] * 2 + x[1]).bandjoin(pyvips.Image.gaussnoise(300, 200))
+        for fmt in ["uchar", "short", "double"]:
+            test = im.cast(fmt)
+            for w, h in [(41, 33), (5, 70)]:
+                mask = pyvips.Image.new_from_array(
+                    [[(i * 7 + j * 3) % 11 - 4 for i in range(w)]
+                     for j in range(h)], scale=w * h, offset=12)
+                result = test.convfft(mask)
+                reference = test.conv(mask, precision="float")
+
+                assert result.width == test.width
+                assert result.height == test.height
+                assert (result - reference).abs().max() < 0.01
+
     def test_sharpen(self):
         for im in self.all_images:
             for fmt in noncomplex_formats:
@@ -29,6 +29,29 @@ class TestCreate:
             assert len(pixel) == 3
             assert_almost_equal_objects(pixel, [0, 0, 0])
 
+    def test_black_fold(self):
+        # operations on constant images are folded, check the values
+        im = pyvips.Image.black(100, 100, bands=3) * [1, 2, 3] + 10
+        assert im(50, 50) == [10, 10, 10]
+        assert im.avg() == 10
+
+        im = (pyvips.Image.black(100, 100) + 7).cast("float")
+        im = im.embed(10, 10, 200, 200, extend="copy")
+        assert im.format == pyvips.BandFormat.FLOAT
+        assert im(0, 0) == [7]
+        assert im(199, 199) == [7]
+
+        # an embed into a different colour is not constant
+        im = (pyvips.Image.black(10, 10) + 7).embed(10, 10, 30, 30)
+        assert im(0, 0) == [0]
+        assert im(15, 15) == [7]
+
+        # constant conditions
+        a = pyvips.Image.black(100, 100) + 1
+        b = pyvips.Image.black(100, 100) + [2, 3, 4]
+        assert a.ifthenelse(b, 5)(10, 10) == [2, 3, 4]
+        assert (a - 1).ifthenelse(b, 5)(10, 10) == [5, 5, 5]
+
     def test_buildlut(self):
         M = pyvips.Image.new_from_array([[0, 0],
                                          [255, 100]])
@@ -77,6 +100,50 @@ class TestCreate:
         im = pyvips.Image.black(2, 1)
         im.fwfft()
 
+    @skip_if_no("fwfft")
+    def test_fwfft_plan_cache(self):
+        # plans are cached and shared, repeated transforms of the same size
+        # should round-trip every time
+        for width, height in [(64, 48), (33, 17)]:
+            im = pyvips.Image.gaussnoise(width, height)
+            for i in range(3):
+                real = im.fwfft().invfft(real=True)
+                assert (real - im).abs().max() < 0.001
+
+                complex = im.cast("complex").fwfft().invfft()
+                assert (complex - im).abs().max() < 0.001
+
+    @skip_if_no("fwfft")
+    def test_fwfft_half(self):
+        for width, height in [(64, 48), (33, 17)]:
+            im = pyvips.Image.gaussnoise(width, height)
+
+            half = im.fwfft(half=True)
+            assert half.width == width // 2 + 1
+            assert half.height == height
+            assert half.get("fft-width") == width
+
+            # the left half should match the full spectrum
+            full = im.fwfft().crop(0, 0, half.width, height)
+            assert (half - full).abs().max() < 0.01
+
+            # non-double images can go through single precision fftw
+            real = half.invfft(real=True)
+            assert real.width == width
+            assert "fft-width" not in real.get_fields()
+            assert (real - im).abs().max() < 0.01
+
+            complex = half.invfft()
+            assert complex.width == width
+            assert (complex.real() - im).abs().max() < 0.01
+
+            # freqmult works on the half spectrum, it should match filtering
+            # the full one
+            mask = pyvips.Image.mask_gaussian(width, height, 0.3, 0.1)
+            filtered = im.freqmult(mask)
+            full = (im.fwfft() * mask).invfft(real=True)
+            assert (filtered - full).abs().max() < 0.01
+
     @skip_if_no("fwfft")
     def test_fractsurf(self):
         im = pyvips.Image.fractsurf(100, 90, 2.5)
@@ -130,6 +197,18 @@ class TestCreate:
         assert sigma == pytest.approx(10, abs=0.4)
         assert mean == pytest.approx(100, abs=0.4)
 
+    def test_gaussnoise_seed(self):
+        # pixels depend only on the seed and their position, so any width
+        # (and so any split between vector body and tail) gives the same
+        # values
+        im = pyvips.Image.gaussnoise(100, 90, seed=42)
+        for width in [1, 7, 37, 64]:
+            small = pyvips.Image.gaussnoise(width, 5, seed=42)
+            assert (im.crop(0, 0, width, 5) - small).abs().max() == 0
+
+        other = pyvips.Image.gaussnoise(100, 90, seed=43)
+        assert (im - other).abs().max() > 0
+
     def test_grey(self):
         im = pyvips.Image.grey(100, 90)
         assert im.width == 100
@@ -425,6 +504,17 @@ class TestCreate:
         im2 = pyvips.Image.text("helloworld", width=100, dpi=500, wrap="char")
         assert im1.width > im2.width
 
+        # a second render (from the text cache) should match the first, and
+        # give the same autofit dpi
+        pyvips.cache_set_max(0)
+        im1, opts1 = pyvips.Image.text("Hello, world!", width=500,
+                                       height=500, autofit_dpi=True)
+        im2, opts2 = pyvips.Image.text("Hello, world!", width=500,
+                                       height=500, autofit_dpi=True)
+        pyvips.cache_set_max(100)
+        assert opts1["autofit_dpi"] == opts2["autofit_dpi"]
+        assert (im1 - im2).abs().max() == 0
+
     def test_tonelut(self):
         im = pyvips.Image.tonelut()
         assert im.bands == 1
@@ -36,6 +36,25 @@ class TestDraw:
         diff = (im - im2).abs().max()
         assert diff == 0
 
+    def test_draw_flood_large(self):
+        # big enough for the parallel fill ... a serpentine of walls makes
+        # the filled area cross every strip many times
+        xy = pyvips.Image.xyz(2100, 2100)
+        x = xy[0]
+        y = xy[1]
+        walls = ((x % 40 == 0) & (y < 2080)) | ((x % 40 == 20) & (y > 20))
+        walls = walls.cast("uchar")
+
+        # filling in place uses the parallel path, filling with a separate
+        # test image uses the serial one
+        im = walls.draw_flood(128, 10, 10, equal=True)
+        im2 = pyvips.Image.black(2100, 2100).draw_flood(128, 10, 10,
+                                                        test=walls,
+                                                        equal=True)
+
+        assert ((im == 128) == (im2 == 128)).min() == 255
+        assert (im == 128).avg() > 0
+
     def test_draw_flood_out_of_bounds(self):
         im = pyvips.Image.black(100, 100)
         with pytest.raises(pyvips.error.Error):
@@ -108,5 +127,33 @@ class TestDraw:
         assert diff == 0
 
 
+    def test_draw_list(self):
+        # big enough to need several cells, with primitives across the
+        # cell edges and off the image
+        rects = [10, 10, 200, 150, 250, 5, 3, 3, -20, 280, 60, 60]
+        circles = [128, 128, 40, 300, 300, 30, 5, 5, 20]
+        lines = [0, 0, 299, 299, 299, 0, 0, 250, 50, 140, 280, 140]
+        points = [1, 2, 129, 129, 299, 299]
+
+        for fill in [False, True]:
+            im = pyvips.Image.black(300, 300)
+            im2 = im.draw_list([100], rects=rects, circles=circles,
+                               lines=lines, points=points, fill=fill)
+
+            im3 = im
+            for i in range(0, len(rects), 4):
+                im3 = im3.draw_rect(100, *rects[i:i + 4], fill=fill)
+            for i in range(0, len(circles), 3):
+                im3 = im3.draw_circle(100, *circles[i:i + 3], fill=fill)
+            for i in range(0, len(lines), 4):
+                im3 = im3.draw_line(100, *lines[i:i + 4])
+            for i in range(0, len(points), 2):
+                im3 = im3.draw_rect(100, *points[i:i + 2], 1, 1)
+
+            assert (im2 - im3).abs().max() == 0
+
+        # the input is not changed
+        assert im.max() == 0
+
 if __name__ == '__main__':
     pytest.main()
@@ -1,13 +1,127 @@
 # vim: set fileencoding=utf-8 :
+import io
 import sys
 import os
 import shutil
+import struct
 import tempfile
+import zipfile
 import pytest
 
 import pyvips
 from helpers import *
 
+
+def heif_boxes(data, start, end):
+    """Walk the ISOBMFF boxes in data[start:end], yielding type, body start
+    and body end.
+    """
+    while start + 8 <= end:
+        size, box_type = struct.unpack(">I4s", data[start:start + 8])
+        header = 8
+        if size == 1:
+            size = struct.unpack(">Q", data[start + 8:start + 16])[0]
+            header = 16
+        elif size == 0:
+            size = end - start
+        assert 8 <= size <= end - start
+        yield box_type.decode("latin-1"), start + header, start + size
+        start += size
+
+
+def heif_structure(data):
+    """Read the item structure of a HEIF file without libheif, so we can
+    check files we assemble ourselves with a second reader.
+
+    Returns the primary item ID, a dict of item ID to [type, hidden], a list
+    of [type, from, [to]] references and a dict of item ID to a list of
+    [type, body] for the associated properties.
+    """
+    primary = None
+    items = {}
+    references = []
+    ipco = []
+    associations = {}
+
+    for box_type, start, end in heif_boxes(data, 0, len(data)):
+        if box_type != "meta":
+            continue
+
+        for child, cstart, cend in heif_boxes(data, start + 4, end):
+            version = data[cstart]
+            flags = int.from_bytes(data[cstart + 1:cstart + 4], "big")
+            p = cstart + 4
+
+            if child == "pitm":
+                primary = struct.unpack(">H" if version == 0 else ">I",
+                                        data[p:p + (2 if version == 0 else 4)])[0]
+            elif child == "iinf":
+                p += 2 if version == 0 else 4
+                for infe, istart, iend in heif_boxes(data, p, cend):
+                    infe_version = data[istart]
+                    hidden = data[istart + 3] & 1 == 1
+                    q = istart + 4
+                    if infe_version == 2:
+                        item_id = struct.unpack(">H", data[q:q + 2])[0]
+                        q += 2
+                    else:
+                        item_id = struct.unpack(">I", data[q:q + 4])[0]
+                        q += 4
+                    item_type = data[q + 2:q + 6].decode("latin-1")
+                    items[item_id] = [item_type, hidden]
+            elif child == "iref":
+                id_format = ">H" if version == 0 else ">I"
+                id_size = struct.calcsize(id_format)
+                for ref, rstart, rend in heif_boxes(data, p, cend):
+                    q = rstart
+                    from_id = struct.unpack(id_format, data[q:q + id_size])[0]
+                    q += id_size
+                    n = struct.unpack(">H", data[q:q + 2])[0]
+                    q += 2
+                    to = [struct.unpack(id_format,
+                                        data[q + i * id_size:
+                                             q + (i + 1) * id_size])[0]
+                          for i in range(n)]
+                    references.append([ref, from_id, to])
+            elif child == "iprp":
+                for sub, sstart, send in heif_boxes(data, cstart, cend):
+                    if sub == "ipco":
+                        for prop, pstart, pend in heif_boxes(data,
+                                                             sstart, send):
+                            ipco.append([prop, data[pstart:pend]])
+                    elif sub == "ipma":
+                        version = data[sstart]
+                        flags = int.from_bytes(data[sstart + 1:sstart + 4],
+                                               "big")
+                        q = sstart + 4
+                        n = struct.unpack(">I", data[q:q + 4])[0]
+                        q += 4
+                        for i in range(n):
+                            if version < 1:
+                                item_id = struct.unpack(">H", data[q:q + 2])[0]
+                                q += 2
+                            else:
+                                item_id = struct.unpack(">I", data[q:q + 4])[0]
+                                q += 4
+                            n_associations = data[q]
+                            q += 1
+                            for j in range(n_associations):
+                                if flags & 1:
+                                    index = struct.unpack(">H",
+                                                          data[q:q + 2])[0]
+                                    index &= 0x7fff
+                                    q += 2
+                                else:
+                                    index = data[q] & 0x7f
+                                    q += 1
+                                associations.setdefault(item_id, []).append(index)
+
+    properties = {item_id: [ipco[index - 1] for index in indexes if index > 0]
+                  for item_id, indexes in associations.items()}
+
+    return primary, items, references, properties
+
+
 class TestForeign:
     tempdir = None
 
@@ -136,6 +250,53 @@ class TestForeign:
 
         x = None
 
+    def test_vips_tiled(self):
+        # tile size doesn't divide the image, so we have edge tiles
+        self.save_load_file(".v", "[tile,tile_width=100,tile_height=60]",
+                            self.colour)
+        self.save_load_file(".v", "[tile]", self.mono)
+
+        # metadata is kept
+        filename = temp_filename(self.tempdir, ".v")
+        self.colour.vipssave(filename, tile=True)
+        x = pyvips.Image.new_from_file(filename)
+        assert x.get("exif-data") == self.colour.get("exif-data")
+
+        # random access
+        assert x.crop(300, 200, 10, 10).avg() == \
+            self.colour.crop(300, 200, 10, 10).avg()
+        x = None
+
+        # zstd is optional
+        filename = temp_filename(self.tempdir, ".v")
+        try:
+            self.colour.vipssave(filename, tile=True, level=1)
+        except pyvips.Error:
+            return
+        x = pyvips.Image.new_from_file(filename)
+        assert (x - self.colour).abs().max() == 0
+        x = None
+
+    def test_vips_tiled_corrupt(self):
+        filename = temp_filename(self.tempdir, ".v")
+        self.mono.vipssave(filename, tile=True)
+        with open(filename, "rb") as f:
+            data = bytearray(f.read())
+
+        # the magic gives the byte order of the rest of the header
+        order = "<" if data[0] == 0xb6 else ">"
+
+        # a huge tile count must not wrap and pass the index checks
+        for size, tile in [[65536, 1], [46341, 1], [4000000, 2]]:
+            struct.pack_into(order + "ii", data, 4, size, size)
+            struct.pack_into(order + "II", data, 64, tile, tile)
+            bad = temp_filename(self.tempdir, ".v")
+            with open(bad, "wb") as f:
+                f.write(data)
+            with pytest.raises(pyvips.error.Error):
+                x = pyvips.Image.new_from_file(bad)
+                x.avg()
+
     @skip_if_no("jpegload")
     def test_jpeg(self):
         def jpeg_valid(im):
@@ -307,6 +468,188 @@ class TestForeign:
         im10 = pyvips.Image.jpegload_buffer(r10)
         assert im0.avg() == im10.avg()
 
+    @skip_if_no("jpegload")
+    def test_zero_copy(self):
+        # these loaders decode memory sources in place
+        ZERO_COPY = 8
+        for loader, filename in [("jpegload_source", JPEG_FILE),
+                                 ("pngload_source", PNG_FILE),
+                                 ("webpload_source", WEBP_FILE),
+                                 ("gifload_source", GIF_FILE)]:
+            if not have(loader):
+                continue
+            with open(filename, "rb") as f:
+                source = pyvips.Source.new_from_memory(f.read())
+            im, opts = pyvips.Operation.call(loader, source, flags=True)
+            assert opts["flags"] & ZERO_COPY
+
+    @skip_if_no("jpegload")
+    def test_exif_lazy(self):
+        im = pyvips.Image.new_from_file(JPEG_FILE)
+        if im.get_typeof("exif-ifd0-Orientation") == 0:
+            return
+
+        # exif tags are expanded on first use, on any copy of the image
+        im = pyvips.Image.new_from_file(JPEG_FILE)
+        x = im.copy()
+        assert x.get("orientation") == 1
+        assert x.get_typeof("exif-ifd0-Orientation") != 0
+        assert "exif-ifd0-Orientation" in im.get_fields()
+        assert im.get("exif-ifd0-Orientation") == \
+            x.get("exif-ifd0-Orientation")
+
+    @skip_if_no("jpegsave")
+    def test_jpegload_restart(self):
+        # jpegs with restart markers are decoded in parallel from memory, but
+        # sequentially from a non-mappable source ... they must match
+        def load_sequential(buf, **kwargs):
+            data = io.BytesIO(buf)
+            source = pyvips.SourceCustom()
+            source.on_read(lambda size: data.read(size))
+            return pyvips.Image.new_from_source(source, "", **kwargs)
+
+        im = pyvips.Image.new_from_file(JPEG_FILE)
+        for subsample_mode in ["on", "off"]:
+            for restart_interval in [1, 7, 64]:
+                buf = im.jpegsave_buffer(subsample_mode=subsample_mode,
+                                         restart_interval=restart_interval)
+                for shrink in [1, 2]:
+                    a = pyvips.Image.new_from_buffer(buf, "", shrink=shrink)
+                    b = load_sequential(buf, shrink=shrink)
+                    assert a.width == b.width
+                    assert a.height == b.height
+                    assert (a - b).abs().max() == 0
+
+    @skip_if_no("jpegload")
+    def test_jpegload_scale(self):
+        im = pyvips.Image.new_from_file(JPEG_FILE)
+        for num in [3, 5, 8]:
+            x = pyvips.Image.new_from_file(JPEG_FILE, scale=num / 8)
+            assert x.width == (im.width * num + 7) // 8
+            assert x.height == (im.height * num + 7) // 8
+
+        # scale 1/2 and shrink 2 are the same decode
+        a = pyvips.Image.new_from_file(JPEG_FILE, scale=0.5)
+        b = pyvips.Image.new_from_file(JPEG_FILE, shrink=2)
+        assert (a - b).abs().max() == 0
+
+    @skip_if_no("jpegload")
+    def test_jpegload_area(self):
+        im = pyvips.Image.new_from_file(JPEG_FILE)
+        for left, top, width, height in [(0, 0, 10, 10),
+                                         (37, 101, 123, 77),
+                                         (im.width - 20, im.height - 9,
+                                          20, 9)]:
+            a = pyvips.Image.new_from_file(JPEG_FILE,
+                                           area=[left, top, width, height])
+            b = im.crop(left, top, width, height)
+            assert a.width == width
+            assert a.height == height
+            assert (a - b).abs().avg() < 1
+
+            # crop on a load may be pushed down into the loader
+            c = pyvips.Image.new_from_file(JPEG_FILE, access="sequential") \
+                .crop(left, top, width, height)
+            assert c.width == width
+            assert (a - c).abs().avg() < 1
+
+        with pytest.raises(pyvips.error.Error):
+            x = pyvips.Image.new_from_file(JPEG_FILE,
+                                           area=[0, 0, im.width + 1, 10])
+            x.avg()
+
+    @skip_if_no("jpegsave")
+    def test_jpegsave_parallel(self):
+        # baseline jpegs with a restart interval are compressed in parallel
+        # bands, optimize_coding forces a serial write ... the coefficients
+        # must match
+        im = pyvips.Image.new_from_file(JPEG_FILE)
+        for subsample_mode in ["on", "off"]:
+            for restart_interval in [0, 1, 7, 64]:
+                a = im.jpegsave_buffer(subsample_mode=subsample_mode,
+                                       restart_interval=restart_interval)
+                b = im.jpegsave_buffer(subsample_mode=subsample_mode,
+                                       restart_interval=restart_interval,
+                                       optimize_coding=True)
+                a = pyvips.Image.jpegload_buffer(a)
+                b = pyvips.Image.jpegload_buffer(b)
+                assert (a - b).abs().max() == 0
+
+        # and mono images too
+        mono = im.colourspace("b-w")
+        a = pyvips.Image.jpegload_buffer(
+            mono.jpegsave_buffer(restart_interval=8))
+        b = pyvips.Image.jpegload_buffer(
+            mono.jpegsave_buffer(restart_interval=8, optimize_coding=True))
+        assert (a - b).abs().max() == 0
+
+        # no restart interval means no DRI marker
+        buf = pyvips.Image.black(1000, 1000).jpegsave_buffer()
+        assert buf.find(b"\xff\xdd") < 0
+
+    @skip_if_no("jpegtran")
+    def test_jpegtran(self):
+        def jpegtran(buf, **kwargs):
+            source = pyvips.Source.new_from_memory(buf)
+            target = pyvips.Target.new_to_memory()
+            opts = pyvips.Operation.call("jpegtran", source, target,
+                                         lossless=True, **kwargs)
+            return target.get("blob"), opts["lossless"]
+
+        # an MCU-aligned image can be rotated and flipped losslessly, and
+        # four rotates must give the original pixels back
+        im = pyvips.Image.new_from_file(JPEG_FILE).crop(0, 0, 288, 432)
+        buf = im.jpegsave_buffer()
+        original = pyvips.Image.new_from_buffer(buf, "")
+
+        x = buf
+        for i in range(4):
+            x, lossless = jpegtran(x, angle="d90")
+            assert lossless
+        x = pyvips.Image.new_from_buffer(x, "")
+        assert (x - original).abs().max() == 0
+
+        x, lossless = jpegtran(buf, angle="d90", flip=True)
+        assert lossless
+        x = pyvips.Image.new_from_buffer(x, "")
+        y = original.rot90().fliphor()
+        assert x.width == y.width
+        assert x.height == y.height
+        assert (x - y).abs().avg() < 2
+
+        # MCU-aligned crops are lossless too
+        x, lossless = jpegtran(buf, left=16, top=32, width=100, height=50)
+        assert lossless
+        x = pyvips.Image.new_from_buffer(x, "")
+        assert x.width == 100
+        assert x.height == 50
+        assert (x - original.crop(16, 32, 100, 50)).abs().max() < 10
+
+        # partial MCUs can't be flipped, so we must decode, unless we trim
+        buf = pyvips.Image.new_from_file(JPEG_FILE).jpegsave_buffer()
+        x, lossless = jpegtran(buf, angle="d180")
+        assert not lossless
+        x = pyvips.Image.new_from_buffer(x, "")
+        assert x.width == 290
+        assert x.height == 442
+
+        x, lossless = jpegtran(buf, angle="d180", trim=True)
+        assert lossless
+        x = pyvips.Image.new_from_buffer(x, "")
+        assert x.width == 288
+        assert x.height == 432
+
+        # orientation is applied and removed
+        im = pyvips.Image.new_from_file(JPEG_FILE).crop(0, 0, 288, 432)
+        im = im.copy()
+        im.set_type(pyvips.GValue.gint_type, "orientation", 6)
+        x, lossless = jpegtran(im.jpegsave_buffer(), autorotate=True)
+        assert lossless
+        x = pyvips.Image.new_from_buffer(x, "")
+        assert x.width == 432
+        assert x.height == 288
+        assert x.get("orientation") == 1
+
     @skip_if_no("jpegsave")
     def test_jpegsave_exif(self):
         def exif_valid(im):
@@ -711,6 +1054,44 @@ class TestForeign:
 
         assert im.avg() == im2.avg()
 
+    @skip_if_no("pngsave")
+    def test_pngsave_parallel(self):
+        # large non-interlaced images are deflated in parallel bands,
+        # interlace forces a serial write
+        im = self.colour.replicate(2, 4)
+        for filter in ["none", "sub", "up", "avg", "paeth", "all"]:
+            for bitdepth in [8, 16]:
+                a = im.pngsave_buffer(filter=filter, bitdepth=bitdepth)
+                b = im.pngsave_buffer(filter=filter, bitdepth=bitdepth,
+                                      interlace=True)
+                a = pyvips.Image.pngload_buffer(a)
+                b = pyvips.Image.pngload_buffer(b)
+                assert a.width == im.width
+                assert a.height == im.height
+                assert (a - b).abs().max() == 0
+
+        # and mono + alpha
+        mono = im.colourspace("b-w").bandjoin(255)
+        a = pyvips.Image.pngload_buffer(mono.pngsave_buffer(compression=9))
+        assert (a - mono).abs().max() == 0
+
+    @skip_if_no("pngload")
+    def test_png_shrink(self):
+        # only the libspng loader can shrink
+        if "shrink" not in \
+                pyvips.Introspect.get("pngload_buffer").optional_input:
+            pytest.skip("no shrink-on-load for png")
+
+        # interlaced images only decode some of the passes
+        im = self.colour.crop(0, 0, 203, 101)
+        for interlace in [False, True]:
+            buf = im.pngsave_buffer(interlace=interlace)
+            for shrink in [2, 4, 8]:
+                a = pyvips.Image.pngload_buffer(buf, shrink=shrink)
+                assert a.width == im.width // shrink
+                assert a.height == im.height // shrink
+                assert (a - im.subsample(shrink, shrink)).abs().max() == 0
+
     @skip_if_no("tiffload")
     def test_tiff(self):
         def tiff_valid(im):
@@ -817,6 +1198,31 @@ class TestForeign:
         assert x.width == 72
         assert abs(x.avg() - 117.3) < 1
 
+        filename = temp_filename(self.tempdir, '.tif')
+        self.colour.write_to_file(filename, cog=True, compression="jpeg")
+        with open(filename, 'rb') as f:
+            header = f.read(64)
+        assert header[8:38] == b"GDAL_STRUCTURAL_METADATA_SIZE="
+        x = pyvips.Image.new_from_file(filename, page=2)
+        assert x.width == 72
+        assert abs(x.avg() - 117.3) < 1
+        filename2 = temp_filename(self.tempdir, '.tif')
+        self.colour.write_to_file(filename2, pyramid=True, compression="jpeg")
+        x = pyvips.Image.new_from_file(filename)
+        y = pyvips.Image.new_from_file(filename2)
+        assert (x - y).abs().max() == 0
+
+        # bitdepth 16 saves float as half float
+        x = self.colour.cast("float") / 256
+        for tile in [False, True]:
+            filename = temp_filename(self.tempdir, '.tif')
+            x.write_to_file(filename, bitdepth=16, tile=tile,
+                            compression="deflate", predictor="float")
+            y = pyvips.Image.new_from_file(filename)
+            assert y.format == "float"
+            assert y.get("bits-per-sample") == 16
+            assert (x - y).abs().max() < 0.001
+
         filename = temp_filename(self.tempdir, '.tif')
         x = pyvips.Image.new_from_file(TIF_FILE)
         x = x.copy()
@@ -913,6 +1319,18 @@ class TestForeign:
         assert x(0, 167)[0] == 0
         assert x(0, 168)[0] == 1
 
+        # parallel page decode added in 8.19
+        y = pyvips.Image.new_from_file(OME_FILE, n=-1, parallel=True)
+        assert y.width == x.width
+        assert y.height == x.height
+        assert (x - y).abs().max() == 0
+
+        with open(OME_FILE, 'rb') as f:
+            buf = f.read()
+        y = pyvips.Image.new_from_buffer(buf, "", page=1, n=-1, parallel=True)
+        assert y.height == page_height * 14
+        assert (x.crop(0, page_height, x.width, y.height) - y).abs().max() == 0
+
         filename = temp_filename(self.tempdir, '.tif')
         x.write_to_file(filename)
 
@@ -987,6 +1405,71 @@ class TestForeign:
         self.file_loader("tiffload", TIF_OJPEG_STRIP_FILE, tiff_ojpeg_strip_valid)
         self.buffer_loader("tiffload_buffer", TIF_OJPEG_STRIP_FILE, tiff_ojpeg_strip_valid)
 
+    @skip_if_no("tiffload")
+    def test_tiff_tiled_codecs(self):
+        # these are decoded outside the libtiff lock, check they match
+        # the original exactly, including predictor undo
+        def supported(compression):
+            try:
+                self.mono.tiffsave_buffer(compression=compression)
+                return True
+            except pyvips.Error:
+                return False
+
+        ushort = self.colour.cast("ushort") * 256
+        fim = self.colour.cast("float") / 255
+        for compression in ["deflate", "lzw", "zstd"]:
+            if not supported(compression):
+                continue
+
+            for predictor in ["none", "horizontal"]:
+                for im in [self.mono, self.colour, self.rgba, ushort]:
+                    self.save_load_file(".tif",
+                                        f"[tile,compression={compression},"
+                                        f"predictor={predictor}]", im)
+            self.save_load_file(".tif",
+                                f"[tile,compression={compression},"
+                                f"predictor=float]", fim)
+
+        if supported("webp"):
+            self.save_load_file(".tif",
+                                "[tile,compression=webp,lossless]",
+                                self.colour)
+
+        # pyramid layers are compressed in parallel too, they should match
+        # an uncompressed pyramid
+        filename = temp_filename(self.tempdir, ".tif")
+        self.colour.tiffsave(filename, tile=True, pyramid=True)
+        ref = pyvips.Image.new_from_file(filename, page=1)
+        for compression in ["deflate", "lzw", "zstd"]:
+            if not supported(compression):
+                continue
+
+            filename = temp_filename(self.tempdir, ".tif")
+            self.colour.tiffsave(filename, tile=True, pyramid=True,
+                                 compression=compression,
+                                 predictor="horizontal")
+            im = pyvips.Image.new_from_file(filename, page=1)
+            assert (im - ref).abs().max() == 0
+
+    @skip_if_no("tiffload")
+    def test_tiff_tile_cache(self):
+        # random access loads share decoded tiles ... check repeated loads
+        # match, and that we see the new pixels if the file changes
+        filename = temp_filename(self.tempdir, ".tif")
+        self.colour.tiffsave(filename, tile=True, pyramid=True)
+        im1 = pyvips.Image.new_from_file(filename, page=1, revalidate=True)
+        im2 = pyvips.Image.new_from_file(filename, page=1, revalidate=True)
+        assert (im1 - im2).abs().max() == 0
+
+        # different size on disc, so a different cache key
+        self.colour.invert().tiffsave(filename, tile=True, pyramid=True,
+                                      compression="deflate")
+        im3 = pyvips.Image.new_from_file(filename, page=1, revalidate=True)
+        ref = pyvips.Image.new_from_file(filename, page=1, revalidate=True,
+                                         access="sequential")
+        assert (im3 - ref).abs().max() == 0
+
     @skip_if_no("jp2kload")
     @skip_if_no("tiffload")
     def test_tiffjp2k(self):
@@ -1121,6 +1604,27 @@ class TestForeign:
             # magicks vary in how they handle this ... just pray we are close
             assert abs(x1.get("gif-loop") - x2.get("gif-loop")) < 5
 
+    @skip_if_no("webpload")
+    def test_webpload_area(self):
+        for scale in [1.0, 0.5, 0.3]:
+            im = pyvips.Image.new_from_file(WEBP_FILE, scale=scale)
+            for left, top, width, height in [(0, 0, 10, 10),
+                                             (37, 51, 63, 47),
+                                             (im.width - 20, im.height - 9,
+                                              20, 9)]:
+                a = pyvips.Image.new_from_file(WEBP_FILE, scale=scale,
+                                               area=[left, top, width, height])
+                b = im.crop(left, top, width, height)
+                assert a.width == width
+                assert a.height == height
+                # the crop is decoded and scaled separately, so edges can
+                # differ slightly
+                assert (a - b).abs().avg() < 4
+
+        with pytest.raises(pyvips.error.Error):
+            x = pyvips.Image.new_from_file(WEBP_FILE, area=[0, 0, 1000, 10])
+            x.avg()
+
     @skip_if_no("webpload")
     def test_webp(self):
         def webp_valid(im):
@@ -1158,6 +1662,15 @@ class TestForeign:
         im2 = pyvips.Image.new_from_buffer(buf, "")
         assert (im - im2).abs().max() != 0
 
+        # lossy frames are built a strip at a time ... alpha must survive,
+        # and opaque frames must be written without alpha
+        im2 = pyvips.Image.new_from_buffer(im.webpsave_buffer(Q=90), "")
+        assert im2.bands == 4
+        assert abs(im2[3].avg() - im[3].avg()) < 1
+        opaque = self.colour.bandjoin(255)
+        im2 = pyvips.Image.new_from_buffer(opaque.webpsave_buffer(), "")
+        assert im2.bands == 3
+
         # try saving an image with an ICC profile and reading it back ... if we
         # can do it, our webp supports metadata load/save
         buf = self.colour.webpsave_buffer()
@@ -1249,6 +1762,12 @@ class TestForeign:
 
         self.file_loader("openexrload", EXR_FILE, exr_valid)
 
+        # page 0 is the full-resolution level
+        im = pyvips.Image.new_from_file(EXR_FILE)
+        im0 = pyvips.Image.new_from_file(EXR_FILE, page=0)
+        assert (im - im0).abs().max() == 0
+        assert im.get("n-pages") >= 1
+
     @skip_if_no("fitsload")
     def test_fitsload(self):
         def fits_valid(im):
@@ -1262,6 +1781,10 @@ class TestForeign:
         self.file_loader("fitsload", FITS_FILE, fits_valid)
         self.save_load("%s.fits", self.mono)
 
+        # uncompressed, unscaled files are mapped directly
+        self.save_load_file(".fits", "", self.colour)
+        self.save_load_file(".fits", "", self.colour.cast("float"))
+
     @skip_if_no("niftiload")
     def test_niftiload(self):
         def nifti_valid(im):
@@ -1274,6 +1797,10 @@ class TestForeign:
         self.file_loader("niftiload", NIFTI_FILE, nifti_valid)
         self.save_load("%s.nii.gz", self.mono)
 
+        # uncompressed files are mapped directly
+        self.save_load_file(".nii", "", self.mono)
+        self.save_load_file(".nii", "", self.mono.cast("float"))
+
     @skip_if_no("openslideload")
     def test_openslideload(self):
 
@@ -1421,6 +1948,21 @@ class TestForeign:
         x2 = pyvips.Image.new_from_file(GIF_ANIM_DISPOSE_PREVIOUS_EXPECTED_PNG_FILE)
         assert (x1 - x2).abs().max() == 0
 
+    @skip_if_no("gifload")
+    def test_gifload_animation_seek(self):
+        # single pages can start decoding from an independent frame or a
+        # cached keyframe, they must match the full decode
+        for filename in [GIF_ANIM_FILE,
+                         GIF_ANIM_DISPOSE_BACKGROUND_FILE,
+                         GIF_ANIM_DISPOSE_PREVIOUS_FILE]:
+            x1 = pyvips.Image.new_from_file(filename, n=-1)
+            page_height = x1.get("page-height")
+            n_pages = x1.height // page_height
+            for page in reversed(range(n_pages)):
+                x2 = pyvips.Image.new_from_file(filename, page=page)
+                x3 = x1.crop(0, page * page_height, x1.width, page_height)
+                assert (x2 - x3).abs().max() == 0
+
     @skip_if_no("gifload")
     def test_gifload_truncated(self):
         # should load with just a warning
@@ -1519,6 +2061,52 @@ class TestForeign:
     def test_csv(self):
         self.save_load("%s.csv", self.mono)
 
+        # files are parsed in parallel, pipes a character at a time, and
+        # both should give the same result
+        text = b"skip me\n" \
+            b"1, 2.5 ,-3e2\t\"a, b\"\n" \
+            b"0.1;1e-5;12345678901234567890\n" \
+            b"\n" \
+            b" 7 ,, 1.\r\n" \
+            b"-0.000125,x,9"
+        filename = temp_filename(self.tempdir, ".csv")
+        with open(filename, "wb") as f:
+            f.write(text)
+        im = pyvips.Image.csvload(filename, skip=1)
+        assert im.width == 4
+        assert im.height == 5
+        assert im(0, 0) == [1.0]
+        assert im(1, 0) == [2.5]
+        assert im(2, 0) == [-300.0]
+        assert im(0, 1) == [0.1]
+        assert im(2, 1) == [12345678901234567890.0]
+        assert im(2, 3) == [1.0]
+        assert im(0, 4) == [-0.000125]
+        assert im(2, 4) == [9.0]
+
+        def read_handler(size):
+            nonlocal text
+            chunk = text[:size]
+            text = text[size:]
+            return chunk
+
+        source = pyvips.SourceCustom()
+        source.on_read(read_handler)
+        im2 = pyvips.Image.csvload_source(source, skip=1)
+        assert im2.width == im.width
+        assert im2.height == im.height
+        assert (im - im2).abs().max() == 0
+
+        # doubles should survive a round trip exactly, with short text
+        values = [0.1, 1 / 3, -2.5e-300, 1e23, 1.2345678901234568e17, 0, -7]
+        im = pyvips.Image.new_from_array([values])
+        target = pyvips.Target.new_to_memory()
+        im.csvsave_target(target)
+        text = target.get("blob")
+        assert text.split(b"\t")[0] == b"0.1"
+        im2 = pyvips.Image.csvload_source(pyvips.Source.new_from_memory(text))
+        assert [im2(x, 0)[0] for x in range(len(values))] == values
+
     def test_matrix(self):
         self.save_load("%s.mat", self.mono)
 
@@ -1715,6 +2303,103 @@ class TestForeign:
         assert buf1.find(b'http://schemas.microsoft.com/deepzoom/2008') != -1
         assert buf2.find(b'http://schemas.microsoft.com/deepzoom/2008') == -1
 
+        # both zips should be readable, with correct crcs
+        for name in [filename, filename2]:
+            with zipfile.ZipFile(name) as zf:
+                assert zf.testzip() is None
+                root = os.path.splitext(os.path.basename(name))[0]
+                assert root + ".dzi" in zf.namelist()
+
+        # test dedupe ... a flat image has many identical tiles, which
+        # should be hard links on the filesystem
+        flat = pyvips.Image.black(1024, 1024, bands=3) + [10, 200, 30]
+        flat = flat.cast("uchar")
+        filename = temp_filename(self.tempdir, '')
+        flat.dzsave(filename, dedupe=True, overlap=0, tile_size=256)
+        a = filename + "_files/10/0_0.jpeg"
+        b = filename + "_files/10/1_1.jpeg"
+        if os.name != "nt":
+            assert os.stat(a).st_ino == os.stat(b).st_ino
+        with open(a, 'rb') as f:
+            buf_a = f.read()
+        with open(b, 'rb') as f:
+            buf_b = f.read()
+        assert buf_a == buf_b
+
+        # and repeated entries in zip output
+        filename = temp_filename(self.tempdir, '.zip')
+        flat.dzsave(filename, dedupe=True, overlap=0, tile_size=256)
+        with zipfile.ZipFile(filename) as zf:
+            assert zf.testzip() is None
+            root = os.path.splitext(os.path.basename(filename))[0]
+            assert zf.read(root + "_files/10/0_0.jpeg") == \
+                zf.read(root + "_files/10/1_1.jpeg")
+
+        # test update ... rewriting just the changed area should give the
+        # same pyramid as a complete save
+        changed = self.colour.draw_rect([255, 0, 0], 300, 100, 50, 40,
+                                        fill=True)
+        filename = temp_filename(self.tempdir, '')
+        self.colour.dzsave(filename, suffix=".png")
+        changed.dzsave(filename, suffix=".png", update=[300, 100, 50, 40])
+        filename2 = temp_filename(self.tempdir, '')
+        changed.dzsave(filename2, suffix=".png")
+        for root, dirs, files in os.walk(filename2 + "_files"):
+            for name in files:
+                path2 = os.path.join(root, name)
+                path = filename + path2[len(filename2):]
+                a = pyvips.Image.new_from_file(path)
+                b = pyvips.Image.new_from_file(path2)
+                assert (a - b).abs().max() == 0
+
+        # test band and merge ... a pyramid made in parts should match
+        # one made in a single save
+        filename = temp_filename(self.tempdir, '')
+        height = self.colour.height
+        self.colour.dzsave(filename, suffix=".png", tile_size=64,
+                           band=[0, 128])
+        self.colour.dzsave(filename, suffix=".png", tile_size=64,
+                           band=[128, height - 128])
+        assert not os.path.exists(filename + ".dzi")
+        self.colour.dzsave(filename, suffix=".png", tile_size=64, merge=True)
+        filename2 = temp_filename(self.tempdir, '')
+        self.colour.dzsave(filename2, suffix=".png", tile_size=64)
+        for root, dirs, files in os.walk(filename2 + "_files"):
+            for name in files:
+                path2 = os.path.join(root, name)
+                path = filename + path2[len(filename2):]
+                a = pyvips.Image.new_from_file(path)
+                b = pyvips.Image.new_from_file(path2)
+                assert (a - b).abs().max() == 0
+        assert os.path.exists(filename + ".dzi")
+
+        # test checkpoint ... a save which fails part way down should leave a
+        # checkpoint, and saving again should resume from it and give the
+        # same pyramid as a single save
+        buf = self.colour.jpegsave_buffer()
+        truncated = pyvips.Image.new_from_buffer(buf[:len(buf) * 2 // 3], "",
+                                                 access="sequential",
+                                                 fail_on="truncated")
+        filename = temp_filename(self.tempdir, '')
+        with pytest.raises(pyvips.Error):
+            truncated.dzsave(filename, suffix=".png", tile_size=64,
+                             checkpoint=1)
+        assert os.path.exists(filename + ".checkpoint")
+        assert not os.path.exists(filename + ".dzi")
+        full = pyvips.Image.new_from_buffer(buf, "")
+        full.dzsave(filename, suffix=".png", tile_size=64, checkpoint=1)
+        assert not os.path.exists(filename + ".checkpoint")
+        filename2 = temp_filename(self.tempdir, '')
+        full.dzsave(filename2, suffix=".png", tile_size=64)
+        for root, dirs, files in os.walk(filename2 + "_files"):
+            for name in files:
+                path2 = os.path.join(root, name)
+                path = filename + path2[len(filename2):]
+                a = pyvips.Image.new_from_file(path)
+                b = pyvips.Image.new_from_file(path2)
+                assert (a - b).abs().max() == 0
+        assert os.path.exists(filename + ".dzi")
+
         # test suffix
         filename = temp_filename(self.tempdir, '')
         self.colour.dzsave(filename, suffix=".png")
@@ -1795,6 +2480,169 @@ class TestForeign:
         im2 = pyvips.Image.new_from_buffer(buf, "")
         assert (im - im2).abs().max() == 0
 
+    @skip_if_no("heifsave")
+    def test_avifsave_grid(self):
+        # grid write encodes tiles a strip at a time, and edge tiles
+        # are padded
+        im = pyvips.Image.new_from_file(AVIF_FILE)
+        buf = im.heifsave_buffer(effort=0, lossless=True, compression="av1",
+                                 tile_width=128, tile_height=96)
+        im2 = pyvips.Image.new_from_buffer(buf, "")
+        assert im.width == im2.width
+        assert im.height == im2.height
+        assert (im - im2).abs().max() == 0
+
+        # alpha and metadata survive grid assembly
+        rgba = im.bandjoin(255)
+        rgba = rgba.copy()
+        rgba.set_type(pyvips.GValue.blob_type, "exif-data",
+                      self.colour.get("exif-data"))
+        buf = rgba.heifsave_buffer(effort=0, lossless=True, compression="av1",
+                                   tile_width=64, tile_height=64)
+        im2 = pyvips.Image.new_from_buffer(buf, "")
+        assert im2.bands == 4
+        assert (rgba - im2).abs().max() == 0
+        assert len(im2.get("exif-data")) > 0
+
+        # grid images decode a tile at a time, so reading an area or
+        # limiting decoder threads must give the same pixels
+        im2 = pyvips.Image.heifload_buffer(buf, threads=1)
+        assert (rgba - im2).abs().max() == 0
+        im2 = pyvips.Image.heifload_buffer(buf, access="random")
+        area = im2.crop(70, 70, 100, 50)
+        assert (rgba.crop(70, 70, 100, 50) - area).abs().max() == 0
+
+    def heif_grid_check(self, grid_buf, single_buf):
+        # check a grid save against a single image save of the same image,
+        # first with our own parser, then by decoding with libheif
+        primary, items, references, properties = heif_structure(grid_buf)
+        s_primary, s_items, s_references, s_properties = \
+            heif_structure(single_buf)
+
+        def described(props):
+            return sorted(p for p in props
+                          if p[0] in ["colr", "pixi", "irot", "imir"])
+
+        def alpha(refs, image_id):
+            return [r[1] for r in refs
+                    if r[0] == "auxl" and image_id in r[2]]
+
+        def prem(refs, image_id):
+            return [r for r in refs if r[0] == "prem" and r[1] == image_id]
+
+        # tiles are hidden, and transforms are only on the grid
+        assert items[primary][0] == "grid"
+        dimg = [r for r in references if r[0] == "dimg"]
+        assert len(dimg) > 0
+        for ref in dimg:
+            assert items[ref[1]][0] == "grid"
+            for tile in ref[2]:
+                assert items[tile][1]
+                assert not [p for p in properties.get(tile, [])
+                            if p[0] in ["irot", "imir", "clap"]]
+
+        # the grid is described as libheif describes the single image
+        assert described(properties[primary]) == \
+            described(s_properties[s_primary])
+
+        # alpha is a grid as well, with the same auxC and prem
+        assert len(alpha(references, primary)) == \
+            len(alpha(s_references, s_primary))
+        assert len(prem(references, primary)) == \
+            len(prem(s_references, s_primary))
+        for grid_alpha, single_alpha in zip(alpha(references, primary),
+                                            alpha(s_references, s_primary)):
+            assert items[grid_alpha][0] == "grid"
+            assert [p for p in properties[grid_alpha] if p[0] == "auxC"] == \
+                [p for p in s_properties[single_alpha] if p[0] == "auxC"]
+
+        grid = pyvips.Image.new_from_buffer(grid_buf, "")
+        single = pyvips.Image.new_from_buffer(single_buf, "")
+        assert grid.width == single.width
+        assert grid.height == single.height
+        assert grid.bands == single.bands
+        assert (grid - single).abs().max() == 0
+
+        return primary, items, references, properties
+
+    @skip_if_no("heifsave")
+    def test_avifsave_grid_alpha(self):
+        options = {"effort": 0, "lossless": True, "compression": "av1"}
+        grid = self.rgba.heifsave_buffer(tile_width=64, tile_height=64,
+                                         **options)
+        single = self.rgba.heifsave_buffer(**options)
+        primary, items, references, properties = \
+            self.heif_grid_check(grid, single)
+        assert [r for r in references if r[0] == "auxl"]
+
+        im = pyvips.Image.new_from_buffer(grid, "")
+        assert (im - self.rgba).abs().max() == 0
+
+    @skip_if_no("heifsave")
+    def test_avifsave_grid_bitdepth(self):
+        rgb16 = self.colour.colourspace("rgb16")
+        for bitdepth in [10, 12]:
+            options = {"effort": 0, "lossless": True, "compression": "av1",
+                       "bitdepth": bitdepth}
+            grid = rgb16.heifsave_buffer(tile_width=128, tile_height=96,
+                                         **options)
+            single = rgb16.heifsave_buffer(**options)
+            primary, items, references, properties = \
+                self.heif_grid_check(grid, single)
+            pixi = [p[1] for p in properties[primary] if p[0] == "pixi"]
+            assert pixi == [bytes([0, 0, 0, 0, 3,
+                                   bitdepth, bitdepth, bitdepth])]
+
+            im = pyvips.Image.new_from_buffer(grid, "")
+            assert im.get("bits-per-sample") == bitdepth
+
+    @skip_if_no("heifsave")
+    def test_avifsave_grid_colour(self):
+        options = {"effort": 0, "lossless": True, "compression": "av1"}
+
+        # an ICC profile
+        icc = self.colour.get("icc-profile-data")
+        grid = self.colour.heifsave_buffer(tile_width=128, tile_height=96,
+                                           **options)
+        single = self.colour.heifsave_buffer(**options)
+        primary, items, references, properties = \
+            self.heif_grid_check(grid, single)
+        colr = [p[1] for p in properties[primary] if p[0] == "colr"]
+        assert [c for c in colr
+                if c[:4] in [b"prof", b"rICC"] and c[4:] == icc]
+
+        # nclx from CICP metadata
+        im = self.colour.copy()
+        im.remove("icc-profile-data")
+        im.set_type(pyvips.GValue.gint_type, "cicp-colour-primaries", 1)
+        im.set_type(pyvips.GValue.gint_type,
+                    "cicp-transfer-characteristics", 13)
+        im.set_type(pyvips.GValue.gint_type, "cicp-matrix-coefficients", 0)
+        im.set_type(pyvips.GValue.gint_type, "cicp-full-range-flag", 1)
+        grid = im.heifsave_buffer(tile_width=128, tile_height=96, **options)
+        single = im.heifsave_buffer(**options)
+        primary, items, references, properties = \
+            self.heif_grid_check(grid, single)
+        colr = [p[1] for p in properties[primary] if p[0] == "colr"]
+        assert colr == [b"nclx" + struct.pack(">HHHB", 1, 13, 0, 0x80)]
+
+    @skip_if_no("heifsave")
+    def test_avifsave_grid_orientation(self):
+        # orientation is written as irot/imir, which must transform the
+        # whole grid, not each tile
+        im = self.colour.copy()
+        im.set_type(pyvips.GValue.gint_type, "orientation", 6)
+        options = {"effort": 0, "lossless": True, "compression": "av1"}
+        grid = im.heifsave_buffer(tile_width=128, tile_height=96, **options)
+        single = im.heifsave_buffer(**options)
+        primary, items, references, properties = \
+            self.heif_grid_check(grid, single)
+        assert [p for p in properties[primary] if p[0] == "irot"]
+
+        im2 = pyvips.Image.new_from_buffer(grid, "")
+        assert im2.width == im.height
+        assert im2.height == im.width
+
     @skip_if_no("heifsave")
     def test_avifsave_Q(self):
         # higher Q should mean a bigger buffer, needs libheif >= v1.8.0,
@@ -2057,6 +2905,15 @@ class TestForeign:
         bitdepth7 = self.colour.gifsave_buffer(bitdepth=7,effort=1)
         assert len(bitdepth8) > len(bitdepth7)
 
+        # One sampled palette for all frames
+        x1 = pyvips.Image.new_from_file(GIF_ANIM_FILE, n=-1)
+        b1 = x1.gifsave_buffer(global_palette=True)
+        x2 = pyvips.Image.new_from_buffer(b1, "", n=-1)
+        assert x1.width == x2.width
+        assert x1.height == x2.height
+        assert x1.get("n-pages") == x2.get("n-pages")
+        assert x1.get("delay") == x2.get("delay")
+
         if have("webpload"):
             # Animated WebP to GIF
             x1 = pyvips.Image.new_from_file(WEBP_ANIMATED_FILE, n=-1)
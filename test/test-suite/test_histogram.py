@@ -49,6 +49,28 @@ class TestHistogram:
 
         assert im3.deviate() < im2.deviate()
 
+    def test_hist_local_tiled(self):
+        im = pyvips.Image.new_from_file(JPEG_FILE)
+
+        im2 = im.hist_local(64, 64, tiled=True)
+        assert im.width == im2.width
+        assert im.height == im2.height
+        assert im2.format == pyvips.BandFormat.UCHAR
+        assert im.deviate() < im2.deviate()
+
+        im3 = im.hist_local(64, 64, tiled=True, max_slope=3)
+        assert im3.deviate() < im2.deviate()
+
+        # a single tile is plain equalisation
+        im4 = im.hist_local(im.width, im.height, tiled=True)
+        assert (im4 - im.hist_equal()).abs().max() <= 2
+
+        # 16-bit stays 16-bit
+        im16 = (im * 256).cast("ushort")
+        im5 = im16.hist_local(64, 64, tiled=True)
+        assert im5.format == pyvips.BandFormat.USHORT
+        assert (im5 / 257 - im2).abs().max() < 1.5
+
     def test_hist_match(self):
         im = pyvips.Image.identity()
         im2 = pyvips.Image.identity()
@@ -79,6 +101,27 @@ class TestHistogram:
 
         assert (im - im2).abs().max() == 0.0
 
+    def test_maplut_bands(self):
+        # a different lut for each band, applied to an interleaved image
+        im = pyvips.Image.new_from_file(JPEG_FILE).crop(0, 0, 101, 37)
+        lut = pyvips.Image.identity(bands=3)
+        lut = (lut * [1, -1, 0.5] + [0, 255, 10]).cast("uchar")
+        im2 = im.maplut(lut)
+
+        for x, y in [(0, 0), (17, 5), (100, 36), (63, 20)]:
+            pixel = im(x, y)
+            expected = [pixel[0], 255 - pixel[1], int(pixel[2] * 0.5 + 10)]
+            assert im2(x, y) == expected
+
+        # ushort index, float lut, and indexes past the end of the lut
+        im = (im.cast("ushort") * 4)
+        lut = pyvips.Image.identity(ushort=True, size=512).cast("float") / 2
+        im2 = im.maplut(lut)
+        assert im2.format == "float"
+        for x, y in [(0, 0), (17, 5), (100, 36), (63, 20)]:
+            expected = [min(v, 511) / 2 for v in im(x, y)]
+            assert im2(x, y) == expected
+
     def test_percent(self):
         im = pyvips.Image.new_from_file(JPEG_FILE).extract_band(1)
 
@@ -60,6 +60,24 @@ class TestIofuncs:
         assert len(fields) > 10
         assert fields[0] == 'width'
 
+    def test_shared_metadata(self):
+        im = pyvips.Image.black(10, 10).copy()
+        im.set_type(pyvips.GValue.gint_type, "banana", 12)
+        im.set_type(pyvips.GValue.gstr_type, "apple", "red")
+
+        # metadata is shared down a pipeline until it is changed
+        im2 = (im + 1).copy()
+        assert im2.get("banana") == 12
+        im2.set_type(pyvips.GValue.gint_type, "banana", 13)
+        im2.remove("apple")
+        assert im2.get("banana") == 13
+        assert "apple" not in im2.get_fields()
+
+        assert im.get("banana") == 12
+        assert im.get("apple") == "red"
+        fields = im.get_fields()
+        assert fields.index("banana") < fields.index("apple")
+
     def test_write_to_memory(self):
         s = bytearray(200)
         im = pyvips.Image.new_from_memory(s, 20, 10, 1, 'uchar')
@@ -94,6 +112,75 @@ class TestIofuncs:
         load2 = pyvips.Image.new_from_file(filename)
         assert load2.width == im2.width
 
+    def test_sequential_plan(self):
+        # top-down pipelines stream the loader, random ones decode to a
+        # temp, and the image can be reused after either
+        im = pyvips.Image.new_from_file(JPEG_FILE)
+        ref = pyvips.Image.new_from_file(JPEG_FILE,
+                                         access="random").copy_memory()
+
+        assert (im * 2).avg() == pytest.approx((ref * 2).avg())
+        assert (im.rot90() - ref.rot90()).abs().max() == 0
+        assert (im.invert() - ref.invert()).abs().max() == 0
+        assert (im.resize(0.5).flip("vertical") -
+                ref.resize(0.5).flip("vertical")).abs().max() == 0
+
+    def test_sequential_plan_offset(self):
+        # two crops of one loader at different offsets are read out of
+        # order, so the loader must not stream
+        im = pyvips.Image.new_from_file(JPEG_FILE)
+        ref = pyvips.Image.new_from_file(JPEG_FILE,
+                                         access="random").copy_memory()
+        w = im.width
+        h = im.height // 2
+
+        def swap(x):
+            return x.crop(0, h, w, h).join(x.crop(0, 0, w, h), "vertical")
+
+        assert (swap(im) - swap(ref)).abs().max() == 0
+
+        im = pyvips.Image.new_from_file(JPEG_FILE)
+        a = im.crop(0, h, w, h).bandjoin(im.crop(0, 0, w, h))
+        b = ref.crop(0, h, w, h).bandjoin(ref.crop(0, 0, w, h))
+        assert (a - b).abs().max() == 0
+
+    def test_sequential_plan_shared(self):
+        # a loader with another consumer must not stream, since that
+        # consumer can read it in any order while the sink runs
+        im = pyvips.Image.new_from_file(JPEG_FILE)
+        ref = pyvips.Image.new_from_file(JPEG_FILE,
+                                         access="random").copy_memory()
+        other = im.rot90()
+        expected = ref.rot90().avg()
+        results = []
+
+        def eval_cb(image, progress):
+            if not results:
+                results.append(other.avg())
+
+        x = im.invert()
+        x.set_progress(True)
+        x.signal_connect("eval", eval_cb)
+        assert (x - ref.invert()).abs().max() == 0
+        assert results == [pytest.approx(expected)]
+
+    @skip_if_no("tiffload")
+    def test_natural_tile(self):
+        # sinks line up with the strips and tiles loaders decode in, the
+        # pixels should be unchanged
+        ref = pyvips.Image.new_from_file(JPEG_FILE,
+                                         access="random").copy_memory()
+
+        for args in [{"tile_height": 7},
+                     {"tile_height": 40},
+                     {"tile": True, "tile_width": 48, "tile_height": 80}]:
+            filename = temp_filename(self.tempdir, '.tif')
+            ref.tiffsave(filename, **args)
+
+            for access in ["sequential", "random"]:
+                im = pyvips.Image.new_from_file(filename, access=access)
+                assert (im.invert() - ref.invert()).abs().max() == 0
+
 
 if __name__ == '__main__':
     pytest.main()
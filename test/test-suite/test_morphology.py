@@ -19,6 +19,25 @@ class TestMorphology:
         assert opts['segments'] == 3
         assert mask.max() == 2
 
+        # a U shape spanning several strips only joins up at the bottom,
+        # regions are numbered in order of first appearance
+        im = pyvips.Image.black(200, 400)
+        im = im.draw_rect(255, 20, 10, 20, 370, fill=True)
+        im = im.draw_rect(255, 160, 10, 20, 370, fill=True)
+        im = im.draw_rect(255, 20, 360, 160, 20, fill=True)
+        im = im.draw_circle(128, 100, 200, 30, fill=True)
+        mask, opts = im.labelregions(segments=True)
+
+        assert opts['segments'] == 4
+        assert mask(0, 0)[0] == 1
+        assert mask(100, 390)[0] == 1
+        assert mask(30, 100)[0] == 2
+        assert mask(170, 100)[0] == 2
+        assert mask(100, 200)[0] == 3
+
+        streamed = im.labelregions(streaming=True)
+        assert (mask - streamed).abs().max() == 0
+
     def test_erode(self):
         im = pyvips.Image.black(100, 100)
         im = im.draw_circle(255, 50, 50, 25, fill=True)
@@ -41,6 +60,47 @@ class TestMorphology:
         assert im.bands == im2.bands
         assert im2.avg() > im.avg()
 
+    def test_morph_rect(self):
+        # large rectangles and lines run as separable passes ... check
+        # against the same shape built from small masks
+        im = pyvips.Image.gaussnoise(120, 90, seed=1)
+        im = im.bandjoin(pyvips.Image.gaussnoise(120, 90, seed=2)).cast("uchar")
+
+        rect = [[255] * 9] * 7
+        line = [[128] * 31, [255] * 31, [128] * 31]
+        for name in ["erode", "dilate"]:
+            whole = getattr(im, name)(rect)
+            parts = getattr(im, name)([[255] * 9])
+            parts = getattr(parts, name)([[255]] * 7)
+            assert (whole - parts).abs().max() == 0
+
+            whole = getattr(im, name)(line)
+            parts = getattr(im, name)([[255] * 15])
+            parts = getattr(parts, name)([[255] * 17])
+            assert (whole - parts).abs().max() == 0
+
+    def test_distance(self):
+        points = [(5, 7), (60, 12), (30, 45)]
+        im = pyvips.Image.black(71, 53)
+        for x, y in points:
+            im = im.draw_rect(255, x, y, 1, 1)
+        distance, opts = im.distance(index=True)
+        index = opts['index']
+
+        assert distance.format == "float"
+        assert index.bands == 2
+        for x in range(0, 71, 7):
+            for y in range(0, 53, 5):
+                nearest = min((x - px) ** 2 + (y - py) ** 2
+                              for px, py in points)
+                assert abs(distance(x, y)[0] - nearest ** 0.5) < 0.001
+                ix, iy = index(x, y)
+                assert (x - ix) ** 2 + (y - iy) ** 2 == nearest
+
+        for x, y in points:
+            assert distance(x, y)[0] == 0
+            assert index(x, y) == [x, y]
+
     def test_rank(self):
         im = pyvips.Image.black(100, 100)
         im = im.draw_circle(255, 50, 50, 25, fill=True)
@@ -50,6 +110,37 @@ class TestMorphology:
         assert im.bands == im2.bands
         assert im2.avg() > im.avg()
 
+    def test_rank_hist(self):
+        # large windows on 8- and 16-bit images use a histogram, it should
+        # match the select path we use for int images
+        im = pyvips.Image.gaussnoise(300, 200, mean=128, sigma=50)
+        im = im.bandjoin(im.rot180())
+        for fmt, scale, offset in [("uchar", 1, 0),
+                                   ("char", 1, -128),
+                                   ("ushort", 200, 0),
+                                   ("short", 200, -20000)]:
+            test = (im * scale + offset).cast(fmt)
+            reference = test.cast("int")
+            for index in [0, 112, 224]:
+                im2 = test.rank(15, 15, index)
+                assert im2.format == fmt
+                assert (im2 - reference.rank(15, 15, index)).abs().max() == 0
+
+        # approximate float ranks are within a bin of the exact result
+        test = (im * 100 - 10000).cast("float")
+        exact = test.median(15)
+        approx = test.median(15, precision="approximate")
+        assert ((exact - approx).abs() - exact.abs() / 128).max() <= 0
+
+    def test_rank_cached(self):
+        # a big rank after a big rank gets an automatic cache between
+        # the two, it must not change the result
+        im = pyvips.Image.gaussnoise(500, 400, mean=128, sigma=50)
+        im = im.cast("uchar").median(21)
+        auto = im.median(21)
+        reference = im.copy_memory().median(21)
+        assert (auto - reference).abs().max() == 0
+
 
 if __name__ == '__main__':
     pytest.main()
@@ -25,6 +25,42 @@ class TestMosaicing:
         assert join.height == top.height + bottom.height - 10
         assert join.bands == 1
 
+    def test_mergen(self):
+        left = pyvips.Image.new_from_file(MOSAIC_FILES[0])
+        right = pyvips.Image.new_from_file(MOSAIC_FILES[1])
+        join = pyvips.Image.mergen([left, right],
+                                   [0, left.width - 10], [0, 0])
+
+        assert join.width == left.width + right.width - 10
+        assert join.height == max(left.height, right.height)
+        assert join.bands == 1
+
+        # overlapping crops put back in place should blend to the original
+        im = pyvips.Image.new_from_file(MOSAIC_FILES[0])
+        w = im.width // 2
+        h = im.height // 2
+        tiles = []
+        x = []
+        y = []
+        for tx in [0, w - 20]:
+            for ty in [0, h - 20]:
+                tiles.append(im.crop(tx, ty, w + 20, h + 20))
+                x.append(tx)
+                y.append(ty)
+        join = pyvips.Image.mergen(tiles, x, y, mblend=15)
+
+        assert join.width == 2 * w
+        assert join.height == 2 * h
+        assert (join - im.crop(0, 0, 2 * w, 2 * h)).abs().max() == 0
+
+        # mblend=0 means later images are on top
+        a = pyvips.Image.black(10, 10) + 1
+        b = pyvips.Image.black(10, 10) + 2
+        join = pyvips.Image.mergen([a, b], [0, 5], [0, 0], mblend=0)
+        assert join.width == 15
+        assert join(2, 2) == [1]
+        assert join(7, 2) == [2]
+
     def test_lrmosaic(self):
         left = pyvips.Image.new_from_file(MOSAIC_FILES[0])
         right = pyvips.Image.new_from_file(MOSAIC_FILES[1])
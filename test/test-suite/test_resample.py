@@ -74,6 +74,48 @@ class TestResample:
 
             assert (x - im).abs().max() == 0
 
+    def test_affine_span(self):
+        # uchar, ushort and float have their own span paths, compare them to
+        # double, which does not
+        im = pyvips.Image.new_from_file(JPEG_FILE).crop(100, 100, 300, 200)
+        # keep away from 0 and 255 so overshoots aren't clipped
+        im = (im * 0.5 + 64).cast("uchar")
+        matrix = [0.94, -0.34, 0.34, 0.94]
+
+        for name in ["bilinear", "bicubic"]:
+            interpolate = pyvips.Interpolate.new(name)
+            ref = im.cast("double").affine(matrix, interpolate=interpolate)
+            for fmt, scale in [("uchar", 1), ("ushort", 256), ("float", 1)]:
+                x = (im * scale).cast(fmt)
+                r = x.affine(matrix, interpolate=interpolate)
+                assert r.format == fmt
+                assert (r / scale - ref).abs().max() < 1.5
+
+                mp = pyvips.Image.xyz(im.width, im.height) + [0.3, 0.6]
+                r = x.mapim(mp, interpolate=interpolate)
+                ref2 = im.cast("double").mapim(mp, interpolate=interpolate)
+                assert (r / scale - ref2).abs().max() < 1.5
+
+    def test_affine_separable(self):
+        # scale and horizontal shear take the separable path, a tiny vertical
+        # shear forces the general one
+        im = pyvips.Image.new_from_file(JPEG_FILE)
+
+        for name in ["bilinear", "bicubic"]:
+            interpolate = pyvips.Interpolate.new(name)
+            for matrix in [[1.7, 0, 0, 1.3], [0.8, 0.2, 0, 1.1]]:
+                a = im.affine(matrix, interpolate=interpolate)
+                b = im.affine([matrix[0], matrix[1], 1e-9, matrix[3]],
+                              interpolate=interpolate,
+                              oarea=[0, 0, a.width, a.height])
+                assert (a - b).abs().max() <= 2
+                assert (a - b).abs().avg() < 0.5
+
+        # integer translations should still be exact
+        x = im.affine([1, 0, 0, 1], interpolate=interpolate,
+                      oarea=[10, 20, 100, 100])
+        assert (x - im.crop(10, 20, 100, 100)).abs().max() == 0
+
     def test_reduce(self):
         im = pyvips.Image.new_from_file(JPEG_FILE)
         # cast down to 0-127, the smallest range, so we aren't messed up by
@@ -110,6 +152,19 @@ class TestResample:
             im2 = im.reduceh(1.5, kernel="nearest")
             assert im2.width == 1
 
+    def test_reduce_shared_kernel(self):
+        im = pyvips.Image.new_from_file(JPEG_FILE)
+
+        # kernel tables are shared between operations, so reductions with the
+        # same kernel and factor must not interfere with each other
+        a = im.reduce(1.7, 1.7, kernel="lanczos3")
+        b = im.reduceh(1.7, kernel="lanczos3").reducev(1.7, kernel="lanczos3")
+        c = im.reduce(1.7, 1.7, kernel="cubic")
+        d = im.reduce(1.7, 1.7, kernel="lanczos3")
+        assert (a - b).abs().max() == 0
+        assert (a - d).abs().max() == 0
+        assert (a - c).abs().max() > 0
+
     def test_resize(self):
         im = pyvips.Image.new_from_file(JPEG_FILE)
         im2 = im.resize(0.25)
@@ -145,6 +200,41 @@ class TestResample:
                 y = x(*point)[0]
                 assert y != 0
 
+    def test_resize_fused(self):
+        im = pyvips.Image.new_from_file(JPEG_FILE)
+
+        # resize shrinks and reduces both axes in one pass, it should match
+        # the separate operations
+        for fmt in ["uchar", "ushort", "short", "float", "double"]:
+            x = im.cast(fmt)
+            for kernel in ["linear", "cubic", "lanczos3"]:
+                for scale in [0.5, 0.23, 0.1]:
+                    for gap in [0.0, 2.0]:
+                        a = x.resize(scale, kernel=kernel, gap=gap)
+                        b = x.reducev(1 / scale, kernel=kernel, gap=gap) \
+                            .reduceh(1 / scale, kernel=kernel, gap=gap)
+                        assert a.width == b.width
+                        assert a.height == b.height
+                        assert a.format == b.format
+                        assert (a - b).abs().max() <= 1
+
+        # and with different scales on each axis
+        a = im.resize(0.3, vscale=0.15)
+        b = im.reducev(1 / 0.15).reduceh(1 / 0.3)
+        assert (a - b).abs().max() <= 1
+
+    def test_resize_shrink_on_load(self):
+        im = pyvips.Image.new_from_file(JPEG_FILE)
+
+        # point operations between the load and the resize shouldn't stop
+        # shrink-on-load, and the result should be close to a full decode
+        # ... resize first, since decoding stops the load being reused
+        pushed = (im * 0.8 + 10).resize(0.1)
+        full = (im.copy_memory() * 0.8 + 10).resize(0.1)
+        assert pushed.width == full.width
+        assert pushed.height == full.height
+        assert (pushed - full).abs().avg() < 2
+
     def test_shrink(self):
         im = pyvips.Image.new_from_file(JPEG_FILE)
         im2 = im.shrink(4, 4)
@@ -224,6 +314,14 @@ class TestResample:
         assert im.width == 100
         assert im.height == 570
 
+        # resizing pages separately should give the same layout
+        im2 = pyvips.Image.thumbnail(OME_FILE + "[n=-1]", 100,
+                                     per_frame=True)
+        assert im2.width == 100
+        assert im2.height == 570
+        assert im2.get("page-height") == im.get("page-height")
+        assert abs(im2.avg() - im.avg()) < 1
+
         # should be able to thumbnail a single-page tiff in a buffer
         im1 = pyvips.Image.thumbnail(TIF_FILE, 100)
         with open(TIF_FILE, 'rb') as f:
@@ -237,6 +335,21 @@ class TestResample:
             im2 = pyvips.Image.new_from_file(RGBA_CORRECT_FILE)
             assert abs(im1.flatten(background=255).avg() - im2.avg()) < 1
 
+        # linear shrink of 8-bit sRGB goes via 16-bit linear light ... it
+        # should match a shrink in float scRGB
+        im = pyvips.Image.new_from_file(JPEG_FILE).copy()
+        if im.get_typeof("icc-profile-data") != 0:
+            im.remove("icc-profile-data")
+        thumb = im.thumbnail_image(128, linear=True)
+        ref = im.colourspace("scrgb") \
+                .resize(thumb.width / im.width,
+                        vscale=thumb.height / im.height) \
+                .colourspace("srgb")
+        assert thumb.format == "uchar"
+        assert thumb.interpretation == "srgb"
+        assert (thumb - ref).abs().avg() < 0.5
+        assert (thumb - ref).abs().max() < 4
+
         # thumbnailing a 16-bit image should always make an 8-bit image
         rgb16_buffer = pyvips.Image \
                 .new_from_file(JPEG_FILE) \
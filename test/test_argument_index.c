@@ -0,0 +1,119 @@
+/* Check that arguments found by position with
+ * vips_object_class_find_argument() work like set by name.
+ */
+
+#include <string.h>
+
+#include <vips/vips.h>
+
+static void
+set_int(VipsOperation *operation, const char *name, int value)
+{
+	VipsObjectClass *class = VIPS_OBJECT_GET_CLASS(operation);
+	GValue gvalue = G_VALUE_INIT;
+	int n;
+
+	if ((n = vips_object_class_find_argument(class, name)) < 0)
+		vips_error_exit(NULL);
+
+	g_value_init(&gvalue, G_TYPE_INT);
+	g_value_set_int(&gvalue, value);
+	if (vips_object_set_nth(VIPS_OBJECT(operation), n, &gvalue))
+		vips_error_exit(NULL);
+	g_value_unset(&gvalue);
+}
+
+int
+main(int argc, char **argv)
+{
+	VipsOperation *operation;
+	VipsObjectClass *class;
+	VipsImage *in;
+	VipsImage *out;
+	VipsImage *expected;
+	GValue gvalue = G_VALUE_INIT;
+	double avg;
+	double avg_expected;
+	int n;
+
+	if (VIPS_INIT(argv[0]))
+		vips_error_exit(NULL);
+
+	if (!(operation = vips_operation_new("embed")))
+		vips_error_exit(NULL);
+	class = VIPS_OBJECT_GET_CLASS(operation);
+
+	/* Unknown names fail, and positions map back to the right argument.
+	 */
+	if (vips_object_class_find_argument(class, "banana") >= 0)
+		vips_error_exit("found unknown argument");
+	vips_error_clear();
+	if ((n = vips_object_class_find_argument(class, "width")) < 0)
+		vips_error_exit(NULL);
+	if (strcmp(g_param_spec_get_name(((VipsArgument *)
+		vips_object_class_nth_argument(class, n))->pspec), "width"))
+		vips_error_exit("position maps to wrong argument");
+	if (vips_object_class_nth_argument(class, -1) ||
+		vips_object_class_nth_argument(class, 1000))
+		vips_error_exit("out of range position found an argument");
+
+	/* Out of range values are refused.
+	 */
+	g_value_init(&gvalue, G_TYPE_INT);
+	g_value_set_int(&gvalue, -100);
+	if (!vips_object_set_nth(VIPS_OBJECT(operation), n, &gvalue))
+		vips_error_exit("out of range value accepted");
+	vips_error_clear();
+	g_value_unset(&gvalue);
+
+	if (vips_xyz(&in, 10, 10, NULL))
+		vips_error_exit(NULL);
+
+	g_value_init(&gvalue, VIPS_TYPE_IMAGE);
+	g_value_set_object(&gvalue, in);
+	if (vips_object_set_nth(VIPS_OBJECT(operation),
+			vips_object_class_find_argument(class, "in"), &gvalue))
+		vips_error_exit(NULL);
+	g_value_unset(&gvalue);
+
+	set_int(operation, "x", 3);
+	set_int(operation, "y", 4);
+	set_int(operation, "width", 20);
+	set_int(operation, "height", 30);
+
+	if (vips_cache_operation_buildp(&operation))
+		vips_error_exit(NULL);
+	g_object_get(operation, "out", &out, NULL);
+	vips_object_unref_outputs(VIPS_OBJECT(operation));
+	g_object_unref(operation);
+
+	if (vips_embed(in, &expected, 3, 4, 20, 30, NULL) ||
+		vips_avg(out, &avg, NULL) ||
+		vips_avg(expected, &avg_expected, NULL))
+		vips_error_exit(NULL);
+
+	if (out->Xsize != 20 ||
+		out->Ysize != 30)
+		vips_error_exit("bad output size");
+	if (avg != avg_expected)
+		vips_error_exit("bad output pixels");
+
+	/* GObject treats '-' and '_' as the same in names.
+	 */
+	if (!(operation = vips_operation_new("gaussblur")))
+		vips_error_exit(NULL);
+	class = VIPS_OBJECT_GET_CLASS(operation);
+	if ((n = vips_object_class_find_argument(class, "min_ampl")) < 0)
+		vips_error_exit(NULL);
+	if (n != vips_object_class_find_argument(class, "min-ampl"))
+		vips_error_exit("'-' and '_' found different arguments");
+	g_object_unref(operation);
+
+	g_object_unref(expected);
+	g_object_unref(out);
+	g_object_unref(in);
+
+	vips_shutdown();
+
+	return 0;
+}
@@ -0,0 +1,121 @@
+/* Check that asynchronous sinks complete, signal their fd, and can be
+ * cancelled.
+ */
+
+#include <vips/vips.h>
+
+#ifndef G_OS_WIN32
+#include <glib-unix.h>
+#endif /*!G_OS_WIN32*/
+
+static int n_pixels = 0; // (atomic)
+static int n_done = 0; // (atomic)
+
+static int
+count_pixels(VipsRegion *region, VipsRect *area, void *a)
+{
+	g_atomic_int_add(&n_pixels, area->width * area->height);
+
+	return 0;
+}
+
+static int
+slow_write(VipsRegion *region, VipsRect *area, void *a)
+{
+	g_usleep(10000);
+
+	return 0;
+}
+
+static void
+done(VipsAsync *async, void *a)
+{
+	g_atomic_int_inc(&n_done);
+}
+
+int
+main(int argc, char **argv)
+{
+	VipsImage *im;
+	VipsImage *x;
+	VipsAsync *async;
+	VipsTarget *target;
+	VipsBlob *blob;
+
+	if (VIPS_INIT(argv[0]))
+		vips_error_exit(NULL);
+
+	vips_cache_set_max(0);
+
+	if (vips_black(&im, 1000, 1000, NULL))
+		vips_error_exit(NULL);
+	if (vips_invert(im, &x, NULL))
+		vips_error_exit(NULL);
+	g_object_unref(im);
+
+	/* The fd should become readable on completion.
+	 */
+	if (!(async = vips_sink_disc_async(x, count_pixels, NULL, done, NULL)))
+		vips_error_exit(NULL);
+#ifndef G_OS_WIN32
+	{
+		GPollFD fd = { vips_async_get_fd(async), G_IO_IN, 0 };
+
+		if (fd.fd < 0)
+			vips_error_exit("no async fd");
+		if (g_poll(&fd, 1, 60000) != 1)
+			vips_error_exit("async fd not readable");
+	}
+#endif /*!G_OS_WIN32*/
+	if (vips_async_wait(async))
+		vips_error_exit(NULL);
+	if (!vips_async_is_done(async))
+		vips_error_exit("async not done after wait");
+	if (vips_async_get_result(async) ||
+		vips_async_get_error(async))
+		vips_error_exit("async sink failed");
+	if (g_atomic_int_get(&n_pixels) != 1000 * 1000)
+		vips_error_exit("async sink missed pixels");
+	vips_async_unref(async);
+
+	/* Save to a memory target.
+	 */
+	target = vips_target_new_to_memory();
+	if (!(async = vips_image_write_to_target_async(x, ".png",
+			  target, done, NULL)))
+		vips_error_exit(NULL);
+	if (vips_async_wait(async))
+		vips_error_exit(NULL);
+	vips_async_unref(async);
+	g_object_get(target, "blob", &blob, NULL);
+	if (VIPS_AREA(blob)->length == 0)
+		vips_error_exit("async save wrote nothing");
+	vips_area_unref(VIPS_AREA(blob));
+	g_object_unref(target);
+	g_object_unref(x);
+
+	/* Cancel a slow job: it must finish with an error.
+	 */
+	if (vips_black(&im, 10000, 10000, NULL))
+		vips_error_exit(NULL);
+	if (!(async = vips_sink_disc_async(im, slow_write, NULL, done, NULL)))
+		vips_error_exit(NULL);
+	vips_async_cancel(async);
+	if (vips_async_wait(async) != -1)
+		vips_error_exit("cancelled async did not fail");
+	if (!vips_async_get_error(async))
+		vips_error_exit("cancelled async has no error");
+	vips_async_unref(async);
+	g_object_unref(im);
+	vips_error_clear();
+
+	/* Callbacks run just after the job is marked done, so wait()
+	 * can return before they have.
+	 */
+	while (g_atomic_int_get(&n_done) < 3)
+		g_usleep(1000);
+
+	vips_shutdown();
+
+	return 0;
+}
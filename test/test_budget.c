@@ -0,0 +1,71 @@
+/* Check that memory budgets limit tracked allocations.
+ */
+
+#include <vips/vips.h>
+
+int
+main(int argc, char **argv)
+{
+	VipsBudget *budget;
+	VipsImage *im;
+	VipsImage *x;
+	VipsImage *memory;
+
+	if (VIPS_INIT(argv[0]))
+		vips_error_exit(NULL);
+
+	/* Budgets attach to images when they are made, so we must not reuse
+	 * cached operations.
+	 */
+	vips_cache_set_max(0);
+
+	/* A 2000 x 2000 uchar image needs 4mb of memory, so a 1mb budget must
+	 * fail.
+	 */
+	budget = vips_budget_new(1024 * 1024);
+	if (vips_budget_set_current(budget))
+		vips_error_exit("budget already set");
+
+	if (vips_black(&im, 2000, 2000, NULL))
+		vips_error_exit(NULL);
+	if (vips_invert(im, &x, NULL))
+		vips_error_exit(NULL);
+	g_object_unref(im);
+	if (vips_image_get_budget(x) != budget)
+		vips_error_exit("image did not pick up budget");
+
+	if ((memory = vips_image_copy_memory(x)))
+		vips_error_exit("copy_memory ignored budget");
+	vips_error_clear();
+	g_object_unref(x);
+
+	if (vips_budget_set_current(NULL) != budget)
+		vips_error_exit("wrong current budget");
+	vips_budget_unref(budget);
+
+	/* And a 16mb budget should work.
+	 */
+	budget = vips_budget_new(16 * 1024 * 1024);
+	vips_budget_set_current(budget);
+
+	if (vips_black(&im, 2000, 2000, NULL))
+		vips_error_exit(NULL);
+	if (vips_invert(im, &x, NULL))
+		vips_error_exit(NULL);
+	g_object_unref(im);
+	if (!(memory = vips_image_copy_memory(x)))
+		vips_error_exit(NULL);
+	g_object_unref(x);
+
+	if (vips_budget_get_mem(budget) < 2000 * 2000 ||
+		vips_budget_get_mem_highwater(budget) < 2000 * 2000)
+		vips_error_exit("budget did not track allocation");
+	g_object_unref(memory);
+
+	vips_budget_set_current(NULL);
+	vips_budget_unref(budget);
+
+	vips_shutdown();
+
+	return 0;
+}
@@ -0,0 +1,108 @@
+/* Check the operation cache counts hits, misses and evictions, and spots
+ * files replaced in place.
+ */
+
+#include <glib/gstdio.h>
+
+#include <vips/vips.h>
+
+/* Write a width x width image of value to filename.
+ */
+static void
+write_file(const char *filename, int width, double value)
+{
+	VipsImage *t[2];
+
+	if (vips_black(&t[0], width, width, NULL) ||
+		vips_linear1(t[0], &t[1], 1.0, value, NULL) ||
+		vips_image_write_to_file(t[1], filename, NULL))
+		vips_error_exit(NULL);
+	g_object_unref(t[0]);
+	g_object_unref(t[1]);
+}
+
+int
+main(int argc, char **argv)
+{
+	VipsImage *im;
+	guint64 hits, misses, evictions;
+	guint64 hits2, misses2, evictions2;
+	int i;
+	char *dir;
+	char *filename;
+	char *tmp;
+	double avg;
+
+	if (VIPS_INIT(argv[0]))
+		vips_error_exit(NULL);
+
+	vips_cache_set_max(100);
+	vips_cache_get_stats(&hits, &misses, &evictions);
+
+	/* The second black should be a hit.
+	 */
+	for (i = 0; i < 2; i++) {
+		if (vips_black(&im, 100, 100, NULL))
+			vips_error_exit(NULL);
+		g_object_unref(im);
+	}
+
+	vips_cache_get_stats(&hits2, &misses2, &evictions2);
+	if (hits2 != hits + 1 ||
+		misses2 != misses + 1 ||
+		evictions2 != evictions)
+		vips_error_exit("bad cache stats after repeat");
+
+	/* Fill the cache past its limit, forcing evictions.
+	 */
+	vips_cache_set_max(10);
+	for (i = 0; i < 50; i++) {
+		if (vips_black(&im, 10 + i, 10, NULL))
+			vips_error_exit(NULL);
+		g_object_unref(im);
+	}
+
+	vips_cache_get_stats(&hits, &misses, &evictions);
+	if (misses != misses2 + 50 ||
+		evictions < evictions2 + 40)
+		vips_error_exit("bad cache stats after overflow");
+	if (vips_cache_get_size() > 10)
+		vips_error_exit("cache over its limit");
+
+	/* Replace a file we've loaded. The cached load must not be used.
+	 */
+	vips_cache_set_max(100);
+	if (!(dir = g_dir_make_tmp("vips-cache-XXXXXX", NULL)))
+		vips_error_exit("unable to make temp dir");
+	filename = g_build_filename(dir, "x.v", NULL);
+	tmp = g_build_filename(dir, "y.v", NULL);
+
+	write_file(filename, 10, 0.0);
+	if (!(im = vips_image_new_from_file(filename, NULL)))
+		vips_error_exit(NULL);
+	if (im->Xsize != 10)
+		vips_error_exit("bad width");
+	g_object_unref(im);
+
+	write_file(tmp, 20, 100.0);
+	if (g_rename(tmp, filename))
+		vips_error_exit("unable to rename %s", tmp);
+	if (!(im = vips_image_new_from_file(filename, NULL)) ||
+		vips_avg(im, &avg, NULL))
+		vips_error_exit(NULL);
+	if (im->Xsize != 20 ||
+		avg != 100.0)
+		vips_error_exit("stale load from cache");
+	g_object_unref(im);
+
+	vips_cache_drop_all();
+	g_unlink(filename);
+	g_rmdir(dir);
+	g_free(tmp);
+	g_free(filename);
+	g_free(dir);
+
+	vips_shutdown();
+
+	return 0;
+}
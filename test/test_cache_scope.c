@@ -0,0 +1,70 @@
+/* Check that a cache scope merges identical subgraphs, even with the
+ * operation cache turned off.
+ */
+
+#include <vips/vips.h>
+
+/* Two identical little pipelines from the same input.
+ */
+static void
+build(VipsImage *in, VipsImage **out)
+{
+	VipsImage *t;
+
+	if (vips_colourspace(in, &t, VIPS_INTERPRETATION_B_W, NULL) ||
+		vips_cast(t, out, VIPS_FORMAT_USHORT, NULL))
+		vips_error_exit(NULL);
+	g_object_unref(t);
+}
+
+int
+main(int argc, char **argv)
+{
+	VipsImage *in;
+	VipsImage *a, *b;
+	double avg;
+
+	if (VIPS_INIT(argv[0]))
+		vips_error_exit(NULL);
+
+	vips_cache_set_max(0);
+
+	if (vips_black(&in, 64, 64, "bands", 3, NULL))
+		vips_error_exit(NULL);
+	in->Type = VIPS_INTERPRETATION_sRGB;
+
+	/* No scope and no cache, so nothing is shared.
+	 */
+	build(in, &a);
+	build(in, &b);
+	if (a == b)
+		vips_error_exit("operation reused with no scope");
+	g_object_unref(a);
+	g_object_unref(b);
+
+	/* Inside a scope, the second pipeline is the first.
+	 */
+	vips_cache_scope_begin();
+	build(in, &a);
+	vips_cache_scope_begin();
+	build(in, &b);
+	vips_cache_scope_end();
+	vips_cache_scope_end();
+	if (a != b)
+		vips_error_exit("operation not reused");
+
+	/* And the shared image must still work after the scope has gone.
+	 */
+	g_object_unref(b);
+	if (vips_avg(a, &avg, NULL))
+		vips_error_exit(NULL);
+	if (avg != 0.0)
+		vips_error_exit("bad avg");
+	g_object_unref(a);
+
+	g_object_unref(in);
+
+	vips_shutdown();
+
+	return 0;
+}
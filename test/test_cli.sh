@@ -102,3 +102,205 @@ if $vips black $tmp/t1.v 1000 1000 > /dev/null 2>&1; then
 fi
 echo ok
 unset VIPS_MAX_COORD
+
+# test profile trace output
+echo -n "testing --vips-profile-trace ... "
+(cd $tmp && $vips avg $image --vips-profile-trace > /dev/null)
+if ! $PYTHON -c "import json, sys; \
+	events = json.load(open(sys.argv[1])); \
+	assert any(e.get('cat') == 'tile' for e in events)" \
+	$tmp/vips-profile.json; then
+  echo "FAIL"
+  echo "--vips-profile-trace did not write a valid trace"
+  exit 1
+fi
+echo ok
+
+# a pipeline should match the same steps run one by one
+echo -n "testing pipeline ... "
+$vips resize $image $tmp/t1.v 0.5
+$vips invert $tmp/t1.v $tmp/t2.v
+$vips pipeline $image "resize 0.5" invert $tmp/t3.v
+if [ "$($vips avg $tmp/t2.v)" != "$($vips avg $tmp/t3.v)" ]; then
+  echo "FAIL"
+  echo "pipeline does not match separate steps"
+  exit 1
+fi
+$vips pipeline $image "resize 0.5 --kernel linear" $tmp/t3.v
+echo ok
+
+# vipsheader --jobs should print the same sizes, in the same order
+echo -n "testing vipsheader --jobs ... "
+$vips copy $image $tmp/t4.v
+serial=$($vipsheader $tmp/t3.v $tmp/t4.v $tmp/t3.v | cut -d' ' -f2)
+parallel=$($vipsheader --jobs 2 $tmp/t3.v $tmp/t4.v $tmp/t3.v | cut -d' ' -f2)
+if [ "$serial" != "$parallel" ]; then
+  echo "FAIL"
+  echo "vipsheader --jobs does not match serial output"
+  exit 1
+fi
+echo ok
+
+# a second process should map the decoded image from the shared cache
+# ... rot is not sequential, so the load will decode to memory
+echo -n "testing VIPS_CACHE_SHARED ... "
+mkdir -p $tmp/shared
+$vips rot $image $tmp/t5.v d90
+VIPS_CACHE_SHARED=$tmp/shared $vips rot $image $tmp/t6.v d90
+VIPS_CACHE_SHARED=$tmp/shared $vips rot $image $tmp/t7.v d90
+if [ -z "$(ls $tmp/shared)" ] ||
+  [ "$($vips avg $tmp/t5.v)" != "$($vips avg $tmp/t6.v)" ] ||
+  [ "$($vips avg $tmp/t6.v)" != "$($vips avg $tmp/t7.v)" ]; then
+  echo "FAIL"
+  echo "shared cache did not give the same image"
+  exit 1
+fi
+echo ok
+
+# a damaged entry must be ignored ... set data_offset to -1
+echo -n "testing VIPS_CACHE_SHARED with a damaged entry ... "
+for entry in $tmp/shared/vips-*.v; do
+  printf '\377\377\377\377\377\377\377\377' |
+    dd of=$entry bs=1 seek=32 conv=notrunc 2>/dev/null
+done
+VIPS_CACHE_SHARED=$tmp/shared $vips rot $image $tmp/t7.v d90
+if [ "$($vips avg $tmp/t5.v)" != "$($vips avg $tmp/t7.v)" ]; then
+  echo "FAIL"
+  echo "shared cache used a damaged entry"
+  exit 1
+fi
+rm -rf $tmp/shared
+echo ok
+
+# entries larger than the limit are not shared
+echo -n "testing VIPS_CACHE_SHARED_MAX_MEM ... "
+mkdir -p $tmp/shared
+VIPS_CACHE_SHARED=$tmp/shared VIPS_CACHE_SHARED_MAX_MEM=1k \
+  $vips rot $image $tmp/t6.v d90
+if [ -n "$(ls $tmp/shared)" ]; then
+  echo "FAIL"
+  echo "shared cache is larger than VIPS_CACHE_SHARED_MAX_MEM"
+  exit 1
+fi
+rm -rf $tmp/shared
+echo ok
+
+# "vips serve" runs operations for "vips --connect" clients ... unix
+# socket paths are short, so don't put it in $tmp
+echo -n "testing vips serve ... "
+sockdir=$(mktemp -d /tmp/vips-XXXXXX)
+socket=$sockdir/vips.sock
+$vips serve $socket &
+server=$!
+for i in 1 2 3 4 5 6 7 8 9 10; do
+  [ -S $socket ] && break
+  sleep 0.5
+done
+serve_fail() {
+  kill $server
+  rm -rf $sockdir
+  echo "FAIL"
+  echo "$1"
+  exit 1
+}
+rm -f $tmp/t8.v
+if ! $vips --connect $socket rot $image $tmp/t8.v d90 ||
+  [ ! -f $tmp/t8.v ] ||
+  [ "$($vips avg $tmp/t5.v)" != "$($vips avg $tmp/t8.v)" ]; then
+  serve_fail "vips --connect did not run the operation"
+fi
+# output goes to the client's stdout, and relative names are in the
+# client's directory
+if [ "$(cd $tmp && $vips --connect $socket avg t8.v)" != \
+  "$($vips avg $tmp/t8.v)" ]; then
+  serve_fail "vips --connect gave the wrong output"
+fi
+# failures give a failing exit status
+if $vips --connect $socket avg $tmp/nosuchfile.v 2>/dev/null; then
+  serve_fail "vips --connect did not report failure"
+fi
+kill $server
+wait $server 2>/dev/null
+echo ok
+
+# with no server listening, the client runs the operation itself
+echo -n "testing vips --connect with no server ... "
+rm -f $tmp/t8.v
+if ! $vips --connect $socket rot $image $tmp/t8.v d90 ||
+  [ ! -f $tmp/t8.v ] ||
+  [ "$($vips avg $tmp/t5.v)" != "$($vips avg $tmp/t8.v)" ]; then
+  rm -rf $sockdir
+  echo "FAIL"
+  echo "vips --connect did not fall back to running locally"
+  exit 1
+fi
+rm -rf $sockdir
+echo ok
+
+# thumbnail a few files one at a time, then check batch runs make the same
+# images
+mkdir -p $tmp/batch
+for name in a b c d e; do
+  cp $image $tmp/batch/$name.jpg
+done
+$vipsthumbnail $tmp/batch/?.jpg -s 64 -o %s-serial.v
+
+test_batch_outputs() {
+  mode=$1
+
+  for name in a b c d e; do
+    serial=$tmp/batch/$name-serial.v
+    out=$tmp/batch/$name-$mode.v
+    if [ ! -f $out ] ||
+      [ "$($vipsheader $out | cut -d' ' -f2)" != \
+        "$($vipsheader $serial | cut -d' ' -f2)" ] ||
+      [ "$($vips avg $out)" != "$($vips avg $serial)" ]; then
+      echo "FAIL"
+      echo "vipsthumbnail $mode output $out does not match serial output"
+      exit 1
+    fi
+  done
+}
+
+echo -n "testing vipsthumbnail --batch ... "
+if ! $vipsthumbnail --batch 2 $tmp/batch/?.jpg -s 64 -o %s-batch.v; then
+  echo "FAIL"
+  echo "vipsthumbnail --batch failed"
+  exit 1
+fi
+test_batch_outputs batch
+# with no filenames, names are read from stdin
+if ! ls $tmp/batch/?.jpg |
+  $vipsthumbnail --batch 2 -s 64 -o %s-stdin.v; then
+  echo "FAIL"
+  echo "vipsthumbnail --batch from stdin failed"
+  exit 1
+fi
+test_batch_outputs stdin
+echo ok
+
+# --jobs shares the worker budget between images in flight ... try more
+# jobs than files, and a failing file, too
+echo -n "testing vipsthumbnail --jobs ... "
+if ! $vipsthumbnail -j 3 $tmp/batch/?.jpg -s 64 -o %s-jobs.v; then
+  echo "FAIL"
+  echo "vipsthumbnail --jobs failed"
+  exit 1
+fi
+test_batch_outputs jobs
+rm -f $tmp/batch/*-jobs.v
+if ! $vipsthumbnail --jobs 8 $tmp/batch/?.jpg -s 64 -o %s-jobs.v; then
+  echo "FAIL"
+  echo "vipsthumbnail --jobs with more jobs than files failed"
+  exit 1
+fi
+test_batch_outputs jobs
+if $vipsthumbnail --jobs 2 $tmp/batch/a.jpg $tmp/batch/nosuchfile.jpg \
+  -s 64 -o %s-fail.v 2>/dev/null ||
+  [ ! -f $tmp/batch/a-fail.v ]; then
+  echo "FAIL"
+  echo "vipsthumbnail --jobs did not report a failed file"
+  exit 1
+fi
+rm -rf $tmp/batch
+echo ok
@@ -0,0 +1,64 @@
+/* Check that evaluation stops with a deadline error once an image's
+ * deadline has passed.
+ */
+
+#include <string.h>
+
+#include <vips/vips.h>
+
+int
+main(int argc, char **argv)
+{
+	VipsImage *im;
+	VipsImage *x;
+	double avg;
+
+	if (VIPS_INIT(argv[0]))
+		vips_error_exit(NULL);
+
+	vips_cache_set_max(0);
+
+	if (vips_black(&im, 10000, 10000, NULL))
+		vips_error_exit(NULL);
+
+	/* An expired deadline must stop the sink, with a distinct error.
+	 */
+	vips_image_set_deadline(im, 0.001);
+	g_usleep(10000);
+	if (!vips_image_deadline_passed(im))
+		vips_error_exit("deadline has not passed");
+	vips_error_clear();
+
+	/* Images made afterwards inherit it.
+	 */
+	if (vips_invert(im, &x, NULL))
+		vips_error_exit(NULL);
+	if (x->deadline != im->deadline)
+		vips_error_exit("deadline not inherited");
+
+	if (!vips_avg(x, &avg, NULL))
+		vips_error_exit("avg ran past the deadline");
+	if (!strstr(vips_error_buffer(), "deadline"))
+		vips_error_exit("no deadline error");
+	vips_error_clear();
+	g_object_unref(x);
+
+	/* With no deadline, it all works.
+	 */
+	vips_image_set_deadline(im, 0);
+	if (vips_image_deadline_passed(im))
+		vips_error_exit("cleared deadline has passed");
+	if (vips_invert(im, &x, NULL))
+		vips_error_exit(NULL);
+	if (vips_avg(x, &avg, NULL))
+		vips_error_exit(NULL);
+	if (avg != 255.0)
+		vips_error_exit("bad avg");
+	g_object_unref(x);
+
+	g_object_unref(im);
+
+	vips_shutdown();
+
+	return 0;
+}
@@ -0,0 +1,76 @@
+/* Check that pipeline metrics count tiles and pixels per operation, and
+ * that vips_image_explain() can show them per node.
+ */
+
+#include <string.h>
+
+#include <vips/vips.h>
+
+static void *
+find_invert(const VipsMetrics *metrics, void *a, void *b)
+{
+	VipsMetrics *result = (VipsMetrics *) a;
+
+	if (g_str_equal(metrics->nickname, "invert")) {
+		*result = *metrics;
+		return result;
+	}
+
+	return NULL;
+}
+
+int
+main(int argc, char **argv)
+{
+	VipsImage *im;
+	VipsImage *x;
+	double avg;
+	VipsMetrics metrics;
+	char *plan;
+
+	if (VIPS_INIT(argv[0]))
+		vips_error_exit(NULL);
+
+	vips_metrics_set(TRUE);
+	if (!vips_metrics_get())
+		vips_error_exit("metrics not enabled");
+
+	if (vips_black(&im, 1000, 1000, NULL))
+		vips_error_exit(NULL);
+	if (vips_invert(im, &x, NULL))
+		vips_error_exit(NULL);
+	g_object_unref(im);
+	if (vips_avg(x, &avg, NULL))
+		vips_error_exit(NULL);
+	if (avg != 255.0)
+		vips_error_exit("bad avg");
+
+	/* Every pixel of the output was generated.
+	 */
+	if (x->generate_pixels < 1000 * 1000)
+		vips_error_exit("missed pixels");
+	plan = vips_image_explain(x);
+	if (!strstr(plan, "black") ||
+		!strstr(plan, "invert") ||
+		!strstr(plan, "actual"))
+		vips_error_exit("bad plan: %s", plan);
+	g_free(plan);
+	g_object_unref(x);
+
+	if (!vips_metrics_map(find_invert, &metrics, NULL))
+		vips_error_exit("no metrics for invert");
+	if (metrics.tiles == 0 ||
+		metrics.pixels < 1000 * 1000)
+		vips_error_exit("invert metrics too small");
+
+	vips_metrics_reset();
+	if (!vips_metrics_map(find_invert, &metrics, NULL))
+		vips_error_exit("no metrics for invert after reset");
+	if (metrics.tiles != 0 ||
+		metrics.pixels != 0)
+		vips_error_exit("metrics not reset");
+
+	vips_shutdown();
+
+	return 0;
+}
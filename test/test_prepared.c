@@ -0,0 +1,63 @@
+/* Check that a prepared pipeline gives the same result as calling the
+ * operations directly, and can be run many times.
+ */
+
+#include <vips/vips.h>
+
+int
+main(int argc, char **argv)
+{
+	VipsPrepared *prepared;
+	VipsImage *in;
+	VipsImage *t;
+	VipsImage *expected;
+	double avg_expected;
+
+	if (VIPS_INIT(argv[0]))
+		vips_error_exit(NULL);
+
+	prepared = vips_prepared_new();
+	if (vips_prepared_add(prepared, "invert", NULL) ||
+		vips_prepared_add(prepared, "embed",
+			"x", 1, "y", 2, "width", 20, "height", 20,
+			NULL))
+		vips_error_exit(NULL);
+
+	/* A step with a missing required argument must fail.
+	 */
+	if (!vips_prepared_add(prepared, "embed", "x", 1, NULL))
+		vips_error_exit("incomplete step accepted");
+	vips_error_clear();
+
+	for (int i = 0; i < 5; i++) {
+		VipsImage *out;
+		double avg;
+
+		if (vips_xyz(&in, 10 + i, 10, NULL) ||
+			vips_invert(in, &t, NULL) ||
+			vips_embed(t, &expected, 1, 2, 20, 20, NULL) ||
+			vips_avg(expected, &avg_expected, NULL))
+			vips_error_exit(NULL);
+		g_object_unref(t);
+
+		if (vips_prepared_run(prepared, in, &out) ||
+			vips_avg(out, &avg, NULL))
+			vips_error_exit(NULL);
+
+		if (out->Xsize != expected->Xsize ||
+			out->Ysize != expected->Ysize)
+			vips_error_exit("bad output size");
+		if (avg != avg_expected)
+			vips_error_exit("bad output pixels");
+
+		g_object_unref(out);
+		g_object_unref(expected);
+		g_object_unref(in);
+	}
+
+	vips_prepared_free(prepared);
+
+	vips_shutdown();
+
+	return 0;
+}
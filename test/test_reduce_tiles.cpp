@@ -0,0 +1,86 @@
+/* Check that VImage::reduce_tiles() visits every pixel exactly once, by
+ * comparing per-band sums with avg(), for several tile sizes.
+ */
+
+#include <cmath>
+#include <vector>
+
+#include <vips/vips8>
+
+using namespace vips;
+
+static std::vector<double>
+band_sums(VImage in, int tile_width, int tile_height)
+{
+	int bands = in.bands();
+
+	return in.reduce_tiles(
+		std::vector<double>(bands, 0.0),
+		[bands](std::vector<double> &acc, const VRegion &region) {
+			VipsRect r = region.valid();
+
+			for (int y = 0; y < r.height; y++) {
+				VipsPel *p = region.addr(r.left, r.top + y);
+
+				for (int x = 0; x < r.width; x++)
+					for (int b = 0; b < bands; b++)
+						acc[b] += *p++;
+			}
+		},
+		[bands](std::vector<double> &total,
+			const std::vector<double> &acc) {
+			for (int b = 0; b < bands; b++)
+				total[b] += acc[b];
+		},
+		tile_width, tile_height);
+}
+
+int
+main(int argc, char **argv)
+{
+	/* Default tiles, odd tiles with ragged edges, and one tile larger
+	 * than the image.
+	 */
+	const int tile_sizes[][2] = {
+		{ 0, 0 },
+		{ 17, 13 },
+		{ 64, 1 },
+		{ 1000, 1000 },
+	};
+
+	if (VIPS_INIT(argv[0]))
+		vips_error_exit(NULL);
+
+	try {
+		/* A uchar image with a different pattern in each band, and a
+		 * size that isn't a multiple of any tile size.
+		 */
+		VImage xy = VImage::xyz(301, 257);
+		VImage in = ((xy[0] * 7 + xy[1] * 3) % 256)
+						.bandjoin(xy[0] % 256)
+						.bandjoin(xy[1] % 256)
+						.cast(VIPS_FORMAT_UCHAR)
+						.copy_memory();
+		double n = (double) in.width() * in.height();
+
+		for (const auto &size : tile_sizes) {
+			std::vector<double> sums = band_sums(in, size[0], size[1]);
+
+			for (int b = 0; b < in.bands(); b++) {
+				double avg = in.extract_band(b).avg();
+
+				if (std::fabs(sums[b] / n - avg) > 1e-6)
+					vips_error_exit("band %d: sum %g does not match "
+									"avg %g with %d x %d tiles",
+						b, sums[b], avg, size[0], size[1]);
+			}
+		}
+	}
+	catch (const VError &e) {
+		vips_error_exit("%s", e.what());
+	}
+
+	vips_shutdown();
+
+	return 0;
+}
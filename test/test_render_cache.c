@@ -0,0 +1,203 @@
+/* Check that the render cache finds earlier saves of the same pipeline,
+ * and only the same pipeline.
+ */
+
+#include <string.h>
+
+#include <glib/gstdio.h>
+
+#include <vips/vips.h>
+
+static int
+count_entries(const char *dir)
+{
+	GDir *gdir;
+	int n;
+
+	if (!(gdir = g_dir_open(dir, 0, NULL)))
+		vips_error_exit("unable to open %s", dir);
+	for (n = 0; g_dir_read_name(gdir); n++)
+		;
+	g_dir_close(gdir);
+
+	return n;
+}
+
+/* Save black plus b, with the operation cache off, so we always build a
+ * new pipeline.
+ */
+static char *
+render(double b, const char *meta, size_t *length)
+{
+	VipsImage *t[3];
+	void *buf;
+
+	if (vips_black(&t[0], 16, 16, NULL) ||
+		vips_linear1(t[0], &t[1], 1.0, b, NULL) ||
+		vips_copy(t[1], &t[2], NULL))
+		vips_error_exit(NULL);
+	if (meta)
+		vips_image_set_string(t[2], "render-cache-test", meta);
+
+	if (vips_image_write_to_buffer(t[2], ".v", &buf, length, NULL))
+		vips_error_exit(NULL);
+
+	for (int i = 0; i < 3; i++)
+		g_object_unref(t[i]);
+
+	return (char *) buf;
+}
+
+/* Fill with the value in a, ignoring the input.
+ */
+static int
+fill_gen(VipsRegion *out_region,
+	void *seq, void *a, void *b, gboolean *stop)
+{
+	int value = GPOINTER_TO_INT(a);
+	VipsRect *r = &out_region->valid;
+
+	for (int y = 0; y < r->height; y++)
+		memset(VIPS_REGION_ADDR(out_region, r->left, r->top + y),
+			value, VIPS_REGION_SIZEOF_LINE(out_region));
+
+	return 0;
+}
+
+/* Save a user generate image over in, filled with value.
+ */
+static char *
+render_fill(VipsImage *in, int value, size_t *length)
+{
+	VipsImage *out;
+	void *buf;
+
+	out = vips_image_new();
+	if (vips_image_pipelinev(out, VIPS_DEMAND_STYLE_ANY, in, NULL) ||
+		vips_image_generate(out,
+			NULL, fill_gen, NULL, GINT_TO_POINTER(value), NULL) ||
+		vips_image_write_to_buffer(out, ".v", &buf, length, NULL))
+		vips_error_exit(NULL);
+	g_object_unref(out);
+
+	return (char *) buf;
+}
+
+static gboolean
+is_fake(const char *buf, size_t length)
+{
+	return length == 6 &&
+		memcmp(buf, "banana", 6) == 0;
+}
+
+int
+main(int argc, char **argv)
+{
+	char *dir;
+	GDir *gdir;
+	const char *name;
+	char *path;
+	VipsImage *black;
+	VipsImage *memory;
+	char *buf;
+	char *buf2;
+	size_t length;
+	size_t length2;
+	void *mbuf;
+
+	if (VIPS_INIT(argv[0]))
+		vips_error_exit(NULL);
+
+	vips_cache_set_max(0);
+
+	if (!(dir = g_dir_make_tmp("vips-render-XXXXXX", NULL)))
+		vips_error_exit("unable to make temp dir");
+	vips_cache_set_render_dir(dir);
+	vips_cache_set_render_max_mem(1024 * 1024);
+
+	/* The first save makes an entry.
+	 */
+	buf = render(10, NULL, &length);
+	if (is_fake(buf, length))
+		vips_error_exit("render found a stale entry");
+	g_free(buf);
+	if (count_entries(dir) != 1)
+		vips_error_exit("render made no cache entry");
+
+	/* Replace the entry and drop the memory tier. An identical pipeline
+	 * must now find the replacement.
+	 */
+	gdir = g_dir_open(dir, 0, NULL);
+	name = g_dir_read_name(gdir);
+	path = g_build_filename(dir, name, NULL);
+	g_dir_close(gdir);
+	if (!g_file_set_contents(path, "banana", 6, NULL))
+		vips_error_exit("unable to write %s", path);
+	vips_cache_set_render_max_mem(0);
+	vips_cache_set_render_max_mem(1024 * 1024);
+
+	buf = render(10, NULL, &length);
+	if (!is_fake(buf, length))
+		vips_error_exit("render did not use the cache entry");
+	g_free(buf);
+
+	/* A different argument or different metadata is a different image.
+	 */
+	buf = render(11, NULL, &length);
+	if (is_fake(buf, length))
+		vips_error_exit("different argument hit the cache");
+	g_free(buf);
+	buf = render(10, "x", &length);
+	if (is_fake(buf, length))
+		vips_error_exit("different metadata hit the cache");
+	g_free(buf);
+	if (count_entries(dir) != 3)
+		vips_error_exit("wrong number of cache entries");
+
+	/* Memory images can be drawn on, so they are never cached.
+	 */
+	if (vips_black(&black, 16, 16, NULL) ||
+		!(memory = vips_image_copy_memory(black)) ||
+		vips_image_write_to_buffer(memory, ".v", &mbuf, &length, NULL))
+		vips_error_exit(NULL);
+	g_free(mbuf);
+	g_object_unref(memory);
+	g_object_unref(black);
+	if (count_entries(dir) != 3)
+		vips_error_exit("memory image was cached");
+
+	/* Partial images made outside the cache have a generate function we
+	 * can't key on, so two over the same input must not match.
+	 */
+	if (vips_black(&black, 16, 16, NULL))
+		vips_error_exit(NULL);
+	buf = render_fill(black, 0, &length);
+	buf2 = render_fill(black, 255, &length2);
+	if (length == length2 &&
+		memcmp(buf, buf2, length) == 0)
+		vips_error_exit("user generate images shared a cache entry");
+	g_free(buf);
+	g_free(buf2);
+	g_object_unref(black);
+	if (count_entries(dir) != 3)
+		vips_error_exit("user generate image was cached");
+
+	vips_cache_set_render_dir(NULL);
+	vips_cache_set_render_max_mem(0);
+
+	gdir = g_dir_open(dir, 0, NULL);
+	while ((name = g_dir_read_name(gdir))) {
+		char *entry = g_build_filename(dir, name, NULL);
+
+		g_unlink(entry);
+		g_free(entry);
+	}
+	g_dir_close(gdir);
+	g_rmdir(dir);
+	g_free(path);
+	g_free(dir);
+
+	vips_shutdown();
+
+	return 0;
+}
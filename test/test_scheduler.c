@@ -0,0 +1,83 @@
+/* Run several pipelines at once through a small scheduler and check they
+ * all complete correctly.
+ */
+
+#include <vips/vips.h>
+
+#define N_PIPELINES (6)
+
+static gpointer
+run_pipeline(gpointer data)
+{
+	int i = GPOINTER_TO_INT(data);
+	VipsImage *im;
+	VipsImage *x;
+	double avg;
+
+	if (vips_black(&im, 1000, 1000, NULL))
+		vips_error_exit(NULL);
+	if (vips_invert(im, &x, NULL))
+		vips_error_exit(NULL);
+	g_object_unref(im);
+
+	/* Mix priorities and weights, everything must still finish.
+	 */
+	vips_image_set_int(x, VIPS_META_PRIORITY, i % 2 ? 10 : -10);
+	vips_image_set_int(x, VIPS_META_WEIGHT, 1 + i);
+	if (vips_image_get_priority(x) != (i % 2 ? 10 : -10) ||
+		vips_image_get_weight(x) != 1 + i)
+		vips_error_exit("priority or weight not set");
+
+	if (vips_avg(x, &avg, NULL))
+		vips_error_exit(NULL);
+	g_object_unref(x);
+
+	if (avg != 255.0)
+		vips_error_exit("bad avg");
+
+	vips_thread_shutdown();
+
+	return NULL;
+}
+
+int
+main(int argc, char **argv)
+{
+	GThread *threads[N_PIPELINES];
+	VipsImage *im;
+	int i;
+
+	if (VIPS_INIT(argv[0]))
+		vips_error_exit(NULL);
+
+	vips_cache_set_max(0);
+
+	if (vips_scheduler_get_max() != 0)
+		vips_error_exit("scheduler limit set at startup");
+	vips_scheduler_set_max(2);
+	if (vips_scheduler_get_max() != 2)
+		vips_error_exit("scheduler limit not set");
+
+	for (i = 0; i < N_PIPELINES; i++)
+		threads[i] = g_thread_new("pipeline",
+			run_pipeline, GINT_TO_POINTER(i));
+	for (i = 0; i < N_PIPELINES; i++)
+		g_thread_join(threads[i]);
+
+	/* Out of range values are ignored.
+	 */
+	if (vips_black(&im, 10, 10, NULL))
+		vips_error_exit(NULL);
+	vips_image_set_int(im, VIPS_META_PRIORITY, 1000);
+	vips_image_set_int(im, VIPS_META_WEIGHT, 0);
+	if (vips_image_get_priority(im) != 0 ||
+		vips_image_get_weight(im) != 1)
+		vips_error_exit("out of range priority or weight used");
+	g_object_unref(im);
+
+	vips_scheduler_set_max(0);
+
+	vips_shutdown();
+
+	return 0;
+}
@@ -0,0 +1,77 @@
+/* Check vips_sink_memory_stride() writes pixels in place, and leaves the
+ * padding between lines alone.
+ */
+
+#include <string.h>
+
+#include <vips/vips.h>
+
+#define PAD (37)
+
+int
+main(int argc, char **argv)
+{
+	VipsImage *x;
+	VipsImage *im;
+	VipsPel *ref;
+	VipsPel *buf;
+	size_t size;
+	size_t line;
+	size_t stride;
+	int y;
+
+	if (VIPS_INIT(argv[0]))
+		vips_error_exit(NULL);
+
+	/* A three band pipeline, wider than a tile.
+	 */
+	if (vips_xyz(&x, 1000, 300, NULL) ||
+		vips_bandjoin_const1(x, &im, 7, NULL))
+		vips_error_exit(NULL);
+	g_object_unref(x);
+	if (vips_cast_uchar(im, &x, NULL))
+		vips_error_exit(NULL);
+	g_object_unref(im);
+
+	if (!(ref = vips_image_write_to_memory(x, &size)))
+		vips_error_exit(NULL);
+
+	/* Lines PAD bytes apart, starting one byte in, so nothing is aligned.
+	 */
+	line = VIPS_IMAGE_SIZEOF_LINE(x);
+	stride = line + PAD;
+	buf = g_malloc(stride * x->Ysize + 1);
+	memset(buf, 0xab, stride * x->Ysize + 1);
+
+	if (vips_sink_memory_stride(x, buf + 1, stride * x->Ysize, stride))
+		vips_error_exit(NULL);
+
+	if (buf[0] != 0xab)
+		vips_error_exit("write before buffer");
+	for (y = 0; y < x->Ysize; y++) {
+		VipsPel *p = buf + 1 + y * stride;
+		int i;
+
+		if (memcmp(p, ref + y * line, line))
+			vips_error_exit("bad pixels on line %d", y);
+		for (i = 0; i < PAD; i++)
+			if (p[line + i] != 0xab)
+				vips_error_exit("write to padding on line %d", y);
+	}
+
+	/* Short lines and short buffers must fail.
+	 */
+	if (!vips_sink_memory_stride(x, buf, stride * x->Ysize, line - 1))
+		vips_error_exit("short stride accepted");
+	if (!vips_sink_memory_stride(x, buf, line, stride))
+		vips_error_exit("short buffer accepted");
+	vips_error_clear();
+
+	g_free(buf);
+	g_free(ref);
+	g_object_unref(x);
+
+	vips_shutdown();
+
+	return 0;
+}
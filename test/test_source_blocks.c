@@ -0,0 +1,130 @@
+/* Check the VipsSourceCustom block cache serves reads correctly, and
+ * coalesces small reads into fewer upstream fetches.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <vips/vips.h>
+
+#define SIZE (100000)
+
+typedef struct _Upstream {
+	unsigned char data[SIZE];
+	gint64 position;
+	int n_reads;
+} Upstream;
+
+static gint64
+upstream_read(VipsSourceCustom *source,
+	void *buffer, gint64 length, Upstream *upstream)
+{
+	gint64 n = VIPS_MIN(length, SIZE - upstream->position);
+
+	memcpy(buffer, upstream->data + upstream->position, n);
+	upstream->position += n;
+	upstream->n_reads += 1;
+
+	return n;
+}
+
+static gint64
+upstream_seek(VipsSourceCustom *source,
+	gint64 offset, int whence, Upstream *upstream)
+{
+	gint64 new_position;
+
+	switch (whence) {
+	case SEEK_SET:
+		new_position = offset;
+		break;
+
+	case SEEK_CUR:
+		new_position = upstream->position + offset;
+		break;
+
+	case SEEK_END:
+		new_position = SIZE + offset;
+		break;
+
+	default:
+		return -1;
+	}
+
+	if (new_position < 0)
+		return -1;
+	upstream->position = new_position;
+
+	return new_position;
+}
+
+int
+main(int argc, char **argv)
+{
+	static Upstream upstream;
+
+	VipsSourceCustom *source;
+	unsigned char buf[1000];
+	gint64 hits, misses, fetches;
+	int i;
+
+	if (VIPS_INIT(argv[0]))
+		vips_error_exit(NULL);
+
+	for (i = 0; i < SIZE; i++)
+		upstream.data[i] = i * 7 + i / 251;
+
+	if (!(source = vips_source_custom_new()))
+		vips_error_exit(NULL);
+	g_signal_connect(source, "read",
+		G_CALLBACK(upstream_read), &upstream);
+	g_signal_connect(source, "seek",
+		G_CALLBACK(upstream_seek), &upstream);
+	if (vips_source_custom_set_block_cache(source, 4096, 8))
+		vips_error_exit(NULL);
+
+	if (vips_source_length(VIPS_SOURCE(source)) != SIZE)
+		vips_error_exit("bad source length");
+
+	/* Lots of small reads, jumping back and forth over a few blocks,
+	 * then off the end.
+	 */
+	for (i = 0; i < 200; i++) {
+		gint64 offset = (i * 3797) % 20000;
+		gint64 n;
+
+		if (vips_source_seek(VIPS_SOURCE(source), offset, SEEK_SET) != offset)
+			vips_error_exit(NULL);
+		if ((n = vips_source_read(VIPS_SOURCE(source),
+				 buf, sizeof(buf))) <= 0)
+			vips_error_exit(NULL);
+		if (memcmp(buf, upstream.data + offset, n))
+			vips_error_exit("bad data at %d", (int) offset);
+	}
+
+	if (vips_source_seek(VIPS_SOURCE(source),
+			SIZE - 10, SEEK_SET) != SIZE - 10)
+		vips_error_exit(NULL);
+	if (vips_source_read(VIPS_SOURCE(source), buf, sizeof(buf)) != 10)
+		vips_error_exit("bad read at end");
+	if (memcmp(buf, upstream.data + SIZE - 10, 10))
+		vips_error_exit("bad data at end");
+	if (vips_source_read(VIPS_SOURCE(source), buf, sizeof(buf)) != 0)
+		vips_error_exit("read past end");
+
+	/* The reads touch the first six blocks, plus the last one.
+	 */
+	vips_source_custom_get_block_stats(source, &hits, &misses, &fetches);
+	if (misses != 7 ||
+		fetches > misses ||
+		hits <= 190)
+		vips_error_exit("bad block stats");
+	if (upstream.n_reads >= 20)
+		vips_error_exit("too many upstream reads");
+
+	g_object_unref(source);
+
+	vips_shutdown();
+
+	return 0;
+}
@@ -0,0 +1,131 @@
+/* Check small writes, vectored writes and source copies all arrive at a
+ * target in order.
+ */
+
+#include <string.h>
+
+#include <glib/gstdio.h>
+#include <vips/vips.h>
+
+#define SIZE (300000)
+
+static unsigned char data[SIZE];
+
+/* Write data in a mix of small chunks, large chunks and gathers.
+ */
+static void
+write_pattern(VipsTarget *target)
+{
+	size_t pos;
+	int i;
+
+	pos = 0;
+	for (i = 0; pos < SIZE; i++) {
+		size_t n = VIPS_MIN(SIZE - pos, (i % 7) * (i % 7) * 300 + 1);
+
+		if (i % 3 == 0) {
+			GOutputVector vectors[2];
+
+			vectors[0].buffer = data + pos;
+			vectors[0].size = n / 2;
+			vectors[1].buffer = data + pos + n / 2;
+			vectors[1].size = n - n / 2;
+			if (vips_target_writev(target, vectors, 2))
+				vips_error_exit(NULL);
+		}
+		else if (vips_target_write(target, data + pos, n))
+			vips_error_exit(NULL);
+
+		pos += n;
+	}
+
+	if (vips_target_end(target))
+		vips_error_exit(NULL);
+}
+
+static void
+check_file(const char *filename)
+{
+	char *contents;
+	gsize length;
+
+	if (!g_file_get_contents(filename, &contents, &length, NULL))
+		vips_error_exit("unable to read %s", filename);
+	if (length != SIZE ||
+		memcmp(contents, data, SIZE))
+		vips_error_exit("bad contents in %s", filename);
+	g_free(contents);
+}
+
+int
+main(int argc, char **argv)
+{
+	VipsTarget *target;
+	VipsSource *source;
+	VipsBlob *blob;
+	char *a;
+	char *b;
+	int i;
+
+	if (VIPS_INIT(argv[0]))
+		vips_error_exit(NULL);
+
+	for (i = 0; i < SIZE; i++)
+		data[i] = i * 13 + i / 1000;
+
+	/* To memory.
+	 */
+	if (!(target = vips_target_new_to_memory()))
+		vips_error_exit(NULL);
+	write_pattern(target);
+	g_object_get(target, "blob", &blob, NULL);
+	if (VIPS_AREA(blob)->length != SIZE ||
+		memcmp(VIPS_AREA(blob)->data, data, SIZE))
+		vips_error_exit("bad memory target contents");
+	vips_area_unref(VIPS_AREA(blob));
+	g_object_unref(target);
+
+	/* To a file.
+	 */
+	if (!(a = vips__temp_name("%s.bin")) ||
+		!(b = vips__temp_name("%s.bin")))
+		vips_error_exit(NULL);
+	if (!(target = vips_target_new_to_file(a)))
+		vips_error_exit(NULL);
+	write_pattern(target);
+	g_object_unref(target);
+	check_file(a);
+
+	/* File to file copy.
+	 */
+	if (!(source = vips_source_new_from_file(a)) ||
+		!(target = vips_target_new_to_file(b)))
+		vips_error_exit(NULL);
+	if (vips_target_write_source(target, source) ||
+		vips_target_end(target))
+		vips_error_exit(NULL);
+	g_object_unref(source);
+	g_object_unref(target);
+	check_file(b);
+
+	/* Memory to file.
+	 */
+	if (!(source = vips_source_new_from_memory(data, SIZE)) ||
+		!(target = vips_target_new_to_file(b)))
+		vips_error_exit(NULL);
+	if (vips_target_write_source(target, source) ||
+		vips_target_end(target))
+		vips_error_exit(NULL);
+	g_object_unref(source);
+	g_object_unref(target);
+	check_file(b);
+
+	g_unlink(a);
+	g_unlink(b);
+	g_free(a);
+	g_free(b);
+
+	vips_shutdown();
+
+	return 0;
+}
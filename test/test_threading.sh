@@ -55,3 +55,13 @@ if [ $exit_code -ne 0 ]; then
 fi
 echo ok
 
+
+# the work-stealing and ordered schedulers should give the same result
+echo -n "checking work-stealing scheduler ... "
+avg_steal=$(VIPS_CONCURRENCY=8 $vips avg $image)
+avg_ordered=$(VIPS_NOSTEAL=1 VIPS_CONCURRENCY=8 $vips avg $image)
+if [ "$avg_steal" != "$avg_ordered" ]; then
+  echo FAILED, $avg_steal != $avg_ordered
+  exit 1
+fi
+echo ok
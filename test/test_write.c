@@ -0,0 +1,51 @@
+/* Check vips_image_write() between memory images makes a private copy, so
+ * drawing on the result can't change the source.
+ */
+
+#include <vips/vips.h>
+
+int
+main(int argc, char **argv)
+{
+	VipsImage *im;
+	VipsImage *x;
+	VipsImage *out;
+	double avg;
+
+	if (VIPS_INIT(argv[0]))
+		vips_error_exit(NULL);
+
+	/* A memory image to build from.
+	 */
+	if (vips_black(&x, 100, 100, NULL))
+		vips_error_exit(NULL);
+	im = vips_image_new_memory();
+	if (vips_image_write(x, im))
+		vips_error_exit(NULL);
+	g_object_unref(x);
+
+	/* Memory to memory with vips_image_write(): we must get a new buffer,
+	 * and drawing on the copy must not change the source.
+	 */
+	out = vips_image_new_memory();
+	if (vips_image_write(im, out))
+		vips_error_exit(NULL);
+	if (out->data == im->data)
+		vips_error_exit("write shared the source pixels");
+	if (vips_draw_rect1(out, 255, 0, 0, 100, 100, "fill", TRUE, NULL))
+		vips_error_exit(NULL);
+	if (vips_avg(im, &avg, NULL))
+		vips_error_exit(NULL);
+	if (avg != 0.0)
+		vips_error_exit("draw on the copy changed the source");
+	if (vips_avg(out, &avg, NULL))
+		vips_error_exit(NULL);
+	if (avg != 255.0)
+		vips_error_exit("draw on the copy failed");
+	g_object_unref(out);
+	g_object_unref(im);
+
+	vips_shutdown();
+
+	return 0;
+}
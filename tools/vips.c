@@ -49,6 +49,11 @@
  * 	- add --targets
  * 1/11/22
  * 	- add "-c" flag
+ * 14/10/26
+ * 	- add --explain
+ * 15/10/26
+ * 	- add "serve" and --connect
+ * 	- add "pipeline"
  */
 
 /*
@@ -97,6 +102,16 @@
 #include <string.h>
 #include <ctype.h>
 #include <locale.h>
+#include <errno.h>
+
+#ifndef G_OS_WIN32
+#include <signal.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#endif /*!G_OS_WIN32*/
 
 #define VIPS_DISABLE_DEPRECATION_WARNINGS
 #include <vips/vips.h>
@@ -106,6 +121,8 @@
 static char *main_option_plugin = NULL;
 static gboolean main_option_targets;
 static gboolean main_option_version;
+static gboolean main_option_explain;
+static char *main_option_connect = NULL;
 
 static void *
 list_class(GType type, void *user_data)
@@ -299,6 +316,12 @@ static GOptionEntry main_option[] = {
 		N_("PLUGIN") },
 	{ "version", 'v', 0, G_OPTION_ARG_NONE, &main_option_version,
 		N_("print version"), NULL },
+	{ "explain", 0, 0, G_OPTION_ARG_NONE, &main_option_explain,
+		N_("print the pipeline for each output image"), NULL },
+	{ "connect", 0, 0, G_OPTION_ARG_FILENAME, &main_option_connect,
+		N_("run the operation in the \"vips serve\" at SOCKET, "
+		   "must be the first argument"),
+		N_("SOCKET") },
 	{ "completion", 'c', G_OPTION_FLAG_OPTIONAL_ARG, G_OPTION_ARG_CALLBACK,
 		(GOptionArgFunc) parse_main_option_completion,
 		N_("print completions"),
@@ -306,6 +329,32 @@ static GOptionEntry main_option[] = {
 	{ NULL }
 };
 
+/* Print the pipeline behind an output image.
+ */
+static void *
+explain_output(VipsObject *object,
+	GParamSpec *pspec,
+	VipsArgumentClass *argument_class,
+	VipsArgumentInstance *argument_instance,
+	void *a, void *b)
+{
+	if ((argument_class->flags & VIPS_ARGUMENT_OUTPUT) &&
+		argument_instance->assigned &&
+		g_type_is_a(G_PARAM_SPEC_VALUE_TYPE(pspec), VIPS_TYPE_IMAGE)) {
+		VipsImage *image;
+		char *plan;
+
+		g_object_get(G_OBJECT(object),
+			g_param_spec_get_name(pspec), &image, NULL);
+		plan = vips_image_explain(image);
+		fprintf(stderr, "%s:\n%s", g_param_spec_get_name(pspec), plan);
+		g_free(plan);
+		g_object_unref(image);
+	}
+
+	return NULL;
+}
+
 #ifdef ENABLE_DEPRECATED
 typedef void *(*map_name_fn)(im_function *);
 
@@ -529,6 +578,262 @@ print_help(int argc, char **argv)
 	return 0;
 }
 
+/* One step of a pipeline: an operation, and the args for it from the
+ * command line.
+ */
+typedef struct _PipelineStep {
+	VipsOperation *operation;
+	char **argv;
+
+	/* Positional args, options removed. args[0] is the operation name.
+	 */
+	GPtrArray *args;
+	int i;
+
+	/* Set when we've attached the input image, and the name of the
+	 * output image.
+	 */
+	gboolean have_in;
+	const char *out;
+} PipelineStep;
+
+/* Set the args from a step's options, and gather the positional args.
+ * Options look like "--name=value", "--name value" or "--flag".
+ */
+static int
+pipeline_step_parse(PipelineStep *step)
+{
+	step->args = g_ptr_array_new();
+	g_ptr_array_add(step->args, step->argv[0]);
+
+	for (int i = 1; step->argv[i]; i++) {
+		const char *arg = step->argv[i];
+
+		if (vips_isprefix("--", arg) &&
+			arg[2]) {
+			char name[256];
+			const char *value;
+			const char *p;
+			GParamSpec *pspec;
+			VipsArgumentClass *argument_class;
+			VipsArgumentInstance *argument_instance;
+
+			g_strlcpy(name, arg + 2, sizeof(name));
+			value = NULL;
+			if ((p = strchr(arg + 2, '='))) {
+				int len = VIPS_MIN(p - (arg + 2), (int) sizeof(name) - 1);
+
+				name[len] = '\0';
+				value = p + 1;
+			}
+
+			if (vips_object_get_argument(VIPS_OBJECT(step->operation), name,
+					&pspec, &argument_class, &argument_instance))
+				return -1;
+
+			if (!value) {
+				if (G_PARAM_SPEC_VALUE_TYPE(pspec) == G_TYPE_BOOLEAN)
+					value = "true";
+				else if (step->argv[i + 1])
+					value = step->argv[++i];
+				else {
+					vips_error("pipeline",
+						_("no value for \"%s\""), name);
+					return -1;
+				}
+			}
+
+			if (vips_object_set_argument_from_string(
+					VIPS_OBJECT(step->operation), name, value))
+				return -1;
+		}
+		else
+			g_ptr_array_add(step->args, (char *) arg);
+	}
+
+	g_ptr_array_add(step->args, NULL);
+
+	return 0;
+}
+
+/* Set the required args for a step. The first required input image is the
+ * output of the previous step, the other inputs come from the command line.
+ */
+static void *
+pipeline_step_required(VipsObject *object,
+	GParamSpec *pspec,
+	VipsArgumentClass *argument_class,
+	VipsArgumentInstance *argument_instance,
+	void *a, void *b)
+{
+	PipelineStep *step = (PipelineStep *) a;
+	VipsImage *in = (VipsImage *) b;
+	const char *name = g_param_spec_get_name(pspec);
+	GType type = G_PARAM_SPEC_VALUE_TYPE(pspec);
+
+	if (!(argument_class->flags & VIPS_ARGUMENT_REQUIRED) ||
+		!(argument_class->flags & VIPS_ARGUMENT_CONSTRUCT) ||
+		(argument_class->flags & VIPS_ARGUMENT_DEPRECATED))
+		return NULL;
+
+	if (argument_class->flags & VIPS_ARGUMENT_INPUT) {
+		if (!step->have_in &&
+			g_type_is_a(type, VIPS_TYPE_IMAGE)) {
+			g_object_set(object, name, in, NULL);
+			step->have_in = TRUE;
+		}
+		else {
+			const char *arg;
+
+			if (!(arg = g_ptr_array_index(step->args, step->i))) {
+				vips_error("pipeline",
+					_("\"%s\" needs more arguments"), step->argv[0]);
+				return pspec;
+			}
+			if (vips_object_set_argument_from_string(object, name, arg))
+				return pspec;
+			step->i += 1;
+		}
+	}
+	else if (argument_class->flags & VIPS_ARGUMENT_OUTPUT) {
+		if (!step->out &&
+			g_type_is_a(type, VIPS_TYPE_IMAGE))
+			step->out = name;
+		else if (vips_object_argument_needsstring(object, name)) {
+			vips_error("pipeline",
+				_("\"%s\" has an output \"%s\" which needs a filename"),
+				step->argv[0], name);
+			return pspec;
+		}
+	}
+
+	return NULL;
+}
+
+/* Run a step on @in, returning a new ref to the output image.
+ */
+static VipsImage *
+pipeline_step_run(PipelineStep *step, VipsImage *in)
+{
+	VipsImage *out;
+
+	step->i = 1;
+	if (vips_argument_map(VIPS_OBJECT(step->operation),
+			pipeline_step_required, step, in))
+		return NULL;
+
+	if (!step->have_in ||
+		!step->out) {
+		vips_error("pipeline",
+			_("\"%s\" does not take and make an image"), step->argv[0]);
+		return NULL;
+	}
+	if (g_ptr_array_index(step->args, step->i)) {
+		vips_error("pipeline",
+			_("too many arguments for \"%s\""), step->argv[0]);
+		return NULL;
+	}
+
+	if (vips_cache_operation_buildp(&step->operation))
+		return NULL;
+
+	g_object_get(step->operation, step->out, &out, NULL);
+
+	return out;
+}
+
+/* "vips pipeline IN STEP... OUT" links a set of operations into a single
+ * pipeline, so there are no intermediate files and the whole chain runs in
+ * one pass.
+ */
+static int
+pipeline(int argc, char **argv)
+{
+	PipelineStep *steps;
+	int n_steps;
+	VipsAccess access;
+	VipsImage *image;
+	int result;
+
+	if (argc < 2) {
+		vips_error("pipeline", "%s",
+			_("usage: vips pipeline IN STEP... OUT"));
+		return -1;
+	}
+
+	n_steps = argc - 2;
+	steps = g_new0(PipelineStep, n_steps);
+	image = NULL;
+	result = -1;
+
+	/* Make all the operations first, so we can pick the access mode for
+	 * the load.
+	 */
+	access = VIPS_ACCESS_SEQUENTIAL;
+	for (int i = 0; i < n_steps; i++) {
+		GError *error = NULL;
+		PipelineStep *step = &steps[i];
+
+		if (!g_shell_parse_argv(argv[i + 1], NULL, &step->argv, &error)) {
+			vips_g_error(&error);
+			goto cleanup;
+		}
+		if (!(step->operation = vips_operation_new(step->argv[0])) ||
+			pipeline_step_parse(step))
+			goto cleanup;
+
+		if (!(vips_operation_get_flags(step->operation) &
+				VIPS_OPERATION_SEQUENTIAL))
+			access = VIPS_ACCESS_RANDOM;
+	}
+
+	if (!(image = vips_image_new_from_file(argv[0],
+			  "access", access,
+			  NULL)))
+		goto cleanup;
+
+	for (int i = 0; i < n_steps; i++) {
+		VipsImage *out;
+
+		if (!(out = pipeline_step_run(&steps[i], image)))
+			goto cleanup;
+		g_object_unref(image);
+		image = out;
+	}
+
+	if (vips_image_write_to_file(image, argv[argc - 1], NULL))
+		goto cleanup;
+
+	if (main_option_explain) {
+		char *plan;
+
+		plan = vips_image_explain(image);
+		fprintf(stderr, "%s", plan);
+		g_free(plan);
+	}
+
+	result = 0;
+
+cleanup:
+	VIPS_UNREF(image);
+	for (int i = 0; i < n_steps; i++) {
+		PipelineStep *step = &steps[i];
+
+		if (step->operation) {
+			vips_object_unref_outputs(VIPS_OBJECT(step->operation));
+			g_object_unref(step->operation);
+		}
+		if (step->args)
+			g_ptr_array_unref(step->args);
+		g_strfreev(step->argv);
+	}
+	g_free(steps);
+
+	return result;
+}
+
+static int serve(int argc, char **argv);
+
 /* All our built-in actions.
  */
 
@@ -558,6 +863,10 @@ static ActionEntry actions[] = {
 #endif
 	{ "help", N_("list possible actions"),
 		&empty_options[0], print_help },
+	{ "pipeline", N_("run IN STEP... OUT as a single pipeline"),
+		&empty_options[0], pipeline },
+	{ "serve", N_("run operations for --connect, listening on SOCKET"),
+		&empty_options[0], serve },
 };
 
 static int
@@ -627,6 +936,376 @@ add_operation_group(GOptionContext *context, VipsOperation *user_data)
 	return group;
 }
 
+#ifndef G_OS_WIN32
+/* "vips serve SOCKET" runs operations for "vips --connect SOCKET" clients,
+ * so scripts which call vips many times only pay for startup once, and
+ * share the operation cache.
+ *
+ * The client passes its stdin, stdout and stderr with SCM_RIGHTS on the
+ * first byte of the request. The request is an int argc, then the client's
+ * working directory and each arg as nul-terminated strings. The server runs
+ * the operation in that directory on those files, then replies with a
+ * single status byte.
+ */
+
+static int
+socket_open(const char *path, struct sockaddr_un *addr)
+{
+	if (strlen(path) >= sizeof(addr->sun_path)) {
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+
+	memset(addr, 0, sizeof(*addr));
+	addr->sun_family = AF_UNIX;
+	strcpy(addr->sun_path, path);
+
+	return socket(AF_UNIX, SOCK_STREAM, 0);
+}
+
+static int
+write_all(int fd, const void *buf, size_t n)
+{
+	const char *p = (const char *) buf;
+
+	while (n > 0) {
+		ssize_t len;
+
+		if ((len = write(fd, p, n)) < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+
+		p += len;
+		n -= len;
+	}
+
+	return 0;
+}
+
+/* Read to EOF, appending to @buf.
+ */
+static int
+read_all(int fd, GByteArray *buf)
+{
+	for (;;) {
+		guint8 chunk[4096];
+		ssize_t len;
+
+		if ((len = read(fd, chunk, sizeof(chunk))) < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		if (len == 0)
+			return 0;
+
+		g_byte_array_append(buf, chunk, len);
+	}
+}
+
+/* Send a command to a server. Returns -1 if we couldn't connect, so the
+ * caller can run the command itself, or 0 with the exit status in @status.
+ * We run before VIPS_INIT(), so we can't use the libvips error system.
+ */
+static int
+connect_run(const char *path, int argc, char **argv, int *status)
+{
+	struct sockaddr_un addr;
+	int fd;
+	GByteArray *request;
+	char *cwd;
+	int fds[3] = { 0, 1, 2 };
+	union {
+		char buf[CMSG_SPACE(sizeof(fds))];
+		struct cmsghdr align;
+	} control;
+	struct msghdr msg = { 0 };
+	struct iovec iov;
+	struct cmsghdr *cmsg;
+	void (*old_handler)(int);
+	GByteArray *reply;
+
+	if ((fd = socket_open(path, &addr)) < 0)
+		return -1;
+	if (connect(fd, (struct sockaddr *) &addr, sizeof(addr))) {
+		close(fd);
+		return -1;
+	}
+
+	request = g_byte_array_new();
+	g_byte_array_append(request, (guint8 *) &argc, sizeof(argc));
+	cwd = g_get_current_dir();
+	g_byte_array_append(request, (guint8 *) cwd, strlen(cwd) + 1);
+	g_free(cwd);
+	for (int i = 0; i < argc; i++)
+		g_byte_array_append(request,
+			(guint8 *) argv[i], strlen(argv[i]) + 1);
+
+	iov.iov_base = request->data;
+	iov.iov_len = 1;
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control.buf;
+	msg.msg_controllen = sizeof(control.buf);
+	cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+	memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+	/* The server has our stdout, so it's fine to wait for the status
+	 * byte with a simple read to EOF.
+	 */
+	old_handler = signal(SIGPIPE, SIG_IGN);
+	reply = g_byte_array_new();
+	if (sendmsg(fd, &msg, 0) != 1 ||
+		write_all(fd, request->data + 1, request->len - 1) ||
+		shutdown(fd, SHUT_WR) ||
+		read_all(fd, reply) ||
+		reply->len != 1) {
+		fprintf(stderr, "vips: lost connection to \"%s\"\n", path);
+		*status = 1;
+	}
+	else
+		*status = reply->data[0];
+	signal(SIGPIPE, old_handler);
+
+	g_byte_array_unref(reply);
+	g_byte_array_unref(request);
+	close(fd);
+
+	return 0;
+}
+
+/* Run an operation for a client. argv[0] is the operation name.
+ */
+static int
+serve_operation(int argc, char **argv)
+{
+	VipsOperation *operation;
+	GOptionContext *context;
+	GOptionGroup *group;
+	int result;
+
+	if (!(operation = vips_operation_new(argv[0])))
+		return -1;
+
+	/* --help would exit() the server.
+	 */
+	context = g_option_context_new(NULL);
+	g_option_context_set_help_enabled(context, FALSE);
+	group = add_operation_group(context, operation);
+	vips_call_options(group, operation);
+
+	result = 0;
+	if (parse_options(context, &argc, argv))
+		result = -1;
+	else if (vips_call_argv(operation, argc - 1, argv + 1)) {
+		if (argc == 1)
+			vips_operation_class_print_usage(
+				VIPS_OPERATION_GET_CLASS(operation));
+		result = -1;
+	}
+
+	vips_object_unref_outputs(VIPS_OBJECT(operation));
+	g_object_unref(operation);
+	g_option_context_free(context);
+
+	return result;
+}
+
+/* Read a request, swap in the client's files and directory, and run it.
+ */
+static int
+serve_request(int conn, const char *server_cwd)
+{
+	int fds[3] = { -1, -1, -1 };
+	union {
+		char buf[CMSG_SPACE(sizeof(fds))];
+		struct cmsghdr align;
+	} control;
+	struct msghdr msg = { 0 };
+	struct iovec iov;
+	struct cmsghdr *cmsg;
+	guint8 first;
+	GByteArray *request;
+	int saved[3];
+	int argc;
+	char **argv;
+	const char *p;
+	const char *end;
+	const char *cwd;
+	guint8 status;
+
+	iov.iov_base = &first;
+	iov.iov_len = 1;
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control.buf;
+	msg.msg_controllen = sizeof(control.buf);
+	if (recvmsg(conn, &msg, 0) != 1)
+		return -1;
+	if ((cmsg = CMSG_FIRSTHDR(&msg)) &&
+		cmsg->cmsg_level == SOL_SOCKET &&
+		cmsg->cmsg_type == SCM_RIGHTS &&
+		cmsg->cmsg_len == CMSG_LEN(sizeof(fds)))
+		memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+	if (fds[0] < 0 ||
+		fds[1] < 0 ||
+		fds[2] < 0) {
+		for (int i = 0; i < 3; i++)
+			if (fds[i] >= 0)
+				close(fds[i]);
+		return -1;
+	}
+
+	request = g_byte_array_new();
+	g_byte_array_append(request, &first, 1);
+	if (read_all(conn, request) ||
+		request->len < sizeof(argc)) {
+		g_byte_array_unref(request);
+		for (int i = 0; i < 3; i++)
+			close(fds[i]);
+		return -1;
+	}
+
+	/* Split the request into cwd and a NULL-terminated argv, checking
+	 * each string is inside the buffer.
+	 */
+	memcpy(&argc, request->data, sizeof(argc));
+	p = (const char *) request->data + sizeof(argc);
+	end = (const char *) request->data + request->len;
+	argv = NULL;
+	cwd = NULL;
+	if (argc > 0 &&
+		argc < 10000) {
+		argv = g_new0(char *, argc + 1);
+		for (int i = -1; i < argc; i++) {
+			const char *nul;
+
+			if (!(nul = memchr(p, '\0', end - p))) {
+				VIPS_FREE(argv);
+				break;
+			}
+
+			if (i < 0)
+				cwd = p;
+			else
+				argv[i] = (char *) p;
+			p = nul + 1;
+		}
+	}
+
+	fflush(stdout);
+	fflush(stderr);
+	for (int i = 0; i < 3; i++) {
+		saved[i] = dup(i);
+		dup2(fds[i], i);
+		close(fds[i]);
+	}
+
+	status = 1;
+	if (!argv)
+		fprintf(stderr, "%s: bad request\n", g_get_prgname());
+	else if (chdir(cwd))
+		fprintf(stderr, "%s: unable to change to \"%s\" -- %s\n",
+			g_get_prgname(), cwd, g_strerror(errno));
+	else {
+		vips_error_clear();
+		if (serve_operation(argc, argv))
+			fprintf(stderr, "%s", vips_error_buffer());
+		else
+			status = 0;
+		vips_error_clear();
+	}
+
+	fflush(stdout);
+	fflush(stderr);
+	for (int i = 0; i < 3; i++) {
+		dup2(saved[i], i);
+		close(saved[i]);
+	}
+	if (chdir(server_cwd))
+		g_warning("unable to change to \"%s\"", server_cwd);
+
+	g_free(argv);
+	g_byte_array_unref(request);
+
+	return write_all(conn, &status, 1);
+}
+
+static int
+serve(int argc, char **argv)
+{
+	struct sockaddr_un addr;
+	struct stat st;
+	char *server_cwd;
+	int fd;
+
+	if (argc != 1) {
+		vips_error("serve", "%s", _("usage: vips serve SOCKET"));
+		return -1;
+	}
+
+	if ((fd = socket_open(argv[0], &addr)) < 0) {
+		vips_error_system(errno, "serve",
+			_("unable to open \"%s\""), argv[0]);
+		return -1;
+	}
+
+	/* Remove a socket left by an earlier server, but nothing else.
+	 */
+	if (!lstat(argv[0], &st) &&
+		S_ISSOCK(st.st_mode))
+		(void) unlink(argv[0]);
+
+	if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) ||
+		listen(fd, 16)) {
+		vips_error_system(errno, "serve",
+			_("unable to listen on \"%s\""), argv[0]);
+		close(fd);
+		return -1;
+	}
+
+	/* Clients can go away at any time.
+	 */
+	signal(SIGPIPE, SIG_IGN);
+
+	/* Requests run one at a time, since each one swaps stdio and the
+	 * working directory. Operations are threaded as usual.
+	 */
+	server_cwd = g_get_current_dir();
+	for (;;) {
+		int conn;
+
+		if ((conn = accept(fd, NULL, NULL)) < 0) {
+			if (errno == EINTR)
+				continue;
+
+			vips_error_system(errno, "serve",
+				_("unable to accept on \"%s\""), argv[0]);
+			break;
+		}
+
+		(void) serve_request(conn, server_cwd);
+		close(conn);
+	}
+	g_free(server_cwd);
+	close(fd);
+
+	return -1;
+}
+#else  /*G_OS_WIN32*/
+static int
+serve(int argc, char **argv)
+{
+	vips_error("serve", "%s", _("not supported on this platform"));
+	return -1;
+}
+#endif /*!G_OS_WIN32*/
+
 static void
 print_vector_targets(const char *msg, gint64 targets)
 {
@@ -665,6 +1344,41 @@ main(int argc, char **argv)
 
 	GError *error = NULL;
 
+#ifndef G_OS_WIN32
+	/* Hand the command to a running "vips serve", if we can. This must
+	 * happen before VIPS_INIT(), since skipping startup is the point. If
+	 * there's no server, we run the command ourselves.
+	 */
+	if (argc > 1 &&
+		vips_isprefix("--connect", argv[1])) {
+		const char *path;
+		int skip;
+		int status;
+
+		if (vips_isprefix("--connect=", argv[1])) {
+			path = argv[1] + strlen("--connect=");
+			skip = 1;
+		}
+		else if (strcmp(argv[1], "--connect") == 0 &&
+			argc > 2) {
+			path = argv[2];
+			skip = 2;
+		}
+		else {
+			path = NULL;
+			skip = 0;
+		}
+
+		if (path &&
+			!connect_run(path, argc - 1 - skip, argv + 1 + skip, &status))
+			exit(status);
+
+		for (i = 1; i + skip <= argc; i++)
+			argv[i] = argv[i + skip];
+		argc -= skip;
+	}
+#endif /*!G_OS_WIN32*/
+
 	if (VIPS_INIT(argv[0]))
 		vips_error_exit(NULL);
 
@@ -781,6 +1495,17 @@ main(int argc, char **argv)
 #endif /*ENABLE_MODULES*/
 	}
 
+	if (main_option_connect) {
+		g_option_context_free(context);
+		vips_error_exit("%s", _("--connect must be the first argument"));
+	}
+
+	/* Metrics must be on before we build anything, so --explain can
+	 * show measured times.
+	 */
+	if (main_option_explain)
+		vips_metrics_set(TRUE);
+
 	if (main_option_targets) {
 #ifndef HAVE_ORC
 		print_vector_targets("builtin targets:  ",
@@ -908,6 +1633,10 @@ main(int argc, char **argv)
 				vips_error_exit(NULL);
 		}
 
+		if (main_option_explain)
+			(void) vips_argument_map(VIPS_OBJECT(operation),
+				explain_output, NULL, NULL);
+
 		vips_object_unref_outputs(VIPS_OBJECT(operation));
 		g_object_unref(operation);
 
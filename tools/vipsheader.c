@@ -40,6 +40,8 @@
  * 	- convert to vips8 API
  * 29/6/20
  * 	- allow "stdin" as a filename
+ * 15/10/26
+ * 	- add --jobs, probe many files at once
  */
 
 /*
@@ -84,6 +86,7 @@
 
 static GSList *main_option_fields = NULL;
 static gboolean main_option_all = FALSE;
+static int main_option_jobs = 0;
 static gboolean version = FALSE;
 
 static gboolean
@@ -105,6 +108,9 @@ static GOptionEntry main_option[] = {
 		N_("print value of FIELD (\"getext\" reads extension block, "
 		   "\"Hist\" reads image history)"),
 		"FIELD" },
+	{ "jobs", 'j', 0, G_OPTION_ARG_INT, &main_option_jobs,
+		N_("probe N files at once"),
+		"N" },
 	{ "version", 'v', 0, G_OPTION_ARG_NONE, &version,
 		N_("print version"), NULL },
 	{ NULL }
@@ -186,6 +192,40 @@ print_header(VipsImage *image, gboolean many)
 	return 0;
 }
 
+/* Probe all the files at once and print a summary of each, in order.
+ */
+static int
+print_probe(char **names, int n)
+{
+	VipsForeignProbe *probe;
+	int result;
+
+	probe = VIPS_ARRAY(NULL, n, VipsForeignProbe);
+	result = vips_foreign_probe((const char **) names, n,
+		probe, main_option_jobs);
+
+	for (int i = 0; i < n; i++) {
+		if (probe[i].result)
+			continue;
+
+		printf("%s: %dx%d ", names[i], probe[i].width, probe[i].height);
+		printf(g_dngettext(GETTEXT_PACKAGE,
+				   "%s, %d band", "%s, %d bands", probe[i].bands),
+			vips_enum_nick(VIPS_TYPE_BAND_FORMAT, probe[i].format),
+			probe[i].bands);
+		if (probe[i].loader)
+			printf(", %s", probe[i].loader);
+		printf(g_dngettext(GETTEXT_PACKAGE,
+				   ", %d page", ", %d pages", probe[i].n_pages),
+			probe[i].n_pages);
+		printf(", orientation %d\n", probe[i].orientation);
+	}
+
+	g_free(probe);
+
+	return result;
+}
+
 int
 main(int argc, char *argv[])
 {
@@ -194,6 +234,7 @@ main(int argc, char *argv[])
 	GError *error = NULL;
 	int i;
 	int result;
+	gboolean probed;
 
 	if (VIPS_INIT(argv[0]))
 		vips_error_exit("unable to start VIPS");
@@ -245,8 +286,27 @@ main(int argc, char *argv[])
 		printf("vips-%s\n", vips_version_string());
 
 	result = 0;
+	probed = FALSE;
+
+	/* Plain summaries of a set of files can use the batch probe. Fields,
+	 * --all and stdin need the image itself, so run one at a time.
+	 */
+	if (main_option_jobs > 1 &&
+		!main_option_fields &&
+		!main_option_all) {
+		for (i = 1; argv[i]; i++)
+			if (g_str_equal(argv[i], "stdin"))
+				break;
+
+		if (!argv[i] &&
+			i > 1) {
+			if (print_probe(argv + 1, i - 1))
+				result = 1;
+			probed = TRUE;
+		}
+	}
 
-	for (i = 1; argv[i]; i++) {
+	for (i = 1; !probed && argv[i]; i++) {
 		VipsImage *image = NULL;
 		char filename[VIPS_PATH_MAX];
 		char option_string[VIPS_PATH_MAX];
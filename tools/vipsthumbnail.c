@@ -109,6 +109,10 @@
  *  - rename import/export profile args as input/oputput
  * 13/6/26
  *	- add @ specifier
+ * 14/10/26
+ *	- add --batch
+ * 15/10/26
+ *	- add --jobs, share a global worker budget between images
  */
 
 #ifdef HAVE_CONFIG_H
@@ -155,6 +159,7 @@ static gboolean verbose = FALSE;
 static char *convolution_mask = NULL;
 static char *interpolator = NULL;
 static gboolean rotate_image = FALSE;
+static int batch_jobs = 0;
 
 static GOptionEntry options[] = {
 	{ "size", 's', 0,
@@ -190,6 +195,14 @@ static GOptionEntry options[] = {
 	{ "no-rotate", 0, 0,
 		G_OPTION_ARG_NONE, &no_rotate_image,
 		N_("don't auto-rotate"), NULL },
+	{ "batch", 0, 0,
+		G_OPTION_ARG_INT, &batch_jobs,
+		N_("thumbnail N images at once, read names from stdin if none given"),
+		N_("N") },
+	{ "jobs", 'j', 0,
+		G_OPTION_ARG_INT, &batch_jobs,
+		N_("same as --batch"),
+		N_("N") },
 	{ "version", 'v', 0, G_OPTION_ARG_NONE, &version,
 		N_("print version"), NULL },
 
@@ -334,17 +347,17 @@ thumbnail_write_file(VipsObject *process, VipsImage *im, const char *filename)
 	return 0;
 }
 
+/* Several images can be in flight in batch mode, so the size is per image.
+ */
 static void
-thumbnail_set_size(VipsImage *image)
+thumbnail_set_size(VipsImage *image, int *width, int *height)
 {
 	if (target_pixels > 0) {
 		gint64 source_pixels = (gint64) image->Xsize * image->Ysize;
 		double shrink_factor = sqrt((double) source_pixels / target_pixels);
 
-		thumbnail_width =
-			VIPS_CLIP(1, image->Xsize / shrink_factor, VIPS_MAX_COORD);
-		thumbnail_height =
-			VIPS_CLIP(1, image->Ysize / shrink_factor, VIPS_MAX_COORD);
+		*width = VIPS_CLIP(1, image->Xsize / shrink_factor, VIPS_MAX_COORD);
+		*height = VIPS_CLIP(1, image->Ysize / shrink_factor, VIPS_MAX_COORD);
 	}
 }
 
@@ -356,6 +369,8 @@ thumbnail_process(VipsObject *process, const char *name)
 	VipsIntent intent;
 	char filename[VIPS_PATH_MAX];
 	char option_string[VIPS_PATH_MAX];
+	int width = thumbnail_width;
+	int height = thumbnail_height;
 
 	interesting = VIPS_INTERESTING_NONE;
 	if (crop_image)
@@ -390,13 +405,13 @@ thumbnail_process(VipsObject *process, const char *name)
 			VipsImage *plain;
 			if (!(plain = vips_image_new_from_source(source, "", NULL)))
 				return -1;
-			thumbnail_set_size(plain);
+			thumbnail_set_size(plain, &width, &height);
 			VIPS_UNREF(plain);
 		}
 
-		if (vips_thumbnail_source(source, &image, thumbnail_width,
+		if (vips_thumbnail_source(source, &image, width,
 				"option-string", option_string,
-				"height", thumbnail_height,
+				"height", height,
 				"size", size_restriction,
 				"no-rotate", no_rotate_image,
 				"crop", interesting,
@@ -415,12 +430,12 @@ thumbnail_process(VipsObject *process, const char *name)
 			VipsImage *plain;
 			if (!(plain = vips_image_new_from_file(filename, NULL)))
 				return -1;
-			thumbnail_set_size(plain);
+			thumbnail_set_size(plain, &width, &height);
 			VIPS_UNREF(plain);
 		}
 
-		if (vips_thumbnail(name, &image, thumbnail_width,
-				"height", thumbnail_height,
+		if (vips_thumbnail(name, &image, width,
+				"height", height,
 				"size", size_restriction,
 				"no-rotate", no_rotate_image,
 				"crop", interesting,
@@ -578,6 +593,103 @@ thumbnail_parse_geometry(const char *geometry)
 	return 0;
 }
 
+/* Thumbnail one image, and report any error.
+ */
+static int
+thumbnail_run(const char *prgname, const char *name)
+{
+	static GMutex report_lock;
+
+	/* Hang resources for processing this thumbnail off @process.
+	 */
+	VipsObject *process = VIPS_OBJECT(vips_image_new());
+
+	int result;
+
+	result = 0;
+	if (thumbnail_process(process, name)) {
+		g_mutex_lock(&report_lock);
+		fprintf(stderr, "%s: unable to thumbnail %s\n", prgname, name);
+		fprintf(stderr, "%s", vips_error_buffer());
+		vips_error_clear();
+		g_mutex_unlock(&report_lock);
+
+		result = -1;
+	}
+
+	g_object_unref(process);
+
+	return result;
+}
+
+typedef struct _ThumbnailBatch {
+	const char *prgname;
+
+	/* Set if any thumbnail fails.
+	 */
+	gint failed;
+} ThumbnailBatch;
+
+static void
+thumbnail_batch_work(gpointer data, gpointer user_data)
+{
+	char *name = (char *) data;
+	ThumbnailBatch *batch = (ThumbnailBatch *) user_data;
+
+	if (thumbnail_run(batch->prgname, name))
+		g_atomic_int_set(&batch->failed, 1);
+
+	g_free(name);
+}
+
+/* Run batch_jobs thumbnails at once. Worker threads are reused, so
+ * per-thread state in libvips stays warm from one image to the next.
+ *
+ * The scheduler caps the number of running workers across all pipelines at
+ * the concurrency setting. Each pipeline gets twice its fair share of
+ * threads, so while some images are stuck in a serial step, like header
+ * parsing or PNG decode, the others can use the idle cores.
+ */
+static int
+thumbnail_batch(const char *prgname, char **names)
+{
+	ThumbnailBatch batch = { prgname, 0 };
+	GError *error = NULL;
+	GThreadPool *pool;
+	int concurrency;
+
+	concurrency = vips_concurrency_get();
+	if (!vips_scheduler_get_max())
+		vips_scheduler_set_max(concurrency);
+	vips_concurrency_set(VIPS_CLIP(1,
+		2 * concurrency / batch_jobs, concurrency));
+
+	if (!(pool = g_thread_pool_new(thumbnail_batch_work, &batch,
+			  batch_jobs, FALSE, &error))) {
+		vips_g_error(&error);
+		return -1;
+	}
+
+	if (names[0])
+		for (int i = 0; names[i]; i++)
+			g_thread_pool_push(pool, g_strdup(names[i]), NULL);
+	else {
+		/* No names on the command-line, read one per line from stdin.
+		 */
+		char line[VIPS_PATH_MAX];
+
+		while (fgets(line, VIPS_PATH_MAX, stdin)) {
+			g_strchomp(line);
+			if (line[0])
+				g_thread_pool_push(pool, g_strdup(line), NULL);
+		}
+	}
+
+	g_thread_pool_free(pool, FALSE, TRUE);
+
+	return batch.failed ? -1 : 0;
+}
+
 int
 main(int argc, char **argv)
 {
@@ -649,25 +761,21 @@ main(int argc, char **argv)
 
 	result = 0;
 
-	for (i = 1; argv[i]; i++) {
-		/* Hang resources for processing this thumbnail off @process.
-		 */
-		VipsObject *process = VIPS_OBJECT(vips_image_new());
-
-		if (thumbnail_process(process, argv[i])) {
-			fprintf(stderr, "%s: unable to thumbnail %s\n",
-				argv[0], argv[i]);
-			fprintf(stderr, "%s", vips_error_buffer());
-			vips_error_clear();
+	if (batch_jobs > 0) {
+		if (thumbnail_output_format())
+			vips_error_exit("%s",
+				_("--batch and --jobs can't write to stdout"));
 
+		if (thumbnail_batch(argv[0], argv + 1))
+			result = -1;
+	}
+	else
+		for (i = 1; argv[i]; i++)
 			/* We had a conversion failure: return an error code
 			 * when we finally exit.
 			 */
-			result = -1;
-		}
-
-		g_object_unref(process);
-	}
+			if (thumbnail_run(argv[0], argv[i]))
+				result = -1;
 
 	/* We don't free this on error exit, sadly.
 	 */